@@ -29,7 +29,11 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/file.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "tapdisk.h"
 #include "tapdisk-utils.h"
@@ -58,6 +62,18 @@
 #define BLOCK_CACHE_REQUESTS            (TAPDISK_DATA_REQUESTS << 3)
 #define BLOCK_CACHE_PAGE_IDLETIME       60
 
+/*
+ * if TAPDISK_SHARED_CACHE_MB is set, parent reads are cached in a shared
+ * memory segment of that size instead, which every tapdisk on the host
+ * reading the same parent image attaches to. the segment is named after
+ * the device, inode and mtime of the image, so a replaced image never
+ * hits stale data. the first tapdisk to attach decides its size.
+ */
+#define BLOCK_CACHE_SHM_ENV             "TAPDISK_SHARED_CACHE_MB"
+#define BLOCK_CACHE_SHM_MAGIC           0x62637368 /* "bcsh" */
+#define BLOCK_CACHE_SHM_WAYS            8
+#define BLOCK_CACHE_SHM_SECS            (RADIX_TREE_PAGE_SIZE >> RADIX_TREE_NODE_SHIFT)
+
 typedef struct radix_tree               radix_tree_t;
 typedef struct radix_tree_node          radix_tree_node_t;
 typedef struct radix_tree_link          radix_tree_link_t;
@@ -67,6 +83,8 @@ typedef struct radix_tree_page          radix_tree_page_t;
 typedef struct block_cache              block_cache_t;
 typedef struct block_cache_request      block_cache_request_t;
 typedef struct block_cache_stats        block_cache_stats_t;
+typedef struct block_cache_shm          block_cache_shm_t;
+typedef struct block_cache_shm_slot     block_cache_shm_slot_t;
 
 struct radix_tree_page {
 	char                           *buf;
@@ -102,10 +120,28 @@ struct radix_tree {
 	block_cache_t                  *cache;
 };
 
+/*
+ * header of the shared segment, followed by nr_sets * WAYS slots and
+ * then the page each slot caches. all of it is accessed under flock().
+ */
+struct block_cache_shm {
+	uint32_t                        magic;
+	uint32_t                        users;
+	uint32_t                        nr_sets;
+	uint32_t                        pad;
+	uint64_t                        clock;
+};
+
+struct block_cache_shm_slot {
+	uint64_t                        page; /* page index + 1, 0 if free */
+	uint64_t                        used;
+};
+
 struct block_cache_request {
 	int                             err;
 	char                           *buf;
 	uint64_t                        secs;
+	uint64_t                        page;
 	td_request_t                    treq;
 	block_cache_t                  *cache;
 };
@@ -131,6 +167,13 @@ struct block_cache {
 
 	radix_tree_t                    tree;
 
+	char                           *shm_name;
+	int                             shm_fd;
+	size_t                          shm_size;
+	block_cache_shm_t              *shm;
+	block_cache_shm_slot_t         *shm_slots;
+	char                           *shm_pages;
+
 	block_cache_stats_t             stats;
 };
 
@@ -516,6 +559,230 @@ block_cache_put_request(block_cache_t *cache, block_cache_request_t *breq)
 	cache->request_free_list[cache->requests_free++] = breq;
 }
 
+static inline size_t
+block_cache_shm_size(uint32_t nr_sets)
+{
+	size_t slots, meta;
+
+	slots = (size_t)nr_sets * BLOCK_CACHE_SHM_WAYS;
+	meta  = sizeof(block_cache_shm_t) +
+		slots * sizeof(block_cache_shm_slot_t);
+	meta  = (meta + RADIX_TREE_PAGE_SIZE - 1) &
+		~((size_t)RADIX_TREE_PAGE_SIZE - 1);
+
+	return meta + slots * RADIX_TREE_PAGE_SIZE;
+}
+
+static void
+block_cache_shm_release(block_cache_t *cache)
+{
+	if (cache->shm)
+		munmap(cache->shm, cache->shm_size);
+	if (cache->shm_fd != -1)
+		close(cache->shm_fd);
+	free(cache->shm_name);
+
+	cache->shm      = NULL;
+	cache->shm_fd   = -1;
+	cache->shm_name = NULL;
+}
+
+static int
+block_cache_shm_open(block_cache_t *cache)
+{
+	int err;
+	char *env;
+	struct stat st;
+	uint64_t size;
+	uint32_t nr_sets;
+	block_cache_shm_t *shm;
+
+	env = getenv(BLOCK_CACHE_SHM_ENV);
+	if (!env)
+		return 0;
+
+	size    = strtoull(env, NULL, 0) << 20;
+	nr_sets = size / (BLOCK_CACHE_SHM_WAYS *
+			  (RADIX_TREE_PAGE_SIZE + sizeof(block_cache_shm_slot_t)));
+	if (!nr_sets)
+		return 0;
+
+	if (stat(cache->name, &st))
+		return -errno;
+
+	if (asprintf(&cache->shm_name, "/tapdisk-cache-%llx-%llx-%llx",
+		     (unsigned long long)st.st_dev,
+		     (unsigned long long)st.st_ino,
+		     (unsigned long long)st.st_mtime) == -1) {
+		cache->shm_name = NULL;
+		return -ENOMEM;
+	}
+
+	cache->shm_fd = shm_open(cache->shm_name, O_CREAT | O_RDWR, 0600);
+	if (cache->shm_fd == -1) {
+		err = -errno;
+		goto fail;
+	}
+
+	/* serializes creation against other tapdisks attaching */
+	if (flock(cache->shm_fd, LOCK_EX)) {
+		err = -errno;
+		goto fail;
+	}
+
+	if (fstat(cache->shm_fd, &st)) {
+		err = -errno;
+		goto out;
+	}
+
+	cache->shm_size = st.st_size;
+	if (!cache->shm_size) {
+		cache->shm_size = block_cache_shm_size(nr_sets);
+		if (ftruncate(cache->shm_fd, cache->shm_size)) {
+			err = -errno;
+			goto out;
+		}
+	}
+
+	shm = mmap(NULL, cache->shm_size, PROT_READ | PROT_WRITE,
+		   MAP_SHARED, cache->shm_fd, 0);
+	if (shm == MAP_FAILED) {
+		err = -errno;
+		goto out;
+	}
+	cache->shm = shm;
+
+	if (!st.st_size) {
+		/* ftruncate() left every slot free */
+		shm->magic   = BLOCK_CACHE_SHM_MAGIC;
+		shm->nr_sets = nr_sets;
+	} else if (shm->magic != BLOCK_CACHE_SHM_MAGIC ||
+		   block_cache_shm_size(shm->nr_sets) != cache->shm_size) {
+		err = -EINVAL;
+		goto out;
+	}
+
+	shm->users++;
+	cache->shm_slots = (block_cache_shm_slot_t *)(shm + 1);
+	cache->shm_pages = (char *)shm + cache->shm_size -
+		(size_t)shm->nr_sets * BLOCK_CACHE_SHM_WAYS * RADIX_TREE_PAGE_SIZE;
+	err = 0;
+
+	DPRINTF("%s: shared cache %s, %zu bytes, %u users\n",
+		cache->name, cache->shm_name, cache->shm_size, shm->users);
+
+out:
+	flock(cache->shm_fd, LOCK_UN);
+fail:
+	if (err)
+		block_cache_shm_release(cache);
+	return err;
+}
+
+static void
+block_cache_shm_close(block_cache_t *cache)
+{
+	if (!cache->shm)
+		return;
+
+	flock(cache->shm_fd, LOCK_EX);
+	if (!--cache->shm->users)
+		shm_unlink(cache->shm_name);
+	flock(cache->shm_fd, LOCK_UN);
+
+	block_cache_shm_release(cache);
+}
+
+static block_cache_shm_slot_t *
+block_cache_shm_find(block_cache_t *cache, uint64_t page)
+{
+	int i;
+	block_cache_shm_slot_t *set;
+
+	set = cache->shm_slots +
+		(page % cache->shm->nr_sets) * BLOCK_CACHE_SHM_WAYS;
+
+	for (i = 0; i < BLOCK_CACHE_SHM_WAYS; i++)
+		if (set[i].page == page + 1)
+			return set + i;
+
+	return NULL;
+}
+
+static inline char *
+block_cache_shm_page(block_cache_t *cache, block_cache_shm_slot_t *slot)
+{
+	return cache->shm_pages +
+		(slot - cache->shm_slots) * RADIX_TREE_PAGE_SIZE;
+}
+
+/*
+ * copies @treq, which must lie within one page, out of the shared cache.
+ * returns 0 on a hit.
+ */
+static int
+block_cache_shm_read(block_cache_t *cache, td_request_t treq)
+{
+	off_t off;
+	block_cache_shm_slot_t *slot;
+
+	if (flock(cache->shm_fd, LOCK_EX))
+		return -errno;
+
+	slot = block_cache_shm_find(cache, treq.sec / BLOCK_CACHE_SHM_SECS);
+	if (slot) {
+		slot->used = ++cache->shm->clock;
+		off = (treq.sec % BLOCK_CACHE_SHM_SECS) << RADIX_TREE_NODE_SHIFT;
+		memcpy(treq.buf, block_cache_shm_page(cache, slot) + off,
+		       treq.secs << RADIX_TREE_NODE_SHIFT);
+	}
+
+	flock(cache->shm_fd, LOCK_UN);
+
+	return (slot ? 0 : -ENOENT);
+}
+
+/*
+ * insert a page read from the parent, replacing the least recently
+ * used page of its set if the set is full.
+ */
+static void
+block_cache_shm_insert(block_cache_t *cache, uint64_t page, char *buf)
+{
+	int i;
+	block_cache_shm_slot_t *set, *slot;
+
+	if (flock(cache->shm_fd, LOCK_EX))
+		return;
+
+	/* another tapdisk may have cached it in the meantime */
+	if (block_cache_shm_find(cache, page))
+		goto out;
+
+	set  = cache->shm_slots +
+		(page % cache->shm->nr_sets) * BLOCK_CACHE_SHM_WAYS;
+	slot = set;
+
+	for (i = 0; i < BLOCK_CACHE_SHM_WAYS; i++) {
+		if (!set[i].page) {
+			slot = set + i;
+			break;
+		}
+		if (set[i].used < slot->used)
+			slot = set + i;
+	}
+
+	if (slot->page)
+		cache->stats.prunes += BLOCK_CACHE_SHM_SECS;
+
+	slot->page = page + 1;
+	slot->used = ++cache->shm->clock;
+	memcpy(block_cache_shm_page(cache, slot), buf, RADIX_TREE_PAGE_SIZE);
+
+out:
+	flock(cache->shm_fd, LOCK_UN);
+}
+
 static int
 block_cache_open(td_driver_t *driver, const char *name, td_flag_t flags)
 {
@@ -530,6 +797,8 @@ block_cache_open(td_driver_t *driver, const char *name, td_flag_t flags)
 		return -EINVAL;
 
 	cache = (block_cache_t *)driver->data;
+	cache->shm_fd = -1;
+
 	err   = tapdisk_namedup(&cache->name, (char *)name);
 	if (err)
 		return -ENOMEM;
@@ -554,6 +823,11 @@ block_cache_open(td_driver_t *driver, const char *name, td_flag_t flags)
 	if (cache->timeout_id < 0)
 		goto fail;
 
+	err = block_cache_shm_open(cache);
+	if (err)
+		DPRINTF("%s: no shared cache: %d, caching privately\n",
+			cache->name, err);
+
 	DPRINTF("opening cache for %s, sectors: %"PRIu64", "
 		"tree: %p, height: %d\n",
 		cache->name, cache->sectors, tree, tree->height);
@@ -581,6 +855,7 @@ block_cache_close(td_driver_t *driver)
 	DPRINTF("closing cache for %s\n", cache->name);
 
 	tapdisk_server_unregister_event(cache->timeout_id);
+	block_cache_shm_close(cache);
 	radix_tree_free(tree);
 	free(cache->name);
 
@@ -706,6 +981,93 @@ out:
 	td_forward_request(clone);
 }
 
+static void
+block_cache_shm_populate(td_request_t clone, int err)
+{
+	off_t off;
+	block_cache_t *cache;
+	block_cache_request_t *breq;
+
+	breq        = (block_cache_request_t *)clone.cb_data;
+	cache       = breq->cache;
+	breq->secs -= clone.secs;
+	breq->err   = (breq->err ? breq->err : err);
+
+	if (breq->secs)
+		return;
+
+	if (!breq->err) {
+		off = (breq->treq.sec % BLOCK_CACHE_SHM_SECS) <<
+			RADIX_TREE_NODE_SHIFT;
+		memcpy(breq->treq.buf, breq->buf + off,
+		       breq->treq.secs << RADIX_TREE_NODE_SHIFT);
+		block_cache_shm_insert(cache, breq->page, breq->buf);
+	}
+
+	free(breq->buf);
+	td_complete_request(breq->treq, breq->err);
+	block_cache_put_request(cache, breq);
+}
+
+/*
+ * on a miss, the whole page containing @treq is read from the parent
+ * so it can be shared.
+ */
+static void
+block_cache_shm_miss(block_cache_t *cache, td_request_t treq, uint64_t page)
+{
+	char *buf;
+	td_request_t clone;
+	block_cache_request_t *breq;
+
+	cache->stats.misses += treq.secs;
+
+	breq = block_cache_get_request(cache);
+	if (!breq)
+		return td_forward_request(treq);
+
+	if (posix_memalign((void **)&buf,
+			   RADIX_TREE_NODE_SIZE, RADIX_TREE_PAGE_SIZE)) {
+		block_cache_put_request(cache, breq);
+		return td_forward_request(treq);
+	}
+
+	breq->treq    = treq;
+	breq->secs    = BLOCK_CACHE_SHM_SECS;
+	breq->page    = page;
+	breq->err     = 0;
+	breq->buf     = buf;
+	breq->cache   = cache;
+
+	clone         = treq;
+	clone.sec     = page * BLOCK_CACHE_SHM_SECS;
+	clone.secs    = BLOCK_CACHE_SHM_SECS;
+	clone.buf     = buf;
+	clone.cb      = block_cache_shm_populate;
+	clone.cb_data = breq;
+
+	td_forward_request(clone);
+}
+
+static void
+block_cache_shm_queue_read(block_cache_t *cache, td_request_t treq)
+{
+	uint64_t page;
+
+	page = treq.sec / BLOCK_CACHE_SHM_SECS;
+
+	/* only requests within one whole page of the image are cached */
+	if ((treq.sec + treq.secs - 1) / BLOCK_CACHE_SHM_SECS != page ||
+	    (page + 1) * BLOCK_CACHE_SHM_SECS > cache->sectors)
+		return td_forward_request(treq);
+
+	if (block_cache_shm_read(cache, treq))
+		return block_cache_shm_miss(cache, treq, page);
+
+	cache->stats.hits += treq.secs;
+	td_complete_request(treq, 0);
+}
+
 static void
 block_cache_queue_read(td_driver_t *driver, td_request_t treq)
 {
@@ -719,6 +1081,9 @@ block_cache_queue_read(td_driver_t *driver, td_request_t treq)
 
 	cache->stats.reads += treq.secs;
 
+	if (cache->shm)
+		return block_cache_shm_queue_read(cache, treq);
+
 	if (treq.secs > BLOCK_CACHE_NODES_PER_PAGE)
 		return td_forward_request(treq);
 
@@ -771,6 +1136,9 @@ block_cache_debug(td_driver_t *driver)
 	WARN("BLOCK CACHE %s\n", cache->name);
 	WARN("reads: %"PRIu64", hits: %"PRIu64", misses: %"PRIu64", prunes: %"PRIu64"\n",
 	     stats->reads, stats->hits, stats->misses, stats->prunes);
+	if (cache->shm)
+		WARN("shared cache %s: %zu bytes, %u users\n",
+		     cache->shm_name, cache->shm_size, cache->shm->users);
 }
 
 struct tap_disk tapdisk_block_cache = {
@@ -3,12 +3,12 @@
  * This disk sends all writes to a backup via a network interface before
  * passing them to an underlying device.
  * The backup is a bit more complicated:
- *  1. It applies all incoming writes to a ramdisk.
- *  2. When a checkpoint request arrives, it moves the ramdisk to
- *     a committing state and uses a new ramdisk for subsequent writes.
+ *  1. It appends all incoming writes to the log of the current epoch.
+ *  2. When a checkpoint request arrives, it commits the epoch, moving its
+ *     writes to the end of the ramdisk log, and starts a new one.
  *     It also acknowledges the request, to let the sender know it can
  *     release output.
- *  3. The ramdisk flushes its contents to the underlying driver.
+ *  3. The ramdisk writes out its log to the underlying driver, in order.
  *  4. At failover, the backup waits for the in-flight ramdisk (if any) to
  *     drain before letting the domain be activated.
  *
@@ -37,9 +37,6 @@
 #include "tapdisk-server.h"
 #include "tapdisk-driver.h"
 #include "tapdisk-interface.h"
-#include "hashtable.h"
-#include "hashtable_itr.h"
-#include "hashtable_utility.h"
 
 #include <errno.h>
 #include <inttypes.h>
@@ -98,28 +95,40 @@ td_vbd_t *device_vbd = NULL;
 td_image_t *remus_image = NULL;
 struct tap_disk tapdisk_remus;
 
+/* A write received from the primary, as kept in the backup's log */
+struct ramdisk_write {
+	struct list_head next;
+	struct tdremus_state *state;
+	uint64_t sector;
+	int nb_sectors;
+	char *buf;
+};
+
+/* The backup appends every write it receives to the current epoch. A commit
+ * request closes the epoch: its writes are moved onto the end of the log in
+ * one go, and from there forwarded to the underlying driver in the order
+ * they were made. Committing therefore costs the same however much was
+ * written, and the writes of an epoch start reaching the disk while the next
+ * one is still being received. Adjacent writes get merged by the tapdisk
+ * queue again on their way down.
+ *
+ * A logged write overlapping one in flight is held back until that one
+ * completes, as the disk gives no guarantee which of two overlapping
+ * requests in its queue is written first. Everything logged after it is held
+ * back as well, to keep the order.
+ */
+#define RAMDISK_MAX_INFLIGHT 128
+
 struct ramdisk {
 	size_t sector_size;
-	struct hashtable* h;
-	/* when a ramdisk is flushed, h is given a new empty hash for writes
-	 * while the old ramdisk (prev) is drained asynchronously.
-	 */
-	struct hashtable* prev;
-	/* count of outstanding requests to the base driver */
+	/* written since the last commit request */
+	struct list_head epoch;
+	/* committed, not forwarded yet */
+	struct list_head log;
+	/* forwarded to the base driver, not completed */
+	struct list_head inprogress;
 	size_t inflight;
-	/* prev holds the requests to be flushed, while inprogress holds
-	 * requests being flushed. When requests complete, they are removed
-	 * from inprogress.
-	 * Whenever a new flush is merged with ongoing flush (i.e, prev),
-	 * we have to make sure that none of the new requests overlap with
-	 * ones in "inprogress". If it does, keep it back in prev and dont issue
-	 * IO until the current one finishes. If we allow this IO to proceed,
-	 * we might end up with two "overlapping" requests in the disk's queue and
-	 * the disk may not offer any guarantee on which one is written first.
-	 * IOW, make sure we dont create a write-after-write time ordering constraint.
-	 * 
-	 */
-	struct hashtable* inprogress;
+	int flushing;
 };
 
 /* the ramdisk intercepts the original callback for reads and writes.
@@ -233,13 +242,28 @@ static int ramdisk_flush(td_driver_t *driver, struct tdremus_state* s);
 
 /* functions to create and sumbit treq's */
 
+static void ramdisk_free_write(struct ramdisk_write *w)
+{
+	free(w->buf);
+	free(w);
+}
+
+static void ramdisk_free_list(struct list_head *head)
+{
+	struct ramdisk_write *w, *tmp;
+
+	list_for_each_entry_safe(w, tmp, head, next) {
+		list_del(&w->next);
+		ramdisk_free_write(w);
+	}
+}
+
 static void
 replicated_write_callback(td_request_t treq, int err)
 {
-	struct tdremus_state *s = (struct tdremus_state *) treq.cb_data;
+	struct ramdisk_write *w = (struct ramdisk_write *) treq.cb_data;
+	struct tdremus_state *s = w->state;
 	td_vbd_request_t *vreq;
-	int i;
-	uint64_t start;
 	vreq = (td_vbd_request_t *) treq.private;
 
 	/* the write failed for now, lets panic. this is very bad */
@@ -253,32 +277,27 @@ replicated_write_callback(td_request_t treq, int err)
 	list_del(&vreq->next);
 	free(vreq);
 
+	list_del(&w->next);
+	ramdisk_free_write(w);
 	s->ramdisk.inflight--;
-	start = treq.sec;
-	for (i = 0; i < treq.secs; i++) {
-		hashtable_remove(s->ramdisk.inprogress, &start);
-		start++;
-	}
-	free(treq.buf);
 
-	if (!s->ramdisk.inflight && !s->ramdisk.prev) {
-		/* TODO: the ramdisk has been flushed */
-	}
+	/* this may have been what the head of the log was waiting for */
+	ramdisk_flush(s->tdremus_driver, s);
 }
 
 static inline int
-create_write_request(struct tdremus_state *state, td_sector_t sec, int secs, char *buf)
+create_write_request(struct tdremus_state *state, struct ramdisk_write *w)
 {
 	td_request_t treq;
 	td_vbd_request_t *vreq;
 
 	treq.op      = TD_OP_WRITE;
-	treq.buf     = buf;
-	treq.sec     = sec;
-	treq.secs    = secs;
+	treq.buf     = w->buf;
+	treq.sec     = w->sector;
+	treq.secs    = w->nb_sectors;
 	treq.image   = remus_image;
 	treq.cb      = replicated_write_callback;
-	treq.cb_data = state;
+	treq.cb_data = w;
 	treq.id      = 0;
 	treq.sidx    = 0;
 
@@ -301,314 +320,141 @@ create_write_request(struct tdremus_state *state, td_sector_t sec, int secs, cha
 	return 0;
 }
 
-
-/* http://www.concentric.net/~Ttwang/tech/inthash.htm */
-static unsigned int uint64_hash(void* k)
-{
-	uint64_t key = *(uint64_t*)k;
-
-	key = (~key) + (key << 18);
-	key = key ^ (key >> 31);
-	key = key * 21;
-	key = key ^ (key >> 11);
-	key = key + (key << 6);
-	key = key ^ (key >> 22);
-
-	return (unsigned int)key;
-}
-
-static int rd_hash_equal(void* k1, void* k2)
+static inline int ramdisk_overlap(const struct ramdisk_write *w,
+				  uint64_t sector, int nb_sectors)
 {
-	uint64_t key1, key2;
-
-	key1 = *(uint64_t*)k1;
-	key2 = *(uint64_t*)k2;
-
-	return key1 == key2;
+	return w->sector < sector + nb_sectors &&
+		sector < w->sector + w->nb_sectors;
 }
 
+/* Copy the committed contents of the sectors into buf, newest write winning.
+ * Returns -1 unless all of them are found. */
 static int ramdisk_read(struct ramdisk* ramdisk, uint64_t sector,
 			int nb_sectors, char* buf)
 {
-	int i;
-	char* v;
-	uint64_t key;
-
-	for (i = 0; i < nb_sectors; i++) {
-		key = sector + i;
-		/* check whether it is queued in a previous flush request */
-		if (!(ramdisk->prev && (v = hashtable_search(ramdisk->prev, &key)))) {
-			/* check whether it is an ongoing flush */
-			if (!(ramdisk->inprogress && (v = hashtable_search(ramdisk->inprogress, &key))))
-				return -1;
-		}
-		memcpy(buf + i * ramdisk->sector_size, v, ramdisk->sector_size);
-	}
-
-	return 0;
-}
-
-static int ramdisk_write_hash(struct hashtable* h, uint64_t sector, char* buf,
-			      size_t len)
-{
-	char* v;
-	uint64_t* key;
-
-	if ((v = hashtable_search(h, &sector))) {
-		memcpy(v, buf, len);
-		return 0;
-	}
+	struct list_head *lists[] = { &ramdisk->inprogress, &ramdisk->log };
+	struct ramdisk_write *w;
+	uint64_t first, last, i;
+	char *found;
+	int l, missing = nb_sectors;
 
-	if (!(v = malloc(len))) {
-		DPRINTF("ramdisk_write_hash: malloc failed\n");
-		return -1;
-	}
-	memcpy(v, buf, len);
-	if (!(key = malloc(sizeof(*key)))) {
-		DPRINTF("ramdisk_write_hash: error allocating key\n");
-		free(v);
+	if (list_empty(&ramdisk->inprogress) && list_empty(&ramdisk->log))
 		return -1;
-	}
-	*key = sector;
-	if (!hashtable_insert(h, key, v)) {
-		DPRINTF("ramdisk_write_hash failed on sector %" PRIu64 "\n", sector);
-		free(key);
-		free(v);
-		return -1;
-	}
 
-	return 0;
-}
+	if (!(found = calloc(nb_sectors, 1)))
+		return -1;
 
-static inline int ramdisk_write(struct ramdisk* ramdisk, uint64_t sector,
-				int nb_sectors, char* buf)
-{
-	int i, rc;
-
-	for (i = 0; i < nb_sectors; i++) {
-		rc = ramdisk_write_hash(ramdisk->h, sector + i,
-					buf + i * ramdisk->sector_size,
-					ramdisk->sector_size);
-		if (rc)
-			return rc;
+	/* in flight writes are older than the ones still in the log */
+	for (l = 0; l < 2; l++) {
+		list_for_each_entry(w, lists[l], next) {
+			if (!ramdisk_overlap(w, sector, nb_sectors))
+				continue;
+
+			first = MAX(w->sector, sector);
+			last = MIN(w->sector + w->nb_sectors, sector + nb_sectors);
+			for (i = first; i < last; i++) {
+				if (!found[i - sector]) {
+					found[i - sector] = 1;
+					missing--;
+				}
+				memcpy(buf + (i - sector) * ramdisk->sector_size,
+				       w->buf + (i - w->sector) * ramdisk->sector_size,
+				       ramdisk->sector_size);
+			}
+		}
 	}
 
-	return 0;
-}
-
-static int uint64_compare(const void* k1, const void* k2)
-{
-	uint64_t u1 = *(uint64_t*)k1;
-	uint64_t u2 = *(uint64_t*)k2;
+	free(found);
 
-	/* u1 - u2 is unsigned */
-	return u1 < u2 ? -1 : u1 > u2 ? 1 : 0;
+	return missing ? -1 : 0;
 }
 
-/* set psectors to an array of the sector numbers in the hash, returning
- * the number of entries (or -1 on error) */
-static int ramdisk_get_sectors(struct hashtable* h, uint64_t** psectors)
+/* append a write to the current epoch */
+static int ramdisk_write(struct tdremus_state *s, uint64_t sector,
+			 int nb_sectors, char* buf)
 {
-	struct hashtable_itr* itr;
-	uint64_t* sectors;
-	int count;
+	struct ramdisk *ramdisk = &s->ramdisk;
+	struct ramdisk_write *w;
+	size_t len = nb_sectors * ramdisk->sector_size;
 
-	if (!(count = hashtable_count(h)))
-		return 0;
-
-	if (!(*psectors = malloc(count * sizeof(uint64_t)))) {
-		DPRINTF("ramdisk_get_sectors: error allocating sector map\n");
+	if (!(w = malloc(sizeof(*w))) || !(w->buf = valloc(len))) {
+		DPRINTF("ramdisk_write: allocation failed\n");
+		free(w);
 		return -1;
 	}
-	sectors = *psectors;
 
-	itr = hashtable_iterator(h);
-	count = 0;
-	do {
-		sectors[count++] = *(uint64_t*)hashtable_iterator_key(itr);
-	} while (hashtable_iterator_advance(itr));
-	free(itr);
+	w->state = s;
+	w->sector = sector;
+	w->nb_sectors = nb_sectors;
+	memcpy(w->buf, buf, len);
+	list_add_tail(&w->next, &ramdisk->epoch);
 
-	return count;
+	return 0;
 }
 
-/*
-  return -1 for OOM
-  return -2 for merge lookup failure
-  return -3 for WAW race
-  return 0 on success.
-*/
-static int merge_requests(struct ramdisk* ramdisk, uint64_t start,
-			size_t count, char **mergedbuf)
+static int ramdisk_overlaps_inflight(struct ramdisk *ramdisk,
+				     const struct ramdisk_write *w)
 {
-	char* buf;
-	char* sector;
-	int i;
-	uint64_t *key;
-	int rc = 0;
-
-	if (!(buf = valloc(count * ramdisk->sector_size))) {
-		DPRINTF("merge_request: allocation failed\n");
-		return -1;
-	}
+	struct ramdisk_write *f;
 
-	for (i = 0; i < count; i++) {
-		if (!(sector = hashtable_search(ramdisk->prev, &start))) {
-			DPRINTF("merge_request: lookup failed on %"PRIu64"\n", start);
-			free(buf);
-			rc = -2;
-			goto fail;
-		}
+	list_for_each_entry(f, &ramdisk->inprogress, next)
+		if (ramdisk_overlap(f, w->sector, w->nb_sectors))
+			return 1;
 
-		/* Check inprogress requests to avoid waw non-determinism */
-		if (hashtable_search(ramdisk->inprogress, &start)) {
-			DPRINTF("merge_request: WAR RACE on %"PRIu64"\n", start);
-			free(buf);
-			rc = -3;
-			goto fail;
-		}
-		/* Insert req into inprogress (brief period of duplication of hash entries until
-		 * they are removed from prev. Read tracking would not be reading wrong entries)
-		 */
-		if (!(key = malloc(sizeof(*key)))) {
-			DPRINTF("%s: error allocating key\n", __FUNCTION__);
-			free(buf);			
-			rc = -1;
-			goto fail;
-		}
-		*key = start;
-		if (!hashtable_insert(ramdisk->inprogress, key, NULL)) {
-			DPRINTF("%s failed to insert sector %" PRIu64 " into inprogress hash\n", 
-				__FUNCTION__, start);
-			free(key);
-			free(buf);
-			rc = -1;
-			goto fail;
-		}
-		memcpy(buf + i * ramdisk->sector_size, sector, ramdisk->sector_size);
-		start++;
-	}
-
-	*mergedbuf = buf;
 	return 0;
-fail:
-	for (start--; i >0; i--, start--)
-		hashtable_remove(ramdisk->inprogress, &start);
-	return rc;
 }
 
-/* The underlying driver may not handle having the whole ramdisk queued at
- * once. We queue what we can and let the callbacks attempt to queue more. */
+/* Forward what we can from the head of the log, and let the callbacks
+ * forward more as writes complete. */
 /* NOTE: may be called from callback, while dd->private still belongs to
  * the underlying driver */
 static int ramdisk_flush(td_driver_t *driver, struct tdremus_state* s)
 {
-	uint64_t* sectors;
-	char* buf = NULL;
-	uint64_t base, batchlen;
-	int i, j, count = 0;
-
-	// RPRINTF("ramdisk flush\n");
+	struct ramdisk *rd = &s->ramdisk;
+	struct ramdisk_write *w;
+	int rc = 0;
 
-	if ((count = ramdisk_get_sectors(s->ramdisk.prev, &sectors)) <= 0)
-		return count;
+	/* requests completing as they are forwarded come back here */
+	if (rd->flushing)
+		return 0;
+	rd->flushing = 1;
 
-	/* Create the inprogress table if empty */
-	if (!s->ramdisk.inprogress)
-		s->ramdisk.inprogress = create_hashtable(RAMDISK_HASHSIZE,
-							uint64_hash,
-							rd_hash_equal);
-	
-	/*
-	  RPRINTF("ramdisk: flushing %d sectors\n", count);
-	*/
+	while (!list_empty(&rd->log) && rd->inflight < RAMDISK_MAX_INFLIGHT) {
+		w = list_entry(rd->log.next, struct ramdisk_write, next);
+		if (ramdisk_overlaps_inflight(rd, w))
+			break;
 
-	/* sort and merge sectors to improve disk performance */
-	qsort(sectors, count, sizeof(*sectors), uint64_compare);
-
-	for (i = 0; i < count;) {
-		base = sectors[i++];
-		while (i < count && sectors[i] == sectors[i-1] + 1)
-			i++;
-		batchlen = sectors[i-1] - base + 1;
-
-		j = merge_requests(&s->ramdisk, base, batchlen, &buf);
-			
-		if (j) {
-			RPRINTF("ramdisk_flush: merge_requests failed:%s\n",
-				j == -1? "OOM": (j==-2? "missing sector" : "WAW race"));
-			if (j == -3) continue;
-			free(sectors);
-			return -1;
-		}
+		list_del(&w->next);
+		list_add_tail(&w->next, &rd->inprogress);
+		rd->inflight++;
 
 		/* NOTE: create_write_request() creates a treq AND forwards it down
 		 * the driver chain */
-		// RPRINTF("forwarding write request at %" PRIu64 ", length: %" PRIu64 "\n", base, batchlen);
-		create_write_request(s, base, batchlen, buf);
-		//RPRINTF("write request at %" PRIu64 ", length: %" PRIu64 " forwarded\n", base, batchlen);
-
-		s->ramdisk.inflight++;
-
-		for (j = 0; j < batchlen; j++) {
-			buf = hashtable_search(s->ramdisk.prev, &base);
-			free(buf);
-			hashtable_remove(s->ramdisk.prev, &base);
-			base++;
+		if (create_write_request(s, w) < 0) {
+			RPRINTF("ramdisk_flush: out of memory\n");
+			list_del(&w->next);
+			list_add(&w->next, &rd->log);
+			rd->inflight--;
+			rc = -1;
+			break;
 		}
 	}
 
-	if (!hashtable_count(s->ramdisk.prev)) {
-		/* everything is in flight */
-		hashtable_destroy(s->ramdisk.prev, 0);
-		s->ramdisk.prev = NULL;
-	}
-
-	free(sectors);
-
-	// RPRINTF("ramdisk flush done\n");
-	return 0;
+	rd->flushing = 0;
+	return rc;
 }
 
-/* flush ramdisk contents to disk */
+/* commit the current epoch and start writing it out */
 static int ramdisk_start_flush(td_driver_t *driver)
 {
 	struct tdremus_state *s = (struct tdremus_state *)driver->data;
-	uint64_t* key;
-	char* buf;
-	int rc = 0;
-	int i, j, count, batchlen;
-	uint64_t* sectors;
+	struct ramdisk *rd = &s->ramdisk;
 
-	if (!hashtable_count(s->ramdisk.h)) {
-		/*
-		  RPRINTF("Nothing to flush\n");
-		*/
+	if (list_empty(&rd->epoch))
 		return 0;
-	}
 
-	if (s->ramdisk.prev) {
-		/* a flush request issued while a previous flush is still in progress
-		 * will merge with the previous request. If you want the previous
-		 * request to be consistent, wait for it to complete. */
-		if ((count = ramdisk_get_sectors(s->ramdisk.h, &sectors)) < 0)
-			return count;
-
-		for (i = 0; i < count; i++) {
-			buf = hashtable_search(s->ramdisk.h, sectors + i);
-			ramdisk_write_hash(s->ramdisk.prev, sectors[i], buf,
-					   s->ramdisk.sector_size);
-		}
-		free(sectors);
-
-		hashtable_destroy (s->ramdisk.h, 0);
-	} else
-		s->ramdisk.prev = s->ramdisk.h;
-
-	/* We create a new hashtable so that new writes can be performed before
-	 * the old hashtable is completely drained. */
-	s->ramdisk.h = create_hashtable(RAMDISK_HASHSIZE, uint64_hash,
-					rd_hash_equal);
+	__list_splice(&rd->epoch, rd->log.prev, &rd->log);
+	INIT_LIST_HEAD(&rd->epoch);
 
 	return ramdisk_flush(driver, s);
 }
@@ -618,14 +464,12 @@ static int ramdisk_start(td_driver_t *driver)
 {
 	struct tdremus_state *s = (struct tdremus_state *)driver->data;
 
-	if (s->ramdisk.h) {
+	if (s->ramdisk.sector_size) {
 		RPRINTF("ramdisk already allocated\n");
 		return 0;
 	}
 
 	s->ramdisk.sector_size = driver->info.sector_size;
-	s->ramdisk.h = create_hashtable(RAMDISK_HASHSIZE, uint64_hash,
-					rd_hash_equal);
 
 	DPRINTF("Ramdisk started, %zu bytes/sector\n", s->ramdisk.sector_size);
 
@@ -902,13 +746,8 @@ static int client_flush(td_driver_t *driver)
 static int server_flush(td_driver_t *driver)
 {
 	struct tdremus_state *s = (struct tdremus_state *)driver->data;
-	/* 
-	 * Nothing to flush in beginning.
-	 */
-	if (!s->ramdisk.prev)
-		return 0;
 	/* Try to flush any remaining requests */
-	return ramdisk_flush(driver, s);	
+	return ramdisk_flush(driver, s);
 }
 
 static int primary_start(td_driver_t *driver)
@@ -1137,7 +976,7 @@ static inline int server_writes_inflight(td_driver_t *driver)
 {
 	struct tdremus_state *s = (struct tdremus_state *)driver->data;
 
-	if (!s->ramdisk.inflight && !s->ramdisk.prev)
+	if (list_empty(&s->ramdisk.inprogress) && list_empty(&s->ramdisk.log))
 		return 0;
 
 	return 1;
@@ -1224,7 +1063,7 @@ static int server_do_wreq(td_driver_t *driver)
 	if (mread(s->stream_fd.fd, buf, len) < 0)
 		goto err;
 
-	if (ramdisk_write(&s->ramdisk, *sector, *sectors, buf) < 0)
+	if (ramdisk_write(s, *sector, *sectors, buf) < 0)
 		goto err;
 
 	return 0;
@@ -1306,11 +1145,10 @@ void unprotected_queue_read(td_driver_t *driver, td_request_t treq)
 	/* wait for previous ramdisk to flush  before servicing reads */
 	if (server_writes_inflight(driver)) {
 		/* for now lets just return EBUSY.
-		 * if there are any left-over requests in prev,
+		 * if there are any left-over requests in the log,
 		 * kick em again.
 		 */
-		if(!s->ramdisk.inflight) /* nothing in inprogress */
-			ramdisk_flush(driver, s);
+		ramdisk_flush(driver, s);
 
 		td_complete_request(treq, -EBUSY);
 	}
@@ -1328,8 +1166,7 @@ void unprotected_queue_write(td_driver_t *driver, td_request_t treq)
 	/* wait for previous ramdisk to flush */
 	if (server_writes_inflight(driver)) {
 		RPRINTF("queue_write: waiting for queue to drain");
-		if(!s->ramdisk.inflight) /* nothing in inprogress. Kick prev */
-			ramdisk_flush(driver, s);
+		ramdisk_flush(driver, s); /* kick the log */
 		td_complete_request(treq, -EBUSY);
 	}
 	else {
@@ -1345,6 +1182,9 @@ static int unprotected_start(td_driver_t *driver)
 
 	RPRINTF("failure detected, activating passthrough\n");
 
+	/* the primary never committed what it wrote since the last checkpoint */
+	ramdisk_free_list(&s->ramdisk.epoch);
+
 	/* close the server socket */
 	close_stream_fd(s);
 
@@ -1646,6 +1486,9 @@ static int tdremus_open(td_driver_t *driver, const char *name,
 	device_vbd = tapdisk_server_get_vbd(0);
 
 	memset(s, 0, sizeof(*s));
+	INIT_LIST_HEAD(&s->ramdisk.epoch);
+	INIT_LIST_HEAD(&s->ramdisk.log);
+	INIT_LIST_HEAD(&s->ramdisk.inprogress);
 	s->server_fd.fd = -1;
 	s->stream_fd.fd = -1;
 	s->ctl_fd.fd = -1;
@@ -1688,8 +1531,9 @@ static int tdremus_close(td_driver_t *driver)
 	struct tdremus_state *s = (struct tdremus_state *)driver->data;
 
 	RPRINTF("closing\n");
-	if (s->ramdisk.inprogress)
-		hashtable_destroy(s->ramdisk.inprogress, 0);
+	/* writes in flight are freed as they complete */
+	ramdisk_free_list(&s->ramdisk.epoch);
+	ramdisk_free_list(&s->ramdisk.log);
 	
 	if (s->driver_data) {
 		free(s->driver_data);
@@ -109,7 +109,7 @@ unsigned int SPB;
 #endif
 
 /******VHD DEFINES******/
-#define VHD_CACHE_SIZE               32
+#define VHD_CACHE_SIZE               128
 
 #define VHD_REQS_DATA                TAPDISK_DATA_REQUESTS
 #define VHD_REQS_META                (VHD_CACHE_SIZE + 2)
@@ -229,6 +229,7 @@ struct vhd_state {
 
 	u64                       bm_lru;      /* lru sequence number */
 	u32                       bm_secs;     /* size of bitmap, in sectors */
+	int                       no_zero_range; /* fs can't zero extents */
 	struct vhd_bitmap        *bitmap[VHD_CACHE_SIZE];
 
 	int                       bm_free_count;
@@ -1415,6 +1416,25 @@ allocate_block(struct vhd_state *s, uint32_t blk)
 	}
 
 	size = vhd_sectors_to_bytes(s->spb + s->bm_secs + gap);
+
+	/*
+	 * let the filesystem zero the new block as an extent rather
+	 * than writing a block of zeros synchronously from here.
+	 */
+#ifdef FALLOC_FL_ZERO_RANGE
+	if (!s->no_zero_range) {
+		err = fallocate(s->vhd.fd, FALLOC_FL_ZERO_RANGE, offset, size);
+		if (!err)
+			goto zeroed;
+		if (errno != EOPNOTSUPP && errno != ENOSYS) {
+			err = -errno;
+			ERR(err, "fallocate failed");
+			return err;
+		}
+		s->no_zero_range = 1;
+	}
+#endif
+
 	err  = write(s->vhd.fd, vhd_zeros(size), size);
 	if (err != size) {
 		err = (err == -1 ? -errno : -EIO);
@@ -1422,6 +1442,10 @@ allocate_block(struct vhd_state *s, uint32_t blk)
 		return err;
 	}
 
+#ifdef FALLOC_FL_ZERO_RANGE
+ zeroed:
+#endif
+
 	/* empty bitmap could already be in
 	 * cache if earlier bat update failed */
 	bm = get_bitmap(s, blk);
@@ -30,6 +30,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <sys/time.h>
+#include <sys/epoll.h>
 
 #include "scheduler.h"
 #include "tapdisk-log.h"
@@ -37,6 +38,7 @@
 #define DBG(_f, _a...)               tlog_write(TLOG_DBG, _f, ##_a)
 
 #define SCHEDULER_MAX_TIMEOUT        600
+#define SCHEDULER_MAX_READY          64
 #define SCHEDULER_POLL_FD           (SCHEDULER_POLL_READ_FD |	\
 				     SCHEDULER_POLL_WRITE_FD |	\
 				     SCHEDULER_POLL_EXCEPT_FD)
@@ -47,11 +49,24 @@
 #define scheduler_for_each_event(s, event, tmp)	\
 	list_for_each_entry_safe(event, tmp, &(s)->events, next)
 
+/*
+ * fd events are registered with epoll once, when the event is
+ * registered, instead of rebuilding fd sets on every iteration.
+ * registration is level triggered, as with select(): callbacks are not
+ * required to drain their fd. epoll takes each fd only once, so a
+ * second event on the same fd is registered through a dup() of it.
+ * fds epoll can't wait on, regular files, always count as ready, which
+ * is what select() does for them.
+ */
 typedef struct event {
 	char                         mode;
+	char                         dead;
+	char                         always_ready;
 	event_id_t                   id;
+	unsigned int                 pass;
 
 	int                          fd;
+	int                          epoll_fd;   /* fd given to epoll, or -1 */
 	int                          timeout;
 	int                          deadline;
 
@@ -68,30 +83,13 @@ scheduler_prepare_events(scheduler_t *s)
 	struct timeval now;
 	event_t *event, *tmp;
 
-	FD_ZERO(&s->read_fds);
-	FD_ZERO(&s->write_fds);
-	FD_ZERO(&s->except_fds);
-
-	s->max_fd  = 0;
 	s->timeout = SCHEDULER_MAX_TIMEOUT;
 
 	gettimeofday(&now, NULL);
 
 	scheduler_for_each_event(s, event, tmp) {
-		if (event->mode & SCHEDULER_POLL_READ_FD) {
-			FD_SET(event->fd, &s->read_fds);
-			s->max_fd = MAX(event->fd, s->max_fd);
-		}
-
-		if (event->mode & SCHEDULER_POLL_WRITE_FD) {
-			FD_SET(event->fd, &s->write_fds);
-			s->max_fd = MAX(event->fd, s->max_fd);
-		}
-
-		if (event->mode & SCHEDULER_POLL_EXCEPT_FD) {
-			FD_SET(event->fd, &s->except_fds);
-			s->max_fd = MAX(event->fd, s->max_fd);
-		}
+		if (event->always_ready)
+			s->timeout = 0;
 
 		if (event->mode & SCHEDULER_POLL_TIMEOUT) {
 			diff = event->deadline - now.tv_sec;
@@ -117,36 +115,73 @@ scheduler_event_callback(event_t *event, char mode)
 	event->cb(event->id, mode, event->private);
 }
 
+static char
+scheduler_ready_mode(event_t *event, uint32_t revents)
+{
+	/* select() reports errors and hangups as readable or writable */
+	if ((event->mode & SCHEDULER_POLL_READ_FD) &&
+	    (revents & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+		return SCHEDULER_POLL_READ_FD;
+
+	if ((event->mode & SCHEDULER_POLL_WRITE_FD) &&
+	    (revents & (EPOLLOUT | EPOLLHUP | EPOLLERR)))
+		return SCHEDULER_POLL_WRITE_FD;
+
+	/*
+	 * an except-only event would otherwise keep epoll reporting
+	 * the error forever. let its owner see it.
+	 */
+	if (event->mode & SCHEDULER_POLL_EXCEPT_FD)
+		return SCHEDULER_POLL_EXCEPT_FD;
+
+	return 0;
+}
+
+static void
+scheduler_reap_events(scheduler_t *s)
+{
+	event_t *event, *tmp;
+
+	list_for_each_entry_safe(event, tmp, &s->dead_events, next) {
+		list_del(&event->next);
+		free(event);
+	}
+}
+
 static void
-scheduler_run_events(scheduler_t *s)
+scheduler_run_events(scheduler_t *s, struct epoll_event *ready, int n)
 {
+	int i;
+	char mode;
 	struct timeval now;
 	event_t *event, *tmp;
 
 	gettimeofday(&now, NULL);
 
+	/* callbacks may unregister events later in @ready; those are dead */
+	for (i = 0; i < n; i++) {
+		event = ready[i].data.ptr;
+		if (event->dead)
+			continue;
+
+		mode = scheduler_ready_mode(event, ready[i].events);
+		if (mode)
+			scheduler_event_callback(event, mode);
+	}
+
+	s->pass++;
+
  again:
 	s->restart = 0;
 
 	scheduler_for_each_event(s, event, tmp) {
-		if ((event->mode & SCHEDULER_POLL_READ_FD) &&
-		    FD_ISSET(event->fd, &s->read_fds)) {
-			FD_CLR(event->fd, &s->read_fds);
-			scheduler_event_callback(event, SCHEDULER_POLL_READ_FD);
+		if (event->pass == s->pass)
 			goto next;
-		}
+		event->pass = s->pass;
 
-		if ((event->mode & SCHEDULER_POLL_WRITE_FD) &&
-		    FD_ISSET(event->fd, &s->write_fds)) {
-			FD_CLR(event->fd, &s->write_fds);
-			scheduler_event_callback(event, SCHEDULER_POLL_WRITE_FD);
-			goto next;
-		}
-
-		if ((event->mode & SCHEDULER_POLL_EXCEPT_FD) &&
-		    FD_ISSET(event->fd, &s->except_fds)) {
-			FD_CLR(event->fd, &s->except_fds);
-			scheduler_event_callback(event, SCHEDULER_POLL_EXCEPT_FD);
+		if (event->always_ready) {
+			mode = scheduler_ready_mode(event, EPOLLIN | EPOLLOUT);
+			scheduler_event_callback(event, mode);
 			goto next;
 		}
 
@@ -158,12 +193,94 @@ scheduler_run_events(scheduler_t *s)
 		if (s->restart)
 			goto again;
 	}
+
+	scheduler_reap_events(s);
+}
+
+static int
+scheduler_epoll_add(scheduler_t *s, event_t *event, int fd)
+{
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.data.ptr = event;
+
+	if (event->mode & SCHEDULER_POLL_READ_FD)
+		ev.events |= EPOLLIN;
+	if (event->mode & SCHEDULER_POLL_WRITE_FD)
+		ev.events |= EPOLLOUT;
+	if (event->mode & SCHEDULER_POLL_EXCEPT_FD)
+		ev.events |= EPOLLPRI;
+
+	if (epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, fd, &ev))
+		return -errno;
+
+	return 0;
+}
+
+static int
+scheduler_add_fd(scheduler_t *s, event_t *event)
+{
+	int fd, err;
+
+	err = scheduler_epoll_add(s, event, event->fd);
+	if (!err) {
+		event->epoll_fd = event->fd;
+		return 0;
+	}
+
+	if (err == -EPERM) {
+		event->always_ready = !!(event->mode & (SCHEDULER_POLL_READ_FD |
+							SCHEDULER_POLL_WRITE_FD));
+		return 0;
+	}
+
+	if (err != -EEXIST)
+		return err;
+
+	fd = dup(event->fd);
+	if (fd == -1)
+		return -errno;
+
+	err = scheduler_epoll_add(s, event, fd);
+	if (err) {
+		close(fd);
+		return err;
+	}
+
+	event->epoll_fd = fd;
+	return 0;
+}
+
+static void
+scheduler_del_fd(scheduler_t *s, event_t *event)
+{
+	event_t *e, *tmp;
+
+	if (event->epoll_fd == -1)
+		return;
+
+	epoll_ctl(s->epoll_fd, EPOLL_CTL_DEL, event->epoll_fd, NULL);
+	if (event->epoll_fd != event->fd) {
+		close(event->epoll_fd);
+		return;
+	}
+
+	/*
+	 * if the owner closed the fd before unregistering, its number may
+	 * by now belong to a file another event is waiting on, which the
+	 * delete above just removed. put those back.
+	 */
+	scheduler_for_each_event(s, e, tmp)
+		if (e->epoll_fd == event->fd)
+			scheduler_epoll_add(s, e, e->epoll_fd);
 }
 
 int
 scheduler_register_event(scheduler_t *s, char mode, int fd,
 			 int timeout, event_cb_t cb, void *private)
 {
+	int err;
 	event_t *event;
 	struct timeval now;
 
@@ -183,10 +300,20 @@ scheduler_register_event(scheduler_t *s, char mode, int fd,
 
 	event->mode     = mode;
 	event->fd       = fd;
+	event->epoll_fd = -1;
 	event->timeout  = timeout;
 	event->deadline = now.tv_sec + timeout;
 	event->cb       = cb;
 	event->private  = private;
+
+	if (mode & SCHEDULER_POLL_FD) {
+		err = scheduler_add_fd(s, event);
+		if (err) {
+			free(event);
+			return err;
+		}
+	}
+
 	event->id       = s->uuid++;
 
 	if (!s->uuid)
@@ -208,7 +335,9 @@ scheduler_unregister_event(scheduler_t *s, event_id_t id)
 	scheduler_for_each_event(s, event, tmp)
 		if (event->id == id) {
 			list_del(&event->next);
-			free(event);
+			scheduler_del_fd(s, event);
+			event->dead = 1;
+			list_add_tail(&event->next, &s->dead_events);
 			s->restart = 1;
 			break;
 		}
@@ -225,18 +354,15 @@ int
 scheduler_wait_for_events(scheduler_t *s)
 {
 	int ret;
-	struct timeval tv;
+	struct epoll_event ready[SCHEDULER_MAX_READY];
 
 	scheduler_prepare_events(s);
 
-	tv.tv_sec  = s->timeout;
-	tv.tv_usec = 0;
-
 	DBG("timeout: %d, max_timeout: %d\n",
 	    s->timeout, s->max_timeout);
 
-	ret = select(s->max_fd + 1, &s->read_fds,
-		     &s->write_fds, &s->except_fds, &tv);
+	ret = epoll_wait(s->epoll_fd, ready, SCHEDULER_MAX_READY,
+			 s->timeout * 1000);
 
 	s->restart     = 0;
 	s->timeout     = SCHEDULER_MAX_TIMEOUT;
@@ -245,21 +371,24 @@ scheduler_wait_for_events(scheduler_t *s)
 	if (ret < 0)
 		return ret;
 
-	scheduler_run_events(s);
+	scheduler_run_events(s, ready, ret);
 
 	return ret;
 }
 
-void
+int
 scheduler_initialize(scheduler_t *s)
 {
 	memset(s, 0, sizeof(scheduler_t));
 
 	s->uuid = 1;
 
-	FD_ZERO(&s->read_fds);
-	FD_ZERO(&s->write_fds);
-	FD_ZERO(&s->except_fds);
-
 	INIT_LIST_HEAD(&s->events);
+	INIT_LIST_HEAD(&s->dead_events);
+
+	s->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (s->epoll_fd == -1)
+		return -errno;
+
+	return 0;
 }
@@ -438,6 +438,54 @@ tapdisk_lio_ack_event(struct tqueue *queue)
 		read_exact(lio->event_fd, &val, sizeof(val));
 }
 
+/*
+ * Linux maps the completion ring of an AIO context into the process, at
+ * the address io_setup returns as the context.  Reaping completions from
+ * it directly saves the io_getevents syscall on every event, which is
+ * what limits small block IOPS.  The layout is the kernel's struct
+ * aio_ring; anything else (e.g. the aio-poll patch) falls back to the
+ * syscall.
+ */
+#define AIO_RING_MAGIC 0xa10a10a1
+
+struct aio_ring {
+	unsigned        id;
+	unsigned        nr;
+	unsigned        head;
+	unsigned        tail;
+	unsigned        magic;
+	unsigned        compat_features;
+	unsigned        incompat_features;
+	unsigned        header_length;
+	struct io_event io_events[0];
+};
+
+static int
+tapdisk_lio_getevents(struct lio *lio, int max, struct io_event *events)
+{
+	struct aio_ring *ring = (struct aio_ring *)lio->aio_ctx;
+	unsigned head, tail;
+	int n = 0;
+
+	if (!ring || ring == (struct aio_ring *)REQUEST_ASYNC_FD ||
+	    ring->magic != AIO_RING_MAGIC)
+		return io_getevents(lio->aio_ctx, 0, max, events, NULL);
+
+	head = ring->head;
+	tail = ring->tail;
+	__sync_synchronize(); /* read tail /then/ the events */
+
+	while (n < max && head != tail) {
+		events[n++] = ring->io_events[head];
+		head = (head + 1) % ring->nr;
+	}
+
+	__sync_synchronize(); /* copy events /then/ release the slots */
+	ring->head = head;
+
+	return n;
+}
+
 static void
 tapdisk_lio_event(event_id_t id, char mode, void *private)
 {
@@ -451,8 +499,7 @@ tapdisk_lio_event(event_id_t id, char mode, void *private)
 	tapdisk_lio_ack_event(queue);
 
 	lio   = queue->tio_data;
-	ret   = io_getevents(lio->aio_ctx, 0,
-			     queue->size, lio->aio_events, NULL);
+	ret   = tapdisk_lio_getevents(lio, queue->size, lio->aio_events);
 	split = io_split(&queue->opioctx, lio->aio_events, ret);
 	tapdisk_filter_events(queue->filter, lio->aio_events, split);
 
@@ -66,6 +66,7 @@
 #define TD_VBD_EIO_RETRIES          10
 #define TD_VBD_EIO_SLEEP            1
 #define TD_VBD_WATCHDOG_TIMEOUT     10
+#define TD_VBD_RING_PASSES          4
 
 static void tapdisk_vbd_ring_event(event_id_t, char, void *);
 static void tapdisk_vbd_callback(void *, blkif_response_t *);
@@ -1549,10 +1550,10 @@ tapdisk_vbd_issue_requests(td_vbd_t *vbd)
 	return tapdisk_vbd_issue_new_requests(vbd);
 }
 
-static void
+static int
 tapdisk_vbd_pull_ring_requests(td_vbd_t *vbd)
 {
-	int idx;
+	int idx, n = 0;
 	RING_IDX rp, rc;
 	td_ring_t *ring;
 	blkif_request_t *req;
@@ -1560,7 +1561,7 @@ tapdisk_vbd_pull_ring_requests(td_vbd_t *vbd)
 
 	ring = &vbd->ring;
 	if (!ring->sring)
-		return;
+		return 0;
 
 	rp   = ring->fe_ring.sring->req_prod;
 	xen_rmb();
@@ -1580,9 +1581,12 @@ tapdisk_vbd_pull_ring_requests(td_vbd_t *vbd)
 		vreq->vbd = vbd;
 
 		tapdisk_vbd_move_request(vreq, &vbd->new_requests);
+		n++;
 
 		DBG(TLOG_DBG, "%s: request %d \n", vbd->name, idx);
 	}
+
+	return n;
 }
 
 static int
@@ -1705,12 +1709,21 @@ tapdisk_vbd_check_ring_message(td_vbd_t *vbd)
 static void
 tapdisk_vbd_ring_event(event_id_t id, char mode, void *private)
 {
+	int passes;
 	td_vbd_t *vbd;
 
 	vbd = (td_vbd_t *)private;
 
-	tapdisk_vbd_pull_ring_requests(vbd);
-	tapdisk_vbd_issue_requests(vbd);
+	/*
+	 * requests posted while we were issuing the previous batch are
+	 * picked up here rather than on another trip through select().
+	 * bounded, so a busy ring can't starve the other vbds.
+	 */
+	for (passes = 0; passes < TD_VBD_RING_PASSES; passes++) {
+		if (!tapdisk_vbd_pull_ring_requests(vbd) && passes)
+			break;
+		tapdisk_vbd_issue_requests(vbd);
+	}
 
 	/* vbd may be destroyed after this call */
 	tapdisk_vbd_check_ring_message(vbd);
@@ -50,6 +50,11 @@
 #include <libutil.h>
 #endif
 
+#if defined(__linux__)
+#define USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #define MAX(a, b) (((a) > (b)) ? (a) : (b))
 #define MIN(a, b) (((a) < (b)) ? (a) : (b))
 
@@ -61,6 +66,11 @@
 /* Duration of each time period in ms */
 #define RATE_LIMIT_PERIOD 200
 
+/* Guest output is written to its log at the latest after this many ms */
+#define LOG_FLUSH_PERIOD 200
+/* ... or as soon as this many bytes are buffered */
+#define LOG_FLUSH_SIZE 16384
+
 extern int log_reload;
 extern int log_guest;
 extern int log_hv;
@@ -68,17 +78,14 @@ extern int log_time_hv;
 extern int log_time_guest;
 extern char *log_dir;
 extern int discard_overflowed_data;
+extern unsigned long log_rate;
+extern unsigned long log_hv_ring_size;
 
 static int log_time_hv_needts = 1;
-static int log_time_guest_needts = 1;
 static int log_hv_fd = -1;
 
 static xengnttab_handle *xgt_handle = NULL;
 
-static struct pollfd  *fds;
-static unsigned int current_array_size;
-static unsigned int nr_fds;
-
 #define ROUNDUP(_x,_w) (((unsigned long)(_x)+(1UL<<(_w))-1) & ~((1UL<<(_w))-1))
 
 struct buffer {
@@ -89,10 +96,24 @@ struct buffer {
 	size_t max_capacity;
 };
 
+/*
+ * A file descriptor watched by the main loop.  It stays registered across
+ * iterations and only the sources which fired are looked at.
+ */
+struct pollsrc {
+	int fd;			/* -1 if not registered */
+	short events;
+	short revents;
+	struct domain *dom;	/* NULL for the daemon's own fds */
+#ifndef USE_EPOLL
+	unsigned int idx;	/* in fds[] */
+#endif
+};
+
 struct domain {
 	int domid;
 	int master_fd;
-	int master_pollfd_idx;
+	struct pollsrc master_src;
 	int slave_fd;
 	int log_fd;
 	bool is_dead;
@@ -104,14 +125,272 @@ struct domain {
 	xenevtchn_port_or_error_t local_port;
 	xenevtchn_port_or_error_t remote_port;
 	xenevtchn_handle *xce_handle;
-	int xce_pollfd_idx;
+	struct pollsrc xce_src;
 	struct xencons_interface *interface;
 	int event_count;
 	long long next_period;
+	/* Has fired sources, see ready_head */
+	bool is_ready;
+	struct domain *ready_next;
+	/* Has a deadline, see timer_head */
+	bool on_timer;
+	struct domain *timer_next;
+	/* Guest output not yet written to log_fd */
+	struct buffer log_buffer;
+	int log_needts;
+	long long log_flush_at;
+	/* Output allowance for log_rate, and what was dropped over it */
+	long long log_tokens;
+	long long log_tokens_at;
+	unsigned long long log_dropped;
 };
 
 static struct domain *dom_head;
 
+/* Domains with fired sources, to be handled in this iteration. */
+static struct domain *ready_head;
+/* Domains that are rate limited or have log output to flush. */
+static struct domain *timer_head;
+
+static struct pollsrc xs_src = { .fd = -1 };
+static struct pollsrc hv_src = { .fd = -1 };
+
+static long long now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((long long)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+static void domain_set_ready(struct domain *dom)
+{
+	if (dom->is_ready)
+		return;
+	dom->is_ready = true;
+	dom->ready_next = ready_head;
+	ready_head = dom;
+}
+
+static void domain_add_timer(struct domain *dom)
+{
+	if (dom->on_timer)
+		return;
+	dom->on_timer = true;
+	dom->timer_next = timer_head;
+	timer_head = dom;
+}
+
+static void domain_del_timer(struct domain *dom)
+{
+	struct domain **pp;
+
+	if (!dom->on_timer)
+		return;
+	for (pp = &timer_head; *pp; pp = &(*pp)->timer_next) {
+		if (*pp == dom) {
+			*pp = dom->timer_next;
+			break;
+		}
+	}
+	dom->on_timer = false;
+}
+
+static void pollsrc_fired(struct pollsrc *src, short revents)
+{
+	src->revents = revents;
+	if (src->dom)
+		domain_set_ready(src->dom);
+}
+
+#ifdef USE_EPOLL
+static int epoll_fd = -1;
+
+static bool pollsrc_init(void)
+{
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd == -1) {
+		dolog(LOG_ERR, "Failed to create epoll instance: %d (%s)",
+		      errno, strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+static void pollsrc_fini(void)
+{
+	if (epoll_fd != -1)
+		close(epoll_fd);
+	epoll_fd = -1;
+}
+
+static int pollsrc_ctl(struct pollsrc *src, int op, int fd, short events)
+{
+	struct epoll_event ev = { .data.ptr = src };
+
+	if (events & POLLIN)
+		ev.events |= EPOLLIN;
+	if (events & POLLOUT)
+		ev.events |= EPOLLOUT;
+	if (events & POLLPRI)
+		ev.events |= EPOLLPRI;
+
+	return epoll_ctl(epoll_fd, op, fd, &ev);
+}
+
+static int pollsrc_add(struct pollsrc *src, int fd, short events)
+{
+	return pollsrc_ctl(src, EPOLL_CTL_ADD, fd, events);
+}
+
+static void pollsrc_mod(struct pollsrc *src, short events)
+{
+	pollsrc_ctl(src, EPOLL_CTL_MOD, src->fd, events);
+}
+
+static void pollsrc_del(struct pollsrc *src)
+{
+	pollsrc_ctl(src, EPOLL_CTL_DEL, src->fd, 0);
+}
+
+static int pollsrc_wait(int timeout)
+{
+	struct epoll_event evs[64];
+	short revents;
+	int i, n;
+
+	n = epoll_wait(epoll_fd, evs, sizeof(evs) / sizeof(evs[0]), timeout);
+	for (i = 0; i < n; i++) {
+		revents = 0;
+		if (evs[i].events & EPOLLIN)
+			revents |= POLLIN;
+		if (evs[i].events & EPOLLOUT)
+			revents |= POLLOUT;
+		if (evs[i].events & EPOLLPRI)
+			revents |= POLLPRI;
+		if (evs[i].events & EPOLLERR)
+			revents |= POLLERR;
+		if (evs[i].events & EPOLLHUP)
+			revents |= POLLHUP;
+		pollsrc_fired(evs[i].data.ptr, revents);
+	}
+
+	return n;
+}
+#else
+static struct pollfd  *fds;
+static struct pollsrc **fd_srcs;
+static unsigned int current_array_size;
+static unsigned int nr_fds;
+
+static bool pollsrc_init(void)
+{
+	return true;
+}
+
+static void pollsrc_fini(void)
+{
+	free(fds);
+	free(fd_srcs);
+	fds = NULL;
+	fd_srcs = NULL;
+	current_array_size = 0;
+	nr_fds = 0;
+}
+
+static int pollsrc_add(struct pollsrc *src, int fd, short events)
+{
+	if (current_array_size < nr_fds + 1) {
+		struct pollfd  *new_fds = NULL;
+		struct pollsrc **new_srcs = NULL;
+		unsigned long newsize;
+
+		/* Round up to 2^8 boundary, in practice this just
+		 * make newsize larger than current_array_size.
+		 */
+		newsize = ROUNDUP(nr_fds + 1, 8);
+
+		new_fds = realloc(fds, sizeof(struct pollfd)*newsize);
+		if (!new_fds)
+			return -1;
+		fds = new_fds;
+
+		new_srcs = realloc(fd_srcs, sizeof(struct pollsrc *)*newsize);
+		if (!new_srcs)
+			return -1;
+		fd_srcs = new_srcs;
+
+		current_array_size = newsize;
+	}
+
+	fds[nr_fds].fd = fd;
+	fds[nr_fds].events = events;
+	fds[nr_fds].revents = 0;
+	fd_srcs[nr_fds] = src;
+	src->idx = nr_fds++;
+
+	return 0;
+}
+
+static void pollsrc_mod(struct pollsrc *src, short events)
+{
+	fds[src->idx].events = events;
+}
+
+static void pollsrc_del(struct pollsrc *src)
+{
+	unsigned int last = --nr_fds;
+
+	/* Fill the hole with the last entry. */
+	if (src->idx != last) {
+		fds[src->idx] = fds[last];
+		fd_srcs[src->idx] = fd_srcs[last];
+		fd_srcs[src->idx]->idx = src->idx;
+	}
+}
+
+static int pollsrc_wait(int timeout)
+{
+	unsigned int i;
+	int n;
+
+	n = poll(fds, nr_fds, timeout);
+	for (i = 0; n > 0 && i < nr_fds; i++)
+		if (fds[i].revents)
+			pollsrc_fired(fd_srcs[i], fds[i].revents);
+
+	return n;
+}
+#endif
+
+/*
+ * Watch fd for events, replacing what src watched before.  An fd of -1
+ * or no events stops watching: polling an fd even for no events would
+ * still report hangups on it.
+ */
+static void pollsrc_set(struct pollsrc *src, int fd, short events)
+{
+	if (src->fd != -1 && (fd != src->fd || !events)) {
+		pollsrc_del(src);
+		src->fd = -1;
+	}
+
+	if (fd == -1 || !events)
+		return;
+
+	if (src->fd == -1) {
+		if (pollsrc_add(src, fd, events)) {
+			dolog(LOG_ERR, "Failed to watch fd %d: %d (%s)",
+			      fd, errno, strerror(errno));
+			return;
+		}
+		src->fd = fd;
+	} else if (events != src->events)
+		pollsrc_mod(src, events);
+
+	src->events = events;
+}
+
 static int write_all(int fd, const char* buf, size_t len)
 {
 	while (len) {
@@ -158,6 +437,138 @@ static int write_with_timestamp(int fd, const char *data, size_t sz,
 	return 0;
 }
 
+static void buffer_reserve(struct buffer *buffer, size_t len)
+{
+	if ((buffer->capacity - buffer->size) < len) {
+		buffer->capacity += (len + 1024);
+		buffer->data = realloc(buffer->data, buffer->capacity);
+		if (buffer->data == NULL) {
+			dolog(LOG_ERR, "Memory allocation failed");
+			exit(ENOMEM);
+		}
+	}
+}
+
+static void buffer_put(struct buffer *buffer, const char *data, size_t len)
+{
+	buffer_reserve(buffer, len);
+	memcpy(buffer->data + buffer->size, data, len);
+	buffer->size += len;
+}
+
+static void domain_flush_log(struct domain *dom)
+{
+	struct buffer *log = &dom->log_buffer;
+
+	if (dom->log_fd != -1 && log->size &&
+	    write_all(dom->log_fd, log->data, log->size) < 0)
+		dolog(LOG_ERR, "Write to log failed "
+		      "on domain %d: %d (%s)\n",
+		      dom->domid, errno, strerror(errno));
+
+	log->size = 0;
+	dom->log_flush_at = 0;
+}
+
+/* As write_with_timestamp(), but into the log buffer of dom. */
+static void domain_log_put(struct domain *dom, const char *data, size_t sz)
+{
+	struct buffer *log = &dom->log_buffer;
+	const char *last_byte = data + sz - 1;
+	char ts[32];
+	time_t now;
+	size_t tslen;
+
+	if (!sz)
+		return;
+
+	if (!log_time_guest) {
+		buffer_put(log, data, sz);
+		dom->log_needts = (*last_byte == '\n');
+		return;
+	}
+
+	now = time(NULL);
+	tslen = strftime(ts, sizeof(ts), "[%Y-%m-%d %H:%M:%S] ",
+			 localtime(&now));
+
+	while (data <= last_byte) {
+		const char *nl = memchr(data, '\n', last_byte + 1 - data);
+		int found_nl = (nl != NULL);
+		if (!found_nl)
+			nl = last_byte;
+
+		if (dom->log_needts)
+			buffer_put(log, ts, tslen);
+		buffer_put(log, data, nl + 1 - data);
+
+		dom->log_needts = found_nl;
+		data = nl + 1;
+		if (found_nl) {
+			// If we printed a newline, strip all \r following it
+			while (data <= last_byte && *data == '\r')
+				data++;
+		}
+	}
+}
+
+static void domain_log_dropped(struct domain *dom)
+{
+	char msg[80];
+	int len;
+
+	if (!dom->log_dropped)
+		return;
+
+	len = snprintf(msg, sizeof(msg),
+		       "%s[xenconsoled: %llu bytes of output dropped]\n",
+		       dom->log_needts ? "" : "\n", dom->log_dropped);
+	domain_log_put(dom, msg, len);
+	dom->log_dropped = 0;
+}
+
+/*
+ * Queue guest output for the log.  It is written out in one go once
+ * LOG_FLUSH_SIZE bytes are queued or after LOG_FLUSH_PERIOD, so a chatty
+ * guest does not cost a write per event.  Beyond log_rate bytes per
+ * second the output is dropped, which is noted in the log once output
+ * is accepted again.
+ */
+static void domain_log(struct domain *dom, const char *data, size_t size)
+{
+	size_t allowed = size;
+	long long now;
+
+	if (dom->log_fd == -1)
+		return;
+
+	now = now_ms();
+
+	if (log_rate) {
+		dom->log_tokens += (now - dom->log_tokens_at) *
+				   (long long)log_rate / 1000;
+		if (dom->log_tokens > (long long)log_rate)
+			dom->log_tokens = log_rate;
+		dom->log_tokens_at = now;
+
+		if ((long long)allowed > dom->log_tokens)
+			allowed = dom->log_tokens;
+		dom->log_tokens -= allowed;
+	}
+
+	if (allowed)
+		domain_log_dropped(dom);
+	domain_log_put(dom, data, allowed);
+	dom->log_dropped += size - allowed;
+
+	if (dom->log_buffer.size >= LOG_FLUSH_SIZE) {
+		domain_flush_log(dom);
+	} else if (dom->log_buffer.size && !dom->log_flush_at) {
+		dom->log_flush_at = now + LOG_FLUSH_PERIOD;
+		domain_add_timer(dom);
+	}
+}
+
 static void buffer_append(struct domain *dom)
 {
 	struct buffer *buffer = &dom->buffer;
@@ -172,14 +583,7 @@ static void buffer_append(struct domain *dom)
 	if ((size == 0) || (size > sizeof(intf->out)))
 		return;
 
-	if ((buffer->capacity - buffer->size) < size) {
-		buffer->capacity += (size + 1024);
-		buffer->data = realloc(buffer->data, buffer->capacity);
-		if (buffer->data == NULL) {
-			dolog(LOG_ERR, "Memory allocation failed");
-			exit(ENOMEM);
-		}
-	}
+	buffer_reserve(buffer, size);
 
 	while (cons != prod)
 		buffer->data[buffer->size++] = intf->out[
@@ -193,24 +597,7 @@ static void buffer_append(struct domain *dom)
 	 * no one is listening on the console pty then it will fill up
 	 * and handle_tty_write will stop being called.
 	 */
-	if (dom->log_fd != -1) {
-		int logret;
-		if (log_time_guest) {
-			logret = write_with_timestamp(
-				dom->log_fd,
-				buffer->data + buffer->size - size,
-				size, &log_time_guest_needts);
-		} else {
-			logret = write_all(
-				dom->log_fd,
-				buffer->data + buffer->size - size,
-				size);
-		}
-		if (logret < 0)
-			dolog(LOG_ERR, "Write to log failed "
-			      "on domain %d: %d (%s)\n",
-			      dom->domid, errno, strerror(errno));
-	}
+	domain_log(dom, buffer->data + buffer->size - size, size);
 
 	if (discard_overflowed_data && buffer->max_capacity &&
 	    buffer->size > 5 * buffer->max_capacity / 4) {
@@ -325,7 +712,7 @@ static int create_domain_log(struct domain *dom)
 	if (fd != -1 && log_time_guest) {
 		if (write_with_timestamp(fd, "Logfile Opened\n",
 					 strlen("Logfile Opened\n"),
-					 &log_time_guest_needts) < 0) {
+					 &dom->log_needts) < 0) {
 			dolog(LOG_ERR, "Failed to log opening timestamp "
 				       "in %s: %d (%s)", logfile, errno,
 				       strerror(errno));
@@ -339,6 +726,7 @@ static int create_domain_log(struct domain *dom)
 static void domain_close_tty(struct domain *dom)
 {
 	if (dom->master_fd != -1) {
+		pollsrc_set(&dom->master_src, -1, 0);
 		close(dom->master_fd);
 		dom->master_fd = -1;
 	}
@@ -585,8 +973,10 @@ static int domain_create_ring(struct domain *dom)
 
 	dom->local_port = -1;
 	dom->remote_port = -1;
-	if (dom->xce_handle != NULL)
+	if (dom->xce_handle != NULL) {
+		pollsrc_set(&dom->xce_src, -1, 0);
 		xenevtchn_close(dom->xce_handle);
+	}
 
 	/* Opening evtchn independently for each console is a bit
 	 * wasteful, but that's how the code is structured... */
@@ -676,13 +1066,19 @@ static struct domain *create_domain(int domid)
 	strcat(dom->conspath, "/console");
 
 	dom->master_fd = -1;
-	dom->master_pollfd_idx = -1;
+	dom->master_src.fd = -1;
+	dom->master_src.dom = dom;
 	dom->slave_fd = -1;
 	dom->log_fd = -1;
-	dom->xce_pollfd_idx = -1;
+	dom->log_needts = 1;
+	dom->xce_src.fd = -1;
+	dom->xce_src.dom = dom;
 
 	dom->next_period = ((long long)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000) + RATE_LIMIT_PERIOD;
 
+	dom->log_tokens = log_rate;
+	dom->log_tokens_at = dom->next_period - RATE_LIMIT_PERIOD;
+
 	dom->ring_ref = -1;
 	dom->local_port = -1;
 	dom->remote_port = -1;
@@ -730,8 +1126,11 @@ static void remove_domain(struct domain *dom)
 static void cleanup_domain(struct domain *d)
 {
 	domain_close_tty(d);
+	domain_del_timer(d);
 
 	if (d->log_fd != -1) {
+		domain_log_dropped(d);
+		domain_flush_log(d);
 		close(d->log_fd);
 		d->log_fd = -1;
 	}
@@ -739,6 +1138,9 @@ static void cleanup_domain(struct domain *d)
 	free(d->buffer.data);
 	d->buffer.data = NULL;
 
+	free(d->log_buffer.data);
+	d->log_buffer.data = NULL;
+
 	free(d->conspath);
 	d->conspath = NULL;
 
@@ -750,12 +1152,16 @@ static void shutdown_domain(struct domain *d)
 	d->is_dead = true;
 	watch_domain(d, false);
 	domain_unmap_interface(d);
-	if (d->xce_handle != NULL)
+	if (d->xce_handle != NULL) {
+		pollsrc_set(&d->xce_src, -1, 0);
 		xenevtchn_close(d->xce_handle);
+	}
 	d->xce_handle = NULL;
 }
 
 static unsigned enum_pass = 0;
+/* Set when enum_pass changed, see handle_domains_changed() */
+static bool domains_changed;
 
 static void enum_domains(void)
 {
@@ -764,6 +1170,7 @@ static void enum_domains(void)
 	struct domain *dom;
 
 	enum_pass++;
+	domains_changed = true;
 
 	while (xc_domain_getinfo(xc, domid, 1, &dominfo) == 1) {
 		dom = lookup_domain(dominfo.domid);
@@ -869,6 +1276,7 @@ static void handle_tty_write(struct domain *dom)
 static void handle_ring_read(struct domain *dom)
 {
 	xenevtchn_port_or_error_t port;
+	long long now;
 
 	if (dom->is_dead)
 		return;
@@ -876,12 +1284,152 @@ static void handle_ring_read(struct domain *dom)
 	if ((port = xenevtchn_pending(dom->xce_handle)) == -1)
 		return;
 
+	/* Start a new allowance if the last period is over. */
+	now = now_ms();
+	if ((now + 5) > dom->next_period) {
+		dom->next_period = now + RATE_LIMIT_PERIOD;
+		dom->event_count = 0;
+	}
+
 	dom->event_count++;
 
 	buffer_append(dom);
 
 	if (dom->event_count < RATE_LIMIT_ALLOWANCE)
 		(void)xenevtchn_unmask(dom->xce_handle, port);
+	else
+		domain_add_timer(dom);
+}
+
+/* Watch the fds of d for what it can do next. */
+static void domain_update_poll(struct domain *d)
+{
+	short events = 0;
+
+	if (d->xce_handle != NULL &&
+	    d->event_count < RATE_LIMIT_ALLOWANCE &&
+	    (discard_overflowed_data ||
+	     !d->buffer.max_capacity ||
+	     d->buffer.size < d->buffer.max_capacity))
+		events = POLLIN|POLLPRI;
+	pollsrc_set(&d->xce_src,
+		    d->xce_handle ? xenevtchn_fd(d->xce_handle) : -1, events);
+
+	events = 0;
+	if (d->master_fd != -1) {
+		if (!d->is_dead && ring_free_bytes(d))
+			events |= POLLIN;
+
+		if (!buffer_empty(&d->buffer))
+			events |= POLLOUT;
+
+		if (events)
+			events |= POLLPRI;
+	}
+	pollsrc_set(&d->master_src, d->master_fd, events);
+}
+
+static void handle_domain(struct domain *d)
+{
+	short revents;
+
+	revents = d->xce_src.revents;
+	if (d->event_count < RATE_LIMIT_ALLOWANCE &&
+	    d->xce_handle != NULL &&
+	    !(revents & ~(POLLIN|POLLOUT|POLLPRI)) &&
+	    (revents & POLLIN))
+		handle_ring_read(d);
+
+	revents = d->master_src.revents;
+	if (d->master_fd != -1 && revents) {
+		if (revents & ~(POLLIN|POLLOUT|POLLPRI))
+			domain_handle_broken_tty(d,
+					   domain_is_valid(d->domid));
+		else {
+			if (revents & POLLIN)
+				handle_tty_read(d);
+			if (revents & POLLOUT)
+				handle_tty_write(d);
+		}
+	}
+
+	d->xce_src.revents = d->master_src.revents = 0;
+
+	if (d->is_dead)
+		cleanup_domain(d);
+	else
+		domain_update_poll(d);
+}
+
+/* Shut down the domains which enum_domains() did not see any more. */
+static void handle_domains_changed(void)
+{
+	struct domain *d, *n;
+
+	for (d = dom_head; d; d = n) {
+		n = d->next;
+
+		if (d->last_seen != enum_pass)
+			shutdown_domain(d);
+
+		if (d->is_dead)
+			cleanup_domain(d);
+		else
+			domain_update_poll(d);
+	}
+}
+
+/*
+ * Lift expired rate limits and flush logs which are due.  Returns the
+ * poll timeout until the next deadline, in ms.
+ */
+static int handle_timers(void)
+{
+	struct domain *d, **pp;
+	long long now = now_ms(), next = -1, deadline;
+
+	for (pp = &timer_head; (d = *pp) != NULL; ) {
+		deadline = -1;
+
+		if (d->event_count >= RATE_LIMIT_ALLOWANCE) {
+			/* CS 16257:955ee4fa1345 introduces a 5ms fuzz
+			 * for select(), it is not clear poll() has
+			 * similar behavior (returning a couple of ms
+			 * sooner than requested) as well. Just leave
+			 * the fuzz here. Remove it with a separate
+			 * patch if necessary */
+			if ((now + 5) > d->next_period) {
+				d->next_period = now + RATE_LIMIT_PERIOD;
+				d->event_count = 0;
+				if (d->xce_handle != NULL)
+					(void)xenevtchn_unmask(d->xce_handle,
+							       d->local_port);
+				domain_update_poll(d);
+			} else
+				deadline = d->next_period;
+		}
+
+		if (d->log_flush_at) {
+			if (now >= d->log_flush_at)
+				domain_flush_log(d);
+			else if (deadline == -1 || d->log_flush_at < deadline)
+				deadline = d->log_flush_at;
+		}
+
+		if (deadline == -1) {
+			*pp = d->timer_next;
+			d->on_timer = false;
+			continue;
+		}
+
+		if (next == -1 || deadline < next)
+			next = deadline;
+		pp = &d->timer_next;
+	}
+
+	if (next == -1)
+		return -1;
+	return next > now ? next - now : 1;
 }
 
 static void handle_xs(void)
@@ -901,8 +1449,10 @@ static void handle_xs(void)
 		dom = lookup_domain(domid);
 		/* We may get watches firing for domains that have recently
 		   been removed, so dom may be NULL here. */
-		if (dom && dom->is_dead == false)
+		if (dom && dom->is_dead == false) {
 			domain_create_ring(dom);
+			domain_update_poll(dom);
+		}
 	}
 
 	free(vec);
@@ -914,6 +1464,8 @@ static void handle_hv_logs(xenevtchn_handle *xce_handle, bool force)
 	char *bufptr = buffer;
 	unsigned int size;
 	static uint32_t index = 0;
+	static bool started = false;
+	uint32_t lost;
 	xenevtchn_port_or_error_t port = -1;
 
 	if (!force && ((port = xenevtchn_pending(xce_handle)) == -1))
@@ -924,10 +1476,30 @@ static void handle_hv_logs(xenevtchn_handle *xce_handle, bool force)
 		int logret;
 
 		size = sizeof(buffer);
-		if (xc_readconsolering(xc, bufptr, &size, 0, 1, &index) != 0 ||
-		    size == 0)
+		if (xc_readconsolering_incr(xc, bufptr, &size, &index,
+					    &lost) != 0 || size == 0)
 			break;
 
+		/*
+		 * What was overwritten before the first read happened
+		 * before we started, and was never ours to lose.
+		 */
+		if (lost && started) {
+			char msg[80];
+			int len = snprintf(msg, sizeof(msg),
+					   "[xenconsoled: %u bytes of hypervisor "
+					   "log lost]\n", lost);
+
+			dolog(LOG_WARNING, "Lost %u bytes of hypervisor log",
+			      lost);
+			if (log_time_hv)
+				write_with_timestamp(log_hv_fd, msg, len,
+						     &log_time_hv_needts);
+			else
+				write_all(log_hv_fd, msg, len);
+		}
+		started = true;
+
 		if (log_time_hv)
 			logret = write_with_timestamp(log_hv_fd, buffer, size,
 						      &log_time_hv_needts);
@@ -948,8 +1520,10 @@ static void handle_log_reload(void)
 	if (log_guest) {
 		struct domain *d;
 		for (d = dom_head; d; d = d->next) {
-			if (d->log_fd != -1)
+			if (d->log_fd != -1) {
+				domain_flush_log(d);
 				close(d->log_fd);
+			}
 			d->log_fd = create_domain_log(d);
 		}
 	}
@@ -961,54 +1535,15 @@ static void handle_log_reload(void)
 	}
 }
 
-/* Returns index inside fds array if succees, -1 if fail */
-static int set_fds(int fd, short events)
-{
-	int ret;
-	if (current_array_size < nr_fds + 1) {
-		struct pollfd  *new_fds = NULL;
-		unsigned long newsize;
-
-		/* Round up to 2^8 boundary, in practice this just
-		 * make newsize larger than current_array_size.
-		 */
-		newsize = ROUNDUP(nr_fds + 1, 8);
-
-		new_fds = realloc(fds, sizeof(struct pollfd)*newsize);
-		if (!new_fds)
-			goto fail;
-		fds = new_fds;
-
-		memset(&fds[0] + current_array_size, 0,
-		       sizeof(struct pollfd) * (newsize-current_array_size));
-		current_array_size = newsize;
-	}
-
-	fds[nr_fds].fd = fd;
-	fds[nr_fds].events = events;
-	ret = nr_fds;
-	nr_fds++;
-
-	return ret;
-fail:
-	dolog(LOG_ERR, "realloc failed, ignoring fd %d\n", fd);
-	return -1;
-}
-
-static void reset_fds(void)
-{
-	nr_fds = 0;
-	if (fds)
-		memset(fds, 0, sizeof(struct pollfd) * current_array_size);
-}
-
 void handle_io(void)
 {
 	int ret;
 	xenevtchn_port_or_error_t log_hv_evtchn = -1;
-	int xce_pollfd_idx = -1;
-	int xs_pollfd_idx = -1;
 	xenevtchn_handle *xce_handle = NULL;
+	struct domain *d;
+
+	if (!pollsrc_init())
+		goto out;
 
 	if (log_hv) {
 		xce_handle = xenevtchn_open(NULL, 0);
@@ -1026,8 +1561,19 @@ void handle_io(void)
 			      "%d (%s)", errno, strerror(errno));
 			goto out;
 		}
+		if (log_hv_ring_size) {
+			uint32_t size = log_hv_ring_size;
+
+			if (xc_console_ring_resize(xc, &size))
+				dolog(LOG_WARNING, "Failed to resize the "
+				      "hypervisor console ring: %d (%s)",
+				      errno, strerror(errno));
+		}
 		/* Log the boot dmesg even if VIRQ_CON_RING isn't pending. */
 		handle_hv_logs(xce_handle, true);
+
+		pollsrc_set(&hv_src, xenevtchn_fd(xce_handle),
+			    POLLIN|POLLPRI);
 	}
 
 	xgt_handle = xengnttab_open(NULL, 0);
@@ -1036,85 +1582,17 @@ void handle_io(void)
 		      errno, strerror(errno));
 	}
 
+	pollsrc_set(&xs_src, xs_fileno(xs), POLLIN|POLLPRI);
+
 	enum_domains();
 
 	for (;;) {
-		struct domain *d, *n;
-		int poll_timeout; /* timeout in milliseconds */
-		struct timespec ts;
-		long long now, next_timeout = 0;
-
-		reset_fds();
-
-		xs_pollfd_idx = set_fds(xs_fileno(xs), POLLIN|POLLPRI);
-
-		if (log_hv)
-			xce_pollfd_idx = set_fds(xenevtchn_fd(xce_handle),
-						 POLLIN|POLLPRI);
-
-		if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
-			break;
-		now = ((long long)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
-
-		/* Re-calculate any event counter allowances & unblock
-		   domains with new allowance */
-		for (d = dom_head; d; d = d->next) {
-			/* CS 16257:955ee4fa1345 introduces a 5ms fuzz
-			 * for select(), it is not clear poll() has
-			 * similar behavior (returning a couple of ms
-			 * sooner than requested) as well. Just leave
-			 * the fuzz here. Remove it with a separate
-			 * patch if necessary */
-			if ((now+5) > d->next_period) {
-				d->next_period = now + RATE_LIMIT_PERIOD;
-				if (d->event_count >= RATE_LIMIT_ALLOWANCE) {
-					(void)xenevtchn_unmask(d->xce_handle, d->local_port);
-				}
-				d->event_count = 0;
-			}
+		if (domains_changed) {
+			domains_changed = false;
+			handle_domains_changed();
 		}
 
-		for (d = dom_head; d; d = d->next) {
-			if (d->event_count >= RATE_LIMIT_ALLOWANCE) {
-				/* Determine if we're going to be the next time slice to expire */
-				if (!next_timeout ||
-				    d->next_period < next_timeout)
-					next_timeout = d->next_period;
-			} else if (d->xce_handle != NULL) {
-				if (discard_overflowed_data ||
-				    !d->buffer.max_capacity ||
-				    d->buffer.size < d->buffer.max_capacity) {
-					int evtchn_fd = xenevtchn_fd(d->xce_handle);
-					d->xce_pollfd_idx = set_fds(evtchn_fd,
-								    POLLIN|POLLPRI);
-				}
-			}
-
-			if (d->master_fd != -1) {
-				short events = 0;
-				if (!d->is_dead && ring_free_bytes(d))
-					events |= POLLIN;
-
-				if (!buffer_empty(&d->buffer))
-					events |= POLLOUT;
-
-				if (events)
-					d->master_pollfd_idx =
-						set_fds(d->master_fd,
-							events|POLLPRI);
-			}
-		}
-
-		/* If any domain has been rate limited, we need to work
-		   out what timeout to supply to poll */
-		if (next_timeout) {
-			long long duration = (next_timeout - now);
-			if (duration <= 0) /* sanity check */
-				duration = 1;
-			poll_timeout = (int)duration;
-		}
-
-		ret = poll(fds, nr_fds, next_timeout ? poll_timeout : -1);
+		ret = pollsrc_wait(handle_timers());
 
 		if (log_reload) {
 			handle_log_reload();
@@ -1131,72 +1609,39 @@ void handle_io(void)
 			break;
 		}
 
-		if (log_hv && xce_pollfd_idx != -1) {
-			if (fds[xce_pollfd_idx].revents & ~(POLLIN|POLLOUT|POLLPRI)) {
+		if (hv_src.revents) {
+			if (hv_src.revents & ~(POLLIN|POLLOUT|POLLPRI)) {
 				dolog(LOG_ERR,
 				      "Failure in poll xce_handle: %d (%s)",
 				      errno, strerror(errno));
 				break;
-			} else if (fds[xce_pollfd_idx].revents & POLLIN)
+			} else if (hv_src.revents & POLLIN)
 				handle_hv_logs(xce_handle, false);
 
-			xce_pollfd_idx = -1;
+			hv_src.revents = 0;
 		}
 
-		if (ret <= 0)
-			continue;
-
-		if (xs_pollfd_idx != -1) {
-			if (fds[xs_pollfd_idx].revents & ~(POLLIN|POLLOUT|POLLPRI)) {
+		if (xs_src.revents) {
+			if (xs_src.revents & ~(POLLIN|POLLOUT|POLLPRI)) {
 				dolog(LOG_ERR,
 				      "Failure in poll xs_handle: %d (%s)",
 				      errno, strerror(errno));
 				break;
-			} else if (fds[xs_pollfd_idx].revents & POLLIN)
+			} else if (xs_src.revents & POLLIN)
 				handle_xs();
 
-			xs_pollfd_idx = -1;
+			xs_src.revents = 0;
 		}
 
-		for (d = dom_head; d; d = n) {
-			n = d->next;
-			if (d->event_count < RATE_LIMIT_ALLOWANCE) {
-				if (d->xce_handle != NULL &&
-				    d->xce_pollfd_idx != -1 &&
-				    !(fds[d->xce_pollfd_idx].revents &
-				      ~(POLLIN|POLLOUT|POLLPRI)) &&
-				      (fds[d->xce_pollfd_idx].revents &
-				       POLLIN))
-				    handle_ring_read(d);
-			}
-
-			if (d->master_fd != -1 && d->master_pollfd_idx != -1) {
-				if (fds[d->master_pollfd_idx].revents &
-				    ~(POLLIN|POLLOUT|POLLPRI))
-					domain_handle_broken_tty(d,
-						   domain_is_valid(d->domid));
-				else {
-					if (fds[d->master_pollfd_idx].revents &
-					    POLLIN)
-						handle_tty_read(d);
-					if (fds[d->master_pollfd_idx].revents &
-					    POLLOUT)
-						handle_tty_write(d);
-				}
-			}
-
-			d->xce_pollfd_idx = d->master_pollfd_idx = -1;
-
-			if (d->last_seen != enum_pass)
-				shutdown_domain(d);
-
-			if (d->is_dead)
-				cleanup_domain(d);
+		while ((d = ready_head) != NULL) {
+			ready_head = d->ready_next;
+			d->is_ready = false;
+			handle_domain(d);
 		}
 	}
 
-	free(fds);
-	current_array_size = 0;
+	for (d = dom_head; d; d = d->next)
+		domain_flush_log(d);
 
  out:
 	if (log_hv_fd != -1) {
@@ -1212,6 +1657,7 @@ void handle_io(void)
 		xgt_handle = NULL;
 	}
 	log_hv_evtchn = -1;
+	pollsrc_fini();
 }
 
 /*
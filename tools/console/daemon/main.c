@@ -40,6 +40,8 @@ int log_time_hv = 0;
 int log_time_guest = 0;
 char *log_dir = NULL;
 int discard_overflowed_data = 1;
+unsigned long log_rate = 0;
+unsigned long log_hv_ring_size = 0;
 
 static void handle_hup(int sig)
 {
@@ -48,7 +50,7 @@ static void handle_hup(int sig)
 
 static void usage(char *name)
 {
-	printf("Usage: %s [-h] [-V] [-v] [-i] [--log=none|guest|hv|all] [--log-dir=DIR] [--pid-file=PATH] [-t, --timestamp=none|guest|hv|all] [-o, --overflow-data=discard|keep]\n", name);
+	printf("Usage: %s [-h] [-V] [-v] [-i] [--log=none|guest|hv|all] [--log-dir=DIR] [--pid-file=PATH] [-t, --timestamp=none|guest|hv|all] [-o, --overflow-data=discard|keep] [--log-rate=BYTES] [--log-hv-ring=BYTES]\n", name);
 }
 
 static void version(char *name)
@@ -104,6 +106,8 @@ int main(int argc, char **argv)
 		{ "pid-file", 1, 0, 'p' },
 		{ "timestamp", 1, 0, 't' },
 		{ "overflow-data", 1, 0, 'o'},
+		{ "log-rate", 1, 0, 'b' },
+		{ "log-hv-ring", 1, 0, 'R' },
 		{ 0 },
 	};
 	bool is_interactive = false;
@@ -168,6 +172,12 @@ int main(int argc, char **argv)
 				discard_overflowed_data = 1;
 			}
 			break;
+		case 'b':
+			log_rate = strtoul(optarg, NULL, 0);
+			break;
+		case 'R':
+			log_hv_ring_size = strtoul(optarg, NULL, 0);
+			break;
 		case '?':
 			fprintf(stderr,
 				"Try `%s --help' for more information\n",
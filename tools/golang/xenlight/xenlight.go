@@ -19,7 +19,72 @@ package xenlight
 /*
 #cgo LDFLAGS: -lxenlight -lyajl -lxentoollog
 #include <stdlib.h>
+#include <string.h>
 #include <libxl.h>
+
+typedef struct {
+	uint32_t domid;
+	uint32_t vcpuid;
+	uint32_t cpu;
+	bool online, blocked, running;
+	uint64_t vcpu_time;
+} xenlight_vcpu_runstate;
+
+// The vcpus of all domains, collected in one go so that the caller only
+// crosses into C once.  The list is to be freed with free().
+static int xenlight_list_vcpu_runstate(libxl_ctx *ctx,
+				       xenlight_vcpu_runstate **list_out,
+				       int *nb_out)
+{
+	libxl_dominfo *doms;
+	libxl_vcpuinfo *vcpus;
+	xenlight_vcpu_runstate *list = NULL, *new;
+	int nb_dom, nb_vcpu, nr_cpus, i, j, n = 0, size = 0;
+
+	*list_out = NULL;
+	*nb_out = 0;
+
+	doms = libxl_list_domain(ctx, &nb_dom);
+	if (!doms)
+		return ERROR_FAIL;
+
+	for (i = 0; i < nb_dom; i++) {
+		vcpus = libxl_list_vcpu(ctx, doms[i].domid, &nb_vcpu, &nr_cpus);
+		// The domain may have gone away meanwhile.
+		if (!vcpus)
+			continue;
+
+		if (n + nb_vcpu > size) {
+			size = (n + nb_vcpu) * 2;
+			new = realloc(list, size * sizeof(*list));
+			if (!new) {
+				libxl_vcpuinfo_list_free(vcpus, nb_vcpu);
+				libxl_dominfo_list_free(doms, nb_dom);
+				free(list);
+				return ERROR_NOMEM;
+			}
+			list = new;
+		}
+
+		for (j = 0; j < nb_vcpu; j++, n++) {
+			list[n].domid = doms[i].domid;
+			list[n].vcpuid = vcpus[j].vcpuid;
+			list[n].cpu = vcpus[j].cpu;
+			list[n].online = vcpus[j].online;
+			list[n].blocked = vcpus[j].blocked;
+			list[n].running = vcpus[j].running;
+			list[n].vcpu_time = vcpus[j].vcpu_time;
+		}
+
+		libxl_vcpuinfo_list_free(vcpus, nb_vcpu);
+	}
+
+	libxl_dominfo_list_free(doms, nb_dom);
+
+	*list_out = list;
+	*nb_out = n;
+	return 0;
+}
 */
 import "C"
 
@@ -298,10 +363,17 @@ type Dominfo struct {
 func (cdi *C.libxl_dominfo) toGo() (di *Dominfo) {
 
 	di = &Dominfo{}
+	cdi.toGoInto(di)
+
+	return
+}
+
+// Fill in di, only allocating if the ssid label changed.
+func (cdi *C.libxl_dominfo) toGoInto(di *Dominfo) {
 	di.Uuid = Uuid(cdi.uuid)
 	di.Domid = Domid(cdi.domid)
 	di.Ssidref = uint32(cdi.ssidref)
-	di.SsidLabel = C.GoString(cdi.ssid_label)
+	di.SsidLabel = goStringReuse(cdi.ssid_label, di.SsidLabel)
 	di.Running = bool(cdi.running)
 	di.Blocked = bool(cdi.blocked)
 	di.Paused = bool(cdi.paused)
@@ -319,8 +391,21 @@ func (cdi *C.libxl_dominfo) toGo() (di *Dominfo) {
 	di.VcpuOnline = uint32(cdi.vcpu_online)
 	di.Cpupool = uint32(cdi.cpupool)
 	di.DomainType = int32(cdi.domain_type)
+}
 
-	return
+// C.GoString(cstr), but returns old rather than a copy if they are equal.
+func goStringReuse(cstr *C.char, old string) string {
+	if cstr == nil {
+		return ""
+	}
+
+	n := int(C.strlen(cstr))
+	b := (*[1 << 30]byte)(unsafe.Pointer(cstr))[:n:n]
+	if string(b) == old {
+		return old
+	}
+
+	return string(b)
 }
 
 // # Consistent with values defined in domctl.h
@@ -1089,6 +1174,39 @@ func (Ctx *Context) ListDomain() (glist []Dominfo) {
 	return
 }
 
+// ListDomainInto is ListDomain for callers polling lots of domains often.
+// The entries are filled into list's storage, which is returned extended
+// as needed, so that passing back the previous result makes a steady state
+// poll free of Go allocations.
+func (Ctx *Context) ListDomainInto(list []Dominfo) (glist []Dominfo, err error) {
+	glist = list[:0]
+
+	err = Ctx.CheckOpen()
+	if err != nil {
+		return
+	}
+
+	var nbDomain C.int
+	clist := C.libxl_list_domain(Ctx.ctx, &nbDomain)
+	if clist == nil {
+		err = ErrorFail
+		return
+	}
+	defer C.libxl_dominfo_list_free(clist, nbDomain)
+
+	gslice := (*[1 << 30]C.libxl_dominfo)(unsafe.Pointer(clist))[:nbDomain:nbDomain]
+	for i := range gslice {
+		if len(glist) < cap(glist) {
+			glist = glist[:len(glist)+1]
+		} else {
+			glist = append(glist, Dominfo{})
+		}
+		gslice[i].toGoInto(&glist[len(glist)-1])
+	}
+
+	return
+}
+
 type Vcpuinfo struct {
 	Vcpuid     uint32
 	Cpu        uint32
@@ -1141,6 +1259,60 @@ func (Ctx *Context) ListVcpu(id Domid) (glist []Vcpuinfo) {
 	return
 }
 
+// The scheduling state of a vcpu, as returned by ListVcpuRunstate.
+// Unlike Vcpuinfo it carries no cpumaps, which would need allocating.
+type VcpuRunstate struct {
+	Domid    Domid
+	Vcpuid   uint32
+	Cpu      uint32
+	Online   bool
+	Blocked  bool
+	Running  bool
+	VCpuTime time.Duration
+}
+
+// ListVcpuRunstate returns the vcpus of all domains, filled into list's
+// storage like ListDomainInto.  It costs a single call into C however
+// many domains there are.
+func (Ctx *Context) ListVcpuRunstate(list []VcpuRunstate) (glist []VcpuRunstate, err error) {
+	glist = list[:0]
+
+	err = Ctx.CheckOpen()
+	if err != nil {
+		return
+	}
+
+	var clist *C.xenlight_vcpu_runstate
+	var nbVcpu C.int
+
+	ret := C.xenlight_list_vcpu_runstate(Ctx.ctx, &clist, &nbVcpu)
+	if ret != 0 {
+		err = Error(-ret)
+		return
+	}
+	defer C.free(unsafe.Pointer(clist))
+
+	if int(nbVcpu) == 0 {
+		return
+	}
+
+	gslice := (*[1 << 28]C.xenlight_vcpu_runstate)(unsafe.Pointer(clist))[:nbVcpu:nbVcpu]
+	for i := range gslice {
+		crs := &gslice[i]
+		glist = append(glist, VcpuRunstate{
+			Domid:    Domid(crs.domid),
+			Vcpuid:   uint32(crs.vcpuid),
+			Cpu:      uint32(crs.cpu),
+			Online:   bool(crs.online),
+			Blocked:  bool(crs.blocked),
+			Running:  bool(crs.running),
+			VCpuTime: time.Duration(crs.vcpu_time),
+		})
+	}
+
+	return
+}
+
 type ConsoleType int
 
 const (
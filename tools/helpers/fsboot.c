@@ -0,0 +1,1292 @@
+/*
+ * fsboot: a native bootloader for PV guests
+ *
+ * Finds the grub2, extlinux or grub legacy configuration in a guest's
+ * disk image through libfsimage, like pygrub does, and copies out the
+ * kernel and ramdisk of the default (or requested) entry.  There is no
+ * interactive menu.  It takes pygrub's command line, so that it can be
+ * used as bootloader="fsboot" in place of pygrub.
+ *
+ * What got extracted is cached, keyed by the identity and modification
+ * time of the image and by the options, so that booting an unchanged image
+ * again only has to link the cached files into place.  Block devices don't
+ * tell when their contents change, so only images in regular files are
+ * cached.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <fsimage.h>
+
+#include "_paths.h"
+
+#define SECTOR_SIZE         512
+#define CONFIG_READ_MAX     (1 << 20)
+#define COPY_CHUNK          (1 << 20)
+#define CACHE_DIR           XEN_RUN_DIR "/fsboot-cache"
+#define CACHE_MAX           32
+#define MAX_PARTITIONS      128
+
+struct boot_entry {
+    char *title;
+    char *kernel;
+    char *initrd;
+    char *args;
+};
+
+struct boot_config {
+    struct boot_entry *entries;
+    int nr, size;
+    int def;                    /* Default entry, by index ... */
+    char *def_title;            /* ... or by title, if set. */
+};
+
+enum config_type { CONFIG_GRUB2, CONFIG_EXTLINUX, CONFIG_GRUB };
+
+static const struct {
+    const char *path;
+    enum config_type type;
+} config_files[] = {
+    { "/boot/grub/grub.cfg",            CONFIG_GRUB2 },
+    { "/grub/grub.cfg",                 CONFIG_GRUB2 },
+    { "/boot/grub2/grub.cfg",           CONFIG_GRUB2 },
+    { "/grub2/grub.cfg",                CONFIG_GRUB2 },
+    { "/boot/isolinux/isolinux.cfg",    CONFIG_EXTLINUX },
+    { "/boot/extlinux/extlinux.conf",   CONFIG_EXTLINUX },
+    { "/boot/extlinux.conf",            CONFIG_EXTLINUX },
+    { "/extlinux/extlinux.conf",        CONFIG_EXTLINUX },
+    { "/extlinux.conf",                 CONFIG_EXTLINUX },
+    { "/boot/grub/menu.lst",            CONFIG_GRUB },
+    { "/boot/grub/grub.conf",           CONFIG_GRUB },
+    { "/grub/menu.lst",                 CONFIG_GRUB },
+    { "/grub/grub.conf",                CONFIG_GRUB },
+};
+
+static bool debug;
+
+static void __attribute__((format(printf, 1, 2))) dbg(const char *fmt, ...)
+{
+    va_list ap;
+
+    if (!debug)
+        return;
+
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+}
+
+static void *xmalloc(size_t size)
+{
+    void *p = malloc(size);
+
+    if (!p) {
+        perror("malloc");
+        exit(1);
+    }
+    return p;
+}
+
+static char *xstrndup(const char *s, size_t n)
+{
+    char *p = strndup(s, n);
+
+    if (!p) {
+        perror("strndup");
+        exit(1);
+    }
+    return p;
+}
+
+static char *xstrdup(const char *s)
+{
+    return xstrndup(s, strlen(s));
+}
+
+static char * __attribute__((format(printf, 1, 2))) xasprintf(
+    const char *fmt, ...)
+{
+    va_list ap;
+    char *s;
+    int r;
+
+    va_start(ap, fmt);
+    r = vasprintf(&s, fmt, ap);
+    va_end(ap);
+    if (r < 0) {
+        perror("vasprintf");
+        exit(1);
+    }
+    return s;
+}
+
+/*----- partitions -----*/
+
+static int read_at(int fd, void *buf, size_t len, off_t off)
+{
+    ssize_t r = pread(fd, buf, len, off);
+
+    return r == len ? 0 : -1;
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t get_le64(const uint8_t *p)
+{
+    return get_le32(p) | ((uint64_t)get_le32(p + 4) << 32);
+}
+
+/*
+ * Work out where the file systems may start, as pygrub does: the image
+ * itself if it has no partition table, otherwise the MBR or GPT
+ * partitions, and also the image itself for a hybrid ISO.
+ */
+static int get_partition_offsets(const char *image, uint64_t *offs)
+{
+    uint8_t mbr[SECTOR_SIZE], hdr[SECTOR_SIZE], iso[5], *ent;
+    uint32_t i, j, nr_gpt, gpt_size;
+    int fd, nr = 0;
+
+    fd = open(image, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot open %s: %s\n", image, strerror(errno));
+        return -1;
+    }
+
+    if (read_at(fd, mbr, sizeof(mbr), 0) ||
+        mbr[0x1fe] != 0x55 || mbr[0x1ff] != 0xaa) {
+        offs[nr++] = 0;
+        goto out;
+    }
+
+    if (!read_at(fd, iso, sizeof(iso), 0x8001) && !memcmp(iso, "CD001", 5))
+        offs[nr++] = 0;
+
+    for (i = 0; i < 4; i++) {
+        const uint8_t *part = &mbr[446 + 16 * i];
+        uint64_t start = (uint64_t)get_le32(part + 8) * SECTOR_SIZE;
+
+        if (!start)
+            continue;
+
+        if (part[4] != 0xee) {
+            offs[nr++] = start;
+            continue;
+        }
+
+        /* Protective MBR: the partitions are in the GPT. */
+        if (read_at(fd, hdr, sizeof(hdr), SECTOR_SIZE))
+            continue;
+        nr_gpt = get_le32(hdr + 80);
+        gpt_size = get_le32(hdr + 84);
+        if (gpt_size < 40 || gpt_size > 4096)
+            continue;
+        ent = xmalloc(gpt_size);
+        for (j = 0; j < nr_gpt && nr < MAX_PARTITIONS; j++) {
+            off_t pos = get_le64(hdr + 72) * SECTOR_SIZE +
+                        (off_t)j * gpt_size;
+
+            if (read_at(fd, ent, gpt_size, pos))
+                break;
+            if (get_le64(ent + 32))
+                offs[nr++] = get_le64(ent + 32) * SECTOR_SIZE;
+        }
+        free(ent);
+        break;
+    }
+
+ out:
+    close(fd);
+    return nr;
+}
+
+/*----- configuration parsing -----*/
+
+static struct boot_entry *new_entry(struct boot_config *cfg, char *title)
+{
+    struct boot_entry *e;
+
+    if (cfg->nr == cfg->size) {
+        cfg->size = cfg->size ? cfg->size * 2 : 8;
+        cfg->entries = realloc(cfg->entries,
+                               cfg->size * sizeof(*cfg->entries));
+        if (!cfg->entries) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+
+    e = &cfg->entries[cfg->nr++];
+    memset(e, 0, sizeof(*e));
+    e->title = title;
+
+    return e;
+}
+
+static char *skip_space(char *s)
+{
+    while (isspace((unsigned char)*s))
+        s++;
+    return s;
+}
+
+/* Splits off the first word of *line, and leaves *line at the rest. */
+static char *next_word(char **line)
+{
+    char *s = skip_space(*line), *w = s;
+
+    while (*s && !isspace((unsigned char)*s))
+        s++;
+    if (*s)
+        *s++ = '\0';
+    *line = skip_space(s);
+
+    return w;
+}
+
+static char *unquote(char *s)
+{
+    size_t l = strlen(s);
+
+    if (l >= 2 && (s[0] == '"' || s[0] == '\'') && s[l - 1] == s[0]) {
+        s[l - 1] = '\0';
+        s++;
+    }
+    return s;
+}
+
+static void set_default(struct boot_config *cfg, char *val)
+{
+    char *end;
+    long n;
+
+    val = unquote(val);
+    free(cfg->def_title);
+    cfg->def_title = NULL;
+    cfg->def = 0;
+
+    /* Anything referring to grub's environment block boots the first. */
+    if (!*val || val[0] == '$' || !strcmp(val, "saved"))
+        return;
+
+    n = strtol(val, &end, 10);
+    if (end != val && (!*end || *end == '>'))
+        cfg->def = n;
+    else
+        cfg->def_title = xstrdup(val);
+}
+
+/* Strips grub legacy's "(hd0,0)" device from a path. */
+static char *grub_path(char *s)
+{
+    char *p;
+
+    if (*s == '(' && (p = strchr(s, ')')))
+        return p + 1;
+    return s;
+}
+
+static void parse_grub2(struct boot_config *cfg, char *buf)
+{
+    struct boot_entry *e = NULL;
+    int submenus = 0;
+    char *line, *next, *w, *title;
+
+    for (line = buf; line; line = next) {
+        next = strchr(line, '\n');
+        if (next)
+            *next++ = '\0';
+        line = skip_space(line);
+        if (!*line || *line == '#')
+            continue;
+
+        if (!strncmp(line, "menuentry", 9) && isspace(line[9])) {
+            line = skip_space(line + 9);
+            if (*line == '"' || *line == '\'') {
+                char *end = strchr(line + 1, *line);
+
+                title = xstrndup(line + 1, end ? end - line - 1
+                                               : strlen(line + 1));
+            } else {
+                title = xstrdup(next_word(&line));
+            }
+            e = new_entry(cfg, title);
+            continue;
+        }
+        if (!strncmp(line, "submenu", 7) && isspace(line[7])) {
+            submenus++;
+            continue;
+        }
+        if (*line == '}') {
+            if (e)
+                e = NULL;
+            else if (submenus)
+                submenus--;
+            continue;
+        }
+
+        w = next_word(&line);
+        if (!e) {
+            if (!strcmp(w, "set") && !strncmp(line, "default=", 8))
+                set_default(cfg, line + 8);
+            continue;
+        }
+
+        if (!strcmp(w, "linux") || !strcmp(w, "linux16") ||
+            !strcmp(w, "linuxefi")) {
+            free(e->kernel);
+            free(e->args);
+            e->kernel = xstrdup(next_word(&line));
+            e->args = xstrdup(line);
+        } else if (!strcmp(w, "initrd") || !strcmp(w, "initrd16") ||
+                   !strcmp(w, "initrdefi")) {
+            free(e->initrd);
+            e->initrd = xstrdup(next_word(&line));
+        }
+    }
+}
+
+static void parse_grub(struct boot_config *cfg, char *buf)
+{
+    struct boot_entry *e = NULL;
+    char *line, *next, *w, *p;
+
+    for (line = buf; line; line = next) {
+        next = strchr(line, '\n');
+        if (next)
+            *next++ = '\0';
+        line = skip_space(line);
+        if (!*line || *line == '#')
+            continue;
+
+        /* Commands may also be separated from their arguments by '='. */
+        for (p = line; *p && !isspace((unsigned char)*p); p++) {
+            if (*p == '=') {
+                *p = ' ';
+                break;
+            }
+        }
+
+        w = next_word(&line);
+        if (!strcmp(w, "title")) {
+            e = new_entry(cfg, xstrdup(line));
+        } else if (!strcmp(w, "default")) {
+            set_default(cfg, line);
+        } else if (e && !strcmp(w, "kernel")) {
+            free(e->kernel);
+            free(e->args);
+            e->kernel = xstrdup(grub_path(next_word(&line)));
+            e->args = xstrdup(line);
+        } else if (e && !strcmp(w, "initrd")) {
+            free(e->initrd);
+            e->initrd = xstrdup(grub_path(next_word(&line)));
+        }
+    }
+
+    /* grub legacy counts the default from 0, but titles aren't used. */
+    free(cfg->def_title);
+    cfg->def_title = NULL;
+}
+
+/* extlinux paths are relative to the directory of the configuration. */
+static char *extlinux_path(const char *cfgfile, const char *path)
+{
+    const char *slash = strrchr(cfgfile, '/');
+
+    if (*path == '/')
+        return xstrdup(path);
+    return xasprintf("%.*s/%s", (int)(slash - cfgfile), cfgfile, path);
+}
+
+static void parse_extlinux(struct boot_config *cfg, char *buf,
+                           const char *cfgfile)
+{
+    struct boot_entry *e = NULL;
+    char *line, *next, *w, *a;
+
+    for (line = buf; line; line = next) {
+        next = strchr(line, '\n');
+        if (next)
+            *next++ = '\0';
+        line = skip_space(line);
+        if (!*line || *line == '#')
+            continue;
+
+        w = next_word(&line);
+        if (!strcasecmp(w, "label")) {
+            e = new_entry(cfg, xstrdup(line));
+        } else if (!strcasecmp(w, "default")) {
+            set_default(cfg, line);
+        } else if (!e) {
+            continue;
+        } else if (!strcasecmp(w, "kernel") || !strcasecmp(w, "linux")) {
+            free(e->kernel);
+            e->kernel = extlinux_path(cfgfile, next_word(&line));
+        } else if (!strcasecmp(w, "initrd")) {
+            free(e->initrd);
+            e->initrd = extlinux_path(cfgfile, next_word(&line));
+        } else if (!strcasecmp(w, "append")) {
+            free(e->args);
+            e->args = xstrdup(line);
+            if ((a = strstr(e->args, "initrd=")) &&
+                (a == e->args || isspace((unsigned char)a[-1]))) {
+                char *end = a + 7;
+
+                while (*end && !isspace((unsigned char)*end))
+                    end++;
+                free(e->initrd);
+                *end = '\0';
+                e->initrd = extlinux_path(cfgfile, a + 7);
+                *end = ' ';
+            }
+        } else if (!strcasecmp(w, "menu") &&
+                   !strcasecmp(next_word(&line), "default")) {
+            free(cfg->def_title);
+            cfg->def_title = xstrdup(e->title);
+        }
+    }
+}
+
+/*----- file system access -----*/
+
+static char *read_file(fsi_t *fsi, const char *path, size_t max,
+                       size_t *len_r)
+{
+    fsi_file_t *f;
+    char *buf;
+    size_t len = 0;
+    ssize_t r;
+
+    f = fsi_open_file(fsi, path);
+    if (!f)
+        return NULL;
+
+    buf = xmalloc(max + 1);
+    while (len < max && (r = fsi_read_file(f, buf + len, max - len)) > 0)
+        len += r;
+    fsi_close_file(f);
+
+    buf[len] = '\0';
+    if (len_r)
+        *len_r = len;
+
+    return buf;
+}
+
+static bool find_config(fsi_t *fsi, struct boot_config *cfg)
+{
+    unsigned int i;
+    char *buf;
+
+    for (i = 0; i < sizeof(config_files) / sizeof(config_files[0]); i++) {
+        buf = read_file(fsi, config_files[i].path, CONFIG_READ_MAX, NULL);
+        if (!buf)
+            continue;
+
+        dbg("Using %s\n", config_files[i].path);
+        switch (config_files[i].type) {
+        case CONFIG_GRUB2:
+            parse_grub2(cfg, buf);
+            break;
+        case CONFIG_EXTLINUX:
+            parse_extlinux(cfg, buf, config_files[i].path);
+            break;
+        case CONFIG_GRUB:
+            parse_grub(cfg, buf);
+            break;
+        }
+        free(buf);
+
+        return true;
+    }
+
+    return false;
+}
+
+/* Copies a file out of the image into a new file in <dir>. */
+static char *extract_file(fsi_t *fsi, const char *path, const char *what,
+                          const char *dir)
+{
+    fsi_file_t *f;
+    char *out, *buf;
+    ssize_t r;
+    int fd;
+
+    f = fsi_open_file(fsi, path);
+    if (!f) {
+        fprintf(stderr, "Error opening %s in guest\n", path);
+        return NULL;
+    }
+
+    out = xasprintf("%s/boot_%s.XXXXXX", dir, what);
+    fd = mkstemp(out);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot create %s: %s\n", out, strerror(errno));
+        fsi_close_file(f);
+        free(out);
+        return NULL;
+    }
+
+    buf = xmalloc(COPY_CHUNK);
+    while ((r = fsi_read_file(f, buf, COPY_CHUNK)) > 0) {
+        if (write(fd, buf, r) != r) {
+            r = -1;
+            break;
+        }
+    }
+    free(buf);
+    fsi_close_file(f);
+
+    if (close(fd) || r < 0) {
+        fprintf(stderr, "Error writing temporary copy of %s\n", what);
+        unlink(out);
+        free(out);
+        return NULL;
+    }
+
+    return out;
+}
+
+/*----- cache -----*/
+
+static uint64_t fnv1a(const char *s)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    for (; *s; s++)
+        h = (h ^ (unsigned char)*s) * 0x100000001b3ULL;
+
+    return h;
+}
+
+/*
+ * Everything the result depends on.  ctime catches the contents being
+ * swapped with rename(), on top of the usual size and mtime.
+ */
+static char *cache_key(const struct stat *st, const char *offset,
+                       const char *entry, const char *kernel,
+                       const char *ramdisk, const char *args)
+{
+    return xasprintf("fsboot 1\ndev %"PRIx64"\nino %"PRIu64"\n"
+                     "size %"PRId64"\nmtime %"PRId64".%09ld\n"
+                     "ctime %"PRId64".%09ld\noffset %s\nentry %s\n"
+                     "kernel %s\nramdisk %s\nargs %s\n",
+                     (uint64_t)st->st_dev, (uint64_t)st->st_ino,
+                     (int64_t)st->st_size,
+                     (int64_t)st->st_mtim.tv_sec, st->st_mtim.tv_nsec,
+                     (int64_t)st->st_ctim.tv_sec, st->st_ctim.tv_nsec,
+                     offset ?: "", entry ?: "", kernel ?: "",
+                     ramdisk ?: "", args ?: "");
+}
+
+static char *read_small_file(const char *path)
+{
+    struct stat st;
+    char *buf = NULL;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    if (!fstat(fd, &st) && st.st_size < CONFIG_READ_MAX) {
+        buf = xmalloc(st.st_size + 1);
+        if (read(fd, buf, st.st_size) != st.st_size) {
+            free(buf);
+            buf = NULL;
+        } else {
+            buf[st.st_size] = '\0';
+        }
+    }
+    close(fd);
+
+    return buf;
+}
+
+static int write_small_file(const char *path, const char *s)
+{
+    size_t len = strlen(s);
+    int fd, rc = 0;
+
+    fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0600);
+    if (fd < 0)
+        return -1;
+    if (write(fd, s, len) != len)
+        rc = -1;
+    if (close(fd))
+        rc = -1;
+
+    return rc;
+}
+
+/* Hard links <src> as <dst>, or copies it if they're on different fs. */
+static int link_or_copy(const char *src, const char *dst)
+{
+    char *buf;
+    ssize_t r;
+    int in, out;
+
+    if (!link(src, dst))
+        return 0;
+    if (errno != EXDEV && errno != EPERM)
+        return -1;
+
+    in = open(src, O_RDONLY);
+    if (in < 0)
+        return -1;
+    out = open(dst, O_WRONLY | O_CREAT | O_EXCL, 0600);
+    if (out < 0) {
+        close(in);
+        return -1;
+    }
+
+    buf = xmalloc(COPY_CHUNK);
+    while ((r = read(in, buf, COPY_CHUNK)) > 0)
+        if (write(out, buf, r) != r) {
+            r = -1;
+            break;
+        }
+    free(buf);
+    close(in);
+    if (close(out) || r < 0) {
+        unlink(dst);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Puts a cached file into <dir> under a name of its own. */
+static char *cache_output(const char *src, const char *what,
+                          const char *dir)
+{
+    char *out = xasprintf("%s/boot_%s.XXXXXX", dir, what);
+    int fd = mkstemp(out);
+
+    if (fd < 0) {
+        free(out);
+        return NULL;
+    }
+    close(fd);
+    unlink(out);
+
+    if (link_or_copy(src, out)) {
+        free(out);
+        return NULL;
+    }
+
+    return out;
+}
+
+static void cache_remove(const char *entry)
+{
+    static const char *const files[] = { "key", "kernel", "ramdisk", "args" };
+    unsigned int i;
+    char *p;
+
+    for (i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        p = xasprintf("%s/%s", entry, files[i]);
+        unlink(p);
+        free(p);
+    }
+    rmdir(entry);
+}
+
+/* Keeps the CACHE_MAX most recently used entries. */
+static void cache_prune(const char *cache_dir)
+{
+    struct dirent *d;
+    struct stat st;
+    time_t oldest;
+    char *p, *victim;
+    int nr;
+    DIR *dir;
+
+    for (;;) {
+        dir = opendir(cache_dir);
+        if (!dir)
+            return;
+
+        nr = 0;
+        oldest = 0;
+        victim = NULL;
+        while ((d = readdir(dir))) {
+            if (d->d_name[0] == '.')
+                continue;
+            p = xasprintf("%s/%s", cache_dir, d->d_name);
+            if (stat(p, &st) || !S_ISDIR(st.st_mode)) {
+                free(p);
+                continue;
+            }
+            nr++;
+            if (!victim || st.st_mtime < oldest) {
+                free(victim);
+                victim = p;
+                oldest = st.st_mtime;
+            } else {
+                free(p);
+            }
+        }
+        closedir(dir);
+
+        if (nr <= CACHE_MAX) {
+            free(victim);
+            return;
+        }
+
+        dbg("Dropping cache entry %s\n", victim);
+        cache_remove(victim);
+        free(victim);
+    }
+}
+
+static bool cache_lookup(const char *cache_dir, const char *key,
+                         const char *out_dir, char **kernel,
+                         char **ramdisk, char **args)
+{
+    char *entry, *p, *s;
+    bool hit = false;
+
+    entry = xasprintf("%s/%016"PRIx64, cache_dir, fnv1a(key));
+
+    p = xasprintf("%s/key", entry);
+    s = read_small_file(p);
+    free(p);
+    if (!s || strcmp(s, key))
+        goto out;
+
+    p = xasprintf("%s/kernel", entry);
+    *kernel = cache_output(p, "kernel", out_dir);
+    free(p);
+    if (!*kernel)
+        goto out;
+
+    p = xasprintf("%s/ramdisk", entry);
+    if (!access(p, F_OK)) {
+        *ramdisk = cache_output(p, "ramdisk", out_dir);
+        if (!*ramdisk) {
+            unlink(*kernel);
+            free(*kernel);
+            *kernel = NULL;
+            free(p);
+            goto out;
+        }
+    }
+    free(p);
+
+    p = xasprintf("%s/args", entry);
+    *args = read_small_file(p);
+    free(p);
+
+    /* The entry's mtime tells how recently it was used. */
+    utimes(entry, NULL);
+    hit = true;
+    dbg("Using cached %s\n", entry);
+
+ out:
+    free(s);
+    free(entry);
+    return hit;
+}
+
+/*
+ * The entry is assembled under a temporary name and then renamed, so that
+ * concurrent boots of the same image never see it half written.
+ */
+static void cache_store(const char *cache_dir, const char *key,
+                        const char *kernel, const char *ramdisk,
+                        const char *args)
+{
+    char *entry, *tmp, *p;
+    int rc;
+
+    if (mkdir(cache_dir, 0700) && errno != EEXIST)
+        return;
+
+    entry = xasprintf("%s/%016"PRIx64, cache_dir, fnv1a(key));
+    tmp = xasprintf("%s/.new.%016"PRIx64".%d", cache_dir, fnv1a(key),
+                    (int)getpid());
+    if (mkdir(tmp, 0700))
+        goto out;
+
+    p = xasprintf("%s/kernel", tmp);
+    rc = link_or_copy(kernel, p);
+    free(p);
+    if (!rc && ramdisk) {
+        p = xasprintf("%s/ramdisk", tmp);
+        rc = link_or_copy(ramdisk, p);
+        free(p);
+    }
+    if (!rc && args) {
+        p = xasprintf("%s/args", tmp);
+        rc = write_small_file(p, args);
+        free(p);
+    }
+    if (!rc) {
+        p = xasprintf("%s/key", tmp);
+        rc = write_small_file(p, key);
+        free(p);
+    }
+
+    /* Replace an entry of an image with the same hash, but not its key. */
+    if (!rc && rename(tmp, entry)) {
+        cache_remove(entry);
+        rc = rename(tmp, entry);
+    }
+    if (rc)
+        cache_remove(tmp);
+    else
+        cache_prune(cache_dir);
+
+ out:
+    free(tmp);
+    free(entry);
+}
+
+/*----- main -----*/
+
+static int mkdir_p(const char *path)
+{
+    char *p = xstrdup(path), *s = p;
+    int rc = 0;
+
+    do {
+        s = *s ? strchr(s + 1, '/') : NULL;
+        if (s)
+            *s = '\0';
+        if (mkdir(p, 0700) && errno != EEXIST)
+            rc = -1;
+        if (s)
+            *s = '/';
+    } while (s && !rc);
+    free(p);
+
+    return rc;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-q|--quiet] [-l|--list-entries] [-n|--not-really]\n"
+            "       [--output=] [--output-format=sxp|simple|simple0]\n"
+            "       [--output-directory=] [--offset=] [--entry=]\n"
+            "       [--kernel=] [--ramdisk=] [--args=]\n"
+            "       [--cache-dir=] [--no-cache] [--debug] <image>\n",
+            prog);
+}
+
+static int select_entry(const struct boot_config *cfg, const char *entry)
+{
+    const char *title = entry ?: cfg->def_title;
+    char *end;
+    long n;
+    int i;
+
+    if (entry) {
+        n = strtol(entry, &end, 10);
+        if (end != entry && !*end)
+            return n >= 0 && n < cfg->nr ? n : 0;
+    }
+
+    if (title)
+        for (i = 0; i < cfg->nr; i++)
+            if (!strcmp(cfg->entries[i].title, title))
+                return i;
+
+    return cfg->def >= 0 && cfg->def < cfg->nr ? cfg->def : 0;
+}
+
+static void list_config(const struct boot_config *cfg)
+{
+    int i;
+
+    for (i = 0; i < cfg->nr; i++) {
+        const struct boot_entry *e = &cfg->entries[i];
+
+        printf("title: %s\n", e->title);
+        printf("  kernel: %s\n", e->kernel ?: "");
+        printf("  args: %s\n", e->args ?: "");
+        printf("  initrd: %s\n", e->initrd ?: "");
+    }
+}
+
+static void free_config(struct boot_config *cfg)
+{
+    int i;
+
+    for (i = 0; i < cfg->nr; i++) {
+        free(cfg->entries[i].title);
+        free(cfg->entries[i].kernel);
+        free(cfg->entries[i].initrd);
+        free(cfg->entries[i].args);
+    }
+    free(cfg->entries);
+    free(cfg->def_title);
+    memset(cfg, 0, sizeof(*cfg));
+}
+
+/* Substitutes the zfs boot file system, as found by libfsimage. */
+static char *zfs_args(fsi_t *fsi, char *args)
+{
+    const char *bootfs = fsi_fs_bootstring(fsi);
+    char *p, *end, *s;
+
+    if (!bootfs || !args)
+        return args;
+
+    p = strstr(args, "zfs-bootfs=");
+    if (!p) {
+        s = xasprintf("%s -B %s", args, bootfs);
+    } else {
+        for (end = p; *end && !isspace((unsigned char)*end) &&
+                      *end != ',' && *end != '"'; end++)
+            ;
+        s = xasprintf("%.*s%s%s", (int)(p - args), args, bootfs, end);
+    }
+    free(args);
+
+    return s;
+}
+
+/* Appends <item> and <sep> to the output in <buf>. */
+static void add_output(char **buf, size_t *len, const char *item, char sep)
+{
+    size_t l = strlen(item);
+
+    *buf = realloc(*buf, *len + l + 1);
+    if (!*buf) {
+        perror("realloc");
+        exit(1);
+    }
+    memcpy(*buf + *len, item, l);
+    (*buf)[*len + l] = sep;
+    *len += l + 1;
+}
+
+static char *format_output(const char *format, const char *kernel,
+                           const char *ramdisk, const char *args,
+                           size_t *len)
+{
+    char sep = !strcmp(format, "simple0") ? '\0' : '\n';
+    char *buf = NULL, *item;
+
+    if (!strcmp(format, "sxp")) {
+        buf = xasprintf("linux (kernel '%s')%s%s%s%s%s%s", kernel,
+                        ramdisk ? "(ramdisk '" : "", ramdisk ?: "",
+                        ramdisk ? "')" : "", args ? "(args '" : "",
+                        args ?: "", args ? "')" : "");
+        *len = strlen(buf);
+        return buf;
+    }
+
+    /* strchr() would find the terminating NUL. */
+    if (sep && ((ramdisk && strchr(ramdisk, sep)) ||
+                (args && strchr(args, sep)) || strchr(kernel, sep))) {
+        fprintf(stderr, "simple format cannot represent "
+                "delimiter-containing value\n");
+        return NULL;
+    }
+
+    *len = 0;
+    item = xasprintf("kernel %s", kernel);
+    add_output(&buf, len, item, sep);
+    free(item);
+    if (ramdisk) {
+        item = xasprintf("ramdisk %s", ramdisk);
+        add_output(&buf, len, item, sep);
+        free(item);
+    }
+    if (args) {
+        item = xasprintf("args %s", args);
+        add_output(&buf, len, item, sep);
+        free(item);
+    }
+    add_output(&buf, len, "", sep);
+
+    return buf;
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option opts[] = {
+        { "quiet",            no_argument,       NULL, 'q' },
+        { "interactive",      no_argument,       NULL, 'i' },
+        { "list-entries",     no_argument,       NULL, 'l' },
+        { "not-really",       no_argument,       NULL, 'n' },
+        { "help",             no_argument,       NULL, 'h' },
+        { "output",           required_argument, NULL, 'o' },
+        { "output-format",    required_argument, NULL, 'f' },
+        { "output-directory", required_argument, NULL, 'd' },
+        { "offset",           required_argument, NULL, 'O' },
+        { "entry",            required_argument, NULL, 'e' },
+        { "kernel",           required_argument, NULL, 'k' },
+        { "ramdisk",          required_argument, NULL, 'r' },
+        { "args",             required_argument, NULL, 'a' },
+        { "cache-dir",        required_argument, NULL, 'c' },
+        { "no-cache",         no_argument,       NULL, 'C' },
+        { "debug",            no_argument,       NULL, 'D' },
+        { NULL, 0, NULL, 0 }
+    };
+    const char *output = NULL, *format = "sxp";
+    const char *out_dir = XEN_RUN_DIR "/pygrub", *cache_dir = CACHE_DIR;
+    const char *offset = NULL, *entry = NULL;
+    const char *in_kernel = NULL, *in_ramdisk = NULL, *in_args = NULL;
+    bool list = false, not_really = false, use_cache = true;
+    char *kernel = NULL, *ramdisk = NULL, *args = NULL, *key = NULL;
+    char *options = NULL, *out, *end;
+    uint64_t offs[MAX_PARTITIONS + 1];
+    struct boot_config cfg = { 0 };
+    const struct boot_entry *e;
+    fsi_t *fsi = NULL;
+    struct stat st;
+    size_t len;
+    int c, i, nr, fd, rc = 1;
+
+    while ((c = getopt_long(argc, argv, "qilnh", opts, NULL)) != -1) {
+        switch (c) {
+        case 'q':
+            break;
+        case 'i':
+            fprintf(stderr, "No interactive menu, booting the default\n");
+            break;
+        case 'l':
+            list = true;
+            break;
+        case 'n':
+            not_really = true;
+            break;
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        case 'o':
+            output = optarg;
+            break;
+        case 'f':
+            if (strcmp(optarg, "sxp") && strcmp(optarg, "simple") &&
+                strcmp(optarg, "simple0")) {
+                fprintf(stderr, "unknown output format %s\n", optarg);
+                usage(argv[0]);
+                return 1;
+            }
+            format = optarg;
+            break;
+        case 'd':
+            out_dir = optarg;
+            break;
+        case 'O':
+            strtoull(optarg, &end, 0);
+            if (end == optarg || *end) {
+                fprintf(stderr, "offset value must be an integer\n");
+                usage(argv[0]);
+                return 1;
+            }
+            offset = optarg;
+            break;
+        case 'e':
+            entry = optarg;
+            break;
+        case 'k':
+            in_kernel = optarg;
+            break;
+        case 'r':
+            in_ramdisk = optarg;
+            break;
+        case 'a':
+            in_args = optarg;
+            break;
+        case 'c':
+            cache_dir = optarg;
+            break;
+        case 'C':
+            use_cache = false;
+            break;
+        case 'D':
+            debug = true;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (stat(argv[optind], &st)) {
+        fprintf(stderr, "Cannot access %s: %s\n", argv[optind],
+                strerror(errno));
+        return 1;
+    }
+
+    if (!list && !not_really && mkdir_p(out_dir)) {
+        fprintf(stderr, "Cannot create %s: %s\n", out_dir, strerror(errno));
+        return 1;
+    }
+
+    if (use_cache && !list && !not_really && S_ISREG(st.st_mode)) {
+        key = cache_key(&st, offset, entry, in_kernel, in_ramdisk, in_args);
+        if (cache_lookup(cache_dir, key, out_dir, &kernel, &ramdisk, &args))
+            goto output;
+    }
+
+    /* The zfs boot file system may be passed as an argument. */
+    if (in_args && (out = strstr(in_args, "zfs-bootfs="))) {
+        out += 11;
+        for (end = out; *end && !isspace((unsigned char)*end) &&
+                        *end != ',' && *end != '"'; end++)
+            ;
+        options = xstrndup(out, end - out);
+    }
+
+    if (offset) {
+        offs[0] = strtoull(offset, NULL, 0);
+        nr = 1;
+    } else {
+        nr = get_partition_offsets(argv[optind], offs);
+    }
+
+    for (i = 0, e = NULL; i < nr; i++) {
+        fsi = fsi_open_fsimage(argv[optind], offs[i], options ?: "");
+        if (!fsi)
+            continue;
+
+        if (in_kernel) {
+            if (fsi_file_exists(fsi, in_kernel))
+                break;
+        } else if (find_config(fsi, &cfg)) {
+            if (list)
+                list_config(&cfg);
+            if (cfg.nr) {
+                e = &cfg.entries[select_entry(&cfg, entry)];
+                if (e->kernel && fsi_file_exists(fsi, e->kernel))
+                    break;
+                fprintf(stderr, "Kernel %s of entry \"%s\" not found\n",
+                        e->kernel ?: "(none)", e->title);
+                e = NULL;
+            }
+            free_config(&cfg);
+        }
+
+        fsi_close_fsimage(fsi);
+        fsi = NULL;
+    }
+
+    if (list) {
+        rc = 0;
+        goto out;
+    }
+
+    if (!fsi) {
+        fprintf(stderr, "Unable to find partition containing kernel\n");
+        goto out;
+    }
+
+    if (in_kernel) {
+        kernel = xstrdup(in_kernel);
+        ramdisk = in_ramdisk ? xstrdup(in_ramdisk) : NULL;
+        args = in_args ? xstrdup(in_args) : NULL;
+    } else {
+        kernel = xstrdup(e->kernel);
+        ramdisk = e->initrd ? xstrdup(e->initrd) : NULL;
+        if (e->args && in_args)
+            args = xasprintf("%s %s", e->args, in_args);
+        else if (e->args || in_args)
+            args = xstrdup(e->args ?: in_args);
+    }
+    args = zfs_args(fsi, args);
+
+    if (not_really) {
+        out = xasprintf("<kernel:%s>", kernel);
+        free(kernel);
+        kernel = out;
+        if (ramdisk) {
+            out = xasprintf("<ramdisk:%s>", ramdisk);
+            free(ramdisk);
+            ramdisk = out;
+        }
+        goto output;
+    }
+
+    out = extract_file(fsi, kernel, "kernel", out_dir);
+    free(kernel);
+    kernel = out;
+    if (!kernel)
+        goto out;
+
+    if (ramdisk) {
+        out = extract_file(fsi, ramdisk, "ramdisk", out_dir);
+        free(ramdisk);
+        ramdisk = out;
+        if (!ramdisk) {
+            unlink(kernel);
+            goto out;
+        }
+    }
+
+    if (key)
+        cache_store(cache_dir, key, kernel, ramdisk, args);
+
+ output:
+    out = format_output(format, kernel, ramdisk, args, &len);
+    if (!out)
+        goto out;
+
+    if (!output || !strcmp(output, "-"))
+        fd = STDOUT_FILENO;
+    else
+        fd = open(output, O_WRONLY | O_CREAT, 0600);
+    if (fd < 0 || write(fd, out, len) != len) {
+        fprintf(stderr, "Cannot write %s: %s\n", output ?: "output",
+                strerror(errno));
+    } else {
+        rc = 0;
+    }
+    if (fd > STDOUT_FILENO)
+        close(fd);
+    free(out);
+
+ out:
+    if (fsi)
+        fsi_close_fsimage(fsi);
+    free_config(&cfg);
+    free(kernel);
+    free(ramdisk);
+    free(args);
+    free(options);
+    free(key);
+
+    return rc;
+}
@@ -52,12 +52,18 @@ fsi_t *fsi_open_fsimage(const char *path, uint64_t off, const char *options)
 	fsi->f_off = off;
 	fsi->f_data = NULL;
 	fsi->f_bootstring = NULL;
+	bzero(fsi->f_blks, sizeof (fsi->f_blks));
+	fsi->f_tick = 0;
+	fsi->f_ra_next = 0;
+	fsi->f_ra_win = 1;
 
 	pthread_mutex_lock(&fsi_lock);
 	err = find_plugin(fsi, path, options);
 	pthread_mutex_unlock(&fsi_lock);
-	if (err != 0)
+	if (err != 0) {
+		fsi_cache_free(fsi);
 		goto fail;
+	}
 
 	return (fsi);
 
@@ -75,6 +81,7 @@ void fsi_close_fsimage(fsi_t *fsi)
 	pthread_mutex_lock(&fsi_lock);
         fsi->f_plugin->fp_ops->fpo_umount(fsi);
         (void) close(fsi->f_fd);
+	fsi_cache_free(fsi);
 	free(fsi);
 	pthread_mutex_unlock(&fsi_lock);
 }
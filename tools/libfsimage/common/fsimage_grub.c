@@ -158,48 +158,18 @@ int
 fsig_devread(fsi_file_t *ffi, unsigned int sector, unsigned int offset,
     unsigned int bufsize, char *buf)
 {
-	off_t off;
+	uint64_t off;
 	ssize_t ret;
-	int n, r;
-	char tmp[SECTOR_SIZE];
 
-	off = ffi->ff_fsi->f_off + ((off_t)sector * SECTOR_SIZE) + offset;
+	off = ((uint64_t)sector * SECTOR_SIZE) + offset;
 
 	/*
-	 * Make reads from a raw disk sector-aligned. This is a requirement
-	 * for NetBSD. Split the read up into to three parts to meet this
-	 * requirement.
+	 * The block cache only issues reads aligned on FSI_BLKSIZE, which
+	 * keeps raw disks happy (a requirement on NetBSD).
 	 */
-
-	n = (off & (SECTOR_SIZE - 1));
-	if (n > 0) {
-		r = SECTOR_SIZE - n;
-		if (r > bufsize)
-			r = bufsize;
-		ret = pread(ffi->ff_fsi->f_fd, tmp, SECTOR_SIZE, off - n);
-		if (ret < n + r)
-			return (0);
-		memcpy(buf, tmp + n, r);
-		buf += r;
-		bufsize -= r;
-		off += r;
-	}
-
-	n = (bufsize & ~(SECTOR_SIZE - 1));
-	if (n > 0) {
-		ret = pread(ffi->ff_fsi->f_fd, buf, n, off);
-		if (ret < n)
-			return (0);
-		buf += n;
-		bufsize -= n;
-		off += n;
-	}
-	if (bufsize > 0) {
-		ret = pread(ffi->ff_fsi->f_fd, tmp, SECTOR_SIZE, off);
-		if (ret < bufsize)
-			return (0);
-		memcpy(buf, tmp, bufsize);
-	}
+	ret = fsip_pread(ffi->ff_fsi, buf, bufsize, off);
+	if (ret < 0 || (size_t)ret != bufsize)
+		return (0);
 
 	return (1);
 }
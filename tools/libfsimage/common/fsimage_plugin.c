@@ -21,8 +21,10 @@
  * Use is subject to license terms.
  */
 
+#include <sys/uio.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <unistd.h>
 #include <strings.h>
 #include <string.h>
 #include <dirent.h>
@@ -78,6 +80,147 @@ fsip_fs_data(fsi_t *fsi)
 	return (fsi->f_data);
 }
 
+static struct fsi_blk *
+fsi_blk_find(fsi_t *fsi, uint64_t blk)
+{
+	int i;
+
+	for (i = 0; i < FSI_NBLKS; i++) {
+		struct fsi_blk *b = &fsi->f_blks[i];
+
+		if (b->fb_len != 0 && b->fb_blk == blk)
+			return (b);
+	}
+
+	return (NULL);
+}
+
+/*
+ * Evict the least recently used block. It is marked as just used, so that
+ * picking several victims in a row never hands out the same one twice.
+ */
+static struct fsi_blk *
+fsi_blk_victim(fsi_t *fsi)
+{
+	struct fsi_blk *b = &fsi->f_blks[0];
+	int i;
+
+	for (i = 1; i < FSI_NBLKS; i++) {
+		if (fsi->f_blks[i].fb_used < b->fb_used)
+			b = &fsi->f_blks[i];
+	}
+
+	b->fb_len = 0;
+	b->fb_used = ++fsi->f_tick;
+	return (b);
+}
+
+/*
+ * Read blk from the device, along with as many of the following blocks
+ * as the readahead window allows. The window doubles for every miss that
+ * continues where the previous one stopped, and falls back to a single
+ * block on random access.
+ */
+static struct fsi_blk *
+fsi_blk_fill(fsi_t *fsi, uint64_t blk)
+{
+	struct fsi_blk *b[FSI_RA_MAX];
+	struct iovec iov[FSI_RA_MAX];
+	unsigned int i, n;
+	ssize_t ret;
+
+	if (blk == fsi->f_ra_next && fsi->f_ra_win < FSI_RA_MAX)
+		fsi->f_ra_win *= 2;
+	else if (blk != fsi->f_ra_next)
+		fsi->f_ra_win = 1;
+
+	for (n = 0; n < fsi->f_ra_win; n++) {
+		if (n > 0 && fsi_blk_find(fsi, blk + n) != NULL)
+			break;
+		b[n] = fsi_blk_victim(fsi);
+		if (b[n]->fb_data == NULL &&
+		    (b[n]->fb_data = malloc(FSI_BLKSIZE)) == NULL)
+			break;
+		iov[n].iov_base = b[n]->fb_data;
+		iov[n].iov_len = FSI_BLKSIZE;
+	}
+
+	if (n == 0) {
+		errno = ENOMEM;
+		return (NULL);
+	}
+
+	do {
+		ret = preadv(fsi->f_fd, iov, n, (off_t)(blk * FSI_BLKSIZE));
+	} while (ret == -1 && errno == EINTR);
+
+	if (ret == -1)
+		return (NULL);
+
+	for (i = 0; i < n; i++) {
+		size_t len = ret > FSI_BLKSIZE ? FSI_BLKSIZE : ret;
+
+		b[i]->fb_blk = blk + i;
+		b[i]->fb_len = len;
+		ret -= len;
+	}
+
+	fsi->f_ra_next = blk + n;
+	return (b[0]);
+}
+
+/*
+ * Read from the image through its block cache. off is relative to the
+ * start of the filesystem. Must be called with fsi_lock held, which is
+ * the case for all plugin operations.
+ */
+ssize_t
+fsip_pread(fsi_t *fsi, void *buf, size_t nbytes, uint64_t off)
+{
+	char *p = buf;
+	size_t done = 0;
+
+	off += fsi->f_off;
+
+	while (done < nbytes) {
+		uint64_t blk = off / FSI_BLKSIZE;
+		size_t boff = off % FSI_BLKSIZE;
+		struct fsi_blk *b;
+		size_t len;
+
+		if ((b = fsi_blk_find(fsi, blk)) == NULL &&
+		    (b = fsi_blk_fill(fsi, blk)) == NULL)
+			return (done > 0 ? (ssize_t)done : -1);
+
+		b->fb_used = ++fsi->f_tick;
+
+		/* A short block is the end of the device. */
+		if (boff >= b->fb_len)
+			break;
+
+		len = b->fb_len - boff;
+		if (len > nbytes - done)
+			len = nbytes - done;
+		memcpy(p + done, b->fb_data + boff, len);
+		done += len;
+		off += len;
+
+		if (b->fb_len < FSI_BLKSIZE)
+			break;
+	}
+
+	return ((ssize_t)done);
+}
+
+void
+fsi_cache_free(fsi_t *fsi)
+{
+	int i;
+
+	for (i = 0; i < FSI_NBLKS; i++)
+		free(fsi->f_blks[i].fb_data);
+}
+
 void *
 fsip_file_data(fsi_file_t *ffi)
 {
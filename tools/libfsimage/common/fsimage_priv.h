@@ -41,12 +41,32 @@ struct fsi_plugin {
 	void *fp_data;
 };
 
+/*
+ * Block cache in front of the image: reads are done in FSI_BLKSIZE units
+ * aligned on the start of the device, and sequential misses grow a
+ * readahead window of up to FSI_RA_MAX blocks issued as a single preadv.
+ */
+#define	FSI_BLKSIZE	(64 * 1024)
+#define	FSI_NBLKS	32
+#define	FSI_RA_MAX	16
+
+struct fsi_blk {
+	uint64_t fb_blk;
+	size_t fb_len;		/* 0 if the entry holds nothing */
+	uint64_t fb_used;
+	char *fb_data;
+};
+
 struct fsi {
 	int f_fd;
 	uint64_t f_off;
 	void *f_data;
 	fsi_plugin_t *f_plugin;
 	char *f_bootstring;
+	struct fsi_blk f_blks[FSI_NBLKS];
+	uint64_t f_tick;
+	uint64_t f_ra_next;
+	unsigned int f_ra_win;
 };
 
 struct fsi_file {
@@ -55,6 +75,7 @@ struct fsi_file {
 };
 
 int find_plugin(fsi_t *, const char *, const char *);
+void fsi_cache_free(fsi_t *);
 
 #ifdef __cplusplus
 };
@@ -46,8 +46,29 @@ static void cache_unlock(xencall_handle *xcall)
     errno = saved_errno;
 }
 
+/* The size class of a buffer, or -1 if it is too big to be cached. */
+static int cache_order(size_t nr_pages)
+{
+    int order = 0;
+
+    while ( ((size_t)1 << order) < nr_pages )
+        if ( ++order >= BUFFER_CACHE_ORDERS )
+            return -1;
+
+    return order;
+}
+
+/* The number of pages actually backing a buffer of nr_pages. */
+static size_t buffer_pages(size_t nr_pages)
+{
+    int order = cache_order(nr_pages);
+
+    return order < 0 ? nr_pages : (size_t)1 << order;
+}
+
 static void *cache_alloc(xencall_handle *xcall, size_t nr_pages)
 {
+    int order = cache_order(nr_pages);
     void *p = NULL;
 
     cache_lock(xcall);
@@ -57,13 +78,14 @@ static void *cache_alloc(xencall_handle *xcall, size_t nr_pages)
     if ( xcall->buffer_current_allocations > xcall->buffer_maximum_allocations )
         xcall->buffer_maximum_allocations = xcall->buffer_current_allocations;
 
-    if ( nr_pages > 1 )
+    if ( order < 0 )
     {
         xcall->buffer_cache_toobig++;
     }
-    else if ( xcall->buffer_cache_nr > 0 )
+    else if ( xcall->buffer_cache[order].nr > 0 )
     {
-        p = xcall->buffer_cache[--xcall->buffer_cache_nr];
+        p = xcall->buffer_cache[order].p[--xcall->buffer_cache[order].nr];
+        xcall->buffer_cache_pages -= (size_t)1 << order;
         xcall->buffer_cache_hits++;
     }
     else
@@ -78,6 +100,7 @@ static void *cache_alloc(xencall_handle *xcall, size_t nr_pages)
 
 static int cache_free(xencall_handle *xcall, void *p, size_t nr_pages)
 {
+    int order = cache_order(nr_pages);
     int rc = 0;
 
     cache_lock(xcall);
@@ -85,10 +108,13 @@ static int cache_free(xencall_handle *xcall, void *p, size_t nr_pages)
     xcall->buffer_total_releases++;
     xcall->buffer_current_allocations--;
 
-    if ( nr_pages == 1 &&
-         xcall->buffer_cache_nr < BUFFER_CACHE_SIZE )
+    if ( order >= 0 &&
+         xcall->buffer_cache[order].nr < BUFFER_CACHE_SIZE &&
+         xcall->buffer_cache_pages + ((size_t)1 << order) <=
+         BUFFER_CACHE_MAX_PAGES )
     {
-        xcall->buffer_cache[xcall->buffer_cache_nr++] = p;
+        xcall->buffer_cache[order].p[xcall->buffer_cache[order].nr++] = p;
+        xcall->buffer_cache_pages += (size_t)1 << order;
         rc = 1;
     }
 
@@ -100,6 +126,7 @@ static int cache_free(xencall_handle *xcall, void *p, size_t nr_pages)
 void buffer_release_cache(xencall_handle *xcall)
 {
     void *p;
+    int order;
 
     cache_lock(xcall);
 
@@ -109,18 +136,22 @@ void buffer_release_cache(xencall_handle *xcall)
     DBGPRINTF("current allocations:%d maximum allocations:%d",
               xcall->buffer_current_allocations,
               xcall->buffer_maximum_allocations);
-    DBGPRINTF("cache current size:%d",
-              xcall->buffer_cache_nr);
+    DBGPRINTF("cache current size:%zu pages",
+              xcall->buffer_cache_pages);
     DBGPRINTF("cache hits:%d misses:%d toobig:%d",
               xcall->buffer_cache_hits,
               xcall->buffer_cache_misses,
               xcall->buffer_cache_toobig);
 
-    while ( xcall->buffer_cache_nr > 0 )
+    for ( order = 0; order < BUFFER_CACHE_ORDERS; order++ )
     {
-        p = xcall->buffer_cache[--xcall->buffer_cache_nr];
-        osdep_free_pages(xcall, p, 1);
+        while ( xcall->buffer_cache[order].nr > 0 )
+        {
+            p = xcall->buffer_cache[order].p[--xcall->buffer_cache[order].nr];
+            osdep_free_pages(xcall, p, (size_t)1 << order);
+        }
     }
+    xcall->buffer_cache_pages = 0;
 
     cache_unlock(xcall);
 }
@@ -130,7 +161,7 @@ void *xencall_alloc_buffer_pages(xencall_handle *xcall, size_t nr_pages)
     void *p = cache_alloc(xcall, nr_pages);
 
     if ( !p )
-        p = osdep_alloc_pages(xcall, nr_pages);
+        p = osdep_alloc_pages(xcall, buffer_pages(nr_pages));
 
     if (!p)
         return NULL;
@@ -146,7 +177,7 @@ void xencall_free_buffer_pages(xencall_handle *xcall, void *p, size_t nr_pages)
         return;
 
     if ( !cache_free(xcall, p, nr_pages) )
-        osdep_free_pages(xcall, p, nr_pages);
+        osdep_free_pages(xcall, p, buffer_pages(nr_pages));
 }
 
 struct allocation_header {
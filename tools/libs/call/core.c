@@ -14,6 +14,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "private.h"
 
@@ -27,7 +28,8 @@ xencall_handle *xencall_open(xentoollog_logger *logger, unsigned open_flags)
     xcall->fd = -1;
 
     xcall->flags = open_flags;
-    xcall->buffer_cache_nr = 0;
+    memset(xcall->buffer_cache, 0, sizeof(xcall->buffer_cache));
+    xcall->buffer_cache_pages = 0;
 
     xcall->buffer_total_allocations = 0;
     xcall->buffer_total_releases = 0;
@@ -22,13 +22,21 @@ struct xencall_handle {
     int fd;
 
     /*
-     * A simple cache of unused, single page, hypercall buffers
+     * A cache of unused hypercall buffers, by size class.  Buffers of up
+     * to 1 << (BUFFER_CACHE_ORDERS - 1) pages are rounded up to the next
+     * power of two pages, and class <order> holds those of 1 << order
+     * pages.  The total is bounded by BUFFER_CACHE_MAX_PAGES.
      *
      * Protected by a global lock.
      */
-#define BUFFER_CACHE_SIZE 4
-    int buffer_cache_nr;
-    void *buffer_cache[BUFFER_CACHE_SIZE];
+#define BUFFER_CACHE_ORDERS    9
+#define BUFFER_CACHE_SIZE      4
+#define BUFFER_CACHE_MAX_PAGES 1024
+    struct {
+        int nr;
+        void *p[BUFFER_CACHE_SIZE];
+    } buffer_cache[BUFFER_CACHE_ORDERS];
+    size_t buffer_cache_pages;
 
     /*
      * Hypercall buffer statistics. All protected by the global
@@ -151,6 +151,14 @@ static int xendevicemodel_op(
 int xendevicemodel_create_ioreq_server(
     xendevicemodel_handle *dmod, domid_t domid, int handle_bufioreq,
     ioservid_t *id)
+{
+    return xendevicemodel_create_ioreq_server_order(dmod, domid,
+                                                    handle_bufioreq, 0, id);
+}
+
+int xendevicemodel_create_ioreq_server_order(
+    xendevicemodel_handle *dmod, domid_t domid, int handle_bufioreq,
+    unsigned int bufioreq_order, ioservid_t *id)
 {
     struct xen_dm_op op;
     struct xen_dm_op_create_ioreq_server *data;
@@ -162,6 +170,7 @@ int xendevicemodel_create_ioreq_server(
     data = &op.u.create_ioreq_server;
 
     data->handle_bufioreq = handle_bufioreq;
+    data->bufioreq_order = bufioreq_order;
 
     rc = xendevicemodel_op(dmod, domid, 1, &op, sizeof(op));
     if (rc)
@@ -366,6 +375,102 @@ int xendevicemodel_set_ioreq_server_state(
     return xendevicemodel_op(dmod, domid, 1, &op, sizeof(op));
 }
 
+int xendevicemodel_complete_ioreqs(
+    xendevicemodel_handle *dmod, domid_t domid, ioservid_t id)
+{
+    struct xen_dm_op op;
+    struct xen_dm_op_complete_ioreqs *data;
+
+    memset(&op, 0, sizeof(op));
+
+    op.op = XEN_DMOP_complete_ioreqs;
+    data = &op.u.complete_ioreqs;
+
+    data->id = id;
+
+    return xendevicemodel_op(dmod, domid, 1, &op, sizeof(op));
+}
+
+int xendevicemodel_get_ioreq_server_stats(
+    xendevicemodel_handle *dmod, domid_t domid, ioservid_t id,
+    struct xen_dm_op_get_ioreq_server_stats *stats)
+{
+    struct xen_dm_op op;
+    struct xen_dm_op_get_ioreq_server_stats *data;
+    int rc;
+
+    memset(&op, 0, sizeof(op));
+
+    op.op = XEN_DMOP_get_ioreq_server_stats;
+    data = &op.u.get_ioreq_server_stats;
+
+    data->id = id;
+
+    rc = xendevicemodel_op(dmod, domid, 1, &op, sizeof(op));
+    if (rc)
+        return rc;
+
+    *stats = *data;
+
+    return 0;
+}
+
+int xendevicemodel_map_io_event_to_ioreq_server(
+    xendevicemodel_handle *dmod, domid_t domid, ioservid_t id, int is_mmio,
+    uint64_t addr, unsigned int size, int datamatch, uint64_t value,
+    evtchn_port_t *port)
+{
+    struct xen_dm_op op;
+    struct xen_dm_op_ioreq_server_io_event *data;
+    int rc;
+
+    memset(&op, 0, sizeof(op));
+
+    op.op = XEN_DMOP_map_io_event_to_ioreq_server;
+    data = &op.u.map_io_event_to_ioreq_server;
+
+    data->id = id;
+    data->type = is_mmio ? XEN_DMOP_IO_RANGE_MEMORY : XEN_DMOP_IO_RANGE_PORT;
+    data->addr = addr;
+    data->size = size;
+    if (datamatch) {
+        data->flags = XEN_DMOP_IO_EVENT_DATAMATCH;
+        data->data = value;
+    }
+
+    rc = xendevicemodel_op(dmod, domid, 1, &op, sizeof(op));
+    if (rc)
+        return rc;
+
+    *port = data->port;
+
+    return 0;
+}
+
+int xendevicemodel_unmap_io_event_from_ioreq_server(
+    xendevicemodel_handle *dmod, domid_t domid, ioservid_t id, int is_mmio,
+    uint64_t addr, unsigned int size, int datamatch, uint64_t value)
+{
+    struct xen_dm_op op;
+    struct xen_dm_op_ioreq_server_io_event *data;
+
+    memset(&op, 0, sizeof(op));
+
+    op.op = XEN_DMOP_unmap_io_event_from_ioreq_server;
+    data = &op.u.unmap_io_event_from_ioreq_server;
+
+    data->id = id;
+    data->type = is_mmio ? XEN_DMOP_IO_RANGE_MEMORY : XEN_DMOP_IO_RANGE_PORT;
+    data->addr = addr;
+    data->size = size;
+    if (datamatch) {
+        data->flags = XEN_DMOP_IO_EVENT_DATAMATCH;
+        data->data = value;
+    }
+
+    return xendevicemodel_op(dmod, domid, 1, &op, sizeof(op));
+}
+
 int xendevicemodel_set_pci_intx_level(
     xendevicemodel_handle *dmod, domid_t domid, uint16_t segment,
     uint8_t bus, uint8_t device, uint8_t intx, unsigned int level)
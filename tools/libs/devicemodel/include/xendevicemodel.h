@@ -53,6 +53,23 @@ int xendevicemodel_create_ioreq_server(
     xendevicemodel_handle *dmod, domid_t domid, int handle_bufioreq,
     ioservid_t *id);
 
+/**
+ * As xendevicemodel_create_ioreq_server(), with a buffered ioreq ring of
+ * 2^bufioreq_order pages (see IOREQ_BUFFER_SLOTS() in hvm/ioreq.h).
+ *
+ * @parm dmod a handle to an open devicemodel interface.
+ * @parm domid the domain id to be serviced
+ * @parm handle_bufioreq how should the IOREQ Server handle buffered
+ *                       requests (HVM_IOREQSRV_BUFIOREQ_*)?
+ * @parm bufioreq_order log2 of the number of pages of the buffered ioreq
+ *                      ring (at most XEN_DMOP_BUFIOREQ_MAX_ORDER)
+ * @parm id pointer to an ioservid_t to receive the IOREQ Server id.
+ * @return 0 on success, -1 on failure.
+ */
+int xendevicemodel_create_ioreq_server_order(
+    xendevicemodel_handle *dmod, domid_t domid, int handle_bufioreq,
+    unsigned int bufioreq_order, ioservid_t *id);
+
 /**
  * This function retrieves the necessary information to allow an
  * emulator to use an IOREQ Server.
@@ -180,6 +197,73 @@ int xendevicemodel_destroy_ioreq_server(
 int xendevicemodel_set_ioreq_server_state(
     xendevicemodel_handle *dmod, domid_t domid, ioservid_t id, int enabled);
 
+/**
+ * This function wakes up all the vCPUs whose synchronous request to an
+ * IOREQ Server has been completed (i.e. is in STATE_IORESP_READY), in
+ * place of notifying the event channel of each of them.
+ *
+ * @parm dmod a handle to an open devicemodel interface.
+ * @parm domid the domain id to be serviced
+ * @parm id the IOREQ Server id.
+ * @return 0 on success, -1 on failure.
+ */
+int xendevicemodel_complete_ioreqs(
+    xendevicemodel_handle *dmod, domid_t domid, ioservid_t id);
+
+/**
+ * This function retrieves the numbers of emulation requests sent to an
+ * IOREQ Server, by type and by size.
+ *
+ * @parm dmod a handle to an open devicemodel interface.
+ * @parm domid the domain id to be serviced
+ * @parm id the IOREQ Server id.
+ * @parm stats pointer to a struct xen_dm_op_get_ioreq_server_stats to
+ *             receive the counters.
+ * @return 0 on success, -1 on failure.
+ */
+int xendevicemodel_get_ioreq_server_stats(
+    xendevicemodel_handle *dmod, domid_t domid, ioservid_t id,
+    struct xen_dm_op_get_ioreq_server_stats *stats);
+
+/**
+ * This function registers a write to a port or memory address which
+ * should only signal an event channel, without an emulation request.
+ *
+ * @parm dmod a handle to an open devicemodel interface.
+ * @parm domid the domain id to be serviced
+ * @parm id the IOREQ Server id.
+ * @parm is_mmio is this a port or a memory address
+ * @parm addr the address written
+ * @parm size the size of the write (1, 2, 4 or 8 bytes)
+ * @parm datamatch only match writes of the given value
+ * @parm value the value written, if datamatch is set
+ * @parm port pointer to an evtchn_port_t to receive the event channel
+ *            to bind
+ * @return 0 on success, -1 on failure.
+ */
+int xendevicemodel_map_io_event_to_ioreq_server(
+    xendevicemodel_handle *dmod, domid_t domid, ioservid_t id, int is_mmio,
+    uint64_t addr, unsigned int size, int datamatch, uint64_t value,
+    evtchn_port_t *port);
+
+/**
+ * This function deregisters a write previously registered with the same
+ * parameters by xendevicemodel_map_io_event_to_ioreq_server().
+ *
+ * @parm dmod a handle to an open devicemodel interface.
+ * @parm domid the domain id to be serviced
+ * @parm id the IOREQ Server id.
+ * @parm is_mmio is this a port or a memory address
+ * @parm addr the address written
+ * @parm size the size of the write (1, 2, 4 or 8 bytes)
+ * @parm datamatch only match writes of the given value
+ * @parm value the value written, if datamatch is set
+ * @return 0 on success, -1 on failure.
+ */
+int xendevicemodel_unmap_io_event_from_ioreq_server(
+    xendevicemodel_handle *dmod, domid_t domid, ioservid_t id, int is_mmio,
+    uint64_t addr, unsigned int size, int datamatch, uint64_t value);
+
 /**
  * This function sets the level of INTx pin of an emulated PCI device.
  *
@@ -127,6 +127,39 @@ int xenevtchn_unmask(xenevtchn_handle *xce, evtchn_port_t port)
     return 0;
 }
 
+int xenevtchn_pending_batch(xenevtchn_handle *xce, evtchn_port_t *ports,
+                            unsigned int nr)
+{
+    int fd = xce->fd;
+    ssize_t rc;
+
+    /* The driver returns as many pending ports as there are, up to a page. */
+    rc = read(fd, ports, nr * sizeof(*ports));
+    if ( rc < 0 )
+        return -1;
+
+    return rc / sizeof(*ports);
+}
+
+int xenevtchn_unmask_batch(xenevtchn_handle *xce, const evtchn_port_t *ports,
+                           unsigned int nr)
+{
+    int fd = xce->fd;
+    size_t done = 0, len = nr * sizeof(*ports);
+    ssize_t rc;
+
+    /* The driver accepts up to a page of ports per write. */
+    while ( done < len )
+    {
+        rc = write(fd, (const char *)ports + done, len - done);
+        if ( rc <= 0 )
+            return -1;
+        done += rc;
+    }
+
+    return 0;
+}
+
 /*
  * Local variables:
  * mode: C
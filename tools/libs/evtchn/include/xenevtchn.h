@@ -151,6 +151,23 @@ xenevtchn_pending(xenevtchn_handle *xce);
  */
 int xenevtchn_unmask(xenevtchn_handle *xce, evtchn_port_t port);
 
+/*
+ * Batched versions of the above, for handles with many event channels
+ * bound.  xenevtchn_pending_batch() stores up to @nr pending event
+ * channels in @ports, taking a single system call where the OS allows,
+ * and returns how many it stored, or -1 on failure.  Like
+ * xenevtchn_pending() it blocks until at least one is pending, unless
+ * the handle's file descriptor is non-blocking.  Depending on the OS
+ * fewer than all the pending ones may be returned, so the file descriptor
+ * still needs polling as above.  xenevtchn_unmask_batch() unmasks @nr
+ * event channels, returning 0 on success or -1 on failure, in which case
+ * some of them may have been unmasked.  errno is set on failure.
+ */
+int xenevtchn_pending_batch(xenevtchn_handle *xce, evtchn_port_t *ports,
+                            unsigned int nr);
+int xenevtchn_unmask_batch(xenevtchn_handle *xce, const evtchn_port_t *ports,
+                           unsigned int nr);
+
 #endif
 
 /*
@@ -255,6 +255,41 @@ int xenevtchn_unmask(xenevtchn_handle *xce, evtchn_port_t port)
     return 0;
 }
 
+int xenevtchn_pending_batch(xenevtchn_handle *xce, evtchn_port_t *ports,
+                            unsigned int nr)
+{
+    int fd = xce->fd;
+    struct evtchn_port_info *port_info;
+    unsigned long flags;
+    unsigned int n = 0;
+
+    local_irq_save(flags);
+    files[fd].read = 0;
+
+    LIST_FOREACH(port_info, &files[fd].evtchn.ports, list) {
+        if (port_info->port != -1 && port_info->pending) {
+            if (n == nr) {
+                files[fd].read = 1;
+                break;
+            }
+            ports[n++] = port_info->port;
+            port_info->pending = 0;
+        }
+    }
+    local_irq_restore(flags);
+    return n;
+}
+
+int xenevtchn_unmask_batch(xenevtchn_handle *xce, const evtchn_port_t *ports,
+                           unsigned int nr)
+{
+    unsigned int i;
+
+    for (i = 0; i < nr; i++)
+        unmask_evtchn(ports[i]);
+    return 0;
+}
+
 /*
  * Local variables:
  * mode: C
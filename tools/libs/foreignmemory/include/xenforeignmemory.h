@@ -107,6 +107,24 @@ void *xenforeignmemory_map(xenforeignmemory_handle *fmem, uint32_t dom,
                            int prot, size_t pages,
                            const xen_pfn_t arr[/*pages*/], int err[/*pages*/]);
 
+/*
+ * Almost like the previous one but also accepts two additional parameters:
+ *
+ * @addr is the same as in mmap(2).
+ * @flags is the same as in mmap(2).
+ *
+ * With MAP_FIXED and the address and size of an existing mapping, the new
+ * frames replace those previously mapped there.  This allows keeping a
+ * window of address space reserved while repeatedly mapping different
+ * frames into it, without going through munmap(2) every time.  Replacing
+ * only part of an earlier mapping is not supported.  On failure the
+ * range is left unmapped.  MAP_FIXED is only honoured on Linux, FreeBSD,
+ * NetBSD and Solaris.
+ */
+void *xenforeignmemory_map2(xenforeignmemory_handle *fmem, uint32_t dom,
+                            void *addr, int prot, int flags, size_t pages,
+                            const xen_pfn_t arr[/*pages*/], int err[/*pages*/]);
+
 /*
  * Unmap a mapping previous created with xenforeignmemory_map().
  *
@@ -0,0 +1,311 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; If not, see <http://www.gnu.org/licenses/>.
+ *
+ * A cache of single page grant mappings, keyed by (domid, ref).  Entries
+ * which no caller holds are kept on an LRU list and are unmapped when
+ * room is needed, or when the caller invalidates the domain's mappings.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "private.h"
+
+#define CACHE_BUCKETS 1024
+
+struct cache_entry {
+    uint32_t domid, ref;
+    int prot;
+    unsigned int users;
+    bool stale;                 /* Unmap once the last user is gone. */
+    void *addr;
+    struct cache_entry *hash_next, *addr_next;
+    /* Unused entries only, most recently used first. */
+    struct cache_entry *lru_prev, *lru_next;
+};
+
+struct xengnttab_cache {
+    unsigned int capacity;
+    struct cache_entry lru;
+    xengnttab_cache_stats_t stats;
+    struct cache_entry *buckets[CACHE_BUCKETS];
+    struct cache_entry *addr_buckets[CACHE_BUCKETS];
+};
+
+static struct cache_entry **bucket(struct xengnttab_cache *cache,
+                                   uint32_t domid, uint32_t ref)
+{
+    return &cache->buckets[(ref * 2654435761u + domid) % CACHE_BUCKETS];
+}
+
+static struct cache_entry **addr_bucket(struct xengnttab_cache *cache,
+                                        const void *addr)
+{
+    /* Mappings are page aligned. */
+    return &cache->addr_buckets[((unsigned long)addr >> 12) % CACHE_BUCKETS];
+}
+
+static void lru_del(struct cache_entry *e)
+{
+    e->lru_prev->lru_next = e->lru_next;
+    e->lru_next->lru_prev = e->lru_prev;
+}
+
+static void lru_add(struct xengnttab_cache *cache, struct cache_entry *e)
+{
+    e->lru_next = cache->lru.lru_next;
+    e->lru_prev = &cache->lru;
+    e->lru_next->lru_prev = e;
+    cache->lru.lru_next = e;
+}
+
+/* Unmap and free an entry, which must not be on the LRU list. */
+static void entry_free(xengnttab_handle *xgt, struct cache_entry *e)
+{
+    struct xengnttab_cache *cache = xgt->cache;
+    struct cache_entry **pp = bucket(cache, e->domid, e->ref);
+
+    while ( *pp != e )
+        pp = &(*pp)->hash_next;
+    *pp = e->hash_next;
+
+    pp = addr_bucket(cache, e->addr);
+    while ( *pp != e )
+        pp = &(*pp)->addr_next;
+    *pp = e->addr_next;
+
+    osdep_gnttab_unmap(xgt, e->addr, 1);
+    cache->stats.entries--;
+    free(e);
+}
+
+/* Drop unused entries, oldest first, until at most @nr are cached. */
+static void cache_shrink(xengnttab_handle *xgt, unsigned int nr)
+{
+    struct xengnttab_cache *cache = xgt->cache;
+    struct cache_entry *e;
+
+    while ( cache->stats.entries > nr &&
+            (e = cache->lru.lru_prev) != &cache->lru )
+    {
+        lru_del(e);
+        entry_free(xgt, e);
+        cache->stats.evictions++;
+    }
+}
+
+int xengnttab_cache_set_size(xengnttab_handle *xgt, unsigned int nr)
+{
+    struct xengnttab_cache *cache = xgt->cache;
+
+    if ( !cache )
+    {
+        if ( !nr )
+            return 0;
+
+        cache = calloc(1, sizeof(*cache));
+        if ( !cache )
+            return -1;
+        cache->lru.lru_next = cache->lru.lru_prev = &cache->lru;
+        xgt->cache = cache;
+    }
+
+    cache->capacity = nr;
+    cache_shrink(xgt, nr);
+
+    if ( !nr && !cache->stats.entries )
+    {
+        free(cache);
+        xgt->cache = NULL;
+    }
+
+    return 0;
+}
+
+void *xengnttab_cache_map(xengnttab_handle *xgt, uint32_t domid,
+                          uint32_t ref, int prot)
+{
+    struct xengnttab_cache *cache = xgt->cache;
+    struct cache_entry *e;
+
+    if ( !cache || !cache->capacity )
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    for ( e = *bucket(cache, domid, ref); e; e = e->hash_next )
+        if ( e->domid == domid && e->ref == ref && !e->stale )
+            break;
+
+    if ( e && (e->prot & prot) == prot )
+    {
+        if ( !e->users++ )
+            lru_del(e);
+        cache->stats.hits++;
+        cache->stats.in_use += e->users == 1;
+        return e->addr;
+    }
+
+    cache->stats.misses++;
+
+    if ( e )
+    {
+        /* Cached with fewer permissions than now asked for. */
+        if ( e->users )
+        {
+            errno = EBUSY;
+            return NULL;
+        }
+        lru_del(e);
+        entry_free(xgt, e);
+    }
+
+    cache_shrink(xgt, cache->capacity - 1);
+
+    e = calloc(1, sizeof(*e));
+    if ( !e )
+        return NULL;
+
+    e->addr = osdep_gnttab_grant_map(xgt, 1, 0, prot, &domid, &ref, -1, -1);
+    if ( !e->addr )
+    {
+        free(e);
+        return NULL;
+    }
+
+    e->domid = domid;
+    e->ref = ref;
+    e->prot = prot;
+    e->users = 1;
+    e->hash_next = *bucket(cache, domid, ref);
+    *bucket(cache, domid, ref) = e;
+    e->addr_next = *addr_bucket(cache, e->addr);
+    *addr_bucket(cache, e->addr) = e;
+    cache->stats.entries++;
+    cache->stats.in_use++;
+
+    return e->addr;
+}
+
+int xengnttab_cache_put(xengnttab_handle *xgt, void *addr)
+{
+    struct xengnttab_cache *cache = xgt->cache;
+    struct cache_entry *e;
+
+    for ( e = cache ? *addr_bucket(cache, addr) : NULL; e; e = e->addr_next )
+        if ( e->addr == addr && e->users )
+            break;
+
+    if ( !e )
+    {
+        errno = ENOENT;
+        return -1;
+    }
+
+    if ( --e->users )
+        return 0;
+
+    cache->stats.in_use--;
+    if ( e->stale )
+        entry_free(xgt, e);
+    else
+    {
+        lru_add(cache, e);
+        cache_shrink(xgt, cache->capacity);
+    }
+
+    return 0;
+}
+
+int xengnttab_cache_invalidate(xengnttab_handle *xgt, uint32_t domid)
+{
+    struct xengnttab_cache *cache = xgt->cache;
+    struct cache_entry *e, *next;
+    unsigned int i;
+    int rc = 0;
+
+    if ( !cache )
+        return 0;
+
+    for ( i = 0; i < CACHE_BUCKETS; i++ )
+    {
+        for ( e = cache->buckets[i]; e; e = next )
+        {
+            next = e->hash_next;
+            if ( domid != XENGNTTAB_CACHE_ALL_DOMAINS && e->domid != domid )
+                continue;
+
+            if ( e->users )
+            {
+                e->stale = true;
+                rc = -1;
+                continue;
+            }
+            lru_del(e);
+            entry_free(xgt, e);
+        }
+    }
+
+    if ( rc )
+        errno = EBUSY;
+
+    return rc;
+}
+
+int xengnttab_cache_get_stats(xengnttab_handle *xgt,
+                              xengnttab_cache_stats_t *stats)
+{
+    if ( xgt->cache )
+        *stats = xgt->cache->stats;
+    else
+        memset(stats, 0, sizeof(*stats));
+
+    return 0;
+}
+
+void gnttab_cache_destroy(xengnttab_handle *xgt)
+{
+    struct xengnttab_cache *cache = xgt->cache;
+    struct cache_entry *e, *next;
+    unsigned int i;
+
+    if ( !cache )
+        return;
+
+    for ( i = 0; i < CACHE_BUCKETS; i++ )
+    {
+        for ( e = cache->buckets[i]; e; e = next )
+        {
+            next = e->hash_next;
+            osdep_gnttab_unmap(xgt, e->addr, 1);
+            free(e);
+        }
+    }
+
+    free(cache);
+    xgt->cache = NULL;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -30,6 +30,7 @@ xengnttab_handle *xengnttab_open(xentoollog_logger *logger, unsigned open_flags)
     if (!xgt) return NULL;
 
     xgt->fd = -1;
+    xgt->cache = NULL;
     xgt->logger = logger;
     xgt->logger_tofree  = NULL;
 
@@ -59,6 +60,7 @@ int xengnttab_close(xengnttab_handle *xgt)
     if ( !xgt )
         return 0;
 
+    gnttab_cache_destroy(xgt);
     rc = osdep_gnttab_close(xgt);
     xtl_logger_destroy(xgt->logger_tofree);
     free(xgt);
@@ -84,6 +84,33 @@ int xengnttab_grant_copy(xengnttab_handle *xgt,
 {
     abort();
 }
+
+int xengnttab_cache_set_size(xengnttab_handle *xgt, unsigned int nr)
+{
+    abort();
+}
+
+void *xengnttab_cache_map(xengnttab_handle *xgt, uint32_t domid,
+                          uint32_t ref, int prot)
+{
+    abort();
+}
+
+int xengnttab_cache_put(xengnttab_handle *xgt, void *addr)
+{
+    abort();
+}
+
+int xengnttab_cache_invalidate(xengnttab_handle *xgt, uint32_t domid)
+{
+    abort();
+}
+
+int xengnttab_cache_get_stats(xengnttab_handle *xgt,
+                              xengnttab_cache_stats_t *stats)
+{
+    abort();
+}
 /*
  * Local variables:
  * mode: C
@@ -286,6 +286,71 @@ int xengnttab_grant_copy(xengnttab_handle *xgt,
                          uint32_t count,
                          xengnttab_grant_copy_segment_t *segs);
 
+/*
+ * Grant mapping cache
+ *
+ * Backends which keep mapping the same grants can have single page
+ * mappings cached, keyed by (domid, ref), instead of being unmapped when
+ * they are done with them.  Cached mappings nobody holds are unmapped
+ * least recently used first when room is needed.
+ *
+ * Keeping a grant mapped stops the granting domain from revoking it, so
+ * this is only suitable where the frontend expects grants to stay
+ * mapped (e.g. blkif's feature-persistent).  The cache must be
+ * invalidated when the frontend disconnects.
+ *
+ * Calls on one handle must be serialised by the caller.
+ */
+
+/**
+ * Sets the number of mappings the cache may hold, and enables the cache
+ * if @nr is non-zero.  Setting 0 unmaps all cached mappings (those in use
+ * once released) and disables it.  Returns 0 on success or -1 on failure,
+ * setting errno.
+ */
+int xengnttab_cache_set_size(xengnttab_handle *xgt, unsigned int nr);
+
+/**
+ * Returns a mapping of grant @ref of domain @domid with at least @prot
+ * (as for mmap(2)), from the cache if possible, or NULL on failure,
+ * setting errno.  Each successful call must be paired with
+ * xengnttab_cache_put().  Fails with EBUSY if the grant is in use with
+ * fewer permissions than asked for.
+ */
+void *xengnttab_cache_map(xengnttab_handle *xgt, uint32_t domid,
+                          uint32_t ref, int prot);
+
+/**
+ * Releases a mapping obtained from xengnttab_cache_map(), which stays
+ * cached.  Returns 0 on success or -1 on failure, setting errno.
+ */
+int xengnttab_cache_put(xengnttab_handle *xgt, void *addr);
+
+#define XENGNTTAB_CACHE_ALL_DOMAINS (~(uint32_t)0)
+
+/**
+ * Unmaps the cached mappings of @domid (or of all domains with
+ * XENGNTTAB_CACHE_ALL_DOMAINS).  Mappings still in use are unmapped once
+ * released, and no longer returned by xengnttab_cache_map(); if there are
+ * any, -1 is returned with errno set to EBUSY.  Returns 0 otherwise.
+ */
+int xengnttab_cache_invalidate(xengnttab_handle *xgt, uint32_t domid);
+
+typedef struct xengnttab_cache_stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;         /* Unmapped to make room. */
+    uint32_t entries;           /* Currently mapped. */
+    uint32_t in_use;            /* ... of which are held by callers. */
+} xengnttab_cache_stats_t;
+
+/**
+ * Returns the cache statistics of the handle, all 0 while the cache is
+ * disabled.
+ */
+int xengnttab_cache_get_stats(xengnttab_handle *xgt,
+                              xengnttab_cache_stats_t *stats);
+
 /*
  * Grant Sharing Interface (allocating and granting pages to others)
  */
@@ -13,8 +13,11 @@
 struct xengntdev_handle {
     xentoollog_logger *logger, *logger_tofree;
     int fd;
+    struct xengnttab_cache *cache; /* gnttab only */
 };
 
+void gnttab_cache_destroy(xengnttab_handle *xgt);
+
 int osdep_gnttab_open(xengnttab_handle *xgt);
 int osdep_gnttab_close(xengnttab_handle *xgt);
 
@@ -203,24 +203,60 @@ int libxenvchan_wait(struct libxenvchan *ctrl)
 	return 0;
 }
 
+static size_t iov_size(const struct iovec *iov, int count)
+{
+	size_t size = 0;
+	int i;
+
+	for (i = 0; i < count; i++)
+		size += iov[i].iov_len;
+	return size;
+}
+
 /**
- * returns -1 on error, or size on success
- *
- * caller must have checked that enough space is available
+ * Copy size bytes, starting skip bytes into the iovec, to the ring at the
+ * producer index. Nothing is made visible to the peer yet.
  */
-static int do_send(struct libxenvchan *ctrl, const void *data, size_t size)
+static void copy_to_ring(struct libxenvchan *ctrl, const struct iovec *iov,
+			 size_t skip, size_t size)
 {
-	int real_idx = wr_prod(ctrl) & (wr_ring_size(ctrl) - 1);
-	int avail_contig = wr_ring_size(ctrl) - real_idx;
-	if (avail_contig > size)
-		avail_contig = size;
-	xen_mb(); /* read indexes /then/ write data */
-	memcpy(wr_ring(ctrl) + real_idx, data, avail_contig);
-	if (avail_contig < size)
-	{
-		// we rolled across the end of the ring
-		memcpy(wr_ring(ctrl), data + avail_contig, size - avail_contig);
+	uint32_t idx = wr_prod(ctrl);
+
+	for (; size; iov++) {
+		size_t len = iov->iov_len;
+		const void *data = iov->iov_base;
+
+		if (skip >= len) {
+			skip -= len;
+			continue;
+		}
+		data += skip;
+		len -= skip;
+		skip = 0;
+		if (len > size)
+			len = size;
+		size -= len;
+
+		while (len) {
+			int real_idx = idx & (wr_ring_size(ctrl) - 1);
+			size_t contig = wr_ring_size(ctrl) - real_idx;
+
+			if (contig > len)
+				contig = len;
+			memcpy(wr_ring(ctrl) + real_idx, data, contig);
+			idx += contig;
+			data += contig;
+			len -= contig;
+		}
 	}
+}
+
+/**
+ * Make size bytes written at the producer index visible, and notify the
+ * peer if it asked for it.
+ */
+static int publish_send(struct libxenvchan *ctrl, size_t size)
+{
 	xen_wmb(); /* write data /then/ notify */
 	wr_prod(ctrl) += size;
 	if (send_notify(ctrl, VCHAN_NOTIFY_WRITE))
@@ -228,18 +264,33 @@ static int do_send(struct libxenvchan *ctrl, const void *data, size_t size)
 	return size;
 }
 
+/**
+ * returns -1 on error, or size on success
+ *
+ * caller must have checked that enough space is available
+ */
+static int do_send(struct libxenvchan *ctrl, const struct iovec *iov,
+		   size_t skip, size_t size)
+{
+	xen_mb(); /* read indexes /then/ write data */
+	copy_to_ring(ctrl, iov, skip, size);
+	return publish_send(ctrl, size);
+}
+
 /**
  * returns 0 if no buffer space is available, -1 on error, or size on success
  */
-int libxenvchan_send(struct libxenvchan *ctrl, const void *data, size_t size)
+int libxenvchan_sendv(struct libxenvchan *ctrl, const struct iovec *iov,
+		      int count)
 {
+	size_t size = iov_size(iov, count);
 	int avail;
 	while (1) {
 		if (!libxenvchan_is_open(ctrl))
 			return -1;
 		avail = fast_get_buffer_space(ctrl, size);
 		if (size <= avail)
-			return do_send(ctrl, data, size);
+			return do_send(ctrl, iov, 0, size);
 		if (!ctrl->blocking)
 			return 0;
 		if (size > wr_ring_size(ctrl))
@@ -249,8 +300,17 @@ int libxenvchan_send(struct libxenvchan *ctrl, const void *data, size_t size)
 	}
 }
 
-int libxenvchan_write(struct libxenvchan *ctrl, const void *data, size_t size)
+int libxenvchan_send(struct libxenvchan *ctrl, const void *data, size_t size)
+{
+	struct iovec iov = { .iov_base = (void *)data, .iov_len = size };
+
+	return libxenvchan_sendv(ctrl, &iov, 1);
+}
+
+int libxenvchan_writev(struct libxenvchan *ctrl, const struct iovec *iov,
+		       int count)
 {
+	size_t size = iov_size(iov, count);
 	int avail;
 	if (!libxenvchan_is_open(ctrl))
 		return -1;
@@ -261,7 +321,7 @@ int libxenvchan_write(struct libxenvchan *ctrl, const void *data, size_t size)
 			if (pos + avail > size)
 				avail = size - pos;
 			if (avail)
-				pos += do_send(ctrl, data + pos, avail);
+				pos += do_send(ctrl, iov, pos, avail);
 			if (pos == size)
 				return pos;
 			if (libxenvchan_wait(ctrl))
@@ -275,28 +335,77 @@ int libxenvchan_write(struct libxenvchan *ctrl, const void *data, size_t size)
 			size = avail;
 		if (size == 0)
 			return 0;
-		return do_send(ctrl, data, size);
+		return do_send(ctrl, iov, 0, size);
 	}
 }
 
+int libxenvchan_write(struct libxenvchan *ctrl, const void *data, size_t size)
+{
+	struct iovec iov = { .iov_base = (void *)data, .iov_len = size };
+
+	return libxenvchan_writev(ctrl, &iov, 1);
+}
+
+void *libxenvchan_write_reserve(struct libxenvchan *ctrl, size_t *size)
+{
+	int real_idx = wr_prod(ctrl) & (wr_ring_size(ctrl) - 1);
+	size_t avail = fast_get_buffer_space(ctrl, 1);
+
+	if (avail > wr_ring_size(ctrl) - real_idx)
+		avail = wr_ring_size(ctrl) - real_idx;
+	*size = avail;
+	return avail ? wr_ring(ctrl) + real_idx : NULL;
+}
+
+int libxenvchan_write_commit(struct libxenvchan *ctrl, size_t size)
+{
+	return publish_send(ctrl, size);
+}
+
 /**
- * returns -1 on error, or size on success
- *
- * caller must have checked that enough data is available
+ * Copy size bytes from the ring at the consumer index, to the iovec
+ * starting skip bytes into it.
  */
-static int do_recv(struct libxenvchan *ctrl, void *data, size_t size)
+static void copy_from_ring(struct libxenvchan *ctrl, const struct iovec *iov,
+			   size_t skip, size_t size)
 {
-	int real_idx = rd_cons(ctrl) & (rd_ring_size(ctrl) - 1);
-	int avail_contig = rd_ring_size(ctrl) - real_idx;
-	if (avail_contig > size)
-		avail_contig = size;
-	xen_rmb(); /* data read must happen /after/ rd_cons read */
-	memcpy(data, rd_ring(ctrl) + real_idx, avail_contig);
-	if (avail_contig < size)
-	{
-		// we rolled across the end of the ring
-		memcpy(data + avail_contig, rd_ring(ctrl), size - avail_contig);
+	uint32_t idx = rd_cons(ctrl);
+
+	for (; size; iov++) {
+		size_t len = iov->iov_len;
+		void *data = iov->iov_base;
+
+		if (skip >= len) {
+			skip -= len;
+			continue;
+		}
+		data += skip;
+		len -= skip;
+		skip = 0;
+		if (len > size)
+			len = size;
+		size -= len;
+
+		while (len) {
+			int real_idx = idx & (rd_ring_size(ctrl) - 1);
+			size_t contig = rd_ring_size(ctrl) - real_idx;
+
+			if (contig > len)
+				contig = len;
+			memcpy(data, rd_ring(ctrl) + real_idx, contig);
+			idx += contig;
+			data += contig;
+			len -= contig;
+		}
 	}
+}
+
+/**
+ * Release size bytes at the consumer index to the peer, and notify it if
+ * it asked for it.
+ */
+static int publish_recv(struct libxenvchan *ctrl, size_t size)
+{
 	xen_mb(); /* consume /then/ notify */
 	rd_cons(ctrl) += size;
 	if (send_notify(ctrl, VCHAN_NOTIFY_READ))
@@ -304,16 +413,31 @@ static int do_recv(struct libxenvchan *ctrl, void *data, size_t size)
 	return size;
 }
 
+/**
+ * returns -1 on error, or size on success
+ *
+ * caller must have checked that enough data is available
+ */
+static int do_recv(struct libxenvchan *ctrl, const struct iovec *iov,
+		   size_t size)
+{
+	xen_rmb(); /* data read must happen /after/ rd_cons read */
+	copy_from_ring(ctrl, iov, 0, size);
+	return publish_recv(ctrl, size);
+}
+
 /**
  * reads exactly size bytes from the vchan.
  * returns 0 if insufficient data is available, -1 on error, or size on success
  */
-int libxenvchan_recv(struct libxenvchan *ctrl, void *data, size_t size)
+int libxenvchan_recvv(struct libxenvchan *ctrl, const struct iovec *iov,
+		      int count)
 {
+	size_t size = iov_size(iov, count);
 	while (1) {
 		int avail = fast_get_data_ready(ctrl, size);
 		if (size <= avail)
-			return do_recv(ctrl, data, size);
+			return do_recv(ctrl, iov, size);
 		if (!libxenvchan_is_open(ctrl))
 			return -1;
 		if (!ctrl->blocking)
@@ -325,14 +449,23 @@ int libxenvchan_recv(struct libxenvchan *ctrl, void *data, size_t size)
 	}
 }
 
-int libxenvchan_read(struct libxenvchan *ctrl, void *data, size_t size)
+int libxenvchan_recv(struct libxenvchan *ctrl, void *data, size_t size)
 {
+	struct iovec iov = { .iov_base = data, .iov_len = size };
+
+	return libxenvchan_recvv(ctrl, &iov, 1);
+}
+
+int libxenvchan_readv(struct libxenvchan *ctrl, const struct iovec *iov,
+		      int count)
+{
+	size_t size = iov_size(iov, count);
 	while (1) {
 		int avail = fast_get_data_ready(ctrl, size);
 		if (avail && size > avail)
 			size = avail;
 		if (avail)
-			return do_recv(ctrl, data, size);
+			return do_recv(ctrl, iov, size);
 		if (!libxenvchan_is_open(ctrl))
 			return -1;
 		if (!ctrl->blocking)
@@ -342,6 +475,32 @@ int libxenvchan_read(struct libxenvchan *ctrl, void *data, size_t size)
 	}
 }
 
+int libxenvchan_read(struct libxenvchan *ctrl, void *data, size_t size)
+{
+	struct iovec iov = { .iov_base = data, .iov_len = size };
+
+	return libxenvchan_readv(ctrl, &iov, 1);
+}
+
+const void *libxenvchan_read_peek(struct libxenvchan *ctrl, size_t *size)
+{
+	int real_idx = rd_cons(ctrl) & (rd_ring_size(ctrl) - 1);
+	size_t avail = fast_get_data_ready(ctrl, 1);
+
+	if (avail > rd_ring_size(ctrl) - real_idx)
+		avail = rd_ring_size(ctrl) - real_idx;
+	*size = avail;
+	if (!avail)
+		return NULL;
+	xen_rmb(); /* data read must happen /after/ rd_cons read */
+	return rd_ring(ctrl) + real_idx;
+}
+
+int libxenvchan_read_consume(struct libxenvchan *ctrl, size_t size)
+{
+	return publish_recv(ctrl, size);
+}
+
 int libxenvchan_is_open(struct libxenvchan* ctrl)
 {
 	if (ctrl->is_server)
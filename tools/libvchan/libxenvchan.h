@@ -42,6 +42,7 @@
  *  compile time, so the macros in ring.h cannot be used to access the rings.
  */
 
+#include <sys/uio.h>
 #include <xen/io/libxenvchan.h>
 #include <xen/sys/evtchn.h>
 #include <xenevtchn.h>
@@ -152,6 +153,46 @@ int libxenvchan_send(struct libxenvchan *ctrl, const void *data, size_t size);
  *         the vchan is nonblocking)
  */
 int libxenvchan_write(struct libxenvchan *ctrl, const void *data, size_t size);
+/**
+ * Scatter/gather variants of the above: they behave as if the buffers
+ * described by iov were concatenated, saving the caller a copy.
+ */
+int libxenvchan_recvv(struct libxenvchan *ctrl, const struct iovec *iov, int count);
+int libxenvchan_readv(struct libxenvchan *ctrl, const struct iovec *iov, int count);
+int libxenvchan_sendv(struct libxenvchan *ctrl, const struct iovec *iov, int count);
+int libxenvchan_writev(struct libxenvchan *ctrl, const struct iovec *iov, int count);
+/**
+ * Zero-copy send: get the contiguous free space at the head of the send
+ * ring, which may be less than the total free space if it wraps. Never
+ * blocks; returns NULL with *size set to 0 if the ring is full, in which
+ * case libxenvchan_wait() returns once space has been freed.
+ * @param ctrl The vchan control structure
+ * @param size Set to the number of bytes which may be written
+ * @return Pointer into the ring, or NULL
+ */
+void *libxenvchan_write_reserve(struct libxenvchan *ctrl, size_t *size);
+/**
+ * Send the first $size bytes written after libxenvchan_write_reserve().
+ * @return -1 on error, or $size
+ */
+int libxenvchan_write_commit(struct libxenvchan *ctrl, size_t size);
+/**
+ * Zero-copy receive: get the contiguous data at the tail of the receive
+ * ring, which may be less than the total amount available if it wraps.
+ * Never blocks; returns NULL with *size set to 0 if there is no data.
+ * Note the peer can still modify the data in place, so it must be copied
+ * before being validated.
+ * @param ctrl The vchan control structure
+ * @param size Set to the number of bytes which may be read
+ * @return Pointer into the ring, or NULL
+ */
+const void *libxenvchan_read_peek(struct libxenvchan *ctrl, size_t *size);
+/**
+ * Release the first $size bytes returned by libxenvchan_read_peek() to
+ * the peer.
+ * @return -1 on error, or $size
+ */
+int libxenvchan_read_consume(struct libxenvchan *ctrl, size_t size);
 /**
  * Waits for reads or writes to unblock, or for a close
  */
@@ -56,6 +56,15 @@ struct xc_dom_phys {
     xen_pfn_t count;
 };
 
+/* How the memory of one vmemrange got mapped, in extents of each size. */
+struct xc_dom_populate_stats {
+    unsigned int vnode;
+    unsigned int pnode;         /* XC_NUMA_NO_NODE if any */
+    xen_pfn_t nr_4k;
+    xen_pfn_t nr_2m;
+    xen_pfn_t nr_1g;
+};
+
 struct xc_dom_image {
     /* files */
     void *kernel_blob;
@@ -69,6 +78,13 @@ struct xc_dom_image {
     size_t max_ramdisk_size;
     size_t max_devicetree_size;
 
+    /* decompressed kernel cache, see xc_dom_kernel_cache() */
+    char *kernel_cache_dir;
+    char *kernel_cache_key;
+    bool kernel_cache_hit;
+    void *kernel_file_blob;
+    size_t kernel_file_size;
+
     /* arguments and parameters */
     char *cmdline;
     size_t cmdline_size;
@@ -182,6 +198,16 @@ struct xc_dom_image {
     unsigned int *vnode_to_pnode;
     unsigned int nr_vnodes;
 
+    /*
+     * HVM only: with superpages_strict, every extent of guest memory which
+     * can be mapped by a 1GB or 2MB page must be, retrying for a while and
+     * then failing the build otherwise (ignored with PoD).
+     * xc_dom_boot_mem_init() fills populate_stats, one per vmemrange.
+     */
+    int superpages_strict;
+    struct xc_dom_populate_stats *populate_stats;
+    unsigned int nr_populate_stats;
+
     /* domain type/architecture specific data */
     void *arch_private;
 
@@ -300,6 +326,12 @@ int xc_dom_do_gunzip(xc_interface *xch,
                      void *src, size_t srclen, void *dst, size_t dstlen);
 int xc_dom_try_gunzip(struct xc_dom_image *dom, void **blob, size_t * size);
 
+/*
+ * Cache kernels decompressed by xc_dom_kernel_file() in @dir, keyed by the
+ * identity (device, inode, size and times) of the kernel file, so later
+ * builds from the same file can map the decompressed image directly.
+ */
+int xc_dom_kernel_cache(struct xc_dom_image *dom, const char *dir);
 int xc_dom_kernel_file(struct xc_dom_image *dom, const char *filename);
 int xc_dom_ramdisk_file(struct xc_dom_image *dom, const char *filename);
 int xc_dom_kernel_mem(struct xc_dom_image *dom, const void *mem,
@@ -183,6 +183,13 @@ enum xc_open_flags {
  */
 int xc_interface_close(xc_interface *xch);
 
+/**
+ * Return the time the hypervisor has spent handling the domctls issued
+ * through this handle, in nanoseconds.  Callers interested in a single
+ * operation should look at the difference between two calls.
+ */
+uint64_t xc_domctl_time(xc_interface *xch);
+
 /*
  * HYPERCALL SAFE MEMORY BUFFER
  *
@@ -567,6 +574,23 @@ int xc_domain_unpause(xc_interface *xch,
 int xc_domain_destroy(xc_interface *xch,
                       uint32_t domid);
 
+/**
+ * This function reports how far the destruction of a domain has got, e.g.
+ * while another process is waiting in xc_domain_destroy().
+ *
+ * @parm xch a handle to an open hypervisor interface
+ * @parm domid the domain id being destroyed
+ * @parm state XEN_DOMCTL_DESTROY_* state of the teardown
+ * @parm pages_total pages the domain owned when teardown began
+ * @parm pages_left pages the domain still owns
+ * @return 0 on success, -1 on failure (errno ESRCH once the domain is gone)
+ */
+int xc_domain_destroy_progress(xc_interface *xch,
+                               uint32_t domid,
+                               unsigned int *state,
+                               uint64_t *pages_total,
+                               uint64_t *pages_left);
+
 
 /**
  * This function resumes a suspended domain. The domain should have
@@ -676,6 +700,60 @@ int xc_domain_node_getaffinity(xc_interface *xch,
                                uint32_t domind,
                                xc_nodemap_t nodemap);
 
+/**
+ * This function moves the memory of a domain which lies outside its node
+ * affinity onto the nodes within it, a chunk at a time: it looks at up to
+ * nr_gfns gfns from *gfn on, pausing the domain meanwhile, and advances *gfn
+ * past what it looked at.  Once *gfn exceeds *max_gfn the whole of the
+ * domain's memory was looked at.  Only for HVM domains.
+ *
+ * @parm xch a handle to an open hypervisor interface.
+ * @parm domid the domain id whose memory to move.
+ * @parm gfn the first gfn to look at, updated to the next one.
+ * @parm nr_gfns how many gfns to look at, at most.
+ * @parm max_gfn the domain's highest gfn.
+ * @parm moved how many pages were moved.
+ * @parm busy how many pages could not be moved as others were using them.
+ * @return 0 on success, -1 on failure.
+ */
+int xc_domain_rehome_memory(xc_interface *xch,
+                            uint32_t domid,
+                            uint64_t *gfn,
+                            uint64_t nr_gfns,
+                            uint64_t *max_gfn,
+                            uint32_t *moved,
+                            uint32_t *busy);
+
+/**
+ * This function turns automatic NUMA balancing of an HVM domain on or off.
+ * While on, Xen samples which memory the domain accesses, and moves the soft
+ * affinity of its vcpus to the node holding most of it.
+ *
+ * @parm xch a handle to an open hypervisor interface.
+ * @parm domid the domain id to balance.
+ * @parm enable whether to balance the domain.
+ * @return 0 on success, -1 on failure.
+ */
+int xc_domain_numa_balancing_set(xc_interface *xch,
+                                 uint32_t domid,
+                                 int enable);
+
+/**
+ * This function looks at the state of NUMA balancing of an HVM domain.
+ *
+ * @parm xch a handle to an open hypervisor interface.
+ * @parm domid the domain id to look at.
+ * @parm enabled whether the domain gets balanced.
+ * @parm node the node the vcpus were steered to, ~0 if none yet.
+ * @parm passes how many times its memory was sampled as a whole.
+ * @return 0 on success, -1 on failure.
+ */
+int xc_domain_numa_balancing_get(xc_interface *xch,
+                                 uint32_t domid,
+                                 int *enabled,
+                                 uint32_t *node,
+                                 uint32_t *passes);
+
 /**
  * This function specifies the CPU affinity for a vcpu.
  *
@@ -801,6 +879,27 @@ int xc_domain_getinfolist(xc_interface *xch,
                           unsigned int max_domains,
                           xc_domaininfo_t *info);
 
+/**
+ * This function returns the runstate information of the vCPUs of one or
+ * more domains, using a single hypercall.  The vCPUs of a domain are never
+ * split across calls.
+ *
+ * @parm xch a handle to an open hypervisor interface
+ * @parm first_domain the first domain to return the vCPUs of
+ * @parm entries an array of *nr_entries elements receiving the information
+ * @parm nr_entries the number of elements in entries; on return the number
+ *                  filled in, or on ENOBUFS the number the first domain needs
+ * @parm next_domain the first_domain to pass to the next call, or
+ *                   DOMID_FIRST_RESERVED once all domains were returned
+ * @return 0 on success, -1 on error
+ */
+typedef xen_sysctl_vcpu_runstate_entry_t xc_vcpu_runstate_t;
+int xc_vcpu_runstate_list(xc_interface *xch,
+                          uint32_t first_domain,
+                          xc_vcpu_runstate_t *entries,
+                          unsigned int *nr_entries,
+                          uint32_t *next_domain);
+
 /**
  * This function set p2m for broken page
  * &parm xch a handle to an open hypervisor interface
@@ -926,6 +1025,24 @@ int xc_shadow_control(xc_interface *xch,
                       uint32_t mode,
                       xc_shadow_op_stats_t *stats);
 
+/*
+ * Like xc_shadow_control(XEN_DOMCTL_SHADOW_OP_{CLEAN,PEEK}), but report the
+ * dirty pages of [*start_pfn, *start_pfn + *nr_pfns) as up to nr_extents
+ * xen_domctl_shadow_op_extent_t entries.  On return *start_pfn and *nr_pfns
+ * describe the part of the range still to be scanned; call again until
+ * *nr_pfns is 0.  Returns the number of extents written, or -1 on error.
+ */
+typedef xen_domctl_shadow_op_extent_t xc_shadow_op_extent_t;
+int xc_shadow_control_extents(xc_interface *xch,
+                              uint32_t domid,
+                              unsigned int sop,
+                              xc_hypercall_buffer_t *extents,
+                              unsigned int nr_extents,
+                              xen_pfn_t *start_pfn,
+                              xen_pfn_t *nr_pfns,
+                              uint32_t mode,
+                              xc_shadow_op_stats_t *stats);
+
 int xc_sched_credit_domain_set(xc_interface *xch,
                                uint32_t domid,
                                struct xen_domctl_sched_credit *sdom);
@@ -968,6 +1085,16 @@ int xc_sched_rtds_vcpu_get(xc_interface *xch,
                            struct xen_domctl_schedparam_vcpu *vcpus,
                            uint32_t num_vcpus);
 
+/*
+ * Get which vCPU is assigned to each pCPU of a cpupool using the null
+ * scheduler. assignment has room for *nr_cpus entries (indexed by pCPU);
+ * on return *nr_cpus holds the number of entries needed for all pCPUs.
+ */
+int xc_sched_null_assignment_get(xc_interface *xch,
+                                 uint32_t cpupool_id,
+                                 xen_sysctl_null_assignment_t *assignment,
+                                 unsigned int *nr_cpus);
+
 int
 xc_sched_arinc653_schedule_set(
     xc_interface *xch,
@@ -1064,6 +1191,32 @@ int xc_domain_set_virq_handler(xc_interface *xch, uint32_t domid, int virq);
 int xc_domain_set_max_evtchn(xc_interface *xch, uint32_t domid,
                              uint32_t max_port);
 
+/**
+ * Set the default FIFO priorities of a domain's event channels, by what
+ * they are bound to.
+ *
+ * This does not affect ports that are already bound.
+ *
+ * @param xch a handle to an open hypervisor interface
+ * @param domid the domain id
+ * @param priority XEN_DOMCTL_EVTCHN_CLASS_NR priorities, indexed by
+ *                 XEN_DOMCTL_EVTCHN_CLASS_*
+ */
+int xc_domain_set_evtchn_priority(xc_interface *xch, uint32_t domid,
+                                  const uint8_t *priority);
+
+/**
+ * Get the number of PAUSE-loop exits of an HVM domain's vcpus, and of the
+ * ones turned into a directed yield to a preempted vcpu of the domain.
+ *
+ * @param xch a handle to an open hypervisor interface
+ * @param domid the domain id
+ * @param exits where to store the number of exits
+ * @param directed where to store the number of directed yields
+ */
+int xc_domain_pause_loop_stats(xc_interface *xch, uint32_t domid,
+                               uint64_t *exits, uint64_t *directed);
+
 /*
  * CPUPOOL MANAGEMENT FUNCTIONS
  */
@@ -1195,6 +1348,18 @@ int xc_evtchn_reset(xc_interface *xch,
 typedef struct evtchn_status xc_evtchn_status_t;
 int xc_evtchn_status(xc_interface *xch, xc_evtchn_status_t *status);
 
+/*
+ * Get the event channel delivery statistics of a domain (only available
+ * when Xen was booted with "evtchn_stats"): the domain totals, and the
+ * counters of up to *nr_ports ports in use starting at first_port.  On
+ * return *nr_ports holds the number of entries filled in.
+ */
+typedef xen_sysctl_evtchn_port_stats_t xc_evtchn_port_stats_t;
+int xc_evtchn_stats(xc_interface *xch, uint32_t domid, uint32_t first_port,
+                    xc_evtchn_port_stats_t *ports, unsigned int *nr_ports,
+                    uint64_t *sent, uint64_t *coalesced,
+                    uint64_t *link_retries);
+
 
 
 int xc_physdev_pci_access_modify(xc_interface *xch,
@@ -1209,8 +1374,28 @@ int xc_readconsolering(xc_interface *xch,
                        unsigned int *pnr_chars,
                        int clear, int incremental, uint32_t *pindex);
 
+/*
+ * Read from *pindex on, and set *plost to the number of bytes between
+ * *pindex and the oldest byte still in the ring, which were overwritten
+ * before they could be read.
+ */
+int xc_readconsolering_incr(xc_interface *xch,
+                            char *buffer,
+                            unsigned int *pnr_chars,
+                            uint32_t *pindex, uint32_t *plost);
+
+/* Size of the console ring, and the indexes of its newest and oldest byte. */
+int xc_console_ring_info(xc_interface *xch, uint32_t *size,
+                         uint32_t *producer, uint32_t *consumer);
+
+/* Resize the console ring to at least *size bytes, and return its size. */
+int xc_console_ring_resize(xc_interface *xch, uint32_t *size);
+
 int xc_send_debug_keys(xc_interface *xch, char *keys);
 
+/* Load a microcode update blob on all online CPUs. */
+int xc_microcode_update(xc_interface *xch, const void *buf, size_t len);
+
 typedef xen_sysctl_physinfo_t xc_physinfo_t;
 typedef xen_sysctl_cputopo_t xc_cputopo_t;
 typedef xen_sysctl_numainfo_t xc_numainfo_t;
@@ -1243,6 +1428,47 @@ typedef xen_sysctl_cpuinfo_t xc_cpuinfo_t;
 int xc_getcpuinfo(xc_interface *xch, int max_cpus,
                   xc_cpuinfo_t *info, int *nr_cpus); 
 
+/*
+ * Get the interrupt delivery statistics of an HVM domain (x86 only),
+ * summed over its vCPUs.
+ */
+typedef xen_sysctl_irq_stats_t xc_irq_stats_t;
+int xc_irq_stats(xc_interface *xch, uint32_t domid, xc_irq_stats_t *stats);
+
+/*
+ * Get the hypercall statistics (x86 only, and only available when Xen was
+ * booted with "hypercall_stats").  Up to *nr_entries are filled in, and on
+ * return *nr_entries holds the number of entries Xen has.  *dropped counts
+ * the calls Xen had no room to account for.
+ */
+typedef xen_sysctl_hypercall_stats_entry_t xc_hypercall_stats_entry_t;
+int xc_hypercall_stats(xc_interface *xch, xc_hypercall_stats_entry_t *entries,
+                       unsigned int *nr_entries, uint64_t *dropped);
+int xc_hypercall_stats_reset(xc_interface *xch);
+
+/*
+ * Get the VM exit, runqueue wait and wakeup latency statistics (only
+ * available when Xen was booted with "latency_stats"), with the same
+ * conventions as xc_hypercall_stats().
+ */
+typedef xen_sysctl_latency_stats_entry_t xc_latency_stats_entry_t;
+int xc_latency_stats(xc_interface *xch, xc_latency_stats_entry_t *entries,
+                     unsigned int *nr_entries, uint64_t *dropped);
+int xc_latency_stats_reset(xc_interface *xch);
+
+/*
+ * Get the sampled lock statistics (only available when Xen was built with
+ * CONFIG_LOCK_SAMPLE), with the same conventions as xc_hypercall_stats().
+ * *rate, if not NULL, is set to the current sampling rate: one in *rate
+ * acquisitions on each pCPU is sampled, none if 0.
+ */
+typedef xen_sysctl_lock_sample_entry_t xc_lock_sample_entry_t;
+int xc_lock_sample(xc_interface *xch, xc_lock_sample_entry_t *entries,
+                   unsigned int *nr_entries, uint64_t *dropped,
+                   unsigned int *rate);
+int xc_lock_sample_reset(xc_interface *xch);
+int xc_lock_sample_set_rate(xc_interface *xch, unsigned int rate);
+
 int xc_domain_setmaxmem(xc_interface *xch,
                         uint32_t domid,
                         uint64_t max_memkb);
@@ -1340,6 +1566,13 @@ int xc_domain_maximum_gpfn(xc_interface *xch, domid_t domid, xen_pfn_t *gpfns);
 
 int xc_domain_nr_gpfns(xc_interface *xch, domid_t domid, xen_pfn_t *gpfns);
 
+/*
+ * Replace each of the num gfns in arr with its type, a combination of the
+ * XEN_DOMCTL_PFINFO_* values.  num must not exceed 1024.
+ */
+int xc_get_pfn_type_batch(xc_interface *xch, uint32_t dom,
+                          unsigned int num, xen_pfn_t *arr);
+
 int xc_domain_increase_reservation(xc_interface *xch,
                                    uint32_t domid,
                                    unsigned long nr_extents,
@@ -1366,6 +1599,18 @@ int xc_domain_decrease_reservation_exact(xc_interface *xch,
                                          unsigned int extent_order,
                                          xen_pfn_t *extent_start);
 
+/**
+ * Free the pages of the domain in [first_gfn, first_gfn + nr_pages), using
+ * the largest extents possible.
+ *
+ * @return the number of pages freed from the start of the range, or -1 on
+ * error
+ */
+long xc_domain_decrease_reservation_range(xc_interface *xch,
+                                          uint32_t domid,
+                                          xen_pfn_t first_gfn,
+                                          unsigned long nr_pages);
+
 int xc_domain_add_to_physmap(xc_interface *xch,
                              uint32_t domid,
                              unsigned int space,
@@ -1390,6 +1635,15 @@ int xc_domain_claim_pages(xc_interface *xch,
                                uint32_t domid,
                                unsigned long nr_pages);
 
+/*
+ * Like xc_domain_claim_pages(), but only claim memory on NUMA node @node
+ * (XC_NUMA_NO_NODE from xenguest.h meaning any node).
+ */
+int xc_domain_claim_pages_node(xc_interface *xch,
+                               uint32_t domid,
+                               unsigned int node,
+                               unsigned long nr_pages);
+
 int xc_domain_memory_exchange_pages(xc_interface *xch,
                                     int domid,
                                     unsigned long nr_in_extents,
@@ -1447,6 +1701,17 @@ int xc_perfc_query_number(xc_interface *xch,
 int xc_perfc_query(xc_interface *xch,
                    xc_hypercall_buffer_t *desc,
                    xc_hypercall_buffer_t *val);
+/*
+ * Query the domain-scoped counters: desc (or NULL) receives their names,
+ * val (or NULL) a row per domain of the domain ID followed by their values.
+ * *nbr_val holds the size of val on entry, and the number of values
+ * written (or needed, with a NULL val) on return.
+ */
+int xc_perfc_query_dom(xc_interface *xch,
+                       xc_hypercall_buffer_t *desc,
+                       xc_hypercall_buffer_t *val,
+                       int *nbr_desc,
+                       int *nbr_val);
 
 typedef xen_sysctl_lockprof_data_t xc_lockprof_data_t;
 int xc_lockprof_reset(xc_interface *xch);
@@ -1519,6 +1784,35 @@ long xc_get_tot_pages(xc_interface *xch, uint32_t domid);
 int xc_availheap(xc_interface *xch, int min_width, int max_width, int node,
                  uint64_t *bytes);
 
+/**
+ * This function retrieves the number of free chunks of each order (i.e. of
+ * 2^order pages) in the heap of a node.
+ *
+ * @parm xch a handle to an open hypervisor interface
+ * @parm node the node to query
+ * @parm chunks array to put the counts in, indexed by order
+ * @parm nr_orders IN: number of elements of chunks, OUT: number of orders
+ *       Xen has (only as many as there were elements are filled in)
+ * @return 0 on success, <0 on failure.
+ */
+int xc_heap_chunks(xc_interface *xch, int node, uint64_t *chunks,
+                   unsigned int *nr_orders);
+
+/**
+ * These functions control background memory compaction (x86), which moves
+ * HVM guest memory around to assemble free chunks of the given order.
+ *
+ * @parm xch a handle to an open hypervisor interface
+ * @parm enable(d) whether compaction is on
+ * @parm order the order of the chunks to assemble, 9 (2M) to 18 (1G)
+ * @parm moved, assembled, abandoned pages moved, chunks assembled and
+ *       chunks given up on so far
+ * @return 0 on success, <0 on failure.
+ */
+int xc_compact_get(xc_interface *xch, int *enabled, unsigned int *order,
+                   uint64_t *moved, uint64_t *assembled, uint64_t *abandoned);
+int xc_compact_set(xc_interface *xch, int enable, unsigned int order);
+
 /*
  * Trace Buffer Operations
  */
@@ -1830,6 +2124,9 @@ struct xc_cx_stat {
     uint32_t nr_cc;        /* entry nr in cc[] */
     uint64_t *pc;          /* 1-biased indexing (i.e. excl C0) */
     uint64_t *cc;          /* 1-biased indexing (i.e. excl C0) */
+    uint64_t predicted_us; /* idle governor's predicted residencies */
+    uint64_t measured_us;  /* actual residencies of the same periods */
+    uint64_t early;        /* periods too short for the C-state picked */
 };
 typedef struct xc_cx_stat xc_cx_stat_t;
 
@@ -1891,6 +2188,9 @@ int xc_get_vcpu_migration_delay(xc_interface *xch, uint32_t *value);
 
 int xc_get_cpuidle_max_cstate(xc_interface *xch, uint32_t *value);
 int xc_set_cpuidle_max_cstate(xc_interface *xch, uint32_t value);
+/* Limit the C-state exit latency after running domid's vCPUs, 0: none. */
+int xc_domain_set_idle_latency(xc_interface *xch, uint32_t domid,
+                               uint32_t max_exit_us);
 
 int xc_enable_turbo(xc_interface *xch, int cpuid);
 int xc_disable_turbo(xc_interface *xch, int cpuid);
@@ -1949,6 +2249,22 @@ int xc_mem_paging_prep(xc_interface *xch, domid_t domain_id, uint64_t gfn);
 int xc_mem_paging_load(xc_interface *xch, domid_t domain_id,
                        uint64_t gfn, void *buffer);
 
+/*
+ * Batched versions of nominate, evict and load, for entries[0..nr-1].
+ * Each entry gets its own result in rc (0 or -errno); for load, the
+ * buffer of each entry must be page aligned.  Return 0 once all entries
+ * have been processed, -1 with errno set if the batch could not be.
+ */
+int xc_mem_paging_nominate_batch(xc_interface *xch, domid_t domain_id,
+                                 xen_mem_paging_batch_entry_t *entries,
+                                 uint32_t nr);
+int xc_mem_paging_evict_batch(xc_interface *xch, domid_t domain_id,
+                              xen_mem_paging_batch_entry_t *entries,
+                              uint32_t nr);
+int xc_mem_paging_load_batch(xc_interface *xch, domid_t domain_id,
+                             xen_mem_paging_batch_entry_t *entries,
+                             uint32_t nr);
+
 /** 
  * Access tracking operations.
  * Supported only on Intel EPT 64 bit processors.
@@ -1978,6 +2294,17 @@ int xc_set_mem_access_multi(xc_interface *xch, domid_t domain_id,
 int xc_get_mem_access(xc_interface *xch, domid_t domain_id,
                       uint64_t pfn, xenmem_access_t *access);
 
+/*
+ * Gets the mem access of the *nr pages from *pfn, as up to nr_runs runs of
+ * consecutive pages with the same access.  Pages without a mapping are
+ * left out.  Returns the number of runs written, or -1 on error, and
+ * moves *pfn and *nr past the pages reported: call again while *nr is not
+ * zero.
+ */
+int xc_get_mem_access_range(xc_interface *xch, domid_t domain_id,
+                            uint64_t *pfn, uint32_t *nr,
+                            xen_mem_access_run_t *runs, uint32_t nr_runs);
+
 /***
  * Monitor control operations.
  *
@@ -1989,7 +2316,19 @@ int xc_get_mem_access(xc_interface *xch, domid_t domain_id,
  * Caller has to unmap this page when done.
  */
 void *xc_monitor_enable(xc_interface *xch, domid_t domain_id, uint32_t *port);
+/*
+ * As xc_monitor_enable(), with a ring of nr_pages pages (at most
+ * XEN_VM_EVENT_MAX_RING_PAGES) so that more events can be outstanding
+ * before vCPUs wait for room.  The caller has to unmap nr_pages pages and
+ * pass nr_pages * XC_PAGE_SIZE to BACK_RING_INIT().
+ */
+void *xc_monitor_enable_pages(xc_interface *xch, domid_t domain_id,
+                              unsigned int nr_pages, uint32_t *port);
 int xc_monitor_disable(xc_interface *xch, domid_t domain_id);
+/*
+ * Makes Xen pull every response queued on the monitor ring, so any number
+ * of events can be acknowledged at once.
+ */
 int xc_monitor_resume(xc_interface *xch, domid_t domain_id);
 /*
  * Get a bitmap of supported monitor events in the form
@@ -2058,6 +2397,18 @@ int xc_memshr_control(xc_interface *xch,
                       domid_t domid,
                       int enable);
 
+/* Set the number of pages Xen keeps allocated for breaking the sharing of
+ * pages of domid, so that a write to a shared page rarely has to wait for
+ * the allocator or fails with ENOMEM.  The pages are not accounted to the
+ * domain until they are used, and target may not exceed its max_pages.
+ * 0 disables the pool.  If count is not NULL, it is set to the number of
+ * pages currently held, as the pool is refilled in the background.
+ */
+int xc_memshr_pool_size(xc_interface *xch,
+                        domid_t domid,
+                        uint32_t target,
+                        uint32_t *count);
+
 /* Create a communication ring in which the hypervisor will place ENOMEM
  * notifications.
  *
@@ -2200,6 +2551,49 @@ int xc_memshr_range_share(xc_interface *xch,
                           uint64_t first_gfn,
                           uint64_t last_gfn);
 
+/* Batched versions of xc_memshr_nominate_gfn and xc_memshr_share_gfns, with
+ * the source pages in source_domain.  Each entry may name its own client
+ * domain and gets its own result in rc; nominate fills in both handles.
+ * share nominates any page whose handle is 0 first, like
+ * xc_memshr_range_share does for a range, and fills in its handle.
+ *
+ * Returns 0 once all entries have been processed, or fails with -EINVAL if
+ * memory sharing is not enabled on the source domain.
+ */
+int xc_memshr_nominate_batch(xc_interface *xch,
+                             domid_t source_domain,
+                             xen_mem_sharing_batch_entry_t *entries,
+                             uint32_t nr);
+int xc_memshr_share_batch(xc_interface *xch,
+                          domid_t source_domain,
+                          xen_mem_sharing_batch_entry_t *entries,
+                          uint32_t nr);
+
+/* Populates a range of the (empty) physmap of a client domain with the
+ * pages of the source domain, sharing them copy-on-write.  gfns which can't
+ * be shared in the source, or which are already populated in the client,
+ * are skipped.  Both domains must be paused and have sharing enabled.
+ *
+ * May fail with -EINVAL if the range exceeds the source domain's memory or
+ * if memory sharing is not enabled on either of the domains, or with -ENOMEM
+ * if there isn't enough memory available to store the sharing metadata.
+ */
+int xc_memshr_range_fork(xc_interface *xch,
+                         domid_t source_domain,
+                         domid_t client_domain,
+                         uint64_t first_gfn,
+                         uint64_t last_gfn);
+
+/* Makes an empty, paused HVM client domain a copy-on-write clone of a
+ * paused source domain: all shareable memory via xc_memshr_range_fork, then
+ * the source's HVM context.  The toolstack is responsible for the pages
+ * skipped by the fork (such as the special pages), for devices and for
+ * xenstore.
+ */
+int xc_memshr_fork_domain(xc_interface *xch,
+                          domid_t source_domain,
+                          domid_t client_domain);
+
 /* Debug calls: return the number of pages referencing the shared frame backing
  * the input argument. Should be one or greater. 
  *
@@ -2446,6 +2840,7 @@ enum xc_psr_cat_type {
     XC_PSR_CAT_L3_CBM      = 1,
     XC_PSR_CAT_L3_CBM_CODE = 2,
     XC_PSR_CAT_L3_CBM_DATA = 3,
+    XC_PSR_MBA_THRTL       = 4,
 };
 typedef enum xc_psr_cat_type xc_psr_cat_type;
 
@@ -2473,6 +2868,9 @@ int xc_psr_cat_get_domain_data(xc_interface *xch, uint32_t domid,
 int xc_psr_cat_get_l3_info(xc_interface *xch, uint32_t socket,
                            uint32_t *cos_max, uint32_t *cbm_len,
                            bool *cdp_enabled);
+int xc_psr_mba_get_info(xc_interface *xch, uint32_t socket,
+                        uint32_t *cos_max, uint32_t *thrtl_max,
+                        bool *linear);
 
 int xc_get_cpu_levelling_caps(xc_interface *xch, uint32_t *caps);
 int xc_get_cpu_featureset(xc_interface *xch, uint32_t index,
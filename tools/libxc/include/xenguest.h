@@ -29,6 +29,8 @@
 #define XCFLAGS_HVM       (1 << 2)
 #define XCFLAGS_STDVGA    (1 << 3)
 #define XCFLAGS_CHECKPOINT_COMPRESS    (1 << 4)
+#define XCFLAGS_STREAM_COMPRESS        (1 << 5)
+#define XCFLAGS_CHECKPOINT_ASYNC       (1 << 6)
 
 #define X86_64_B_SIZE   64 
 #define X86_32_B_SIZE   32
@@ -39,6 +41,30 @@
  */
 struct xenevtchn_handle;
 
+/*
+ * Statistics about a live migration's pre-copy phase, handed to the
+ * precopy_policy callback before each iteration.  Rates are in pages per
+ * second, and are measured over the most recent iteration.
+ */
+struct precopy_stats
+{
+    unsigned int iteration;      /* Iterations completed so far. */
+    unsigned long total_written; /* Pages sent so far. */
+    unsigned long dirty_count;   /* Pages dirty now, to send next. */
+    unsigned long round_pages;   /* Pages sent in the last iteration. */
+    unsigned long round_ms;      /* Duration of the last iteration. */
+    unsigned long send_rate;
+    unsigned long dirty_rate;
+    unsigned long downtime_ms;   /* Predicted, if suspended now. */
+    unsigned int throttle;       /* % of the guest's cpu time withheld. */
+};
+
+/* Return values of precopy_policy. */
+#define XGS_POLICY_ABORT            (-1) /* Fail the migration. */
+#define XGS_POLICY_CONTINUE_PRECOPY   0  /* Run another iteration. */
+#define XGS_POLICY_STOP_AND_COPY      1  /* Suspend and send the rest. */
+#define XGS_POLICY_THROTTLE           2  /* Slow the guest, then continue. */
+
 /* callbacks provided by xc_domain_save */
 struct save_callbacks {
     /* Called after expiration of checkpoint interval,
@@ -80,6 +106,15 @@ struct save_callbacks {
     /* Enable qemu-dm logging dirty pages to xen */
     int (*switch_qemu_logdirty)(int domid, unsigned enable, void *data); /* HVM only */
 
+    /*
+     * Called before each pre-copy iteration of a live migration to decide
+     * what to do next.  Returns one of XGS_POLICY_*.  XGS_POLICY_THROTTLE
+     * halves the guest's remaining cpu time using a credit scheduler cap,
+     * which is undone if the migration fails.  If NULL, pre-copy runs until
+     * the dirty set is small, stops shrinking, or max_iters is reached.
+     */
+    int (*precopy_policy)(struct precopy_stats stats, void *data);
+
     /* to be provided as the last argument to each callback function */
     void* data;
 };
@@ -416,6 +416,50 @@ elfnote_dump_format_version(xc_interface *xch,
     return dump_rtn(xch, args, (char*)&format_version, sizeof(format_version));
 }
 
+/*
+ * Map the @nr frames in @gmfns in one go, and dump the contents of those
+ * which could be mapped, recording their pfns (@pfns) in @p2m_array, or in
+ * @pfn_array if that is NULL (auto-translated guest), from index *@j on.
+ * Frames which can't be mapped are skipped.
+ */
+static int
+dump_pages_batch(xc_interface *xch, uint32_t domid, void *args,
+                 dumpcore_rtn_t dump_rtn, char *dump_mem,
+                 const xen_pfn_t *gmfns, const xen_pfn_t *pfns, int *err,
+                 unsigned int nr, struct xen_dumpcore_p2m *p2m_array,
+                 uint64_t *pfn_array, unsigned long *j)
+{
+    char *vaddr;
+    unsigned int i, done = 0;
+
+    if ( nr == 0 )
+        return 0;
+
+    vaddr = xenforeignmemory_map(xch->fmem, domid, PROT_READ, nr, gmfns, err);
+    if ( vaddr == NULL )
+        return 0;
+
+    for ( i = 0; i < nr; i++ )
+    {
+        if ( err[i] )
+            continue;
+
+        memcpy(dump_mem + done * PAGE_SIZE, vaddr + i * PAGE_SIZE, PAGE_SIZE);
+        if ( p2m_array != NULL )
+        {
+            p2m_array[*j].pfn = pfns[i];
+            p2m_array[*j].gmfn = gmfns[i];
+        }
+        else
+            pfn_array[*j] = pfns[i];
+        (*j)++;
+        done++;
+    }
+    xenforeignmemory_unmap(xch->fmem, vaddr, nr);
+
+    return dump_rtn(xch, args, dump_mem, done * PAGE_SIZE);
+}
+
 int
 xc_domain_dumpcore_via_callback(xc_interface *xch,
                                 uint32_t domid,
@@ -428,7 +472,10 @@ xc_domain_dumpcore_via_callback(xc_interface *xch,
     struct domain_info_context *dinfo = &_dinfo;
 
     int nr_vcpus = 0;
-    char *dump_mem, *dump_mem_start = NULL;
+    char *dump_mem_start = NULL;
+    xen_pfn_t *batch_gmfns = NULL, *batch_pfns = NULL;
+    int *batch_err = NULL;
+    unsigned int nr_batch;
     vcpu_guest_context_any_t *ctxt = NULL;
     struct xc_core_arch_context arch_ctxt;
     char dummy[PAGE_SIZE];
@@ -466,7 +513,10 @@ xc_domain_dumpcore_via_callback(xc_interface *xch,
     }
 
     xc_core_arch_context_init(&arch_ctxt);
-    if ( (dump_mem_start = malloc(DUMP_INCREMENT*PAGE_SIZE)) == NULL )
+    if ( (dump_mem_start = malloc(DUMP_INCREMENT*PAGE_SIZE)) == NULL ||
+         (batch_gmfns = malloc(DUMP_INCREMENT * sizeof(*batch_gmfns))) == NULL ||
+         (batch_pfns = malloc(DUMP_INCREMENT * sizeof(*batch_pfns))) == NULL ||
+         (batch_err = malloc(DUMP_INCREMENT * sizeof(*batch_err))) == NULL )
     {
         PERROR("Could not allocate dump_mem");
         goto out;
@@ -775,9 +825,13 @@ xc_domain_dumpcore_via_callback(xc_interface *xch,
     if ( sts != 0 )
         goto out;
 
-    /* dump pages: .xen_pages */
+    /*
+     * dump pages: .xen_pages
+     * They're mapped DUMP_INCREMENT at a time, rather than one mmap() and
+     * munmap() each.
+     */
     j = 0;
-    dump_mem = dump_mem_start;
+    nr_batch = 0;
     for ( map_idx = 0; map_idx < nr_memory_map; map_idx++ )
     {
         uint64_t pfn_start;
@@ -788,8 +842,16 @@ xc_domain_dumpcore_via_callback(xc_interface *xch,
         for ( i = pfn_start; i < pfn_end; i++ )
         {
             uint64_t gmfn;
-            void *vaddr;
-            
+
+            if ( j + nr_batch >= nr_pages )
+            {
+                sts = dump_pages_batch(
+                    xch, domid, args, dump_rtn, dump_mem_start, batch_gmfns,
+                    batch_pfns, batch_err, nr_batch, p2m_array, pfn_array, &j);
+                if ( sts != 0 )
+                    goto out;
+                nr_batch = 0;
+            }
             if ( j >= nr_pages )
             {
                 /*
@@ -817,9 +879,6 @@ xc_domain_dumpcore_via_callback(xc_interface *xch,
                     if ( gmfn == (uint32_t)INVALID_PFN )
                        continue;
                 }
-
-                p2m_array[j].pfn = i;
-                p2m_array[j].gmfn = gmfn;
             }
             else
             {
@@ -827,31 +886,26 @@ xc_domain_dumpcore_via_callback(xc_interface *xch,
                     continue;
 
                 gmfn = i;
-                pfn_array[j] = i;
             }
 
-            vaddr = xc_map_foreign_range(
-                xch, domid, PAGE_SIZE, PROT_READ, gmfn);
-            if ( vaddr == NULL )
-                continue;
-            memcpy(dump_mem, vaddr, PAGE_SIZE);
-            munmap(vaddr, PAGE_SIZE);
-            dump_mem += PAGE_SIZE;
-            if ( (j + 1) % DUMP_INCREMENT == 0 )
+            batch_gmfns[nr_batch] = gmfn;
+            batch_pfns[nr_batch] = i;
+            if ( ++nr_batch == DUMP_INCREMENT )
             {
-                sts = dump_rtn(
-                    xch, args, dump_mem_start, dump_mem - dump_mem_start);
+                sts = dump_pages_batch(
+                    xch, domid, args, dump_rtn, dump_mem_start, batch_gmfns,
+                    batch_pfns, batch_err, nr_batch, p2m_array, pfn_array, &j);
                 if ( sts != 0 )
                     goto out;
-                dump_mem = dump_mem_start;
+                nr_batch = 0;
             }
-
-            j++;
         }
     }
 
 copy_done:
-    sts = dump_rtn(xch, args, dump_mem_start, dump_mem - dump_mem_start);
+    sts = dump_pages_batch(
+        xch, domid, args, dump_rtn, dump_mem_start, batch_gmfns, batch_pfns,
+        batch_err, nr_batch, p2m_array, pfn_array, &j);
     if ( sts != 0 )
         goto out;
     if ( j < nr_pages )
@@ -909,6 +963,9 @@ out:
         free(ctxt);
     if ( dump_mem_start != NULL )
         free(dump_mem_start);
+    free(batch_gmfns);
+    free(batch_pfns);
+    free(batch_err);
     if ( live_shinfo != NULL )
         munmap(live_shinfo, PAGE_SIZE);
     xc_core_arch_context_free(&arch_ctxt);
@@ -921,16 +978,55 @@ struct dump_args {
     int     fd;
 };
 
-/* Callback routine for writing to a local dump file. */
+static int page_is_zero(const char *page)
+{
+    const unsigned long *p = (const unsigned long *)page;
+    unsigned int i;
+
+    for ( i = 0; i < PAGE_SIZE / sizeof(*p); i++ )
+        if ( p[i] )
+            return 0;
+
+    return 1;
+}
+
+/*
+ * Callback routine for writing to a local dump file.  Pages which are all
+ * zeroes are seeked over rather than written, leaving holes in the file.
+ */
 static int local_file_dump(xc_interface *xch,
                            void *args, char *buffer, unsigned int length)
 {
     struct dump_args *da = args;
+    unsigned int off, len;
 
-    if ( write_exact(da->fd, buffer, length) == -1 )
+    for ( off = 0; off < length; off += len )
     {
-        PERROR("Failed to write buffer");
-        return -errno;
+        len = length - off;
+        if ( len % PAGE_SIZE == 0 && page_is_zero(buffer + off) )
+        {
+            for ( len = PAGE_SIZE;
+                  off + len < length && page_is_zero(buffer + off + len);
+                  len += PAGE_SIZE )
+                ;
+            if ( lseek(da->fd, len, SEEK_CUR) == -1 )
+            {
+                PERROR("Failed to seek over zero pages");
+                return -errno;
+            }
+            continue;
+        }
+
+        if ( len % PAGE_SIZE == 0 )
+            for ( len = PAGE_SIZE;
+                  off + len < length && !page_is_zero(buffer + off + len);
+                  len += PAGE_SIZE )
+                ;
+        if ( write_exact(da->fd, buffer + off, len) == -1 )
+        {
+            PERROR("Failed to write buffer");
+            return -errno;
+        }
     }
 
     if ( length >= (DUMP_INCREMENT * PAGE_SIZE) )
@@ -960,6 +1056,13 @@ xc_domain_dumpcore(xc_interface *xch,
     sts = xc_domain_dumpcore_via_callback(
         xch, domid, &da, &local_file_dump);
 
+    /* The dump may end in a hole, which only extending the file creates. */
+    if ( sts == 0 && ftruncate(da.fd, lseek(da.fd, 0, SEEK_CUR)) == -1 )
+    {
+        PERROR("Could not set the size of corefile %s", corename);
+        sts = -errno;
+    }
+
     /* flush and discard any remaining portion of the file from cache */
     discard_file_cache(xch, da.fd, 1/* flush first*/);
 
@@ -30,6 +30,9 @@
 #include <inttypes.h>
 #include <zlib.h>
 #include <assert.h>
+#ifndef __MINIOS__
+#include <dirent.h>
+#endif
 
 #include "xg_private.h"
 #include "xc_dom.h"
@@ -810,13 +813,162 @@ int xc_dom_devicetree_max_size(struct xc_dom_image *dom, size_t sz)
     return 0;
 }
 
+/* ------------------------------------------------------------------------ */
+/* decompressed kernel cache                                                */
+
+#ifndef __MINIOS__
+int xc_dom_kernel_cache(struct xc_dom_image *dom, const char *dir)
+{
+    DOMPRINTF("%s: dir=\"%s\"", __FUNCTION__, dir);
+    dom->kernel_cache_dir = xc_dom_strdup(dom, dir);
+    return dom->kernel_cache_dir ? 0 : -1;
+}
+
+/*
+ * Look @filename up in the cache.  On a hit, map the cached image as the
+ * kernel and return 0.  Otherwise remember the key for
+ * kernel_cache_store() and return -1.
+ */
+static int kernel_cache_lookup(struct xc_dom_image *dom, const char *filename)
+{
+    struct stat st;
+    char key[128], *path;
+    size_t size;
+
+    if ( stat(filename, &st) || !S_ISREG(st.st_mode) )
+        return -1;
+
+    snprintf(key, sizeof(key), "%lx-%lx-%lx-%lx.%lx-%lx.%lx",
+             (unsigned long)st.st_dev, (unsigned long)st.st_ino,
+             (unsigned long)st.st_size,
+             (unsigned long)st.st_mtim.tv_sec, st.st_mtim.tv_nsec,
+             (unsigned long)st.st_ctim.tv_sec, st.st_ctim.tv_nsec);
+    dom->kernel_cache_key = xc_dom_strdup(dom, key);
+
+    path = xc_dom_malloc(dom, strlen(dom->kernel_cache_dir) + strlen(key) + 2);
+    if ( !dom->kernel_cache_key || !path )
+        return -1;
+    sprintf(path, "%s/%s", dom->kernel_cache_dir, key);
+
+    if ( stat(path, &st) || !S_ISREG(st.st_mode) || st.st_size == 0 )
+        return -1;
+
+    dom->kernel_blob = xc_dom_malloc_filemap(dom, path, &size,
+                                             dom->max_kernel_size);
+    if ( dom->kernel_blob == NULL )
+        return -1;
+
+    DOMPRINTF("%s: using cached kernel %s", __FUNCTION__, path);
+    dom->kernel_size = size;
+    dom->kernel_cache_hit = true;
+    return 0;
+}
+
+/*
+ * Remove cache entries for older versions of the same kernel file, i.e.
+ * those with the same device and inode but a different key.
+ */
+static void kernel_cache_prune(struct xc_dom_image *dom)
+{
+    const char *key = dom->kernel_cache_key;
+    size_t prefix = strchr(strchr(key, '-') + 1, '-') + 1 - key;
+    struct dirent *de;
+    DIR *dir = opendir(dom->kernel_cache_dir);
+
+    if ( !dir )
+        return;
+
+    while ( (de = readdir(dir)) != NULL )
+        if ( !strncmp(de->d_name, key, prefix) && strcmp(de->d_name, key) )
+            unlinkat(dirfd(dir), de->d_name, 0);
+
+    closedir(dir);
+}
+
+/*
+ * Called once the image has been parsed.  If the kernel had to be
+ * decompressed (either by xc_dom_kernel_file() or by a loader's probe),
+ * write the result into the cache.  Failure to do so is not an error.
+ */
+static void kernel_cache_store(struct xc_dom_image *dom)
+{
+    char *path, *tmp;
+    int fd;
+
+    if ( !dom->kernel_cache_key || dom->kernel_cache_hit ||
+         ((dom->kernel_blob >= dom->kernel_file_blob) &&
+          (dom->kernel_blob < dom->kernel_file_blob + dom->kernel_file_size)) )
+        return;
+
+    path = xc_dom_malloc(dom, strlen(dom->kernel_cache_dir) +
+                         strlen(dom->kernel_cache_key) + 2);
+    tmp = xc_dom_malloc(dom, strlen(dom->kernel_cache_dir) +
+                        strlen(dom->kernel_cache_key) + 32);
+    if ( !path || !tmp )
+        return;
+    sprintf(path, "%s/%s", dom->kernel_cache_dir, dom->kernel_cache_key);
+    sprintf(tmp, "%s.tmp.%d", path, (int)getpid());
+
+    if ( mkdir(dom->kernel_cache_dir, 0700) && errno != EEXIST )
+        goto err;
+
+    fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL, 0600);
+    if ( fd < 0 )
+        goto err;
+
+    if ( write_exact(fd, dom->kernel_blob, dom->kernel_size) )
+    {
+        close(fd);
+        unlink(tmp);
+        goto err;
+    }
+    close(fd);
+
+    kernel_cache_prune(dom);
+
+    if ( rename(tmp, path) )
+    {
+        unlink(tmp);
+        goto err;
+    }
+
+    DOMPRINTF("%s: cached 0x%zx byte kernel as %s", __FUNCTION__,
+              dom->kernel_size, path);
+    return;
+
+ err:
+    DOMPRINTF("%s: unable to cache kernel as %s: %s", __FUNCTION__,
+              path, strerror(errno));
+}
+#else
+int xc_dom_kernel_cache(struct xc_dom_image *dom, const char *dir)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+static int kernel_cache_lookup(struct xc_dom_image *dom, const char *filename)
+{
+    return -1;
+}
+
+static void kernel_cache_store(struct xc_dom_image *dom)
+{
+}
+#endif
+
 int xc_dom_kernel_file(struct xc_dom_image *dom, const char *filename)
 {
     DOMPRINTF("%s: filename=\"%s\"", __FUNCTION__, filename);
+    if ( dom->kernel_cache_dir && !kernel_cache_lookup(dom, filename) )
+        return 0;
+
     dom->kernel_blob = xc_dom_malloc_filemap(dom, filename, &dom->kernel_size,
                                              dom->max_kernel_size);
     if ( dom->kernel_blob == NULL )
         return -1;
+    dom->kernel_file_blob = dom->kernel_blob;
+    dom->kernel_file_size = dom->kernel_size;
     return xc_dom_try_gunzip(dom, &dom->kernel_blob, &dom->kernel_size);
 }
 
@@ -909,6 +1061,8 @@ int xc_dom_parse_image(struct xc_dom_image *dom)
             goto err;
         }
     }
+
+    kernel_cache_store(dom);
     return 0;
 
  err:
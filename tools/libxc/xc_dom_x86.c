@@ -27,6 +27,10 @@
 #include <string.h>
 #include <inttypes.h>
 #include <assert.h>
+#include <time.h>
+#ifndef __MINIOS__
+#include <pthread.h>
+#endif
 
 #include <xen/xen.h>
 #include <xen/foreign/x86_32.h>
@@ -1061,11 +1065,219 @@ static int x86_compat(xc_interface *xch, domid_t domid, char *guest_type)
     return rc;
 }
 
+/*
+ * The physical node all of the guest's memory is to come from, if its vNUMA
+ * layout puts every vnode on the same one, else XC_NUMA_NO_NODE.
+ */
+static unsigned int claim_node(struct xc_dom_image *dom)
+{
+    unsigned int i, pnode;
+
+    if ( dom->nr_vnodes == 0 )
+        return XC_NUMA_NO_NODE;
+
+    pnode = dom->vnode_to_pnode[0];
+    for ( i = 1; i < dom->nr_vnodes; i++ )
+        if ( dom->vnode_to_pnode[i] != pnode )
+            return XC_NUMA_NO_NODE;
+
+    return pnode;
+}
+
+/*
+ * Guest memory is populated one vmemrange at a time.  With vNUMA, each
+ * vmemrange is populated from a thread of its own: the allocations for
+ * different nodes are independent, and for large guests the populate
+ * hypercalls dominate domain build time.
+ */
+struct populate_work
+{
+    struct xc_dom_image *dom;
+    int (*fn)(struct populate_work *w);
+
+    unsigned int vmemid;
+    unsigned int vnode;
+    unsigned int pnode;
+    unsigned int memflags;
+    bool strict;                       /* dom->superpages_strict, no PoD */
+    xen_pfn_t start, end;              /* pfns [start, end) to populate */
+
+    int rc;
+    unsigned long stat_normal_pages, stat_2mb_pages, stat_1gb_pages;
+    uint64_t usecs;
+};
+
+static uint64_t now_usecs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void *populate_one(void *arg)
+{
+    struct populate_work *w = arg;
+    uint64_t start = now_usecs();
+
+    w->rc = w->fn(w);
+    w->usecs = now_usecs() - start;
+
+    return NULL;
+}
+
+static int populate_vmemranges(struct xc_dom_image *dom,
+                               struct populate_work *work, unsigned int nr,
+                               bool parallel)
+{
+    unsigned int i;
+    int rc = 0;
+#ifndef __MINIOS__
+    pthread_t threads[nr];
+    bool started[nr];
+
+    for ( i = 0; i < nr; i++ )
+        started[i] = parallel && nr > 1 &&
+            !pthread_create(&threads[i], NULL, populate_one, &work[i]);
+
+    for ( i = 0; i < nr; i++ )
+    {
+        if ( started[i] )
+            pthread_join(threads[i], NULL);
+        else
+            populate_one(&work[i]);
+    }
+#else
+    for ( i = 0; i < nr; i++ )
+        populate_one(&work[i]);
+#endif
+
+    dom->populate_stats = xc_dom_malloc(dom, nr * sizeof(*dom->populate_stats));
+    dom->nr_populate_stats = dom->populate_stats ? nr : 0;
+
+    for ( i = 0; i < nr; i++ )
+    {
+        DOMPRINTF("%s: vmemrange %u (pnode %d): 0x%"PRIpfn" pages in %"PRIu64
+                  "us", __func__, work[i].vmemid, (int)work[i].pnode,
+                  work[i].end - work[i].start, work[i].usecs);
+        if ( work[i].rc && !rc )
+            rc = work[i].rc;
+
+        if ( dom->populate_stats )
+        {
+            struct xc_dom_populate_stats *s = &dom->populate_stats[i];
+
+            s->vnode = work[i].vnode;
+            s->pnode = work[i].pnode;
+            s->nr_4k = work[i].stat_normal_pages;
+            s->nr_2m = work[i].stat_2mb_pages;
+            s->nr_1g = work[i].stat_1gb_pages;
+        }
+    }
+
+    return rc;
+}
+
+/*
+ * Strict superpage population retries for a while before giving up: free
+ * memory only merges into superpages in Xen's heap as it gets freed, and
+ * memory getting freed (e.g. by domains being destroyed) may complete one.
+ */
+#define SUPERPAGE_STRICT_RETRIES    10
+#define SUPERPAGE_STRICT_DELAY_US   100000
+
+/* Populate nr superpages, returning how many got populated. */
+static long populate_superpages(struct populate_work *w, unsigned long nr,
+                                unsigned int order, xen_pfn_t *extents)
+{
+    struct xc_dom_image *dom = w->dom;
+    unsigned int retries = 0;
+    unsigned long done = 0;
+    long rc;
+
+    for ( ; ; )
+    {
+        rc = xc_domain_populate_physmap(dom->xch, dom->guest_domid,
+                                        nr - done, order, w->memflags,
+                                        extents + done);
+        if ( rc > 0 )
+            done += rc;
+
+        if ( done == nr || !w->strict ||
+             retries++ == SUPERPAGE_STRICT_RETRIES )
+            return done;
+
+        usleep(SUPERPAGE_STRICT_DELAY_US);
+    }
+}
+
+static int populate_vmemrange_pv(struct populate_work *w)
+{
+    struct xc_dom_image *dom = w->dom;
+    xen_pfn_t pfn, allocsz, mfn, pfn_base = w->start, pfn_base_idx;
+    uint64_t pages = w->end - w->start;
+    uint64_t super_pages = pages >> SUPERPAGE_2MB_SHIFT;
+    xen_pfn_t extents[SUPERPAGE_BATCH_SIZE];
+    int rc, j, k;
+
+    pfn_base_idx = pfn_base;
+    while ( super_pages ) {
+        uint64_t count = min_t(uint64_t, super_pages, SUPERPAGE_BATCH_SIZE);
+        super_pages -= count;
+
+        for ( pfn = pfn_base_idx, j = 0;
+              pfn < pfn_base_idx + (count << SUPERPAGE_2MB_SHIFT);
+              pfn += SUPERPAGE_2MB_NR_PFNS, j++ )
+            extents[j] = dom->p2m_host[pfn];
+        rc = xc_domain_populate_physmap(dom->xch, dom->guest_domid, count,
+                                        SUPERPAGE_2MB_SHIFT, w->memflags,
+                                        extents);
+        if ( rc < 0 )
+            return rc;
+
+        /* Expand the returned mfns into the p2m array. */
+        pfn = pfn_base_idx;
+        for ( j = 0; j < rc; j++ )
+        {
+            mfn = extents[j];
+            for ( k = 0; k < SUPERPAGE_2MB_NR_PFNS; k++, pfn++ )
+                dom->p2m_host[pfn] = mfn + k;
+        }
+        w->stat_2mb_pages += rc;
+        pfn_base_idx = pfn;
+    }
+
+    for ( j = pfn_base_idx - pfn_base; j < pages; j += allocsz )
+    {
+        allocsz = min_t(uint64_t, 1024 * 1024, pages - j);
+        rc = xc_domain_populate_physmap_exact(dom->xch, dom->guest_domid,
+                 allocsz, 0, w->memflags, &dom->p2m_host[pfn_base + j]);
+
+        if ( rc )
+        {
+            if ( w->pnode != XC_NUMA_NO_NODE )
+                xc_dom_panic(dom->xch, XC_INTERNAL_ERROR,
+                             "%s: failed to allocate 0x%"PRIx64" pages (v=%d, p=%d)",
+                             __func__, pages, w->vmemid, w->pnode);
+            else
+                xc_dom_panic(dom->xch, XC_INTERNAL_ERROR,
+                             "%s: failed to allocate 0x%"PRIx64" pages",
+                             __func__, pages);
+            return rc;
+        }
+        w->stat_normal_pages += allocsz;
+    }
+
+    return 0;
+}
+
 static int meminit_pv(struct xc_dom_image *dom)
 {
     int rc;
-    xen_pfn_t pfn, allocsz, mfn, total, pfn_base;
-    int i, j, k;
+    xen_pfn_t pfn, total;
+    int i;
+    struct populate_work *work;
     xen_vmemrange_t dummy_vmemrange[1];
     unsigned int dummy_vnode_to_pnode[1];
     xen_vmemrange_t *vmemranges;
@@ -1079,8 +1291,8 @@ static int meminit_pv(struct xc_dom_image *dom)
     /* try to claim pages for early warning of insufficient memory avail */
     if ( dom->claim_enabled )
     {
-        rc = xc_domain_claim_pages(dom->xch, dom->guest_domid,
-                                   dom->total_pages);
+        rc = xc_domain_claim_pages_node(dom->xch, dom->guest_domid,
+                                        claim_node(dom), dom->total_pages);
         if ( rc )
             return rc;
     }
@@ -1139,73 +1351,32 @@ static int meminit_pv(struct xc_dom_image *dom)
         dom->p2m_host[pfn] = INVALID_PFN;
 
     /* allocate guest memory */
+    work = calloc(nr_vmemranges, sizeof(*work));
+    if ( work == NULL )
+        return -ENOMEM;
+
     for ( i = 0; i < nr_vmemranges; i++ )
     {
-        unsigned int memflags;
-        uint64_t pages, super_pages;
         unsigned int pnode = vnode_to_pnode[vmemranges[i].nid];
-        xen_pfn_t extents[SUPERPAGE_BATCH_SIZE];
-        xen_pfn_t pfn_base_idx;
 
-        memflags = 0;
+        work[i].dom = dom;
+        work[i].fn = populate_vmemrange_pv;
+        work[i].vmemid = i;
+        work[i].vnode = vmemranges[i].nid;
+        work[i].pnode = pnode;
         if ( pnode != XC_NUMA_NO_NODE )
-            memflags |= XENMEMF_exact_node(pnode);
+            work[i].memflags |= XENMEMF_exact_node(pnode);
+        work[i].start = vmemranges[i].start >> PAGE_SHIFT;
+        work[i].end = vmemranges[i].end >> PAGE_SHIFT;
 
-        pages = (vmemranges[i].end - vmemranges[i].start) >> PAGE_SHIFT;
-        super_pages = pages >> SUPERPAGE_2MB_SHIFT;
-        pfn_base = vmemranges[i].start >> PAGE_SHIFT;
-
-        for ( pfn = pfn_base; pfn < pfn_base+pages; pfn++ )
+        for ( pfn = work[i].start; pfn < work[i].end; pfn++ )
             dom->p2m_host[pfn] = pfn;
-
-        pfn_base_idx = pfn_base;
-        while ( super_pages ) {
-            uint64_t count = min_t(uint64_t, super_pages, SUPERPAGE_BATCH_SIZE);
-            super_pages -= count;
-
-            for ( pfn = pfn_base_idx, j = 0;
-                  pfn < pfn_base_idx + (count << SUPERPAGE_2MB_SHIFT);
-                  pfn += SUPERPAGE_2MB_NR_PFNS, j++ )
-                extents[j] = dom->p2m_host[pfn];
-            rc = xc_domain_populate_physmap(dom->xch, dom->guest_domid, count,
-                                            SUPERPAGE_2MB_SHIFT, memflags,
-                                            extents);
-            if ( rc < 0 )
-                return rc;
-
-            /* Expand the returned mfns into the p2m array. */
-            pfn = pfn_base_idx;
-            for ( j = 0; j < rc; j++ )
-            {
-                mfn = extents[j];
-                for ( k = 0; k < SUPERPAGE_2MB_NR_PFNS; k++, pfn++ )
-                    dom->p2m_host[pfn] = mfn + k;
-            }
-            pfn_base_idx = pfn;
-        }
-
-        for ( j = pfn_base_idx - pfn_base; j < pages; j += allocsz )
-        {
-            allocsz = min_t(uint64_t, 1024 * 1024, pages - j);
-            rc = xc_domain_populate_physmap_exact(dom->xch, dom->guest_domid,
-                     allocsz, 0, memflags, &dom->p2m_host[pfn_base + j]);
-
-            if ( rc )
-            {
-                if ( pnode != XC_NUMA_NO_NODE )
-                    xc_dom_panic(dom->xch, XC_INTERNAL_ERROR,
-                                 "%s: failed to allocate 0x%"PRIx64" pages (v=%d, p=%d)",
-                                 __func__, pages, i, pnode);
-                else
-                    xc_dom_panic(dom->xch, XC_INTERNAL_ERROR,
-                                 "%s: failed to allocate 0x%"PRIx64" pages",
-                                 __func__, pages);
-                return rc;
-            }
-        }
-        rc = 0;
     }
 
+    rc = populate_vmemranges(dom, work, nr_vmemranges,
+                             dom->nr_vmemranges != 0);
+    free(work);
+
     /* Ensure no unclaimed pages are left unused.
      * OK to call if hadn't done the earlier claim call. */
     xc_domain_claim_pages(dom->xch, dom->guest_domid, 0 /* cancel claim */);
@@ -1226,12 +1397,158 @@ static int check_mmio_hole(uint64_t start, uint64_t memsize,
         return 1;
 }
 
+static int populate_vmemrange_hvm(struct populate_work *w)
+{
+    struct xc_dom_image *dom = w->dom;
+    xc_interface *xch = dom->xch;
+    uint32_t domid = dom->guest_domid;
+    unsigned long i, cur_pages = w->start, cur_pfn;
+    uint64_t end_pages = w->end;
+    bool try_1gb = true;
+    int rc = 0;
+
+    while ( (rc == 0) && (end_pages > cur_pages) )
+    {
+        /* Clip count to maximum 1GB extent. */
+        unsigned long count = end_pages - cur_pages;
+        unsigned long max_pages = SUPERPAGE_1GB_NR_PFNS;
+
+        if ( count > max_pages )
+            count = max_pages;
+
+        cur_pfn = dom->p2m_host[cur_pages];
+
+        /* Take care the corner cases of super page tails */
+        if ( ((cur_pfn & (SUPERPAGE_1GB_NR_PFNS-1)) != 0) &&
+             (count > (-cur_pfn & (SUPERPAGE_1GB_NR_PFNS-1))) )
+            count = -cur_pfn & (SUPERPAGE_1GB_NR_PFNS-1);
+        else if ( ((count & (SUPERPAGE_1GB_NR_PFNS-1)) != 0) &&
+                  (count > SUPERPAGE_1GB_NR_PFNS) )
+            count &= ~(SUPERPAGE_1GB_NR_PFNS - 1);
+
+        /* Attemp to allocate 1GB super page. Because in each pass
+         * we only allocate at most 1GB, we don't have to clip
+         * super page boundaries.
+         */
+        if ( try_1gb &&
+             ((count | cur_pfn) & (SUPERPAGE_1GB_NR_PFNS - 1)) == 0 &&
+             /* Check if there exists MMIO hole in the 1GB memory
+              * range */
+             !check_mmio_hole(cur_pfn << PAGE_SHIFT,
+                              SUPERPAGE_1GB_NR_PFNS << PAGE_SHIFT,
+                              dom->mmio_start, dom->mmio_size) )
+        {
+            long done;
+            unsigned long nr_extents = count >> SUPERPAGE_1GB_SHIFT;
+            xen_pfn_t sp_extents[nr_extents];
+
+            for ( i = 0; i < nr_extents; i++ )
+                sp_extents[i] =
+                    dom->p2m_host[cur_pages+(i<<SUPERPAGE_1GB_SHIFT)];
+
+            done = populate_superpages(w, nr_extents, SUPERPAGE_1GB_SHIFT,
+                                       sp_extents);
+
+            if ( done > 0 )
+            {
+                w->stat_1gb_pages += done;
+                done <<= SUPERPAGE_1GB_SHIFT;
+                cur_pages += done;
+                count -= done;
+            }
+
+            if ( count != 0 && w->strict )
+            {
+                xc_dom_panic(xch, XC_OUT_OF_MEMORY,
+                             "%s: no 1GB page for pfn 0x%"PRIpfn" (v=%u, p=%d)",
+                             __func__, dom->p2m_host[cur_pages], w->vnode,
+                             (int)w->pnode);
+                rc = -ENOMEM;
+                break;
+            }
+
+            /*
+             * The node has no (more) free 1GB extents.  Don't keep asking
+             * for them for the rest of this range.
+             */
+            if ( count != 0 )
+                try_1gb = false;
+        }
+
+        if ( count != 0 )
+        {
+            /* Clip count to maximum 8MB extent. */
+            max_pages = SUPERPAGE_2MB_NR_PFNS * 4;
+            if ( count > max_pages )
+                count = max_pages;
+
+            /* Clip partial superpage extents to superpage
+             * boundaries. */
+            if ( ((cur_pfn & (SUPERPAGE_2MB_NR_PFNS-1)) != 0) &&
+                 (count > (-cur_pfn & (SUPERPAGE_2MB_NR_PFNS-1))) )
+                count = -cur_pfn & (SUPERPAGE_2MB_NR_PFNS-1);
+            else if ( ((count & (SUPERPAGE_2MB_NR_PFNS-1)) != 0) &&
+                      (count > SUPERPAGE_2MB_NR_PFNS) )
+                count &= ~(SUPERPAGE_2MB_NR_PFNS - 1); /* clip non-s.p. tail */
+
+            /* Attempt to allocate superpage extents. */
+            if ( ((count | cur_pfn) & (SUPERPAGE_2MB_NR_PFNS - 1)) == 0 )
+            {
+                long done;
+                unsigned long nr_extents = count >> SUPERPAGE_2MB_SHIFT;
+                xen_pfn_t sp_extents[nr_extents];
+
+                for ( i = 0; i < nr_extents; i++ )
+                    sp_extents[i] =
+                        dom->p2m_host[cur_pages+(i<<SUPERPAGE_2MB_SHIFT)];
+
+                done = populate_superpages(w, nr_extents, SUPERPAGE_2MB_SHIFT,
+                                           sp_extents);
+
+                if ( done > 0 )
+                {
+                    w->stat_2mb_pages += done;
+                    done <<= SUPERPAGE_2MB_SHIFT;
+                    cur_pages += done;
+                    count -= done;
+                }
+
+                if ( count != 0 && w->strict )
+                {
+                    xc_dom_panic(xch, XC_OUT_OF_MEMORY,
+                                 "%s: no 2MB page for pfn 0x%"PRIpfn
+                                 " (v=%u, p=%d)", __func__,
+                                 dom->p2m_host[cur_pages], w->vnode,
+                                 (int)w->pnode);
+                    rc = -ENOMEM;
+                    break;
+                }
+            }
+        }
+
+        /* Fall back to 4kB extents. */
+        if ( count != 0 )
+        {
+            rc = xc_domain_populate_physmap_exact(
+                xch, domid, count, 0, w->memflags, &dom->p2m_host[cur_pages]);
+            cur_pages += count;
+            w->stat_normal_pages += count;
+        }
+    }
+
+    if ( rc != 0 )
+        DOMPRINTF("Could not allocate memory for HVM guest.");
+
+    return rc;
+}
+
 static int meminit_hvm(struct xc_dom_image *dom)
 {
     unsigned long i, vmemid, nr_pages = dom->total_pages;
     unsigned long p2m_size;
     unsigned long target_pages = dom->target_pages;
-    unsigned long cur_pages, cur_pfn;
+    struct populate_work *work;
+    uint64_t start_us;
     int rc;
     unsigned long stat_normal_pages = 0, stat_2mb_pages = 0, 
         stat_1gb_pages = 0;
@@ -1340,8 +1657,8 @@ static int meminit_hvm(struct xc_dom_image *dom)
      * allocated is pointless.
      */
     if ( claim_enabled ) {
-        rc = xc_domain_claim_pages(xch, domid,
-                                   target_pages - dom->vga_hole_size);
+        rc = xc_domain_claim_pages_node(xch, domid, claim_node(dom),
+                                        target_pages - dom->vga_hole_size);
         if ( rc != 0 )
         {
             DOMPRINTF("Could not allocate memory for HVM guest as we cannot claim memory!");
@@ -1388,18 +1705,30 @@ static int meminit_hvm(struct xc_dom_image *dom)
         }
     }
 
-    stat_normal_pages = 0;
+    work = calloc(nr_vmemranges, sizeof(*work));
+    if ( work == NULL )
+    {
+        DOMPRINTF("Could not allocate populate state");
+        goto error_out;
+    }
+
     for ( vmemid = 0; vmemid < nr_vmemranges; vmemid++ )
     {
-        unsigned int new_memflags = memflags;
-        uint64_t end_pages;
         unsigned int vnode = vmemranges[vmemid].nid;
         unsigned int pnode = vnode_to_pnode[vnode];
 
+        work[vmemid].dom = dom;
+        work[vmemid].fn = populate_vmemrange_hvm;
+        work[vmemid].vmemid = vmemid;
+        work[vmemid].vnode = vnode;
+        work[vmemid].pnode = pnode;
+        work[vmemid].memflags = memflags;
+        work[vmemid].strict = dom->superpages_strict &&
+                              !(memflags & XENMEMF_populate_on_demand);
         if ( pnode != XC_NUMA_NO_NODE )
-            new_memflags |= XENMEMF_exact_node(pnode);
+            work[vmemid].memflags |= XENMEMF_exact_node(pnode);
 
-        end_pages = vmemranges[vmemid].end >> PAGE_SHIFT;
+        work[vmemid].end = vmemranges[vmemid].end >> PAGE_SHIFT;
         /*
          * Consider vga hole belongs to the vmemrange that covers
          * 0xA0000-0xC0000. Note that 0x00000-0xA0000 is populated just
@@ -1407,126 +1736,34 @@ static int meminit_hvm(struct xc_dom_image *dom)
          */
         if ( vmemranges[vmemid].start == 0 && dom->device_model )
         {
-            cur_pages = 0xc0;
-            stat_normal_pages += 0xc0;
+            work[vmemid].start = 0xc0;
+            work[vmemid].stat_normal_pages = 0xc0;
         }
         else
-            cur_pages = vmemranges[vmemid].start >> PAGE_SHIFT;
-
-        rc = 0;
-        while ( (rc == 0) && (end_pages > cur_pages) )
-        {
-            /* Clip count to maximum 1GB extent. */
-            unsigned long count = end_pages - cur_pages;
-            unsigned long max_pages = SUPERPAGE_1GB_NR_PFNS;
-
-            if ( count > max_pages )
-                count = max_pages;
-
-            cur_pfn = dom->p2m_host[cur_pages];
-
-            /* Take care the corner cases of super page tails */
-            if ( ((cur_pfn & (SUPERPAGE_1GB_NR_PFNS-1)) != 0) &&
-                 (count > (-cur_pfn & (SUPERPAGE_1GB_NR_PFNS-1))) )
-                count = -cur_pfn & (SUPERPAGE_1GB_NR_PFNS-1);
-            else if ( ((count & (SUPERPAGE_1GB_NR_PFNS-1)) != 0) &&
-                      (count > SUPERPAGE_1GB_NR_PFNS) )
-                count &= ~(SUPERPAGE_1GB_NR_PFNS - 1);
-
-            /* Attemp to allocate 1GB super page. Because in each pass
-             * we only allocate at most 1GB, we don't have to clip
-             * super page boundaries.
-             */
-            if ( ((count | cur_pfn) & (SUPERPAGE_1GB_NR_PFNS - 1)) == 0 &&
-                 /* Check if there exists MMIO hole in the 1GB memory
-                  * range */
-                 !check_mmio_hole(cur_pfn << PAGE_SHIFT,
-                                  SUPERPAGE_1GB_NR_PFNS << PAGE_SHIFT,
-                                  dom->mmio_start, dom->mmio_size) )
-            {
-                long done;
-                unsigned long nr_extents = count >> SUPERPAGE_1GB_SHIFT;
-                xen_pfn_t sp_extents[nr_extents];
-
-                for ( i = 0; i < nr_extents; i++ )
-                    sp_extents[i] =
-                        dom->p2m_host[cur_pages+(i<<SUPERPAGE_1GB_SHIFT)];
-
-                done = xc_domain_populate_physmap(xch, domid, nr_extents,
-                                                  SUPERPAGE_1GB_SHIFT,
-                                                  new_memflags, sp_extents);
-
-                if ( done > 0 )
-                {
-                    stat_1gb_pages += done;
-                    done <<= SUPERPAGE_1GB_SHIFT;
-                    cur_pages += done;
-                    count -= done;
-                }
-            }
+            work[vmemid].start = vmemranges[vmemid].start >> PAGE_SHIFT;
+    }
 
-            if ( count != 0 )
-            {
-                /* Clip count to maximum 8MB extent. */
-                max_pages = SUPERPAGE_2MB_NR_PFNS * 4;
-                if ( count > max_pages )
-                    count = max_pages;
-
-                /* Clip partial superpage extents to superpage
-                 * boundaries. */
-                if ( ((cur_pfn & (SUPERPAGE_2MB_NR_PFNS-1)) != 0) &&
-                     (count > (-cur_pfn & (SUPERPAGE_2MB_NR_PFNS-1))) )
-                    count = -cur_pfn & (SUPERPAGE_2MB_NR_PFNS-1);
-                else if ( ((count & (SUPERPAGE_2MB_NR_PFNS-1)) != 0) &&
-                          (count > SUPERPAGE_2MB_NR_PFNS) )
-                    count &= ~(SUPERPAGE_2MB_NR_PFNS - 1); /* clip non-s.p. tail */
-
-                /* Attempt to allocate superpage extents. */
-                if ( ((count | cur_pfn) & (SUPERPAGE_2MB_NR_PFNS - 1)) == 0 )
-                {
-                    long done;
-                    unsigned long nr_extents = count >> SUPERPAGE_2MB_SHIFT;
-                    xen_pfn_t sp_extents[nr_extents];
-
-                    for ( i = 0; i < nr_extents; i++ )
-                        sp_extents[i] =
-                            dom->p2m_host[cur_pages+(i<<SUPERPAGE_2MB_SHIFT)];
-
-                    done = xc_domain_populate_physmap(xch, domid, nr_extents,
-                                                      SUPERPAGE_2MB_SHIFT,
-                                                      new_memflags, sp_extents);
-
-                    if ( done > 0 )
-                    {
-                        stat_2mb_pages += done;
-                        done <<= SUPERPAGE_2MB_SHIFT;
-                        cur_pages += done;
-                        count -= done;
-                    }
-                }
-            }
+    /* Only vNUMA guests (which can't use PoD) are populated concurrently. */
+    start_us = now_usecs();
+    rc = populate_vmemranges(dom, work, nr_vmemranges,
+                             dom->nr_vmemranges != 0);
 
-            /* Fall back to 4kB extents. */
-            if ( count != 0 )
-            {
-                rc = xc_domain_populate_physmap_exact(
-                    xch, domid, count, 0, new_memflags, &dom->p2m_host[cur_pages]);
-                cur_pages += count;
-                stat_normal_pages += count;
-            }
-        }
-
-        if ( rc != 0 )
-        {
-            DOMPRINTF("Could not allocate memory for HVM guest.");
-            goto error_out;
-        }
+    for ( vmemid = 0; vmemid < nr_vmemranges; vmemid++ )
+    {
+        stat_normal_pages += work[vmemid].stat_normal_pages;
+        stat_2mb_pages += work[vmemid].stat_2mb_pages;
+        stat_1gb_pages += work[vmemid].stat_1gb_pages;
     }
+    free(work);
+
+    if ( rc != 0 )
+        goto error_out;
 
     DPRINTF("PHYSICAL MEMORY ALLOCATION:\n");
     DPRINTF("  4KB PAGES: 0x%016lx\n", stat_normal_pages);
     DPRINTF("  2MB PAGES: 0x%016lx\n", stat_2mb_pages);
     DPRINTF("  1GB PAGES: 0x%016lx\n", stat_1gb_pages);
+    DPRINTF("  populated in %"PRIu64"us\n", now_usecs() - start_us);
 
     rc = 0;
     goto out;
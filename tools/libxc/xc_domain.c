@@ -117,6 +117,28 @@ int xc_domain_destroy(xc_interface *xch,
     return do_domctl(xch, &domctl);
 }
 
+int xc_domain_destroy_progress(xc_interface *xch,
+                               uint32_t domid,
+                               unsigned int *state,
+                               uint64_t *pages_total,
+                               uint64_t *pages_left)
+{
+    int rc;
+    DECLARE_DOMCTL;
+
+    domctl.cmd = XEN_DOMCTL_get_destroy_progress;
+    domctl.domain = (domid_t)domid;
+
+    rc = do_domctl(xch, &domctl);
+    if ( rc )
+        return rc;
+
+    *state = domctl.u.destroy_progress.state;
+    *pages_total = domctl.u.destroy_progress.pages_total;
+    *pages_left = domctl.u.destroy_progress.pages_left;
+    return 0;
+}
+
 int xc_domain_shutdown(xc_interface *xch,
                        uint32_t domid,
                        int reason)
@@ -221,6 +243,70 @@ int xc_domain_node_getaffinity(xc_interface *xch,
     return ret;
 }
 
+int xc_domain_rehome_memory(xc_interface *xch,
+                            uint32_t domid,
+                            uint64_t *gfn,
+                            uint64_t nr_gfns,
+                            uint64_t *max_gfn,
+                            uint32_t *moved,
+                            uint32_t *busy)
+{
+    int rc;
+    DECLARE_DOMCTL;
+
+    domctl.cmd = XEN_DOMCTL_rehome_memory;
+    domctl.domain = (domid_t)domid;
+    domctl.u.rehome_memory.gfn = *gfn;
+    domctl.u.rehome_memory.nr_gfns = nr_gfns;
+
+    rc = do_domctl(xch, &domctl);
+    if ( rc )
+        return rc;
+
+    *gfn = domctl.u.rehome_memory.gfn;
+    *max_gfn = domctl.u.rehome_memory.max_gfn;
+    *moved = domctl.u.rehome_memory.moved;
+    *busy = domctl.u.rehome_memory.busy;
+    return 0;
+}
+
+int xc_domain_numa_balancing_set(xc_interface *xch,
+                                 uint32_t domid,
+                                 int enable)
+{
+    DECLARE_DOMCTL;
+
+    domctl.cmd = XEN_DOMCTL_numa_balancing;
+    domctl.domain = (domid_t)domid;
+    domctl.u.numa_balancing.op = XEN_DOMCTL_NUMA_BALANCING_SET;
+    domctl.u.numa_balancing.enable = !!enable;
+
+    return do_domctl(xch, &domctl);
+}
+
+int xc_domain_numa_balancing_get(xc_interface *xch,
+                                 uint32_t domid,
+                                 int *enabled,
+                                 uint32_t *node,
+                                 uint32_t *passes)
+{
+    int rc;
+    DECLARE_DOMCTL;
+
+    domctl.cmd = XEN_DOMCTL_numa_balancing;
+    domctl.domain = (domid_t)domid;
+    domctl.u.numa_balancing.op = XEN_DOMCTL_NUMA_BALANCING_GET;
+
+    rc = do_domctl(xch, &domctl);
+    if ( rc )
+        return rc;
+
+    *enabled = domctl.u.numa_balancing.enable;
+    *node = domctl.u.numa_balancing.node;
+    *passes = domctl.u.numa_balancing.passes;
+    return 0;
+}
+
 int xc_vcpu_setaffinity(xc_interface *xch,
                         uint32_t domid,
                         int vcpu,
@@ -435,6 +521,38 @@ int xc_domain_getinfolist(xc_interface *xch,
     return ret;
 }
 
+int xc_vcpu_runstate_list(xc_interface *xch,
+                          uint32_t first_domain,
+                          xc_vcpu_runstate_t *entries,
+                          unsigned int *nr_entries,
+                          uint32_t *next_domain)
+{
+    int ret;
+    DECLARE_SYSCTL;
+    DECLARE_HYPERCALL_BOUNCE(entries, *nr_entries * sizeof(*entries),
+                             XC_HYPERCALL_BUFFER_BOUNCE_OUT);
+
+    if ( xc_hypercall_bounce_pre(xch, entries) )
+        return -1;
+
+    sysctl.cmd = XEN_SYSCTL_vcpu_runstate;
+    memset(&sysctl.u.vcpu_runstate, 0, sizeof(sysctl.u.vcpu_runstate));
+    sysctl.u.vcpu_runstate.first_domain = first_domain;
+    sysctl.u.vcpu_runstate.nr_entries = *nr_entries;
+    set_xen_guest_handle(sysctl.u.vcpu_runstate.entries, entries);
+
+    ret = do_sysctl(xch, &sysctl);
+
+    xc_hypercall_bounce_post(xch, entries);
+
+    /* Also on ENOBUFS, where it is the number of entries needed. */
+    *nr_entries = sysctl.u.vcpu_runstate.nr_entries;
+    if ( !ret )
+        *next_domain = sysctl.u.vcpu_runstate.next_domain;
+
+    return ret;
+}
+
 /* set broken page p2m */
 int xc_set_broken_page_p2m(xc_interface *xch,
                            uint32_t domid,
@@ -680,6 +798,45 @@ int xc_shadow_control(xc_interface *xch,
     return (rc == 0) ? domctl.u.shadow_op.pages : rc;
 }
 
+int xc_shadow_control_extents(xc_interface *xch,
+                              uint32_t domid,
+                              unsigned int sop,
+                              xc_hypercall_buffer_t *extents,
+                              unsigned int nr_extents,
+                              xen_pfn_t *start_pfn,
+                              xen_pfn_t *nr_pfns,
+                              uint32_t mode,
+                              xc_shadow_op_stats_t *stats)
+{
+    int rc;
+    DECLARE_DOMCTL;
+    DECLARE_HYPERCALL_BUFFER_ARGUMENT(extents);
+
+    memset(&domctl, 0, sizeof(domctl));
+
+    domctl.cmd = XEN_DOMCTL_shadow_op;
+    domctl.domain = (domid_t)domid;
+    domctl.u.shadow_op.op         = sop;
+    domctl.u.shadow_op.mode       = mode | XEN_DOMCTL_SHADOW_LOGDIRTY_EXTENTS;
+    domctl.u.shadow_op.start_pfn  = *start_pfn;
+    domctl.u.shadow_op.nr_pfns    = *nr_pfns;
+    domctl.u.shadow_op.nr_extents = nr_extents;
+    set_xen_guest_handle(domctl.u.shadow_op.extents, extents);
+
+    rc = do_domctl(xch, &domctl);
+    if ( rc )
+        return rc;
+
+    if ( stats )
+        memcpy(stats, &domctl.u.shadow_op.stats,
+               sizeof(xc_shadow_op_stats_t));
+
+    *start_pfn = domctl.u.shadow_op.start_pfn;
+    *nr_pfns = domctl.u.shadow_op.nr_pfns;
+
+    return domctl.u.shadow_op.nr_extents;
+}
+
 int xc_domain_setmaxmem(xc_interface *xch,
                         uint32_t domid,
                         uint64_t max_memkb)
@@ -1016,6 +1173,21 @@ int xc_domain_decrease_reservation_exact(xc_interface *xch,
     return err;
 }
 
+long xc_domain_decrease_reservation_range(xc_interface *xch,
+                                          uint32_t domid,
+                                          xen_pfn_t first_gfn,
+                                          unsigned long nr_pages)
+{
+    struct xen_reservation_range range = {
+        .first_gfn = first_gfn,
+        .nr_pages  = nr_pages,
+        .domid     = domid
+    };
+
+    return do_memory_op(xch, XENMEM_decrease_reservation_range,
+                        &range, sizeof(range));
+}
+
 int xc_domain_add_to_physmap(xc_interface *xch,
                              uint32_t domid,
                              unsigned int space,
@@ -1034,12 +1206,20 @@ int xc_domain_add_to_physmap(xc_interface *xch,
 int xc_domain_claim_pages(xc_interface *xch,
                                uint32_t domid,
                                unsigned long nr_pages)
+{
+    return xc_domain_claim_pages_node(xch, domid, XC_NUMA_NO_NODE, nr_pages);
+}
+
+int xc_domain_claim_pages_node(xc_interface *xch,
+                               uint32_t domid,
+                               unsigned int node,
+                               unsigned long nr_pages)
 {
     int err;
     struct xen_memory_reservation reservation = {
         .nr_extents   = nr_pages,
         .extent_order = 0,
-        .mem_flags    = 0, /* no flags */
+        .mem_flags    = node == XC_NUMA_NO_NODE ? 0 : XENMEMF_exact_node(node),
         .domid        = domid
     };
 
@@ -1322,6 +1502,71 @@ int xc_availheap(xc_interface *xch,
     return rc;
 }
 
+int xc_heap_chunks(xc_interface *xch,
+                   int node,
+                   uint64_t *chunks,
+                   unsigned int *nr_orders)
+{
+    DECLARE_SYSCTL;
+    DECLARE_HYPERCALL_BOUNCE(chunks, *nr_orders * sizeof(*chunks),
+                             XC_HYPERCALL_BUFFER_BOUNCE_OUT);
+    int rc;
+
+    if ( xc_hypercall_bounce_pre(xch, chunks) )
+        return -1;
+
+    sysctl.cmd = XEN_SYSCTL_heap_chunks;
+    sysctl.u.heap_chunks.node = node;
+    sysctl.u.heap_chunks.nr_orders = *nr_orders;
+    set_xen_guest_handle(sysctl.u.heap_chunks.chunks, chunks);
+
+    rc = do_sysctl(xch, &sysctl);
+
+    xc_hypercall_bounce_post(xch, chunks);
+
+    if ( !rc )
+        *nr_orders = sysctl.u.heap_chunks.nr_orders;
+
+    return rc;
+}
+
+int xc_compact_get(xc_interface *xch,
+                   int *enabled,
+                   unsigned int *order,
+                   uint64_t *moved,
+                   uint64_t *assembled,
+                   uint64_t *abandoned)
+{
+    DECLARE_SYSCTL;
+    int rc;
+
+    sysctl.cmd = XEN_SYSCTL_compact_op;
+    sysctl.u.compact_op.cmd = XEN_SYSCTL_COMPACT_get;
+
+    rc = do_sysctl(xch, &sysctl);
+    if ( rc )
+        return rc;
+
+    *enabled = sysctl.u.compact_op.enable;
+    *order = sysctl.u.compact_op.order;
+    *moved = sysctl.u.compact_op.moved;
+    *assembled = sysctl.u.compact_op.assembled;
+    *abandoned = sysctl.u.compact_op.abandoned;
+    return 0;
+}
+
+int xc_compact_set(xc_interface *xch, int enable, unsigned int order)
+{
+    DECLARE_SYSCTL;
+
+    sysctl.cmd = XEN_SYSCTL_compact_op;
+    sysctl.u.compact_op.cmd = XEN_SYSCTL_COMPACT_set;
+    sysctl.u.compact_op.enable = !!enable;
+    sysctl.u.compact_op.order = order;
+
+    return do_sysctl(xch, &sysctl);
+}
+
 int xc_vcpu_setcontext(xc_interface *xch,
                        uint32_t domid,
                        uint32_t vcpu,
@@ -2222,6 +2467,35 @@ int xc_domain_set_max_evtchn(xc_interface *xch, uint32_t domid,
     return do_domctl(xch, &domctl);
 }
 
+int xc_domain_set_evtchn_priority(xc_interface *xch, uint32_t domid,
+                                  const uint8_t *priority)
+{
+    DECLARE_DOMCTL;
+
+    domctl.cmd = XEN_DOMCTL_set_evtchn_priority;
+    domctl.domain = domid;
+    memcpy(domctl.u.set_evtchn_priority.priority, priority,
+           sizeof(domctl.u.set_evtchn_priority.priority));
+    return do_domctl(xch, &domctl);
+}
+
+int xc_domain_pause_loop_stats(xc_interface *xch, uint32_t domid,
+                               uint64_t *exits, uint64_t *directed)
+{
+    int rc;
+    DECLARE_DOMCTL;
+
+    domctl.cmd = XEN_DOMCTL_pause_loop_stats;
+    domctl.domain = domid;
+    rc = do_domctl(xch, &domctl);
+    if ( rc )
+        return rc;
+
+    *exits = domctl.u.pause_loop_stats.exits;
+    *directed = domctl.u.pause_loop_stats.directed;
+    return 0;
+}
+
 /* Plumbing Xen with vNUMA topology */
 int xc_domain_setvnuma(xc_interface *xch,
                        uint32_t domid,
@@ -74,6 +74,40 @@ int xc_evtchn_status(xc_interface *xch, xc_evtchn_status_t *status)
                         sizeof(*status), 1);
 }
 
+int xc_evtchn_stats(xc_interface *xch, uint32_t domid, uint32_t first_port,
+                    xc_evtchn_port_stats_t *ports, unsigned int *nr_ports,
+                    uint64_t *sent, uint64_t *coalesced,
+                    uint64_t *link_retries)
+{
+    int ret;
+    DECLARE_SYSCTL;
+    DECLARE_HYPERCALL_BOUNCE(ports, *nr_ports * sizeof(*ports),
+                             XC_HYPERCALL_BUFFER_BOUNCE_OUT);
+
+    if ( (ret = xc_hypercall_bounce_pre(xch, ports)) )
+        return ret;
+
+    sysctl.cmd = XEN_SYSCTL_evtchn_stats;
+    sysctl.u.evtchn_stats.domid = domid;
+    sysctl.u.evtchn_stats.pad = 0;
+    sysctl.u.evtchn_stats.first_port = first_port;
+    sysctl.u.evtchn_stats.nr_ports = *nr_ports;
+    sysctl.u.evtchn_stats.pad2 = 0;
+    set_xen_guest_handle(sysctl.u.evtchn_stats.ports, ports);
+
+    if ( (ret = do_sysctl(xch, &sysctl)) == 0 )
+    {
+        *nr_ports = sysctl.u.evtchn_stats.nr_ports;
+        *sent = sysctl.u.evtchn_stats.sent;
+        *coalesced = sysctl.u.evtchn_stats.coalesced;
+        *link_retries = sysctl.u.evtchn_stats.link_retries;
+    }
+
+    xc_hypercall_bounce_post(xch, ports);
+
+    return ret;
+}
+
 /*
  * Local variables:
  * mode: C
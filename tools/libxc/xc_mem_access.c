@@ -100,6 +100,47 @@ int xc_get_mem_access(xc_interface *xch,
     return rc;
 }
 
+int xc_get_mem_access_range(xc_interface *xch,
+                            domid_t domain_id,
+                            uint64_t *pfn,
+                            uint32_t *nr,
+                            xen_mem_access_run_t *runs,
+                            uint32_t nr_runs)
+{
+    DECLARE_HYPERCALL_BOUNCE(runs, nr_runs * sizeof(*runs),
+                             XC_HYPERCALL_BUFFER_BOUNCE_OUT);
+    int rc;
+
+    xen_mem_access_op_t mao =
+    {
+        .op      = XENMEM_access_op_get_access_range,
+        .domid   = domain_id,
+        .pfn     = *pfn,
+        .nr      = *nr,
+        .nr_runs = nr_runs,
+    };
+
+    if ( xc_hypercall_bounce_pre(xch, runs) )
+    {
+        PERROR("Could not bounce memory for XENMEM_access_op_get_access_range");
+        return -1;
+    }
+
+    set_xen_guest_handle(mao.runs, runs);
+
+    rc = do_memory_op(xch, XENMEM_access_op, &mao, sizeof(mao));
+
+    xc_hypercall_bounce_post(xch, runs);
+
+    if ( rc >= 0 )
+    {
+        *pfn = mao.pfn;
+        *nr = mao.nr;
+    }
+
+    return rc;
+}
+
 /*
  * Local variables:
  * mode: C
@@ -116,6 +116,87 @@ int xc_mem_paging_load(xc_interface *xch, domid_t domain_id,
     return rc;
 }
 
+static int xc_mem_paging_batch(xc_interface *xch, domid_t domain_id,
+                               unsigned int op,
+                               xen_mem_paging_batch_entry_t *entries,
+                               uint32_t nr)
+{
+    DECLARE_HYPERCALL_BOUNCE(entries, nr * sizeof(*entries),
+                             XC_HYPERCALL_BUFFER_BOUNCE_BOTH);
+    xen_mem_paging_batch_op_t mbo;
+    int rc;
+
+    if ( !nr )
+        return 0;
+
+    if ( xc_hypercall_bounce_pre(xch, entries) )
+        return -1;
+
+    memset(&mbo, 0, sizeof(mbo));
+    mbo.op     = op;
+    mbo.domain = domain_id;
+    mbo.nr     = nr;
+    set_xen_guest_handle(mbo.entries, entries);
+
+    rc = do_memory_op(xch, XENMEM_paging_op, &mbo, sizeof(mbo));
+
+    xc_hypercall_bounce_post(xch, entries);
+
+    return rc;
+}
+
+int xc_mem_paging_nominate_batch(xc_interface *xch, domid_t domain_id,
+                                 xen_mem_paging_batch_entry_t *entries,
+                                 uint32_t nr)
+{
+    return xc_mem_paging_batch(xch, domain_id,
+                               XENMEM_paging_op_nominate_batch,
+                               entries, nr);
+}
+
+int xc_mem_paging_evict_batch(xc_interface *xch, domid_t domain_id,
+                              xen_mem_paging_batch_entry_t *entries,
+                              uint32_t nr)
+{
+    return xc_mem_paging_batch(xch, domain_id,
+                               XENMEM_paging_op_evict_batch,
+                               entries, nr);
+}
+
+int xc_mem_paging_load_batch(xc_interface *xch, domid_t domain_id,
+                             xen_mem_paging_batch_entry_t *entries,
+                             uint32_t nr)
+{
+    uint32_t i, locked;
+    int rc, old_errno;
+
+    errno = EINVAL;
+
+    for ( i = 0; i < nr; i++ )
+        if ( !entries[i].buffer ||
+             (entries[i].buffer & (XC_PAGE_SIZE - 1)) )
+            return -1;
+
+    for ( locked = 0; locked < nr; locked++ )
+        if ( mlock((void *)(unsigned long)entries[locked].buffer,
+                   XC_PAGE_SIZE) )
+            break;
+
+    if ( locked == nr )
+        rc = xc_mem_paging_batch(xch, domain_id,
+                                 XENMEM_paging_op_prep_batch,
+                                 entries, nr);
+    else
+        rc = -1;
+
+    old_errno = errno;
+    for ( i = 0; i < locked; i++ )
+        munlock((void *)(unsigned long)entries[i].buffer, XC_PAGE_SIZE);
+    errno = old_errno;
+
+    return rc;
+}
+
 
 /*
  * Local variables:
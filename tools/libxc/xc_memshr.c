@@ -41,6 +41,29 @@ int xc_memshr_control(xc_interface *xch,
     return do_domctl(xch, &domctl);
 }
 
+int xc_memshr_pool_size(xc_interface *xch,
+                        domid_t domid,
+                        uint32_t target,
+                        uint32_t *count)
+{
+    DECLARE_DOMCTL;
+    struct xen_domctl_mem_sharing_op *op;
+    int rc;
+
+    domctl.cmd = XEN_DOMCTL_mem_sharing_op;
+    domctl.interface_version = XEN_DOMCTL_INTERFACE_VERSION;
+    domctl.domain = domid;
+    op = &(domctl.u.mem_sharing_op);
+    op->op = XEN_DOMCTL_MEM_SHARING_POOL;
+    op->u.pool.target = target;
+
+    rc = do_domctl(xch, &domctl);
+    if ( !rc && count )
+        *count = op->u.pool.count;
+
+    return rc;
+}
+
 int xc_memshr_ring_enable(xc_interface *xch, 
                           domid_t domid, 
                           uint32_t *port)
@@ -200,6 +223,115 @@ int xc_memshr_range_share(xc_interface *xch,
     return xc_memshr_memop(xch, source_domain, &mso);
 }
 
+static int xc_memshr_batch(xc_interface *xch,
+                           domid_t source_domain,
+                           uint8_t op,
+                           xen_mem_sharing_batch_entry_t *entries,
+                           uint32_t nr)
+{
+    DECLARE_HYPERCALL_BOUNCE(entries, nr * sizeof(*entries),
+                             XC_HYPERCALL_BUFFER_BOUNCE_BOTH);
+    xen_mem_sharing_op_t mso;
+    int rc;
+
+    if ( xc_hypercall_bounce_pre(xch, entries) )
+    {
+        PERROR("Could not bounce memory for batched sharing op");
+        return -1;
+    }
+
+    memset(&mso, 0, sizeof(mso));
+
+    mso.op = op;
+    set_xen_guest_handle(mso.u.batch.entries, entries);
+    mso.u.batch.nr = nr;
+
+    rc = xc_memshr_memop(xch, source_domain, &mso);
+
+    xc_hypercall_bounce_post(xch, entries);
+
+    return rc;
+}
+
+int xc_memshr_nominate_batch(xc_interface *xch,
+                             domid_t source_domain,
+                             xen_mem_sharing_batch_entry_t *entries,
+                             uint32_t nr)
+{
+    return xc_memshr_batch(xch, source_domain,
+                           XENMEM_sharing_op_nominate_batch, entries, nr);
+}
+
+int xc_memshr_share_batch(xc_interface *xch,
+                          domid_t source_domain,
+                          xen_mem_sharing_batch_entry_t *entries,
+                          uint32_t nr)
+{
+    return xc_memshr_batch(xch, source_domain,
+                           XENMEM_sharing_op_share_batch, entries, nr);
+}
+
+int xc_memshr_range_fork(xc_interface *xch,
+                         domid_t source_domain,
+                         domid_t client_domain,
+                         uint64_t first_gfn,
+                         uint64_t last_gfn)
+{
+    xen_mem_sharing_op_t mso;
+
+    memset(&mso, 0, sizeof(mso));
+
+    mso.op = XENMEM_sharing_op_range_fork;
+
+    mso.u.range.client_domain = client_domain;
+    mso.u.range.first_gfn = first_gfn;
+    mso.u.range.last_gfn = last_gfn;
+
+    return xc_memshr_memop(xch, source_domain, &mso);
+}
+
+int xc_memshr_fork_domain(xc_interface *xch,
+                          domid_t source_domain,
+                          domid_t client_domain)
+{
+    xen_pfn_t max_gpfn;
+    uint8_t *ctxt = NULL;
+    int size, rc;
+
+    rc = xc_domain_maximum_gpfn(xch, source_domain, &max_gpfn);
+    if ( rc < 0 )
+        return rc;
+
+    rc = xc_memshr_range_fork(xch, source_domain, client_domain,
+                              0, max_gpfn);
+    if ( rc )
+    {
+        PERROR("Failed to fork memory of d%d into d%d",
+               source_domain, client_domain);
+        return rc;
+    }
+
+    size = xc_domain_hvm_getcontext(xch, source_domain, NULL, 0);
+    if ( size <= 0 )
+        return -1;
+
+    ctxt = malloc(size);
+    if ( !ctxt )
+        return -1;
+
+    rc = -1;
+    if ( xc_domain_hvm_getcontext(xch, source_domain, ctxt, size) <= 0 ||
+         xc_domain_hvm_setcontext(xch, client_domain, ctxt, size) )
+        PERROR("Failed to copy HVM context of d%d into d%d",
+               source_domain, client_domain);
+    else
+        rc = 0;
+
+    free(ctxt);
+
+    return rc;
+}
+
 int xc_memshr_domain_resume(xc_interface *xch,
                             domid_t domid)
 {
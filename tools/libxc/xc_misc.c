@@ -131,10 +131,10 @@ xc_nodemap_t xc_nodemap_alloc(xc_interface *xch)
     return calloc(1, sz);
 }
 
-int xc_readconsolering(xc_interface *xch,
-                       char *buffer,
-                       unsigned int *pnr_chars,
-                       int clear, int incremental, uint32_t *pindex)
+static int readconsolering(xc_interface *xch, char *buffer,
+                           unsigned int *pnr_chars, int clear,
+                           int incremental, uint32_t *pindex,
+                           uint32_t *plost)
 {
     int ret;
     unsigned int nr_chars = *pnr_chars;
@@ -160,6 +160,8 @@ int xc_readconsolering(xc_interface *xch,
         *pnr_chars = sysctl.u.readconsole.count;
         if ( pindex )
             *pindex = sysctl.u.readconsole.index;
+        if ( plost )
+            *plost = sysctl.u.readconsole.lost;
     }
 
     xc_hypercall_bounce_post(xch, buffer);
@@ -167,6 +169,60 @@ int xc_readconsolering(xc_interface *xch,
     return ret;
 }
 
+int xc_readconsolering(xc_interface *xch,
+                       char *buffer,
+                       unsigned int *pnr_chars,
+                       int clear, int incremental, uint32_t *pindex)
+{
+    return readconsolering(xch, buffer, pnr_chars, clear, incremental,
+                           pindex, NULL);
+}
+
+int xc_readconsolering_incr(xc_interface *xch,
+                            char *buffer,
+                            unsigned int *pnr_chars,
+                            uint32_t *pindex, uint32_t *plost)
+{
+    return readconsolering(xch, buffer, pnr_chars, 0, 1, pindex, plost);
+}
+
+int xc_console_ring_info(xc_interface *xch, uint32_t *size,
+                         uint32_t *producer, uint32_t *consumer)
+{
+    int ret;
+    DECLARE_SYSCTL;
+
+    sysctl.cmd = XEN_SYSCTL_conring_op;
+    sysctl.u.conring_op.cmd = XEN_SYSCTL_CONRING_get_info;
+
+    if ( (ret = do_sysctl(xch, &sysctl)) == 0 )
+    {
+        if ( size )
+            *size = sysctl.u.conring_op.size;
+        if ( producer )
+            *producer = sysctl.u.conring_op.producer;
+        if ( consumer )
+            *consumer = sysctl.u.conring_op.consumer;
+    }
+
+    return ret;
+}
+
+int xc_console_ring_resize(xc_interface *xch, uint32_t *size)
+{
+    int ret;
+    DECLARE_SYSCTL;
+
+    sysctl.cmd = XEN_SYSCTL_conring_op;
+    sysctl.u.conring_op.cmd = XEN_SYSCTL_CONRING_set_size;
+    sysctl.u.conring_op.size = *size;
+
+    if ( (ret = do_sysctl(xch, &sysctl)) == 0 )
+        *size = sysctl.u.conring_op.size;
+
+    return ret;
+}
+
 int xc_send_debug_keys(xc_interface *xch, char *keys)
 {
     int ret, len = strlen(keys);
@@ -187,6 +243,35 @@ int xc_send_debug_keys(xc_interface *xch, char *keys)
     return ret;
 }
 
+int xc_microcode_update(xc_interface *xch, const void *buf, size_t len)
+{
+    int ret;
+    DECLARE_PLATFORM_OP;
+    DECLARE_HYPERCALL_BUFFER(void, uc);
+
+    if ( len != (uint32_t)len )
+    {
+        errno = E2BIG;
+        return -1;
+    }
+
+    uc = xc_hypercall_buffer_alloc(xch, uc, len);
+    if ( uc == NULL )
+        return -1;
+
+    memcpy(uc, buf, len);
+
+    platform_op.cmd = XENPF_microcode_update;
+    platform_op.u.microcode.length = len;
+    set_xen_guest_handle(platform_op.u.microcode.data, uc);
+
+    ret = do_platform_op(xch, &platform_op);
+
+    xc_hypercall_buffer_free(xch, uc);
+
+    return ret;
+}
+
 int xc_physinfo(xc_interface *xch,
                 xc_physinfo_t *put_info)
 {
@@ -393,6 +478,32 @@ int xc_perfc_query(xc_interface *xch,
     return do_sysctl(xch, &sysctl);
 }
 
+int xc_perfc_query_dom(xc_interface *xch,
+                       struct xc_hypercall_buffer *desc,
+                       struct xc_hypercall_buffer *val,
+                       int *nbr_desc,
+                       int *nbr_val)
+{
+    int rc;
+    DECLARE_SYSCTL;
+    DECLARE_HYPERCALL_BUFFER_ARGUMENT(desc);
+    DECLARE_HYPERCALL_BUFFER_ARGUMENT(val);
+
+    sysctl.cmd = XEN_SYSCTL_perfc_op;
+    sysctl.u.perfc_op.cmd = XEN_SYSCTL_PERFCOP_query_dom;
+    sysctl.u.perfc_op.nr_vals = *nbr_val;
+    set_xen_guest_handle(sysctl.u.perfc_op.desc, desc);
+    set_xen_guest_handle(sysctl.u.perfc_op.val, val);
+
+    rc = do_sysctl(xch, &sysctl);
+
+    if ( nbr_desc )
+        *nbr_desc = sysctl.u.perfc_op.nr_counters;
+    *nbr_val = sysctl.u.perfc_op.nr_vals;
+
+    return rc;
+}
+
 int xc_lockprof_reset(xc_interface *xch)
 {
     DECLARE_SYSCTL;
@@ -467,6 +578,162 @@ int xc_getcpuinfo(xc_interface *xch, int max_cpus,
     return rc;
 }
 
+int xc_irq_stats(xc_interface *xch, uint32_t domid, xc_irq_stats_t *stats)
+{
+    int rc;
+    DECLARE_SYSCTL;
+
+    sysctl.cmd = XEN_SYSCTL_irq_stats;
+    memset(&sysctl.u.irq_stats, 0, sizeof(sysctl.u.irq_stats));
+    sysctl.u.irq_stats.domid = domid;
+
+    if ( (rc = do_sysctl(xch, &sysctl)) == 0 )
+        *stats = sysctl.u.irq_stats;
+
+    return rc;
+}
+
+int xc_hypercall_stats(xc_interface *xch, xc_hypercall_stats_entry_t *entries,
+                       unsigned int *nr_entries, uint64_t *dropped)
+{
+    int rc;
+    DECLARE_SYSCTL;
+    DECLARE_HYPERCALL_BOUNCE(entries, *nr_entries * sizeof(*entries),
+                             XC_HYPERCALL_BUFFER_BOUNCE_OUT);
+
+    if ( xc_hypercall_bounce_pre(xch, entries) )
+        return -1;
+
+    sysctl.cmd = XEN_SYSCTL_hypercall_stats;
+    memset(&sysctl.u.hypercall_stats, 0, sizeof(sysctl.u.hypercall_stats));
+    sysctl.u.hypercall_stats.cmd = XEN_SYSCTL_HCALL_STATS_query;
+    sysctl.u.hypercall_stats.nr_entries = *nr_entries;
+    set_xen_guest_handle(sysctl.u.hypercall_stats.entries, entries);
+
+    rc = do_sysctl(xch, &sysctl);
+
+    xc_hypercall_bounce_post(xch, entries);
+
+    if ( !rc )
+    {
+        *nr_entries = sysctl.u.hypercall_stats.nr_entries;
+        if ( dropped )
+            *dropped = sysctl.u.hypercall_stats.dropped;
+    }
+
+    return rc;
+}
+
+int xc_hypercall_stats_reset(xc_interface *xch)
+{
+    DECLARE_SYSCTL;
+
+    sysctl.cmd = XEN_SYSCTL_hypercall_stats;
+    memset(&sysctl.u.hypercall_stats, 0, sizeof(sysctl.u.hypercall_stats));
+    sysctl.u.hypercall_stats.cmd = XEN_SYSCTL_HCALL_STATS_reset;
+
+    return do_sysctl(xch, &sysctl);
+}
+
+int xc_latency_stats(xc_interface *xch, xc_latency_stats_entry_t *entries,
+                     unsigned int *nr_entries, uint64_t *dropped)
+{
+    int rc;
+    DECLARE_SYSCTL;
+    DECLARE_HYPERCALL_BOUNCE(entries, *nr_entries * sizeof(*entries),
+                             XC_HYPERCALL_BUFFER_BOUNCE_OUT);
+
+    if ( xc_hypercall_bounce_pre(xch, entries) )
+        return -1;
+
+    sysctl.cmd = XEN_SYSCTL_latency_stats;
+    memset(&sysctl.u.latency_stats, 0, sizeof(sysctl.u.latency_stats));
+    sysctl.u.latency_stats.cmd = XEN_SYSCTL_LATENCY_STATS_query;
+    sysctl.u.latency_stats.nr_entries = *nr_entries;
+    set_xen_guest_handle(sysctl.u.latency_stats.entries, entries);
+
+    rc = do_sysctl(xch, &sysctl);
+
+    xc_hypercall_bounce_post(xch, entries);
+
+    if ( !rc )
+    {
+        *nr_entries = sysctl.u.latency_stats.nr_entries;
+        if ( dropped )
+            *dropped = sysctl.u.latency_stats.dropped;
+    }
+
+    return rc;
+}
+
+int xc_latency_stats_reset(xc_interface *xch)
+{
+    DECLARE_SYSCTL;
+
+    sysctl.cmd = XEN_SYSCTL_latency_stats;
+    memset(&sysctl.u.latency_stats, 0, sizeof(sysctl.u.latency_stats));
+    sysctl.u.latency_stats.cmd = XEN_SYSCTL_LATENCY_STATS_reset;
+
+    return do_sysctl(xch, &sysctl);
+}
+
+int xc_lock_sample(xc_interface *xch, xc_lock_sample_entry_t *entries,
+                   unsigned int *nr_entries, uint64_t *dropped,
+                   unsigned int *rate)
+{
+    int rc;
+    DECLARE_SYSCTL;
+    DECLARE_HYPERCALL_BOUNCE(entries, *nr_entries * sizeof(*entries),
+                             XC_HYPERCALL_BUFFER_BOUNCE_OUT);
+
+    if ( xc_hypercall_bounce_pre(xch, entries) )
+        return -1;
+
+    sysctl.cmd = XEN_SYSCTL_lock_sample;
+    memset(&sysctl.u.lock_sample, 0, sizeof(sysctl.u.lock_sample));
+    sysctl.u.lock_sample.cmd = XEN_SYSCTL_LOCK_SAMPLE_query;
+    sysctl.u.lock_sample.nr_entries = *nr_entries;
+    set_xen_guest_handle(sysctl.u.lock_sample.entries, entries);
+
+    rc = do_sysctl(xch, &sysctl);
+
+    xc_hypercall_bounce_post(xch, entries);
+
+    if ( !rc )
+    {
+        *nr_entries = sysctl.u.lock_sample.nr_entries;
+        if ( dropped )
+            *dropped = sysctl.u.lock_sample.dropped;
+        if ( rate )
+            *rate = sysctl.u.lock_sample.rate;
+    }
+
+    return rc;
+}
+
+int xc_lock_sample_reset(xc_interface *xch)
+{
+    DECLARE_SYSCTL;
+
+    sysctl.cmd = XEN_SYSCTL_lock_sample;
+    memset(&sysctl.u.lock_sample, 0, sizeof(sysctl.u.lock_sample));
+    sysctl.u.lock_sample.cmd = XEN_SYSCTL_LOCK_SAMPLE_reset;
+
+    return do_sysctl(xch, &sysctl);
+}
+
+int xc_lock_sample_set_rate(xc_interface *xch, unsigned int rate)
+{
+    DECLARE_SYSCTL;
+
+    sysctl.cmd = XEN_SYSCTL_lock_sample;
+    memset(&sysctl.u.lock_sample, 0, sizeof(sysctl.u.lock_sample));
+    sysctl.u.lock_sample.cmd = XEN_SYSCTL_LOCK_SAMPLE_set_rate;
+    sysctl.u.lock_sample.rate = rate;
+
+    return do_sysctl(xch, &sysctl);
+}
+
 int xc_livepatch_upload(xc_interface *xch,
                         char *name,
                         unsigned char *payload,
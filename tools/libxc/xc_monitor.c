@@ -28,6 +28,14 @@ void *xc_monitor_enable(xc_interface *xch, domid_t domain_id, uint32_t *port)
                               port);
 }
 
+void *xc_monitor_enable_pages(xc_interface *xch, domid_t domain_id,
+                              unsigned int nr_pages, uint32_t *port)
+{
+    return xc_vm_event_enable_pages(xch, domain_id,
+                                    HVM_PARAM_MONITOR_RING_PFN,
+                                    nr_pages, port);
+}
+
 int xc_monitor_disable(xc_interface *xch, domid_t domain_id)
 {
     return xc_vm_event_control(xch, domain_id,
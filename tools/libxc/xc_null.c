@@ -0,0 +1,54 @@
+/****************************************************************************
+ *
+ *        File: xc_null.c
+ *
+ * Description: XC Interface to the null scheduler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "xc_private.h"
+
+int
+xc_sched_null_assignment_get(
+    xc_interface *xch,
+    uint32_t cpupool_id,
+    xen_sysctl_null_assignment_t *assignment,
+    unsigned int *nr_cpus)
+{
+    int rc;
+    DECLARE_SYSCTL;
+    DECLARE_HYPERCALL_BOUNCE(assignment, *nr_cpus * sizeof(*assignment),
+                             XC_HYPERCALL_BUFFER_BOUNCE_OUT);
+
+    if ( xc_hypercall_bounce_pre(xch, assignment) )
+        return -1;
+
+    sysctl.cmd = XEN_SYSCTL_scheduler_op;
+    sysctl.u.scheduler_op.cpupool_id = cpupool_id;
+    sysctl.u.scheduler_op.sched_id = XEN_SCHEDULER_NULL;
+    sysctl.u.scheduler_op.cmd = XEN_SYSCTL_SCHEDOP_getinfo;
+    sysctl.u.scheduler_op.u.sched_null.nr_cpus = *nr_cpus;
+    sysctl.u.scheduler_op.u.sched_null.pad = 0;
+    set_xen_guest_handle(sysctl.u.scheduler_op.u.sched_null.assignment,
+                         assignment);
+
+    rc = do_sysctl(xch, &sysctl);
+    if ( rc == 0 )
+        *nr_cpus = sysctl.u.scheduler_op.u.sched_null.nr_cpus;
+
+    xc_hypercall_bounce_post(xch, assignment);
+
+    return rc;
+}
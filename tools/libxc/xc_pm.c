@@ -168,6 +168,9 @@ int xc_pm_get_cxstat(xc_interface *xch, int cpuid, struct xc_cx_stat *cxpt)
     cxpt->idle_time = sysctl.u.get_pmstat.u.getcx.idle_time;
     cxpt->nr_pc = sysctl.u.get_pmstat.u.getcx.nr_pc;
     cxpt->nr_cc = sysctl.u.get_pmstat.u.getcx.nr_cc;
+    cxpt->predicted_us = sysctl.u.get_pmstat.u.getcx.predicted_us;
+    cxpt->measured_us = sysctl.u.get_pmstat.u.getcx.measured_us;
+    cxpt->early = sysctl.u.get_pmstat.u.getcx.early;
 
 unlock_4:
     xc_hypercall_bounce_post(xch, cc);
@@ -434,6 +437,18 @@ int xc_set_cpuidle_max_cstate(xc_interface *xch, uint32_t value)
     return do_sysctl(xch, &sysctl);
 }
 
+int xc_domain_set_idle_latency(xc_interface *xch, uint32_t domid,
+                               uint32_t max_exit_us)
+{
+    DECLARE_DOMCTL;
+
+    domctl.cmd = XEN_DOMCTL_set_idle_latency;
+    domctl.domain = (domid_t)domid;
+    domctl.u.idle_latency.max_exit_us = max_exit_us;
+
+    return do_domctl(xch, &domctl);
+}
+
 int xc_enable_turbo(xc_interface *xch, int cpuid)
 {
     DECLARE_SYSCTL;
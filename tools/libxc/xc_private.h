@@ -101,6 +101,9 @@ struct xc_interface_core {
 
     /* Device model */
     xendevicemodel_handle *dmod;
+
+    /* Hypervisor time spent in domctls issued through this handle, in ns */
+    uint64_t domctl_ns;
 };
 
 int osdep_privcmd_open(xc_interface *xch);
@@ -267,6 +270,7 @@ static inline int do_domctl(xc_interface *xch, struct xen_domctl *domctl)
         goto out1;
     }
 
+    domctl->cost_ns = 0;
     ret = xencall1(xch->xcall, __HYPERVISOR_domctl,
                    HYPERCALL_BUFFER_AS_ARG(domctl));
     if ( ret < 0 )
@@ -277,6 +281,7 @@ static inline int do_domctl(xc_interface *xch, struct xen_domctl *domctl)
     }
 
     xc_hypercall_bounce_post(xch, domctl);
+    xch->domctl_ns += domctl->cost_ns;
  out1:
     return ret;
 }
@@ -361,9 +366,6 @@ void *xc_map_foreign_ranges(xc_interface *xch, uint32_t dom,
                             size_t size, int prot, size_t chunksize,
                             privcmd_mmap_entry_t entries[], int nentries);
 
-int xc_get_pfn_type_batch(xc_interface *xch, uint32_t dom,
-                          unsigned int num, xen_pfn_t *);
-
 void bitmap_64_to_byte(uint8_t *bp, const uint64_t *lp, int nbits);
 void bitmap_byte_to_64(uint64_t *lp, const uint8_t *bp, int nbits);
 
@@ -422,6 +424,10 @@ int xc_vm_event_control(xc_interface *xch, domid_t domain_id, unsigned int op,
  */
 void *xc_vm_event_enable(xc_interface *xch, domid_t domain_id, int param,
                          uint32_t *port);
+/* The same with a ring of nr_pages pages, mapped contiguously. */
+void *xc_vm_event_enable_pages(xc_interface *xch, domid_t domain_id,
+                               int param, unsigned int nr_pages,
+                               uint32_t *port);
 
 int do_dm_op(xc_interface *xch, domid_t domid, unsigned int nr_bufs, ...);
 
@@ -266,6 +266,9 @@ int xc_psr_cat_set_domain_data(xc_interface *xch, uint32_t domid,
     case XC_PSR_CAT_L3_CBM_DATA:
         cmd = XEN_DOMCTL_PSR_CAT_OP_SET_L3_DATA;
         break;
+    case XC_PSR_MBA_THRTL:
+        cmd = XEN_DOMCTL_PSR_CAT_OP_SET_MBA_THRTL;
+        break;
     default:
         errno = EINVAL;
         return -1;
@@ -299,6 +302,9 @@ int xc_psr_cat_get_domain_data(xc_interface *xch, uint32_t domid,
     case XC_PSR_CAT_L3_CBM_DATA:
         cmd = XEN_DOMCTL_PSR_CAT_OP_GET_L3_DATA;
         break;
+    case XC_PSR_MBA_THRTL:
+        cmd = XEN_DOMCTL_PSR_CAT_OP_GET_MBA_THRTL;
+        break;
     default:
         errno = EINVAL;
         return -1;
@@ -340,6 +346,29 @@ int xc_psr_cat_get_l3_info(xc_interface *xch, uint32_t socket,
     return rc;
 }
 
+int xc_psr_mba_get_info(xc_interface *xch, uint32_t socket,
+                        uint32_t *cos_max, uint32_t *thrtl_max,
+                        bool *linear)
+{
+    int rc;
+    DECLARE_SYSCTL;
+
+    sysctl.cmd = XEN_SYSCTL_psr_cat_op;
+    sysctl.u.psr_cat_op.cmd = XEN_SYSCTL_PSR_CAT_get_mba_info;
+    sysctl.u.psr_cat_op.target = socket;
+
+    rc = xc_sysctl(xch, &sysctl);
+    if ( !rc )
+    {
+        *cos_max = sysctl.u.psr_cat_op.u.mba_info.cos_max;
+        *thrtl_max = sysctl.u.psr_cat_op.u.mba_info.thrtl_max;
+        *linear = sysctl.u.psr_cat_op.u.mba_info.flags &
+                  XEN_SYSCTL_PSR_MBA_LINEAR;
+    }
+
+    return rc;
+}
+
 /*
  * Local variables:
  * mode: C
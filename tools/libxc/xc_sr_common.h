@@ -18,6 +18,9 @@ const char *rec_type_to_str(uint32_t type);
 
 struct xc_sr_context;
 struct xc_sr_record;
+struct xc_sr_batch_writer;
+struct xc_sr_staging;
+struct z_stream_s;
 
 /**
  * Save operations.  To be implemented for each type of guest, for use by the
@@ -178,6 +181,12 @@ struct xc_sr_context
     uint32_t domid;
     int fd;
 
+    /*
+     * Save side only: while set, records are collected here rather than
+     * written to fd, until the checkpoint's domain is resumed.
+     */
+    struct xc_sr_staging *staging;
+
     xc_dominfo_t dominfo;
 
     union /* Common save or restore data. */
@@ -198,14 +207,27 @@ struct xc_sr_context
             /* Further debugging information in the stream. */
             bool debug;
 
+            /* Send page data as COMPRESSED_PAGE_DATA records where smaller. */
+            bool compress;
+            /* Write Remus checkpoints out once the domain is resumed. */
+            bool async_checkpoint;
+            struct z_stream_s *zstream;
+
             /* Parameters for tweaking live migration. */
             unsigned max_iterations;
             unsigned dirty_threshold;
 
+            /* Pre-copy progress, and credit scheduler state if throttled. */
+            struct precopy_stats precopy;
+            bool throttled;
+            struct xen_domctl_sched_credit orig_sched;
+
             unsigned long p2m_size;
 
             xen_pfn_t *batch_pfns;
             unsigned nr_batch_pfns;
+            struct xc_sr_batch_writer *writer;
+            struct xc_sr_staging *stage;
             unsigned long *deferred_pages;
             unsigned long nr_deferred_pages;
             xc_hypercall_buffer_t dirty_bitmap_hbuf;
@@ -230,6 +252,9 @@ struct xc_sr_context
             /* Plain VM, or checkpoints over time. */
             int checkpointed;
 
+            /* The stream may contain COMPRESSED_PAGE_DATA records. */
+            bool compressed;
+
             /* Currently buffering records between a checkpoint */
             bool buffer_all_records;
 
@@ -260,6 +285,14 @@ struct xc_sr_context
 
             /* Sender has invoked verify mode on the stream. */
             bool verify;
+
+            /*
+             * Restoring from a regular file, records are parsed in place
+             * from a mapping of it, at offset map_pos, rather than read()
+             * into malloc()ed buffers.
+             */
+            void *map;
+            size_t map_size, map_pos;
         } restore;
     };
 
@@ -364,6 +397,15 @@ struct xc_sr_record
 int write_split_record(struct xc_sr_context *ctx, struct xc_sr_record *rec,
                        void *buf, size_t sz);
 
+/*
+ * Copies an already laid out record into ctx->staging, to be written into
+ * the stream after the page data staged before it.
+ *
+ * Returns 0 on success and non0 on failure.
+ */
+int stage_record(struct xc_sr_context *ctx, const struct iovec *iov,
+                 int iovcnt);
+
 /*
  * Writes a record to the stream, applying correct padding where appropriate.
  * Records with a non-zero length must provide a valid data field; records
@@ -1,6 +1,9 @@
 #include <arpa/inet.h>
 
 #include <assert.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
 
 #include "xc_sr_common.h"
 
@@ -46,6 +49,7 @@ static int read_headers(struct xc_sr_context *ctx)
     }
 
     ctx->restore.format_version = ihdr.version;
+    ctx->restore.compressed = !!(ihdr.options & IHDR_OPT_COMPRESSED);
 
     if ( read_exact(ctx->fd, &dhdr, sizeof(dhdr)) )
     {
@@ -325,6 +329,49 @@ static int process_page_data(struct xc_sr_context *ctx, unsigned count,
     return rc;
 }
 
+/*
+ * Validate the pfn array shared by PAGE_DATA and COMPRESSED_PAGE_DATA
+ * records, splitting it into @pfns and @types, and count the pages which
+ * should have data in the record.
+ */
+static int parse_page_data_pfns(struct xc_sr_context *ctx, unsigned count,
+                                const uint64_t *rec_pfns, xen_pfn_t *pfns,
+                                uint32_t *types, unsigned *pages_of_data)
+{
+    xc_interface *xch = ctx->xch;
+    xen_pfn_t pfn;
+    uint32_t type;
+    unsigned i;
+
+    for ( i = 0, *pages_of_data = 0; i < count; ++i )
+    {
+        pfn = rec_pfns[i] & PAGE_DATA_PFN_MASK;
+        if ( !ctx->restore.ops.pfn_is_valid(ctx, pfn) )
+        {
+            ERROR("pfn %#"PRIpfn" (index %u) outside domain maximum", pfn, i);
+            return -1;
+        }
+
+        type = (rec_pfns[i] & PAGE_DATA_TYPE_MASK) >> 32;
+        if ( ((type >> XEN_DOMCTL_PFINFO_LTAB_SHIFT) >= 5) &&
+             ((type >> XEN_DOMCTL_PFINFO_LTAB_SHIFT) <= 8) )
+        {
+            ERROR("Invalid type %#"PRIx32" for pfn %#"PRIpfn" (index %u)",
+                  type, pfn, i);
+            return -1;
+        }
+        else if ( type < XEN_DOMCTL_PFINFO_BROKEN )
+            /* NOTAB and all L1 through L4 tables (including pinned) should
+             * have a page worth of data in the record. */
+            (*pages_of_data)++;
+
+        pfns[i] = pfn;
+        types[i] = type;
+    }
+
+    return 0;
+}
+
 /*
  * Validate a PAGE_DATA record from the stream, and pass the results to
  * process_page_data() to actually perform the legwork.
@@ -333,11 +380,11 @@ static int handle_page_data(struct xc_sr_context *ctx, struct xc_sr_record *rec)
 {
     xc_interface *xch = ctx->xch;
     struct xc_sr_rec_page_data_header *pages = rec->data;
-    unsigned i, pages_of_data = 0;
+    unsigned pages_of_data = 0;
     int rc = -1;
 
-    xen_pfn_t *pfns = NULL, pfn;
-    uint32_t *types = NULL, type;
+    xen_pfn_t *pfns = NULL;
+    uint32_t *types = NULL;
 
     if ( rec->length < sizeof(*pages) )
     {
@@ -366,31 +413,9 @@ static int handle_page_data(struct xc_sr_context *ctx, struct xc_sr_record *rec)
         goto err;
     }
 
-    for ( i = 0; i < pages->count; ++i )
-    {
-        pfn = pages->pfn[i] & PAGE_DATA_PFN_MASK;
-        if ( !ctx->restore.ops.pfn_is_valid(ctx, pfn) )
-        {
-            ERROR("pfn %#"PRIpfn" (index %u) outside domain maximum", pfn, i);
-            goto err;
-        }
-
-        type = (pages->pfn[i] & PAGE_DATA_TYPE_MASK) >> 32;
-        if ( ((type >> XEN_DOMCTL_PFINFO_LTAB_SHIFT) >= 5) &&
-             ((type >> XEN_DOMCTL_PFINFO_LTAB_SHIFT) <= 8) )
-        {
-            ERROR("Invalid type %#"PRIx32" for pfn %#"PRIpfn" (index %u)",
-                  type, pfn, i);
-            goto err;
-        }
-        else if ( type < XEN_DOMCTL_PFINFO_BROKEN )
-            /* NOTAB and all L1 through L4 tables (including pinned) should
-             * have a page worth of data in the record. */
-            pages_of_data++;
-
-        pfns[i] = pfn;
-        types[i] = type;
-    }
+    if ( parse_page_data_pfns(ctx, pages->count, pages->pfn, pfns, types,
+                              &pages_of_data) )
+        goto err;
 
     if ( rec->length != (sizeof(*pages) +
                          (sizeof(uint64_t) * pages->count) +
@@ -411,6 +436,125 @@ static int handle_page_data(struct xc_sr_context *ctx, struct xc_sr_record *rec)
     return rc;
 }
 
+/*
+ * Validate a COMPRESSED_PAGE_DATA record from the stream, expand it back
+ * into plain page data, and pass the results to process_page_data().
+ */
+static int handle_compressed_page_data(struct xc_sr_context *ctx,
+                                       struct xc_sr_record *rec)
+{
+    xc_interface *xch = ctx->xch;
+    struct xc_sr_rec_compressed_page_data_header *pages = rec->data;
+    unsigned i, n, pages_of_data = 0, nr_data = 0;
+    const uint32_t *src;
+    uLongf zlen;
+    int rc = -1;
+
+    xen_pfn_t *pfns = NULL;
+    uint32_t *types = NULL;
+    void *page_data = NULL, *data = NULL;
+
+    if ( !ctx->restore.compressed )
+    {
+        ERROR("COMPRESSED_PAGE_DATA record in a stream not advertising it");
+        goto err;
+    }
+    else if ( rec->length < sizeof(*pages) )
+    {
+        ERROR("COMPRESSED_PAGE_DATA record truncated: length %u, min %zu",
+              rec->length, sizeof(*pages));
+        goto err;
+    }
+    else if ( pages->count < 1 )
+    {
+        ERROR("Expected at least 1 pfn in COMPRESSED_PAGE_DATA record");
+        goto err;
+    }
+    else if ( rec->length < sizeof(*pages) + (pages->count * sizeof(uint64_t)) )
+    {
+        ERROR("COMPRESSED_PAGE_DATA record (length %u) too short to contain"
+              " %u pfns worth of information", rec->length, pages->count);
+        goto err;
+    }
+
+    pfns = malloc(pages->count * sizeof(*pfns));
+    types = malloc(pages->count * sizeof(*types));
+    if ( !pfns || !types )
+    {
+        ERROR("Unable to allocate enough memory for %u pfns",
+              pages->count);
+        goto err;
+    }
+
+    if ( parse_page_data_pfns(ctx, pages->count, pages->pfn, pfns, types,
+                              &pages_of_data) )
+        goto err;
+
+    if ( rec->length != (sizeof(*pages) +
+                         (sizeof(uint64_t) * pages->count) +
+                         (sizeof(*src) * pages_of_data) +
+                         pages->compressed_length) )
+    {
+        ERROR("COMPRESSED_PAGE_DATA record wrong size: length %u, expected "
+              "%zu + %zu + %zu + %u", rec->length, sizeof(*pages),
+              (sizeof(uint64_t) * pages->count),
+              (sizeof(*src) * pages_of_data), pages->compressed_length);
+        goto err;
+    }
+
+    src = (const uint32_t *)&pages->pfn[pages->count];
+    for ( i = 0; i < pages_of_data; ++i )
+    {
+        if ( src[i] == COMPRESSED_PAGE_DATA )
+            nr_data++;
+        else if ( src[i] != COMPRESSED_PAGE_ZERO && src[i] >= i )
+        {
+            ERROR("Invalid source %#"PRIx32" for data page %u", src[i], i);
+            goto err;
+        }
+    }
+
+    page_data = malloc(pages_of_data * PAGE_SIZE);
+    data = malloc(nr_data * PAGE_SIZE);
+    if ( !page_data || (nr_data && !data) )
+    {
+        ERROR("Unable to allocate memory to expand %u pages of data",
+              pages_of_data);
+        goto err;
+    }
+
+    zlen = nr_data * PAGE_SIZE;
+    if ( nr_data &&
+         (uncompress(data, &zlen, (const Bytef *)&src[pages_of_data],
+                     pages->compressed_length) != Z_OK ||
+          zlen != nr_data * PAGE_SIZE) )
+    {
+        ERROR("Failed to decompress %u pages of data", nr_data);
+        goto err;
+    }
+
+    for ( i = 0, n = 0; i < pages_of_data; ++i )
+    {
+        void *page = page_data + i * PAGE_SIZE;
+
+        if ( src[i] == COMPRESSED_PAGE_DATA )
+            memcpy(page, data + (n++ * PAGE_SIZE), PAGE_SIZE);
+        else if ( src[i] == COMPRESSED_PAGE_ZERO )
+            memset(page, 0, PAGE_SIZE);
+        else
+            memcpy(page, page_data + src[i] * PAGE_SIZE, PAGE_SIZE);
+    }
+
+    rc = process_page_data(ctx, pages->count, pfns, types, page_data);
+ err:
+    free(data);
+    free(page_data);
+    free(types);
+    free(pfns);
+
+    return rc;
+}
+
 /*
  * Send checkpoint dirty pfn list to primary.
  */
@@ -640,6 +784,10 @@ static int process_record(struct xc_sr_context *ctx, struct xc_sr_record *rec)
         rc = handle_page_data(ctx, rec);
         break;
 
+    case REC_TYPE_COMPRESSED_PAGE_DATA:
+        rc = handle_compressed_page_data(ctx, rec);
+        break;
+
     case REC_TYPE_VERIFY:
         DPRINTF("Verify mode enabled");
         ctx->restore.verify = true;
@@ -654,12 +802,80 @@ static int process_record(struct xc_sr_context *ctx, struct xc_sr_record *rec)
         break;
     }
 
-    free(rec->data);
+    if ( !ctx->restore.map )
+        free(rec->data);
     rec->data = NULL;
 
     return rc;
 }
 
+/*
+ * Map the rest of the stream when it is a regular file, saving a copy of
+ * the data and an allocation per record.  Not being able to is not an
+ * error: records are then read() as usual.
+ */
+static void map_stream(struct xc_sr_context *ctx)
+{
+    struct stat st;
+    off_t pos;
+    void *map;
+
+    if ( ctx->restore.checkpointed ||
+         fstat(ctx->fd, &st) || !S_ISREG(st.st_mode) ||
+         (pos = lseek(ctx->fd, 0, SEEK_CUR)) == (off_t)-1 ||
+         (pos & ((1U << REC_ALIGN_ORDER) - 1)) ||
+         pos >= st.st_size || st.st_size != (size_t)st.st_size )
+        return;
+
+    /* Private and writeable, as record handlers may modify their data. */
+    map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+               ctx->fd, 0);
+    if ( map == MAP_FAILED )
+        return;
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    ctx->restore.map = map;
+    ctx->restore.map_size = st.st_size;
+    ctx->restore.map_pos = pos;
+}
+
+/* As read_record(), for a mapped stream. */
+static int read_mapped_record(struct xc_sr_context *ctx,
+                              struct xc_sr_record *rec)
+{
+    xc_interface *xch = ctx->xch;
+    struct xc_sr_rhdr *rhdr = ctx->restore.map + ctx->restore.map_pos;
+    size_t left = ctx->restore.map_size - ctx->restore.map_pos;
+    size_t datasz;
+
+    if ( left < sizeof(*rhdr) )
+    {
+        ERROR("Failed to read Record Header from stream: end of file");
+        return -1;
+    }
+    else if ( rhdr->length > REC_LENGTH_MAX )
+    {
+        ERROR("Record (0x%08x, %s) length %#x exceeds max (%#x)", rhdr->type,
+              rec_type_to_str(rhdr->type), rhdr->length, REC_LENGTH_MAX);
+        return -1;
+    }
+
+    datasz = ROUNDUP(rhdr->length, REC_ALIGN_ORDER);
+    if ( left - sizeof(*rhdr) < datasz )
+    {
+        ERROR("Failed to read %zu bytes of data for record (0x%08x, %s): "
+              "end of file", datasz, rhdr->type, rec_type_to_str(rhdr->type));
+        return -1;
+    }
+
+    rec->type   = rhdr->type;
+    rec->length = rhdr->length;
+    rec->data   = datasz ? rhdr + 1 : NULL;
+    ctx->restore.map_pos += sizeof(*rhdr) + datasz;
+
+    return 0;
+}
+
 static int setup(struct xc_sr_context *ctx)
 {
     xc_interface *xch = ctx->xch;
@@ -704,6 +920,8 @@ static int setup(struct xc_sr_context *ctx)
     }
     ctx->restore.allocated_rec_num = DEFAULT_BUF_RECORDS;
 
+    map_stream(ctx);
+
  err:
     return rc;
 }
@@ -725,6 +943,14 @@ static void cleanup(struct xc_sr_context *ctx)
     free(ctx->restore.populated_pfns);
     if ( ctx->restore.ops.cleanup(ctx) )
         PERROR("Failed to clean up");
+
+    if ( ctx->restore.map )
+    {
+        /* Leave the file offset after the stream, as reading it would. */
+        if ( lseek(ctx->fd, ctx->restore.map_pos, SEEK_SET) == (off_t)-1 )
+            PERROR("Failed to seek past the stream");
+        munmap(ctx->restore.map, ctx->restore.map_size);
+    }
 }
 
 /*
@@ -744,7 +970,10 @@ static int restore(struct xc_sr_context *ctx)
 
     do
     {
-        rc = read_record(ctx, ctx->fd, &rec);
+        if ( ctx->restore.map )
+            rc = read_mapped_record(ctx, &rec);
+        else
+            rc = read_record(ctx, ctx->fd, &rec);
         if ( rc )
         {
             if ( ctx->restore.buffer_all_records )
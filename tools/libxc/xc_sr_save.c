@@ -1,4 +1,7 @@
 #include <assert.h>
+#include <pthread.h>
+#include <time.h>
+#include <zlib.h>
 #include <arpa/inet.h>
 
 #include "xc_sr_common.h"
@@ -15,7 +18,8 @@ static int write_headers(struct xc_sr_context *ctx, uint16_t guest_type)
             .marker  = IHDR_MARKER,
             .id      = htonl(IHDR_ID),
             .version = htonl(IHDR_VERSION),
-            .options = htons(IHDR_OPT_LITTLE_ENDIAN),
+            .options = htons(IHDR_OPT_LITTLE_ENDIAN |
+                             (ctx->save.zstream ? IHDR_OPT_COMPRESSED : 0)),
         };
     struct xc_sr_dhdr dhdr =
         {
@@ -66,6 +70,781 @@ static int write_checkpoint_record(struct xc_sr_context *ctx)
     return write_record(ctx, &checkpoint);
 }
 
+/*
+ * A PAGE_DATA record which has been fully constructed (pages mapped and
+ * normalised, iovec built), but not yet written into the stream.  It owns
+ * the guest mapping and any locally allocated pages until it is written.
+ */
+struct xc_sr_pending_batch
+{
+    struct xc_sr_record rec;
+    struct xc_sr_rec_page_data_header hdr;
+    struct xc_sr_rec_compressed_page_data_header chdr;
+    uint64_t *rec_pfns;
+    uint32_t *src;
+    void *zbuf;
+    struct iovec *iov;
+    int iovcnt;
+
+    void *guest_mapping;
+    unsigned nr_pages_mapped;
+    void **local_pages;
+    unsigned nr_pfns;
+
+    /* A staged record's contents. */
+    void *copy;
+    /* Staged page data still to be compressed, and what describes it. */
+    bool compress;
+    xen_pfn_t *types;
+    void **data;
+};
+
+/*
+ * Page data writes are handed to a writer thread, so the mapping and
+ * normalisation of the next batch overlaps with the stream write of the
+ * previous one.  The queue is bounded to limit the amount of guest memory
+ * kept mapped at once.
+ */
+#define WRITE_QUEUE_DEPTH 4
+
+struct xc_sr_batch_writer
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    struct xc_sr_pending_batch *queue[WRITE_QUEUE_DEPTH];
+    unsigned head, count;
+    bool busy;     /* The writer thread is writing a dequeued batch. */
+    bool stop;     /* Discard anything still queued and exit. */
+    int error;     /* errno of the first failed write, or 0. */
+};
+
+static void release_batch_pages(struct xc_sr_context *ctx,
+                                struct xc_sr_pending_batch *b)
+{
+    xc_interface *xch = ctx->xch;
+    unsigned i;
+
+    if ( b->guest_mapping )
+        xenforeignmemory_unmap(xch->fmem, b->guest_mapping,
+                               b->nr_pages_mapped);
+    b->guest_mapping = NULL;
+
+    for ( i = 0; b->local_pages && i < b->nr_pfns; ++i )
+    {
+        free(b->local_pages[i]);
+        b->local_pages[i] = NULL;
+    }
+}
+
+static void free_pending_batch(struct xc_sr_context *ctx,
+                               struct xc_sr_pending_batch *b)
+{
+    if ( !b )
+        return;
+
+    release_batch_pages(ctx, b);
+    free(b->local_pages);
+    free(b->rec_pfns);
+    free(b->src);
+    free(b->zbuf);
+    free(b->iov);
+    free(b->copy);
+    free(b->types);
+    free(b->data);
+    free(b);
+}
+
+static void *batch_writer_thread(void *arg)
+{
+    struct xc_sr_context *ctx = arg;
+    struct xc_sr_batch_writer *w = ctx->save.writer;
+    struct xc_sr_pending_batch *b;
+    bool skip;
+    int err;
+
+    pthread_mutex_lock(&w->lock);
+    for ( ; ; )
+    {
+        while ( !w->count && !w->stop )
+            pthread_cond_wait(&w->cond, &w->lock);
+
+        if ( !w->count )
+            break;
+
+        b = w->queue[w->head];
+        w->head = (w->head + 1) % WRITE_QUEUE_DEPTH;
+        w->count--;
+        w->busy = true;
+        skip = w->stop || w->error;
+        pthread_mutex_unlock(&w->lock);
+
+        /* Once a write has failed, later batches are dropped. */
+        err = 0;
+        if ( !skip && writev_exact(ctx->fd, b->iov, b->iovcnt) )
+            err = errno ?: EIO;
+
+        free_pending_batch(ctx, b);
+
+        pthread_mutex_lock(&w->lock);
+        if ( err && !w->error )
+            w->error = err;
+        w->busy = false;
+        pthread_cond_broadcast(&w->cond);
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    return NULL;
+}
+
+static int start_batch_writer(struct xc_sr_context *ctx)
+{
+    xc_interface *xch = ctx->xch;
+    struct xc_sr_batch_writer *w = calloc(1, sizeof(*w));
+    int rc;
+
+    if ( !w )
+    {
+        ERROR("Unable to allocate page data writer");
+        errno = ENOMEM;
+        return -1;
+    }
+
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cond, NULL);
+    ctx->save.writer = w;
+
+    rc = pthread_create(&w->thread, NULL, batch_writer_thread, ctx);
+    if ( rc )
+    {
+        /* Not fatal - write_batch() falls back to writing synchronously. */
+        errno = rc;
+        PERROR("Unable to create page data writer thread");
+        pthread_cond_destroy(&w->cond);
+        pthread_mutex_destroy(&w->lock);
+        free(w);
+        ctx->save.writer = NULL;
+    }
+
+    return 0;
+}
+
+static void stop_batch_writer(struct xc_sr_context *ctx)
+{
+    struct xc_sr_batch_writer *w = ctx->save.writer;
+
+    if ( !w )
+        return;
+
+    pthread_mutex_lock(&w->lock);
+    w->stop = true;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+
+    pthread_join(w->thread, NULL);
+    pthread_cond_destroy(&w->cond);
+    pthread_mutex_destroy(&w->lock);
+    free(w);
+    ctx->save.writer = NULL;
+}
+
+/*
+ * Hand a constructed batch to the writer thread, waiting for a free slot if
+ * the queue is full.  Ownership of @b passes to the writer, even on error.
+ */
+static int queue_batch(struct xc_sr_context *ctx,
+                       struct xc_sr_pending_batch *b)
+{
+    xc_interface *xch = ctx->xch;
+    struct xc_sr_batch_writer *w = ctx->save.writer;
+    int rc;
+
+    if ( !w )
+    {
+        rc = writev_exact(ctx->fd, b->iov, b->iovcnt);
+        if ( rc )
+            PERROR("Failed to write page data to stream");
+        free_pending_batch(ctx, b);
+        return rc;
+    }
+
+    pthread_mutex_lock(&w->lock);
+    while ( w->count == WRITE_QUEUE_DEPTH && !w->error )
+        pthread_cond_wait(&w->cond, &w->lock);
+
+    rc = w->error;
+    if ( !rc )
+    {
+        w->queue[(w->head + w->count) % WRITE_QUEUE_DEPTH] = b;
+        w->count++;
+        pthread_cond_broadcast(&w->cond);
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    if ( rc )
+    {
+        free_pending_batch(ctx, b);
+        errno = rc;
+        PERROR("Failed to write page data to stream");
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Wait for the writer thread to put every queued batch into the stream.  Must
+ * be done before anything else is written to ctx->fd.
+ */
+static int drain_batches(struct xc_sr_context *ctx)
+{
+    xc_interface *xch = ctx->xch;
+    struct xc_sr_batch_writer *w = ctx->save.writer;
+    int rc;
+
+    if ( !w )
+        return 0;
+
+    pthread_mutex_lock(&w->lock);
+    while ( w->count || w->busy )
+        pthread_cond_wait(&w->cond, &w->lock);
+    rc = w->error;
+    pthread_mutex_unlock(&w->lock);
+
+    if ( rc )
+    {
+        errno = rc;
+        PERROR("Failed to write page data to stream");
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Zero pages, and pages duplicating an earlier page of the same batch, are
+ * described in a COMPRESSED_PAGE_DATA record by their source entry alone.
+ * Duplicates are found by hashing each page into an open addressed table.
+ */
+#define DEDUP_SLOTS (2 * MAX_BATCH_SIZE)
+
+/*
+ * Try to construct @b as a COMPRESSED_PAGE_DATA record from the @nr_pages
+ * pages of data in @guest_data, using @zs.  Returns 0 on success, 1 if the result would
+ * be no smaller than a plain PAGE_DATA record, or -1 on error.
+ */
+static int compress_batch(struct xc_sr_context *ctx, z_stream *zs,
+                          struct xc_sr_pending_batch *b,
+                          const xen_pfn_t *types, void **guest_data,
+                          unsigned nr_pfns, unsigned nr_pages)
+{
+    static const char zeroes[(1u << REC_ALIGN_ORDER) - 1] = { 0 };
+
+    xc_interface *xch = ctx->xch;
+    void **pages = malloc(nr_pages * sizeof(*pages));
+    uint32_t *slots = calloc(DEDUP_SLOTS, sizeof(*slots));
+    uint32_t *src = malloc(nr_pages * sizeof(*src));
+    unsigned i, k, n, nr_data = 0;
+    size_t bound, body;
+    int rc = -1;
+
+    if ( !pages || !slots || !src )
+    {
+        ERROR("Unable to allocate compression state for %u pages", nr_pages);
+        goto out;
+    }
+
+    for ( i = 0, k = 0; i < nr_pfns; ++i )
+    {
+        const uint64_t *w = guest_data[i];
+        uint64_t hash = 0xcbf29ce484222325ULL, any = 0;
+
+        if ( !w )
+            continue;
+
+        pages[k] = guest_data[i];
+        src[k] = COMPRESSED_PAGE_DATA;
+
+        /* Page tables are always sent, as each one is localised. */
+        if ( types[i] != XEN_DOMCTL_PFINFO_NOTAB )
+        {
+            ++nr_data;
+            ++k;
+            continue;
+        }
+
+        for ( n = 0; n < PAGE_SIZE / sizeof(*w); ++n )
+        {
+            any |= w[n];
+            hash = (hash ^ w[n]) * 0x100000001b3ULL;
+        }
+
+        if ( !any )
+            src[k] = COMPRESSED_PAGE_ZERO;
+        else
+        {
+            for ( n = hash % DEDUP_SLOTS; slots[n];
+                  n = (n + 1) % DEDUP_SLOTS )
+            {
+                if ( !memcmp(pages[slots[n] - 1], w, PAGE_SIZE) )
+                {
+                    src[k] = slots[n] - 1;
+                    break;
+                }
+            }
+
+            if ( !slots[n] )
+            {
+                slots[n] = k + 1;
+                ++nr_data;
+            }
+        }
+        ++k;
+    }
+    assert(k == nr_pages);
+
+    b->chdr.compressed_length = 0;
+    if ( nr_data )
+    {
+        if ( deflateReset(zs) != Z_OK )
+        {
+            ERROR("Failed to reset deflate stream");
+            goto out;
+        }
+
+        bound = deflateBound(zs, nr_data * PAGE_SIZE);
+        b->zbuf = malloc(bound);
+        if ( !b->zbuf )
+        {
+            ERROR("Unable to allocate %zu bytes for compressed page data",
+                  bound);
+            goto out;
+        }
+
+        zs->next_out = b->zbuf;
+        zs->avail_out = bound;
+
+        for ( k = 0, n = 0; k < nr_pages; ++k )
+        {
+            if ( src[k] != COMPRESSED_PAGE_DATA )
+                continue;
+
+            zs->next_in = pages[k];
+            zs->avail_in = PAGE_SIZE;
+            if ( deflate(zs, ++n == nr_data ? Z_FINISH : Z_NO_FLUSH) ==
+                 Z_STREAM_ERROR || zs->avail_in )
+            {
+                ERROR("Failed to compress page data: %s",
+                      zs->msg ?: "insufficient output space");
+                goto out;
+            }
+        }
+
+        b->chdr.compressed_length = bound - zs->avail_out;
+    }
+
+    body = nr_pages * sizeof(*src) + b->chdr.compressed_length;
+    if ( body >= (size_t)nr_pages * PAGE_SIZE )
+    {
+        free(b->zbuf);
+        b->zbuf = NULL;
+        rc = 1;
+        goto out;
+    }
+
+    b->chdr.count = nr_pfns;
+    b->rec.type = REC_TYPE_COMPRESSED_PAGE_DATA;
+    b->rec.length = sizeof(b->chdr) + nr_pfns * sizeof(*b->rec_pfns) + body;
+    b->src = src;
+    src = NULL;
+
+    b->iov[0].iov_base = &b->rec.type;
+    b->iov[0].iov_len = sizeof(b->rec.type);
+    b->iov[1].iov_base = &b->rec.length;
+    b->iov[1].iov_len = sizeof(b->rec.length);
+    b->iov[2].iov_base = &b->chdr;
+    b->iov[2].iov_len = sizeof(b->chdr);
+    b->iov[3].iov_base = b->rec_pfns;
+    b->iov[3].iov_len = nr_pfns * sizeof(*b->rec_pfns);
+    b->iov[4].iov_base = b->src;
+    b->iov[4].iov_len = nr_pages * sizeof(*b->src);
+    b->iov[5].iov_base = b->zbuf;
+    b->iov[5].iov_len = b->chdr.compressed_length;
+    b->iov[6].iov_base = (void *)zeroes;
+    b->iov[6].iov_len = ROUNDUP(b->rec.length, REC_ALIGN_ORDER) -
+                        b->rec.length;
+    b->iovcnt = 7;
+
+    /* The page contents are now in zbuf; drop the guest mapping early. */
+    release_batch_pages(ctx, b);
+    rc = 0;
+
+ out:
+    free(src);
+    free(slots);
+    free(pages);
+
+    return rc;
+}
+
+/*
+ * The checkpoints of a Remus stream may be staged: while the domain is
+ * paused, its dirty pages are only copied aside, and the records describing
+ * them, as well as anything else written until the domain is resumed, are
+ * held back in order.  Once the domain runs again, the page data is
+ * compressed on worker threads and everything is written out.  The pause
+ * then lasts about as long as copying the dirty memory.
+ *
+ * The copies live in chunks of MAX_BATCH_SIZE pages, one per batch, which
+ * are kept from one checkpoint to the next, so that only a checkpoint larger
+ * than all the previous ones allocates memory while the domain is paused.
+ */
+#define STAGE_MAX_WORKERS 4
+
+struct xc_sr_stage_worker
+{
+    struct xc_sr_context *ctx;
+    pthread_t thread;
+    z_stream zs;
+    bool zinit;
+};
+
+struct xc_sr_staging
+{
+    void **chunks;
+    unsigned nr_chunks, used_chunks;
+
+    /* Page data batches and records, in stream order. */
+    struct xc_sr_pending_batch **batches;
+    unsigned nr_batches, max_batches;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    unsigned next;  /* Next batch for a worker to look at. */
+    bool failed;    /* Stop handing out batches. */
+
+    unsigned nr_workers;
+    struct xc_sr_stage_worker workers[STAGE_MAX_WORKERS];
+};
+
+/* Append @b to the staged stream.  Ownership of @b passes, even on error. */
+static int stage_batch(struct xc_sr_context *ctx,
+                       struct xc_sr_pending_batch *b)
+{
+    xc_interface *xch = ctx->xch;
+    struct xc_sr_staging *s = ctx->staging;
+    struct xc_sr_pending_batch **batches;
+    unsigned max;
+
+    if ( s->nr_batches == s->max_batches )
+    {
+        max = s->max_batches ? 2 * s->max_batches : 64;
+        batches = realloc(s->batches, max * sizeof(*batches));
+        if ( !batches )
+        {
+            ERROR("Unable to stage %u records", max);
+            free_pending_batch(ctx, b);
+            return -1;
+        }
+        s->batches = batches;
+        s->max_batches = max;
+    }
+
+    s->batches[s->nr_batches++] = b;
+
+    return 0;
+}
+
+int stage_record(struct xc_sr_context *ctx, const struct iovec *iov,
+                 int iovcnt)
+{
+    xc_interface *xch = ctx->xch;
+    struct xc_sr_pending_batch *b = calloc(1, sizeof(*b));
+    size_t len = 0;
+    char *p;
+    int i;
+
+    for ( i = 0; i < iovcnt; ++i )
+        len += iov[i].iov_len;
+
+    if ( b )
+    {
+        b->copy = malloc(len);
+        b->iov = malloc(sizeof(*b->iov));
+    }
+
+    if ( !b || !b->copy || !b->iov )
+    {
+        ERROR("Unable to stage a record of %zu bytes", len);
+        free_pending_batch(ctx, b);
+        return -1;
+    }
+
+    for ( i = 0, p = b->copy; i < iovcnt; p += iov[i++].iov_len )
+        memcpy(p, iov[i].iov_base, iov[i].iov_len);
+
+    b->iov[0].iov_base = b->copy;
+    b->iov[0].iov_len = len;
+    b->iovcnt = 1;
+
+    return stage_batch(ctx, b);
+}
+
+/*
+ * Copy the page data of @b into a staging chunk, pointing @guest_data at the
+ * copies, and let go of the guest mapping.
+ */
+static int stage_pages(struct xc_sr_context *ctx,
+                       struct xc_sr_pending_batch *b, void **guest_data)
+{
+    xc_interface *xch = ctx->xch;
+    struct xc_sr_staging *s = ctx->staging;
+    void **chunks;
+    void *chunk;
+    unsigned i, p;
+
+    if ( s->used_chunks == s->nr_chunks )
+    {
+        chunks = realloc(s->chunks, (s->nr_chunks + 1) * sizeof(*chunks));
+        if ( !chunks )
+            goto nomem;
+        s->chunks = chunks;
+
+        s->chunks[s->nr_chunks] = xc_memalign(xch, PAGE_SIZE,
+                                              MAX_BATCH_SIZE * PAGE_SIZE);
+        if ( !s->chunks[s->nr_chunks] )
+            goto nomem;
+        s->nr_chunks++;
+    }
+    chunk = s->chunks[s->used_chunks++];
+
+    for ( i = 0, p = 0; i < b->nr_pfns; ++i )
+    {
+        if ( !guest_data[i] )
+            continue;
+
+        memcpy(chunk + p * PAGE_SIZE, guest_data[i], PAGE_SIZE);
+        guest_data[i] = chunk + p++ * PAGE_SIZE;
+    }
+
+    release_batch_pages(ctx, b);
+
+    return 0;
+
+ nomem:
+    ERROR("Unable to allocate staging for %u pages", MAX_BATCH_SIZE);
+    return -1;
+}
+
+/* Replace @b's PAGE_DATA record by a COMPRESSED_PAGE_DATA one if smaller. */
+static int compress_staged(struct xc_sr_context *ctx, z_stream *zs,
+                           struct xc_sr_pending_batch *b)
+{
+    unsigned i, nr_pages = 0;
+    int rc;
+
+    for ( i = 0; i < b->nr_pfns; ++i )
+        if ( b->data[i] )
+            ++nr_pages;
+
+    rc = compress_batch(ctx, zs, b, b->types, b->data, b->nr_pfns, nr_pages);
+
+    free(b->types);
+    free(b->data);
+    b->types = NULL;
+    b->data = NULL;
+
+    return rc < 0 ? -1 : 0;
+}
+
+static void *stage_worker_thread(void *arg)
+{
+    struct xc_sr_stage_worker *wk = arg;
+    struct xc_sr_context *ctx = wk->ctx;
+    struct xc_sr_staging *s = ctx->save.stage;
+    struct xc_sr_pending_batch *b;
+    int rc;
+
+    pthread_mutex_lock(&s->lock);
+    while ( s->next < s->nr_batches && !s->failed )
+    {
+        /* Batches already written out have been cleared. */
+        b = s->batches[s->next++];
+        if ( !b || !b->compress )
+            continue;
+        pthread_mutex_unlock(&s->lock);
+
+        rc = compress_staged(ctx, &wk->zs, b);
+
+        pthread_mutex_lock(&s->lock);
+        if ( rc )
+            s->failed = true;
+        b->compress = false;
+        pthread_cond_broadcast(&s->cond);
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    return NULL;
+}
+
+static void start_staging(struct xc_sr_context *ctx)
+{
+    struct xc_sr_staging *s = ctx->save.stage;
+
+    s->used_chunks = 0;
+    s->nr_batches = 0;
+    s->next = 0;
+    s->failed = false;
+
+    ctx->staging = s;
+}
+
+/*
+ * Called once the domain has been resumed: compress the staged page data and
+ * hand everything staged to the writer thread, in order.  Returns once all
+ * of it has been written.
+ */
+static int write_staged(struct xc_sr_context *ctx)
+{
+    xc_interface *xch = ctx->xch;
+    struct xc_sr_staging *s = ctx->save.stage;
+    struct xc_sr_pending_batch *b;
+    unsigned i, nr_workers = 0;
+    bool failed, busy;
+    int rc = 0, err;
+
+    ctx->staging = NULL;
+
+    /* Without any worker, the batches get compressed right here. */
+    for ( ; nr_workers < s->nr_workers; ++nr_workers )
+    {
+        err = pthread_create(&s->workers[nr_workers].thread, NULL,
+                             stage_worker_thread, &s->workers[nr_workers]);
+        if ( err )
+        {
+            errno = err;
+            PERROR("Unable to create page data compression thread");
+            break;
+        }
+    }
+
+    for ( i = 0; i < s->nr_batches; ++i )
+    {
+        pthread_mutex_lock(&s->lock);
+        b = s->batches[i];
+        while ( nr_workers && b->compress && !s->failed )
+            pthread_cond_wait(&s->cond, &s->lock);
+        if ( rc )
+            s->failed = true;
+        failed = s->failed;
+        /* If so, a worker may still be compressing @b; it is freed below. */
+        busy = failed && b->compress;
+        if ( !busy )
+            s->batches[i] = NULL;
+        pthread_mutex_unlock(&s->lock);
+
+        if ( failed )
+        {
+            if ( !busy )
+                free_pending_batch(ctx, b);
+            rc = -1;
+            continue;
+        }
+
+        if ( b->compress &&
+             compress_staged(ctx, ctx->save.zstream, b) )
+        {
+            free_pending_batch(ctx, b);
+            rc = -1;
+            continue;
+        }
+        b->compress = false;
+
+        rc = queue_batch(ctx, b);
+    }
+
+    while ( nr_workers )
+        pthread_join(s->workers[--nr_workers].thread, NULL);
+
+    if ( rc )
+    {
+        for ( i = 0; i < s->nr_batches; ++i )
+        {
+            free_pending_batch(ctx, s->batches[i]);
+            s->batches[i] = NULL;
+        }
+        ERROR("Failed to write staged checkpoint");
+        return -1;
+    }
+
+    return drain_batches(ctx);
+}
+
+static int setup_staging(struct xc_sr_context *ctx)
+{
+    xc_interface *xch = ctx->xch;
+    struct xc_sr_staging *s = calloc(1, sizeof(*s));
+    long nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned i;
+
+    if ( !s )
+    {
+        ERROR("Unable to allocate checkpoint staging");
+        errno = ENOMEM;
+        return -1;
+    }
+
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+    ctx->save.stage = s;
+
+    if ( !ctx->save.zstream )
+        return 0;
+
+    s->nr_workers = nr_cpus > 0 ? min_t(long, nr_cpus, STAGE_MAX_WORKERS) : 1;
+    for ( i = 0; i < s->nr_workers; ++i )
+    {
+        s->workers[i].ctx = ctx;
+        if ( deflateInit(&s->workers[i].zs, Z_BEST_SPEED) != Z_OK )
+        {
+            ERROR("Unable to initialise page data compression");
+            return -1;
+        }
+        s->workers[i].zinit = true;
+    }
+
+    return 0;
+}
+
+static void cleanup_staging(struct xc_sr_context *ctx)
+{
+    struct xc_sr_staging *s = ctx->save.stage;
+    unsigned i;
+
+    if ( !s )
+        return;
+
+    ctx->staging = NULL;
+
+    for ( i = 0; i < s->nr_batches; ++i )
+        free_pending_batch(ctx, s->batches[i]);
+    free(s->batches);
+
+    for ( i = 0; i < s->nr_chunks; ++i )
+        free(s->chunks[i]);
+    free(s->chunks);
+
+    for ( i = 0; i < s->nr_workers; ++i )
+        if ( s->workers[i].zinit )
+            deflateEnd(&s->workers[i].zs);
+
+    pthread_cond_destroy(&s->cond);
+    pthread_mutex_destroy(&s->lock);
+    free(s);
+    ctx->save.stage = NULL;
+}
+
 /*
  * Writes a batch of memory as a PAGE_DATA record into the stream.  The batch
  * is constructed in ctx->save.batch_pfns.
@@ -74,29 +853,31 @@ static int write_checkpoint_record(struct xc_sr_context *ctx)
  * - gets the types for each pfn in the batch.
  * - for each pfn with real data:
  *   - maps and attempts to localise the pages.
- * - construct and writes a PAGE_DATA record into the stream.
+ * - construct a PAGE_DATA (or COMPRESSED_PAGE_DATA) record and queues it for
+ *   the writer thread.
+ *
+ * While staging, the page data is copied aside and the record staged instead,
+ * with any compression left until the domain is resumed.
  */
 static int write_batch(struct xc_sr_context *ctx)
 {
     xc_interface *xch = ctx->xch;
+    struct xc_sr_pending_batch *b = NULL;
     xen_pfn_t *mfns = NULL, *types = NULL;
-    void *guest_mapping = NULL;
     void **guest_data = NULL;
     void **local_pages = NULL;
     int *errors = NULL, rc = -1;
-    unsigned i, p, nr_pages = 0, nr_pages_mapped = 0;
+    unsigned i, p, nr_pages = 0;
     unsigned nr_pfns = ctx->save.nr_batch_pfns;
     void *page, *orig_page;
     uint64_t *rec_pfns = NULL;
     struct iovec *iov = NULL; int iovcnt = 0;
-    struct xc_sr_rec_page_data_header hdr = { 0 };
-    struct xc_sr_record rec =
-    {
-        .type = REC_TYPE_PAGE_DATA,
-    };
+    bool defer_compress;
 
     assert(nr_pfns != 0);
 
+    /* The record under construction.  Owns everything needed for writev(). */
+    b = calloc(1, sizeof(*b));
     /* Mfns of the batch pfns. */
     mfns = malloc(nr_pfns * sizeof(*mfns));
     /* Types of the batch pfns. */
@@ -107,10 +888,25 @@ static int write_batch(struct xc_sr_context *ctx)
     guest_data = calloc(nr_pfns, sizeof(*guest_data));
     /* Pointers to locally allocated pages.  Need freeing. */
     local_pages = calloc(nr_pfns, sizeof(*local_pages));
-    /* iovec[] for writev(). */
-    iov = malloc((nr_pfns + 4) * sizeof(*iov));
+    /* iovec[] for writev().  Enough for a compressed record's 7 parts too. */
+    iov = malloc((nr_pfns + 7) * sizeof(*iov));
+
+    if ( b )
+    {
+        b->rec.type = REC_TYPE_PAGE_DATA;
+        b->local_pages = local_pages;
+        b->nr_pfns = nr_pfns;
+        b->iov = iov;
+    }
+    else
+    {
+        free(local_pages);
+        free(iov);
+        local_pages = NULL;
+    }
 
-    if ( !mfns || !types || !errors || !guest_data || !local_pages || !iov )
+    if ( !b || !mfns || !types || !errors || !guest_data ||
+         !local_pages || !iov )
     {
         ERROR("Unable to allocate arrays for a batch of %u pages",
               nr_pfns);
@@ -153,14 +949,14 @@ static int write_batch(struct xc_sr_context *ctx)
 
     if ( nr_pages > 0 )
     {
-        guest_mapping = xenforeignmemory_map(xch->fmem,
+        b->guest_mapping = xenforeignmemory_map(xch->fmem,
             ctx->domid, PROT_READ, nr_pages, mfns, errors);
-        if ( !guest_mapping )
+        if ( !b->guest_mapping )
         {
             PERROR("Failed to map guest pages");
             goto err;
         }
-        nr_pages_mapped = nr_pages;
+        b->nr_pages_mapped = nr_pages;
 
         for ( i = 0, p = 0; i < nr_pfns; ++i )
         {
@@ -179,7 +975,7 @@ static int write_batch(struct xc_sr_context *ctx)
                 goto err;
             }
 
-            orig_page = page = guest_mapping + (p * PAGE_SIZE);
+            orig_page = page = b->guest_mapping + (p * PAGE_SIZE);
             rc = ctx->save.ops.normalise_page(ctx, types[i], &page);
 
             if ( orig_page != page )
@@ -205,7 +1001,7 @@ static int write_batch(struct xc_sr_context *ctx)
         }
     }
 
-    rec_pfns = malloc(nr_pfns * sizeof(*rec_pfns));
+    rec_pfns = b->rec_pfns = malloc(nr_pfns * sizeof(*rec_pfns));
     if ( !rec_pfns )
     {
         ERROR("Unable to allocate %zu bytes of memory for page data pfn list",
@@ -213,61 +1009,88 @@ static int write_batch(struct xc_sr_context *ctx)
         goto err;
     }
 
-    hdr.count = nr_pfns;
-
-    rec.length = sizeof(hdr);
-    rec.length += nr_pfns * sizeof(*rec_pfns);
-    rec.length += nr_pages * PAGE_SIZE;
-
     for ( i = 0; i < nr_pfns; ++i )
         rec_pfns[i] = ((uint64_t)(types[i]) << 32) | ctx->save.batch_pfns[i];
 
-    iov[0].iov_base = &rec.type;
-    iov[0].iov_len = sizeof(rec.type);
+    if ( ctx->staging && nr_pages )
+    {
+        rc = stage_pages(ctx, b, guest_data);
+        if ( rc )
+            goto err;
+    }
+
+    rc = 1;
+    defer_compress = ctx->staging && ctx->save.zstream && nr_pages;
+    if ( ctx->save.zstream && nr_pages && !defer_compress )
+    {
+        rc = compress_batch(ctx, ctx->save.zstream, b, types, guest_data,
+                            nr_pfns, nr_pages);
+        if ( rc < 0 )
+            goto err;
+    }
+
+    if ( rc )
+    {
+        b->hdr.count = nr_pfns;
 
-    iov[1].iov_base = &rec.length;
-    iov[1].iov_len = sizeof(rec.length);
+        b->rec.length = sizeof(b->hdr);
+        b->rec.length += nr_pfns * sizeof(*rec_pfns);
+        b->rec.length += nr_pages * PAGE_SIZE;
 
-    iov[2].iov_base = &hdr;
-    iov[2].iov_len = sizeof(hdr);
+        iov[0].iov_base = &b->rec.type;
+        iov[0].iov_len = sizeof(b->rec.type);
 
-    iov[3].iov_base = rec_pfns;
-    iov[3].iov_len = nr_pfns * sizeof(*rec_pfns);
+        iov[1].iov_base = &b->rec.length;
+        iov[1].iov_len = sizeof(b->rec.length);
 
-    iovcnt = 4;
+        iov[2].iov_base = &b->hdr;
+        iov[2].iov_len = sizeof(b->hdr);
 
-    if ( nr_pages )
-    {
-        for ( i = 0; i < nr_pfns; ++i )
+        iov[3].iov_base = rec_pfns;
+        iov[3].iov_len = nr_pfns * sizeof(*rec_pfns);
+
+        iovcnt = 4;
+
+        if ( nr_pages )
         {
-            if ( guest_data[i] )
+            for ( i = 0; i < nr_pfns; ++i )
             {
-                iov[iovcnt].iov_base = guest_data[i];
-                iov[iovcnt].iov_len = PAGE_SIZE;
-                iovcnt++;
-                --nr_pages;
+                if ( guest_data[i] )
+                {
+                    iov[iovcnt].iov_base = guest_data[i];
+                    iov[iovcnt].iov_len = PAGE_SIZE;
+                    iovcnt++;
+                    --nr_pages;
+                }
             }
         }
+
+        /* Sanity check we have queued all the pages we expected to. */
+        assert(nr_pages == 0);
+        b->iovcnt = iovcnt;
     }
 
-    if ( writev_exact(ctx->fd, iov, iovcnt) )
+    if ( defer_compress )
     {
-        PERROR("Failed to write page data to stream");
-        goto err;
+        b->compress = true;
+        b->types = types;
+        b->data = guest_data;
+        types = NULL;
+        guest_data = NULL;
     }
 
-    /* Sanity check we have sent all the pages we expected to. */
-    assert(nr_pages == 0);
+    if ( ctx->staging )
+        rc = stage_batch(ctx, b);
+    else
+        rc = queue_batch(ctx, b);
+    b = NULL;
+    if ( rc )
+        goto err;
+
     rc = ctx->save.nr_batch_pfns = 0;
 
  err:
-    free(rec_pfns);
-    if ( guest_mapping )
-        xenforeignmemory_unmap(xch->fmem, guest_mapping, nr_pages_mapped);
-    for ( i = 0; local_pages && i < nr_pfns; ++i )
-        free(local_pages[i]);
-    free(iov);
-    free(local_pages);
+    free_pending_batch(ctx, b);
     free(guest_data);
     free(errors);
     free(types);
@@ -277,16 +1100,18 @@ static int write_batch(struct xc_sr_context *ctx)
 }
 
 /*
- * Flush a batch of pfns into the stream.
+ * Flush a batch of pfns into the stream, and wait for everything queued so
+ * far to be written out.
  */
 static int flush_batch(struct xc_sr_context *ctx)
 {
     int rc = 0;
 
-    if ( ctx->save.nr_batch_pfns == 0 )
-        return rc;
+    if ( ctx->save.nr_batch_pfns )
+        rc = write_batch(ctx);
 
-    rc = write_batch(ctx);
+    if ( !rc )
+        rc = drain_batches(ctx);
 
     if ( !rc )
     {
@@ -299,14 +1124,21 @@ static int flush_batch(struct xc_sr_context *ctx)
 }
 
 /*
- * Add a single pfn to the batch, flushing the batch if full.
+ * Add a single pfn to the batch, writing the batch if full.  The write
+ * completes asynchronously; flush_batch() waits for it.
  */
 static int add_to_batch(struct xc_sr_context *ctx, xen_pfn_t pfn)
 {
     int rc = 0;
 
     if ( ctx->save.nr_batch_pfns == MAX_BATCH_SIZE )
-        rc = flush_batch(ctx);
+    {
+        rc = write_batch(ctx);
+        if ( !rc )
+            VALGRIND_MAKE_MEM_UNDEFINED(ctx->save.batch_pfns,
+                                        MAX_BATCH_SIZE *
+                                        sizeof(*ctx->save.batch_pfns));
+    }
 
     if ( rc == 0 )
         ctx->save.batch_pfns[ctx->save.nr_batch_pfns++] = pfn;
@@ -466,29 +1298,183 @@ static int update_progress_string(struct xc_sr_context *ctx,
     return 0;
 }
 
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Halve the cpu time available to the guest, by way of a credit scheduler
+ * cap.  The original parameters are restored by unthrottle_domain().
+ */
+static int throttle_domain(struct xc_sr_context *ctx)
+{
+    xc_interface *xch = ctx->xch;
+    struct precopy_stats *ps = &ctx->save.precopy;
+    struct xen_domctl_sched_credit sdom;
+    unsigned int full, remaining;
+
+    if ( !ctx->save.throttled )
+    {
+        if ( xc_sched_credit_domain_get(xch, ctx->domid,
+                                        &ctx->save.orig_sched) )
+        {
+            PERROR("Unable to throttle: no credit scheduler parameters");
+            return -1;
+        }
+        ctx->save.throttled = true;
+    }
+
+    /* A cap of 0 is uncapped, i.e. 100% of each vcpu. */
+    full = ctx->save.orig_sched.cap ?:
+        (ctx->dominfo.max_vcpu_id + 1) * 100;
+    remaining = (100 - ps->throttle) / 2;
+    if ( remaining == 0 )
+        return 0;
+
+    sdom = ctx->save.orig_sched;
+    sdom.cap = max(1U, full * remaining / 100);
+
+    if ( xc_sched_credit_domain_set(xch, ctx->domid, &sdom) )
+    {
+        PERROR("Failed to set credit cap %u", sdom.cap);
+        return -1;
+    }
+
+    ps->throttle = 100 - remaining;
+    DPRINTF("Throttled to %u%% cpu (cap %u)", remaining, sdom.cap);
+
+    return 0;
+}
+
+static void unthrottle_domain(struct xc_sr_context *ctx)
+{
+    xc_interface *xch = ctx->xch;
+
+    if ( !ctx->save.throttled )
+        return;
+
+    if ( xc_sched_credit_domain_set(xch, ctx->domid, &ctx->save.orig_sched) )
+        PERROR("Failed to restore credit scheduler parameters");
+
+    ctx->save.throttled = false;
+    ctx->save.precopy.throttle = 0;
+}
+
+/*
+ * The policy used without a precopy_policy callback.  Stop once the dirty
+ * set is small, or once the guest dirties memory at least as fast as it can
+ * be sent, as further iterations would only resend its working set.
+ */
+static int default_precopy_policy(struct xc_sr_context *ctx,
+                                  const struct precopy_stats *ps)
+{
+    xc_interface *xch = ctx->xch;
+
+    if ( ps->iteration >= ctx->save.max_iterations ||
+         ps->dirty_count <= ctx->save.dirty_threshold )
+        return XGS_POLICY_STOP_AND_COPY;
+
+    if ( ps->iteration > 1 && ps->dirty_rate >= ps->send_rate )
+    {
+        DPRINTF("Not converging (dirty %lu pages/s, sending %lu pages/s), "
+                "suspending after %u iterations", ps->dirty_rate,
+                ps->send_rate, ps->iteration);
+        return XGS_POLICY_STOP_AND_COPY;
+    }
+
+    return XGS_POLICY_CONTINUE_PRECOPY;
+}
+
+/*
+ * Account for an iteration which sent @sent pages over @ms milliseconds, and
+ * for the pages the guest dirtied meanwhile.
+ */
+static int update_precopy_stats(struct xc_sr_context *ctx,
+                                unsigned long sent, uint64_t ms)
+{
+    xc_interface *xch = ctx->xch;
+    struct precopy_stats *ps = &ctx->save.precopy;
+    xc_shadow_op_stats_t stats;
+
+    if ( xc_shadow_control(xch, ctx->domid, XEN_DOMCTL_SHADOW_OP_PEEK,
+                           NULL, 0, NULL, 0, &stats) < 0 )
+    {
+        PERROR("Failed to retrieve logdirty stats");
+        return -1;
+    }
+
+    ms = ms ?: 1;
+    ps->iteration++;
+    ps->total_written += sent;
+    ps->dirty_count = stats.dirty_count;
+    ps->round_pages = sent;
+    ps->round_ms = ms;
+    ps->send_rate = sent * 1000 / ms;
+    ps->dirty_rate = stats.dirty_count * 1000ULL / ms;
+    ps->downtime_ms = ps->send_rate ?
+        ps->dirty_count * 1000ULL / ps->send_rate : ~0UL;
+
+    IPRINTF("Pre-copy iteration %u: sent %lu pages in %lums (%lu pages/s), "
+            "%lu dirtied (%lu pages/s), predicted downtime %lums%s",
+            ps->iteration, sent, ps->round_ms, ps->send_rate,
+            ps->dirty_count, ps->dirty_rate, ps->downtime_ms,
+            ps->throttle ? ", throttled" : "");
+
+    return 0;
+}
+
 /*
  * Send memory while guest is running.
  */
 static int send_memory_live(struct xc_sr_context *ctx)
 {
     xc_interface *xch = ctx->xch;
+    struct save_callbacks *cb = ctx->save.callbacks;
+    struct precopy_stats *ps = &ctx->save.precopy;
     xc_shadow_op_stats_t stats = { 0, ctx->save.p2m_size };
     char *progress_str = NULL;
-    unsigned x;
-    int rc;
+    uint64_t start;
+    int rc, policy;
 
     rc = update_progress_string(ctx, &progress_str, 0);
     if ( rc )
         goto out;
 
+    start = now_ms();
     rc = send_all_pages(ctx);
     if ( rc )
         goto out;
 
-    for ( x = 1;
-          ((x < ctx->save.max_iterations) &&
-           (stats.dirty_count > ctx->save.dirty_threshold)); ++x )
+    rc = update_precopy_stats(ctx, ctx->save.p2m_size, now_ms() - start);
+    if ( rc )
+        goto out;
+
+    for ( ; ; )
     {
+        policy = cb->precopy_policy ? cb->precopy_policy(*ps, cb->data)
+                                    : default_precopy_policy(ctx, ps);
+
+        if ( policy == XGS_POLICY_ABORT )
+        {
+            ERROR("Pre-copy aborted by policy after %u iterations",
+                  ps->iteration);
+            rc = -1;
+            goto out;
+        }
+        else if ( policy == XGS_POLICY_STOP_AND_COPY )
+            break;
+        else if ( policy == XGS_POLICY_THROTTLE && throttle_domain(ctx) )
+        {
+            rc = -1;
+            goto out;
+        }
+
+        start = now_ms();
         if ( xc_shadow_control(
                  xch, ctx->domid, XEN_DOMCTL_SHADOW_OP_CLEAN,
                  &ctx->save.dirty_bitmap_hbuf, ctx->save.p2m_size,
@@ -502,13 +1488,17 @@ static int send_memory_live(struct xc_sr_context *ctx)
         if ( stats.dirty_count == 0 )
             break;
 
-        rc = update_progress_string(ctx, &progress_str, x);
+        rc = update_progress_string(ctx, &progress_str, ps->iteration);
         if ( rc )
             goto out;
 
         rc = send_dirty_pages(ctx, stats.dirty_count);
         if ( rc )
             goto out;
+
+        rc = update_precopy_stats(ctx, stats.dirty_count, now_ms() - start);
+        if ( rc )
+            goto out;
     }
 
  out:
@@ -707,6 +1697,9 @@ static int send_domain_memory_live(struct xc_sr_context *ctx)
  */
 static int send_domain_memory_checkpointed(struct xc_sr_context *ctx)
 {
+    if ( ctx->save.stage )
+        start_staging(ctx);
+
     return suspend_and_send_dirty(ctx);
 }
 
@@ -759,7 +1752,28 @@ static int setup(struct xc_sr_context *ctx)
         goto err;
     }
 
-    rc = 0;
+    if ( ctx->save.compress )
+    {
+        ctx->save.zstream = calloc(1, sizeof(*ctx->save.zstream));
+        if ( !ctx->save.zstream ||
+             deflateInit(ctx->save.zstream, Z_BEST_SPEED) != Z_OK )
+        {
+            ERROR("Unable to initialise page data compression");
+            free(ctx->save.zstream);
+            ctx->save.zstream = NULL;
+            rc = -1;
+            goto err;
+        }
+    }
+
+    if ( ctx->save.async_checkpoint )
+    {
+        rc = setup_staging(ctx);
+        if ( rc )
+            goto err;
+    }
+
+    rc = start_batch_writer(ctx);
 
  err:
     return rc;
@@ -771,6 +1785,16 @@ static void cleanup(struct xc_sr_context *ctx)
     DECLARE_HYPERCALL_BUFFER_SHADOW(unsigned long, dirty_bitmap,
                                     &ctx->save.dirty_bitmap_hbuf);
 
+    stop_batch_writer(ctx);
+    cleanup_staging(ctx);
+    unthrottle_domain(ctx);
+
+    if ( ctx->save.zstream )
+    {
+        deflateEnd(ctx->save.zstream);
+        free(ctx->save.zstream);
+        ctx->save.zstream = NULL;
+    }
 
     xc_shadow_control(xch, ctx->domid, XEN_DOMCTL_SHADOW_OP_OFF,
                       NULL, 0, NULL, 0, NULL);
@@ -867,6 +1891,14 @@ static int save(struct xc_sr_context *ctx, uint16_t guest_type)
             if ( rc <= 0 )
                 goto err;
 
+            /* The domain runs again; write out what was staged meanwhile. */
+            if ( ctx->staging )
+            {
+                rc = write_staged(ctx);
+                if ( rc )
+                    goto err;
+            }
+
             if ( ctx->save.checkpointed == XC_MIG_STREAM_COLO )
             {
                 rc = ctx->save.callbacks->wait_checkpoint(
@@ -930,7 +1962,13 @@ int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom,
     ctx.save.callbacks = callbacks;
     ctx.save.live  = !!(flags & XCFLAGS_LIVE);
     ctx.save.debug = !!(flags & XCFLAGS_DEBUG);
+    ctx.save.compress = !!(flags & XCFLAGS_STREAM_COMPRESS);
     ctx.save.checkpointed = stream_type;
+    if ( stream_type == XC_MIG_STREAM_REMUS )
+    {
+        ctx.save.compress |= !!(flags & XCFLAGS_CHECKPOINT_COMPRESS);
+        ctx.save.async_checkpoint = !!(flags & XCFLAGS_CHECKPOINT_ASYNC);
+    }
     ctx.save.recv_fd = recv_fd;
 
     /* If altering migration_stream update this assert too. */
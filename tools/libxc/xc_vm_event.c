@@ -22,8 +22,9 @@
 
 #include "xc_private.h"
 
-int xc_vm_event_control(xc_interface *xch, domid_t domain_id, unsigned int op,
-                        unsigned int mode, uint32_t *port)
+static int vm_event_control(xc_interface *xch, domid_t domain_id,
+                            unsigned int op, unsigned int mode,
+                            unsigned int nr_pages, uint32_t *port)
 {
     DECLARE_DOMCTL;
     int rc;
@@ -32,6 +33,7 @@ int xc_vm_event_control(xc_interface *xch, domid_t domain_id, unsigned int op,
     domctl.domain = domain_id;
     domctl.u.vm_event_op.op = op;
     domctl.u.vm_event_op.mode = mode;
+    domctl.u.vm_event_op.ring_pages = nr_pages;
 
     rc = do_domctl(xch, &domctl);
     if ( !rc && port )
@@ -39,16 +41,58 @@ int xc_vm_event_control(xc_interface *xch, domid_t domain_id, unsigned int op,
     return rc;
 }
 
-void *xc_vm_event_enable(xc_interface *xch, domid_t domain_id, int param,
-                         uint32_t *port)
+int xc_vm_event_control(xc_interface *xch, domid_t domain_id, unsigned int op,
+                        unsigned int mode, uint32_t *port)
+{
+    return vm_event_control(xch, domain_id, op, mode, 0, port);
+}
+
+/*
+ * A multi-page ring needs nr_pages free gfns in a row, which the special
+ * pages set up by the domain builder do not provide.  Take them above the
+ * highest gfn of the guest and point the ring's HVM param there; as for
+ * a single page, they leave the physmap again once Xen holds the ring.
+ */
+static int vm_event_populate_ring(xc_interface *xch, domid_t domain_id,
+                                  int param, unsigned int nr_pages,
+                                  xen_pfn_t *ring_pfns)
+{
+    xen_pfn_t max_gpfn;
+    unsigned int i;
+    int rc;
+
+    rc = xc_domain_maximum_gpfn(xch, domain_id, &max_gpfn);
+    if ( rc )
+        return rc;
+
+    for ( i = 0; i < nr_pages; i++ )
+        ring_pfns[i] = max_gpfn + 1 + i;
+
+    rc = xc_domain_populate_physmap_exact(xch, domain_id, nr_pages, 0, 0,
+                                          ring_pfns);
+    if ( rc )
+        return rc;
+
+    rc = xc_hvm_param_set(xch, domain_id, param, ring_pfns[0]);
+    if ( rc )
+        xc_domain_decrease_reservation_exact(xch, domain_id, nr_pages, 0,
+                                             ring_pfns);
+
+    return rc;
+}
+
+void *xc_vm_event_enable_pages(xc_interface *xch, domid_t domain_id,
+                               int param, unsigned int nr_pages,
+                               uint32_t *port)
 {
     void *ring_page = NULL;
     uint64_t pfn;
     xen_pfn_t ring_pfn, mmap_pfn;
+    xen_pfn_t ring_pfns[XEN_VM_EVENT_MAX_RING_PAGES];
     unsigned int op, mode;
     int rc1, rc2, saved_errno;
 
-    if ( !port )
+    if ( !port || !nr_pages || nr_pages > XEN_VM_EVENT_MAX_RING_PAGES )
     {
         errno = EINVAL;
         return NULL;
@@ -62,32 +106,46 @@ void *xc_vm_event_enable(xc_interface *xch, domid_t domain_id, int param,
         return NULL;
     }
 
-    /* Get the pfn of the ring page */
-    rc1 = xc_hvm_param_get(xch, domain_id, param, &pfn);
-    if ( rc1 != 0 )
+    if ( nr_pages > 1 )
     {
-        PERROR("Failed to get pfn of ring page\n");
-        goto out;
+        rc1 = vm_event_populate_ring(xch, domain_id, param, nr_pages,
+                                     ring_pfns);
+        if ( rc1 != 0 )
+        {
+            PERROR("Failed to populate ring pfns\n");
+            goto out;
+        }
     }
-
-    ring_pfn = pfn;
-    mmap_pfn = pfn;
-    rc1 = xc_get_pfn_type_batch(xch, domain_id, 1, &mmap_pfn);
-    if ( rc1 || mmap_pfn & XEN_DOMCTL_PFINFO_XTAB )
+    else
     {
-        /* Page not in the physmap, try to populate it */
-        rc1 = xc_domain_populate_physmap_exact(xch, domain_id, 1, 0, 0,
-                                              &ring_pfn);
+        /* Get the pfn of the ring page */
+        rc1 = xc_hvm_param_get(xch, domain_id, param, &pfn);
         if ( rc1 != 0 )
         {
-            PERROR("Failed to populate ring pfn\n");
+            PERROR("Failed to get pfn of ring page\n");
             goto out;
         }
+
+        ring_pfn = pfn;
+        mmap_pfn = pfn;
+        rc1 = xc_get_pfn_type_batch(xch, domain_id, 1, &mmap_pfn);
+        if ( rc1 || mmap_pfn & XEN_DOMCTL_PFINFO_XTAB )
+        {
+            /* Page not in the physmap, try to populate it */
+            rc1 = xc_domain_populate_physmap_exact(xch, domain_id, 1, 0, 0,
+                                                   &ring_pfn);
+            if ( rc1 != 0 )
+            {
+                PERROR("Failed to populate ring pfn\n");
+                goto out;
+            }
+        }
+
+        ring_pfns[0] = ring_pfn;
     }
 
-    mmap_pfn = ring_pfn;
     ring_page = xc_map_foreign_pages(xch, domain_id, PROT_READ | PROT_WRITE,
-                                         &mmap_pfn, 1);
+                                     ring_pfns, nr_pages);
     if ( !ring_page )
     {
         PERROR("Could not map the ring page\n");
@@ -121,15 +179,16 @@ void *xc_vm_event_enable(xc_interface *xch, domid_t domain_id, int param,
         goto out;
     }
 
-    rc1 = xc_vm_event_control(xch, domain_id, op, mode, port);
+    rc1 = vm_event_control(xch, domain_id, op, mode, nr_pages, port);
     if ( rc1 != 0 )
     {
         PERROR("Failed to enable vm_event\n");
         goto out;
     }
 
-    /* Remove the ring_pfn from the guest's physmap */
-    rc1 = xc_domain_decrease_reservation_exact(xch, domain_id, 1, 0, &ring_pfn);
+    /* Remove the ring pfns from the guest's physmap */
+    rc1 = xc_domain_decrease_reservation_exact(xch, domain_id, nr_pages, 0,
+                                               ring_pfns);
     if ( rc1 != 0 )
         PERROR("Failed to remove ring page from guest physmap");
 
@@ -147,7 +206,7 @@ void *xc_vm_event_enable(xc_interface *xch, domid_t domain_id, int param,
         }
 
         if ( ring_page )
-            xenforeignmemory_unmap(xch->fmem, ring_page, 1);
+            xenforeignmemory_unmap(xch->fmem, ring_page, nr_pages);
         ring_page = NULL;
 
         errno = saved_errno;
@@ -156,6 +215,12 @@ void *xc_vm_event_enable(xc_interface *xch, domid_t domain_id, int param,
     return ring_page;
 }
 
+void *xc_vm_event_enable(xc_interface *xch, domid_t domain_id, int param,
+                         uint32_t *port)
+{
+    return xc_vm_event_enable_pages(xch, domain_id, param, 1, port);
+}
+
 /*
  * Local variables:
  * mode: C
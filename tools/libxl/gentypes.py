@@ -467,10 +467,142 @@ def libxl_C_type_parse_json(ty, w, v, indent = "    ", parent = None, discrimina
         s = indent +s
     return s.replace("\n", "\n%s" % indent).rstrip(indent)
 
+def libxl_C_json_stream_name(ty):
+    return ty.namespace + "_" + ty.rawname + "_json_stream"
+
+# Definitions emitted so far for the libxl__json_stream_type of
+# builtin types, which are shared between all their uses.
+json_stream_values = set()
+
+def libxl_C_json_stream_ref(ty, parent, path, defs):
+    """Returns a pointer to the libxl__json_stream_type for ty, adding the
+    definitions it depends on to defs.  The value is found at path within
+    parent, the innermost named struct.  Returns None when ty cannot be
+    parsed from JSON."""
+    if isinstance(ty, idl.Array):
+        elem = libxl_C_json_stream_ref(ty.elem_type, None, None, defs)
+        if elem is None:
+            return None
+        if isinstance(ty.elem_type, idl.Array):
+            raise Exception("Arrays of arrays cannot be parsed from JSON")
+        name = "json_stream_%s_%s" % (parent.rawname, path.replace(".", "_"))
+        d = "static const libxl__json_stream_type %s = {\n" % name
+        d += "    .kind = LIBXL__JSON_STREAM_ARRAY,\n"
+        d += "    .elem = %s,\n" % elem
+        d += "    .elem_size = sizeof(%s),\n" % ty.elem_type.typename
+        d += "};\n\n"
+        defs.append(d)
+        return "&" + name
+    elif isinstance(ty, idl.Struct) and ty.typename is None:
+        name = "json_stream_%s_%s" % (parent.rawname, path.replace(".", "_"))
+        defs.append(libxl_C_json_stream_struct(ty, name, parent, path + ".",
+                                               defs, static=True))
+        return "&" + name
+    elif ty.json_parse_fn is None:
+        return None
+    elif not isinstance(ty, idl.Builtin):
+        return "&" + libxl_C_json_stream_name(ty)
+    else:
+        name = "json_stream_" + ty.json_parse_fn
+        if name not in json_stream_values:
+            json_stream_values.add(name)
+            d = "static const libxl__json_stream_type %s = {\n" % name
+            d += "    .kind = LIBXL__JSON_STREAM_VALUE,\n"
+            d += "    .parse = (libxl__json_parse_callback)&%s,\n" % ty.json_parse_fn
+            d += "};\n\n"
+            defs.append(d)
+        return "&" + name
+
+def libxl_C_json_stream_field(name, expected, offset, ref,
+                              len_offset = None, init_key = None):
+    s = "    {\n"
+    s += "        .name = \"%s\",\n" % name
+    s += "        .expected_type = %s,\n" % expected
+    s += "        .offset = %s,\n" % offset
+    if ref is not None:
+        s += "        .type = %s,\n" % ref
+    if len_offset is not None:
+        s += "        .len_offset = %s,\n" % len_offset
+    if init_key is not None:
+        s += "        .init_key = %s,\n" % init_key
+    s += "    },\n"
+    return s
+
+def libxl_C_json_stream_struct(ty, name, parent, path, defs, static = False):
+    """Returns the definition of the libxl__json_stream_type name for the
+    struct ty.  The fields of an anonymous struct are given relative to
+    parent, which gets passed down to it unchanged."""
+    s = ""
+    for f in [f for f in ty.fields if not f.const and not f.type.private]:
+        if isinstance(f.type, idl.KeyedUnion):
+            if ty.typename is None:
+                raise Exception("KeyedUnion must be a member of a named type")
+            for x in f.type.fields:
+                init = "json_stream_init_%s_%s" % (ty.rawname, x.name)
+                d = "static void %s(void *p)\n" % init
+                d += "{\n"
+                d += "    %s_%s(p, %s);\n" % (ty.init_fn, f.type.keyvar.name, x.enumname)
+                d += "}\n\n"
+                defs.append(d)
+                mpath = path + f.name + "." + x.name
+                ref = None
+                offset = "0"
+                if x.type is not None:
+                    ref = libxl_C_json_stream_ref(x.type, parent, mpath, defs)
+                    if not (isinstance(x.type, idl.Struct) and x.type.typename is None):
+                        offset = "offsetof(%s, %s)" % (parent.typename, mpath)
+                s += libxl_C_json_stream_field(f.type.keyvar.name + "." + x.name,
+                                               "JSON_MAP", offset, ref,
+                                               init_key = init)
+            continue
+
+        fpath = path + f.name
+        ref = libxl_C_json_stream_ref(f.type, parent, fpath, defs)
+        if ref is None:
+            continue
+        if isinstance(f.type, idl.Struct) and f.type.typename is None:
+            offset = "0"
+        else:
+            offset = "offsetof(%s, %s)" % (parent.typename, fpath)
+        len_offset = None
+        if isinstance(f.type, idl.Array):
+            len_offset = "offsetof(%s, %s)" % (parent.typename,
+                                               path + f.type.lenvar.name)
+        s += libxl_C_json_stream_field(f.name, f.type.json_parse_type,
+                                       offset, ref, len_offset)
+
+    fields = name.replace("json_stream", "json_stream_fields", 1) \
+             if static else "json_stream_fields_" + ty.rawname
+    d = "static const libxl__json_stream_field %s[] = {\n" % fields
+    d += s
+    d += "    { .name = NULL },\n"
+    d += "};\n\n"
+    d += "%sconst libxl__json_stream_type %s = {\n" % \
+         ("static " if static else "", name)
+    d += "    .kind = LIBXL__JSON_STREAM_STRUCT,\n"
+    d += "    .fields = %s,\n" % fields
+    d += "};\n\n"
+    return d
+
+def libxl_C_type_json_stream(ty):
+    """Returns the definition of the libxl__json_stream_type of the named
+    type ty, preceded by everything it depends on."""
+    defs = []
+    name = libxl_C_json_stream_name(ty)
+    if isinstance(ty, idl.Struct):
+        d = libxl_C_json_stream_struct(ty, name, ty, "", defs)
+    else:
+        d = "const libxl__json_stream_type %s = {\n" % name
+        d += "    .kind = LIBXL__JSON_STREAM_VALUE,\n"
+        d += "    .parse = (libxl__json_parse_callback)&%s_parse_json,\n" % \
+             (ty.namespace + "_" + ty.rawname)
+        d += "};\n\n"
+    return "".join(defs) + d
+
 def libxl_C_type_from_json(ty, v, w, indent = "    "):
     s = ""
-    parse = "(libxl__json_parse_callback)&%s_parse_json" % (ty.namespace + "_" + ty.rawname)
-    s += "return libxl__object_from_json(ctx, \"%s\", %s, %s, %s);\n" % (ty.typename, parse, v, w)
+    stream = "&" + libxl_C_json_stream_name(ty)
+    s += "return libxl__object_from_json_stream(ctx, \"%s\", %s, %s, %s);\n" % (ty.typename, stream, v, w)
 
     if s != "":
         s = indent + s
@@ -613,6 +745,8 @@ if __name__ == '__main__':
         f.write("%sint %s_parse_json(libxl__gc *gc, const libxl__json_object *o, %s);\n" % \
                 (ty.hidden(), ty.namespace + "_" + ty.rawname,
                  ty.make_arg("p", passby=idl.PASS_BY_REFERENCE)))
+        f.write("%sextern const libxl__json_stream_type %s;\n" % \
+                (ty.hidden(), libxl_C_json_stream_name(ty)))
 
     f.write("\n")
     f.write("""#endif /* %s */\n""" % header_json_define)
@@ -630,6 +764,7 @@ if __name__ == '__main__':
 
 #include "libxl_osdeps.h"
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -698,6 +833,8 @@ if __name__ == '__main__':
         f.write("}\n")
         f.write("\n")
 
+        f.write(libxl_C_type_json_stream(ty))
+
         f.write("int %s_from_json(libxl_ctx *ctx, %s, const char *s)\n" % (ty.typename, ty.make_arg("p", passby=idl.PASS_BY_REFERENCE)))
         f.write("{\n")
         if not isinstance(ty, idl.Enumeration):
@@ -51,7 +51,8 @@ int libxl_ctx_alloc(libxl_ctx **pctx, int version,
     LIBXL_LIST_INIT(&ctx->pollers_fds_changed);
 
     LIBXL_LIST_INIT(&ctx->efds);
-    LIBXL_TAILQ_INIT(&ctx->etimes);
+    ctx->etimes = 0;
+    ctx->netimes = ctx->etimes_allocd = 0;
 
     ctx->watch_slots = 0;
     LIBXL_SLIST_INIT(&ctx->watch_freeslots);
@@ -66,6 +67,8 @@ int libxl_ctx_alloc(libxl_ctx **pctx, int version,
     LIBXL_TAILQ_INIT(&ctx->death_list);
     libxl__ev_xswatch_init(&ctx->death_watch);
 
+    LIBXL_TAILQ_INIT(&ctx->acpi_cache);
+
     ctx->childproc_hooks = &libxl__childproc_default_hooks;
     ctx->childproc_user = 0;
 
@@ -135,6 +138,16 @@ static void discard_events(struct libxl__event_list *l) {
         libxl_event_free(0, ev);
 }
 
+void libxl__acpi_cache_entry_free(libxl__acpi_cache_entry *ace)
+{
+    int i;
+
+    for (i = 0; i < ace->nr_modules; i++)
+        free(ace->modules[i].data);
+    free(ace->key);
+    free(ace);
+}
+
 int libxl_ctx_free(libxl_ctx *ctx)
 {
     if (!ctx) return 0;
@@ -165,7 +178,7 @@ int libxl_ctx_free(libxl_ctx *ctx)
     /* Now there should be no more events requested from the application: */
 
     assert(LIBXL_LIST_EMPTY(&ctx->efds));
-    assert(LIBXL_TAILQ_EMPTY(&ctx->etimes));
+    assert(!ctx->netimes);
     assert(LIBXL_LIST_EMPTY(&ctx->evtchns_waiting));
     assert(LIBXL_LIST_EMPTY(&ctx->aos_inprogress));
 
@@ -185,6 +198,12 @@ int libxl_ctx_free(libxl_ctx *ctx)
     }
 
     free(ctx->watch_slots);
+    free(ctx->etimes);
+    free(ctx->trace);
+
+    libxl__acpi_cache_entry *ace, *ace_tmp;
+    LIBXL_TAILQ_FOREACH_SAFE(ace, &ctx->acpi_cache, entry, ace_tmp)
+        libxl__acpi_cache_entry_free(ace);
 
     discard_events(&ctx->occurred);
 
@@ -528,6 +547,21 @@ libxl_numainfo *libxl_get_numainfo(libxl_ctx *ctx, int *nr)
 #undef V
     }
 
+    /* Not available from older hypervisors, nor for nodes without memory. */
+    for (i = 0; i < num_nodes; i++) {
+        uint64_t chunks[64];
+        unsigned int nr_orders = ARRAY_SIZE(chunks);
+
+        if (ret[i].size == LIBXL_NUMAINFO_INVALID_ENTRY ||
+            xc_heap_chunks(ctx->xch, i, chunks, &nr_orders))
+            continue;
+
+        nr_orders = min(nr_orders, (unsigned int)ARRAY_SIZE(chunks));
+        ret[i].free_chunks = libxl__calloc(NOGC, nr_orders, sizeof(*chunks));
+        memcpy(ret[i].free_chunks, chunks, nr_orders * sizeof(*chunks));
+        ret[i].num_free_chunks = nr_orders;
+    }
+
  out:
     GC_FREE;
     return ret;
@@ -299,6 +299,22 @@
  */
 #define LIBXL_HAVE_VIRIDIAN_CRASH_CTL 1
 
+/*
+ * LIBXL_HAVE_VIRIDIAN_HCALL_IPI and LIBXL_HAVE_VIRIDIAN_EX_PROCESSOR_MASKS
+ * indicate that the 'hcall_ipi' and 'ex_processor_masks' values are present
+ * in the viridian enlightenment enumeration.
+ */
+#define LIBXL_HAVE_VIRIDIAN_HCALL_IPI 1
+#define LIBXL_HAVE_VIRIDIAN_EX_PROCESSOR_MASKS 1
+
+/*
+ * LIBXL_HAVE_VIRIDIAN_SYNIC and LIBXL_HAVE_VIRIDIAN_STIMER indicate that
+ * the 'synic' and 'stimer' values are present in the viridian enlightenment
+ * enumeration.
+ */
+#define LIBXL_HAVE_VIRIDIAN_SYNIC 1
+#define LIBXL_HAVE_VIRIDIAN_STIMER 1
+
 /*
  * LIBXL_HAVE_BUILDINFO_HVM_ACPI_LAPTOP_SLATE indicates that
  * libxl_domain_build_info has the u.hvm.acpi_laptop_slate field.
@@ -888,6 +904,22 @@ typedef struct libxl__ctx libxl_ctx;
  */
 #define LIBXL_HAVE_COLO_USERSPACE_PROXY 1
 
+/*
+ * LIBXL_HAVE_REMUS_ASYNC_CHECKPOINT
+ * If this is defined, libxl_domain_remus_info has an async_checkpoint field,
+ * which writes the memory of each Remus checkpoint out after resuming the
+ * domain, rather than with the domain paused.
+ */
+#define LIBXL_HAVE_REMUS_ASYNC_CHECKPOINT 1
+
+/*
+ * LIBXL_HAVE_COLO_CHECKPOINT_MIN_INTERVAL
+ * If this is defined, the interval field of libxl_domain_remus_info is, for
+ * COLO, the minimum time in ms between checkpoints requested by the COLO
+ * proxy.
+ */
+#define LIBXL_HAVE_COLO_CHECKPOINT_MIN_INTERVAL 1
+
 typedef uint8_t libxl_mac[6];
 #define LIBXL_MAC_FMT "%02hhx:%02hhx:%02hhx:%02hhx:%02hhx:%02hhx"
 #define LIBXL_MAC_FMTLEN ((2*6)+5) /* 6 hex bytes plus 5 colons */
@@ -922,6 +954,13 @@ void libxl_mac_copy(libxl_ctx *ctx, libxl_mac *dst, const libxl_mac *src);
  * If this is defined, the Code and Data Prioritization feature is supported.
  */
 #define LIBXL_HAVE_PSR_CDP 1
+
+/*
+ * LIBXL_HAVE_PSR_MBA
+ *
+ * If this is defined, the Memory Bandwidth Allocation feature is supported.
+ */
+#define LIBXL_HAVE_PSR_MBA 1
 #endif
 
 /*
@@ -1037,6 +1076,153 @@ void libxl_mac_copy(libxl_ctx *ctx, libxl_mac *dst, const libxl_mac *src);
  */
 #define LIBXL_HAVE_QED 1
 
+/*
+ * LIBXL_HAVE_DOMAIN_DESTROY_PROGRESS
+ *
+ * If this is defined libxl_domain_destroy_progress() is available, to find
+ * out how far the teardown of a domain being destroyed has got.
+ */
+#define LIBXL_HAVE_DOMAIN_DESTROY_PROGRESS 1
+
+/*
+ * LIBXL_HAVE_EVTCHN_STATS
+ *
+ * If this is defined libxl_evtchn_stats_list() is available, returning the
+ * event channel delivery statistics Xen keeps when booted with
+ * "evtchn_stats".
+ */
+#define LIBXL_HAVE_EVTCHN_STATS 1
+
+/*
+ * LIBXL_HAVE_IRQ_STATS
+ *
+ * If this is defined libxl_domain_irq_stats() is available, returning the
+ * interrupt delivery statistics of an HVM domain.
+ */
+#define LIBXL_HAVE_IRQ_STATS 1
+
+/*
+ * LIBXL_HAVE_IRQ_STATS_APIC
+ *
+ * If this is defined libxl_irq_stats has the apic_*_exits fields, counting
+ * the local APIC accesses which were emulated.
+ */
+#define LIBXL_HAVE_IRQ_STATS_APIC 1
+
+/*
+ * LIBXL_HAVE_SCHED_NULL_ASSIGNMENT
+ *
+ * If this is defined libxl_sched_null_assignment_list() is available,
+ * returning which vcpu is assigned to each cpu of a cpupool using the
+ * null scheduler.
+ */
+#define LIBXL_HAVE_SCHED_NULL_ASSIGNMENT 1
+
+/*
+ * LIBXL_HAVE_CREATEINFO_ASYNC_BACKENDS
+ *
+ * If this is defined libxl_domain_create_info has the async_backends
+ * field.  When set, domain creation does not wait for backends running
+ * in a driver domain to reach InitWait before completing.
+ */
+#define LIBXL_HAVE_CREATEINFO_ASYNC_BACKENDS 1
+
+/*
+ * LIBXL_HAVE_BUILDINFO_HVM_UNSHARE_POOL_MEMKB
+ *
+ * If this is defined libxl_domain_build_info has the
+ * u.hvm.unshare_pool_memkb field: the memory Xen keeps allocated for
+ * breaking the sharing of pages of the domain.
+ */
+#define LIBXL_HAVE_BUILDINFO_HVM_UNSHARE_POOL_MEMKB 1
+
+/*
+ * LIBXL_HAVE_BUILDINFO_HVM_VPT_LAZY
+ *
+ * If this is defined libxl_domain_build_info has the u.hvm.vpt_lazy
+ * field: periodic Virtual Platform Timers are not run while their vcpu
+ * is blocked.
+ */
+#define LIBXL_HAVE_BUILDINFO_HVM_VPT_LAZY 1
+
+/*
+ * LIBXL_HAVE_DOMAIN_CREATE_MANY
+ *
+ * If this is defined libxl_domain_create_many() and
+ * libxl_domain_destroy_many() are available, creating or destroying a
+ * number of domains concurrently within one operation.
+ */
+#define LIBXL_HAVE_DOMAIN_CREATE_MANY 1
+
+/*
+ * LIBXL_HAVE_WAIT_FOR_MEMORY_AVAILABLE
+ *
+ * If this is defined libxl_wait_for_memory_available() is available, an
+ * asynchronous operation completing once enough memory is free.
+ */
+#define LIBXL_HAVE_WAIT_FOR_MEMORY_AVAILABLE 1
+
+/*
+ * LIBXL_HAVE_DOMAIN_SUSPEND_MANY
+ *
+ * If this is defined libxl_domain_suspend_many() is available, saving a
+ * number of domains concurrently within one operation.
+ */
+#define LIBXL_HAVE_DOMAIN_SUSPEND_MANY 1
+
+/*
+ * LIBXL_HAVE_DOMAIN_REHOME_MEMORY
+ *
+ * If this is defined libxl_domain_rehome_memory() and the
+ * DOMAIN_MEMORY_REHOME_PROGRESS event are available, moving a domain's
+ * memory onto the nodes it now runs on.
+ */
+#define LIBXL_HAVE_DOMAIN_REHOME_MEMORY 1
+
+/*
+ * LIBXL_HAVE_NUMA_BALANCING
+ *
+ * If this is defined libxl_domain_build_info has a numa_balancing field,
+ * and libxl_domain_{set,get}_numa_balancing() are available, turning
+ * automatic NUMA balancing of an HVM domain on or off.
+ */
+#define LIBXL_HAVE_NUMA_BALANCING 1
+
+/*
+ * LIBXL_HAVE_BUILDINFO_SUPERPAGES_STRICT
+ *
+ * If this is defined libxl_domain_build_info has a superpages_strict
+ * field, failing the build of an HVM domain whose memory can't all be
+ * mapped by the largest pages possible.
+ */
+#define LIBXL_HAVE_BUILDINFO_SUPERPAGES_STRICT 1
+
+/*
+ * LIBXL_HAVE_NUMAINFO_FREE_CHUNKS
+ *
+ * If this is defined libxl_numainfo has free_chunks, the number of free
+ * chunks of memory on the node by order.
+ */
+#define LIBXL_HAVE_NUMAINFO_FREE_CHUNKS 1
+
+/*
+ * LIBXL_HAVE_BUILDINFO_EVTCHN_PRIORITY
+ *
+ * If this is defined libxl_domain_build_info has an evtchn_priority field,
+ * setting the default FIFO priority of the domain's event channels by
+ * what they are bound to (timer VIRQ, other VIRQs, IPIs, PIRQs and
+ * interdomain channels).
+ */
+#define LIBXL_HAVE_BUILDINFO_EVTCHN_PRIORITY 1
+
+/*
+ * LIBXL_HAVE_TRACE
+ *
+ * If this is defined libxl_trace_enable and libxl_trace_write are
+ * available, see below.
+ */
+#define LIBXL_HAVE_TRACE 1
+
 typedef char **libxl_string_list;
 void libxl_string_list_dispose(libxl_string_list *sl);
 int libxl_string_list_length(const libxl_string_list *sl);
@@ -1294,6 +1480,16 @@ int libxl_ctx_alloc(libxl_ctx **pctx, int version,
                     xentoollog_logger *lg);
 int libxl_ctx_free(libxl_ctx *ctx /* 0 is OK */);
 
+/*
+ * Once libxl_trace_enable has been called, libxl records how long the
+ * phases of domain creation on this ctx take, together with the time
+ * the hypervisor spent in the domctls issued meanwhile.
+ * libxl_trace_write writes all the phases finished so far to path, as
+ * JSON in the Chrome trace event format (chrome://tracing can load it).
+ */
+int libxl_trace_enable(libxl_ctx *ctx);
+int libxl_trace_write(libxl_ctx *ctx, const char *path);
+
 /* domain related functions */
 
 /* If the result is ERROR_ABORTED, the domain may or may not exist
@@ -1313,6 +1509,20 @@ int libxl_domain_create_restore(libxl_ctx *ctx, libxl_domain_config *d_config,
                                 const libxl_asyncprogress_how *aop_console_how)
                                 LIBXL_EXTERNAL_CALLERS_ONLY;
 
+/*
+ * Creates the nr domains described by d_configs[] as with
+ * libxl_domain_create_new, running at most max_parallel of the
+ * creations at a time (all of them if max_parallel is 0).  domids[i]
+ * is set as by libxl_domain_create_new and, if rcs is not NULL, rcs[i]
+ * to the result of creating d_configs[i].  The operation completes once
+ * all of them are done, with the first error encountered if any.
+ */
+int libxl_domain_create_many(libxl_ctx *ctx, libxl_domain_config *d_configs,
+                             int nr, int max_parallel,
+                             uint32_t *domids, int *rcs,
+                             const libxl_asyncop_how *ao_how)
+                             LIBXL_EXTERNAL_CALLERS_ONLY;
+
 #if defined(LIBXL_API_VERSION) && LIBXL_API_VERSION < 0x040400
 
 static inline int libxl_domain_create_restore_0x040200(
@@ -1387,6 +1597,20 @@ int libxl_domain_suspend(libxl_ctx *ctx, uint32_t domid, int fd,
 #define LIBXL_SUSPEND_DEBUG 1
 #define LIBXL_SUSPEND_LIVE 2
 
+/*
+ * Like libxl_domain_suspend, for domids[i] saved to fds[i], with at most
+ * max_parallel (0: no limit) saves in progress at once.  Each domain's
+ * result goes to rcs[i] (if rcs is non-NULL); the first failure, if any,
+ * is returned.  With LIBXL_SUSPEND_LIVE the domains keep running while
+ * most of their memory is written out, as for live migration.
+ */
+int libxl_domain_suspend_many(libxl_ctx *ctx, const uint32_t *domids,
+                              const int *fds, int nr,
+                              int flags, /* LIBXL_SUSPEND_* */
+                              int max_parallel, int *rcs,
+                              const libxl_asyncop_how *ao_how)
+                              LIBXL_EXTERNAL_CALLERS_ONLY;
+
 /* @param suspend_cancel [from xenctrl.h:xc_domain_resume( @param fast )]
  *   If this parameter is true, use co-operative resume. The guest
  *   must support this.
@@ -1410,6 +1634,19 @@ int libxl_domain_reboot(libxl_ctx *ctx, uint32_t domid);
 int libxl_domain_destroy(libxl_ctx *ctx, uint32_t domid,
                          const libxl_asyncop_how *ao_how)
                          LIBXL_EXTERNAL_CALLERS_ONLY;
+/* Like libxl_domain_create_many, for libxl_domain_destroy. */
+int libxl_domain_destroy_many(libxl_ctx *ctx, const uint32_t *domids,
+                              int nr, int max_parallel, int *rcs,
+                              const libxl_asyncop_how *ao_how)
+                              LIBXL_EXTERNAL_CALLERS_ONLY;
+/*
+ * How much of the memory a domain owned when its destruction began it still
+ * owns. Both are 0 if destruction hasn't started yet. Returns
+ * ERROR_DOMAIN_NOTFOUND once the domain is gone.
+ */
+int libxl_domain_destroy_progress(libxl_ctx *ctx, uint32_t domid,
+                                  uint64_t *total_memkb,
+                                  uint64_t *remaining_memkb);
 int libxl_domain_preserve(libxl_ctx *ctx, uint32_t domid, libxl_domain_create_info *info, const char *name_suffix, libxl_uuid new_uuid);
 
 /* get max. number of cpus supported by hypervisor */
@@ -1485,6 +1722,16 @@ int libxl_wait_for_free_memory(libxl_ctx *ctx, uint32_t domid, uint64_t memory_k
  * time for the guest to reach its target as an argument.
  */
 int libxl_wait_for_memory_target(libxl_ctx *ctx, uint32_t domid, int wait_secs);
+/*
+ * Wait for memory_kb to be free in the system without sleeping, giving up
+ * with ERROR_NOMEM once domid (typically dom0, being ballooned down) has
+ * made no progress towards its target for wait_secs.  Completes as soon as
+ * enough memory is free, even if domid has not reached its target yet.
+ */
+int libxl_wait_for_memory_available(libxl_ctx *ctx, uint32_t domid,
+                                    uint64_t memory_kb, int wait_secs,
+                                    const libxl_asyncop_how *ao_how)
+                                    LIBXL_EXTERNAL_CALLERS_ONLY;
 
 #if defined(LIBXL_API_VERSION) && LIBXL_API_VERSION < 0x040800
 #define libxl_get_memory_target libxl_get_memory_target_0x040700
@@ -1580,6 +1827,23 @@ libxl_vcpuinfo *libxl_list_vcpu(libxl_ctx *ctx, uint32_t domid,
                                 int *nb_vcpu, int *nr_cpus_out);
 void libxl_vcpuinfo_list_free(libxl_vcpuinfo *, int nr_vcpus);
 
+/*
+ * Returns the per-port event channel statistics of all ports of domid in
+ * use, and the domain's totals (with port 0) in *totals.  Fails with
+ * ERROR_NI if Xen isn't maintaining statistics.
+ */
+int libxl_evtchn_stats_list(libxl_ctx *ctx, uint32_t domid,
+                            libxl_evtchn_stats *totals,
+                            libxl_evtchn_stats **list_r, int *nr_r);
+void libxl_evtchn_stats_list_free(libxl_evtchn_stats *, int nr);
+
+/*
+ * Returns the interrupt delivery statistics of domid, summed over its
+ * vcpus.  Fails with ERROR_INVAL if domid is not an HVM domain.
+ */
+int libxl_domain_irq_stats(libxl_ctx *ctx, uint32_t domid,
+                           libxl_irq_stats *stats);
+
 void libxl_device_vtpm_list_free(libxl_device_vtpm*, int nr_vtpms);
 void libxl_vtpminfo_list_free(libxl_vtpminfo *, int nr_vtpms);
 
@@ -2025,6 +2289,17 @@ int libxl_domain_set_nodeaffinity(libxl_ctx *ctx, uint32_t domid,
                                   libxl_bitmap *nodemap);
 int libxl_domain_get_nodeaffinity(libxl_ctx *ctx, uint32_t domid,
                                   libxl_bitmap *nodemap);
+/*
+ * Automatic NUMA balancing, HVM domains only: Xen samples which memory the
+ * domain accesses, and moves the soft affinity of all its vcpus to the node
+ * holding most of it, overriding the soft affinity set otherwise.  Fails
+ * with ERROR_NI where the hardware doesn't allow for the sampling.  node is
+ * the node the vcpus were steered to, -1 if none yet.
+ */
+int libxl_domain_set_numa_balancing(libxl_ctx *ctx, uint32_t domid,
+                                    bool enable);
+int libxl_domain_get_numa_balancing(libxl_ctx *ctx, uint32_t domid,
+                                    bool *enabled, int *node);
 int libxl_set_vcpuonline(libxl_ctx *ctx, uint32_t domid, libxl_bitmap *cpumap);
 
 /* A return value less than 0 should be interpreted as a libxl_error, while a
@@ -2042,6 +2317,13 @@ int libxl_sched_credit2_params_get(libxl_ctx *ctx, uint32_t poolid,
 int libxl_sched_credit2_params_set(libxl_ctx *ctx, uint32_t poolid,
                                    libxl_sched_credit2_params *scinfo);
 
+/* Which vcpu is assigned to each cpu of a cpupool using the null scheduler */
+libxl_sched_null_assignment *libxl_sched_null_assignment_list(libxl_ctx *ctx,
+                                                              uint32_t poolid,
+                                                              int *nb_out);
+void libxl_sched_null_assignment_list_free(libxl_sched_null_assignment *list,
+                                           int nb);
+
 /* Scheduler Per-domain parameters */
 
 #define LIBXL_DOMAIN_SCHED_PARAM_WEIGHT_DEFAULT    -1
@@ -2052,6 +2334,10 @@ int libxl_sched_credit2_params_set(libxl_ctx *ctx, uint32_t poolid,
 #define LIBXL_DOMAIN_SCHED_PARAM_EXTRATIME_DEFAULT -1
 #define LIBXL_DOMAIN_SCHED_PARAM_BUDGET_DEFAULT    -1
 
+/* Event channel priorities, 0 being the highest */
+#define LIBXL_EVTCHN_PRIORITY_DEFAULT -1
+#define LIBXL_EVTCHN_PRIORITY_MAX     15
+
 /* Per-VCPU parameters */
 #define LIBXL_SCHED_PARAM_VCPU_INDEX_DEFAULT   -1
 
@@ -2135,6 +2421,20 @@ int libxl_cpupool_cpuremove_node(libxl_ctx *ctx, uint32_t poolid, int node, int
 int libxl_cpupool_cpuremove_cpumap(libxl_ctx *ctx, uint32_t poolid,
                                    const libxl_bitmap *cpumap);
 int libxl_cpupool_movedomain(libxl_ctx *ctx, uint32_t poolid, uint32_t domid);
+/*
+ * Move the memory of HVM domain domid which lies outside the domain's NUMA
+ * node affinity, typically after libxl_cpupool_movedomain() to a pool on
+ * other nodes, onto nodes within it.  The domain keeps running, only being
+ * paused briefly for each chunk of its memory.  Pages mapped by other
+ * domains (e.g. a device model) stay where they are.  Progress gets
+ * reported through DOMAIN_MEMORY_REHOME_PROGRESS events, the last one once
+ * all of the memory was looked at.  Fails with ERROR_NOMEM when the nodes
+ * run out of memory, leaving the rest where it was.
+ */
+int libxl_domain_rehome_memory(libxl_ctx *ctx, uint32_t domid,
+                               const libxl_asyncop_how *ao_how,
+                               const libxl_asyncprogress_how *aop_progress_how)
+                               LIBXL_EXTERNAL_CALLERS_ONLY;
 int libxl_cpupool_info(libxl_ctx *ctx, libxl_cpupoolinfo *info, uint32_t poolid);
 
 int libxl_domid_valid_guest(uint32_t domid);
@@ -2205,6 +2505,26 @@ int libxl_psr_cat_get_l3_info(libxl_ctx *ctx, libxl_psr_cat_info **info,
 void libxl_psr_cat_info_list_free(libxl_psr_cat_info *list, int nr);
 #endif
 
+#ifdef LIBXL_HAVE_PSR_MBA
+/*
+ * Set a domain's memory bandwidth throttling, as a delay in %, on all the
+ * sockets in 'target_map'.  Xen rounds it down to what the hardware
+ * supports.
+ */
+int libxl_psr_mba_set_thrtl(libxl_ctx *ctx, uint32_t domid,
+                            libxl_bitmap *target_map, uint32_t thrtl);
+int libxl_psr_mba_get_thrtl(libxl_ctx *ctx, uint32_t domid,
+                            uint32_t target, uint32_t *thrtl_r);
+
+/*
+ * On success, the function returns an array of elements in 'info',
+ * and the length in 'nr'.
+ */
+int libxl_psr_mba_get_info(libxl_ctx *ctx, libxl_psr_mba_info **info,
+                           int *nr);
+void libxl_psr_mba_info_list_free(libxl_psr_mba_info *list, int nr);
+#endif
+
 /* misc */
 
 /* Each of these sets or clears the flag according to whether the
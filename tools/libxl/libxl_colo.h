@@ -71,6 +71,13 @@ struct libxl__colo_proxy_state {
     bool is_userspace_proxy;
     const char *checkpoint_host;
     const char *checkpoint_port;
+
+    /*
+     * Private.  Checkpoint requests are held back until min_interval_us
+     * after the last checkpoint, 0 for no limit.
+     */
+    uint64_t min_interval_us;
+    uint64_t last_checkpoint_us;
 };
 
 struct libxl__colo_save_state {
@@ -339,8 +339,61 @@ void colo_proxy_teardown(libxl__colo_proxy_state *cps)
 
 /* ========= colo-proxy: preresume, postresume and checkpoint ========== */
 
+static uint64_t colo_proxy_now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/*
+ * Consume the checkpoint requests already queued by the proxy, without
+ * waiting for more.  Returns how many there were.
+ */
+static int colo_proxy_drain(libxl__colo_proxy_state *cps)
+{
+    uint8_t buff[1024];
+    uint32_t len;
+    int n = 0;
+
+    for (;;) {
+        if (cps->is_userspace_proxy) {
+            /* Only take a message on once its length has fully arrived. */
+            if (recv(cps->sock_fd, &len, sizeof(len),
+                     MSG_DONTWAIT | MSG_PEEK) != sizeof(len))
+                break;
+            recv(cps->sock_fd, &len, sizeof(len), 0);
+            len = ntohl(len);
+            if (len > sizeof(buff) ||
+                recv(cps->sock_fd, buff, len, MSG_WAITALL) != len)
+                break;
+        } else if (recv(cps->sock_fd, buff, sizeof(buff), MSG_DONTWAIT) <= 0) {
+            break;
+        }
+        n++;
+    }
+
+    return n;
+}
+
 void colo_proxy_preresume(libxl__colo_proxy_state *cps)
 {
+    int stale;
+
+    STATE_AO_GC(cps->ao);
+
+    /*
+     * Whatever divergence got reported up to now is resolved by the
+     * checkpoint being taken, so drop the requests still queued rather
+     * than have each of them trigger another checkpoint.
+     */
+    stale = colo_proxy_drain(cps);
+    if (stale)
+        LOGD(DEBUG, ao->domid, "%d checkpoint requests merged", stale);
+    cps->last_checkpoint_us = colo_proxy_now_us();
+
     /*
      * If enable userspace proxy mode,
      * we don't need preresume kernel proxy
@@ -372,8 +425,8 @@ typedef struct colo_msg {
  *  0: no checkpoint event is received before timeout
  *  1: do checkpoint
  */
-int colo_proxy_checkpoint(libxl__colo_proxy_state *cps,
-                          unsigned int timeout_us)
+static int colo_proxy_wait_checkpoint(libxl__colo_proxy_state *cps,
+                                      unsigned int timeout_us)
 {
     uint8_t *buff = NULL;
     int64_t size;
@@ -436,3 +489,30 @@ out:
     free(buff);
     return ret;
 }
+
+/*
+ * As colo_proxy_wait_checkpoint(), but a request is only acted upon once at
+ * least min_interval_us passed since the last checkpoint.  Requests coming
+ * in meanwhile are merged into it.  The proxy keeps holding back the primary
+ * output until then, so this trades latency for fewer checkpoints when the
+ * guest's output keeps diverging, not consistency.
+ */
+int colo_proxy_checkpoint(libxl__colo_proxy_state *cps,
+                          unsigned int timeout_us)
+{
+    uint64_t now, deadline;
+    int ret;
+
+    ret = colo_proxy_wait_checkpoint(cps, timeout_us);
+    if (ret <= 0 || !cps->min_interval_us)
+        return ret;
+
+    deadline = cps->last_checkpoint_us + cps->min_interval_us;
+    while ((now = colo_proxy_now_us()) < deadline) {
+        ret = colo_proxy_wait_checkpoint(cps, deadline - now);
+        if (ret < 0)
+            return ret;
+    }
+
+    return 1;
+}
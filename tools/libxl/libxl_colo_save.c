@@ -104,6 +104,7 @@ void libxl__colo_save_setup(libxl__egc *egc, libxl__colo_save_state *css)
     libxl__ev_child_init(&css->child);
     css->cps.is_userspace_proxy =
         libxl_defbool_val(dss->remus->userspace_colo_proxy);
+    css->cps.min_interval_us = (uint64_t)dss->remus->interval * 1000;
 
     if (dss->remus->netbufscript)
         css->colo_proxy_script = libxl__strdup(gc, dss->remus->netbufscript);
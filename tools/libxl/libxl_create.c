@@ -42,6 +42,7 @@ int libxl__domain_create_info_setdefault(libxl__gc *gc,
 
     libxl_defbool_setdefault(&c_info->run_hotplug_scripts, true);
     libxl_defbool_setdefault(&c_info->driver_domain, false);
+    libxl_defbool_setdefault(&c_info->async_backends, false);
 
     if (!c_info->ssidref)
         c_info->ssidref = SECINITSID_DOMU;
@@ -193,6 +194,7 @@ int libxl__domain_build_info_setdefault(libxl__gc *gc,
     }
 
     libxl_defbool_setdefault(&b_info->numa_placement, true);
+    libxl_defbool_setdefault(&b_info->numa_balancing, false);
 
     if (b_info->max_memkb == LIBXL_MEMKB_DEFAULT)
         b_info->max_memkb = 32 * 1024;
@@ -200,6 +202,7 @@ int libxl__domain_build_info_setdefault(libxl__gc *gc,
         b_info->target_memkb = b_info->max_memkb;
 
     libxl_defbool_setdefault(&b_info->claim_mode, false);
+    libxl_defbool_setdefault(&b_info->superpages_strict, false);
 
     libxl_defbool_setdefault(&b_info->localtime, false);
 
@@ -318,6 +321,7 @@ int libxl__domain_build_info_setdefault(libxl__gc *gc,
         libxl_defbool_setdefault(&b_info->u.hvm.viridian,           false);
         libxl_defbool_setdefault(&b_info->u.hvm.hpet,               true);
         libxl_defbool_setdefault(&b_info->u.hvm.vpt_align,          true);
+        libxl_defbool_setdefault(&b_info->u.hvm.vpt_lazy,           false);
         libxl_defbool_setdefault(&b_info->u.hvm.nested_hvm,         false);
         libxl_defbool_setdefault(&b_info->u.hvm.altp2m,             false);
         libxl_defbool_setdefault(&b_info->u.hvm.usb,                false);
@@ -372,6 +376,9 @@ int libxl__domain_build_info_setdefault(libxl__gc *gc,
         libxl_defbool_setdefault(&b_info->u.hvm.gfx_passthru, false);
 
         libxl__rdm_setdefault(gc, b_info);
+
+        if (b_info->u.hvm.unshare_pool_memkb == LIBXL_MEMKB_DEFAULT)
+            b_info->u.hvm.unshare_pool_memkb = 0;
         break;
     case LIBXL_DOMAIN_TYPE_PV:
         libxl_defbool_setdefault(&b_info->u.pv.e820_host, false);
@@ -431,10 +438,13 @@ int libxl__domain_build(libxl__gc *gc,
     struct timeval start_time;
     int i, ret;
 
+    libxl__trace_span span = libxl__trace_begin(gc, domid, "build_pre");
+
     ret = libxl__build_pre(gc, domid, d_config, state);
     if (ret)
         goto out;
 
+    libxl__trace_next(gc, &span, domid, "build_image");
     gettimeofday(&start_time, NULL);
 
     switch (info->type) {
@@ -501,8 +511,10 @@ int libxl__domain_build(libxl__gc *gc,
         ret = ERROR_INVAL;
         goto out;
     }
+    libxl__trace_next(gc, &span, domid, "build_post");
     ret = libxl__build_post(gc, domid, info, state, vments, localents);
 out:
+    libxl__trace_end(gc, &span);
     return ret;
 }
 
@@ -750,6 +762,15 @@ static void domcreate_bootloader_done(libxl__egc *egc,
 
 static void domcreate_launch_dm(libxl__egc *egc, libxl__multidev *aodevs,
                                 int ret);
+static bool domcreate_can_launch_dm_early(const libxl_domain_config *d_config);
+static void domcreate_do_launch_dm(libxl__egc *egc,
+                                   libxl__domain_create_state *dcs);
+static void domcreate_early_disks_done(libxl__egc *egc,
+                                       libxl__multidev *multidev, int ret);
+static void domcreate_early_dm_join(libxl__egc *egc,
+                                    libxl__domain_create_state *dcs, int rc);
+static void domcreate_dm_ready(libxl__egc *egc,
+                               libxl__domain_create_state *dcs, int ret);
 
 static void domcreate_console_available(libxl__egc *egc,
                                         libxl__domain_create_state *dcs);
@@ -790,6 +811,10 @@ static void initiate_domain_create(libxl__egc *egc,
 
     domid = dcs->domid_soft_reset;
 
+    dcs->trace_create = libxl__trace_begin(gc, domid, "domain_create");
+    dcs->trace_phase = LIBXL__TRACE_NONE;
+    dcs->trace_dm = LIBXL__TRACE_NONE;
+
     if (d_config->c_info.ssid_label) {
         char *s = d_config->c_info.ssid_label;
         ret = libxl_flask_context_to_sid(ctx, s, strlen(s),
@@ -918,7 +943,10 @@ static void initiate_domain_create(libxl__egc *egc,
         goto error_out;
     }
 
+    libxl__trace_next(gc, &dcs->trace_phase, domid, "domain_make");
     ret = libxl__domain_make(gc, d_config, &domid, &state->config);
+    libxl__trace_set_domid(gc, dcs->trace_create, domid);
+    libxl__trace_set_domid(gc, dcs->trace_phase, domid);
     if (ret) {
         LOGD(ERROR, domid, "cannot make domain: %d", ret);
         dcs->guest_domid = domid;
@@ -963,6 +991,7 @@ static void initiate_domain_create(libxl__egc *egc,
         domcreate_bootloader_done(egc, &dcs->bl, 0);
     } else  {
         LOGD(DEBUG, domid, "running bootloader");
+        libxl__trace_next(gc, &dcs->trace_phase, domid, "bootloader");
         dcs->bl.callback = domcreate_bootloader_done;
         dcs->bl.console_available = domcreate_bootloader_console_available;
         dcs->bl.info = &d_config->b_info;
@@ -1052,6 +1081,7 @@ static void domcreate_bootloader_done(libxl__egc *egc,
     dcs->sdss.callback = domcreate_devmodel_started;
 
     if (restore_fd < 0 && dcs->domid_soft_reset == INVALID_DOMID) {
+        libxl__trace_next(gc, &dcs->trace_phase, domid, "build");
         rc = libxl__domain_build(gc, d_config, domid, state);
         domcreate_rebuild_done(egc, dcs, rc);
         return;
@@ -1075,6 +1105,7 @@ static void domcreate_bootloader_done(libxl__egc *egc,
         goto out;
     }
 
+    libxl__trace_next(gc, &dcs->trace_phase, domid, "restore");
     rc = libxl__build_pre(gc, domid, d_config, state);
     if (rc)
         goto out;
@@ -1221,11 +1252,22 @@ static void domcreate_rebuild_done(libxl__egc *egc,
 
     store_libxl_entry(gc, domid, &d_config->b_info);
 
+    libxl__trace_next(gc, &dcs->trace_phase, domid, "disks");
+    dcs->early_dm = domcreate_can_launch_dm_early(d_config);
+    dcs->early_dm_pending = dcs->early_dm ? 2 : 0;
+    dcs->early_dm_rc = 0;
+
     libxl__multidev_begin(ao, &dcs->multidev);
-    dcs->multidev.callback = domcreate_launch_dm;
+    dcs->multidev.callback = dcs->early_dm ? domcreate_early_disks_done
+                                           : domcreate_launch_dm;
+    dcs->multidev.skip_backend_wait =
+        libxl_defbool_val(d_config->c_info.async_backends);
     libxl__add_disks(egc, ao, domid, d_config, &dcs->multidev);
     libxl__multidev_prepared(egc, &dcs->multidev, 0);
 
+    if (dcs->early_dm)
+        domcreate_do_launch_dm(egc, dcs);
+
     return;
 
  error_out:
@@ -1233,22 +1275,91 @@ static void domcreate_rebuild_done(libxl__egc *egc,
     domcreate_complete(egc, dcs, ret);
 }
 
+/*
+ * Whether the device model can be spawned while the disks are being added:
+ * only if its command line does not depend on the outcome of adding them,
+ * that is, if every disk can be opened by qemu from its configured path.
+ */
+static bool domcreate_can_launch_dm_early(const libxl_domain_config *d_config)
+{
+    const libxl_domain_build_info *b_info = &d_config->b_info;
+    int i;
+
+    if (d_config->c_info.type != LIBXL_DOMAIN_TYPE_HVM ||
+        b_info->device_model_version != LIBXL_DEVICE_MODEL_VERSION_QEMU_XEN ||
+        libxl_defbool_val(b_info->device_model_stubdomain))
+        return false;
+
+    for (i = 0; i < d_config->num_disks; i++) {
+        const libxl_device_disk *disk = &d_config->disks[i];
+
+        if (disk->backend_domname || disk->script ||
+            disk->backend == LIBXL_DISK_BACKEND_TAP ||
+            libxl_defbool_val(disk->colo_enable))
+            return false;
+        if (disk->format != LIBXL_DISK_FORMAT_RAW &&
+            disk->backend != LIBXL_DISK_BACKEND_QDISK)
+            return false;
+    }
+
+    return true;
+}
+
+static void domcreate_early_disks_done(libxl__egc *egc,
+                                       libxl__multidev *multidev, int ret)
+{
+    libxl__domain_create_state *dcs = CONTAINER_OF(multidev, *dcs, multidev);
+    STATE_AO_GC(dcs->ao);
+
+    libxl__trace_end(gc, &dcs->trace_phase);
+    if (ret)
+        LOGD(ERROR, dcs->guest_domid, "unable to add disk devices");
+
+    domcreate_early_dm_join(egc, dcs, ret);
+}
+
+/* Called once for the disks and once for the device model. */
+static void domcreate_early_dm_join(libxl__egc *egc,
+                                    libxl__domain_create_state *dcs, int rc)
+{
+    assert(dcs->early_dm_pending > 0);
+
+    if (rc && !dcs->early_dm_rc)
+        dcs->early_dm_rc = rc;
+    if (--dcs->early_dm_pending)
+        return;
+
+    domcreate_dm_ready(egc, dcs, dcs->early_dm_rc);
+}
+
 static void domcreate_launch_dm(libxl__egc *egc, libxl__multidev *multidev,
                                 int ret)
 {
     libxl__domain_create_state *dcs = CONTAINER_OF(multidev, *dcs, multidev);
     STATE_AO_GC(dcs->ao);
-    int i;
+
+    libxl__trace_end(gc, &dcs->trace_phase);
+    if (ret) {
+        LOGD(ERROR, dcs->guest_domid, "unable to add disk devices");
+        domcreate_complete(egc, dcs, ret);
+        return;
+    }
+
+    domcreate_do_launch_dm(egc, dcs);
+}
+
+static void domcreate_do_launch_dm(libxl__egc *egc,
+                                   libxl__domain_create_state *dcs)
+{
+    STATE_AO_GC(dcs->ao);
+    int i, ret;
 
     /* convenience aliases */
     const uint32_t domid = dcs->guest_domid;
     libxl_domain_config *const d_config = dcs->guest_config;
     libxl__domain_build_state *const state = &dcs->build_state;
 
-    if (ret) {
-        LOGD(ERROR, domid, "unable to add disk devices");
-        goto error_out;
-    }
+    dcs->trace_dm = libxl__trace_begin(gc, domid, "device_model");
 
     for (i = 0; i < d_config->b_info.num_ioports; i++) {
         libxl_ioport_range *io = &d_config->b_info.ioports[i];
@@ -1360,6 +1471,12 @@ static void domcreate_launch_dm(libxl__egc *egc, libxl__multidev *multidev,
          * the VGA framebuffer.
          */
         ret = libxl__grant_vga_iomem_permission(gc, domid, d_config);
+        if ( ret && dcs->early_dm ) {
+            /* The device model still has to report to the join. */
+            if (!dcs->early_dm_rc)
+                dcs->early_dm_rc = ret;
+            return;
+        }
         if ( ret )
             goto error_out;
 
@@ -1401,7 +1518,10 @@ static void domcreate_launch_dm(libxl__egc *egc, libxl__multidev *multidev,
 
  error_out:
     assert(ret);
-    domcreate_complete(egc, dcs, ret);
+    if (dcs->early_dm)
+        domcreate_early_dm_join(egc, dcs, ret);
+    else
+        domcreate_complete(egc, dcs, ret);
 }
 
 static void libxl__add_dtdevs(libxl__egc *egc, libxl__ao *ao, uint32_t domid,
@@ -1454,24 +1574,31 @@ static void domcreate_attach_devices(libxl__egc *egc,
     const struct libxl_device_type *dt;
 
     if (ret) {
-        LOGD(ERROR, domid, "unable to add %s devices",
-             device_type_tbl[dcs->device_type_idx]->type);
+        LOGD(ERROR, domid, "unable to add devices");
         goto error_out;
     }
 
     dcs->device_type_idx++;
     dt = device_type_tbl[dcs->device_type_idx];
     if (dt) {
-        if (*libxl__device_type_get_num(dt, d_config) > 0 && !dt->skip_attach) {
-            /* Attach devices */
-            libxl__multidev_begin(ao, &dcs->multidev);
-            dcs->multidev.callback = domcreate_attach_devices;
-            dt->add(egc, ao, domid, d_config, &dcs->multidev);
-            libxl__multidev_prepared(egc, &dcs->multidev, 0);
-            return;
+        /*
+         * Attach devices of this and all following types in one go, up
+         * to the next type which needs the earlier ones to be in place.
+         */
+        libxl__multidev_begin(ao, &dcs->multidev);
+        dcs->multidev.callback = domcreate_attach_devices;
+        dcs->multidev.skip_backend_wait =
+            libxl_defbool_val(d_config->c_info.async_backends);
+        for (;;) {
+            if (*libxl__device_type_get_num(dt, d_config) > 0 &&
+                !dt->skip_attach)
+                dt->add(egc, ao, domid, d_config, &dcs->multidev);
+            dt = device_type_tbl[dcs->device_type_idx + 1];
+            if (!dt || dt->attach_after_prev)
+                break;
+            dcs->device_type_idx++;
         }
-
-        domcreate_attach_devices(egc, &dcs->multidev, 0);
+        libxl__multidev_prepared(egc, &dcs->multidev, 0);
         return;
     }
 
@@ -1492,15 +1619,28 @@ static void domcreate_devmodel_started(libxl__egc *egc,
 {
     libxl__domain_create_state *dcs = CONTAINER_OF(dmss, *dcs, sdss.dm);
     STATE_AO_GC(dmss->spawn.ao);
+
+    libxl__trace_end(gc, &dcs->trace_dm);
+    if (ret)
+        LOGD(ERROR, dcs->guest_domid, "device model did not start: %d", ret);
+
+    if (dcs->early_dm)
+        domcreate_early_dm_join(egc, dcs, ret);
+    else
+        domcreate_dm_ready(egc, dcs, ret);
+}
+
+static void domcreate_dm_ready(libxl__egc *egc,
+                               libxl__domain_create_state *dcs, int ret)
+{
+    STATE_AO_GC(dcs->ao);
     int domid = dcs->guest_domid;
 
     /* convenience aliases */
     libxl_domain_config *const d_config = dcs->guest_config;
 
-    if (ret) {
-        LOGD(ERROR, domid, "device model did not start: %d", ret);
+    if (ret)
         goto error_out;
-    }
 
     if (dcs->sdss.dm.guest_domid) {
         if (d_config->b_info.device_model_version
@@ -1509,6 +1649,7 @@ static void domcreate_devmodel_started(libxl__egc *egc,
         }
     }
 
+    libxl__trace_next(gc, &dcs->trace_phase, domid, "devices");
     dcs->device_type_idx = -1;
     domcreate_attach_devices(egc, &dcs->multidev, 0);
     return;
@@ -1526,6 +1667,10 @@ static void domcreate_complete(libxl__egc *egc,
     libxl_domain_config *const d_config = dcs->guest_config;
     libxl_domain_config *d_config_saved = &dcs->guest_config_saved;
 
+    libxl__trace_end(gc, &dcs->trace_phase);
+    libxl__trace_end(gc, &dcs->trace_dm);
+    libxl__trace_end(gc, &dcs->trace_create);
+
     libxl__file_reference_unmap(&dcs->build_state.pv_kernel);
     libxl__file_reference_unmap(&dcs->build_state.pv_ramdisk);
 
@@ -1881,6 +2026,122 @@ int libxl_domain_soft_reset(libxl_ctx *ctx,
                                 aop_console_how);
 }
 
+/*----- creating many domains within one ao -----*/
+
+typedef struct libxl__domain_create_many_state
+    libxl__domain_create_many_state;
+
+typedef struct {
+    libxl__domain_create_state dcs;
+    libxl__domain_create_many_state *dcms;
+    int idx;
+} libxl__domain_create_many_entry;
+
+struct libxl__domain_create_many_state {
+    libxl__ao *ao;
+    libxl_domain_config *d_configs;
+    uint32_t *domids;
+    int *rcs;
+    int nr, max_parallel;
+    int next, running;
+    bool in_next;
+    int rc;
+    libxl__domain_create_many_entry *entries;
+};
+
+static void domain_create_many_cb(libxl__egc *egc,
+                                  libxl__domain_create_state *dcs,
+                                  int rc, uint32_t domid);
+
+static void domain_create_many_next(libxl__egc *egc,
+                                    libxl__domain_create_many_state *dcms)
+{
+    STATE_AO_GC(dcms->ao);
+
+    /*
+     * A creation may complete, and call us again, before returning: leave
+     * starting the rest, and completing the ao, to the outermost call.
+     */
+    if (dcms->in_next)
+        return;
+    dcms->in_next = true;
+
+    while (dcms->next < dcms->nr &&
+           (!dcms->max_parallel || dcms->running < dcms->max_parallel)) {
+        libxl__domain_create_many_entry *e = &dcms->entries[dcms->next];
+        libxl_domain_config *d_config = &dcms->d_configs[dcms->next];
+
+        e->dcms = dcms;
+        e->idx = dcms->next++;
+        dcms->running++;
+
+        unset_disk_colo_restore(d_config);
+        e->dcs.ao = ao;
+        e->dcs.guest_config = d_config;
+        libxl_domain_config_init(&e->dcs.guest_config_saved);
+        libxl_domain_config_copy(CTX, &e->dcs.guest_config_saved, d_config);
+        e->dcs.restore_fd = e->dcs.libxc_fd = -1;
+        e->dcs.send_back_fd = -1;
+        e->dcs.callback = domain_create_many_cb;
+        e->dcs.domid_soft_reset = INVALID_DOMID;
+        e->dcs.colo_proxy_script = NULL;
+        e->dcs.crs.cps.is_userspace_proxy = false;
+        libxl__ao_progress_gethow(&e->dcs.aop_console_how, NULL);
+
+        initiate_domain_create(egc, &e->dcs);
+    }
+
+    dcms->in_next = false;
+    if (!dcms->running && dcms->next == dcms->nr)
+        libxl__ao_complete(egc, ao, dcms->rc);
+}
+
+static void domain_create_many_cb(libxl__egc *egc,
+                                  libxl__domain_create_state *dcs,
+                                  int rc, uint32_t domid)
+{
+    libxl__domain_create_many_entry *e = CONTAINER_OF(dcs, *e, dcs);
+    libxl__domain_create_many_state *dcms = e->dcms;
+
+    dcms->domids[e->idx] = domid;
+    if (dcms->rcs)
+        dcms->rcs[e->idx] = rc;
+    if (rc && !dcms->rc)
+        dcms->rc = rc;
+    dcms->running--;
+
+    domain_create_many_next(egc, dcms);
+}
+
+int libxl_domain_create_many(libxl_ctx *ctx, libxl_domain_config *d_configs,
+                             int nr, int max_parallel,
+                             uint32_t *domids, int *rcs,
+                             const libxl_asyncop_how *ao_how)
+{
+    AO_CREATE(ctx, 0, ao_how);
+    libxl__domain_create_many_state *dcms;
+    int i;
+
+    if (nr <= 0 || max_parallel < 0)
+        return AO_CREATE_FAIL(ERROR_INVAL);
+
+    GCNEW(dcms);
+    dcms->ao = ao;
+    dcms->d_configs = d_configs;
+    dcms->domids = domids;
+    dcms->rcs = rcs;
+    dcms->nr = nr;
+    dcms->max_parallel = max_parallel;
+    GCNEW_ARRAY(dcms->entries, nr);
+
+    for (i = 0; i < nr; i++)
+        domids[i] = INVALID_DOMID;
+
+    domain_create_many_next(egc, dcms);
+
+    return AO_INPROGRESS;
+}
+
 /*
  * Local variables:
  * mode: C
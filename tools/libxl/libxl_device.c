@@ -600,6 +600,7 @@ void libxl__prepare_ao_device(libxl__ao *ao, libxl__ao_device *aodev)
     aodev->rc = 0;
     aodev->dev = NULL;
     aodev->num_exec = 0;
+    aodev->skip_backend_wait = false;
     /* Initialize timer for QEMU Bodge */
     libxl__ev_time_init(&aodev->timeout);
     /*
@@ -623,6 +624,7 @@ void libxl__multidev_begin(libxl__ao *ao, libxl__multidev *multidev)
     multidev->ao = ao;
     multidev->array = 0;
     multidev->used = multidev->allocd = 0;
+    multidev->skip_backend_wait = false;
 
     /* We allocate an aodev to represent the operation of preparing
      * all of the other operations.  This operation is completed when
@@ -645,6 +647,7 @@ void libxl__multidev_prepare_with_aodev(libxl__multidev *multidev,
     aodev->multidev = multidev;
     aodev->callback = libxl__multidev_one_callback;
     libxl__prepare_ao_device(ao, aodev);
+    aodev->skip_backend_wait = multidev->skip_backend_wait;
 
     if (multidev->used >= multidev->allocd) {
         multidev->allocd = multidev->used * 2 + 5;
@@ -867,6 +870,7 @@ void libxl__wait_device_connection(libxl__egc *egc, libxl__ao_device *aodev)
     STATE_AO_GC(aodev->ao);
     char *be_path = libxl__device_backend_path(gc, aodev->dev);
     char *state_path = GCSPRINTF("%s/state", be_path);
+    uint32_t domid;
     int rc = 0;
 
     if (QEMU_BACKEND(aodev->dev)) {
@@ -881,6 +885,21 @@ void libxl__wait_device_connection(libxl__egc *egc, libxl__ao_device *aodev)
         return;
     }
 
+    /*
+     * We never run hotplug scripts for backends in a driver domain, so
+     * waiting for them is only useful to report errors early.  The
+     * frontend will wait for the backend anyway.
+     */
+    if (aodev->skip_backend_wait &&
+        aodev->action == LIBXL__DEVICE_ACTION_ADD &&
+        !libxl__get_domid(gc, &domid) &&
+        aodev->dev->backend_domid != domid) {
+        LOGD(DEBUG, aodev->dev->domid,
+             "Not waiting for backend %s in driver domain", be_path);
+        device_hotplug_done(egc, aodev);
+        return;
+    }
+
     rc = libxl__ev_devstate_wait(ao, &aodev->backend_ds,
                                  device_backend_callback,
                                  state_path, XenbusStateInitWait,
@@ -238,6 +238,13 @@ static int hvm_set_viridian_features(libxl__gc *gc, uint32_t domid,
         goto err;
     }
 
+    /* Synthetic timers count in partition reference time */
+    if (libxl_bitmap_test(&enlightenments, LIBXL_VIRIDIAN_ENLIGHTENMENT_STIMER) &&
+        !libxl_bitmap_test(&enlightenments, LIBXL_VIRIDIAN_ENLIGHTENMENT_TIME_REF_COUNT)) {
+        LOG(ERROR, "stimer group requires time_ref_count group");
+        goto err;
+    }
+
     libxl_for_each_set_bit(v, enlightenments)
         LOG(DETAIL, "%s group enabled", libxl_viridian_enlightenment_to_string(v));
 
@@ -263,6 +270,18 @@ static int hvm_set_viridian_features(libxl__gc *gc, uint32_t domid,
     if (libxl_bitmap_test(&enlightenments, LIBXL_VIRIDIAN_ENLIGHTENMENT_CRASH_CTL))
         mask |= HVMPV_crash_ctl;
 
+    if (libxl_bitmap_test(&enlightenments, LIBXL_VIRIDIAN_ENLIGHTENMENT_HCALL_IPI))
+        mask |= HVMPV_hcall_ipi;
+
+    if (libxl_bitmap_test(&enlightenments, LIBXL_VIRIDIAN_ENLIGHTENMENT_EX_PROCESSOR_MASKS))
+        mask |= HVMPV_ex_processor_masks;
+
+    if (libxl_bitmap_test(&enlightenments, LIBXL_VIRIDIAN_ENLIGHTENMENT_SYNIC))
+        mask |= HVMPV_synic;
+
+    if (libxl_bitmap_test(&enlightenments, LIBXL_VIRIDIAN_ENLIGHTENMENT_STIMER))
+        mask |= HVMPV_stimer;
+
     if (mask != 0 &&
         xc_hvm_param_set(CTX->xch,
                          domid,
@@ -293,10 +312,51 @@ static void hvm_set_conf_params(xc_interface *handle, uint32_t domid,
     xc_hvm_param_set(handle, domid, HVM_PARAM_TIMER_MODE, timer_mode(info));
     xc_hvm_param_set(handle, domid, HVM_PARAM_VPT_ALIGN,
                     libxl_defbool_val(info->u.hvm.vpt_align));
+    xc_hvm_param_set(handle, domid, HVM_PARAM_VPT_LAZY,
+                    libxl_defbool_val(info->u.hvm.vpt_lazy));
     xc_hvm_param_set(handle, domid, HVM_PARAM_NESTEDHVM,
                     libxl_defbool_val(info->u.hvm.nested_hvm));
 }
 
+static int set_evtchn_priority(libxl__gc *gc, uint32_t domid,
+                               const libxl_evtchn_priority *prio)
+{
+    const int classes[XEN_DOMCTL_EVTCHN_CLASS_NR] = {
+        [XEN_DOMCTL_EVTCHN_CLASS_TIMER]       = prio->timer,
+        [XEN_DOMCTL_EVTCHN_CLASS_VIRQ]        = prio->virq,
+        [XEN_DOMCTL_EVTCHN_CLASS_IPI]         = prio->ipi,
+        [XEN_DOMCTL_EVTCHN_CLASS_PIRQ]        = prio->pirq,
+        [XEN_DOMCTL_EVTCHN_CLASS_INTERDOMAIN] = prio->interdomain,
+    };
+    uint8_t priority[XEN_DOMCTL_EVTCHN_CLASS_NR];
+    bool set = false;
+    int i;
+
+    for (i = 0; i < XEN_DOMCTL_EVTCHN_CLASS_NR; i++) {
+        if (classes[i] == LIBXL_EVTCHN_PRIORITY_DEFAULT) {
+            priority[i] = EVTCHN_FIFO_PRIORITY_DEFAULT;
+            continue;
+        }
+        if (classes[i] < 0 || classes[i] > LIBXL_EVTCHN_PRIORITY_MAX) {
+            LOG(ERROR, "Invalid event channel priority %d", classes[i]);
+            return ERROR_INVAL;
+        }
+        priority[i] = classes[i];
+        set = true;
+    }
+
+    /* Leave hypervisors without per-domain priorities alone. */
+    if (!set)
+        return 0;
+
+    if (xc_domain_set_evtchn_priority(CTX->xch, domid, priority)) {
+        LOGE(ERROR, "Failed to set event channel priorities");
+        return ERROR_FAIL;
+    }
+
+    return 0;
+}
+
 int libxl__build_pre(libxl__gc *gc, uint32_t domid,
               libxl_domain_config *d_config, libxl__domain_build_state *state)
 {
@@ -431,6 +491,11 @@ int libxl__build_pre(libxl__gc *gc, uint32_t domid,
     state->console_domid = con_domid ? atoi(con_domid) : 0;
     free(con_domid);
 
+    /* Before binding any port, so the store and console ones get theirs. */
+    rc = set_evtchn_priority(gc, domid, &info->evtchn_priority);
+    if (rc)
+        return rc;
+
     state->store_port = xc_evtchn_alloc_unbound(ctx->xch, domid, state->store_domid);
     state->console_port = xc_evtchn_alloc_unbound(ctx->xch, domid, state->console_domid);
 
@@ -441,6 +506,11 @@ int libxl__build_pre(libxl__gc *gc, uint32_t domid,
         if (rc)
             return rc;
 #endif
+        if (libxl_defbool_val(info->numa_balancing)) {
+            rc = libxl_domain_set_numa_balancing(ctx, domid, true);
+            if (rc)
+                return rc;
+        }
     }
 
     /* Alternate p2m support on x86 is available only for HVM guests. */
@@ -640,18 +710,23 @@ static int libxl__build_dom(libxl__gc *gc, uint32_t domid,
              struct xc_dom_image *dom)
 {
     uint64_t mem_kb;
+    unsigned int i;
     int ret;
+    libxl__trace_span span = LIBXL__TRACE_NONE;
 
+    libxl__trace_next(gc, &span, domid, "xc_dom_boot_xen_init");
     if ( (ret = xc_dom_boot_xen_init(dom, CTX->xch, domid)) != 0 ) {
         LOGE(ERROR, "xc_dom_boot_xen_init failed");
         goto out;
     }
 #ifdef GUEST_RAM_BASE
+    libxl__trace_next(gc, &span, domid, "xc_dom_rambase_init");
     if ( (ret = xc_dom_rambase_init(dom, GUEST_RAM_BASE)) != 0 ) {
         LOGE(ERROR, "xc_dom_rambase failed");
         goto out;
     }
 #endif
+    libxl__trace_next(gc, &span, domid, "xc_dom_parse_image");
     if ( (ret = xc_dom_parse_image(dom)) != 0 ) {
         LOGE(ERROR, "xc_dom_parse_image failed");
         goto out;
@@ -663,32 +738,45 @@ static int libxl__build_dom(libxl__gc *gc, uint32_t domid,
 
     mem_kb = dom->container_type == XC_DOM_HVM_CONTAINER ?
              (info->max_memkb - info->video_memkb) : info->target_memkb;
+    libxl__trace_next(gc, &span, domid, "xc_dom_mem_init");
     if ( (ret = xc_dom_mem_init(dom, mem_kb / 1024)) != 0 ) {
         LOGE(ERROR, "xc_dom_mem_init failed");
         goto out;
     }
+    libxl__trace_next(gc, &span, domid, "xc_dom_boot_mem_init");
     if ( (ret = xc_dom_boot_mem_init(dom)) != 0 ) {
         LOGE(ERROR, "xc_dom_boot_mem_init failed");
         goto out;
     }
+    for (i = 0; i < dom->nr_populate_stats; i++) {
+        const struct xc_dom_populate_stats *st = &dom->populate_stats[i];
+
+        LOGD(DEBUG, domid, "vnode %u (pnode %d) mapped by %"PRIpfn" 1GB, "
+             "%"PRIpfn" 2MB and %"PRIpfn" 4KB pages",
+             st->vnode, (int)st->pnode, st->nr_1g, st->nr_2m, st->nr_4k);
+    }
     if ( (ret = libxl__arch_domain_finalise_hw_description(gc, info, dom)) != 0 ) {
         LOGE(ERROR, "libxl__arch_domain_finalise_hw_description failed");
         goto out;
     }
+    libxl__trace_next(gc, &span, domid, "xc_dom_build_image");
     if ( (ret = xc_dom_build_image(dom)) != 0 ) {
         LOGE(ERROR, "xc_dom_build_image failed");
         goto out;
     }
+    libxl__trace_next(gc, &span, domid, "xc_dom_boot_image");
     if ( (ret = xc_dom_boot_image(dom)) != 0 ) {
         LOGE(ERROR, "xc_dom_boot_image failed");
         goto out;
     }
+    libxl__trace_next(gc, &span, domid, "xc_dom_gnttab_init");
     if ( (ret = xc_dom_gnttab_init(dom)) != 0 ) {
         LOGE(ERROR, "xc_dom_gnttab_init failed");
         goto out;
     }
 
 out:
+    libxl__trace_end(gc, &span);
     return ret != 0 ? ERROR_FAIL : 0;
 }
 
@@ -721,6 +809,8 @@ int libxl__build_pv(libxl__gc *gc, uint32_t domid,
             goto out;
         }
     } else {
+        if (xc_dom_kernel_cache(dom, LIBXL_KERNEL_CACHE_DIR))
+            LOGE(DEBUG, "xc_dom_kernel_cache failed, not caching kernel");
         ret = xc_dom_kernel_file(dom, state->pv_kernel.path);
         if ( ret != 0) {
             LOGE(ERROR, "xc_dom_kernel_file failed");
@@ -965,6 +1055,8 @@ static int libxl__domain_firmware(libxl__gc *gc,
     if (info->kernel != NULL &&
         info->device_model_version == LIBXL_DEVICE_MODEL_VERSION_NONE) {
         /* Try to load a kernel instead of the firmware. */
+        if (xc_dom_kernel_cache(dom, LIBXL_KERNEL_CACHE_DIR))
+            LOGE(DEBUG, "xc_dom_kernel_cache failed, not caching kernel");
         rc = xc_dom_kernel_file(dom, info->kernel);
         if (rc == 0 && info->ramdisk != NULL)
             rc = xc_dom_ramdisk_file(dom, info->ramdisk);
@@ -1083,6 +1175,7 @@ int libxl__build_hvm(libxl__gc *gc, uint32_t domid,
     mem_size = (uint64_t)(info->max_memkb - info->video_memkb) << 10;
     dom->target_pages = (uint64_t)(info->target_memkb - info->video_memkb) >> 2;
     dom->claim_enabled = libxl_defbool_val(info->claim_mode);
+    dom->superpages_strict = libxl_defbool_val(info->superpages_strict);
     if (info->u.hvm.mmio_hole_memkb) {
         uint64_t max_ram_below_4g = (1ULL << 32) -
             (info->u.hvm.mmio_hole_memkb << 10);
@@ -396,6 +396,8 @@ void libxl__domain_save(libxl__egc *egc, libxl__domain_save_state *dss)
     if (dss->checkpointed_stream == LIBXL_CHECKPOINTED_STREAM_REMUS) {
         if (libxl_defbool_val(r_info->compression))
             dss->xcflags |= XCFLAGS_CHECKPOINT_COMPRESS;
+        if (libxl_defbool_val(r_info->async_checkpoint))
+            dss->xcflags |= XCFLAGS_CHECKPOINT_ASYNC;
     }
 
     if (dss->checkpointed_stream == LIBXL_CHECKPOINTED_STREAM_NONE)
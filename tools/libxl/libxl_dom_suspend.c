@@ -34,6 +34,7 @@ int libxl__domain_suspend_init(libxl__egc *egc,
     libxl__ev_evtchn_init(&dsps->guest_evtchn);
     libxl__ev_xswatch_init(&dsps->guest_watch);
     libxl__ev_time_init(&dsps->guest_timeout);
+    libxl__ev_qmp_init(&dsps->qmp);
 
     if (type == LIBXL_DOMAIN_TYPE_INVALID) goto out;
     dsps->type = type;
@@ -103,6 +104,17 @@ static void domain_suspend_common_wait_guest(libxl__egc *egc,
                                              libxl__domain_suspend_state *dsps);
 static void domain_suspend_common_guest_suspended(libxl__egc *egc,
                                          libxl__domain_suspend_state *dsps);
+static void domain_suspend_device_model_qmp(libxl__egc *egc,
+                                            libxl__domain_suspend_state *dsps);
+static void suspend_device_model_stopped(libxl__egc *egc, libxl__ev_qmp *ev,
+                                         const libxl__json_object *response,
+                                         int rc);
+static void suspend_device_model_saved(libxl__egc *egc, libxl__ev_qmp *ev,
+                                       const libxl__json_object *response,
+                                       int rc);
+static void suspend_device_model_done(libxl__egc *egc,
+                                      libxl__domain_suspend_state *dsps,
+                                      int rc);
 
 static void domain_suspend_common_pvcontrol_suspending(libxl__egc *egc,
       libxl__xswait_state *xswa, int rc, const char *state);
@@ -379,6 +391,13 @@ static void domain_suspend_common_guest_suspended(libxl__egc *egc,
     libxl__ev_xswatch_deregister(gc, &dsps->guest_watch);
     libxl__ev_time_deregister(gc, &dsps->guest_timeout);
 
+    if (dsps->type == LIBXL_DOMAIN_TYPE_HVM &&
+        libxl__device_model_version_running(gc, dsps->domid) ==
+            LIBXL_DEVICE_MODEL_VERSION_QEMU_XEN) {
+        domain_suspend_device_model_qmp(egc, dsps);
+        return;
+    }
+
     if (dsps->type == LIBXL_DOMAIN_TYPE_HVM) {
         rc = libxl__domain_suspend_device_model(gc, dsps);
         if (rc) {
@@ -391,6 +410,76 @@ static void domain_suspend_common_guest_suspended(libxl__egc *egc,
     domain_suspend_common_done(egc, dsps, 0);
 }
 
+/*
+ * Like libxl__domain_suspend_device_model for upstream QEMU, but
+ * without blocking: stop and xen-save-devices-state are sent together
+ * on one QMP connection and QEMU runs them in order.
+ */
+static void domain_suspend_device_model_qmp(libxl__egc *egc,
+                                            libxl__domain_suspend_state *dsps)
+{
+    STATE_AO_GC(dsps->ao);
+    libxl__json_object *args = NULL;
+    int rc;
+
+    LOGD(DEBUG, dsps->domid, "Saving device model state to %s",
+         dsps->dm_savefile);
+
+    dsps->qmp.ao = dsps->ao;
+    dsps->qmp.domid = dsps->domid;
+    dsps->qmp_stop_rc = 0;
+
+    rc = libxl__ev_qmp_send(gc, &dsps->qmp, "stop", NULL,
+                            suspend_device_model_stopped);
+    if (rc) goto out;
+
+    libxl__qmp_param_add_string(gc, &args, "filename", dsps->dm_savefile);
+    rc = libxl__ev_qmp_send(gc, &dsps->qmp, "xen-save-devices-state", args,
+                            suspend_device_model_saved);
+    if (rc) goto out;
+
+    return;
+
+ out:
+    suspend_device_model_done(egc, dsps, rc);
+}
+
+static void suspend_device_model_stopped(libxl__egc *egc, libxl__ev_qmp *ev,
+                                         const libxl__json_object *response,
+                                         int rc)
+{
+    libxl__domain_suspend_state *dsps = CONTAINER_OF(ev, *dsps, qmp);
+
+    /* The save is already queued; its reply will finish the job. */
+    dsps->qmp_stop_rc = rc;
+}
+
+static void suspend_device_model_saved(libxl__egc *egc, libxl__ev_qmp *ev,
+                                       const libxl__json_object *response,
+                                       int rc)
+{
+    libxl__domain_suspend_state *dsps = CONTAINER_OF(ev, *dsps, qmp);
+
+    if (!rc)
+        rc = dsps->qmp_stop_rc;
+    suspend_device_model_done(egc, dsps, rc);
+}
+
+static void suspend_device_model_done(libxl__egc *egc,
+                                      libxl__domain_suspend_state *dsps,
+                                      int rc)
+{
+    EGC_GC;
+
+    libxl__ev_qmp_dispose(gc, &dsps->qmp);
+    if (rc) {
+        LOGD(ERROR, dsps->domid,
+             "failed to save device model state, rc=%d", rc);
+        unlink(dsps->dm_savefile);
+    }
+    domain_suspend_common_done(egc, dsps, rc);
+}
+
 static void domain_suspend_common_done(libxl__egc *egc,
                                        libxl__domain_suspend_state *dsps,
                                        int rc)
@@ -400,6 +489,7 @@ static void domain_suspend_common_done(libxl__egc *egc,
     libxl__ev_evtchn_cancel(gc, &dsps->guest_evtchn);
     libxl__ev_xswatch_deregister(gc, &dsps->guest_watch);
     libxl__ev_time_deregister(gc, &dsps->guest_timeout);
+    libxl__ev_qmp_dispose(gc, &dsps->qmp);
     dsps->callback_common_done(egc, dsps, rc);
 }
 
@@ -297,18 +297,29 @@ libxl_dominfo * libxl_list_domain(libxl_ctx *ctx, int *nb_domain_out)
 {
     libxl_dominfo *ptr = NULL;
     int i, ret;
-    xc_domaininfo_t info[1024];
-    int size = 0;
+    xc_domaininfo_t *info;
+    int size = 0, chunk = 1024;
     uint32_t domid = 0;
     GC_INIT(ctx);
 
-    while ((ret = xc_domain_getinfolist(ctx->xch, domid, 1024, info)) > 0) {
+    /*
+     * Ask for twice as many domains each time the previous chunk came back
+     * full, so that listing many thousands of them takes a few hypercalls.
+     */
+    GCNEW_ARRAY(info, chunk);
+    while ((ret = xc_domain_getinfolist(ctx->xch, domid, chunk, info)) > 0) {
         ptr = libxl__realloc(NOGC, ptr, (size + ret) * sizeof(libxl_dominfo));
         for (i = 0; i < ret; i++) {
             libxl__xcinfo2xlinfo(ctx, &info[i], &ptr[size + i]);
         }
         domid = info[ret - 1].domain + 1;
         size += ret;
+        if (ret < chunk)
+            break;
+        if (chunk < DOMID_FIRST_RESERVED) {
+            chunk *= 2;
+            GCREALLOC_ARRAY(info, chunk);
+        }
     }
 
     if (ret < 0) {
@@ -410,6 +421,8 @@ int libxl_domain_remus_start(libxl_ctx *ctx, libxl_domain_remus_info *info,
     libxl_defbool_setdefault(&info->blackhole, false);
     libxl_defbool_setdefault(&info->compression,
                              !libxl_defbool_val(info->colo));
+    libxl_defbool_setdefault(&info->async_checkpoint,
+                             !libxl_defbool_val(info->colo));
     libxl_defbool_setdefault(&info->netbuf, true);
     libxl_defbool_setdefault(&info->diskbuf, true);
 
@@ -421,6 +434,14 @@ int libxl_domain_remus_start(libxl_ctx *ctx, libxl_domain_remus_info *info,
             goto out;
     }
 
+    if (libxl_defbool_val(info->colo) &&
+        libxl_defbool_val(info->async_checkpoint)) {
+            LOGD(ERROR, domid, "Cannot use asynchronous memory "
+                        "checkpoints in COLO mode");
+            rc = ERROR_FAIL;
+            goto out;
+    }
+
     if (!libxl_defbool_val(info->allow_unsafe) &&
         (libxl_defbool_val(info->blackhole) ||
          !libxl_defbool_val(info->netbuf) ||
@@ -523,6 +544,139 @@ int libxl_domain_suspend(libxl_ctx *ctx, uint32_t domid, int fd, int flags,
     return AO_CREATE_FAIL(rc);
 }
 
+/*----- suspending many domains within one ao -----*/
+
+typedef struct libxl__domain_suspend_many_state
+    libxl__domain_suspend_many_state;
+
+typedef struct {
+    libxl__domain_save_state dss;
+    libxl__domain_suspend_many_state *dsms;
+    int idx;
+} libxl__domain_suspend_many_entry;
+
+struct libxl__domain_suspend_many_state {
+    libxl__ao *ao;
+    const uint32_t *domids;
+    const int *fds;
+    int *rcs;
+    int flags;
+    int nr, max_parallel;
+    int next, running;
+    bool in_next;
+    int rc;
+    libxl__domain_suspend_many_entry *entries;
+};
+
+static void domain_suspend_many_cb(libxl__egc *egc,
+                                   libxl__domain_save_state *dss, int rc);
+
+static void domain_suspend_many_next(libxl__egc *egc,
+                                     libxl__domain_suspend_many_state *dsms)
+{
+    STATE_AO_GC(dsms->ao);
+    int rc;
+
+    /*
+     * A save may complete, and call us again, before returning: leave
+     * starting the rest, and completing the ao, to the outermost call.
+     */
+    if (dsms->in_next)
+        return;
+    dsms->in_next = true;
+
+    while (dsms->next < dsms->nr &&
+           (!dsms->max_parallel || dsms->running < dsms->max_parallel)) {
+        libxl__domain_suspend_many_entry *e = &dsms->entries[dsms->next];
+        libxl__domain_save_state *dss = &e->dss;
+
+        e->dsms = dsms;
+        e->idx = dsms->next++;
+        dsms->running++;
+
+        dss->ao = ao;
+        dss->callback = domain_suspend_many_cb;
+        dss->domid = dsms->domids[e->idx];
+        dss->fd = dsms->fds[e->idx];
+        dss->fdfl = -1;
+        dss->type = libxl__domain_type(gc, dss->domid);
+        dss->live = dsms->flags & LIBXL_SUSPEND_LIVE;
+        dss->debug = dsms->flags & LIBXL_SUSPEND_DEBUG;
+        dss->checkpointed_stream = LIBXL_CHECKPOINTED_STREAM_NONE;
+
+        if (dss->type == LIBXL_DOMAIN_TYPE_INVALID) {
+            domain_suspend_many_cb(egc, dss, ERROR_FAIL);
+            continue;
+        }
+
+        rc = libxl__fd_flags_modify_save(gc, dss->fd,
+                                         ~(O_NONBLOCK|O_NDELAY), 0,
+                                         &dss->fdfl);
+        if (rc < 0) {
+            dss->fdfl = -1;
+            domain_suspend_many_cb(egc, dss, rc);
+            continue;
+        }
+
+        libxl__domain_save(egc, dss);
+    }
+
+    dsms->in_next = false;
+    if (!dsms->running && dsms->next == dsms->nr)
+        libxl__ao_complete(egc, ao, dsms->rc);
+}
+
+static void domain_suspend_many_cb(libxl__egc *egc,
+                                   libxl__domain_save_state *dss, int rc)
+{
+    libxl__domain_suspend_many_entry *e = CONTAINER_OF(dss, *e, dss);
+    libxl__domain_suspend_many_state *dsms = e->dsms;
+    STATE_AO_GC(dsms->ao);
+    int flrc;
+
+    if (dss->fdfl != -1) {
+        flrc = libxl__fd_flags_restore(gc, dss->fd, dss->fdfl);
+        if (flrc && !rc) rc = flrc;
+    }
+
+    if (rc)
+        LOGD(ERROR, dss->domid, "Saving domain failed");
+
+    if (dsms->rcs)
+        dsms->rcs[e->idx] = rc;
+    if (rc && !dsms->rc)
+        dsms->rc = rc;
+    dsms->running--;
+
+    domain_suspend_many_next(egc, dsms);
+}
+
+int libxl_domain_suspend_many(libxl_ctx *ctx, const uint32_t *domids,
+                              const int *fds, int nr, int flags,
+                              int max_parallel, int *rcs,
+                              const libxl_asyncop_how *ao_how)
+{
+    AO_CREATE(ctx, 0, ao_how);
+    libxl__domain_suspend_many_state *dsms;
+
+    if (nr <= 0 || max_parallel < 0)
+        return AO_CREATE_FAIL(ERROR_INVAL);
+
+    GCNEW(dsms);
+    dsms->ao = ao;
+    dsms->domids = domids;
+    dsms->fds = fds;
+    dsms->rcs = rcs;
+    dsms->flags = flags;
+    dsms->nr = nr;
+    dsms->max_parallel = max_parallel;
+    GCNEW_ARRAY(dsms->entries, nr);
+
+    domain_suspend_many_next(egc, dsms);
+
+    return AO_INPROGRESS;
+}
+
 int libxl_domain_pause(libxl_ctx *ctx, uint32_t domid)
 {
     int ret;
@@ -891,6 +1045,105 @@ static void domain_destroy_cb(libxl__egc *egc, libxl__domain_destroy_state *dds,
     libxl__ao_complete(egc, ao, rc);
 }
 
+/*----- destroying many domains within one ao -----*/
+
+typedef struct libxl__domain_destroy_many_state
+    libxl__domain_destroy_many_state;
+
+typedef struct {
+    libxl__domain_destroy_state dds;
+    libxl__domain_destroy_many_state *ddms;
+    int idx;
+} libxl__domain_destroy_many_entry;
+
+struct libxl__domain_destroy_many_state {
+    libxl__ao *ao;
+    const uint32_t *domids;
+    int *rcs;
+    int nr, max_parallel;
+    int next, running;
+    bool in_next;
+    int rc;
+    libxl__domain_destroy_many_entry *entries;
+};
+
+static void domain_destroy_many_cb(libxl__egc *egc,
+                                   libxl__domain_destroy_state *dds, int rc);
+
+static void domain_destroy_many_next(libxl__egc *egc,
+                                     libxl__domain_destroy_many_state *ddms)
+{
+    STATE_AO_GC(ddms->ao);
+
+    /*
+     * A destruction may complete, and call us again, before returning: leave
+     * starting the rest, and completing the ao, to the outermost call.
+     */
+    if (ddms->in_next)
+        return;
+    ddms->in_next = true;
+
+    while (ddms->next < ddms->nr &&
+           (!ddms->max_parallel || ddms->running < ddms->max_parallel)) {
+        libxl__domain_destroy_many_entry *e = &ddms->entries[ddms->next];
+
+        e->ddms = ddms;
+        e->idx = ddms->next++;
+        ddms->running++;
+
+        e->dds.ao = ddms->ao;
+        e->dds.domid = ddms->domids[e->idx];
+        e->dds.callback = domain_destroy_many_cb;
+        libxl__domain_destroy(egc, &e->dds);
+    }
+
+    ddms->in_next = false;
+    if (!ddms->running && ddms->next == ddms->nr)
+        libxl__ao_complete(egc, ao, ddms->rc);
+}
+
+static void domain_destroy_many_cb(libxl__egc *egc,
+                                   libxl__domain_destroy_state *dds, int rc)
+{
+    libxl__domain_destroy_many_entry *e = CONTAINER_OF(dds, *e, dds);
+    libxl__domain_destroy_many_state *ddms = e->ddms;
+    STATE_AO_GC(ddms->ao);
+
+    if (rc)
+        LOGD(ERROR, dds->domid, "Destruction of domain failed");
+
+    if (ddms->rcs)
+        ddms->rcs[e->idx] = rc;
+    if (rc && !ddms->rc)
+        ddms->rc = rc;
+    ddms->running--;
+
+    domain_destroy_many_next(egc, ddms);
+}
+
+int libxl_domain_destroy_many(libxl_ctx *ctx, const uint32_t *domids,
+                              int nr, int max_parallel, int *rcs,
+                              const libxl_asyncop_how *ao_how)
+{
+    AO_CREATE(ctx, 0, ao_how);
+    libxl__domain_destroy_many_state *ddms;
+
+    if (nr <= 0 || max_parallel < 0)
+        return AO_CREATE_FAIL(ERROR_INVAL);
+
+    GCNEW(ddms);
+    ddms->ao = ao;
+    ddms->domids = domids;
+    ddms->rcs = rcs;
+    ddms->nr = nr;
+    ddms->max_parallel = max_parallel;
+    GCNEW_ARRAY(ddms->entries, nr);
+
+    domain_destroy_many_next(egc, ddms);
+
+    return AO_INPROGRESS;
+}
+
 /* Callbacks for libxl__domain_destroy */
 
 static void stubdom_destroy_callback(libxl__egc *egc,
@@ -984,6 +1237,12 @@ static void devices_destroy_cb(libxl__egc *egc,
 static void domain_destroy_domid_cb(libxl__egc *egc,
                                     libxl__ev_child *destroyer,
                                     pid_t pid, int status);
+static void domain_destroy_progress_cb(libxl__egc *egc, libxl__ev_time *ev,
+                                       const struct timeval *requested_abs,
+                                       int rc);
+
+/* How often to report on the hypervisor's teardown of a domain. */
+#define DESTROY_PROGRESS_INTERVAL_MS 5000
 
 void libxl__destroy_domid(libxl__egc *egc, libxl__destroy_domid_state *dis)
 {
@@ -994,6 +1253,7 @@ void libxl__destroy_domid(libxl__egc *egc, libxl__destroy_domid_state *dis)
     int rc, dm_present;
 
     libxl__ev_child_init(&dis->destroyer);
+    libxl__ev_time_init(&dis->progress_timer);
 
     rc = libxl_domain_info(ctx, NULL, domid);
     switch(rc) {
@@ -1139,6 +1399,12 @@ static void devices_destroy_cb(libxl__egc *egc,
     }
     LOGD(DEBUG, domid, "Forked pid %ld for destroy of domain", (long)rc);
 
+    /* Not fatal: this only serves to keep the user informed. */
+    if (!dis->soft_reset)
+        libxl__ev_time_register_rel(ao, &dis->progress_timer,
+                                    domain_destroy_progress_cb,
+                                    DESTROY_PROGRESS_INTERVAL_MS);
+
     return;
 
 out:
@@ -1154,6 +1420,8 @@ static void domain_destroy_domid_cb(libxl__egc *egc,
     STATE_AO_GC(dis->ao);
     int rc;
 
+    libxl__ev_time_deregister(gc, &dis->progress_timer);
+
     if (status) {
         if (WIFEXITED(status) && WEXITSTATUS(status)<126) {
             LOGEVD(ERROR, WEXITSTATUS(status), dis->domid,
@@ -1171,6 +1439,66 @@ static void domain_destroy_domid_cb(libxl__egc *egc,
     dis->callback(egc, dis, rc);
 }
 
+static void domain_destroy_progress_cb(libxl__egc *egc, libxl__ev_time *ev,
+                                       const struct timeval *requested_abs,
+                                       int rc)
+{
+    libxl__destroy_domid_state *dis =
+        CONTAINER_OF(ev, *dis, progress_timer);
+    STATE_AO_GC(dis->ao);
+    uint64_t total_memkb, remaining_memkb;
+
+    libxl__ev_time_deregister(gc, &dis->progress_timer);
+
+    if (rc == ERROR_ABORTED)
+        return;
+
+    if (libxl_domain_destroy_progress(CTX, dis->domid, &total_memkb,
+                                      &remaining_memkb))
+        return;
+
+    LOGD(INFO, dis->domid, "Destroying domain: %"PRIu64" of %"PRIu64
+         " KiB released", total_memkb - remaining_memkb, total_memkb);
+
+    libxl__ev_time_register_rel(ao, &dis->progress_timer,
+                                domain_destroy_progress_cb,
+                                DESTROY_PROGRESS_INTERVAL_MS);
+}
+
+int libxl_domain_destroy_progress(libxl_ctx *ctx, uint32_t domid,
+                                  uint64_t *total_memkb,
+                                  uint64_t *remaining_memkb)
+{
+    GC_INIT(ctx);
+    unsigned int state;
+    uint64_t pages_total, pages_left;
+    int rc;
+
+    if (xc_domain_destroy_progress(ctx->xch, domid, &state,
+                                   &pages_total, &pages_left)) {
+        if (errno == ESRCH) {
+            rc = ERROR_DOMAIN_NOTFOUND;
+        } else {
+            LOGED(ERROR, domid, "Getting domain destroy progress");
+            rc = ERROR_FAIL;
+        }
+        goto out;
+    }
+
+    if (state == XEN_DOMCTL_DESTROY_NOT_STARTED) {
+        *total_memkb = *remaining_memkb = 0;
+    } else {
+        *total_memkb = pages_total << (XC_PAGE_SHIFT - 10);
+        /* Pages may have been allocated after teardown started. */
+        *remaining_memkb = min(pages_left, pages_total) << (XC_PAGE_SHIFT - 10);
+    }
+    rc = 0;
+
+ out:
+    GC_FREE;
+    return rc;
+}
+
 int libxl__get_domid(libxl__gc *gc, uint32_t *domid)
 {
     int rc;
@@ -1258,6 +1586,99 @@ err:
     return NULL;
 }
 
+#define EVTCHN_STATS_CHUNK 256
+
+int libxl_evtchn_stats_list(libxl_ctx *ctx, uint32_t domid,
+                            libxl_evtchn_stats *totals,
+                            libxl_evtchn_stats **list_r, int *nr_r)
+{
+    GC_INIT(ctx);
+    xc_evtchn_port_stats_t *buf;
+    libxl_evtchn_stats *list = NULL;
+    uint64_t sent, coalesced, link_retries;
+    uint32_t first_port = 0;
+    unsigned int i, n;
+    int nr = 0, rc;
+
+    GCNEW_ARRAY(buf, EVTCHN_STATS_CHUNK);
+
+    do {
+        n = EVTCHN_STATS_CHUNK;
+        if (xc_evtchn_stats(ctx->xch, domid, first_port, buf, &n,
+                            &sent, &coalesced, &link_retries)) {
+            if (errno == EOPNOTSUPP) {
+                LOGD(ERROR, domid, "Event channel statistics not enabled"
+                     " (boot Xen with evtchn_stats)");
+                rc = ERROR_NI;
+            } else {
+                LOGED(ERROR, domid, "Getting event channel statistics");
+                rc = ERROR_FAIL;
+            }
+            goto out;
+        }
+
+        list = libxl__realloc(NOGC, list, (nr + n) * sizeof(*list));
+        for (i = 0; i < n; i++, nr++) {
+            libxl_evtchn_stats_init(&list[nr]);
+            list[nr].port = buf[i].port;
+            list[nr].sent = buf[i].sent;
+            list[nr].coalesced = buf[i].coalesced;
+            list[nr].link_retries = buf[i].link_retries;
+        }
+        if (n)
+            first_port = buf[n - 1].port + 1;
+    } while (n == EVTCHN_STATS_CHUNK);
+
+    libxl_evtchn_stats_init(totals);
+    totals->sent = sent;
+    totals->coalesced = coalesced;
+    totals->link_retries = link_retries;
+
+    *list_r = list;
+    *nr_r = nr;
+    list = NULL;
+    rc = 0;
+
+out:
+    if (list)
+        libxl_evtchn_stats_list_free(list, nr);
+    GC_FREE;
+    return rc;
+}
+
+int libxl_domain_irq_stats(libxl_ctx *ctx, uint32_t domid,
+                           libxl_irq_stats *stats)
+{
+    GC_INIT(ctx);
+    xc_irq_stats_t buf;
+    int rc;
+
+    if (xc_irq_stats(ctx->xch, domid, &buf)) {
+        if (errno == EINVAL) {
+            rc = ERROR_INVAL;
+        } else {
+            LOGED(ERROR, domid, "Getting interrupt statistics");
+            rc = ERROR_FAIL;
+        }
+        goto out;
+    }
+
+    libxl_irq_stats_init(stats);
+    stats->extint_exits = buf.extint_exits;
+    stats->guest_irq_exits = buf.guest_irq_exits;
+    stats->pi_wakeups = buf.pi_wakeups;
+    stats->apic_icr_exits = buf.apic_icr_exits;
+    stats->apic_eoi_exits = buf.apic_eoi_exits;
+    stats->apic_tpr_exits = buf.apic_tpr_exits;
+    stats->apic_timer_exits = buf.apic_timer_exits;
+    stats->apic_other_exits = buf.apic_other_exits;
+    rc = 0;
+
+out:
+    GC_FREE;
+    return rc;
+}
+
 static int libxl__set_vcpuonline_xenstore(libxl__gc *gc, uint32_t domid,
                                          libxl_bitmap *cpumap,
                                          const libxl_dominfo *info)
@@ -194,6 +194,7 @@ int libxl__ev_fd_register(libxl__gc *gc, libxl__ev_fd *ev,
     ev->func = func;
 
     LIBXL_LIST_INSERT_HEAD(&CTX->efds, ev, entry);
+    CTX->efds_generation++;
 
     rc = 0;
 
@@ -236,6 +237,7 @@ void libxl__ev_fd_deregister(libxl__gc *gc, libxl__ev_fd *ev)
 
     OSEVENT_HOOK_VOID(fd,deregister, release, ev->fd, ev->nexus->for_app_reg);
     LIBXL_LIST_REMOVE(ev, entry);
+    CTX->efds_generation++;
     ev->fd = -1;
 
     LIBXL_LIST_FOREACH(poller, &CTX->pollers_fds_changed, fds_changed_entry)
@@ -299,11 +301,91 @@ static int time_rel_to_abs(libxl__gc *gc, int ms, struct timeval *abs_out)
     return 0;
 }
 
+/*
+ * The finite timeouts are kept in CTX->etimes, a binary min-heap
+ * ordered by abs, so that registering and deregistering one is
+ * O(log n) and the next one due is always etimes[0].
+ */
+
+static void time_heap_set(libxl__gc *gc, int i, libxl__ev_time *ev)
+{
+    CTX->etimes[i] = ev;
+    ev->heap_index = i;
+}
+
+static void time_heap_sift_up(libxl__gc *gc, int i)
+{
+    libxl__ev_time *ev = CTX->etimes[i];
+
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!timercmp(&CTX->etimes[parent]->abs, &ev->abs, >))
+            break;
+        time_heap_set(gc, i, CTX->etimes[parent]);
+        i = parent;
+    }
+    time_heap_set(gc, i, ev);
+}
+
+static void time_heap_sift_down(libxl__gc *gc, int i)
+{
+    libxl__ev_time *ev = CTX->etimes[i];
+
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= CTX->netimes)
+            break;
+        if (child + 1 < CTX->netimes &&
+            timercmp(&CTX->etimes[child]->abs,
+                     &CTX->etimes[child + 1]->abs, >))
+            child++;
+        if (!timercmp(&ev->abs, &CTX->etimes[child]->abs, >))
+            break;
+        time_heap_set(gc, i, CTX->etimes[child]);
+        i = child;
+    }
+    time_heap_set(gc, i, ev);
+}
+
+static void time_heap_insert(libxl__gc *gc, libxl__ev_time *ev)
+{
+    if (CTX->netimes == CTX->etimes_allocd) {
+        int newsize = CTX->etimes_allocd ? CTX->etimes_allocd * 2 : 16;
+        assert(ARRAY_SIZE_OK(CTX->etimes, newsize));
+        CTX->etimes = libxl__realloc(NOGC, CTX->etimes,
+                                     newsize * sizeof(*CTX->etimes));
+        CTX->etimes_allocd = newsize;
+    }
+
+    CTX->etimes[CTX->netimes++] = ev;
+    time_heap_sift_up(gc, CTX->netimes - 1);
+}
+
+static void time_heap_remove(libxl__gc *gc, libxl__ev_time *ev)
+{
+    int i = ev->heap_index;
+    libxl__ev_time *last;
+
+    assert(i >= 0 && i < CTX->netimes && CTX->etimes[i] == ev);
+
+    last = CTX->etimes[--CTX->netimes];
+    if (last != ev) {
+        time_heap_set(gc, i, last);
+        time_heap_sift_up(gc, i);
+        time_heap_sift_down(gc, last->heap_index);
+    }
+    ev->heap_index = -1;
+}
+
+static libxl__ev_time *time_heap_first(libxl__gc *gc)
+{
+    return CTX->netimes ? CTX->etimes[0] : NULL;
+}
+
 static int time_register_finite(libxl__gc *gc, libxl__ev_time *ev,
                                 struct timeval absolute)
 {
     int rc;
-    libxl__ev_time *evsearch;
 
     rc = OSEVENT_HOOK(timeout,register, alloc, &ev->nexus->for_app_reg,
                       absolute, ev->nexus);
@@ -311,8 +393,7 @@ static int time_register_finite(libxl__gc *gc, libxl__ev_time *ev,
 
     ev->infinite = 0;
     ev->abs = absolute;
-    LIBXL_TAILQ_INSERT_SORTED(&CTX->etimes, entry, ev, evsearch, /*empty*/,
-                              timercmp(&ev->abs, &evsearch->abs, >));
+    time_heap_insert(gc, ev);
 
     return 0;
 }
@@ -328,7 +409,7 @@ static void time_deregister(libxl__gc *gc, libxl__ev_time *ev)
         OSEVENT_HOOK_VOID(timeout,modify,
                           noop /* release nexus in _occurred_ */,
                           &ev->nexus->for_app_reg, right_away);
-        LIBXL_TAILQ_REMOVE(&CTX->etimes, ev, entry);
+        time_heap_remove(gc, ev);
     }
 }
 
@@ -1110,7 +1191,7 @@ static int beforepoll_internal(libxl__gc *gc, libxl__poller *poller,
 
     poller->fds_changed = 0;
 
-    libxl__ev_time *etime = LIBXL_TAILQ_FIRST(&CTX->etimes);
+    libxl__ev_time *etime = time_heap_first(gc);
     if (etime) {
         int our_timeout;
         struct timeval rel;
@@ -1240,29 +1321,29 @@ static void afterpoll_internal(libxl__egc *egc, libxl__poller *poller,
      *   CTX->efds    is more complicated; see below.
      */
 
-    for (;;) {
-        /* We restart our scan of fd events whenever we call a
-         * callback function.  This is necessary because such
-         * a callback might make arbitrary changes to CTX->efds.
-         * We invalidate the fd_rindices[] entries which were used
-         * so that we don't call the same function again. */
+    efd = LIBXL_LIST_FIRST(&CTX->efds);
+    while (efd) {
+        /* We restart our scan of fd events whenever a callback
+         * function adds or removes an entry of CTX->efds, since
+         * then our next pointer may be stale.  Otherwise we carry
+         * on from where we were, so that dispatching k events
+         * costs O(n+k) rather than O(n*k).  We invalidate the
+         * fd_rindices[] entries which were used so that we don't
+         * call the same function again. */
+        libxl__ev_fd *next = LIBXL_LIST_NEXT(efd, entry);
+        unsigned generation = CTX->efds_generation;
         int revents;
 
-        LIBXL_LIST_FOREACH(efd, &CTX->efds, entry) {
-
-            if (!efd->events)
-                continue;
-
+        if (efd->events) {
             revents = afterpoll_check_fd(poller,fds,nfds,
                                          efd->fd,efd->events);
-            if (revents)
-                goto found_fd_event;
+            if (revents) {
+                fd_occurs(egc, efd, revents);
+                if (CTX->efds_generation != generation)
+                    next = LIBXL_LIST_FIRST(&CTX->efds);
+            }
         }
-        /* no ordinary fd events, then */
-        break;
-
-    found_fd_event:
-        fd_occurs(egc, efd, revents);
+        efd = next;
     }
 
     if (afterpoll_check_fd(poller,fds,nfds, poller->wakeup_pipe[0],POLLIN)) {
@@ -1271,7 +1352,7 @@ static void afterpoll_internal(libxl__egc *egc, libxl__poller *poller,
     }
 
     for (;;) {
-        libxl__ev_time *etime = LIBXL_TAILQ_FIRST(&CTX->etimes);
+        libxl__ev_time *etime = time_heap_first(gc);
         if (!etime)
             break;
 
@@ -1307,7 +1388,7 @@ void libxl_osevent_register_hooks(libxl_ctx *ctx,
     GC_INIT(ctx);
     CTX_LOCK;
     assert(LIBXL_LIST_EMPTY(&ctx->efds));
-    assert(LIBXL_TAILQ_EMPTY(&ctx->etimes));
+    assert(!ctx->netimes);
     ctx->osevent_hooks = hooks;
     ctx->osevent_user = user;
     CTX_UNLOCK;
@@ -1347,7 +1428,7 @@ void libxl_osevent_occurred_timeout(libxl_ctx *ctx, void *for_libxl)
     if (!ev) goto out;
     assert(!ev->infinite);
 
-    LIBXL_TAILQ_REMOVE(&CTX->etimes, ev, entry);
+    time_heap_remove(gc, ev);
 
     time_occurs(egc, ev, ERROR_TIMEDOUT);
 
@@ -95,6 +95,7 @@
 #define LIBXL_DEVICE_MODEL_START_TIMEOUT 60
 #define LIBXL_DEVICE_MODEL_SAVE_FILE XEN_LIB_DIR "/qemu-save" /* .$domid */
 #define LIBXL_DEVICE_MODEL_RESTORE_FILE XEN_LIB_DIR "/qemu-resume" /* .$domid */
+#define LIBXL_KERNEL_CACHE_DIR XEN_LIB_DIR "/kernel-cache"
 #define LIBXL_STUBDOM_START_TIMEOUT 30
 #define LIBXL_QEMU_BODGE_TIMEOUT 2
 #define LIBXL_XENCONSOLE_LIMIT 1048576
@@ -287,8 +288,8 @@ struct libxl__ev_time {
     /* read-only for caller, who may read only when registered: */
     libxl__ev_time_callback *func;
     /* remainder is private for libxl__ev_time... */
-    int infinite; /* not registered in list or with app if infinite */
-    LIBXL_TAILQ_ENTRY(libxl__ev_time) entry;
+    int infinite; /* not registered in heap or with app if infinite */
+    int heap_index; /* in CTX->etimes */
     struct timeval abs;
     libxl__osevent_hook_nexus *nexus;
     libxl__ao_abortable abrt;
@@ -432,10 +433,29 @@ struct libxl__gc {
     libxl_ctx *owner;
 };
 
+/*
+ * ACPI tables built by libxl for a guest, keyed by everything their
+ * contents depend on.  See libxl__dom_load_acpi.
+ */
+#define LIBXL__ACPI_CACHE_MAX 8
+typedef struct libxl__acpi_cache_entry libxl__acpi_cache_entry;
+struct libxl__acpi_cache_entry {
+    LIBXL_TAILQ_ENTRY(libxl__acpi_cache_entry) entry;
+    void *key;
+    size_t key_len;
+    int nr_modules;
+    struct {
+        void *data;
+        uint32_t length;
+    } modules[3];
+};
+_hidden void libxl__acpi_cache_entry_free(libxl__acpi_cache_entry *ace);
+
 struct libxl__ctx {
     xentoollog_logger *lg;
     xc_interface *xch;
     struct xs_handle *xsh;
+    bool xs_batch_unsupported; /* xenstored rejected XS_BATCH */
     libxl__gc nogc_gc;
 
     const libxl_event_hooks *event_hooks;
@@ -469,7 +489,9 @@ struct libxl__ctx {
     LIBXL_SLIST_HEAD(libxl__osevent_hook_nexi, libxl__osevent_hook_nexus)
         hook_fd_nexi_idle, hook_timeout_nexi_idle;
     LIBXL_LIST_HEAD(, libxl__ev_fd) efds;
-    LIBXL_TAILQ_HEAD(, libxl__ev_time) etimes;
+    unsigned efds_generation; /* bumped when efds gains or loses an entry */
+    libxl__ev_time **etimes; /* binary min-heap ordered by abs */
+    int netimes, etimes_allocd;
 
     libxl__ev_watch_slot *watch_slots;
     int watch_nslots, nwatches;
@@ -499,6 +521,16 @@ struct libxl__ctx {
     LIBXL_LIST_ENTRY(libxl_ctx) sigchld_users_entry;
 
     libxl_version_info version_info;
+
+    /* Spans recorded since libxl_trace_enable, see libxl_trace.c */
+    bool trace_enabled;
+    uint64_t trace_epoch_us;
+    struct libxl__trace_event *trace;
+    int trace_used, trace_size;
+
+    /* Firmware tables built by libxl, most recently used first */
+    LIBXL_TAILQ_HEAD(libxl__acpi_cache, libxl__acpi_cache_entry) acpi_cache;
+    int acpi_cache_used;
 };
 
 typedef struct {
@@ -1785,6 +1817,24 @@ _hidden int libxl__init_recursive_mutex(libxl_ctx *ctx, pthread_mutex_t *lock);
 
 _hidden int libxl__gettimeofday(libxl__gc *gc, struct timeval *now_r);
 
+/*
+ * Timing spans for libxl_trace_write.  All of these are no-ops unless
+ * the application called libxl_trace_enable.  name must be a string
+ * literal, it isn't copied.  libxl__trace_end may be called on a span
+ * which is LIBXL__TRACE_NONE, and sets it so; libxl__trace_next ends
+ * *span and begins the next one.  Spans begun before the domain exists
+ * are given its domid with libxl__trace_set_domid once it does.
+ */
+typedef int libxl__trace_span;
+#define LIBXL__TRACE_NONE (-1)
+_hidden libxl__trace_span libxl__trace_begin(libxl__gc *gc, uint32_t domid,
+                                             const char *name);
+_hidden void libxl__trace_end(libxl__gc *gc, libxl__trace_span *span);
+_hidden void libxl__trace_set_domid(libxl__gc *gc, libxl__trace_span span,
+                                    uint32_t domid);
+_hidden void libxl__trace_next(libxl__gc *gc, libxl__trace_span *span,
+                               uint32_t domid, const char *name);
+
 #define STRINGIFY(x) #x
 #define TOSTRING(x) STRINGIFY(x)
 
@@ -2022,6 +2072,122 @@ _hidden void libxl__json_object_free(libxl__gc *gc_opt,
 
 _hidden libxl__json_object *libxl__json_parse(libxl__gc *gc_opt, const char *s);
 
+/*
+ * Streaming parser, filling in an IDL type straight from the yajl
+ * events rather than from a libxl__json_object tree.  The layout of
+ * each type is described by the tables gentypes.py generates
+ * (libxl__<type>_json_stream).  Only the values handled by one of the
+ * libxl__*_parse_json functions above (numbers, strings, bitmaps, ...)
+ * are still turned into a libxl__json_object, one at a time, before
+ * being passed to that function.
+ */
+typedef enum {
+    LIBXL__JSON_STREAM_VALUE,
+    LIBXL__JSON_STREAM_STRUCT,
+    LIBXL__JSON_STREAM_ARRAY,
+} libxl__json_stream_kind;
+
+typedef struct libxl__json_stream_type libxl__json_stream_type;
+
+typedef struct {
+    const char *name;
+    /* Values of any other type are ignored, like libxl__json_map_get. */
+    libxl__json_node_type expected_type;
+    size_t offset;
+    const libxl__json_stream_type *type;    /* NULL: nothing to parse */
+    /* Arrays: where the number of elements goes. */
+    size_t len_offset;
+    /* Keyed union members: selects the member before it gets parsed. */
+    void (*init_key)(void *p);
+} libxl__json_stream_field;
+
+struct libxl__json_stream_type {
+    libxl__json_stream_kind kind;
+    libxl__json_parse_callback parse;       /* VALUE */
+    const libxl__json_stream_field *fields; /* STRUCT, up to a NULL name */
+    const libxl__json_stream_type *elem;    /* ARRAY */
+    size_t elem_size;                       /* ARRAY */
+};
+
+_hidden int libxl__object_from_json_stream(libxl_ctx *ctx, const char *type,
+                                           const libxl__json_stream_type *desc,
+                                           void *p, const char *s);
+
+/* from libxl_qmp: asynchronous client */
+
+/*
+ * libxl__ev_qmp: a connection to the QMP socket of a device model,
+ * driven by the libxl event loop.
+ *
+ * Any number of commands may be outstanding on one connection.  They
+ * are written as soon as QEMU is ready to accept them, without
+ * waiting for earlier replies, and QEMU answers them in order.  The
+ * connection is opened by the first send and stays up until
+ * libxl__ev_qmp_dispose, so a sequence of commands pays for one
+ * connection and capabilities negotiation.  Since QEMU serves one QMP
+ * client at a time, do not keep it longer than the operation needs.
+ *
+ * Possible states:
+ *  Undefined
+ *    Might contain anything.
+ *  Idle
+ *    Not connected, no commands outstanding.
+ *  Active
+ *    Connecting or connected.  Commands may be outstanding; while
+ *    they are, an idle timeout is running and the ao may be aborted.
+ *
+ * libxl__ev_qmp_init: Undefined/Idle -> Idle
+ *
+ * libxl__ev_qmp_send: Idle/Active -> Active
+ *    Queues cmd (with args, which may be NULL) and returns 0, or
+ *    returns an error code leaving the state unchanged.  callback
+ *    will be called exactly once for cmd, from the event loop and
+ *    never from within _send: with rc = 0 and the "return" value of
+ *    the reply, or with an error and response = NULL.  If the
+ *    connection fails, each outstanding callback is called in turn
+ *    with the error; the connection is closed before the first one.
+ *    Callbacks may send further commands or dispose of ev.
+ *
+ * libxl__ev_qmp_dispose: Idle/Active -> Idle
+ *    Closes the connection.  The callbacks of outstanding commands
+ *    will not be called.
+ */
+typedef struct libxl__ev_qmp libxl__ev_qmp;
+typedef struct libxl__ev_qmp_cmd libxl__ev_qmp_cmd;
+typedef void libxl__ev_qmp_callback(libxl__egc *egc, libxl__ev_qmp *ev,
+                                    const libxl__json_object *response,
+                                    int rc);
+
+struct libxl__ev_qmp {
+    /* caller must fill these in, and they must all remain valid */
+    libxl__ao *ao;
+    uint32_t domid;
+    /* remainder is private for libxl__ev_qmp_... */
+    int fd;
+    bool ready; /* greeting received, commands may be written */
+    int connect_tries;
+    int generation;
+    libxl__ev_fd efd;
+    libxl__ev_time etime;
+    char *rx_buf;
+    size_t rx_len, rx_size;
+    int last_id_used;
+    LIBXL_TAILQ_HEAD(, libxl__ev_qmp_cmd) cmds;
+};
+
+_hidden void libxl__ev_qmp_init(libxl__ev_qmp *ev);
+_hidden int libxl__ev_qmp_send(libxl__gc *unused_gc, libxl__ev_qmp *ev,
+                               const char *cmd, libxl__json_object *args,
+                               libxl__ev_qmp_callback *callback);
+_hidden void libxl__ev_qmp_dispose(libxl__gc *unused_gc, libxl__ev_qmp *ev);
+static inline bool libxl__ev_qmp_isactive(const libxl__ev_qmp *ev)
+                { return ev->fd >= 0 || !LIBXL_TAILQ_EMPTY(&ev->cmds); }
+
+/* Add a string argument to the args of a QMP command. */
+_hidden void libxl__qmp_param_add_string(libxl__gc *gc,
+                                         libxl__json_object **param,
+                                         const char *name, const char *s);
+
   /* Based on /local/domain/$domid/dm-version xenstore key
    * default is qemu xen traditional */
 _hidden int libxl__device_model_version_running(libxl__gc *gc, uint32_t domid);
@@ -2436,6 +2602,8 @@ struct libxl__ao_device {
     libxl__async_exec_state aes;
     /* If we need to update JSON config */
     bool update_json;
+    /* Don't wait for InitWait if the backend is in a driver domain */
+    bool skip_backend_wait;
     /* for asynchronous execution of synchronous-only syscalls etc. */
     libxl__ev_child child;
 };
@@ -2496,6 +2664,8 @@ typedef void libxl__devices_callback(libxl__egc*, libxl__multidev*, int rc);
 struct libxl__multidev {
     /* set by user: */
     libxl__devices_callback *callback;
+    /* passed on to each aodev, see libxl__ao_device */
+    bool skip_backend_wait;
     /* for private use by libxl__...ao_devices... machinery: */
     libxl__ao *ao;
     libxl__ao_device **array;
@@ -3278,6 +3448,8 @@ struct libxl__domain_suspend_state {
     libxl__ev_time guest_timeout;
 
     const char *dm_savefile;
+    libxl__ev_qmp qmp;
+    int qmp_stop_rc;
     void (*callback_common_done)(libxl__egc*,
                                  struct libxl__domain_suspend_state*, int ok);
 };
@@ -3474,6 +3646,7 @@ _hidden void libxl__bootloader_run(libxl__egc*, libxl__bootloader_state *st);
 struct libxl_device_type {
     char *type;
     int skip_attach;   /* Skip entry in domcreate_attach_devices() if 1 */
+    int attach_after_prev; /* Attach only once earlier types are done if 1 */
     int ptr_offset;    /* Offset of device array ptr in libxl_domain_config */
     int num_offset;    /* Offset of # of devices in libxl_domain_config */
     int dev_elem_size; /* Size of one device element in array */
@@ -3582,6 +3755,7 @@ struct libxl__destroy_domid_state {
     /* private to implementation */
     libxl__devices_remove_state drs;
     libxl__ev_child destroyer;
+    libxl__ev_time progress_timer;
     bool soft_reset;
 };
 
@@ -3710,6 +3884,11 @@ struct libxl__domain_create_state {
     /* necessary if the domain creation failed and we have to destroy it */
     libxl__domain_destroy_state dds;
     libxl__multidev multidev;
+    /* device model spawned while the disks are being added */
+    bool early_dm;
+    int early_dm_pending, early_dm_rc;
+    /* the whole creation, the current phase of it, the device model */
+    libxl__trace_span trace_create, trace_phase, trace_dm;
 };
 
 _hidden int libxl__device_nic_set_devids(libxl__gc *gc,
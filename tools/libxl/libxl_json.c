@@ -724,46 +724,50 @@ static bool is_decimal(const char *s, unsigned len)
     return false;
 }
 
-static int json_callback_number(void *opaque, const char *s, libxl_yajl_length len)
+/*
+ * Fills in @obj for the NUL terminated number @s, which it keeps pointing
+ * to if the number does not fit in a long long or a double.
+ */
+static void json_number_to_object(libxl__json_object *obj, char *s)
 {
-    libxl__yajl_ctx *ctx = opaque;
-    libxl__json_object *obj = NULL;
-    char *t = NULL;
-
-    DEBUG_GEN_NUMBER(ctx, s, len);
-
-    if (is_decimal(s, len)) {
+    if (is_decimal(s, strlen(s))) {
         double d = strtod(s, NULL);
 
-        if ((d == HUGE_VALF || d == HUGE_VALL) && errno == ERANGE) {
-            goto error;
+        if (!((d == HUGE_VALF || d == HUGE_VALL) && errno == ERANGE)) {
+            obj->type = JSON_DOUBLE;
+            obj->u.d = d;
+            return;
         }
-
-        obj = libxl__json_object_alloc(ctx->gc, JSON_DOUBLE);
-        obj->u.d = d;
     } else {
         long long i = strtoll(s, NULL, 10);
 
-        if ((i == LLONG_MIN || i == LLONG_MAX) && errno == ERANGE) {
-            goto error;
+        if (!((i == LLONG_MIN || i == LLONG_MAX) && errno == ERANGE)) {
+            obj->type = JSON_INTEGER;
+            obj->u.i = i;
+            return;
         }
-
-        obj = libxl__json_object_alloc(ctx->gc, JSON_INTEGER);
-        obj->u.i = i;
     }
-    goto out;
 
-error:
     /* If the conversion fail, we just store the original string. */
-    obj = libxl__json_object_alloc(ctx->gc, JSON_NUMBER);
+    obj->type = JSON_NUMBER;
+    obj->u.string = s;
+}
+
+static int json_callback_number(void *opaque, const char *s, libxl_yajl_length len)
+{
+    libxl__yajl_ctx *ctx = opaque;
+    libxl__json_object *obj = NULL;
+    char *t = NULL;
+
+    DEBUG_GEN_NUMBER(ctx, s, len);
 
     t = libxl__zalloc(ctx->gc, len + 1);
     strncpy(t, s, len);
     t[len] = 0;
 
-    obj->u.string = t;
+    obj = libxl__json_object_alloc(ctx->gc, JSON_NULL);
+    json_number_to_object(obj, t);
 
-out:
     if (libxl__json_object_append_to(ctx->gc, obj, ctx))
         return 0;
 
@@ -1068,6 +1072,358 @@ out:
     return rc;
 }
 
+/*
+ * Streaming parser
+ */
+
+/* Nesting follows the IDL, so this is plenty. */
+#define JSON_STREAM_MAX_DEPTH 32
+
+typedef struct {
+    const libxl__json_stream_type *type;
+    char *p;
+    /* STRUCT: the field the next value is for, as found from its key. */
+    const libxl__json_stream_field *field;
+    /* ARRAY: p points to the array, len to its number of elements. */
+    int *len;
+    int alloc;
+} json_stream_frame;
+
+typedef struct {
+    libxl__gc *gc;
+    const libxl__json_stream_type *root_type;
+    void *root;
+    int rc;
+    json_stream_frame stack[JSON_STREAM_MAX_DEPTH];
+    int depth;
+    /* Nesting level within a map or array which is being ignored. */
+    int skip;
+    /* A map or array for a VALUE, collected as a libxl__json_object. */
+    libxl__yajl_ctx tree;
+    int tree_depth;
+    const libxl__json_stream_type *tree_type;
+    void *tree_p;
+    /* The last string or number, NUL terminated. */
+    char *buf;
+    size_t buf_size;
+} json_stream_ctx;
+
+static char *json_stream_copy(json_stream_ctx *js, const char *s,
+                              libxl_yajl_length len)
+{
+    libxl__gc *gc = js->gc;
+
+    if (len + 1 > js->buf_size) {
+        js->buf_size = len + 1;
+        js->buf = libxl__realloc(NOGC, js->buf, js->buf_size);
+    }
+    memcpy(js->buf, s, len);
+    js->buf[len] = 0;
+
+    return js->buf;
+}
+
+/*
+ * Works out where the next value, of JSON type @jt, goes.  Returns the
+ * type to parse it as, or NULL if it is to be ignored.
+ */
+static const libxl__json_stream_type *json_stream_target(
+    json_stream_ctx *js, libxl__json_node_type jt, void **p, int **len)
+{
+    libxl__gc *gc = js->gc;
+    json_stream_frame *f;
+    const libxl__json_stream_field *field;
+
+    if (!js->depth) {
+        *p = js->root;
+        return js->root_type;
+    }
+
+    f = &js->stack[js->depth - 1];
+    if (f->type->kind == LIBXL__JSON_STREAM_ARRAY) {
+        size_t size = f->type->elem_size;
+        char **array = (char **)f->p;
+
+        /* Elements start out zeroed, like with libxl__calloc. */
+        if (*f->len == f->alloc) {
+            int alloc = f->alloc ? f->alloc * 2 : 4;
+
+            *array = libxl__realloc(NOGC, *array, alloc * size);
+            memset(*array + f->alloc * size, 0, (alloc - f->alloc) * size);
+            f->alloc = alloc;
+        }
+        *p = *array + (*f->len)++ * size;
+        return f->type->elem;
+    }
+
+    field = f->field;
+    f->field = NULL;
+    if (!field || !(jt & field->expected_type))
+        return NULL;
+
+    if (field->init_key)
+        field->init_key(f->p);
+    *p = f->p + field->offset;
+    *len = (int *)(f->p + field->len_offset);
+    return field->type;
+}
+
+static int json_stream_scalar(json_stream_ctx *js, libxl__json_object *obj)
+{
+    const libxl__json_stream_type *type;
+    void *p;
+    int *len = NULL;
+
+    if (js->skip)
+        return 1;
+
+    type = json_stream_target(js, obj->type, &p, &len);
+    if (!type || type->kind != LIBXL__JSON_STREAM_VALUE)
+        return 1;
+
+    js->rc = type->parse(js->gc, obj, p);
+    return !js->rc;
+}
+
+static int json_stream_start(json_stream_ctx *js, libxl__json_node_type jt)
+{
+    const libxl__json_stream_type *type;
+    json_stream_frame *f;
+    void *p;
+    int *len = NULL;
+
+    if (js->skip) {
+        js->skip++;
+        return 1;
+    }
+    if (js->tree_depth) {
+        js->tree_depth++;
+        goto tree;
+    }
+
+    type = json_stream_target(js, jt, &p, &len);
+    if (!type)
+        goto skip;
+
+    switch (type->kind) {
+    case LIBXL__JSON_STREAM_VALUE:
+        memset(&js->tree, 0, sizeof(js->tree));
+        js->tree.gc = js->gc;
+        js->tree_depth = 1;
+        js->tree_type = type;
+        js->tree_p = p;
+        goto tree;
+    case LIBXL__JSON_STREAM_STRUCT:
+        if (jt != JSON_MAP)
+            goto skip;
+        break;
+    case LIBXL__JSON_STREAM_ARRAY:
+        if (jt != JSON_ARRAY)
+            goto skip;
+        *(void **)p = NULL;
+        *len = 0;
+        break;
+    }
+
+    assert(js->depth < JSON_STREAM_MAX_DEPTH);
+    f = &js->stack[js->depth++];
+    f->type = type;
+    f->p = p;
+    f->field = NULL;
+    f->len = len;
+    f->alloc = 0;
+    return 1;
+
+tree:
+    if (jt == JSON_MAP)
+        return json_callback_start_map(&js->tree);
+    return json_callback_start_array(&js->tree);
+
+skip:
+    js->skip = 1;
+    return 1;
+}
+
+static int json_stream_end(json_stream_ctx *js, libxl__json_node_type jt)
+{
+    int ok;
+
+    if (js->skip) {
+        js->skip--;
+        return 1;
+    }
+
+    if (js->tree_depth) {
+        if (jt == JSON_MAP)
+            ok = json_callback_end_map(&js->tree);
+        else
+            ok = json_callback_end_array(&js->tree);
+        if (!ok || --js->tree_depth)
+            return ok;
+
+        js->rc = js->tree_type->parse(js->gc, js->tree.head, js->tree_p);
+        return !js->rc;
+    }
+
+    assert(js->depth);
+    js->depth--;
+    return 1;
+}
+
+static int json_stream_null(void *opaque)
+{
+    json_stream_ctx *js = opaque;
+    libxl__json_object obj = { .type = JSON_NULL };
+
+    if (js->tree_depth)
+        return json_callback_null(&js->tree);
+
+    return json_stream_scalar(js, &obj);
+}
+
+static int json_stream_boolean(void *opaque, int boolean)
+{
+    json_stream_ctx *js = opaque;
+    libxl__json_object obj = { .type = JSON_BOOL, .u.b = boolean };
+
+    if (js->tree_depth)
+        return json_callback_boolean(&js->tree, boolean);
+
+    return json_stream_scalar(js, &obj);
+}
+
+static int json_stream_number(void *opaque, const char *s,
+                              libxl_yajl_length len)
+{
+    json_stream_ctx *js = opaque;
+    libxl__json_object obj = { .type = JSON_NULL };
+
+    if (js->tree_depth)
+        return json_callback_number(&js->tree, s, len);
+
+    json_number_to_object(&obj, json_stream_copy(js, s, len));
+    return json_stream_scalar(js, &obj);
+}
+
+static int json_stream_string(void *opaque, const unsigned char *str,
+                              libxl_yajl_length len)
+{
+    json_stream_ctx *js = opaque;
+    libxl__json_object obj = { .type = JSON_STRING };
+
+    if (js->tree_depth)
+        return json_callback_string(&js->tree, str, len);
+
+    obj.u.string = json_stream_copy(js, (const char *)str, len);
+    return json_stream_scalar(js, &obj);
+}
+
+static int json_stream_map_key(void *opaque, const unsigned char *str,
+                               libxl_yajl_length len)
+{
+    json_stream_ctx *js = opaque;
+    json_stream_frame *f;
+    const libxl__json_stream_field *field;
+
+    if (js->skip)
+        return 1;
+    if (js->tree_depth)
+        return json_callback_map_key(&js->tree, str, len);
+
+    /* Maps only get a frame when they are a STRUCT. */
+    f = &js->stack[js->depth - 1];
+    for (field = f->type->fields; field->name; field++) {
+        if (!strncmp(field->name, (const char *)str, len) &&
+            !field->name[len])
+            break;
+    }
+    f->field = field->name ? field : NULL;
+
+    return 1;
+}
+
+static int json_stream_start_map(void *opaque)
+{
+    return json_stream_start(opaque, JSON_MAP);
+}
+
+static int json_stream_end_map(void *opaque)
+{
+    return json_stream_end(opaque, JSON_MAP);
+}
+
+static int json_stream_start_array(void *opaque)
+{
+    return json_stream_start(opaque, JSON_ARRAY);
+}
+
+static int json_stream_end_array(void *opaque)
+{
+    return json_stream_end(opaque, JSON_ARRAY);
+}
+
+static yajl_callbacks stream_callbacks = {
+    json_stream_null,
+    json_stream_boolean,
+    NULL,
+    NULL,
+    json_stream_number,
+    json_stream_string,
+    json_stream_start_map,
+    json_stream_map_key,
+    json_stream_end_map,
+    json_stream_start_array,
+    json_stream_end_array
+};
+
+int libxl__object_from_json_stream(libxl_ctx *ctx, const char *type,
+                                   const libxl__json_stream_type *desc,
+                                   void *p, const char *s)
+{
+    GC_INIT(ctx);
+    json_stream_ctx js;
+    yajl_handle hand;
+    yajl_status status;
+    unsigned char *str;
+    int rc;
+
+    memset(&js, 0, sizeof(js));
+    js.gc = gc;
+    js.root_type = desc;
+    js.root = p;
+
+    hand = libxl__yajl_alloc(&stream_callbacks, NULL, &js);
+    if (!hand) {
+        rc = ERROR_NOMEM;
+        goto out;
+    }
+
+    status = yajl_parse(hand, (const unsigned char *)s, strlen(s));
+    if (status == yajl_status_ok)
+        status = yajl_complete_parse(hand);
+    if (status != yajl_status_ok) {
+        if (js.rc) {
+            LOG(ERROR, "unable to convert JSON representation to %s. (rc=%d)",
+                type, js.rc);
+        } else {
+            str = yajl_get_error(hand, 1, (const unsigned char *)s, strlen(s));
+            LOG(ERROR, "unable to parse JSON representation of %s: %s",
+                type, str);
+            yajl_free_error(hand, str);
+        }
+        rc = ERROR_FAIL;
+        goto out;
+    }
+
+    rc = 0;
+out:
+    if (hand)
+        yajl_free(hand);
+    free(js.buf);
+    GC_FREE;
+    return rc;
+}
+
 int libxl__int_parse_json(libxl__gc *gc, const libxl__json_object *o,
                           void *p)
 {
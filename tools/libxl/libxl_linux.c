@@ -16,6 +16,14 @@
 #include "libxl_osdeps.h" /* must come before any other headers */
 
 #include "libxl_internal.h"
+
+#include <glob.h>
+#include <mntent.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <net/ethernet.h>
+#include <linux/loop.h>
+#include <linux/sockios.h>
  
 int libxl__try_phy_backend(mode_t st_mode)
 {
@@ -93,6 +101,620 @@ static char **get_hotplug_env(libxl__gc *gc,
     return env;
 }
 
+/*
+ * Native hotplug
+ *
+ * For the common cases (a vif on a Linux bridge, a disk backed by a
+ * block device or a file), do what the stock vif-bridge and block
+ * scripts would do here rather than forking a shell.  Each of these
+ * returns 0 if the device was dealt with, 1 if the script should be
+ * run instead (anything unusual is left to the scripts) or a libxl
+ * error code.  The environment variable LIBXL_NATIVE_HOTPLUG=0 turns
+ * this off.
+ */
+
+#define HOTPLUG_LOCK_DIR "/var/run/xen-hotplug"
+
+static bool hotplug_native_enabled(libxl__gc *gc, const char *script,
+                                   const char *name)
+{
+    const char *env = getenv("LIBXL_NATIVE_HOTPLUG");
+
+    if (env && !strcmp(env, "0"))
+        return false;
+
+    /* Only replace the stock script, not one the user has chosen. */
+    return !strcmp(script, GCSPRINTF("%s/%s", libxl__xen_script_dir_path(),
+                                     name));
+}
+
+static int netdev_ioctl(libxl__gc *gc, unsigned long req, struct ifreq *ifr)
+{
+    int fd, r;
+
+    fd = socket(AF_LOCAL, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    r = ioctl(fd, req, ifr);
+    close(fd);
+    return r;
+}
+
+static int netdev_set_up(libxl__gc *gc, const char *dev, bool up)
+{
+    struct ifreq ifr;
+
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, dev, IFNAMSIZ - 1);
+    if (netdev_ioctl(gc, SIOCGIFFLAGS, &ifr))
+        return -1;
+    if (up)
+        ifr.ifr_flags |= IFF_UP;
+    else
+        ifr.ifr_flags &= ~IFF_UP;
+    return netdev_ioctl(gc, SIOCSIFFLAGS, &ifr);
+}
+
+static int netdev_rename(libxl__gc *gc, uint32_t domid,
+                         const char *dev, const char *name)
+{
+    struct ifreq ifr;
+
+    if (if_nametoindex(name)) {
+        LOGD(ERROR, domid, "Cannot rename interface %s. An interface with "
+             "name %s already exists.", dev, name);
+        return ERROR_FAIL;
+    }
+
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, dev, IFNAMSIZ - 1);
+    strncpy(ifr.ifr_newname, name, IFNAMSIZ - 1);
+    if (netdev_ioctl(gc, SIOCSIFNAME, &ifr)) {
+        LOGED(ERROR, domid, "unable to rename %s to %s", dev, name);
+        return ERROR_FAIL;
+    }
+    return 0;
+}
+
+/* As vif-bridge: setup_virtual_bridge_port, set_mtu and add_to_bridge. */
+static int bridge_add_port(libxl__gc *gc, uint32_t domid,
+                           const char *bridge, const char *dev)
+{
+    struct ifreq ifr;
+    int ifindex = if_nametoindex(dev);
+
+    if (!ifindex) {
+        LOGED(ERROR, domid, "%s does not exist", dev);
+        return ERROR_FAIL;
+    }
+
+    if (!access(GCSPRINTF("/sys/class/net/%s/brif/%s", bridge, dev), F_OK))
+        goto up;
+
+    netdev_set_up(gc, dev, false);
+
+    /*
+     * Use the numerically largest non-broadcast address so that the
+     * bridge does not pick the vif's address for itself.  A new vif has
+     * no IP addresses, so unlike the script we need not flush them.
+     */
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, dev, IFNAMSIZ - 1);
+    ifr.ifr_hwaddr.sa_family = ARPHRD_ETHER;
+    memset(ifr.ifr_hwaddr.sa_data, 0xff, ETH_ALEN);
+    ifr.ifr_hwaddr.sa_data[0] = 0xfe;
+    if (netdev_ioctl(gc, SIOCSIFHWADDR, &ifr))
+        LOGED(DEBUG, domid, "unable to set MAC address of %s", dev);
+
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, bridge, IFNAMSIZ - 1);
+    if (!netdev_ioctl(gc, SIOCGIFMTU, &ifr) && ifr.ifr_mtu > 0) {
+        strncpy(ifr.ifr_name, dev, IFNAMSIZ - 1);
+        if (netdev_ioctl(gc, SIOCSIFMTU, &ifr))
+            LOGED(DEBUG, domid, "unable to set MTU of %s", dev);
+    }
+
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, bridge, IFNAMSIZ - 1);
+    ifr.ifr_ifindex = ifindex;
+    if (netdev_ioctl(gc, SIOCBRADDIF, &ifr)) {
+        LOGED(ERROR, domid, "unable to add %s to bridge %s", dev, bridge);
+        return ERROR_FAIL;
+    }
+
+ up:
+    if (netdev_set_up(gc, dev, true)) {
+        LOGED(ERROR, domid, "unable to bring up %s", dev);
+        return ERROR_FAIL;
+    }
+    return 0;
+}
+
+static void bridge_del_port(libxl__gc *gc, uint32_t domid,
+                            const char *bridge, const char *dev)
+{
+    struct ifreq ifr;
+
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, bridge, IFNAMSIZ - 1);
+    ifr.ifr_ifindex = if_nametoindex(dev);
+    if (!ifr.ifr_ifindex || netdev_ioctl(gc, SIOCBRDELIF, &ifr))
+        LOGED(DEBUG, domid, "unable to remove %s from bridge %s", dev, bridge);
+    if (netdev_set_up(gc, dev, false))
+        LOGED(DEBUG, domid, "unable to bring down %s", dev);
+}
+
+/*
+ * vif-bridge also installs iptables rules and runs vif-post.d hooks.
+ * We don't, so leave it to the script whenever either would matter.
+ */
+static bool vif_needs_script(libxl__gc *gc)
+{
+    char name[32];
+    bool filter = false;
+    glob_t g;
+    bool hooks;
+    FILE *f;
+
+    f = fopen("/proc/net/ip_tables_names", "r");
+    if (f) {
+        while (!filter && fgets(name, sizeof(name), f))
+            filter = !strcmp(name, "filter\n");
+        fclose(f);
+        if (filter)
+            return true;
+    }
+
+    hooks = !glob(GCSPRINTF("%s/vif-post.d/*.hook",
+                            libxl__xen_script_dir_path()), 0, NULL, &g);
+    globfree(&g);
+    return hooks;
+}
+
+static int hotplug_nic_native(libxl__gc *gc, libxl__device *dev,
+                              const char *script, libxl_nic_type nictype,
+                              libxl__device_action action)
+{
+    char *be_path = libxl__device_backend_path(gc, dev);
+    const char *bridge, *vifname, *vif, *tap;
+    int rc;
+
+    if (!hotplug_native_enabled(gc, script, "vif-bridge") ||
+        vif_needs_script(gc))
+        return 1;
+
+    rc = libxl__xs_read_checked(gc, XBT_NULL,
+                                GCSPRINTF("%s/bridge", be_path), &bridge);
+    if (rc) return rc;
+    rc = libxl__xs_read_checked(gc, XBT_NULL,
+                                GCSPRINTF("%s/vifname", be_path), &vifname);
+    if (rc) return rc;
+
+    /* Let the script guess a missing bridge. */
+    if (!bridge || !*bridge)
+        return 1;
+
+    /* Old style xenbrX names, see vif-bridge. */
+    if (access(GCSPRINTF("/sys/class/net/%s", bridge), F_OK) &&
+        !strncmp(bridge, "xenbr", 5) &&
+        !access(GCSPRINTF("/sys/class/net/eth%s/bridge", bridge + 5), F_OK))
+        bridge = GCSPRINTF("eth%s", bridge + 5);
+
+    /* Not a Linux bridge, e.g. an openvswitch one. */
+    if (access(GCSPRINTF("/sys/class/net/%s/bridge", bridge), F_OK))
+        return 1;
+
+    vif = libxl__device_nic_devname(gc, dev->domid, dev->devid,
+                                    LIBXL_NIC_TYPE_VIF);
+    if (vifname && !*vifname)
+        vifname = NULL;
+
+    if (action != LIBXL__DEVICE_ACTION_ADD) {
+        bridge_del_port(gc, dev->domid, bridge, vifname ?: vif);
+        return 0;
+    }
+
+    if (vifname) {
+        rc = netdev_rename(gc, dev->domid, vif, vifname);
+        if (rc) return rc;
+        vif = vifname;
+    }
+    rc = bridge_add_port(gc, dev->domid, bridge, vif);
+    if (rc) return rc;
+
+    /*
+     * The emulated nic would otherwise be handled by a second run of the
+     * script; do it now as we tell our caller there is nothing left to do.
+     */
+    if (nictype == LIBXL_NIC_TYPE_VIF_IOEMU &&
+        !libxl_get_stubdom_id(CTX, dev->domid)) {
+        tap = libxl__device_nic_devname(gc, dev->domid, dev->devid,
+                                        LIBXL_NIC_TYPE_VIF_IOEMU);
+        if (vifname) {
+            rc = netdev_rename(gc, dev->domid, tap,
+                               GCSPRINTF("%s-emu", vifname));
+            if (rc) return rc;
+            tap = GCSPRINTF("%s-emu", vifname);
+        }
+        rc = bridge_add_port(gc, dev->domid, bridge, tap);
+        if (rc) return rc;
+    }
+
+    LOGD(DEBUG, dev->domid, "Native vif-bridge online for %s, bridge %s",
+         vif, bridge);
+    return libxl__xs_printf(gc, XBT_NULL,
+                            GCSPRINTF("%s/hotplug-status", be_path),
+                            "connected");
+}
+
+/*
+ * Serialise against other native and script invocations, using the same
+ * lock file, and the same protocol, as claim_lock in locking.sh.
+ */
+static int block_lock(libxl__gc *gc)
+{
+    const char *lockfile = HOTPLUG_LOCK_DIR "/block";
+    struct stat stab, fstab;
+    int fd;
+
+    if (mkdir(HOTPLUG_LOCK_DIR, 0755) && errno != EEXIST)
+        return -1;
+
+    for (;;) {
+        fd = open(lockfile, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+        if (fd < 0)
+            return -1;
+
+        while (flock(fd, LOCK_EX)) {
+            if (errno != EINTR) {
+                close(fd);
+                return -1;
+            }
+        }
+
+        if (!fstat(fd, &fstab) && !stat(lockfile, &stab) &&
+            stab.st_dev == fstab.st_dev && stab.st_ino == fstab.st_ino)
+            return fd;
+
+        close(fd);
+    }
+}
+
+static void block_unlock(int fd)
+{
+    unlink(HOTPLUG_LOCK_DIR "/block");
+    close(fd);
+}
+
+/* As canonicalise_mode in block-common.sh. */
+static char block_mode(const char *mode)
+{
+    if (!mode || !strchr(mode, 'w'))
+        return 'r';
+    return strchr(mode, '!') ? '!' : 'w';
+}
+
+static const char *domain_vm(libxl__gc *gc, const char *domid)
+{
+    return libxl__xs_read(gc, XBT_NULL,
+                          GCSPRINTF("/local/domain/%s/vm", domid));
+}
+
+/* As same_vm in block-common.sh, including device model stubdoms. */
+static bool block_same_vm(libxl__gc *gc, uint32_t domid, const char *other)
+{
+    const char *vm = domain_vm(gc, GCSPRINTF("%u", domid));
+    const char *othervm = domain_vm(gc, other);
+    const char *target, *vms[2], *othervms[2];
+    int i, j;
+
+    if (!othervm)
+        return true;
+
+    target = libxl__xs_read(gc, XBT_NULL,
+                            GCSPRINTF("/local/domain/%u/target", domid));
+    vms[0] = vm;
+    vms[1] = target ? domain_vm(gc, target) : NULL;
+    target = libxl__xs_read(gc, XBT_NULL,
+                            GCSPRINTF("/local/domain/%s/target", other));
+    othervms[0] = othervm;
+    othervms[1] = target ? domain_vm(gc, target) : NULL;
+
+    for (i = 0; i < 2; i++)
+        for (j = 0; j < 2; j++)
+            if (vms[i] && othervms[j] && !strcmp(vms[i], othervms[j]))
+                return true;
+    return false;
+}
+
+/*
+ * The loop devices currently backed by @st, which is the file we are
+ * about to attach.  losetup -a in check_sharing does the same.
+ */
+static int block_file_loopdevs(libxl__gc *gc, const struct stat *st,
+                               dev_t **devs_r)
+{
+    DIR *dir = opendir("/sys/block");
+    struct dirent *de;
+    struct loop_info64 info;
+    dev_t *devs = NULL;
+    int n = 0, fd;
+    struct stat lst;
+
+    if (!dir)
+        return 0;
+
+    while ((de = readdir(dir))) {
+        const char *path;
+
+        if (strncmp(de->d_name, "loop", 4))
+            continue;
+        path = GCSPRINTF("/dev/%s", de->d_name);
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            continue;
+        if (!ioctl(fd, LOOP_GET_STATUS64, &info) &&
+            info.lo_device == st->st_dev && info.lo_inode == st->st_ino &&
+            !fstat(fd, &lst)) {
+            GCREALLOC_ARRAY(devs, n + 1);
+            devs[n++] = lst.st_rdev;
+        }
+        close(fd);
+    }
+    closedir(dir);
+
+    *devs_r = devs;
+    return n;
+}
+
+static bool block_dev_in(dev_t d, const dev_t *devs, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        if (devs[i] == d)
+            return true;
+    return false;
+}
+
+/* As check_sharing in block: may these devices be used in @mode? */
+static int block_check_sharing(libxl__gc *gc, libxl__device *dev,
+                               const dev_t *devs, int n, char mode)
+{
+    const char *base = GCSPRINTF("/local/domain/%u/backend/vbd",
+                                 dev->backend_domid);
+    char **doms, **vbds;
+    unsigned int ndoms, nvbds, i, j;
+    struct mntent *m;
+    struct stat st;
+    FILE *f;
+
+    f = setmntent("/proc/mounts", "r");
+    if (f) {
+        while ((m = getmntent(f))) {
+            if (mode != 'w' && hasmntopt(m, "ro"))
+                continue;
+            if (!stat(m->mnt_fsname, &st) && S_ISBLK(st.st_mode) &&
+                block_dev_in(st.st_rdev, devs, n)) {
+                endmntent(f);
+                LOGD(ERROR, dev->domid, "%s is mounted in the privileged "
+                     "domain, and so cannot be used by a guest", m->mnt_fsname);
+                return ERROR_FAIL;
+            }
+        }
+        endmntent(f);
+    }
+
+    doms = libxl__xs_directory(gc, XBT_NULL, base, &ndoms);
+    for (i = 0; i < ndoms; i++) {
+        vbds = libxl__xs_directory(gc, XBT_NULL,
+                                   GCSPRINTF("%s/%s", base, doms[i]), &nvbds);
+        for (j = 0; j < nvbds; j++) {
+            const char *path = GCSPRINTF("%s/%s/%s", base, doms[i], vbds[j]);
+            const char *pdev, *omode;
+            unsigned int major, minor;
+
+            pdev = libxl__xs_read(gc, XBT_NULL,
+                                  GCSPRINTF("%s/physical-device", path));
+            if (!pdev || sscanf(pdev, "%x:%x", &major, &minor) != 2 ||
+                !block_dev_in(makedev(major, minor), devs, n))
+                continue;
+
+            if (mode != 'w') {
+                omode = libxl__xs_read(gc, XBT_NULL,
+                                       GCSPRINTF("%s/mode", path));
+                if (block_mode(omode) != 'w')
+                    continue;
+            }
+            if (!block_same_vm(gc, dev->domid, doms[i])) {
+                LOGD(ERROR, dev->domid, "device %s is already in use by "
+                     "domain %s", pdev, doms[i]);
+                return ERROR_FAIL;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static int block_loop_attach(libxl__gc *gc, uint32_t domid,
+                             const char *file, char mode, const char **node_r)
+{
+    struct loop_info64 info;
+    const char *node = NULL;
+    int ctl, lfd = -1, ffd, flags, n, rc = ERROR_FAIL;
+
+    flags = (mode == 'r' ? O_RDONLY : O_RDWR) | O_CLOEXEC;
+    ffd = open(file, flags);
+    if (ffd < 0) {
+        LOGED(ERROR, domid, "unable to open %s", file);
+        return ERROR_FAIL;
+    }
+
+    ctl = open("/dev/loop-control", O_RDWR | O_CLOEXEC);
+    if (ctl < 0) {
+        LOGED(ERROR, domid, "unable to open /dev/loop-control");
+        goto out;
+    }
+
+    /* Someone else may grab the free device before we do; try again. */
+    for (;;) {
+        n = ioctl(ctl, LOOP_CTL_GET_FREE);
+        if (n < 0) {
+            LOGED(ERROR, domid, "Failed to find an unused loop device");
+            goto out;
+        }
+        node = GCSPRINTF("/dev/loop%d", n);
+        lfd = open(node, flags);
+        if (lfd < 0) {
+            LOGED(ERROR, domid, "unable to open %s", node);
+            goto out;
+        }
+        if (!ioctl(lfd, LOOP_SET_FD, ffd))
+            break;
+        if (errno != EBUSY) {
+            LOGED(ERROR, domid, "unable to attach %s to %s", file, node);
+            goto out;
+        }
+        close(lfd);
+        lfd = -1;
+    }
+
+    memset(&info, 0, sizeof(info));
+    strncpy((char *)info.lo_file_name, file, LO_NAME_SIZE - 1);
+    if (ioctl(lfd, LOOP_SET_STATUS64, &info))
+        LOGED(DEBUG, domid, "unable to set name of %s", node);
+
+    *node_r = node;
+    rc = 0;
+
+ out:
+    if (lfd >= 0) close(lfd);
+    if (ctl >= 0) close(ctl);
+    close(ffd);
+    return rc;
+}
+
+static void block_loop_detach(libxl__gc *gc, uint32_t domid, const char *node)
+{
+    int fd = open(node, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0 || ioctl(fd, LOOP_CLR_FD, 0))
+        LOGED(ERROR, domid, "unable to detach %s", node);
+    if (fd >= 0)
+        close(fd);
+}
+
+static int hotplug_disk_native(libxl__gc *gc, libxl__device *dev,
+                               const char *script,
+                               libxl__device_action action)
+{
+    char *be_path = libxl__device_backend_path(gc, dev);
+    const char *params, *mode, *node = NULL, *pdev;
+    char *path = NULL;
+    struct stat st;
+    dev_t *devs = NULL;
+    int n, lockfd = -1, rc;
+    char m;
+
+    if (!hotplug_native_enabled(gc, script, "block"))
+        return 1;
+
+    if (action != LIBXL__DEVICE_ACTION_ADD) {
+        rc = libxl__xs_read_checked(gc, XBT_NULL,
+                                    GCSPRINTF("%s/node", be_path), &node);
+        if (rc) return rc;
+        if (node && !strncmp(node, "/dev/loop", 9)) {
+            lockfd = block_lock(gc);
+            block_loop_detach(gc, dev->domid, node);
+            if (lockfd >= 0) block_unlock(lockfd);
+        }
+        return 0;
+    }
+
+    rc = libxl__xs_read_checked(gc, XBT_NULL,
+                                GCSPRINTF("%s/physical-device", be_path),
+                                &pdev);
+    if (rc) return rc;
+    /* The script may be called twice, see block. */
+    if (pdev)
+        return 0;
+
+    params = libxl__xs_read(gc, XBT_NULL, GCSPRINTF("%s/params", be_path));
+    mode = libxl__xs_read(gc, XBT_NULL, GCSPRINTF("%s/mode", be_path));
+    if (!params)
+        return 1;
+
+    path = realpath(params, NULL);
+    if (!path || stat(path, &st) ||
+        !(S_ISBLK(st.st_mode) || S_ISREG(st.st_mode))) {
+        /* Not phy or file: let the script report it or run block-$type. */
+        free(path);
+        return 1;
+    }
+    libxl__ptr_add(gc, path);
+    m = block_mode(mode);
+
+    lockfd = block_lock(gc);
+    if (lockfd < 0) {
+        LOGED(ERROR, dev->domid, "unable to take block hotplug lock");
+        return ERROR_FAIL;
+    }
+
+    if (S_ISBLK(st.st_mode)) {
+        if (m != '!') {
+            rc = block_check_sharing(gc, dev, &st.st_rdev, 1, m);
+            if (rc) goto out;
+        }
+    } else {
+        if (m == 'w' && access(path, W_OK)) {
+            LOGD(ERROR, dev->domid, "File %s is read-only, and so I will not "
+                 "mount it read-write in a guest domain.", path);
+            rc = ERROR_FAIL;
+            goto out;
+        }
+        if (m != '!') {
+            n = block_file_loopdevs(gc, &st, &devs);
+            if (n) {
+                rc = block_check_sharing(gc, dev, devs, n, m);
+                if (rc) goto out;
+            }
+        }
+
+        rc = block_loop_attach(gc, dev->domid, path, m, &node);
+        if (rc) goto out;
+        if (stat(node, &st)) {
+            LOGED(ERROR, dev->domid, "unable to stat %s", node);
+            block_loop_detach(gc, dev->domid, node);
+            rc = ERROR_FAIL;
+            goto out;
+        }
+        path = (char *)node;
+        rc = libxl__xs_printf(gc, XBT_NULL, GCSPRINTF("%s/node", be_path),
+                              "%s", node);
+        if (rc) goto out;
+    }
+
+    rc = libxl__xs_printf(gc, XBT_NULL,
+                          GCSPRINTF("%s/physical-device", be_path),
+                          "%x:%x", major(st.st_rdev), minor(st.st_rdev));
+    if (rc) goto out;
+    rc = libxl__xs_printf(gc, XBT_NULL,
+                          GCSPRINTF("%s/physical-device-path", be_path),
+                          "%s", path);
+    if (rc) goto out;
+    rc = libxl__xs_printf(gc, XBT_NULL,
+                          GCSPRINTF("%s/hotplug-status", be_path),
+                          "connected");
+    if (rc) goto out;
+
+    LOGD(DEBUG, dev->domid, "Native block add for %s", path);
+
+ out:
+    block_unlock(lockfd);
+    return rc;
+}
+
 /* Hotplug scripts caller functions */
 
 static int libxl__hotplug_nic(libxl__gc *gc, libxl__device *dev,
@@ -124,6 +746,12 @@ static int libxl__hotplug_nic(libxl__gc *gc, libxl__device *dev,
         goto out;
     }
 
+    if (num_exec == 0) {
+        rc = hotplug_nic_native(gc, dev, script, nictype, action);
+        if (rc <= 0)
+            goto out;
+    }
+
     *env = get_hotplug_env(gc, script, dev);
     if (!*env) {
         rc = ERROR_FAIL;
@@ -168,6 +796,10 @@ static int libxl__hotplug_disk(libxl__gc *gc, libxl__device *dev,
         goto error;
     }
 
+    rc = hotplug_disk_native(gc, dev, script, action);
+    if (rc <= 0)
+        goto error;
+
     *env = get_hotplug_env(gc, script, dev);
     if (!*env) {
         LOGD(ERROR, dev->domid, "Failed to get hotplug environment");
@@ -592,6 +592,215 @@ out:
     return rc;
 }
 
+/*----- waiting for memory without blocking -----*/
+
+#define MEMORY_WAIT_POLL_MS 200
+
+typedef struct {
+    libxl__ao *ao;
+    uint32_t domid;
+    uint64_t need_memkb;
+    uint64_t prev_memkb;
+    int stall_ms_left;
+    libxl__ev_time poll;
+} libxl__memory_wait_state;
+
+static void memory_wait_check(libxl__egc *egc, libxl__memory_wait_state *mws);
+
+static void memory_wait_poll_cb(libxl__egc *egc, libxl__ev_time *ev,
+                                const struct timeval *requested_abs, int rc)
+{
+    libxl__memory_wait_state *mws = CONTAINER_OF(ev, *mws, poll);
+    STATE_AO_GC(mws->ao);
+
+    libxl__ev_time_deregister(gc, &mws->poll);
+
+    if (rc == ERROR_ABORTED) {
+        libxl__ao_complete(egc, ao, rc);
+        return;
+    }
+
+    memory_wait_check(egc, mws);
+}
+
+static void memory_wait_check(libxl__egc *egc, libxl__memory_wait_state *mws)
+{
+    STATE_AO_GC(mws->ao);
+    libxl_dominfo info;
+    uint64_t free_memkb, current_memkb;
+    int rc;
+
+    libxl_dominfo_init(&info);
+
+    rc = libxl_get_free_memory(CTX, &free_memkb);
+    if (rc) goto out;
+    if (free_memkb >= mws->need_memkb)
+        goto out;
+
+    rc = libxl_domain_info(CTX, &info, mws->domid);
+    if (rc) goto out;
+
+    /* Only count the time during which the domain gives nothing back. */
+    current_memkb = info.current_memkb + info.outstanding_memkb;
+    if (current_memkb >= mws->prev_memkb)
+        mws->stall_ms_left -= MEMORY_WAIT_POLL_MS;
+    mws->prev_memkb = current_memkb;
+
+    if (mws->stall_ms_left <= 0) {
+        LOGD(ERROR, mws->domid, "Only %"PRIu64" of %"PRIu64" KiB free, and "
+             "the domain stopped releasing memory", free_memkb,
+             mws->need_memkb);
+        rc = ERROR_NOMEM;
+        goto out;
+    }
+
+    rc = libxl__ev_time_register_rel(ao, &mws->poll, memory_wait_poll_cb,
+                                     MEMORY_WAIT_POLL_MS);
+    if (rc) goto out;
+
+    libxl_dominfo_dispose(&info);
+    return;
+
+ out:
+    libxl_dominfo_dispose(&info);
+    libxl__ao_complete(egc, ao, rc);
+}
+
+int libxl_wait_for_memory_available(libxl_ctx *ctx, uint32_t domid,
+                                    uint64_t memory_kb, int wait_secs,
+                                    const libxl_asyncop_how *ao_how)
+{
+    AO_CREATE(ctx, domid, ao_how);
+    libxl__memory_wait_state *mws;
+
+    GCNEW(mws);
+    mws->ao = ao;
+    mws->domid = domid;
+    mws->need_memkb = memory_kb;
+    mws->prev_memkb = UINT64_MAX;
+    mws->stall_ms_left = wait_secs * 1000;
+    libxl__ev_time_init(&mws->poll);
+
+    memory_wait_check(egc, mws);
+
+    return AO_INPROGRESS;
+}
+
+/*----- moving memory onto the domain's nodes -----*/
+
+/*
+ * Each step pauses the domain while it looks at REHOME_CHUNK_GFNS gfns,
+ * copying up to that many pages.  Between steps the domain runs for at
+ * least REHOME_INTERVAL_MS.
+ */
+#define REHOME_CHUNK_GFNS       1024
+#define REHOME_INTERVAL_MS         5
+#define REHOME_REPORT_STEPS      256
+
+typedef struct {
+    libxl__ao *ao;
+    uint32_t domid;
+    uint64_t gfn, max_gfn;
+    uint64_t moved, busy;
+    unsigned int steps;
+    libxl_asyncprogress_how aop_how;
+    libxl__ev_time step;
+} libxl__rehome_state;
+
+static void rehome_step(libxl__egc *egc, libxl__rehome_state *rhs);
+
+static void rehome_report(libxl__egc *egc, libxl__rehome_state *rhs)
+{
+    STATE_AO_GC(rhs->ao);
+    libxl_event *ev;
+
+    ev = NEW_EVENT(egc, DOMAIN_MEMORY_REHOME_PROGRESS, rhs->domid,
+                   rhs->aop_how.for_event);
+    ev->u.domain_memory_rehome_progress.gfns_done =
+        rhs->gfn > rhs->max_gfn ? rhs->max_gfn + 1 : rhs->gfn;
+    ev->u.domain_memory_rehome_progress.gfns_total = rhs->max_gfn + 1;
+    ev->u.domain_memory_rehome_progress.moved_pages = rhs->moved;
+    ev->u.domain_memory_rehome_progress.busy_pages = rhs->busy;
+    libxl__ao_progress_report(egc, ao, &rhs->aop_how, ev);
+}
+
+static void rehome_step_cb(libxl__egc *egc, libxl__ev_time *ev,
+                           const struct timeval *requested_abs, int rc)
+{
+    libxl__rehome_state *rhs = CONTAINER_OF(ev, *rhs, step);
+    STATE_AO_GC(rhs->ao);
+
+    libxl__ev_time_deregister(gc, &rhs->step);
+
+    if (rc == ERROR_ABORTED) {
+        libxl__ao_complete(egc, ao, rc);
+        return;
+    }
+
+    rehome_step(egc, rhs);
+}
+
+static void rehome_step(libxl__egc *egc, libxl__rehome_state *rhs)
+{
+    STATE_AO_GC(rhs->ao);
+    uint32_t moved, busy;
+    int r, rc;
+
+    r = xc_domain_rehome_memory(CTX->xch, rhs->domid, &rhs->gfn,
+                                REHOME_CHUNK_GFNS, &rhs->max_gfn,
+                                &moved, &busy);
+    if (r) {
+        rc = errno == ENOMEM ? ERROR_NOMEM : ERROR_FAIL;
+        LOGED(ERROR, rhs->domid, "Moving memory at gfn 0x%"PRIx64, rhs->gfn);
+        goto out;
+    }
+    rhs->moved += moved;
+    rhs->busy += busy;
+
+    if (rhs->gfn > rhs->max_gfn) {
+        LOGD(DEBUG, rhs->domid, "Moved %"PRIu64" pages, %"PRIu64" stayed "
+             "as they were in use", rhs->moved, rhs->busy);
+        rehome_report(egc, rhs);
+        rc = 0;
+        goto out;
+    }
+
+    if (!(++rhs->steps % REHOME_REPORT_STEPS))
+        rehome_report(egc, rhs);
+
+    rc = libxl__ev_time_register_rel(ao, &rhs->step, rehome_step_cb,
+                                     REHOME_INTERVAL_MS);
+    if (rc) goto out;
+
+    return;
+
+ out:
+    libxl__ao_complete(egc, ao, rc);
+}
+
+int libxl_domain_rehome_memory(libxl_ctx *ctx, uint32_t domid,
+                               const libxl_asyncop_how *ao_how,
+                               const libxl_asyncprogress_how *aop_progress_how)
+{
+    AO_CREATE(ctx, domid, ao_how);
+    libxl__rehome_state *rhs;
+
+    if (libxl__domain_type(gc, domid) != LIBXL_DOMAIN_TYPE_HVM) {
+        LOGD(ERROR, domid, "Only HVM domains' memory can be moved");
+        return AO_CREATE_FAIL(ERROR_INVAL);
+    }
+
+    GCNEW(rhs);
+    rhs->ao = ao;
+    rhs->domid = domid;
+    libxl__ao_progress_gethow(&rhs->aop_how, aop_progress_how);
+    libxl__ev_time_init(&rhs->step);
+
+    rehome_step(egc, rhs);
+
+    return AO_INPROGRESS;
+}
+
 /*
  * Local variables:
  * mode: C
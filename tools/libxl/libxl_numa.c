@@ -104,6 +104,9 @@ static int comb_next(comb_iter_t it, int n, int k)
 
 /* NUMA automatic placement (see libxl_internal.h for details) */
 
+/* Most combinations of nodes evaluated by libxl__get_numa_candidate() */
+#define NUMA_PLACEMENT_MAX_CANDIDATES 65535
+
 /*
  * This function turns a k-combination iterator into a node map,
  * given another map, telling us which nodes should be considered.
@@ -136,45 +139,62 @@ static void comb_get_nodemap(comb_iter_t it, libxl_bitmap *suitable_nodemap,
     }
 }
 
-/* Retrieve the number of cpus that the nodes that are part of the nodemap
- * span and are also set in suitable_cpumap. */
-static int nodemap_to_nr_cpus(libxl_cputopology *tinfo, int nr_cpus,
-                              const libxl_bitmap *suitable_cpumap,
-                              const libxl_bitmap *nodemap)
+/*
+ * Per-node index of the resources the placement looks at, so that the
+ * figures for a candidate are just sums over its nodes, instead of scans
+ * of all the cpus. node_cpus[] only counts the cpus in suitable_cpumap.
+ */
+static void numa_node_index(libxl_numainfo *ninfo, int nr_nodes,
+                            libxl_cputopology *tinfo, int nr_cpus,
+                            const libxl_bitmap *suitable_cpumap,
+                            uint64_t node_free_memkb[], int node_cpus[])
 {
-    int i, nodes_cpus = 0;
+    int i;
+
+    for (i = 0; i < nr_nodes; i++)
+        node_free_memkb[i] = ninfo[i].free / 1024;
 
     for (i = 0; i < nr_cpus; i++) {
-        if (libxl_bitmap_test(suitable_cpumap, i) &&
-            libxl_bitmap_test(nodemap, tinfo[i].node))
-            nodes_cpus++;
+        if (tinfo[i].node < nr_nodes &&
+            libxl_bitmap_test(suitable_cpumap, i))
+            node_cpus[tinfo[i].node]++;
     }
-    return nodes_cpus;
 }
 
-/* Retrieve the amount of free memory within the nodemap */
-static uint32_t nodemap_to_free_memkb(libxl_numainfo *ninfo,
-                                      libxl_bitmap *nodemap)
+/* Sums of the per-node figures over the nodes of a combination */
+static uint64_t comb_free_memkb(comb_iter_t it, int k, const int suit_nodes[],
+                                const uint64_t node_free_memkb[])
 {
-    uint32_t free_memkb = 0;
+    uint64_t free_memkb = 0;
     int i;
 
-    libxl_for_each_set_bit(i, *nodemap)
-        free_memkb += ninfo[i].free / 1024;
+    for (i = 0; i < k; i++)
+        free_memkb += node_free_memkb[suit_nodes[it[i]]];
 
     return free_memkb;
 }
 
-/* Retrieve the number of vcpus able to run on the nodes in nodemap */
-static int nodemap_to_nr_vcpus(libxl__gc *gc, int vcpus_on_node[],
-                               const libxl_bitmap *nodemap)
+static int comb_sum(comb_iter_t it, int k, const int suit_nodes[],
+                    const int per_node[])
 {
-    int i, nr_vcpus = 0;
+    int i, sum = 0;
 
-    libxl_for_each_set_bit(i, *nodemap)
-        nr_vcpus += vcpus_on_node[i];
+    for (i = 0; i < k; i++)
+        sum += per_node[suit_nodes[it[i]]];
 
-    return nr_vcpus;
+    return sum;
+}
+
+static int cmp_memkb_desc(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+static int cmp_int_desc(const void *a, const void *b)
+{
+    return *(const int *)b - *(const int *)a;
 }
 
 /* Number of vcpus able to run on the cpus of the various nodes
@@ -316,7 +336,9 @@ int libxl__get_numa_candidate(libxl__gc *gc,
     libxl_numainfo *ninfo = NULL;
     int nr_nodes = 0, nr_suit_nodes, nr_cpus = 0;
     libxl_bitmap suitable_nodemap, nodemap;
-    int *vcpus_on_node, rc = 0;
+    int *vcpus_on_node, *node_cpus, *suit_nodes, *top_cpus;
+    uint64_t *node_free_memkb, *top_free_memkb;
+    int i, nr_cndts = 0, rc = 0;
 
     libxl_bitmap_init(&nodemap);
     libxl_bitmap_init(&suitable_nodemap);
@@ -333,32 +355,8 @@ int libxl__get_numa_candidate(libxl__gc *gc,
     }
 
     GCNEW_ARRAY(vcpus_on_node, nr_nodes);
-
-    /*
-     * The good thing about this solution is that it is based on heuristics
-     * (implemented in numa_cmpf() ), but we at least can evaluate it on
-     * all the possible placement candidates. That can happen because the
-     * number of nodes present in current NUMA systems is quite small.
-     * In fact, even if a sum of binomials is involved, if the system has
-     * up to 16 nodes it "only" takes 65535 steps. This is fine, as the
-     * number of nodes the biggest NUMA systems provide at the time of this
-     * writing is 8 (and it will probably continue to be so for a while).
-     * However, computanional complexity would explode on systems bigger
-     * than that, and it's really important we avoid trying to run this
-     * on monsters with 32, 64 or more nodes (if they ever pop into being).
-     * Therefore, here it comes a safety catch that disables the algorithm
-     * for the cases when it wouldn't work well.
-     */
-    if (nr_nodes > 16) {
-        /* Log we did nothing and return 0, as no real error occurred */
-        LOG(WARN, "System has %d NUMA nodes, which is too big for the "
-                  "placement algorithm to work effectively: skipping it. "
-                  "Consider manually pinning the vCPUs and/or looking at "
-                  "cpupools for manually partitioning the system.",
-                  nr_nodes);
-        *cndt_found = 0;
-        goto out;
-    }
+    GCNEW_ARRAY(node_free_memkb, nr_nodes);
+    GCNEW_ARRAY(node_cpus, nr_nodes);
 
     tinfo = libxl_get_cpu_topology(CTX, &nr_cpus);
     if (tinfo == NULL) {
@@ -395,6 +393,9 @@ int libxl__get_numa_candidate(libxl__gc *gc,
     if (rc)
         goto out;
 
+    numa_node_index(ninfo, nr_nodes, tinfo, nr_cpus, suitable_cpumap,
+                    node_free_memkb, node_cpus);
+
     /*
      * If the minimum number of NUMA nodes is not explicitly specified
      * (i.e., min_nodes == 0), we try to figure out a sensible number of nodes
@@ -416,6 +417,30 @@ int libxl__get_numa_candidate(libxl__gc *gc,
      * nodes we are allowed to use. */
     nr_suit_nodes = libxl_bitmap_count_set(&suitable_nodemap);
 
+    /*
+     * The suitable nodes, which the combinations index, and the best a
+     * combination of k of them can possibly offer, in free memory and in
+     * cpus: the sums of the k largest figures. If that's not enough, there
+     * is no point in generating any combination of k nodes.
+     */
+    GCNEW_ARRAY(suit_nodes, nr_suit_nodes);
+    GCNEW_ARRAY(top_free_memkb, nr_suit_nodes + 1);
+    GCNEW_ARRAY(top_cpus, nr_suit_nodes + 1);
+    nr_suit_nodes = 0;
+    libxl_for_each_set_bit(i, suitable_nodemap) {
+        suit_nodes[nr_suit_nodes] = i;
+        top_free_memkb[nr_suit_nodes + 1] = node_free_memkb[i];
+        top_cpus[nr_suit_nodes + 1] = node_cpus[i];
+        nr_suit_nodes++;
+    }
+    qsort(top_free_memkb + 1, nr_suit_nodes, sizeof(*top_free_memkb),
+          cmp_memkb_desc);
+    qsort(top_cpus + 1, nr_suit_nodes, sizeof(*top_cpus), cmp_int_desc);
+    for (i = 1; i <= nr_suit_nodes; i++) {
+        top_free_memkb[i] += top_free_memkb[i - 1];
+        top_cpus[i] += top_cpus[i - 1];
+    }
+
     if (min_nodes > nr_suit_nodes)
         min_nodes = nr_suit_nodes;
     if (!max_nodes || max_nodes > nr_suit_nodes)
@@ -439,12 +464,24 @@ int libxl__get_numa_candidate(libxl__gc *gc,
      * could find during the (i+1)-eth and all the subsequent steps (they
      * all will have more nodes). It's thus pointless to keep going if
      * we already found something.
+     *
+     * The number of combinations explodes with the number of nodes, so no
+     * more than NUMA_PLACEMENT_MAX_CANDIDATES of them are generated: that
+     * is all of them on up to 16 nodes, while on bigger hosts the search
+     * stops with the best candidate found so far, if any.
      */
     *cndt_found = 0;
-    while (min_nodes <= max_nodes && *cndt_found == 0) {
+    while (min_nodes <= max_nodes && *cndt_found == 0 &&
+           nr_cndts < NUMA_PLACEMENT_MAX_CANDIDATES) {
         comb_iter_t comb_iter;
         int comb_ok;
 
+        if ((min_free_memkb && top_free_memkb[min_nodes] < min_free_memkb) ||
+            (min_cpus && top_cpus[min_nodes] < min_cpus)) {
+            min_nodes++;
+            continue;
+        }
+
         /*
          * And here it is. Each step of this cycle generates a combination of
          * nodes as big as min_nodes mandates.  Each of these combinations is
@@ -453,37 +490,37 @@ int libxl__get_numa_candidate(libxl__gc *gc,
          * become our best placement iff it passes the check.
          */
         for (comb_ok = comb_init(gc, &comb_iter, nr_suit_nodes, min_nodes);
-             comb_ok;
+             comb_ok && nr_cndts < NUMA_PLACEMENT_MAX_CANDIDATES;
              comb_ok = comb_next(comb_iter, nr_suit_nodes, min_nodes)) {
             uint64_t nodes_free_memkb;
             int nodes_cpus;
 
-            /* Get the nodemap for the combination, only considering
-             * suitable nodes. */
-            comb_get_nodemap(comb_iter, &suitable_nodemap,
-                             &nodemap, min_nodes);
+            nr_cndts++;
 
             /* If there is not enough memory in this combination, skip it
              * and go generating the next one... */
-            nodes_free_memkb = nodemap_to_free_memkb(ninfo, &nodemap);
+            nodes_free_memkb = comb_free_memkb(comb_iter, min_nodes,
+                                               suit_nodes, node_free_memkb);
             if (min_free_memkb && nodes_free_memkb < min_free_memkb)
                 continue;
 
             /* And the same applies if this combination is short in cpus */
-            nodes_cpus = nodemap_to_nr_cpus(tinfo, nr_cpus, suitable_cpumap,
-                                            &nodemap);
+            nodes_cpus = comb_sum(comb_iter, min_nodes, suit_nodes, node_cpus);
             if (min_cpus && nodes_cpus < min_cpus)
                 continue;
 
             /*
              * Conditions are met, we can compare this candidate with the
-             * current best one (if any).
+             * current best one (if any). Get the nodemap for the
+             * combination, only considering suitable nodes.
              */
+            comb_get_nodemap(comb_iter, &suitable_nodemap,
+                             &nodemap, min_nodes);
             libxl__numa_candidate_put_nodemap(gc, &new_cndt, &nodemap);
-            new_cndt.nr_vcpus = nodemap_to_nr_vcpus(gc, vcpus_on_node,
-                                                    &nodemap);
+            new_cndt.nr_vcpus = comb_sum(comb_iter, min_nodes, suit_nodes,
+                                         vcpus_on_node);
             new_cndt.free_memkb = nodes_free_memkb;
-            new_cndt.nr_nodes = libxl_bitmap_count_set(&nodemap);
+            new_cndt.nr_nodes = min_nodes;
             new_cndt.nr_cpus = nodes_cpus;
 
             /*
@@ -514,6 +551,8 @@ int libxl__get_numa_candidate(libxl__gc *gc,
         min_nodes++;
     }
 
+    if (nr_cndts >= NUMA_PLACEMENT_MAX_CANDIDATES)
+        LOG(DEBUG, "NUMA placement stopped after %d candidates", nr_cndts);
     if (*cndt_found == 0)
         LOG(NOTICE, "NUMA placement failed, performance might be affected");
 
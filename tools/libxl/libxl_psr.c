@@ -91,6 +91,9 @@ static void libxl__psr_cat_log_err_msg(libxl__gc *gc, int err)
     case ENXIO:
         msg = "Unable to set code or data CBM when CDP is disabled";
         break;
+    case EINVAL:
+        msg = "Invalid value";
+        break;
 
     default:
         libxl__psr_log_err_msg(gc, err);
@@ -407,6 +410,132 @@ void libxl_psr_cat_info_list_free(libxl_psr_cat_info *list, int nr)
     free(list);
 }
 
+static void libxl__psr_mba_log_err_msg(libxl__gc *gc, int err)
+{
+    char *msg;
+
+    switch (err) {
+    case ENODEV:
+        msg = "MBA is not supported in this system";
+        break;
+    case ENOENT:
+        msg = "MBA is not enabled on the socket";
+        break;
+    case EINVAL:
+        msg = "Throttling value above the maximum";
+        break;
+    default:
+        /* Classes of service are shared with CAT. */
+        libxl__psr_cat_log_err_msg(gc, err);
+        return;
+    }
+
+    LOGE(ERROR, "%s", msg);
+}
+
+int libxl_psr_mba_set_thrtl(libxl_ctx *ctx, uint32_t domid,
+                            libxl_bitmap *target_map, uint32_t thrtl)
+{
+    GC_INIT(ctx);
+    int rc;
+    int socketid, nr_sockets;
+
+    rc = libxl__count_physical_sockets(gc, &nr_sockets);
+    if (rc) {
+        LOGED(ERROR, domid, "failed to get system socket count");
+        goto out;
+    }
+
+    libxl_for_each_set_bit(socketid, *target_map) {
+        if (socketid >= nr_sockets)
+            break;
+
+        if (xc_psr_cat_set_domain_data(ctx->xch, domid, XC_PSR_MBA_THRTL,
+                                       socketid, thrtl)) {
+            libxl__psr_mba_log_err_msg(gc, errno);
+            rc = ERROR_FAIL;
+        }
+    }
+
+out:
+    GC_FREE;
+    return rc;
+}
+
+int libxl_psr_mba_get_thrtl(libxl_ctx *ctx, uint32_t domid,
+                            uint32_t target, uint32_t *thrtl_r)
+{
+    GC_INIT(ctx);
+    int rc = 0;
+    uint64_t data;
+
+    if (xc_psr_cat_get_domain_data(ctx->xch, domid, XC_PSR_MBA_THRTL,
+                                   target, &data)) {
+        libxl__psr_mba_log_err_msg(gc, errno);
+        rc = ERROR_FAIL;
+    } else
+        *thrtl_r = data;
+
+    GC_FREE;
+    return rc;
+}
+
+int libxl_psr_mba_get_info(libxl_ctx *ctx, libxl_psr_mba_info **info,
+                           int *nr)
+{
+    GC_INIT(ctx);
+    int rc;
+    int i = 0, socketid, nr_sockets;
+    libxl_bitmap socketmap;
+    libxl_psr_mba_info *ptr;
+
+    libxl_bitmap_init(&socketmap);
+
+    rc = libxl__count_physical_sockets(gc, &nr_sockets);
+    if (rc) {
+        LOGE(ERROR, "failed to get system socket count");
+        goto out;
+    }
+
+    libxl_socket_bitmap_alloc(ctx, &socketmap, nr_sockets);
+    rc = libxl_get_online_socketmap(ctx, &socketmap);
+    if (rc < 0) {
+        LOGE(ERROR, "failed to get available sockets");
+        goto out;
+    }
+
+    ptr = libxl__malloc(NOGC, nr_sockets * sizeof(libxl_psr_mba_info));
+
+    libxl_for_each_set_bit(socketid, socketmap) {
+        libxl_psr_mba_info_init(&ptr[i]);
+        ptr[i].id = socketid;
+        if (xc_psr_mba_get_info(ctx->xch, socketid, &ptr[i].cos_max,
+                                &ptr[i].thrtl_max, &ptr[i].linear)) {
+            libxl__psr_mba_log_err_msg(gc, errno);
+            rc = ERROR_FAIL;
+            free(ptr);
+            goto out;
+        }
+        i++;
+    }
+
+    *info = ptr;
+    *nr = i;
+out:
+    libxl_bitmap_dispose(&socketmap);
+    GC_FREE;
+    return rc;
+}
+
+void libxl_psr_mba_info_list_free(libxl_psr_mba_info *list, int nr)
+{
+    int i;
+
+    for (i = 0; i < nr; i++)
+        libxl_psr_mba_info_dispose(&list[i]);
+    free(list);
+}
+
 /*
  * Local variables:
  * mode: C
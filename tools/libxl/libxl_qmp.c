@@ -225,8 +225,7 @@ static int enable_qmp_capabilities(libxl__qmp_handler *qmp)
  * Helpers
  */
 
-static libxl__qmp_message_type qmp_response_type(libxl__qmp_handler *qmp,
-                                                 const libxl__json_object *o)
+static libxl__qmp_message_type qmp_response_type(const libxl__json_object *o)
 {
     libxl__qmp_message_type type;
     libxl__json_map_node *node = NULL;
@@ -292,7 +291,7 @@ static int qmp_handle_response(libxl__gc *gc, libxl__qmp_handler *qmp,
 {
     libxl__qmp_message_type type = LIBXL__QMP_MESSAGE_TYPE_INVALID;
 
-    type = qmp_response_type(qmp, resp);
+    type = qmp_response_type(resp);
     LOGD(DEBUG, qmp->domid, "message type: %s", libxl__qmp_message_type_to_string(type));
 
     switch (type) {
@@ -504,17 +503,16 @@ static int qmp_next(libxl__gc *gc, libxl__qmp_handler *qmp)
     return rc;
 }
 
-static char *qmp_send_prepare(libxl__gc *gc, libxl__qmp_handler *qmp,
-                              const char *cmd, libxl__json_object *args,
-                              qmp_callback_t callback, void *opaque,
-                              qmp_request_context *context)
+/* Returns the command as a string allocated from gc, without the CRLF. */
+static char *qmp_cmd_to_string(libxl__gc *gc, uint32_t domid,
+                               const char *cmd, libxl__json_object *args,
+                               int id)
 {
     const unsigned char *buf = NULL;
     char *ret = NULL;
     libxl_yajl_length len = 0;
     yajl_gen_status s;
     yajl_gen hand;
-    callback_id_pair *elm = NULL;
 
     hand = libxl_yajl_gen_alloc(NULL);
 
@@ -526,7 +524,7 @@ static char *qmp_send_prepare(libxl__gc *gc, libxl__qmp_handler *qmp,
     libxl__yajl_gen_asciiz(hand, "execute");
     libxl__yajl_gen_asciiz(hand, cmd);
     libxl__yajl_gen_asciiz(hand, "id");
-    yajl_gen_integer(hand, ++qmp->last_id_used);
+    yajl_gen_integer(hand, id);
     if (args) {
         libxl__yajl_gen_asciiz(hand, "arguments");
         libxl__json_object_to_yajl_gen(gc, hand, args);
@@ -536,14 +534,35 @@ static char *qmp_send_prepare(libxl__gc *gc, libxl__qmp_handler *qmp,
     s = yajl_gen_get_buf(hand, &buf, &len);
 
     if (s) {
-        LOGD(ERROR, qmp->domid, "Failed to generate a qmp command");
+        LOGD(ERROR, domid, "Failed to generate a qmp command");
         goto out;
     }
 
+    ret = libxl__strndup(gc, (const char*)buf, len);
+
+    LOGD(DEBUG, domid, "next qmp command: '%s'", buf);
+
+out:
+    yajl_gen_free(hand);
+    return ret;
+}
+
+static char *qmp_send_prepare(libxl__gc *gc, libxl__qmp_handler *qmp,
+                              const char *cmd, libxl__json_object *args,
+                              qmp_callback_t callback, void *opaque,
+                              qmp_request_context *context)
+{
+    char *ret = NULL;
+    callback_id_pair *elm = NULL;
+
+    ret = qmp_cmd_to_string(gc, qmp->domid, cmd, args, ++qmp->last_id_used);
+    if (!ret)
+        return NULL;
+
     elm = malloc(sizeof (callback_id_pair));
     if (elm == NULL) {
         LOGED(ERROR, qmp->domid, "Failed to allocate a QMP callback");
-        goto out;
+        return NULL;
     }
     elm->id = qmp->last_id_used;
     elm->callback = callback;
@@ -551,12 +570,6 @@ static char *qmp_send_prepare(libxl__gc *gc, libxl__qmp_handler *qmp,
     elm->context = context;
     LIBXL_STAILQ_INSERT_TAIL(&qmp->callback_list, elm, next);
 
-    ret = libxl__strndup(gc, (const char*)buf, len);
-
-    LOGD(DEBUG, qmp->domid, "next qmp command: '%s'", buf);
-
-out:
-    yajl_gen_free(hand);
     return ret;
 }
 
@@ -681,6 +694,13 @@ static void qmp_parameters_add_integer(libxl__gc *gc,
     qmp_parameters_common_add(gc, param, name, obj);
 }
 
+void libxl__qmp_param_add_string(libxl__gc *gc,
+                                 libxl__json_object **param,
+                                 const char *name, const char *s)
+{
+    qmp_parameters_add_string(gc, param, name, s);
+}
+
 #define QMP_PARAMETERS_SPRINTF(args, name, format, ...) \
     qmp_parameters_add_string(gc, args, name, GCSPRINTF(format, __VA_ARGS__))
 
@@ -1192,6 +1212,439 @@ int libxl__qmp_initializations(libxl__gc *gc, uint32_t domid,
     return ret;
 }
 
+/*
+ * Asynchronous client
+ */
+
+#define QMP_CONNECT_RETRY_MS 200
+#define QMP_REPLY_TIMEOUT_MS (5 * 1000)
+
+struct libxl__ev_qmp_cmd {
+    LIBXL_TAILQ_ENTRY(libxl__ev_qmp_cmd) entry;
+    int id;
+    int generation;
+    libxl__ev_qmp_callback *callback; /* NULL for qmp_capabilities */
+    char *buf; /* including the CRLF, from NOGC */
+    size_t len, written;
+};
+
+static void qmp_ev_fd_callback(libxl__egc *egc, libxl__ev_fd *efd,
+                               int fd, short events, short revents);
+static void qmp_ev_time_callback(libxl__egc *egc, libxl__ev_time *etime,
+                                 const struct timeval *requested_abs,
+                                 int rc);
+
+static libxl__ev_qmp_cmd *qmp_ev_cmd_new(libxl__gc *gc, libxl__ev_qmp *ev,
+                                         const char *cmd,
+                                         libxl__json_object *args,
+                                         libxl__ev_qmp_callback *callback)
+{
+    libxl__ev_qmp_cmd *c;
+    char *buf;
+    int id = ++ev->last_id_used;
+
+    buf = qmp_cmd_to_string(gc, ev->domid, cmd, args, id);
+    if (!buf)
+        return NULL;
+
+    c = libxl__zalloc(NOGC, sizeof(*c));
+    c->id = id;
+    c->generation = ev->generation;
+    c->callback = callback;
+    c->buf = libxl__sprintf(NOGC, "%s\r\n", buf);
+    c->len = strlen(c->buf);
+
+    return c;
+}
+
+static void qmp_ev_cmd_free(libxl__ev_qmp_cmd *c)
+{
+    free(c->buf);
+    free(c);
+}
+
+/* Leaves the queued commands alone. */
+static void qmp_ev_disconnect(libxl__gc *gc, libxl__ev_qmp *ev)
+{
+    libxl__ev_fd_deregister(gc, &ev->efd);
+    libxl__ev_time_deregister(gc, &ev->etime);
+    if (ev->fd >= 0)
+        close(ev->fd);
+    ev->fd = -1;
+    ev->ready = false;
+    free(ev->rx_buf);
+    ev->rx_buf = NULL;
+    ev->rx_len = ev->rx_size = 0;
+}
+
+static int qmp_ev_connect(libxl__gc *gc, libxl__ev_qmp *ev)
+{
+    struct sockaddr_un un;
+    const char *path;
+    int rc, r;
+
+    path = GCSPRINTF("%s/qmp-libxl-%d", libxl__run_dir_path(), ev->domid);
+    if (sizeof (un.sun_path) <= strlen(path)) {
+        LOGD(ERROR, ev->domid, "QMP socket path too long: %s", path);
+        return ERROR_FAIL;
+    }
+    memset(&un, 0, sizeof (un));
+    un.sun_family = AF_UNIX;
+    strncpy(un.sun_path, path, sizeof (un.sun_path) - 1);
+
+    ev->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (ev->fd < 0) {
+        LOGED(ERROR, ev->domid, "Failed to create QMP socket");
+        rc = ERROR_FAIL;
+        goto out;
+    }
+    rc = libxl_fd_set_nonblock(CTX, ev->fd, 1);
+    if (rc) goto out;
+    rc = libxl_fd_set_cloexec(CTX, ev->fd, 1);
+    if (rc) goto out;
+
+    r = connect(ev->fd, (struct sockaddr *) &un, sizeof (un));
+    if (r && (errno == ENOENT || errno == ECONNREFUSED || errno == EAGAIN) &&
+        ++ev->connect_tries <=
+            QMP_SOCKET_CONNECT_TIMEOUT * 1000 / QMP_CONNECT_RETRY_MS) {
+        /* ENOENT       : Socket may not have shown up yet
+         * ECONNREFUSED : Leftover socket hasn't been removed yet
+         * EAGAIN       : QEMU is not keeping up with connections */
+        close(ev->fd);
+        ev->fd = -1;
+        rc = libxl__ev_time_register_rel(ev->ao, &ev->etime,
+                                         qmp_ev_time_callback,
+                                         QMP_CONNECT_RETRY_MS);
+        if (rc) goto out;
+        return 0;
+    }
+    if (r) {
+        LOGED(ERROR, ev->domid, "Failed to connect to %s", path);
+        rc = ERROR_FAIL;
+        goto out;
+    }
+    ev->connect_tries = 0;
+
+    LOGD(DEBUG, ev->domid, "connected to %s", path);
+
+    rc = libxl__ev_fd_register(gc, &ev->efd, qmp_ev_fd_callback,
+                               ev->fd, POLLIN);
+    if (rc) goto out;
+    rc = libxl__ev_time_register_rel(ev->ao, &ev->etime,
+                                     qmp_ev_time_callback,
+                                     QMP_REPLY_TIMEOUT_MS);
+    if (rc) goto out;
+
+    return 0;
+
+out:
+    qmp_ev_disconnect(gc, ev);
+    return rc;
+}
+
+/* Calls the callback of every command sent over the failed connection. */
+static void qmp_ev_fail(libxl__egc *egc, libxl__ev_qmp *ev, int rc)
+{
+    EGC_GC;
+    libxl__ev_qmp_cmd *c;
+    libxl__ev_qmp_callback *callback;
+    int generation = ev->generation++;
+
+    qmp_ev_disconnect(gc, ev);
+    ev->connect_tries = 0;
+
+    /* Stops early if a callback disposes of ev. */
+    while ((c = LIBXL_TAILQ_FIRST(&ev->cmds)) &&
+           c->generation == generation) {
+        callback = c->callback;
+        LIBXL_TAILQ_REMOVE(&ev->cmds, c, entry);
+        qmp_ev_cmd_free(c);
+        if (callback)
+            callback(egc, ev, NULL, rc);
+    }
+}
+
+/* Sets the fd events and the reply timeout to suit the queue. */
+static int qmp_ev_update(libxl__gc *gc, libxl__ev_qmp *ev)
+{
+    libxl__ev_qmp_cmd *c;
+    short events = POLLIN;
+    int rc;
+
+    if (ev->fd < 0)
+        return 0;
+
+    if (ev->ready) {
+        LIBXL_TAILQ_FOREACH(c, &ev->cmds, entry) {
+            if (c->written < c->len) {
+                events |= POLLOUT;
+                break;
+            }
+        }
+    }
+    rc = libxl__ev_fd_modify(gc, &ev->efd, events);
+    if (rc) return rc;
+
+    if (LIBXL_TAILQ_EMPTY(&ev->cmds)) {
+        libxl__ev_time_deregister(gc, &ev->etime);
+        return 0;
+    }
+    /* Restart the reply timeout. */
+    libxl__ev_time_deregister(gc, &ev->etime);
+    return libxl__ev_time_register_rel(ev->ao, &ev->etime,
+                                       qmp_ev_time_callback,
+                                       QMP_REPLY_TIMEOUT_MS);
+}
+
+static int qmp_ev_write(libxl__gc *gc, libxl__ev_qmp *ev)
+{
+    libxl__ev_qmp_cmd *c;
+    ssize_t r;
+
+    LIBXL_TAILQ_FOREACH(c, &ev->cmds, entry) {
+        while (c->written < c->len) {
+            r = write(ev->fd, c->buf + c->written, c->len - c->written);
+            if (r < 0) {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EWOULDBLOCK)
+                    return 0;
+                LOGED(ERROR, ev->domid, "Socket write error");
+                return ERROR_FAIL;
+            }
+            c->written += r;
+        }
+    }
+
+    return 0;
+}
+
+/* Reads at most once, so that a reply is not lost behind an EOF. */
+static int qmp_ev_read(libxl__gc *gc, libxl__ev_qmp *ev)
+{
+    ssize_t r;
+
+    if (ev->rx_size - ev->rx_len < QMP_RECEIVE_BUFFER_SIZE) {
+        ev->rx_size += QMP_RECEIVE_BUFFER_SIZE;
+        ev->rx_buf = libxl__realloc(NOGC, ev->rx_buf, ev->rx_size + 1);
+    }
+
+    do {
+        r = read(ev->fd, ev->rx_buf + ev->rx_len, ev->rx_size - ev->rx_len);
+    } while (r < 0 && errno == EINTR);
+    if (r < 0) {
+        if (errno == EWOULDBLOCK)
+            return 0;
+        LOGED(ERROR, ev->domid, "Socket read error");
+        return ERROR_FAIL;
+    }
+    if (r == 0) {
+        LOGD(ERROR, ev->domid, "Unexpected end of socket");
+        return ERROR_FAIL;
+    }
+
+    DEBUG_REPORT_RECEIVED(ev->domid, ev->rx_buf + ev->rx_len, (int)r);
+
+    ev->rx_len += r;
+    ev->rx_buf[ev->rx_len] = '\0';
+
+    return 0;
+}
+
+static int qmp_ev_handle_message(libxl__egc *egc, libxl__ev_qmp *ev,
+                                 const char *s)
+{
+    EGC_GC;
+    const libxl__json_object *o, *id, *response = NULL;
+    libxl__qmp_message_type type;
+    libxl__ev_qmp_callback *callback;
+    libxl__ev_qmp_cmd *c;
+    int rc = 0;
+
+    o = libxl__json_parse(gc, s);
+    if (!o) {
+        LOGD(ERROR, ev->domid, "Parse error of : %s", s);
+        return ERROR_FAIL;
+    }
+
+    type = qmp_response_type(o);
+    LOGD(DEBUG, ev->domid, "message type: %s",
+         libxl__qmp_message_type_to_string(type));
+
+    switch (type) {
+    case LIBXL__QMP_MESSAGE_TYPE_QMP:
+        if (ev->ready) {
+            LOGD(ERROR, ev->domid, "Unexpected QMP greeting");
+            return ERROR_FAIL;
+        }
+        /* Capabilities go ahead of everything queued so far. */
+        c = qmp_ev_cmd_new(gc, ev, "qmp_capabilities", NULL, NULL);
+        if (!c)
+            return ERROR_FAIL;
+        LIBXL_TAILQ_INSERT_HEAD(&ev->cmds, c, entry);
+        ev->ready = true;
+        return 0;
+    case LIBXL__QMP_MESSAGE_TYPE_RETURN:
+        response = libxl__json_map_get("return", o, JSON_ANY);
+        break;
+    case LIBXL__QMP_MESSAGE_TYPE_ERROR:
+        rc = ERROR_FAIL;
+        break;
+    case LIBXL__QMP_MESSAGE_TYPE_EVENT:
+        return 0;
+    case LIBXL__QMP_MESSAGE_TYPE_INVALID:
+    default:
+        LOGD(ERROR, ev->domid, "Unexpected QMP message: %s", s);
+        return ERROR_FAIL;
+    }
+
+    /* Replies come in the order the commands were sent. */
+    id = libxl__json_map_get("id", o, JSON_INTEGER);
+    c = LIBXL_TAILQ_FIRST(&ev->cmds);
+    if (!id || !c || c->written < c->len ||
+        libxl__json_object_get_integer(id) != c->id) {
+        LOGD(ERROR, ev->domid, "Unexpected QMP reply: %s", s);
+        return ERROR_FAIL;
+    }
+    callback = c->callback;
+    LIBXL_TAILQ_REMOVE(&ev->cmds, c, entry);
+    qmp_ev_cmd_free(c);
+
+    if (rc) {
+        o = libxl__json_map_get("error", o, JSON_MAP);
+        o = libxl__json_map_get("desc", o, JSON_STRING);
+        LOGD(ERROR, ev->domid, "received an error message from QMP server: %s",
+             libxl__json_object_get_string(o));
+    }
+
+    if (!callback)
+        return rc; /* failed qmp_capabilities fails the connection */
+    callback(egc, ev, response, rc);
+    return 0;
+}
+
+static int qmp_ev_handle_messages(libxl__egc *egc, libxl__ev_qmp *ev)
+{
+    EGC_GC;
+    int generation = ev->generation;
+    char *end, *s;
+    size_t len;
+    int rc;
+
+    /* A callback may dispose of ev or start another connection. */
+    while (ev->generation == generation && ev->rx_len &&
+           (end = strstr(ev->rx_buf, "\r\n"))) {
+        len = end - ev->rx_buf;
+        s = libxl__strndup(gc, ev->rx_buf, len);
+        ev->rx_len -= len + 2;
+        memmove(ev->rx_buf, end + 2, ev->rx_len + 1);
+
+        rc = qmp_ev_handle_message(egc, ev, s);
+        if (rc) return rc;
+    }
+
+    return 0;
+}
+
+static void qmp_ev_fd_callback(libxl__egc *egc, libxl__ev_fd *efd,
+                               int fd, short events, short revents)
+{
+    EGC_GC;
+    libxl__ev_qmp *ev = CONTAINER_OF(efd, *ev, efd);
+    int generation = ev->generation;
+    int rc;
+
+    if (revents & POLLOUT) {
+        rc = qmp_ev_write(gc, ev);
+        if (rc) goto out;
+    }
+
+    if (revents & (POLLIN | POLLHUP | POLLERR)) {
+        rc = qmp_ev_read(gc, ev);
+        if (rc) goto out;
+        rc = qmp_ev_handle_messages(egc, ev);
+        if (rc && ev->generation == generation) goto out;
+    }
+
+    rc = qmp_ev_update(gc, ev);
+
+out:
+    if (rc)
+        qmp_ev_fail(egc, ev, rc);
+}
+
+static void qmp_ev_time_callback(libxl__egc *egc, libxl__ev_time *etime,
+                                 const struct timeval *requested_abs,
+                                 int rc)
+{
+    EGC_GC;
+    libxl__ev_qmp *ev = CONTAINER_OF(etime, *ev, etime);
+
+    if (rc == ERROR_TIMEDOUT) {
+        if (ev->fd < 0) {
+            rc = qmp_ev_connect(gc, ev);
+            if (!rc) return;
+        } else {
+            LOGD(ERROR, ev->domid, "timeout");
+        }
+    }
+
+    qmp_ev_fail(egc, ev, rc);
+}
+
+void libxl__ev_qmp_init(libxl__ev_qmp *ev)
+{
+    ev->fd = -1;
+    ev->ready = false;
+    ev->connect_tries = 0;
+    ev->generation = 0;
+    libxl__ev_fd_init(&ev->efd);
+    libxl__ev_time_init(&ev->etime);
+    ev->rx_buf = NULL;
+    ev->rx_len = ev->rx_size = 0;
+    ev->last_id_used = 0;
+    LIBXL_TAILQ_INIT(&ev->cmds);
+}
+
+int libxl__ev_qmp_send(libxl__gc *unused_gc, libxl__ev_qmp *ev,
+                       const char *cmd, libxl__json_object *args,
+                       libxl__ev_qmp_callback *callback)
+{
+    STATE_AO_GC(ev->ao);
+    libxl__ev_qmp_cmd *c;
+    int rc;
+
+    c = qmp_ev_cmd_new(gc, ev, cmd, args, callback);
+    if (!c)
+        return ERROR_FAIL;
+    LIBXL_TAILQ_INSERT_TAIL(&ev->cmds, c, entry);
+
+    if (ev->fd < 0 && !libxl__ev_time_isregistered(&ev->etime))
+        rc = qmp_ev_connect(gc, ev);
+    else
+        rc = qmp_ev_update(gc, ev);
+    if (rc) {
+        LIBXL_TAILQ_REMOVE(&ev->cmds, c, entry);
+        qmp_ev_cmd_free(c);
+    }
+
+    return rc;
+}
+
+void libxl__ev_qmp_dispose(libxl__gc *gc, libxl__ev_qmp *ev)
+{
+    libxl__ev_qmp_cmd *c;
+
+    ev->generation++;
+    qmp_ev_disconnect(gc, ev);
+    ev->connect_tries = 0;
+
+    while ((c = LIBXL_TAILQ_FIRST(&ev->cmds))) {
+        LIBXL_TAILQ_REMOVE(&ev->cmds, c, entry);
+        qmp_ev_cmd_free(c);
+    }
+}
+
 /*
  * Local variables:
  * mode: C
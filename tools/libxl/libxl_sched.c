@@ -156,6 +156,39 @@ int libxl_domain_get_nodeaffinity(libxl_ctx *ctx, uint32_t domid,
     return 0;
 }
 
+int libxl_domain_set_numa_balancing(libxl_ctx *ctx, uint32_t domid,
+                                    bool enable)
+{
+    GC_INIT(ctx);
+    int rc = 0;
+
+    if (xc_domain_numa_balancing_set(ctx->xch, domid, enable)) {
+        rc = errno == EOPNOTSUPP ? ERROR_NI : ERROR_FAIL;
+        LOGED(ERROR, domid, "%s NUMA balancing",
+              enable ? "Enabling" : "Disabling");
+    }
+    GC_FREE;
+    return rc;
+}
+
+int libxl_domain_get_numa_balancing(libxl_ctx *ctx, uint32_t domid,
+                                    bool *enabled, int *node)
+{
+    GC_INIT(ctx);
+    int on, rc = 0;
+    uint32_t n, passes;
+
+    if (xc_domain_numa_balancing_get(ctx->xch, domid, &on, &n, &passes)) {
+        rc = errno == EOPNOTSUPP ? ERROR_NI : ERROR_FAIL;
+        LOGED(ERROR, domid, "Getting NUMA balancing state");
+    } else {
+        *enabled = on;
+        *node = n == ~0U ? -1 : n;
+    }
+    GC_FREE;
+    return rc;
+}
+
 int libxl_get_scheduler(libxl_ctx *ctx)
 {
     int r, sched;
@@ -390,6 +423,67 @@ int libxl_sched_credit2_params_set(libxl_ctx *ctx, uint32_t poolid,
     return rc;
 }
 
+libxl_sched_null_assignment *libxl_sched_null_assignment_list(libxl_ctx *ctx,
+                                                              uint32_t poolid,
+                                                              int *nb_out)
+{
+    GC_INIT(ctx);
+    libxl_cpupoolinfo info;
+    xen_sysctl_null_assignment_t *buf;
+    libxl_sched_null_assignment *list = NULL;
+    unsigned int nr_cpus;
+    int max_cpus, cpu, nb = 0;
+
+    libxl_cpupoolinfo_init(&info);
+    if (libxl_cpupool_info(ctx, &info, poolid))
+        goto out;
+
+    max_cpus = libxl_get_max_cpus(ctx);
+    if (max_cpus < 0)
+        goto out;
+
+    nr_cpus = max_cpus;
+    GCNEW_ARRAY(buf, nr_cpus);
+    if (xc_sched_null_assignment_get(ctx->xch, poolid, buf, &nr_cpus)) {
+        LOGE(ERROR, "getting null scheduler assignment");
+        goto out;
+    }
+    if (nr_cpus > (unsigned int)max_cpus)
+        nr_cpus = max_cpus;
+
+    list = libxl__calloc(NOGC, libxl_bitmap_count_set(&info.cpumap),
+                         sizeof(*list));
+    libxl_for_each_set_bit(cpu, info.cpumap) {
+        if ((unsigned int)cpu >= nr_cpus)
+            break;
+        libxl_sched_null_assignment_init(&list[nb]);
+        list[nb].cpu = cpu;
+        if (buf[cpu].domid != DOMID_INVALID) {
+            list[nb].assigned = true;
+            list[nb].domid = buf[cpu].domid;
+            list[nb].vcpuid = buf[cpu].vcpu_id;
+        }
+        nb++;
+    }
+
+    *nb_out = nb;
+
+ out:
+    libxl_cpupoolinfo_dispose(&info);
+    GC_FREE;
+    return list;
+}
+
+void libxl_sched_null_assignment_list_free(libxl_sched_null_assignment *list,
+                                           int nb)
+{
+    int i;
+
+    for (i = 0; i < nb; i++)
+        libxl_sched_null_assignment_dispose(&list[i]);
+    free(list);
+}
+
 static int sched_credit2_domain_get(libxl__gc *gc, uint32_t domid,
                                     libxl_domain_sched_params *scinfo)
 {
@@ -0,0 +1,181 @@
+/*
+ * Copyright 2017 Citrix Ltd and other contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; version 2.1 only. with the special
+ * exception on linking described in file LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ */
+
+/*
+ * Timing spans of domain lifecycle operations.
+ *
+ * Spans are kept in an array hanging off the ctx, and are referred to
+ * by their index so that the array can grow while spans are open.
+ * Besides the wall clock time, each span records the time the
+ * hypervisor spent handling the domctls issued through CTX->xch while
+ * it was open.  When several operations run in parallel on the same
+ * ctx, that includes the domctls of all of them.
+ */
+
+#include "libxl_osdeps.h" /* must come before any other headers */
+
+#include "libxl_internal.h"
+
+struct libxl__trace_event {
+    const char *name;
+    uint32_t domid;
+    uint64_t start_us, end_us;
+    uint64_t domctl_ns;
+};
+
+static uint64_t trace_now_us(libxl__gc *gc)
+{
+    struct timeval now;
+
+    if (libxl__gettimeofday(gc, &now))
+        return 0;
+
+    return now.tv_sec * 1000000ULL + now.tv_usec;
+}
+
+int libxl_trace_enable(libxl_ctx *ctx)
+{
+    GC_INIT(ctx);
+
+    CTX_LOCK;
+    if (!CTX->trace_enabled) {
+        CTX->trace_enabled = true;
+        CTX->trace_epoch_us = trace_now_us(gc);
+    }
+    CTX_UNLOCK;
+
+    GC_FREE;
+    return 0;
+}
+
+libxl__trace_span libxl__trace_begin(libxl__gc *gc, uint32_t domid,
+                                     const char *name)
+{
+    struct libxl__trace_event *ev;
+    libxl__trace_span span = LIBXL__TRACE_NONE;
+
+    CTX_LOCK;
+
+    if (!CTX->trace_enabled)
+        goto out;
+
+    if (CTX->trace_used == CTX->trace_size) {
+        CTX->trace_size = CTX->trace_size ? CTX->trace_size * 2 : 64;
+        CTX->trace = libxl__realloc(NOGC, CTX->trace,
+                                    CTX->trace_size * sizeof(*CTX->trace));
+    }
+
+    span = CTX->trace_used++;
+    ev = &CTX->trace[span];
+    ev->name = name;
+    ev->domid = domid;
+    ev->start_us = trace_now_us(gc);
+    ev->end_us = 0;
+    ev->domctl_ns = xc_domctl_time(CTX->xch);
+
+ out:
+    CTX_UNLOCK;
+    return span;
+}
+
+void libxl__trace_end(libxl__gc *gc, libxl__trace_span *span)
+{
+    struct libxl__trace_event *ev;
+
+    if (*span == LIBXL__TRACE_NONE)
+        return;
+
+    CTX_LOCK;
+    ev = &CTX->trace[*span];
+    ev->end_us = trace_now_us(gc);
+    ev->domctl_ns = xc_domctl_time(CTX->xch) - ev->domctl_ns;
+    CTX_UNLOCK;
+
+    *span = LIBXL__TRACE_NONE;
+}
+
+void libxl__trace_set_domid(libxl__gc *gc, libxl__trace_span span,
+                            uint32_t domid)
+{
+    if (span == LIBXL__TRACE_NONE)
+        return;
+
+    CTX_LOCK;
+    CTX->trace[span].domid = domid;
+    CTX_UNLOCK;
+}
+
+void libxl__trace_next(libxl__gc *gc, libxl__trace_span *span,
+                       uint32_t domid, const char *name)
+{
+    libxl__trace_end(gc, span);
+    *span = libxl__trace_begin(gc, domid, name);
+}
+
+int libxl_trace_write(libxl_ctx *ctx, const char *path)
+{
+    GC_INIT(ctx);
+    const struct libxl__trace_event *ev;
+    const char *sep = "";
+    FILE *f = NULL;
+    pid_t pid = getpid();
+    int i, rc;
+
+    CTX_LOCK;
+
+    f = fopen(path, "w");
+    if (!f) {
+        LOGE(ERROR, "failed to open trace file %s", path);
+        rc = ERROR_FAIL;
+        goto out;
+    }
+
+    fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+    for (i = 0; i < CTX->trace_used; i++) {
+        ev = &CTX->trace[i];
+        /* Still open, e.g. because the operation failed half way. */
+        if (!ev->end_us)
+            continue;
+        fprintf(f, "%s\n  {\"name\": \"%s\", \"cat\": \"libxl\", "
+                "\"ph\": \"X\", \"ts\": %"PRIu64", \"dur\": %"PRIu64", "
+                "\"pid\": %d, \"tid\": %"PRIu32", "
+                "\"args\": {\"domid\": %"PRIu32", \"domctl_us\": %"PRIu64"}}",
+                sep, ev->name, ev->start_us - CTX->trace_epoch_us,
+                ev->end_us - ev->start_us, (int)pid, ev->domid, ev->domid,
+                ev->domctl_ns / 1000);
+        sep = ",";
+    }
+    fprintf(f, "\n]}\n");
+
+    if (fclose(f)) {
+        LOGE(ERROR, "failed to write trace file %s", path);
+        rc = ERROR_FAIL;
+        goto out;
+    }
+
+    rc = 0;
+
+ out:
+    CTX_UNLOCK;
+    GC_FREE;
+    return rc;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
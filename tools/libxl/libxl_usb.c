@@ -1968,7 +1968,10 @@ void libxl_device_usbdev_list_free(libxl_device_usbdev *list, int nr)
 DEFINE_DEVICE_TYPE_STRUCT(usbctrl,
     .dm_needed = libxl_device_usbctrl_dm_needed
 );
-DEFINE_DEVICE_TYPE_STRUCT(usbdev);
+/* usbdevs are plugged into the usbctrls attached before them */
+DEFINE_DEVICE_TYPE_STRUCT(usbdev,
+    .attach_after_prev = 1
+);
 
 /*
  * Local variables:
@@ -1060,6 +1060,14 @@ void libxl_vcpuinfo_list_free(libxl_vcpuinfo *list, int nr)
     free(list);
 }
 
+void libxl_evtchn_stats_list_free(libxl_evtchn_stats *list, int nr)
+{
+    int i;
+    for (i = 0; i < nr; i++)
+        libxl_evtchn_stats_dispose(&list[i]);
+    free(list);
+}
+
 int libxl__sendmsg_fds(libxl__gc *gc, int carrier,
                        const void *data, size_t datalen,
                        int nfds, const int fds[], const char *what) {
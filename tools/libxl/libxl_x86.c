@@ -343,6 +343,15 @@ int libxl__arch_domain_create(libxl__gc *gc, libxl_domain_config *d_config,
                                            1024);
         xc_shadow_control(ctx->xch, domid, XEN_DOMCTL_SHADOW_OP_SET_ALLOCATION,
                           NULL, 0, &shadow, 0, NULL);
+
+        if (d_config->b_info.u.hvm.unshare_pool_memkb &&
+            xc_memshr_pool_size(ctx->xch, domid,
+                    d_config->b_info.u.hvm.unshare_pool_memkb >>
+                    (XC_PAGE_SHIFT - 10), NULL)) {
+            LOGED(ERROR, domid, "Failed to set the unshare pool size");
+            ret = ERROR_FAIL;
+            goto out;
+        }
     }
 
     if (d_config->c_info.type == LIBXL_DOMAIN_TYPE_PV &&
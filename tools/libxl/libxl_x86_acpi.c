@@ -129,7 +129,8 @@ static int init_acpi_config(libxl__gc *gc,
         }
 
         vmemrange = libxl__zalloc(gc, dom->nr_vmemranges * sizeof(*vmemrange));
-        vdistance = libxl__zalloc(gc, dom->nr_vnodes * sizeof(*vdistance));
+        vdistance = libxl__zalloc(gc, dom->nr_vnodes * dom->nr_vnodes *
+                                      sizeof(*vdistance));
         vcpu_to_vnode = libxl__zalloc(gc, hvminfo->nr_vcpus *
                                       sizeof(*vcpu_to_vnode));
         r = xc_domain_getvnuma(xch, domid, &numa->nr_vnodes,
@@ -161,6 +162,106 @@ out:
     return rc;
 }
 
+/*
+ * The tables only depend on the page size and on what init_acpi_config()
+ * puts into the config, so a toolstack creating many alike guests with
+ * the same ctx need not rebuild them every time.
+ */
+static void *acpi_cache_key(libxl__gc *gc, unsigned int page_size,
+                            const struct acpi_config *config,
+                            size_t *key_len)
+{
+    const struct acpi_numa *numa = &config->numa;
+    unsigned int nr_vcpus = config->hvminfo->nr_vcpus;
+    size_t vmemrange_len, vdistance_len, vcpu_to_vnode_len;
+    char *key, *p;
+
+    vmemrange_len = numa->nr_vmemranges * sizeof(*numa->vmemrange);
+    vdistance_len = numa->nr_vnodes * numa->nr_vnodes *
+                    sizeof(*numa->vdistance);
+    vcpu_to_vnode_len = numa->nr_vnodes ?
+                        nr_vcpus * sizeof(*numa->vcpu_to_vnode) : 0;
+
+    *key_len = sizeof(page_size) + sizeof(*config->hvminfo) +
+               sizeof(numa->nr_vnodes) + sizeof(numa->nr_vmemranges) +
+               vmemrange_len + vdistance_len + vcpu_to_vnode_len;
+    key = p = libxl__zalloc(gc, *key_len);
+
+#define KEY_ADD(x, len) do { memcpy(p, (x), (len)); p += (len); } while (0)
+    KEY_ADD(&page_size, sizeof(page_size));
+    KEY_ADD(config->hvminfo, sizeof(*config->hvminfo));
+    KEY_ADD(&numa->nr_vnodes, sizeof(numa->nr_vnodes));
+    KEY_ADD(&numa->nr_vmemranges, sizeof(numa->nr_vmemranges));
+    if (vmemrange_len)
+        KEY_ADD(numa->vmemrange, vmemrange_len);
+    if (vdistance_len)
+        KEY_ADD(numa->vdistance, vdistance_len);
+    if (vcpu_to_vnode_len)
+        KEY_ADD(numa->vcpu_to_vnode, vcpu_to_vnode_len);
+#undef KEY_ADD
+
+    return key;
+}
+
+/* Fills in the data of the acpi modules from the cache, if it's there. */
+static bool acpi_cache_get(libxl__gc *gc, const void *key, size_t key_len,
+                           struct xc_dom_image *dom)
+{
+    libxl__acpi_cache_entry *ace;
+    int i;
+
+    CTX_LOCK;
+    LIBXL_TAILQ_FOREACH(ace, &CTX->acpi_cache, entry) {
+        if (ace->key_len == key_len && !memcmp(ace->key, key, key_len))
+            break;
+    }
+    if (ace) {
+        LIBXL_TAILQ_REMOVE(&CTX->acpi_cache, ace, entry);
+        LIBXL_TAILQ_INSERT_HEAD(&CTX->acpi_cache, ace, entry);
+        for (i = 0; i < ace->nr_modules; i++) {
+            dom->acpi_modules[i].data =
+                libxl__malloc(gc, ace->modules[i].length);
+            memcpy(dom->acpi_modules[i].data, ace->modules[i].data,
+                   ace->modules[i].length);
+            dom->acpi_modules[i].length = ace->modules[i].length;
+        }
+    }
+    CTX_UNLOCK;
+
+    return ace != NULL;
+}
+
+static void acpi_cache_put(libxl__gc *gc, const void *key, size_t key_len,
+                           const struct xc_dom_image *dom, int nr_modules)
+{
+    libxl__acpi_cache_entry *ace;
+    int i;
+
+    ace = libxl__zalloc(NOGC, sizeof(*ace));
+    ace->key = libxl__malloc(NOGC, key_len);
+    memcpy(ace->key, key, key_len);
+    ace->key_len = key_len;
+    ace->nr_modules = nr_modules;
+    for (i = 0; i < nr_modules; i++) {
+        ace->modules[i].data =
+            libxl__malloc(NOGC, dom->acpi_modules[i].length);
+        memcpy(ace->modules[i].data, dom->acpi_modules[i].data,
+               dom->acpi_modules[i].length);
+        ace->modules[i].length = dom->acpi_modules[i].length;
+    }
+
+    CTX_LOCK;
+    LIBXL_TAILQ_INSERT_HEAD(&CTX->acpi_cache, ace, entry);
+    if (CTX->acpi_cache_used == LIBXL__ACPI_CACHE_MAX) {
+        ace = LIBXL_TAILQ_LAST(&CTX->acpi_cache, libxl__acpi_cache);
+        LIBXL_TAILQ_REMOVE(&CTX->acpi_cache, ace, entry);
+        libxl__acpi_cache_entry_free(ace);
+    } else {
+        CTX->acpi_cache_used++;
+    }
+    CTX_UNLOCK;
+}
+
 int libxl__dom_load_acpi(libxl__gc *gc,
                          const libxl_domain_build_info *b_info,
                          struct xc_dom_image *dom)
@@ -170,6 +271,8 @@ int libxl__dom_load_acpi(libxl__gc *gc,
     int rc = 0, acpi_pages_num;
     void *acpi_pages;
     unsigned long page_mask;
+    void *key;
+    size_t key_len;
 
     if ((b_info->type != LIBXL_DOMAIN_TYPE_HVM) ||
         (b_info->device_model_version != LIBXL_DEVICE_MODEL_VERSION_NONE))
@@ -189,6 +292,12 @@ int libxl__dom_load_acpi(libxl__gc *gc,
         goto out;
     }
 
+    key = acpi_cache_key(gc, libxl_ctxt.page_size, &config, &key_len);
+    if (acpi_cache_get(gc, key, key_len, dom)) {
+        LOG(DEBUG, "reusing ACPI tables built for an identical guest");
+        goto done;
+    }
+
     config.rsdp = (unsigned long)libxl__malloc(gc, libxl_ctxt.page_size);
     config.infop = (unsigned long)libxl__malloc(gc, libxl_ctxt.page_size);
     /* Pages to hold ACPI tables */
@@ -221,14 +330,18 @@ int libxl__dom_load_acpi(libxl__gc *gc,
 
     dom->acpi_modules[0].data = (void *)config.rsdp;
     dom->acpi_modules[0].length = 64;
-    dom->acpi_modules[0].guest_addr_out = RSDP_ADDRESS;
 
     dom->acpi_modules[1].data = (void *)config.infop;
     dom->acpi_modules[1].length = 4096;
-    dom->acpi_modules[1].guest_addr_out = ACPI_INFO_PHYSICAL_ADDRESS;
 
     dom->acpi_modules[2].data = acpi_pages;
     dom->acpi_modules[2].length = acpi_pages_num  << libxl_ctxt.page_shift;
+
+    acpi_cache_put(gc, key, key_len, dom, 3);
+
+done:
+    dom->acpi_modules[0].guest_addr_out = RSDP_ADDRESS;
+    dom->acpi_modules[1].guest_addr_out = ACPI_INFO_PHYSICAL_ADDRESS;
     dom->acpi_modules[2].guest_addr_out = ACPI_INFO_PHYSICAL_ADDRESS +
         libxl_ctxt.page_size;
 
@@ -45,6 +45,53 @@ char **libxl__xs_kvs_of_flexarray(libxl__gc *gc, flexarray_t *array)
     return kvs;
 }
 
+/*
+ * Sends the writes in as few XS_BATCH requests as possible.  On failure
+ * some of the batches may have been applied already; that's fine since
+ * the caller just does all of it again one request at a time.
+ */
+static int xs_writev_batch(libxl__gc *gc, xs_transaction_t t,
+                           const char *dir, char *kvs[],
+                           struct xs_permissions *perms,
+                           unsigned int num_perms)
+{
+    libxl_ctx *ctx = libxl__gc_owner(gc);
+    struct xs_batch *b;
+    char *path;
+    bool retry;
+    int i, rc = ERROR_FAIL;
+
+    b = xs_batch_new();
+    if (!b)
+        return ERROR_NOMEM;
+
+    for (i = 0; kvs[i] != NULL; i += 2) {
+        if (!kvs[i + 1])
+            continue;
+        path = GCSPRINTF("%s/%s", dir, kvs[i]);
+        for (retry = false; ; retry = true) {
+            if (xs_batch_write(b, path, kvs[i + 1], strlen(kvs[i + 1])) &&
+                (!perms ||
+                 xs_batch_set_permissions(b, path, perms, num_perms)))
+                break;
+            /* Full: send what we have and carry on in an empty batch. */
+            if (errno != E2BIG || retry || !xs_batch_commit(ctx->xsh, t, b))
+                goto out;
+        }
+    }
+
+    if (!xs_batch_empty(b) && !xs_batch_commit(ctx->xsh, t, b))
+        goto out;
+
+    rc = 0;
+
+out:
+    if (rc && errno == ENOSYS)
+        ctx->xs_batch_unsupported = true;
+    xs_batch_free(b);
+    return rc;
+}
+
 int libxl__xs_writev_perms(libxl__gc *gc, xs_transaction_t t,
                            const char *dir, char *kvs[],
                            struct xs_permissions *perms,
@@ -57,6 +104,10 @@ int libxl__xs_writev_perms(libxl__gc *gc, xs_transaction_t t,
     if (!kvs)
         return 0;
 
+    if (!ctx->xs_batch_unsupported &&
+        !xs_writev_batch(gc, t, dir, kvs, perms, num_perms))
+        return 0;
+
     for (i = 0; kvs[i] != NULL; i += 2) {
         path = GCSPRINTF("%s/%s", dir, kvs[i]);
         if (path && kvs[i + 1]) {
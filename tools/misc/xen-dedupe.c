@@ -0,0 +1,586 @@
+/*
+ * xen-dedupe: share identical pages between HVM guests
+ *
+ * Scans the memory of the domains which opted in, hashes every page and
+ * shares the pages of a later domain (or gfn) with an earlier one holding
+ * the same contents.  A candidate pair is nominated first, which makes both
+ * pages read-only, and the contents are compared again before sharing, so
+ * hash collisions and pages changed since the scan are never merged.  A
+ * guest writing a page after nomination just invalidates its handle and
+ * the share of that entry fails.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License only.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <xenctrl.h>
+#include <xenforeignmemory.h>
+#include <xenstore.h>
+
+#define CHUNK_PAGES     256     /* Pages mapped and hashed at a time. */
+#define MAX_DOMAINS     1024
+
+/* Per-domain opt-in, when no domains are given on the command line. */
+#define OPT_IN_NODE     "memory/dedupe"
+
+static xc_interface *xch;
+static xenforeignmemory_handle *fmem;
+static struct xs_handle *xsh;
+
+static unsigned long rate = 25600;      /* Pages scanned per second. */
+static unsigned int cpu_budget = 10;    /* Percent of one CPU. */
+static unsigned long target_pages;      /* 0 for no limit. */
+static unsigned int interval = 60;      /* Seconds between passes. */
+static unsigned long nr_slots = 1UL << 20;
+static bool once, verbose;
+
+static volatile sig_atomic_t quit;
+
+/*
+ * The pages seen so far, by hash.  Slots are overwritten when a probe
+ * sequence is full, so a bounded table only loses some opportunities.
+ */
+struct slot {
+    uint64_t hash;
+    uint64_t gfn;
+    domid_t domid;
+    bool used;
+};
+
+#define PROBES 8
+
+static struct slot *slots;
+
+/* Candidates of the chunk being processed, with a page of domid/gfn. */
+struct candidate {
+    domid_t source_domid;
+    xen_mem_sharing_batch_entry_t e;
+};
+
+static struct candidate cands[CHUNK_PAGES];
+static unsigned int nr_cands;
+
+static struct {
+    unsigned long scanned, candidates, shared, mismatched;
+} stats;
+
+static void usage(FILE *f)
+{
+    fprintf(f,
+            "Usage: xen-dedupe [options] [domid...]\n"
+            "Share identical pages between the given HVM domains, or the\n"
+            "domains whose xenstore node " OPT_IN_NODE " is 1.\n"
+            "\n"
+            "  -r, --rate=PAGES       pages scanned per second (default %lu)\n"
+            "  -c, --cpu=PERCENT      budget of one CPU (default %u)\n"
+            "  -t, --target=MIB       stop sharing once this much memory is\n"
+            "                         saved host wide (default no limit)\n"
+            "  -i, --interval=SECS    pause between passes (default %u)\n"
+            "  -e, --entries=N        pages remembered between passes,\n"
+            "                         rounded up to a power of 2 (default %lu)\n"
+            "  -1, --once             stop after one pass\n"
+            "  -v, --verbose\n"
+            "  -h, --help\n",
+            rate, cpu_budget, interval, nr_slots);
+}
+
+static void handle_signal(int sig)
+{
+    quit = 1;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void sleep_ns(uint64_t ns)
+{
+    struct timespec ts = {
+        .tv_sec = ns / 1000000000,
+        .tv_nsec = ns % 1000000000,
+    };
+
+    while ( !quit && nanosleep(&ts, &ts) && errno == EINTR )
+        ;
+}
+
+/*
+ * Throttle after a chunk of nr pages which took work_ns: to the scan rate,
+ * and so that the time spent working, including in the hypervisor, stays
+ * within the CPU budget.
+ */
+static void throttle(unsigned int nr, uint64_t work_ns)
+{
+    uint64_t rate_ns = nr * 1000000000ULL / rate;
+    uint64_t budget_ns = work_ns * (100 - cpu_budget) / cpu_budget;
+    uint64_t idle_ns = budget_ns;
+
+    if ( rate_ns > work_ns && rate_ns - work_ns > idle_ns )
+        idle_ns = rate_ns - work_ns;
+
+    sleep_ns(idle_ns);
+}
+
+/* The core loop of xxHash64, over a page. */
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+
+static inline uint64_t rotl64(uint64_t x, unsigned int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t hash_round(uint64_t acc, uint64_t in)
+{
+    return rotl64(acc + in * PRIME64_2, 31) * PRIME64_1;
+}
+
+static uint64_t page_hash(const void *page)
+{
+    const uint64_t *p = page;
+    uint64_t v0 = PRIME64_1 + PRIME64_2, v1 = PRIME64_2, v2 = 0;
+    uint64_t v3 = -PRIME64_1, h;
+    unsigned int i;
+
+    for ( i = 0; i < XC_PAGE_SIZE / sizeof(*p); i += 4 )
+    {
+        v0 = hash_round(v0, p[i]);
+        v1 = hash_round(v1, p[i + 1]);
+        v2 = hash_round(v2, p[i + 2]);
+        v3 = hash_round(v3, p[i + 3]);
+    }
+
+    h = rotl64(v0, 1) + rotl64(v1, 7) + rotl64(v2, 12) + rotl64(v3, 18);
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+
+    return h;
+}
+
+/*
+ * Look up a page by hash.  Returns the slot of an earlier page with the
+ * same hash, or NULL having recorded this page.
+ */
+static struct slot *slot_lookup(uint64_t hash, domid_t domid, uint64_t gfn)
+{
+    unsigned long mask = nr_slots - 1, i;
+    struct slot *s, *free_slot = NULL;
+
+    for ( i = 0; i < PROBES; i++ )
+    {
+        s = &slots[(hash + i) & mask];
+        if ( !s->used )
+        {
+            if ( !free_slot )
+                free_slot = s;
+            continue;
+        }
+        if ( s->hash != hash )
+            continue;
+        if ( s->domid == domid && s->gfn == gfn )
+            return NULL;
+        return s;
+    }
+
+    s = free_slot ?: &slots[hash & mask];
+    s->hash = hash;
+    s->gfn = gfn;
+    s->domid = domid;
+    s->used = true;
+
+    return NULL;
+}
+
+static int cmp_cands(const void *a, const void *b)
+{
+    const struct candidate *x = a, *y = b;
+
+    return (int)x->source_domid - (int)y->source_domid;
+}
+
+/* Compare the page of each nominated entry with its source, after nomination. */
+static void verify_run(domid_t source, domid_t client,
+                       struct candidate *c, unsigned int nr)
+{
+    xen_pfn_t sgfns[CHUNK_PAGES], cgfns[CHUNK_PAGES];
+    int serr[CHUNK_PAGES], cerr[CHUNK_PAGES];
+    uint8_t *smap, *cmap;
+    unsigned int i;
+
+    for ( i = 0; i < nr; i++ )
+    {
+        sgfns[i] = c[i].e.source_gfn;
+        cgfns[i] = c[i].e.client_gfn;
+    }
+
+    smap = xenforeignmemory_map(fmem, source, PROT_READ, nr, sgfns, serr);
+    cmap = xenforeignmemory_map(fmem, client, PROT_READ, nr, cgfns, cerr);
+
+    for ( i = 0; i < nr; i++ )
+    {
+        if ( c[i].e.rc )
+            continue;
+        if ( !smap || !cmap || serr[i] || cerr[i] ||
+             memcmp(smap + i * XC_PAGE_SIZE, cmap + i * XC_PAGE_SIZE,
+                    XC_PAGE_SIZE) )
+        {
+            c[i].e.rc = -EAGAIN;
+            stats.mismatched++;
+        }
+    }
+
+    if ( smap )
+        xenforeignmemory_unmap(fmem, smap, nr);
+    if ( cmap )
+        xenforeignmemory_unmap(fmem, cmap, nr);
+}
+
+/* Nominate, verify and share the candidates of one source domain. */
+static void share_run(domid_t source, domid_t client,
+                      struct candidate *c, unsigned int nr)
+{
+    xen_mem_sharing_batch_entry_t entries[CHUNK_PAGES];
+    unsigned int i, n;
+
+    for ( i = 0; i < nr; i++ )
+        entries[i] = c[i].e;
+
+    if ( xc_memshr_nominate_batch(xch, source, entries, nr) )
+    {
+        if ( verbose )
+            fprintf(stderr, "nominating pages of d%d failed: %s\n",
+                    source, strerror(errno));
+        return;
+    }
+
+    for ( i = 0; i < nr; i++ )
+        c[i].e = entries[i];
+    verify_run(source, client, c, nr);
+
+    for ( i = n = 0; i < nr; i++ )
+        if ( !c[i].e.rc )
+            entries[n++] = c[i].e;
+    if ( !n )
+        return;
+
+    if ( xc_memshr_share_batch(xch, source, entries, n) )
+    {
+        if ( verbose )
+            fprintf(stderr, "sharing pages of d%d failed: %s\n",
+                    source, strerror(errno));
+        return;
+    }
+
+    for ( i = 0; i < n; i++ )
+        if ( !entries[i].rc )
+            stats.shared++;
+}
+
+static bool target_reached(void)
+{
+    long freed;
+
+    if ( !target_pages )
+        return false;
+
+    freed = xc_sharing_freed_pages(xch);
+    return freed >= 0 && (unsigned long)freed >= target_pages;
+}
+
+static void flush_candidates(domid_t client)
+{
+    unsigned int i, j;
+
+    if ( !nr_cands )
+        return;
+
+    if ( !target_reached() )
+    {
+        qsort(cands, nr_cands, sizeof(*cands), cmp_cands);
+        for ( i = 0; i < nr_cands; i = j )
+        {
+            for ( j = i + 1; j < nr_cands; j++ )
+                if ( cands[j].source_domid != cands[i].source_domid )
+                    break;
+            share_run(cands[i].source_domid, client, &cands[i], j - i);
+        }
+    }
+
+    nr_cands = 0;
+}
+
+static void scan_chunk(domid_t domid, uint64_t first, unsigned int nr)
+{
+    xen_pfn_t gfns[CHUNK_PAGES];
+    int errs[CHUNK_PAGES];
+    uint8_t *map;
+    unsigned int i;
+
+    for ( i = 0; i < nr; i++ )
+        gfns[i] = first + i;
+
+    map = xenforeignmemory_map(fmem, domid, PROT_READ, nr, gfns, errs);
+    if ( !map )
+        return;
+
+    for ( i = 0; i < nr; i++ )
+    {
+        struct slot *s;
+        struct candidate *c;
+
+        if ( errs[i] )
+            continue;
+
+        stats.scanned++;
+        s = slot_lookup(page_hash(map + i * XC_PAGE_SIZE), domid, gfns[i]);
+        if ( !s )
+            continue;
+
+        stats.candidates++;
+        c = &cands[nr_cands++];
+        memset(c, 0, sizeof(*c));
+        c->source_domid = s->domid;
+        c->e.source_gfn = s->gfn;
+        c->e.client_gfn = gfns[i];
+        c->e.client_domain = domid;
+    }
+
+    /* Nomination needs the pages to be unmapped. */
+    xenforeignmemory_unmap(fmem, map, nr);
+
+    flush_candidates(domid);
+}
+
+static void scan_domain(domid_t domid)
+{
+    xen_pfn_t max_gpfn;
+    uint64_t gfn, start;
+    unsigned int nr;
+
+    if ( xc_memshr_control(xch, domid, 1) )
+    {
+        if ( verbose )
+            fprintf(stderr, "cannot enable sharing on d%d: %s\n",
+                    domid, strerror(errno));
+        return;
+    }
+
+    if ( xc_domain_maximum_gpfn(xch, domid, &max_gpfn) < 0 )
+        return;
+
+    for ( gfn = 0; gfn <= max_gpfn && !quit; gfn += nr )
+    {
+        nr = CHUNK_PAGES;
+        if ( max_gpfn - gfn + 1 < nr )
+            nr = max_gpfn - gfn + 1;
+
+        start = now_ns();
+        scan_chunk(domid, gfn, nr);
+        throttle(nr, now_ns() - start);
+    }
+}
+
+static bool opted_in(domid_t domid)
+{
+    char path[64], *val;
+    unsigned int len;
+    bool ret;
+
+    snprintf(path, sizeof(path), "/local/domain/%d/" OPT_IN_NODE, domid);
+    val = xs_read(xsh, XBT_NULL, path, &len);
+    ret = val && !strcmp(val, "1");
+    free(val);
+
+    return ret;
+}
+
+static unsigned int find_domains(domid_t *domids)
+{
+    static xc_domaininfo_t info[MAX_DOMAINS];
+    int i, n, nr = 0;
+
+    n = xc_domain_getinfolist(xch, 1, MAX_DOMAINS, info);
+    for ( i = 0; i < n; i++ )
+        if ( (info[i].flags & XEN_DOMINF_hvm_guest) &&
+             !(info[i].flags & XEN_DOMINF_dying) &&
+             opted_in(info[i].domain) )
+            domids[nr++] = info[i].domain;
+
+    return nr;
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct option opts[] = {
+        { "rate",     required_argument, NULL, 'r' },
+        { "cpu",      required_argument, NULL, 'c' },
+        { "target",   required_argument, NULL, 't' },
+        { "interval", required_argument, NULL, 'i' },
+        { "entries",  required_argument, NULL, 'e' },
+        { "once",     no_argument,       NULL, '1' },
+        { "verbose",  no_argument,       NULL, 'v' },
+        { "help",     no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    domid_t domids[MAX_DOMAINS];
+    unsigned int nr_domids = 0, i;
+    unsigned long entries;
+    int ch, rc = 1;
+
+    while ( (ch = getopt_long(argc, argv, "r:c:t:i:e:1vh", opts, NULL)) != -1 )
+    {
+        switch ( ch )
+        {
+        case 'r':
+            rate = strtoul(optarg, NULL, 0);
+            break;
+        case 'c':
+            cpu_budget = strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            target_pages = strtoul(optarg, NULL, 0) << (20 - XC_PAGE_SHIFT);
+            break;
+        case 'i':
+            interval = strtoul(optarg, NULL, 0);
+            break;
+        case 'e':
+            entries = strtoul(optarg, NULL, 0);
+            for ( nr_slots = PROBES; nr_slots < entries; nr_slots <<= 1 )
+                ;
+            break;
+        case '1':
+            once = true;
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        case 'h':
+            usage(stdout);
+            return 0;
+        default:
+            usage(stderr);
+            return 1;
+        }
+    }
+
+    if ( !rate || !cpu_budget || cpu_budget > 100 )
+    {
+        usage(stderr);
+        return 1;
+    }
+
+    for ( ; optind < argc && nr_domids < MAX_DOMAINS; optind++ )
+    {
+        char *end;
+        unsigned long domid = strtoul(argv[optind], &end, 0);
+
+        if ( *end || !domid || domid >= DOMID_FIRST_RESERVED )
+        {
+            fprintf(stderr, "invalid domid %s\n", argv[optind]);
+            return 1;
+        }
+        domids[nr_domids++] = domid;
+    }
+
+    slots = calloc(nr_slots, sizeof(*slots));
+    if ( !slots )
+    {
+        perror("Allocating the page table failed");
+        return 1;
+    }
+
+    xch = xc_interface_open(NULL, NULL, 0);
+    fmem = xenforeignmemory_open(NULL, 0);
+    if ( !xch || !fmem )
+    {
+        perror("Opening xc or foreignmemory failed");
+        goto out;
+    }
+    if ( !nr_domids )
+    {
+        xsh = xs_open(0);
+        if ( !xsh )
+        {
+            perror("Opening xenstore failed");
+            goto out;
+        }
+    }
+
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+
+    while ( !quit )
+    {
+        domid_t found[MAX_DOMAINS];
+        domid_t *d = domids;
+        unsigned int nr = nr_domids;
+
+        if ( !nr )
+        {
+            nr = find_domains(found);
+            d = found;
+        }
+
+        memset(&stats, 0, sizeof(stats));
+        for ( i = 0; i < nr && !quit; i++ )
+            scan_domain(d[i]);
+
+        if ( verbose )
+            printf("pass over %u domains: %lu pages scanned, %lu candidates, "
+                   "%lu shared, %lu changed or collided, %ld freed host wide\n",
+                   nr, stats.scanned, stats.candidates, stats.shared,
+                   stats.mismatched, xc_sharing_freed_pages(xch));
+
+        if ( once )
+            break;
+        sleep_ns((uint64_t)interval * 1000000000);
+    }
+
+    rc = 0;
+
+ out:
+    if ( xsh )
+        xs_close(xsh);
+    if ( fmem )
+        xenforeignmemory_close(fmem);
+    if ( xch )
+        xc_interface_close(xch);
+    free(slots);
+
+    return rc;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -4,6 +4,10 @@
 #include <xc_core.h>
 #include <xenstore.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
 
 #undef ARRAY_SIZE /* We shouldn't be including xc_private.h */
 #define ARRAY_SIZE(a) (sizeof (a) / sizeof ((a)[0]))
@@ -22,6 +26,7 @@ void show_help(void)
             "  mem-online    <mfn>      online MEMORY <mfn>\n"
             "  mem-offline   <mfn>      offline MEMORY <mfn>\n"
             "  mem-status    <mfn>      query Memory status<mfn>\n"
+            "  microcode-update <file>  update CPU microcode from <file>\n"
            );
 }
 
@@ -307,6 +312,54 @@ static int hp_cpu_offline_func(int argc, char *argv[])
     return ret;
 }
 
+static int hp_microcode_update_func(int argc, char *argv[])
+{
+    int fd, ret;
+    struct stat st;
+    struct timeval start, end;
+    void *buf;
+
+    if ( argc != 1 )
+    {
+        show_help();
+        return -1;
+    }
+
+    fd = open(argv[0], O_RDONLY);
+    if ( fd < 0 || fstat(fd, &st) < 0 )
+    {
+        fprintf(stderr, "Cannot open %s: %s\n", argv[0], strerror(errno));
+        if ( fd >= 0 )
+            close(fd);
+        return -1;
+    }
+
+    buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if ( buf == MAP_FAILED )
+    {
+        fprintf(stderr, "Cannot map %s: %s\n", argv[0], strerror(errno));
+        return -1;
+    }
+
+    printf("Prepare to update microcode from %s\n", argv[0]);
+    gettimeofday(&start, NULL);
+    ret = xc_microcode_update(xch, buf, st.st_size);
+    gettimeofday(&end, NULL);
+    munmap(buf, st.st_size);
+
+    if ( ret < 0 )
+        fprintf(stderr, "Microcode update failed (error %d: %s)\n",
+                errno, strerror(errno));
+    else
+        printf("Microcode updated in %lu us (see 'xl dmesg' for how long "
+               "the machine was stopped)\n",
+               (unsigned long)((end.tv_sec - start.tv_sec) * 1000000UL +
+                               end.tv_usec - start.tv_usec));
+
+    return ret;
+}
+
 struct {
     const char *name;
     int (*function)(int argc, char *argv[]);
@@ -317,6 +370,7 @@ struct {
     { "mem-status", hp_mem_query_func},
     { "mem-online", hp_mem_online_func},
     { "mem-offline", hp_mem_offline_func},
+    { "microcode-update", hp_microcode_update_func},
 };
 
 
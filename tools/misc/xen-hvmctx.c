@@ -378,10 +378,22 @@ static void dump_viridian_domain(void)
 static void dump_viridian_vcpu(void)
 {
     HVM_SAVE_TYPE(VIRIDIAN_VCPU) p;
+    unsigned int i;
+
     READ(p);
     printf("    VIRIDIAN_VCPU: vp_assist_msr 0x%llx, vp_assist_vector 0x%x\n",
 	   (unsigned long long) p.vp_assist_msr,
 	   p.vp_assist_vector);
+    printf("    VIRIDIAN_VCPU: scontrol 0x%llx, siefp 0x%llx, simp 0x%llx\n",
+           (unsigned long long) p.synic_scontrol_msr,
+           (unsigned long long) p.synic_siefp_msr,
+           (unsigned long long) p.synic_simp_msr);
+    for ( i = 0; i < 4; i++ )
+        printf("    VIRIDIAN_VCPU: stimer%u config 0x%llx, count 0x%llx, "
+               "expiration 0x%llx\n", i,
+               (unsigned long long) p.stimer_config_msr[i],
+               (unsigned long long) p.stimer_count_msr[i],
+               (unsigned long long) p.stimer_expiration[i]);
 }
 
 static void dump_vmce_vcpu(void)
@@ -373,7 +373,7 @@ int action_func(int argc, char *argv[], unsigned int idx)
         rc = status.state;
 
     if ( action_options[idx].expected == rc )
-        printf("completed\n");
+        printf("completed (CPUs held for %uus)\n", status.stop_us);
     else if ( rc < 0 )
     {
         printf("failed\n");
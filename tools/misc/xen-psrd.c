@@ -0,0 +1,597 @@
+/*
+ * xen-psrd.c
+ *
+ * Cache allocation policy daemon: reads the L3 occupancy and memory
+ * bandwidth of each domain from CMT/MBM, and reassigns CAT cache ways so
+ * that domains with a declared occupancy objective get the ways they need,
+ * while best effort domains thrashing the cache get clamped to a few ways.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <xenctrl.h>
+
+/* Intervals a clamped domain has to stay quiet for before it is released. */
+#define RELEASE_INTERVALS   3
+
+/* MBM counters are only guaranteed to be this wide. */
+#define MBM_COUNTER_MASK    ((1ull << 24) - 1)
+
+#define DOMINFO_CHUNK       256
+
+/* A declared objective: keep at least min_kb of L3 for the domain. */
+struct slo {
+    uint32_t domid;
+    unsigned int min_kb, max_kb;
+};
+
+struct socket {
+    bool cat;                   /* CAT available on this socket. */
+    unsigned int cpu;           /* Any CPU of the socket, for CMT reads. */
+    unsigned int cbm_len;
+    unsigned int way_kb;
+    unsigned int shared;        /* Ways not reserved for any domain. */
+};
+
+struct dom_socket {
+    unsigned int ways;          /* Reserved ways, if the domain has an SLO. */
+    uint64_t cbm;               /* Last mask set, 0 if none. */
+    uint64_t occ_kb;
+    uint64_t mbm;               /* Last raw MBM counter read. */
+    uint64_t bw_mbs;
+    bool mbm_valid;
+};
+
+struct dom {
+    uint32_t domid;
+    bool seen;
+    bool attached;              /* Monitoring attached by us. */
+    bool no_rmid;               /* Attaching failed, don't retry. */
+    bool clamped;
+    unsigned int quiet;
+    const struct slo *slo;
+    struct dom_socket *s;
+};
+
+static xc_interface *xch;
+static struct socket *sockets;
+static unsigned int nr_sockets;
+static struct dom *doms;
+static unsigned int nr_doms;
+static struct slo *slos;
+static unsigned int nr_slos;
+
+static unsigned int upscaling_factor;
+static bool have_mbm;
+static unsigned int interval = 5, clamp_ways = 2, occ_pct = 50;
+static unsigned long bw_limit;
+static bool dry_run, verbose;
+static volatile sig_atomic_t stop;
+
+static void usage(const char *prog)
+{
+    printf("%s: [-s domid:min_kb[:max_kb]]... [-b mbs] [-p pct] [-c ways] "
+           "[-i secs] [-n] [-v]\n", prog);
+    printf("    -s domid:min_kb[:max_kb] : reserve ways for at least min_kb\n");
+    printf("                               of L3, growing up to max_kb while\n");
+    printf("                               the domain fills what it has\n");
+    printf("    -b mbs  : clamp best effort domains above mbs MB/s (MBM)\n");
+    printf("    -p pct  : clamp best effort domains occupying more than pct%%\n");
+    printf("              of the shared ways (default 50)\n");
+    printf("    -c ways : ways clamped domains are confined to (default 2)\n");
+    printf("    -i secs : interval between adjustments (default 5)\n");
+    printf("    -n      : only report what would be changed\n");
+    printf("    -v      : report the measurements of each interval\n");
+}
+
+static void handle_signal(int sig)
+{
+    stop = 1;
+}
+
+/* A mask of @nr ways starting at way @first. */
+static uint64_t ways_mask(unsigned int first, unsigned int nr)
+{
+    return nr ? ((~0ull >> (64 - nr)) << first) : 0;
+}
+
+static int parse_slo(const char *arg)
+{
+    struct slo *slo;
+    char *end;
+
+    slo = realloc(slos, (nr_slos + 1) * sizeof(*slos));
+    if ( !slo )
+        return -1;
+    slos = slo;
+    slo = &slos[nr_slos];
+
+    slo->domid = strtoul(arg, &end, 0);
+    if ( *end != ':' )
+        return -1;
+    slo->min_kb = strtoul(end + 1, &end, 0);
+    slo->max_kb = slo->min_kb;
+    if ( *end == ':' )
+        slo->max_kb = strtoul(end + 1, &end, 0);
+    if ( *end || !slo->min_kb || slo->max_kb < slo->min_kb )
+        return -1;
+
+    nr_slos++;
+    return 0;
+}
+
+static int init_sockets(void)
+{
+    xc_cputopo_t *topo;
+    unsigned int i, nr_cpus = 0, cos_max, l3_kb;
+    bool cdp;
+
+    if ( xc_cputopoinfo(xch, &nr_cpus, NULL) )
+        return -1;
+    topo = calloc(nr_cpus, sizeof(*topo));
+    if ( !topo || xc_cputopoinfo(xch, &nr_cpus, topo) )
+    {
+        free(topo);
+        return -1;
+    }
+
+    for ( i = 0; i < nr_cpus; i++ )
+        if ( topo[i].socket != XEN_INVALID_SOCKET_ID &&
+             topo[i].socket >= nr_sockets )
+            nr_sockets = topo[i].socket + 1;
+
+    sockets = calloc(nr_sockets, sizeof(*sockets));
+    if ( !sockets )
+    {
+        free(topo);
+        return -1;
+    }
+
+    for ( i = nr_cpus; i-- > 0; )
+        if ( topo[i].socket != XEN_INVALID_SOCKET_ID )
+            sockets[topo[i].socket].cpu = i;
+    free(topo);
+
+    for ( i = 0; i < nr_sockets; i++ )
+    {
+        struct socket *s = &sockets[i];
+
+        if ( xc_psr_cat_get_l3_info(xch, i, &cos_max, &s->cbm_len, &cdp) ||
+             !s->cbm_len ||
+             xc_psr_cmt_get_l3_cache_size(xch, s->cpu, &l3_kb) )
+            continue;
+
+        s->cat = true;
+        s->way_kb = l3_kb / s->cbm_len;
+        printf("Socket %u: %u ways of %u KB, %u classes of service%s\n",
+               i, s->cbm_len, s->way_kb, cos_max + 1, cdp ? ", CDP" : "");
+    }
+
+    return 0;
+}
+
+static struct dom *find_dom(uint32_t domid)
+{
+    unsigned int i;
+    struct dom *d;
+
+    for ( i = 0; i < nr_doms; i++ )
+        if ( doms[i].domid == domid )
+            return &doms[i];
+
+    d = realloc(doms, (nr_doms + 1) * sizeof(*doms));
+    if ( !d )
+        return NULL;
+    doms = d;
+    d = &doms[nr_doms];
+
+    memset(d, 0, sizeof(*d));
+    d->domid = domid;
+    d->s = calloc(nr_sockets, sizeof(*d->s));
+    if ( !d->s )
+        return NULL;
+    for ( i = 0; i < nr_slos; i++ )
+        if ( slos[i].domid == domid )
+            d->slo = &slos[i];
+    nr_doms++;
+
+    return d;
+}
+
+/* Refresh the domain list, attaching monitoring to new domains. */
+static int update_doms(void)
+{
+    xc_domaininfo_t info[DOMINFO_CHUNK];
+    uint32_t rmid, next = 0;
+    unsigned int i;
+    int nr;
+
+    for ( i = 0; i < nr_doms; i++ )
+        doms[i].seen = false;
+
+    do {
+        nr = xc_domain_getinfolist(xch, next, DOMINFO_CHUNK, info);
+        if ( nr < 0 )
+            return -1;
+
+        for ( i = 0; i < nr; i++ )
+        {
+            struct dom *d = find_dom(info[i].domain);
+
+            if ( !d )
+                return -1;
+            d->seen = true;
+
+            if ( d->attached || d->no_rmid ||
+                 (!xc_psr_cmt_get_domain_rmid(xch, d->domid, &rmid) && rmid) )
+                continue;
+
+            if ( xc_psr_cmt_attach(xch, d->domid) )
+            {
+                fprintf(stderr, "Can't monitor d%u: %d (%s)\n",
+                        d->domid, errno, strerror(errno));
+                d->no_rmid = true;
+            }
+            else
+                d->attached = true;
+        }
+        if ( nr )
+            next = info[nr - 1].domain + 1;
+    } while ( nr == DOMINFO_CHUNK );
+
+    /* Forget about domains which are gone. */
+    for ( i = 0; i < nr_doms; )
+    {
+        if ( doms[i].seen )
+        {
+            i++;
+            continue;
+        }
+        free(doms[i].s);
+        doms[i] = doms[--nr_doms];
+    }
+
+    return 0;
+}
+
+static void sample(struct dom *d, unsigned int secs)
+{
+    uint64_t data, tsc, delta;
+    unsigned int i;
+    uint32_t rmid;
+
+    if ( xc_psr_cmt_get_domain_rmid(xch, d->domid, &rmid) || !rmid )
+        return;
+
+    for ( i = 0; i < nr_sockets; i++ )
+    {
+        struct dom_socket *ds = &d->s[i];
+
+        if ( !sockets[i].cat )
+            continue;
+
+        if ( !xc_psr_cmt_get_data(xch, rmid, sockets[i].cpu,
+                                  XC_PSR_CMT_L3_OCCUPANCY, &data, &tsc) )
+            ds->occ_kb = data * upscaling_factor / 1024;
+
+        if ( !have_mbm ||
+             xc_psr_cmt_get_data(xch, rmid, sockets[i].cpu,
+                                 XC_PSR_CMT_TOTAL_MEM_COUNT, &data, &tsc) )
+            continue;
+
+        if ( ds->mbm_valid )
+        {
+            delta = (data - ds->mbm) & MBM_COUNTER_MASK;
+            ds->bw_mbs = delta * upscaling_factor / secs / (1024 * 1024);
+        }
+        ds->mbm = data;
+        ds->mbm_valid = true;
+    }
+}
+
+/* Resize the reservations of the domains with an SLO on socket @i. */
+static unsigned int reserve(unsigned int i)
+{
+    const struct socket *s = &sockets[i];
+    unsigned int j, want, avail, reserved = 0;
+
+    /* The shared ways never shrink below what clamped domains get. */
+    avail = s->cbm_len > clamp_ways ? s->cbm_len - clamp_ways : 0;
+
+    for ( j = 0; j < nr_doms; j++ )
+    {
+        struct dom *d = &doms[j];
+        struct dom_socket *ds = &d->s[i];
+        unsigned int min, max;
+
+        if ( !d->slo )
+            continue;
+
+        min = (d->slo->min_kb + s->way_kb - 1) / s->way_kb;
+        max = (d->slo->max_kb + s->way_kb - 1) / s->way_kb;
+
+        want = ds->ways < min ? min : ds->ways;
+        /* Filling what it has: give it another way, if allowed to. */
+        if ( ds->occ_kb * 10 >= (uint64_t)want * s->way_kb * 9 && want < max )
+            want++;
+        /* Using less than half of one way fewer: take one back. */
+        else if ( want > min &&
+                  ds->occ_kb * 2 < (uint64_t)(want - 1) * s->way_kb )
+            want--;
+
+        if ( want > avail - reserved )
+        {
+            if ( ds->ways != avail - reserved )
+                fprintf(stderr, "d%u: only %u of %u ways available on "
+                        "socket %u\n", d->domid, avail - reserved, want, i);
+            want = avail - reserved;
+        }
+
+        ds->ways = want;
+        reserved += want;
+    }
+
+    return reserved;
+}
+
+static void set_cbm(struct dom *d, unsigned int i, uint64_t cbm)
+{
+    if ( d->s[i].cbm == cbm )
+        return;
+
+    printf("d%u socket %u: cbm %#"PRIx64" -> %#"PRIx64"%s\n", d->domid, i,
+           d->s[i].cbm, cbm, dry_run ? " (dry run)" : "");
+
+    if ( !dry_run && xc_psr_cat_set_domain_data(xch, d->domid,
+                                                XC_PSR_CAT_L3_CBM, i, cbm) )
+    {
+        fprintf(stderr, "d%u socket %u: setting cbm %#"PRIx64" failed: "
+                "%d (%s)\n", d->domid, i, cbm, errno,
+                errno == EOVERFLOW ? "out of classes of service" :
+                strerror(errno));
+        return;
+    }
+
+    d->s[i].cbm = cbm;
+}
+
+/*
+ * Ways are handed out from the top: the domains with an SLO each get
+ * their own, and all other domains share the remaining low ones, clamped
+ * domains only the lowest clamp_ways of them.
+ */
+static void adjust(void)
+{
+    unsigned int i, j, top;
+    uint64_t occ_kb, bw_mbs;
+
+    for ( i = 0; i < nr_sockets; i++ )
+    {
+        struct socket *s = &sockets[i];
+
+        if ( !s->cat )
+            continue;
+
+        top = s->cbm_len;
+        s->shared = s->cbm_len - reserve(i);
+
+        for ( j = 0; j < nr_doms; j++ )
+        {
+            struct dom *d = &doms[j];
+
+            if ( d->slo && d->s[i].ways )
+            {
+                top -= d->s[i].ways;
+                set_cbm(d, i, ways_mask(top, d->s[i].ways));
+            }
+        }
+
+        for ( j = 0; j < nr_doms; j++ )
+        {
+            struct dom *d = &doms[j];
+
+            if ( d->slo && d->s[i].ways )
+                continue;
+
+            if ( verbose )
+                printf("d%u socket %u: %"PRIu64" KB, %"PRIu64" MB/s%s\n",
+                       d->domid, i, d->s[i].occ_kb, d->s[i].bw_mbs,
+                       d->clamped ? " (clamped)" : "");
+
+            set_cbm(d, i, d->clamped && clamp_ways < s->shared ?
+                    ways_mask(0, clamp_ways) : ways_mask(0, s->shared));
+        }
+    }
+
+    /* Clamping is decided over all sockets, and applies from next time. */
+    for ( j = 0; j < nr_doms; j++ )
+    {
+        struct dom *d = &doms[j];
+        bool noisy = false, quiet = true;
+
+        if ( d->slo || d->domid == 0 )
+            continue;
+
+        for ( i = 0; i < nr_sockets; i++ )
+        {
+            const struct socket *s = &sockets[i];
+            uint64_t shared_kb, clamp_kb;
+
+            if ( !s->cat )
+                continue;
+
+            occ_kb = d->s[i].occ_kb;
+            bw_mbs = d->s[i].bw_mbs;
+            shared_kb = (uint64_t)s->shared * s->way_kb;
+            clamp_kb = (uint64_t)clamp_ways * s->way_kb;
+
+            if ( occ_kb * 100 > shared_kb * occ_pct ||
+                 (bw_limit && bw_mbs > bw_limit) )
+                noisy = true;
+            if ( occ_kb * 2 >= clamp_kb || (bw_limit && bw_mbs * 2 > bw_limit) )
+                quiet = false;
+        }
+
+        if ( !d->clamped && noisy )
+        {
+            printf("d%u: clamping to %u ways\n", d->domid, clamp_ways);
+            d->clamped = true;
+        }
+        else if ( d->clamped && (quiet ? ++d->quiet : (d->quiet = 0)) >=
+                  RELEASE_INTERVALS )
+        {
+            printf("d%u: releasing\n", d->domid);
+            d->clamped = false;
+            d->quiet = 0;
+        }
+    }
+}
+
+/* Give all domains the whole cache back, and stop monitoring. */
+static void restore(void)
+{
+    unsigned int i, j;
+
+    for ( j = 0; j < nr_doms; j++ )
+    {
+        struct dom *d = &doms[j];
+
+        for ( i = 0; i < nr_sockets; i++ )
+            if ( sockets[i].cat && d->s[i].cbm )
+                set_cbm(d, i, ways_mask(0, sockets[i].cbm_len));
+
+        if ( d->attached )
+            xc_psr_cmt_detach(xch, d->domid);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    struct sigaction sa = { .sa_handler = handle_signal };
+    uint32_t event_mask;
+    int opt;
+
+    while ( (opt = getopt(argc, argv, "s:b:p:c:i:nv")) != -1 )
+    {
+        switch ( opt )
+        {
+        case 's':
+            if ( parse_slo(optarg) )
+            {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'b':
+            bw_limit = strtoul(optarg, NULL, 0);
+            break;
+        case 'p':
+            occ_pct = strtoul(optarg, NULL, 0);
+            break;
+        case 'c':
+            clamp_ways = strtoul(optarg, NULL, 0);
+            break;
+        case 'i':
+            interval = strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            dry_run = true;
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if ( optind < argc || !interval || !clamp_ways )
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    xch = xc_interface_open(0, 0, 0);
+    if ( !xch )
+    {
+        fprintf(stderr, "Error opening xc interface: %d (%s)\n",
+                errno, strerror(errno));
+        return 1;
+    }
+
+    if ( !xc_psr_cmt_enabled(xch) ||
+         xc_psr_cmt_get_l3_upscaling_factor(xch, &upscaling_factor) )
+    {
+        fprintf(stderr, "Cache monitoring not available, Xen needs "
+                "\"psr=cmt,cat\"\n");
+        return 1;
+    }
+    have_mbm = !xc_psr_cmt_get_l3_event_mask(xch, &event_mask) &&
+               (event_mask & (1u << XC_PSR_CMT_TOTAL_MEM_COUNT));
+    if ( bw_limit && !have_mbm )
+        fprintf(stderr, "No memory bandwidth monitoring, ignoring -b\n");
+
+    if ( init_sockets() )
+    {
+        fprintf(stderr, "Error getting socket information: %d (%s)\n",
+                errno, strerror(errno));
+        return 1;
+    }
+
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    while ( !stop )
+    {
+        unsigned int j;
+
+        if ( update_doms() )
+        {
+            fprintf(stderr, "Error getting domain list: %d (%s)\n",
+                    errno, strerror(errno));
+            break;
+        }
+
+        for ( j = 0; j < nr_doms; j++ )
+            sample(&doms[j], interval);
+        adjust();
+
+        fflush(stdout);
+        sleep(interval);
+    }
+
+    restore();
+    xc_interface_close(xch);
+
+    return 0;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,220 @@
+/*
+ * xenhypstat.c
+ *
+ * Show which hypercalls, made by which domains, Xen spends its time in,
+ * from the statistics Xen collects when booted with "hypercall_stats".
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <xenctrl.h>
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof(*(a)))
+
+#define X(name) [__HYPERVISOR_##name] = #name
+static const char *const hypercall_name_table[64] =
+{
+    X(set_trap_table),
+    X(mmu_update),
+    X(set_gdt),
+    X(stack_switch),
+    X(set_callbacks),
+    X(fpu_taskswitch),
+    X(sched_op_compat),
+    X(platform_op),
+    X(set_debugreg),
+    X(get_debugreg),
+    X(update_descriptor),
+    X(memory_op),
+    X(multicall),
+    X(update_va_mapping),
+    X(set_timer_op),
+    X(event_channel_op_compat),
+    X(xen_version),
+    X(console_io),
+    X(physdev_op_compat),
+    X(grant_table_op),
+    X(vm_assist),
+    X(update_va_mapping_otherdomain),
+    X(iret),
+    X(vcpu_op),
+    X(set_segment_base),
+    X(mmuext_op),
+    X(xsm_op),
+    X(nmi_op),
+    X(sched_op),
+    X(callback_op),
+    X(xenoprof_op),
+    X(event_channel_op),
+    X(physdev_op),
+    X(hvm_op),
+    X(sysctl),
+    X(domctl),
+    X(kexec_op),
+    X(tmem_op),
+    X(xc_reserved_op),
+    X(xenpmu_op),
+    X(arch_0),
+    X(arch_1),
+    X(arch_2),
+    X(arch_3),
+    X(arch_4),
+    X(arch_5),
+    X(arch_6),
+    X(arch_7),
+};
+#undef X
+
+/* Upper bounds of the histogram buckets, in microseconds. */
+static const char *const bucket_name[XEN_SYSCTL_HCALL_STATS_BUCKETS] =
+{
+    "<1", "<2", "<4", "<8", "<16", "<32", "<64", "<128", "<256", "<512",
+    "<1024", ">=1024",
+};
+
+static void usage(const char *prog)
+{
+    printf("%s: [-r] [-d domid] [-n count] [-H]\n", prog);
+    printf("no args: show the 20 hypercalls Xen spent most time in\n");
+    printf("    -r        : reset the statistics\n");
+    printf("    -d domid  : only show the hypercalls of this domain\n");
+    printf("    -n count  : number of entries to show (0 for all)\n");
+    printf("    -H        : also show the run time histograms (us)\n");
+}
+
+static int cmp_total(const void *a, const void *b)
+{
+    const xc_hypercall_stats_entry_t *x = a, *y = b;
+
+    return x->total_ns < y->total_ns ? 1 : x->total_ns > y->total_ns ? -1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+    xc_interface *xch;
+    xc_hypercall_stats_entry_t *entries = NULL;
+    unsigned int i, j, nr = 0, shown = 0, count = 20;
+    bool reset = false, histo = false;
+    long domid = -1;
+    uint64_t dropped;
+    int opt;
+
+    while ( (opt = getopt(argc, argv, "rd:n:H")) != -1 )
+    {
+        switch ( opt )
+        {
+        case 'r':
+            reset = true;
+            break;
+        case 'd':
+            domid = strtol(optarg, NULL, 0);
+            break;
+        case 'n':
+            count = strtoul(optarg, NULL, 0);
+            break;
+        case 'H':
+            histo = true;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if ( optind < argc )
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    xch = xc_interface_open(0, 0, 0);
+    if ( !xch )
+    {
+        fprintf(stderr, "Error opening xc interface: %d (%s)\n",
+                errno, strerror(errno));
+        return 1;
+    }
+
+    if ( reset )
+    {
+        if ( xc_hypercall_stats_reset(xch) )
+        {
+            fprintf(stderr, "Error resetting hypercall statistics: %d (%s)\n",
+                    errno, strerror(errno));
+            return 1;
+        }
+        return 0;
+    }
+
+    /* Entries may get added between the two calls, so allow for some. */
+    if ( xc_hypercall_stats(xch, NULL, &nr, NULL) == 0 )
+    {
+        nr += 64;
+        entries = calloc(nr, sizeof(*entries));
+    }
+    if ( !entries || xc_hypercall_stats(xch, entries, &nr, &dropped) )
+    {
+        fprintf(stderr, "Error getting hypercall statistics: %d (%s)%s\n",
+                errno, strerror(errno), errno == EOPNOTSUPP ?
+                ", Xen not booted with \"hypercall_stats\"" : "");
+        return 1;
+    }
+
+    qsort(entries, nr, sizeof(*entries), cmp_total);
+
+    printf("%5s %-24s %6s %12s %10s %10s %10s %10s\n", "Dom", "Hypercall",
+           "Subop", "Calls", "Cont", "Total ms", "Avg us", "Max us");
+
+    for ( i = 0; i < nr && (!count || shown < count); i++ )
+    {
+        const xc_hypercall_stats_entry_t *e = &entries[i];
+        const char *name = e->op < ARRAY_SIZE(hypercall_name_table) ?
+                           hypercall_name_table[e->op] : NULL;
+
+        if ( domid >= 0 && e->domid != domid )
+            continue;
+        shown++;
+
+        if ( name )
+            printf("%5u %-24s", e->domid, name);
+        else
+            printf("%5u [%-22u]", e->domid, e->op);
+        printf(" %6u %12"PRIu64" %10"PRIu64" %10.3f %10.3f %10.3f\n",
+               e->subop, e->calls, e->continuations, e->total_ns / 1e6,
+               e->calls ? e->total_ns / 1e3 / e->calls : 0.0,
+               e->max_ns / 1e3);
+
+        if ( histo )
+        {
+            for ( j = 0; j < XEN_SYSCTL_HCALL_STATS_BUCKETS; j++ )
+                if ( e->histo[j] )
+                    printf("%*s%-7s %u\n", 30, "", bucket_name[j],
+                           e->histo[j]);
+        }
+    }
+
+    if ( dropped )
+        printf("%"PRIu64" calls not accounted for, tables full\n", dropped);
+
+    free(entries);
+    xc_interface_close(xch);
+
+    return 0;
+}
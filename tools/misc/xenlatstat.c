@@ -0,0 +1,356 @@
+/*
+ * xenlatstat.c
+ *
+ * Show the per-domain VM exit, runqueue wait and wakeup-to-run latencies
+ * Xen aggregates when booted with "latency_stats", either once or, top
+ * style, for each interval.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <xenctrl.h>
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof(*(a)))
+
+static const char *const kind_name[] =
+{
+    [XEN_SYSCTL_LATENCY_STATS_exit] = "exit",
+    [XEN_SYSCTL_LATENCY_STATS_runq] = "runq",
+    [XEN_SYSCTL_LATENCY_STATS_wake] = "wake",
+};
+
+/* VMX basic exit reasons. */
+static const char *const exit_name[] =
+{
+    [0]  = "EXCEPTION_NMI",
+    [1]  = "EXTERNAL_INTERRUPT",
+    [2]  = "TRIPLE_FAULT",
+    [3]  = "INIT",
+    [4]  = "SIPI",
+    [5]  = "IO_SMI",
+    [6]  = "OTHER_SMI",
+    [7]  = "PENDING_VIRT_INTR",
+    [8]  = "PENDING_VIRT_NMI",
+    [9]  = "TASK_SWITCH",
+    [10] = "CPUID",
+    [11] = "GETSEC",
+    [12] = "HLT",
+    [13] = "INVD",
+    [14] = "INVLPG",
+    [15] = "RDPMC",
+    [16] = "RDTSC",
+    [17] = "RSM",
+    [18] = "VMCALL",
+    [19] = "VMCLEAR",
+    [20] = "VMLAUNCH",
+    [21] = "VMPTRLD",
+    [22] = "VMPTRST",
+    [23] = "VMREAD",
+    [24] = "VMRESUME",
+    [25] = "VMWRITE",
+    [26] = "VMXOFF",
+    [27] = "VMXON",
+    [28] = "CR_ACCESS",
+    [29] = "DR_ACCESS",
+    [30] = "IO_INSTRUCTION",
+    [31] = "MSR_READ",
+    [32] = "MSR_WRITE",
+    [33] = "INVALID_GUEST_STATE",
+    [34] = "MSR_LOADING",
+    [36] = "MWAIT_INSTRUCTION",
+    [37] = "MONITOR_TRAP_FLAG",
+    [39] = "MONITOR_INSTRUCTION",
+    [40] = "PAUSE_INSTRUCTION",
+    [41] = "MCE_DURING_VMENTRY",
+    [43] = "TPR_BELOW_THRESHOLD",
+    [44] = "APIC_ACCESS",
+    [45] = "EOI_INDUCED",
+    [46] = "ACCESS_GDTR_OR_IDTR",
+    [47] = "ACCESS_LDTR_OR_TR",
+    [48] = "EPT_VIOLATION",
+    [49] = "EPT_MISCONFIG",
+    [50] = "INVEPT",
+    [51] = "RDTSCP",
+    [52] = "PREEMPTION_TIMER",
+    [53] = "INVVPID",
+    [54] = "WBINVD",
+    [55] = "XSETBV",
+    [56] = "APIC_WRITE",
+    [58] = "INVPCID",
+    [59] = "VMFUNC",
+    [62] = "PML_FULL",
+    [63] = "XSAVES",
+    [64] = "XRSTORS",
+};
+
+/* Upper bounds of the histogram buckets, in microseconds. */
+static const char *const bucket_name[XEN_SYSCTL_LATENCY_STATS_BUCKETS] =
+{
+    "<1", "<2", "<4", "<8", "<16", "<32", "<64", "<128", "<256", "<512",
+    "<1024", ">=1024",
+};
+
+static void usage(const char *prog)
+{
+    printf("%s: [-r] [-d domid] [-k kind] [-n count] [-H] [-i secs]\n", prog);
+    printf("no args: show the 20 entries with the most total latency\n");
+    printf("    -r        : reset the statistics\n");
+    printf("    -d domid  : only show the entries of this domain\n");
+    printf("    -k kind   : only show exit, runq or wake latencies\n");
+    printf("    -n count  : number of entries to show (0 for all)\n");
+    printf("    -H        : also show the latency histograms (us)\n");
+    printf("    -i secs   : refresh every secs, showing that interval only\n");
+}
+
+static int cmp_key(const void *a, const void *b)
+{
+    const xc_latency_stats_entry_t *x = a, *y = b;
+
+    if ( x->domid != y->domid )
+        return x->domid < y->domid ? -1 : 1;
+    if ( x->kind != y->kind )
+        return x->kind < y->kind ? -1 : 1;
+    return x->reason < y->reason ? -1 : x->reason > y->reason;
+}
+
+static int cmp_total(const void *a, const void *b)
+{
+    const xc_latency_stats_entry_t *x = a, *y = b;
+
+    return x->total_ns < y->total_ns ? 1 : x->total_ns > y->total_ns ? -1 : 0;
+}
+
+static xc_latency_stats_entry_t *get_stats(xc_interface *xch,
+                                           unsigned int *nr,
+                                           uint64_t *dropped)
+{
+    xc_latency_stats_entry_t *entries = NULL;
+
+    /* Entries may get added between the two calls, so allow for some. */
+    *nr = 0;
+    if ( xc_latency_stats(xch, NULL, nr, NULL) == 0 )
+    {
+        *nr += 64;
+        entries = calloc(*nr, sizeof(*entries));
+    }
+    if ( !entries || xc_latency_stats(xch, entries, nr, dropped) )
+    {
+        fprintf(stderr, "Error getting latency statistics: %d (%s)%s\n",
+                errno, strerror(errno), errno == EOPNOTSUPP ?
+                ", Xen not booted with \"latency_stats\"" : "");
+        free(entries);
+        return NULL;
+    }
+
+    return entries;
+}
+
+/* Turn @cur into the difference to @prev; both are sorted by key. */
+static void subtract(xc_latency_stats_entry_t *cur, unsigned int nr,
+                     const xc_latency_stats_entry_t *prev,
+                     unsigned int nr_prev)
+{
+    unsigned int i, j;
+
+    for ( i = 0; i < nr; i++ )
+    {
+        const xc_latency_stats_entry_t *p =
+            bsearch(&cur[i], prev, nr_prev, sizeof(*prev), cmp_key);
+
+        /* A reset since, or a counter wrapping, leaves it as it is. */
+        if ( !p || p->events > cur[i].events )
+            continue;
+
+        cur[i].events -= p->events;
+        cur[i].timed -= p->timed;
+        cur[i].total_ns -= p->total_ns;
+        for ( j = 0; j < XEN_SYSCTL_LATENCY_STATS_BUCKETS; j++ )
+            cur[i].histo[j] -= p->histo[j];
+    }
+}
+
+static void show(const xc_latency_stats_entry_t *entries, unsigned int nr,
+                 long domid, int kind, unsigned int count, bool histo)
+{
+    unsigned int i, j, shown = 0;
+
+    printf("%5s %-4s %-24s %12s %12s %10s %10s %10s\n", "Dom", "Kind",
+           "Reason", "Events", "Timed", "Total ms", "Avg us", "Max us");
+
+    for ( i = 0; i < nr && (!count || shown < count); i++ )
+    {
+        const xc_latency_stats_entry_t *e = &entries[i];
+        const char *name = NULL;
+
+        if ( (domid >= 0 && e->domid != domid) ||
+             (kind >= 0 && e->kind != kind) || !e->events )
+            continue;
+        shown++;
+
+        printf("%5u %-4s", e->domid, e->kind < ARRAY_SIZE(kind_name) ?
+               kind_name[e->kind] : "?");
+        if ( e->kind == XEN_SYSCTL_LATENCY_STATS_exit )
+        {
+            if ( e->reason < ARRAY_SIZE(exit_name) )
+                name = exit_name[e->reason];
+            if ( name )
+                printf(" %-24s", name);
+            else
+                printf(" [%-22u]", e->reason);
+        }
+        else
+            printf(" %-24s", "-");
+        printf(" %12"PRIu64" %12"PRIu64" %10.3f %10.3f %10.3f\n",
+               e->events, e->timed, e->total_ns / 1e6,
+               e->timed ? e->total_ns / 1e3 / e->timed : 0.0,
+               e->max_ns / 1e3);
+
+        if ( histo )
+        {
+            for ( j = 0; j < XEN_SYSCTL_LATENCY_STATS_BUCKETS; j++ )
+                if ( e->histo[j] )
+                    printf("%*s%-7s %u\n", 36, "", bucket_name[j],
+                           e->histo[j]);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    xc_interface *xch;
+    xc_latency_stats_entry_t *entries, *prev = NULL;
+    unsigned int i, nr, nr_prev = 0, count = 20, interval = 0;
+    bool reset = false, histo = false;
+    long domid = -1;
+    int opt, kind = -1;
+    uint64_t dropped;
+
+    while ( (opt = getopt(argc, argv, "rd:k:n:Hi:")) != -1 )
+    {
+        switch ( opt )
+        {
+        case 'r':
+            reset = true;
+            break;
+        case 'd':
+            domid = strtol(optarg, NULL, 0);
+            break;
+        case 'k':
+            for ( i = 0; i < ARRAY_SIZE(kind_name); i++ )
+                if ( !strcmp(optarg, kind_name[i]) )
+                    kind = i;
+            if ( kind < 0 )
+            {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'n':
+            count = strtoul(optarg, NULL, 0);
+            break;
+        case 'H':
+            histo = true;
+            break;
+        case 'i':
+            interval = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if ( optind < argc )
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    xch = xc_interface_open(0, 0, 0);
+    if ( !xch )
+    {
+        fprintf(stderr, "Error opening xc interface: %d (%s)\n",
+                errno, strerror(errno));
+        return 1;
+    }
+
+    if ( reset )
+    {
+        if ( xc_latency_stats_reset(xch) )
+        {
+            fprintf(stderr, "Error resetting latency statistics: %d (%s)\n",
+                    errno, strerror(errno));
+            return 1;
+        }
+        return 0;
+    }
+
+    for ( ; ; )
+    {
+        entries = get_stats(xch, &nr, &dropped);
+        if ( !entries )
+            return 1;
+
+        if ( interval )
+        {
+            xc_latency_stats_entry_t *copy = malloc(nr * sizeof(*entries));
+
+            if ( !copy )
+            {
+                fprintf(stderr, "Out of memory\n");
+                return 1;
+            }
+            /* Clear the screen and home the cursor, like top. */
+            printf("\033[H\033[2J");
+            if ( prev )
+                printf("Latencies over the last %us (max since reset)\n\n",
+                       interval);
+            else
+                printf("Latencies since reset\n\n");
+
+            qsort(entries, nr, sizeof(*entries), cmp_key);
+            memcpy(copy, entries, nr * sizeof(*entries));
+            if ( prev )
+                subtract(entries, nr, prev, nr_prev);
+            free(prev);
+            prev = copy;
+            nr_prev = nr;
+        }
+
+        qsort(entries, nr, sizeof(*entries), cmp_total);
+        show(entries, nr, domid, kind, count, histo);
+
+        if ( dropped )
+            printf("%"PRIu64" events not accounted for, tables full\n",
+                   dropped);
+
+        free(entries);
+
+        if ( !interval )
+            break;
+        fflush(stdout);
+        sleep(interval);
+    }
+
+    xc_interface_close(xch);
+
+    return 0;
+}
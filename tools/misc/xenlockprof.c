@@ -18,6 +18,78 @@
 #include <string.h>
 #include <inttypes.h>
 
+static int sample_cmp(const void *a, const void *b)
+{
+    const xc_lock_sample_entry_t *x = a, *y = b;
+
+    return x->wait_ns < y->wait_ns ? 1 : x->wait_ns > y->wait_ns ? -1 : 0;
+}
+
+static void sample_histo(const char *what, const uint32_t *histo)
+{
+    unsigned int i;
+
+    printf("    %s:", what);
+    for ( i = 0; i < XEN_SYSCTL_LOCK_SAMPLE_BUCKETS; i++ )
+        printf(" %7"PRIu32, histo[i]);
+    printf("\n");
+}
+
+/* Print the sampled lock statistics, most waited for call sites first. */
+static int sample_print(xc_interface *xc_handle)
+{
+    xc_lock_sample_entry_t *e = NULL;
+    unsigned int i, n = 0, nr, rate;
+    uint64_t dropped;
+
+    for ( ; ; )
+    {
+        nr = n;
+        if ( xc_lock_sample(xc_handle, e, &nr, &dropped, &rate) != 0 )
+        {
+            fprintf(stderr, "Error getting lock samples: %d (%s)\n",
+                    errno, strerror(errno));
+            free(e);
+            return 1;
+        }
+        if ( nr <= n )
+            break;
+        n = nr + 32;
+        free(e);
+        e = malloc(n * sizeof(*e));
+        if ( e == NULL )
+        {
+            fprintf(stderr, "Could not allocate buffers: %d (%s)\n",
+                    errno, strerror(errno));
+            return 1;
+        }
+    }
+
+    qsort(e, nr, sizeof(*e), sample_cmp);
+
+    printf("sampling 1 in %u acquisitions, %"PRIu64" samples dropped\n",
+           rate, dropped);
+    printf("histogram buckets: < 128ns, then doubling up to 128us, "
+           "256us+\n\n");
+    for ( i = 0; i < nr; i++ )
+    {
+        printf("%-40s lock %#"PRIx64": %"PRIu64" samples, "
+               "%"PRIu64" contended\n",
+               e[i].name[0] ? e[i].name : "?", e[i].lock, e[i].samples,
+               e[i].contended);
+        printf("    wait: avg %"PRIu64"ns max %"PRIu64"ns, "
+               "hold: avg %"PRIu64"ns max %"PRIu64"ns\n",
+               e[i].wait_ns / e[i].samples, e[i].wait_max_ns,
+               e[i].hold_ns / e[i].samples, e[i].hold_max_ns);
+        sample_histo("wait", e[i].wait_histo);
+        sample_histo("hold", e[i].hold_histo);
+    }
+
+    free(e);
+
+    return 0;
+}
+
 int main(int argc, char *argv[])
 {
     xc_interface      *xc_handle;
@@ -25,13 +97,25 @@ int main(int argc, char *argv[])
     uint64_t           time;
     double             l, b, sl, sb;
     char               name[100];
+    char              *end;
+    unsigned long      rate = 0;
     DECLARE_HYPERCALL_BUFFER(xc_lockprof_data_t, data);
 
-    if ( (argc > 2) || ((argc == 2) && (strcmp(argv[1], "-r") != 0)) )
+    if ( argc == 3 && strcmp(argv[1], "-S") == 0 )
+        rate = strtoul(argv[2], &end, 0);
+    if ( (argc > 3) ||
+         ((argc == 3) && (strcmp(argv[1], "-S") != 0 || *end != '\0' ||
+                          rate > UINT32_MAX)) ||
+         ((argc == 2) && (strcmp(argv[1], "-r") != 0) &&
+          (strcmp(argv[1], "-s") != 0) && (strcmp(argv[1], "-R") != 0)) )
     {
-        printf("%s: [-r]\n", argv[0]);
+        printf("%s: [-r | -s | -R | -S <rate>]\n", argv[0]);
         printf("no args: print lock profile data\n");
         printf("    -r : reset profile data\n");
+        printf("    -s : print sampled lock statistics\n");
+        printf("    -R : reset sampled lock statistics\n");
+        printf("    -S <rate> : sample 1 in <rate> lock acquisitions, "
+               "0 to stop\n");
         return 1;
     }
 
@@ -42,6 +126,31 @@ int main(int argc, char *argv[])
         return 1;
     }
 
+    if ( argc == 3 )
+    {
+        if ( xc_lock_sample_set_rate(xc_handle, rate) != 0 )
+        {
+            fprintf(stderr, "Error setting sampling rate: %d (%s)\n",
+                    errno, strerror(errno));
+            return 1;
+        }
+        return 0;
+    }
+
+    if ( argc > 1 && strcmp(argv[1], "-s") == 0 )
+        return sample_print(xc_handle);
+
+    if ( argc > 1 && strcmp(argv[1], "-R") == 0 )
+    {
+        if ( xc_lock_sample_reset(xc_handle) != 0 )
+        {
+            fprintf(stderr, "Error reseting lock samples: %d (%s)\n",
+                    errno, strerror(errno));
+            return 1;
+        }
+        return 0;
+    }
+
     if ( argc > 1 )
     {
         if ( xc_lockprof_reset(xc_handle) != 0 )
@@ -68,6 +68,127 @@ const char *hypercall_name_table[64] =
 };
 #undef X
 
+/* Must match PERFC_TIME_HISTO_BUCKETS in xen/include/xen/perfc_defn.h. */
+#define TIME_HISTO_BUCKETS 12
+
+static const char *const softirq_name_table[] =
+{
+    "timer", "schedule", "tlbflush", "rcu", "tasklet",
+};
+
+static const char *const tasklet_name_table[] =
+{
+    "vcpu context", "softirq context",
+};
+
+/* Print one row per instance of a run time histogram. */
+static void print_time_histo(const xc_perfc_val_t *val, unsigned int nr_vals,
+                             const char *const *names, unsigned int nr_names)
+{
+    unsigned int i, j;
+    char name[36];
+
+    printf("\n%-35s %10s", "", "<1us");
+    for ( j = 1; j < TIME_HISTO_BUCKETS - 1; j++ )
+    {
+        snprintf(name, sizeof(name), "<%uus", 1u << j);
+        printf(" %10s", name);
+    }
+    printf(" %10s\n", ">=1ms");
+
+    for ( i = 0; i < nr_vals / TIME_HISTO_BUCKETS; i++ )
+    {
+        const xc_perfc_val_t *row = val + i * TIME_HISTO_BUCKETS;
+
+        for ( j = 0; j < TIME_HISTO_BUCKETS && !row[j]; j++ )
+            ;
+        if ( j == TIME_HISTO_BUCKETS )
+            continue;
+
+        if ( i < nr_names )
+            snprintf(name, sizeof(name), "%s", names[i]);
+        else
+            snprintf(name, sizeof(name), "[%u]", i);
+        printf("%-35s", name);
+        for ( j = 0; j < TIME_HISTO_BUCKETS; j++ )
+            printf(" %10u", (unsigned int)row[j]);
+        printf("\n");
+    }
+}
+
+/* Print the top domains for each of the domain-scoped counters. */
+static int print_dom_counters(xc_interface *xc_handle, unsigned int top)
+{
+    DECLARE_HYPERCALL_BUFFER(xc_perfc_desc_t, pcd);
+    DECLARE_HYPERCALL_BUFFER(xc_perfc_val_t, pcv);
+    int num_desc, num_val = 0, i, rc = 1;
+    unsigned int j, k, row, nr_doms;
+    unsigned char *shown = NULL;
+
+    if ( xc_perfc_query_dom(xc_handle, HYPERCALL_BUFFER(pcd),
+                            HYPERCALL_BUFFER(pcv), &num_desc, &num_val) != 0 )
+    {
+        fprintf(stderr, "Error getting number of domain counters: %d (%s)\n",
+                errno, strerror(errno));
+        return 1;
+    }
+
+    /* Leave room for a few domains created meanwhile. */
+    row = num_desc + 1;
+    num_val += 8 * row;
+
+    pcd = xc_hypercall_buffer_alloc(xc_handle, pcd, sizeof(*pcd) * num_desc);
+    pcv = xc_hypercall_buffer_alloc(xc_handle, pcv, sizeof(*pcv) * num_val);
+    shown = malloc(num_val / row);
+
+    if ( pcd == NULL || pcv == NULL || shown == NULL )
+    {
+        fprintf(stderr, "Could not allocate buffers: %d (%s)\n",
+                errno, strerror(errno));
+        goto out;
+    }
+
+    if ( xc_perfc_query_dom(xc_handle, HYPERCALL_BUFFER(pcd),
+                            HYPERCALL_BUFFER(pcv), &num_desc, &num_val) != 0 )
+    {
+        fprintf(stderr, "Error getting domain counters: %d (%s)\n",
+                errno, strerror(errno));
+        goto out;
+    }
+    nr_doms = num_val / row;
+
+    for ( i = 0; i < num_desc; i++ )
+    {
+        printf("%-35s\n", pcd[i].name);
+
+        memset(shown, 0, nr_doms);
+        for ( k = 0; k < top && k < nr_doms; k++ )
+        {
+            unsigned int best = nr_doms;
+
+            for ( j = 0; j < nr_doms; j++ )
+                if ( !shown[j] && pcv[j * row + i + 1] &&
+                     (best == nr_doms ||
+                      pcv[j * row + i + 1] > pcv[best * row + i + 1]) )
+                    best = j;
+            if ( best == nr_doms )
+                break;
+
+            shown[best] = 1;
+            printf("    d%-30u %12u\n", (unsigned int)pcv[best * row],
+                   (unsigned int)pcv[best * row + i + 1]);
+        }
+    }
+
+    rc = 0;
+
+ out:
+    free(shown);
+    xc_hypercall_buffer_free(xc_handle, pcd);
+    xc_hypercall_buffer_free(xc_handle, pcv);
+    return rc;
+}
+
 int main(int argc, char *argv[])
 {
     int              i, j;
@@ -76,7 +197,7 @@ int main(int argc, char *argv[])
     DECLARE_HYPERCALL_BUFFER(xc_perfc_val_t, pcv);
     xc_perfc_val_t  *val;
     int num_desc, num_val;
-    unsigned int    sum, reset = 0, full = 0, pretty = 0;
+    unsigned int    sum, reset = 0, full = 0, pretty = 0, top = 0;
     char hypercall_name[36];
 
     if ( argc > 1 )
@@ -96,6 +217,11 @@ int main(int argc, char *argv[])
             case 'r':
                 reset = 1;
                 break;
+            case 'd':
+                top = (argc > 2) ? strtoul(argv[2], NULL, 0) : 5;
+                if ( top == 0 )
+                    goto error;
+                break;
             default:
                 goto error;
             }
@@ -107,6 +233,7 @@ int main(int argc, char *argv[])
             printf("no args: print digested counters\n");
             printf("    -f : print full arrays/histograms\n");
             printf("    -p : print full arrays/histograms in pretty format\n");
+            printf("    -d [N] : print top N (5) domains per domain counter\n");
             printf("    -r : reset counters\n");
             return 0;
         }
@@ -131,6 +258,9 @@ int main(int argc, char *argv[])
         return 0;
     }
 
+    if ( top )
+        return print_dom_counters(xc_handle, top);
+
     if ( xc_perfc_query_number(xc_handle, &num_desc, &num_val) != 0 )
     {
         fprintf(stderr, "Error getting number of perf counters: %d (%s)\n",
@@ -184,6 +314,16 @@ int main(int argc, char *argv[])
                     printf("%12u\n", (unsigned int)val[j]);
                 }
             }
+            else if ( pretty &&
+                      (strcmp(pcd[i].name, "softirq run times") == 0) )
+                print_time_histo(val, pcd[i].nr_vals, softirq_name_table,
+                                 sizeof(softirq_name_table) /
+                                 sizeof(*softirq_name_table));
+            else if ( pretty &&
+                      (strcmp(pcd[i].name, "tasklet run times") == 0) )
+                print_time_histo(val, pcd[i].nr_vals, tasklet_name_table,
+                                 sizeof(tasklet_name_table) /
+                                 sizeof(*tasklet_name_table));
             else
             {
                 for ( j = 0; j < pcd[i].nr_vals; j++ )
@@ -65,6 +65,8 @@ void show_help(void)
             " set-vcpu-migration-delay      <num> set scheduler vcpu migration delay in us\n"
             " get-vcpu-migration-delay            get scheduler vcpu migration delay\n"
             " set-max-cstate        <num>         set the C-State limitation (<num> >= 0)\n"
+            " set-idle-latency <domid> <us>       limit the C-State exit latency to <us> after\n"
+            "                                     running domain <domid> (0 for no limit)\n"
             " start [seconds]                     start collect Cx/Px statistics,\n"
             "                                     output after CTRL-C or SIGINT or several seconds.\n"
             " enable-turbo-mode     [cpuid]       enable Turbo Mode for processors that support it.\n"
@@ -132,6 +134,11 @@ static void print_cxstat(int cpuid, struct xc_cx_stat *cxstat)
         if ( cxstat->cc[i] )
            printf("cc%d                  : [%20"PRIu64" ms]\n", i + 1,
                   cxstat->cc[i] / 1000000UL);
+    printf("predicted residency  : [%20"PRIu64" ms]\n",
+           cxstat->predicted_us / 1000UL);
+    printf("measured residency   : [%20"PRIu64" ms]\n",
+           cxstat->measured_us / 1000UL);
+    printf("early wakeups        : [%20"PRIu64"]\n", cxstat->early);
     printf("\n");
 }
 
@@ -1117,6 +1124,25 @@ void set_max_cstate_func(int argc, char *argv[])
                 value, errno, strerror(errno));
 }
 
+void set_idle_latency_func(int argc, char *argv[])
+{
+    int domid, value;
+
+    if ( argc != 2 || sscanf(argv[0], "%d", &domid) != 1 || domid < 0 ||
+         sscanf(argv[1], "%d", &value) != 1 || value < 0 )
+    {
+        fprintf(stderr, "Missing or invalid argument(s)\n");
+        exit(EINVAL);
+    }
+
+    if ( !xc_domain_set_idle_latency(xc_handle, domid, value) )
+        printf("set idle latency of domain %d to %dus succeeded\n",
+               domid, value);
+    else
+        fprintf(stderr, "set idle latency of domain %d failed (%d - %s)\n",
+                domid, errno, strerror(errno));
+}
+
 void enable_turbo_mode(int argc, char *argv[])
 {
     int cpuid = -1;
@@ -1184,6 +1210,7 @@ struct {
     { "get-vcpu-migration-delay", get_vcpu_migration_delay_func},
     { "set-vcpu-migration-delay", set_vcpu_migration_delay_func},
     { "set-max-cstate", set_max_cstate_func},
+    { "set-idle-latency", set_idle_latency_func},
     { "enable-turbo-mode", enable_turbo_mode },
     { "disable-turbo-mode", disable_turbo_mode },
 };
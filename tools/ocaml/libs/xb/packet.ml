@@ -39,6 +39,28 @@ let to_string pkt =
 let unpack pkt =
 	pkt.tid, pkt.rid, pkt.ty, pkt.data
 
+(* Split the payload of a BATCH request into its sub-requests, each of
+   which is a header followed by its data. *)
+let unpack_batch data =
+	let hsize = Partial.header_size () in
+	let len = String.length data in
+	let rec split off acc =
+		if off = len then
+			List.rev acc
+		else begin
+			if len - off < hsize then
+				raise (DataError "truncated batch header");
+			let tid, rid, ty, dlen =
+				Partial.header_of_string_internal (String.sub data off hsize) in
+			let off = off + hsize in
+			if dlen > len - off then
+				raise (DataError "truncated batch data");
+			let pkt = create tid rid (Op.of_cval ty) (String.sub data off dlen) in
+			split (off + dlen) (pkt :: acc)
+		end
+		in
+	split 0 []
+
 let get_tid pkt = pkt.tid
 let get_ty pkt = pkt.ty
 let get_data pkt =
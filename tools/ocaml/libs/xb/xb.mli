@@ -23,6 +23,8 @@ module Op :
       | Resume
       | Set_target
       | Reset_watches
+      | Directory_part
+      | Batch
       | Invalid
     val operation_c_mapping : operation array
     val size : int
@@ -48,6 +50,7 @@ module Packet :
     val of_partialpkt : Partial.pkt -> t
     val to_string : t -> string
     val unpack : t -> int * int * Op.operation * string
+    val unpack_batch : string -> t list
     val get_tid : t -> int
     val get_ty : t -> Op.operation
     val get_data : t -> string
@@ -222,6 +222,7 @@ let string_of_access_type = function
 	| Xenbus.Xb.Op.Debug             -> "debug    "
 
 	| Xenbus.Xb.Op.Directory         -> "directory"
+	| Xenbus.Xb.Op.Directory_part    -> "dir part "
 	| Xenbus.Xb.Op.Read              -> "read     "
 	| Xenbus.Xb.Op.Getperms          -> "getperms "
 
@@ -242,6 +243,7 @@ let string_of_access_type = function
 	| Xenbus.Xb.Op.Rm                -> "rm       "
 	| Xenbus.Xb.Op.Setperms          -> "setperms "
 	| Xenbus.Xb.Op.Reset_watches     -> "reset watches"
+	| Xenbus.Xb.Op.Batch             -> "batch    "
 	| Xenbus.Xb.Op.Set_target        -> "settarget"
 
 	| Xenbus.Xb.Op.Error             -> "error    "
@@ -163,6 +163,30 @@ let do_setperms con t domains cons data =
 		in
 	Transaction.setperms t (Connection.get_perm con) path perms
 
+(* Sub-requests are tried out on a copy of the store first so that either
+   all of them or none take effect. *)
+let do_batch con t domains cons data =
+	let ops =
+		try Xenbus.Xb.Packet.unpack_batch data
+		with Xenbus.Xb.Packet.DataError _ -> raise Invalid_Cmd_Args
+		in
+	let apply t op =
+		let _, _, ty, data = Xenbus.Xb.Packet.unpack op in
+		let fct =
+			match ty with
+			| Xenbus.Xb.Op.Write    -> do_write
+			| Xenbus.Xb.Op.Mkdir    -> do_mkdir
+			| Xenbus.Xb.Op.Rm       -> do_rm
+			| Xenbus.Xb.Op.Setperms -> do_setperms
+			| _                     -> raise Invalid_Cmd_Args
+			in
+		fct con t domains cons data
+		in
+	let trial_store = Store.copy (Transaction.get_store t) in
+	let trial_t = Transaction.make ~internal:true Transaction.none trial_store in
+	List.iter (apply trial_t) ops;
+	List.iter (apply t) ops
+
 let do_error con t domains cons data =
 	raise Define.Unknown_operation
 
@@ -203,7 +227,7 @@ let reply_ack fct con t doms cons data =
 	fct con t doms cons data;
 	Packet.Ack (fun () ->
 		if Transaction.get_id t = Transaction.none then
-			process_watch (Transaction.get_paths t) cons
+			process_watch (List.rev (Transaction.get_paths t)) cons
 	)
 
 let reply_data fct con t doms cons data =
@@ -243,6 +267,7 @@ let function_of_type_simple_op ty =
 	| Xenbus.Xb.Op.Mkdir             -> reply_ack do_mkdir
 	| Xenbus.Xb.Op.Rm                -> reply_ack do_rm
 	| Xenbus.Xb.Op.Setperms          -> reply_ack do_setperms
+	| Xenbus.Xb.Op.Batch             -> reply_ack do_batch
 	| _                              -> reply_ack do_error
 
 let input_handle_error ~cons ~doms ~fct ~con ~t ~req =
@@ -473,9 +498,11 @@ let retain_op_in_history ty =
 	| Xenbus.Xb.Op.Write
 	| Xenbus.Xb.Op.Mkdir
 	| Xenbus.Xb.Op.Rm
-	| Xenbus.Xb.Op.Setperms          -> true
+	| Xenbus.Xb.Op.Setperms
+	| Xenbus.Xb.Op.Batch             -> true
 	| Xenbus.Xb.Op.Debug
 	| Xenbus.Xb.Op.Directory
+	| Xenbus.Xb.Op.Directory_part
 	| Xenbus.Xb.Op.Read
 	| Xenbus.Xb.Op.Getperms
 	| Xenbus.Xb.Op.Watch
@@ -51,6 +51,12 @@ let process_connection_fds store cons domains rset wset =
 	process_fdset_with rset Process.do_input;
 	process_fdset_with wset Process.do_output
 
+(* Requests are processed one at a time from a single thread.  The OCaml
+   runtime lock would serialise worker threads anyway, and there is little
+   left to overlap: a transaction works on its own Store.copy (a persistent
+   snapshot, so O(1)) and a commit which does not conflict only replaces the
+   root.  Fairness between domains comes from the io credit below, which
+   bounds each domain to one request per loop iteration. *)
 let process_domains store cons domains =
 	let do_io_domain domain =
 		if Domain.is_bad_domain domain
@@ -52,6 +52,17 @@ typedef struct {
     xc_interface *xc_handle;
 } XcObject;
 
+/* Foreign guest memory, accessible through the buffer protocol. */
+typedef struct {
+    PyObject_HEAD;
+    void *addr;
+    size_t size;
+    int readonly;
+    int exports;
+} XcMapObject;
+
+static PyTypeObject PyXcMapType;
+
 
 static PyObject *dom_op(XcObject *self, PyObject *args,
                         int (*fn)(xc_interface *, uint32_t));
@@ -443,6 +454,329 @@ static PyObject *pyxc_vcpu_getinfo(XcObject *self,
     return info_dict;
 }
 
+/*
+ * The *_array variants of the queries return their records packed into a
+ * bytes object rather than as a list of dicts, which matters for large
+ * hosts.  The layout of a record is given by the struct module format in
+ * the matching *_FORMAT constant, which numpy understands too.
+ */
+struct pyxc_dominfo_rec {
+    uint32_t domid;
+    uint32_t ssidref;
+    uint32_t shutdown_reason;
+    uint32_t online_vcpus;
+    uint32_t max_vcpu_id;
+    uint32_t cpupool;
+    uint8_t hvm, dying, crashed, shutdown, paused, blocked, running, pad;
+    uint64_t mem_kb;
+    uint64_t maxmem_kb;
+    uint64_t cpu_time;
+    uint8_t handle[16];
+};
+#define DOMINFO_FORMAT "=6I7Bx3Q16s"
+
+struct pyxc_vcpuinfo_rec {
+    uint32_t vcpu;
+    uint32_t cpu;
+    uint8_t online, blocked, running, pad[5];
+    uint64_t cpu_time;
+};
+#define VCPUINFO_FORMAT "=II3B5xQ"
+
+static PyObject *pyxc_domain_getinfo_array(XcObject *self,
+                                           PyObject *args,
+                                           PyObject *kwds)
+{
+    PyObject *obj;
+    struct pyxc_dominfo_rec *rec;
+
+    uint32_t first_dom = 0;
+    int max_doms = 1024, nr_doms, i;
+    xc_dominfo_t *info;
+
+    static char *kwd_list[] = { "first_dom", "max_doms", NULL };
+
+    if ( !PyArg_ParseTupleAndKeywords(args, kwds, "|ii", kwd_list,
+                                      &first_dom, &max_doms) )
+        return NULL;
+
+    info = calloc(max_doms, sizeof(xc_dominfo_t));
+    if (info == NULL)
+        return PyErr_NoMemory();
+
+    nr_doms = xc_domain_getinfo(self->xc_handle, first_dom, max_doms, info);
+
+    if (nr_doms < 0)
+    {
+        free(info);
+        return pyxc_error_to_exception(self->xc_handle);
+    }
+
+    obj = PyBytes_FromStringAndSize(NULL, nr_doms * sizeof(*rec));
+    if ( obj == NULL )
+    {
+        free(info);
+        return NULL;
+    }
+
+    rec = (struct pyxc_dominfo_rec *)PyBytes_AS_STRING(obj);
+    memset(rec, 0, nr_doms * sizeof(*rec));
+    for ( i = 0; i < nr_doms; i++, rec++ )
+    {
+        rec->domid           = info[i].domid;
+        rec->ssidref         = info[i].ssidref;
+        rec->shutdown_reason = info[i].shutdown_reason;
+        rec->online_vcpus    = info[i].nr_online_vcpus;
+        rec->max_vcpu_id     = info[i].max_vcpu_id;
+        rec->cpupool         = info[i].cpupool;
+        rec->hvm             = info[i].hvm;
+        rec->dying           = info[i].dying;
+        rec->crashed         = info[i].crashed;
+        rec->shutdown        = info[i].shutdown;
+        rec->paused          = info[i].paused;
+        rec->blocked         = info[i].blocked;
+        rec->running         = info[i].running;
+        rec->mem_kb          = info[i].nr_pages * (XC_PAGE_SIZE / 1024);
+        rec->maxmem_kb       = info[i].max_memkb;
+        rec->cpu_time        = info[i].cpu_time;
+        memcpy(rec->handle, info[i].handle, sizeof(rec->handle));
+    }
+
+    free(info);
+
+    return obj;
+}
+
+static PyObject *pyxc_vcpu_getinfo_array(XcObject *self,
+                                         PyObject *args,
+                                         PyObject *kwds)
+{
+    PyObject *obj;
+    struct pyxc_vcpuinfo_rec *recs;
+
+    uint32_t dom, vcpu;
+    xc_dominfo_t dominfo;
+    xc_vcpuinfo_t info;
+    unsigned int nr = 0;
+
+    static char *kwd_list[] = { "domid", NULL };
+
+    if ( !PyArg_ParseTupleAndKeywords(args, kwds, "i", kwd_list, &dom) )
+        return NULL;
+
+    if ( xc_domain_getinfo(self->xc_handle, dom, 1, &dominfo) != 1 ||
+         dominfo.domid != dom )
+    {
+        errno = ESRCH;
+        return PyErr_SetFromErrno(xc_error_obj);
+    }
+
+    recs = calloc(dominfo.max_vcpu_id + 1, sizeof(*recs));
+    if ( recs == NULL )
+        return PyErr_NoMemory();
+
+    for ( vcpu = 0; vcpu <= dominfo.max_vcpu_id; vcpu++ )
+    {
+        if ( xc_vcpu_getinfo(self->xc_handle, dom, vcpu, &info) < 0 )
+        {
+            /* Not every vcpu id up to the maximum need be allocated. */
+            if ( errno == ESRCH )
+                continue;
+            free(recs);
+            return pyxc_error_to_exception(self->xc_handle);
+        }
+
+        recs[nr].vcpu     = vcpu;
+        recs[nr].cpu      = info.cpu;
+        recs[nr].online   = info.online;
+        recs[nr].blocked  = info.blocked;
+        recs[nr].running  = info.running;
+        recs[nr].cpu_time = info.cpu_time;
+        nr++;
+    }
+
+    obj = PyBytes_FromStringAndSize((char *)recs, nr * sizeof(*recs));
+    free(recs);
+
+    return obj;
+}
+
+/*
+ * Turn a sequence of ints, or a buffer of native 64-bit integers such as
+ * an array('Q'), into an array of pfns to be freed by the caller.
+ */
+static xen_pfn_t *pyxc_pfn_array(PyObject *obj, Py_ssize_t *nr)
+{
+    xen_pfn_t *arr;
+    Py_ssize_t i, n;
+
+    if ( PyObject_CheckBuffer(obj) )
+    {
+        Py_buffer view;
+        const char *p;
+        uint64_t pfn;
+
+        if ( PyObject_GetBuffer(obj, &view, PyBUF_SIMPLE) )
+            return NULL;
+
+        if ( view.len % sizeof(uint64_t) )
+        {
+            PyBuffer_Release(&view);
+            PyErr_SetString(PyExc_ValueError,
+                            "pfn buffer size is not a multiple of 8");
+            return NULL;
+        }
+
+        n = view.len / sizeof(uint64_t);
+        arr = malloc((n ?: 1) * sizeof(*arr));
+        if ( arr == NULL )
+        {
+            PyBuffer_Release(&view);
+            PyErr_NoMemory();
+            return NULL;
+        }
+
+        for ( i = 0, p = view.buf; i < n; i++, p += sizeof(pfn) )
+        {
+            memcpy(&pfn, p, sizeof(pfn));
+            arr[i] = pfn;
+        }
+
+        PyBuffer_Release(&view);
+    }
+    else
+    {
+        PyObject *seq = PySequence_Fast(obj, "pfns must be a sequence or "
+                                        "a buffer");
+
+        if ( seq == NULL )
+            return NULL;
+
+        n = PySequence_Fast_GET_SIZE(seq);
+        arr = malloc((n ?: 1) * sizeof(*arr));
+        if ( arr == NULL )
+        {
+            Py_DECREF(seq);
+            PyErr_NoMemory();
+            return NULL;
+        }
+
+        for ( i = 0; i < n; i++ )
+        {
+            arr[i] = PyLong_AsUnsignedLongLong(PySequence_Fast_GET_ITEM(seq, i));
+            if ( PyErr_Occurred() )
+            {
+                Py_DECREF(seq);
+                free(arr);
+                return NULL;
+            }
+        }
+
+        Py_DECREF(seq);
+    }
+
+    *nr = n;
+    return arr;
+}
+
+/* The hypervisor looks at no more than this many pfns at a time. */
+#define PFN_TYPE_BATCH 1024
+
+static PyObject *pyxc_get_pfn_types(XcObject *self,
+                                    PyObject *args,
+                                    PyObject *kwds)
+{
+    PyObject *pfns, *obj;
+    uint32_t dom, *types;
+    xen_pfn_t *arr;
+    Py_ssize_t i, n, done;
+    unsigned int batch;
+
+    static char *kwd_list[] = { "domid", "pfns", NULL };
+
+    if ( !PyArg_ParseTupleAndKeywords(args, kwds, "iO", kwd_list,
+                                      &dom, &pfns) )
+        return NULL;
+
+    arr = pyxc_pfn_array(pfns, &n);
+    if ( arr == NULL )
+        return NULL;
+
+    for ( done = 0; done < n; done += batch )
+    {
+        batch = (n - done) > PFN_TYPE_BATCH ? PFN_TYPE_BATCH : (n - done);
+        if ( xc_get_pfn_type_batch(self->xc_handle, dom, batch,
+                                   arr + done) < 0 )
+        {
+            free(arr);
+            return pyxc_error_to_exception(self->xc_handle);
+        }
+    }
+
+    obj = PyBytes_FromStringAndSize(NULL, n * sizeof(*types));
+    if ( obj != NULL )
+    {
+        types = (uint32_t *)PyBytes_AS_STRING(obj);
+        for ( i = 0; i < n; i++ )
+            types[i] = arr[i];
+    }
+
+    free(arr);
+
+    return obj;
+}
+
+static PyObject *pyxc_map_foreign(XcObject *self,
+                                  PyObject *args,
+                                  PyObject *kwds)
+{
+    PyObject *pfns;
+    XcMapObject *map;
+    uint32_t dom;
+    int writable = 0;
+    xen_pfn_t *arr;
+    Py_ssize_t n;
+    void *addr;
+
+    static char *kwd_list[] = { "domid", "pfns", "writable", NULL };
+
+    if ( !PyArg_ParseTupleAndKeywords(args, kwds, "iO|i", kwd_list,
+                                      &dom, &pfns, &writable) )
+        return NULL;
+
+    arr = pyxc_pfn_array(pfns, &n);
+    if ( arr == NULL )
+        return NULL;
+
+    if ( n == 0 || n > INT_MAX )
+    {
+        free(arr);
+        errno = EINVAL;
+        return PyErr_SetFromErrno(xc_error_obj);
+    }
+
+    addr = xc_map_foreign_pages(self->xc_handle, dom,
+                                writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                                arr, n);
+    free(arr);
+    if ( addr == NULL )
+        return pyxc_error_to_exception(self->xc_handle);
+
+    map = PyObject_New(XcMapObject, &PyXcMapType);
+    if ( map == NULL )
+    {
+        munmap(addr, n * XC_PAGE_SIZE);
+        return NULL;
+    }
+
+    map->addr = addr;
+    map->size = n * XC_PAGE_SIZE;
+    map->readonly = !writable;
+    map->exports = 0;
+
+    return (PyObject *)map;
+}
+
 static PyObject *pyxc_hvm_param_get(XcObject *self,
                                     PyObject *args,
                                     PyObject *kwds)
@@ -2171,6 +2505,47 @@ static PyMethodDef pyxc_methods[] = {
       " cpumap   [int]:  Bitmap of CPUs this VCPU can run on\n"
       " cpu      [int]:  CPU that this VCPU is currently bound to\n" },
 
+    { "domain_getinfo_array",
+      (PyCFunction)pyxc_domain_getinfo_array,
+      METH_VARARGS | METH_KEYWORDS, "\n"
+      "Get information regarding a set of domains, as packed records.\n"
+      " first_dom [int, 0]:    First domain to retrieve info about.\n"
+      " max_doms  [int, 1024]: Maximum number of domains to retrieve info"
+      " about.\n\n"
+      "Returns: [bytes] one record per domain, laid out as DOMINFO_FORMAT:\n"
+      " domid, ssidref, shutdown_reason, online_vcpus, max_vcpu_id, cpupool,\n"
+      " hvm, dying, crashed, shutdown, paused, blocked, running,\n"
+      " mem_kb, maxmem_kb, cpu_time, handle.\n" },
+
+    { "vcpu_getinfo_array",
+      (PyCFunction)pyxc_vcpu_getinfo_array,
+      METH_VARARGS | METH_KEYWORDS, "\n"
+      "Get information regarding all the VCPUs of a domain, as packed"
+      " records.\n"
+      " dom [int]: Identifier of domain.\n\n"
+      "Returns: [bytes] one record per VCPU, laid out as VCPUINFO_FORMAT:\n"
+      " vcpu, cpu, online, blocked, running, cpu_time.\n" },
+
+    { "get_pfn_types",
+      (PyCFunction)pyxc_get_pfn_types,
+      METH_VARARGS | METH_KEYWORDS, "\n"
+      "Get the types of a set of guest pages.\n"
+      " dom  [int]: Identifier of domain.\n"
+      " pfns [seq]: Sequence of pfns, or buffer of native 64-bit pfns.\n\n"
+      "Returns: [bytes] one native 32-bit XEN_DOMCTL_PFINFO_* value per"
+      " pfn.\n" },
+
+    { "map_foreign",
+      (PyCFunction)pyxc_map_foreign,
+      METH_VARARGS | METH_KEYWORDS, "\n"
+      "Map guest pages into this process.\n"
+      " dom      [int]:    Identifier of domain.\n"
+      " pfns     [seq]:    Sequence of pfns, or buffer of native 64-bit"
+      " pfns.\n"
+      " writable [int, 0]: Map the pages writable.\n\n"
+      "Returns: [foreign_map] buffer object giving access to the pages\n"
+      " without copying, e.g. through memoryview().\n" },
+
     { "gnttab_hvm_seed",
       (PyCFunction)pyxc_gnttab_hvm_seed,
       METH_KEYWORDS, "\n"
@@ -2651,6 +3026,87 @@ static PyMethodDef pyxc_methods[] = {
 };
 
 
+static int PyXcMap_getbuffer(XcMapObject *self, Py_buffer *view, int flags)
+{
+    if ( self->addr == NULL )
+    {
+        PyErr_SetString(PyExc_ValueError, "mapping is closed");
+        return -1;
+    }
+
+    if ( PyBuffer_FillInfo(view, (PyObject *)self, self->addr, self->size,
+                           self->readonly, flags) )
+        return -1;
+
+    self->exports++;
+    return 0;
+}
+
+static void PyXcMap_releasebuffer(XcMapObject *self, Py_buffer *view)
+{
+    self->exports--;
+}
+
+static PyObject *PyXcMap_close(XcMapObject *self)
+{
+    if ( self->exports )
+    {
+        PyErr_SetString(PyExc_BufferError, "mapping is still in use");
+        return NULL;
+    }
+
+    if ( self->addr )
+    {
+        munmap(self->addr, self->size);
+        self->addr = NULL;
+    }
+
+    Py_INCREF(zero);
+    return zero;
+}
+
+static void PyXcMap_dealloc(XcMapObject *self)
+{
+    if ( self->addr )
+        munmap(self->addr, self->size);
+
+    PyObject_Del(self);
+}
+
+static PyMethodDef pyxc_map_methods[] = {
+    { "close",
+      (PyCFunction)PyXcMap_close,
+      METH_NOARGS, "\n"
+      "Unmap the pages.  Fails while buffers of the mapping are in use.\n" },
+
+    { NULL, NULL, 0, NULL }
+};
+
+static PyBufferProcs PyXcMap_as_buffer = {
+    .bf_getbuffer = (getbufferproc)PyXcMap_getbuffer,
+    .bf_releasebuffer = (releasebufferproc)PyXcMap_releasebuffer,
+};
+
+static PyTypeObject PyXcMapType = {
+#if PY_MAJOR_VERSION >= 3
+    .ob_base = { PyObject_HEAD_INIT(NULL) },
+#else
+    PyObject_HEAD_INIT(NULL)
+#endif
+    .tp_name = PKG ".foreign_map",
+    .tp_basicsize = sizeof(XcMapObject),
+    .tp_itemsize = 0,
+    .tp_dealloc = (destructor)PyXcMap_dealloc,
+    .tp_as_buffer = &PyXcMap_as_buffer,
+#if PY_MAJOR_VERSION >= 3
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+#else
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_NEWBUFFER,
+#endif
+    .tp_doc = "Mapping of guest memory",
+    .tp_methods = pyxc_map_methods,
+};
+
 static PyObject *PyXc_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
 {
     XcObject *self = (XcObject *)type->tp_alloc(type, 0);
@@ -2727,6 +3183,8 @@ PyMODINIT_FUNC initxc(void)
 
     if (PyType_Ready(&PyXcType) < 0)
         INITERROR;
+    if (PyType_Ready(&PyXcMapType) < 0)
+        INITERROR;
 
 #if PY_MAJOR_VERSION >= 3
     m = PyModule_Create(&xc_module);
@@ -2751,6 +3209,9 @@ PyMODINIT_FUNC initxc(void)
     Py_INCREF(&PyXcType);
     PyModule_AddObject(m, CLS, (PyObject *)&PyXcType);
 
+    Py_INCREF(&PyXcMapType);
+    PyModule_AddObject(m, "foreign_map", (PyObject *)&PyXcMapType);
+
     Py_INCREF(xc_error_obj);
     PyModule_AddObject(m, "Error", xc_error_obj);
 
@@ -2758,6 +3219,22 @@ PyMODINIT_FUNC initxc(void)
     PyModule_AddIntConstant(m, "XEN_SCHEDULER_CREDIT", XEN_SCHEDULER_CREDIT);
     PyModule_AddIntConstant(m, "XEN_SCHEDULER_CREDIT2", XEN_SCHEDULER_CREDIT2);
 
+    PyModule_AddStringConstant(m, "DOMINFO_FORMAT", DOMINFO_FORMAT);
+    PyModule_AddStringConstant(m, "VCPUINFO_FORMAT", VCPUINFO_FORMAT);
+    PyModule_AddIntConstant(m, "XEN_DOMCTL_PFINFO_NOTAB", XEN_DOMCTL_PFINFO_NOTAB);
+    PyModule_AddIntConstant(m, "XEN_DOMCTL_PFINFO_L1TAB", XEN_DOMCTL_PFINFO_L1TAB);
+    PyModule_AddIntConstant(m, "XEN_DOMCTL_PFINFO_L2TAB", XEN_DOMCTL_PFINFO_L2TAB);
+    PyModule_AddIntConstant(m, "XEN_DOMCTL_PFINFO_L3TAB", XEN_DOMCTL_PFINFO_L3TAB);
+    PyModule_AddIntConstant(m, "XEN_DOMCTL_PFINFO_L4TAB", XEN_DOMCTL_PFINFO_L4TAB);
+    PyModule_AddIntConstant(m, "XEN_DOMCTL_PFINFO_LTABTYPE_MASK",
+                            XEN_DOMCTL_PFINFO_LTABTYPE_MASK);
+    PyModule_AddIntConstant(m, "XEN_DOMCTL_PFINFO_LPINTAB", XEN_DOMCTL_PFINFO_LPINTAB);
+    PyModule_AddIntConstant(m, "XEN_DOMCTL_PFINFO_XTAB", XEN_DOMCTL_PFINFO_XTAB);
+    PyModule_AddIntConstant(m, "XEN_DOMCTL_PFINFO_XALLOC", XEN_DOMCTL_PFINFO_XALLOC);
+    PyModule_AddIntConstant(m, "XEN_DOMCTL_PFINFO_BROKEN", XEN_DOMCTL_PFINFO_BROKEN);
+    PyModule_AddIntConstant(m, "XEN_DOMCTL_PFINFO_LTAB_MASK",
+                            XEN_DOMCTL_PFINFO_LTAB_MASK);
+
 #if PY_MAJOR_VERSION >= 3
     return m;
 #endif
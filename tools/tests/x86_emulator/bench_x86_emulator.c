@@ -0,0 +1,158 @@
+#include <errno.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include "x86_emulate.h"
+
+/*
+ * Measure the cost of emulating the instructions most commonly seen
+ * accessing emulated devices.  Memory accesses are plain copies, so the
+ * figures are those of the emulator itself, and are meant to be compared
+ * between builds on the same machine.
+ */
+
+#define ITERATIONS 1000000
+
+static int read(
+    enum x86_segment seg,
+    unsigned long offset,
+    void *p_data,
+    unsigned int bytes,
+    struct x86_emulate_ctxt *ctxt)
+{
+    if ( !is_x86_user_segment(seg) )
+        return X86EMUL_UNHANDLEABLE;
+    memcpy(p_data, (void *)offset, bytes);
+    return X86EMUL_OKAY;
+}
+
+static int write(
+    enum x86_segment seg,
+    unsigned long offset,
+    void *p_data,
+    unsigned int bytes,
+    struct x86_emulate_ctxt *ctxt)
+{
+    if ( !is_x86_user_segment(seg) )
+        return X86EMUL_UNHANDLEABLE;
+    memcpy((void *)offset, p_data, bytes);
+    return X86EMUL_OKAY;
+}
+
+static int read_segment(
+    enum x86_segment seg,
+    struct segment_register *reg,
+    struct x86_emulate_ctxt *ctxt)
+{
+    if ( !is_x86_user_segment(seg) )
+        return X86EMUL_UNHANDLEABLE;
+    memset(reg, 0, sizeof(*reg));
+    reg->attr.fields.p = 1;
+    return X86EMUL_OKAY;
+}
+
+static struct x86_emulate_ops emulops = {
+    .read       = read,
+    .insn_fetch = read,
+    .write      = write,
+    .read_segment = read_segment,
+    .cpuid      = emul_test_cpuid,
+    .read_cr    = emul_test_read_cr,
+    .get_fpu    = emul_test_get_fpu,
+    .put_fpu    = emul_test_put_fpu,
+};
+
+static const struct {
+    const char *name;
+    unsigned int len;
+    uint8_t insn[4];
+    bool only64;
+} benches[] = {
+    { "movl %ecx,(%eax)",   2, { 0x89, 0x08 } },
+    { "movl (%eax),%ecx",   2, { 0x8b, 0x08 } },
+    { "movw %cx,(%eax)",    3, { 0x66, 0x89, 0x08 } },
+    { "movb (%eax),%cl",    2, { 0x8a, 0x08 } },
+    { "movq %rcx,(%rax)",   3, { 0x48, 0x89, 0x08 }, true },
+    { "movq (%rax),%rcx",   3, { 0x48, 0x8b, 0x08 }, true },
+    { "movzbl (%eax),%ecx", 3, { 0x0f, 0xb6, 0x08 } },
+    { "movzwl (%eax),%ecx", 3, { 0x0f, 0xb7, 0x08 } },
+    { "addl %ecx,(%eax)",   2, { 0x01, 0x08 } },
+    { "rep movsb",          2, { 0xf3, 0xa4 } },
+    { "rep stosl",          2, { 0xf3, 0xab } },
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+    struct x86_emulate_ctxt ctxt;
+    struct cpu_user_regs regs;
+    unsigned int i, j, iterations = ITERATIONS;
+    unsigned char *mem, *instr;
+
+    if ( argc > 1 )
+        iterations = strtoul(argv[1], NULL, 0) ?: ITERATIONS;
+
+    ctxt.regs = &regs;
+    ctxt.force_writeback = 0;
+    ctxt.vendor    = X86_VENDOR_UNKNOWN;
+    ctxt.lma       = sizeof(void *) == 8;
+    ctxt.addr_size = 8 * sizeof(void *);
+    ctxt.sp_size   = 8 * sizeof(void *);
+
+    mem = mmap((void *)0x100000, MMAP_SZ, PROT_READ|PROT_WRITE|PROT_EXEC,
+               MAP_FIXED|MAP_PRIVATE|MAP_ANONYMOUS, 0, 0);
+    if ( mem == MAP_FAILED )
+    {
+        fprintf(stderr, "mmap to low address failed\n");
+        return 1;
+    }
+    instr = mem + 0x100;
+
+    emul_test_init();
+
+    printf("%-24s %10s\n", "Instruction", "ns/insn");
+
+    for ( i = 0; i < ARRAY_SIZE(benches); i++ )
+    {
+        uint64_t start;
+        int rc = X86EMUL_OKAY;
+
+        if ( benches[i].only64 && sizeof(void *) != 8 )
+            continue;
+
+        memcpy(instr, benches[i].insn, benches[i].len);
+
+        start = now_ns();
+        for ( j = 0; j < iterations && rc == X86EMUL_OKAY; j++ )
+        {
+            memset(&regs, 0, sizeof(regs));
+            regs.eflags = 0x200;
+            regs.eip    = (unsigned long)instr;
+            regs.eax    = (unsigned long)mem + 0x1000;
+            regs.ecx    = 64;
+            regs.esi    = (unsigned long)mem + 0x2000;
+            regs.edi    = (unsigned long)mem + 0x3000;
+
+            rc = x86_emulate(&ctxt, &emulops);
+        }
+
+        if ( rc != X86EMUL_OKAY )
+        {
+            printf("%-24s failed (%d)\n", benches[i].name, rc);
+            return 1;
+        }
+
+        printf("%-24s %10.1f\n", benches[i].name,
+               (double)(now_ns() - start) / iterations);
+    }
+
+    return 0;
+}
@@ -615,6 +615,52 @@ int main(int argc, char **argv)
         goto fail;
     printf("okay\n");
 
+    printf("%-40s", "Testing movzxbd (%eax),%ecx...");
+    instr[0] = 0x0f; instr[1] = 0xb6; instr[2] = 0x08;
+    regs.eflags = 0x200;
+    regs.eip    = (unsigned long)&instr[0];
+    regs.ecx    = ~0UL;
+    regs.eax    = (unsigned long)res;
+    *res        = 0x1234aa82;
+    rc = x86_emulate(&ctxt, &emulops);
+    if ( (rc != X86EMUL_OKAY) ||
+         (*res != 0x1234aa82) ||
+         (regs.ecx != 0x82) ||
+         ((regs.eflags&0x240) != 0x200) ||
+         (regs.eip != (unsigned long)&instr[3]) )
+        goto fail;
+    printf("okay\n");
+
+    printf("%-40s", "Testing movb %ch,(%eax)...");
+    instr[0] = 0x88; instr[1] = 0x28;
+    regs.eflags = 0x200;
+    regs.eip    = (unsigned long)&instr[0];
+    regs.ecx    = 0x12345678;
+    regs.eax    = (unsigned long)res;
+    *res        = 0x1234aa82;
+    rc = x86_emulate(&ctxt, &emulops);
+    if ( (rc != X86EMUL_OKAY) ||
+         (*res != 0x1234aa56) ||
+         (regs.ecx != 0x12345678) ||
+         (regs.eip != (unsigned long)&instr[2]) )
+        goto fail;
+    printf("okay\n");
+
+    printf("%-40s", "Testing movw (%eax),%cx...");
+    instr[0] = 0x66; instr[1] = 0x8b; instr[2] = 0x08;
+    regs.eflags = 0x200;
+    regs.eip    = (unsigned long)&instr[0];
+    regs.ecx    = 0x12345678;
+    regs.eax    = (unsigned long)res;
+    *res        = 0x1234aa82;
+    rc = x86_emulate(&ctxt, &emulops);
+    if ( (rc != X86EMUL_OKAY) ||
+         (*res != 0x1234aa82) ||
+         (regs.ecx != 0x1234aa82) ||
+         (regs.eip != (unsigned long)&instr[3]) )
+        goto fail;
+    printf("okay\n");
+
 #ifndef __x86_64__
     printf("%-40s", "Testing arpl %cx,(%eax)...");
     instr[0] = 0x63; instr[1] = 0x08;
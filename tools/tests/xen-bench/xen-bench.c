@@ -0,0 +1,482 @@
+/*
+ * xen-bench.c
+ *
+ * Microbenchmarks of hot hypervisor paths, driven from dom0.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms and conditions of the GNU General Public
+ * License, version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include <xenctrl.h>
+#include <xenevtchn.h>
+#include <xengnttab.h>
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof(a[0]))
+#define MAX_SAMPLES   100
+
+struct bench {
+    const char *name;
+    int (*init)(void);
+    int (*run)(unsigned int iters);
+    void (*deinit)(void);
+    unsigned int default_iters;
+    const char *descr;
+};
+
+static xc_interface *xch;
+static uint32_t self = 0;
+static bool json;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* Hypercall round trip: the cheapest hypercall there is, via privcmd. */
+static int bench_version(unsigned int iters)
+{
+    unsigned int i;
+
+    for ( i = 0; i < iters; i++ )
+        if ( xc_version(xch, XENVER_version, NULL) < 0 )
+            return errno;
+
+    return 0;
+}
+
+/* A domctl, which additionally goes through the bounce buffers. */
+static int bench_domctl(unsigned int iters)
+{
+    xc_dominfo_t info;
+    unsigned int i;
+
+    for ( i = 0; i < iters; i++ )
+        if ( xc_domain_getinfo(xch, self, 1, &info) != 1 )
+            return errno ?: ENOENT;
+
+    return 0;
+}
+
+/*
+ * Event channel ping-pong: two ends of a loopback interdomain channel,
+ * each owned by its own thread. One iteration is a full round trip.
+ */
+static xenevtchn_handle *xce_ping, *xce_pong;
+static evtchn_port_t port_ping, port_pong;
+static pthread_t pong_thread;
+
+static int evtchn_wait(xenevtchn_handle *xce, evtchn_port_t port)
+{
+    xenevtchn_port_or_error_t p = xenevtchn_pending(xce);
+
+    if ( p < 0 )
+        return errno;
+    if ( p != port )
+        return EINVAL;
+
+    return xenevtchn_unmask(xce, port) ? errno : 0;
+}
+
+static void *pong_main(void *arg)
+{
+    unsigned int i, iters = (uintptr_t)arg;
+
+    for ( i = 0; i < iters; i++ )
+        if ( evtchn_wait(xce_pong, port_pong) ||
+             xenevtchn_notify(xce_pong, port_pong) )
+            break;
+
+    return NULL;
+}
+
+static int bench_evtchn_init(void)
+{
+    xenevtchn_port_or_error_t p;
+
+    xce_ping = xenevtchn_open(NULL, 0);
+    xce_pong = xenevtchn_open(NULL, 0);
+    if ( !xce_ping || !xce_pong )
+        return errno;
+
+    p = xenevtchn_bind_unbound_port(xce_ping, self);
+    if ( p < 0 )
+        return errno;
+    port_ping = p;
+
+    p = xenevtchn_bind_interdomain(xce_pong, self, port_ping);
+    if ( p < 0 )
+        return errno;
+    port_pong = p;
+
+    return 0;
+}
+
+static int bench_evtchn(unsigned int iters)
+{
+    unsigned int i;
+    int ret = 0;
+
+    if ( pthread_create(&pong_thread, NULL, pong_main,
+                        (void *)(uintptr_t)iters) )
+        return errno;
+
+    for ( i = 0; i < iters && !ret; i++ )
+    {
+        if ( xenevtchn_notify(xce_ping, port_ping) )
+            ret = errno;
+        else
+            ret = evtchn_wait(xce_ping, port_ping);
+    }
+
+    if ( ret )
+        pthread_cancel(pong_thread);
+    pthread_join(pong_thread, NULL);
+
+    return ret;
+}
+
+static void bench_evtchn_deinit(void)
+{
+    if ( xce_pong )
+        xenevtchn_close(xce_pong);
+    if ( xce_ping )
+        xenevtchn_close(xce_ping);
+    xce_ping = xce_pong = NULL;
+}
+
+/*
+ * Grant operations against a page we grant to ourselves: map/unmap cost
+ * and copy throughput (one full page per iteration).
+ */
+static xengntshr_handle *xgs;
+static xengnttab_handle *xgt;
+static void *shared_page;
+static uint32_t gref;
+static uint8_t copy_buf[XC_PAGE_SIZE];
+
+static int bench_grant_init(void)
+{
+    xgs = xengntshr_open(NULL, 0);
+    xgt = xengnttab_open(NULL, 0);
+    if ( !xgs || !xgt )
+        return errno;
+
+    shared_page = xengntshr_share_pages(xgs, self, 1, &gref, 1);
+    if ( !shared_page )
+        return errno;
+    memset(shared_page, 0x5a, XC_PAGE_SIZE);
+
+    return 0;
+}
+
+static int bench_grant_map(unsigned int iters)
+{
+    unsigned int i;
+    void *p;
+
+    for ( i = 0; i < iters; i++ )
+    {
+        p = xengnttab_map_grant_ref(xgt, self, gref, PROT_READ | PROT_WRITE);
+        if ( !p )
+            return errno;
+        if ( xengnttab_unmap(xgt, p, 1) )
+            return errno;
+    }
+
+    return 0;
+}
+
+static int bench_grant_copy(unsigned int iters)
+{
+    xengnttab_grant_copy_segment_t seg = {
+        .source.foreign = { .ref = gref, .offset = 0, .domid = self },
+        .dest.virt = copy_buf,
+        .len = XC_PAGE_SIZE,
+        .flags = GNTCOPY_source_gref,
+    };
+    unsigned int i;
+
+    for ( i = 0; i < iters; i++ )
+    {
+        if ( xengnttab_grant_copy(xgt, 1, &seg) )
+            return errno;
+        if ( seg.status != GNTST_okay )
+            return EIO;
+    }
+
+    return 0;
+}
+
+static void bench_grant_deinit(void)
+{
+    if ( shared_page )
+        xengntshr_unshare(xgs, shared_page, 1);
+    if ( xgt )
+        xengnttab_close(xgt);
+    if ( xgs )
+        xengntshr_close(xgs);
+    shared_page = NULL;
+    xgt = NULL;
+    xgs = NULL;
+}
+
+/* Create and destroy an empty (no memory, no vcpus) PV domain. */
+static int bench_domain(unsigned int iters)
+{
+    xen_domain_handle_t handle = { 0 };
+    xc_domain_configuration_t config;
+    unsigned int i;
+    uint32_t domid;
+
+    for ( i = 0; i < iters; i++ )
+    {
+        memset(&config, 0, sizeof(config));
+        domid = 0;
+        if ( xc_domain_create(xch, 0, handle, 0, &domid, &config) )
+            return errno;
+        if ( xc_domain_destroy(xch, domid) )
+            return errno;
+    }
+
+    return 0;
+}
+
+static int nop_init(void)
+{
+    return 0;
+}
+
+static void nop_deinit(void)
+{
+}
+
+static struct bench benches[] = {
+    { "hypercall", nop_init, bench_version, nop_deinit, 100000,
+          "Hypercall round trip (xen_version)" },
+    { "domctl", nop_init, bench_domctl, nop_deinit, 100000,
+          "Domctl round trip (getdomaininfo)" },
+    { "evtchn", bench_evtchn_init, bench_evtchn, bench_evtchn_deinit, 10000,
+          "Event channel ping-pong round trip" },
+    { "grant-map", bench_grant_init, bench_grant_map, bench_grant_deinit,
+          10000, "Grant map + unmap of one page" },
+    { "grant-copy", bench_grant_init, bench_grant_copy, bench_grant_deinit,
+          10000, "Grant copy of one page" },
+    { "domain", nop_init, bench_domain, nop_deinit, 100,
+          "Empty domain create + destroy" },
+};
+
+static int cmp_u64(const void *a, const void *b)
+{
+    const uint64_t *x = a, *y = b;
+
+    return *x < *y ? -1 : *x > *y;
+}
+
+static int call_bench(struct bench *b, unsigned int iters,
+                      unsigned int samples)
+{
+    uint64_t ns[MAX_SAMPLES], start, total = 0;
+    unsigned int s, per_sample;
+    int ret;
+
+    per_sample = (iters ?: b->default_iters) / samples ?: 1;
+
+    ret = b->init();
+    if ( ret )
+        goto out;
+
+    /* Warm up caches and lazily allocated state. */
+    ret = b->run(per_sample / 10 ?: 1);
+
+    for ( s = 0; s < samples && !ret; s++ )
+    {
+        start = now_ns();
+        ret = b->run(per_sample);
+        ns[s] = now_ns() - start;
+        total += ns[s];
+    }
+
+ out:
+    b->deinit();
+
+    if ( ret )
+    {
+        if ( json )
+            printf("{\"bench\": \"%s\", \"error\": \"%s\"}\n",
+                   b->name, strerror(ret));
+        else
+            printf("%-12s: failed: %s\n", b->name, strerror(ret));
+        return ret;
+    }
+
+    qsort(ns, samples, sizeof(ns[0]), cmp_u64);
+
+    if ( json )
+        printf("{\"bench\": \"%s\", \"iterations\": %u, \"samples\": %u, "
+               "\"ns_per_op_min\": %.1f, \"ns_per_op_median\": %.1f, "
+               "\"ns_per_op_max\": %.1f, \"ops_per_sec\": %.0f}\n",
+               b->name, per_sample * samples, samples,
+               (double)ns[0] / per_sample,
+               (double)ns[samples / 2] / per_sample,
+               (double)ns[samples - 1] / per_sample,
+               total ? 1e9 * per_sample * samples / total : 0.0);
+    else
+        printf("%-12s: %10.1f ns/op (min %.1f, max %.1f) %12.0f ops/s\n",
+               b->name, (double)ns[samples / 2] / per_sample,
+               (double)ns[0] / per_sample,
+               (double)ns[samples - 1] / per_sample,
+               total ? 1e9 * per_sample * samples / total : 0.0);
+
+    return 0;
+}
+
+static void print_header(void)
+{
+    xen_extraversion_t extra;
+    xen_changeset_info_t cs;
+    int ver = xc_version(xch, XENVER_version, NULL);
+
+    if ( xc_version(xch, XENVER_extraversion, &extra) )
+        extra[0] = '\0';
+    if ( xc_version(xch, XENVER_changeset, &cs) )
+        cs[0] = '\0';
+    extra[sizeof(extra) - 1] = '\0';
+    cs[sizeof(cs) - 1] = '\0';
+
+    if ( json )
+        printf("{\"xen_version\": \"%d.%d%s\", \"changeset\": \"%s\"}\n",
+               ver >> 16, ver & 0xffff, extra, cs);
+    else
+        printf("Xen %d.%d%s (%s)\n", ver >> 16, ver & 0xffff, extra, cs);
+}
+
+static struct option options[] = {
+    { "list", 0, NULL, 'l' },
+    { "bench", 1, NULL, 'b' },
+    { "iterations", 1, NULL, 'i' },
+    { "samples", 1, NULL, 's' },
+    { "domid", 1, NULL, 'd' },
+    { "json", 0, NULL, 'j' },
+    { "help", 0, NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+};
+
+static void usage(int ret)
+{
+    FILE *out;
+
+    out = ret ? stderr : stdout;
+
+    fprintf(out, "usage: xen-bench [<options>]\n");
+    fprintf(out, "  <options> are:\n");
+    fprintf(out, "  -b|--bench <name>      run only the named benchmark\n");
+    fprintf(out, "  -l|--list              list the benchmarks\n");
+    fprintf(out, "  -i|--iterations <i>    operations per benchmark\n");
+    fprintf(out, "  -s|--samples <s>       split them into <s> timed samples "
+                 "(default 10)\n");
+    fprintf(out, "  -d|--domid <d>         our own domid (default 0)\n");
+    fprintf(out, "  -j|--json              one JSON object per line\n");
+    fprintf(out, "  -h|--help              print this text\n");
+    exit(ret);
+}
+
+int main(int argc, char *argv[])
+{
+    int opt, ret = 0;
+    unsigned int b, iters = 0, samples = 10;
+    const char *bench = NULL;
+    bool list = false;
+
+    while ( (opt = getopt_long(argc, argv, "lb:i:s:d:jh", options,
+                               NULL)) != -1 )
+    {
+        switch ( opt )
+        {
+        case 'b':
+            bench = optarg;
+            break;
+        case 'd':
+            self = strtoul(optarg, NULL, 0);
+            break;
+        case 'i':
+            iters = strtoul(optarg, NULL, 0);
+            break;
+        case 'j':
+            json = true;
+            break;
+        case 'l':
+            list = true;
+            break;
+        case 's':
+            samples = strtoul(optarg, NULL, 0);
+            break;
+        case 'h':
+            usage(0);
+            break;
+        default:
+            usage(1);
+        }
+    }
+
+    if ( optind != argc || !samples || samples > MAX_SAMPLES )
+        usage(1);
+
+    if ( list )
+    {
+        for ( b = 0; b < ARRAY_SIZE(benches); b++ )
+            printf("%-12s: %s\n", benches[b].name, benches[b].descr);
+        return 0;
+    }
+
+    xch = xc_interface_open(NULL, NULL, 0);
+    if ( !xch )
+    {
+        fprintf(stderr, "could not open xc interface\n");
+        exit(2);
+    }
+
+    print_header();
+
+    for ( b = 0; b < ARRAY_SIZE(benches); b++ )
+        if ( !bench || !strcmp(bench, benches[b].name) )
+            ret = call_bench(benches + b, iters, samples) ?: ret;
+
+    xc_interface_close(xch);
+
+    return ret ? 1 : 0;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -28,6 +28,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <time.h>
+#include <sys/wait.h>
 #include <xenstore.h>
 
 #define TEST_PATH "xenstore-test"
@@ -50,6 +51,7 @@ static char *path;
 static char *paths[WRITE_BUFFERS_N];
 static char write_buffers[WRITE_BUFFERS_N][WRITE_BUFFERS_SIZE];
 static int ta_loops;
+static bool quiet;
 
 static struct option options[] = {
     { "list-tests", 0, NULL, 'l' },
@@ -57,6 +59,7 @@ static struct option options[] = {
     { "random", 1, NULL, 'r' },
     { "help", 0, NULL, 'h' },
     { "iterations", 1, NULL, 'i' },
+    { "parallel", 1, NULL, 'p' },
     { NULL, 0, NULL, 0 }
 };
 
@@ -110,7 +113,7 @@ static int call_test(struct test *tst, int iters, bool no_clock)
 
     if ( ret )
         printf("%-10s: failed (ret = %d, stage %s)\n", tst->name, ret, stage);
-    else if ( !no_clock )
+    else if ( !no_clock && !quiet )
     {
         printf("%-10s:", tst->name);
         if ( iters > 1 )
@@ -134,9 +137,13 @@ static void usage(int ret)
     fprintf(out, "  <options> are:\n");
     fprintf(out, "  -i|--iterations <i>  perform each test <i> times (default 1)\n");
     fprintf(out, "  -l|--list-tests      list available tests\n");
+    fprintf(out, "  -p|--parallel <n>    run each test in <n> processes at once, with a\n");
+    fprintf(out, "                       connection each, and report the throughput\n");
     fprintf(out, "  -r|--random <time>   perform random tests for <time> seconds\n");
     fprintf(out, "  -t|--test <test>     run <test> (default is all tests)\n");
     fprintf(out, "  -h|--help            print this usage information\n");
+    fprintf(out, "Set XENSTORED_PATH to the xenbus device to go through the ring\n");
+    fprintf(out, "interface even when xenstored runs in dom0.\n");
     exit(ret);
 }
 
@@ -419,6 +426,75 @@ TEST("ta rmw x", test_ta2, 1, "Read-modify-write transaction abort"),
 TEST("ta err", test_ta3, 0, "Transaction with conflict"),
 };
 
+static void init_paths(void)
+{
+    int t;
+
+    asprintf(&path, "%s/%u", TEST_PATH, getpid());
+    for ( t = 0; t < WRITE_BUFFERS_N; t++ )
+    {
+        memset(write_buffers[t], 'a' + t, WRITE_BUFFERS_SIZE);
+        asprintf(&paths[t], "%s/%c", path, 'a' + t);
+    }
+}
+
+static void cleanup(void);
+
+/*
+ * Run a test in several processes at once, to see how the daemon copes
+ * with many connections rather than how long a single request takes.
+ */
+static int call_test_parallel(struct test *tst, int iters, int jobs)
+{
+    struct timespec tp1, tp2;
+    uint64_t nsec;
+    pid_t pid;
+    int j, status, ret = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &tp1);
+
+    for ( j = 0; j < jobs; j++ )
+    {
+        pid = fork();
+        if ( pid < 0 )
+        {
+            ret = errno;
+            break;
+        }
+        if ( pid == 0 )
+        {
+            /* Own connection and own nodes, so the jobs don't conflict. */
+            xs_close(xsh);
+            init_paths();
+            xsh = xs_open(0);
+            if ( !xsh )
+                exit(2);
+            quiet = true;
+            ret = call_test(tst, iters, false);
+            cleanup();
+            xs_close(xsh);
+            exit(ret ? 1 : 0);
+        }
+    }
+
+    while ( wait(&status) > 0 )
+        if ( !WIFEXITED(status) || WEXITSTATUS(status) )
+            ret = ret ?: EIO;
+
+    clock_gettime(CLOCK_MONOTONIC, &tp2);
+
+    if ( ret )
+        return ret;
+
+    nsec = tp2.tv_sec * 1000000000 + tp2.tv_nsec -
+           tp1.tv_sec * 1000000000 - tp1.tv_nsec;
+    printf("%-10s: %d x %d runs in %"PRIu64" ms, %"PRIu64" runs/s\n",
+           tst->name, jobs, iters, nsec / 1000000,
+           nsec ? (uint64_t)jobs * iters * 1000000000 / nsec : 0);
+
+    return 0;
+}
+
 static void cleanup(void)
 {
     xs_transaction_t t;
@@ -445,12 +521,12 @@ static void cleanup(void)
 
 int main(int argc, char *argv[])
 {
-    int opt, t, iters = 1, ret = 0, randtime = 0;
+    int opt, t, iters = 1, ret = 0, randtime = 0, jobs = 1;
     char *test = NULL;
     bool list = false;
     time_t stop;
 
-    while ( (opt = getopt_long(argc, argv, "lr:t:hi:", options,
+    while ( (opt = getopt_long(argc, argv, "lr:t:hi:p:", options,
                                NULL)) != -1 )
     {
         switch ( opt )
@@ -461,6 +537,9 @@ int main(int argc, char *argv[])
         case 'l':
             list = true;
             break;
+        case 'p':
+            jobs = atoi(optarg);
+            break;
         case 'r':
             randtime = atoi(optarg);
             break;
@@ -482,12 +561,7 @@ int main(int argc, char *argv[])
         return 0;
     }
 
-    asprintf(&path, "%s/%u", TEST_PATH, getpid());
-    for ( t = 0; t < WRITE_BUFFERS_N; t++ )
-    {
-        memset(write_buffers[t], 'a' + t, WRITE_BUFFERS_SIZE);
-        asprintf(&paths[t], "%s/%c", path, 'a' + t);
-    }
+    init_paths();
 
     xsh = xs_open(0);
     if ( !xsh )
@@ -510,7 +584,11 @@ int main(int argc, char *argv[])
     else
         for ( t = 0; t < ARRAY_SIZE(tests); t++ )
         {
-            if ( !test || !strcmp(test, tests[t].name) )
+            if ( test && strcmp(test, tests[t].name) )
+                continue;
+            if ( jobs > 1 )
+                ret = call_test_parallel(tests + t, iters, jobs);
+            else
                 ret = call_test(tests + t, iters, false);
         }
 
@@ -0,0 +1,220 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Measure what saving the extended state of one vCPU and restoring that
+ * of another costs, for the state components a guest commonly uses.  Two
+ * save areas are switched between, as when a pCPU alternates between two
+ * vCPUs, which also defeats the modified optimization of XSAVEOPT the way
+ * a real context switch does.  Each set is measured with its components
+ * in their initial configuration (XINUSE clear, as for a guest which
+ * never touched them) and in use.  XSAVES can't be used in user mode, so
+ * XSAVEC stands in for the compacted format.
+ */
+
+#define ITERATIONS 100000
+
+#define XSTATE_FP      (1ULL << 0)
+#define XSTATE_SSE     (1ULL << 1)
+#define XSTATE_YMM     (1ULL << 2)
+#define XSTATE_BNDREGS (1ULL << 3)
+#define XSTATE_BNDCSR  (1ULL << 4)
+#define XSTATE_OPMASK  (1ULL << 5)
+#define XSTATE_ZMM     (1ULL << 6)
+#define XSTATE_HI_ZMM  (1ULL << 7)
+#define XSTATE_PKRU    (1ULL << 9)
+
+#define XSTATE_COMPACTION_ENABLED (1ULL << 63)
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof(*(a)))
+
+#ifdef __x86_64__
+# define REX64 ".byte 0x48\n"
+#else
+# define REX64
+#endif
+
+struct xsave_hdr {
+    uint64_t xstate_bv;
+    uint64_t xcomp_bv;
+    uint64_t reserved[6];
+};
+
+static const struct {
+    const char *name;
+    uint64_t mask;
+} sets[] = {
+    { "x87+SSE",   XSTATE_FP | XSTATE_SSE },
+    { "+AVX",      XSTATE_FP | XSTATE_SSE | XSTATE_YMM },
+    { "+AVX-512",  XSTATE_FP | XSTATE_SSE | XSTATE_YMM |
+                   XSTATE_OPMASK | XSTATE_ZMM | XSTATE_HI_ZMM },
+    { "+MPX",      XSTATE_FP | XSTATE_SSE | XSTATE_YMM |
+                   XSTATE_OPMASK | XSTATE_ZMM | XSTATE_HI_ZMM |
+                   XSTATE_BNDREGS | XSTATE_BNDCSR },
+    { "+PKRU",     XSTATE_FP | XSTATE_SSE | XSTATE_YMM |
+                   XSTATE_OPMASK | XSTATE_ZMM | XSTATE_HI_ZMM |
+                   XSTATE_BNDREGS | XSTATE_BNDCSR | XSTATE_PKRU },
+};
+
+static void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t *a, uint32_t *b,
+                  uint32_t *c, uint32_t *d)
+{
+    asm volatile ( "cpuid"
+                   : "=a" (*a), "=b" (*b), "=c" (*c), "=d" (*d)
+                   : "a" (leaf), "c" (subleaf) );
+}
+
+static uint64_t xgetbv(uint32_t index)
+{
+    uint32_t lo, hi;
+
+    asm volatile ( ".byte 0x0f,0x01,0xd0" /* xgetbv */
+                   : "=a" (lo), "=d" (hi) : "c" (index) );
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static uint64_t rdtsc(void)
+{
+    uint32_t lo, hi;
+
+    asm volatile ( "rdtsc" : "=a" (lo), "=d" (hi) );
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static void do_xsave(void *ptr, uint64_t mask)
+{
+    asm volatile ( REX64 ".byte 0x0f,0xae,0x27" /* xsave */
+                   :: "a" ((uint32_t)mask), "d" ((uint32_t)(mask >> 32)),
+                      "D" (ptr) : "memory" );
+}
+
+static void do_xsaveopt(void *ptr, uint64_t mask)
+{
+    asm volatile ( REX64 ".byte 0x0f,0xae,0x37" /* xsaveopt */
+                   :: "a" ((uint32_t)mask), "d" ((uint32_t)(mask >> 32)),
+                      "D" (ptr) : "memory" );
+}
+
+static void do_xsavec(void *ptr, uint64_t mask)
+{
+    asm volatile ( REX64 ".byte 0x0f,0xc7,0x27" /* xsavec */
+                   :: "a" ((uint32_t)mask), "d" ((uint32_t)(mask >> 32)),
+                      "D" (ptr) : "memory" );
+}
+
+static void do_xrstor(const void *ptr, uint64_t mask)
+{
+    asm volatile ( REX64 ".byte 0x0f,0xae,0x2f" /* xrstor */
+                   :: "a" ((uint32_t)mask), "d" ((uint32_t)(mask >> 32)),
+                      "D" (ptr) : "memory" );
+}
+
+static const struct {
+    const char *name;
+    void (*save)(void *ptr, uint64_t mask);
+    bool compacted;
+} insns[] = {
+    { "xsave",    do_xsave,    false },
+    { "xsaveopt", do_xsaveopt, false },
+    { "xsavec",   do_xsavec,   true },
+};
+
+static void *area[2];
+static unsigned int area_size;
+
+static void init_area(void *ptr, uint64_t mask, bool used, bool compacted)
+{
+    struct xsave_hdr *hdr = ptr + 512;
+
+    memset(ptr, 0, area_size);
+    *(uint32_t *)(ptr + 24) = 0x1f80; /* MXCSR */
+    hdr->xstate_bv = used ? mask : 0;
+    hdr->xcomp_bv = compacted ? XSTATE_COMPACTION_ENABLED | mask : 0;
+}
+
+/* Returns the cycles of one switch: a save followed by a restore. */
+static uint64_t bench(unsigned int insn, uint64_t mask, bool used,
+                      unsigned int iterations)
+{
+    uint64_t start;
+    unsigned int i;
+
+    init_area(area[0], mask, used, insns[insn].compacted);
+    init_area(area[1], mask, used, insns[insn].compacted);
+    do_xrstor(area[0], mask);
+
+    start = rdtsc();
+    for ( i = 0; i < iterations; i++ )
+    {
+        insns[insn].save(area[i & 1], mask);
+        do_xrstor(area[!(i & 1)], mask);
+    }
+
+    return (rdtsc() - start) / iterations;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t eax, ebx, ecx, edx;
+    unsigned int i, j, k, iterations = ITERATIONS;
+    bool have[ARRAY_SIZE(insns)] = { true };
+    uint64_t xcr0;
+
+    if ( argc > 1 )
+        iterations = strtoul(argv[1], NULL, 0) ?: ITERATIONS;
+
+    cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+    if ( !(ecx & (1u << 27)) )
+    {
+        fprintf(stderr, "XSAVE not enabled by the OS\n");
+        return 1;
+    }
+
+    xcr0 = xgetbv(0);
+    cpuid(0xd, 0, &eax, &ebx, &ecx, &edx);
+    area_size = ebx;
+    cpuid(0xd, 1, &eax, &ebx, &ecx, &edx);
+    have[1] = eax & (1u << 0);
+    have[2] = eax & (1u << 1);
+
+    for ( i = 0; i < 2; i++ )
+    {
+        if ( posix_memalign(&area[i], 64, area_size) )
+        {
+            fprintf(stderr, "cannot allocate a %u byte save area\n",
+                    area_size);
+            return 1;
+        }
+    }
+
+    printf("XCR0 %#"PRIx64", save area %u bytes, cycles per switch\n",
+           xcr0, area_size);
+    printf("%-10s %-6s", "Set", "State");
+    for ( k = 0; k < ARRAY_SIZE(insns); k++ )
+        printf(" %10s", insns[k].name);
+    printf("\n");
+
+    for ( i = 0; i < ARRAY_SIZE(sets); i++ )
+    {
+        if ( sets[i].mask & ~xcr0 )
+            continue;
+
+        for ( j = 0; j < 2; j++ )
+        {
+            printf("%-10s %-6s", sets[i].name, j ? "used" : "init");
+            for ( k = 0; k < ARRAY_SIZE(insns); k++ )
+                if ( have[k] )
+                    printf(" %10"PRIu64, bench(k, sets[i].mask, j,
+                                               iterations));
+                else
+                    printf(" %10s", "-");
+            printf("\n");
+        }
+    }
+
+    return 0;
+}
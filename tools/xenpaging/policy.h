@@ -24,15 +24,56 @@
 #define __XEN_PAGING_POLICY_H__
 
 
+#include <stdbool.h>
 #include "xenpaging.h"
 
 
-int policy_init(struct xenpaging *paging);
-unsigned long policy_choose_victim(struct xenpaging *paging);
-void policy_notify_paged_out(unsigned long gfn);
-void policy_notify_paged_in(unsigned long gfn);
-void policy_notify_paged_in_nomru(unsigned long gfn);
-void policy_notify_dropped(unsigned long gfn);
+/*
+ * A paging policy chooses the pages to evict; xenpaging tells it about
+ * pages leaving and entering the guest.  The optional hooks let a policy
+ * watch the guest: poll_fd() returns a descriptor for the main loop to
+ * poll, handle_event() is called when it is readable, and tick() on each
+ * iteration of the main loop.
+ */
+struct xenpaging_policy {
+    const char *name;
+    int (*init)(struct xenpaging *paging);
+    void (*teardown)(struct xenpaging *paging);
+    /* A gfn to evict, or INVALID_MFN if there is none for now */
+    unsigned long (*choose_victim)(struct xenpaging *paging);
+    void (*notify_paged_out)(struct xenpaging *paging, unsigned long gfn);
+    /* The guest touched the page */
+    void (*notify_paged_in)(struct xenpaging *paging, unsigned long gfn);
+    /* As above, but do not protect the page from eviction */
+    void (*notify_paged_in_nomru)(struct xenpaging *paging, unsigned long gfn);
+    /* The page came back without being touched, by readahead */
+    void (*notify_prefetched)(struct xenpaging *paging, unsigned long gfn);
+    void (*notify_dropped)(struct xenpaging *paging, unsigned long gfn);
+    int (*poll_fd)(struct xenpaging *paging);
+    int (*handle_event)(struct xenpaging *paging);
+    void (*tick)(struct xenpaging *paging);
+};
+
+extern const struct xenpaging_policy policy_default;
+extern const struct xenpaging_policy policy_wset;
+
+/*
+ * The clock over all gfns of the default policy, for other policies to
+ * build on.  policy_default_choose() skips the gfns set in avoid as long
+ * as others are left.
+ */
+int policy_default_init(struct xenpaging *paging);
+unsigned long policy_default_choose(struct xenpaging *paging,
+                                    const unsigned long *avoid);
+bool policy_default_claim(unsigned long gfn);
+void policy_default_notify_paged_out(struct xenpaging *paging,
+                                     unsigned long gfn);
+void policy_default_notify_paged_in(struct xenpaging *paging,
+                                    unsigned long gfn);
+void policy_default_notify_paged_in_nomru(struct xenpaging *paging,
+                                          unsigned long gfn);
+void policy_default_notify_dropped(struct xenpaging *paging,
+                                   unsigned long gfn);
 
 #endif // __XEN_PAGING_POLICY_H__
 
@@ -36,7 +36,7 @@ static unsigned long current_gfn;
 static unsigned long max_pages;
 
 
-int policy_init(struct xenpaging *paging)
+int policy_default_init(struct xenpaging *paging)
 {
     int i;
     int rc = -ENOMEM;
@@ -76,12 +76,11 @@ int policy_init(struct xenpaging *paging)
     return rc;
 }
 
-unsigned long policy_choose_victim(struct xenpaging *paging)
+/* One iteration over all possible gfns, from where the last one stopped */
+static unsigned long clock_scan(const unsigned long *avoid)
 {
-    xc_interface *xch = paging->xc_handle;
     unsigned long i;
 
-    /* One iteration over all possible gfns */
     for ( i = 0; i < max_pages; i++ )
     {
         /* Try next gfn */
@@ -110,12 +109,30 @@ unsigned long policy_choose_victim(struct xenpaging *paging)
         if ( test_bit(current_gfn, unconsumed) )
             continue;
 
+        /* gfn to be kept as long as there are others */
+        if ( avoid && test_bit(current_gfn, avoid) )
+            continue;
+
         /* gfn found */
-        break;
+        set_bit(current_gfn, unconsumed);
+        return current_gfn;
     }
 
+    return INVALID_MFN;
+}
+
+unsigned long policy_default_choose(struct xenpaging *paging,
+                                    const unsigned long *avoid)
+{
+    xc_interface *xch = paging->xc_handle;
+    unsigned long gfn;
+
+    gfn = clock_scan(avoid);
+    if ( gfn == INVALID_MFN && avoid )
+        gfn = clock_scan(NULL);
+
     /* Could not nominate any gfn */
-    if ( i >= max_pages )
+    if ( gfn == INVALID_MFN )
     {
         /* No more pages, wait in poll */
         paging->use_poll_timeout = 1;
@@ -129,14 +146,29 @@ unsigned long policy_choose_victim(struct xenpaging *paging)
             unconsumed_cleared = 0;
             DPRINTF("clearing unconsumed, current_gfn %lx", current_gfn);
         }
-        return INVALID_MFN;
     }
 
-    set_bit(current_gfn, unconsumed);
-    return current_gfn;
+    return gfn;
 }
 
-void policy_notify_paged_out(unsigned long gfn)
+/* Take gfn as the next victim, if the clock would have taken it */
+bool policy_default_claim(unsigned long gfn)
+{
+    if ( gfn >= max_pages || test_bit(gfn, bitmap) ||
+         test_bit(gfn, unconsumed) )
+        return false;
+
+    set_bit(gfn, unconsumed);
+    return true;
+}
+
+static unsigned long policy_choose_victim(struct xenpaging *paging)
+{
+    return policy_default_choose(paging, NULL);
+}
+
+void policy_default_notify_paged_out(struct xenpaging *paging,
+                                     unsigned long gfn)
 {
     set_bit(gfn, bitmap);
     clear_bit(gfn, unconsumed);
@@ -159,21 +191,35 @@ static void policy_handle_paged_in(unsigned long gfn, int do_mru)
     i_mru++;
 }
 
-void policy_notify_paged_in(unsigned long gfn)
+void policy_default_notify_paged_in(struct xenpaging *paging,
+                                    unsigned long gfn)
 {
     policy_handle_paged_in(gfn, 1);
 }
 
-void policy_notify_paged_in_nomru(unsigned long gfn)
+void policy_default_notify_paged_in_nomru(struct xenpaging *paging,
+                                          unsigned long gfn)
 {
     policy_handle_paged_in(gfn, 0);
 }
 
-void policy_notify_dropped(unsigned long gfn)
+void policy_default_notify_dropped(struct xenpaging *paging,
+                                   unsigned long gfn)
 {
     clear_bit(gfn, bitmap);
 }
 
+const struct xenpaging_policy policy_default = {
+    .name                   = "default",
+    .init                   = policy_default_init,
+    .choose_victim          = policy_choose_victim,
+    .notify_paged_out       = policy_default_notify_paged_out,
+    .notify_paged_in        = policy_default_notify_paged_in,
+    .notify_paged_in_nomru  = policy_default_notify_paged_in_nomru,
+    .notify_prefetched      = policy_default_notify_dropped,
+    .notify_dropped         = policy_default_notify_dropped,
+};
+
 
 /*
  * Local variables:
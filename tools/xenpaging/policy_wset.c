@@ -0,0 +1,347 @@
+/******************************************************************************
+ *
+ * Xen domain paging policy based on a working set estimate.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Xen does not report the accessed bits of the p2m, so accesses are
+ * sampled with mem_access instead: each round, a batch of resident gfns
+ * is made inaccessible and the monitor ring reports which of them the
+ * guest touches.  The first touch restores access, so a sampled page
+ * costs the guest at most one trip to xenpaging per round.
+ *
+ * Touched pages are hot and evicted last; pages left untouched for a
+ * whole round are cold and evicted first.  Without a sample, or when the
+ * monitor ring is used by someone else, the clock of the default policy
+ * decides.
+ */
+
+#include <time.h>
+#include "xc_bitops.h"
+#include "policy.h"
+
+
+#define WSET_SAMPLE_PAGES  512      /* Gfns sampled per round */
+#define WSET_ROUND_MS      1000     /* Length of a round */
+#define WSET_COLD_QUEUE    4096     /* Cold gfns remembered, a power of 2 */
+
+
+static unsigned long max_pages;
+static unsigned long *hot;
+static unsigned long *sampled;
+static unsigned long sample_cursor;
+
+static uint64_t sample[WSET_SAMPLE_PAGES];
+static uint8_t sample_access[WSET_SAMPLE_PAGES];
+static unsigned int nr_sample, nr_touched;
+static uint64_t round_start_ms;
+
+static unsigned long cold_queue[WSET_COLD_QUEUE];
+static unsigned int cold_head, cold_tail;
+
+static struct vm_event monitor;
+static bool monitor_enabled;
+
+
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int monitor_enable(struct xenpaging *paging)
+{
+    xc_interface *xch = paging->xc_handle;
+    domid_t domid = paging->vm_event.domain_id;
+    int rc;
+
+    monitor.domain_id = domid;
+    monitor.ring_page = xc_monitor_enable(xch, domid, &monitor.evtchn_port);
+    if ( !monitor.ring_page )
+        return -1;
+
+    monitor.xce_handle = xenevtchn_open(NULL, 0);
+    if ( !monitor.xce_handle )
+        goto err;
+
+    rc = xenevtchn_bind_interdomain(monitor.xce_handle, domid,
+                                    monitor.evtchn_port);
+    if ( rc < 0 )
+        goto err;
+    monitor.port = rc;
+
+    SHARED_RING_INIT((vm_event_sring_t *)monitor.ring_page);
+    BACK_RING_INIT(&monitor.back_ring, (vm_event_sring_t *)monitor.ring_page,
+                   PAGE_SIZE);
+
+    monitor_enabled = true;
+    return 0;
+
+ err:
+    if ( monitor.xce_handle )
+        xenevtchn_close(monitor.xce_handle);
+    monitor.xce_handle = NULL;
+    munmap(monitor.ring_page, PAGE_SIZE);
+    monitor.ring_page = NULL;
+    xc_monitor_disable(xch, domid);
+    return -1;
+}
+
+static void sample_restore(struct xenpaging *paging)
+{
+    xc_interface *xch = paging->xc_handle;
+    unsigned int i;
+
+    if ( !nr_sample )
+        return;
+
+    for ( i = 0; i < nr_sample; i++ )
+    {
+        sample_access[i] = XENMEM_access_rwx;
+        clear_bit(sample[i], sampled);
+    }
+
+    if ( xc_set_mem_access_multi(xch, paging->vm_event.domain_id,
+                                 sample_access, sample, nr_sample) )
+        PERROR("Error restoring access of sampled gfns");
+
+    nr_sample = 0;
+}
+
+/* Close a round: what was sampled and not touched is cold */
+static void round_end(struct xenpaging *paging)
+{
+    xc_interface *xch = paging->xc_handle;
+    unsigned int i;
+
+    for ( i = 0; i < nr_sample; i++ )
+    {
+        if ( !test_bit(sample[i], sampled) )
+            continue;
+
+        clear_bit(sample[i], hot);
+        cold_queue[cold_tail++ & (WSET_COLD_QUEUE - 1)] = sample[i];
+        if ( cold_tail - cold_head > WSET_COLD_QUEUE )
+            cold_head = cold_tail - WSET_COLD_QUEUE;
+    }
+
+    if ( nr_sample )
+        DPRINTF("wset: %u of %u sampled pages touched, working set about "
+                "%lu pages\n", nr_touched, nr_sample,
+                (unsigned long)nr_touched *
+                (max_pages - paging->num_paged_out) / nr_sample);
+
+    sample_restore(paging);
+}
+
+/* Open a round on the next resident gfns */
+static void round_start(struct xenpaging *paging)
+{
+    xc_interface *xch = paging->xc_handle;
+    unsigned long i;
+
+    nr_touched = 0;
+    for ( i = 0; i < max_pages && nr_sample < WSET_SAMPLE_PAGES; i++ )
+    {
+        unsigned long gfn = sample_cursor;
+
+        if ( ++sample_cursor >= max_pages )
+            sample_cursor = 1;
+
+        if ( !gfn || test_bit(gfn, paging->bitmap) )
+            continue;
+
+        sample[nr_sample] = gfn;
+        sample_access[nr_sample] = XENMEM_access_n;
+        nr_sample++;
+    }
+
+    if ( !nr_sample )
+        return;
+
+    if ( xc_set_mem_access_multi(xch, paging->vm_event.domain_id,
+                                 sample_access, sample, nr_sample) )
+    {
+        PERROR("Error setting access of sampled gfns");
+        sample_restore(paging);
+        return;
+    }
+
+    for ( i = 0; i < nr_sample; i++ )
+        set_bit(sample[i], sampled);
+}
+
+static int policy_init(struct xenpaging *paging)
+{
+    xc_interface *xch = paging->xc_handle;
+    int rc;
+
+    rc = policy_default_init(paging);
+    if ( rc )
+        return rc;
+
+    max_pages = paging->max_pages;
+    hot = bitmap_alloc(max_pages);
+    sampled = bitmap_alloc(max_pages);
+    if ( !hot || !sampled )
+        return -ENOMEM;
+    sample_cursor = 1;
+
+    if ( monitor_enable(paging) )
+        ERROR("wset: cannot sample accesses (%s), using the clock only",
+              strerror(errno));
+
+    return 0;
+}
+
+static void policy_teardown(struct xenpaging *paging)
+{
+    xc_interface *xch = paging->xc_handle;
+
+    if ( !monitor_enabled )
+        return;
+
+    sample_restore(paging);
+
+    xenevtchn_unbind(monitor.xce_handle, monitor.port);
+    xenevtchn_close(monitor.xce_handle);
+    munmap(monitor.ring_page, PAGE_SIZE);
+    if ( xc_monitor_disable(xch, paging->vm_event.domain_id) )
+        PERROR("Error disabling the monitor ring");
+    monitor_enabled = false;
+}
+
+static unsigned long policy_choose_victim(struct xenpaging *paging)
+{
+    unsigned long gfn;
+
+    /* Cold pages may have been touched, evicted or claimed since */
+    while ( cold_head != cold_tail )
+    {
+        gfn = cold_queue[cold_head++ & (WSET_COLD_QUEUE - 1)];
+        if ( !test_bit(gfn, hot) && !test_bit(gfn, sampled) &&
+             policy_default_claim(gfn) )
+            return gfn;
+    }
+
+    return policy_default_choose(paging, hot);
+}
+
+static void policy_notify_paged_in(struct xenpaging *paging,
+                                   unsigned long gfn)
+{
+    set_bit(gfn, hot);
+    policy_default_notify_paged_in(paging, gfn);
+}
+
+static int policy_poll_fd(struct xenpaging *paging)
+{
+    return monitor_enabled ? xenevtchn_fd(monitor.xce_handle) : -1;
+}
+
+static int policy_handle_event(struct xenpaging *paging)
+{
+    xc_interface *xch = paging->xc_handle;
+    vm_event_back_ring_t *ring = &monitor.back_ring;
+    vm_event_request_t req;
+    vm_event_response_t rsp;
+    int port;
+
+    port = xenevtchn_pending(monitor.xce_handle);
+    if ( port < 0 || xenevtchn_unmask(monitor.xce_handle, port) < 0 )
+    {
+        PERROR("Error reading the monitor event channel");
+        return -1;
+    }
+
+    while ( RING_HAS_UNCONSUMED_REQUESTS(ring) )
+    {
+        memcpy(&req, RING_GET_REQUEST(ring, ring->req_cons), sizeof(req));
+        ring->req_cons++;
+        ring->sring->req_event = ring->req_cons + 1;
+
+        if ( req.reason == VM_EVENT_REASON_MEM_ACCESS )
+        {
+            unsigned long gfn = req.u.mem_access.gfn;
+
+            if ( gfn < max_pages && test_and_clear_bit(gfn, sampled) )
+            {
+                set_bit(gfn, hot);
+                nr_touched++;
+            }
+            if ( xc_set_mem_access(xch, paging->vm_event.domain_id,
+                                   XENMEM_access_rwx, gfn, 1) )
+                PERROR("Error restoring access of gfn %lx", gfn);
+        }
+
+        memset(&rsp, 0, sizeof(rsp));
+        rsp.version = VM_EVENT_INTERFACE_VERSION;
+        rsp.vcpu_id = req.vcpu_id;
+        rsp.flags = req.flags & VM_EVENT_FLAG_VCPU_PAUSED;
+        rsp.reason = req.reason;
+
+        memcpy(RING_GET_RESPONSE(ring, ring->rsp_prod_pvt), &rsp,
+               sizeof(rsp));
+        ring->rsp_prod_pvt++;
+        RING_PUSH_RESPONSES(ring);
+    }
+
+    return xenevtchn_notify(monitor.xce_handle, monitor.port);
+}
+
+static void policy_tick(struct xenpaging *paging)
+{
+    uint64_t now;
+
+    if ( !monitor_enabled )
+        return;
+
+    now = now_ms();
+    if ( now - round_start_ms < WSET_ROUND_MS )
+        return;
+
+    round_end(paging);
+    round_start(paging);
+    round_start_ms = now;
+}
+
+const struct xenpaging_policy policy_wset = {
+    .name                   = "wset",
+    .init                   = policy_init,
+    .teardown               = policy_teardown,
+    .choose_victim          = policy_choose_victim,
+    .notify_paged_out       = policy_default_notify_paged_out,
+    .notify_paged_in        = policy_notify_paged_in,
+    .notify_paged_in_nomru  = policy_default_notify_paged_in_nomru,
+    .notify_prefetched      = policy_default_notify_dropped,
+    .notify_dropped         = policy_default_notify_dropped,
+    .poll_fd                = policy_poll_fd,
+    .handle_event           = policy_handle_event,
+    .tick                   = policy_tick,
+};
+
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
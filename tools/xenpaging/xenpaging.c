@@ -74,8 +74,8 @@ static int xenpaging_wait_for_event_or_timeout(struct xenpaging *paging)
     xc_interface *xch = paging->xc_handle;
     xenevtchn_handle *xce = paging->vm_event.xce_handle;
     char **vec, *val;
-    unsigned int num;
-    struct pollfd fd[2];
+    unsigned int num, nfds = 2;
+    struct pollfd fd[3];
     int port;
     int rc;
     int timeout;
@@ -86,9 +86,17 @@ static int xenpaging_wait_for_event_or_timeout(struct xenpaging *paging)
     fd[1].fd = xs_fileno(paging->xs_handle);
     fd[1].events = POLLIN | POLLERR;
 
+    /* And for whatever the policy watches */
+    if ( paging->policy->poll_fd &&
+         (fd[2].fd = paging->policy->poll_fd(paging)) >= 0 )
+    {
+        fd[2].events = POLLIN | POLLERR;
+        nfds = 3;
+    }
+
     /* No timeout while page-out is still in progress */
     timeout = paging->use_poll_timeout ? 100 : 0;
-    rc = poll(fd, 2, timeout);
+    rc = poll(fd, nfds, timeout);
     if ( rc < 0 )
     {
         if (errno == EINTR)
@@ -159,6 +167,15 @@ static int xenpaging_wait_for_event_or_timeout(struct xenpaging *paging)
             PERROR("Failed to unmask event channel port");
         }
     }
+
+    if ( !interrupted && nfds > 2 && fd[2].revents & POLLIN )
+    {
+        if ( paging->policy->handle_event(paging) < 0 )
+        {
+            ERROR("Error handling event of policy %s", paging->policy->name);
+            rc = -1;
+        }
+    }
 err:
     return rc;
 }
@@ -178,17 +195,17 @@ static int xenpaging_get_tot_pages(struct xenpaging *paging)
     return domain_info.tot_pages;
 }
 
-static void *init_page(void)
+static void *init_page(unsigned int nr)
 {
     void *buffer;
 
     /* Allocated page memory */
-    errno = posix_memalign(&buffer, PAGE_SIZE, PAGE_SIZE);
+    errno = posix_memalign(&buffer, PAGE_SIZE, nr * PAGE_SIZE);
     if ( errno != 0 )
         return NULL;
 
     /* Lock buffer in memory so it can't be paged out */
-    if ( mlock(buffer, PAGE_SIZE) < 0 )
+    if ( mlock(buffer, nr * PAGE_SIZE) < 0 )
     {
         free(buffer);
         buffer = NULL;
@@ -208,6 +225,10 @@ static void usage(void)
     printf(" -f <file>      --pagefile=<file>        pagefile to use. This option is required.\n");
     printf(" -m <max_memkb> --max_memkb=<max_memkb>  maximum amount of memory to handle.\n");
     printf(" -r <num>       --mru_size=<num>         number of paged-in pages to keep in memory.\n");
+    printf(" -p <name>      --policy=<name>          eviction policy: default (clock) or wset\n");
+    printf("                                         (working set sampled with mem_access).\n");
+    printf(" -a <num>       --readahead=<num>        paged out neighbours to load with a page (default %d).\n",
+           XENPAGING_DEFAULT_READAHEAD);
     printf(" -v             --verbose                enable debug output.\n");
     printf(" -h             --help                   this output.\n");
 }
@@ -215,15 +236,25 @@ static void usage(void)
 static int xenpaging_getopts(struct xenpaging *paging, int argc, char *argv[])
 {
     int ch;
-    static const char sopts[] = "hvd:f:m:r:";
+    static const char sopts[] = "hvd:f:m:r:p:a:";
     static const struct option lopts[] = {
         {"help", 0, NULL, 'h'},
         {"verbose", 0, NULL, 'v'},
         {"domain", 1, NULL, 'd'},
         {"pagefile", 1, NULL, 'f'},
         {"mru_size", 1, NULL, 'm'},
+        {"policy", 1, NULL, 'p'},
+        {"readahead", 1, NULL, 'a'},
         { }
     };
+    static const struct xenpaging_policy *const policies[] = {
+        &policy_default,
+        &policy_wset,
+    };
+    unsigned int i;
+
+    paging->policy = policies[0];
+    paging->readahead = XENPAGING_DEFAULT_READAHEAD;
 
     while ((ch = getopt_long(argc, argv, sopts, lopts, NULL)) != -1)
     {
@@ -242,6 +273,27 @@ static int xenpaging_getopts(struct xenpaging *paging, int argc, char *argv[])
         case 'r':
             paging->policy_mru_size = atoi(optarg);
             break;
+        case 'p':
+            for ( i = 0; i < ARRAY_SIZE(policies); i++ )
+                if ( !strcmp(optarg, policies[i]->name) )
+                    break;
+            if ( i == ARRAY_SIZE(policies) )
+            {
+                printf("Unknown policy %s!\n", optarg);
+                usage();
+                return 1;
+            }
+            paging->policy = policies[i];
+            break;
+        case 'a':
+            paging->readahead = atoi(optarg);
+            if ( paging->readahead < 0 ||
+                 paging->readahead >= XENPAGING_BATCH_SIZE )
+            {
+                printf("readahead must be below %d!\n", XENPAGING_BATCH_SIZE);
+                return 1;
+            }
+            break;
         case 'v':
             paging->debug = 1;
             break;
@@ -459,15 +511,16 @@ static struct xenpaging *xenpaging_init(int argc, char *argv[])
         goto err;
 
     /* Initialise policy */
-    rc = policy_init(paging);
+    rc = paging->policy->init(paging);
     if ( rc != 0 )
     {
         PERROR("Error initialising policy");
         goto err;
     }
 
-    paging->paging_buffer = init_page();
-    if ( !paging->paging_buffer )
+    paging->paging_buffer = init_page(1);
+    paging->batch_buffer = init_page(XENPAGING_BATCH_SIZE);
+    if ( !paging->paging_buffer || !paging->batch_buffer )
     {
         PERROR("Creating page aligned load buffer");
         goto err;
@@ -488,6 +541,8 @@ static struct xenpaging *xenpaging_init(int argc, char *argv[])
     {
         if ( paging->xs_handle )
             xs_close(paging->xs_handle);
+        if ( xch && paging->policy && paging->policy->teardown )
+            paging->policy->teardown(paging);
         if ( xch )
             xc_interface_close(xch);
         if ( paging->paging_buffer )
@@ -495,6 +550,11 @@ static struct xenpaging *xenpaging_init(int argc, char *argv[])
             munlock(paging->paging_buffer, PAGE_SIZE);
             free(paging->paging_buffer);
         }
+        if ( paging->batch_buffer )
+        {
+            munlock(paging->batch_buffer, XENPAGING_BATCH_SIZE * PAGE_SIZE);
+            free(paging->batch_buffer);
+        }
 
         if ( paging->vm_event.ring_page )
         {
@@ -521,6 +581,9 @@ static void xenpaging_teardown(struct xenpaging *paging)
     xs_unwatch(paging->xs_handle, watch_target_tot_pages, "");
     xs_unwatch(paging->xs_handle, "@releaseDomain", watch_token);
 
+    if ( paging->policy->teardown )
+        paging->policy->teardown(paging);
+
     paging->xc_handle = NULL;
     /* Tear down domain paging in Xen */
     munmap(paging->vm_event.ring_page, PAGE_SIZE);
@@ -587,85 +650,6 @@ static void put_response(struct vm_event *vm_event, vm_event_response_t *rsp)
     RING_PUSH_RESPONSES(back_ring);
 }
 
-/* Evict a given gfn
- * Returns < 0 on fatal error
- * Returns 0 on successful evict
- * Returns > 0 if gfn can not be evicted
- */
-static int xenpaging_evict_page(struct xenpaging *paging, unsigned long gfn, int slot)
-{
-    xc_interface *xch = paging->xc_handle;
-    void *page;
-    xen_pfn_t victim = gfn;
-    int ret;
-
-    DECLARE_DOMCTL;
-
-    /* Nominate page */
-    ret = xc_mem_paging_nominate(xch, paging->vm_event.domain_id, gfn);
-    if ( ret < 0 )
-    {
-        /* unpageable gfn is indicated by EBUSY */
-        if ( errno == EBUSY )
-            ret = 1;
-        else
-            PERROR("Error nominating page %lx", gfn);
-        goto out;
-    }
-
-    /* Map page */
-    page = xc_map_foreign_pages(xch, paging->vm_event.domain_id, PROT_READ, &victim, 1);
-    if ( page == NULL )
-    {
-        PERROR("Error mapping page %lx", gfn);
-        ret = -1;
-        goto out;
-    }
-
-    /* Copy page */
-    ret = write_page(paging->fd, page, slot);
-    if ( ret < 0 )
-    {
-        PERROR("Error copying page %lx", gfn);
-        munmap(page, PAGE_SIZE);
-        ret = -1;
-        goto out;
-    }
-
-    /* Release page */
-    munmap(page, PAGE_SIZE);
-
-    /* Tell Xen to evict page */
-    ret = xc_mem_paging_evict(xch, paging->vm_event.domain_id, gfn);
-    if ( ret < 0 )
-    {
-        /* A gfn in use is indicated by EBUSY */
-        if ( errno == EBUSY )
-        {
-                ret = 1;
-                DPRINTF("Nominated page %lx busy", gfn);
-        } else
-            PERROR("Error evicting page %lx", gfn);
-        goto out;
-    }
-
-    DPRINTF("evict_page > gfn %lx pageslot %d\n", gfn, slot);
-    /* Notify policy of page being paged out */
-    policy_notify_paged_out(gfn);
-
-    /* Update index */
-    paging->slot_to_gfn[slot] = gfn;
-    paging->gfn_to_slot[gfn] = slot;
-
-    /* Record number of evicted pages */
-    paging->num_paged_out++;
-
-    ret = 0;
-
- out:
-    return ret;
-}
-
 static int xenpaging_resume_page(struct xenpaging *paging, vm_event_response_t *rsp, int notify_policy)
 {
     /* Put the page info on the ring */
@@ -679,9 +663,9 @@ static int xenpaging_resume_page(struct xenpaging *paging, vm_event_response_t *
          * This allows page-out of these gfns if the target grows again.
          */
         if (paging->num_paged_out > paging->policy_mru_size)
-            policy_notify_paged_in(rsp->u.mem_paging.gfn);
+            paging->policy->notify_paged_in(paging, rsp->u.mem_paging.gfn);
         else
-            policy_notify_paged_in_nomru(rsp->u.mem_paging.gfn);
+            paging->policy->notify_paged_in_nomru(paging, rsp->u.mem_paging.gfn);
 
        /* Record number of resumed pages */
        paging->num_paged_out--;
@@ -732,42 +716,151 @@ static int xenpaging_populate_page(struct xenpaging *paging, unsigned long gfn,
     return ret;
 }
 
-/* Trigger a page-in for a batch of pages */
-static void resume_pages(struct xenpaging *paging, int num_pages)
+/* A free slot of the pagefile, or -1 */
+static int get_free_slot(struct xenpaging *paging)
+{
+    int slot;
+
+    if ( paging->stack_count > 0 )
+        return paging->free_slot_stack[--paging->stack_count];
+
+    while ( paging->next_slot < paging->max_pages )
+    {
+        slot = paging->next_slot++;
+        if ( !paging->slot_to_gfn[slot] )
+            return slot;
+    }
+
+    return -1;
+}
+
+static void put_free_slot(struct xenpaging *paging, int slot)
+{
+    paging->slot_to_gfn[slot] = 0;
+    paging->free_slot_stack[paging->stack_count++] = slot;
+}
+
+/* Load paged out gfns straight from the pagefile, without a request
+ * from Xen, and notify the policy as prefetched.
+ * Returns < 0 on fatal error
+ * Returns the number of pages loaded otherwise
+ */
+static int load_pages(struct xenpaging *paging, const unsigned long *gfns,
+                      int num_pages)
 {
     xc_interface *xch = paging->xc_handle;
+    xen_mem_paging_batch_entry_t entries[XENPAGING_BATCH_SIZE];
+    int i, slot, num = 0;
+
+    if ( !num_pages )
+        return 0;
+
+    memset(entries, 0, sizeof(entries));
+    for ( i = 0; i < num_pages; i++ )
+    {
+        slot = paging->gfn_to_slot[gfns[i]];
+        entries[i].gfn = gfns[i];
+        entries[i].buffer = (unsigned long)paging->batch_buffer + i * PAGE_SIZE;
+
+        if ( read_page(paging->fd, (void *)(unsigned long)entries[i].buffer,
+                       slot) )
+        {
+            PERROR("Error reading page");
+            return -1;
+        }
+    }
+
+    /* A gfn the guest dropped meanwhile will come with a request */
+    if ( xc_mem_paging_load_batch(xch, paging->vm_event.domain_id,
+                                  entries, num_pages) )
+    {
+        PERROR("Error loading %d pages", num_pages);
+        return 0;
+    }
+
+    for ( i = 0; i < num_pages; i++ )
+    {
+        if ( entries[i].rc )
+        {
+            if ( entries[i].rc == -ENOMEM )
+                paging->use_poll_timeout = 1;
+            continue;
+        }
+
+        DPRINTF("load_page < gfn %lx pageslot %d\n", gfns[i],
+                paging->gfn_to_slot[gfns[i]]);
+        clear_bit(gfns[i], paging->bitmap);
+        put_free_slot(paging, paging->gfn_to_slot[gfns[i]]);
+        paging->policy->notify_prefetched(paging, gfns[i]);
+        paging->num_paged_out--;
+        num++;
+    }
+
+    return num;
+}
+
+/* Load the paged out gfns following a requested one */
+static int readahead_pages(struct xenpaging *paging, unsigned long gfn)
+{
+    unsigned long gfns[XENPAGING_BATCH_SIZE];
+    int i, num = 0;
+
+    for ( i = 1; i <= paging->readahead; i++ )
+    {
+        if ( gfn + i >= paging->max_pages )
+            break;
+        if ( test_bit(gfn + i, paging->bitmap) )
+            gfns[num++] = gfn + i;
+    }
+
+    return load_pages(paging, gfns, num) < 0 ? -1 : 0;
+}
+
+/* Load a batch of pages
+ * Returns < 0 on fatal error
+ */
+static int resume_pages(struct xenpaging *paging, int num_pages)
+{
+    unsigned long gfns[XENPAGING_BATCH_SIZE];
     int i, num = 0;
 
     for ( i = 0; i < paging->max_pages && num < num_pages; i++ )
     {
         if ( test_bit(i, paging->bitmap) )
         {
-            paging->pagein_queue[num] = i;
+            gfns[num] = i;
             num++;
-            if ( num == XENPAGING_PAGEIN_QUEUE_SIZE )
+            if ( num == XENPAGING_BATCH_SIZE )
                 break;
         }
     }
     /* num may be less than num_pages, caller has to try again */
-    if ( num )
-        page_in_trigger();
+    return load_pages(paging, gfns, num) < 0 ? -1 : 0;
 }
 
-/* Evict one gfn and write it to the given slot
+/* Evict a batch of up to XENPAGING_BATCH_SIZE victims and write them to
+ * free slots in the paging file.  *exhausted is set once the policy has
+ * no more victims.
  * Returns < 0 on fatal error
- * Returns 0 on successful evict
- * Returns > 0 if no gfn can be evicted
+ * Returns the number of pages evicted otherwise
  */
-static int evict_victim(struct xenpaging *paging, int slot)
+static int evict_batch(struct xenpaging *paging, int num_pages,
+                       bool *exhausted)
 {
     xc_interface *xch = paging->xc_handle;
-    unsigned long gfn;
+    domid_t domid = paging->vm_event.domain_id;
+    xen_mem_paging_batch_entry_t entries[XENPAGING_BATCH_SIZE];
+    xen_pfn_t gfns[XENPAGING_BATCH_SIZE];
+    int slots[XENPAGING_BATCH_SIZE], errs[XENPAGING_BATCH_SIZE];
     static int num_paged_out;
-    int ret;
+    unsigned long gfn;
+    void *pages;
+    int i, nr = 0, num = 0;
 
-    do
+    memset(entries, 0, sizeof(entries));
+    while ( nr < num_pages )
     {
-        gfn = policy_choose_victim(paging);
+        gfn = paging->policy->choose_victim(paging);
         if ( gfn == INVALID_MFN )
         {
             /* If the number did not change after last flush command then
@@ -781,70 +874,133 @@ static int evict_victim(struct xenpaging *paging, int slot)
                 xenpaging_mem_paging_flush_ioemu_cache(paging);
                 num_paged_out = paging->num_paged_out;
             }
-            ret = ENOSPC;
-            goto out;
+            *exhausted = true;
+            break;
         }
 
         if ( interrupted )
         {
-            ret = EINTR;
-            goto out;
+            *exhausted = true;
+            break;
         }
 
-        ret = xenpaging_evict_page(paging, gfn, slot);
-        if ( ret < 0 )
-            goto out;
+        entries[nr++].gfn = gfn;
     }
-    while ( ret );
 
-    if ( test_and_set_bit(gfn, paging->bitmap) )
-        ERROR("Page %lx has been evicted before", gfn);
+    if ( !nr )
+        return 0;
 
-    ret = 0;
+    /* Nominate pages; unpageable gfns are indicated by EBUSY */
+    if ( xc_mem_paging_nominate_batch(xch, domid, entries, nr) )
+    {
+        PERROR("Error nominating %d pages", nr);
+        return -1;
+    }
 
- out:
-    return ret;
-}
+    for ( i = num = 0; i < nr; i++ )
+    {
+        if ( entries[i].rc == -EBUSY )
+            continue;
+        if ( entries[i].rc )
+        {
+            errno = -entries[i].rc;
+            PERROR("Error nominating page %"PRIx64, entries[i].gfn);
+            return -1;
+        }
+        gfns[num++] = entries[i].gfn;
+    }
+    nr = num;
+    if ( !nr )
+        return 0;
 
-/* Evict a batch of pages and write them to a free slot in the paging file
- * Returns < 0 on fatal error
- * Returns 0 if no gfn can be evicted
- * Returns > 0 on successful evict
- */
-static int evict_pages(struct xenpaging *paging, int num_pages)
-{
-    xc_interface *xch = paging->xc_handle;
-    int rc, slot, num = 0;
+    /* Map pages */
+    pages = xc_map_foreign_bulk(xch, domid, PROT_READ, gfns, errs, nr);
+    if ( pages == NULL )
+    {
+        PERROR("Error mapping %d pages", nr);
+        return -1;
+    }
 
-    /* Reuse known free slots */
-    while ( paging->stack_count > 0 && num < num_pages )
+    /* Copy pages */
+    for ( i = 0; i < nr; i++ )
     {
-        slot = paging->free_slot_stack[--paging->stack_count];
-        rc = evict_victim(paging, slot);
-        if ( rc )
+        slots[i] = get_free_slot(paging);
+        if ( errs[i] || slots[i] < 0 ||
+             write_page(paging->fd, pages + i * PAGE_SIZE, slots[i]) < 0 )
         {
-            num = rc < 0 ? -1 : num;
-            return num;
+            PERROR("Error copying page %"PRI_xen_pfn, gfns[i]);
+            munmap(pages, nr * PAGE_SIZE);
+            return -1;
         }
-        num++;
+        paging->slot_to_gfn[slots[i]] = gfns[i];
     }
 
-    /* Scan all slots slots for remainders */
-    for ( slot = 0; slot < paging->max_pages && num < num_pages; slot++ )
+    /* Release pages */
+    munmap(pages, nr * PAGE_SIZE);
+
+    /* Tell Xen to evict pages; a gfn in use is indicated by EBUSY */
+    memset(entries, 0, sizeof(entries));
+    for ( i = 0; i < nr; i++ )
+        entries[i].gfn = gfns[i];
+    if ( xc_mem_paging_evict_batch(xch, domid, entries, nr) )
     {
-        /* Slot is allocated */
-        if ( paging->slot_to_gfn[slot] )
-            continue;
+        PERROR("Error evicting %d pages", nr);
+        return -1;
+    }
 
-        rc = evict_victim(paging, slot);
-        if ( rc )
+    for ( i = num = 0; i < nr; i++ )
+    {
+        if ( entries[i].rc )
         {
-            num = rc < 0 ? -1 : num;
-            break;
+            put_free_slot(paging, slots[i]);
+            if ( entries[i].rc == -EBUSY )
+            {
+                DPRINTF("Nominated page %"PRI_xen_pfn" busy", gfns[i]);
+                continue;
+            }
+            errno = -entries[i].rc;
+            PERROR("Error evicting page %"PRI_xen_pfn, gfns[i]);
+            return -1;
         }
 
+        DPRINTF("evict_page > gfn %"PRI_xen_pfn" pageslot %d\n",
+                gfns[i], slots[i]);
+        /* Notify policy of page being paged out */
+        paging->policy->notify_paged_out(paging, gfns[i]);
+
+        /* Update index */
+        paging->gfn_to_slot[gfns[i]] = slots[i];
+
+        if ( test_and_set_bit(gfns[i], paging->bitmap) )
+            ERROR("Page %"PRI_xen_pfn" has been evicted before", gfns[i]);
+
+        /* Record number of evicted pages */
+        paging->num_paged_out++;
         num++;
     }
+
+    return num;
+}
+
+/* Evict pages and write them to free slots in the paging file
+ * Returns < 0 on fatal error
+ * Returns 0 if no gfn can be evicted
+ * Returns > 0 on successful evict
+ */
+static int evict_pages(struct xenpaging *paging, int num_pages)
+{
+    bool exhausted = false;
+    int rc, num = 0;
+
+    while ( num < num_pages && !exhausted )
+    {
+        rc = evict_batch(paging, min(num_pages - num, XENPAGING_BATCH_SIZE),
+                         &exhausted);
+        if ( rc < 0 )
+            return -1;
+        num += rc;
+    }
+
     return num;
 }
 
@@ -881,9 +1037,6 @@ int main(int argc, char *argv[])
     sigaction(SIGINT,  &act, NULL);
     sigaction(SIGALRM, &act, NULL);
 
-    /* listen for page-in events to stop pager */
-    create_page_in_thread(paging);
-
     /* Swap pages in and out */
     while ( 1 )
     {
@@ -932,7 +1085,7 @@ int main(int argc, char *argv[])
                     DPRINTF("drop_page ^ gfn %"PRIx64" pageslot %d\n",
                             req.u.mem_paging.gfn, slot);
                     /* Notify policy of page being dropped */
-                    policy_notify_dropped(req.u.mem_paging.gfn);
+                    paging->policy->notify_dropped(paging, req.u.mem_paging.gfn);
                 }
                 else
                 {
@@ -960,6 +1113,11 @@ int main(int argc, char *argv[])
 
                 /* Record this free slot */
                 paging->free_slot_stack[paging->stack_count++] = slot;
+
+                /* Load the neighbours the guest is likely to touch next */
+                if ( !(req.u.mem_paging.flags & MEM_PAGING_DROP_PAGE) &&
+                     readahead_pages(paging, req.u.mem_paging.gfn) < 0 )
+                    goto out;
             }
             else
             {
@@ -996,7 +1154,9 @@ int main(int argc, char *argv[])
                 break;
             
             /* One more round if there are still pages to process. */
-            resume_pages(paging, paging->num_paged_out);
+            rc = 1;
+            if ( resume_pages(paging, paging->num_paged_out) < 0 )
+                goto out;
 
             /* Resume main loop */
             continue;
@@ -1009,6 +1169,9 @@ int main(int argc, char *argv[])
         /* Indicate possible error */
         rc = 1;
 
+        if ( paging->policy->tick )
+            paging->policy->tick(paging);
+
         /* Check if the target has been reached already */
         tot_pages = xenpaging_get_tot_pages(paging);
         if ( tot_pages < 0 )
@@ -1017,8 +1180,9 @@ int main(int argc, char *argv[])
         /* Resume all pages if paging is disabled or no target was set */
         if ( paging->target_tot_pages == 0 )
         {
-            if ( paging->num_paged_out )
-                resume_pages(paging, paging->num_paged_out);
+            if ( paging->num_paged_out &&
+                 resume_pages(paging, paging->num_paged_out) < 0 )
+                goto out;
         }
         /* Evict more pages if target not reached */
         else if ( tot_pages > paging->target_tot_pages )
@@ -1047,7 +1211,8 @@ int main(int argc, char *argv[])
                 DPRINTF("Need to resume %d pages to reach %d target_tot_pages\n", num, paging->target_tot_pages);
                 prev_num = num;
             }
-            resume_pages(paging, num);
+            if ( resume_pages(paging, num) < 0 )
+                goto out;
         }
         /* Now target was reached, enable poll() timeout */
         else
@@ -31,7 +31,13 @@
 #include <xen/event_channel.h>
 #include <xen/vm_event.h>
 
-#define XENPAGING_PAGEIN_QUEUE_SIZE 64
+/* Pages evicted or loaded per hypercall */
+#define XENPAGING_BATCH_SIZE 64
+
+/* Paged out neighbours of a requested gfn loaded along with it */
+#define XENPAGING_DEFAULT_READAHEAD 8
+
+struct xenpaging_policy;
 
 struct vm_event {
     domid_t domain_id;
@@ -52,6 +58,8 @@ struct xenpaging {
     int *gfn_to_slot;
 
     void *paging_buffer;
+    /* XENPAGING_BATCH_SIZE pages for loading batches */
+    void *batch_buffer;
 
     struct vm_event vm_event;
     int fd;
@@ -60,16 +68,16 @@ struct xenpaging {
     int num_paged_out;
     int target_tot_pages;
     int policy_mru_size;
+    const struct xenpaging_policy *policy;
+    int readahead;
     int use_poll_timeout;
     int debug;
     int stack_count;
     int *free_slot_stack;
-    unsigned long pagein_queue[XENPAGING_PAGEIN_QUEUE_SIZE];
+    /* Slots from here on were never used */
+    int next_slot;
 };
 
-extern void create_page_in_thread(struct xenpaging *paging);
-extern void page_in_trigger(void);
-
 #endif // __XEN_PAGING_H__
 
 
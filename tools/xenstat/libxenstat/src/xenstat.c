@@ -20,6 +20,7 @@
  * Use is subject to license terms.
  */
 
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -60,7 +61,10 @@ static void xenstat_free_xen_version(xenstat_node * node);
 static void xenstat_free_vbds(xenstat_node * node);
 static void xenstat_uninit_vcpus(xenstat_handle * handle);
 static void xenstat_uninit_xen_version(xenstat_handle * handle);
-static char *xenstat_get_domain_name(xenstat_handle * handle, unsigned int domain_id);
+static char *xenstat_get_domain_name(xenstat_handle * handle,
+				     const xc_domaininfo_t *info);
+static void xenstat_check_name_watches(xenstat_handle * handle);
+static void xenstat_prune_names(xenstat_handle * handle);
 static void xenstat_prune_domain(xenstat_node *node, unsigned int entry);
 
 static xenstat_collector collectors[] = {
@@ -126,6 +130,9 @@ void xenstat_uninit(xenstat_handle * handle)
 			collectors[i].uninit(handle);
 		xc_interface_close(handle->xc_handle);
 		xs_daemon_close(handle->xshandle);
+		for (i = 0; i < handle->num_names; i++)
+			free(handle->names[i].name);
+		free(handle->names);
 		free(handle->priv);
 		free(handle);
 	}
@@ -166,7 +173,7 @@ xenstat_node *xenstat_get_node(xenstat_handle * handle, unsigned int flags)
 	xc_domaininfo_t domaininfo[DOMAIN_CHUNK_SIZE];
 	int new_domains;
 	unsigned int i;
-	int rc;
+	int rc, have_tmem;
 
 	/* Create the node */
 	node = (xenstat_node *) calloc(1, sizeof(xenstat_node));
@@ -193,6 +200,8 @@ xenstat_node *xenstat_get_node(xenstat_handle * handle, unsigned int flags)
 	rc = xc_tmem_control(handle->xc_handle, -1,
                          XEN_SYSCTL_TMEM_OP_QUERY_FREEABLE_MB, -1, 0, 0, NULL);
 	node->freeable_mb = (rc < 0) ? 0 : rc;
+	/* Without tmem, don't ask for the statistics of every domain. */
+	have_tmem = rc >= 0;
 	/* malloc(0) is not portable, so allocate a single domain.  This will
 	 * be resized below. */
 	node->domains = malloc(sizeof(xenstat_domain));
@@ -201,6 +210,9 @@ xenstat_node *xenstat_get_node(xenstat_handle * handle, unsigned int flags)
 		return NULL;
 	}
 
+	handle->generation++;
+	xenstat_check_name_watches(handle);
+
 	node->num_domains = 0;
 	do {
 		xenstat_domain *domain, *tmp;
@@ -228,8 +240,8 @@ xenstat_node *xenstat_get_node(xenstat_handle * handle, unsigned int flags)
 		for (i = 0; i < new_domains; i++) {
 			/* Fill in domain using domaininfo[i] */
 			domain->id = domaininfo[i].domain;
-			domain->name = xenstat_get_domain_name(handle, 
-							       domain->id);
+			domain->name = xenstat_get_domain_name(handle,
+							       &domaininfo[i]);
 			if (domain->name == NULL) {
 				if (errno == ENOMEM) {
 					/* fatal error */
@@ -260,13 +272,15 @@ xenstat_node *xenstat_get_node(xenstat_handle * handle, unsigned int flags)
 			domain->networks = NULL;
 			domain->num_vbds = 0;
 			domain->vbds = NULL;
-			domain_get_tmem_stats(handle,domain);
+			if (have_tmem)
+				domain_get_tmem_stats(handle,domain);
 
 			domain++;
 			node->num_domains++;
 		}
 	} while (new_domains == DOMAIN_CHUNK_SIZE);
 
+	xenstat_prune_names(handle);
 
 	/* Run all the extra data collectors requested */
 	node->flags = 0;
@@ -308,13 +322,18 @@ void xenstat_free_node(xenstat_node * node)
 
 xenstat_domain *xenstat_node_domain(xenstat_node * node, unsigned int domid)
 {
-	unsigned int i;
+	unsigned int lo = 0, hi = node->num_domains;
 
-	/* FIXME: binary search */
-	/* Find the appropriate domain entry in the node struct. */
-	for (i = 0; i < node->num_domains; i++) {
-		if (node->domains[i].id == domid)
-			return &(node->domains[i]);
+	/* The domains are listed, and stay, in domid order. */
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+
+		if (node->domains[mid].id == domid)
+			return &(node->domains[mid]);
+		if (node->domains[mid].id < domid)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
 	return NULL;
 }
@@ -480,8 +499,9 @@ xenstat_vbd *xenstat_domain_vbd(xenstat_domain * domain,
 /*
  * VCPU functions
  */
-/* Collect information about VCPUs */
-static int xenstat_collect_vcpus(xenstat_node * node)
+/* Collect information about VCPUs one hypercall per VCPU, for when Xen
+ * can't report them in bulk */
+static int xenstat_collect_vcpus_each(xenstat_node * node)
 {
 	unsigned int i, vcpu, inc_index;
 
@@ -489,13 +509,12 @@ static int xenstat_collect_vcpus(xenstat_node * node)
 	for (i = 0; i < node->num_domains; i+=inc_index) {
 		inc_index = 1; /* default is to increment to next domain */
 
-		node->domains[i].vcpus = malloc(node->domains[i].num_vcpus
-						* sizeof(xenstat_vcpu));
+		node->domains[i].vcpus = calloc(node->domains[i].num_vcpus,
+						sizeof(xenstat_vcpu));
 		if (node->domains[i].vcpus == NULL)
 			return 0;
 	
 		for (vcpu = 0; vcpu < node->domains[i].num_vcpus; vcpu++) {
-			/* FIXME: need to be using a more efficient mechanism*/
 			xc_vcpuinfo_t info;
 
 			if (xc_vcpu_getinfo(node->handle->xc_handle,
@@ -507,6 +526,7 @@ static int xenstat_collect_vcpus(xenstat_node * node)
 				else {
 					/* domain is in transition - remove
 					   from list */
+					free(node->domains[i].vcpus);
 					xenstat_prune_domain(node, i);
 
 					/* remember not to increment index! */
@@ -517,12 +537,109 @@ static int xenstat_collect_vcpus(xenstat_node * node)
 			else {
 				node->domains[i].vcpus[vcpu].online = info.online;
 				node->domains[i].vcpus[vcpu].ns = info.cpu_time;
+				node->domains[i].vcpus[vcpu].runstate_ns[RUNSTATE_running] =
+					info.cpu_time;
 			}
 		}
 	}
 	return 1;
 }
 
+/* Collect information about VCPUs, the runstates of many domains' VCPUs
+ * at a time.  Returns -1 if Xen can't report them that way. */
+static int xenstat_collect_vcpus_bulk(xenstat_node * node)
+{
+#define VCPU_CHUNK_SIZE 1024
+	xc_vcpu_runstate_t *entries;
+	unsigned int i, j, nr, size = VCPU_CHUNK_SIZE;
+	uint32_t first = 0, next;
+	char *seen;
+	int ret = 1;
+
+	entries = malloc(size * sizeof(*entries));
+	seen = calloc(node->num_domains + 1, 1);
+	if (entries == NULL || seen == NULL) {
+		free(entries);
+		free(seen);
+		return 0;
+	}
+
+	for (i = 0; i < node->num_domains; i++) {
+		node->domains[i].vcpus = calloc(node->domains[i].num_vcpus,
+						sizeof(xenstat_vcpu));
+		if (node->domains[i].vcpus == NULL) {
+			ret = 0;
+			goto out;
+		}
+	}
+
+	do {
+		nr = size;
+		if (xc_vcpu_runstate_list(node->handle->xc_handle, first,
+					  entries, &nr, &next) != 0) {
+			xc_vcpu_runstate_t *tmp;
+
+			if (errno != ENOBUFS || nr <= size) {
+				ret = errno == ENOMEM ? 0 : -1;
+				goto out;
+			}
+			/* A domain with more VCPUs than fit */
+			tmp = realloc(entries, nr * sizeof(*entries));
+			if (tmp == NULL) {
+				ret = 0;
+				goto out;
+			}
+			entries = tmp;
+			size = nr;
+			continue;
+		}
+
+		for (i = 0; i < nr; i++) {
+			const xc_vcpu_runstate_t *e = &entries[i];
+			xenstat_domain *domain = xenstat_node_domain(node, e->domid);
+			xenstat_vcpu *vcpu;
+
+			/* Created since the domains were listed */
+			if (domain == NULL || e->vcpu >= domain->num_vcpus)
+				continue;
+
+			seen[domain - node->domains] = 1;
+			vcpu = &domain->vcpus[e->vcpu];
+			vcpu->online = e->state != RUNSTATE_offline;
+			vcpu->ns = e->time[RUNSTATE_running];
+			for (j = 0; j < 4; j++)
+				vcpu->runstate_ns[j] = e->time[j];
+		}
+		first = next;
+	} while (first < DOMID_FIRST_RESERVED);
+
+	/* Domains without VCPUs are in transition - remove from list */
+	for (i = node->num_domains; i-- > 0; ) {
+		if (!seen[i]) {
+			free(node->domains[i].vcpus);
+			xenstat_prune_domain(node, i);
+		}
+	}
+
+out:
+	if (ret < 0) {
+		for (i = 0; i < node->num_domains; i++) {
+			free(node->domains[i].vcpus);
+			node->domains[i].vcpus = NULL;
+		}
+	}
+	free(entries);
+	free(seen);
+	return ret;
+}
+
+static int xenstat_collect_vcpus(xenstat_node * node)
+{
+	int ret = xenstat_collect_vcpus_bulk(node);
+
+	return ret < 0 ? xenstat_collect_vcpus_each(node) : ret;
+}
+
 /* Free VCPU information */
 static void xenstat_free_vcpus(xenstat_node * node)
 {
@@ -548,6 +665,27 @@ unsigned long long xenstat_vcpu_ns(xenstat_vcpu * vcpu)
 	return vcpu->ns;
 }
 
+/* Get VCPU runstate times */
+unsigned long long xenstat_vcpu_running_ns(xenstat_vcpu * vcpu)
+{
+	return vcpu->runstate_ns[RUNSTATE_running];
+}
+
+unsigned long long xenstat_vcpu_runnable_ns(xenstat_vcpu * vcpu)
+{
+	return vcpu->runstate_ns[RUNSTATE_runnable];
+}
+
+unsigned long long xenstat_vcpu_blocked_ns(xenstat_vcpu * vcpu)
+{
+	return vcpu->runstate_ns[RUNSTATE_blocked];
+}
+
+unsigned long long xenstat_vcpu_offline_ns(xenstat_vcpu * vcpu)
+{
+	return vcpu->runstate_ns[RUNSTATE_offline];
+}
+
 /*
  * Network functions
  */
@@ -763,13 +901,156 @@ unsigned long long xenstat_tmem_succ_pers_gets(xenstat_tmem *tmem)
 }
 
 
-static char *xenstat_get_domain_name(xenstat_handle *handle, unsigned int domain_id)
+/*
+ * Domain names are cached in the handle, so that a refresh doesn't need a
+ * xenstore read per domain.  A watch on each name invalidates it when the
+ * domain is renamed, the domain handle tells a reused domid apart, and the
+ * entries of domains which are gone get dropped after each refresh.
+ */
+#define NAME_WATCH_TOKEN "xenstat-name"
+
+static void xenstat_name_path(char *path, size_t len, unsigned int domid)
 {
+	snprintf(path, len, "/local/domain/%u/name", domid);
+}
+
+/* Find the entry of domid, or where it would be inserted into *pos. */
+static struct xenstat_name *xenstat_find_name(xenstat_handle *handle,
+					      unsigned int domid,
+					      unsigned int *pos)
+{
+	unsigned int lo = 0, hi = handle->num_names;
+
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+
+		if (handle->names[mid].domid == domid)
+			return &handle->names[mid];
+		if (handle->names[mid].domid < domid)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (pos)
+		*pos = lo;
+	return NULL;
+}
+
+static struct xenstat_name *xenstat_insert_name(xenstat_handle *handle,
+						unsigned int pos)
+{
+	struct xenstat_name *n;
+
+	if (handle->num_names == handle->max_names) {
+		unsigned int max = handle->max_names ? handle->max_names * 2
+						     : 64;
+
+		n = realloc(handle->names, max * sizeof(*n));
+		if (n == NULL)
+			return NULL;
+		handle->names = n;
+		handle->max_names = max;
+	}
+
+	/* Domains are listed in domid order, so this mostly appends. */
+	n = &handle->names[pos];
+	memmove(n + 1, n, (handle->num_names - pos) * sizeof(*n));
+	memset(n, 0, sizeof(*n));
+	handle->num_names++;
+
+	return n;
+}
+
+static char *xenstat_get_domain_name(xenstat_handle *handle,
+				     const xc_domaininfo_t *info)
+{
+	struct xenstat_name *n;
+	unsigned int pos;
+	char path[80], *name;
+
+	xenstat_name_path(path, sizeof(path), info->domain);
+
+	n = xenstat_find_name(handle, info->domain, &pos);
+	if (n == NULL) {
+		n = xenstat_insert_name(handle, pos);
+		if (n == NULL) {
+			errno = ENOMEM;
+			return NULL;
+		}
+		n->domid = info->domain;
+		memcpy(n->uuid, info->handle, sizeof(n->uuid));
+		/* Watch before reading, so no rename in between gets lost. */
+		n->watched = xs_watch(handle->xshandle, path,
+				      NAME_WATCH_TOKEN);
+	} else if (memcmp(n->uuid, info->handle, sizeof(n->uuid))) {
+		free(n->name);
+		n->name = NULL;
+		memcpy(n->uuid, info->handle, sizeof(n->uuid));
+	}
+	n->seen = handle->generation;
+
+	if (n->name == NULL) {
+		n->name = xs_read(handle->xshandle, XBT_NULL, path, NULL);
+		if (n->name == NULL)
+			return NULL;
+	}
+
+	name = strdup(n->name);
+	if (!n->watched) {
+		free(n->name);
+		n->name = NULL;
+	}
+	if (name == NULL)
+		errno = ENOMEM;
+	return name;
+}
+
+/* Invalidate the names of the domains which got renamed. */
+static void xenstat_check_name_watches(xenstat_handle *handle)
+{
+	struct xenstat_name *n;
+	unsigned int domid;
+	char **vec;
+
+	while ((vec = xs_check_watch(handle->xshandle)) != NULL) {
+		if (!strcmp(vec[XS_WATCH_TOKEN], NAME_WATCH_TOKEN) &&
+		    sscanf(vec[XS_WATCH_PATH], "/local/domain/%u/name",
+			   &domid) == 1 &&
+		    (n = xenstat_find_name(handle, domid, NULL)) != NULL) {
+			/* Each watch fires once when it is set up. */
+			if (!n->armed)
+				n->armed = 1;
+			else {
+				free(n->name);
+				n->name = NULL;
+			}
+		}
+		free(vec);
+	}
+}
+
+/* Drop the names of the domains not listed by the last refresh. */
+static void xenstat_prune_names(xenstat_handle *handle)
+{
+	unsigned int i, j = 0;
 	char path[80];
 
-	snprintf(path, sizeof(path),"/local/domain/%i/name", domain_id);
+	for (i = 0; i < handle->num_names; i++) {
+		struct xenstat_name *n = &handle->names[i];
 
-	return xs_read(handle->xshandle, XBT_NULL, path, NULL);
+		if (n->seen != handle->generation) {
+			if (n->watched) {
+				xenstat_name_path(path, sizeof(path),
+						  n->domid);
+				xs_unwatch(handle->xshandle, path,
+					   NAME_WATCH_TOKEN);
+			}
+			free(n->name);
+			continue;
+		}
+		handle->names[j++] = *n;
+	}
+	handle->num_names = j;
 }
 
 /* Remove specified entry from list of domains */
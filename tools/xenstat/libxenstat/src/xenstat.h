@@ -144,6 +144,14 @@ xenstat_tmem *xenstat_domain_tmem(xenstat_domain * domain);
 unsigned int xenstat_vcpu_online(xenstat_vcpu * vcpu);
 unsigned long long xenstat_vcpu_ns(xenstat_vcpu * vcpu);
 
+/* Get the time the VCPU spent running, runnable (waiting for a CPU),
+ * blocked and offline.  Only the running time is known when Xen can't
+ * report runstates, the others are 0 then. */
+unsigned long long xenstat_vcpu_running_ns(xenstat_vcpu * vcpu);
+unsigned long long xenstat_vcpu_runnable_ns(xenstat_vcpu * vcpu);
+unsigned long long xenstat_vcpu_blocked_ns(xenstat_vcpu * vcpu);
+unsigned long long xenstat_vcpu_offline_ns(xenstat_vcpu * vcpu);
+
 
 /*
  * Network functions - extract information from a xenstat_network
@@ -28,7 +28,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <regex.h>
+#include <net/if.h>
 
 #include "xenstat_priv.h"
 
@@ -87,8 +87,8 @@ void getBridge(char *excludeName, char *result, size_t resultLen)
 	closedir(d);
 }
 
-/* parseNetLine provides regular expression based parsing for lines from /proc/net/dev, all the */
-/* information are parsed but not all are used in our case, ie. for xenstat */
+/* parseNetDevLine parses a line from /proc/net/dev.  All the fields are parsed, but not all */
+/* are used in our case, ie. for xenstat.  iface must have room for IFNAMSIZ characters. */
 int parseNetDevLine(char *line, char *iface, unsigned long long *rxBytes, unsigned long long *rxPackets,
 		unsigned long long *rxErrs, unsigned long long *rxDrops, unsigned long long *rxFifo,
 		unsigned long long *rxFrames, unsigned long long *rxComp, unsigned long long *rxMcast,
@@ -96,142 +96,46 @@ int parseNetDevLine(char *line, char *iface, unsigned long long *rxBytes, unsign
 		unsigned long long *txDrops, unsigned long long *txFifo, unsigned long long *txColls,
 		unsigned long long *txCarrier, unsigned long long *txComp)
 {
-	/* Temporary/helper variables */
-	int ret;
-	char *tmp;
-	int i = 0, x = 0, col = 0;
-	regex_t r;
-	regmatch_t matches[19];
-	int num = 19;
-
-	/* Regular exception to parse all the information from /proc/net/dev line */
-	char *regex = "([^:]*):([^ ]*)[ ]*([^ ]*)[ ]*([^ ]*)[ ]*([^ ]*)[ ]*([^ ]*)[ ]*([^ ]*)"
-			"[ ]*([^ ]*)[ ]*([^ ]*)[ ]*([^ ]*)[ ]*([^ ]*)[ ]*([^ ]*)[ ]*([^ ]*)[ ]*"
-			"([^ ]*)[ ]*([^ ]*)[ ]*([^ ]*)[ ]*([^ ]*)[ ]*([^ ]*)";
-
-	/* Initialize all variables called has passed as non-NULL to zeros */
+	/* Where each of the 16 counters following the interface name goes */
+	unsigned long long *fields[] = {
+		rxBytes, rxPackets, rxErrs, rxDrops, rxFifo, rxFrames, rxComp, rxMcast,
+		txBytes, txPackets, txErrs, txDrops, txFifo, txColls, txCarrier, txComp,
+	};
+	char *p, *colon, *end;
+	unsigned int i;
+	size_t len;
+
+	/* This runs for each interface on each refresh, so no regular expressions here */
+	for (i = 0; i < sizeof(fields) / sizeof(fields[0]); i++)
+		if (fields[i] != NULL)
+			*fields[i] = 0;
 	if (iface != NULL)
-		memset(iface, 0, sizeof(*iface));
-	if (rxBytes != NULL)
-		*rxBytes = 0;
-	if (rxPackets != NULL)
-		*rxPackets = 0;
-	if (rxErrs != NULL)
-		*rxErrs = 0;
-	if (rxDrops != NULL)
-		*rxDrops = 0;
-	if (rxFifo != NULL)
-		*rxFifo = 0;
-	if (rxFrames != NULL)
-		*rxFrames = 0;
-	if (rxPackets != NULL)
-		*rxPackets = 0;
-	if (rxComp != NULL)
-		*rxComp = 0;
-	if (txBytes != NULL)
-		*txBytes = 0;
-	if (txPackets != NULL)
-		*txPackets = 0;
-	if (txErrs != NULL)
-		*txErrs = 0;
-	if (txDrops != NULL)
-		*txDrops = 0;
-	if (txFifo != NULL)
-		*txFifo = 0;
-	if (txColls != NULL)
-		*txColls = 0;
-	if (txCarrier != NULL)
-		*txCarrier = 0;
-	if (txComp != NULL)
-		*txComp = 0;
-
-	if ((ret = regcomp(&r, regex, REG_EXTENDED))) {
-		regfree(&r);
-		return ret;
-	}
+		*iface = '\0';
 
-	tmp = (char *)malloc( sizeof(char) );
-	if (regexec (&r, line, num, matches, REG_EXTENDED) == 0){
-		for (i = 1; i < num; i++) {
-			/* The expression matches are empty sometimes so we need to check it first */
-			if (matches[i].rm_eo - matches[i].rm_so > 0) {
-				/* Col variable contains current id of non-empty match */
-				col++;
-				tmp = (char *)realloc(tmp, (matches[i].rm_eo - 
-							matches[i].rm_so + 1) * sizeof(char));
-				for (x = matches[i].rm_so; x < matches[i].rm_eo; x++)
-					tmp[x - matches[i].rm_so] = line[x];
-
-				/* We populate all the fields from /proc/net/dev line */
-				if (i > 1) {
-					unsigned long long ullTmp = strtoull(tmp, NULL, 10);
-
-					switch (col) {
-						case 2: if (rxBytes != NULL)
-								*rxBytes = ullTmp;
-							break;
-						case 3: if (rxPackets != NULL)
-								*rxPackets = ullTmp;
-							break;
-						case 4: if (rxErrs != NULL)
-								*rxErrs = ullTmp;
-							break;
-						case 5: if (rxDrops != NULL)
-								*rxDrops = ullTmp;
-							break;
-						case 6: if (rxFifo != NULL)
-								*rxFifo = ullTmp;
-							break;
-						case 7: if (rxFrames != NULL)
-								*rxFrames = ullTmp;
-							break;
-						case 8: if (rxComp != NULL)
-								*rxComp = ullTmp;
-							break;
-						case 9: if (rxMcast != NULL)
-								*rxMcast = ullTmp;
-							break;
-						case 10: if (txBytes != NULL)
-								*txBytes = ullTmp;
-							break;
-						case 11: if (txPackets != NULL)
-								*txPackets = ullTmp;
-							break;
-						case 12: if (txErrs != NULL)
-								*txErrs = ullTmp;
-							break;
-						case 13: if (txDrops != NULL)
-								*txDrops = ullTmp;
-							break;
-						case 14: if (txFifo != NULL)
-								*txFifo = ullTmp;
-							break;
-						case 15: if (txColls != NULL)
-								*txColls = ullTmp;
-							break;
-						case 16: if (txCarrier != NULL)
-								*txCarrier = ullTmp;
-							break;
-						case 17: if (txComp != NULL)
-								*txComp = ullTmp;
-							break;
-					}
-				}
-				else
-				/* There were errors when parsing this directly in RE. strpbrk() helps */
-				if (iface != NULL) {
-					char *tmp2 = strpbrk(tmp, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789");
-					if (tmp2 != NULL)
-						strcpy(iface, tmp2);
-				}
+	colon = strchr(line, ':');
+	if (colon == NULL)
+		return 0;
 
-				memset(tmp, 0, matches[i].rm_eo - matches[i].rm_so);
-			}
-		}
+	if (iface != NULL) {
+		for (p = line; *p == ' '; p++)
+			;
+		len = colon - p;
+		if (len > IFNAMSIZ - 1)
+			len = IFNAMSIZ - 1;
+		memcpy(iface, p, len);
+		iface[len] = '\0';
 	}
 
-	free(tmp);
-	regfree(&r);
+	p = colon + 1;
+	for (i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+		unsigned long long val = strtoull(p, &end, 10);
+
+		if (end == p)
+			break;
+		if (fields[i] != NULL)
+			*fields[i] = val;
+		p = end;
+	}
 
 	return 0;
 }
@@ -298,7 +202,6 @@ int xenstat_collect_networks(xenstat_node * node)
 	}
 
 	/* Fill in networks */
-	/* FIXME: optimize this */
 	fseek(priv->procnetdev, sizeof(PROCNETDEV_HEADER) - 1,
 	      SEEK_SET);
 
@@ -346,7 +249,6 @@ int xenstat_collect_networks(xenstat_node * node)
 			net.rerrs = rxErrs;
 			net.rdrop = rxDrops;
 
-		/* FIXME: this does a search for the domid */
 		  domain = xenstat_node_domain(node, domid);
 		  if (domain == NULL) {
 			fprintf(stderr,
@@ -385,14 +287,15 @@ void xenstat_uninit_networks(xenstat_handle * handle)
 		fclose(priv->procnetdev);
 }
 
-static int read_attributes_vbd(const char *vbd_directory, const char *what, char *ret, int cap)
+static int read_attributes_vbd(DIR *sysfsvbd, const char *vbd_directory, const char *what,
+			       char *ret, int cap)
 {
-	static char file_name[80];
+	char file_name[80];
 	int fd, num_read;
 
-	snprintf(file_name, sizeof(file_name), "%s/%s/%s",
-		SYSFS_VBD_PATH, vbd_directory, what);
-	fd = open(file_name, O_RDONLY, 0);
+	/* Relative to the open directory, saving a full path walk per attribute */
+	snprintf(file_name, sizeof(file_name), "%s/%s", vbd_directory, what);
+	fd = openat(dirfd(sysfsvbd), file_name, O_RDONLY, 0);
 	if (fd==-1) return -1;
 	num_read = read(fd, ret, cap - 1);
 	close(fd);
@@ -453,31 +356,31 @@ int xenstat_collect_vbds(xenstat_node * node)
 			continue;
 		}
 
-		if((read_attributes_vbd(dp->d_name, "statistics/oo_req", buf, 256)<=0)
+		if((read_attributes_vbd(priv->sysfsvbd, dp->d_name, "statistics/oo_req", buf, 256)<=0)
 		   || ((ret = sscanf(buf, "%llu", &vbd.oo_reqs)) != 1))
 		{
 			continue;
 		}
 
-		if((read_attributes_vbd(dp->d_name, "statistics/rd_req", buf, 256)<=0)
+		if((read_attributes_vbd(priv->sysfsvbd, dp->d_name, "statistics/rd_req", buf, 256)<=0)
 		   || ((ret = sscanf(buf, "%llu", &vbd.rd_reqs)) != 1))
 		{
 			continue;
 		}
 
-		if((read_attributes_vbd(dp->d_name, "statistics/wr_req", buf, 256)<=0)
+		if((read_attributes_vbd(priv->sysfsvbd, dp->d_name, "statistics/wr_req", buf, 256)<=0)
 		   || ((ret = sscanf(buf, "%llu", &vbd.wr_reqs)) != 1))
 		{
 			continue;
 		}
 
-		if((read_attributes_vbd(dp->d_name, "statistics/rd_sect", buf, 256)<=0)
+		if((read_attributes_vbd(priv->sysfsvbd, dp->d_name, "statistics/rd_sect", buf, 256)<=0)
 		   || ((ret = sscanf(buf, "%llu", &vbd.rd_sects)) != 1))
 		{
 			continue;
 		}
 
-		if((read_attributes_vbd(dp->d_name, "statistics/wr_sect", buf, 256)<=0)
+		if((read_attributes_vbd(priv->sysfsvbd, dp->d_name, "statistics/wr_sect", buf, 256)<=0)
 		   || ((ret = sscanf(buf, "%llu", &vbd.wr_sects)) != 1))
 		{
 			continue;
@@ -28,16 +28,30 @@
 #include "xenstat.h"
 
 #include "xenctrl.h"
+#include <xen/vcpu.h>
 
 #define SHORT_ASC_LEN 5                 /* length of 65535 */
 #define VERSION_SIZE (2 * SHORT_ASC_LEN + 1 + sizeof(xen_extraversion_t) + 1)
 
+/* A domain name, cached across refreshes. */
+struct xenstat_name {
+	unsigned int domid;
+	xen_domain_handle_t uuid;	/* Tells a reused domid apart */
+	char *name;			/* NULL if it needs (re)reading */
+	unsigned int seen;		/* Refresh the domain was last listed in */
+	unsigned int watched:1;		/* A watch invalidates the name */
+	unsigned int armed:1;		/* The watch's initial event came */
+};
+
 struct xenstat_handle {
 	xc_interface *xc_handle;
 	struct xs_handle *xshandle; /* xenstore handle */
 	int page_size;
 	void *priv;
 	char xen_version[VERSION_SIZE]; /* xen version running on this node */
+	struct xenstat_name *names;	/* Sorted by domid */
+	unsigned int num_names, max_names;
+	unsigned int generation;	/* Number of refreshes */
 };
 
 struct xenstat_node {
@@ -79,6 +93,7 @@ struct xenstat_domain {
 struct xenstat_vcpu {
 	unsigned int online;
 	unsigned long long ns;
+	unsigned long long runstate_ns[4];	/* Indexed by RUNSTATE_* */
 };
 
 struct xenstat_network {
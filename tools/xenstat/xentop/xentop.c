@@ -138,6 +138,7 @@ static void do_vcpu(xenstat_domain *);
 static void do_network(xenstat_domain *);
 static void do_vbd(xenstat_domain *);
 static void top(void);
+static void stream(void);
 
 /* Field types */
 typedef enum field_id {
@@ -212,6 +213,7 @@ int show_vbds = 0;
 int show_tmem = 0;
 int repeat_header = 0;
 int show_full_name = 0;
+enum { OUTPUT_TOP, OUTPUT_CSV, OUTPUT_JSON } output = OUTPUT_TOP;
 #define PROMPT_VAL_LEN 80
 char *prompt = NULL;
 char prompt_val[PROMPT_VAL_LEN];
@@ -241,6 +243,8 @@ static void usage(const char *program)
 	       "-b, --batch	     output in batch mode, no user input accepted\n"
 	       "-i, --iterations     number of iterations before exiting\n"
 	       "-f, --full-name      output the full domain name (not truncated)\n"
+	       "-o, --output=FORMAT  stream vcpu data as csv or json, one record\n"
+	       "                     per vcpu or refresh respectively\n"
 	       "\n" XENTOP_BUGSTO,
 	       program);
 	return;
@@ -536,6 +540,65 @@ static void print_cpu_pct(xenstat_domain *domain)
 	print("%6.1f", get_cpu_pct(domain));
 }
 
+/* Where the vcpus of a domain spent the last interval, in percent: running,
+ * stolen (runnable, or offline while up, e.g. paused) and waiting (blocked) */
+typedef struct vcpu_pcts {
+	double run, steal, wait;
+} vcpu_pcts;
+
+static double runstate_pct(unsigned long long cur, unsigned long long old,
+			   double us_elapsed)
+{
+	/* See get_cpu_pct() for the conversion */
+	return cur > old ? ((cur - old) / 10.0) / us_elapsed : 0.0;
+}
+
+/* Computes the percentages for vcpu i of a domain, or for all its vcpus
+ * summed up if i is -1.  All are 0 without a previous sample. */
+static void get_vcpu_pcts(xenstat_domain *domain, int i, vcpu_pcts *pcts)
+{
+	xenstat_domain *old_domain = NULL;
+	unsigned int v, num_vcpus;
+	double us_elapsed;
+
+	pcts->run = pcts->steal = pcts->wait = 0.0;
+
+	if (prev_node != NULL)
+		old_domain = xenstat_node_domain(prev_node,
+						 xenstat_domain_id(domain));
+	if (old_domain == NULL)
+		return;
+
+	us_elapsed = ((curtime.tv_sec-oldtime.tv_sec)*1000000.0
+		      +(curtime.tv_usec - oldtime.tv_usec));
+	num_vcpus = xenstat_domain_num_vcpus(domain);
+	if (num_vcpus > xenstat_domain_num_vcpus(old_domain))
+		num_vcpus = xenstat_domain_num_vcpus(old_domain);
+
+	for (v = 0; v < num_vcpus; v++) {
+		xenstat_vcpu *vcpu = xenstat_domain_vcpu(domain, v);
+		xenstat_vcpu *old = xenstat_domain_vcpu(old_domain, v);
+
+		if (i >= 0 && v != i)
+			continue;
+
+		pcts->run += runstate_pct(xenstat_vcpu_running_ns(vcpu),
+					  xenstat_vcpu_running_ns(old),
+					  us_elapsed);
+		pcts->steal += runstate_pct(xenstat_vcpu_runnable_ns(vcpu),
+					    xenstat_vcpu_runnable_ns(old),
+					    us_elapsed);
+		if (xenstat_vcpu_online(vcpu))
+			pcts->steal +=
+				runstate_pct(xenstat_vcpu_offline_ns(vcpu),
+					     xenstat_vcpu_offline_ns(old),
+					     us_elapsed);
+		pcts->wait += runstate_pct(xenstat_vcpu_blocked_ns(vcpu),
+					   xenstat_vcpu_blocked_ns(old),
+					   us_elapsed);
+	}
+}
+
 /* Compares current memory of two domains, returning -1,0,1 for <,=,> */
 static int compare_mem(xenstat_domain *domain1, xenstat_domain *domain2)
 {
@@ -994,9 +1057,10 @@ void do_domain(xenstat_domain *domain)
 /* Output all vcpu information */
 void do_vcpu(xenstat_domain *domain)
 {
-	int i = 0;
+	int i = 0, shown;
 	unsigned num_vcpus = 0;
 	xenstat_vcpu *vcpu;
+	vcpu_pcts pcts;
 
 	print("VCPUs(sec): ");
 
@@ -1014,6 +1078,27 @@ void do_vcpu(xenstat_domain *domain)
 		}
 	}
 	print("\n");
+
+	/* Without a previous sample there is nothing to compare against */
+	if (prev_node == NULL)
+		return;
+
+	get_vcpu_pcts(domain, -1, &pcts);
+	print("VCPUs(%%run/steal/wait): %5.1f/%5.1f/%5.1f\n        ",
+	      pcts.run, pcts.steal, pcts.wait);
+	for (i=0, shown=0; i< num_vcpus; i++) {
+		vcpu = xenstat_domain_vcpu(domain,i);
+
+		if (xenstat_vcpu_online(vcpu) > 0) {
+			if (shown != 0 && (shown%4)==0)
+				print("\n        ");
+			get_vcpu_pcts(domain, i, &pcts);
+			print(" %2u: %5.1f/%5.1f/%5.1f", i,
+			      pcts.run, pcts.steal, pcts.wait);
+			shown++;
+		}
+	}
+	print("\n");
 }
 
 /* Output all network information */
@@ -1165,6 +1250,120 @@ static void top(void)
 	free(domains);
 }
 
+/* Prints a string as a CSV field, quoting it if need be */
+static void csv_string(const char *s)
+{
+	if (strpbrk(s, ",\"\n") == NULL) {
+		fputs(s, stdout);
+		return;
+	}
+	putchar('"');
+	for (; *s; s++) {
+		if (*s == '"')
+			putchar('"');
+		putchar(*s);
+	}
+	putchar('"');
+}
+
+/* Prints a string as a JSON string */
+static void json_string(const char *s)
+{
+	putchar('"');
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			printf("\\%c", *s);
+		else if ((unsigned char)*s < 0x20)
+			printf("\\u%04x", *s);
+		else
+			putchar(*s);
+	}
+	putchar('"');
+}
+
+/* Streams the vcpu runstates of all domains, one CSV row per vcpu or one
+ * JSON object per refresh, for consumption by other tools */
+static void stream(void)
+{
+	static int header_done;
+	unsigned int i, j, num_domains, num_vcpus;
+	xenstat_domain *domain;
+	xenstat_vcpu *vcpu;
+	vcpu_pcts pcts;
+	double now = curtime.tv_sec + curtime.tv_usec / 1000000.0;
+
+	if (prev_node != NULL)
+		xenstat_free_node(prev_node);
+	prev_node = cur_node;
+	cur_node = xenstat_get_node(xhandle, XENSTAT_VCPU);
+	if (cur_node == NULL)
+		fail("Failed to retrieve statistics from libxenstat\n");
+
+	num_domains = xenstat_node_num_domains(cur_node);
+
+	if (output == OUTPUT_CSV && !header_done) {
+		printf("time,domid,name,vcpu,online,running_ns,runnable_ns,"
+		       "blocked_ns,offline_ns,run_pct,steal_pct,wait_pct\n");
+		header_done = 1;
+	}
+	if (output == OUTPUT_JSON)
+		printf("{\"time\":%.6f,\"domains\":[", now);
+
+	for (i = 0; i < num_domains; i++) {
+		domain = xenstat_node_domain_by_index(cur_node, i);
+		num_vcpus = xenstat_domain_num_vcpus(domain);
+
+		if (output == OUTPUT_JSON) {
+			get_vcpu_pcts(domain, -1, &pcts);
+			printf("%s{\"domid\":%u,\"name\":", i ? "," : "",
+			       xenstat_domain_id(domain));
+			json_string(xenstat_domain_name(domain));
+			printf(",\"cpu_ns\":%llu,\"cpu_pct\":%.1f,"
+			       "\"steal_pct\":%.1f,\"wait_pct\":%.1f,"
+			       "\"vcpus\":[", xenstat_domain_cpu_ns(domain),
+			       pcts.run, pcts.steal, pcts.wait);
+		}
+
+		for (j = 0; j < num_vcpus; j++) {
+			vcpu = xenstat_domain_vcpu(domain, j);
+			get_vcpu_pcts(domain, j, &pcts);
+
+			if (output == OUTPUT_CSV) {
+				printf("%.6f,%u,", now,
+				       xenstat_domain_id(domain));
+				csv_string(xenstat_domain_name(domain));
+				printf(",%u,%u,%llu,%llu,%llu,%llu,"
+				       "%.1f,%.1f,%.1f\n", j,
+				       xenstat_vcpu_online(vcpu),
+				       xenstat_vcpu_running_ns(vcpu),
+				       xenstat_vcpu_runnable_ns(vcpu),
+				       xenstat_vcpu_blocked_ns(vcpu),
+				       xenstat_vcpu_offline_ns(vcpu),
+				       pcts.run, pcts.steal, pcts.wait);
+				continue;
+			}
+
+			printf("%s{\"vcpu\":%u,\"online\":%s,"
+			       "\"running_ns\":%llu,\"runnable_ns\":%llu,"
+			       "\"blocked_ns\":%llu,\"offline_ns\":%llu,"
+			       "\"run_pct\":%.1f,\"steal_pct\":%.1f,"
+			       "\"wait_pct\":%.1f}", j ? "," : "", j,
+			       xenstat_vcpu_online(vcpu) ? "true" : "false",
+			       xenstat_vcpu_running_ns(vcpu),
+			       xenstat_vcpu_runnable_ns(vcpu),
+			       xenstat_vcpu_blocked_ns(vcpu),
+			       xenstat_vcpu_offline_ns(vcpu),
+			       pcts.run, pcts.steal, pcts.wait);
+		}
+
+		if (output == OUTPUT_JSON)
+			printf("]}");
+	}
+
+	if (output == OUTPUT_JSON)
+		printf("]}\n");
+}
+
 static int signal_exit;
 
 static void signal_exit_handler(int sig)
@@ -1188,9 +1387,10 @@ int main(int argc, char **argv)
 		{ "batch",	   no_argument,	      NULL, 'b' },
 		{ "iterations",	   required_argument, NULL, 'i' },
 		{ "full-name",     no_argument,       NULL, 'f' },
+		{ "output",        required_argument, NULL, 'o' },
 		{ 0, 0, 0, 0 },
 	};
-	const char *sopts = "hVnxrvd:bi:f";
+	const char *sopts = "hVnxrvd:bi:fo:";
 
 	if (atexit(cleanup) != 0)
 		fail("Failed to install cleanup handler.\n");
@@ -1235,6 +1435,18 @@ int main(int argc, char **argv)
 		case 't':
 			show_tmem = 1;
 			break;
+		case 'o':
+			if (strcmp(optarg, "csv") == 0)
+				output = OUTPUT_CSV;
+			else if (strcmp(optarg, "json") == 0)
+				output = OUTPUT_JSON;
+			else {
+				usage(argv[0]);
+				exit(1);
+			}
+			/* Streams are for other programs to read */
+			batch = 1;
+			break;
 		}
 	}
 
@@ -1280,7 +1492,10 @@ int main(int argc, char **argv)
 
 		do {
 			gettimeofday(&curtime, NULL);
-			top();
+			if (output == OUTPUT_TOP)
+				top();
+			else
+				stream();
 			fflush(stdout);
 			oldtime = curtime;
 			if ((!loop) && !(--iterations))
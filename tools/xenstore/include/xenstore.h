@@ -169,6 +169,32 @@ bool xs_set_permissions(struct xs_handle *h, xs_transaction_t t,
 			const char *path, struct xs_permissions *perms,
 			unsigned int num_perms);
 
+/* Batches of WRITE, MKDIR, RM and SET_PERMS requests.
+ *
+ * The xs_batch_* operations queue a request in the batch instead of
+ * sending it, and fail with E2BIG once the batch would no longer fit
+ * in a single message.  xs_batch_commit() then sends all of them in one
+ * go: they are applied atomically, and the batch is emptied.  Daemons
+ * which don't know about batches fail it with ENOSYS.
+ */
+struct xs_batch;
+
+struct xs_batch *xs_batch_new(void);
+void xs_batch_free(struct xs_batch *b);
+bool xs_batch_empty(struct xs_batch *b);
+
+bool xs_batch_write(struct xs_batch *b, const char *path,
+		    const void *data, unsigned int len);
+bool xs_batch_mkdir(struct xs_batch *b, const char *path);
+bool xs_batch_rm(struct xs_batch *b, const char *path);
+bool xs_batch_set_permissions(struct xs_batch *b, const char *path,
+			      struct xs_permissions *perms,
+			      unsigned int num_perms);
+
+/* Returns false on failure, in which case the batch is left intact. */
+bool xs_batch_commit(struct xs_handle *h, xs_transaction_t t,
+		     struct xs_batch *b);
+
 /* Watch a node for changes (poll on fd to detect, or call read_watch()).
  * When the node (or any child) changes, fd will become readable.
  * Token is returned when watch is read, to allow matching.
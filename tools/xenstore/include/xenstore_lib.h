@@ -59,6 +59,7 @@ const char *xs_daemon_rootdir(void);
 const char *xs_daemon_rundir(void);
 const char *xs_daemon_socket(void);
 const char *xs_daemon_socket_ro(void);
+const char *xs_daemon_snapshot(void);
 const char *xs_domain_dev(void);
 const char *xs_daemon_tdb(void);
 
@@ -23,6 +23,7 @@
 
 #include "utils.h"
 #include "talloc.h"
+#include "xenstore_lib.h"
 #include "xenstored_core.h"
 #include "xenstored_control.h"
 
@@ -115,6 +116,28 @@ static int do_control_memreport(void *ctx, struct connection *conn,
 	return 0;
 }
 
+static int do_control_snapshot(void *ctx, struct connection *conn,
+			       char **vec, int num)
+{
+	const char *file;
+	int ret;
+
+	if (num > 1)
+		return EINVAL;
+
+	file = num ? vec[0] : talloc_asprintf(ctx, "%s.snapshot",
+					      xs_daemon_tdb());
+	if (!file)
+		return ENOMEM;
+
+	ret = db_snapshot(file);
+	if (ret)
+		return ret;
+
+	send_ack(conn, XS_CONTROL);
+	return 0;
+}
+
 static int do_control_print(void *ctx, struct connection *conn,
 			    char **vec, int num)
 {
@@ -135,6 +158,7 @@ static struct cmd_s cmds[] = {
 	{ "logfile", do_control_logfile, "<file>" },
 	{ "memreport", do_control_memreport, "[<file>]" },
 	{ "print", do_control_print, "<string>" },
+	{ "snapshot", do_control_snapshot, "[<file>]" },
 	{ "help", do_control_help, "" },
 };
 
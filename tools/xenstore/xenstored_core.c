@@ -43,6 +43,11 @@
 
 #include <xenevtchn.h>
 
+#if defined(__linux__) && !defined(__MINIOS__)
+#define USE_EPOLL 1
+#include <sys/epoll.h>
+#endif
+
 #include "utils.h"
 #include "list.h"
 #include "talloc.h"
@@ -52,6 +57,8 @@
 #include "xenstored_transaction.h"
 #include "xenstored_domain.h"
 #include "xenstored_control.h"
+#include "xenstored_memdb.h"
+#include "xenstored_snapshot.h"
 #include "tdb.h"
 
 #ifndef NO_SOCKETS
@@ -65,19 +72,37 @@
 #endif
 
 extern xenevtchn_handle *xce_handle; /* in xenstored_domain.c */
-static int xce_pollfd_idx = -1;
+
+/*
+ * File descriptors stay registered with the main loop for as long as
+ * they are open, and connections which may have work to do are queued on
+ * ready_conns: an iteration of the main loop only looks at those rather
+ * than at every connection.
+ */
+static struct pollsrc sock_src = { .fd = -1 };
+static struct pollsrc ro_sock_src = { .fd = -1 };
+static struct pollsrc reopen_log_src = { .fd = -1 };
+static struct pollsrc xce_src = { .fd = -1 };
+static LIST_HEAD(ready_conns);
+/* Domains with requests held back by the write rate limit. */
+static LIST_HEAD(delayed_conns);
+
+#ifdef USE_EPOLL
+static int epoll_fd = -1;
+#else
 static struct pollfd *fds;
+static struct pollsrc **fd_srcs;
 static unsigned int current_array_size;
 static unsigned int nr_fds;
 
 #define ROUNDUP(_x, _w) (((unsigned long)(_x)+(1UL<<(_w))-1) & ~((1UL<<(_w))-1))
+#endif
 
 static bool verbose = false;
 LIST_HEAD(connections);
 int tracefd = -1;
 static bool recovery = true;
 static int reopen_log_pipe[2];
-static int reopen_log_pipe0_pollfd_idx = -1;
 char *tracefile = NULL;
 TDB_CONTEXT *tdb_ctx = NULL;
 
@@ -101,6 +126,7 @@ int quota_nb_entry_per_domain = 1000;
 int quota_nb_watch_per_domain = 128;
 int quota_max_entry_size = 2048; /* 2K */
 int quota_max_transaction = 10;
+int quota_max_output = 1024 * 1024; /* 1M */
 
 void trace(const char *fmt, ...)
 {
@@ -247,12 +273,21 @@ static bool write_messages(struct connection *conn)
 
 	trace_io(conn, out, 1);
 
+	conn->out_bytes -= sizeof(out->hdr) + out->hdr.msg.len;
+	if (conn->out_dropping && conn->out_bytes < quota_max_output) {
+		syslog(LOG_INFO, "connection %u caught up with its output",
+		       conn->id);
+		conn->out_dropping = false;
+	}
+
 	list_del(&out->list);
 	talloc_free(out);
 
 	return true;
 }
 
+static void pollsrc_del(struct pollsrc *src);
+
 static int destroy_conn(void *_conn)
 {
 	struct connection *conn = _conn;
@@ -267,8 +302,10 @@ static int destroy_conn(void *_conn)
 		       && poll(&pfd, 1, 0) == 1)
 			if (!write_messages(conn))
 				break;
+		pollsrc_del(&conn->pollsrc);
 		close(conn->fd);
 	}
+	list_del(&conn->ready);
         if (conn->target)
                 talloc_unlink(conn, conn->target);
 	list_del(&conn->list);
@@ -276,12 +313,67 @@ static int destroy_conn(void *_conn)
 	return 0;
 }
 
-/* This function returns index inside the array if succeed, -1 if fail */
-static int set_fd(int fd, short events)
+#ifdef USE_EPOLL
+static void pollsrc_init(void)
+{
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd < 0)
+		barf_perror("Could not create epoll instance");
+}
+
+/* The EPOLL* flags have the same values as the POLL* ones. */
+static bool pollsrc_ctl(struct pollsrc *src, int op)
+{
+	struct epoll_event ev;
+
+	ev.events = src->events;
+	ev.data.ptr = src;
+
+	return epoll_ctl(epoll_fd, op, src->fd, &ev) == 0;
+}
+
+static bool pollsrc_add(struct pollsrc *src, int fd, short events)
+{
+	src->fd = fd;
+	src->events = events;
+	src->revents = 0;
+	if (!pollsrc_ctl(src, EPOLL_CTL_ADD)) {
+		syslog(LOG_ERR, "epoll_ctl failed, ignoring fd %d\n", fd);
+		src->fd = -1;
+		return false;
+	}
+
+	return true;
+}
+
+static void pollsrc_set_events(struct pollsrc *src, short events)
+{
+	if (src->fd == -1 || src->events == events)
+		return;
+
+	src->events = events;
+	if (!pollsrc_ctl(src, EPOLL_CTL_MOD))
+		syslog(LOG_ERR, "epoll_ctl failed for fd %d\n", src->fd);
+}
+
+static void pollsrc_del(struct pollsrc *src)
+{
+	if (src->fd == -1)
+		return;
+
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, src->fd, NULL);
+	src->fd = -1;
+}
+#else
+static void pollsrc_init(void)
+{
+}
+
+static bool pollsrc_add(struct pollsrc *src, int fd, short events)
 {
-	int ret;
 	if (current_array_size < nr_fds + 1) {
 		struct pollfd *new_fds = NULL;
+		struct pollsrc **new_srcs = NULL;
 		unsigned long newsize;
 
 		/* Round up to 2^8 boundary, in practice this just
@@ -293,67 +385,305 @@ static int set_fd(int fd, short events)
 		if (!new_fds)
 			goto fail;
 		fds = new_fds;
+		new_srcs = realloc(fd_srcs, sizeof(struct pollsrc *)*newsize);
+		if (!new_srcs)
+			goto fail;
+		fd_srcs = new_srcs;
 
 		memset(&fds[0] + current_array_size, 0,
 		       sizeof(struct pollfd ) * (newsize-current_array_size));
 		current_array_size = newsize;
 	}
 
+	src->fd = fd;
+	src->events = events;
+	src->revents = 0;
+	src->idx = nr_fds;
 	fds[nr_fds].fd = fd;
 	fds[nr_fds].events = events;
-	ret = nr_fds;
+	fd_srcs[nr_fds] = src;
 	nr_fds++;
 
-	return ret;
+	return true;
 fail:
 	syslog(LOG_ERR, "realloc failed, ignoring fd %d\n", fd);
-	return -1;
+	return false;
 }
 
-static void initialize_fds(int sock, int *p_sock_pollfd_idx,
-			   int ro_sock, int *p_ro_sock_pollfd_idx,
-			   int *ptimeout)
+static void pollsrc_set_events(struct pollsrc *src, short events)
 {
-	struct connection *conn;
-	struct wrl_timestampt now;
+	if (src->fd == -1)
+		return;
 
-	if (fds)
-		memset(fds, 0, sizeof(struct pollfd) * current_array_size);
-	nr_fds = 0;
+	src->events = events;
+	fds[src->idx].events = events;
+}
 
-	*ptimeout = -1;
+static void pollsrc_del(struct pollsrc *src)
+{
+	if (src->fd == -1)
+		return;
 
-	if (sock != -1)
-		*p_sock_pollfd_idx = set_fd(sock, POLLIN|POLLPRI);
-	if (ro_sock != -1)
-		*p_ro_sock_pollfd_idx = set_fd(ro_sock, POLLIN|POLLPRI);
-	if (reopen_log_pipe[0] != -1)
-		reopen_log_pipe0_pollfd_idx =
-			set_fd(reopen_log_pipe[0], POLLIN|POLLPRI);
+	/* Fill the hole with the last entry. */
+	nr_fds--;
+	if (src->idx != nr_fds) {
+		fds[src->idx] = fds[nr_fds];
+		fd_srcs[src->idx] = fd_srcs[nr_fds];
+		fd_srcs[src->idx]->idx = src->idx;
+	}
+	src->fd = -1;
+}
+#endif
+
+void conn_set_ready(struct connection *conn)
+{
+	/* This also takes it off delayed_conns, if it's there. */
+	list_move_tail(&conn->ready, &ready_conns);
+}
+
+static void pollsrc_ready(struct pollsrc *src, short revents)
+{
+	src->revents = revents;
+	if (src->conn)
+		conn_set_ready(src->conn);
+}
+
+/* Wait for events, recording them in the sources which had any. */
+static void pollsrc_wait(int timeout)
+{
+#ifdef USE_EPOLL
+	struct epoll_event events[64];
+	int i, n;
+
+	n = epoll_wait(epoll_fd, events, ARRAY_SIZE(events), timeout);
+	if (n < 0) {
+		if (errno == EINTR)
+			return;
+		barf_perror("Poll failed");
+	}
 
-	if (xce_handle != NULL)
-		xce_pollfd_idx = set_fd(xenevtchn_fd(xce_handle),
-					POLLIN|POLLPRI);
+	for (i = 0; i < n; i++)
+		pollsrc_ready(events[i].data.ptr, events[i].events);
+#else
+	unsigned int i;
+
+	if (poll(fds, nr_fds, timeout) < 0) {
+		if (errno == EINTR)
+			return;
+		barf_perror("Poll failed");
+	}
+
+	for (i = 0; i < nr_fds; i++)
+		if (fds[i].revents)
+			pollsrc_ready(fd_srcs[i], fds[i].revents);
+#endif
+}
+
+static bool conn_can_read(struct connection *conn)
+{
+	/* Let a client which doesn't read its replies wait for them. */
+	if (conn->out_bytes >= quota_max_output)
+		return false;
+
+	if (conn->domain)
+		return domain_can_read(conn);
+
+	return conn->pollsrc.revents & POLLIN;
+}
+
+static bool conn_can_write(struct connection *conn)
+{
+	if (list_empty(&conn->out_list))
+		return false;
+
+	if (conn->domain)
+		return domain_can_write(conn);
+
+	return conn->pollsrc.revents & POLLOUT;
+}
+
+/* There is new output on conn: make sure the main loop sends it. */
+static void conn_output_queued(struct connection *conn)
+{
+	if (conn->domain)
+		conn_set_ready(conn);
+	else
+		pollsrc_set_events(&conn->pollsrc,
+				   conn->pollsrc.events | POLLOUT);
+}
+
+/* Decide what conn has to wait for, after the main loop looked at it. */
+static void conn_rearm(struct connection *conn)
+{
+	short events = 0;
+
+	if (conn->domain) {
+		/* One event for all the ring updates of this round. */
+		domain_notify(conn);
+
+		/* Domains only send an event when their ring changes. */
+		if (conn_can_read(conn) || conn_can_write(conn))
+			conn_set_ready(conn);
+		else if (domain_wrl_blocked(conn))
+			list_move_tail(&conn->ready, &delayed_conns);
+		return;
+	}
+
+	conn->pollsrc.revents = 0;
+	if (conn->out_bytes < quota_max_output)
+		events |= POLLIN|POLLPRI;
+	if (!list_empty(&conn->out_list))
+		events |= POLLOUT;
+	pollsrc_set_events(&conn->pollsrc, events);
+}
+
+static int get_timeout(void)
+{
+	struct connection *conn, *next;
+	struct wrl_timestampt now;
+	int timeout = -1;
 
 	wrl_gettime_now(&now);
 	wrl_log_periodic(now);
 
-	list_for_each_entry(conn, &connections, list) {
-		if (conn->domain) {
-			wrl_check_timeout(conn->domain, now, ptimeout);
-			if (domain_can_read(conn) ||
-			    (domain_can_write(conn) &&
-			     !list_empty(&conn->out_list)))
-				*ptimeout = 0;
-		} else {
-			short events = POLLIN|POLLPRI;
-			if (!list_empty(&conn->out_list))
-				events |= POLLOUT;
-			conn->pollfd_idx = set_fd(conn->fd, events);
+	list_for_each_entry_safe(conn, next, &delayed_conns, ready) {
+		wrl_check_timeout(conn->domain, now, &timeout);
+		if (conn_can_read(conn) || conn_can_write(conn))
+			conn_set_ready(conn);
+	}
+
+	snapshot_check_timeout(&timeout);
+
+	return list_empty(&ready_conns) ? timeout : 0;
+}
+
+static void handle_input(struct connection *conn);
+static void handle_output(struct connection *conn);
+
+/*
+ * Requests a domain may have handled in one round of the main loop when
+ * it has several queued in its ring.  Other connections get their turn
+ * in between.
+ */
+#define DOMAIN_BATCH 16
+
+/* Returns false if conn was freed. */
+static bool handle_conn(struct connection *conn)
+{
+	talloc_increase_ref_count(conn);
+	if (conn_can_read(conn))
+		handle_input(conn);
+	if (talloc_free(conn) == 0)
+		return false;
+
+	talloc_increase_ref_count(conn);
+	if (conn_can_write(conn))
+		handle_output(conn);
+	if (talloc_free(conn) == 0)
+		return false;
+
+	return true;
+}
+
+static void handle_ready_conns(void)
+{
+	struct connection *conn;
+	unsigned int n;
+	LIST_HEAD(todo);
+
+	/* Connections becoming ready meanwhile wait for the next round. */
+	list_splice_init(&ready_conns, &todo);
+
+	while ((conn = list_top(&todo, struct connection, ready))) {
+		list_del_init(&conn->ready);
+
+		if (conn->pollsrc.revents & ~(POLLIN|POLLOUT)) {
+			talloc_free(conn);
+			continue;
+		}
+
+		for (n = 0; ; n++) {
+			if (!handle_conn(conn))
+				break;
+			if (!conn->domain || n + 1 == DOMAIN_BATCH ||
+			    !conn_can_read(conn)) {
+				conn_rearm(conn);
+				break;
+			}
 		}
 	}
 }
 
+/* Use the in-memory data base instead of TDB, see xenstored_memdb.c. */
+bool use_memdb = false;
+
+/*
+ * Fetch the record for key, allocated in ctx.  A shared record may be a
+ * reference to the one in the data base and must not be modified.
+ * If it fails, returns dptr NULL and sets errno (ENOENT if there is no
+ * such record).
+ */
+TDB_DATA db_fetch(const void *ctx, TDB_DATA key, bool shared)
+{
+	TDB_DATA data;
+
+	if (use_memdb)
+		return memdb_fetch(ctx, key, shared);
+
+	data = tdb_fetch(tdb_ctx, key);
+	if (data.dptr)
+		talloc_steal(ctx, data.dptr);
+	else if (tdb_error(tdb_ctx) == TDB_ERR_NOEXIST)
+		errno = ENOENT;
+	else {
+		log("TDB error on read: %s", tdb_errorstr(tdb_ctx));
+		errno = EIO;
+	}
+
+	return data;
+}
+
+/* Nodes of transactions are keyed by "<generation>/<path>". */
+static bool db_key_is_global(TDB_DATA key)
+{
+	return key.dsize && key.dptr[0] == '/';
+}
+
+int db_store(TDB_DATA key, TDB_DATA data)
+{
+	if (db_key_is_global(key))
+		snapshot_invalidate();
+
+	if (use_memdb)
+		return memdb_store(key, data);
+
+	/* TDB should set errno, but doesn't even set ecode AFAICT. */
+	if (tdb_store(tdb_ctx, key, data, TDB_REPLACE)) {
+		errno = EIO;
+		return -1;
+	}
+	return 0;
+}
+
+int db_delete(TDB_DATA key)
+{
+	if (db_key_is_global(key))
+		snapshot_invalidate();
+
+	if (use_memdb)
+		return memdb_delete(key);
+
+	return tdb_delete(tdb_ctx, key);
+}
+
+int db_traverse(tdb_traverse_func fn, void *private)
+{
+	if (use_memdb)
+		return memdb_traverse(fn, private);
+
+	return tdb_traverse(tdb_ctx, fn, private);
+}
+
 /*
  * If it fails, returns NULL and sets errno.
  * Temporary memory allocations will be done with ctx.
@@ -380,23 +710,19 @@ static struct node *read_node(struct connection *conn, const void *ctx,
 	if (transaction_prepend(conn, name, &key))
 		return NULL;
 
-	data = tdb_fetch(tdb_ctx, key);
+	data = db_fetch(node, key, true);
 
 	if (data.dptr == NULL) {
-		if (tdb_error(tdb_ctx) == TDB_ERR_NOEXIST) {
+		if (errno == ENOENT) {
 			node->generation = NO_GENERATION;
 			access_node(conn, node, NODE_ACCESS_READ, NULL);
 			errno = ENOENT;
-		} else {
-			log("TDB error on read: %s", tdb_errorstr(tdb_ctx));
-			errno = EIO;
 		}
 		talloc_free(node);
 		return NULL;
 	}
 
 	node->parent = NULL;
-	talloc_steal(node, data.dptr);
 
 	/* Datalen, childlen, number of permissions */
 	hdr = (void *)data.dptr;
@@ -446,10 +772,8 @@ int write_node_raw(struct connection *conn, TDB_DATA *key, struct node *node)
 	p += node->datalen;
 	memcpy(p, node->children, node->childlen);
 
-	/* TDB should set errno, but doesn't even set ecode AFAICT. */
-	if (tdb_store(tdb_ctx, *key, data, TDB_REPLACE) != 0) {
+	if (db_store(*key, data)) {
 		corrupt(conn, "Write of %s failed", key->dptr);
-		errno = EIO;
 		return errno;
 	}
 	return 0;
@@ -661,6 +985,10 @@ void send_reply(struct connection *conn, enum xsd_sockmsg_type type,
 {
 	struct buffered_data *bdata;
 
+	/* The batch as a whole is acknowledged instead. */
+	if (conn->in_batch && type != XS_WATCH_EVENT)
+		return;
+
 	if ( len > XENSTORE_PAYLOAD_MAX ) {
 		send_error(conn, E2BIG);
 		return;
@@ -673,6 +1001,19 @@ void send_reply(struct connection *conn, enum xsd_sockmsg_type type,
 		bdata->used = 0;
 		conn->in = NULL;
 	} else {
+		/*
+		 * Replies are bounded by the requests we read, but events
+		 * keep coming for a client which doesn't pick them up.
+		 */
+		if (conn->out_bytes >= quota_max_output) {
+			if (!conn->out_dropping)
+				syslog(LOG_WARNING, "connection %u has too "
+				       "much output queued, dropping watch "
+				       "events", conn->id);
+			conn->out_dropping = true;
+			return;
+		}
+
 		/* Message is a child of the connection for auto-cleanup. */
 		bdata = new_buffer(conn);
 
@@ -706,6 +1047,8 @@ void send_reply(struct connection *conn, enum xsd_sockmsg_type type,
 
 	/* Queue for later transmission. */
 	list_add_tail(&bdata->list, &conn->out_list);
+	conn->out_bytes += sizeof(bdata->hdr) + len;
+	conn_output_queued(conn);
 
 	return;
 }
@@ -891,7 +1234,7 @@ static void delete_node_single(struct connection *conn, struct node *node)
 	if (access_node(conn, node, NODE_ACCESS_DELETE, &key))
 		return;
 
-	if (tdb_delete(tdb_ctx, key) != 0) {
+	if (db_delete(key) != 0) {
 		corrupt(conn, "Could not delete '%s'", node->name);
 		return;
 	}
@@ -979,7 +1322,7 @@ static int destroy_node(void *_node)
 	key.dptr = (void *)node->name;
 	key.dsize = strlen(node->name);
 
-	tdb_delete(tdb_ctx, key);
+	db_delete(key);
 	return 0;
 }
 
@@ -1113,6 +1456,13 @@ static int remove_child_entry(struct connection *conn, struct node *node,
 			      size_t offset)
 {
 	size_t childlen = strlen(node->children + offset);
+	char *children;
+
+	/* The children may be shared with the data base, see read_node(). */
+	children = talloc_memdup(node, node->children, node->childlen);
+	if (!children)
+		return ENOMEM;
+	node->children = children;
 	memdel(node->children, offset, childlen + 1, node->childlen);
 	node->childlen -= childlen + 1;
 	return write_node(conn, node);
@@ -1263,6 +1613,8 @@ static int do_set_perms(struct connection *conn, struct buffered_data *in)
 	return 0;
 }
 
+static int do_batch(struct connection *conn, struct buffered_data *in);
+
 static struct {
 	const char *str;
 	int (*func)(struct connection *conn, struct buffered_data *in);
@@ -1290,6 +1642,7 @@ static struct {
 	[XS_SET_TARGET]        = { "SET_TARGET",        do_set_target },
 	[XS_RESET_WATCHES]     = { "RESET_WATCHES",     do_reset_watches },
 	[XS_DIRECTORY_PART]    = { "DIRECTORY_PART",    send_directory_part },
+	[XS_BATCH]             = { "BATCH",             do_batch },
 };
 
 static const char *sockmsg_string(enum xsd_sockmsg_type type)
@@ -1300,6 +1653,85 @@ static const char *sockmsg_string(enum xsd_sockmsg_type type)
 	return "**UNKNOWN**";
 }
 
+static int do_batch_op(struct connection *conn, struct buffered_data *in,
+		       const struct xsd_sockmsg *msg, char *data)
+{
+	struct buffered_data *op;
+	int ret;
+
+	switch (msg->type) {
+	case XS_WRITE:
+	case XS_MKDIR:
+	case XS_RM:
+	case XS_SET_PERMS:
+		break;
+	default:
+		return EINVAL;
+	}
+
+	op = talloc_zero(in, struct buffered_data);
+	if (!op)
+		return ENOMEM;
+	op->hdr.msg = *msg;
+	op->buffer = data;
+	op->used = msg->len;
+
+	ret = wire_funcs[msg->type].func(conn, op);
+	talloc_free(op);
+
+	return ret;
+}
+
+/* <sub-request>*: applies all of them, or none if one fails. */
+static int do_batch(struct connection *conn, struct buffered_data *in)
+{
+	struct transaction *trans = NULL;
+	struct xsd_sockmsg msg;
+	unsigned int off;
+	int ret = 0;
+
+	/*
+	 * Within a transaction the sub-requests simply become part of it,
+	 * otherwise they get one of their own so that no one sees a partial
+	 * batch and watches fire only when all of it has been applied.
+	 */
+	if (!conn->transaction) {
+		trans = transaction_start_implicit(conn, in);
+		if (!trans)
+			return errno;
+		conn->transaction = trans;
+	}
+
+	conn->in_batch = true;
+	for (off = 0; off < in->used && !ret; off += msg.len) {
+		if (in->used - off < sizeof(msg)) {
+			ret = EINVAL;
+			break;
+		}
+		memcpy(&msg, in->buffer + off, sizeof(msg));
+		off += sizeof(msg);
+		if (msg.len > in->used - off) {
+			ret = EINVAL;
+			break;
+		}
+		ret = do_batch_op(conn, in, &msg, in->buffer + off);
+	}
+	conn->in_batch = false;
+
+	if (trans) {
+		conn->transaction = NULL;
+		if (!ret)
+			ret = transaction_commit_implicit(conn, trans);
+		talloc_free(trans);
+	}
+	if (ret)
+		return ret;
+
+	send_ack(conn, XS_BATCH);
+
+	return 0;
+}
+
 /* Process "in" for conn: "in" will vanish after this conversation, so
  * we can talloc off it for temporary variables.  May free "conn".
  */
@@ -1406,8 +1838,13 @@ bad_client:
 
 static void handle_output(struct connection *conn)
 {
-	if (!write_messages(conn))
-		talloc_free(conn);
+	/* A domain takes all the replies there is room for in its ring. */
+	do {
+		if (!write_messages(conn)) {
+			talloc_free(conn);
+			return;
+		}
+	} while (conn->domain && conn_can_write(conn));
 }
 
 struct connection *new_connection(connwritefn_t *write, connreadfn_t *read)
@@ -1419,11 +1856,13 @@ struct connection *new_connection(connwritefn_t *write, connreadfn_t *read)
 		return NULL;
 
 	new->fd = -1;
-	new->pollfd_idx = -1;
+	new->pollsrc.fd = -1;
+	new->pollsrc.conn = new;
 	new->write = write;
 	new->read = read;
 	new->can_write = true;
 	new->transaction_started = 0;
+	INIT_LIST_HEAD(&new->ready);
 	INIT_LIST_HEAD(&new->out_list);
 	INIT_LIST_HEAD(&new->watches);
 	INIT_LIST_HEAD(&new->transaction_list);
@@ -1490,6 +1929,8 @@ static void accept_connection(int sock, bool canwrite)
 	if (conn) {
 		conn->fd = fd;
 		conn->can_write = canwrite;
+		if (!pollsrc_add(&conn->pollsrc, fd, POLLIN|POLLPRI))
+			talloc_free(conn);
 	} else
 		close(fd);
 }
@@ -1547,13 +1988,18 @@ static void setup_structure(void)
 	if (!tdbname)
 		barf_perror("Could not create tdbname");
 
-	if (!(tdb_flags & TDB_INTERNAL))
+	if (!(tdb_flags & TDB_INTERNAL) || use_memdb)
 		unlink(tdbname);
 
-	tdb_ctx = tdb_open_ex(tdbname, 7919, tdb_flags, O_RDWR|O_CREAT|O_EXCL,
-			      0640, &tdb_logger, NULL);
-	if (!tdb_ctx)
-		barf_perror("Could not create tdb file %s", tdbname);
+	if (use_memdb)
+		memdb_init();
+	else {
+		tdb_ctx = tdb_open_ex(tdbname, 7919, tdb_flags,
+				      O_RDWR|O_CREAT|O_EXCL, 0640,
+				      &tdb_logger, NULL);
+		if (!tdb_ctx)
+			barf_perror("Could not create tdb file %s", tdbname);
+	}
 
 	manual_node("/", "tool");
 	manual_node("/tool", "xenstored");
@@ -1562,6 +2008,51 @@ static void setup_structure(void)
 	check_store();
 }
 
+static int snapshot_(TDB_CONTEXT *tdb, TDB_DATA key, TDB_DATA val,
+		     void *private)
+{
+	TDB_CONTEXT *snap = private;
+
+	return tdb_store(snap, key, val, TDB_INSERT) ? -1 : 0;
+}
+
+/*
+ * Write the whole data base to a TDB file, e.g. for xs_tdb_dump.  This
+ * is mostly useful with the in-memory data bases, which otherwise never
+ * reach the disk.
+ */
+int db_snapshot(const char *file)
+{
+	char *name;
+	TDB_CONTEXT *snap;
+	int ret = 0;
+
+	name = talloc_asprintf(NULL, "%s.tmp", file);
+	if (!name)
+		return ENOMEM;
+
+	unlink(name);
+	snap = tdb_open_ex(name, 7919, TDB_NOLOCK, O_RDWR|O_CREAT|O_EXCL,
+			   0640, &tdb_logger, NULL);
+	if (!snap) {
+		ret = errno;
+		goto out;
+	}
+
+	if (db_traverse(snapshot_, snap) < 0 || tdb_error(snap))
+		ret = EIO;
+	tdb_close(snap);
+
+	if (ret)
+		unlink(name);
+	else if (rename(name, file))
+		ret = errno;
+
+ out:
+	talloc_free(name);
+	return ret;
+}
+
 
 static unsigned int hash_from_key_fn(void *k)
 {
@@ -1729,7 +2220,7 @@ static int clean_store_(TDB_CONTEXT *tdb, TDB_DATA key, TDB_DATA val,
 	if (!hashtable_search(reachable, name)) {
 		log("clean_store: '%s' is orphaned!", name);
 		if (recovery) {
-			tdb_delete(tdb, key);
+			db_delete(key);
 		}
 	}
 
@@ -1745,7 +2236,7 @@ static int clean_store_(TDB_CONTEXT *tdb, TDB_DATA key, TDB_DATA val,
  */
 static void clean_store(struct hashtable *reachable)
 {
-	tdb_traverse(tdb_ctx, &clean_store_, reachable);
+	db_traverse(&clean_store_, reachable);
 }
 
 
@@ -1876,9 +2367,14 @@ static void usage(void)
 "  -S, --entry-size <size> limit the size of entry per domain, and\n"
 "  -W, --watch-nb <nb>     limit the number of watches per domain,\n"
 "  -t, --transaction <nb>  limit the number of transaction allowed per domain,\n"
+"  -O, --output-quota <size> limit the output queued per connection, beyond\n"
+"                          which watch events are dropped,\n"
 "  -R, --no-recovery       to request that no recovery should be attempted when\n"
 "                          the store is corrupted (debug only),\n"
 "  -I, --internal-db       store database in memory, not on disk\n"
+"  -M, --memory-db         keep nodes in an in-memory tree instead of a TDB,\n"
+"  -s, --read-snapshot     publish a snapshot of the store which local clients\n"
+"                          read without asking the daemon,\n"
 "  -V, --verbose           to request verbose execution.\n");
 }
 
@@ -1893,11 +2389,14 @@ static struct option options[] = {
 	{ "no-fork", 0, NULL, 'N' },
 	{ "priv-domid", 1, NULL, 'p' },
 	{ "output-pid", 0, NULL, 'P' },
+	{ "output-quota", 1, NULL, 'O' },
 	{ "entry-size", 1, NULL, 'S' },
 	{ "trace-file", 1, NULL, 'T' },
 	{ "transaction", 1, NULL, 't' },
 	{ "no-recovery", 0, NULL, 'R' },
 	{ "internal-db", 0, NULL, 'I' },
+	{ "memory-db", 0, NULL, 'M' },
+	{ "read-snapshot", 0, NULL, 's' },
 	{ "verbose", 0, NULL, 'V' },
 	{ "watch-nb", 1, NULL, 'W' },
 	{ NULL, 0, NULL, 0 } };
@@ -1910,15 +2409,13 @@ int priv_domid = 0;
 int main(int argc, char *argv[])
 {
 	int opt, *sock = NULL, *ro_sock = NULL;
-	int sock_pollfd_idx = -1, ro_sock_pollfd_idx = -1;
 	bool dofork = true;
 	bool outputpid = false;
 	bool no_domain_init = false;
 	const char *pidfile = NULL;
-	int timeout;
 
 
-	while ((opt = getopt_long(argc, argv, "DE:F:HNPS:t:T:RVW:", options,
+	while ((opt = getopt_long(argc, argv, "DE:F:HMNO:PS:st:T:RVW:", options,
 				  NULL)) != -1) {
 		switch (opt) {
 		case 'D':
@@ -1948,12 +2445,21 @@ int main(int argc, char *argv[])
 		case 't':
 			quota_max_transaction = strtol(optarg, NULL, 10);
 			break;
+		case 'O':
+			quota_max_output = strtol(optarg, NULL, 10);
+			break;
 		case 'T':
 			tracefile = optarg;
 			break;
 		case 'I':
 			tdb_flags = TDB_INTERNAL|TDB_NOLOCK;
 			break;
+		case 'M':
+			use_memdb = true;
+			break;
+		case 's':
+			use_read_snapshot = true;
+			break;
 		case 'V':
 			verbose = true;
 			break;
@@ -2002,6 +2508,7 @@ int main(int argc, char *argv[])
 	init_pipe(reopen_log_pipe);
 
 	/* Setup the database */
+	snapshot_init();
 	setup_structure();
 
 	/* Listen to hypervisor. */
@@ -2025,8 +2532,17 @@ int main(int argc, char *argv[])
 		tracefile = talloc_strdup(NULL, tracefile);
 
 	/* Get ready to listen to the tools. */
-	initialize_fds(*sock, &sock_pollfd_idx, *ro_sock, &ro_sock_pollfd_idx,
-		       &timeout);
+	pollsrc_init();
+	if (*sock != -1 && !pollsrc_add(&sock_src, *sock, POLLIN|POLLPRI))
+		barf("Could not listen on socket");
+	if (*ro_sock != -1 &&
+	    !pollsrc_add(&ro_sock_src, *ro_sock, POLLIN|POLLPRI))
+		barf("Could not listen on socket");
+	if (reopen_log_pipe[0] != -1)
+		pollsrc_add(&reopen_log_src, reopen_log_pipe[0], POLLIN|POLLPRI);
+	if (xce_handle != NULL &&
+	    !pollsrc_add(&xce_src, xenevtchn_fd(xce_handle), POLLIN|POLLPRI))
+		barf("Could not listen to event channels");
 
 	/* Tell the kernel we're up and running. */
 	xenbus_notify_running();
@@ -2038,114 +2554,50 @@ int main(int argc, char *argv[])
 
 	/* Main loop. */
 	for (;;) {
-		struct connection *conn, *next;
-
-		if (poll(fds, nr_fds, timeout) < 0) {
-			if (errno == EINTR)
-				continue;
-			barf_perror("Poll failed");
-		}
-
-		if (reopen_log_pipe0_pollfd_idx != -1) {
-			if (fds[reopen_log_pipe0_pollfd_idx].revents
-			    & ~POLLIN) {
-				close(reopen_log_pipe[0]);
-				close(reopen_log_pipe[1]);
-				init_pipe(reopen_log_pipe);
-			} else if (fds[reopen_log_pipe0_pollfd_idx].revents
-				   & POLLIN) {
-				char c;
-				if (read(reopen_log_pipe[0], &c, 1) != 1)
-					barf_perror("read failed");
-				reopen_log();
-			}
-			reopen_log_pipe0_pollfd_idx = -1;
+		pollsrc_wait(get_timeout());
+
+		snapshot_update();
+
+		if (reopen_log_src.revents & ~POLLIN) {
+			pollsrc_del(&reopen_log_src);
+			close(reopen_log_pipe[0]);
+			close(reopen_log_pipe[1]);
+			init_pipe(reopen_log_pipe);
+			pollsrc_add(&reopen_log_src, reopen_log_pipe[0],
+				    POLLIN|POLLPRI);
+		} else if (reopen_log_src.revents & POLLIN) {
+			char c;
+			if (read(reopen_log_pipe[0], &c, 1) != 1)
+				barf_perror("read failed");
+			reopen_log();
 		}
+		reopen_log_src.revents = 0;
 
-		if (sock_pollfd_idx != -1) {
-			if (fds[sock_pollfd_idx].revents & ~POLLIN) {
-				barf_perror("sock poll failed");
-				break;
-			} else if (fds[sock_pollfd_idx].revents & POLLIN) {
-				accept_connection(*sock, true);
-				sock_pollfd_idx = -1;
-			}
-		}
-
-		if (ro_sock_pollfd_idx != -1) {
-			if (fds[ro_sock_pollfd_idx].revents & ~POLLIN) {
-				barf_perror("ro sock poll failed");
-				break;
-			} else if (fds[ro_sock_pollfd_idx].revents & POLLIN) {
-				accept_connection(*ro_sock, false);
-				ro_sock_pollfd_idx = -1;
-			}
+		if (sock_src.revents & ~POLLIN) {
+			barf_perror("sock poll failed");
+			break;
+		} else if (sock_src.revents & POLLIN) {
+			accept_connection(*sock, true);
+			sock_src.revents = 0;
 		}
 
-		if (xce_pollfd_idx != -1) {
-			if (fds[xce_pollfd_idx].revents & ~POLLIN) {
-				barf_perror("xce_handle poll failed");
-				break;
-			} else if (fds[xce_pollfd_idx].revents & POLLIN) {
-				handle_event();
-				xce_pollfd_idx = -1;
-			}
+		if (ro_sock_src.revents & ~POLLIN) {
+			barf_perror("ro sock poll failed");
+			break;
+		} else if (ro_sock_src.revents & POLLIN) {
+			accept_connection(*ro_sock, false);
+			ro_sock_src.revents = 0;
 		}
 
-		next = list_entry(connections.next, typeof(*conn), list);
-		if (&next->list != &connections)
-			talloc_increase_ref_count(next);
-		while (&next->list != &connections) {
-			conn = next;
-
-			next = list_entry(conn->list.next,
-					  typeof(*conn), list);
-			if (&next->list != &connections)
-				talloc_increase_ref_count(next);
-
-			if (conn->domain) {
-				if (domain_can_read(conn))
-					handle_input(conn);
-				if (talloc_free(conn) == 0)
-					continue;
-
-				talloc_increase_ref_count(conn);
-				if (domain_can_write(conn) &&
-				    !list_empty(&conn->out_list))
-					handle_output(conn);
-				if (talloc_free(conn) == 0)
-					continue;
-			} else {
-				if (conn->pollfd_idx != -1) {
-					if (fds[conn->pollfd_idx].revents
-					    & ~(POLLIN|POLLOUT))
-						talloc_free(conn);
-					else if (fds[conn->pollfd_idx].revents
-						 & POLLIN)
-						handle_input(conn);
-				}
-				if (talloc_free(conn) == 0)
-					continue;
-
-				talloc_increase_ref_count(conn);
-
-				if (conn->pollfd_idx != -1) {
-					if (fds[conn->pollfd_idx].revents
-					    & ~(POLLIN|POLLOUT))
-						talloc_free(conn);
-					else if (fds[conn->pollfd_idx].revents
-						 & POLLOUT)
-						handle_output(conn);
-				}
-				if (talloc_free(conn) == 0)
-					continue;
-
-				conn->pollfd_idx = -1;
-			}
+		if (xce_src.revents & ~POLLIN) {
+			barf_perror("xce_handle poll failed");
+			break;
+		} else if (xce_src.revents & POLLIN) {
+			handle_event();
+			xce_src.revents = 0;
 		}
 
-		initialize_fds(*sock, &sock_pollfd_idx, *ro_sock,
-			       &ro_sock_pollfd_idx, &timeout);
+		handle_ready_conns();
 	}
 }
 
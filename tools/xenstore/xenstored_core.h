@@ -64,6 +64,23 @@ struct buffered_data
 };
 
 struct connection;
+
+/* A file descriptor registered with the main loop. */
+struct pollsrc
+{
+	int fd;
+	short events;
+
+	/* Events seen by the last wait, cleared once they are handled. */
+	short revents;
+
+	/* The connection it belongs to, if any. */
+	struct connection *conn;
+
+	/* Index in the poll() array, when epoll isn't used. */
+	int idx;
+};
+
 typedef int connwritefn_t(struct connection *, const void *, unsigned int);
 typedef int connreadfn_t(struct connection *, void *, unsigned int);
 
@@ -73,8 +90,10 @@ struct connection
 
 	/* The file descriptor we came in on. */
 	int fd;
-	/* The index of pollfd in global pollfd array */
-	int pollfd_idx;
+	struct pollsrc pollsrc;
+
+	/* On the list of connections the main loop has to look at. */
+	struct list_head ready;
 
 	/* Who am I? 0 for socket connections. */
 	unsigned int id;
@@ -88,9 +107,16 @@ struct connection
 	/* Buffered output data */
 	struct list_head out_list;
 
+	/* Bytes queued in out_list, bounded by quota_max_output. */
+	unsigned int out_bytes;
+	bool out_dropping; /* Over the bound: watch events are dropped. */
+
 	/* Transaction context for current request (NULL if none). */
 	struct transaction *transaction;
 
+	/* Handling sub-requests of a batch: their replies are suppressed. */
+	bool in_batch;
+
 	/* List of in-progress transactions. */
 	struct list_head transaction_list;
 	uint32_t next_transaction_id;
@@ -153,6 +179,13 @@ char *canonicalize(struct connection *conn, const void *ctx, const char *node);
 /* Write a node to the tdb data base. */
 int write_node_raw(struct connection *conn, TDB_DATA *key, struct node *node);
 
+/* Data base access, through TDB or the in-memory data base. */
+TDB_DATA db_fetch(const void *ctx, TDB_DATA key, bool shared);
+int db_store(TDB_DATA key, TDB_DATA data);
+int db_delete(TDB_DATA key);
+int db_traverse(tdb_traverse_func fn, void *private);
+int db_snapshot(const char *file);
+
 /* Get this node, checking we have permissions. */
 struct node *get_node(struct connection *conn,
 		      const void *ctx,
@@ -160,6 +193,9 @@ struct node *get_node(struct connection *conn,
 		      enum xs_perm_type perm);
 
 struct connection *new_connection(connwritefn_t *write, connreadfn_t *read);
+
+/* Have the main loop look at conn, e.g. because its domain signalled it. */
+void conn_set_ready(struct connection *conn);
 void check_store(void);
 void corrupt(struct connection *conn, const char *fmt, ...);
 
@@ -178,6 +214,7 @@ extern char *tracefile;
 extern int tracefd;
 
 extern TDB_CONTEXT *tdb_ctx;
+extern bool use_memdb;
 extern int dom0_domid;
 extern int dom0_event;
 extern int priv_domid;
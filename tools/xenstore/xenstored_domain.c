@@ -71,6 +71,9 @@ struct domain
 	/* Have we noticed that this domain is shutdown? */
 	int shutdown;
 
+	/* Ring indexes moved since we last sent an event. */
+	bool notify;
+
 	/* number of entry from this domain in the store */
 	int nbentry;
 
@@ -85,6 +88,34 @@ struct domain
 
 static LIST_HEAD(domains);
 
+/* Domains by local event channel port, to tell whom an event is from. */
+static struct domain **port_domains;
+static unsigned int nr_port_domains;
+
+static int set_port_domain(evtchn_port_t port, struct domain *domain)
+{
+	struct domain **new;
+	unsigned int nr;
+
+	if (port >= nr_port_domains) {
+		if (!domain)
+			return 0;
+		nr = (port | 63) + 1;
+		new = talloc_realloc(NULL, port_domains, struct domain *, nr);
+		if (!new) {
+			errno = ENOMEM;
+			return -1;
+		}
+		memset(new + nr_port_domains, 0,
+		       (nr - nr_port_domains) * sizeof(*new));
+		port_domains = new;
+		nr_port_domains = nr;
+	}
+	port_domains[port] = domain;
+
+	return 0;
+}
+
 static bool check_indexes(XENSTORE_RING_IDX cons, XENSTORE_RING_IDX prod)
 {
 	return ((prod - cons) <= XENSTORE_RING_SIZE);
@@ -136,7 +167,7 @@ static int writechn(struct connection *conn,
 	xen_mb();
 	intf->rsp_prod += len;
 
-	xenevtchn_notify(xce_handle, conn->domain->port);
+	conn->domain->notify = true;
 
 	return len;
 }
@@ -166,11 +197,25 @@ static int readchn(struct connection *conn, void *data, unsigned int len)
 	xen_mb();
 	intf->req_cons += len;
 
-	xenevtchn_notify(xce_handle, conn->domain->port);
+	conn->domain->notify = true;
 
 	return len;
 }
 
+/*
+ * Tell the guest about everything read from and written to its ring since
+ * the last event.  The main loop calls this once it is done with the
+ * connection for a round, rather than every ring access sending one.
+ */
+void domain_notify(struct connection *conn)
+{
+	if (!conn->domain->notify)
+		return;
+
+	conn->domain->notify = false;
+	xenevtchn_notify(xce_handle, conn->domain->port);
+}
+
 static void *map_interface(domid_t domid, unsigned long mfn)
 {
 	if (*xgt_handle != NULL) {
@@ -198,6 +243,7 @@ static int destroy_domain(void *_domain)
 	list_del(&domain->list);
 
 	if (domain->port) {
+		set_port_domain(domain->port, NULL);
 		if (xenevtchn_unbind(xce_handle, domain->port) == -1)
 			eprintf("> Unbinding port %i failed!\n", domain->port);
 	}
@@ -244,7 +290,6 @@ static void domain_cleanup(void)
 		fire_watches(NULL, NULL, "@releaseDomain", false);
 }
 
-/* We scan all domains rather than use the information given here. */
 void handle_event(void)
 {
 	evtchn_port_t port;
@@ -254,6 +299,8 @@ void handle_event(void)
 
 	if (port == virq_port)
 		domain_cleanup();
+	else if (port < nr_port_domains && port_domains[port])
+		conn_set_ready(port_domains[port]->conn);
 
 	if (xenevtchn_unmask(xce_handle, port) == -1)
 		barf_perror("Failed to write to event fd");
@@ -268,6 +315,14 @@ bool domain_can_read(struct connection *conn)
 	return (intf->req_cons != intf->req_prod);
 }
 
+bool domain_wrl_blocked(struct connection *conn)
+{
+	struct xenstore_domain_interface *intf = conn->domain->interface;
+
+	return domain_is_unprivileged(conn) && conn->domain->wrl_credit < 0 &&
+	       intf->req_cons != intf->req_prod;
+}
+
 static bool domid_is_unprivileged(unsigned int domid)
 {
 	return domid != 0 && domid != priv_domid;
@@ -325,6 +380,11 @@ static struct domain *new_domain(void *context, unsigned int domid,
 	domain->conn->domain = domain;
 	domain->conn->id = domid;
 
+	if (set_port_domain(domain->port, domain))
+		return NULL;
+	/* It may have queued requests before it was introduced. */
+	conn_set_ready(domain->conn);
+
 	domain->remote_port = port;
 	domain->nbentry = 0;
 	domain->nbwatch = 0;
@@ -357,6 +417,9 @@ static void domain_conn_reset(struct domain *domain)
 		talloc_free(out);
 	}
 
+	conn->out_bytes = 0;
+	conn->out_dropping = false;
+
 	talloc_free(conn->in);
 
 	domain->interface->req_cons = domain->interface->req_prod = 0;
@@ -410,11 +473,16 @@ int do_introduce(struct connection *conn, struct buffered_data *in)
 		fire_watches(NULL, in, "@introduceDomain", false);
 	} else if ((domain->mfn == mfn) && (domain->conn != conn)) {
 		/* Use XS_INTRODUCE for recreating the xenbus event-channel. */
-		if (domain->port)
+		if (domain->port) {
+			set_port_domain(domain->port, NULL);
 			xenevtchn_unbind(xce_handle, domain->port);
+		}
 		rc = xenevtchn_bind_interdomain(xce_handle, domid, port);
 		domain->port = (rc == -1) ? 0 : rc;
 		domain->remote_port = port;
+		if (domain->port && set_port_domain(domain->port, domain))
+			eprintf("Could not track port %u of domain %u",
+				domain->port, domid);
 	} else
 		return EINVAL;
 
@@ -54,6 +54,12 @@ void restore_existing_connections(void);
 bool domain_can_read(struct connection *conn);
 bool domain_can_write(struct connection *conn);
 
+/* Send the event owed for ring updates, if any. */
+void domain_notify(struct connection *conn);
+
+/* Has requests held back by the write rate limit? */
+bool domain_wrl_blocked(struct connection *conn);
+
 bool domain_is_unprivileged(struct connection *conn);
 
 /* Quota manipulation */
@@ -0,0 +1,275 @@
+/*
+    In-memory data base for Xen Store Daemon.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * A chained hash table of node records, used instead of TDB when
+ * xenstored is started with --memory-db.
+ *
+ * Records are reference counted: each key referring to a record holds a
+ * reference, as does each shared fetch (read_node() uses these, so
+ * reading a node does not copy it).  This also lets a transaction keep
+ * its copy of a node it has read by linking to the global record
+ * instead of writing a duplicate.
+ */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "talloc.h"
+#include "utils.h"
+#include "xenstored_memdb.h"
+
+struct memdb_rec {
+	unsigned int refs;
+	size_t size;
+	char data[];
+};
+
+struct memdb_entry {
+	struct memdb_entry *next;
+	unsigned int hash;
+	TDB_DATA key;
+	struct memdb_rec *rec;
+};
+
+/* Reference to a record held by a shared fetch. */
+struct memdb_hold {
+	struct memdb_rec *rec;
+};
+
+#define MEMDB_MIN_BUCKETS 1024
+
+static void *memdb_ctx;
+static struct memdb_entry **buckets;
+static unsigned int nr_buckets, nr_entries;
+
+static unsigned int memdb_hash(TDB_DATA key)
+{
+	unsigned int hash = 5381;
+	size_t i;
+
+	for (i = 0; i < key.dsize; i++)
+		hash = ((hash << 5) + hash) + (unsigned char)key.dptr[i];
+
+	return hash;
+}
+
+static void rec_put(struct memdb_rec *rec)
+{
+	if (--rec->refs == 0)
+		talloc_free(rec);
+}
+
+static int hold_destroy(void *_hold)
+{
+	struct memdb_hold *hold = _hold;
+
+	rec_put(hold->rec);
+	return 0;
+}
+
+static struct memdb_entry **find_entry(TDB_DATA key, unsigned int hash)
+{
+	struct memdb_entry **e;
+
+	for (e = &buckets[hash % nr_buckets]; *e; e = &(*e)->next)
+		if ((*e)->hash == hash && (*e)->key.dsize == key.dsize &&
+		    !memcmp((*e)->key.dptr, key.dptr, key.dsize))
+			break;
+
+	return e;
+}
+
+static void grow_buckets(void)
+{
+	struct memdb_entry **new, *e, *next;
+	unsigned int i, nr = nr_buckets * 2;
+
+	new = talloc_zero_array(memdb_ctx, struct memdb_entry *, nr);
+	if (!new)
+		return;	/* Carry on with longer chains. */
+
+	for (i = 0; i < nr_buckets; i++) {
+		for (e = buckets[i]; e; e = next) {
+			next = e->next;
+			e->next = new[e->hash % nr];
+			new[e->hash % nr] = e;
+		}
+	}
+
+	talloc_free(buckets);
+	buckets = new;
+	nr_buckets = nr;
+}
+
+void memdb_init(void)
+{
+	memdb_ctx = talloc_named_const(NULL, 0, "memdb");
+	buckets = talloc_zero_array(memdb_ctx, struct memdb_entry *,
+				    MEMDB_MIN_BUCKETS);
+	if (!memdb_ctx || !buckets)
+		barf("Could not allocate memory data base");
+	nr_buckets = MEMDB_MIN_BUCKETS;
+}
+
+TDB_DATA memdb_fetch(const void *ctx, TDB_DATA key, bool shared)
+{
+	struct memdb_entry *e = *find_entry(key, memdb_hash(key));
+	struct memdb_hold *hold;
+	TDB_DATA data = { NULL, 0 };
+
+	if (!e) {
+		errno = ENOENT;
+		return data;
+	}
+
+	if (shared) {
+		hold = talloc(ctx, struct memdb_hold);
+		if (!hold) {
+			errno = ENOMEM;
+			return data;
+		}
+		hold->rec = e->rec;
+		e->rec->refs++;
+		talloc_set_destructor(hold, hold_destroy);
+		data.dptr = e->rec->data;
+	} else {
+		data.dptr = talloc_memdup(ctx, e->rec->data, e->rec->size);
+		if (!data.dptr) {
+			errno = ENOMEM;
+			return data;
+		}
+	}
+	data.dsize = e->rec->size;
+
+	return data;
+}
+
+/* Point key at rec, taking a new reference to it. */
+static int set_entry(TDB_DATA key, struct memdb_rec *rec)
+{
+	unsigned int hash = memdb_hash(key);
+	struct memdb_entry **pe = find_entry(key, hash);
+	struct memdb_entry *e = *pe;
+
+	rec->refs++;
+
+	if (e) {
+		rec_put(e->rec);
+		e->rec = rec;
+		return 0;
+	}
+
+	e = talloc(memdb_ctx, struct memdb_entry);
+	if (!e)
+		goto nomem;
+	e->key.dptr = talloc_memdup(e, key.dptr, key.dsize);
+	if (!e->key.dptr) {
+		talloc_free(e);
+		goto nomem;
+	}
+	e->key.dsize = key.dsize;
+	e->hash = hash;
+	e->rec = rec;
+	e->next = NULL;
+	*pe = e;
+
+	if (++nr_entries > 2 * nr_buckets)
+		grow_buckets();
+
+	return 0;
+
+ nomem:
+	rec_put(rec);
+	errno = ENOMEM;
+	return -1;
+}
+
+int memdb_store(TDB_DATA key, TDB_DATA data)
+{
+	struct memdb_rec *rec;
+	int ret;
+
+	rec = talloc_size(memdb_ctx, sizeof(*rec) + data.dsize);
+	if (!rec) {
+		errno = ENOMEM;
+		return -1;
+	}
+	rec->refs = 1;
+	rec->size = data.dsize;
+	memcpy(rec->data, data.dptr, data.dsize);
+
+	ret = set_entry(key, rec);
+	rec_put(rec);
+
+	return ret;
+}
+
+int memdb_link(TDB_DATA key, TDB_DATA from)
+{
+	struct memdb_entry *e = *find_entry(from, memdb_hash(from));
+
+	if (!e) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	return set_entry(key, e->rec);
+}
+
+int memdb_delete(TDB_DATA key)
+{
+	struct memdb_entry **pe = find_entry(key, memdb_hash(key));
+	struct memdb_entry *e = *pe;
+
+	if (!e) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	*pe = e->next;
+	nr_entries--;
+	rec_put(e->rec);
+	talloc_free(e);
+
+	return 0;
+}
+
+int memdb_traverse(tdb_traverse_func fn, void *private)
+{
+	struct memdb_entry *e, *next;
+	TDB_DATA data;
+	unsigned int i;
+	int count = 0;
+
+	/* fn may delete the entry it is called for, but no other. */
+	for (i = 0; i < nr_buckets; i++) {
+		for (e = buckets[i]; e; e = next) {
+			next = e->next;
+			data.dptr = e->rec->data;
+			data.dsize = e->rec->size;
+			count++;
+			if (fn(NULL, e->key, data, private))
+				return count;
+		}
+	}
+
+	return count;
+}
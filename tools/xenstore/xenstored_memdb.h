@@ -0,0 +1,43 @@
+/*
+    In-memory data base for Xen Store Daemon.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef _XENSTORED_MEMDB_H
+#define _XENSTORED_MEMDB_H
+
+#include <stdbool.h>
+#include "tdb.h"
+
+void memdb_init(void);
+
+/*
+ * Returns the record for key allocated in ctx, or dptr NULL with errno
+ * set to ENOENT.  A shared record is a reference to the stored one and
+ * must not be modified; it stays valid until ctx is freed.
+ */
+TDB_DATA memdb_fetch(const void *ctx, TDB_DATA key, bool shared);
+
+/* Store a copy of data under key, replacing any old record. */
+int memdb_store(TDB_DATA key, TDB_DATA data);
+
+/* Make key refer to the record of from, without copying it. */
+int memdb_link(TDB_DATA key, TDB_DATA from);
+
+int memdb_delete(TDB_DATA key);
+
+/* As tdb_traverse(), fn is called with a NULL TDB_CONTEXT. */
+int memdb_traverse(tdb_traverse_func fn, void *private);
+
+#endif /* _XENSTORED_MEMDB_H */
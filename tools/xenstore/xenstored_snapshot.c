@@ -0,0 +1,316 @@
+/*
+    Read-only snapshot of the store for local clients.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * With --read-snapshot the values of all nodes are published in a file
+ * which libxenstore maps, so that xs_read() from a local client can be
+ * served without a round trip to the daemon.  See xs_snapshot.h for the
+ * layout and the rules for readers.
+ *
+ * The file is rewritten only once the store has been quiet for
+ * SNAPSHOT_QUIET_MS, so a burst of writes costs one invalidation and
+ * one rebuild.  Invalidation happens before the store is modified, hence
+ * before any reply or watch event can tell a client about the change.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "talloc.h"
+#include "utils.h"
+#include "xenstore_lib.h"
+#include "xenstored_core.h"
+#include "xenstored_snapshot.h"
+#include "xs_snapshot.h"
+
+#define SNAPSHOT_QUIET_MS	1000
+
+bool use_read_snapshot = false;
+
+#ifndef NO_SOCKETS
+
+/* The published snapshot, mapped so that it can be invalidated. */
+static struct xs_snapshot_hdr *snap;
+static size_t snap_size;
+
+static bool snap_dirty;
+static uint64_t last_change_ms;
+
+struct snap_buf {
+	char *buf;
+	size_t len;
+	uint32_t *entries;
+	unsigned int nr_entries;
+	int err;
+};
+
+static uint64_t now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void snapshot_init(void)
+{
+	const char *path = xs_daemon_snapshot();
+	uint32_t valid = 0;
+	int fd;
+
+	if (!path) {
+		use_read_snapshot = false;
+		return;
+	}
+
+	/* Clients of a previous instance may still trust its snapshot. */
+	fd = open(path, O_WRONLY);
+	if (fd >= 0) {
+		if (pwrite(fd, &valid, sizeof(valid),
+			   offsetof(struct xs_snapshot_hdr, valid)) !=
+		    sizeof(valid))
+			syslog(LOG_ERR, "could not invalidate %s", path);
+		close(fd);
+	}
+	unlink(path);
+
+	snap_dirty = use_read_snapshot;
+}
+
+void snapshot_invalidate(void)
+{
+	if (!use_read_snapshot)
+		return;
+
+	if (snap && snap->valid) {
+		snap->valid = 0;
+		__sync_synchronize();
+	}
+	snap_dirty = true;
+	last_change_ms = now_ms();
+}
+
+void snapshot_check_timeout(int *ptimeout)
+{
+	uint64_t now, due;
+	int timeout;
+
+	if (!snap_dirty)
+		return;
+
+	now = now_ms();
+	due = last_change_ms + SNAPSHOT_QUIET_MS;
+	timeout = (due > now) ? due - now : 0;
+
+	if (*ptimeout < 0 || timeout < *ptimeout)
+		*ptimeout = timeout;
+}
+
+static int snap_append(struct snap_buf *sb, TDB_DATA key, const char *data,
+		       uint32_t datalen)
+{
+	struct xs_snapshot_entry *e;
+	size_t len = (sizeof(*e) + key.dsize + datalen + 3) & ~3UL;
+	uint32_t *entries;
+	char *buf;
+
+	if (sb->len + len > UINT32_MAX) {
+		sb->err = E2BIG;
+		return -1;
+	}
+
+	buf = talloc_realloc_size(NULL, sb->buf, sb->len + len);
+	entries = talloc_realloc(NULL, sb->entries, uint32_t,
+				 sb->nr_entries + 1);
+	if (buf)
+		sb->buf = buf;
+	if (entries)
+		sb->entries = entries;
+	if (!buf || !entries) {
+		sb->err = ENOMEM;
+		return -1;
+	}
+
+	e = (void *)(sb->buf + sb->len);
+	memset(e, 0, len);
+	e->hash = xs_snapshot_hash(key.dptr, key.dsize);
+	e->pathlen = key.dsize;
+	e->datalen = datalen;
+	memcpy(e->path, key.dptr, key.dsize);
+	memcpy(e->path + key.dsize, data, datalen);
+
+	sb->entries[sb->nr_entries++] = sb->len;
+	sb->len += len;
+
+	return 0;
+}
+
+static int snapshot_node(TDB_CONTEXT *tdb, TDB_DATA key, TDB_DATA val,
+			 void *private)
+{
+	struct snap_buf *sb = private;
+	struct xs_tdb_record_hdr *hdr = (void *)val.dptr;
+	size_t perms_len;
+
+	/* Skip the private copies of nodes modified in transactions. */
+	if (key.dsize == 0 || key.dptr[0] != '/')
+		return 0;
+
+	if (val.dsize < sizeof(*hdr))
+		return 0;
+	perms_len = hdr->num_perms * sizeof(hdr->perms[0]);
+	if (val.dsize < sizeof(*hdr) + perms_len + hdr->datalen)
+		return 0;
+
+	return snap_append(sb, key, (char *)(hdr->perms + hdr->num_perms),
+			   hdr->datalen);
+}
+
+/* Build the file contents in sb. */
+static int snapshot_build(struct snap_buf *sb)
+{
+	struct xs_snapshot_hdr *hdr;
+	struct xs_snapshot_entry *e;
+	uint32_t nr_buckets = 1, *buckets;
+	size_t buckets_off;
+	unsigned int i;
+	char *buf;
+
+	sb->len = sizeof(*hdr);
+	sb->buf = talloc_zero_size(NULL, sb->len);
+	if (!sb->buf) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	if (db_traverse(snapshot_node, sb) < 0 && !sb->err)
+		sb->err = EIO;
+	if (sb->err) {
+		errno = sb->err;
+		return -1;
+	}
+
+	while (nr_buckets < sb->nr_entries)
+		nr_buckets <<= 1;
+
+	buckets_off = sb->len;
+	if (buckets_off + nr_buckets * sizeof(*buckets) > UINT32_MAX) {
+		errno = E2BIG;
+		return -1;
+	}
+	buf = talloc_realloc_size(NULL, sb->buf,
+				  buckets_off + nr_buckets * sizeof(*buckets));
+	if (!buf) {
+		errno = ENOMEM;
+		return -1;
+	}
+	sb->buf = buf;
+	sb->len = buckets_off + nr_buckets * sizeof(*buckets);
+
+	buckets = (void *)(sb->buf + buckets_off);
+	memset(buckets, 0, nr_buckets * sizeof(*buckets));
+	for (i = 0; i < sb->nr_entries; i++) {
+		e = (void *)(sb->buf + sb->entries[i]);
+		e->next = buckets[e->hash & (nr_buckets - 1)];
+		buckets[e->hash & (nr_buckets - 1)] = sb->entries[i];
+	}
+
+	hdr = (void *)sb->buf;
+	hdr->magic = XS_SNAPSHOT_MAGIC;
+	hdr->valid = 1;
+	hdr->size = sb->len;
+	hdr->nr_buckets = nr_buckets;
+	hdr->buckets = buckets_off;
+
+	return 0;
+}
+
+static int snapshot_publish(void)
+{
+	const char *path = xs_daemon_snapshot();
+	struct snap_buf sb = { };
+	char *tmp = NULL;
+	void *map = MAP_FAILED;
+	int fd = -1, ret = -1;
+
+	if (snapshot_build(&sb))
+		goto out;
+
+	tmp = talloc_asprintf(NULL, "%s.tmp", path);
+	if (!tmp) {
+		errno = ENOMEM;
+		goto out;
+	}
+
+	unlink(tmp);
+	fd = open(tmp, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+	if (fd < 0)
+		goto out;
+	if (!xs_write_all(fd, sb.buf, sb.len))
+		goto out;
+
+	map = mmap(NULL, sb.len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		goto out;
+
+	if (rename(tmp, path))
+		goto out;
+
+	if (snap)
+		munmap(snap, snap_size);
+	snap = map;
+	snap_size = sb.len;
+	map = MAP_FAILED;
+	ret = 0;
+
+ out:
+	if (ret)
+		syslog(LOG_ERR, "could not publish read snapshot: %s",
+		       strerror(errno));
+	if (map != MAP_FAILED)
+		munmap(map, sb.len);
+	if (fd >= 0)
+		close(fd);
+	if (ret && tmp)
+		unlink(tmp);
+	talloc_free(tmp);
+	talloc_free(sb.buf);
+	talloc_free(sb.entries);
+
+	return ret;
+}
+
+void snapshot_update(void)
+{
+	if (!snap_dirty || now_ms() < last_change_ms + SNAPSHOT_QUIET_MS)
+		return;
+
+	/* On failure try again after another quiet period. */
+	if (snapshot_publish())
+		last_change_ms = now_ms();
+	else
+		snap_dirty = false;
+}
+#endif /* NO_SOCKETS */
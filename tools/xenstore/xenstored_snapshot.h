@@ -0,0 +1,43 @@
+/*
+    Read-only snapshot of the store for local clients.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef _XENSTORED_SNAPSHOT_H
+#define _XENSTORED_SNAPSHOT_H
+
+#include <stdbool.h>
+
+extern bool use_read_snapshot;
+
+#ifndef NO_SOCKETS
+/* Withdraw any snapshot left by a previous instance. */
+void snapshot_init(void);
+
+/* Must be called before each change of a node outside a transaction. */
+void snapshot_invalidate(void);
+
+/* Lower *ptimeout (in ms, -1 for none) to the next snapshot update. */
+void snapshot_check_timeout(int *ptimeout);
+
+/* Publish a new snapshot if the store has been quiet for long enough. */
+void snapshot_update(void);
+#else
+static inline void snapshot_init(void) {}
+static inline void snapshot_invalidate(void) {}
+static inline void snapshot_check_timeout(int *ptimeout) {}
+static inline void snapshot_update(void) {}
+#endif
+
+#endif /* _XENSTORED_SNAPSHOT_H */
@@ -33,6 +33,7 @@
 #include "xenstored_transaction.h"
 #include "xenstored_watch.h"
 #include "xenstored_domain.h"
+#include "xenstored_memdb.h"
 #include "xenstore_lib.h"
 #include "utils.h"
 
@@ -209,6 +210,23 @@ int transaction_prepend(struct connection *conn, const char *name,
 	return 0;
 }
 
+/*
+ * Keep the transaction's copy of a node it has just read.  The node is
+ * unchanged from the global record, so the in-memory data base can
+ * share that record instead of storing a duplicate.
+ */
+static int read_copy(struct connection *conn, TDB_DATA *key,
+		     struct node *node)
+{
+	TDB_DATA from;
+
+	if (!use_memdb)
+		return write_node_raw(conn, key, node);
+
+	set_tdb_key(node->name, &from);
+	return memdb_link(*key, from) ? errno : 0;
+}
+
 /*
  * A node has been accessed.
  *
@@ -276,7 +294,7 @@ int access_node(struct connection *conn, struct node *node,
 			i->check_gen = true;
 			if (node->generation != NO_GENERATION) {
 				set_tdb_key(trans_name, &local_key);
-				ret = write_node_raw(conn, &local_key, node);
+				ret = read_copy(conn, &local_key, node);
 				if (ret)
 					goto err;
 				i->ta_node = true;
@@ -334,15 +352,14 @@ static int finalize_transaction(struct connection *conn,
 			continue;
 
 		set_tdb_key(i->node, &key);
-		data = tdb_fetch(tdb_ctx, key);
+		data = db_fetch(i, key, true);
 		hdr = (void *)data.dptr;
 		if (!data.dptr) {
-			if (tdb_error(tdb_ctx) != TDB_ERR_NOEXIST)
+			if (errno != ENOENT)
 				return EIO;
 			gen = NO_GENERATION;
 		} else
 			gen = hdr->generation;
-		talloc_free(data.dptr);
 		if (i->generation != gen)
 			return EAGAIN;
 	}
@@ -358,22 +375,21 @@ static int finalize_transaction(struct connection *conn,
 		if (i->modified) {
 			set_tdb_key(i->node, &key);
 			if (i->ta_node) {
-				data = tdb_fetch(tdb_ctx, ta_key);
+				data = db_fetch(i, ta_key, false);
 				if (!data.dptr)
 					goto err;
 				hdr = (void *)data.dptr;
 				hdr->generation = generation++;
-				ret = tdb_store(tdb_ctx, key, data,
-						TDB_REPLACE);
+				ret = db_store(key, data);
 				talloc_free(data.dptr);
 				if (ret)
 					goto err;
-			} else if (tdb_delete(tdb_ctx, key))
+			} else if (db_delete(key))
 					goto err;
 			fire_watches(conn, trans, i->node, false);
 		}
 
-		if (i->ta_node && tdb_delete(tdb_ctx, ta_key))
+		if (i->ta_node && db_delete(ta_key))
 			goto err;
 		list_del(&i->list);
 		talloc_free(i);
@@ -401,7 +417,7 @@ static int destroy_transaction(void *_transaction)
 							       i->node);
 			if (trans_name) {
 				set_tdb_key(trans_name, &key);
-				tdb_delete(tdb_ctx, key);
+				db_delete(key);
 			}
 		}
 		list_del(&i->list);
@@ -425,6 +441,22 @@ struct transaction *transaction_lookup(struct connection *conn, uint32_t id)
 	return ERR_PTR(-ENOENT);
 }
 
+static struct transaction *transaction_new(void *ctx)
+{
+	struct transaction *trans;
+
+	trans = talloc_zero(ctx, struct transaction);
+	if (!trans)
+		return NULL;
+
+	INIT_LIST_HEAD(&trans->accessed);
+	INIT_LIST_HEAD(&trans->changed_domains);
+	trans->fail = false;
+	trans->generation = generation++;
+
+	return trans;
+}
+
 int do_transaction_start(struct connection *conn, struct buffered_data *in)
 {
 	struct transaction *trans, *exists;
@@ -438,15 +470,10 @@ int do_transaction_start(struct connection *conn, struct buffered_data *in)
 		return ENOSPC;
 
 	/* Attach transaction to input for autofree until it's complete */
-	trans = talloc_zero(in, struct transaction);
+	trans = transaction_new(in);
 	if (!trans)
 		return ENOMEM;
 
-	INIT_LIST_HEAD(&trans->accessed);
-	INIT_LIST_HEAD(&trans->changed_domains);
-	trans->fail = false;
-	trans->generation = generation++;
-
 	/* Pick an unused transaction identifier. */
 	do {
 		trans->id = conn->next_transaction_id;
@@ -480,6 +507,27 @@ static int transaction_fix_domains(struct transaction *trans, bool update)
 	return 0;
 }
 
+static int transaction_commit(struct connection *conn,
+			      struct transaction *trans)
+{
+	int ret;
+
+	if (trans->fail)
+		return ENOMEM;
+	ret = transaction_fix_domains(trans, false);
+	if (ret)
+		return ret;
+	if (finalize_transaction(conn, trans))
+		return EAGAIN;
+
+	wrl_apply_debit_trans_commit(conn);
+
+	/* fix domain entry for each changed domain */
+	transaction_fix_domains(trans, true);
+
+	return 0;
+}
+
 int do_transaction_end(struct connection *conn, struct buffered_data *in)
 {
 	const char *arg = onearg(in);
@@ -500,24 +548,42 @@ int do_transaction_end(struct connection *conn, struct buffered_data *in)
 	talloc_steal(in, trans);
 
 	if (streq(arg, "T")) {
-		if (trans->fail)
-			return ENOMEM;
-		ret = transaction_fix_domains(trans, false);
+		ret = transaction_commit(conn, trans);
 		if (ret)
 			return ret;
-		if (finalize_transaction(conn, trans))
-			return EAGAIN;
-
-		wrl_apply_debit_trans_commit(conn);
-
-		/* fix domain entry for each changed domain */
-		transaction_fix_domains(trans, true);
 	}
 	send_ack(conn, XS_TRANSACTION_END);
 
 	return 0;
 }
 
+struct transaction *transaction_start_implicit(struct connection *conn,
+					       void *ctx)
+{
+	struct transaction *trans;
+
+	trans = transaction_new(ctx);
+	if (!trans) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	/* Not on the transaction list: the client can't refer to it. */
+	INIT_LIST_HEAD(&trans->list);
+	talloc_set_destructor(trans, destroy_transaction);
+	wrl_ntransactions++;
+
+	return trans;
+}
+
+int transaction_commit_implicit(struct connection *conn,
+				struct transaction *trans)
+{
+	assert(conn->transaction == NULL);
+
+	return transaction_commit(conn, trans);
+}
+
 void transaction_entry_inc(struct transaction *trans, unsigned int domid)
 {
 	struct changed_domain *d;
@@ -32,6 +32,16 @@ int do_transaction_end(struct connection *conn, struct buffered_data *in);
 
 struct transaction *transaction_lookup(struct connection *conn, uint32_t id);
 
+/*
+ * Transaction private to a single request, e.g. to apply the sub-requests
+ * of a batch atomically.  It must be committed with conn->transaction
+ * cleared and freed by the caller either way.
+ */
+struct transaction *transaction_start_implicit(struct connection *conn,
+					       void *ctx);
+int transaction_commit_implicit(struct connection *conn,
+				struct transaction *trans);
+
 /* inc/dec entry number local to trans while changing a node */
 void transaction_entry_inc(struct transaction *trans, unsigned int domid);
 void transaction_entry_dec(struct transaction *trans, unsigned int domid);
@@ -25,6 +25,7 @@
 #include <assert.h>
 #include "talloc.h"
 #include "list.h"
+#include "hashtable.h"
 #include "xenstored_watch.h"
 #include "xenstore_lib.h"
 #include "utils.h"
@@ -32,11 +33,42 @@
 
 extern int quota_nb_watch_per_domain;
 
+/*
+ * Watches are indexed by the path they watch, in a tree mirroring the
+ * node hierarchy: there is an index node for every watched path and
+ * for each of its parents ("@" special paths hang off "/", as a watch on
+ * "/" sees everything).  All index nodes are in a hash table by path.
+ *
+ * A change to a node is then only matched against the watches on that
+ * node and its parents, found by walking up from the deepest indexed
+ * parent, and for a recursive change the watches below it.
+ */
+struct watch_node
+{
+	/* Siblings: entries of parent->children. */
+	struct list_head list;
+
+	struct watch_node *parent;
+	struct list_head children;
+
+	/* Watches on exactly this path. */
+	struct list_head watches;
+
+	char *path;
+};
+
+static struct hashtable *watch_index;
+
 struct watch
 {
 	/* Watches on this connection */
 	struct list_head list;
 
+	/* Watches on the same path, see struct watch_node. */
+	struct list_head node_list;
+	struct watch_node *index;
+	struct connection *conn;
+
 	/* Current outstanding events applying to this watch. */
 	struct list_head events;
 
@@ -56,22 +88,108 @@ static bool check_event_node(const char *node)
 	return true;
 }
 
-/* Is child a subnode of parent, or equal? */
-static bool is_child(const char *child, const char *parent)
+static unsigned int hash_path(void *k)
+{
+	char *str = k;
+	unsigned int hash = 5381;
+	char c;
+
+	while ((c = *str++))
+		hash = ((hash << 5) + hash) + (unsigned int)c;
+
+	return hash;
+}
+
+static int paths_equal(void *key1, void *key2)
 {
-	unsigned int len = strlen(parent);
+	return streq(key1, key2);
+}
 
-	/*
-	 * / should really be "" for this algorithm to work, but that's a
-	 * usability nightmare.
-	 */
-	if (streq(parent, "/"))
-		return true;
+/*
+ * Truncate path to its parent in the index, returning false for "/".
+ * / should really be "" for this to work, but that's a usability
+ * nightmare.
+ */
+static bool index_parent(char *path)
+{
+	char *slash = strrchr(path, '/');
 
-	if (strncmp(child, parent, len) != 0)
+	if (streq(path, "/"))
 		return false;
 
-	return child[len] == '/' || child[len] == '\0';
+	if (!slash || slash == path)
+		strcpy(path, "/");
+	else
+		*slash = '\0';
+
+	return true;
+}
+
+static struct watch_node *index_lookup(const char *path)
+{
+	return watch_index ? hashtable_search(watch_index, (void *)path) : NULL;
+}
+
+static struct watch_node *index_get(const char *path)
+{
+	struct watch_node *wn, *parent = NULL;
+	char *key, *ppath;
+
+	wn = index_lookup(path);
+	if (wn)
+		return wn;
+
+	if (!watch_index) {
+		watch_index = create_hashtable(64, hash_path, paths_equal);
+		if (!watch_index)
+			return NULL;
+	}
+
+	ppath = talloc_strdup(NULL, path);
+	if (!ppath)
+		return NULL;
+	if (index_parent(ppath)) {
+		parent = index_get(ppath);
+		if (!parent) {
+			talloc_free(ppath);
+			return NULL;
+		}
+	}
+	talloc_free(ppath);
+
+	wn = talloc_zero(NULL, struct watch_node);
+	if (!wn)
+		return NULL;
+	wn->path = talloc_strdup(wn, path);
+	key = strdup(path);
+	if (!wn->path || !key || !hashtable_insert(watch_index, key, wn)) {
+		free(key);
+		talloc_free(wn);
+		return NULL;
+	}
+
+	INIT_LIST_HEAD(&wn->children);
+	INIT_LIST_HEAD(&wn->watches);
+	wn->parent = parent;
+	if (parent)
+		list_add_tail(&wn->list, &parent->children);
+
+	return wn;
+}
+
+/* Drop index nodes which no longer lead to any watch. */
+static void index_prune(struct watch_node *wn)
+{
+	struct watch_node *parent;
+
+	while (wn && list_empty(&wn->watches) && list_empty(&wn->children)) {
+		parent = wn->parent;
+		if (parent)
+			list_del(&wn->list);
+		hashtable_remove(watch_index, wn->path);
+		talloc_free(wn);
+		wn = parent;
+	}
 }
 
 /*
@@ -123,29 +241,55 @@ static void add_event(struct connection *conn,
  * Check whether any watch events are to be sent.
  * Temporary memory allocations are done with ctx.
  */
+/* Fire the watches below wn, which has been removed recursively. */
+static void fire_watches_below(void *ctx, struct watch_node *wn)
+{
+	struct watch_node *child;
+	struct watch *watch;
+
+	list_for_each_entry(child, &wn->children, list) {
+		list_for_each_entry(watch, &child->watches, node_list)
+			add_event(watch->conn, ctx, watch, watch->node);
+		fire_watches_below(ctx, child);
+	}
+}
+
 void fire_watches(struct connection *conn, void *ctx, const char *name,
 		  bool recurse)
 {
-	struct connection *i;
+	struct watch_node *wn, *exact;
 	struct watch *watch;
+	char *path;
 
 	/* During transactions, don't fire watches. */
 	if (conn && conn->transaction)
 		return;
 
-	/* Create an event for each watch. */
-	list_for_each_entry(i, &connections, list) {
-		list_for_each_entry(watch, &i->watches, list) {
-			if (is_child(name, watch->node))
-				add_event(i, ctx, watch, name);
-			else if (recurse && is_child(watch->node, name))
-				add_event(i, ctx, watch, watch->node);
-		}
-	}
+	path = talloc_strdup(ctx, name);
+	if (!path)
+		return;
+
+	/* Find the deepest watched path at or above name. */
+	while (!(wn = index_lookup(path)) && index_parent(path))
+		;
+	exact = (wn && streq(wn->path, name)) ? wn : NULL;
+	talloc_free(path);
+
+	/* Create an event for each watch on name or above it. */
+	for (; wn; wn = wn->parent)
+		list_for_each_entry(watch, &wn->watches, node_list)
+			add_event(watch->conn, ctx, watch, name);
+
+	if (recurse && exact)
+		fire_watches_below(ctx, exact);
 }
 
 static int destroy_watch(void *_watch)
 {
+	struct watch *watch = _watch;
+
+	list_del(&watch->node_list);
+	index_prune(watch->index);
 	trace_destroy(_watch, "watch");
 	return 0;
 }
@@ -188,10 +332,14 @@ int do_watch(struct connection *conn, struct buffered_data *in)
 		return ENOMEM;
 	watch->node = talloc_strdup(watch, vec[0]);
 	watch->token = talloc_strdup(watch, vec[1]);
-	if (!watch->node || !watch->token) {
+	watch->index = watch->node ? index_get(watch->node) : NULL;
+	if (!watch->node || !watch->token || !watch->index) {
+		if (watch->index)
+			index_prune(watch->index);
 		talloc_free(watch);
 		return ENOMEM;
 	}
+	watch->conn = conn;
 	if (relative)
 		watch->relative_path = get_implicit_path(conn);
 	else
@@ -201,6 +349,7 @@ int do_watch(struct connection *conn, struct buffered_data *in)
 
 	domain_watch_inc(conn);
 	list_add_tail(&watch->list, &conn->watches);
+	list_add_tail(&watch->node_list, &watch->index->watches);
 	trace_create(watch, "watch");
 	talloc_set_destructor(watch, destroy_watch);
 	send_ack(conn, XS_WATCH);
@@ -22,6 +22,7 @@
 #include <sys/uio.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <sys/mman.h>
 #include <string.h>
 #include <unistd.h>
 #include <stdbool.h>
@@ -34,6 +35,7 @@
 #include "xenstore.h"
 #include "list.h"
 #include "utils.h"
+#include "xs_snapshot.h"
 
 struct xs_stored_msg {
 	struct list_head list;
@@ -81,6 +83,13 @@ struct xs_handle {
 	/* One request at a time. */
 	pthread_mutex_t request_mutex;
 
+	/* Snapshot published by xenstored, protected by snap_mutex. */
+	bool use_snap;
+	const struct xs_snapshot_hdr *snap;
+	size_t snap_size;
+	ino_t snap_ino;
+	pthread_mutex_t snap_mutex;
+
 	/* Lock discipline:
 	 *  Only holder of the request lock may write to h->fd.
 	 *  Only holder of the request lock may access read_thr_exists.
@@ -88,6 +97,7 @@ struct xs_handle {
 	 *  If read_thr_exists==1, only the read thread may read h->fd.
 	 *  Only holder of the reply lock may access reply_list.
 	 *  Only holder of the watch lock may access watch_list.
+	 *  Only holder of the snap lock may access snap, snap_size, snap_ino.
 	 * Lock hierarchy:
 	 *  The order in which to acquire locks is
 	 *     request_mutex
@@ -128,6 +138,11 @@ struct xs_handle {
 	int watch_pipe[2];
 	/* Filtering watch event in unwatch function? */
 	bool unwatch_filter;
+	/* Snapshot published by xenstored. */
+	bool use_snap;
+	const struct xs_snapshot_hdr *snap;
+	size_t snap_size;
+	ino_t snap_ino;
 };
 
 #define mutex_lock(m)		((void)0)
@@ -264,6 +279,14 @@ static struct xs_handle *get_handle(const char *connect_to)
 	pthread_cond_init(&h->reply_condvar, NULL);
 
 	pthread_mutex_init(&h->request_mutex, NULL);
+
+	pthread_mutex_init(&h->snap_mutex, NULL);
+#endif
+
+#ifndef NO_SOCKETS
+	/* Only local clients can see the snapshot. */
+	h->use_snap = S_ISSOCK(buf.st_mode) && xs_daemon_snapshot() &&
+		      access(xs_daemon_snapshot(), R_OK) == 0;
 #endif
 
 	return h;
@@ -323,6 +346,9 @@ static void close_fds_free(struct xs_handle *h) {
 	}
 
         close(h->fd);
+
+	if (h->snap)
+		munmap((void *)h->snap, h->snap_size);
         
 	free(h);
 }
@@ -654,9 +680,130 @@ char **xs_directory(struct xs_handle *h, xs_transaction_t t,
  * Returns a malloced value: call free() on it after use.
  * len indicates length in bytes, not including the nul.
  */
+#ifndef NO_SOCKETS
+/* Map the current snapshot, if it is not the one we have already. */
+static void snap_remap(struct xs_handle *h)
+{
+	const char *path = xs_daemon_snapshot();
+	struct stat st;
+	void *map;
+	int fd;
+
+	if (!path || stat(path, &st) != 0)
+		return;
+	if (h->snap && st.st_ino == h->snap_ino)
+		return;
+	if (st.st_size < sizeof(struct xs_snapshot_hdr) ||
+	    st.st_size > UINT32_MAX)
+		return;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return;
+	/* The file may have been replaced since the stat(). */
+	if (fstat(fd, &st) == 0 && st.st_size >= sizeof(*h->snap) &&
+	    st.st_size <= UINT32_MAX) {
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (map != MAP_FAILED) {
+			if (h->snap)
+				munmap((void *)h->snap, h->snap_size);
+			h->snap = map;
+			h->snap_size = st.st_size;
+			h->snap_ino = st.st_ino;
+		}
+	}
+	close(fd);
+}
+
+static const struct xs_snapshot_entry *snap_lookup(
+	const struct xs_snapshot_hdr *snap, size_t size, const char *path)
+{
+	const struct xs_snapshot_entry *e;
+	const uint32_t *buckets;
+	size_t pathlen = strlen(path);
+	uint32_t hash = xs_snapshot_hash(path, pathlen);
+	uint32_t off, nr = snap->nr_buckets;
+
+	if (snap->magic != XS_SNAPSHOT_MAGIC || snap->size != size ||
+	    !nr || (nr & (nr - 1)) || snap->buckets & 3 ||
+	    snap->buckets > size ||
+	    (size - snap->buckets) / sizeof(*buckets) < nr)
+		return NULL;
+
+	buckets = (const void *)((const char *)snap + snap->buckets);
+	for (off = buckets[hash & (nr - 1)]; off; off = e->next) {
+		if (off & 3 || off > size - sizeof(*e))
+			return NULL;
+		e = (const void *)((const char *)snap + off);
+		if (e->pathlen > size - off - sizeof(*e) ||
+		    e->datalen > size - off - sizeof(*e) - e->pathlen)
+			return NULL;
+		if (e->hash == hash && e->pathlen == pathlen &&
+		    !memcmp(e->path, path, pathlen))
+			return e;
+	}
+
+	return NULL;
+}
+
+/*
+ * Read a node from the snapshot published by xenstored.  Returns NULL if
+ * the daemon has to be asked instead: there is no valid snapshot, or the
+ * node is not in it, in which case the daemon knows which error to give.
+ */
+static void *snap_read(struct xs_handle *h, const char *path,
+		       unsigned int *len)
+{
+	const struct xs_snapshot_entry *e;
+	char *ret = NULL;
+
+	mutex_lock(&h->snap_mutex);
+
+	if (!h->snap || !h->snap->valid)
+		snap_remap(h);
+	if (!h->snap || !h->snap->valid)
+		goto out;
+	__sync_synchronize();
+
+	e = snap_lookup(h->snap, h->snap_size, path);
+	if (!e)
+		goto out;
+
+	ret = malloc(e->datalen + 1);
+	if (!ret)
+		goto out;
+	memcpy(ret, e->path + e->pathlen, e->datalen);
+	ret[e->datalen] = '\0';
+
+	/* The store may have changed while we were copying. */
+	__sync_synchronize();
+	if (!h->snap->valid) {
+		free(ret);
+		ret = NULL;
+		goto out;
+	}
+	if (len)
+		*len = e->datalen;
+
+ out:
+	mutex_unlock(&h->snap_mutex);
+	return ret;
+}
+#endif
+
 void *xs_read(struct xs_handle *h, xs_transaction_t t,
 	      const char *path, unsigned int *len)
 {
+#ifndef NO_SOCKETS
+	void *ret;
+
+	if (h->use_snap && t == XBT_NULL && path[0] == '/') {
+		ret = snap_read(h, path, len);
+		if (ret)
+			return ret;
+	}
+#endif
+
 	return xs_single(h, t, XS_READ, path, len);
 }
 
@@ -769,6 +916,109 @@ unwind:
 	return false;
 }
 
+struct xs_batch {
+	unsigned int len;
+	char buf[XENSTORE_PAYLOAD_MAX];
+};
+
+struct xs_batch *xs_batch_new(void)
+{
+	struct xs_batch *b = malloc(sizeof(*b));
+
+	if (b)
+		b->len = 0;
+	return b;
+}
+
+void xs_batch_free(struct xs_batch *b)
+{
+	free_no_errno(b);
+}
+
+bool xs_batch_empty(struct xs_batch *b)
+{
+	return b->len == 0;
+}
+
+/* Append a sub-request, made of the strings path|arg1|arg2... */
+static bool xs_batch_add(struct xs_batch *b, enum xsd_sockmsg_type type,
+			 const char *path, const char *args,
+			 unsigned int args_len)
+{
+	struct xsd_sockmsg msg;
+	unsigned int path_len = strlen(path) + 1;
+
+	if (b->len + sizeof(msg) + path_len + args_len > sizeof(b->buf)) {
+		errno = E2BIG;
+		return false;
+	}
+
+	msg.type = type;
+	msg.req_id = 0;
+	msg.tx_id = 0;
+	msg.len = path_len + args_len;
+	memcpy(b->buf + b->len, &msg, sizeof(msg));
+	b->len += sizeof(msg);
+	memcpy(b->buf + b->len, path, path_len);
+	b->len += path_len;
+	if (args_len)
+		memcpy(b->buf + b->len, args, args_len);
+	b->len += args_len;
+
+	return true;
+}
+
+bool xs_batch_write(struct xs_batch *b, const char *path,
+		    const void *data, unsigned int len)
+{
+	return xs_batch_add(b, XS_WRITE, path, data, len);
+}
+
+bool xs_batch_mkdir(struct xs_batch *b, const char *path)
+{
+	return xs_batch_add(b, XS_MKDIR, path, NULL, 0);
+}
+
+bool xs_batch_rm(struct xs_batch *b, const char *path)
+{
+	return xs_batch_add(b, XS_RM, path, NULL, 0);
+}
+
+bool xs_batch_set_permissions(struct xs_batch *b, const char *path,
+			      struct xs_permissions *perms,
+			      unsigned int num_perms)
+{
+	char buffer[XENSTORE_PAYLOAD_MAX];
+	unsigned int i, len = 0;
+
+	for (i = 0; i < num_perms; i++) {
+		if (sizeof(buffer) - len < MAX_STRLEN(unsigned int) + 2) {
+			errno = E2BIG;
+			return false;
+		}
+		if (!xs_perm_to_string(&perms[i], buffer + len,
+				       sizeof(buffer) - len))
+			return false;
+		len += strlen(buffer + len) + 1;
+	}
+
+	return xs_batch_add(b, XS_SET_PERMS, path, buffer, len);
+}
+
+bool xs_batch_commit(struct xs_handle *h, xs_transaction_t t,
+		     struct xs_batch *b)
+{
+	struct iovec iovec;
+
+	iovec.iov_base = b->buf;
+	iovec.iov_len = b->len;
+	if (!xs_bool(xs_talkv(h, t, XS_BATCH, &iovec, 1, NULL)))
+		return false;
+
+	b->len = 0;
+	return true;
+}
+
 /* Watch a node for changes (poll on fd to detect, or call read_watch()).
  * When the node (or any child) changes, fd will become readable.
  * Token is returned when watch is read, to allow matching.
@@ -72,6 +72,17 @@ const char *xs_daemon_socket_ro(void)
 	return buf;
 }
 
+const char *xs_daemon_snapshot(void)
+{
+	static char buf[PATH_MAX];
+	const char *s = xs_daemon_path();
+	if (s == NULL)
+		return NULL;
+	if (snprintf(buf, sizeof(buf), "%s_snapshot", s) >= PATH_MAX)
+		return NULL;
+	return buf;
+}
+
 const char *xs_domain_dev(void)
 {
 	char *s = getenv("XENSTORED_PATH");
@@ -0,0 +1,65 @@
+/*
+    Layout of the read-only snapshot of the store shared by xenstored
+    with local clients.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef _XS_SNAPSHOT_H
+#define _XS_SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The snapshot is a file next to the daemon socket holding the value of
+ * every node, hashed by path.  It is written once and then only changes
+ * by valid dropping to zero, which xenstored does before the first
+ * modification of the store after the snapshot was taken.  A newer
+ * snapshot is a new file renamed over the old one.
+ *
+ * A reader must check valid both before and after copying a value; the
+ * value is current only if valid was set both times.  All offsets are
+ * from the start of the file, and 0 terminates a chain.
+ */
+
+#define XS_SNAPSHOT_MAGIC	0x58535331	/* "XSS1" */
+
+struct xs_snapshot_hdr {
+	uint32_t magic;
+	uint32_t valid;
+	uint32_t size;		/* Of the whole file. */
+	uint32_t nr_buckets;	/* A power of two. */
+	uint32_t buckets;	/* Offset of the uint32_t bucket array. */
+};
+
+struct xs_snapshot_entry {
+	uint32_t next;
+	uint32_t hash;
+	uint32_t pathlen;	/* Without nul. */
+	uint32_t datalen;
+	char path[];		/* Followed by data, then padding to 4 bytes. */
+};
+
+static inline uint32_t xs_snapshot_hash(const char *path, size_t len)
+{
+	uint32_t hash = 5381;
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		hash = ((hash << 5) + hash) + (unsigned char)path[i];
+
+	return hash;
+}
+
+#endif /* _XS_SNAPSHOT_H */
@@ -27,6 +27,17 @@ mread_handle_t mread_init(int fd)
     fstat(fd, &s);
     h->file_size = s.st_size;
 
+    /* xenalyze reads each pcpu's records from a different place in the
+     * file, so on hosts with many pcpus the windows below keep evicting
+     * each other.  Where the address space allows, map the whole file
+     * once instead, and leave paging it in to the kernel. */
+    if ( sizeof(void *) >= 8 && h->file_size > 0 )
+    {
+        h->whole = mmap(NULL, h->file_size, PROT_READ, MAP_SHARED, fd, 0);
+        if ( h->whole == MAP_FAILED )
+            h->whole = NULL;
+    }
+
     return h;
 }
 
@@ -66,6 +77,12 @@ ssize_t mread64(mread_handle_t h, void *rec, ssize_t len, off_t offset)
         len = h->file_size - offset;
     }
 
+    if ( h->whole )
+    {
+        bcopy(h->whole + offset, rec, len);
+        return len;
+    }
+
     /* Try to find the offset in our range */
     dprintf(warn, " Trying last, %d\n", last);
     if ( h->map[h->last].buffer
@@ -6,6 +6,7 @@
 typedef struct mread_ctrl {
     int fd;
     off_t file_size;
+    char * whole; /* The whole file, if it could be mapped at once */
     struct mread_buffer {
         char * buffer;
         off_t start_offset;
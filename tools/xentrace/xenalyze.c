@@ -1474,6 +1474,7 @@ enum {
     PV_PTWR_EMULATION_PAE,
     PV_HYPERCALL_V2 = 13,
     PV_HYPERCALL_SUBCALL = 14,
+    PV_MULTICALL = 15,
     PV_MAX
 };
 
@@ -1491,6 +1492,7 @@ char *pv_name[PV_MAX] = {
     [PV_PTWR_EMULATION_PAE]="ptwr(pae)",
     [PV_HYPERCALL_V2]="hypercall",
     [PV_HYPERCALL_SUBCALL]="hypercall (subcall)",
+    [PV_MULTICALL]="multicall",
 };
 
 #define PV_HYPERCALL_MAX 56
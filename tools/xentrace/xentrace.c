@@ -22,9 +22,11 @@
 #include <inttypes.h>
 #include <string.h>
 #include <getopt.h>
+#include <limits.h>
 #include <assert.h>
 #include <ctype.h>
 #include <poll.h>
+#include <pthread.h>
 #include <sys/statvfs.h>
 
 #include <xen/xen.h>
@@ -43,6 +45,11 @@ do {                                                            \
 } while (0)
 
 
+/* *BSD has no O_LARGEFILE */
+#ifndef O_LARGEFILE
+#define O_LARGEFILE	0
+#endif
+
 /***** Compile time configuration of defaults ********************************/
 
 /* sleep for this long (milliseconds) between checking the trace buffers */
@@ -62,7 +69,8 @@ typedef struct settings_st {
     unsigned long memory_buffer;
     uint8_t discard:1,
         disable_tracing:1,
-        start_disabled:1;
+        start_disabled:1,
+        per_cpu:1;
 } settings_t;
 
 struct t_struct {
@@ -343,8 +351,8 @@ fail:
  * Outputs the trace buffer to a filestream, prepending the CPU and size
  * of the buffer write.
  */
-static void write_buffer(unsigned int cpu, unsigned char *start, int size,
-                         int total_size)
+static void write_buffer(int fd, unsigned int cpu, unsigned char *start,
+                         int size, int total_size)
 {
     struct statvfs stat;
     size_t written = 0;
@@ -354,7 +362,7 @@ static void write_buffer(unsigned int cpu, unsigned char *start, int size,
         unsigned long long freespace;
 
         /* Check that filesystem has enough space. */
-        if ( fstatvfs (outfd, &stat) )
+        if ( fstatvfs (fd, &stat) )
         {
             fprintf(stderr, "Statfs failed!\n");
             goto fail;
@@ -393,7 +401,7 @@ static void write_buffer(unsigned int cpu, unsigned char *start, int size,
             rec.data.cpu = cpu;
             rec.data.window_size = total_size;
 
-            written = write(outfd, &rec, sizeof(rec));
+            written = write(fd, &rec, sizeof(rec));
             if ( written != sizeof(rec) )
             {
                 fprintf(stderr, "Cannot write cpu change (write returned %zd)\n",
@@ -409,7 +417,7 @@ static void write_buffer(unsigned int cpu, unsigned char *start, int size,
     }
     else
     {
-        written = write(outfd, start, size);
+        written = write(fd, start, size);
         if ( written != size )
         {
             fprintf(stderr, "Write failed! (size %d, returned %zd)\n",
@@ -658,6 +666,189 @@ static void wait_for_event_or_timeout(unsigned long milliseconds)
 }
 
 
+/**
+ * drain_buffer - write out whatever one CPU's trace buffer holds
+ * @fd:        file to write to
+ * @cpu:       the CPU the buffer belongs to
+ */
+static void drain_buffer(int fd, unsigned int cpu, struct t_buf *meta,
+                         unsigned char *data, unsigned long data_size)
+{
+    unsigned long start_offset, end_offset, window_size, cons, prod;
+
+    /* Read window information only once. */
+    cons = meta->cons;
+    prod = meta->prod;
+    xen_rmb(); /* read prod, then read item. */
+
+    if ( cons == prod )
+        return;
+
+    assert(cons < 2*data_size);
+    assert(prod < 2*data_size);
+
+    // NB: if (prod<cons), then (prod-cons)%data_size will not yield
+    // the correct answer because data_size is not a power of 2.
+    if ( prod < cons )
+        window_size = (prod + 2*data_size) - cons;
+    else
+        window_size = prod - cons;
+    assert(window_size > 0);
+    assert(window_size <= data_size);
+
+    start_offset = cons % data_size;
+    end_offset = prod % data_size;
+
+    if ( end_offset > start_offset )
+    {
+        /* If window does not wrap, write in one big chunk */
+        write_buffer(fd, cpu, data + start_offset,
+                     window_size,
+                     window_size);
+    }
+    else
+    {
+        /* If wrapped, write in two chunks:
+         * - first, start to the end of the buffer
+         * - second, start of buffer to end of window
+         */
+        write_buffer(fd, cpu, data + start_offset,
+                     data_size - start_offset,
+                     window_size);
+        write_buffer(fd, cpu, data,
+                     end_offset,
+                     0);
+    }
+
+    xen_mb(); /* read buffer, then update cons. */
+    meta->cons = prod;
+}
+
+/*
+ * With --per-cpu, each CPU's buffer gets a thread of its own writing it
+ * straight from the mapping to a file of its own, so a CPU producing
+ * records quickly doesn't wait for the writes of all the others.  The
+ * main thread still takes the VIRQ and wakes the writers.
+ */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    unsigned long generation;
+    int stop;
+    unsigned int nr;
+    pthread_t *threads;
+} writers = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+struct writer {
+    unsigned int cpu;
+    int fd;
+    struct t_buf *meta;
+    unsigned char *data;
+    unsigned long data_size;
+};
+
+static void *writer_thread(void *arg)
+{
+    struct writer *w = arg;
+    unsigned long seen = 0;
+    int stop;
+
+    do {
+        pthread_mutex_lock(&writers.lock);
+        while ( writers.generation == seen && !writers.stop )
+            pthread_cond_wait(&writers.cond, &writers.lock);
+        seen = writers.generation;
+        stop = writers.stop;
+        pthread_mutex_unlock(&writers.lock);
+
+        drain_buffer(w->fd, w->cpu, w->meta, w->data, w->data_size);
+    } while ( !stop );
+
+    close(w->fd);
+    free(w);
+
+    return NULL;
+}
+
+static void wake_writers(int stop)
+{
+    pthread_mutex_lock(&writers.lock);
+    writers.generation++;
+    writers.stop = stop;
+    pthread_cond_broadcast(&writers.cond);
+    pthread_mutex_unlock(&writers.lock);
+}
+
+static void start_writers(unsigned int num, struct t_buf **meta,
+                          unsigned char **data, unsigned long data_size)
+{
+    sigset_t set, old;
+    unsigned int i;
+    char name[PATH_MAX];
+    int rc;
+
+    writers.threads = calloc(num, sizeof(*writers.threads));
+    if ( !writers.threads )
+    {
+        PERROR("Failed to allocate writer threads");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Signals are for the main thread, which does the final read. */
+    sigfillset(&set);
+    pthread_sigmask(SIG_BLOCK, &set, &old);
+
+    for ( i = 0; i < num; i++ )
+    {
+        struct writer *w = calloc(1, sizeof(*w));
+
+        if ( !w )
+        {
+            PERROR("Failed to allocate writer");
+            exit(EXIT_FAILURE);
+        }
+
+        snprintf(name, sizeof(name), "%s.%u", opts.outfile, i);
+
+        w->cpu = i;
+        w->meta = meta[i];
+        w->data = data[i];
+        w->data_size = data_size;
+        w->fd = open(name, O_WRONLY | O_CREAT | O_TRUNC | O_LARGEFILE, 0644);
+        if ( w->fd < 0 )
+        {
+            PERROR("Could not open output file %s", name);
+            exit(EXIT_FAILURE);
+        }
+
+        rc = pthread_create(&writers.threads[i], NULL, writer_thread, w);
+        if ( rc )
+        {
+            errno = rc;
+            PERROR("Failed to start writer for cpu %u", i);
+            exit(EXIT_FAILURE);
+        }
+        writers.nr++;
+    }
+
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+static void stop_writers(void)
+{
+    unsigned int i;
+
+    wake_writers(1);
+
+    for ( i = 0; i < writers.nr; i++ )
+        pthread_join(writers.threads[i], NULL);
+
+    free(writers.threads);
+}
+
 /**
  * monitor_tbufs - monitor the contents of tbufs and output to a file
  * @logfile:       the FILE * representing the file to log to
@@ -704,61 +895,17 @@ static int monitor_tbufs(void)
         for ( i = 0; i < num; i++ )
             meta[i]->cons = meta[i]->prod;
 
+    if ( opts.per_cpu )
+        start_writers(num, meta, data, data_size);
+
     /* now, scan buffers for events */
     while ( 1 )
     {
-        for ( i = 0; i < num; i++ )
-        {
-            unsigned long start_offset, end_offset, window_size, cons, prod;
-                
-            /* Read window information only once. */
-            cons = meta[i]->cons;
-            prod = meta[i]->prod;
-            xen_rmb(); /* read prod, then read item. */
-
-            if ( cons == prod )
-                continue;
-           
-            assert(cons < 2*data_size);
-            assert(prod < 2*data_size);
-
-            // NB: if (prod<cons), then (prod-cons)%data_size will not yield
-            // the correct answer because data_size is not a power of 2.
-            if ( prod < cons )
-                window_size = (prod + 2*data_size) - cons;
-            else
-                window_size = prod - cons;
-            assert(window_size > 0);
-            assert(window_size <= data_size);
-
-            start_offset = cons % data_size;
-            end_offset = prod % data_size;
-
-            if ( end_offset > start_offset )
-            {
-                /* If window does not wrap, write in one big chunk */
-                write_buffer(i, data[i]+start_offset,
-                             window_size,
-                             window_size);
-            }
-            else
-            {
-                /* If wrapped, write in two chunks:
-                 * - first, start to the end of the buffer
-                 * - second, start of buffer to end of window
-                 */
-                write_buffer(i, data[i] + start_offset,
-                             data_size - start_offset,
-                             window_size);
-                write_buffer(i, data[i],
-                             end_offset,
-                             0);
-            }
-
-            xen_mb(); /* read buffer, then update cons. */
-            meta[i]->cons = prod;
-
-        }
+        if ( opts.per_cpu )
+            wake_writers(0);
+        else
+            for ( i = 0; i < num; i++ )
+                drain_buffer(outfd, i, meta[i], data[i], data_size);
 
         if ( interrupted )
         {
@@ -777,6 +924,9 @@ static int monitor_tbufs(void)
         wait_for_event_or_timeout(opts.poll_sleep);
     }
 
+    if ( opts.per_cpu )
+        stop_writers();
+
     if ( opts.memory_buffer )
         membuf_dump();
 
@@ -784,7 +934,8 @@ static int monitor_tbufs(void)
     free(meta);
     free(data);
     /* don't need to munmap - cleanup is automatic */
-    close(outfd);
+    if ( outfd >= 0 )
+        close(outfd);
 
     return 0;
 }
@@ -835,6 +986,9 @@ static void usage(void)
 "  -r  --reserve-disk-space=n Before writing trace records to disk, check to see\n" \
 "                          that after the write there will be at least n space\n" \
 "                          left on the disk.\n" \
+"  -P, --per-cpu           Write each CPU's records to <output file>.<cpu>\n" \
+"                          from a thread of its own.  Concatenate the files\n" \
+"                          to get input for xenalyze.\n" \
 "\n" \
 "This tool is used to capture trace buffer data from Xen. The\n" \
 "data is output in a binary format, in the following order:\n" \
@@ -1083,12 +1237,13 @@ static void parse_args(int argc, char **argv)
         { "discard-buffers", no_argument,      0, 'D' },
         { "dont-disable-tracing", no_argument, 0, 'x' },
         { "start-disabled", no_argument,       0, 'X' },
+        { "per-cpu",        no_argument,       0, 'P' },
         { "help",           no_argument,       0, '?' },
         { "version",        no_argument,       0, 'V' },
         { 0, 0, 0, 0 }
     };
 
-    while ( (option = getopt_long(argc, argv, "t:s:c:e:S:r:T:M:DxX?V",
+    while ( (option = getopt_long(argc, argv, "t:s:c:e:S:r:T:M:DxXP?V",
                     long_options, NULL)) != -1) 
     {
         switch ( option )
@@ -1137,6 +1292,10 @@ static void parse_args(int argc, char **argv)
             opts.memory_buffer = sargtol(optarg, 0);
             break;
 
+        case 'P':
+            opts.per_cpu = 1;
+            break;
+
         default:
             usage();
         }
@@ -1147,12 +1306,13 @@ static void parse_args(int argc, char **argv)
         usage();
 
     opts.outfile = argv[optind];
-}
 
-/* *BSD has no O_LARGEFILE */
-#ifndef O_LARGEFILE
-#define O_LARGEFILE	0
-#endif
+    if ( opts.per_cpu && opts.memory_buffer )
+    {
+        fprintf(stderr, "--per-cpu and --memory-buffer can't be combined.\n");
+        exit(EXIT_FAILURE);
+    }
+}
 
 int main(int argc, char **argv)
 {
@@ -1189,18 +1349,20 @@ int main(int argc, char **argv)
     if ( opts.timeout != 0 ) 
         alarm(opts.timeout);
 
-    if ( opts.outfile )
+    if ( opts.per_cpu )
+        outfd = -1;
+    else if ( opts.outfile )
         outfd = open(opts.outfile,
                      O_WRONLY | O_CREAT | O_TRUNC | O_LARGEFILE,
                      0644);
 
-    if ( outfd < 0 )
+    if ( outfd < 0 && !opts.per_cpu )
     {
         perror("Could not open output file");
         exit(EXIT_FAILURE);
     }        
 
-    if ( isatty(outfd) )
+    if ( !opts.per_cpu && isatty(outfd) )
     {
         fprintf(stderr, "Cannot output to a TTY, specify a log file.\n");
         exit(EXIT_FAILURE);
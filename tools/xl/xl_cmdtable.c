@@ -34,7 +34,12 @@ struct cmd_spec cmd_table[] = {
       "-e                      Do not wait in the background for the death of the domain.\n"
       "-V, --vncviewer         Connect to the VNC display after the domain is created.\n"
       "-A, --vncviewer-autopass\n"
-      "                        Pass VNC password to viewer via stdin."
+      "                        Pass VNC password to viewer via stdin.\n"
+      "-b FILE, --batch=FILE   Create the domains of all the config files listed\n"
+      "                        in FILE, one per line, without monitoring them.\n"
+      "-j N, --parallel=N      With -b, create at most N domains at a time.\n"
+      "--trace=FILE            Write the time taken by each phase of the creation\n"
+      "                        to FILE, in Chrome trace event format."
     },
     { "config-update",
       &main_config_update, 1, 1,
@@ -63,7 +68,9 @@ struct cmd_spec cmd_table[] = {
       "[options] <Domain>\n",
       "-f                      Permit destroying domain 0, which will only succeed\n"
       "                        when run from disaggregated toolstack domain with a\n"
-      "                        hardware domain distinct from domain 0."
+      "                        hardware domain distinct from domain 0.\n"
+      "-b FILE, --batch=FILE   Destroy all the domains listed in FILE, one per line.\n"
+      "-j N, --parallel=N      With -b, destroy at most N domains at a time."
     },
     { "shutdown",
       &main_shutdown, 0, 1,
@@ -149,9 +156,14 @@ struct cmd_spec cmd_table[] = {
       &main_save, 0, 1,
       "Save a domain state to restore later",
       "[options] <Domain> <CheckpointFile> [<ConfigFile>]",
-      "-h  Print this help.\n"
-      "-c  Leave domain running after creating the snapshot.\n"
-      "-p  Leave domain paused after creating the snapshot."
+      "-h                      Print this help.\n"
+      "-c                      Leave domain running after creating the snapshot.\n"
+      "-p                      Leave domain paused after creating the snapshot.\n"
+      "-l, --live              Keep the domain running while most of its memory\n"
+      "                        is written out.\n"
+      "-b FILE, --batch=FILE   Save all the domains listed in FILE, one\n"
+      "                        \"<Domain> <CheckpointFile>\" pair per line.\n"
+      "-j N, --parallel=N      With -b, save at most N domains at a time."
     },
     { "migrate",
       &main_migrate, 0, 1,
@@ -279,6 +291,12 @@ struct cmd_spec cmd_table[] = {
       "-p PERIOD, --period=PERIOD     Period (us)\n"
       "-b BUDGET, --budget=BUDGET     Budget (us)\n"
     },
+    { "sched-null",
+      &main_sched_null, 0, 0,
+      "List the vcpu assigned to each cpu by the null scheduler",
+      "[-p CPUPOOL]",
+      "-p CPUPOOL, --cpupool=CPUPOOL  Cpupool to list (default: Pool-0)"
+    },
     { "domid",
       &main_domid, 0, 0,
       "Convert a domain name to domain id",
@@ -383,6 +401,17 @@ struct cmd_spec cmd_table[] = {
       "",
       "",
     },
+    { "evtchn-stats",
+      &main_evtchn_stats, 0, 0,
+      "List event channel delivery statistics of a domain",
+      "<Domain>",
+    },
+    { "irq-stats",
+      &main_irq_stats, 0, 0,
+      "List interrupt delivery statistics of HVM domains",
+      "[-a] [Domain]",
+      "-a, --apic   List the emulated local APIC accesses instead",
+    },
     { "tmem-list",
       &main_tmem_list, 0, 0,
       "List tmem pools",
@@ -463,7 +492,9 @@ struct cmd_spec cmd_table[] = {
     { "cpupool-migrate",
       &main_cpupoolmigrate, 0, 1,
       "Moves a domain into a CPU pool",
-      "<Domain> <CPU Pool>",
+      "[options] <Domain> <CPU Pool>",
+      "-m, --move-memory       Also move the domain's memory onto the pool's\n"
+      "                        NUMA nodes (HVM domains only)."
     },
     { "cpupool-numa-split",
       &main_cpupoolnumasplit, 0, 1,
@@ -491,7 +522,9 @@ struct cmd_spec cmd_table[] = {
       "Enable Remus HA for domain",
       "[options] <Domain> [<host>]",
       "-i MS                   Checkpoint domain memory every MS milliseconds (def. 200ms).\n"
+      "                        With -c, wait at least MS milliseconds between checkpoints.\n"
       "-u                      Disable memory checkpoint compression.\n"
+      "-A                      Write memory checkpoints with the domain paused.\n"
       "-s <sshcommand>         Use <sshcommand> instead of ssh.  String will be passed\n"
       "                        to sh. If empty, run <host> instead of \n"
       "                        ssh <host> xl migrate-receive -r [-e]\n"
@@ -505,7 +538,7 @@ struct cmd_spec cmd_table[] = {
       "                        Works only in unsafe mode.\n"
       "-n                      Disable network output buffering. Works only in unsafe mode.\n"
       "-d                      Disable disk replication. Works only in unsafe mode.\n"
-      "-c                      Enable COLO HA. It is conflict with -i and -b, and memory\n"
+      "-c                      Enable COLO HA. It is conflict with -b, and memory\n"
       "                        checkpoint must be disabled.\n"
       "-p                      Use COLO userspace proxy."
     },
@@ -524,6 +557,7 @@ struct cmd_spec cmd_table[] = {
       "[options]",
       "-m, --cmt       Show Cache Monitoring Technology (CMT) hardware info\n"
       "-a, --cat       Show Cache Allocation Technology (CAT) hardware info\n"
+      "-b, --mba       Show Memory Bandwidth Allocation (MBA) hardware info\n"
     },
     { "psr-cmt-attach",
       &main_psr_cmt_attach, 0, 1,
@@ -560,6 +594,19 @@ struct cmd_spec cmd_table[] = {
       "<Domain>",
     },
 
+#endif
+#ifdef LIBXL_HAVE_PSR_MBA
+    { "psr-mba-set",
+      &main_psr_mba_set, 0, 1,
+      "Set memory bandwidth throttling for a domain",
+      "[options] <Domain> <THRTL>",
+      "-s <socket>       Specify the socket to process, otherwise all sockets are processed\n"
+    },
+    { "psr-mba-show",
+      &main_psr_mba_show, 0, 1,
+      "Show Memory Bandwidth Allocation information",
+      "<Domain>",
+    },
 #endif
     { "usbctrl-attach",
       &main_usbctrl_attach, 0, 1,
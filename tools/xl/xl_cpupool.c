@@ -12,6 +12,7 @@
  * GNU Lesser General Public License for more details.
  */
 
+#include <inttypes.h>
 #include <limits.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -433,6 +434,23 @@ out:
     return rc;
 }
 
+static void rehome_progress(libxl_ctx *ctx_ignored,
+                            libxl_event *ev, void *priv)
+{
+    uint64_t done = ev->u.domain_memory_rehome_progress.gfns_done;
+    uint64_t total = ev->u.domain_memory_rehome_progress.gfns_total;
+
+    fprintf(stderr, "\rMoving memory: %3"PRIu64"%%, %"PRIu64" MiB moved, "
+            "%"PRIu64" MiB in use elsewhere",
+            total ? done * 100 / total : 100,
+            ev->u.domain_memory_rehome_progress.moved_pages >> 8,
+            ev->u.domain_memory_rehome_progress.busy_pages >> 8);
+    if (done == total)
+        fputc('\n', stderr);
+
+    libxl_event_free(ctx, ev);
+}
+
 int main_cpupoolmigrate(int argc, char **argv)
 {
     int opt;
@@ -440,9 +458,17 @@ int main_cpupoolmigrate(int argc, char **argv)
     uint32_t poolid;
     const char *dom;
     uint32_t domid;
+    int move_memory = 0;
+    libxl_asyncprogress_how progress_how;
+    static struct option opts[] = {
+        {"move-memory", 0, 0, 'm'},
+        COMMON_LONG_OPTS
+    };
 
-    SWITCH_FOREACH_OPT(opt, "", NULL, "cpupool-migrate", 2) {
-        /* No options */
+    SWITCH_FOREACH_OPT(opt, "m", opts, "cpupool-migrate", 2) {
+    case 'm':
+        move_memory = 1;
+        break;
     }
 
     dom = argv[optind++];
@@ -463,6 +489,16 @@ int main_cpupoolmigrate(int argc, char **argv)
     if (libxl_cpupool_movedomain(ctx, poolid, domid))
         return EXIT_FAILURE;
 
+    if (move_memory) {
+        progress_how.callback = rehome_progress;
+        progress_how.for_event = 0;
+        progress_how.for_callback = NULL;
+        if (libxl_domain_rehome_memory(ctx, domid, NULL, &progress_how)) {
+            fprintf(stderr, "\nmoving the memory of '%s' failed\n", dom);
+            return EXIT_FAILURE;
+        }
+    }
+
     return EXIT_SUCCESS;
 }
 
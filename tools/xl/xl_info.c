@@ -260,6 +260,19 @@ static void output_numainfo(void)
         }
     }
 
+    printf("free_chunks            :\n");
+    printf("node:    order:count ...\n");
+
+    for (i = 0; i < nr; i++) {
+        if (!info[i].num_free_chunks)
+            continue;
+        printf("%4d:   ", i);
+        for (j = 0; j < info[i].num_free_chunks; j++)
+            if (info[i].free_chunks[j])
+                printf(" %d:%"PRIu64, j, info[i].free_chunks[j]);
+        printf("\n");
+    }
+
     libxl_numainfo_list_free(info, nr);
 
     return;
@@ -358,7 +371,9 @@ static void list_vm(void)
 static void list_domains(bool verbose, bool context, bool claim, bool numa,
                          bool cpupool, const libxl_dominfo *info, int nb_domain)
 {
-    int i;
+    int i, j, nr_pools = 0;
+    uint32_t *pool_ids = NULL;
+    char **pool_names = NULL;
     static const char shutdown_reason_letters[]= "-rscwS";
     libxl_bitmap nodemap;
     libxl_physinfo physinfo;
@@ -416,9 +431,19 @@ static void list_domains(bool verbose, bool context, bool claim, bool numa,
         if (verbose || context)
             printf(" %16s", info[i].ssid_label ? : "-");
         if (cpupool) {
-            char *poolname = libxl_cpupoolid_to_name(ctx, info[i].cpupool);
-            printf("%16s", poolname);
-            free(poolname);
+            /* There are few pools: only look each one's name up once. */
+            for (j = 0; j < nr_pools; j++)
+                if (pool_ids[j] == info[i].cpupool)
+                    break;
+            if (j == nr_pools) {
+                pool_ids = xrealloc(pool_ids, sizeof(*pool_ids) * (j + 1));
+                pool_names = xrealloc(pool_names,
+                                      sizeof(*pool_names) * (j + 1));
+                pool_ids[j] = info[i].cpupool;
+                pool_names[j] = libxl_cpupoolid_to_name(ctx, info[i].cpupool);
+                nr_pools++;
+            }
+            printf("%16s", pool_names[j]);
         }
         if (numa) {
             libxl_domain_get_nodeaffinity(ctx, info[i].domid, &nodemap);
@@ -429,6 +454,10 @@ static void list_domains(bool verbose, bool context, bool claim, bool numa,
         putchar('\n');
     }
 
+    for (j = 0; j < nr_pools; j++)
+        free(pool_names[j]);
+    free(pool_names);
+    free(pool_ids);
     libxl_bitmap_dispose(&nodemap);
     libxl_physinfo_dispose(&physinfo);
 }
@@ -469,6 +498,17 @@ static void list_domains_details(const libxl_dominfo *info, int nb_domain)
         libxl_domain_config_dispose(&d_config);
         if (s != yajl_gen_status_ok)
             goto out;
+
+        /* Print each domain as soon as it is retrieved, rather than
+         * building up the output for all of them. */
+        if (default_output_format == OUTPUT_FORMAT_JSON) {
+            s = yajl_gen_get_buf(hand, (const unsigned char **)&buf,
+                                 &yajl_len);
+            if (s != yajl_gen_status_ok)
+                goto out;
+            fwrite(buf, 1, yajl_len, stdout);
+            yajl_gen_clear(hand);
+        }
     }
 
     if (default_output_format == OUTPUT_FORMAT_JSON) {
@@ -721,6 +761,115 @@ int main_claims(int argc, char **argv)
     return 0;
 }
 
+int main_evtchn_stats(int argc, char **argv)
+{
+    libxl_evtchn_stats totals, *list;
+    uint32_t domid;
+    int opt, nr, i;
+
+    SWITCH_FOREACH_OPT(opt, "", NULL, "evtchn-stats", 1) {
+        /* No options */
+    }
+
+    domid = find_domain(argv[optind]);
+
+    if (libxl_evtchn_stats_list(ctx, domid, &totals, &list, &nr)) {
+        fprintf(stderr, "cannot get event channel statistics of domain %u\n",
+                domid);
+        return EXIT_FAILURE;
+    }
+
+    printf("%-8s %20s %20s %20s\n", "Port", "Sent", "Coalesced",
+           "Link-retries");
+    for (i = 0; i < nr; i++)
+        printf("%-8u %20"PRIu64" %20"PRIu64" %20"PRIu64"\n",
+               list[i].port, list[i].sent, list[i].coalesced,
+               list[i].link_retries);
+    printf("%-8s %20"PRIu64" %20"PRIu64" %20"PRIu64"\n", "Total",
+           totals.sent, totals.coalesced, totals.link_retries);
+
+    libxl_evtchn_stats_list_free(list, nr);
+    libxl_evtchn_stats_dispose(&totals);
+
+    return EXIT_SUCCESS;
+}
+
+static int print_irq_stats(uint32_t domid, bool apic, bool quiet)
+{
+    libxl_irq_stats stats;
+    char *name;
+    int rc;
+
+    rc = libxl_domain_irq_stats(ctx, domid, &stats);
+    if (rc) {
+        if (!quiet)
+            fprintf(stderr, "cannot get interrupt statistics of domain %u%s\n",
+                    domid, rc == ERROR_INVAL ? " (not an HVM domain)" : "");
+        return rc;
+    }
+
+    name = libxl_domid_to_name(ctx, domid);
+    if (apic)
+        printf("%-32s %5u %14"PRIu64" %14"PRIu64" %14"PRIu64" %14"PRIu64
+               " %14"PRIu64"\n", name ? name : "", domid,
+               stats.apic_icr_exits, stats.apic_eoi_exits,
+               stats.apic_tpr_exits, stats.apic_timer_exits,
+               stats.apic_other_exits);
+    else
+        printf("%-40s %5u %20"PRIu64" %20"PRIu64" %20"PRIu64"\n",
+               name ? name : "", domid, stats.extint_exits,
+               stats.guest_irq_exits, stats.pi_wakeups);
+    free(name);
+    libxl_irq_stats_dispose(&stats);
+
+    return 0;
+}
+
+int main_irq_stats(int argc, char **argv)
+{
+    libxl_dominfo *info;
+    int opt, nb_domain, i, rc = 0;
+    bool apic = false;
+    static struct option opts[] = {
+        {"apic", 0, 0, 'a'},
+        COMMON_LONG_OPTS
+    };
+
+    SWITCH_FOREACH_OPT(opt, "a", opts, "irq-stats", 0) {
+    case 'a':
+        apic = true;
+        break;
+    }
+
+    if (apic)
+        printf("%-32s %5s %14s %14s %14s %14s %14s\n", "Name", "ID",
+               "ICR-exits", "EOI-exits", "TPR-exits", "Timer-exits",
+               "Other-exits");
+    else
+        printf("%-40s %5s %20s %20s %20s\n", "Name", "ID", "Extint-exits",
+               "Guest-IRQ-exits", "PI-wakeups");
+
+    if (optind < argc)
+        return print_irq_stats(find_domain(argv[optind]), apic, false)
+               ? EXIT_FAILURE : EXIT_SUCCESS;
+
+    info = libxl_list_domain(ctx, &nb_domain);
+    if (!info) {
+        fprintf(stderr, "libxl_list_domain failed.\n");
+        return EXIT_FAILURE;
+    }
+
+    /* Domains which aren't HVM have nothing to report. */
+    for (i = 0; i < nb_domain; i++)
+        if (print_irq_stats(info[i].domid, apic, true) &&
+            info[i].domain_type == LIBXL_DOMAIN_TYPE_HVM)
+            rc = EXIT_FAILURE;
+
+    libxl_dominfo_list_free(info, nb_domain);
+
+    return rc ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
 static char *current_time_to_string(time_t now)
 {
     char now_str[100];
@@ -614,7 +614,7 @@ int main_remus(int argc, char **argv)
 
     memset(&r_info, 0, sizeof(libxl_domain_remus_info));
 
-    SWITCH_FOREACH_OPT(opt, "Fbundi:s:N:ecp", NULL, "remus", 2) {
+    SWITCH_FOREACH_OPT(opt, "FbuAndi:s:N:ecp", NULL, "remus", 2) {
     case 'i':
         r_info.interval = atoi(optarg);
         break;
@@ -627,6 +627,9 @@ int main_remus(int argc, char **argv)
     case 'u':
         libxl_defbool_set(&r_info.compression, false);
         break;
+    case 'A':
+        libxl_defbool_set(&r_info.async_checkpoint, false);
+        break;
     case 'n':
         libxl_defbool_set(&r_info.netbuf, false);
         break;
@@ -667,10 +670,10 @@ int main_remus(int argc, char **argv)
     }
 
     if (libxl_defbool_val(r_info.colo)) {
-        if (r_info.interval || libxl_defbool_val(r_info.blackhole) ||
+        if (libxl_defbool_val(r_info.blackhole) ||
             !libxl_defbool_is_default(r_info.netbuf) ||
             !libxl_defbool_is_default(r_info.diskbuf)) {
-            perror("option -c is conflict with -i, -d, -n or -b");
+            perror("option -c is conflict with -d, -n or -b");
             exit(-1);
         }
 
@@ -252,6 +252,51 @@ int parse_cpurange(const char *cpu, libxl_bitmap *cpumap)
     return rc;
 }
 
+/*
+ * Takes a comma separated list of CLASS=PRIORITY items, e.g.
+ * "timer=0,interdomain=2", and fills in the matching event channel
+ * priorities.
+ */
+static int parse_evtchn_priority(const char *str, libxl_evtchn_priority *prio)
+{
+    char *ptr, *saveptr = NULL, *buf = xstrdup(str), *oparg, *endptr;
+    int *p, rc = 0;
+    long l;
+
+    for (ptr = strtok_r(buf, ",", &saveptr); ptr;
+         ptr = strtok_r(NULL, ",", &saveptr)) {
+        if (MATCH_OPTION("timer", ptr, oparg))
+            p = &prio->timer;
+        else if (MATCH_OPTION("virq", ptr, oparg))
+            p = &prio->virq;
+        else if (MATCH_OPTION("ipi", ptr, oparg))
+            p = &prio->ipi;
+        else if (MATCH_OPTION("pirq", ptr, oparg))
+            p = &prio->pirq;
+        else if (MATCH_OPTION("interdomain", ptr, oparg))
+            p = &prio->interdomain;
+        else {
+            fprintf(stderr, "Unknown event channel class in \"%s\"\n", ptr);
+            rc = ERROR_INVAL;
+            break;
+        }
+
+        l = strtol(oparg, &endptr, 10);
+        if (*oparg == '\0' || *endptr != '\0' ||
+            l < 0 || l > LIBXL_EVTCHN_PRIORITY_MAX) {
+            fprintf(stderr, "Invalid event channel priority in \"%s\", "
+                    "expecting 0 (highest) to %d\n",
+                    ptr, LIBXL_EVTCHN_PRIORITY_MAX);
+            rc = ERROR_INVAL;
+            break;
+        }
+        *p = l;
+    }
+    free(buf);
+
+    return rc;
+}
+
 static void parse_top_level_vnc_options(XLU_Config *config,
                                         libxl_vnc_info *vnc)
 {
@@ -1027,12 +1072,17 @@ void parse_config_data(const char *config_source,
     if (!xlu_cfg_get_long(config, "max_event_channels", &l, 0))
         b_info->event_channels = l;
 
+    if (!xlu_cfg_get_string(config, "evtchn_priority", &buf, 0) &&
+        parse_evtchn_priority(buf, &b_info->evtchn_priority))
+        exit(1);
+
     xlu_cfg_replace_string (config, "kernel", &b_info->kernel, 0);
     xlu_cfg_replace_string (config, "ramdisk", &b_info->ramdisk, 0);
     xlu_cfg_replace_string (config, "device_tree", &b_info->device_tree, 0);
     b_info->cmdline = parse_cmdline(config);
 
     xlu_cfg_get_defbool(config, "driver_domain", &c_info->driver_domain, 0);
+    xlu_cfg_get_defbool(config, "async_backends", &c_info->async_backends, 0);
     xlu_cfg_get_defbool(config, "acpi", &b_info->acpi, 0);
 
     switch(b_info->type) {
@@ -1069,6 +1119,7 @@ void parse_config_data(const char *config_source,
         xlu_cfg_get_defbool(config, "nx", &b_info->u.hvm.nx, 0);
         xlu_cfg_get_defbool(config, "hpet", &b_info->u.hvm.hpet, 0);
         xlu_cfg_get_defbool(config, "vpt_align", &b_info->u.hvm.vpt_align, 0);
+        xlu_cfg_get_defbool(config, "vpt_lazy", &b_info->u.hvm.vpt_lazy, 0);
 
         switch (xlu_cfg_get_list(config, "viridian",
                                  &viridian, &num_viridian, 1))
@@ -1155,6 +1206,9 @@ void parse_config_data(const char *config_source,
         }
 
         xlu_cfg_get_defbool(config, "nestedhvm", &b_info->u.hvm.nested_hvm, 0);
+        xlu_cfg_get_defbool(config, "numa_balancing", &b_info->numa_balancing, 0);
+        xlu_cfg_get_defbool(config, "superpages_strict",
+                            &b_info->superpages_strict, 0);
 
         if (!xlu_cfg_get_defbool(config, "altp2mhvm", &b_info->u.hvm.altp2m, 0))
             fprintf(stderr, "WARNING: Specifying \"altp2mhvm\" is deprecated. "
@@ -1182,6 +1236,9 @@ void parse_config_data(const char *config_source,
 
         if (!xlu_cfg_get_long (config, "rdm_mem_boundary", &l, 0))
             b_info->u.hvm.rdm_mem_boundary_memkb = l * 1024;
+
+        if (!xlu_cfg_get_long (config, "unshare_pool", &l, 0))
+            b_info->u.hvm.unshare_pool_memkb = l * 1024;
         break;
     case LIBXL_DOMAIN_TYPE_PV:
     {
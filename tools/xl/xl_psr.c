@@ -434,6 +434,27 @@ out:
     return rc;
 }
 
+/* Add the sockets of a list like "0,2-3" to 'target_map'. */
+static void psr_parse_socket_list(const char *arg, libxl_bitmap *target_map)
+{
+    char *value;
+    libxl_string_list socket_list;
+    unsigned long start, end;
+    int i, j, len;
+
+    trim(isspace, arg, &value);
+    split_string_into_string_list(value, ",", &socket_list);
+    len = libxl_string_list_length(&socket_list);
+    for (i = 0; i < len; i++) {
+        parse_range(socket_list[i], &start, &end);
+        for (j = start; j <= end; j++)
+            libxl_bitmap_set(target_map, j);
+    }
+
+    libxl_string_list_dispose(&socket_list);
+    free(value);
+}
+
 int main_psr_cat_cbm_set(int argc, char **argv)
 {
     uint32_t domid;
@@ -442,10 +463,6 @@ int main_psr_cat_cbm_set(int argc, char **argv)
     int ret, opt = 0;
     int opt_data = 0, opt_code = 0;
     libxl_bitmap target_map;
-    char *value;
-    libxl_string_list socket_list;
-    unsigned long start, end;
-    int i, j, len;
 
     static struct option opts[] = {
         {"socket", 1, 0, 's'},
@@ -459,17 +476,7 @@ int main_psr_cat_cbm_set(int argc, char **argv)
 
     SWITCH_FOREACH_OPT(opt, "s:cd", opts, "psr-cat-cbm-set", 2) {
     case 's':
-        trim(isspace, optarg, &value);
-        split_string_into_string_list(value, ",", &socket_list);
-        len = libxl_string_list_length(&socket_list);
-        for (i = 0; i < len; i++) {
-            parse_range(socket_list[i], &start, &end);
-            for (j = start; j <= end; j++)
-                libxl_bitmap_set(&target_map, j);
-        }
-
-        libxl_string_list_dispose(&socket_list);
-        free(value);
+        psr_parse_socket_list(optarg, &target_map);
         break;
     case 'd':
         opt_data = 1;
@@ -528,23 +535,175 @@ int main_psr_cat_show(int argc, char **argv)
     return psr_cat_show(domid);
 }
 
+#ifdef LIBXL_HAVE_PSR_MBA
+static int psr_mba_hwinfo(void)
+{
+    int rc;
+    int i, nr;
+    libxl_psr_mba_info *info;
+
+    printf("Memory Bandwidth Allocation (MBA):\n");
+
+    rc = libxl_psr_mba_get_info(ctx, &info, &nr);
+    if (rc) {
+        fprintf(stderr, "Failed to get mba info\n");
+        return rc;
+    }
+
+    for (i = 0; i < nr; i++) {
+        printf("%-16s: %u\n", "Socket ID", info[i].id);
+        printf("%-16s: %s\n", "Linear Mode",
+               info[i].linear ? "Enabled" : "Disabled");
+        printf("%-16s: %u\n", "Maximum COS", info[i].cos_max);
+        printf("%-16s: %u%%\n", "Maximum THRTL", info[i].thrtl_max);
+        printf("%-16s: %u%%\n", "Default THRTL", 0);
+    }
+
+    libxl_psr_mba_info_list_free(info, nr);
+    return rc;
+}
+
+static void psr_mba_print_one_domain(uint32_t domid, uint32_t socketid)
+{
+    char *domain_name;
+    uint32_t thrtl;
+
+    domain_name = libxl_domid_to_name(ctx, domid);
+    printf("%5d%25s", domid, domain_name);
+    free(domain_name);
+
+    if (!libxl_psr_mba_get_thrtl(ctx, domid, socketid, &thrtl))
+        printf("%16u\n", thrtl);
+    else
+        printf("%16s\n", "error");
+}
+
+static int psr_mba_show(uint32_t domid)
+{
+    int i, j, nr, nr_domains;
+    int rc;
+    libxl_psr_mba_info *info;
+    libxl_dominfo *list = NULL;
+
+    rc = libxl_psr_mba_get_info(ctx, &info, &nr);
+    if (rc) {
+        fprintf(stderr, "Failed to get mba info\n");
+        return rc;
+    }
+
+    if (domid == INVALID_DOMID &&
+        !(list = libxl_list_domain(ctx, &nr_domains))) {
+        fprintf(stderr, "Failed to get domain list for mba display\n");
+        rc = -1;
+        goto out;
+    }
+
+    for (i = 0; i < nr; i++) {
+        printf("%-16s: %u\n", "Socket ID", info[i].id);
+        printf("%5s%25s%16s\n", "ID", "NAME", "THRTL");
+
+        if (!list)
+            psr_mba_print_one_domain(domid, info[i].id);
+        else
+            for (j = 0; j < nr_domains; j++)
+                psr_mba_print_one_domain(list[j].domid, info[i].id);
+    }
+
+    if (list)
+        libxl_dominfo_list_free(list, nr_domains);
+out:
+    libxl_psr_mba_info_list_free(info, nr);
+    return rc;
+}
+
+int main_psr_mba_set(int argc, char **argv)
+{
+    uint32_t domid;
+    unsigned long thrtl;
+    char *end;
+    int ret, opt = 0;
+    libxl_bitmap target_map;
+
+    static struct option opts[] = {
+        {"socket", 1, 0, 's'},
+        COMMON_LONG_OPTS
+    };
+
+    libxl_socket_bitmap_alloc(ctx, &target_map, 0);
+    libxl_bitmap_set_none(&target_map);
+
+    SWITCH_FOREACH_OPT(opt, "s:", opts, "psr-mba-set", 2) {
+    case 's':
+        psr_parse_socket_list(optarg, &target_map);
+        break;
+    }
+
+    if (libxl_bitmap_is_empty(&target_map))
+        libxl_bitmap_set_any(&target_map);
+
+    if (argc != optind + 2) {
+        help("psr-mba-set");
+        libxl_bitmap_dispose(&target_map);
+        return 2;
+    }
+
+    domid = find_domain(argv[optind]);
+    thrtl = strtoul(argv[optind + 1], &end, 0);
+    if (*end || thrtl > UINT32_MAX) {
+        fprintf(stderr, "Invalid throttling value %s\n", argv[optind + 1]);
+        libxl_bitmap_dispose(&target_map);
+        return 2;
+    }
+
+    ret = libxl_psr_mba_set_thrtl(ctx, domid, &target_map, thrtl);
+
+    libxl_bitmap_dispose(&target_map);
+    return ret;
+}
+
+int main_psr_mba_show(int argc, char **argv)
+{
+    int opt;
+    uint32_t domid;
+
+    SWITCH_FOREACH_OPT(opt, "", NULL, "psr-mba-show", 0) {
+        /* No options */
+    }
+
+    if (optind >= argc)
+        domid = INVALID_DOMID;
+    else if (optind == argc - 1)
+        domid = find_domain(argv[optind]);
+    else {
+        help("psr-mba-show");
+        return 2;
+    }
+
+    return psr_mba_show(domid);
+}
+#endif
+
 int main_psr_hwinfo(int argc, char **argv)
 {
     int opt, ret = 0;
-    bool all = true, cmt = false, cat = false;
+    bool all = true, cmt = false, cat = false, mba = false;
     static struct option opts[] = {
         {"cmt", 0, 0, 'm'},
         {"cat", 0, 0, 'a'},
+        {"mba", 0, 0, 'b'},
         COMMON_LONG_OPTS
     };
 
-    SWITCH_FOREACH_OPT(opt, "ma", opts, "psr-hwinfo", 0) {
+    SWITCH_FOREACH_OPT(opt, "mab", opts, "psr-hwinfo", 0) {
     case 'm':
         all = false; cmt = true;
         break;
     case 'a':
         all = false; cat = true;
         break;
+    case 'b':
+        all = false; mba = true;
+        break;
     }
 
     if (!ret && (all || cmt))
@@ -553,6 +712,12 @@ int main_psr_hwinfo(int argc, char **argv)
     if (!ret && (all || cat))
         ret = psr_cat_hwinfo();
 
+#ifdef LIBXL_HAVE_PSR_MBA
+    /* Not shown by default: few systems with CAT have MBA as well. */
+    if (!ret && mba)
+        ret = psr_mba_hwinfo();
+#endif
+
     return ret;
 }
 
@@ -120,7 +120,8 @@ void save_domain_core_writeconfig(int fd, const char *source,
 }
 
 static int save_domain(uint32_t domid, const char *filename, int checkpoint,
-                            int leavepaused, const char *override_config_file)
+                       int leavepaused, int flags,
+                       const char *override_config_file)
 {
     int fd;
     uint8_t *config_data;
@@ -141,7 +142,7 @@ static int save_domain(uint32_t domid, const char *filename, int checkpoint,
 
     save_domain_core_writeconfig(fd, filename, config_data, config_len);
 
-    int rc = libxl_domain_suspend(ctx, domid, fd, 0, NULL);
+    int rc = libxl_domain_suspend(ctx, domid, fd, flags, NULL);
     close(fd);
 
     if (rc < 0) {
@@ -159,6 +160,87 @@ static int save_domain(uint32_t domid, const char *filename, int checkpoint,
     exit(rc < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
 }
 
+/*
+ * Saves every "<Domain> <CheckpointFile>" pair listed in the batch file,
+ * running up to max_parallel saves at once, then deals with each domain as
+ * save_domain does.
+ */
+static int save_domains_batch(const char *filename, int max_parallel,
+                              int checkpoint, int leavepaused, int flags)
+{
+    char **entries, **files;
+    uint32_t *domids;
+    int *fds, *rcs;
+    int i, nr, rc, ret = EXIT_SUCCESS;
+
+    nr = read_batch_file(filename, &entries);
+    domids = xcalloc(nr, sizeof(*domids));
+    files = xcalloc(nr, sizeof(*files));
+    fds = xcalloc(nr, sizeof(*fds));
+    rcs = xcalloc(nr, sizeof(*rcs));
+
+    for (i = 0; i < nr; i++) {
+        char *p = entries[i] + strcspn(entries[i], " \t");
+
+        if (!*p) {
+            fprintf(stderr, "Batch file %s: no checkpoint file for %s\n",
+                    filename, entries[i]);
+            exit(EXIT_FAILURE);
+        }
+        *p++ = '\0';
+        files[i] = p + strspn(p, " \t");
+        domids[i] = find_domain(entries[i]);
+    }
+
+    for (i = 0; i < nr; i++) {
+        uint8_t *config_data;
+        int config_len;
+
+        save_domain_core_begin(domids[i], NULL, &config_data, &config_len);
+        if (!config_len)
+            fprintf(stderr, " Savefile %s will not contain xl domain config\n",
+                    files[i]);
+
+        fds[i] = open(files[i], O_WRONLY|O_CREAT|O_TRUNC, 0644);
+        if (fds[i] < 0) {
+            fprintf(stderr, "Failed to open temp file %s for writing\n",
+                    files[i]);
+            exit(EXIT_FAILURE);
+        }
+
+        save_domain_core_writeconfig(fds[i], files[i],
+                                     config_data, config_len);
+        free(config_data);
+    }
+
+    rc = libxl_domain_suspend_many(ctx, domids, fds, nr, flags,
+                                   max_parallel, rcs, NULL);
+    if (rc)
+        ret = EXIT_FAILURE;
+
+    for (i = 0; i < nr; i++) {
+        close(fds[i]);
+
+        if (rcs[i]) {
+            fprintf(stderr, "Failed to save %s (rc=%d), resuming domain\n",
+                    entries[i], rcs[i]);
+            libxl_domain_resume(ctx, domids[i], 1, 0);
+        } else if (leavepaused || checkpoint) {
+            if (leavepaused)
+                libxl_domain_pause(ctx, domids[i]);
+            libxl_domain_resume(ctx, domids[i], 1, 0);
+        } else
+            libxl_domain_destroy(ctx, domids[i], 0);
+    }
+
+    free(rcs);
+    free(fds);
+    free(files);
+    free(domids);
+    free_batch_entries(entries, nr);
+    return ret;
+}
+
 int main_restore(int argc, char **argv)
 {
     const char *checkpoint_file = NULL;
@@ -233,17 +315,49 @@ int main_save(int argc, char **argv)
     uint32_t domid;
     const char *filename;
     const char *config_filename = NULL;
+    const char *batch = NULL;
     int checkpoint = 0;
     int leavepaused = 0;
+    int flags = 0, max_parallel = 0;
     int opt;
+    static struct option opts[] = {
+        {"live", 0, 0, 'l'},
+        {"batch", 1, 0, 'b'},
+        {"parallel", 1, 0, 'j'},
+        COMMON_LONG_OPTS
+    };
 
-    SWITCH_FOREACH_OPT(opt, "cp", NULL, "save", 2) {
+    SWITCH_FOREACH_OPT(opt, "cplb:j:", opts, "save", 0) {
     case 'c':
         checkpoint = 1;
         break;
     case 'p':
         leavepaused = 1;
         break;
+    case 'l':
+        flags |= LIBXL_SUSPEND_LIVE;
+        break;
+    case 'b':
+        batch = optarg;
+        break;
+    case 'j':
+        max_parallel = atoi(optarg);
+        break;
+    }
+
+    if (batch) {
+        if (optind < argc) {
+            help("save");
+            return 2;
+        }
+        return save_domains_batch(batch, max_parallel, checkpoint,
+                                  leavepaused, flags);
+    }
+
+    if (argc-optind < 2) {
+        fprintf(stderr, "'xl save' requires at least 2 arguments.\n\n");
+        help("save");
+        return 2;
     }
 
     if (argc-optind > 3) {
@@ -256,7 +370,8 @@ int main_save(int argc, char **argv)
     if ( argc - optind >= 3 )
         config_filename = argv[optind + 2];
 
-    save_domain(domid, filename, checkpoint, leavepaused, config_filename);
+    save_domain(domid, filename, checkpoint, leavepaused, flags,
+                config_filename);
     return EXIT_SUCCESS;
 }
 
@@ -879,6 +879,64 @@ out:
     return r;
 }
 
+/*
+ * <nothing>            : List the vcpu assigned to each cpu of Pool-0
+ * -p [cpupool]         : List the vcpu assigned to each cpu of cpupool
+ */
+int main_sched_null(int argc, char **argv)
+{
+    const char *cpupool = NULL;
+    libxl_sched_null_assignment *list;
+    uint32_t poolid = 0;
+    char *poolname, *domname;
+    int opt, nb, i;
+    static struct option opts[] = {
+        {"cpupool", 1, 0, 'p'},
+        COMMON_LONG_OPTS
+    };
+
+    SWITCH_FOREACH_OPT(opt, "p:", opts, "sched-null", 0) {
+    case 'p':
+        cpupool = optarg;
+        break;
+    }
+
+    if (cpupool) {
+        if (libxl_cpupool_qualifier_to_cpupoolid(ctx, cpupool,
+                                                 &poolid, NULL) ||
+            !libxl_cpupoolid_is_valid(ctx, poolid)) {
+            fprintf(stderr, "unknown cpupool \'%s\'\n", cpupool);
+            return EXIT_FAILURE;
+        }
+    }
+
+    list = libxl_sched_null_assignment_list(ctx, poolid, &nb);
+    if (!list) {
+        fprintf(stderr, "libxl_sched_null_assignment_list failed.\n");
+        return EXIT_FAILURE;
+    }
+
+    poolname = libxl_cpupoolid_to_name(ctx, poolid);
+    printf("Cpupool %s: sched=null\n", poolname);
+    free(poolname);
+
+    printf("%4s %-33s %4s %4s\n", "CPU", "Name", "ID", "VCPU");
+    for (i = 0; i < nb; i++) {
+        if (!list[i].assigned) {
+            printf("%4u %-33s %4s %4s\n", list[i].cpu, "(free)", "-", "-");
+            continue;
+        }
+        domname = libxl_domid_to_name(ctx, list[i].domid);
+        printf("%4u %-33s %4u %4u\n", list[i].cpu, domname,
+               list[i].domid, list[i].vcpuid);
+        free(domname);
+    }
+
+    libxl_sched_null_assignment_list_free(list, nb);
+
+    return EXIT_SUCCESS;
+}
+
 /*
  * Local variables:
  * mode: C
@@ -99,6 +99,8 @@ void printf_info_sexp(int domid, libxl_domain_config *d_config, FILE *fh)
                libxl_defbool_to_string(b_info->u.hvm.hpet));
         fprintf(fh, "\t\t\t(vpt_align %s)\n",
                libxl_defbool_to_string(b_info->u.hvm.vpt_align));
+        fprintf(fh, "\t\t\t(vpt_lazy %s)\n",
+               libxl_defbool_to_string(b_info->u.hvm.vpt_lazy));
         fprintf(fh, "\t\t\t(timer_mode %s)\n",
                libxl_timer_mode_to_string(b_info->u.hvm.timer_mode));
         fprintf(fh, "\t\t\t(nestedhvm %s)\n",
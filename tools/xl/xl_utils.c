@@ -316,6 +316,64 @@ out:
     return ret;
 }
 
+/*
+ * Reads a --batch list file: one entry per line, ignoring blank lines and
+ * lines starting with '#'.  Returns the number of entries, or exits.
+ */
+int read_batch_file(const char *filename, char ***entries_r)
+{
+    FILE *f;
+    char buf[PATH_MAX + 2];
+    char **entries = NULL;
+    int nr = 0;
+
+    f = fopen(filename, "r");
+    if (!f) {
+        fprintf(stderr, "Failed to open batch file %s: %s\n",
+                filename, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    while (fgets(buf, sizeof(buf), f)) {
+        char *p = buf, *end;
+
+        while (*p == ' ' || *p == '\t')
+            p++;
+        end = p + strlen(p);
+        while (end > p && (end[-1] == '\n' || end[-1] == '\r' ||
+                           end[-1] == ' ' || end[-1] == '\t'))
+            *--end = '\0';
+        if (!*p || *p == '#')
+            continue;
+
+        entries = xrealloc(entries, sizeof(*entries) * (nr + 1));
+        entries[nr++] = xstrdup(p);
+    }
+    if (ferror(f)) {
+        fprintf(stderr, "Failed to read batch file %s: %s\n",
+                filename, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    fclose(f);
+
+    if (!nr) {
+        fprintf(stderr, "Batch file %s lists no domains\n", filename);
+        exit(EXIT_FAILURE);
+    }
+
+    *entries_r = entries;
+    return nr;
+}
+
+void free_batch_entries(char **entries, int nr)
+{
+    int i;
+
+    for (i = 0; i < nr; i++)
+        free(entries[i]);
+    free(entries);
+}
+
 /*
  * Local variables:
  * mode: C
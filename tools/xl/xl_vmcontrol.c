@@ -31,6 +31,8 @@
 #include "xl_parse.h"
 
 static int fd_lock = -1;
+static int fd_name_lock = -1;
+static char *name_lockfile;
 
 static void pause_domain(uint32_t domid)
 {
@@ -82,15 +84,76 @@ int main_unpause(int argc, char **argv)
     return EXIT_SUCCESS;
 }
 
+static int destroy_domains_batch(const char *filename, int max_parallel,
+                                 int force)
+{
+    char **entries;
+    uint32_t *domids;
+    int *rcs;
+    int i, nr, rc, ret = EXIT_SUCCESS;
+
+    nr = read_batch_file(filename, &entries);
+    domids = xcalloc(nr, sizeof(*domids));
+    rcs = xcalloc(nr, sizeof(*rcs));
+
+    for (i = 0; i < nr; i++) {
+        domids[i] = find_domain(entries[i]);
+        if (domids[i] == 0 && !force) {
+            fprintf(stderr, "Not destroying domain 0; use -f to force.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    rc = libxl_domain_destroy_many(ctx, domids, nr, max_parallel, rcs, 0);
+    if (rc) {
+        for (i = 0; i < nr; i++)
+            if (rcs[i])
+                fprintf(stderr, "destroy of %s failed (rc=%d)\n",
+                        entries[i], rcs[i]);
+        ret = EXIT_FAILURE;
+    }
+
+    free(rcs);
+    free(domids);
+    free_batch_entries(entries, nr);
+    return ret;
+}
+
 int main_destroy(int argc, char **argv)
 {
     int opt;
-    int force = 0;
+    int force = 0, max_parallel = 0;
+    const char *batch = NULL;
+    static struct option opts[] = {
+        {"batch", 1, 0, 'b'},
+        {"parallel", 1, 0, 'j'},
+        COMMON_LONG_OPTS
+    };
 
-    SWITCH_FOREACH_OPT(opt, "f", NULL, "destroy", 1) {
+    SWITCH_FOREACH_OPT(opt, "fb:j:", opts, "destroy", 0) {
     case 'f':
         force = 1;
         break;
+    case 'b':
+        batch = optarg;
+        break;
+    case 'j':
+        max_parallel = atoi(optarg);
+        break;
+    }
+
+    if (batch) {
+        if (optind < argc) {
+            help("destroy");
+            return 2;
+        }
+        return destroy_domains_batch(batch, max_parallel, force);
+    }
+
+    if (optind >= argc) {
+        fprintf(stderr, "'xl destroy' requires at least 1 argument.\n\n");
+        help("destroy");
+        return 2;
     }
 
     destroy_domain(find_domain(argv[optind]), force);
@@ -314,17 +377,10 @@ static int domain_wait_event(uint32_t domid, libxl_event **event_r)
  * Returns true in case there is already, or we manage to free it, enough
  * memory, but also if autoballoon is false.
  */
-static bool freemem(uint32_t domid, libxl_domain_build_info *b_info)
+static bool freemem_kb(uint64_t need_memkb)
 {
     int rc, retries = 3;
-    uint64_t need_memkb, free_memkb;
-
-    if (!autoballoon)
-        return true;
-
-    rc = libxl_domain_need_memory(ctx, b_info, &need_memkb);
-    if (rc < 0)
-        return false;
+    uint64_t free_memkb;
 
     do {
         rc = libxl_get_free_memory(ctx, &free_memkb);
@@ -338,9 +394,9 @@ static bool freemem(uint32_t domid, libxl_domain_build_info *b_info)
         if (rc < 0)
             return false;
 
-        /* wait until dom0 reaches its target, as long as we are making
-         * progress */
-        rc = libxl_wait_for_memory_target(ctx, 0, 10);
+        /* wait until enough memory is free, as long as dom0 is making
+         * progress towards its target */
+        rc = libxl_wait_for_memory_available(ctx, 0, need_memkb, 10, 0);
         if (rc < 0)
             return false;
 
@@ -350,6 +406,21 @@ static bool freemem(uint32_t domid, libxl_domain_build_info *b_info)
     return false;
 }
 
+static bool freemem(uint32_t domid, libxl_domain_build_info *b_info)
+{
+    int rc;
+    uint64_t need_memkb;
+
+    if (!autoballoon)
+        return true;
+
+    rc = libxl_domain_need_memory(ctx, b_info, &need_memkb);
+    if (rc < 0)
+        return false;
+
+    return freemem_kb(need_memkb);
+}
+
 static void reload_domain_config(uint32_t domid,
                                  libxl_domain_config *d_config)
 {
@@ -550,70 +621,126 @@ static void autoconnect_vncviewer(uint32_t domid, int autopass)
     _exit(EXIT_FAILURE);
 }
 
-static int acquire_lock(void)
+static int lock_file(const char *path, int *fd_r, bool transient)
 {
-    int rc;
+    int fd, rc;
     struct flock fl;
+    struct stat stab, fstab;
 
     /* lock already acquired */
-    if (fd_lock >= 0)
+    if (*fd_r >= 0)
         return ERROR_INVAL;
 
     fl.l_type = F_WRLCK;
     fl.l_whence = SEEK_SET;
     fl.l_start = 0;
     fl.l_len = 0;
-    fd_lock = open(lockfile, O_WRONLY|O_CREAT, S_IWUSR);
-    if (fd_lock < 0) {
-        fprintf(stderr, "cannot open the lockfile %s errno=%d\n", lockfile, errno);
+reopen:
+    fd = open(path, O_WRONLY|O_CREAT, S_IWUSR);
+    if (fd < 0) {
+        fprintf(stderr, "cannot open the lockfile %s errno=%d\n", path, errno);
         return ERROR_FAIL;
     }
-    if (fcntl(fd_lock, F_SETFD, FD_CLOEXEC) < 0) {
-        close(fd_lock);
-        fprintf(stderr, "cannot set cloexec to lockfile %s errno=%d\n", lockfile, errno);
+    if (fcntl(fd, F_SETFD, FD_CLOEXEC) < 0) {
+        close(fd);
+        fprintf(stderr, "cannot set cloexec to lockfile %s errno=%d\n", path, errno);
         return ERROR_FAIL;
     }
 get_lock:
-    rc = fcntl(fd_lock, F_SETLKW, &fl);
+    rc = fcntl(fd, F_SETLKW, &fl);
     if (rc < 0 && errno == EINTR)
         goto get_lock;
     if (rc < 0) {
-        fprintf(stderr, "cannot acquire lock %s errno=%d\n", lockfile, errno);
-        rc = ERROR_FAIL;
-    } else
-        rc = 0;
-    return rc;
+        fprintf(stderr, "cannot acquire lock %s errno=%d\n", path, errno);
+        close(fd);
+        return ERROR_FAIL;
+    }
+
+    /*
+     * A transient lockfile is unlinked by whoever releases it, so we may
+     * have locked one which is no longer there: if so, start over.
+     */
+    if (transient &&
+        (fstat(fd, &fstab) || stat(path, &stab) ||
+         stab.st_dev != fstab.st_dev || stab.st_ino != fstab.st_ino)) {
+        close(fd);
+        goto reopen;
+    }
+
+    *fd_r = fd;
+    return 0;
 }
 
-static int release_lock(void)
+static int unlock_file(const char *path, int *fd_r, bool transient)
 {
     int rc;
     struct flock fl;
 
     /* lock not acquired */
-    if (fd_lock < 0)
+    if (*fd_r < 0)
         return ERROR_INVAL;
 
+    /* Unlink before unlocking, see lock_file(). */
+    if (transient)
+        unlink(path);
+
 release_lock:
     fl.l_type = F_UNLCK;
     fl.l_whence = SEEK_SET;
     fl.l_start = 0;
     fl.l_len = 0;
 
-    rc = fcntl(fd_lock, F_SETLKW, &fl);
+    rc = fcntl(*fd_r, F_SETLKW, &fl);
     if (rc < 0 && errno == EINTR)
         goto release_lock;
     if (rc < 0) {
-        fprintf(stderr, "cannot release lock %s, errno=%d\n", lockfile, errno);
+        fprintf(stderr, "cannot release lock %s, errno=%d\n", path, errno);
         rc = ERROR_FAIL;
     } else
         rc = 0;
-    close(fd_lock);
-    fd_lock = -1;
+    close(*fd_r);
+    *fd_r = -1;
 
     return rc;
 }
 
+static int acquire_lock(void)
+{
+    return lock_file(lockfile, &fd_lock, false);
+}
+
+static int release_lock(void)
+{
+    return unlock_file(lockfile, &fd_lock, false);
+}
+
+/*
+ * Creating a domain only needs the global lock for ballooning: freemem()
+ * can only account for other creations once their domains own their
+ * memory, so with autoballoon the lock has to cover the whole creation.
+ * Otherwise, creations only need serialising against those of domains
+ * with the same name, which libxl does not check atomically.
+ */
+static int acquire_create_lock(const char *name)
+{
+    if (autoballoon || !name || strchr(name, '/'))
+        return acquire_lock();
+
+    assert(!name_lockfile);
+    xasprintf(&name_lockfile, "%s.%s", lockfile, name);
+    return lock_file(name_lockfile, &fd_name_lock, true);
+}
+
+static void release_create_lock(void)
+{
+    if (fd_lock >= 0)
+        release_lock();
+    if (name_lockfile) {
+        unlock_file(name_lockfile, &fd_name_lock, true);
+        free(name_lockfile);
+        name_lockfile = NULL;
+    }
+}
 
 static void autoconnect_console(libxl_ctx *ctx_ignored,
                                 libxl_event *ev, void *priv)
@@ -843,7 +970,7 @@ int create_domain(struct domain_create *dom_info)
 start:
     assert(domid == INVALID_DOMID);
 
-    rc = acquire_lock();
+    rc = acquire_create_lock(d_config.c_info.name);
     if (rc < 0)
         goto error_out;
 
@@ -868,6 +995,9 @@ start:
         autoconnect_console_how = 0;
     }
 
+    if (dom_info->trace_file)
+        libxl_trace_enable(ctx);
+
     if ( restoring ) {
         libxl_domain_restore_params params;
 
@@ -902,10 +1032,14 @@ start:
         ret = libxl_domain_create_new(ctx, &d_config, &domid,
                                       0, autoconnect_console_how);
     }
+    if (dom_info->trace_file &&
+        libxl_trace_write(ctx, dom_info->trace_file))
+        fprintf(stderr, "Failed to write trace to %s\n",
+                dom_info->trace_file);
     if ( ret )
         goto error_out;
 
-    release_lock();
+    release_create_lock();
 
     if (restore_fd_to_close >= 0) {
         if (close(restore_fd_to_close))
@@ -1079,7 +1213,7 @@ start:
     }
 
 error_out:
-    release_lock();
+    release_create_lock();
     if (libxl_domid_valid_guest(domid)) {
         libxl_domain_destroy(ctx, domid, 0);
         domid = INVALID_DOMID;
@@ -1119,12 +1253,98 @@ out:
     return ret;
 }
 
+/*
+ * Creates all the domains whose config files are listed in @filename,
+ * with one libxl operation, at most @max_parallel of them at a time.  The
+ * domains are not monitored: this behaves like "xl create -e".
+ */
+static int create_domains_batch(const char *filename, int max_parallel,
+                                int paused, int quiet)
+{
+    char **entries;
+    libxl_domain_config *d_configs;
+    uint32_t *domids;
+    int *rcs;
+    uint64_t need_memkb = 0;
+    int i, nr, rc, ret = EXIT_SUCCESS;
+
+    nr = read_batch_file(filename, &entries);
+    d_configs = xcalloc(nr, sizeof(*d_configs));
+    domids = xcalloc(nr, sizeof(*domids));
+    rcs = xcalloc(nr, sizeof(*rcs));
+
+    for (i = 0; i < nr; i++) {
+        void *config_data = 0;
+        int config_len = 0;
+        uint64_t memkb;
+
+        if (libxl_read_file_contents(ctx, entries[i],
+                                     &config_data, &config_len)) {
+            fprintf(stderr, "Failed to read config file: %s: %s\n",
+                    entries[i], strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        if (!quiet)
+            fprintf(stderr, "Parsing config from %s\n", entries[i]);
+        libxl_domain_config_init(&d_configs[i]);
+        parse_config_data(entries[i], config_data, config_len, &d_configs[i]);
+        free(config_data);
+
+        if (autoballoon) {
+            if (libxl_domain_need_memory(ctx, &d_configs[i].b_info, &memkb)) {
+                fprintf(stderr, "failed to compute memory for %s\n",
+                        entries[i]);
+                exit(EXIT_FAILURE);
+            }
+            need_memkb += memkb;
+        }
+    }
+
+    if (acquire_lock() < 0)
+        exit(EXIT_FAILURE);
+
+    /* Balloon once, for all of the domains. */
+    if (autoballoon && !freemem_kb(need_memkb)) {
+        fprintf(stderr, "failed to free memory for the domains\n");
+        release_lock();
+        exit(EXIT_FAILURE);
+    }
+
+    rc = libxl_domain_create_many(ctx, d_configs, nr, max_parallel,
+                                  domids, rcs, 0);
+    release_lock();
+
+    for (i = 0; i < nr; i++) {
+        if (rcs[i]) {
+            fprintf(stderr, "Failed to create domain from %s (rc=%d)\n",
+                    entries[i], rcs[i]);
+            continue;
+        }
+        if (!paused)
+            libxl_domain_unpause(ctx, domids[i]);
+        if (!quiet)
+            fprintf(stderr, "Created domain %s (domid %u)\n",
+                    d_configs[i].c_info.name, domids[i]);
+    }
+    if (rc)
+        ret = EXIT_FAILURE;
+
+    for (i = 0; i < nr; i++)
+        libxl_domain_config_dispose(&d_configs[i]);
+    free(rcs);
+    free(domids);
+    free(d_configs);
+    free_batch_entries(entries, nr);
+    return ret;
+}
+
 int main_create(int argc, char **argv)
 {
     const char *filename = NULL;
     struct domain_create dom_info;
     int paused = 0, debug = 0, daemonize = 1, console_autoconnect = 0,
-        quiet = 0, monitor = 1, vnc = 0, vncautopass = 0;
+        quiet = 0, monitor = 1, vnc = 0, vncautopass = 0, max_parallel = 0;
+    const char *batch = NULL, *trace_file = NULL;
     int opt, rc;
     static struct option opts[] = {
         {"dryrun", 0, 0, 'n'},
@@ -1132,6 +1352,9 @@ int main_create(int argc, char **argv)
         {"defconfig", 1, 0, 'f'},
         {"vncviewer", 0, 0, 'V'},
         {"vncviewer-autopass", 0, 0, 'A'},
+        {"batch", 1, 0, 'b'},
+        {"parallel", 1, 0, 'j'},
+        {"trace", 1, 0, 0x100},
         COMMON_LONG_OPTS
     };
 
@@ -1142,7 +1365,7 @@ int main_create(int argc, char **argv)
         argc--; argv++;
     }
 
-    SWITCH_FOREACH_OPT(opt, "Fnqf:pcdeVA", opts, "create", 0) {
+    SWITCH_FOREACH_OPT(opt, "Fnqf:pcdeVAb:j:", opts, "create", 0) {
     case 'f':
         filename = optarg;
         break;
@@ -1174,6 +1397,24 @@ int main_create(int argc, char **argv)
     case 'A':
         vnc = vncautopass = 1;
         break;
+    case 'b':
+        batch = optarg;
+        break;
+    case 'j':
+        max_parallel = atoi(optarg);
+        break;
+    case 0x100: /* --trace */
+        trace_file = optarg;
+        break;
+    }
+
+    if (batch) {
+        if (filename || optind < argc || console_autoconnect || vnc ||
+            dryrun_only) {
+            help("create");
+            return 2;
+        }
+        return create_domains_batch(batch, max_parallel, paused, quiet);
     }
 
     memset(&dom_info, 0, sizeof(dom_info));
@@ -1203,6 +1444,7 @@ int main_create(int argc, char **argv)
     dom_info.vnc = vnc;
     dom_info.vncautopass = vncautopass;
     dom_info.console_autoconnect = console_autoconnect;
+    dom_info.trace_file = trace_file;
 
     rc = create_domain(&dom_info);
     if (rc < 0) {
@@ -64,7 +64,20 @@ bool gicv3_its_host_has_its(void)
 }
 
 #define BUFPTR_MASK                     GENMASK(19, 5)
-static int its_send_command(struct host_its *hw_its, const void *its_cmd)
+
+/* Space left in the command queue, in bytes. */
+static unsigned long its_cmd_queue_space(uint64_t readp, uint64_t writep)
+{
+    /* One slot stays unused, to tell a full queue from an empty one. */
+    return (readp - writep - ITS_CMD_SIZE) % ITS_CMD_QUEUE_SZ;
+}
+
+/*
+ * Queue @nr consecutive commands, making them visible to the ITS with a
+ * single update of GITS_CWRITER.
+ */
+static int its_send_commands(struct host_its *hw_its, const void *its_cmds,
+                             unsigned int nr)
 {
     /*
      * The command queue should actually never become full, if it does anyway
@@ -73,16 +86,19 @@ static int its_send_command(struct host_its *hw_its, const void *its_cmd)
      * So to cover the one-off case where we actually hit a full command
      * queue, we introduce a small grace period to not give up too quickly.
      * Given the usual multi-hundred MHz frequency the ITS usually runs with,
-     * one millisecond (for a single command) seem to be more than enough.
+     * one millisecond (for a single command or a small batch) seem to be
+     * more than enough.
      * But this value is rather arbitrarily chosen based on theoretical
      * considerations.
      */
     s_time_t deadline = NOW() + MILLISECS(1);
     uint64_t readp, writep;
+    unsigned int i;
     int ret = -EBUSY;
 
     /* No ITS commands from an interrupt handler (at the moment). */
     ASSERT(!in_irq());
+    ASSERT(nr && nr * ITS_CMD_SIZE < ITS_CMD_QUEUE_SZ);
 
     spin_lock(&hw_its->cmd_lock);
 
@@ -90,7 +106,7 @@ static int its_send_command(struct host_its *hw_its, const void *its_cmd)
         readp = readq_relaxed(hw_its->its_base + GITS_CREADR) & BUFPTR_MASK;
         writep = readq_relaxed(hw_its->its_base + GITS_CWRITER) & BUFPTR_MASK;
 
-        if ( ((writep + ITS_CMD_SIZE) % ITS_CMD_QUEUE_SZ) != readp )
+        if ( its_cmd_queue_space(readp, writep) >= nr * ITS_CMD_SIZE )
         {
             ret = 0;
             break;
@@ -114,14 +130,20 @@ static int its_send_command(struct host_its *hw_its, const void *its_cmd)
         return ret;
     }
 
-    memcpy(hw_its->cmd_buf + writep, its_cmd, ITS_CMD_SIZE);
-    if ( hw_its->flags & HOST_ITS_FLUSH_CMD_QUEUE )
-        clean_and_invalidate_dcache_va_range(hw_its->cmd_buf + writep,
-                                             ITS_CMD_SIZE);
-    else
+    for ( i = 0; i < nr; i++ )
+    {
+        memcpy(hw_its->cmd_buf + writep, its_cmds + i * ITS_CMD_SIZE,
+               ITS_CMD_SIZE);
+        if ( hw_its->flags & HOST_ITS_FLUSH_CMD_QUEUE )
+            clean_and_invalidate_dcache_va_range(hw_its->cmd_buf + writep,
+                                                 ITS_CMD_SIZE);
+
+        writep = (writep + ITS_CMD_SIZE) % ITS_CMD_QUEUE_SZ;
+    }
+
+    if ( !(hw_its->flags & HOST_ITS_FLUSH_CMD_QUEUE) )
         dsb(ishst);
 
-    writep = (writep + ITS_CMD_SIZE) % ITS_CMD_QUEUE_SZ;
     writeq_relaxed(writep & BUFPTR_MASK, hw_its->its_base + GITS_CWRITER);
 
     spin_unlock(&hw_its->cmd_lock);
@@ -129,6 +151,11 @@ static int its_send_command(struct host_its *hw_its, const void *its_cmd)
     return 0;
 }
 
+static int its_send_command(struct host_its *hw_its, const void *its_cmd)
+{
+    return its_send_commands(hw_its, its_cmd, 1);
+}
+
 /* Wait for an ITS to finish processing all commands. */
 static int gicv3_its_wait_commands(struct host_its *hw_its)
 {
@@ -140,6 +167,7 @@ static int gicv3_its_wait_commands(struct host_its *hw_its)
      */
     s_time_t deadline = NOW() + MILLISECS(100);
     uint64_t readp, writep;
+    unsigned int delay = 1;
 
     do {
         spin_lock(&hw_its->cmd_lock);
@@ -150,8 +178,14 @@ static int gicv3_its_wait_commands(struct host_its *hw_its)
         if ( readp == writep )
             return 0;
 
+        /*
+         * Back off while a longer queue drains, to not keep hammering the
+         * ITS registers and the command queue lock.
+         */
         cpu_relax();
-        udelay(1);
+        udelay(delay);
+        if ( delay < 64 )
+            delay <<= 1;
     } while ( NOW() <= deadline );
 
     return -ETIMEDOUT;
@@ -179,18 +213,14 @@ static int its_send_cmd_sync(struct host_its *its, unsigned int cpu)
     return its_send_command(its, cmd);
 }
 
-static int its_send_cmd_mapti(struct host_its *its,
-                              uint32_t deviceid, uint32_t eventid,
-                              uint32_t pintid, uint16_t icid)
+static void its_encode_cmd_mapti(uint64_t *cmd,
+                                 uint32_t deviceid, uint32_t eventid,
+                                 uint32_t pintid, uint16_t icid)
 {
-    uint64_t cmd[4];
-
     cmd[0] = GITS_CMD_MAPTI | ((uint64_t)deviceid << 32);
     cmd[1] = eventid | ((uint64_t)pintid << 32);
     cmd[2] = icid;
     cmd[3] = 0x00;
-
-    return its_send_command(its, cmd);
 }
 
 static int its_send_cmd_mapc(struct host_its *its, uint32_t collection_id,
@@ -231,17 +261,13 @@ static int its_send_cmd_mapd(struct host_its *its, uint32_t deviceid,
     return its_send_command(its, cmd);
 }
 
-static int its_send_cmd_inv(struct host_its *its,
-                            uint32_t deviceid, uint32_t eventid)
+static void its_encode_cmd_inv(uint64_t *cmd,
+                               uint32_t deviceid, uint32_t eventid)
 {
-    uint64_t cmd[4];
-
     cmd[0] = GITS_CMD_INV | ((uint64_t)deviceid << 32);
     cmd[1] = eventid;
     cmd[2] = 0x00;
     cmd[3] = 0x00;
-
-    return its_send_command(its, cmd);
 }
 
 /* Set up the (1:1) collection mapping for the given host CPU. */
@@ -587,37 +613,44 @@ static int compare_its_guest_devices(struct its_device *dev,
     return 0;
 }
 
+/* Number of events whose MAPTI and INV commands get queued in one go. */
+#define ITS_MAP_BATCH   8
+
 /*
  * On the host ITS @its, map @nr_events consecutive LPIs.
  * The mapping connects a device @devid and event @eventid pair to LPI @lpi,
  * increasing both @eventid and @lpi to cover the number of requested LPIs.
+ * The caller needs to issue a SYNC and wait for it before relying on the
+ * mappings.
  */
 static int gicv3_its_map_host_events(struct host_its *its,
                                      uint32_t devid, uint32_t eventid,
                                      uint32_t lpi, uint32_t nr_events)
 {
-    uint32_t i;
+    uint64_t cmds[ITS_MAP_BATCH * 2][4];
+    uint32_t i, j, n;
     int ret;
 
-    for ( i = 0; i < nr_events; i++ )
+    for ( i = 0; i < nr_events; i += n )
     {
-        /* For now we map every host LPI to host CPU 0 */
-        ret = its_send_cmd_mapti(its, devid, eventid + i, lpi + i, 0);
-        if ( ret )
-            return ret;
+        n = min_t(uint32_t, nr_events - i, ITS_MAP_BATCH);
 
-        ret = its_send_cmd_inv(its, devid, eventid + i);
+        for ( j = 0; j < n; j++ )
+        {
+            /* For now we map every host LPI to host CPU 0 */
+            its_encode_cmd_mapti(cmds[j * 2], devid, eventid + i + j,
+                                 lpi + i + j, 0);
+            its_encode_cmd_inv(cmds[j * 2 + 1], devid, eventid + i + j);
+        }
+
+        ret = its_send_commands(its, cmds, n * 2);
         if ( ret )
             return ret;
     }
 
     /* TODO: Consider using INVALL here. Didn't work on the model, though. */
 
-    ret = its_send_cmd_sync(its, 0);
-    if ( ret )
-        return ret;
-
-    return gicv3_its_wait_commands(its);
+    return 0;
 }
 
 /*
@@ -760,6 +793,16 @@ int gicv3_its_map_guest_device(struct domain *d,
             break;
     }
 
+    /* A single SYNC covers the mappings of all the blocks. */
+    if ( !ret )
+    {
+        ret = its_send_cmd_sync(hw_its, 0);
+        if ( !ret )
+            ret = gicv3_its_wait_commands(hw_its);
+        if ( ret )
+            i--;        /* All blocks got allocated. */
+    }
+
     if ( ret )
     {
         /* Clean up all allocated host LPI blocks. */
@@ -389,15 +389,21 @@ static inline void gic_add_to_lr_pending(struct vcpu *v, struct pending_irq *n)
     if ( !list_empty(&n->lr_queue) )
         return;
 
-    list_for_each_entry ( iter, &v->arch.vgic.lr_pending, lr_queue )
+    v->arch.vgic.lr_pending_stalled = false;
+
+    /*
+     * Search from the tail: IRQs mostly get queued behind ones of the
+     * same priority, which this finds straight away.
+     */
+    list_for_each_entry_reverse ( iter, &v->arch.vgic.lr_pending, lr_queue )
     {
-        if ( iter->priority > n->priority )
+        if ( iter->priority <= n->priority )
         {
-            list_add_tail(&n->lr_queue, &iter->lr_queue);
+            list_add(&n->lr_queue, &iter->lr_queue);
             return;
         }
     }
-    list_add_tail(&n->lr_queue, &v->arch.vgic.lr_pending);
+    list_add(&n->lr_queue, &v->arch.vgic.lr_pending);
 }
 
 void gic_remove_from_queues(struct vcpu *v, unsigned int virtual_irq)
@@ -447,6 +453,7 @@ void gic_raise_guest_irq(struct vcpu *v, unsigned int virtual_irq,
         }
     }
 
+    v->arch.vgic.lr_overflows++;
     gic_add_to_lr_pending(v, irq_to_pending(v, virtual_irq));
 }
 
@@ -559,6 +566,10 @@ static void gic_restore_pending_irqs(struct vcpu *v)
     if ( list_empty(&v->arch.vgic.lr_pending) )
         goto out;
 
+    /* Nothing changed since the last attempt found no LR to use. */
+    if ( v->arch.vgic.lr_pending_stalled && lr_all_full() )
+        goto out;
+
     inflight_r = &v->arch.vgic.inflight_irqs;
     list_for_each_entry_safe ( p, t, &v->arch.vgic.lr_pending, lr_queue )
     {
@@ -569,16 +580,17 @@ static void gic_restore_pending_irqs(struct vcpu *v)
             list_for_each_entry_reverse( p_r, inflight_r, inflight )
             {
                 if ( p_r->priority == p->priority )
-                    goto out;
+                    goto stalled;
                 if ( test_bit(GIC_IRQ_GUEST_VISIBLE, &p_r->status) &&
                      !test_bit(GIC_IRQ_GUEST_ACTIVE, &p_r->status) )
                     goto found;
             }
             /* We didn't find a victim this time, and we won't next
              * time, so quit */
-            goto out;
+            goto stalled;
 
 found:
+            v->arch.vgic.lr_evictions++;
             lr = p_r->lr;
             p_r->lr = GIC_INVALID_LR;
             set_bit(GIC_IRQ_GUEST_QUEUED, &p_r->status);
@@ -596,7 +608,10 @@ found:
         if ( lrs == 0 )
             break;
     }
+    goto out;
 
+stalled:
+    v->arch.vgic.lr_pending_stalled = true;
 out:
     spin_unlock_irqrestore(&v->arch.vgic.lock, flags);
 }
@@ -608,6 +623,7 @@ void gic_clear_pending_irqs(struct vcpu *v)
     ASSERT(spin_is_locked(&v->arch.vgic.lock));
 
     v->arch.lr_mask = 0;
+    v->arch.vgic.lr_pending_stalled = false;
     list_for_each_entry_safe ( p, t, &v->arch.vgic.lr_pending, lr_queue )
         list_del_init(&p->lr_queue);
 }
@@ -738,6 +754,9 @@ void gic_dump_info(struct vcpu *v)
     struct pending_irq *p;
 
     printk("GICH_LRs (vcpu %d) mask=%"PRIx64"\n", v->vcpu_id, v->arch.lr_mask);
+    printk("LR overflows=%u evictions=%u%s\n", v->arch.vgic.lr_overflows,
+           v->arch.vgic.lr_evictions,
+           v->arch.vgic.lr_pending_stalled ? " (stalled)" : "");
     gic_hw_ops->dump_state(v);
 
     list_for_each_entry ( p, &v->arch.vgic.inflight_irqs, inflight )
@@ -71,10 +71,13 @@ static inline bool p2m_is_superpage(lpae_t pte, unsigned int level)
 
 static void p2m_flush_tlb(struct p2m_domain *p2m);
 
+/* P2M whose deferred TLB flush this CPU leaves to p2m_flush_deferred(). */
+static DEFINE_PER_CPU(struct p2m_domain *, p2m_flush_batch);
+
 /* Unlock the flush and do a P2M TLB flush if necessary */
 void p2m_write_unlock(struct p2m_domain *p2m)
 {
-    if ( p2m->need_flush )
+    if ( p2m->need_flush && this_cpu(p2m_flush_batch) != p2m )
     {
         p2m->need_flush = false;
         /*
@@ -182,6 +185,33 @@ static void p2m_flush_tlb(struct p2m_domain *p2m)
     }
 }
 
+/*
+ * Start a batch of operations on the P2M of @d, whose TLB flushes for
+ * removed mappings are done only once, by p2m_flush_deferred().  The
+ * caller must not release any reference to the pages unmapped before
+ * then.
+ */
+void p2m_defer_flush(struct domain *d)
+{
+    ASSERT(!this_cpu(p2m_flush_batch));
+    this_cpu(p2m_flush_batch) = &d->arch.p2m;
+}
+
+/* End the batch started by p2m_defer_flush(), doing its TLB flush. */
+void p2m_flush_deferred(void)
+{
+    struct p2m_domain *p2m = this_cpu(p2m_flush_batch);
+
+    if ( !p2m )
+        return;
+
+    this_cpu(p2m_flush_batch) = NULL;
+
+    /* Flushes, with the lock held, if a flush is still needed. */
+    p2m_write_lock(p2m);
+    p2m_write_unlock(p2m);
+}
+
 /*
  * Force a synchronous P2M TLB flush.
  *
@@ -967,7 +997,15 @@ static int __p2m_set_entry(struct p2m_domain *p2m,
                 p2m->need_flush = true;
         }
         else /* new mapping */
+        {
+            /*
+             * The flush for a mapping previously removed from this entry
+             * may still be pending (see p2m_defer_flush()).
+             */
+            if ( p2m->need_flush )
+                p2m_flush_tlb_sync(p2m);
             p2m->stats.mappings[level]++;
+        }
 
         p2m_write_pte(entry, pte, p2m->clean_pte);
 
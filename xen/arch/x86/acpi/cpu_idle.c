@@ -579,8 +579,11 @@ static void acpi_processor_idle(void)
      */
     local_irq_disable();
 
+    rcu_idle_enter(smp_processor_id());
+
     if ( !cpu_is_haltable(smp_processor_id()) )
     {
+        rcu_idle_exit(smp_processor_id());
         local_irq_enable();
         sched_tick_resume();
         cpufreq_dbs_timer_resume();
@@ -706,6 +709,7 @@ static void acpi_processor_idle(void)
     default:
         /* Now in C0 */
         power->last_state = &power->states[0];
+        rcu_idle_exit(smp_processor_id());
         local_irq_enable();
         sched_tick_resume();
         cpufreq_dbs_timer_resume();
@@ -715,6 +719,7 @@ static void acpi_processor_idle(void)
     /* Now in C0 */
     power->last_state = &power->states[0];
 
+    rcu_idle_exit(smp_processor_id());
     sched_tick_resume();
     cpufreq_dbs_timer_resume();
 
@@ -1221,6 +1226,9 @@ int pmstat_get_cx_stat(uint32_t cpuid, struct pm_cx_stat *stat)
         stat->idle_time = 0;
         stat->nr_pc = 0;
         stat->nr_cc = 0;
+        stat->predicted_us = 0;
+        stat->measured_us = 0;
+        stat->early = 0;
         return 0;
     }
 
@@ -1311,12 +1319,17 @@ int pmstat_get_cx_stat(uint32_t cpuid, struct pm_cx_stat *stat)
 
     stat->nr_pc = nr_pc;
     stat->nr_cc = nr_cc;
+    menu_get_residency_stats(cpuid, &stat->predicted_us, &stat->measured_us,
+                             &stat->early);
 
     return 0;
 }
 
 int pmstat_reset_cx_stat(uint32_t cpuid)
 {
+    if ( processor_powers[cpuid] )
+        menu_reset_residency_stats(cpuid);
+
     return 0;
 }
 
@@ -28,6 +28,7 @@
 #include <xen/acpi.h>
 #include <xen/timer.h>
 #include <xen/cpuidle.h>
+#include <xen/sched.h>
 #include <asm/irq.h>
 
 #define BUCKETS 6
@@ -35,6 +36,7 @@
 #define DECAY 4
 #define MAX_INTERESTING 50000
 #define LATENCY_MULTIPLIER 10
+#define INTERVALS 8
 
 /*
  * Concepts and ideas behind the menu governor
@@ -43,7 +45,7 @@
  * state:
  * 1) Energy break even point
  * 2) Performance impact
- * 3) Latency tolerance (TBD: from guest virtual C state)
+ * 3) Latency tolerance, as hinted per domain by the toolstack
  * These these three factors are treated independently.
  *
  * Energy break even point
@@ -90,6 +92,20 @@
  * As an additional rule to reduce the performance impact, menu tries to
  * limit the exit latency duration to be no more than 10% of the decaying
  * measured idle time.
+ *
+ * Repeating patterns
+ * ------------------
+ * Neither the timer nor the correction factor see wakeups which come in at
+ * a steady rate, like a guest's periodic event channel notifications, some
+ * way short of the next timer.  So the last INTERVALS idle durations are
+ * kept, and when they are consistent enough their average is used as the
+ * prediction, if that is shorter.
+ *
+ * Latency tolerance
+ * -----------------
+ * A domain may have a limit set for the exit latency it tolerates.  The
+ * vCPU which ran here last is the one most likely to be woken here next,
+ * so its domain's limit applies.
  */
 
 struct perf_factor{
@@ -109,7 +125,14 @@ struct menu_device
     unsigned int    exit_us;
     unsigned int    bucket;
     u64             correction_factor[BUCKETS];
+    unsigned int    intervals[INTERVALS];
+    unsigned int    interval_ptr;
     struct perf_factor pf;
+
+    /* Prediction accuracy, for PMSTAT_get_cxstat. */
+    u64             predicted_total_us;
+    u64             measured_total_us;
+    u64             early_wakeups;
 };
 
 static DEFINE_PER_CPU(struct menu_device, menu_devices);
@@ -185,11 +208,76 @@ static unsigned int get_sleep_length_us(void)
     return (us >> 32) ? (unsigned int)-2000 : (unsigned int)us;
 }
 
+/*
+ * Try detecting repeating patterns by keeping track of the last INTERVALS
+ * durations, and if the standard deviation is small enough use their
+ * average.  Outliers above the average get discarded, as long as three
+ * quarters of the samples remain.
+ */
+static unsigned int get_typical_interval(const struct menu_device *data)
+{
+    unsigned int i, divisor, max, thresh = UINT_MAX;
+    uint64_t avg, variance;
+
+    for ( ; ; )
+    {
+        max = divisor = 0;
+        avg = variance = 0;
+        for ( i = 0; i < INTERVALS; i++ )
+        {
+            unsigned int value = data->intervals[i];
+
+            if ( value <= thresh )
+            {
+                avg += value;
+                divisor++;
+                if ( value > max )
+                    max = value;
+            }
+        }
+        avg /= divisor;
+
+        for ( i = 0; i < INTERVALS; i++ )
+        {
+            unsigned int value = data->intervals[i];
+
+            if ( value <= thresh )
+                variance += (avg - value) * (avg - value);
+        }
+        variance /= divisor;
+
+        /*
+         * Accept the average when the standard deviation is below a sixth
+         * of it, or below 20us.
+         */
+        if ( (avg * avg > variance * 36 && divisor * 4 >= INTERVALS * 3) ||
+             variance <= 400 )
+            return avg;
+
+        if ( divisor * 4 <= INTERVALS * 3 )
+            return UINT_MAX;
+
+        thresh = max - 1;
+    }
+}
+
+/*
+ * curr_vcpu is still the last guest vCPU which ran here, if any.  It can't
+ * go away under our feet: this CPU isn't RCU idle yet.
+ */
+static unsigned int get_latency_req_us(void)
+{
+    const struct vcpu *v = this_cpu(curr_vcpu);
+
+    return is_idle_vcpu(v) ? 0 : v->domain->idle_latency_us;
+}
+
 static int menu_select(struct acpi_processor_power *power)
 {
     struct menu_device *data = &__get_cpu_var(menu_devices);
     int i;
     s_time_t    io_interval;
+    unsigned int latency_req, typical_us;
 
     /*  TBD: Change to 0 if C0(polling mode) support is added later*/
     data->last_state_idx = CPUIDLE_DRIVER_STATE_START;
@@ -218,6 +306,12 @@ static int menu_select(struct acpi_processor_power *power)
             data->expected_us * data->correction_factor[data->bucket],
             RESOLUTION * DECAY);
 
+    typical_us = get_typical_interval(data);
+    if ( typical_us < data->predicted_us )
+        data->predicted_us = typical_us;
+
+    latency_req = get_latency_req_us();
+
     /* find the deepest idle state that satisfies our constraints */
     for ( i = CPUIDLE_DRIVER_STATE_START + 1; i < power->count; i++ )
     {
@@ -229,7 +323,8 @@ static int menu_select(struct acpi_processor_power *power)
             break;
         if (s->latency * LATENCY_MULTIPLIER > data->latency_factor)
             break;
-        /* TBD: we need to check the QoS requirment in future */
+        if ( latency_req && s->latency > latency_req )
+            break;
         data->exit_us = s->latency;
         data->last_state_idx = i;
     }
@@ -251,6 +346,18 @@ static void menu_reflect(struct acpi_processor_power *power)
     if (data->measured_us > data->exit_us)
         data->measured_us -= data->exit_us;
 
+    data->predicted_total_us += data->predicted_us;
+    data->measured_total_us += data->measured_us;
+    if ( data->last_state_idx > CPUIDLE_DRIVER_STATE_START &&
+         data->measured_us <
+         power->states[data->last_state_idx].target_residency )
+        data->early_wakeups++;
+
+    data->intervals[data->interval_ptr++] =
+        min(data->measured_us, (unsigned int)MAX_INTERESTING);
+    if ( data->interval_ptr >= INTERVALS )
+        data->interval_ptr = 0;
+
     /* update our correction ratio */
 
     new_factor = data->correction_factor[data->bucket]
@@ -301,3 +408,23 @@ void menu_get_trace_data(u32 *expected, u32 *pred)
     *expected = data->expected_us;
     *pred = data->predicted_us;
 }
+
+void menu_get_residency_stats(unsigned int cpu, uint64_t *predicted_us,
+                              uint64_t *measured_us, uint64_t *early)
+{
+    const struct menu_device *data = &per_cpu(menu_devices, cpu);
+
+    *predicted_us = data->predicted_total_us;
+    *measured_us = data->measured_total_us;
+    *early = data->early_wakeups;
+}
+
+void menu_reset_residency_stats(unsigned int cpu)
+{
+    struct menu_device *data = &per_cpu(menu_devices, cpu);
+
+    /* Racing with the CPU going idle, an update may get lost. */
+    data->predicted_total_us = 0;
+    data->measured_total_us = 0;
+    data->early_wakeups = 0;
+}
@@ -749,7 +749,10 @@ static void mwait_idle(void)
 	/* Interrupts must be disabled for C2 and higher transitions. */
 	local_irq_disable();
 
+	rcu_idle_enter(cpu);
+
 	if (!cpu_is_haltable(cpu)) {
+		rcu_idle_exit(cpu);
 		local_irq_enable();
 		sched_tick_resume();
 		cpufreq_dbs_timer_resume();
@@ -788,6 +791,7 @@ static void mwait_idle(void)
 
 	/* Now back in C0. */
 	update_idle_stats(power, cx, before, after);
+	rcu_idle_exit(cpu);
 	local_irq_enable();
 
 	if (!(lapic_timer_reliable_states & (1 << cstate)))
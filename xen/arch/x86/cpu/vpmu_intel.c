@@ -85,6 +85,23 @@ static unsigned int __read_mostly arch_pmc_cnt, fixed_pmc_cnt;
 static uint64_t __read_mostly fixed_ctrl_mask, fixed_counters_mask;
 static uint64_t __read_mostly global_ovf_ctrl_mask, global_ctrl_mask;
 
+/*
+ * Hypervisor-only state.  Counters are numbered as in the global registers:
+ * general-purpose ones from bit 0, fixed ones from bit 32.
+ */
+struct core2_vpmu_priv {
+    uint64_t enabled_cntrs;     /* Enabled in their control register */
+    uint64_t live_cntrs;        /* Counter or control possibly non-zero */
+};
+
+/*
+ * Counters, including their controls, known to be zero in hardware on this
+ * CPU.  Only live counters get switched with a vCPU; the others cannot have
+ * changed, as writing them is intercepted, and only need clearing once after
+ * a vCPU which used them ran here.
+ */
+static DEFINE_PER_CPU(uint64_t, core2_clean_cntrs);
+
 /* Total size of PMU registers block (copied to/from PV(H) guest) */
 static unsigned int __read_mostly regs_sz;
 /* Offset into context of the beginning of PMU register block */
@@ -230,29 +247,53 @@ static inline int msraddr_to_bitpos(int x)
     return x;
 }
 
-static void core2_vpmu_set_msr_bitmap(unsigned long *msr_bitmap)
+static void core2_vpmu_intercept_cntr_write(unsigned long *msr_bitmap,
+                                            unsigned int cntr,
+                                            bool_t intercept)
+{
+    unsigned long *wr_bitmap = msr_bitmap + 0x800/BYTES_PER_LONG;
+    unsigned int msr[2], i, nr = 1;
+
+    if ( cntr >= 32 )
+        msr[0] = MSR_CORE_PERF_FIXED_CTR0 + cntr - 32;
+    else
+    {
+        msr[0] = MSR_IA32_PERFCTR0 + cntr;
+        if ( full_width_write )
+            msr[nr++] = MSR_IA32_A_PERFCTR0 + cntr;
+    }
+
+    for ( i = 0; i < nr; i++ )
+    {
+        if ( intercept )
+            set_bit(msraddr_to_bitpos(msr[i]), wr_bitmap);
+        else
+            clear_bit(msraddr_to_bitpos(msr[i]), wr_bitmap);
+    }
+}
+
+static void core2_vpmu_set_msr_bitmap(unsigned long *msr_bitmap,
+                                      uint64_t live_cntrs)
 {
     int i;
 
-    /* Allow Read/Write PMU Counters MSR Directly. */
+    /*
+     * Allow Read PMU Counters MSR Directly, but Write only the live ones:
+     * other counters have to become live first, to be switched from then on.
+     */
     for ( i = 0; i < fixed_pmc_cnt; i++ )
     {
         clear_bit(msraddr_to_bitpos(MSR_CORE_PERF_FIXED_CTR0 + i), msr_bitmap);
-        clear_bit(msraddr_to_bitpos(MSR_CORE_PERF_FIXED_CTR0 + i),
-                  msr_bitmap + 0x800/BYTES_PER_LONG);
+        core2_vpmu_intercept_cntr_write(msr_bitmap, 32 + i,
+                                        !(live_cntrs & ((1ULL << 32) << i)));
     }
     for ( i = 0; i < arch_pmc_cnt; i++ )
     {
         clear_bit(msraddr_to_bitpos(MSR_IA32_PERFCTR0+i), msr_bitmap);
-        clear_bit(msraddr_to_bitpos(MSR_IA32_PERFCTR0+i),
-                  msr_bitmap + 0x800/BYTES_PER_LONG);
-
         if ( full_width_write )
-        {
             clear_bit(msraddr_to_bitpos(MSR_IA32_A_PERFCTR0 + i), msr_bitmap);
-            clear_bit(msraddr_to_bitpos(MSR_IA32_A_PERFCTR0 + i),
-                      msr_bitmap + 0x800/BYTES_PER_LONG);
-        }
+        core2_vpmu_intercept_cntr_write(msr_bitmap, i,
+                                        !(live_cntrs & (1ULL << i)));
     }
 
     /* Allow Read PMU Non-global Controls Directly. */
@@ -298,14 +339,25 @@ static inline void __core2_vpmu_save(struct vcpu *v)
 {
     int i;
     struct xen_pmu_intel_ctxt *core2_vpmu_cxt = vcpu_vpmu(v)->context;
+    const struct core2_vpmu_priv *priv = vcpu_vpmu(v)->priv_context;
     uint64_t *fixed_counters = vpmu_reg_pointer(core2_vpmu_cxt, fixed_counters);
     struct xen_pmu_cntr_pair *xen_pmu_cntr_pair =
         vpmu_reg_pointer(core2_vpmu_cxt, arch_counters);
+    uint64_t live = priv->live_cntrs;
+
+    /*
+     * In XENPMU_MODE_ALL the hardware domain samples whatever is loaded,
+     * which needn't be the context the live counters were tracked for.
+     */
+    if ( vpmu_mode & XENPMU_MODE_ALL )
+        live = ~0ULL;
 
     for ( i = 0; i < fixed_pmc_cnt; i++ )
-        rdmsrl(MSR_CORE_PERF_FIXED_CTR0 + i, fixed_counters[i]);
+        if ( live & ((1ULL << 32) << i) )
+            rdmsrl(MSR_CORE_PERF_FIXED_CTR0 + i, fixed_counters[i]);
     for ( i = 0; i < arch_pmc_cnt; i++ )
-        rdmsrl(MSR_IA32_PERFCTR0 + i, xen_pmu_cntr_pair[i].counter);
+        if ( live & (1ULL << i) )
+            rdmsrl(MSR_IA32_PERFCTR0 + i, xen_pmu_cntr_pair[i].counter);
 
     if ( !is_hvm_vcpu(v) )
         rdmsrl(MSR_CORE_PERF_GLOBAL_STATUS, core2_vpmu_cxt->global_status);
@@ -342,12 +394,25 @@ static inline void __core2_vpmu_load(struct vcpu *v)
 {
     unsigned int i, pmc_start;
     struct xen_pmu_intel_ctxt *core2_vpmu_cxt = vcpu_vpmu(v)->context;
+    struct core2_vpmu_priv *priv = vcpu_vpmu(v)->priv_context;
     uint64_t *fixed_counters = vpmu_reg_pointer(core2_vpmu_cxt, fixed_counters);
     struct xen_pmu_cntr_pair *xen_pmu_cntr_pair =
         vpmu_reg_pointer(core2_vpmu_cxt, arch_counters);
+    uint64_t *clean = &this_cpu(core2_clean_cntrs);
+    uint64_t live = 0, fixed_ctrl = core2_vpmu_cxt->fixed_ctrl;
 
+    /* Write the live counters, and clear what others ran here used. */
     for ( i = 0; i < fixed_pmc_cnt; i++ )
+    {
+        uint64_t bit = (1ULL << 32) << i;
+
+        if ( fixed_counters[i] ||
+             ((fixed_ctrl >> (i * FIXED_CTR_CTRL_BITS)) & FIXED_CTR_CTRL_MASK) )
+            live |= bit;
+        else if ( *clean & bit )
+            continue;
         wrmsrl(MSR_CORE_PERF_FIXED_CTR0 + i, fixed_counters[i]);
+    }
 
     if ( full_width_write )
         pmc_start = MSR_IA32_A_PERFCTR0;
@@ -355,10 +420,19 @@ static inline void __core2_vpmu_load(struct vcpu *v)
         pmc_start = MSR_IA32_PERFCTR0;
     for ( i = 0; i < arch_pmc_cnt; i++ )
     {
+        if ( xen_pmu_cntr_pair[i].counter || xen_pmu_cntr_pair[i].control )
+            live |= 1ULL << i;
+        else if ( *clean & (1ULL << i) )
+            continue;
         wrmsrl(pmc_start + i, xen_pmu_cntr_pair[i].counter);
         wrmsrl(MSR_P6_EVNTSEL(i), xen_pmu_cntr_pair[i].control);
     }
 
+    priv->live_cntrs = live;
+    *clean = ~live;
+    if ( is_hvm_vcpu(v) && cpu_has_vmx_msr_bitmap )
+        core2_vpmu_set_msr_bitmap(v->arch.hvm_vmx.msr_bitmap, live);
+
     wrmsrl(MSR_CORE_PERF_FIXED_CTR_CTRL, core2_vpmu_cxt->fixed_ctrl);
     if ( vpmu_is_set(vcpu_vpmu(v), VPMU_CPU_HAS_DS) )
         wrmsrl(MSR_IA32_DS_AREA, core2_vpmu_cxt->ds_area);
@@ -380,7 +454,7 @@ static int core2_vpmu_verify(struct vcpu *v)
     struct xen_pmu_cntr_pair *xen_pmu_cntr_pair =
         vpmu_reg_pointer(core2_vpmu_cxt, arch_counters);
     uint64_t fixed_ctrl;
-    uint64_t *priv_context = vpmu->priv_context;
+    struct core2_vpmu_priv *priv = vpmu->priv_context;
     uint64_t enabled_cntrs = 0;
 
     if ( core2_vpmu_cxt->global_ovf_ctrl & global_ovf_ctrl_mask )
@@ -425,7 +499,7 @@ static int core2_vpmu_verify(struct vcpu *v)
     else
         vpmu_reset(vpmu, VPMU_RUNNING);
 
-    *priv_context = enabled_cntrs;
+    priv->enabled_cntrs = enabled_cntrs;
 
     return 0;
 }
@@ -470,7 +544,7 @@ static int core2_vpmu_alloc_resource(struct vcpu *v)
 {
     struct vpmu_struct *vpmu = vcpu_vpmu(v);
     struct xen_pmu_intel_ctxt *core2_vpmu_cxt = NULL;
-    uint64_t *p = NULL;
+    struct core2_vpmu_priv *p = NULL;
 
     if ( !acquire_pmu_ownership(PMU_OWNER_HVM) )
         return 0;
@@ -490,7 +564,7 @@ static int core2_vpmu_alloc_resource(struct vcpu *v)
                                    sizeof(uint64_t) * fixed_pmc_cnt +
                                    sizeof(struct xen_pmu_cntr_pair) *
                                    arch_pmc_cnt);
-    p = xzalloc(uint64_t);
+    p = xzalloc(struct core2_vpmu_priv);
     if ( !core2_vpmu_cxt || !p )
         goto out_err;
 
@@ -540,13 +614,25 @@ static int core2_vpmu_msr_common_check(u32 msr_index, int *type, int *index)
     {
         __core2_vpmu_load(current);
         vpmu_set(vpmu, VPMU_CONTEXT_LOADED);
-        if ( is_hvm_vcpu(current) &&
-             cpu_has_vmx_msr_bitmap )
-            core2_vpmu_set_msr_bitmap(current->arch.hvm_vmx.msr_bitmap);
     }
     return 1;
 }
 
+/* Counter @cntr of the loaded vCPU @v may no longer be zero. */
+static void core2_vpmu_mark_live(struct vcpu *v, unsigned int cntr)
+{
+    struct core2_vpmu_priv *priv = vcpu_vpmu(v)->priv_context;
+    uint64_t bit = 1ULL << cntr;
+
+    if ( priv->live_cntrs & bit )
+        return;
+
+    priv->live_cntrs |= bit;
+    this_cpu(core2_clean_cntrs) &= ~bit;
+    if ( is_hvm_vcpu(v) && cpu_has_vmx_msr_bitmap )
+        core2_vpmu_intercept_cntr_write(v->arch.hvm_vmx.msr_bitmap, cntr, 0);
+}
+
 static int core2_vpmu_do_wrmsr(unsigned int msr, uint64_t msr_content,
                                uint64_t supported)
 {
@@ -555,6 +641,7 @@ static int core2_vpmu_do_wrmsr(unsigned int msr, uint64_t msr_content,
     struct vcpu *v = current;
     struct vpmu_struct *vpmu = vcpu_vpmu(v);
     struct xen_pmu_intel_ctxt *core2_vpmu_cxt;
+    struct core2_vpmu_priv *priv;
     uint64_t *enabled_cntrs;
 
     if ( !core2_vpmu_msr_common_check(msr, &type, &index) )
@@ -587,7 +674,8 @@ static int core2_vpmu_do_wrmsr(unsigned int msr, uint64_t msr_content,
         return -EINVAL;
 
     core2_vpmu_cxt = vpmu->context;
-    enabled_cntrs = vpmu->priv_context;
+    priv = vpmu->priv_context;
+    enabled_cntrs = &priv->enabled_cntrs;
     switch ( msr )
     {
     case MSR_CORE_PERF_GLOBAL_OVF_CTRL:
@@ -648,6 +736,8 @@ static int core2_vpmu_do_wrmsr(unsigned int msr, uint64_t msr_content,
             {
                 if ( val & 3 )
                     *enabled_cntrs |= (1ULL << 32) << i;
+                if ( val & FIXED_CTR_CTRL_MASK )
+                    core2_vpmu_mark_live(v, 32 + i);
                 val >>= FIXED_CTR_CTRL_BITS;
             }
         }
@@ -714,11 +804,18 @@ static int core2_vpmu_do_wrmsr(unsigned int msr, uint64_t msr_content,
                 *enabled_cntrs |= 1ULL << tmp;
             else
                 *enabled_cntrs &= ~(1ULL << tmp);
+            if ( msr_content )
+                core2_vpmu_mark_live(v, tmp);
 
             xen_pmu_cntr_pair[tmp].control = msr_content;
         }
     }
 
+    if ( msr_content && type == MSR_TYPE_COUNTER )
+        core2_vpmu_mark_live(v, 32 + index);
+    else if ( msr_content && type == MSR_TYPE_ARCH_COUNTER )
+        core2_vpmu_mark_live(v, index);
+
     if ( type != MSR_TYPE_GLOBAL )
         wrmsrl(msr, msr_content);
     else
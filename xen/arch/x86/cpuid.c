@@ -1,5 +1,6 @@
 #include <xen/init.h>
 #include <xen/lib.h>
+#include <xen/perfc.h>
 #include <xen/sched.h>
 #include <asm/cpuid.h>
 #include <asm/hvm/hvm.h>
@@ -41,6 +42,34 @@ static void cpuid_count_leaf(uint32_t leaf, uint32_t subleaf,
     cpuid_count(leaf, subleaf, &data->a, &data->b, &data->c, &data->d);
 }
 
+/*
+ * CPUID[0xD,0/1].EBX depend on the XCR0 in context, which guests hardly
+ * ever change.  Remember the last values read on each CPU rather than
+ * executing CPUID again for every guest query of these leaves.
+ */
+struct xstate_size_cache {
+    uint64_t xcr0[2];
+    uint32_t ebx[2];
+};
+static DEFINE_PER_CPU(struct xstate_size_cache, xstate_size_cache);
+
+static uint32_t xstate_size_ebx(unsigned int subleaf)
+{
+    struct xstate_size_cache *c = &this_cpu(xstate_size_cache);
+    uint64_t xcr0 = get_xcr0();
+
+    ASSERT(subleaf < ARRAY_SIZE(c->ebx));
+
+    /* XCR0 always has x87 set, so 0 never matches. */
+    if ( c->xcr0[subleaf] != xcr0 )
+    {
+        c->ebx[subleaf] = cpuid_count_ebx(XSTATE_CPUID, subleaf);
+        c->xcr0[subleaf] = xcr0;
+    }
+
+    return c->ebx[subleaf];
+}
+
 static void sanitise_featureset(uint32_t *fs)
 {
     /* for_each_set_bit() uses unsigned longs.  Extend with zeroes. */
@@ -605,6 +634,8 @@ void guest_cpuid(const struct vcpu *v, uint32_t leaf,
 
     *res = EMPTY_LEAF;
 
+    perfc_incr_dom(guest_cpuid, d);
+
     /*
      * First pass:
      * - Perform max_leaf/subleaf calculations.  Out-of-range leaves return
@@ -900,9 +931,10 @@ void guest_cpuid(const struct vcpu *v, uint32_t leaf,
                 /*
                  * Read CPUID[0xD,0/1].EBX from hardware.  They vary with
                  * enabled XSTATE, and appropraite XCR0|XSS are in context.
+                 * XSS is always 0 (see above), so XCR0 alone keys the cache.
                  */
         case 0:
-                res->b = cpuid_count_ebx(leaf, subleaf);
+                res->b = xstate_size_ebx(subleaf);
             }
             break;
         }
@@ -33,6 +33,8 @@
 #include <xen/pci.h>
 #include <xen/paging.h>
 #include <xen/cpu.h>
+#include <xen/sched-if.h>
+#include <xen/tasklet.h>
 #include <xen/wait.h>
 #include <xen/guest_access.h>
 #include <xen/livepatch.h>
@@ -114,11 +116,20 @@ static void play_dead(void)
 
 static void idle_loop(void)
 {
+    unsigned int cpu = smp_processor_id();
+
     for ( ; ; )
     {
-        if ( cpu_is_offline(smp_processor_id()) )
+        if ( cpu_is_offline(cpu) )
             play_dead();
-        (*pm_idle)();
+        /*
+         * Test softirqs twice --- first to see if should even try scrubbing
+         * and then, after it is done, whether softirqs became pending
+         * while we were scrubbing.
+         */
+        if ( !softirq_pending(cpu) && !scrub_free_pages() &&
+             !softirq_pending(cpu) )
+            (*pm_idle)();
         do_tasklet();
         do_softirq();
         /*
@@ -2306,6 +2317,171 @@ static int relinquish_memory(
     return ret;
 }
 
+/*
+ * Tearing down the memory of large HVM guests gets spread across up to this
+ * many CPUs (the one doing the teardown included).
+ */
+static unsigned int __read_mostly opt_teardown_workers = 4;
+integer_param("teardown_workers", opt_teardown_workers);
+
+/* Guests smaller than this (1GiB) aren't worth the fan-out. */
+#define RELMEM_PARALLEL_MIN_PAGES (1UL << (30 - PAGE_SHIFT))
+#define RELMEM_BATCH              256
+
+struct relmem_worker {
+    struct tasklet tasklet;
+    struct domain *domain;
+};
+
+/*
+ * Take a batch of pages off @d's page list and drop the domain's own
+ * references to them. Returns the number of pages taken, i.e. 0 once
+ * the list is empty. May run on several CPUs at once.
+ *
+ * Pages are held on a private list only while we hold a reference, so that
+ * nobody else can free them (and unlink them from a list they aren't on).
+ * Anything needing more than dropping the allocation reference is left for
+ * the serial passes of domain_relinquish_resources().
+ */
+static unsigned int relmem_drain_batch(struct domain *d)
+{
+    struct page_info *page;
+    PAGE_LIST_HEAD(batch);
+    unsigned int n = 0;
+
+    spin_lock(&d->page_alloc_lock);
+
+    while ( n < RELMEM_BATCH && (page = page_list_remove_head(&d->page_list)) )
+    {
+        n++;
+
+        if ( unlikely(!get_page(page, d)) )
+        {
+            /* Couldn't get a reference -- someone is freeing this page. */
+            page_list_add_tail(page, &d->arch.relmem_list);
+            continue;
+        }
+
+        if ( unlikely(page->u.inuse.type_info & (PGT_pinned | PGT_partial)) )
+        {
+            page_list_add_tail(page, &d->arch.relmem_list);
+            put_page(page);
+            continue;
+        }
+
+        page_list_add_tail(page, &batch);
+    }
+
+    spin_unlock(&d->page_alloc_lock);
+
+    while ( (page = page_list_remove_head(&batch)) )
+    {
+        clear_superpage_mark(page);
+
+        if ( test_and_clear_bit(_PGC_allocated, &page->count_info) )
+            put_page(page);
+
+        /* Put the page on the list and /then/ potentially free it. */
+        spin_lock(&d->page_alloc_lock);
+        page_list_add_tail(page, &d->arch.relmem_list);
+        spin_unlock(&d->page_alloc_lock);
+        put_page(page);
+    }
+
+    return n;
+}
+
+static void relmem_worker_fn(unsigned long data)
+{
+    struct relmem_worker *w = (struct relmem_worker *)data;
+    struct domain *d = w->domain;
+
+    while ( relmem_drain_batch(d) )
+        if ( softirq_pending(smp_processor_id()) )
+        {
+            /* Let the CPU get on with other work, and come back later. */
+            tasklet_schedule(&w->tasklet);
+            return;
+        }
+
+    atomic_dec(&d->arch.relmem_busy);
+}
+
+/* Fan the work out to (preferably idle) other CPUs. */
+static void relmem_start_workers(struct domain *d)
+{
+    unsigned int cpu, this_cpu = smp_processor_id(), nr = 0, want;
+    struct relmem_worker *w;
+
+    want = min_t(unsigned int, opt_teardown_workers, num_online_cpus());
+    if ( want < 2 || d->tot_pages < RELMEM_PARALLEL_MIN_PAGES )
+        return;
+    want--;
+
+    w = xzalloc_array(struct relmem_worker, want);
+    if ( !w )
+        return;
+
+    d->arch.relmem_workers = w;
+    atomic_set(&d->arch.relmem_busy, want);
+
+    for_each_online_cpu ( cpu )
+    {
+        if ( nr == want )
+            break;
+        if ( cpu == this_cpu || !is_idle_vcpu(curr_on_cpu(cpu)) )
+            continue;
+
+        w[nr].domain = d;
+        tasklet_init(&w[nr].tasklet, relmem_worker_fn, (unsigned long)&w[nr]);
+        tasklet_schedule_on_cpu(&w[nr].tasklet, cpu);
+        nr++;
+    }
+
+    d->arch.nr_relmem_workers = nr;
+    /* Account for the helpers we didn't find a CPU for. */
+    atomic_sub(want - nr, &d->arch.relmem_busy);
+}
+
+/*
+ * Free the bulk of an HVM guest's memory in parallel, before the serial
+ * passes deal with whatever is left (pinned or otherwise special pages,
+ * and PV guests' page tables, which need tearing down in order).
+ */
+static int relinquish_memory_parallel(struct domain *d)
+{
+    unsigned int i;
+
+    if ( is_pv_domain(d) )
+        return 0;
+
+    if ( !d->arch.relmem_workers )
+        relmem_start_workers(d);
+
+    /* Help out, until there is nothing left to take. */
+    while ( relmem_drain_batch(d) )
+        if ( hypercall_preempt_check() )
+            return -ERESTART;
+
+    /* Wait for the helpers to finish their last batches. */
+    if ( atomic_read(&d->arch.relmem_busy) )
+        return -ERESTART;
+
+    for ( i = 0; i < d->arch.nr_relmem_workers; i++ )
+        tasklet_kill(&d->arch.relmem_workers[i].tasklet);
+    xfree(d->arch.relmem_workers);
+    d->arch.relmem_workers = NULL;
+    d->arch.nr_relmem_workers = 0;
+
+    /* Hand what's left to the serial passes. */
+    spin_lock(&d->page_alloc_lock);
+    page_list_splice(&d->arch.relmem_list, &d->page_list);
+    INIT_PAGE_LIST_HEAD(&d->arch.relmem_list);
+    spin_unlock(&d->page_alloc_lock);
+
+    return 0;
+}
+
 int domain_relinquish_resources(struct domain *d)
 {
     int ret;
@@ -2378,6 +2554,13 @@ int domain_relinquish_resources(struct domain *d)
         /* Fallthrough. Relinquish every page of memory. */
     case RELMEM_xen:
         ret = relinquish_memory(d, &d->xenpage_list, ~0UL);
+        if ( ret )
+            return ret;
+        d->arch.relmem = RELMEM_parallel;
+        /* fallthrough */
+
+    case RELMEM_parallel:
+        ret = relinquish_memory_parallel(d);
         if ( ret )
             return ret;
         d->arch.relmem = RELMEM_l4;
@@ -2422,6 +2605,11 @@ int domain_relinquish_resources(struct domain *d)
 void arch_dump_domain_info(struct domain *d)
 {
     paging_dump_domain_info(d);
+
+    if ( is_hvm_domain(d) )
+        printk("    pause-loop exits: %"PRIu64" (%"PRIu64" directed yields)\n",
+               d->arch.hvm_domain.pause_loop.exits,
+               d->arch.hvm_domain.pause_loop.directed);
 }
 
 void arch_dump_vcpu_info(struct vcpu *v)
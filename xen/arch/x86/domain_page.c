@@ -70,7 +70,7 @@ void __init mapcache_override_current(struct vcpu *v)
 void *map_domain_page(mfn_t mfn)
 {
     unsigned long flags;
-    unsigned int idx, i;
+    unsigned int idx, i, next = ~0U;
     struct vcpu *v;
     struct mapcache_domain *dcache;
     struct mapcache_vcpu *vcache;
@@ -102,6 +102,7 @@ void *map_domain_page(mfn_t mfn)
         hashent->refcnt++;
         ASSERT(hashent->refcnt);
         ASSERT(l1e_get_pfn(MAPCACHE_L1ENT(idx)) == mfn_x(mfn));
+        perfc_incr(map_domain_page_hit);
         goto out;
     }
 
@@ -135,18 +136,30 @@ void *map_domain_page(mfn_t mfn)
             idx = find_first_zero_bit(dcache->inuse, dcache->entries);
         else
         {
-            /* Replace a hash entry instead. */
+            /*
+             * Replace hash entries instead.  All unreferenced ones get
+             * reclaimed in one go, covered by the flush below, so that the
+             * misses following this one don't each need another sweep and
+             * TLB flush.
+             */
             i = MAPHASH_HASHFN(mfn_x(mfn));
             do {
                 hashent = &vcache->hash[i];
                 if ( hashent->idx != MAPHASHENT_NOTINUSE && !hashent->refcnt )
                 {
-                    idx = hashent->idx;
-                    ASSERT(l1e_get_pfn(MAPCACHE_L1ENT(idx)) == hashent->mfn);
-                    l1e_write(&MAPCACHE_L1ENT(idx), l1e_empty());
+                    ASSERT(l1e_get_pfn(MAPCACHE_L1ENT(hashent->idx)) ==
+                           hashent->mfn);
+                    l1e_write(&MAPCACHE_L1ENT(hashent->idx), l1e_empty());
+                    if ( idx >= dcache->entries )
+                        idx = hashent->idx;
+                    else
+                    {
+                        clear_bit(hashent->idx, dcache->inuse);
+                        next = min(next, hashent->idx);
+                    }
                     hashent->idx = MAPHASHENT_NOTINUSE;
                     hashent->mfn = ~0UL;
-                    break;
+                    perfc_incr(domain_page_hash_reclaim);
                 }
                 if ( ++i == MAPHASH_ENTRIES )
                     i = 0;
@@ -162,7 +175,7 @@ void *map_domain_page(mfn_t mfn)
     }
 
     set_bit(idx, dcache->inuse);
-    dcache->cursor = idx + 1;
+    dcache->cursor = next < idx ? next : idx + 1;
 
     spin_unlock(&dcache->lock);
 
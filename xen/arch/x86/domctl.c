@@ -24,6 +24,7 @@
 #include <asm/hvm/hvm.h>
 #include <asm/hvm/support.h>
 #include <asm/hvm/cacheattr.h>
+#include <asm/hvm/vmx/vmx.h>
 #include <asm/processor.h>
 #include <asm/acpi.h> /* for hvm_acpi_power_button */
 #include <xen/hypercall.h> /* for arch_do_domctl */
@@ -1222,6 +1223,8 @@ long arch_do_domctl(
 
     case XEN_DOMCTL_mem_sharing_op:
         ret = mem_sharing_domctl(d, &domctl->u.mem_sharing_op);
+        if ( !ret )
+            copyback = 1;
         break;
 
 #if P2M_AUDIT
@@ -1454,6 +1457,26 @@ long arch_do_domctl(
             copyback = 1;
             break;
 
+        case XEN_DOMCTL_PSR_CAT_OP_SET_MBA_THRTL:
+            if ( domctl->u.psr_cat_op.data > UINT32_MAX )
+            {
+                ret = -EINVAL;
+                break;
+            }
+            ret = psr_set_mba_thrtl(d, domctl->u.psr_cat_op.target,
+                                    domctl->u.psr_cat_op.data);
+            break;
+
+        case XEN_DOMCTL_PSR_CAT_OP_GET_MBA_THRTL:
+        {
+            uint32_t thrtl;
+
+            ret = psr_get_mba_thrtl(d, domctl->u.psr_cat_op.target, &thrtl);
+            domctl->u.psr_cat_op.data = thrtl;
+            copyback = 1;
+            break;
+        }
+
         default:
             ret = -EOPNOTSUPP;
             break;
@@ -1465,6 +1488,73 @@ long arch_do_domctl(
         recalculate_cpuid_policy(d);
         break;
 
+    case XEN_DOMCTL_rehome_memory:
+    {
+        struct xen_domctl_rehome_memory *rm = &domctl->u.rehome_memory;
+        unsigned long gfn = rm->gfn;
+
+        ret = -EINVAL;
+        if ( d == currd || /* no domain_pause() */
+             gfn != rm->gfn )
+            break;
+
+        ret = p2m_rehome_memory(d, &gfn, rm->nr_gfns, &rm->moved, &rm->busy);
+        rm->gfn = gfn;
+        rm->max_gfn = p2m_get_hostp2m(d)->max_mapped_pfn;
+        copyback = 1;
+        break;
+    }
+
+    case XEN_DOMCTL_numa_balancing:
+    {
+        struct xen_domctl_numa_balancing *nb = &domctl->u.numa_balancing;
+        bool_t enabled;
+
+        ret = -EOPNOTSUPP;
+        if ( !hap_enabled(d) || !cpu_has_vmx )
+            break;
+
+        switch ( nb->op )
+        {
+        case XEN_DOMCTL_NUMA_BALANCING_SET:
+            ret = -EINVAL;
+            if ( d == currd ) /* no domain_pause() */
+                break;
+            ret = ept_set_numa_balancing(p2m_get_hostp2m(d), !!nb->enable);
+            break;
+
+        case XEN_DOMCTL_NUMA_BALANCING_GET:
+            ept_get_numa_balancing(p2m_get_hostp2m(d), &enabled,
+                                   &nb->node, &nb->passes);
+            nb->enable = enabled;
+            if ( nb->node == NUMA_NO_NODE )
+                nb->node = ~0U;
+            copyback = 1;
+            ret = 0;
+            break;
+
+        default:
+            ret = -EINVAL;
+            break;
+        }
+        break;
+    }
+
+    case XEN_DOMCTL_pause_loop_stats:
+    {
+        struct xen_domctl_pause_loop_stats *pl = &domctl->u.pause_loop_stats;
+
+        ret = -EINVAL;
+        if ( !is_hvm_domain(d) )
+            break;
+
+        pl->exits = d->arch.hvm_domain.pause_loop.exits;
+        pl->directed = d->arch.hvm_domain.pause_loop.directed;
+        copyback = 1;
+        ret = 0;
+        break;
+    }
+
     default:
         ret = iommu_do_domctl(domctl, d, u_domctl);
         break;
@@ -115,6 +115,19 @@ unsigned int flush_area_local(const void *va, unsigned int flags)
              */
             asm volatile ( "invlpg %0"
                            : : "m" (*(const char *)(va)) : "memory" );
+
+            /*
+             * INVLPG only covers the current PCID (and global mappings), so
+             * the address needs removing from the other ones as well.
+             */
+            if ( read_cr4() & X86_CR4_PCIDE )
+            {
+                unsigned int pcid, cur = read_cr3() & X86_CR3_PCID_MASK;
+
+                for ( pcid = 0; pcid <= PCID_PV_USER; pcid++ )
+                    if ( pcid != cur )
+                        invpcid_flush_one(pcid, (unsigned long)va);
+            }
         }
         else
         {
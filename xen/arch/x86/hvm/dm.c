@@ -328,11 +328,12 @@ static int dm_op(domid_t domid,
         const_op = false;
 
         rc = -EINVAL;
-        if ( data->pad[0] || data->pad[1] || data->pad[2] )
+        if ( data->pad[0] || data->pad[1] )
             break;
 
         rc = hvm_create_ioreq_server(d, curr_d->domain_id, 0,
-                                     data->handle_bufioreq, &data->id);
+                                     data->handle_bufioreq,
+                                     data->bufioreq_order, &data->id);
         break;
     }
 
@@ -457,6 +458,67 @@ static int dm_op(domid_t domid,
         break;
     }
 
+    case XEN_DMOP_complete_ioreqs:
+    {
+        const struct xen_dm_op_complete_ioreqs *data =
+            &op.u.complete_ioreqs;
+
+        rc = -EINVAL;
+        if ( data->pad )
+            break;
+
+        rc = hvm_complete_ioreqs(d, data->id);
+        break;
+    }
+
+    case XEN_DMOP_get_ioreq_server_stats:
+    {
+        struct xen_dm_op_get_ioreq_server_stats *data =
+            &op.u.get_ioreq_server_stats;
+
+        const_op = false;
+
+        rc = -EINVAL;
+        if ( data->pad0 || data->pad1 )
+            break;
+
+        rc = hvm_get_ioreq_server_stats(d, data->id, data);
+        break;
+    }
+
+    case XEN_DMOP_map_io_event_to_ioreq_server:
+    {
+        struct xen_dm_op_ioreq_server_io_event *data =
+            &op.u.map_io_event_to_ioreq_server;
+
+        const_op = false;
+
+        rc = -EINVAL;
+        if ( data->pad )
+            break;
+
+        rc = hvm_map_io_event_to_ioreq_server(d, data->id, data->type,
+                                              data->addr, data->size,
+                                              data->flags, data->data,
+                                              &data->port);
+        break;
+    }
+
+    case XEN_DMOP_unmap_io_event_from_ioreq_server:
+    {
+        const struct xen_dm_op_ioreq_server_io_event *data =
+            &op.u.unmap_io_event_from_ioreq_server;
+
+        rc = -EINVAL;
+        if ( data->pad )
+            break;
+
+        rc = hvm_unmap_io_event_from_ioreq_server(d, data->id, data->type,
+                                                  data->addr, data->size,
+                                                  data->flags, data->data);
+        break;
+    }
+
     case XEN_DMOP_track_dirty_vram:
     {
         const struct xen_dm_op_track_dirty_vram *data =
@@ -575,6 +637,8 @@ static int dm_op(domid_t domid,
 
 CHECK_dm_op_create_ioreq_server;
 CHECK_dm_op_get_ioreq_server_info;
+CHECK_dm_op_get_ioreq_server_stats;
+CHECK_dm_op_ioreq_server_io_event;
 CHECK_dm_op_ioreq_server_range;
 CHECK_dm_op_set_ioreq_server_state;
 CHECK_dm_op_destroy_ioreq_server;
@@ -586,6 +650,7 @@ CHECK_dm_op_modified_memory;
 CHECK_dm_op_set_mem_type;
 CHECK_dm_op_inject_event;
 CHECK_dm_op_inject_msi;
+CHECK_dm_op_complete_ioreqs;
 
 #define MAX_NR_BUFS 2
 
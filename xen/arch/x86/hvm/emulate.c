@@ -20,6 +20,7 @@
 #include <asm/hvm/emulate.h>
 #include <asm/hvm/hvm.h>
 #include <asm/hvm/ioreq.h>
+#include <asm/hvm/nestedhvm.h>
 #include <asm/hvm/trace.h>
 #include <asm/hvm/support.h>
 #include <asm/hvm/svm/svm.h>
@@ -1934,6 +1935,8 @@ static int _hvm_emulate_one(struct hvm_emulate_ctxt *hvmemul_ctxt,
     struct hvm_vcpu_io *vio = &curr->arch.hvm_vcpu.hvm_io;
     int rc;
 
+    perfc_incr_dom(hvm_emulations, curr->domain);
+
     hvm_emulate_init_per_insn(hvmemul_ctxt, vio->mmio_insn,
                               vio->mmio_insn_bytes);
 
@@ -2121,6 +2124,80 @@ void hvm_emulate_init_once(
     hvmemul_ctxt->ctxt.force_writeback = true;
 }
 
+static bool_t __read_mostly opt_insn_cache = 1;
+boolean_param("hvm_insn_cache", opt_insn_cache);
+
+/*
+ * Fetch the instruction at linear address @addr, for emulation.
+ *
+ * The same few instructions make nearly all accesses to emulated devices,
+ * so remember the frames they were last fetched from, per vCPU and CR3,
+ * to save the guest page walk on the next exit.  A cached translation is
+ * only used while its frame still holds the instruction bytes cached
+ * with it, and not at all for instructions which may cross a page.
+ */
+static unsigned int hvmemul_fetch_insn(uint8_t *buf, unsigned long addr,
+                                       uint32_t pfec)
+{
+    struct vcpu *curr = current;
+    struct hvm_vcpu_io *vio = &curr->arch.hvm_vcpu.hvm_io;
+    unsigned long cr3 = curr->arch.hvm_vcpu.guest_cr[3];
+    unsigned int i, off = addr & ~PAGE_MASK;
+    struct hvm_insn_cache *ent;
+    uint8_t insn[sizeof(ent->insn)];
+    uint32_t walk_pfec = PFEC_page_present | PFEC_insn_fetch | pfec;
+    unsigned long gfn;
+
+    BUILD_BUG_ON(sizeof(ent->insn) !=
+                 sizeof(((struct hvm_emulate_ctxt *)0)->insn_buf));
+
+    if ( !opt_insn_cache || off + sizeof(insn) > PAGE_SIZE ||
+         !hvm_paging_enabled(curr) || nestedhvm_vcpu_in_guestmode(curr) )
+        return hvm_fetch_from_guest_linear(buf, addr, sizeof(insn), pfec,
+                                           NULL) == HVMCOPY_okay ?
+               sizeof(insn) : 0;
+
+    for ( i = 0; i < ARRAY_SIZE(vio->insn_cache); i++ )
+    {
+        ent = &vio->insn_cache[i];
+
+        if ( ent->addr != addr || ent->cr3 != cr3 || ent->pfec != pfec )
+            continue;
+
+        if ( hvm_copy_from_guest_phys(insn, pfn_to_paddr(ent->gfn) | off,
+                                      sizeof(insn)) == HVMCOPY_okay &&
+             !memcmp(insn, ent->insn, sizeof(insn)) )
+        {
+            perfc_incr(insn_cache_hits);
+            memcpy(buf, insn, sizeof(insn));
+            return sizeof(insn);
+        }
+
+        /* Stale: refill this entry. */
+        break;
+    }
+
+    perfc_incr(insn_cache_misses);
+
+    gfn = paging_gva_to_gfn(curr, addr, &walk_pfec);
+    if ( gfn == gfn_x(INVALID_GFN) ||
+         hvm_copy_from_guest_phys(buf, pfn_to_paddr(gfn) | off,
+                                  sizeof(insn)) != HVMCOPY_okay )
+        return 0;
+
+    if ( i == ARRAY_SIZE(vio->insn_cache) )
+        i = vio->insn_cache_next++ % ARRAY_SIZE(vio->insn_cache);
+
+    ent = &vio->insn_cache[i];
+    ent->cr3 = cr3;
+    ent->addr = addr;
+    ent->gfn = gfn;
+    ent->pfec = pfec;
+    memcpy(ent->insn, buf, sizeof(ent->insn));
+
+    return sizeof(insn);
+}
+
 void hvm_emulate_init_per_insn(
     struct hvm_emulate_ctxt *hvmemul_ctxt,
     const unsigned char *insn_buf,
@@ -2157,11 +2234,8 @@ void hvm_emulate_init_per_insn(
                                         sizeof(hvmemul_ctxt->insn_buf),
                                         hvm_access_insn_fetch,
                                         &hvmemul_ctxt->seg_reg[x86_seg_cs],
-                                        &addr) &&
-             hvm_fetch_from_guest_linear(hvmemul_ctxt->insn_buf, addr,
-                                         sizeof(hvmemul_ctxt->insn_buf),
-                                         pfec, NULL) == HVMCOPY_okay) ?
-            sizeof(hvmemul_ctxt->insn_buf) : 0;
+                                        &addr) ?
+             hvmemul_fetch_insn(hvmemul_ctxt->insn_buf, addr, pfec) : 0);
     }
     else
     {
@@ -430,6 +430,7 @@ void hvm_migrate_timers(struct vcpu *v)
 {
     rtc_migrate_timers(v);
     pt_migrate(v);
+    viridian_migrate_timers(v);
 }
 
 static int hvm_migrate_pirq(struct domain *d, struct hvm_pirq_dpci *pirq_dpci,
@@ -448,7 +449,8 @@ static int hvm_migrate_pirq(struct domain *d, struct hvm_pirq_dpci *pirq_dpci,
         if ( !desc )
             return 0;
         ASSERT(MSI_IRQ(desc - irq_desc));
-        irq_set_affinity(desc, cpumask_of(v->processor));
+        /* If rate limited, the move happens on the next remote delivery. */
+        pt_pirq_follow_vcpu(pirq_dpci, desc, v->processor);
         spin_unlock_irq(&desc->lock);
     }
 
@@ -613,6 +615,8 @@ int hvm_domain_initialise(struct domain *d)
     INIT_LIST_HEAD(&d->arch.hvm_domain.write_map.list);
     INIT_LIST_HEAD(&d->arch.hvm_domain.g2m_ioport_list);
 
+    mem_sharing_domain_init(d);
+
     hvm_init_cacheattr_region_list(d);
 
     rc = paging_enable(d, PG_refcounts|PG_translate|PG_external);
@@ -710,6 +714,8 @@ void hvm_domain_relinquish_resources(struct domain *d)
 
     msixtbl_pt_cleanup(d);
 
+    mem_sharing_domain_relinquish(d);
+
     /* Stop all asynchronous timer actions. */
     rtc_deinit(d);
     if ( d->vcpu != NULL && d->vcpu[0] != NULL )
@@ -1492,6 +1498,12 @@ int hvm_vcpu_initialise(struct vcpu *v)
     spin_lock_init(&v->arch.hvm_vcpu.tm_lock);
     INIT_LIST_HEAD(&v->arch.hvm_vcpu.tm_list);
 
+    v->arch.hvm_vcpu.irq_stats = xzalloc(struct hvm_irq_stats);
+    if ( !v->arch.hvm_vcpu.irq_stats ) /* teardown: xfree */
+        return -ENOMEM;
+
+    viridian_vcpu_init(v); /* teardown: viridian_vcpu_deinit */
+
     rc = hvm_vcpu_cacheattr_init(v); /* teardown: vcpu_cacheattr_destroy */
     if ( rc != 0 )
         goto fail1;
@@ -1548,6 +1560,9 @@ int hvm_vcpu_initialise(struct vcpu *v)
  fail2:
     hvm_vcpu_cacheattr_destroy(v);
  fail1:
+    viridian_vcpu_deinit(v);
+    xfree(v->arch.hvm_vcpu.irq_stats);
+    v->arch.hvm_vcpu.irq_stats = NULL;
     return rc;
 }
 
@@ -1571,6 +1586,9 @@ void hvm_vcpu_destroy(struct vcpu *v)
         vlapic_destroy(v);
 
     hvm_vcpu_cacheattr_destroy(v);
+
+    xfree(v->arch.hvm_vcpu.irq_stats);
+    v->arch.hvm_vcpu.irq_stats = NULL;
 }
 
 void hvm_vcpu_down(struct vcpu *v)
@@ -3331,6 +3349,51 @@ void hvm_rdtsc_intercept(struct cpu_user_regs *regs)
     HVMTRACE_2D(RDTSC, regs->eax, regs->edx);
 }
 
+/*
+ * A vcpu preempted within this long of its last PAUSE-loop exit is taken
+ * to be spinning itself, rather than holding the lock others spin on.
+ */
+#define PAUSE_LOOP_SPIN_SLACK MICROSECS(50)
+
+/*
+ * The vcpu spins on a contended lock, whose holder likely is a vcpu of the
+ * same domain which got preempted.  Rather than just yielding, yield to
+ * such a vcpu (round-robin, starting after the one picked last), so that
+ * the scheduler may run it ahead of others.
+ */
+void hvm_pause_loop_exit(void)
+{
+    struct vcpu *curr = current, *v = NULL;
+    struct domain *d = curr->domain;
+    unsigned int i, id = d->arch.hvm_domain.pause_loop.last_target;
+
+    perfc_incr(pauseloop_exits);
+    d->arch.hvm_domain.pause_loop.exits++;
+    curr->arch.hvm_vcpu.pause_loop_time = NOW();
+
+    for ( i = 0; i < d->max_vcpus; i++ )
+    {
+        if ( ++id >= d->max_vcpus )
+            id = 0;
+        v = d->vcpu[id];
+        if ( v && v != curr && v->runstate.state == RUNSTATE_runnable &&
+             v->runstate.state_entry_time >
+             v->arch.hvm_vcpu.pause_loop_time + PAUSE_LOOP_SPIN_SLACK )
+            break;
+        v = NULL;
+    }
+
+    if ( !v )
+    {
+        vcpu_yield();
+        return;
+    }
+
+    d->arch.hvm_domain.pause_loop.last_target = id;
+    d->arch.hvm_domain.pause_loop.directed++;
+    vcpu_yield_to(v);
+}
+
 int hvm_msr_read_intercept(unsigned int msr, uint64_t *msr_content)
 {
     struct vcpu *v = current;
@@ -3372,6 +3435,7 @@ int hvm_msr_read_intercept(unsigned int msr, uint64_t *msr_content)
 
     case MSR_IA32_TSC_DEADLINE:
         *msr_content = vlapic_tdt_msr_get(vcpu_vlapic(v));
+        v->arch.hvm_vcpu.irq_stats->apic_timer_exits++;
         break;
 
     case MSR_IA32_CR_PAT:
@@ -3511,6 +3575,7 @@ int hvm_msr_write_intercept(unsigned int msr, uint64_t msr_content,
 
     case MSR_IA32_TSC_DEADLINE:
         vlapic_tdt_msr_set(vcpu_vlapic(v), msr_content);
+        v->arch.hvm_vcpu.irq_stats->apic_timer_exits++;
         break;
 
     case MSR_IA32_APICBASE_MSR ... MSR_IA32_APICBASE_MSR + 0x3ff:
@@ -4083,10 +4148,17 @@ static int hvmop_set_param(
         if ( a.value > HVMPTM_one_missed_tick_pending )
             rc = -EINVAL;
         break;
+    case HVM_PARAM_VPT_LAZY:
+        if ( a.value > 1 )
+            rc = -EINVAL;
+        break;
     case HVM_PARAM_VIRIDIAN:
         if ( (a.value & ~HVMPV_feature_mask) ||
              !(a.value & HVMPV_base_freq) )
             rc = -EINVAL;
+        /* Synthetic timers count in partition reference time. */
+        if ( (a.value & HVMPV_stimer) && !(a.value & HVMPV_time_ref_count) )
+            rc = -EINVAL;
         break;
     case HVM_PARAM_IDENT_PT:
         /*
@@ -4361,7 +4433,8 @@ static int hvmop_get_param(
             domid_t domid = d->arch.hvm_domain.params[HVM_PARAM_DM_DOMAIN];
 
             rc = hvm_create_ioreq_server(d, domid, 1,
-                                         HVM_IOREQSRV_BUFIOREQ_LEGACY, NULL);
+                                         HVM_IOREQSRV_BUFIOREQ_LEGACY, 0,
+                                         NULL);
             if ( rc != 0 && rc != -EEXIST )
                 goto out;
         }
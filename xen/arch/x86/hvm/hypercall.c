@@ -19,6 +19,7 @@
  * Copyright (c) 2017 Citrix Systems Ltd.
  */
 #include <xen/lib.h>
+#include <xen/guest_access.h>
 #include <xen/hypercall.h>
 
 #include <asm/hvm/support.h>
@@ -147,6 +148,7 @@ int hvm_hypercall(struct cpu_user_regs *regs)
     struct domain *currd = curr->domain;
     int mode = hvm_guest_x86_mode(curr);
     unsigned long eax = regs->eax;
+    struct hypercall_stats_ctxt stats;
 
     switch ( mode )
     {
@@ -180,6 +182,9 @@ int hvm_hypercall(struct cpu_user_regs *regs)
 
     curr->hcall_preempted = false;
 
+    if ( unlikely(opt_hypercall_stats) )
+        hypercall_stats_begin(&stats, eax, mode == 8 ? regs->rdi : regs->ebx);
+
     if ( mode == 8 )
     {
         unsigned long rdi = regs->rdi;
@@ -205,8 +210,42 @@ int hvm_hypercall(struct cpu_user_regs *regs)
         }
 #endif
 
-        regs->rax = hvm_hypercall_table[eax].native(rdi, rsi, rdx, r10, r8,
-                                                    r9);
+        /*
+         * Call the handlers of the hypercalls 64-bit guests make most often
+         * directly, rather than through hvm_hypercall_table[].  Grant
+         * copies also skip the command audit of hvm_grant_table_op(), as
+         * GNTTABOP_copy is always allowed (continuations of it encode
+         * progress in the command, and take the normal path).
+         */
+        switch ( eax )
+        {
+        case __HYPERVISOR_event_channel_op:
+            regs->rax = do_event_channel_op(rdi,
+                                            guest_handle_from_ptr(rsi, void));
+            break;
+
+        case __HYPERVISOR_sched_op:
+            regs->rax = do_sched_op(rdi, guest_handle_from_ptr(rsi, void));
+            break;
+
+        case __HYPERVISOR_set_timer_op:
+            regs->rax = do_set_timer_op(rdi);
+            break;
+
+        case __HYPERVISOR_grant_table_op:
+            if ( (unsigned int)rdi == GNTTABOP_copy )
+            {
+                regs->rax = do_grant_table_op(rdi,
+                                              guest_handle_from_ptr(rsi, void),
+                                              rdx);
+                break;
+            }
+            /* fall through */
+        default:
+            regs->rax = hvm_hypercall_table[eax].native(rdi, rsi, rdx, r10,
+                                                        r8, r9);
+            break;
+        }
 
 #ifndef NDEBUG
         if ( !curr->hcall_preempted )
@@ -271,6 +310,9 @@ int hvm_hypercall(struct cpu_user_regs *regs)
 #endif
     }
 
+    if ( unlikely(opt_hypercall_stats) )
+        hypercall_stats_end(&stats, curr);
+
     HVM_DBG_LOG(DBG_LEVEL_HCALL, "hcall%lu -> %lx", eax, regs->rax);
 
     if ( curr->hcall_preempted )
@@ -181,60 +181,72 @@ bool_t handle_hvm_io_completion(struct vcpu *v)
     return 1;
 }
 
-static int hvm_alloc_ioreq_gmfn(struct domain *d, unsigned long *gmfn)
+/* Allocate nr contiguous gmfns. Called with the ioreq_server lock held. */
+static int hvm_alloc_ioreq_gmfn(struct domain *d, unsigned int nr,
+                                unsigned long *gmfn)
 {
-    unsigned int i;
-    int rc;
+    unsigned long *mask = &d->arch.hvm_domain.ioreq_gmfn.mask;
+    unsigned int i, j;
 
-    rc = -ENOMEM;
-    for ( i = 0; i < sizeof(d->arch.hvm_domain.ioreq_gmfn.mask) * 8; i++ )
+    for ( i = 0; i + nr <= sizeof(*mask) * 8; i++ )
     {
-        if ( test_and_clear_bit(i, &d->arch.hvm_domain.ioreq_gmfn.mask) )
-        {
-            *gmfn = d->arch.hvm_domain.ioreq_gmfn.base + i;
-            rc = 0;
-            break;
-        }
+        for ( j = 0; j < nr && test_bit(i + j, mask); j++ )
+            continue;
+        if ( j < nr )
+            continue;
+
+        for ( j = 0; j < nr; j++ )
+            clear_bit(i + j, mask);
+        *gmfn = d->arch.hvm_domain.ioreq_gmfn.base + i;
+        return 0;
     }
 
-    return rc;
+    return -ENOMEM;
 }
 
-static void hvm_free_ioreq_gmfn(struct domain *d, unsigned long gmfn)
+static void hvm_free_ioreq_gmfn(struct domain *d, unsigned long gmfn,
+                                unsigned int nr)
 {
     unsigned int i = gmfn - d->arch.hvm_domain.ioreq_gmfn.base;
 
-    if ( gmfn != gfn_x(INVALID_GFN) )
-        set_bit(i, &d->arch.hvm_domain.ioreq_gmfn.mask);
+    if ( gmfn == gfn_x(INVALID_GFN) )
+        return;
+
+    while ( nr-- )
+        set_bit(i + nr, &d->arch.hvm_domain.ioreq_gmfn.mask);
 }
 
 static void hvm_unmap_ioreq_page(struct hvm_ioreq_server *s, bool_t buf)
 {
     struct hvm_ioreq_page *iorp = buf ? &s->bufioreq : &s->ioreq;
 
-    destroy_ring_for_helper(&iorp->va, iorp->page);
+    destroy_rings_for_helper(&iorp->va, iorp->page, iorp->nr_pages);
 }
 
 static int hvm_map_ioreq_page(
-    struct hvm_ioreq_server *s, bool_t buf, unsigned long gmfn)
+    struct hvm_ioreq_server *s, bool_t buf, unsigned long gmfn,
+    unsigned int nr_pages)
 {
     struct domain *d = s->domain;
     struct hvm_ioreq_page *iorp = buf ? &s->bufioreq : &s->ioreq;
-    struct page_info *page;
+    struct page_info *pages[ARRAY_SIZE(iorp->page)];
     void *va;
     int rc;
 
-    if ( (rc = prepare_ring_for_helper(d, gmfn, &page, &va)) )
+    ASSERT(nr_pages <= ARRAY_SIZE(iorp->page));
+
+    if ( (rc = prepare_rings_for_helper(d, gmfn, nr_pages, pages, &va)) )
         return rc;
 
     if ( (iorp->va != NULL) || d->is_dying )
     {
-        destroy_ring_for_helper(&va, page);
+        destroy_rings_for_helper(&va, pages, nr_pages);
         return -EINVAL;
     }
 
     iorp->va = va;
-    iorp->page = page;
+    memcpy(iorp->page, pages, nr_pages * sizeof(*pages));
+    iorp->nr_pages = nr_pages;
     iorp->gmfn = gmfn;
 
     return 0;
@@ -251,12 +263,17 @@ bool_t is_ioreq_server_page(struct domain *d, const struct page_info *page)
                           &d->arch.hvm_domain.ioreq_server.list,
                           list_entry )
     {
-        if ( (s->ioreq.va && s->ioreq.page == page) ||
-             (s->bufioreq.va && s->bufioreq.page == page) )
-        {
+        unsigned int i;
+
+        if ( s->ioreq.va && s->ioreq.page[0] == page )
             found = 1;
+
+        for ( i = 0; s->bufioreq.va && i < s->bufioreq.nr_pages; i++ )
+            if ( s->bufioreq.page[i] == page )
+                found = 1;
+
+        if ( found )
             break;
-        }
     }
 
     spin_unlock_recursive(&d->arch.hvm_domain.ioreq_server.lock);
@@ -267,22 +284,29 @@ bool_t is_ioreq_server_page(struct domain *d, const struct page_info *page)
 static void hvm_remove_ioreq_gmfn(
     struct domain *d, struct hvm_ioreq_page *iorp)
 {
-    guest_physmap_remove_page(d, _gfn(iorp->gmfn),
-                              _mfn(page_to_mfn(iorp->page)), 0);
-    clear_page(iorp->va);
+    unsigned int i;
+
+    for ( i = 0; i < iorp->nr_pages; i++ )
+        guest_physmap_remove_page(d, _gfn(iorp->gmfn + i),
+                                  _mfn(page_to_mfn(iorp->page[i])), 0);
+    memset(iorp->va, 0, iorp->nr_pages * PAGE_SIZE);
 }
 
 static int hvm_add_ioreq_gmfn(
     struct domain *d, struct hvm_ioreq_page *iorp)
 {
-    int rc;
+    unsigned int i;
+    int rc = 0;
 
-    clear_page(iorp->va);
+    memset(iorp->va, 0, iorp->nr_pages * PAGE_SIZE);
 
-    rc = guest_physmap_add_page(d, _gfn(iorp->gmfn),
-                                _mfn(page_to_mfn(iorp->page)), 0);
-    if ( rc == 0 )
-        paging_mark_dirty(d, _mfn(page_to_mfn(iorp->page)));
+    for ( i = 0; !rc && i < iorp->nr_pages; i++ )
+    {
+        rc = guest_physmap_add_page(d, _gfn(iorp->gmfn + i),
+                                    _mfn(page_to_mfn(iorp->page[i])), 0);
+        if ( rc == 0 )
+            paging_mark_dirty(d, _mfn(page_to_mfn(iorp->page[i])));
+    }
 
     return rc;
 }
@@ -412,16 +436,17 @@ static void hvm_ioreq_server_remove_all_vcpus(struct hvm_ioreq_server *s)
 
 static int hvm_ioreq_server_map_pages(struct hvm_ioreq_server *s,
                                       unsigned long ioreq_pfn,
-                                      unsigned long bufioreq_pfn)
+                                      unsigned long bufioreq_pfn,
+                                      unsigned int bufioreq_pages)
 {
     int rc;
 
-    rc = hvm_map_ioreq_page(s, 0, ioreq_pfn);
+    rc = hvm_map_ioreq_page(s, 0, ioreq_pfn, 1);
     if ( rc )
         return rc;
 
     if ( bufioreq_pfn != gfn_x(INVALID_GFN) )
-        rc = hvm_map_ioreq_page(s, 1, bufioreq_pfn);
+        rc = hvm_map_ioreq_page(s, 1, bufioreq_pfn, bufioreq_pages);
 
     if ( rc )
         hvm_unmap_ioreq_page(s, 0);
@@ -431,7 +456,8 @@ static int hvm_ioreq_server_map_pages(struct hvm_ioreq_server *s,
 
 static int hvm_ioreq_server_setup_pages(struct hvm_ioreq_server *s,
                                         bool_t is_default,
-                                        bool_t handle_bufioreq)
+                                        bool_t handle_bufioreq,
+                                        unsigned int bufioreq_pages)
 {
     struct domain *d = s->domain;
     unsigned long ioreq_pfn = gfn_x(INVALID_GFN);
@@ -444,24 +470,25 @@ static int hvm_ioreq_server_setup_pages(struct hvm_ioreq_server *s,
          * The default ioreq server must handle buffered ioreqs, for
          * backwards compatibility.
          */
-        ASSERT(handle_bufioreq);
+        ASSERT(handle_bufioreq && bufioreq_pages == 1);
         return hvm_ioreq_server_map_pages(s,
                    d->arch.hvm_domain.params[HVM_PARAM_IOREQ_PFN],
-                   d->arch.hvm_domain.params[HVM_PARAM_BUFIOREQ_PFN]);
+                   d->arch.hvm_domain.params[HVM_PARAM_BUFIOREQ_PFN], 1);
     }
 
-    rc = hvm_alloc_ioreq_gmfn(d, &ioreq_pfn);
+    rc = hvm_alloc_ioreq_gmfn(d, 1, &ioreq_pfn);
 
     if ( !rc && handle_bufioreq )
-        rc = hvm_alloc_ioreq_gmfn(d, &bufioreq_pfn);
+        rc = hvm_alloc_ioreq_gmfn(d, bufioreq_pages, &bufioreq_pfn);
 
     if ( !rc )
-        rc = hvm_ioreq_server_map_pages(s, ioreq_pfn, bufioreq_pfn);
+        rc = hvm_ioreq_server_map_pages(s, ioreq_pfn, bufioreq_pfn,
+                                        bufioreq_pages);
 
     if ( rc )
     {
-        hvm_free_ioreq_gmfn(d, ioreq_pfn);
-        hvm_free_ioreq_gmfn(d, bufioreq_pfn);
+        hvm_free_ioreq_gmfn(d, ioreq_pfn, 1);
+        hvm_free_ioreq_gmfn(d, bufioreq_pfn, bufioreq_pages);
     }
 
     return rc;
@@ -481,9 +508,9 @@ static void hvm_ioreq_server_unmap_pages(struct hvm_ioreq_server *s,
     if ( !is_default )
     {
         if ( handle_bufioreq )
-            hvm_free_ioreq_gmfn(d, s->bufioreq.gmfn);
+            hvm_free_ioreq_gmfn(d, s->bufioreq.gmfn, s->bufioreq.nr_pages);
 
-        hvm_free_ioreq_gmfn(d, s->ioreq.gmfn);
+        hvm_free_ioreq_gmfn(d, s->ioreq.gmfn, 1);
     }
 }
 
@@ -600,7 +627,7 @@ static void hvm_ioreq_server_disable(struct hvm_ioreq_server *s,
 static int hvm_ioreq_server_init(struct hvm_ioreq_server *s,
                                  struct domain *d, domid_t domid,
                                  bool_t is_default, int bufioreq_handling,
-                                 ioservid_t id)
+                                 unsigned int bufioreq_order, ioservid_t id)
 {
     struct vcpu *v;
     int rc;
@@ -612,6 +639,7 @@ static int hvm_ioreq_server_init(struct hvm_ioreq_server *s,
     spin_lock_init(&s->lock);
     INIT_LIST_HEAD(&s->ioreq_vcpu_list);
     spin_lock_init(&s->bufioreq_lock);
+    INIT_LIST_HEAD(&s->io_event_list);
 
     rc = hvm_ioreq_server_alloc_rangesets(s, is_default);
     if ( rc )
@@ -621,7 +649,8 @@ static int hvm_ioreq_server_init(struct hvm_ioreq_server *s,
         s->bufioreq_atomic = 1;
 
     rc = hvm_ioreq_server_setup_pages(
-             s, is_default, bufioreq_handling != HVM_IOREQSRV_BUFIOREQ_OFF);
+             s, is_default, bufioreq_handling != HVM_IOREQSRV_BUFIOREQ_OFF,
+             1u << bufioreq_order);
     if ( rc )
         goto fail_map;
 
@@ -644,11 +673,26 @@ static int hvm_ioreq_server_init(struct hvm_ioreq_server *s,
     return rc;
 }
 
+static void hvm_ioreq_server_free_io_events(struct hvm_ioreq_server *s)
+{
+    struct hvm_ioreq_io_event *e, *next;
+
+    list_for_each_entry_safe ( e, next, &s->io_event_list, list_entry )
+    {
+        list_del(&e->list_entry);
+        free_xen_event_channel(s->domain, e->port);
+        xfree(e);
+    }
+
+    s->nr_io_events = 0;
+}
+
 static void hvm_ioreq_server_deinit(struct hvm_ioreq_server *s,
                                     bool_t is_default)
 {
     ASSERT(!s->enabled);
     hvm_ioreq_server_remove_all_vcpus(s);
+    hvm_ioreq_server_free_io_events(s);
     hvm_ioreq_server_unmap_pages(s, is_default);
     hvm_ioreq_server_free_rangesets(s, is_default);
 }
@@ -681,12 +725,13 @@ static ioservid_t next_ioservid(struct domain *d)
 
 int hvm_create_ioreq_server(struct domain *d, domid_t domid,
                             bool_t is_default, int bufioreq_handling,
-                            ioservid_t *id)
+                            unsigned int bufioreq_order, ioservid_t *id)
 {
     struct hvm_ioreq_server *s;
     int rc;
 
-    if ( bufioreq_handling > HVM_IOREQSRV_BUFIOREQ_ATOMIC )
+    if ( bufioreq_handling > HVM_IOREQSRV_BUFIOREQ_ATOMIC ||
+         bufioreq_order > XEN_DMOP_BUFIOREQ_MAX_ORDER )
         return -EINVAL;
 
     rc = -ENOMEM;
@@ -702,7 +747,7 @@ int hvm_create_ioreq_server(struct domain *d, domid_t domid,
         goto fail2;
 
     rc = hvm_ioreq_server_init(s, d, domid, is_default, bufioreq_handling,
-                               next_ioservid(d));
+                               bufioreq_order, next_ioservid(d));
     if ( rc )
         goto fail3;
 
@@ -916,6 +961,188 @@ int hvm_unmap_io_range_from_ioreq_server(struct domain *d, ioservid_t id,
     return rc;
 }
 
+static uint64_t io_event_data(uint64_t data, unsigned int size)
+{
+    return size < sizeof(data) ? data & ((1ull << (size * 8)) - 1) : data;
+}
+
+static struct hvm_ioreq_io_event *hvm_ioreq_server_find_io_event(
+    struct hvm_ioreq_server *s, const ioreq_t *p)
+{
+    struct hvm_ioreq_io_event *e;
+    uint32_t type;
+
+    if ( list_empty(&s->io_event_list) )
+        return NULL;
+
+    if ( p->dir != IOREQ_WRITE || p->data_is_ptr || p->count != 1 )
+        return NULL;
+
+    switch ( p->type )
+    {
+    case IOREQ_TYPE_PIO:
+        type = XEN_DMOP_IO_RANGE_PORT;
+        break;
+    case IOREQ_TYPE_COPY:
+        type = XEN_DMOP_IO_RANGE_MEMORY;
+        break;
+    default:
+        return NULL;
+    }
+
+    list_for_each_entry ( e, &s->io_event_list, list_entry )
+    {
+        if ( e->type != type || e->addr != p->addr || e->size != p->size )
+            continue;
+
+        if ( (e->flags & XEN_DMOP_IO_EVENT_DATAMATCH) &&
+             e->data != io_event_data(p->data, p->size) )
+            continue;
+
+        return e;
+    }
+
+    return NULL;
+}
+
+int hvm_map_io_event_to_ioreq_server(struct domain *d, ioservid_t id,
+                                     uint32_t type, uint64_t addr,
+                                     unsigned int size, unsigned int flags,
+                                     uint64_t data, evtchn_port_t *port)
+{
+    struct hvm_ioreq_server *s;
+    struct hvm_ioreq_io_event *e, *cur;
+    int rc;
+
+    if ( (type != XEN_DMOP_IO_RANGE_PORT &&
+          type != XEN_DMOP_IO_RANGE_MEMORY) ||
+         (size != 1 && size != 2 && size != 4 && size != 8) ||
+         (flags & ~XEN_DMOP_IO_EVENT_DATAMATCH) )
+        return -EINVAL;
+
+    if ( (flags & XEN_DMOP_IO_EVENT_DATAMATCH) &&
+         io_event_data(data, size) != data )
+        return -EINVAL;
+
+    if ( !(flags & XEN_DMOP_IO_EVENT_DATAMATCH) )
+        data = 0;
+
+    e = xzalloc(struct hvm_ioreq_io_event);
+    if ( !e )
+        return -ENOMEM;
+
+    e->type = type;
+    e->addr = addr;
+    e->size = size;
+    e->flags = flags;
+    e->data = data;
+
+    spin_lock_recursive(&d->arch.hvm_domain.ioreq_server.lock);
+
+    rc = -ENOENT;
+    list_for_each_entry ( s,
+                          &d->arch.hvm_domain.ioreq_server.list,
+                          list_entry )
+    {
+        if ( s == d->arch.hvm_domain.default_ioreq_server )
+            continue;
+
+        if ( s->id != id )
+            continue;
+
+        /*
+         * An event matching any write also matches those of a given
+         * value, so refuse overlapping registrations altogether.
+         */
+        rc = -EEXIST;
+        list_for_each_entry ( cur, &s->io_event_list, list_entry )
+            if ( cur->type == type && cur->addr == addr &&
+                 cur->size == size &&
+                 (!(cur->flags & flags & XEN_DMOP_IO_EVENT_DATAMATCH) ||
+                  cur->data == data) )
+                goto out;
+
+        rc = -ENOSPC;
+        if ( s->nr_io_events >= MAX_NR_IO_EVENTS )
+            break;
+
+        rc = alloc_unbound_xen_event_channel(d, 0, s->domid, NULL);
+        if ( rc < 0 )
+            break;
+
+        e->port = rc;
+
+        /* The list is walked, unlocked, by the vCPUs' emulation path. */
+        domain_pause(d);
+        list_add(&e->list_entry, &s->io_event_list);
+        s->nr_io_events++;
+        domain_unpause(d);
+
+        *port = e->port;
+        e = NULL;
+        rc = 0;
+        break;
+    }
+
+ out:
+    spin_unlock_recursive(&d->arch.hvm_domain.ioreq_server.lock);
+
+    xfree(e);
+
+    return rc;
+}
+
+int hvm_unmap_io_event_from_ioreq_server(struct domain *d, ioservid_t id,
+                                         uint32_t type, uint64_t addr,
+                                         unsigned int size, unsigned int flags,
+                                         uint64_t data)
+{
+    struct hvm_ioreq_server *s;
+    struct hvm_ioreq_io_event *e;
+    int rc;
+
+    if ( !(flags & XEN_DMOP_IO_EVENT_DATAMATCH) )
+        data = 0;
+
+    spin_lock_recursive(&d->arch.hvm_domain.ioreq_server.lock);
+
+    rc = -ENOENT;
+    list_for_each_entry ( s,
+                          &d->arch.hvm_domain.ioreq_server.list,
+                          list_entry )
+    {
+        if ( s == d->arch.hvm_domain.default_ioreq_server )
+            continue;
+
+        if ( s->id != id )
+            continue;
+
+        list_for_each_entry ( e, &s->io_event_list, list_entry )
+        {
+            if ( e->type != type || e->addr != addr || e->size != size ||
+                 e->flags != flags || e->data != data )
+                continue;
+
+            domain_pause(d);
+            list_del(&e->list_entry);
+            s->nr_io_events--;
+            domain_unpause(d);
+
+            free_xen_event_channel(d, e->port);
+            xfree(e);
+
+            rc = 0;
+            break;
+        }
+
+        break;
+    }
+
+    spin_unlock_recursive(&d->arch.hvm_domain.ioreq_server.lock);
+
+    return rc;
+}
+
 /*
  * Map or unmap an ioreq server to specific memory type. For now, only
  * HVMMEM_ioreq_server is supported, and in the future new types can be
@@ -1005,6 +1232,94 @@ int hvm_set_ioreq_server_state(struct domain *d, ioservid_t id,
     return rc;
 }
 
+int hvm_complete_ioreqs(struct domain *d, ioservid_t id)
+{
+    struct hvm_ioreq_server *s;
+    int rc;
+
+    spin_lock_recursive(&d->arch.hvm_domain.ioreq_server.lock);
+
+    rc = -ENOENT;
+    list_for_each_entry ( s,
+                          &d->arch.hvm_domain.ioreq_server.list,
+                          list_entry )
+    {
+        shared_iopage_t *p = s->ioreq.va;
+        struct hvm_ioreq_vcpu *sv;
+
+        if ( s == d->arch.hvm_domain.default_ioreq_server )
+            continue;
+
+        if ( s->id != id )
+            continue;
+
+        spin_lock(&s->lock);
+
+        /*
+         * As the notification of the vCPU's event channel would: a vCPU not
+         * yet blocked will find the response itself (see hvm_wait_for_io()).
+         */
+        list_for_each_entry ( sv,
+                              &s->ioreq_vcpu_list,
+                              list_entry )
+        {
+            struct vcpu *v = sv->vcpu;
+
+            if ( p->vcpu_ioreq[v->vcpu_id].state == STATE_IORESP_READY &&
+                 test_and_clear_bit(_VPF_blocked_in_xen, &v->pause_flags) )
+                vcpu_wake(v);
+        }
+
+        spin_unlock(&s->lock);
+
+        rc = 0;
+        break;
+    }
+
+    spin_unlock_recursive(&d->arch.hvm_domain.ioreq_server.lock);
+
+    return rc;
+}
+
+int hvm_get_ioreq_server_stats(struct domain *d, ioservid_t id,
+                               struct xen_dm_op_get_ioreq_server_stats *stats)
+{
+    struct hvm_ioreq_server *s;
+    unsigned int i;
+    int rc;
+
+    spin_lock_recursive(&d->arch.hvm_domain.ioreq_server.lock);
+
+    rc = -ENOENT;
+    list_for_each_entry ( s,
+                          &d->arch.hvm_domain.ioreq_server.list,
+                          list_entry )
+    {
+        if ( s == d->arch.hvm_domain.default_ioreq_server )
+            continue;
+
+        if ( s->id != id )
+            continue;
+
+        stats->sync = s->stats.sync;
+        stats->buffered = s->stats.buffered;
+        stats->ring_full = s->stats.ring_full;
+        stats->pio = s->stats.pio;
+        stats->copy = s->stats.copy;
+        stats->pci_config = s->stats.pci_config;
+        stats->other_type = s->stats.other_type;
+        for ( i = 0; i < ARRAY_SIZE(stats->size); i++ )
+            stats->size[i] = s->stats.size[i];
+
+        rc = 0;
+        break;
+    }
+
+    spin_unlock_recursive(&d->arch.hvm_domain.ioreq_server.lock);
+
+    return rc;
+}
+
 int hvm_all_ioreq_servers_add_vcpu(struct domain *d, struct vcpu *v)
 {
     struct hvm_ioreq_server *s;
@@ -1170,6 +1485,18 @@ struct hvm_ioreq_server *hvm_select_ioreq_server(struct domain *d,
     if ( p->type != IOREQ_TYPE_COPY && p->type != IOREQ_TYPE_PIO )
         return d->arch.hvm_domain.default_ioreq_server;
 
+    /* I/O events take precedence, see hvm_send_ioreq(). */
+    list_for_each_entry ( s,
+                          &d->arch.hvm_domain.ioreq_server.list,
+                          list_entry )
+    {
+        if ( s == d->arch.hvm_domain.default_ioreq_server )
+            continue;
+
+        if ( s->enabled && hvm_ioreq_server_find_io_event(s, p) )
+            return s;
+    }
+
     cf8 = d->arch.hvm_domain.pci_cf8;
 
     if ( p->type == IOREQ_TYPE_PIO &&
@@ -1255,11 +1582,49 @@ struct hvm_ioreq_server *hvm_select_ioreq_server(struct domain *d,
     return d->arch.hvm_domain.default_ioreq_server;
 }
 
+/* Count a request sent to s, see XEN_DMOP_get_ioreq_server_stats. */
+static void hvm_ioreq_account(struct hvm_ioreq_server *s, const ioreq_t *p,
+                              bool buffered)
+{
+    if ( buffered )
+        s->stats.buffered++;
+    else
+        s->stats.sync++;
+
+    switch ( p->type )
+    {
+    case IOREQ_TYPE_PIO:
+        s->stats.pio++;
+        break;
+    case IOREQ_TYPE_COPY:
+        s->stats.copy++;
+        break;
+    case IOREQ_TYPE_PCI_CONFIG:
+        s->stats.pci_config++;
+        break;
+    default:
+        s->stats.other_type++;
+        break;
+    }
+
+    switch ( p->size )
+    {
+    case 1: case 2: case 4: case 8:
+        s->stats.size[ffs(p->size) - 1]++;
+        break;
+    default:
+        s->stats.size[ARRAY_SIZE(s->stats.size) - 1]++;
+        break;
+    }
+}
+
 static int hvm_send_buffered_ioreq(struct hvm_ioreq_server *s, ioreq_t *p)
 {
     struct domain *d = current->domain;
     struct hvm_ioreq_page *iorp;
     buffered_iopage_t *pg;
+    buf_ioreq_t *slot;
+    unsigned int slots;
     buf_ioreq_t bp = { .data = p->data,
                        .addr = p->addr,
                        .type = p->type,
@@ -1276,6 +1641,10 @@ static int hvm_send_buffered_ioreq(struct hvm_ioreq_server *s, ioreq_t *p)
     if ( !pg )
         return X86EMUL_UNHANDLEABLE;
 
+    /* The slots may extend past the first page, see IOREQ_BUFFER_SLOTS(). */
+    slot = pg->buf_ioreq;
+    slots = IOREQ_BUFFER_SLOTS(iorp->nr_pages);
+
     /*
      * Return 0 for the cases we can't deal with:
      *  - 'addr' is only a 20-bit field, so we cannot address beyond 1MB
@@ -1310,19 +1679,20 @@ static int hvm_send_buffered_ioreq(struct hvm_ioreq_server *s, ioreq_t *p)
     spin_lock(&s->bufioreq_lock);
 
     if ( (pg->ptrs.write_pointer - pg->ptrs.read_pointer) >=
-         (IOREQ_BUFFER_SLOT_NUM - qw) )
+         (slots - qw) )
     {
         /* The queue is full: send the iopacket through the normal path. */
+        s->stats.ring_full++;
         spin_unlock(&s->bufioreq_lock);
         return X86EMUL_UNHANDLEABLE;
     }
 
-    pg->buf_ioreq[pg->ptrs.write_pointer % IOREQ_BUFFER_SLOT_NUM] = bp;
+    slot[pg->ptrs.write_pointer % slots] = bp;
 
     if ( qw )
     {
         bp.data = p->data >> 32;
-        pg->buf_ioreq[(pg->ptrs.write_pointer+1) % IOREQ_BUFFER_SLOT_NUM] = bp;
+        slot[(pg->ptrs.write_pointer + 1) % slots] = bp;
     }
 
     /* Make the ioreq_t visible /before/ write_pointer. */
@@ -1330,17 +1700,18 @@ static int hvm_send_buffered_ioreq(struct hvm_ioreq_server *s, ioreq_t *p)
     pg->ptrs.write_pointer += qw ? 2 : 1;
 
     /* Canonicalize read/write pointers to prevent their overflow. */
-    while ( s->bufioreq_atomic && qw++ < IOREQ_BUFFER_SLOT_NUM &&
-            pg->ptrs.read_pointer >= IOREQ_BUFFER_SLOT_NUM )
+    while ( s->bufioreq_atomic && qw++ < slots &&
+            pg->ptrs.read_pointer >= slots )
     {
         union bufioreq_pointers old = pg->ptrs, new;
-        unsigned int n = old.read_pointer / IOREQ_BUFFER_SLOT_NUM;
+        unsigned int n = old.read_pointer / slots;
 
-        new.read_pointer = old.read_pointer - n * IOREQ_BUFFER_SLOT_NUM;
-        new.write_pointer = old.write_pointer - n * IOREQ_BUFFER_SLOT_NUM;
+        new.read_pointer = old.read_pointer - n * slots;
+        new.write_pointer = old.write_pointer - n * slots;
         cmpxchg(&pg->ptrs.full, old.full, new.full);
     }
 
+    hvm_ioreq_account(s, p, 1);
     notify_via_xen_event_channel(d, s->bufioreq_evtchn);
     spin_unlock(&s->bufioreq_lock);
 
@@ -1359,6 +1730,19 @@ int hvm_send_ioreq(struct hvm_ioreq_server *s, ioreq_t *proto_p,
     if ( buffered )
         return hvm_send_buffered_ioreq(s, proto_p);
 
+    /* A write registered as an I/O event completes on notification. */
+    if ( s->enabled )
+    {
+        struct hvm_ioreq_io_event *e =
+            hvm_ioreq_server_find_io_event(s, proto_p);
+
+        if ( e )
+        {
+            notify_via_xen_event_channel(d, e->port);
+            return X86EMUL_OKAY;
+        }
+    }
+
     if ( unlikely(!vcpu_start_shutdown_deferral(curr)) )
         return X86EMUL_RETRY;
 
@@ -1399,6 +1783,7 @@ int hvm_send_ioreq(struct hvm_ioreq_server *s, ioreq_t *proto_p,
             p->state = STATE_IOREQ_READY;
             notify_via_xen_event_channel(d, port);
 
+            hvm_ioreq_account(s, proto_p, 0);
             sv->pending = 1;
             return X86EMUL_RETRY;
         }
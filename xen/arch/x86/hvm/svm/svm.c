@@ -2124,8 +2124,7 @@ static void svm_vmexit_do_pause(struct cpu_user_regs *regs)
      * The guest is running a contended spinlock and we've detected it.
      * Do something useful, like reschedule the guest
      */
-    perfc_incr(pauseloop_exits);
-    do_sched_op(SCHEDOP_yield, guest_handle_from_ptr(NULL, void));
+    hvm_pause_loop_exit();
 }
 
 static void
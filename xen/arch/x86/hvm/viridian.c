@@ -10,6 +10,7 @@
  */
 
 #include <xen/sched.h>
+#include <xen/event.h>
 #include <xen/version.h>
 #include <xen/perfc.h>
 #include <xen/hypercall.h>
@@ -19,7 +20,9 @@
 #include <asm/p2m.h>
 #include <asm/apic.h>
 #include <asm/hvm/support.h>
+#include <asm/hvm/vlapic.h>
 #include <public/sched.h>
+#include <public/hvm/hvm_info_table.h>
 #include <public/hvm/hvm_op.h>
 
 /* Viridian MSR numbers. */
@@ -97,15 +100,23 @@
 #define HV_STATUS_INVALID_PARAMETER             0x0005
 
 /* Viridian Hypercall Codes. */
-#define HvFlushVirtualAddressSpace 0x0002
-#define HvFlushVirtualAddressList  0x0003
-#define HvNotifyLongSpinWait       0x0008
-#define HvGetPartitionId           0x0046
-#define HvExtCallQueryCapabilities 0x8001
+#define HvFlushVirtualAddressSpace   0x0002
+#define HvFlushVirtualAddressList    0x0003
+#define HvNotifyLongSpinWait         0x0008
+#define HvSendSyntheticClusterIpi    0x000b
+#define HvFlushVirtualAddressSpaceEx 0x0013
+#define HvFlushVirtualAddressListEx  0x0014
+#define HvSendSyntheticClusterIpiEx  0x0015
+#define HvGetPartitionId             0x0046
+#define HvExtCallQueryCapabilities   0x8001
 
 /* Viridian Hypercall Flags. */
 #define HV_FLUSH_ALL_PROCESSORS 1
 
+/* Viridian processor set formats (HV_GENERIC_SET_FORMAT). */
+#define HV_GENERIC_SET_SPARSE_4K 0
+#define HV_GENERIC_SET_ALL       1
+
 /*
  * Viridian Partition Privilege Flags.
  *
@@ -164,13 +175,50 @@ typedef union _HV_CRASH_CTL_REG_CONTENTS
     } u;
 } HV_CRASH_CTL_REG_CONTENTS;
 
+/*
+ * SynIC message slots, as in section 11.9 of the specification. The
+ * SIMP page holds one message per SINT.
+ */
+#define HvMessageTypeNone     0x00000000
+#define HvMessageTimerExpired 0x80000010
+
+#define HV_MESSAGE_FLAG_PENDING 1
+
+typedef struct _HV_TIMER_MESSAGE_PAYLOAD
+{
+    uint32_t TimerIndex;
+    uint32_t Reserved;
+    uint64_t ExpirationTime;
+    uint64_t DeliveryTime;
+} HV_TIMER_MESSAGE_PAYLOAD;
+
+typedef struct _HV_MESSAGE
+{
+    uint32_t MessageType;
+    uint8_t  PayloadSize;
+    uint8_t  MessageFlags;
+    uint8_t  Reserved[2];
+    uint64_t Sender;
+    union {
+        uint64_t Payload[30];
+        HV_TIMER_MESSAGE_PAYLOAD Timer;
+    } u;
+} HV_MESSAGE;
+
+#define HV_SCONTROL_ENABLE 1
+#define HV_SYNIC_VERSION   1
+
 /* Viridian CPUID leaf 3, Hypervisor Feature Indication */
-#define CPUID3D_CRASH_MSRS (1 << 10)
+#define CPUID3D_CRASH_MSRS         (1 << 10)
+#define CPUID3D_STIMER_DIRECT_MODE (1 << 19)
 
 /* Viridian CPUID leaf 4: Implementation Recommendations. */
 #define CPUID4A_HCALL_REMOTE_TLB_FLUSH (1 << 2)
 #define CPUID4A_MSR_BASED_APIC         (1 << 3)
 #define CPUID4A_RELAX_TIMER_INT        (1 << 5)
+#define CPUID4A_DEPRECATE_AUTOEOI      (1 << 9)
+#define CPUID4A_SYNTHETIC_CLUSTER_IPI  (1 << 10)
+#define CPUID4A_EX_PROCESSOR_MASKS     (1 << 11)
 
 /* Viridian CPUID leaf 6: Implementation HW features detected and in use. */
 #define CPUID6A_APIC_OVERLAY    (1 << 0)
@@ -254,6 +302,10 @@ void cpuid_viridian_leaves(const struct vcpu *v, uint32_t leaf,
             mask.AccessPartitionReferenceCounter = 1;
         if ( viridian_feature_mask(d) & HVMPV_reference_tsc )
             mask.AccessPartitionReferenceTsc = 1;
+        if ( viridian_feature_mask(d) & HVMPV_synic )
+            mask.AccessSynicRegs = 1;
+        if ( viridian_feature_mask(d) & HVMPV_stimer )
+            mask.AccessSyntheticTimerRegs = 1;
 
         u.mask = mask;
 
@@ -261,7 +313,9 @@ void cpuid_viridian_leaves(const struct vcpu *v, uint32_t leaf,
         res->b = u.hi;
 
         if ( viridian_feature_mask(d) & HVMPV_crash_ctl )
-            res->d = CPUID3D_CRASH_MSRS;
+            res->d |= CPUID3D_CRASH_MSRS;
+        if ( viridian_feature_mask(d) & HVMPV_stimer )
+            res->d |= CPUID3D_STIMER_DIRECT_MODE;
 
         break;
     }
@@ -274,6 +328,13 @@ void cpuid_viridian_leaves(const struct vcpu *v, uint32_t leaf,
         res->a = CPUID4A_RELAX_TIMER_INT;
         if ( viridian_feature_mask(d) & HVMPV_hcall_remote_tlb_flush )
             res->a |= CPUID4A_HCALL_REMOTE_TLB_FLUSH;
+        if ( viridian_feature_mask(d) & HVMPV_hcall_ipi )
+            res->a |= CPUID4A_SYNTHETIC_CLUSTER_IPI;
+        if ( viridian_feature_mask(d) & HVMPV_ex_processor_masks )
+            res->a |= CPUID4A_EX_PROCESSOR_MASKS;
+        /* Auto-EOI cannot be honoured with virtual interrupt delivery. */
+        if ( viridian_feature_mask(d) & HVMPV_synic )
+            res->a |= CPUID4A_DEPRECATE_AUTOEOI;
         if ( !cpu_has_vmx_apic_reg_virt )
             res->a |= CPUID4A_MSR_BASED_APIC;
 
@@ -377,20 +438,11 @@ static void enable_hypercall_page(struct domain *d)
     put_page_and_type(page);
 }
 
-static void initialize_vp_assist(struct vcpu *v)
+static void *map_guest_page(struct domain *d, unsigned long gmfn)
 {
-    struct domain *d = v->domain;
-    unsigned long gmfn = v->arch.hvm_vcpu.viridian.vp_assist.msr.fields.pfn;
     struct page_info *page = get_page_from_gfn(d, gmfn, NULL, P2M_ALLOC);
     void *va;
 
-    ASSERT(!v->arch.hvm_vcpu.viridian.vp_assist.va);
-
-    /*
-     * See section 7.8.7 of the specification for details of this
-     * enlightenment.
-     */
-
     if ( !page )
         goto fail;
 
@@ -407,30 +459,66 @@ static void initialize_vp_assist(struct vcpu *v)
         goto fail;
     }
 
-    clear_page(va);
-
-    v->arch.hvm_vcpu.viridian.vp_assist.va = va;
-    return;
+    return va;
 
  fail:
     gdprintk(XENLOG_WARNING, "Bad GMFN %#"PRI_gfn" (MFN %#"PRI_mfn")\n", gmfn,
              page ? page_to_mfn(page) : mfn_x(INVALID_MFN));
+    return NULL;
+}
+
+static void unmap_guest_page(void *va)
+{
+    struct page_info *page = mfn_to_page(domain_page_map_to_mfn(va));
+
+    unmap_domain_page_global(va);
+    put_page_and_type(page);
+}
+
+static void initialize_vp_assist(struct vcpu *v)
+{
+    ASSERT(!v->arch.hvm_vcpu.viridian.vp_assist.va);
+
+    /*
+     * See section 7.8.7 of the specification for details of this
+     * enlightenment.
+     */
+    v->arch.hvm_vcpu.viridian.vp_assist.va =
+        map_guest_page(v->domain,
+                       v->arch.hvm_vcpu.viridian.vp_assist.msr.fields.pfn);
+    if ( v->arch.hvm_vcpu.viridian.vp_assist.va )
+        clear_page(v->arch.hvm_vcpu.viridian.vp_assist.va);
 }
 
 static void teardown_vp_assist(struct vcpu *v)
 {
     void *va = v->arch.hvm_vcpu.viridian.vp_assist.va;
-    struct page_info *page;
 
     if ( !va )
         return;
 
     v->arch.hvm_vcpu.viridian.vp_assist.va = NULL;
+    unmap_guest_page(va);
+}
 
-    page = mfn_to_page(domain_page_map_to_mfn(va));
+static void initialize_simp(struct vcpu *v)
+{
+    ASSERT(!v->arch.hvm_vcpu.viridian.synic.simp_va);
 
-    unmap_domain_page_global(va);
-    put_page_and_type(page);
+    v->arch.hvm_vcpu.viridian.synic.simp_va =
+        map_guest_page(v->domain,
+                       v->arch.hvm_vcpu.viridian.synic.simp.fields.pfn);
+}
+
+static void teardown_simp(struct vcpu *v)
+{
+    void *va = v->arch.hvm_vcpu.viridian.synic.simp_va;
+
+    if ( !va )
+        return;
+
+    v->arch.hvm_vcpu.viridian.synic.simp_va = NULL;
+    unmap_guest_page(va);
 }
 
 void viridian_start_apic_assist(struct vcpu *v, int vector)
@@ -541,9 +629,15 @@ static void update_reference_tsc(struct domain *d, bool_t initialize)
      * ReferenceTime = ((RDTSC() * TscScale) >> 64) + TscOffset
      *
      * Windows uses a 100ns tick, so we need a scale which is cpu
-     * ticks per 100ns shifted left by 64.
+     * ticks per 100ns shifted left by 64. The low half of the fraction
+     * is computed from the remainder so that the page does not drift
+     * away from HV_X64_MSR_TIME_REF_COUNT, and the offset keeps the two
+     * equal across pauses and migration.
      */
-    p->TscScale = ((10000ul << 32) / d->arch.tsc_khz) << 32;
+    p->TscScale = (((10000ul << 32) / d->arch.tsc_khz) << 32) |
+                  ((((10000ul << 32) % d->arch.tsc_khz) << 32) /
+                   d->arch.tsc_khz);
+    p->TscOffset = d->arch.hvm_domain.viridian.time_ref_count.off;
 
     p->TscSequence++;
     if ( p->TscSequence == 0xFFFFFFFF ||
@@ -556,6 +650,280 @@ static void update_reference_tsc(struct domain *d, bool_t initialize)
     put_page_and_type(page);
 }
 
+static int64_t raw_trc_val(struct domain *d)
+{
+    uint64_t tsc;
+    struct time_scale tsc_to_ns;
+
+    tsc = hvm_get_guest_tsc(pt_global_vcpu_target(d));
+
+    /* convert tsc to count of 100ns periods */
+    set_time_scale(&tsc_to_ns, d->arch.tsc_khz * 1000ul);
+    return scale_delta(tsc, &tsc_to_ns) / 100ul;
+}
+
+static int64_t time_now(struct domain *d)
+{
+    return raw_trc_val(d) + d->arch.hvm_domain.viridian.time_ref_count.off;
+}
+
+/*
+ * Post a timer expiry message in the SIMP slot of the SINT. If the guest
+ * has not consumed the previous message yet, flag the slot so that the
+ * guest writes HV_X64_MSR_EOM once it has, and retry then.
+ */
+static bool synic_deliver_timer_msg(struct vcpu *v, unsigned int sintx,
+                                    unsigned int index, uint64_t expiration,
+                                    uint64_t delivery)
+{
+    struct viridian_vcpu *vv = &v->arch.hvm_vcpu.viridian;
+    const union viridian_sint_msr *vs = &vv->synic.sint[sintx];
+    HV_MESSAGE *msg = vv->synic.simp_va;
+
+    BUILD_BUG_ON(sizeof(*msg) * VIRIDIAN_SINT_COUNT != PAGE_SIZE);
+
+    /* Without a message page the expiry is lost, as with real Hyper-V. */
+    if ( !(vv->synic.scontrol & HV_SCONTROL_ENABLE) || !msg )
+        return true;
+
+    msg += sintx;
+    if ( msg->MessageType != HvMessageTypeNone )
+    {
+        msg->MessageFlags |= HV_MESSAGE_FLAG_PENDING;
+        return false;
+    }
+
+    msg->PayloadSize = sizeof(msg->u.Timer);
+    msg->MessageFlags = 0;
+    msg->Sender = 0;
+    msg->u.Timer.TimerIndex = index;
+    msg->u.Timer.Reserved = 0;
+    msg->u.Timer.ExpirationTime = expiration;
+    msg->u.Timer.DeliveryTime = delivery;
+    smp_wmb();
+    msg->MessageType = HvMessageTimerExpired;
+
+    if ( !vs->fields.mask && vs->fields.vector >= 0x10 )
+        vlapic_set_irq(vcpu_vlapic(v), vs->fields.vector, 0);
+
+    return true;
+}
+
+bool viridian_synic_is_auto_eoi_sint(const struct vcpu *v, uint8_t vector)
+{
+    const struct viridian_vcpu *vv = &v->arch.hvm_vcpu.viridian;
+    unsigned int i;
+
+    if ( !(vv->synic.scontrol & HV_SCONTROL_ENABLE) )
+        return false;
+
+    for ( i = 0; i < ARRAY_SIZE(vv->synic.sint); i++ )
+    {
+        const union viridian_sint_msr *vs = &vv->synic.sint[i];
+
+        if ( !vs->fields.mask && vs->fields.auto_eoi &&
+             vs->fields.vector == vector )
+            return true;
+    }
+
+    return false;
+}
+
+/* Periodic timers must be at least 0.1ms, as for the emulated timers. */
+#define STIMER_MIN_PERIOD 1000 /* 100ns units */
+
+static void start_stimer(struct viridian_stimer *vs)
+{
+    int64_t now = time_now(vs->v->domain);
+    int64_t timeout = vs->expiration - now;
+
+    set_timer(&vs->timer, NOW() + (timeout > 0 ? timeout * 100 : 0));
+}
+
+static void stop_stimer(struct viridian_stimer *vs)
+{
+    struct viridian_vcpu *vv = &vs->v->arch.hvm_vcpu.viridian;
+
+    stop_timer(&vs->timer);
+    clear_bit(vs - vv->stimer, &vv->stimer_pending);
+}
+
+/*
+ * Section 15.3.1: a periodic timer counts from its enabling, a one-shot
+ * timer expires when the reference time reaches its count.
+ */
+static void enable_stimer(struct viridian_stimer *vs)
+{
+    if ( vs->config.fields.periodic )
+    {
+        if ( vs->count < STIMER_MIN_PERIOD )
+            vs->count = STIMER_MIN_PERIOD;
+        vs->expiration = time_now(vs->v->domain) + vs->count;
+    }
+    else
+        vs->expiration = vs->count;
+
+    start_stimer(vs);
+}
+
+static void stimer_expired(void *data)
+{
+    struct viridian_stimer *vs = data;
+    struct vcpu *v = vs->v;
+
+    set_bit(vs - v->arch.hvm_vcpu.viridian.stimer,
+            &v->arch.hvm_vcpu.viridian.stimer_pending);
+    vcpu_kick(v);
+}
+
+/*
+ * Called on the way into the guest, when looking for a pending interrupt,
+ * to turn expired timers into messages or, in direct mode, interrupts.
+ */
+void viridian_poll_stimers(struct vcpu *v)
+{
+    struct viridian_vcpu *vv = &v->arch.hvm_vcpu.viridian;
+    unsigned int i;
+
+    if ( likely(!vv->stimer_pending) || v != current )
+        return;
+
+    for ( i = 0; i < ARRAY_SIZE(vv->stimer); i++ )
+    {
+        struct viridian_stimer *vs = &vv->stimer[i];
+
+        if ( !test_bit(i, &vv->stimer_pending) )
+            continue;
+
+        if ( !vs->config.fields.enabled )
+        {
+            clear_bit(i, &vv->stimer_pending);
+            continue;
+        }
+
+        if ( vs->config.fields.direct_mode )
+        {
+            if ( vs->config.fields.vector >= 0x10 )
+                vlapic_set_irq(vcpu_vlapic(v), vs->config.fields.vector, 0);
+        }
+        else if ( !synic_deliver_timer_msg(v, vs->config.fields.sintx, i,
+                                           vs->expiration,
+                                           time_now(v->domain)) )
+            continue;
+
+        perfc_incr(mshv_stimer_expired);
+        clear_bit(i, &vv->stimer_pending);
+
+        if ( !vs->config.fields.periodic )
+        {
+            vs->config.fields.enabled = 0;
+            continue;
+        }
+
+        /* Missed periods are not caught up. */
+        vs->expiration += vs->count;
+        if ( vs->expiration <= time_now(v->domain) )
+            vs->expiration = time_now(v->domain) + vs->count;
+        start_stimer(vs);
+    }
+}
+
+static void write_stimer_config(struct viridian_stimer *vs, uint64_t val)
+{
+    stop_stimer(vs);
+
+    vs->config.raw = val;
+    vs->config.fields.reserved_zero1 = vs->config.fields.reserved_zero2 = 0;
+
+    /* Section 15.3.1: a message timer routed to SINT0 is disabled. */
+    if ( !vs->config.fields.direct_mode && !vs->config.fields.sintx )
+        vs->config.fields.enabled = 0;
+
+    if ( vs->config.fields.enabled && vs->count )
+        enable_stimer(vs);
+    else
+        vs->config.fields.enabled = 0;
+}
+
+static void write_stimer_count(struct viridian_stimer *vs, uint64_t val)
+{
+    stop_stimer(vs);
+
+    vs->count = val;
+
+    if ( !vs->count )
+        vs->config.fields.enabled = 0;
+    else if ( vs->config.fields.auto_enable &&
+              (vs->config.fields.direct_mode || vs->config.fields.sintx) )
+        vs->config.fields.enabled = 1;
+
+    if ( vs->config.fields.enabled )
+        enable_stimer(vs);
+}
+
+void viridian_migrate_timers(struct vcpu *v)
+{
+    unsigned int i;
+
+    if ( !is_viridian_domain(v->domain) )
+        return;
+
+    for ( i = 0; i < ARRAY_SIZE(v->arch.hvm_vcpu.viridian.stimer); i++ )
+        migrate_timer(&v->arch.hvm_vcpu.viridian.stimer[i].timer,
+                      v->processor);
+}
+
+void viridian_time_ref_count_freeze(struct domain *d)
+{
+    struct viridian_time_ref_count *trc;
+    struct vcpu *v;
+    unsigned int i;
+
+    trc = &d->arch.hvm_domain.viridian.time_ref_count;
+
+    if ( !test_and_clear_bit(_TRC_running, &trc->flags) )
+        return;
+
+    trc->val = raw_trc_val(d) + trc->off;
+
+    /* Synthetic timers count in reference time, which now stands still. */
+    for_each_vcpu ( d, v )
+    {
+        for ( i = 0; i < ARRAY_SIZE(v->arch.hvm_vcpu.viridian.stimer); i++ )
+            stop_timer(&v->arch.hvm_vcpu.viridian.stimer[i].timer);
+    }
+}
+
+void viridian_time_ref_count_thaw(struct domain *d)
+{
+    struct viridian_time_ref_count *trc;
+    struct vcpu *v;
+    unsigned int i;
+
+    trc = &d->arch.hvm_domain.viridian.time_ref_count;
+
+    if ( d->is_shutting_down ||
+         test_and_set_bit(_TRC_running, &trc->flags) )
+        return;
+
+    trc->off = (int64_t)trc->val - raw_trc_val(d);
+
+    /* Keep the reference TSC page in step with the new offset. */
+    if ( d->arch.hvm_domain.viridian.reference_tsc.fields.enabled )
+        update_reference_tsc(d, 0);
+
+    for_each_vcpu ( d, v )
+    {
+        for ( i = 0; i < ARRAY_SIZE(v->arch.hvm_vcpu.viridian.stimer); i++ )
+        {
+            struct viridian_stimer *vs = &v->arch.hvm_vcpu.viridian.stimer[i];
+
+            if ( vs->config.fields.enabled )
+                start_stimer(vs);
+        }
+    }
+}
+
 int wrmsr_viridian_regs(uint32_t idx, uint64_t val)
 {
     struct vcpu *v = current;
@@ -626,6 +994,76 @@ int wrmsr_viridian_regs(uint32_t idx, uint64_t val)
             update_reference_tsc(d, 1);
         break;
 
+    case HV_X64_MSR_SCONTROL:
+        if ( !(viridian_feature_mask(d) & HVMPV_synic) )
+            return 0;
+
+        v->arch.hvm_vcpu.viridian.synic.scontrol = val & HV_SCONTROL_ENABLE;
+        break;
+
+    case HV_X64_MSR_SIEFP:
+        if ( !(viridian_feature_mask(d) & HVMPV_synic) )
+            return 0;
+
+        /* No events are signalled, so the page is never written. */
+        v->arch.hvm_vcpu.viridian.synic.siefp.raw = val;
+        break;
+
+    case HV_X64_MSR_SIMP:
+        if ( !(viridian_feature_mask(d) & HVMPV_synic) )
+            return 0;
+
+        perfc_incr(mshv_wrmsr_simp);
+        teardown_simp(v); /* release any previous mapping */
+        v->arch.hvm_vcpu.viridian.synic.simp.raw = val;
+        if ( v->arch.hvm_vcpu.viridian.synic.simp.fields.enabled )
+        {
+            initialize_simp(v);
+            if ( v->arch.hvm_vcpu.viridian.synic.simp_va )
+                clear_page(v->arch.hvm_vcpu.viridian.synic.simp_va);
+        }
+        break;
+
+    case HV_X64_MSR_EOM:
+        if ( !(viridian_feature_mask(d) & HVMPV_synic) )
+            return 0;
+
+        /*
+         * A slot has been freed. Timer messages still pending are retried
+         * on the way back into the guest.
+         */
+        perfc_incr(mshv_wrmsr_eom);
+        break;
+
+    case HV_X64_MSR_SINT0 ... HV_X64_MSR_SINT15:
+    {
+        union viridian_sint_msr sint = { .raw = val };
+
+        if ( !(viridian_feature_mask(d) & HVMPV_synic) ||
+             (!sint.fields.mask && sint.fields.vector < 0x10) )
+            return 0;
+
+        v->arch.hvm_vcpu.viridian.synic.sint[idx - HV_X64_MSR_SINT0] = sint;
+        break;
+    }
+
+    case HV_X64_MSR_STIMER0_CONFIG ... HV_X64_MSR_STIMER3_COUNT:
+    {
+        struct viridian_stimer *vs;
+
+        if ( !(viridian_feature_mask(d) & HVMPV_stimer) )
+            return 0;
+
+        perfc_incr(mshv_wrmsr_stimer);
+        idx -= HV_X64_MSR_STIMER0_CONFIG;
+        vs = &v->arch.hvm_vcpu.viridian.stimer[idx / 2];
+        if ( idx & 1 )
+            write_stimer_count(vs, val);
+        else
+            write_stimer_config(vs, val);
+        break;
+    }
+
     case HV_X64_MSR_CRASH_P0:
     case HV_X64_MSR_CRASH_P1:
     case HV_X64_MSR_CRASH_P2:
@@ -667,39 +1105,6 @@ int wrmsr_viridian_regs(uint32_t idx, uint64_t val)
     return 1;
 }
 
-static int64_t raw_trc_val(struct domain *d)
-{
-    uint64_t tsc;
-    struct time_scale tsc_to_ns;
-
-    tsc = hvm_get_guest_tsc(pt_global_vcpu_target(d));
-
-    /* convert tsc to count of 100ns periods */
-    set_time_scale(&tsc_to_ns, d->arch.tsc_khz * 1000ul);
-    return scale_delta(tsc, &tsc_to_ns) / 100ul;
-}
-
-void viridian_time_ref_count_freeze(struct domain *d)
-{
-    struct viridian_time_ref_count *trc;
-
-    trc = &d->arch.hvm_domain.viridian.time_ref_count;
-
-    if ( test_and_clear_bit(_TRC_running, &trc->flags) )
-        trc->val = raw_trc_val(d) + trc->off;
-}
-
-void viridian_time_ref_count_thaw(struct domain *d)
-{
-    struct viridian_time_ref_count *trc;
-
-    trc = &d->arch.hvm_domain.viridian.time_ref_count;
-
-    if ( !d->is_shutting_down &&
-         !test_and_set_bit(_TRC_running, &trc->flags) )
-        trc->off = (int64_t)trc->val - raw_trc_val(d);
-}
-
 int rdmsr_viridian_regs(uint32_t idx, uint64_t *val)
 {
     struct vcpu *v = current;
@@ -783,6 +1188,61 @@ int rdmsr_viridian_regs(uint32_t idx, uint64_t *val)
         break;
     }
 
+    case HV_X64_MSR_SCONTROL:
+        if ( !(viridian_feature_mask(d) & HVMPV_synic) )
+            return 0;
+
+        *val = v->arch.hvm_vcpu.viridian.synic.scontrol;
+        break;
+
+    case HV_X64_MSR_SVERSION:
+        if ( !(viridian_feature_mask(d) & HVMPV_synic) )
+            return 0;
+
+        *val = HV_SYNIC_VERSION;
+        break;
+
+    case HV_X64_MSR_SIEFP:
+        if ( !(viridian_feature_mask(d) & HVMPV_synic) )
+            return 0;
+
+        *val = v->arch.hvm_vcpu.viridian.synic.siefp.raw;
+        break;
+
+    case HV_X64_MSR_SIMP:
+        if ( !(viridian_feature_mask(d) & HVMPV_synic) )
+            return 0;
+
+        *val = v->arch.hvm_vcpu.viridian.synic.simp.raw;
+        break;
+
+    case HV_X64_MSR_EOM:
+        if ( !(viridian_feature_mask(d) & HVMPV_synic) )
+            return 0;
+
+        *val = 0;
+        break;
+
+    case HV_X64_MSR_SINT0 ... HV_X64_MSR_SINT15:
+        if ( !(viridian_feature_mask(d) & HVMPV_synic) )
+            return 0;
+
+        *val = v->arch.hvm_vcpu.viridian.synic.sint[idx - HV_X64_MSR_SINT0].raw;
+        break;
+
+    case HV_X64_MSR_STIMER0_CONFIG ... HV_X64_MSR_STIMER3_COUNT:
+    {
+        const struct viridian_stimer *vs;
+
+        if ( !(viridian_feature_mask(d) & HVMPV_stimer) )
+            return 0;
+
+        idx -= HV_X64_MSR_STIMER0_CONFIG;
+        vs = &v->arch.hvm_vcpu.viridian.stimer[idx / 2];
+        *val = (idx & 1) ? vs->count : vs->config.raw;
+        break;
+    }
+
     case HV_X64_MSR_CRASH_P0:
     case HV_X64_MSR_CRASH_P1:
     case HV_X64_MSR_CRASH_P2:
@@ -816,21 +1276,168 @@ int rdmsr_viridian_regs(uint32_t idx, uint64_t *val)
     return 1;
 }
 
+void viridian_vcpu_init(struct vcpu *v)
+{
+    struct viridian_vcpu *vv = &v->arch.hvm_vcpu.viridian;
+    unsigned int i;
+
+    for ( i = 0; i < ARRAY_SIZE(vv->synic.sint); i++ )
+        vv->synic.sint[i].fields.mask = 1;
+
+    for ( i = 0; i < ARRAY_SIZE(vv->stimer); i++ )
+    {
+        vv->stimer[i].v = v;
+        init_timer(&vv->stimer[i].timer, stimer_expired, &vv->stimer[i],
+                   v->processor);
+    }
+}
+
 void viridian_vcpu_deinit(struct vcpu *v)
 {
+    unsigned int i;
+
     teardown_vp_assist(v);
+    teardown_simp(v);
+
+    for ( i = 0; i < ARRAY_SIZE(v->arch.hvm_vcpu.viridian.stimer); i++ )
+        kill_timer(&v->arch.hvm_vcpu.viridian.stimer[i].timer);
 }
 
 void viridian_domain_deinit(struct domain *d)
 {
     struct vcpu *v;
+    unsigned int i;
 
     for_each_vcpu ( d, v )
+    {
         teardown_vp_assist(v);
+        teardown_simp(v);
+
+        for ( i = 0; i < ARRAY_SIZE(v->arch.hvm_vcpu.viridian.stimer); i++ )
+            stop_timer(&v->arch.hvm_vcpu.viridian.stimer[i].timer);
+    }
 }
 
 static DEFINE_PER_CPU(cpumask_t, ipi_cpumask);
 
+/* Set of virtual processors targeted by a hypercall, by VP index. */
+struct hypercall_vpmask {
+    DECLARE_BITMAP(mask, HVM_MAX_VCPUS);
+};
+
+static DEFINE_PER_CPU(struct hypercall_vpmask, hypercall_vpmask);
+
+static void vpmask_set(struct hypercall_vpmask *vpmask, unsigned int base,
+                       uint64_t mask)
+{
+    unsigned int vp;
+
+    for ( vp = 0; mask && base + vp < HVM_MAX_VCPUS; vp++, mask >>= 1 )
+        if ( mask & 1 )
+            __set_bit(base + vp, vpmask->mask);
+}
+
+/*
+ * Read a processor set (HV_VP_SET) at @gpa, as used by the "Ex" variants
+ * of the hypercalls.
+ * Sparse sets only carry the banks of 64 processors which have a bit set
+ * in the valid bank mask, in order.
+ */
+static int vpmask_read_vpset(struct hypercall_vpmask *vpmask,
+                             unsigned long gpa)
+{
+    struct {
+        uint64_t format;
+        uint64_t valid_bank_mask;
+    } set;
+    unsigned int bank;
+
+    if ( hvm_copy_from_guest_phys(&set, gpa, sizeof(set)) != HVMCOPY_okay )
+        return -EFAULT;
+
+    gpa += sizeof(set);
+
+    switch ( set.format )
+    {
+    case HV_GENERIC_SET_ALL:
+        bitmap_fill(vpmask->mask, HVM_MAX_VCPUS);
+        return 0;
+
+    case HV_GENERIC_SET_SPARSE_4K:
+        bitmap_zero(vpmask->mask, HVM_MAX_VCPUS);
+
+        for ( bank = 0; bank < 64; bank++ )
+        {
+            uint64_t mask;
+
+            if ( !(set.valid_bank_mask & (1ull << bank)) )
+                continue;
+
+            if ( hvm_copy_from_guest_phys(&mask, gpa,
+                                          sizeof(mask)) != HVMCOPY_okay )
+                return -EFAULT;
+
+            gpa += sizeof(mask);
+            vpmask_set(vpmask, bank * 64, mask);
+        }
+
+        return 0;
+    }
+
+    return -EINVAL;
+}
+
+/*
+ * For each targeted virtual CPU flush all ASIDs to invalidate TLB entries
+ * the next time it is scheduled and then, if it is currently running, add
+ * its physical CPU to a mask of those which need to be interrupted to force
+ * a flush.  vCPUs not running need no IPI, wherever they last ran.
+ */
+static void flush_vcpus(const struct hypercall_vpmask *vpmask)
+{
+    struct vcpu *curr = current;
+    cpumask_t *pcpu_mask = &this_cpu(ipi_cpumask);
+    struct vcpu *v;
+
+    cpumask_clear(pcpu_mask);
+
+    for_each_vcpu ( curr->domain, v )
+    {
+        if ( v->vcpu_id >= HVM_MAX_VCPUS )
+            break;
+
+        if ( !test_bit(v->vcpu_id, vpmask->mask) )
+            continue;
+
+        hvm_asid_flush_vcpu(v);
+        if ( v != curr && v->is_running )
+            __cpumask_set_cpu(v->processor, pcpu_mask);
+    }
+
+    /*
+     * Since ASIDs have now been flushed it just remains to
+     * force any CPUs currently running target vCPUs out of non-
+     * root mode. It's possible that re-scheduling has taken place
+     * so we may unnecessarily IPI some CPUs.
+     */
+    if ( !cpumask_empty(pcpu_mask) )
+        smp_send_event_check_mask(pcpu_mask);
+}
+
+static void send_ipi(const struct hypercall_vpmask *vpmask, uint8_t vector)
+{
+    struct vcpu *v;
+
+    for_each_vcpu ( current->domain, v )
+    {
+        if ( v->vcpu_id >= HVM_MAX_VCPUS )
+            break;
+
+        if ( test_bit(v->vcpu_id, vpmask->mask) )
+            vlapic_set_irq(vcpu_vlapic(v), vector, 0);
+    }
+}
+
 int viridian_hypercall(struct cpu_user_regs *regs)
 {
     struct vcpu *curr = current;
@@ -894,8 +1501,7 @@ int viridian_hypercall(struct cpu_user_regs *regs)
     case HvFlushVirtualAddressSpace:
     case HvFlushVirtualAddressList:
     {
-        cpumask_t *pcpu_mask;
-        struct vcpu *v;
+        struct hypercall_vpmask *vpmask = &this_cpu(hypercall_vpmask);
         struct {
             uint64_t address_space;
             uint64_t flags;
@@ -923,40 +1529,122 @@ int viridian_hypercall(struct cpu_user_regs *regs)
          * so err on the safe side.
          */
         if ( input_params.flags & HV_FLUSH_ALL_PROCESSORS )
-            input_params.vcpu_mask = ~0ul;
+            bitmap_fill(vpmask->mask, HVM_MAX_VCPUS);
+        else
+        {
+            bitmap_zero(vpmask->mask, HVM_MAX_VCPUS);
+            vpmask_set(vpmask, 0, input_params.vcpu_mask);
+        }
+
+        flush_vcpus(vpmask);
 
-        pcpu_mask = &this_cpu(ipi_cpumask);
-        cpumask_clear(pcpu_mask);
+        output.rep_complete = input.rep_count;
+
+        status = HV_STATUS_SUCCESS;
+        break;
+    }
+
+    case HvFlushVirtualAddressSpaceEx:
+    case HvFlushVirtualAddressListEx:
+    {
+        struct hypercall_vpmask *vpmask = &this_cpu(hypercall_vpmask);
+        struct {
+            uint64_t address_space;
+            uint64_t flags;
+        } input_params;
 
         /*
-         * For each specified virtual CPU flush all ASIDs to invalidate
-         * TLB entries the next time it is scheduled and then, if it
-         * is currently running, add its physical CPU to a mask of
-         * those which need to be interrupted to force a flush.
+         * As above, with the processors given as a set.  The list of
+         * addresses, if any, follows the set and is ignored: the whole
+         * ASID is flushed.
          */
-        for_each_vcpu ( currd, v )
-        {
-            if ( v->vcpu_id >= (sizeof(input_params.vcpu_mask) * 8) )
-                break;
+        perfc_incr(mshv_call_flush_ex);
 
-            if ( !(input_params.vcpu_mask & (1ul << v->vcpu_id)) )
-                continue;
+        status = HV_STATUS_INVALID_HYPERCALL_CODE;
+        if ( !(viridian_feature_mask(currd) & HVMPV_ex_processor_masks) )
+            break;
 
-            hvm_asid_flush_vcpu(v);
-            if ( v != curr && v->is_running )
-                __cpumask_set_cpu(v->processor, pcpu_mask);
-        }
+        status = HV_STATUS_INVALID_PARAMETER;
+        if ( input.fast )
+            break;
+
+        if ( hvm_copy_from_guest_phys(&input_params, input_params_gpa,
+                                      sizeof(input_params)) != HVMCOPY_okay )
+            break;
+
+        if ( input_params.flags & HV_FLUSH_ALL_PROCESSORS )
+            bitmap_fill(vpmask->mask, HVM_MAX_VCPUS);
+        else if ( vpmask_read_vpset(vpmask, input_params_gpa +
+                                            sizeof(input_params)) )
+            break;
+
+        flush_vcpus(vpmask);
+
+        output.rep_complete = input.rep_count;
+
+        status = HV_STATUS_SUCCESS;
+        break;
+    }
+
+    case HvSendSyntheticClusterIpi:
+    case HvSendSyntheticClusterIpiEx:
+    {
+        struct hypercall_vpmask *vpmask = &this_cpu(hypercall_vpmask);
+        struct {
+            uint32_t vector;
+            uint8_t target_vtl;
+            uint8_t reserved_zero[3];
+            uint64_t vp_mask;
+        } input_params;
 
         /*
-         * Since ASIDs have now been flushed it just remains to
-         * force any CPUs currently running target vCPUs out of non-
-         * root mode. It's possible that re-scheduling has taken place
-         * so we may unnecessarily IPI some CPUs.
+         * The non-Ex variant may use the fast-call convention, with the
+         * input parameters in the registers otherwise holding the
+         * addresses of the input and output parameters.
          */
-        if ( !cpumask_empty(pcpu_mask) )
-            smp_send_event_check_mask(pcpu_mask);
+        perfc_incr(mshv_call_send_ipi);
 
-        output.rep_complete = input.rep_count;
+        status = HV_STATUS_INVALID_HYPERCALL_CODE;
+        if ( !(viridian_feature_mask(currd) & HVMPV_hcall_ipi) ||
+             (input.call_code == HvSendSyntheticClusterIpiEx &&
+              !(viridian_feature_mask(currd) & HVMPV_ex_processor_masks)) )
+            break;
+
+        status = HV_STATUS_INVALID_PARAMETER;
+        if ( input.call_code == HvSendSyntheticClusterIpi )
+        {
+            if ( input.fast )
+            {
+                input_params.vector = (uint32_t)input_params_gpa;
+                input_params.target_vtl = input_params_gpa >> 32;
+                input_params.vp_mask = output_params_gpa;
+            }
+            else if ( hvm_copy_from_guest_phys(&input_params,
+                                               input_params_gpa,
+                                               sizeof(input_params)) !=
+                      HVMCOPY_okay )
+                break;
+
+            bitmap_zero(vpmask->mask, HVM_MAX_VCPUS);
+            vpmask_set(vpmask, 0, input_params.vp_mask);
+        }
+        else
+        {
+            if ( input.fast ||
+                 hvm_copy_from_guest_phys(&input_params, input_params_gpa,
+                                          offsetof(typeof(input_params),
+                                                   vp_mask)) !=
+                 HVMCOPY_okay ||
+                 vpmask_read_vpset(vpmask, input_params_gpa +
+                                   offsetof(typeof(input_params), vp_mask)) )
+                break;
+        }
+
+        if ( input_params.target_vtl ||
+             input_params.vector < 0x10 || input_params.vector > 0xff )
+            break;
+
+        send_ipi(vpmask, input_params.vector);
 
         status = HV_STATUS_SUCCESS;
         break;
@@ -1038,10 +1726,30 @@ static int viridian_save_vcpu_ctxt(struct domain *d, hvm_domain_context_t *h)
         return 0;
 
     for_each_vcpu( d, v ) {
+        const struct viridian_vcpu *vv = &v->arch.hvm_vcpu.viridian;
         struct hvm_viridian_vcpu_context ctxt = {
-            .vp_assist_msr = v->arch.hvm_vcpu.viridian.vp_assist.msr.raw,
-            .vp_assist_vector = v->arch.hvm_vcpu.viridian.vp_assist.vector,
+            .vp_assist_msr = vv->vp_assist.msr.raw,
+            .vp_assist_vector = vv->vp_assist.vector,
+            .synic_scontrol_msr = vv->synic.scontrol,
+            .synic_siefp_msr = vv->synic.siefp.raw,
+            .synic_simp_msr = vv->synic.simp.raw,
         };
+        unsigned int i;
+
+        BUILD_BUG_ON(ARRAY_SIZE(ctxt.synic_sint_msr) !=
+                     ARRAY_SIZE(vv->synic.sint));
+        BUILD_BUG_ON(ARRAY_SIZE(ctxt.stimer_config_msr) !=
+                     ARRAY_SIZE(vv->stimer));
+
+        for ( i = 0; i < ARRAY_SIZE(vv->synic.sint); i++ )
+            ctxt.synic_sint_msr[i] = vv->synic.sint[i].raw;
+
+        for ( i = 0; i < ARRAY_SIZE(vv->stimer); i++ )
+        {
+            ctxt.stimer_config_msr[i] = vv->stimer[i].config.raw;
+            ctxt.stimer_count_msr[i] = vv->stimer[i].count;
+            ctxt.stimer_expiration[i] = vv->stimer[i].expiration;
+        }
 
         if ( hvm_save_entry(VIRIDIAN_VCPU, v->vcpu_id, h, &ctxt) != 0 )
             return 1;
@@ -1054,7 +1762,9 @@ static int viridian_load_vcpu_ctxt(struct domain *d, hvm_domain_context_t *h)
 {
     int vcpuid;
     struct vcpu *v;
+    struct viridian_vcpu *vv;
     struct hvm_viridian_vcpu_context ctxt;
+    unsigned int i;
 
     vcpuid = hvm_load_instance(h);
     if ( vcpuid >= d->max_vcpus || (v = d->vcpu[vcpuid]) == NULL )
@@ -1070,6 +1780,8 @@ static int viridian_load_vcpu_ctxt(struct domain *d, hvm_domain_context_t *h)
     if ( memcmp(&ctxt._pad, zero_page, sizeof(ctxt._pad)) )
         return -EINVAL;
 
+    vv = &v->arch.hvm_vcpu.viridian;
+
     v->arch.hvm_vcpu.viridian.vp_assist.msr.raw = ctxt.vp_assist_msr;
     if ( v->arch.hvm_vcpu.viridian.vp_assist.msr.fields.enabled &&
          !v->arch.hvm_vcpu.viridian.vp_assist.va )
@@ -1077,6 +1789,25 @@ static int viridian_load_vcpu_ctxt(struct domain *d, hvm_domain_context_t *h)
 
     v->arch.hvm_vcpu.viridian.vp_assist.vector = ctxt.vp_assist_vector;
 
+    vv->synic.scontrol = ctxt.synic_scontrol_msr;
+    vv->synic.siefp.raw = ctxt.synic_siefp_msr;
+    vv->synic.simp.raw = ctxt.synic_simp_msr;
+    if ( vv->synic.simp.fields.enabled && !vv->synic.simp_va )
+        initialize_simp(v);
+
+    /* Streams from older hosts carry no SINTs: leave them masked. */
+    if ( vv->synic.scontrol & HV_SCONTROL_ENABLE )
+        for ( i = 0; i < ARRAY_SIZE(vv->synic.sint); i++ )
+            vv->synic.sint[i].raw = ctxt.synic_sint_msr[i];
+
+    /* Enabled timers are started when the domain is unpaused. */
+    for ( i = 0; i < ARRAY_SIZE(vv->stimer); i++ )
+    {
+        vv->stimer[i].config.raw = ctxt.stimer_config_msr[i];
+        vv->stimer[i].count = ctxt.stimer_count_msr[i];
+        vv->stimer[i].expiration = ctxt.stimer_expiration[i];
+    }
+
     return 0;
 }
 
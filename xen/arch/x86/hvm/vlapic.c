@@ -494,8 +494,16 @@ void vlapic_ipi(
         /* fall through */
     default: {
         struct vcpu *v;
-        bool_t batch = is_multicast_dest(vlapic, short_hand, dest, dest_mode);
+        bool_t batch;
 
+        /* Self-IPIs need not look at every vCPU of the domain. */
+        if ( short_hand == APIC_DEST_SELF )
+        {
+            vlapic_accept_irq(vlapic_vcpu(vlapic), icr_low);
+            break;
+        }
+
+        batch = is_multicast_dest(vlapic, short_hand, dest, dest_mode);
         if ( batch )
             cpu_raise_softirq_batch_begin();
         for_each_vcpu ( vlapic_domain(vlapic), v )
@@ -511,6 +519,41 @@ void vlapic_ipi(
     }
 }
 
+/* Account an access to a register which hardware didn't virtualize. */
+static void vlapic_count_exit(struct vcpu *v, unsigned int offset)
+{
+    struct hvm_irq_stats *stats = v->arch.hvm_vcpu.irq_stats;
+
+    switch ( offset )
+    {
+    case APIC_ICR:
+    case APIC_ICR2:
+    case APIC_SELF_IPI:
+        stats->apic_icr_exits++;
+        break;
+
+    case APIC_EOI:
+        stats->apic_eoi_exits++;
+        break;
+
+    case APIC_TASKPRI:
+    case APIC_PROCPRI:
+        stats->apic_tpr_exits++;
+        break;
+
+    case APIC_LVTT:
+    case APIC_TMICT:
+    case APIC_TMCCT:
+    case APIC_TDCR:
+        stats->apic_timer_exits++;
+        break;
+
+    default:
+        stats->apic_other_exits++;
+        break;
+    }
+}
+
 static uint32_t vlapic_get_tmcct(struct vlapic *vlapic)
 {
     struct vcpu *v = current;
@@ -584,6 +627,7 @@ static int vlapic_read(
     if ( offset > (APIC_TDCR + 0x3) )
         goto out;
 
+    vlapic_count_exit(v, offset & ~3);
     tmp = vlapic_read_aligned(vlapic, offset & ~3);
 
     switch ( len )
@@ -647,6 +691,7 @@ int hvm_x2apic_msr_read(struct vcpu *v, unsigned int msr, uint64_t *msr_content)
          (reg >= sizeof(readable) * 8) || !test_bit(reg, readable) )
         return X86EMUL_UNHANDLEABLE;
 
+    vlapic_count_exit(v, offset);
     if ( offset == APIC_ICR )
         high = vlapic_read_aligned(vlapic, APIC_ICR2);
 
@@ -674,6 +719,7 @@ static void vlapic_reg_write(struct vcpu *v,
     struct vlapic *vlapic = vcpu_vlapic(v);
 
     memset(&vlapic->loaded, 0, sizeof(vlapic->loaded));
+    vlapic_count_exit(v, offset);
 
     switch ( offset )
     {
@@ -1172,6 +1218,8 @@ int vlapic_has_pending_irq(struct vcpu *v)
     if ( !vlapic_enabled(vlapic) )
         return -1;
 
+    viridian_poll_stimers(v);
+
     irr = vlapic_find_highest_irr(vlapic);
     if ( irr == -1 )
         return -1;
@@ -1212,6 +1260,14 @@ int vlapic_ack_pending_irq(struct vcpu *v, int vector, bool_t force_ack)
          vlapic_virtual_intr_delivery_enabled() )
         return 1;
 
+    /* An auto-EOI SINT never becomes in-service. */
+    if ( has_viridian_synic(v->domain) &&
+         viridian_synic_is_auto_eoi_sint(v, vector) )
+    {
+        vlapic_clear_irr(vector, vlapic);
+        return 1;
+    }
+
     /* If there's no chance of using APIC assist then bail now. */
     if ( !has_viridian_apic_assist(v->domain) ||
          vlapic_test_vector(vector, &vlapic->regs->data[APIC_TMR]) )
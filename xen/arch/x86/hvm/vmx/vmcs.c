@@ -50,6 +50,10 @@ boolean_param("unrestricted_guest", opt_unrestricted_guest_enabled);
 static bool_t __read_mostly opt_apicv_enabled = 1;
 boolean_param("apicv", opt_apicv_enabled);
 
+/* Fire the LAPIC timer of running vCPUs from the VMX preemption timer. */
+static bool_t __read_mostly opt_preempt_timer;
+boolean_param("vmx_preempt_timer", opt_preempt_timer);
+
 /*
  * These two parameters are used to config the controls for Pause-Loop Exiting:
  * ple_gap:    upper bound on the amount of time between two successive
@@ -66,6 +70,7 @@ integer_param("ple_window", ple_window);
 
 static bool_t __read_mostly opt_pml_enabled = 1;
 static s8 __read_mostly opt_ept_ad = -1;
+bool_t __read_mostly opt_ept_coalesce;
 
 /*
  * The 'ept' parameter controls functionalities that depend on, or impact the
@@ -73,6 +78,7 @@ static s8 __read_mostly opt_ept_ad = -1;
  *
  *  pml                 Enable PML
  *  ad                  Use A/D bits
+ *  coalesce            Rebuild split superpages in the background
  */
 static void __init parse_ept_param(char *s)
 {
@@ -92,6 +98,8 @@ static void __init parse_ept_param(char *s)
             opt_pml_enabled = val;
         else if ( !strcmp(s, "ad") )
             opt_ept_ad = val;
+        else if ( !strcmp(s, "coalesce") )
+            opt_ept_coalesce = val;
 
         s = ss + 1;
     } while ( ss );
@@ -107,6 +115,7 @@ u32 vmx_vmentry_control __read_mostly;
 u64 vmx_ept_vpid_cap __read_mostly;
 u64 vmx_vmfunc __read_mostly;
 bool_t vmx_virt_exception __read_mostly;
+unsigned int vmx_preempt_timer_shift __read_mostly;
 
 static DEFINE_PER_CPU_READ_MOSTLY(paddr_t, vmxon_region);
 static DEFINE_PER_CPU(paddr_t, current_vmcs);
@@ -138,6 +147,7 @@ static void __init vmx_display_features(void)
     P(cpu_has_vmx_virt_exceptions, "Virtualisation Exceptions");
     P(cpu_has_vmx_pml, "Page Modification Logging");
     P(cpu_has_vmx_tsc_scaling, "TSC Scaling");
+    P(cpu_has_vmx_preempt_timer, "VMX Preemption Timer");
 #undef P
 
     if ( !printed )
@@ -183,6 +193,7 @@ static int vmx_init_vmcs_config(void)
     u32 _vmx_vmexit_control;
     u32 _vmx_vmentry_control;
     u64 _vmx_vmfunc = 0;
+    unsigned int _vmx_preempt_timer_shift = 0;
     bool_t mismatch = 0;
 
     rdmsr(MSR_IA32_VMX_BASIC, vmx_basic_msr_low, vmx_basic_msr_high);
@@ -191,10 +202,18 @@ static int vmx_init_vmcs_config(void)
            PIN_BASED_NMI_EXITING);
     opt = (PIN_BASED_VIRTUAL_NMIS |
            PIN_BASED_POSTED_INTERRUPT);
+    if ( opt_preempt_timer )
+        opt |= PIN_BASED_PREEMPT_TIMER;
     _vmx_pin_based_exec_control = adjust_vmx_controls(
         "Pin-Based Exec Control", min, opt,
         MSR_IA32_VMX_PINBASED_CTLS, &mismatch);
 
+    if ( _vmx_pin_based_exec_control & PIN_BASED_PREEMPT_TIMER )
+    {
+        rdmsrl(MSR_IA32_VMX_MISC, _vmx_misc_cap);
+        _vmx_preempt_timer_shift = _vmx_misc_cap & VMX_MISC_PREEMPT_TIMER_RATE;
+    }
+
     min = (CPU_BASED_HLT_EXITING |
            CPU_BASED_VIRTUAL_INTR_PENDING |
            CPU_BASED_CR8_LOAD_EXITING |
@@ -392,6 +411,7 @@ static int vmx_init_vmcs_config(void)
         vmx_vmfunc                 = _vmx_vmfunc;
         vmx_virt_exception         = !!(_vmx_secondary_exec_control &
                                        SECONDARY_EXEC_ENABLE_VIRT_EXCEPTIONS);
+        vmx_preempt_timer_shift    = _vmx_preempt_timer_shift;
         vmx_display_features();
 
         /* IA-32 SDM Vol 3B: VMCS size is never greater than 4kB. */
@@ -431,6 +451,9 @@ static int vmx_init_vmcs_config(void)
         mismatch |= cap_check(
             "VMFUNC Capability",
             vmx_vmfunc, _vmx_vmfunc);
+        mismatch |= cap_check(
+            "Preemption Timer Rate",
+            vmx_preempt_timer_shift, _vmx_preempt_timer_shift);
         if ( cpu_has_vmx_ins_outs_instr_info !=
              !!(vmx_basic_msr_high & (VMX_BASIC_INS_OUT_INFO >> 32)) )
         {
@@ -1487,7 +1510,7 @@ void vmx_vcpu_disable_pml(struct vcpu *v)
 void vmx_vcpu_flush_pml_buffer(struct vcpu *v)
 {
     uint64_t *pml_buf;
-    unsigned long pml_idx;
+    unsigned long pml_idx, first;
 
     ASSERT((v == current) || (!vcpu_runnable(v) && !v->is_running));
     ASSERT(vmx_vcpu_pml_enabled(v));
@@ -1512,7 +1535,7 @@ void vmx_vcpu_flush_pml_buffer(struct vcpu *v)
     else
         pml_idx++;
 
-    for ( ; pml_idx < NR_PML_ENTRIES; pml_idx++ )
+    for ( first = pml_idx; pml_idx < NR_PML_ENTRIES; pml_idx++ )
     {
         unsigned long gfn = pml_buf[pml_idx] >> PAGE_SHIFT;
 
@@ -1526,10 +1549,15 @@ void vmx_vcpu_flush_pml_buffer(struct vcpu *v)
          */
         p2m_change_type_one(v->domain, gfn, p2m_ram_logdirty, p2m_ram_rw);
 
-        /* HVM guest: pfn == gfn */
-        paging_mark_pfn_dirty(v->domain, _pfn(gfn));
+        /* HVM guest: pfn == gfn.  Keep it for the batched marking below. */
+        pml_buf[pml_idx] = gfn;
     }
 
+    /* Mark all logged GFNs dirty under a single paging lock acquisition. */
+    BUILD_BUG_ON(sizeof(*pml_buf) != sizeof(unsigned long));
+    paging_mark_pfns_dirty(v->domain, (unsigned long *)pml_buf + first,
+                           NR_PML_ENTRIES - first);
+
     unmap_domain_page(pml_buf);
 
     /* Reset PML index */
@@ -23,6 +23,7 @@
 #include <xen/softirq.h>
 #include <xen/domain_page.h>
 #include <xen/hypercall.h>
+#include <xen/latency_stats.h>
 #include <xen/perfc.h>
 #include <asm/current.h>
 #include <asm/io.h>
@@ -85,18 +86,38 @@ struct vmx_pi_blocking_vcpu {
 };
 
 /*
- * We maintain a per-CPU linked-list of vCPUs, so in PI wakeup
+ * We maintain per-CPU linked-lists of vCPUs, so in PI wakeup
  * handler we can find which vCPU should be woken up.
+ *
+ * Each pCPU has one list per wakeup vector, and a blocking vCPU is put
+ * on the list matching the NV it is given, so that the handler of a
+ * wakeup vector only walks (and locks) the vCPUs which may have been
+ * notified through it.  The lists are spread over as many vectors as are
+ * left in the high priority range, up to NR_PI_WAKEUP_VECTORS.
  */
-static DEFINE_PER_CPU(struct vmx_pi_blocking_vcpu, vmx_pi_blocking);
+#define NR_PI_WAKEUP_VECTORS 4
+
+static DEFINE_PER_CPU(struct vmx_pi_blocking_vcpu[NR_PI_WAKEUP_VECTORS],
+                      vmx_pi_blocking);
 
 uint8_t __read_mostly posted_intr_vector;
-static uint8_t __read_mostly pi_wakeup_vector;
+static uint8_t __read_mostly pi_wakeup_vector[NR_PI_WAKEUP_VECTORS];
+static unsigned int __read_mostly nr_pi_wakeup_vectors = 1;
+
+static unsigned int pi_wakeup_shard(const struct vcpu *v)
+{
+    return (v->domain->domain_id + v->vcpu_id) % nr_pi_wakeup_vectors;
+}
 
 void vmx_pi_per_cpu_init(unsigned int cpu)
 {
-    INIT_LIST_HEAD(&per_cpu(vmx_pi_blocking, cpu).list);
-    spin_lock_init(&per_cpu(vmx_pi_blocking, cpu).lock);
+    unsigned int i;
+
+    for ( i = 0; i < NR_PI_WAKEUP_VECTORS; i++ )
+    {
+        INIT_LIST_HEAD(&per_cpu(vmx_pi_blocking, cpu)[i].list);
+        spin_lock_init(&per_cpu(vmx_pi_blocking, cpu)[i].lock);
+    }
 }
 
 static void vmx_vcpu_block(struct vcpu *v)
@@ -104,8 +125,10 @@ static void vmx_vcpu_block(struct vcpu *v)
     unsigned long flags;
     unsigned int dest;
     spinlock_t *old_lock;
-    spinlock_t *pi_blocking_list_lock =
-		&per_cpu(vmx_pi_blocking, v->processor).lock;
+    unsigned int shard = pi_wakeup_shard(v);
+    struct vmx_pi_blocking_vcpu *blocking =
+        &per_cpu(vmx_pi_blocking, v->processor)[shard];
+    spinlock_t *pi_blocking_list_lock = &blocking->lock;
     struct pi_desc *pi_desc = &v->arch.hvm_vmx.pi_desc;
 
     spin_lock_irqsave(pi_blocking_list_lock, flags);
@@ -119,8 +142,7 @@ static void vmx_vcpu_block(struct vcpu *v)
      */
     ASSERT(old_lock == NULL);
 
-    list_add_tail(&v->arch.hvm_vmx.pi_blocking.list,
-                  &per_cpu(vmx_pi_blocking, v->processor).list);
+    list_add_tail(&v->arch.hvm_vmx.pi_blocking.list, &blocking->list);
     spin_unlock_irqrestore(pi_blocking_list_lock, flags);
 
     ASSERT(!pi_test_sn(pi_desc));
@@ -130,7 +152,7 @@ static void vmx_vcpu_block(struct vcpu *v)
     ASSERT(pi_desc->ndst ==
            (x2apic_enabled ? dest : MASK_INSR(dest, PI_xAPIC_NDST_MASK)));
 
-    write_atomic(&pi_desc->nv, pi_wakeup_vector);
+    write_atomic(&pi_desc->nv, pi_wakeup_vector[shard]);
 }
 
 static void vmx_pi_switch_from(struct vcpu *v)
@@ -199,16 +221,15 @@ static void vmx_pi_do_resume(struct vcpu *v)
     vmx_pi_unblock_vcpu(v);
 }
 
-void vmx_pi_desc_fixup(unsigned int cpu)
+static void vmx_pi_list_fixup(unsigned int cpu, unsigned int shard)
 {
     unsigned int new_cpu, dest;
     unsigned long flags;
     struct arch_vmx_struct *vmx, *tmp;
-    spinlock_t *new_lock, *old_lock = &per_cpu(vmx_pi_blocking, cpu).lock;
-    struct list_head *blocked_vcpus = &per_cpu(vmx_pi_blocking, cpu).list;
-
-    if ( !iommu_intpost )
-        return;
+    struct vmx_pi_blocking_vcpu *blocking =
+        &per_cpu(vmx_pi_blocking, cpu)[shard];
+    spinlock_t *new_lock, *old_lock = &blocking->lock;
+    struct list_head *blocked_vcpus = &blocking->list;
 
     /*
      * We are in the context of CPU_DEAD or CPU_UP_CANCELED notification,
@@ -246,7 +267,7 @@ void vmx_pi_desc_fixup(unsigned int cpu)
              * notification event arrives.
              */
             new_cpu = cpumask_any(&cpu_online_map);
-            new_lock = &per_cpu(vmx_pi_blocking, new_cpu).lock;
+            new_lock = &per_cpu(vmx_pi_blocking, new_cpu)[shard].lock;
 
             spin_lock(new_lock);
 
@@ -257,7 +278,7 @@ void vmx_pi_desc_fixup(unsigned int cpu)
                          x2apic_enabled ? dest : MASK_INSR(dest, PI_xAPIC_NDST_MASK));
 
             list_move(&vmx->pi_blocking.list,
-                      &per_cpu(vmx_pi_blocking, new_cpu).list);
+                      &per_cpu(vmx_pi_blocking, new_cpu)[shard].list);
             vmx->pi_blocking.lock = new_lock;
 
             spin_unlock(new_lock);
@@ -269,6 +290,18 @@ void vmx_pi_desc_fixup(unsigned int cpu)
     spin_unlock_irqrestore(old_lock, flags);
 }
 
+void vmx_pi_desc_fixup(unsigned int cpu)
+{
+    unsigned int i;
+
+    if ( !iommu_intpost )
+        return;
+
+    /* The vCPUs keep their NV, so they move to the same list elsewhere. */
+    for ( i = 0; i < nr_pi_wakeup_vectors; i++ )
+        vmx_pi_list_fixup(cpu, i);
+}
+
 /*
  * To handle posted interrupts correctly, we need to set the following
  * state:
@@ -291,8 +324,8 @@ void vmx_pi_desc_fixup(unsigned int cpu)
  *
  * C: ... -> blocked
  *  - SN = 0
- *  - NV = pi_wakeup_vector
- *  - Add vcpu to blocked list
+ *  - NV = one of pi_wakeup_vector[]
+ *  - Add vcpu to the blocked list of that vector
  *  If the vm is blocked, we want the PI delivered to Xen so that it can
  *  wake it up.
  *
@@ -1023,6 +1056,7 @@ static void vmx_ctxt_switch_from(struct vcpu *v)
         vmx_vmcs_reload(v);
     }
 
+    latency_stats_exit_cancel(v);
     vmx_fpu_leave(v);
     vmx_save_guest_msrs(v);
     vmx_restore_host_msrs();
@@ -2358,19 +2392,28 @@ static struct hvm_function_table __initdata vmx_function_table = {
 static void pi_wakeup_interrupt(struct cpu_user_regs *regs)
 {
     struct arch_vmx_struct *vmx, *tmp;
-    spinlock_t *lock = &per_cpu(vmx_pi_blocking, smp_processor_id()).lock;
-    struct list_head *blocked_vcpus =
-		&per_cpu(vmx_pi_blocking, smp_processor_id()).list;
+    struct vcpu *v;
+    uint8_t vector = regs->entry_vector;
+    unsigned int shard = 0;
+    spinlock_t *lock;
+    struct list_head *blocked_vcpus;
 
     ack_APIC_irq();
     this_cpu(irq_count)++;
 
+    while ( shard < nr_pi_wakeup_vectors - 1 &&
+            pi_wakeup_vector[shard] != vector )
+        shard++;
+
+    lock = &this_cpu(vmx_pi_blocking)[shard].lock;
+    blocked_vcpus = &this_cpu(vmx_pi_blocking)[shard].list;
+
     spin_lock(lock);
 
     /*
      * XXX: The length of the list depends on how many vCPU is current
-     * blocked on this specific pCPU. This may hurt the interrupt latency
-     * if the list grows to too many entries.
+     * blocked with this vector on this specific pCPU. This may hurt the
+     * interrupt latency if the list grows to too many entries.
      */
     list_for_each_entry_safe(vmx, tmp, blocked_vcpus, pi_blocking.list)
     {
@@ -2379,7 +2422,9 @@ static void pi_wakeup_interrupt(struct cpu_user_regs *regs)
             list_del(&vmx->pi_blocking.list);
             ASSERT(vmx->pi_blocking.lock == lock);
             vmx->pi_blocking.lock = NULL;
-            vcpu_unblock(container_of(vmx, struct vcpu, arch.hvm_vmx));
+            v = container_of(vmx, struct vcpu, arch.hvm_vmx);
+            v->arch.hvm_vcpu.irq_stats->pi_wakeups++;
+            vcpu_unblock(v);
         }
     }
 
@@ -2479,7 +2524,16 @@ const struct hvm_function_table * __init start_vmx(void)
     {
         alloc_direct_apic_vector(&posted_intr_vector, pi_notification_interrupt);
         if ( iommu_intpost )
-            alloc_direct_apic_vector(&pi_wakeup_vector, pi_wakeup_interrupt);
+        {
+            unsigned int i;
+
+            alloc_direct_apic_vector(&pi_wakeup_vector[0], pi_wakeup_interrupt);
+            for ( i = 1; i < NR_PI_WAKEUP_VECTORS &&
+                         nr_free_hipriority_vectors(); i++ )
+                alloc_direct_apic_vector(&pi_wakeup_vector[i],
+                                         pi_wakeup_interrupt);
+            nr_pi_wakeup_vectors = i;
+        }
     }
     else
     {
@@ -3176,6 +3230,7 @@ gp_fault:
 static void vmx_do_extint(struct cpu_user_regs *regs)
 {
     unsigned long vector;
+    int irq;
 
     __vmread(VM_EXIT_INTR_INFO, &vector);
     BUG_ON(!(vector & INTR_INFO_VALID_MASK));
@@ -3183,6 +3238,15 @@ static void vmx_do_extint(struct cpu_user_regs *regs)
     vector &= INTR_INFO_VECTOR_MASK;
     HVMTRACE_1D(INTR, vector);
 
+    /*
+     * Exits for interrupts routed to a guest are what posted delivery
+     * would have avoided (the descriptor state is only peeked at).
+     */
+    current->arch.hvm_vcpu.irq_stats->extint_exits++;
+    irq = this_cpu(vector_irq)[vector];
+    if ( irq >= 0 && (irq_to_desc(irq)->status & IRQ_GUEST) )
+        current->arch.hvm_vcpu.irq_stats->guest_irq_exits++;
+
     regs->entry_vector = vector;
     do_IRQ(regs);
 }
@@ -3526,6 +3590,7 @@ void vmx_vmexit_handler(struct cpu_user_regs *regs)
                     regs->eip, 0, 0, 0, 0);
 
     perfc_incra(vmexits, exit_reason);
+    latency_stats_exit_begin((uint16_t)exit_reason);
 
     /* Handle the interrupt we missed before allowing any more in. */
     switch ( (uint16_t)exit_reason )
@@ -4005,6 +4070,7 @@ void vmx_vmexit_handler(struct cpu_user_regs *regs)
 
         ASSERT(cpu_has_vmx_virtual_intr_delivery);
 
+        v->arch.hvm_vcpu.irq_stats->apic_eoi_exits++;
         vlapic_handle_EOI(vcpu_vlapic(v), exit_qualification);
         break;
 
@@ -4071,8 +4137,7 @@ void vmx_vmexit_handler(struct cpu_user_regs *regs)
         break;
 
     case EXIT_REASON_PAUSE_INSTRUCTION:
-        perfc_incr(pauseloop_exits);
-        do_sched_op(SCHEDOP_yield, guest_handle_from_ptr(NULL, void));
+        hvm_pause_loop_exit();
         break;
 
     case EXIT_REASON_XSETBV:
@@ -4102,6 +4167,11 @@ void vmx_vmexit_handler(struct cpu_user_regs *regs)
         break;
 
     case EXIT_REASON_VMX_PREEMPTION_TIMER_EXPIRED:
+        if ( !cpu_has_vmx_preempt_timer )
+            goto exit_and_crash;
+        pt_lapic_expire(v);
+        break;
+
     case EXIT_REASON_INVPCID:
     /* fall through */
     default:
@@ -4174,6 +4244,22 @@ static void lbr_tsx_fixup(void)
         msr->data |= ((LBR_FROM_SIGNEXT_2MSB & msr->data) << 2);
 }
 
+/* Expire the LAPIC timer of the vcpu about to run while it runs. */
+static void vmx_set_preempt_timer(struct vcpu *v)
+{
+    s_time_t deadline = pt_lapic_deadline(v), delta;
+    uint64_t ticks = ~0U;
+
+    if ( deadline )
+    {
+        delta = deadline - NOW();
+        ticks = delta > 0 ? muldiv64(delta, cpu_khz, 1000000) >>
+                            vmx_preempt_timer_shift : 0;
+    }
+
+    __vmwrite(GUEST_PREEMPTION_TIMER, min_t(uint64_t, ticks, ~0U));
+}
+
 void vmx_vmenter_helper(const struct cpu_user_regs *regs)
 {
     struct vcpu *curr = current;
@@ -4184,6 +4270,9 @@ void vmx_vmenter_helper(const struct cpu_user_regs *regs)
     if ( curr->domain->arch.hvm_domain.pi_ops.do_resume )
         curr->domain->arch.hvm_domain.pi_ops.do_resume(curr);
 
+    if ( cpu_has_vmx_preempt_timer && !nestedhvm_vcpu_in_guestmode(curr) )
+        vmx_set_preempt_timer(curr);
+
     if ( !cpu_has_vmx_vpid )
         goto out;
     if ( nestedhvm_vcpu_in_guestmode(curr) )
@@ -4234,6 +4323,7 @@ void vmx_vmenter_helper(const struct cpu_user_regs *regs)
         lbr_tsx_fixup();
 
     HVMTRACE_ND(VMENTRY, 0, 1/*cycles*/, 0, 0, 0, 0, 0, 0, 0);
+    latency_stats_exit_end(curr);
 
     __vmwrite(GUEST_RIP,    regs->rip);
     __vmwrite(GUEST_RSP,    regs->rsp);
@@ -70,6 +70,10 @@ int nvmx_vcpu_initialise(struct vcpu *v)
     }
     nvcpu->nv_n2vmcx_pa = page_to_maddr(pg);
 
+    /* Without it all of the guest state is copied on each switch. */
+    nvmx->gstate = xzalloc_array(uint64_t, NVMX_GSTATE_FIELDS);
+    nvmx->gstate_valid = 0;
+
     /* non-root VMREAD/VMWRITE bitmap. */
     if ( cpu_has_vmx_vmcs_shadowing )
     {
@@ -153,6 +157,9 @@ void nvmx_vcpu_destroy(struct vcpu *v)
             xfree(item);
         }
 
+    xfree(nvmx->gstate);
+    nvmx->gstate = NULL;
+
     if ( v->arch.hvm_vmx.vmread_bitmap )
     {
         free_domheap_page(v->arch.hvm_vmx.vmread_bitmap);
@@ -793,6 +800,7 @@ static void nvmx_purge_vvmcs(struct vcpu *v)
     int i;
 
     __clear_current_vvmcs(v);
+    nvmx->gstate_valid = 0;
     if ( nvcpu->nv_vvmcxaddr != INVALID_PADDR )
         hvm_unmap_guest_frame(nvcpu->nv_vvmcx, 1);
     nvcpu->nv_vvmcx = NULL;
@@ -1008,6 +1016,95 @@ fallback:
         shadow_to_vvmcs(v, field[i]);
 }
 
+/*
+ * The guest state fields are synchronised on every virtual vmentry and
+ * vmexit, but few of them change in between.  Both the shadow and the
+ * virtual VMCS hold the values last synchronised, as L1 runs on another
+ * VMCS and L2 cannot reach the virtual one, so only the fields whose
+ * value differs from that need a VMWRITE.  With VMCS shadowing L1's
+ * VMWRITEs don't exit, so which fields changed is found by comparing
+ * rather than by logging them.
+ */
+static void vvmcs_to_shadow_gstate(struct vcpu *v)
+{
+    struct nestedvmx *nvmx = &vcpu_2_nvmx(v);
+    u64 *value = this_cpu(vvmcs_buf);
+    unsigned int i, n = ARRAY_SIZE(vmcs_gstate_field);
+
+    BUILD_BUG_ON(ARRAY_SIZE(vmcs_gstate_field) != NVMX_GSTATE_FIELDS);
+    BUILD_BUG_ON(NVMX_GSTATE_FIELDS > VMCS_BUF_SIZE);
+
+    if ( !value || !nvmx->gstate )
+    {
+        vvmcs_to_shadow_bulk(v, n, vmcs_gstate_field);
+        nvmx->gstate_valid = 0;
+        return;
+    }
+
+    if ( cpu_has_vmx_vmcs_shadowing )
+    {
+        virtual_vmcs_enter(v);
+        for ( i = 0; i < n; i++ )
+            __vmread(vmcs_gstate_field[i], &value[i]);
+        virtual_vmcs_exit(v);
+    }
+    else
+        for ( i = 0; i < n; i++ )
+            value[i] = get_vvmcs(v, vmcs_gstate_field[i]);
+
+    for ( i = 0; i < n; i++ )
+    {
+        if ( nvmx->gstate_valid && value[i] == nvmx->gstate[i] )
+            continue;
+        __vmwrite(vmcs_gstate_field[i], value[i]);
+        nvmx->gstate[i] = value[i];
+    }
+
+    nvmx->gstate_valid = 1;
+}
+
+static void shadow_to_vvmcs_gstate(struct vcpu *v)
+{
+    struct nestedvmx *nvmx = &vcpu_2_nvmx(v);
+    u64 *value = this_cpu(vvmcs_buf);
+    u8 changed[NVMX_GSTATE_FIELDS];
+    unsigned int i, nr = 0;
+
+    if ( !value || !nvmx->gstate_valid )
+    {
+        shadow_to_vvmcs_bulk(v, ARRAY_SIZE(vmcs_gstate_field),
+                             vmcs_gstate_field);
+        nvmx->gstate_valid = 0;
+        return;
+    }
+
+    for ( i = 0; i < ARRAY_SIZE(vmcs_gstate_field); i++ )
+    {
+        unsigned long val;
+
+        if ( vmread_safe(vmcs_gstate_field[i], &val) ||
+             val == nvmx->gstate[i] )
+            continue;
+        nvmx->gstate[i] = val;
+        value[nr] = val;
+        changed[nr++] = i;
+    }
+
+    if ( !nr )
+        return;
+
+    if ( cpu_has_vmx_vmcs_shadowing )
+    {
+        virtual_vmcs_enter(v);
+        for ( i = 0; i < nr; i++ )
+            __vmwrite(vmcs_gstate_field[changed[i]], value[i]);
+        virtual_vmcs_exit(v);
+    }
+    else
+        for ( i = 0; i < nr; i++ )
+            set_vvmcs(v, vmcs_gstate_field[changed[i]], value[i]);
+}
+
 static void load_shadow_control(struct vcpu *v)
 {
     /*
@@ -1041,8 +1138,7 @@ static void load_shadow_guest_state(struct vcpu *v)
     };
 
     /* vvmcs.gstate to shadow vmcs.gstate */
-    vvmcs_to_shadow_bulk(v, ARRAY_SIZE(vmcs_gstate_field),
-                         vmcs_gstate_field);
+    vvmcs_to_shadow_gstate(v);
 
     nvcpu->guest_cr[0] = get_vvmcs(v, CR0_READ_SHADOW);
     nvcpu->guest_cr[4] = get_vvmcs(v, CR4_READ_SHADOW);
@@ -1209,8 +1305,7 @@ static void virtual_vmentry(struct cpu_user_regs *regs)
 static void sync_vvmcs_guest_state(struct vcpu *v, struct cpu_user_regs *regs)
 {
     /* copy shadow vmcs.gstate back to vvmcs.gstate */
-    shadow_to_vvmcs_bulk(v, ARRAY_SIZE(vmcs_gstate_field),
-                         vmcs_gstate_field);
+    shadow_to_vvmcs_gstate(v);
     /* RIP, RSP are in user regs */
     set_vvmcs(v, GUEST_RIP, regs->rip);
     set_vvmcs(v, GUEST_RSP, regs->rsp);
@@ -1471,6 +1566,7 @@ int nvmx_handle_vmxon(struct cpu_user_regs *regs)
     __vmpclear(v->arch.hvm_vmx.vmcs_pa);
     copy_domain_page(_mfn(PFN_DOWN(nvcpu->nv_n2vmcx_pa)),
                      _mfn(PFN_DOWN(v->arch.hvm_vmx.vmcs_pa)));
+    nvmx->gstate_valid = 0;
     __vmptrld(v->arch.hvm_vmx.vmcs_pa);
     v->arch.hvm_vmx.launched = 0;
     vmsucceed(regs);
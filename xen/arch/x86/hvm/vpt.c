@@ -192,13 +192,38 @@ static void pt_thaw_time(struct vcpu *v)
     v->arch.hvm_vcpu.guest_time = 0;
 }
 
+/*
+ * A blocked vcpu normally keeps its timers running, as their ticks are
+ * what wakes it up. Guests which wake on something else can ask for the
+ * periodic timers to be stopped instead, and the ticks they missed to be
+ * accounted by pt_restore_timer() once something else woke the vcpu.
+ * One-shot timers are deadlines the guest asked for, so they stay armed.
+ */
+static void pt_park_timers(struct vcpu *v)
+{
+    struct list_head *head = &v->arch.hvm_vcpu.tm_list;
+    struct periodic_time *pt;
+
+    spin_lock(&v->arch.hvm_vcpu.tm_lock);
+
+    list_for_each_entry ( pt, head, list )
+        if ( !pt->one_shot )
+            stop_timer(&pt->timer);
+
+    spin_unlock(&v->arch.hvm_vcpu.tm_lock);
+}
+
 void pt_save_timer(struct vcpu *v)
 {
     struct list_head *head = &v->arch.hvm_vcpu.tm_list;
     struct periodic_time *pt;
 
     if ( v->pause_flags & VPF_blocked )
+    {
+        if ( v->domain->arch.hvm_domain.params[HVM_PARAM_VPT_LAZY] )
+            pt_park_timers(v);
         return;
+    }
 
     spin_lock(&v->arch.hvm_vcpu.tm_lock);
 
@@ -388,6 +413,43 @@ void pt_intr_post(struct vcpu *v, struct hvm_intack intack)
         cb(v, cb_priv);
 }
 
+/*
+ * A timer backend able to interrupt the running vcpu itself (the VMX
+ * preemption timer) fires its LAPIC timer without the softirq and the
+ * slop of the Xen timer, which stays armed for when the vcpu isn't
+ * running.  pt_lapic_deadline() is read without the lock: a stale value
+ * only makes the backend fire early, or too late to matter.
+ */
+s_time_t pt_lapic_deadline(struct vcpu *v)
+{
+    const struct periodic_time *pt = &vcpu_vlapic(v)->pt;
+
+    if ( !pt->on_list || pt->pending_intr_nr )
+        return 0;
+
+    return pt->scheduled;
+}
+
+void pt_lapic_expire(struct vcpu *v)
+{
+    struct periodic_time *pt = &vcpu_vlapic(v)->pt;
+
+    ASSERT(v == current);
+
+    spin_lock(&v->arch.hvm_vcpu.tm_lock);
+
+    /* As pt_timer_fn(), which runs on this pCPU and so can't be running. */
+    if ( pt->on_list && !pt->pending_intr_nr && pt->scheduled <= NOW() )
+    {
+        stop_timer(&pt->timer);
+        pt->pending_intr_nr++;
+        pt->scheduled += pt->period;
+        pt->do_not_freeze = 0;
+    }
+
+    spin_unlock(&v->arch.hvm_vcpu.tm_lock);
+}
+
 void pt_migrate(struct vcpu *v)
 {
     struct list_head *head = &v->arch.hvm_vcpu.tm_list;
@@ -19,7 +19,13 @@
  * Copyright (c) 2015,2016 Citrix Systems Ltd.
  */
 
+#include <xen/cpu.h>
+#include <xen/guest_access.h>
 #include <xen/hypercall.h>
+#include <xen/init.h>
+#include <xen/sched.h>
+#include <xen/spinlock.h>
+#include <xen/xmalloc.h>
 
 #define ARGS(x, n)                              \
     [ __HYPERVISOR_ ## x ] = { n, n }
@@ -251,6 +257,260 @@ int hypercall_xlat_continuation(unsigned int *id, unsigned int nr,
     return rc;
 }
 
+/*
+ * Hypercall statistics: for each calling domain, hypercall and sub-op, the
+ * number of invocations, how many of them got preempted, and a histogram
+ * of their run times.  Each CPU collects into a hash table of its own, so
+ * recording takes no locks; the tables are merged when queried.
+ */
+bool_t __read_mostly opt_hypercall_stats;
+boolean_param("hypercall_stats", opt_hypercall_stats);
+
+#define HCALL_STATS_ORDER   9       /* Entries per CPU. */
+#define HCALL_STATS_MERGED  10      /* Entries of a query. */
+#define HCALL_STATS_PROBES  16
+#define HCALL_STATS_MAX_SUBOP 0xffff
+
+/* The op is offset by one, so that a key of 0 denotes a free slot. */
+#define HCALL_STATS_KEY(d, op, subop) \
+    (((uint64_t)(d) << 48) | ((uint64_t)(op) + 1) << 32 | (subop))
+
+struct hcall_stats {
+    uint64_t key;
+    uint64_t calls;
+    uint64_t continuations;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint32_t histo[XEN_SYSCTL_HCALL_STATS_BUCKETS];
+};
+
+static DEFINE_PER_CPU(struct hcall_stats *, hcall_stats);
+static DEFINE_PER_CPU(unsigned long, hcall_stats_dropped);
+static DEFINE_SPINLOCK(hcall_stats_lock);
+
+/* Hypercalls whose first argument is a sub-op. */
+#define CMD(x) (1ULL << __HYPERVISOR_ ## x)
+static const uint64_t hcall_cmd_arg =
+    CMD(memory_op) | CMD(xen_version) | CMD(console_io) | CMD(vm_assist) |
+    CMD(vcpu_op) | CMD(nmi_op) | CMD(sched_op) | CMD(callback_op) |
+    CMD(xenoprof_op) | CMD(event_channel_op) | CMD(physdev_op) |
+    CMD(hvm_op) | CMD(kexec_op) | CMD(xenpmu_op) | CMD(grant_table_op);
+/* Hypercalls taking a structure starting with the sub-op. */
+static const uint64_t hcall_cmd_struct =
+    CMD(platform_op) | CMD(sysctl) | CMD(domctl);
+#undef CMD
+
+static struct hcall_stats *hcall_stats_find(struct hcall_stats *table,
+                                            unsigned int order, uint64_t key)
+{
+    unsigned int i, mask = (1u << order) - 1;
+    unsigned int idx = (key * 0x9e3779b97f4a7c15ULL) >> (64 - order);
+
+    for ( i = 0; i < HCALL_STATS_PROBES; i++, idx = (idx + 1) & mask )
+    {
+        if ( table[idx].key == key )
+            return &table[idx];
+        if ( !table[idx].key )
+        {
+            table[idx].key = key;
+            return &table[idx];
+        }
+    }
+
+    return NULL;
+}
+
+void hypercall_stats_begin(struct hypercall_stats_ctxt *ctxt,
+                           unsigned int op, unsigned long arg0)
+{
+    uint32_t subop = 0;
+
+    if ( hcall_cmd_arg & (1ULL << op) )
+        subop = op == __HYPERVISOR_memory_op ? arg0 & MEMOP_CMD_MASK : arg0;
+    else if ( (hcall_cmd_struct & (1ULL << op)) &&
+              raw_copy_from_guest(&subop, (void *)arg0, sizeof(subop)) )
+        subop = HCALL_STATS_MAX_SUBOP;
+
+    ctxt->op = op;
+    ctxt->subop = min_t(uint32_t, subop, HCALL_STATS_MAX_SUBOP);
+    ctxt->start = NOW();
+}
+
+void hypercall_stats_end(const struct hypercall_stats_ctxt *ctxt,
+                         const struct vcpu *v)
+{
+    struct hcall_stats *table = this_cpu(hcall_stats), *s = NULL;
+    uint64_t ns = NOW() - ctxt->start;
+
+    if ( table )
+        s = hcall_stats_find(table, HCALL_STATS_ORDER,
+                             HCALL_STATS_KEY(v->domain->domain_id, ctxt->op,
+                                             ctxt->subop));
+    if ( !s )
+    {
+        this_cpu(hcall_stats_dropped)++;
+        return;
+    }
+
+    s->calls++;
+    if ( v->hcall_preempted )
+        s->continuations++;
+    s->total_ns += ns;
+    if ( ns > s->max_ns )
+        s->max_ns = ns;
+
+    /* Bucket 0 is below 1us, bucket n below 2^n us, the last one 1ms+. */
+    s->histo[ns < (1u << (XEN_SYSCTL_HCALL_STATS_BUCKETS + 8)) ?
+             fls(ns >> 10) : XEN_SYSCTL_HCALL_STATS_BUCKETS - 1]++;
+}
+
+static int hcall_stats_cpu_callback(
+    struct notifier_block *nfb, unsigned long action, void *hcpu)
+{
+    unsigned int cpu = (unsigned long)hcpu;
+
+    if ( action == CPU_UP_PREPARE && !per_cpu(hcall_stats, cpu) )
+    {
+        per_cpu(hcall_stats, cpu) =
+            xzalloc_array(struct hcall_stats, 1u << HCALL_STATS_ORDER);
+        if ( !per_cpu(hcall_stats, cpu) )
+            return notifier_from_errno(-ENOMEM);
+    }
+
+    return NOTIFY_DONE;
+}
+
+static struct notifier_block hcall_stats_cpu_nfb = {
+    .notifier_call = hcall_stats_cpu_callback
+};
+
+static int __init hypercall_stats_init(void)
+{
+    unsigned int cpu;
+
+    if ( !opt_hypercall_stats )
+        return 0;
+
+    for_each_online_cpu ( cpu )
+        hcall_stats_cpu_callback(&hcall_stats_cpu_nfb, CPU_UP_PREPARE,
+                                 (void *)(unsigned long)cpu);
+    register_cpu_notifier(&hcall_stats_cpu_nfb);
+
+    return 0;
+}
+presmp_initcall(hypercall_stats_init);
+
+static int hypercall_stats_query(struct xen_sysctl_hypercall_stats *op)
+{
+    struct hcall_stats *merged, *s, *m;
+    unsigned int cpu, i, nr = 0;
+    int rc = 0;
+
+    merged = xzalloc_array(struct hcall_stats, 1u << HCALL_STATS_MERGED);
+    if ( !merged )
+        return -ENOMEM;
+
+    op->dropped = 0;
+    for_each_online_cpu ( cpu )
+    {
+        op->dropped += per_cpu(hcall_stats_dropped, cpu);
+        if ( !per_cpu(hcall_stats, cpu) )
+            continue;
+
+        for ( i = 0; i < (1u << HCALL_STATS_ORDER); i++ )
+        {
+            unsigned int b;
+
+            s = &per_cpu(hcall_stats, cpu)[i];
+            if ( !s->key )
+                continue;
+
+            m = hcall_stats_find(merged, HCALL_STATS_MERGED, s->key);
+            if ( !m )
+            {
+                op->dropped += s->calls;
+                continue;
+            }
+
+            m->calls += s->calls;
+            m->continuations += s->continuations;
+            m->total_ns += s->total_ns;
+            m->max_ns = max(m->max_ns, s->max_ns);
+            for ( b = 0; b < XEN_SYSCTL_HCALL_STATS_BUCKETS; b++ )
+                m->histo[b] += s->histo[b];
+        }
+    }
+
+    for ( i = 0; i < (1u << HCALL_STATS_MERGED); i++ )
+    {
+        struct xen_sysctl_hypercall_stats_entry e;
+
+        m = &merged[i];
+        if ( !m->key )
+            continue;
+
+        if ( nr < op->nr_entries )
+        {
+            e.domid = m->key >> 48;
+            e.op = ((m->key >> 32) & 0xffff) - 1;
+            e.subop = (uint32_t)m->key;
+            e.calls = m->calls;
+            e.continuations = m->continuations;
+            e.total_ns = m->total_ns;
+            e.max_ns = m->max_ns;
+            memcpy(e.histo, m->histo, sizeof(e.histo));
+            if ( copy_to_guest_offset(op->entries, nr, &e, 1) )
+            {
+                rc = -EFAULT;
+                break;
+            }
+        }
+        nr++;
+    }
+
+    xfree(merged);
+    op->nr_entries = nr;
+
+    return rc;
+}
+
+int hypercall_stats_op(struct xen_sysctl_hypercall_stats *op)
+{
+    unsigned int cpu;
+    int rc = 0;
+
+    if ( !opt_hypercall_stats )
+        return -EOPNOTSUPP;
+
+    spin_lock(&hcall_stats_lock);
+
+    switch ( op->cmd )
+    {
+    case XEN_SYSCTL_HCALL_STATS_query:
+        rc = hypercall_stats_query(op);
+        break;
+
+    case XEN_SYSCTL_HCALL_STATS_reset:
+        /* Racing with updates, so some of them may survive. */
+        for_each_online_cpu ( cpu )
+        {
+            if ( per_cpu(hcall_stats, cpu) )
+                memset(per_cpu(hcall_stats, cpu), 0,
+                       sizeof(struct hcall_stats) << HCALL_STATS_ORDER);
+            per_cpu(hcall_stats_dropped, cpu) = 0;
+        }
+        break;
+
+    default:
+        rc = -EINVAL;
+        break;
+    }
+
+    spin_unlock(&hcall_stats_lock);
+
+    return rc;
+}
+
 /*
  * Local variables:
  * mode: C
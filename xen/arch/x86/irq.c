@@ -775,12 +775,20 @@ void pirq_set_affinity(struct domain *d, int pirq, const cpumask_t *mask)
 
 DEFINE_PER_CPU(unsigned int, irq_count);
 
+static uint8_t next_hipriority_vector = FIRST_HIPRIORITY_VECTOR;
+
 uint8_t alloc_hipriority_vector(void)
 {
-    static uint8_t next = FIRST_HIPRIORITY_VECTOR;
+    uint8_t next = next_hipriority_vector;
     BUG_ON(next < FIRST_HIPRIORITY_VECTOR);
     BUG_ON(next > LAST_HIPRIORITY_VECTOR);
-    return next++;
+    next_hipriority_vector = next + 1;
+    return next;
+}
+
+unsigned int nr_free_hipriority_vectors(void)
+{
+    return LAST_HIPRIORITY_VECTOR + 1 - next_hipriority_vector;
 }
 
 static void (*direct_apic_vector[NR_VECTORS])(struct cpu_user_regs *);
@@ -1476,20 +1484,17 @@ void desc_guest_eoi(struct irq_desc *desc, struct pirq *pirq)
 
 int pirq_guest_unmask(struct domain *d)
 {
-    unsigned int pirq = 0, n, i;
+    unsigned int n, i;
     struct pirq *pirqs[16];
+    struct radix_tree_iter iter;
 
-    do {
-        n = radix_tree_gang_lookup(&d->pirq_tree, (void **)pirqs, pirq,
-                                   ARRAY_SIZE(pirqs));
+    radix_tree_iter_init(&iter, 0, d->nr_pirqs - 1);
+    while ( (n = radix_tree_next_batch(&d->pirq_tree, &iter, (void **)pirqs,
+                                       NULL, ARRAY_SIZE(pirqs))) )
         for ( i = 0; i < n; ++i )
-        {
-            pirq = pirqs[i]->pirq;
             if ( pirqs[i]->masked &&
                  !evtchn_port_is_masked(d, evtchn_from_port(d, pirqs[i]->evtchn)) )
                 pirq_guest_eoi(pirqs[i]);
-        }
-    } while ( ++pirq < d->nr_pirqs && n == ARRAY_SIZE(pirqs) );
 
     return 0;
 }
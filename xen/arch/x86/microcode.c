@@ -30,6 +30,7 @@
 #include <xen/smp.h>
 #include <xen/softirq.h>
 #include <xen/spinlock.h>
+#include <xen/stop_machine.h>
 #include <xen/tasklet.h>
 #include <xen/guest_access.h>
 #include <xen/earlycpio.h>
@@ -85,6 +86,10 @@ static void __init parse_ucode(char *s)
 }
 custom_param("ucode", parse_ucode);
 
+/* Load late updates on all cores at once, rather than one CPU at a time. */
+static bool_t __read_mostly opt_ucode_parallel;
+boolean_param("ucode_parallel", opt_ucode_parallel);
+
 /*
  * 8MB ought to be enough.
  */
@@ -190,6 +195,8 @@ struct microcode_info {
     unsigned int cpu;
     uint32_t buffer_size;
     int error;
+    s_time_t start;
+    cpumask_t cores_done;   /* Parallel mode: first thread of core is done. */
     char buffer[1];
 };
 
@@ -262,20 +269,27 @@ int microcode_resume_cpu(unsigned int cpu)
     return err;
 }
 
-static int microcode_update_cpu(const void *buf, size_t size)
+static int __microcode_update_cpu(const void *buf, size_t size)
 {
     int err;
     unsigned int cpu = smp_processor_id();
     struct ucode_cpu_info *uci = &per_cpu(ucode_cpu_info, cpu);
 
-    spin_lock(&microcode_mutex);
-
     err = microcode_ops->collect_cpu_info(cpu, &uci->cpu_sig);
     if ( likely(!err) )
         err = microcode_ops->cpu_request_microcode(cpu, buf, size);
     else
         __microcode_fini_cpu(cpu);
 
+    return err;
+}
+
+static int microcode_update_cpu(const void *buf, size_t size)
+{
+    int err;
+
+    spin_lock(&microcode_mutex);
+    err = __microcode_update_cpu(buf, size);
     spin_unlock(&microcode_mutex);
 
     return err;
@@ -297,6 +311,61 @@ static long do_microcode_update(void *_info)
         return continue_hypercall_on_cpu(info->cpu, do_microcode_update, info);
 
     error = info->error;
+    printk(XENLOG_INFO "microcode: serial update took %"PRI_stime"us\n",
+           (NOW() - info->start) / MICROSECS(1));
+    xfree(info);
+    return error;
+}
+
+/* Runs on all online CPUs at once, with interrupts disabled. */
+static int do_microcode_update_parallel(void *_info)
+{
+    struct microcode_info *info = _info;
+    unsigned int cpu = smp_processor_id();
+    unsigned int first = cpumask_first(per_cpu(cpu_sibling_mask, cpu));
+    int error;
+
+    /*
+     * The threads of a core share its microcode engine and must not load
+     * at the same time.  The first thread of each core loads, the others
+     * then only find themselves up to date and pick up the new revision.
+     */
+    if ( cpu != first )
+        while ( !cpumask_test_cpu(first, &info->cores_done) )
+            cpu_relax();
+
+    /*
+     * No CPU can be in microcode_resume_cpu() or microcode_fini_cpu() while
+     * the machine is stopped, so microcode_mutex isn't needed, and taking it
+     * would serialise the cores again.
+     */
+    error = __microcode_update_cpu(info->buffer, info->buffer_size);
+    if ( error )
+        cmpxchg(&info->error, 0, error);
+
+    if ( cpu == first )
+        cpumask_set_cpu(cpu, &info->cores_done);
+
+    return 0;
+}
+
+static long microcode_update_parallel(void *_info)
+{
+    struct microcode_info *info = _info;
+    s_time_t window;
+    int error;
+
+    cpumask_clear(&info->cores_done);
+
+    window = NOW();
+    error = stop_machine_run(do_microcode_update_parallel, info, NR_CPUS);
+    window = NOW() - window;
+    if ( !error )
+        error = info->error;
+
+    printk(XENLOG_INFO "microcode: parallel update took %"PRI_stime"us, "
+           "%"PRI_stime"us with the machine stopped\n",
+           (NOW() - info->start) / MICROSECS(1), window / MICROSECS(1));
     xfree(info);
     return error;
 }
@@ -326,6 +395,7 @@ int microcode_update(XEN_GUEST_HANDLE_PARAM(const_void) buf, unsigned long len)
     info->buffer_size = len;
     info->error = 0;
     info->cpu = cpumask_first(&cpu_online_map);
+    info->start = NOW();
 
     if ( microcode_ops->start_update )
     {
@@ -337,7 +407,10 @@ int microcode_update(XEN_GUEST_HANDLE_PARAM(const_void) buf, unsigned long len)
         }
     }
 
-    return continue_hypercall_on_cpu(info->cpu, do_microcode_update, info);
+    return continue_hypercall_on_cpu(info->cpu,
+                                     opt_ucode_parallel
+                                     ? microcode_update_parallel
+                                     : do_microcode_update, info);
 }
 
 static int __init microcode_init(void)
@@ -510,9 +510,28 @@ void make_cr3(struct vcpu *v, unsigned long mfn)
     v->arch.cr3 = mfn << PAGE_SHIFT;
 }
 
+/*
+ * The PCID to run a vCPU's current address space with.  Only 64-bit PV
+ * guests get one, for each of their kernel and user page tables, which
+ * saves them refilling the TLB on every guest kernel entry and exit.  PV
+ * guests being shadowed are left alone, their CR3 being owned by the
+ * paging code.
+ */
+unsigned long pv_cr3_pcid(const struct vcpu *v)
+{
+    if ( !(mmu_cr4_features & X86_CR4_PCIDE) || is_idle_vcpu(v) ||
+         !is_pv_vcpu(v) || is_pv_32bit_vcpu(v) ||
+         paging_mode_enabled(v->domain) )
+        return 0;
+
+    return (v->arch.flags & TF_kernel_mode) ? PCID_PV_KERNEL : PCID_PV_USER;
+}
+
 void write_ptbase(struct vcpu *v)
 {
-    write_cr3(v->arch.cr3);
+    /* A full flush, covering all PCIDs. */
+    v->arch.flags &= ~TF_flush_user;
+    write_cr3(v->arch.cr3 | pv_cr3_pcid(v));
 }
 
 /*
@@ -3411,6 +3430,8 @@ long do_mmuext_op(
             }
 
             curr->arch.guest_table_user = pagetable_from_pfn(op.arg1.mfn);
+            /* The user PCID may still hold the old tables' translations. */
+            curr->arch.flags |= TF_flush_user;
 
             if ( old_mfn != 0 )
             {
@@ -3720,7 +3741,7 @@ long do_mmu_update(
             (void)copy_from_guest(&done, pdone, 1);
     }
     else
-        perfc_incr(calls_to_mmu_update);
+        perfc_incr_dom(calls_to_mmu_update, curr->domain);
 
     if ( unlikely(!guest_handle_okay(ureqs, count)) )
         return -EFAULT;
@@ -5474,7 +5495,7 @@ int ptwr_do_page_fault(struct vcpu *v, unsigned long addr,
 
         /* Fallthrough */
     case X86EMUL_RETRY:
-        perfc_incr(ptwr_emulations);
+        perfc_incr_dom(ptwr_emulations, current->domain);
         return EXCRET_fault_fixed;
     }
 
@@ -5624,7 +5645,7 @@ int mmio_ro_do_page_fault(struct vcpu *v, unsigned long addr,
 
         /* Fallthrough */
     case X86EMUL_RETRY:
-        perfc_incr(ptwr_emulations);
+        perfc_incr_dom(ptwr_emulations, current->domain);
         return EXCRET_fault_fixed;
     }
 
@@ -5770,6 +5791,7 @@ int map_pages_to_xen(
     unsigned int flags)
 {
     bool_t locking = system_state > SYS_STATE_boot;
+    bool_t flush = !(flags & MAP_NO_FLUSH);
     l2_pgentry_t *pl2e, ol2e;
     l1_pgentry_t *pl1e, ol1e;
     unsigned int  i;
@@ -5788,6 +5810,8 @@ int map_pages_to_xen(
     }                                          \
 } while (0)
 
+    flags &= ~MAP_NO_FLUSH;
+
     while ( nr_mfns != 0 )
     {
         l3_pgentry_t ol3e, *pl3e = virt_to_xen_l3e(virt);
@@ -6004,7 +6028,7 @@ int map_pages_to_xen(
             pl1e  = l2e_to_l1e(*pl2e) + l1_table_offset(virt);
             ol1e  = *pl1e;
             l1e_write_atomic(pl1e, l1e_from_pfn(mfn, flags));
-            if ( (l1e_get_flags(ol1e) & _PAGE_PRESENT) )
+            if ( flush && (l1e_get_flags(ol1e) & _PAGE_PRESENT) )
             {
                 unsigned int flush_flags = FLUSH_TLB | FLUSH_ORDER(0);
 
@@ -0,0 +1,351 @@
+/******************************************************************************
+ * arch/x86/mm/compact.c
+ *
+ * Background memory compaction.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <xen/init.h>
+#include <xen/lib.h>
+#include <xen/mm.h>
+#include <xen/rcupdate.h>
+#include <xen/sched.h>
+#include <xen/tasklet.h>
+#include <xen/timer.h>
+#include <asm/p2m.h>
+#include <asm/paging.h>
+#include <public/sysctl.h>
+
+/*
+ * Over time the heap gets fragmented, and guests built then get their
+ * memory mapped by 4k pages.  With compaction enabled, a tasklet checks
+ * every COMPACT_PERIOD whether a node has fewer than COMPACT_LOW_CHUNKS
+ * free chunks of compact_order pages or bigger.  If so, it looks for a
+ * suitably aligned block of memory which is at least half free, and of
+ * which everything else is HVM guest memory mapped by extents smaller
+ * than the block.  That memory gets moved elsewhere on the same node, the
+ * guest being paused meanwhile, and the block merges into a free chunk.
+ */
+#define COMPACT_PERIOD          SECONDS(1)
+#define COMPACT_LOW_CHUNKS      16
+#define COMPACT_SCAN_PAGES      (1UL << PAGE_ORDER_1G) /* per node and run */
+#define COMPACT_MOVE_PAGES      2048                   /* per run */
+
+static bool_t __read_mostly compact_enabled;
+static unsigned int __read_mostly compact_order = PAGE_ORDER_2M;
+
+static unsigned long compact_cursor[MAX_NUMNODES];
+static unsigned long compact_moved, compact_assembled, compact_abandoned;
+
+static void compact_work(unsigned long unused);
+static DECLARE_TASKLET(compact_tasklet, compact_work, 0);
+static struct timer compact_timer;
+static bool_t compact_timer_initialised;
+
+/* "mem-compact=<boolean>|<order>" */
+static void __init parse_compact(const char *s)
+{
+    int val = parse_bool(s);
+
+    if ( val >= 0 )
+        compact_enabled = val;
+    else
+    {
+        val = simple_strtoul(s, NULL, 0);
+        if ( val >= PAGE_ORDER_2M && val <= PAGE_ORDER_1G )
+        {
+            compact_enabled = 1;
+            compact_order = val;
+        }
+    }
+}
+custom_param("mem-compact", parse_compact);
+
+/*
+ * The domain owning pg, if its memory may get moved, with a reference
+ * taken.  pg may get freed (and its owner destroyed) at any time, so only
+ * trust the owner field once the domain was found in the domain list.
+ */
+static struct domain *compact_get_owner(const struct page_info *pg)
+{
+    struct domain *owner, *d;
+
+    if ( !page_state_is(pg, inuse) || !(owner = page_get_owner(pg)) )
+        return NULL;
+
+    rcu_read_lock(&domlist_read_lock);
+    for_each_domain ( d )
+        if ( d == owner )
+            break;
+    if ( d && (!paging_mode_translate(d) || !get_domain(d)) )
+        d = NULL;
+    rcu_read_unlock(&domlist_read_lock);
+
+    return d;
+}
+
+/* Worth compacting: at least half free, and the rest possibly movable. */
+static bool_t compact_candidate(unsigned int node, unsigned long start,
+                                unsigned long nr)
+{
+    const struct domain *last = NULL;
+    const struct page_info *pg;
+    struct domain *d;
+    unsigned long i, nr_free = 0;
+
+    for ( i = 0; i < nr; i++ )
+    {
+        if ( !mfn_valid(_mfn(start + i)) ||
+             phys_to_nid(pfn_to_paddr(start + i)) != node )
+            return 0;
+
+        pg = mfn_to_page(start + i);
+        if ( page_state_is(pg, free) )
+        {
+            nr_free++;
+            continue;
+        }
+
+        if ( (pg->count_info & (PGC_count_mask | PGC_allocated)) !=
+             (1 | PGC_allocated) ||
+             (pg->u.inuse.type_info & PGT_count_mask) )
+            return 0;
+
+        if ( page_get_owner(pg) != last )
+        {
+            if ( !(d = compact_get_owner(pg)) )
+                return 0;
+            last = d;
+            put_domain(d);
+        }
+
+        /* Give up early once half the block can't be free. */
+        if ( i + 1 - nr_free > nr / 2 )
+            return 0;
+    }
+
+    return nr_free < nr;
+}
+
+/*
+ * Move what is in use out of the block.  Returns -ERESTART if the budget
+ * ran out, with the block to be continued on next time.
+ */
+static int compact_block(unsigned long start, unsigned long nr,
+                         unsigned long *budget)
+{
+    PAGE_LIST_HEAD(held);
+    struct domain *paused = NULL, *d;
+    struct page_info *pg;
+    unsigned long mfn, step;
+    int rc = 0;
+
+    for ( mfn = start; mfn < start + nr; mfn += step )
+    {
+        step = 1;
+        pg = mfn_to_page(mfn);
+        if ( page_state_is(pg, free) )
+            continue;
+
+        /* Allocated by us (on held), or otherwise to be left alone. */
+        if ( page_state_is(pg, inuse) && !page_get_owner(pg) &&
+             !(pg->count_info & PGC_count_mask) )
+            continue;
+
+        if ( !*budget )
+        {
+            rc = -ERESTART;
+            break;
+        }
+
+        if ( !(d = compact_get_owner(pg)) )
+        {
+            rc = -EBUSY;
+            break;
+        }
+
+        /* Keep each domain paused while going over a run of its pages. */
+        if ( d == paused )
+        {
+            put_domain(d);
+        }
+        else
+        {
+            if ( paused )
+            {
+                domain_unpause(paused);
+                put_domain(paused);
+            }
+            domain_pause(d);
+            paused = d;
+        }
+
+        rc = p2m_compact_extent(d, _mfn(mfn), compact_order, _mfn(start), nr,
+                                &held, &step);
+        if ( rc < 0 )
+            break;
+        compact_moved += rc;
+        *budget -= min_t(unsigned long, *budget, rc);
+        rc = 0;
+    }
+
+    if ( paused )
+    {
+        domain_unpause(paused);
+        put_domain(paused);
+    }
+
+    while ( (pg = page_list_remove_head(&held)) != NULL )
+        free_domheap_page(pg);
+    page_cache_drain_local();
+
+    return rc;
+}
+
+static void compact_node(unsigned int node, unsigned long *budget)
+{
+    unsigned long chunks[MAX_ORDER + 1], nr = 1UL << compact_order;
+    unsigned long start = ROUNDUP(node_start_pfn(node), nr);
+    unsigned long end = node_end_pfn(node) & ~(nr - 1);
+    unsigned long scanned, mfn, have = 0;
+    unsigned int order;
+    int rc;
+
+    if ( start >= end || avail_node_heap_pages(node) < (nr << 2) )
+        return;
+
+    avail_node_heap_chunks(node, chunks, ARRAY_SIZE(chunks));
+    for ( order = compact_order; order <= MAX_ORDER; order++ )
+        have += chunks[order];
+    if ( have >= COMPACT_LOW_CHUNKS )
+        return;
+
+    for ( scanned = 0; scanned < COMPACT_SCAN_PAGES && *budget;
+          scanned += nr )
+    {
+        mfn = compact_cursor[node];
+        if ( mfn < start || mfn >= end || (mfn & (nr - 1)) )
+            mfn = start;
+
+        if ( !compact_candidate(node, mfn, nr) )
+        {
+            compact_cursor[node] = mfn + nr;
+            continue;
+        }
+
+        rc = compact_block(mfn, nr, budget);
+        if ( rc == -ERESTART )
+        {
+            compact_cursor[node] = mfn;
+            break;
+        }
+        compact_cursor[node] = mfn + nr;
+
+        if ( !rc && page_state_is(mfn_to_page(mfn), free) &&
+             PFN_ORDER(mfn_to_page(mfn)) >= compact_order )
+            compact_assembled++;
+        else
+            compact_abandoned++;
+
+        if ( rc == -ENOMEM )
+            break;
+    }
+}
+
+static void compact_work(unsigned long unused)
+{
+    unsigned long budget = COMPACT_MOVE_PAGES;
+    unsigned int node;
+
+    if ( !compact_enabled )
+        return;
+
+    for_each_online_node ( node )
+        compact_node(node, &budget);
+
+    set_timer(&compact_timer, NOW() + COMPACT_PERIOD);
+}
+
+static void compact_timer_fn(void *unused)
+{
+    tasklet_schedule(&compact_tasklet);
+}
+
+static void compact_start(void)
+{
+    if ( !compact_timer_initialised )
+    {
+        init_timer(&compact_timer, compact_timer_fn, NULL,
+                   smp_processor_id());
+        compact_timer_initialised = 1;
+    }
+    set_timer(&compact_timer, NOW() + COMPACT_PERIOD);
+}
+
+int compact_op(struct xen_sysctl_compact_op *op)
+{
+    switch ( op->cmd )
+    {
+    case XEN_SYSCTL_COMPACT_get:
+        op->enable = compact_enabled;
+        op->order = compact_order;
+        op->moved = compact_moved;
+        op->assembled = compact_assembled;
+        op->abandoned = compact_abandoned;
+        return 0;
+
+    case XEN_SYSCTL_COMPACT_set:
+        if ( op->enable &&
+             (op->order < PAGE_ORDER_2M || op->order > PAGE_ORDER_1G) )
+            return -EINVAL;
+
+        /* Serialised by the sysctl lock. */
+        if ( op->enable )
+        {
+            compact_order = op->order;
+            if ( !compact_enabled )
+            {
+                compact_enabled = 1;
+                compact_start();
+            }
+        }
+        else if ( compact_enabled )
+        {
+            compact_enabled = 0;
+            stop_timer(&compact_timer);
+        }
+        return 0;
+    }
+
+    return -EOPNOTSUPP;
+}
+
+static int __init compact_init(void)
+{
+    if ( compact_enabled )
+        compact_start();
+
+    return 0;
+}
+__initcall(compact_init);
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -246,6 +246,63 @@ static void hap_clean_dirty_bitmap(struct domain *d)
 /************************************************/
 /*             HAP SUPPORT FUNCTIONS            */
 /************************************************/
+
+/*
+ * Upper bound on how far the pool may grow past what the toolstack asked
+ * for.  When the free list runs low, it is grown in HAP_GROW_PAGES steps
+ * from a tasklet, rather than the domain crashing on exhaustion; pages
+ * added this way are handed back once they are free again.
+ */
+static unsigned long __read_mostly opt_hap_autogrow;
+size_param("hap_autogrow", opt_hap_autogrow);
+
+#define HAP_GROW_PAGES    256
+#define HAP_GROW_LOW      (HAP_GROW_PAGES / 4)
+#define HAP_SHRINK_HIGH   (HAP_GROW_PAGES * 2)
+
+static bool hap_may_grow(const struct domain *d)
+{
+    return d->arch.paging.hap.free_pages < HAP_GROW_LOW &&
+           ((unsigned long)d->arch.paging.hap.grown_pages + HAP_GROW_PAGES) <=
+           (opt_hap_autogrow >> PAGE_SHIFT);
+}
+
+static bool hap_may_shrink(const struct domain *d)
+{
+    return d->arch.paging.hap.grown_pages &&
+           d->arch.paging.hap.free_pages > HAP_SHRINK_HIGH;
+}
+
+static void hap_grow_pool(unsigned long data)
+{
+    struct domain *d = (struct domain *)data;
+    struct hap_domain *hap = &d->arch.paging.hap;
+    unsigned int pages, old_total;
+
+    paging_lock(d);
+
+    if ( d->is_dying )
+        goto out;
+
+    old_total = hap->total_pages;
+    pages = hap->total_pages + hap->p2m_pages;
+
+    if ( hap_may_grow(d) )
+    {
+        hap_set_allocation(d, pages + HAP_GROW_PAGES, NULL);
+        hap->grown_pages += hap->total_pages - old_total;
+    }
+    else if ( hap_may_shrink(d) )
+    {
+        hap_set_allocation(d, pages - min_t(unsigned int, hap->grown_pages,
+                                                 HAP_GROW_PAGES), NULL);
+        hap->grown_pages -= old_total - hap->total_pages;
+    }
+
+ out:
+    paging_unlock(d);
+}
+
 static struct page_info *hap_alloc(struct domain *d)
 {
     struct page_info *pg = NULL;
@@ -253,6 +310,9 @@ static struct page_info *hap_alloc(struct domain *d)
 
     ASSERT(paging_locked_by_me(d));
 
+    if ( unlikely(hap_may_grow(d)) )
+        tasklet_schedule(&d->arch.paging.hap.grow_tasklet);
+
     pg = page_list_remove_head(&d->arch.paging.hap.freelist);
     if ( unlikely(!pg) )
         return NULL;
@@ -274,6 +334,9 @@ static void hap_free(struct domain *d, mfn_t mfn)
 
     d->arch.paging.hap.free_pages++;
     page_list_add_tail(pg, &d->arch.paging.hap.freelist);
+
+    if ( unlikely(hap_may_shrink(d)) )
+        tasklet_schedule(&d->arch.paging.hap.grow_tasklet);
 }
 
 static struct page_info *hap_alloc_p2m_page(struct domain *d)
@@ -458,6 +521,8 @@ void hap_domain_init(struct domain *d)
     };
 
     INIT_PAGE_LIST_HEAD(&d->arch.paging.hap.freelist);
+    tasklet_init(&d->arch.paging.hap.grow_tasklet, hap_grow_pool,
+                 (unsigned long)d);
 
     /* Use HAP logdirty mechanism. */
     paging_log_dirty_init(d, &hap_ops);
@@ -538,6 +603,8 @@ void hap_final_teardown(struct domain *d)
 {
     unsigned int i;
 
+    tasklet_kill(&d->arch.paging.hap.grow_tasklet);
+
     if ( hvm_altp2m_supported() )
     {
         d->arch.altp2m_active = 0;
@@ -577,7 +644,10 @@ void hap_teardown(struct domain *d, bool *preempted)
     ASSERT(d != current->domain);
 
     if ( !paging_locked_by_me(d) )
+    {
+        tasklet_kill(&d->arch.paging.hap.grow_tasklet);
         paging_lock(d); /* Keep various asserts happy */
+    }
 
     if ( paging_mode_enabled(d) )
     {
@@ -624,6 +694,8 @@ int hap_domctl(struct domain *d, xen_domctl_shadow_op_t *sc,
     case XEN_DOMCTL_SHADOW_OP_SET_ALLOCATION:
         paging_lock(d);
         rc = hap_set_allocation(d, sc->mb << (20 - PAGE_SHIFT), &preempted);
+        /* The toolstack has taken over sizing the pool again. */
+        d->arch.paging.hap.grown_pages = 0;
         paging_unlock(d);
         if ( preempted )
             /* Not finished.  Set up to re-run the call. */
@@ -644,6 +716,15 @@ int hap_domctl(struct domain *d, xen_domctl_shadow_op_t *sc,
     }
 }
 
+void hap_dump_domain_info(struct domain *d)
+{
+    const struct hap_domain *hap = &d->arch.paging.hap;
+
+    printk("    hap pool: %u pages (%u free, %u p2m, %u grown)\n",
+           hap->total_pages + hap->p2m_pages, hap->free_pages,
+           hap->p2m_pages, hap->grown_pages);
+}
+
 static const struct paging_mode hap_paging_real_mode;
 static const struct paging_mode hap_paging_protected_mode;
 static const struct paging_mode hap_paging_pae_mode;
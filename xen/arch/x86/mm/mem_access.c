@@ -236,9 +236,23 @@ bool_t p2m_mem_access_check(paddr_t gpa, unsigned long gla,
     return (p2ma != p2m_access_n2rwx);
 }
 
+/* Whether the nr gfns from gfn cover the whole entry of the given order. */
+static bool range_covers_entry(unsigned long gfn, unsigned long nr,
+                               unsigned int order)
+{
+    return order != PAGE_ORDER_4K && !(gfn & ((1UL << order) - 1)) &&
+           nr >= (1UL << order);
+}
+
+/*
+ * Set the access of gfn in an altp2m view.  When the nr gfns from gfn
+ * cover a whole superpage of the view, or of the host p2m, the access is
+ * set on the superpage as a whole instead of splitting it into 4k entries.
+ * *order returns the order of the entry written.
+ */
 int p2m_set_altp2m_mem_access(struct domain *d, struct p2m_domain *hp2m,
                               struct p2m_domain *ap2m, p2m_access_t a,
-                              gfn_t gfn)
+                              gfn_t gfn, unsigned long nr, unsigned int *order)
 {
     mfn_t mfn;
     p2m_type_t t;
@@ -247,7 +261,9 @@ int p2m_set_altp2m_mem_access(struct domain *d, struct p2m_domain *hp2m,
     unsigned long gfn_l = gfn_x(gfn);
     int rc;
 
-    mfn = ap2m->get_entry(ap2m, gfn_l, &t, &old_a, 0, NULL, NULL);
+    *order = PAGE_ORDER_4K;
+
+    mfn = ap2m->get_entry(ap2m, gfn_l, &t, &old_a, 0, &page_order, NULL);
 
     /* Check host p2m if no valid entry in alternate */
     if ( !mfn_valid(mfn) )
@@ -260,8 +276,9 @@ int p2m_set_altp2m_mem_access(struct domain *d, struct p2m_domain *hp2m,
         if ( !mfn_valid(mfn) || t != p2m_ram_rw )
             return rc;
 
-        /* If this is a superpage, copy that first */
-        if ( page_order != PAGE_ORDER_4K )
+        /* If this is a superpage only partly covered, copy that first */
+        if ( page_order != PAGE_ORDER_4K &&
+             !range_covers_entry(gfn_l, nr, page_order) )
         {
             unsigned long mask = ~((1UL << page_order) - 1);
             unsigned long gfn2_l = gfn_l & mask;
@@ -273,19 +290,44 @@ int p2m_set_altp2m_mem_access(struct domain *d, struct p2m_domain *hp2m,
         }
     }
 
-    return ap2m->set_entry(ap2m, gfn_l, mfn, PAGE_ORDER_4K, t, a,
+    if ( range_covers_entry(gfn_l, nr, page_order) )
+        *order = page_order;
+
+    return ap2m->set_entry(ap2m, gfn_l, mfn, *order, t, a,
                          (current->domain != d));
 }
 
+/*
+ * Set the access of gfn, and of as many of the following nr - 1 gfns as
+ * can be done at once: those in the same last-level table when the p2m
+ * can update them in place, or those sharing gfn's superpage mapping.
+ * *done returns how many gfns were set.
+ */
 static int set_mem_access(struct domain *d, struct p2m_domain *p2m,
                           struct p2m_domain *ap2m, p2m_access_t a,
-                          gfn_t gfn)
+                          gfn_t gfn, unsigned long nr, unsigned long *done)
 {
+    struct p2m_domain *target = ap2m ?: p2m;
+    unsigned int order = PAGE_ORDER_4K;
     int rc = 0;
 
+    if ( nr > 1 && target->set_access_range )
+    {
+        long n = target->set_access_range(target, gfn_x(gfn), nr, a,
+                                          ap2m ? (current->domain != d) : -1);
+
+        if ( n < 0 )
+            return n;
+        if ( n > 0 )
+        {
+            *done = n;
+            return 0;
+        }
+    }
+
     if ( ap2m )
     {
-        rc = p2m_set_altp2m_mem_access(d, p2m, ap2m, a, gfn);
+        rc = p2m_set_altp2m_mem_access(d, p2m, ap2m, a, gfn, nr, &order);
         /* If the corresponding mfn is invalid we will want to just skip it */
         if ( rc == -ESRCH )
             rc = 0;
@@ -295,12 +337,17 @@ static int set_mem_access(struct domain *d, struct p2m_domain *p2m,
         mfn_t mfn;
         p2m_access_t _a;
         p2m_type_t t;
+        unsigned int page_order;
         unsigned long gfn_l = gfn_x(gfn);
 
-        mfn = p2m->get_entry(p2m, gfn_l, &t, &_a, 0, NULL, NULL);
-        rc = p2m->set_entry(p2m, gfn_l, mfn, PAGE_ORDER_4K, t, a, -1);
+        mfn = p2m->get_entry(p2m, gfn_l, &t, &_a, 0, &page_order, NULL);
+        if ( mfn_valid(mfn) && range_covers_entry(gfn_l, nr, page_order) )
+            order = page_order;
+        rc = p2m->set_entry(p2m, gfn_l, mfn, order, t, a, -1);
     }
 
+    *done = 1UL << order;
+
     return rc;
 }
 
@@ -349,6 +396,7 @@ long p2m_set_mem_access(struct domain *d, gfn_t gfn, uint32_t nr,
     struct p2m_domain *p2m = p2m_get_hostp2m(d), *ap2m = NULL;
     p2m_access_t a;
     unsigned long gfn_l;
+    bool preempt = false;
     long rc = 0;
 
     /* altp2m view 0 is treated as the hostp2m */
@@ -375,15 +423,30 @@ long p2m_set_mem_access(struct domain *d, gfn_t gfn, uint32_t nr,
     if ( ap2m )
         p2m_lock(ap2m);
 
-    for ( gfn_l = gfn_x(gfn) + start; nr > start; ++gfn_l )
+    for ( gfn_l = gfn_x(gfn) + start; nr > start; )
     {
-        rc = set_mem_access(d, p2m, ap2m, a, _gfn(gfn_l));
+        uint32_t prev = start;
+        unsigned long done;
+
+        rc = set_mem_access(d, p2m, ap2m, a, _gfn(gfn_l),
+                            preempt ? 1 : nr - start, &done);
 
         if ( rc )
             break;
 
-        /* Check for continuation if it's not the last iteration. */
-        if ( nr > ++start && !(start & mask) && hypercall_preempt_check() )
+        gfn_l += done;
+        start += done;
+
+        /*
+         * Check for continuation if it's not the last iteration, each time
+         * start crosses a multiple of mask + 1.  Larger steps may go past
+         * those, but a continuation can only resume at one, so once
+         * preempted carry on a gfn at a time until the next.
+         */
+        if ( !preempt && nr > start && ((start ^ prev) & ~mask) )
+            preempt = hypercall_preempt_check();
+
+        if ( preempt && nr > start && !(start & mask) )
         {
             rc = start;
             break;
@@ -423,8 +486,9 @@ long p2m_set_mem_access_multi(struct domain *d,
     while ( start < nr )
     {
         p2m_access_t a;
-        uint8_t access;
-        uint64_t gfn_l;
+        uint8_t access, next_access;
+        uint64_t gfn_l, next_gfn;
+        unsigned long run, done;
 
         if ( copy_from_guest_offset(&gfn_l, pfn_list, start, 1) ||
              copy_from_guest_offset(&access, access_list, start, 1) )
@@ -439,13 +503,38 @@ long p2m_set_mem_access_multi(struct domain *d,
             break;
         }
 
-        rc = set_mem_access(d, p2m, ap2m, a, _gfn(gfn_l));
+        /*
+         * Consecutive gfns given the same access are set as one range, up
+         * to the next point a continuation could resume from.
+         */
+        for ( run = 1; start + run < nr && ((start + run) & mask); run++ )
+        {
+            if ( copy_from_guest_offset(&next_gfn, pfn_list, start + run, 1) ||
+                 copy_from_guest_offset(&next_access, access_list,
+                                        start + run, 1) )
+            {
+                rc = -EFAULT;
+                break;
+            }
+            if ( next_gfn != gfn_l + run || next_access != access )
+                break;
+        }
+        if ( rc )
+            break;
+
+        for ( done = 0; run; gfn_l += done, run -= done )
+        {
+            rc = set_mem_access(d, p2m, ap2m, a, _gfn(gfn_l), run, &done);
+            if ( rc )
+                break;
+            start += done;
+        }
 
         if ( rc )
             break;
 
         /* Check for continuation if it's not the last iteration. */
-        if ( nr > ++start && !(start & mask) && hypercall_preempt_check() )
+        if ( nr > start && !(start & mask) && hypercall_preempt_check() )
         {
             rc = start;
             break;
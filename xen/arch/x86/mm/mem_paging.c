@@ -21,9 +21,50 @@
 
 
 #include <asm/p2m.h>
+#include <xen/event.h>
 #include <xen/guest_access.h>
 #include <xsm/xsm.h>
 
+/*
+ * Do a batch op, so that the pager can evict or load many pages for one
+ * hypercall.  Preemptible: progress is recorded in mbo->done.
+ */
+static int paging_batch(struct domain *d, xen_mem_paging_batch_op_t *mbo)
+{
+    xen_mem_paging_batch_entry_t e;
+    int rc = 0;
+
+    if ( mbo->_pad || mbo->done > mbo->nr )
+        return -EINVAL;
+
+    while ( mbo->done < mbo->nr )
+    {
+        if ( copy_from_guest_offset(&e, mbo->entries, mbo->done, 1) )
+            return -EFAULT;
+
+        if ( e._pad )
+            e.rc = -EINVAL;
+        else if ( mbo->op == XENMEM_paging_op_nominate_batch )
+            e.rc = p2m_mem_paging_nominate(d, e.gfn);
+        else if ( mbo->op == XENMEM_paging_op_evict_batch )
+            e.rc = p2m_mem_paging_evict(d, e.gfn);
+        else
+            e.rc = p2m_mem_paging_prep(d, e.gfn, e.buffer);
+
+        if ( copy_to_guest_offset(mbo->entries, mbo->done, &e, 1) )
+            return -EFAULT;
+
+        /* Check for continuation if it's not the last iteration. */
+        if ( ++mbo->done < mbo->nr && hypercall_preempt_check() )
+        {
+            rc = 1;
+            break;
+        }
+    }
+
+    return rc;
+}
+
 int mem_paging_memop(XEN_GUEST_HANDLE_PARAM(xen_mem_paging_op_t) arg)
 {
     int rc;
@@ -62,6 +103,33 @@ int mem_paging_memop(XEN_GUEST_HANDLE_PARAM(xen_mem_paging_op_t) arg)
             copyback = 1;
         break;
 
+    case XENMEM_paging_op_nominate_batch:
+    case XENMEM_paging_op_evict_batch:
+    case XENMEM_paging_op_prep_batch:
+    {
+        XEN_GUEST_HANDLE_PARAM(xen_mem_paging_batch_op_t) batch_arg =
+            guest_handle_cast(guest_handle_cast(arg, void),
+                              xen_mem_paging_batch_op_t);
+        xen_mem_paging_batch_op_t mbo;
+
+        BUILD_BUG_ON(sizeof(mbo) != sizeof(mpo));
+        rc = -EFAULT;
+        if ( copy_from_guest(&mbo, batch_arg, 1) )
+            break;
+
+        rc = paging_batch(d, &mbo);
+        if ( rc > 0 )
+        {
+            if ( __copy_to_guest(batch_arg, &mbo, 1) )
+                rc = -EFAULT;
+            else
+                rc = hypercall_create_continuation(__HYPERVISOR_memory_op,
+                                                   "lh", XENMEM_paging_op,
+                                                   arg);
+        }
+        break;
+    }
+
     default:
         rc = -ENOSYS;
         break;
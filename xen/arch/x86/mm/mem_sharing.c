@@ -1098,6 +1098,124 @@ err_out:
  *     4.3. do not corrupt guest memory
  *     4.4. let the guest deal with it if the error propagation will reach it
  */
+/*
+ * Each domain can keep a pool of pages for breaking sharing, so that a
+ * write to a shared page need not wait for the heap allocator, nor fail
+ * while memory is tight.  The pages have no owner until they are handed
+ * to the domain, and are refilled from a tasklet.  They need no scrubbing
+ * as the contents of the shared page are copied over them.
+ */
+#define UNSHARE_POOL_BATCH 64
+
+static void unshare_pool_refill(unsigned long data)
+{
+    struct domain *d = (struct domain *)data;
+    struct hvm_domain *hd = &d->arch.hvm_domain;
+    struct page_info *pg;
+    unsigned int i;
+
+    for ( i = 0; i < UNSHARE_POOL_BATCH; i++ )
+    {
+        if ( read_atomic(&hd->unshare_pool.count) >=
+             read_atomic(&hd->unshare_pool.target) )
+            return;
+
+        /* On failure, try again on the next unshare. */
+        pg = alloc_domheap_page(d, MEMF_no_owner);
+        if ( !pg )
+            return;
+
+        spin_lock(&hd->unshare_pool.lock);
+        if ( hd->unshare_pool.count < hd->unshare_pool.target )
+        {
+            page_list_add(pg, &hd->unshare_pool.pages);
+            hd->unshare_pool.count++;
+            pg = NULL;
+        }
+        spin_unlock(&hd->unshare_pool.lock);
+
+        if ( pg )
+        {
+            free_domheap_page(pg);
+            return;
+        }
+    }
+
+    tasklet_schedule(&hd->unshare_pool.refill);
+}
+
+/* Shrink the pool to its target. */
+static void unshare_pool_trim(struct domain *d)
+{
+    struct hvm_domain *hd = &d->arch.hvm_domain;
+    struct page_info *pg;
+
+    for ( ; ; )
+    {
+        spin_lock(&hd->unshare_pool.lock);
+        pg = NULL;
+        if ( hd->unshare_pool.count > hd->unshare_pool.target )
+        {
+            pg = page_list_remove_head(&hd->unshare_pool.pages);
+            hd->unshare_pool.count--;
+        }
+        spin_unlock(&hd->unshare_pool.lock);
+
+        if ( !pg )
+            break;
+        free_domheap_page(pg);
+    }
+}
+
+/* A page for d to break sharing with, from the pool if possible. */
+static struct page_info *unshare_alloc_page(struct domain *d)
+{
+    struct hvm_domain *hd = &d->arch.hvm_domain;
+    struct page_info *pg;
+
+    if ( !read_atomic(&hd->unshare_pool.target) )
+        return alloc_domheap_page(d, 0);
+
+    spin_lock(&hd->unshare_pool.lock);
+    pg = page_list_remove_head(&hd->unshare_pool.pages);
+    if ( pg )
+        hd->unshare_pool.count--;
+    spin_unlock(&hd->unshare_pool.lock);
+
+    tasklet_schedule(&hd->unshare_pool.refill);
+
+    if ( !pg )
+        return alloc_domheap_page(d, 0);
+
+    /* As for the heap, the domain must not grow past max_pages. */
+    if ( assign_pages(d, pg, 0, 0) )
+    {
+        free_domheap_page(pg);
+        return NULL;
+    }
+
+    return pg;
+}
+
+void mem_sharing_domain_init(struct domain *d)
+{
+    struct hvm_domain *hd = &d->arch.hvm_domain;
+
+    spin_lock_init(&hd->unshare_pool.lock);
+    INIT_PAGE_LIST_HEAD(&hd->unshare_pool.pages);
+    tasklet_init(&hd->unshare_pool.refill, unshare_pool_refill,
+                 (unsigned long)d);
+}
+
+void mem_sharing_domain_relinquish(struct domain *d)
+{
+    struct hvm_domain *hd = &d->arch.hvm_domain;
+
+    write_atomic(&hd->unshare_pool.target, 0);
+    tasklet_kill(&hd->unshare_pool.refill);
+    unshare_pool_trim(d);
+}
+
 int __mem_sharing_unshare_page(struct domain *d,
                              unsigned long gfn, 
                              uint16_t flags)
@@ -1172,7 +1290,7 @@ int __mem_sharing_unshare_page(struct domain *d,
     }
 
     old_page = page;
-    page = alloc_domheap_page(d, 0);
+    page = unshare_alloc_page(d);
     if ( !page ) 
     {
         /* Undo dec of nr_saved_mfns, as the retry will decrease again. */
@@ -1319,6 +1437,156 @@ static int range_share(struct domain *d, struct domain *cd,
     return rc;
 }
 
+/*
+ * Populate the physmap of cd with the pages of d over the range, sharing
+ * each of them.  gfns which cannot be shared in d, or which are not holes
+ * in cd, are skipped: they are for the caller to fill in (typically they
+ * are special pages which the fork should get fresh copies of anyway).
+ */
+static int range_fork(struct domain *d, struct domain *cd,
+                      struct mem_sharing_op_range *range)
+{
+    int rc = 0;
+    shr_handle_t sh;
+    unsigned long start = range->opaque ?: range->first_gfn;
+
+    while ( range->last_gfn >= start )
+    {
+        rc = nominate_page(d, _gfn(start), 0, &sh);
+        if ( rc == -ENOMEM )
+            break;
+
+        if ( !rc )
+        {
+            rc = mem_sharing_add_to_physmap(d, start, sh, cd, start);
+            if ( rc == -ENOMEM )
+                break;
+        }
+
+        /* Check for continuation if it's not the last iteration. */
+        if ( range->last_gfn >= ++start && hypercall_preempt_check() )
+        {
+            rc = 1;
+            break;
+        }
+    }
+
+    range->opaque = start;
+
+    /* As for range_share(), individual pages may legitimately fail. */
+    if ( range->last_gfn < start && rc < 0 && rc != -ENOMEM )
+        rc = 0;
+
+    return rc;
+}
+
+/* Point *cd at the client domain of a batch entry, checked as for a share. */
+static int batch_client(struct domain *d, domid_t domid, struct domain **cd)
+{
+    struct domain *c;
+    int rc;
+
+    if ( *cd && (*cd)->domain_id == domid )
+        return 0;
+
+    if ( *cd )
+    {
+        rcu_unlock_domain(*cd);
+        *cd = NULL;
+    }
+
+    rc = rcu_lock_live_remote_domain_by_id(domid, &c);
+    if ( rc )
+        return rc;
+
+    rc = xsm_mem_sharing_op(XSM_DM_PRIV, d, c, XENMEM_sharing_op_share);
+    if ( !rc && !mem_sharing_enabled(c) )
+        rc = -EINVAL;
+    if ( rc )
+    {
+        rcu_unlock_domain(c);
+        return rc;
+    }
+
+    *cd = c;
+    return 0;
+}
+
+/*
+ * Nominate or share the pages of a list of entries, so that a scanner
+ * can hand over a whole batch of candidates in one hypercall.  Each
+ * entry gets its own result; only a failure to access the list fails
+ * the op.
+ */
+static int sharing_batch(struct domain *d, xen_mem_sharing_op_t *mso)
+{
+    struct mem_sharing_op_batch *batch = &mso->u.batch;
+    xen_mem_sharing_batch_entry_t e;
+    struct domain *cd = NULL;
+    shr_handle_t sh, ch;
+    int rc = 0;
+
+    if ( batch->done > batch->nr )
+        return -EINVAL;
+
+    while ( batch->done < batch->nr )
+    {
+        if ( copy_from_guest_offset(&e, batch->entries, batch->done, 1) )
+        {
+            rc = -EFAULT;
+            break;
+        }
+
+        e.rc = e._pad ? -EINVAL : batch_client(d, e.client_domain, &cd);
+        if ( !e.rc && mso->op == XENMEM_sharing_op_nominate_batch )
+        {
+            e.rc = nominate_page(d, _gfn(e.source_gfn), 0, &sh);
+            e.source_handle = sh;
+            e.client_handle = 0;
+            if ( !e.rc )
+            {
+                e.rc = nominate_page(cd, _gfn(e.client_gfn), 0, &ch);
+                e.client_handle = ch;
+            }
+        }
+        else if ( !e.rc )
+        {
+            /* Handles are never 0: such an entry is nominated first. */
+            if ( !e.source_handle )
+            {
+                e.rc = nominate_page(d, _gfn(e.source_gfn), 0, &sh);
+                e.source_handle = sh;
+            }
+            if ( !e.rc && !e.client_handle )
+            {
+                e.rc = nominate_page(cd, _gfn(e.client_gfn), 0, &ch);
+                e.client_handle = ch;
+            }
+            if ( !e.rc )
+                e.rc = share_pages(d, _gfn(e.source_gfn), e.source_handle,
+                                   cd, _gfn(e.client_gfn), e.client_handle);
+        }
+
+        if ( copy_to_guest_offset(batch->entries, batch->done, &e, 1) )
+        {
+            rc = -EFAULT;
+            break;
+        }
+
+        /* Check for continuation if it's not the last iteration. */
+        if ( ++batch->done < batch->nr && hypercall_preempt_check() )
+        {
+            rc = 1;
+            break;
+        }
+    }
+
+    if ( cd )
+        rcu_unlock_domain(cd);
+
+    return rc;
+}
+
 int mem_sharing_memop(XEN_GUEST_HANDLE_PARAM(xen_mem_sharing_op_t) arg)
 {
     int rc;
@@ -1496,6 +1764,7 @@ int mem_sharing_memop(XEN_GUEST_HANDLE_PARAM(xen_mem_sharing_op_t) arg)
         break;
 
         case XENMEM_sharing_op_range_share:
+        case XENMEM_sharing_op_range_fork:
         {
             unsigned long max_sgfn, max_cgfn;
             struct domain *cd;
@@ -1558,17 +1827,22 @@ int mem_sharing_memop(XEN_GUEST_HANDLE_PARAM(xen_mem_sharing_op_t) arg)
             max_sgfn = domain_get_maximum_gpfn(d);
             max_cgfn = domain_get_maximum_gpfn(cd);
 
+            /* A fork target is expected to start out (mostly) empty. */
             if ( max_sgfn < mso.u.range.first_gfn ||
                  max_sgfn < mso.u.range.last_gfn ||
-                 max_cgfn < mso.u.range.first_gfn ||
-                 max_cgfn < mso.u.range.last_gfn )
+                 (mso.op == XENMEM_sharing_op_range_share &&
+                  (max_cgfn < mso.u.range.first_gfn ||
+                   max_cgfn < mso.u.range.last_gfn)) )
             {
                 rcu_unlock_domain(cd);
                 rc = -EINVAL;
                 goto out;
             }
 
-            rc = range_share(d, cd, &mso.u.range);
+            if ( mso.op == XENMEM_sharing_op_range_fork )
+                rc = range_fork(d, cd, &mso.u.range);
+            else
+                rc = range_share(d, cd, &mso.u.range);
             rcu_unlock_domain(cd);
 
             if ( rc > 0 )
@@ -1585,6 +1859,30 @@ int mem_sharing_memop(XEN_GUEST_HANDLE_PARAM(xen_mem_sharing_op_t) arg)
         }
         break;
 
+        case XENMEM_sharing_op_nominate_batch:
+        case XENMEM_sharing_op_share_batch:
+        {
+            rc = -EINVAL;
+            if ( !mem_sharing_enabled(d) )
+                goto out;
+
+            /* done is the hypercall continuation value, as opaque above. */
+            rc = sharing_batch(d, &mso);
+
+            if ( rc > 0 )
+            {
+                if ( __copy_to_guest(arg, &mso, 1) )
+                    rc = -EFAULT;
+                else
+                    rc = hypercall_create_continuation(__HYPERVISOR_memory_op,
+                                                       "lh", XENMEM_sharing_op,
+                                                       arg);
+            }
+            else
+                mso.u.batch.done = 0;
+        }
+        break;
+
         case XENMEM_sharing_op_debug_gfn:
             rc = debug_gfn(d, _gfn(mso.u.debug.u.gfn));
             break;
@@ -1626,6 +1924,23 @@ int mem_sharing_domctl(struct domain *d, xen_domctl_mem_sharing_op_t *mec)
         }
         break;
 
+        case XEN_DOMCTL_MEM_SHARING_POOL:
+        {
+            struct hvm_domain *hd = &d->arch.hvm_domain;
+
+            /* The pool is not accounted to the domain, so bound it. */
+            rc = -EINVAL;
+            if ( d->is_dying || mec->u.pool.target > d->max_pages )
+                break;
+
+            rc = 0;
+            write_atomic(&hd->unshare_pool.target, mec->u.pool.target);
+            unshare_pool_trim(d);
+            tasklet_schedule(&hd->unshare_pool.refill);
+            mec->u.pool.count = read_atomic(&hd->unshare_pool.count);
+        }
+        break;
+
         default:
             rc = -ENOSYS;
     }
@@ -17,11 +17,13 @@
 
 #include <xen/domain_page.h>
 #include <xen/sched.h>
+#include <xen/sched-if.h>
 #include <asm/current.h>
 #include <asm/paging.h>
 #include <asm/types.h>
 #include <asm/domain.h>
 #include <asm/p2m.h>
+#include <asm/altp2m.h>
 #include <asm/hvm/vmx/vmx.h>
 #include <asm/hvm/vmx/vmcs.h>
 #include <asm/hvm/nestedhvm.h>
@@ -866,30 +868,10 @@ out:
     {
         if ( iommu_hap_pt_share )
             rc = iommu_pte_flush(d, gfn, &ept_entry->epte, order, vtd_pte_present);
+        else if ( iommu_flags )
+            rc = iommu_map_pages(d, gfn, mfn_x(mfn), order, iommu_flags);
         else
-        {
-            if ( iommu_flags )
-                for ( i = 0; i < (1 << order); i++ )
-                {
-                    rc = iommu_map_page(d, gfn + i, mfn_x(mfn) + i, iommu_flags);
-                    if ( unlikely(rc) )
-                    {
-                        while ( i-- )
-                            /* If statement to satisfy __must_check. */
-                            if ( iommu_unmap_page(p2m->domain, gfn + i) )
-                                continue;
-
-                        break;
-                    }
-                }
-            else
-                for ( i = 0; i < (1 << order); i++ )
-                {
-                    ret = iommu_unmap_page(d, gfn + i);
-                    if ( !rc )
-                        rc = ret;
-                }
-        }
+            rc = iommu_unmap_pages(d, gfn, order);
     }
 
     unmap_domain_page(table);
@@ -1069,6 +1051,90 @@ out:
     return;
 }
 
+/*
+ * Set the access of the nr gfns from gfn directly in the last-level table
+ * holding gfn, stopping at its end: one walk, and with the p2m lock held
+ * one flush, for up to 512 entries.  Superpages, entries pending a type
+ * recalculation and, in alternate views, entries not copied from the host
+ * p2m yet are left to ept_set_entry(), as are all changes to a host p2m
+ * that has to propagate them to its views.
+ */
+static long ept_set_access_range(struct p2m_domain *p2m, unsigned long gfn,
+                                 unsigned long nr, p2m_access_t p2ma,
+                                 int sve)
+{
+    ept_entry_t *table;
+    unsigned long gfn_remainder = gfn;
+    unsigned int i, end;
+    bool_t changed = 0;
+    long done = 0;
+    int rc;
+
+    ASSERT(p2m_locked_by_me(p2m));
+
+    if ( p2m_is_hostp2m(p2m) && altp2m_active(p2m->domain) )
+        return 0;
+
+    if ( gfn > p2m->max_mapped_pfn ||
+         ((u64)gfn >> ((p2m->ept.wl + 1) * EPT_TABLE_ORDER)) )
+        return 0;
+
+    /* Carry out any eventually pending earlier changes first. */
+    rc = resolve_misconfig(p2m, gfn);
+    if ( rc < 0 )
+        return rc;
+
+    table = map_domain_page(_mfn(pagetable_get_pfn(p2m_get_pagetable(p2m))));
+
+    for ( i = p2m->ept.wl; i > 0; i-- )
+    {
+        if ( table[gfn_remainder >> (i * EPT_TABLE_ORDER)].recalc ||
+             ept_next_level(p2m, 1, &table, &gfn_remainder, i) !=
+             GUEST_TABLE_NORMAL_PAGE )
+            goto out;
+    }
+
+    i = gfn_remainder;
+    end = min_t(unsigned long, EPT_PAGETABLE_ENTRIES, i + nr);
+
+    for ( ; i < end; i++, done++ )
+    {
+        ept_entry_t e = atomic_read_ept_entry(&table[i]), new_entry;
+
+        if ( !is_epte_valid(&e) )
+        {
+            /* ept_set_entry() would leave such an entry empty. */
+            if ( p2m_is_hostp2m(p2m) )
+                continue;
+            break;
+        }
+
+        if ( e.recalc )
+            break;
+
+        new_entry = e;
+        new_entry.access = p2ma;
+        ept_p2m_type_to_flags(p2m, &new_entry, e.sa_p2mt, p2ma);
+        if ( sve != -1 )
+            new_entry.suppress_ve = !!sve;
+
+        if ( new_entry.epte == e.epte )
+            continue;
+
+        rc = atomic_write_ept_entry(&table[i], new_entry, 0);
+        ASSERT(rc == 0);
+        changed = 1;
+    }
+
+ out:
+    unmap_domain_page(table);
+
+    if ( changed )
+        ept_sync_domain(p2m);
+
+    return done;
+}
+
 static void ept_change_entry_type_global(struct p2m_domain *p2m,
                                          p2m_type_t ot, p2m_type_t nt)
 {
@@ -1219,8 +1285,8 @@ static void ept_disable_pml(struct p2m_domain *p2m)
 
     vmx_domain_disable_pml(p2m->domain);
 
-    /* Disable EPT A/D bit */
-    p2m->ept.ad = 0;
+    /* Disable EPT A/D bit, unless NUMA balancing still needs it */
+    p2m->ept.ad = p2m->ept.balance;
     vmx_domain_update_eptp(p2m->domain);
 }
 
@@ -1232,6 +1298,391 @@ static void ept_flush_pml_buffers(struct p2m_domain *p2m)
     vmx_domain_flush_pml_buffers(p2m->domain);
 }
 
+/*
+ * Rebuilding of superpages.
+ *
+ * Splitting a superpage, to restrict access to part of it or to replace or
+ * remove some of its pages, is never undone by ept_set_entry(), so the
+ * mappings of long running guests only get more fragmented.  With
+ * "ept=coalesce", a tasklet scans part of the host p2m every
+ * EPT_COALESCE_PERIOD, and replaces each table whose entries map
+ * contiguous, suitably aligned RAM with identical type, access and memory
+ * type by a single superpage entry.
+ */
+#define EPT_COALESCE_PERIOD  MILLISECS(1000)
+#define EPT_COALESCE_BUDGET  512    /* 2M ranges looked at per period */
+
+/* Try to turn the table behind the level entry mapping gfn into a leaf. */
+static bool_t ept_coalesce_entry(struct p2m_domain *p2m, unsigned long gfn,
+                                 unsigned int level)
+{
+    ept_entry_t *table, *child, *ept_entry, e, first, new_entry;
+    unsigned long gfn_remainder = gfn;
+    unsigned int i, child_order = (level - 1) * EPT_TABLE_ORDER;
+    uint8_t ipat = 0;
+    bool_t merged = 0;
+    int rc;
+
+    table = map_domain_page(_mfn(pagetable_get_pfn(p2m_get_pagetable(p2m))));
+
+    for ( i = p2m->ept.wl; i > level; i-- )
+        if ( ept_next_level(p2m, 1, &table, &gfn_remainder, i) !=
+             GUEST_TABLE_NORMAL_PAGE )
+            goto out;
+
+    ept_entry = table + (gfn_remainder >> (level * EPT_TABLE_ORDER));
+    e = atomic_read_ept_entry(ept_entry);
+    if ( !is_epte_present(&e) || is_epte_superpage(&e) ||
+         e.emt == MTRR_NUM_TYPES || e.recalc )
+        goto out;
+
+    child = map_domain_page(_mfn(e.mfn));
+
+    first = atomic_read_ept_entry(&child[0]);
+    if ( !is_epte_present(&first) || first.sa_p2mt != p2m_ram_rw ||
+         first.emt == MTRR_NUM_TYPES || first.recalc ||
+         (first.mfn & ((1UL << (level * EPT_TABLE_ORDER)) - 1)) ||
+         (level > 1 && !is_epte_superpage(&first)) )
+        goto unmap;
+
+    /* All entries must match the first but for the frame and A/D bits. */
+    for ( i = 1; i < EPT_PAGETABLE_ENTRIES; i++ )
+    {
+        ept_entry_t a = atomic_read_ept_entry(&child[i]), b = first;
+
+        if ( a.mfn != first.mfn + ((unsigned long)i << child_order) )
+            goto unmap;
+        a.mfn = b.mfn = 0;
+        a.a = a.d = b.a = b.d = 0;
+        if ( a.epte != b.epte )
+            goto unmap;
+    }
+
+    /* The memory type has to be uniform over the whole range. */
+    if ( epte_get_entry_emt(p2m->domain, gfn, _mfn(first.mfn),
+                            level * EPT_TABLE_ORDER, &ipat, 0) != first.emt ||
+         ipat != first.ipat )
+        goto unmap;
+
+    new_entry = first;
+    new_entry.sp = 1;
+    ept_p2m_type_to_flags(p2m, &new_entry, first.sa_p2mt, first.access);
+
+    unmap_domain_page(child);
+
+    rc = atomic_write_ept_entry(ept_entry, new_entry, level);
+    ASSERT(rc == 0);
+    ept_sync_domain(p2m);
+
+    /* Flushes the TLBs again before handing the table back. */
+    ept_free_entry(p2m, &e, level);
+    merged = 1;
+    goto out;
+
+ unmap:
+    unmap_domain_page(child);
+ out:
+    unmap_domain_page(table);
+    return merged;
+}
+
+static void ept_coalesce(unsigned long data)
+{
+    struct p2m_domain *p2m = (struct p2m_domain *)data;
+    struct ept_data *ept = &p2m->ept;
+    struct domain *d = p2m->domain;
+    unsigned long gfn = ept->coalesce_gfn;
+    unsigned int budget = EPT_COALESCE_BUDGET;
+
+    if ( !p2m_is_hostp2m(p2m) )
+        return;
+
+    p2m_lock(p2m);
+
+    if ( d->is_dying )
+    {
+        p2m_unlock(p2m);
+        return;
+    }
+
+    /*
+     * Shared IOMMU tables would need flushing as well, and log-dirty mode
+     * is going to split what gets merged again.
+     */
+    if ( hap_has_2mb && !need_iommu(d) && !paging_mode_log_dirty(d) )
+    {
+        while ( budget-- )
+        {
+            if ( gfn > p2m->max_mapped_pfn )
+            {
+                gfn = 0;
+                break;
+            }
+
+            if ( ept_coalesce_entry(p2m, gfn, 1) )
+                ept->coalesced_2m++;
+            gfn += 1UL << EPT_TABLE_ORDER;
+
+            /* Once past a 1G range, see whether it can be merged too. */
+            if ( hap_has_1gb &&
+                 !(gfn & ((1UL << (2 * EPT_TABLE_ORDER)) - 1)) &&
+                 ept_coalesce_entry(p2m,
+                                    gfn - (1UL << (2 * EPT_TABLE_ORDER)), 2) )
+                ept->coalesced_1g++;
+        }
+        ept->coalesce_gfn = gfn;
+    }
+
+    p2m_unlock(p2m);
+
+    set_timer(&ept->coalesce_timer, NOW() + EPT_COALESCE_PERIOD);
+}
+
+static void ept_coalesce_timer_fn(void *data)
+{
+    struct p2m_domain *p2m = data;
+
+    tasklet_schedule(&p2m->ept.coalesce_tasklet);
+}
+
+/*
+ * NUMA balancing.
+ *
+ * Once enabled for a domain, a tasklet samples which of its memory gets
+ * used: every EPT_BALANCE_PERIOD it looks at EPT_BALANCE_BUDGET 2M ranges
+ * of the host p2m, and clears the accessed bit of each RAM leaf entry,
+ * counting the pages behind those which had it set against their node.
+ * At the end of a full pass, if one node holds most of what was accessed
+ * during it, the vCPUs' soft affinity gets set to that node's CPUs.  The
+ * domain's memory then gets allocated there too, and with what was
+ * accessed already being there, the vCPUs and their working set get back
+ * together.  This keeps overriding soft affinity set by the toolstack.
+ */
+#define EPT_BALANCE_PERIOD   MILLISECS(100)
+#define EPT_BALANCE_BUDGET   64     /* 2M ranges looked at per period */
+
+static void ept_sample_entry(ept_entry_t *e, unsigned int order,
+                             unsigned long *accessed)
+{
+    if ( !is_epte_present(e) || !p2m_is_ram(e->sa_p2mt) ||
+         !mfn_valid(_mfn(e->mfn)) )
+        return;
+
+    /* Bit 8 is the accessed bit, set by the CPU as it walks the tables. */
+    if ( test_and_clear_bit(8, &e->epte) )
+        accessed[phys_to_nid(pfn_to_paddr(e->mfn))] += 1UL << order;
+}
+
+/* Sample the 2M range starting at gfn. */
+static void ept_sample_range(struct p2m_domain *p2m, unsigned long gfn,
+                             unsigned long *accessed)
+{
+    ept_entry_t *table, *ept_entry, *child;
+    unsigned long gfn_remainder = gfn;
+    unsigned int i;
+    int ret = GUEST_TABLE_NORMAL_PAGE;
+
+    table = map_domain_page(_mfn(pagetable_get_pfn(p2m_get_pagetable(p2m))));
+
+    for ( i = p2m->ept.wl; i > 1; i-- )
+    {
+        ret = ept_next_level(p2m, 1, &table, &gfn_remainder, i);
+        if ( ret != GUEST_TABLE_NORMAL_PAGE )
+            break;
+    }
+
+    ept_entry = table + (gfn_remainder >> (i * EPT_TABLE_ORDER));
+
+    if ( ret == GUEST_TABLE_SUPER_PAGE )
+    {
+        /* A 1G page gets accounted for once, at its first 2M range. */
+        if ( i == 2 && !(gfn & ((1UL << (2 * EPT_TABLE_ORDER)) - 1)) )
+            ept_sample_entry(ept_entry, 2 * EPT_TABLE_ORDER, accessed);
+    }
+    else if ( ret == GUEST_TABLE_NORMAL_PAGE && is_epte_present(ept_entry) )
+    {
+        if ( is_epte_superpage(ept_entry) )
+            ept_sample_entry(ept_entry, EPT_TABLE_ORDER, accessed);
+        else
+        {
+            child = map_domain_page(_mfn(ept_entry->mfn));
+            for ( i = 0; i < EPT_PAGETABLE_ENTRIES; i++ )
+                ept_sample_entry(&child[i], PAGE_ORDER_4K, accessed);
+            unmap_domain_page(child);
+        }
+    }
+
+    unmap_domain_page(table);
+}
+
+/*
+ * A full pass is over.  Returns the node to steer the vCPUs to, or
+ * NUMA_NO_NODE.
+ */
+static unsigned int ept_balance_pass_done(struct ept_data *ept)
+{
+    unsigned long total = 0, best_accessed = 0;
+    unsigned int node, best = NUMA_NO_NODE;
+
+    for_each_online_node ( node )
+    {
+        total += ept->balance_accessed[node];
+        if ( ept->balance_accessed[node] > best_accessed )
+        {
+            best_accessed = ept->balance_accessed[node];
+            best = node;
+        }
+    }
+    memset(ept->balance_accessed, 0,
+           MAX_NUMNODES * sizeof(*ept->balance_accessed));
+
+    /*
+     * The first pass only clears the bits set since the entries got
+     * written.  After that, go only for a node holding most of the working
+     * set, and only once.
+     */
+    if ( ++ept->balance_passes == 1 || best == NUMA_NO_NODE ||
+         best_accessed * 2 <= total || best == ept->balance_node )
+        return NUMA_NO_NODE;
+
+    ept->balance_node = best;
+    return best;
+}
+
+static void ept_balance_steer(struct domain *d, unsigned int node)
+{
+    cpumask_t mask;
+    struct vcpu *v;
+
+    cpumask_and(&mask, &node_to_cpumask(node), cpupool_domain_cpumask(d));
+    if ( cpumask_empty(&mask) )
+        return;
+
+    printk(XENLOG_G_INFO "d%d: working set on node %u, steering vCPUs there\n",
+           d->domain_id, node);
+
+    for_each_vcpu ( d, v )
+        vcpu_set_soft_affinity(v, &mask);
+}
+
+static void ept_balance(unsigned long data)
+{
+    struct p2m_domain *p2m = (struct p2m_domain *)data;
+    struct ept_data *ept = &p2m->ept;
+    struct domain *d = p2m->domain;
+    unsigned long gfn = ept->balance_gfn;
+    unsigned int budget = EPT_BALANCE_BUDGET, node = NUMA_NO_NODE;
+
+    p2m_lock(p2m);
+
+    if ( !ept->balance || d->is_dying )
+    {
+        p2m_unlock(p2m);
+        return;
+    }
+
+    while ( budget-- )
+    {
+        if ( gfn > p2m->max_mapped_pfn )
+        {
+            gfn = 0;
+            node = ept_balance_pass_done(ept);
+            break;
+        }
+
+        ept_sample_range(p2m, gfn, ept->balance_accessed);
+        gfn += 1UL << EPT_TABLE_ORDER;
+    }
+    ept->balance_gfn = gfn;
+
+    /* Have the next accesses set the bits cleared above again. */
+    ept_sync_domain(p2m);
+
+    /* Under the lock, for ept_set_numa_balancing() to stop us. */
+    set_timer(&ept->balance_timer, NOW() + EPT_BALANCE_PERIOD);
+
+    p2m_unlock(p2m);
+
+    if ( node != NUMA_NO_NODE )
+        ept_balance_steer(d, node);
+}
+
+static void ept_balance_timer_fn(void *data)
+{
+    struct p2m_domain *p2m = data;
+
+    tasklet_schedule(&p2m->ept.balance_tasklet);
+}
+
+/* Turn the accessed bits on or off as needed by balancing and PML. */
+static void ept_update_ad(struct p2m_domain *p2m)
+{
+    struct domain *d = p2m->domain;
+
+    ASSERT(atomic_read(&d->pause_count));
+
+    p2m->ept.ad = p2m->ept.balance || vmx_domain_pml_enabled(d);
+    vmx_domain_update_eptp(d);
+}
+
+int ept_set_numa_balancing(struct p2m_domain *p2m, bool_t enable)
+{
+    struct ept_data *ept = &p2m->ept;
+    struct domain *d = p2m->domain;
+    unsigned long *accessed = NULL;
+
+    if ( !cpu_has_vmx_ept_ad || !p2m_is_hostp2m(p2m) )
+        return -EOPNOTSUPP;
+
+    if ( !enable == !ept->balance )
+        return 0;
+
+    if ( enable )
+    {
+        accessed = xzalloc_array(unsigned long, MAX_NUMNODES);
+        if ( !accessed )
+            return -ENOMEM;
+    }
+
+    domain_pause(d);
+    p2m_lock(p2m);
+
+    if ( enable )
+    {
+        ept->balance_accessed = accessed;
+        ept->balance_gfn = 0;
+        ept->balance_passes = 0;
+        ept->balance_node = NUMA_NO_NODE;
+        tasklet_init(&ept->balance_tasklet, ept_balance, (unsigned long)p2m);
+        init_timer(&ept->balance_timer, ept_balance_timer_fn, p2m,
+                   smp_processor_id());
+        set_timer(&ept->balance_timer, NOW() + EPT_BALANCE_PERIOD);
+    }
+    ept->balance = !!enable;
+    ept_update_ad(p2m);
+
+    p2m_unlock(p2m);
+    domain_unpause(d);
+
+    if ( !enable )
+    {
+        kill_timer(&ept->balance_timer);
+        tasklet_kill(&ept->balance_tasklet);
+        xfree(ept->balance_accessed);
+        ept->balance_accessed = NULL;
+    }
+
+    return 0;
+}
+
+void ept_get_numa_balancing(const struct p2m_domain *p2m, bool_t *enabled,
+                            unsigned int *node, unsigned int *passes)
+{
+    *enabled = p2m->ept.balance;
+    *node = p2m->ept.balance ? p2m->ept.balance_node : NUMA_NO_NODE;
+    *passes = p2m->ept.balance_passes;
+}
+
 int ept_p2m_init(struct p2m_domain *p2m)
 {
     struct ept_data *ept = &p2m->ept;
@@ -1240,6 +1691,7 @@ int ept_p2m_init(struct p2m_domain *p2m)
     p2m->get_entry = ept_get_entry;
     p2m->change_entry_type_global = ept_change_entry_type_global;
     p2m->change_entry_type_range = ept_change_entry_type_range;
+    p2m->set_access_range = ept_set_access_range;
     p2m->memory_type_changed = ept_memory_type_changed;
     p2m->audit_p2m = NULL;
     p2m->tlb_flush = ept_tlb_flush;
@@ -1266,12 +1718,37 @@ int ept_p2m_init(struct p2m_domain *p2m)
      */
     cpumask_setall(ept->invalidate);
 
+    if ( opt_ept_coalesce )
+    {
+        ept->coalesce_gfn = 0;
+        tasklet_init(&ept->coalesce_tasklet, ept_coalesce,
+                     (unsigned long)p2m);
+        init_timer(&ept->coalesce_timer, ept_coalesce_timer_fn, p2m,
+                   smp_processor_id());
+        set_timer(&ept->coalesce_timer, NOW() + EPT_COALESCE_PERIOD);
+    }
+
     return 0;
 }
 
 void ept_p2m_uninit(struct p2m_domain *p2m)
 {
     struct ept_data *ept = &p2m->ept;
+
+    if ( opt_ept_coalesce )
+    {
+        kill_timer(&ept->coalesce_timer);
+        tasklet_kill(&ept->coalesce_tasklet);
+    }
+
+    if ( ept->balance )
+    {
+        ept->balance = 0;
+        kill_timer(&ept->balance_timer);
+        tasklet_kill(&ept->balance_tasklet);
+        xfree(ept->balance_accessed);
+    }
+
     free_cpumask_var(ept->invalidate);
 }
 
@@ -1310,6 +1787,9 @@ static void ept_dump_p2m_table(unsigned char key)
         p2m = p2m_get_hostp2m(d);
         ept = &p2m->ept;
         printk("\ndomain%d EPT p2m table:\n", d->domain_id);
+        if ( opt_ept_coalesce )
+            printk("superpages rebuilt: %lu 2M, %lu 1G\n",
+                   ept->coalesced_2m, ept->coalesced_1g);
 
         for ( gfn = 0; gfn <= p2m->max_mapped_pfn; gfn += 1UL << order )
         {
@@ -22,6 +22,8 @@
 #include <xen/iommu.h>
 #include <xen/vm_event.h>
 #include <xen/event.h>
+#include <xen/softirq.h>
+#include <xen/tasklet.h>
 #include <public/vm_event.h>
 #include <asm/domain.h>
 #include <asm/page.h>
@@ -42,6 +44,27 @@
 
 #define superpage_aligned(_x)  (((_x)&(SUPERPAGE_PAGES-1))==0)
 
+/*
+ * Check words of a page for zero.  The words of one cache line are or-ed
+ * together before testing, so that non-zero data is found after at most
+ * one line more than necessary, but zero pages are read without a branch
+ * per word.  Note that words must be a multiple of 8.
+ */
+static bool_t pod_words_are_zero(const unsigned long *p, unsigned int words)
+{
+    unsigned int i;
+
+    for ( i = 0; i < words; i += 8 )
+        if ( p[i] | p[i + 1] | p[i + 2] | p[i + 3] |
+             p[i + 4] | p[i + 5] | p[i + 6] | p[i + 7] )
+            return 0;
+
+    return 1;
+}
+
+#define POD_QUICK_WORDS 16
+#define POD_PAGE_WORDS  (PAGE_SIZE / sizeof(unsigned long))
+
 /* Enforce lock ordering when grabbing the "external" page_alloc lock */
 static inline void lock_page_alloc(struct p2m_domain *p2m)
 {
@@ -674,7 +697,7 @@ p2m_pod_zero_check_superpage(struct p2m_domain *p2m, unsigned long gfn)
     unsigned long * map = NULL;
     int ret=0, reset = 0;
     unsigned long i, n;
-    unsigned int j;
+    bool_t zero;
     int max_ref = 1;
     struct domain *d = p2m->domain;
 
@@ -739,14 +762,10 @@ p2m_pod_zero_check_superpage(struct p2m_domain *p2m, unsigned long gfn)
     {
         /* Quick zero-check */
         map = map_domain_page(_mfn(mfn_x(mfn0) + i));
-
-        for ( j=0; j<16; j++ )
-            if( *(map+j) != 0 )
-                break;
-
+        zero = pod_words_are_zero(map, POD_QUICK_WORDS);
         unmap_domain_page(map);
 
-        if ( j < 16 )
+        if ( !zero )
             goto out;
 
     }
@@ -773,14 +792,8 @@ p2m_pod_zero_check_superpage(struct p2m_domain *p2m, unsigned long gfn)
     for ( i=0; i < SUPERPAGE_PAGES; i++ )
     {
         map = map_domain_page(_mfn(mfn_x(mfn0) + i));
-
-        for ( j=0; j<PAGE_SIZE/sizeof(*map); j++ )
-            if( *(map+j) != 0 )
-            {
-                reset = 1;
-                break;
-            }
-
+        if ( !pod_words_are_zero(map, POD_PAGE_WORDS) )
+            reset = 1;
         unmap_domain_page(map);
 
         if ( reset )
@@ -826,7 +839,8 @@ p2m_pod_zero_check(struct p2m_domain *p2m, unsigned long *gfns, int count)
     unsigned long * map[count];
     struct domain *d = p2m->domain;
 
-    int i, j;
+    int i;
+    bool_t zero;
     int max_ref = 1;
 
     /* Allow an extra refcount for one shadow pt mapping in shadowed domains */
@@ -857,11 +871,7 @@ p2m_pod_zero_check(struct p2m_domain *p2m, unsigned long *gfns, int count)
             continue;
 
         /* Quick zero-check */
-        for ( j=0; j<16; j++ )
-            if( *(map[i]+j) != 0 )
-                break;
-
-        if ( j < 16 )
+        if ( !pod_words_are_zero(map[i], POD_QUICK_WORDS) )
         {
             unmap_domain_page(map[i]);
             map[i] = NULL;
@@ -894,15 +904,13 @@ p2m_pod_zero_check(struct p2m_domain *p2m, unsigned long *gfns, int count)
         if(!map[i])
             continue;
 
-        for ( j=0; j<PAGE_SIZE/sizeof(*map[i]); j++ )
-            if( *(map[i]+j) != 0 )
-                break;
+        zero = pod_words_are_zero(map[i], POD_PAGE_WORDS);
 
         unmap_domain_page(map[i]);
 
         /* See comment in p2m_pod_zero_check_superpage() re gnttab
          * check timing.  */
-        if ( j < PAGE_SIZE/sizeof(*map[i]) )
+        if ( !zero )
         {
             p2m_set_entry(p2m, gfns[i], mfns[i], PAGE_ORDER_4K,
                 types[i], p2m->default_access);
@@ -985,6 +993,90 @@ p2m_pod_emergency_sweep(struct p2m_domain *p2m)
 
 }
 
+/*
+ * Background sweep.  The emergency sweep runs with the gfn lock of the
+ * faulting vcpu held, which is the p2m lock, so every vcpu faulting on PoD
+ * waits for it.  Once the cache gets below POD_LOW_WATERMARK pages while
+ * more PoD entries remain, a tasklet sweeps ahead of the guest instead,
+ * taking the p2m and PoD locks for POD_BG_SWEEP_BATCH gfns at a time, and
+ * giving up the cpu whenever softirqs are pending.  It stops once the cache
+ * is back to POD_HIGH_WATERMARK, all PoD entries are covered, or after
+ * POD_BG_SWEEP_LIMIT gfns.
+ */
+#define POD_LOW_WATERMARK   SUPERPAGE_PAGES
+#define POD_HIGH_WATERMARK  (4 * SUPERPAGE_PAGES)
+#define POD_BG_SWEEP_BATCH  256
+#define POD_BG_SWEEP_LIMIT  (64UL * 1024)
+
+static void p2m_pod_sweep_schedule(struct p2m_domain *p2m)
+{
+    ASSERT(pod_locked_by_me(p2m));
+
+    if ( p2m->pod.sweep_left || p2m->pod.count >= POD_LOW_WATERMARK ||
+         p2m->pod.entry_count <= p2m->pod.count )
+        return;
+
+    p2m->pod.sweep_left = POD_BG_SWEEP_LIMIT;
+    tasklet_schedule(&p2m->pod.sweep_tasklet);
+}
+
+void p2m_pod_background_sweep(unsigned long data)
+{
+    struct p2m_domain *p2m = (struct p2m_domain *)data;
+    unsigned long gfns[POD_SWEEP_STRIDE];
+    unsigned long i, n;
+    unsigned int j;
+    p2m_type_t t;
+    p2m_access_t a;
+
+    for ( ; ; )
+    {
+        p2m_lock(p2m);
+        pod_lock(p2m);
+
+        if ( p2m->domain->is_dying || !p2m->pod.sweep_left ||
+             p2m->pod.count >= POD_HIGH_WATERMARK ||
+             p2m->pod.entry_count <= p2m->pod.count )
+            break;
+
+        if ( p2m->pod.reclaim_single == 0 )
+            p2m->pod.reclaim_single = p2m->pod.max_guest;
+
+        i = p2m->pod.reclaim_single;
+        for ( n = j = 0; n < POD_BG_SWEEP_BATCH && i > 0; n++, i-- )
+        {
+            (void)p2m->get_entry(p2m, i, &t, &a, 0, NULL, NULL);
+            if ( !p2m_is_ram(t) )
+                continue;
+
+            gfns[j++] = i;
+            if ( j == POD_SWEEP_STRIDE )
+            {
+                p2m_pod_zero_check(p2m, gfns, j);
+                j = 0;
+            }
+        }
+        if ( j )
+            p2m_pod_zero_check(p2m, gfns, j);
+
+        p2m->pod.reclaim_single = i;
+        p2m->pod.sweep_left -= min(n, p2m->pod.sweep_left);
+
+        pod_unlock(p2m);
+        p2m_unlock(p2m);
+
+        if ( softirq_pending(smp_processor_id()) )
+        {
+            tasklet_schedule(&p2m->pod.sweep_tasklet);
+            return;
+        }
+    }
+
+    p2m->pod.sweep_left = 0;
+    pod_unlock(p2m);
+    p2m_unlock(p2m);
+}
+
 static void pod_eager_reclaim(struct p2m_domain *p2m)
 {
     struct pod_mrp_list *mrp = &p2m->pod.mrp;
@@ -1117,6 +1209,7 @@ p2m_pod_demand_populate(struct p2m_domain *p2m, unsigned long gfn,
     BUG_ON(p2m->pod.entry_count < 0);
 
     pod_eager_record(p2m, gfn_aligned, order);
+    p2m_pod_sweep_schedule(p2m);
 
     if ( tb_init_done )
     {
@@ -76,6 +76,8 @@ static int p2m_initialise(struct domain *d, struct p2m_domain *p2m)
 
     for ( i = 0; i < ARRAY_SIZE(p2m->pod.mrp.list); ++i )
         p2m->pod.mrp.list[i] = gfn_x(INVALID_GFN);
+    tasklet_init(&p2m->pod.sweep_tasklet, p2m_pod_background_sweep,
+                 (unsigned long)p2m);
 
     if ( hap_enabled(d) && cpu_has_vmx )
         ret = ept_p2m_init(p2m);
@@ -110,6 +112,7 @@ free_p2m:
 
 static void p2m_free_one(struct p2m_domain *p2m)
 {
+    tasklet_kill(&p2m->pod.sweep_tasklet);
     if ( hap_enabled(p2m->domain) && cpu_has_vmx )
         ept_p2m_uninit(p2m);
     free_cpumask_var(p2m->dirty_cpumask);
@@ -472,6 +475,44 @@ void __put_gfn(struct p2m_domain *p2m, unsigned long gfn)
 }
 
 /* Atomically look up a GFN and take a reference count on the backing page. */
+/*
+ * Take a reference on the page a p2m entry refers to, if it's RAM suitable
+ * for get_page_from_gfn().  @locked tells whether the entry was read with
+ * the p2m lock held, and hence can't have gone stale yet.
+ */
+static struct page_info *p2m_get_entry_page(struct domain *d, mfn_t mfn,
+                                            p2m_type_t t, p2m_query_t q,
+                                            bool locked)
+{
+    struct page_info *page;
+
+    if ( !p2m_is_any_ram(t) || !mfn_valid(mfn) ||
+         ((q & P2M_UNSHARE) && p2m_is_shared(t)) )
+        return NULL;
+
+    page = mfn_to_page(mfn);
+    if ( unlikely(p2m_is_foreign(t)) )
+    {
+        struct domain *fdom = page_get_owner_and_reference(page);
+
+        /* A stale foreign entry may refer to a page since given to @d. */
+        ASSERT(!locked || fdom != d);
+        if ( fdom == NULL )
+            return NULL;
+        if ( fdom == d )
+        {
+            put_page(page);
+            return NULL;
+        }
+    }
+    else if ( !get_page(page, d)
+              /* Page could be shared */
+              && !get_page(page, dom_cow) )
+        return NULL;
+
+    return page;
+}
+
 struct page_info *get_page_from_gfn_p2m(
     struct domain *d, struct p2m_domain *p2m, unsigned long gfn,
     p2m_type_t *t, p2m_access_t *a, p2m_query_t q)
@@ -487,29 +528,33 @@ struct page_info *get_page_from_gfn_p2m(
 
     if ( likely(!p2m_locked_by_me(p2m)) )
     {
-        /* Fast path: look up and get out */
-        p2m_read_lock(p2m);
+        p2m_access_t a2;
+        p2m_type_t t2;
+
+        /*
+         * Fast path: look up and take a reference without the p2m lock,
+         * then check the entry still refers to the same page.  This way
+         * readers aren't held up by p2m updates (e.g. log-dirty tracking)
+         * of unrelated entries.
+         */
         mfn = __get_gfn_type_access(p2m, gfn, t, a, 0, NULL, 0);
-        if ( p2m_is_any_ram(*t) && mfn_valid(mfn)
-             && !((q & P2M_UNSHARE) && p2m_is_shared(*t)) )
+        page = p2m_get_entry_page(d, mfn, *t, q, false);
+        if ( page )
         {
-            page = mfn_to_page(mfn);
-            if ( unlikely(p2m_is_foreign(*t)) )
-            {
-                struct domain *fdom = page_get_owner_and_reference(page);
-                ASSERT(fdom != d);
-                if ( fdom == NULL )
-                    page = NULL;
-            }
-            else if ( !get_page(page, d)
-                      /* Page could be shared */
-                      && !get_page(page, dom_cow) )
-                page = NULL;
-        }
-        p2m_read_unlock(p2m);
+            if ( mfn_eq(__get_gfn_type_access(p2m, gfn, &t2, &a2, 0, NULL, 0),
+                        mfn) && t2 == *t && a2 == *a )
+                return page;
+            put_page(page);
 
-        if ( page )
-            return page;
+            /* The entry changed under our feet: look again under the lock. */
+            p2m_read_lock(p2m);
+            mfn = __get_gfn_type_access(p2m, gfn, t, a, 0, NULL, 0);
+            page = p2m_get_entry_page(d, mfn, *t, q, true);
+            p2m_read_unlock(p2m);
+
+            if ( page )
+                return page;
+        }
 
         /* Error path: not a suitable GFN at all */
         if ( !p2m_is_ram(*t) && !p2m_is_paging(*t) && !p2m_is_pod(*t) )
@@ -705,20 +750,10 @@ p2m_remove_page(struct p2m_domain *p2m, unsigned long gfn, unsigned long mfn,
 
     if ( !paging_mode_translate(p2m->domain) )
     {
-        int rc = 0;
-
         if ( need_iommu(p2m->domain) )
-        {
-            for ( i = 0; i < (1 << page_order); i++ )
-            {
-                int ret = iommu_unmap_page(p2m->domain, mfn + i);
-
-                if ( !rc )
-                    rc = ret;
-            }
-        }
+            return iommu_unmap_pages(p2m->domain, mfn, page_order);
 
-        return rc;
+        return 0;
     }
 
     ASSERT(gfn_locked_by_me(p2m, gfn));
@@ -750,6 +785,80 @@ guest_physmap_remove_page(struct domain *d, gfn_t gfn,
     return rc;
 }
 
+/*
+ * Free an extent of RAM which is mapped by a single p2m entry as a whole,
+ * rather than page by page through guest_remove_page(), which splits the
+ * mapping and updates the p2m once per page.  Returns 1 if the extent was
+ * freed, 0 if the caller has to fall back to guest_remove_page().
+ */
+int p2m_remove_ram_extent(struct domain *d, unsigned long gfn,
+                          unsigned int order)
+{
+    struct p2m_domain *p2m = p2m_get_hostp2m(d);
+    unsigned long i, j, nr = 1UL << order;
+    struct page_info *page = NULL;
+    p2m_type_t t;
+    p2m_access_t a;
+    unsigned int cur_order;
+    bool whole = true;
+    mfn_t mfn;
+    int ok;
+
+    if ( !order || !paging_mode_translate(d) || (gfn & (nr - 1)) )
+        return 0;
+
+    gfn_lock(p2m, gfn, order);
+
+    mfn = p2m->get_entry(p2m, gfn, &t, &a, 0, &cur_order, NULL);
+    ok = t == p2m_ram_rw && cur_order >= order && mfn_valid(mfn);
+    if ( ok )
+    {
+        page = mfn_to_page(mfn);
+        for ( i = 0; ok && i < nr; i++ )
+            ok = page_get_owner(&page[i]) == d;
+    }
+    if ( ok )
+        ok = !p2m_remove_page(p2m, gfn, mfn_x(mfn), order);
+
+    gfn_unlock(p2m, gfn, order);
+
+    if ( !ok )
+        return 0;
+
+    /*
+     * Pages referenced by nothing but their allocation are taken over with
+     * their last reference, so that the extent can go back to the heap in
+     * one piece.  Should any page still be in use elsewhere, fall back to
+     * dropping the allocation references one by one, each page being freed
+     * by whoever puts its last reference.
+     */
+    for ( i = 0; i < nr; i++ )
+    {
+        if ( cmpxchg(&page[i].count_info, PGC_allocated | 1, 0) ==
+             (PGC_allocated | 1) )
+        {
+            if ( !whole )
+                free_domheap_page(&page[i]);
+            continue;
+        }
+
+        if ( whole )
+        {
+            whole = false;
+            for ( j = 0; j < i; j++ )
+                free_domheap_page(&page[j]);
+        }
+
+        if ( test_and_clear_bit(_PGC_allocated, &page[i].count_info) )
+            put_page(&page[i]);
+    }
+
+    if ( whole )
+        free_domheap_pages(page, order);
+
+    return 1;
+}
+
 int
 guest_physmap_add_entry(struct domain *d, gfn_t gfn, mfn_t mfn,
                         unsigned int page_order, p2m_type_t t)
@@ -765,23 +874,8 @@ guest_physmap_add_entry(struct domain *d, gfn_t gfn, mfn_t mfn,
     if ( !paging_mode_translate(d) )
     {
         if ( need_iommu(d) && t == p2m_ram_rw )
-        {
-            for ( i = 0; i < (1 << page_order); i++ )
-            {
-                rc = iommu_map_page(d, mfn_x(mfn_add(mfn, i)),
-                                    mfn_x(mfn_add(mfn, i)),
-                                    IOMMUF_readable|IOMMUF_writable);
-                if ( rc != 0 )
-                {
-                    while ( i-- > 0 )
-                        /* If statement to satisfy __must_check. */
-                        if ( iommu_unmap_page(d, mfn_x(mfn_add(mfn, i))) )
-                            continue;
-
-                    return rc;
-                }
-            }
-        }
+            return iommu_map_pages(d, mfn_x(mfn), mfn_x(mfn), page_order,
+                                   IOMMUF_readable|IOMMUF_writable);
         return 0;
     }
 
@@ -1672,6 +1766,291 @@ void p2m_mem_paging_resume(struct domain *d, vm_event_response_t *rsp)
     }
 }
 
+/*
+ * Only the allocation reference may remain on pages to be moved: a page
+ * mapped by someone else, or by Xen itself, must not change under their
+ * feet.  Checking up front avoids steal_page() complaining about each of
+ * them.
+ */
+static bool_t p2m_extent_busy(const struct domain *d, mfn_t mfn,
+                              unsigned long nr)
+{
+    const struct page_info *page;
+    unsigned long i;
+
+    for ( i = 0; i < nr; i++ )
+    {
+        page = mfn_to_page(mfn_add(mfn, i));
+        if ( page_get_owner(page) != d ||
+             (page->count_info & (PGC_count_mask | PGC_allocated)) !=
+             (1 | PGC_allocated) ||
+             (page->u.inuse.type_info & PGT_count_mask) )
+            return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Replace the 2^order pages from mfn on, which d has mapped from gfn base
+ * on, by copies in new_page (allocated with MEMF_no_owner), freeing the old
+ * pages.  The gfn must be locked and the domain paused.  new_page is freed
+ * on failure.  Returns the number of pages moved, -EBUSY if anything beyond
+ * the p2m took a reference to one of the pages, or another error.
+ */
+static int p2m_move_extent(struct domain *d, unsigned long base, mfn_t mfn,
+                           unsigned int order, p2m_type_t t, p2m_access_t a,
+                           struct page_info *new_page)
+{
+    struct p2m_domain *p2m = p2m_get_hostp2m(d);
+    unsigned long i, nr = 1UL << order;
+    mfn_t new_mfn = page_to_mfn(new_page);
+    struct page_info *page;
+    int rc;
+
+    /*
+     * As in memory_exchange(), steal and assign without adjusting tot_pages,
+     * which therefore stays the same.
+     */
+    rc = -EBUSY;
+    for ( i = 0; i < nr; i++ )
+        if ( steal_page(d, mfn_to_page(mfn_add(mfn, i)), MEMF_no_refcount) )
+            goto out_reassign;
+
+    for ( i = 0; i < nr; i++ )
+        copy_domain_page(mfn_add(new_mfn, i), mfn_add(mfn, i));
+
+    rc = -ESRCH;
+    if ( assign_pages(d, new_page, order, MEMF_no_refcount) )
+        goto out_reassign;
+
+    rc = p2m_set_entry(p2m, base, new_mfn, order, t, a);
+    if ( rc )
+    {
+        /* Nobody knows of the new pages yet, so they can go again. */
+        for ( i = 0; i < nr; i++ )
+        {
+            page = mfn_to_page(mfn_add(new_mfn, i));
+            BUG_ON(steal_page(d, page, MEMF_no_refcount));
+            if ( test_and_clear_bit(_PGC_allocated, &page->count_info) )
+                put_page(page);
+        }
+        i = nr;
+        new_page = NULL;
+        goto out_reassign;
+    }
+
+    for ( i = 0; i < nr; i++ )
+    {
+        set_gpfn_from_mfn(mfn_x(mfn_add(new_mfn, i)), base + i);
+        set_gpfn_from_mfn(mfn_x(mfn_add(mfn, i)), INVALID_M2P_ENTRY);
+        paging_mark_dirty(d, mfn_add(new_mfn, i));
+
+        /* Drop the allocation reference of the old page, freeing it. */
+        page = mfn_to_page(mfn_add(mfn, i));
+        if ( test_and_clear_bit(_PGC_allocated, &page->count_info) )
+            put_page(page);
+    }
+
+    return nr;
+
+ out_reassign:
+    while ( i-- )
+    {
+        page = mfn_to_page(mfn_add(mfn, i));
+        if ( assign_pages(d, page, 0, MEMF_no_refcount) )
+        {
+            BUG_ON(!d->is_dying);
+            if ( test_and_clear_bit(_PGC_allocated, &page->count_info) )
+                put_page(page);
+        }
+    }
+    if ( new_page )
+        free_domheap_pages(new_page, order);
+    return rc;
+}
+
+/*
+ * Move the extent of guest memory mapped at gfn, if it is RAM on a node
+ * outside the domain's node affinity, to memory allocated on a node within
+ * it.  Extents are the 4k or 2M mappings in the p2m, so superpages stay
+ * intact; 1G mappings get split into 2M ones.  The domain must be paused.
+ *
+ * Returns the number of pages moved, 0 if nothing needed moving, -EBUSY if
+ * anything beyond the p2m holds a reference to some page of the extent, or
+ * -ENOMEM.  Either way *nr is set to the size of the extent.
+ */
+static int p2m_rehome_extent(struct domain *d, unsigned long gfn,
+                             unsigned long *nr)
+{
+    struct p2m_domain *p2m = p2m_get_hostp2m(d);
+    struct page_info *new_page;
+    unsigned long base;
+    unsigned int order;
+    p2m_type_t t;
+    p2m_access_t a;
+    mfn_t mfn;
+    int rc = 0;
+
+    gfn_lock(p2m, gfn, 0);
+
+    mfn = p2m->get_entry(p2m, gfn, &t, &a, 0, &order, NULL);
+    order = min(order, (unsigned int)PAGE_ORDER_2M);
+    base = gfn & ~((1UL << order) - 1);
+    *nr = 1UL << order;
+
+    if ( (t != p2m_ram_rw && t != p2m_ram_logdirty) || !mfn_valid(mfn) ||
+         node_isset(phys_to_nid(pfn_to_paddr(mfn_x(mfn))),
+                    d->node_affinity) )
+        goto out;
+    mfn = _mfn(mfn_x(mfn) - (gfn - base));
+
+    rc = -EBUSY;
+    if ( p2m_extent_busy(d, mfn, *nr) )
+        goto out;
+
+    /* Without a node given, the allocator prefers d's node affinity. */
+    rc = -ENOMEM;
+    new_page = alloc_domheap_pages(d, order, MEMF_no_owner);
+    if ( !new_page )
+        goto out;
+    if ( !node_isset(phys_to_nid(page_to_maddr(new_page)), d->node_affinity) )
+    {
+        free_domheap_pages(new_page, order);
+        goto out;
+    }
+
+    rc = p2m_move_extent(d, base, mfn, order, t, a, new_page);
+
+ out:
+    gfn_unlock(p2m, gfn, 0);
+    return rc;
+}
+
+/*
+ * Memory compaction: move the extent of guest memory, owned by d, which
+ * the page at mfn belongs to, out of the range [avoid, avoid + nr_avoid)
+ * to memory on the same node.  Only extents of less than 2^max_order pages
+ * get moved, as bigger ones are superpages already.  Pages allocated within
+ * the range get put on held instead, for the caller to free once done, so
+ * that they can merge with what got moved out.  The domain must be paused.
+ *
+ * Returns the number of pages moved, -EBUSY if the page can't be moved
+ * (e.g. as anything beyond the p2m holds a reference to it), or another
+ * error.  Either way *nr is set to the number of pages from mfn on which
+ * were looked at.
+ */
+int p2m_compact_extent(struct domain *d, mfn_t mfn, unsigned int max_order,
+                       mfn_t avoid, unsigned long nr_avoid,
+                       struct page_list_head *held, unsigned long *nr)
+{
+    struct p2m_domain *p2m = p2m_get_hostp2m(d);
+    unsigned int node = phys_to_nid(pfn_to_paddr(mfn_x(mfn)));
+    struct page_info *new_page;
+    unsigned long gfn, base, i, new;
+    unsigned int order;
+    p2m_type_t t;
+    p2m_access_t a;
+    mfn_t cur;
+    int rc;
+
+    *nr = 1;
+
+    /* As for p2m_rehome_memory(). */
+    if ( !paging_mode_translate(d) || need_iommu(d) || altp2m_active(d) ||
+         d->is_dying )
+        return -EOPNOTSUPP;
+
+    gfn = get_gpfn_from_mfn(mfn_x(mfn));
+    if ( !VALID_M2P(gfn) )
+        return -EBUSY;
+
+    gfn_lock(p2m, gfn, 0);
+
+    rc = -EBUSY;
+    cur = p2m->get_entry(p2m, gfn, &t, &a, 0, &order, NULL);
+    if ( (t != p2m_ram_rw && t != p2m_ram_logdirty) || !mfn_eq(cur, mfn) ||
+         order >= max_order || order > PAGE_ORDER_2M )
+        goto out;
+    base = gfn & ~((1UL << order) - 1);
+    mfn = _mfn(mfn_x(mfn) - (gfn - base));
+    *nr = (1UL << order) - (gfn - base);
+
+    if ( p2m_extent_busy(d, mfn, 1UL << order) )
+        goto out;
+
+    for ( ; ; )
+    {
+        rc = -ENOMEM;
+        new_page = alloc_domheap_pages(d, order,
+                                       MEMF_no_owner | MEMF_node(node) |
+                                       MEMF_exact_node);
+        if ( !new_page )
+            goto out;
+
+        new = mfn_x(page_to_mfn(new_page));
+        if ( new + (1UL << order) <= mfn_x(avoid) ||
+             new >= mfn_x(avoid) + nr_avoid )
+            break;
+
+        /* Freed one by one later, so put on the list one by one. */
+        for ( i = 0; i < (1UL << order); i++ )
+            page_list_add(new_page + i, held);
+    }
+
+    rc = p2m_move_extent(d, base, mfn, order, t, a, new_page);
+
+ out:
+    gfn_unlock(p2m, gfn, 0);
+    return rc;
+}
+
+int p2m_rehome_memory(struct domain *d, unsigned long *gfn,
+                      unsigned long nr_gfns, unsigned int *moved,
+                      unsigned int *busy)
+{
+    struct p2m_domain *p2m = p2m_get_hostp2m(d);
+    unsigned long end, nr;
+    unsigned int done = 0;
+    int rc = 0;
+
+    /*
+     * Devices may DMA into a passthrough domain's memory at any time, and
+     * alternate p2m views would keep referring to the old pages.
+     */
+    if ( !paging_mode_translate(d) || need_iommu(d) || altp2m_active(d) )
+        return -EOPNOTSUPP;
+
+    *moved = *busy = 0;
+    end = p2m->max_mapped_pfn + 1;
+    if ( nr_gfns < end - *gfn )
+        end = *gfn + nr_gfns;
+
+    domain_pause(d);
+
+    while ( *gfn < end )
+    {
+        rc = p2m_rehome_extent(d, *gfn, &nr);
+        if ( rc > 0 )
+            *moved += rc;
+        else if ( rc == -EBUSY )
+            *busy += nr;
+        else if ( rc )
+            break;
+        rc = 0;
+
+        /* The extent may have started before *gfn. */
+        *gfn = (*gfn & ~(nr - 1)) + nr;
+
+        if ( !(++done & 0x3f) && hypercall_preempt_check() )
+            break;
+    }
+
+    domain_unpause(d);
+
+    return rc;
+}
+
 void p2m_altp2m_check(struct vcpu *v, uint16_t idx)
 {
     if ( altp2m_active(v->domain) )
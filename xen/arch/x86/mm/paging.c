@@ -263,16 +263,14 @@ static int paging_log_dirty_disable(struct domain *d, bool_t resuming)
 }
 
 /* Mark a page as dirty, with taking guest pfn as parameter */
-void paging_mark_pfn_dirty(struct domain *d, pfn_t pfn)
+/* Mark a page as dirty in the log-dirty bitmap.  The paging lock is held. */
+static void mark_pfn_dirty(struct domain *d, pfn_t pfn)
 {
     bool changed;
     mfn_t mfn, *l4, *l3, *l2;
     unsigned long *l1;
     unsigned int i1, i2, i3, i4;
 
-    if ( !paging_mode_log_dirty(d) )
-        return;
-
     /* Shared MFNs should NEVER be marked dirty */
     BUG_ON(SHARED_M2P(pfn_x(pfn)));
 
@@ -289,14 +287,11 @@ void paging_mark_pfn_dirty(struct domain *d, pfn_t pfn)
     i3 = L3_LOGDIRTY_IDX(pfn);
     i4 = L4_LOGDIRTY_IDX(pfn);
 
-    /* Recursive: this is called from inside the shadow code */
-    paging_lock_recursive(d);
-
     if ( unlikely(!mfn_valid(d->arch.paging.log_dirty.top)) ) 
     {
          d->arch.paging.log_dirty.top = paging_new_log_dirty_node(d);
          if ( unlikely(!mfn_valid(d->arch.paging.log_dirty.top)) )
-             goto out;
+             return;
     }
 
     l4 = paging_map_log_dirty_bitmap(d);
@@ -305,7 +300,7 @@ void paging_mark_pfn_dirty(struct domain *d, pfn_t pfn)
         l4[i4] = mfn = paging_new_log_dirty_node(d);
     unmap_domain_page(l4);
     if ( !mfn_valid(mfn) )
-        goto out;
+        return;
 
     l3 = map_domain_page(mfn);
     mfn = l3[i3];
@@ -313,7 +308,7 @@ void paging_mark_pfn_dirty(struct domain *d, pfn_t pfn)
         l3[i3] = mfn = paging_new_log_dirty_node(d);
     unmap_domain_page(l3);
     if ( !mfn_valid(mfn) )
-        goto out;
+        return;
 
     l2 = map_domain_page(mfn);
     mfn = l2[i2];
@@ -321,7 +316,7 @@ void paging_mark_pfn_dirty(struct domain *d, pfn_t pfn)
         l2[i2] = mfn = paging_new_log_dirty_leaf(d);
     unmap_domain_page(l2);
     if ( !mfn_valid(mfn) )
-        goto out;
+        return;
 
     l1 = map_domain_page(mfn);
     changed = !__test_and_set_bit(i1, l1);
@@ -333,11 +328,35 @@ void paging_mark_pfn_dirty(struct domain *d, pfn_t pfn)
                      d->domain_id, mfn_x(mfn), pfn_x(pfn));
         d->arch.paging.log_dirty.dirty_count++;
     }
+}
+
+void paging_mark_pfn_dirty(struct domain *d, pfn_t pfn)
+{
+    if ( !paging_mode_log_dirty(d) )
+        return;
+
+    /* Recursive: this is called from inside the shadow code */
+    paging_lock_recursive(d);
+    mark_pfn_dirty(d, pfn);
+    paging_unlock(d);
+}
 
-out:
-    /* We've already recorded any failed allocations */
+/*
+ * Mark a batch of pages as dirty, taking the paging lock only once.  Used
+ * when draining hardware dirty logs (e.g. the VMX PML buffers).
+ */
+void paging_mark_pfns_dirty(struct domain *d, const unsigned long *pfns,
+                            unsigned int nr)
+{
+    unsigned int i;
+
+    if ( !paging_mode_log_dirty(d) || !nr )
+        return;
+
+    paging_lock_recursive(d);
+    for ( i = 0; i < nr; i++ )
+        mark_pfn_dirty(d, _pfn(pfns[i]));
     paging_unlock(d);
-    return;
 }
 
 /* Mark a page as dirty */
@@ -404,6 +423,177 @@ int paging_mfn_is_dirty(struct domain *d, mfn_t gmfn)
 
 /* Read a domain's log-dirty bitmap and stats.  If the operation is a CLEAN,
  * clear the bitmap and stats as well. */
+/* Number of pfns covered by a log-dirty leaf and by interior nodes. */
+#define LOGDIRTY_L1_PFNS  (1UL << (PAGE_SHIFT + 3))
+#define LOGDIRTY_L2_PFNS  (LOGDIRTY_L1_PFNS << PAGETABLE_ORDER)
+#define LOGDIRTY_L3_PFNS  (LOGDIRTY_L2_PFNS << PAGETABLE_ORDER)
+#define LOGDIRTY_MAX_PFNS (LOGDIRTY_L3_PFNS << PAGETABLE_ORDER)
+
+/*
+ * Report (and possibly clean) a range of the log-dirty bitmap as a list of
+ * extents.  Only the populated parts of the trie are visited.  Rather than
+ * using continuations, the operation returns early with the range updated
+ * when it needs to be preempted or runs out of space for extents.
+ */
+static int paging_log_dirty_extents(struct domain *d,
+                                    struct xen_domctl_shadow_op *sc)
+{
+    bool clean = (sc->op == XEN_DOMCTL_SHADOW_OP_CLEAN), cleaned = false;
+    unsigned long pfn = sc->start_pfn, end = sc->start_pfn + sc->nr_pfns;
+    unsigned int written = 0;
+    struct xen_domctl_shadow_op_extent ext = { .nr = 0 };
+    mfn_t mfn, *l4, *l3, *l2;
+    unsigned long *l1;
+    int rv = 0;
+
+    if ( end < pfn )
+        return -EINVAL;
+    if ( end > LOGDIRTY_MAX_PFNS )
+        end = LOGDIRTY_MAX_PFNS;
+
+    if ( is_hvm_domain(d) && (sc->mode & XEN_DOMCTL_SHADOW_LOGDIRTY_FINAL) )
+        hvm_mapped_guest_frames_mark_dirty(d);
+
+    domain_pause(d);
+    p2m_flush_hardware_cached_dirty(d);
+
+    paging_lock(d);
+
+    /* Don't interfere with a preempted bitmap operation. */
+    if ( d->arch.paging.preempt.dom )
+    {
+        rv = -EBUSY;
+        goto out;
+    }
+
+    sc->stats.fault_count = d->arch.paging.log_dirty.fault_count;
+    sc->stats.dirty_count = d->arch.paging.log_dirty.dirty_count;
+
+    if ( unlikely(d->arch.paging.log_dirty.failed_allocs) )
+    {
+        printk(XENLOG_WARNING
+               "%u failed page allocs while logging dirty pages of d%d\n",
+               d->arch.paging.log_dirty.failed_allocs, d->domain_id);
+        rv = -ENOMEM;
+        goto out;
+    }
+
+    l4 = paging_map_log_dirty_bitmap(d);
+    if ( !l4 )
+        pfn = end;
+
+    while ( pfn < end )
+    {
+        unsigned long base, lim, i, j;
+        bool full = false;
+
+        mfn = l4[L4_LOGDIRTY_IDX(_pfn(pfn))];
+        if ( !mfn_valid(mfn) )
+        {
+            pfn = (pfn | (LOGDIRTY_L3_PFNS - 1)) + 1;
+            continue;
+        }
+        l3 = map_domain_page(mfn);
+        mfn = l3[L3_LOGDIRTY_IDX(_pfn(pfn))];
+        unmap_domain_page(l3);
+        if ( !mfn_valid(mfn) )
+        {
+            pfn = (pfn | (LOGDIRTY_L2_PFNS - 1)) + 1;
+            continue;
+        }
+        l2 = map_domain_page(mfn);
+        mfn = l2[L2_LOGDIRTY_IDX(_pfn(pfn))];
+        unmap_domain_page(l2);
+        if ( !mfn_valid(mfn) )
+        {
+            pfn = (pfn | (LOGDIRTY_L1_PFNS - 1)) + 1;
+            continue;
+        }
+
+        base = pfn & ~(LOGDIRTY_L1_PFNS - 1);
+        lim = min(end - base, LOGDIRTY_L1_PFNS);
+        l1 = map_domain_page(mfn);
+
+        for ( i = find_next_bit(l1, lim, pfn - base); i < lim;
+              i = find_next_bit(l1, lim, j) )
+        {
+            j = find_next_zero_bit(l1, lim, i);
+
+            if ( ext.nr && ext.pfn + ext.nr == base + i )
+                ext.nr += j - i;
+            else
+            {
+                if ( ext.nr )
+                {
+                    if ( copy_to_guest_offset(sc->extents, written, &ext, 1) )
+                        rv = -EFAULT;
+                    written++;
+                }
+                if ( rv || written == sc->nr_extents )
+                {
+                    /* Leave this and later runs for the next call. */
+                    ext.nr = 0;
+                    full = true;
+                    break;
+                }
+                ext.pfn = base + i;
+                ext.nr = j - i;
+            }
+
+            if ( clean )
+            {
+                for ( ; i < j; i++ )
+                    __clear_bit(i, l1);
+                cleaned = true;
+            }
+        }
+
+        unmap_domain_page(l1);
+
+        pfn = full ? base + i : base + lim;
+        if ( full || hypercall_preempt_check() )
+            break;
+    }
+
+    if ( l4 )
+        unmap_domain_page(l4);
+    if ( pfn > end )
+        pfn = end;
+
+    if ( ext.nr )
+    {
+        if ( copy_to_guest_offset(sc->extents, written, &ext, 1) )
+            rv = -EFAULT;
+        written++;
+    }
+
+    if ( clean )
+    {
+        d->arch.paging.log_dirty.fault_count = 0;
+        d->arch.paging.log_dirty.dirty_count = 0;
+    }
+
+    sc->nr_extents = written;
+    sc->nr_pfns = end - pfn;
+    sc->start_pfn = pfn;
+
+ out:
+    paging_unlock(d);
+
+    /*
+     * Re-arm logging for the whole guest, not just the cleaned range: this
+     * only costs spurious faults on pages whose bits are still set, while
+     * the domain being paused guarantees no write escapes logging.  This
+     * must happen even on error if any bit has already been cleared.
+     */
+    if ( clean && (cleaned || !rv) )
+        d->arch.paging.log_dirty.ops->clean(d);
+
+    domain_unpause(d);
+
+    return rv;
+}
+
 static int paging_log_dirty_op(struct domain *d,
                                struct xen_domctl_shadow_op *sc,
                                bool_t resuming)
@@ -598,8 +788,11 @@ void paging_log_dirty_range(struct domain *d,
                            uint8_t *dirty_bitmap)
 {
     struct p2m_domain *p2m = p2m_get_hostp2m(d);
-    int i;
-    unsigned long pfn;
+    unsigned long i, j, next;
+    unsigned int order;
+    p2m_access_t a;
+    p2m_type_t t;
+    bool_t dirty = 0;
 
     /*
      * Set l1e entries of P2M table to be read-only.
@@ -608,14 +801,33 @@ void paging_log_dirty_range(struct domain *d,
      * and on retry the write succeeds.
      *
      * We populate dirty_bitmap by looking for entries that have been
-     * switched to read-write.
+     * switched to read-write.  Only the lookups are done per GFN (and
+     * per superpage where the p2m has one); the whole range is then
+     * switched back with a single ranged type change, which on EPT and
+     * NPT just marks the covering intermediate entries for recalculation
+     * and flushes once, rather than rewriting and flushing every dirty
+     * leaf entry.  Both happen under the p2m lock, so no write can slip
+     * in between being reported and being write-protected again.
      */
 
     p2m_lock(p2m);
 
-    for ( i = 0, pfn = begin_pfn; pfn < begin_pfn + nr; i++, pfn++ )
-        if ( !p2m_change_type_one(d, pfn, p2m_ram_rw, p2m_ram_logdirty) )
-            dirty_bitmap[i >> 3] |= (1 << (i & 7));
+    for ( i = 0; i < nr; i = next )
+    {
+        p2m->get_entry(p2m, begin_pfn + i, &t, &a, 0, &order, NULL);
+        next = ((begin_pfn + i) | ((1UL << order) - 1)) + 1 - begin_pfn;
+        if ( next > nr )
+            next = nr;
+        if ( t != p2m_ram_rw )
+            continue;
+        for ( j = i; j < next; j++ )
+            dirty_bitmap[j >> 3] |= (1 << (j & 7));
+        dirty = 1;
+    }
+
+    if ( dirty )
+        p2m_change_type_range(d, begin_pfn, begin_pfn + nr,
+                              p2m_ram_rw, p2m_ram_logdirty);
 
     p2m_unlock(p2m);
 
@@ -741,8 +953,11 @@ int paging_domctl(struct domain *d, xen_domctl_shadow_op_t *sc,
 
     case XEN_DOMCTL_SHADOW_OP_CLEAN:
     case XEN_DOMCTL_SHADOW_OP_PEEK:
-        if ( sc->mode & ~XEN_DOMCTL_SHADOW_LOGDIRTY_FINAL )
+        if ( sc->mode & ~(XEN_DOMCTL_SHADOW_LOGDIRTY_FINAL |
+                          XEN_DOMCTL_SHADOW_LOGDIRTY_EXTENTS) )
             return -EINVAL;
+        if ( sc->mode & XEN_DOMCTL_SHADOW_LOGDIRTY_EXTENTS )
+            return paging_log_dirty_extents(d, sc);
         return paging_log_dirty_op(d, sc, resuming);
     }
 
@@ -890,6 +1105,10 @@ void paging_dump_domain_info(struct domain *d)
         if ( paging_mode_external(d) )
             printk("external ");
         printk("\n");
+        if ( paging_mode_shadow(d) )
+            shadow_dump_domain_info(d);
+        else if ( paging_mode_hap(d) )
+            hap_dump_domain_info(d);
     }
 }
 
@@ -43,6 +43,7 @@ DEFINE_PER_CPU(uint32_t,trace_shadow_path_flags);
 static int sh_enable_log_dirty(struct domain *, bool_t log_global);
 static int sh_disable_log_dirty(struct domain *);
 static void sh_clean_dirty_bitmap(struct domain *);
+static void shadow_hash_resize(struct domain *d);
 
 /* Set up the shadow-specific parts of a domain struct at start of day.
  * Called for every domain from arch_domain_create() */
@@ -718,6 +719,7 @@ static void oos_hash_add(struct vcpu *v, mfn_t gmfn)
         /* Crush the current occupant. */
         _sh_resync(v, oos[idx], &oos_fixup[idx], oos_snapshot[idx]);
         perfc_incr(shadow_unsync_evict);
+        SHADOW_STAT_INCR(v->domain, OOS_EVICT);
     }
     oos[idx] = gmfn;
     oos_fixup[idx] = fixup;
@@ -1299,6 +1301,30 @@ void shadow_blow_tables_per_domain(struct domain *d)
     }
 }
 
+void shadow_dump_domain_info(struct domain *d)
+{
+    static const char *const names[SHADOW_STAT_NR] = {
+        [SHADOW_STAT_FAST_EMULATE]   = "fast emulate",
+        [SHADOW_STAT_FAST_PROPAGATE] = "fast propagate",
+        [SHADOW_STAT_FAST_MMIO]      = "fast mmio",
+        [SHADOW_STAT_REAL_FAULT]     = "guest fault",
+        [SHADOW_STAT_FIXED]          = "fixed",
+        [SHADOW_STAT_EMULATE]        = "emulate",
+        [SHADOW_STAT_MMIO]           = "mmio",
+        [SHADOW_STAT_OOS_EVICT]      = "oos evict",
+    };
+    unsigned int i;
+
+    printk("    shadow: %u pages, %u hash buckets\n",
+           d->arch.paging.shadow.total_pages,
+           d->arch.paging.shadow.hash_buckets);
+    printk("    shadow events:");
+    for ( i = 0; i < SHADOW_STAT_NR; i++ )
+        printk(" %s %u", names[i],
+               atomic_read(&d->arch.paging.shadow.stats[i]));
+    printk("\n");
+}
+
 #ifndef NDEBUG
 /* Blow all shadows of all shadowed domains: this can be used to cause the
  * guest's pagetables to be re-shadowed if we suspect that the shadows
@@ -1612,6 +1638,8 @@ int shadow_set_allocation(struct domain *d, unsigned int pages, bool *preempted)
         }
     }
 
+    shadow_hash_resize(d);
+
     return 0;
 }
 
@@ -1829,18 +1857,41 @@ void sh_emulate_unmap_dest(struct vcpu *v, void *addr, unsigned int bytes,
  * The table itself is an array of pointers to shadows; the shadows are then
  * threaded on a singly-linked list of shadows with the same hash value */
 
-#define SHADOW_HASH_BUCKETS 251
-/* Other possibly useful primes are 509, 1021, 2039, 4093, 8191, 16381 */
+/* The number of buckets scales with the shadow pool, aiming at a couple of
+ * shadows per chain when the pool is in full use. */
+static const unsigned int sh_hash_primes[] = {
+    251, 509, 1021, 2039, 4093, 8191, 16381
+};
+#define SHADOW_HASH_PAGES_PER_BUCKET 8
+
+static unsigned int sh_hash_buckets(const struct domain *d)
+{
+    unsigned int i;
+
+    for ( i = 0; i < ARRAY_SIZE(sh_hash_primes) - 1; i++ )
+        if ( sh_hash_primes[i] * SHADOW_HASH_PAGES_PER_BUCKET >=
+             d->arch.paging.shadow.total_pages )
+            break;
+
+    return sh_hash_primes[i];
+}
 
 /* Hash function that takes a gfn or mfn, plus another byte of type info */
 typedef u32 key_t;
-static inline key_t sh_hash(unsigned long n, unsigned int t)
+static inline key_t sh_hash_key(unsigned int buckets, unsigned long n,
+                                unsigned int t)
 {
     unsigned char *p = (unsigned char *)&n;
     key_t k = t;
     int i;
     for ( i = 0; i < sizeof(n) ; i++ ) k = (u32)p[i] + (k<<6) + (k<<16) - k;
-    return k % SHADOW_HASH_BUCKETS;
+    return k % buckets;
+}
+
+static inline key_t sh_hash(const struct domain *d, unsigned long n,
+                            unsigned int t)
+{
+    return sh_hash_key(d->arch.paging.shadow.hash_buckets, n, t);
 }
 
 #if SHADOW_AUDIT & (SHADOW_AUDIT_HASH|SHADOW_AUDIT_HASH_FULL)
@@ -1866,7 +1917,7 @@ static void sh_hash_audit_bucket(struct domain *d, int bucket)
         /* Wrong page of a multi-page shadow? */
         BUG_ON( !sp->u.sh.head );
         /* Wrong bucket? */
-        BUG_ON( sh_hash(__backpointer(sp), sp->u.sh.type) != bucket );
+        BUG_ON( sh_hash(d, __backpointer(sp), sp->u.sh.type) != bucket );
         /* Duplicate entry? */
         for ( x = next_shadow(sp); x; x = next_shadow(x) )
             BUG_ON( x->v.sh.back == sp->v.sh.back &&
@@ -1931,7 +1982,7 @@ static void sh_hash_audit(struct domain *d)
     if ( !(SHADOW_AUDIT_ENABLE) )
         return;
 
-    for ( i = 0; i < SHADOW_HASH_BUCKETS; i++ )
+    for ( i = 0; i < d->arch.paging.shadow.hash_buckets; i++ )
     {
         sh_hash_audit_bucket(d, i);
     }
@@ -1946,16 +1997,53 @@ static void sh_hash_audit(struct domain *d)
 static int shadow_hash_alloc(struct domain *d)
 {
     struct page_info **table;
+    unsigned int buckets = sh_hash_buckets(d);
 
     ASSERT(paging_locked_by_me(d));
     ASSERT(!d->arch.paging.shadow.hash_table);
 
-    table = xzalloc_array(struct page_info *, SHADOW_HASH_BUCKETS);
+    table = xzalloc_array(struct page_info *, buckets);
     if ( !table ) return 1;
     d->arch.paging.shadow.hash_table = table;
+    d->arch.paging.shadow.hash_buckets = buckets;
     return 0;
 }
 
+/* Rehash into a table sized for the current shadow pool.  Failing to
+ * allocate a new table just leaves the old one in place. */
+static void shadow_hash_resize(struct domain *d)
+{
+    struct page_info **table, **old = d->arch.paging.shadow.hash_table;
+    unsigned int i, buckets = sh_hash_buckets(d);
+    struct page_info *sp, *next;
+    key_t key;
+
+    ASSERT(paging_locked_by_me(d));
+    ASSERT(!d->arch.paging.shadow.hash_walking);
+
+    if ( !old || buckets == d->arch.paging.shadow.hash_buckets )
+        return;
+
+    table = xzalloc_array(struct page_info *, buckets);
+    if ( !table )
+        return;
+
+    for ( i = 0; i < d->arch.paging.shadow.hash_buckets; i++ )
+        for ( sp = old[i]; sp; sp = next )
+        {
+            next = next_shadow(sp);
+            key = sh_hash_key(buckets, __backpointer(sp), sp->u.sh.type);
+            set_next_shadow(sp, table[key]);
+            table[key] = sp;
+        }
+
+    d->arch.paging.shadow.hash_table = table;
+    d->arch.paging.shadow.hash_buckets = buckets;
+    xfree(old);
+
+    sh_hash_audit(d);
+}
+
 /* Tear down the hash table and return all memory to Xen.
  * This function does not care whether the table is populated. */
 static void shadow_hash_teardown(struct domain *d)
@@ -1982,7 +2070,7 @@ mfn_t shadow_hash_lookup(struct domain *d, unsigned long n, unsigned int t)
     sh_hash_audit(d);
 
     perfc_incr(shadow_hash_lookups);
-    key = sh_hash(n, t);
+    key = sh_hash(d, n, t);
     sh_hash_audit_bucket(d, key);
 
     sp = d->arch.paging.shadow.hash_table[key];
@@ -2035,7 +2123,7 @@ void shadow_hash_insert(struct domain *d, unsigned long n, unsigned int t,
     sh_hash_audit(d);
 
     perfc_incr(shadow_hash_inserts);
-    key = sh_hash(n, t);
+    key = sh_hash(d, n, t);
     sh_hash_audit_bucket(d, key);
 
     /* Insert this shadow at the top of the bucket */
@@ -2060,7 +2148,7 @@ void shadow_hash_delete(struct domain *d, unsigned long n, unsigned int t,
     sh_hash_audit(d);
 
     perfc_incr(shadow_hash_deletes);
-    key = sh_hash(n, t);
+    key = sh_hash(d, n, t);
     sh_hash_audit_bucket(d, key);
 
     sp = mfn_to_page(smfn);
@@ -2117,7 +2205,7 @@ static void hash_vcpu_foreach(struct vcpu *v, unsigned int callback_mask,
     ASSERT(d->arch.paging.shadow.hash_walking == 0);
     d->arch.paging.shadow.hash_walking = 1;
 
-    for ( i = 0; i < SHADOW_HASH_BUCKETS; i++ )
+    for ( i = 0; i < d->arch.paging.shadow.hash_buckets; i++ )
     {
         /* WARNING: This is not safe against changes to the hash table.
          * The callback *must* return non-zero if it has inserted or
@@ -2164,7 +2252,7 @@ static void hash_domain_foreach(struct domain *d,
     ASSERT(d->arch.paging.shadow.hash_walking == 0);
     d->arch.paging.shadow.hash_walking = 1;
 
-    for ( i = 0; i < SHADOW_HASH_BUCKETS; i++ )
+    for ( i = 0; i < d->arch.paging.shadow.hash_buckets; i++ )
     {
         /* WARNING: This is not safe against changes to the hash table.
          * The callback *must* return non-zero if it has inserted or
@@ -2912,7 +2912,7 @@ static int sh_page_fault(struct vcpu *v,
     SHADOW_PRINTK("%pv va=%#lx err=%#x, rip=%lx\n",
                   v, va, regs->error_code, regs->rip);
 
-    perfc_incr(shadow_fault);
+    perfc_incr_dom(shadow_fault, d);
 
 #if SHADOW_OPTIMIZATIONS & SHOPT_FAST_EMULATION
     /* If faulting frame is successfully emulated in last shadow fault
@@ -2942,6 +2942,7 @@ static int sh_page_fault(struct vcpu *v,
 #endif /* OOS */
 
             perfc_incr(shadow_fault_fast_emulate);
+            SHADOW_STAT_INCR(d, FAST_EMULATE);
             goto early_emulation;
         }
         else
@@ -2999,6 +3000,7 @@ static int sh_page_fault(struct vcpu *v,
                 regs->error_code ^= (PFEC_reserved_bit|PFEC_page_present);
                 reset_early_unshadow(v);
                 perfc_incr(shadow_fault_fast_gnp);
+                SHADOW_STAT_INCR(d, FAST_PROPAGATE);
                 SHADOW_PRINTK("fast path not-present\n");
                 trace_shadow_gen(TRC_SHADOW_FAST_PROPAGATE, va);
                 return 0;
@@ -3012,6 +3014,7 @@ static int sh_page_fault(struct vcpu *v,
                     | (va & ~PAGE_MASK);
             }
             perfc_incr(shadow_fault_fast_mmio);
+            SHADOW_STAT_INCR(d, FAST_MMIO);
             SHADOW_PRINTK("fast path mmio %#"PRIpaddr"\n", gpa);
             reset_early_unshadow(v);
             trace_shadow_gen(TRC_SHADOW_FAST_MMIO, va);
@@ -3124,6 +3127,7 @@ static int sh_page_fault(struct vcpu *v,
     if ( !walk_ok )
     {
         perfc_incr(shadow_fault_bail_real_fault);
+        SHADOW_STAT_INCR(d, REAL_FAULT);
         SHADOW_PRINTK("not a shadow fault\n");
         reset_early_unshadow(v);
         regs->error_code = gw.pfec & PFEC_arch_mask;
@@ -3301,7 +3305,7 @@ static int sh_page_fault(struct vcpu *v,
 #endif
          && (ft == ft_demand_write) )
     {
-        perfc_incr(shadow_fault_emulate_write);
+        perfc_incr_dom(shadow_fault_emulate_write, d);
         goto emulate;
     }
 
@@ -3338,6 +3342,7 @@ static int sh_page_fault(struct vcpu *v,
     }
 
     perfc_incr(shadow_fault_fixed);
+    SHADOW_STAT_INCR(d, FIXED);
     d->arch.paging.log_dirty.fault_count++;
     reset_early_unshadow(v);
 
@@ -3353,6 +3358,7 @@ static int sh_page_fault(struct vcpu *v,
  emulate:
     if ( !shadow_mode_refcounts(d) || !guest_mode(regs) )
         goto not_a_shadow_fault;
+    SHADOW_STAT_INCR(d, EMULATE);
 
     /*
      * We do not emulate user writes. Instead we use them as a hint that the
@@ -3589,7 +3595,8 @@ static int sh_page_fault(struct vcpu *v,
  mmio:
     if ( !guest_mode(regs) )
         goto not_a_shadow_fault;
-    perfc_incr(shadow_fault_mmio);
+    perfc_incr_dom(shadow_fault_mmio, d);
+    SHADOW_STAT_INCR(d, MMIO);
     sh_audit_gw(v, &gw);
     SHADOW_PRINTK("mmio %#"PRIpaddr"\n", gpa);
     shadow_audit_tables(v);
@@ -105,6 +105,10 @@ DECLARE_PER_CPU(uint32_t,trace_shadow_path_flags);
 #define TRACE_CLEAR_PATH_FLAGS                  \
     this_cpu(trace_shadow_path_flags) = 0
 
+/* Count an event in the domain's shadow statistics. */
+#define SHADOW_STAT_INCR(_d, _s)                                \
+    atomic_inc(&(_d)->arch.paging.shadow.stats[SHADOW_STAT_##_s])
+
 enum {
     TRCE_SFLAG_SET_AD,
     TRCE_SFLAG_SET_A,
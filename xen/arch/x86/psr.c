@@ -22,6 +22,7 @@
 #define PSR_CMT        (1<<0)
 #define PSR_CAT        (1<<1)
 #define PSR_CDP        (1<<2)
+#define PSR_MBA        (1<<3)
 
 struct psr_cat_cbm {
     union {
@@ -31,12 +32,19 @@ struct psr_cat_cbm {
             uint64_t data;
         };
     };
+    unsigned int mba_thrtl;     /* Memory bandwidth throttling, in %. */
     unsigned int ref;
 };
 
+/*
+ * MBA throttling values are selected by the same COS as the L3 masks, so a
+ * COS stands for a combination of masks and a throttling value.
+ */
 struct psr_cat_socket_info {
     unsigned int cbm_len;
     unsigned int cos_max;
+    unsigned int mba_thrtl_max;
+    bool mba_linear;
     struct psr_cat_cbm *cos_to_cbm;
     spinlock_t cbm_lock;
 };
@@ -51,6 +59,7 @@ struct psr_cmt *__read_mostly psr_cmt;
 static unsigned long *__read_mostly cat_socket_enable;
 static struct psr_cat_socket_info *__read_mostly cat_socket_info;
 static unsigned long *__read_mostly cdp_socket_enable;
+static unsigned long *__read_mostly mba_socket_enable;
 
 static unsigned int opt_psr;
 static unsigned int __initdata opt_rmid_max = 255;
@@ -103,6 +112,7 @@ static void __init parse_psr_param(char *s)
         parse_psr_bool(s, val_str, "cmt", PSR_CMT);
         parse_psr_bool(s, val_str, "cat", PSR_CAT);
         parse_psr_bool(s, val_str, "cdp", PSR_CDP);
+        parse_psr_bool(s, val_str, "mba", PSR_MBA);
 
         if ( val_str && !strcmp(s, "rmid_max") )
             opt_rmid_max = simple_strtoul(val_str, NULL, 0);
@@ -275,6 +285,11 @@ static inline bool_t cdp_is_enabled(unsigned int socket)
     return cdp_socket_enable && test_bit(socket, cdp_socket_enable);
 }
 
+static inline bool mba_is_enabled(unsigned int socket)
+{
+    return mba_socket_enable && test_bit(socket, mba_socket_enable);
+}
+
 int psr_get_cat_l3_info(unsigned int socket, uint32_t *cbm_len,
                         uint32_t *cos_max, uint32_t *flags)
 {
@@ -358,8 +373,10 @@ struct cos_cbm_info
 {
     unsigned int cos;
     bool_t cdp;
+    bool mba;
     uint64_t cbm_code;
     uint64_t cbm_data;
+    unsigned int mba_thrtl;
 };
 
 static void do_write_l3_cbm(void *data)
@@ -373,10 +390,14 @@ static void do_write_l3_cbm(void *data)
     }
     else
         wrmsrl(MSR_IA32_PSR_L3_MASK(info->cos), info->cbm_code);
+
+    if ( info->mba )
+        wrmsrl(MSR_IA32_PSR_MBA_MASK(info->cos), info->mba_thrtl);
 }
 
 static int write_l3_cbm(unsigned int socket, unsigned int cos,
-                        uint64_t cbm_code, uint64_t cbm_data, bool_t cdp)
+                        uint64_t cbm_code, uint64_t cbm_data, bool_t cdp,
+                        unsigned int mba_thrtl)
 {
     struct cos_cbm_info info =
     {
@@ -384,6 +405,8 @@ static int write_l3_cbm(unsigned int socket, unsigned int cos,
         .cbm_code = cbm_code,
         .cbm_data = cbm_data,
         .cdp = cdp,
+        .mba = mba_is_enabled(socket),
+        .mba_thrtl = mba_thrtl,
     };
 
     if ( socket == cpu_to_socket(smp_processor_id()) )
@@ -401,7 +424,8 @@ static int write_l3_cbm(unsigned int socket, unsigned int cos,
 }
 
 static int find_cos(struct psr_cat_cbm *map, unsigned int cos_max,
-                    uint64_t cbm_code, uint64_t cbm_data, bool_t cdp_enabled)
+                    uint64_t cbm_code, uint64_t cbm_data, bool_t cdp_enabled,
+                    unsigned int mba_thrtl)
 {
     unsigned int cos;
 
@@ -410,7 +434,8 @@ static int find_cos(struct psr_cat_cbm *map, unsigned int cos_max,
         if ( (map[cos].ref || cos == 0) &&
              ((!cdp_enabled && map[cos].cbm == cbm_code) ||
               (cdp_enabled && map[cos].code == cbm_code &&
-                              map[cos].data == cbm_data)) )
+                              map[cos].data == cbm_data)) &&
+             map[cos].mba_thrtl == mba_thrtl )
             return cos;
     }
 
@@ -434,11 +459,70 @@ static int pick_avail_cos(struct psr_cat_cbm *map, unsigned int cos_max,
     return -ENOENT;
 }
 
+/*
+ * Move @d to a COS with these masks and throttling value.  Called with
+ * info->cbm_lock held, which is dropped.
+ */
+static int psr_set_cos(struct domain *d, unsigned int socket,
+                       struct psr_cat_socket_info *info, uint64_t cbm_code,
+                       uint64_t cbm_data, unsigned int mba_thrtl)
+{
+    unsigned int old_cos = d->arch.psr_cos_ids[socket];
+    unsigned int cos_max = info->cos_max;
+    bool_t cdp_enabled = cdp_is_enabled(socket);
+    struct psr_cat_cbm *map = info->cos_to_cbm;
+    int cos, ret;
+
+    cos = find_cos(map, cos_max, cbm_code, cbm_data, cdp_enabled, mba_thrtl);
+    if ( cos >= 0 )
+    {
+        if ( cos == old_cos )
+        {
+            spin_unlock(&info->cbm_lock);
+            return 0;
+        }
+    }
+    else
+    {
+        cos = pick_avail_cos(map, cos_max, old_cos);
+        if ( cos < 0 )
+        {
+            spin_unlock(&info->cbm_lock);
+            return cos;
+        }
+
+        /* We try to avoid writing MSR. */
+        if ( (cdp_enabled &&
+             (map[cos].code != cbm_code || map[cos].data != cbm_data)) ||
+             (!cdp_enabled && map[cos].cbm != cbm_code) ||
+             map[cos].mba_thrtl != mba_thrtl )
+        {
+            ret = write_l3_cbm(socket, cos, cbm_code, cbm_data, cdp_enabled,
+                               mba_thrtl);
+            if ( ret )
+            {
+                spin_unlock(&info->cbm_lock);
+                return ret;
+            }
+            map[cos].code = cbm_code;
+            map[cos].data = cbm_data;
+            map[cos].mba_thrtl = mba_thrtl;
+        }
+    }
+
+    map[cos].ref++;
+    map[old_cos].ref--;
+    spin_unlock(&info->cbm_lock);
+
+    d->arch.psr_cos_ids[socket] = cos;
+
+    return 0;
+}
+
 int psr_set_l3_cbm(struct domain *d, unsigned int socket,
                    uint64_t cbm, enum cbm_type type)
 {
-    unsigned int old_cos, cos_max;
-    int cos, ret;
+    unsigned int old_cos;
     uint64_t cbm_data, cbm_code;
     bool_t cdp_enabled = cdp_is_enabled(socket);
     struct psr_cat_cbm *map;
@@ -454,10 +538,12 @@ int psr_set_l3_cbm(struct domain *d, unsigned int socket,
                           type == PSR_CBM_TYPE_L3_DATA) )
         return -ENXIO;
 
-    cos_max = info->cos_max;
-    old_cos = d->arch.psr_cos_ids[socket];
     map = info->cos_to_cbm;
 
+    spin_lock(&info->cbm_lock);
+
+    old_cos = d->arch.psr_cos_ids[socket];
+
     switch ( type )
     {
     case PSR_CBM_TYPE_L3:
@@ -477,53 +563,80 @@ int psr_set_l3_cbm(struct domain *d, unsigned int socket,
 
     default:
         ASSERT_UNREACHABLE();
+        spin_unlock(&info->cbm_lock);
         return -EINVAL;
     }
 
-    spin_lock(&info->cbm_lock);
-    cos = find_cos(map, cos_max, cbm_code, cbm_data, cdp_enabled);
-    if ( cos >= 0 )
-    {
-        if ( cos == old_cos )
-        {
-            spin_unlock(&info->cbm_lock);
-            return 0;
-        }
-    }
-    else
-    {
-        cos = pick_avail_cos(map, cos_max, old_cos);
-        if ( cos < 0 )
-        {
-            spin_unlock(&info->cbm_lock);
-            return cos;
-        }
+    return psr_set_cos(d, socket, info, cbm_code, cbm_data,
+                       map[old_cos].mba_thrtl);
+}
 
-        /* We try to avoid writing MSR. */
-        if ( (cdp_enabled &&
-             (map[cos].code != cbm_code || map[cos].data != cbm_data)) ||
-             (!cdp_enabled && map[cos].cbm != cbm_code) )
-        {
-            ret = write_l3_cbm(socket, cos, cbm_code, cbm_data, cdp_enabled);
-            if ( ret )
-            {
-                spin_unlock(&info->cbm_lock);
-                return ret;
-            }
-            map[cos].code = cbm_code;
-            map[cos].data = cbm_data;
-        }
-    }
+int psr_get_mba_info(unsigned int socket, uint32_t *thrtl_max,
+                     uint32_t *cos_max, uint32_t *flags)
+{
+    struct psr_cat_socket_info *info = get_cat_socket_info(socket);
 
-    map[cos].ref++;
-    map[old_cos].ref--;
-    spin_unlock(&info->cbm_lock);
+    if ( IS_ERR(info) )
+        return PTR_ERR(info);
 
-    d->arch.psr_cos_ids[socket] = cos;
+    if ( !mba_is_enabled(socket) )
+        return -ENOENT;
+
+    *thrtl_max = info->mba_thrtl_max;
+    *cos_max = info->cos_max;
+
+    *flags = 0;
+    if ( info->mba_linear )
+        *flags |= XEN_SYSCTL_PSR_MBA_LINEAR;
+
+    return 0;
+}
+
+int psr_get_mba_thrtl(struct domain *d, unsigned int socket,
+                      uint32_t *thrtl)
+{
+    struct psr_cat_socket_info *info = get_cat_socket_info(socket);
+
+    if ( IS_ERR(info) )
+        return PTR_ERR(info);
+
+    if ( !mba_is_enabled(socket) )
+        return -ENOENT;
+
+    *thrtl = info->cos_to_cbm[d->arch.psr_cos_ids[socket]].mba_thrtl;
 
     return 0;
 }
 
+int psr_set_mba_thrtl(struct domain *d, unsigned int socket, uint32_t thrtl)
+{
+    struct psr_cat_socket_info *info = get_cat_socket_info(socket);
+    struct psr_cat_cbm *old;
+
+    if ( IS_ERR(info) )
+        return PTR_ERR(info);
+
+    if ( !mba_is_enabled(socket) )
+        return -ENOENT;
+
+    if ( thrtl > info->mba_thrtl_max )
+        return -EINVAL;
+
+    /*
+     * Linear throttling goes in steps of 100 - max, non-linear throttling
+     * only knows powers of 2: round down to what the hardware would use.
+     */
+    if ( info->mba_linear )
+        thrtl -= thrtl % (100 - info->mba_thrtl_max);
+    else if ( thrtl & (thrtl - 1) )
+        thrtl = 1u << (fls(thrtl) - 1);
+
+    spin_lock(&info->cbm_lock);
+    old = &info->cos_to_cbm[d->arch.psr_cos_ids[socket]];
+
+    return psr_set_cos(d, socket, info, old->code, old->data, thrtl);
+}
+
 /* Called with domain lock held, no extra lock needed for 'psr_cos_ids' */
 static void psr_free_cos(struct domain *d)
 {
@@ -582,7 +695,7 @@ static int cat_cpu_prepare(unsigned int cpu)
 
 static void cat_cpu_init(void)
 {
-    unsigned int eax, ebx, ecx, edx;
+    unsigned int eax, ebx, ecx, edx, res;
     struct psr_cat_socket_info *info;
     unsigned int socket;
     unsigned int cpu = smp_processor_id();
@@ -596,8 +709,8 @@ static void cat_cpu_init(void)
     if ( test_bit(socket, cat_socket_enable) )
         return;
 
-    cpuid_count(PSR_CPUID_LEVEL_CAT, 0, &eax, &ebx, &ecx, &edx);
-    if ( ebx & PSR_RESOURCE_TYPE_L3 )
+    cpuid_count(PSR_CPUID_LEVEL_CAT, 0, &eax, &res, &ecx, &edx);
+    if ( res & PSR_RESOURCE_TYPE_L3 )
     {
         cpuid_count(PSR_CPUID_LEVEL_CAT, 1, &eax, &ebx, &ecx, &edx);
         info = cat_socket_info + socket;
@@ -630,6 +743,24 @@ static void cat_cpu_init(void)
 
             set_bit(socket, cdp_socket_enable);
         }
+
+        /* MBA shares the COS, so only as many as both support are usable. */
+        if ( (res & PSR_RESOURCE_TYPE_MBA) && (opt_psr & PSR_MBA) &&
+             mba_socket_enable )
+        {
+            cpuid_count(PSR_CPUID_LEVEL_CAT, 3, &eax, &ebx, &ecx, &edx);
+            info->mba_thrtl_max = (eax & 0xfff) + 1;
+            info->mba_linear = ecx & PSR_MBA_LINEAR_CAPABILITY;
+            if ( info->mba_thrtl_max < 100 )
+            {
+                info->cos_max = min(info->cos_max, edx & 0xffff);
+                set_bit(socket, mba_socket_enable);
+                printk(XENLOG_INFO "MBA: enabled on socket %u, "
+                       "thrtl_max:%u, linear:%s\n", socket,
+                       info->mba_thrtl_max, info->mba_linear ? "yes" : "no");
+            }
+        }
+
         printk(XENLOG_INFO "CAT: enabled on socket %u, cos_max:%u, cbm_len:%u, CDP:%s\n",
                socket, info->cos_max, info->cbm_len,
                cdp_is_enabled(socket) ? "on" : "off");
@@ -653,6 +784,9 @@ static void cat_cpu_fini(unsigned int cpu)
         if ( cdp_is_enabled(socket) )
             clear_bit(socket, cdp_socket_enable);
 
+        if ( mba_is_enabled(socket) )
+            clear_bit(socket, mba_socket_enable);
+
         clear_bit(socket, cat_socket_enable);
     }
 }
@@ -676,6 +810,7 @@ static void __init init_psr_cat(void)
     cat_socket_enable = xzalloc_array(unsigned long, BITS_TO_LONGS(nr_sockets));
     cat_socket_info = xzalloc_array(struct psr_cat_socket_info, nr_sockets);
     cdp_socket_enable = xzalloc_array(unsigned long, BITS_TO_LONGS(nr_sockets));
+    mba_socket_enable = xzalloc_array(unsigned long, BITS_TO_LONGS(nr_sockets));
 
     if ( !cat_socket_enable || !cat_socket_info )
         psr_cat_free();
@@ -738,7 +873,8 @@ static int __init psr_presmp_init(void)
     if ( (opt_psr & PSR_CMT) && opt_rmid_max )
         init_psr_cmt(opt_rmid_max);
 
-    if ( opt_psr & PSR_CAT )
+    /* MBA is configured through the same COS as CAT. */
+    if ( opt_psr & (PSR_CAT | PSR_MBA) )
         init_psr_cat();
 
     if ( psr_cpu_prepare(0) )
@@ -13,6 +13,7 @@
 #include <xen/paging.h>
 #include <xen/pfn.h>
 #include <xen/sched.h>
+#include <xen/smp.h>
 #include <xen/softirq.h>
 
 #include <asm/bzimage.h>
@@ -29,18 +30,65 @@
 #define L3_PROT (BASE_PROT|_PAGE_DIRTY)
 #define L4_PROT (BASE_PROT|_PAGE_DIRTY)
 
-static __init void dom0_update_physmap(struct domain *d, unsigned long pfn,
-                                       unsigned long mfn,
-                                       unsigned long vphysmap_s)
+static __init void dom0_update_p2m(struct domain *d, unsigned long pfn,
+                                   unsigned long mfn,
+                                   unsigned long vphysmap_s)
 {
     if ( !is_pv_32bit_domain(d) )
         ((unsigned long *)vphysmap_s)[pfn] = mfn;
     else
         ((unsigned int *)vphysmap_s)[pfn] = mfn;
+}
 
+static __init void dom0_update_physmap(struct domain *d, unsigned long pfn,
+                                       unsigned long mfn,
+                                       unsigned long vphysmap_s)
+{
+    dom0_update_p2m(d, pfn, mfn, vphysmap_s);
     set_gpfn_from_mfn(mfn, pfn);
 }
 
+/*
+ * The M2P entries for the bulk of dom0's memory get written by all online
+ * CPUs.  Unlike dom0's phys->machine table, which is only mapped by dom0's
+ * page tables (in use on just this CPU while building), the M2P is mapped
+ * everywhere.
+ */
+struct m2p_fill {
+    unsigned long mfn, pfn, nr;
+    bool reverse;
+    unsigned long next;
+};
+
+#define M2P_FILL_BATCH    (1UL << 12)
+/* Below this many pages, interrupting the other CPUs isn't worth it. */
+#define M2P_FILL_PARALLEL (1UL << 16)
+
+static void __init smp_fill_m2p(void *data)
+{
+    struct m2p_fill *f = data;
+    unsigned long i, end;
+
+    while ( (i = arch_fetch_and_add(&f->next, M2P_FILL_BATCH)) < f->nr )
+        for ( end = min(i + M2P_FILL_BATCH, f->nr); i < end; i++ )
+            set_gpfn_from_mfn(f->mfn + i,
+                              f->reverse ? f->pfn - i : f->pfn + i);
+}
+
+/* Map @nr MFNs from @mfn to PFNs counting up (or down) from @pfn. */
+static __init void dom0_fill_m2p(unsigned long mfn, unsigned long pfn,
+                                 unsigned long nr, bool reverse)
+{
+    struct m2p_fill f = {
+        .mfn = mfn, .pfn = pfn, .nr = nr, .reverse = reverse,
+    };
+
+    if ( nr < M2P_FILL_PARALLEL || num_online_cpus() == 1 )
+        smp_fill_m2p(&f);
+    else
+        on_selected_cpus(&cpu_online_map, smp_fill_m2p, &f, 1);
+}
+
 static __init void mark_pv_pt_pages_rdonly(struct domain *d,
                                            l4_pgentry_t *l4start,
                                            unsigned long vpt_start,
@@ -806,20 +854,30 @@ int __init dom0_construct_pv(struct domain *d,
 #endif
     while ( pfn < nr_pages )
     {
+        unsigned long chunk_pfn = pfn;
+
         if ( (page = alloc_chunk(d, nr_pages - d->tot_pages)) == NULL )
             panic("Not enough RAM for DOM0 reservation");
+        mfn = page_to_mfn(page);
         while ( pfn < d->tot_pages )
         {
-            mfn = page_to_mfn(page);
 #ifndef NDEBUG
 #define pfn (nr_pages - 1 - (pfn - (alloc_epfn - alloc_spfn)))
 #endif
-            dom0_update_physmap(d, pfn, mfn, vphysmap_start);
+            dom0_update_p2m(d, pfn, page_to_mfn(page), vphysmap_start);
 #undef pfn
             page++; pfn++;
             if ( !(pfn & 0xfffff) )
                 process_pending_softirqs();
         }
+#ifndef NDEBUG
+        dom0_fill_m2p(mfn,
+                      nr_pages - 1 - (chunk_pfn - (alloc_epfn - alloc_spfn)),
+                      pfn - chunk_pfn, true);
+#else
+        dom0_fill_m2p(mfn, chunk_pfn, pfn - chunk_pfn, false);
+#endif
+        process_pending_softirqs();
     }
 
     if ( initrd_len != 0 )
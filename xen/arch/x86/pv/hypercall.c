@@ -90,6 +90,7 @@ static const hypercall_table_t pv_hypercall_table[] = {
 void pv_hypercall(struct cpu_user_regs *regs)
 {
     struct vcpu *curr = current;
+    struct hypercall_stats_ctxt stats;
     unsigned long eax;
 
     ASSERT(guest_kernel_mode(curr, regs));
@@ -108,6 +109,10 @@ void pv_hypercall(struct cpu_user_regs *regs)
 
     curr->hcall_preempted = false;
 
+    if ( unlikely(opt_hypercall_stats) )
+        hypercall_stats_begin(&stats, eax, is_pv_32bit_vcpu(curr) ? regs->ebx
+                                                                  : regs->rdi);
+
     if ( !is_pv_32bit_vcpu(curr) )
     {
         unsigned long rdi = regs->rdi;
@@ -204,6 +209,9 @@ void pv_hypercall(struct cpu_user_regs *regs)
 #endif
     }
 
+    if ( unlikely(opt_hypercall_stats) )
+        hypercall_stats_end(&stats, curr);
+
     /*
      * PV guests use SYSCALL or INT $0x82 to make a hypercall, both of which
      * have trap semantics.  If the hypercall has been preempted, rewind the
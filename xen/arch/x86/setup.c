@@ -151,6 +151,10 @@ static void __init parse_smap_param(char *s)
 }
 custom_param("smap", parse_smap_param);
 
+/* pcid: Tag the address spaces of 64-bit PV guests (default off). */
+static bool_t __initdata opt_pcid;
+boolean_param("pcid", opt_pcid);
+
 bool_t __read_mostly acpi_disabled;
 bool_t __initdata acpi_force;
 static char __initdata acpi_param[10] = "";
@@ -1486,6 +1490,10 @@ void __init noreturn __start_xen(unsigned long mbi_p)
     if ( cpu_has_fsgsbase )
         set_in_cr4(X86_CR4_FSGSBASE);
 
+    /* Flushing one address from all PCIDs needs INVPCID. */
+    if ( opt_pcid && cpu_has_pcid && cpu_has_invpcid )
+        set_in_cr4(X86_CR4_PCIDE);
+
     init_idle_domain();
 
     this_cpu(stubs.addr) = alloc_stub_page(smp_processor_id(),
@@ -197,20 +197,72 @@ void send_IPI_mask_phys(const cpumask_t *mask, int vector)
     local_irq_restore(flags);
 }
 
-static DEFINE_SPINLOCK(flush_lock);
-static cpumask_t flush_cpumask;
-static const void *flush_va;
-static unsigned int flush_flags;
+/*
+ * Every CPU can have one flush outstanding, described by its own request,
+ * so shootdowns started by different CPUs don't serialise behind a single
+ * global lock.  A CPU receiving the IPI serves all requests naming it in
+ * one go, merging them into a single local flush.
+ */
+struct flush_request {
+    cpumask_t mask;          /* CPUs yet to perform the flush */
+    const void *va;
+    unsigned int flags;
+    u32 stamp;               /* TLB clock when the request was made */
+};
+
+static DEFINE_PER_CPU(struct flush_request, flush_request);
+static DEFINE_PER_CPU(cpumask_t, flush_served);
+static cpumask_t flush_initiators;
 
 void invalidate_interrupt(struct cpu_user_regs *regs)
 {
-    unsigned int flags = flush_flags;
+    unsigned int cpu = smp_processor_id(), initiator, flags = 0;
+    const void *va = NULL;
+    bool_t found = 0;
+    cpumask_t *served = &this_cpu(flush_served);
+
     ack_APIC_irq();
     perfc_incr(ipis);
+
+    cpumask_clear(served);
+    for_each_cpu ( initiator, &flush_initiators )
+    {
+        const struct flush_request *req = &per_cpu(flush_request, initiator);
+        unsigned int f;
+
+        if ( !cpumask_test_cpu(cpu, &req->mask) )
+            continue;
+        smp_rmb();
+        f = req->flags;
+
+        /* A full flush since the request was made already covered the TLB. */
+        if ( !NEED_FLUSH(this_cpu(tlbflush_time), req->stamp) )
+            f &= ~(FLUSH_TLB | FLUSH_TLB_GLOBAL);
+
+        if ( !found )
+        {
+            flags = f;
+            va = req->va;
+            found = 1;
+        }
+        else if ( f != flags || req->va != va )
+        {
+            /* Different areas: flush everything asked for, in full. */
+            flags = (flags | f) & ~(FLUSH_ORDER_MASK | FLUSH_VA_VALID);
+            va = NULL;
+        }
+
+        cpumask_set_cpu(initiator, served);
+    }
+
+    /* Always sync lazy state, sync_vcpu_execstate() relies on it. */
     if ( __sync_local_execstate() )
         flags &= ~(FLUSH_TLB | FLUSH_TLB_GLOBAL);
-    flush_area_local(flush_va, flags);
-    cpumask_clear_cpu(smp_processor_id(), &flush_cpumask);
+    if ( flags & ~FLUSH_ORDER_MASK )
+        flush_area_local(va, flags);
+
+    for_each_cpu ( initiator, served )
+        cpumask_clear_cpu(cpu, &per_cpu(flush_request, initiator).mask);
 }
 
 void flush_area_mask(const cpumask_t *mask, const void *va, unsigned int flags)
@@ -225,15 +277,27 @@ void flush_area_mask(const cpumask_t *mask, const void *va, unsigned int flags)
     if ( (flags & ~FLUSH_ORDER_MASK) &&
          !cpumask_subset(mask, cpumask_of(cpu)) )
     {
-        spin_lock(&flush_lock);
-        cpumask_and(&flush_cpumask, mask, &cpu_online_map);
-        cpumask_clear_cpu(cpu, &flush_cpumask);
-        flush_va      = va;
-        flush_flags   = flags;
-        send_IPI_mask(&flush_cpumask, INVALIDATE_TLB_VECTOR);
-        while ( !cpumask_empty(&flush_cpumask) )
+        struct flush_request *req = &this_cpu(flush_request);
+
+        req->va    = va;
+        req->flags = flags;
+        req->stamp = tlbflush_current_time();
+        smp_wmb();
+        cpumask_and(&req->mask, mask, &cpu_online_map);
+        cpumask_clear_cpu(cpu, &req->mask);
+        cpumask_set_cpu(cpu, &flush_initiators);
+
+        /*
+         * Targets which already served the request (while handling another
+         * CPU's IPI) have dropped out of the mask and don't get an IPI.
+         * Interrupts stay enabled while waiting, so requests from other
+         * CPUs naming this one are served meanwhile.
+         */
+        send_IPI_mask(&req->mask, INVALIDATE_TLB_VECTOR);
+        while ( !cpumask_empty(&req->mask) )
             cpu_relax();
-        spin_unlock(&flush_lock);
+
+        cpumask_clear_cpu(cpu, &flush_initiators);
     }
 }
 
@@ -184,12 +184,84 @@ long arch_do_sysctl(
                 ret = -EFAULT;
             break;
 
+        case XEN_SYSCTL_PSR_CAT_get_mba_info:
+            ret = psr_get_mba_info(sysctl->u.psr_cat_op.target,
+                                   &sysctl->u.psr_cat_op.u.mba_info.thrtl_max,
+                                   &sysctl->u.psr_cat_op.u.mba_info.cos_max,
+                                   &sysctl->u.psr_cat_op.u.mba_info.flags);
+
+            if ( !ret && __copy_field_to_guest(u_sysctl, sysctl, u.psr_cat_op) )
+                ret = -EFAULT;
+            break;
+
         default:
             ret = -EOPNOTSUPP;
             break;
         }
         break;
 
+    case XEN_SYSCTL_irq_stats:
+    {
+        struct xen_sysctl_irq_stats *stats = &sysctl->u.irq_stats;
+        struct domain *d;
+        struct vcpu *v;
+
+        if ( stats->pad[0] || stats->pad[1] || stats->pad[2] )
+        {
+            ret = -EINVAL;
+            break;
+        }
+
+        d = rcu_lock_domain_by_id(stats->domid);
+        if ( d == NULL )
+        {
+            ret = -ESRCH;
+            break;
+        }
+
+        stats->extint_exits = 0;
+        stats->guest_irq_exits = 0;
+        stats->pi_wakeups = 0;
+        stats->apic_icr_exits = 0;
+        stats->apic_eoi_exits = 0;
+        stats->apic_tpr_exits = 0;
+        stats->apic_timer_exits = 0;
+        stats->apic_other_exits = 0;
+        if ( !is_hvm_domain(d) )
+            ret = -EINVAL;
+        else
+            for_each_vcpu ( d, v )
+            {
+                const struct hvm_irq_stats *vs = v->arch.hvm_vcpu.irq_stats;
+
+                stats->extint_exits += vs->extint_exits;
+                stats->guest_irq_exits += vs->guest_irq_exits;
+                stats->pi_wakeups += vs->pi_wakeups;
+                stats->apic_icr_exits += vs->apic_icr_exits;
+                stats->apic_eoi_exits += vs->apic_eoi_exits;
+                stats->apic_tpr_exits += vs->apic_tpr_exits;
+                stats->apic_timer_exits += vs->apic_timer_exits;
+                stats->apic_other_exits += vs->apic_other_exits;
+            }
+        rcu_unlock_domain(d);
+
+        if ( !ret && __copy_to_guest(u_sysctl, sysctl, 1) )
+            ret = -EFAULT;
+        break;
+    }
+
+    case XEN_SYSCTL_hypercall_stats:
+        ret = hypercall_stats_op(&sysctl->u.hypercall_stats);
+        if ( !ret && __copy_to_guest(u_sysctl, sysctl, 1) )
+            ret = -EFAULT;
+        break;
+
+    case XEN_SYSCTL_compact_op:
+        ret = compact_op(&sysctl->u.compact_op);
+        if ( !ret && __copy_to_guest(u_sysctl, sysctl, 1) )
+            ret = -EFAULT;
+        break;
+
     case XEN_SYSCTL_get_cpu_levelling_caps:
         sysctl->u.cpu_levelling_caps.caps = levelling_caps;
         if ( __copy_field_to_guest(u_sysctl, sysctl, u.cpu_levelling_caps.caps) )
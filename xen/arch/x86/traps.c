@@ -1511,7 +1511,7 @@ void do_page_fault(struct cpu_user_regs *regs)
     if ( debugger_trap_entry(TRAP_page_fault, regs) )
         return;
 
-    perfc_incr(page_faults);
+    perfc_incr_dom(page_faults, current->domain);
 
     if ( unlikely(fixup_page_fault(addr, regs) != 0) )
         return;
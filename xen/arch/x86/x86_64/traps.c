@@ -256,6 +256,8 @@ void do_double_fault(struct cpu_user_regs *regs)
 
 void toggle_guest_mode(struct vcpu *v)
 {
+    unsigned long cr3, pcid;
+
     if ( is_pv_32bit_vcpu(v) )
         return;
     if ( cpu_has_fsgsbase )
@@ -268,8 +270,23 @@ void toggle_guest_mode(struct vcpu *v)
     v->arch.flags ^= TF_kernel_mode;
     asm volatile ( "swapgs" );
     update_cr3(v);
-    /* Don't flush user global mappings from the TLB. Don't tick TLB clock. */
-    asm volatile ( "mov %0, %%cr3" : : "r" (v->arch.cr3) : "memory" );
+
+    /*
+     * Don't flush user global mappings from the TLB. Don't tick TLB clock.
+     * With PCIDs the mode being entered keeps its translations too, unless
+     * its page tables were replaced without any flush since it last ran.
+     */
+    cr3 = v->arch.cr3;
+    pcid = pv_cr3_pcid(v);
+    if ( pcid )
+    {
+        cr3 |= pcid;
+        if ( pcid == PCID_PV_USER && (v->arch.flags & TF_flush_user) )
+            v->arch.flags &= ~TF_flush_user;
+        else
+            cr3 |= X86_CR3_NOFLUSH;
+    }
+    asm volatile ( "mov %0, %%cr3" : : "r" (cr3) : "memory" );
 
     if ( !(v->arch.flags & TF_kernel_mode) )
         return;
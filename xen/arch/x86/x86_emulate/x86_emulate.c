@@ -2997,6 +2997,54 @@ x86_emulate(
 
     generate_exception_if(state->not_64bit && mode_64bit(), EXC_UD);
 
+    /*
+     * Plain moves between a register and memory make up nearly all
+     * emulated device accesses.  Their operands are fully known from the
+     * decode, so bypass the generic operand fetch and writeback.
+     */
+    if ( ea.type == OP_MEM && !lock_prefix )
+    {
+        unsigned long *reg, val = 0;
+        unsigned int bytes;
+
+        switch ( ctxt->opcode )
+        {
+        case 0x88 ... 0x89: /* mov r,m */
+            bytes = (d & ByteOp) ? 1 : op_bytes;
+            reg = decode_register(modrm_reg, &_regs,
+                                  (d & ByteOp) && !rex_prefix);
+            fail_if(!ops->write);
+            rc = ops->write(ea.mem.seg, ea.mem.off, reg, bytes, ctxt);
+            if ( rc != X86EMUL_OKAY )
+                goto done;
+            goto complete_insn;
+
+        case 0x8a ... 0x8b: /* mov m,r */
+            bytes = (d & ByteOp) ? 1 : op_bytes;
+            reg = decode_register(modrm_reg, &_regs,
+                                  (d & ByteOp) && !rex_prefix);
+            goto movzx_fast;
+
+        case X86EMUL_OPC(0x0f, 0xb6): /* movzx m8,r{16,32,64} */
+        case X86EMUL_OPC(0x0f, 0xb7): /* movzx m16,r{16,32,64} */
+            bytes = (b & 1) + 1;
+            reg = decode_register(modrm_reg, &_regs, 0);
+        movzx_fast:
+            if ( (rc = read_ulong(ea.mem.seg, ea.mem.off, &val, bytes,
+                                  ctxt, ops)) )
+                goto done;
+            /* The 4-byte case *is* correct: in 64-bit mode we zero-extend. */
+            switch ( b == 0x8a ? 1 : op_bytes )
+            {
+            case 1: *(uint8_t  *)reg = val; break;
+            case 2: *(uint16_t *)reg = val; break;
+            case 4: *reg = (uint32_t)val; break; /* 64b: zero-ext */
+            case 8: *reg = val; break;
+            }
+            goto complete_insn;
+        }
+    }
+
     if ( ea.type == OP_REG )
         ea.reg = decode_register(modrm_rm, &_regs,
                                  (d & ByteOp) && !rex_prefix);
@@ -15,7 +15,9 @@ CHECK_TYPE(domid);
 #undef compat_domid_t
 #undef xen_domid_t
 
+CHECK_reservation_range;
 CHECK_vmemrange;
+CHECK_mem_access_run;
 
 #ifdef CONFIG_HAS_PASSTHROUGH
 struct get_reserved_device_memory {
@@ -232,6 +234,7 @@ int compat_memory_op(unsigned int cmd, XEN_GUEST_HANDLE_PARAM(void) compat)
         case XENMEM_maximum_reservation:
         case XENMEM_maximum_gpfn:
         case XENMEM_maximum_ram_page:
+        case XENMEM_decrease_reservation_range:
             nat.hnd = compat;
             break;
 
@@ -329,11 +332,14 @@ int compat_memory_op(unsigned int cmd, XEN_GUEST_HANDLE_PARAM(void) compat)
             guest_from_compat_handle((_d_)->pfn_list, (_s_)->pfn_list)
 #define XLAT_mem_access_op_HNDL_access_list(_d_, _s_)                   \
             guest_from_compat_handle((_d_)->access_list, (_s_)->access_list)
+#define XLAT_mem_access_op_HNDL_runs(_d_, _s_)                          \
+            guest_from_compat_handle((_d_)->runs, (_s_)->runs)
             
             XLAT_mem_access_op(nat.mao, &cmp.mao);
             
 #undef XLAT_mem_access_op_HNDL_pfn_list
 #undef XLAT_mem_access_op_HNDL_access_list
+#undef XLAT_mem_access_op_HNDL_runs
             
             break;
 
@@ -523,6 +529,7 @@ int compat_memory_op(unsigned int cmd, XEN_GUEST_HANDLE_PARAM(void) compat)
         case XENMEM_add_to_physmap:
         case XENMEM_remove_from_physmap:
         case XENMEM_access_op:
+        case XENMEM_decrease_reservation_range:
             break;
 
         case XENMEM_get_vnumainfo:
@@ -22,6 +22,10 @@ CHECK_sched_shutdown;
 CHECK_sched_remote_shutdown;
 #undef xen_sched_remote_shutdown
 
+#define xen_sched_yield_to sched_yield_to
+CHECK_sched_yield_to;
+#undef xen_sched_yield_to
+
 static int compat_poll(struct compat_sched_poll *compat)
 {
     struct sched_poll native;
@@ -576,7 +576,25 @@ static int cpupool_cpu_remove(unsigned int cpu)
          * allowed only for CPUs in pool0.
          */
         cpumask_clear_cpu(cpu, cpupool0->cpu_valid);
-        ret = 0;
+
+        /*
+         * Send the vcpus away now, while the system is live and the
+         * scheduler can place them properly, rather than later from
+         * __cpu_disable() with the whole machine stopped.  None can come
+         * back, as the cpu is no longer valid for the pool.  Whatever is
+         * still there (a vcpu running in Xen which can't be migrated right
+         * now) gets moved during the stop phase as before.  A temporarily
+         * pinned vcpu can't be moved at all, so fail the unplug here,
+         * rather than hitting the BUG() in __cpu_disable().
+         */
+        rcu_read_lock(&domlist_read_lock);
+        ret = cpu_disable_scheduler(cpu);
+        rcu_read_unlock(&domlist_read_lock);
+
+        if ( ret == -EAGAIN )
+            ret = 0;
+        else if ( ret )
+            cpumask_set_cpu(cpu, cpupool0->cpu_valid);
     }
 
     if ( !ret )
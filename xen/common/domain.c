@@ -71,6 +71,74 @@ struct vcpu *idle_vcpu[NR_CPUS] __read_mostly;
 
 vcpu_info_t dummy_vcpu_info;
 
+/*
+ * A few domain structures are kept allocated and cleared, so that
+ * domain_create() doesn't need to go to the heap for one.  The pool is
+ * refilled from a tasklet, i.e. once the CPU that drained it goes idle.
+ */
+static unsigned int __read_mostly opt_domain_pool = 4;
+integer_param("domain_pool", opt_domain_pool);
+
+static DEFINE_SPINLOCK(domain_pool_lock);
+static struct domain *domain_pool;
+static unsigned int domain_pool_count;
+
+static void domain_pool_refill(unsigned long unused)
+{
+    struct domain *d;
+
+    for ( ; ; )
+    {
+        spin_lock(&domain_pool_lock);
+        if ( domain_pool_count >= opt_domain_pool )
+        {
+            spin_unlock(&domain_pool_lock);
+            break;
+        }
+        spin_unlock(&domain_pool_lock);
+
+        if ( (d = alloc_domain_struct()) == NULL )
+            break;
+
+        spin_lock(&domain_pool_lock);
+        d->next_in_list = domain_pool;
+        domain_pool = d;
+        domain_pool_count++;
+        spin_unlock(&domain_pool_lock);
+    }
+}
+static DECLARE_TASKLET(domain_pool_tasklet, domain_pool_refill, 0);
+
+static struct domain *claim_domain_struct(void)
+{
+    struct domain *d;
+
+    spin_lock(&domain_pool_lock);
+    if ( (d = domain_pool) != NULL )
+    {
+        domain_pool = d->next_in_list;
+        domain_pool_count--;
+    }
+    spin_unlock(&domain_pool_lock);
+
+    if ( opt_domain_pool && system_state >= SYS_STATE_active )
+        tasklet_schedule(&domain_pool_tasklet);
+
+    if ( d == NULL )
+        return alloc_domain_struct();
+
+    d->next_in_list = NULL;
+    return d;
+}
+
+static int __init domain_pool_init(void)
+{
+    if ( opt_domain_pool )
+        tasklet_schedule(&domain_pool_tasklet);
+    return 0;
+}
+__initcall(domain_pool_init);
+
 static void __domain_finalise_shutdown(struct domain *d)
 {
     struct vcpu *v;
@@ -264,7 +332,7 @@ struct domain *domain_create(domid_t domid, unsigned int domcr_flags,
     int err, init_status = 0;
     int poolid = CPUPOOLID_NONE;
 
-    if ( (d = alloc_domain_struct()) == NULL )
+    if ( (d = claim_domain_struct()) == NULL )
         return ERR_PTR(-ENOMEM);
 
     d->domain_id = domid;
@@ -350,7 +418,11 @@ struct domain *domain_create(domid_t domid, unsigned int domcr_flags,
         if ( d->nr_pirqs > nr_irqs )
             d->nr_pirqs = nr_irqs;
 
-        radix_tree_init(&d->pirq_tree);
+        /* Keep large pirq spaces (e.g. the hardware domain's) two levels deep. */
+        radix_tree_init_fanout(&d->pirq_tree,
+                               d->nr_pirqs > (1U << (2 * RADIX_TREE_MAP_SHIFT))
+                               ? RADIX_TREE_MAX_MAP_SHIFT
+                               : RADIX_TREE_MAP_SHIFT);
 
         if ( (err = evtchn_init(d)) != 0 )
             goto fail;
@@ -370,6 +442,9 @@ struct domain *domain_create(domid_t domid, unsigned int domcr_flags,
         d->pbuf = xzalloc_array(char, DOMAIN_PBUF_SIZE);
         if ( !d->pbuf )
             goto fail;
+
+        if ( (err = perfc_domain_init(d)) != 0 )
+            goto fail;
     }
 
     if ( (err = arch_domain_create(d, domcr_flags, config)) != 0 )
@@ -405,6 +480,7 @@ struct domain *domain_create(domid_t domid, unsigned int domcr_flags,
     atomic_set(&d->refcnt, DOMAIN_DESTROYED);
     xfree(d->vm_event);
     xfree(d->pbuf);
+    perfc_domain_destroy(d);
     if ( init_status & INIT_arch )
         arch_domain_destroy(d);
     if ( init_status & INIT_gnttab )
@@ -622,12 +698,13 @@ int domain_kill(struct domain *d)
     case DOMDYING_alive:
         domain_pause(d);
         d->is_dying = DOMDYING_dying;
+        d->teardown_pages = d->tot_pages;
         spin_barrier(&d->domain_lock);
         evtchn_destroy(d);
         gnttab_release_mappings(d);
         tmem_destroy(d->tmem_client);
         vnuma_destroy(d->vnuma);
-        domain_set_outstanding_pages(d, 0);
+        domain_set_outstanding_pages(d, 0, NUMA_NO_NODE);
         d->tmem_client = NULL;
         /* fallthrough */
     case DOMDYING_dying:
@@ -822,6 +899,7 @@ static void complete_domain_destroy(struct rcu_head *head)
 
     xfree(d->vm_event);
     xfree(d->pbuf);
+    perfc_domain_destroy(d);
 
     for ( i = d->max_vcpus - 1; i >= 0; i-- )
         if ( (v = d->vcpu[i]) != NULL )
@@ -382,6 +382,7 @@ long do_domctl(XEN_GUEST_HANDLE_PARAM(xen_domctl_t) u_domctl)
     bool_t copyback = 0;
     struct xen_domctl curop, *op = &curop;
     struct domain *d;
+    s_time_t start = NOW();
 
     if ( copy_from_guest(op, u_domctl, 1) )
         return -EFAULT;
@@ -666,6 +667,35 @@ long do_domctl(XEN_GUEST_HANDLE_PARAM(xen_domctl_t) u_domctl)
                 __HYPERVISOR_domctl, "h", u_domctl);
         break;
 
+    case XEN_DOMCTL_get_destroy_progress:
+    {
+        struct xen_domctl_destroy_progress *prog = &op->u.destroy_progress;
+
+        switch ( d->is_dying )
+        {
+        case DOMDYING_alive:
+            prog->state = XEN_DOMCTL_DESTROY_NOT_STARTED;
+            prog->pages_total = 0;
+            break;
+        case DOMDYING_dying:
+            prog->state = XEN_DOMCTL_DESTROY_RUNNING;
+            prog->pages_total = d->teardown_pages;
+            break;
+        default:
+            prog->state = XEN_DOMCTL_DESTROY_DONE;
+            prog->pages_total = d->teardown_pages;
+            break;
+        }
+        prog->pad = 0;
+        prog->pages_left = d->tot_pages;
+        copyback = 1;
+        break;
+    }
+
+    case XEN_DOMCTL_set_idle_latency:
+        d->idle_latency_us = op->u.idle_latency.max_exit_us;
+        break;
+
     case XEN_DOMCTL_setnodeaffinity:
     {
         nodemask_t new_affinity;
@@ -1116,6 +1146,10 @@ long do_domctl(XEN_GUEST_HANDLE_PARAM(xen_domctl_t) u_domctl)
                                    INT_MAX);
         break;
 
+    case XEN_DOMCTL_set_evtchn_priority:
+        ret = evtchn_set_default_priority(d, &op->u.set_evtchn_priority);
+        break;
+
     case XEN_DOMCTL_setvnumainfo:
     {
         struct vnuma_info *vnuma;
@@ -1153,7 +1187,9 @@ long do_domctl(XEN_GUEST_HANDLE_PARAM(xen_domctl_t) u_domctl)
     if ( d )
         rcu_unlock_domain(d);
 
-    if ( copyback && __copy_to_guest(u_domctl, op, 1) )
+    op->cost_ns = NOW() - start;
+    if ( copyback ? __copy_to_guest(u_domctl, op, 1)
+                  : __copy_field_to_guest(u_domctl, op, cost_ns) )
         ret = -EFAULT;
 
     return ret;
@@ -26,13 +26,16 @@ static void evtchn_2l_set_pending(struct vcpu *v, struct evtchn *evtchn)
      */
 
     if ( test_and_set_bit(port, &shared_info(d, evtchn_pending)) )
+    {
+        evtchn_stat_inc(d, evtchn, coalesced);
         return;
+    }
 
     if ( !test_bit        (port, &shared_info(d, evtchn_mask)) &&
          !test_and_set_bit(port / BITS_PER_EVTCHN_WORD(d),
                            &vcpu_info(v, evtchn_pending_sel)) )
     {
-        vcpu_mark_events_pending(v);
+        evtchn_mark_events_pending(v);
     }
 
     evtchn_check_pollers(d, port);
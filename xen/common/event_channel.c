@@ -29,6 +29,7 @@
 
 #include <public/xen.h>
 #include <public/event_channel.h>
+#include <public/sysctl.h>
 #include <xsm/xsm.h>
 
 #define ERROR_EXIT(_errno)                                          \
@@ -50,6 +51,9 @@
 
 #define consumer_is_xen(e) (!!(e)->xen_consumer)
 
+bool_t __read_mostly evtchn_stats;
+boolean_param("evtchn_stats", evtchn_stats);
+
 /*
  * The function alloc_unbound_xen_event_channel() allows an arbitrary
  * notifier function to be specified. However, very few unique functions
@@ -156,27 +160,74 @@ static void free_evtchn_bucket(struct domain *d, struct evtchn *bucket)
     xfree(bucket);
 }
 
+/* Make room in the in-use bitmap for @nr ports (doubling its size). */
+static int grow_evtchn_inuse(struct domain *d, unsigned int nr)
+{
+    unsigned int size = max_t(unsigned int, d->evtchn_inuse_size,
+                              EVTCHNS_PER_BUCKET);
+    unsigned long *inuse;
+
+    if ( nr <= d->evtchn_inuse_size )
+        return 0;
+
+    while ( size < nr )
+        size <<= 1;
+
+    inuse = xzalloc_array(unsigned long, BITS_TO_LONGS(size));
+    if ( !inuse )
+        return -ENOMEM;
+
+    if ( d->evtchn_inuse )
+        memcpy(inuse, d->evtchn_inuse,
+               BITS_TO_LONGS(d->evtchn_inuse_size) * sizeof(*inuse));
+    xfree(d->evtchn_inuse);
+    d->evtchn_inuse = inuse;
+    d->evtchn_inuse_size = size;
+
+    return 0;
+}
+
+/*
+ * A set bit in d->evtchn_inuse means the port is not free.  Bits get set
+ * lazily, when a scan finds the port has been taken since it was handed
+ * out, and are cleared again by free_evtchn().  All ports below
+ * d->evtchn_port_hint are known to be in use.
+ */
 static int get_free_port(struct domain *d)
 {
     struct evtchn *chn;
     struct evtchn **grp;
+    unsigned int   valid = d->valid_evtchns;
     int            port;
 
     if ( d->is_dying )
         return -EINVAL;
 
-    for ( port = 0; port_is_valid(d, port); port++ )
+    port = find_next_zero_bit(d->evtchn_inuse, valid, d->evtchn_port_hint);
+    d->evtchn_port_hint = port;
+
+    for ( ; port < valid;
+          port = find_next_zero_bit(d->evtchn_inuse, valid, port + 1) )
     {
         if ( port > d->max_evtchn_port )
             return -ENOSPC;
-        if ( evtchn_from_port(d, port)->state == ECS_FREE
-             && !evtchn_port_is_busy(d, port) )
+        if ( evtchn_from_port(d, port)->state != ECS_FREE )
+        {
+            __set_bit(port, d->evtchn_inuse);
+            if ( port == d->evtchn_port_hint )
+                d->evtchn_port_hint = port + 1;
+            continue;
+        }
+        if ( !evtchn_port_is_busy(d, port) )
             return port;
     }
 
     if ( port == d->max_evtchns || port > d->max_evtchn_port )
         return -ENOSPC;
 
+    if ( grow_evtchn_inuse(d, port + EVTCHNS_PER_BUCKET) )
+        return -ENOMEM;
+
     if ( !group_from_port(d, port) )
     {
         grp = xzalloc_array(struct evtchn *, BUCKETS_PER_GROUP);
@@ -205,6 +256,14 @@ static void free_evtchn(struct domain *d, struct evtchn *chn)
     chn->notify_vcpu_id = 0;
     chn->xen_consumer   = 0;
 
+    __clear_bit(chn->port, d->evtchn_inuse);
+    if ( chn->port < d->evtchn_port_hint )
+        d->evtchn_port_hint = chn->port;
+
+    chn->nr_sent         = 0;
+    chn->nr_coalesced    = 0;
+    chn->nr_link_retries = 0;
+
     xsm_evtchn_close_post(chn);
 }
 
@@ -700,6 +759,82 @@ out:
     return ret;
 }
 
+/* VCPUs to notify at the end of the EVTCHNOP_send_multi on this CPU. */
+struct evtchn_notify_batch {
+    bool_t active;
+    unsigned int nr;
+    struct vcpu *vcpu[EVTCHN_SEND_MULTI_MAX];
+};
+static DEFINE_PER_CPU(struct evtchn_notify_batch, evtchn_notify_batch);
+
+void evtchn_mark_events_pending(struct vcpu *v)
+{
+    struct evtchn_notify_batch *batch = &this_cpu(evtchn_notify_batch);
+    unsigned int i;
+
+    /*
+     * Events raised from interrupt context (e.g. PIRQs) are not deferred,
+     * so that only the hypercall path ever updates the batch.
+     */
+    if ( batch->active && !in_irq() )
+    {
+        for ( i = 0; i < batch->nr; i++ )
+            if ( batch->vcpu[i] == v )
+                return;
+
+        if ( batch->nr < ARRAY_SIZE(batch->vcpu) )
+        {
+            batch->vcpu[batch->nr++] = v;
+            return;
+        }
+    }
+
+    vcpu_mark_events_pending(v);
+}
+
+static long evtchn_send_multi(struct domain *ld,
+                              XEN_GUEST_HANDLE_PARAM(void) arg)
+{
+    XEN_GUEST_HANDLE_PARAM(evtchn_send_multi_t) uop =
+        guest_handle_cast(arg, evtchn_send_multi_t);
+    struct evtchn_notify_batch *batch = &this_cpu(evtchn_notify_batch);
+    struct evtchn_send_multi op;
+    unsigned int i;
+    long rc;
+
+    if ( copy_field_from_guest(&op, uop, nr_ports) )
+        return -EFAULT;
+    if ( op.nr_ports > EVTCHN_SEND_MULTI_MAX )
+        return -E2BIG;
+    if ( copy_from_guest_offset(op.ports,
+                                guest_handle_cast(arg, evtchn_port_t),
+                                offsetof(struct evtchn_send_multi, ports) /
+                                sizeof(evtchn_port_t),
+                                op.nr_ports) )
+        return -EFAULT;
+
+    /*
+     * The domains of all VCPUs recorded in the batch are kept alive by
+     * the RCU read lock until they have been notified.
+     */
+    rcu_read_lock(&domlist_read_lock);
+
+    ASSERT(!batch->active);
+    batch->active = 1;
+    batch->nr = 0;
+
+    for ( i = 0, rc = 0; i < op.nr_ports && !rc; i++ )
+        rc = evtchn_send(ld, op.ports[i]);
+
+    batch->active = 0;
+    for ( i = 0; i < batch->nr; i++ )
+        vcpu_mark_events_pending(batch->vcpu[i]);
+
+    rcu_read_unlock(&domlist_read_lock);
+
+    return rc;
+}
+
 int guest_enabled_event(struct vcpu *v, uint32_t virq)
 {
     return ((v != NULL) && (v->virq_to_evtchn[virq] != 0));
@@ -1098,6 +1233,10 @@ long do_event_channel_op(int cmd, XEN_GUEST_HANDLE_PARAM(void) arg)
         break;
     }
 
+    case EVTCHNOP_send_multi:
+        rc = evtchn_send_multi(current->domain, arg);
+        break;
+
     case EVTCHNOP_status: {
         struct evtchn_status status;
         if ( copy_from_guest(&status, arg, 1) != 0 )
@@ -1265,19 +1404,48 @@ void evtchn_check_pollers(struct domain *d, unsigned int port)
     }
 }
 
+int evtchn_set_default_priority(
+    struct domain *d, const struct xen_domctl_set_evtchn_priority *prio)
+{
+    unsigned int i;
+
+    for ( i = 0; i < ARRAY_SIZE(prio->pad); i++ )
+        if ( prio->pad[i] )
+            return -EINVAL;
+
+    for ( i = 0; i < XEN_DOMCTL_EVTCHN_CLASS_NR; i++ )
+        if ( prio->priority[i] > EVTCHN_FIFO_PRIORITY_MIN )
+            return -EINVAL;
+
+    /* Ports already bound keep the priority they have. */
+    spin_lock(&d->event_lock);
+    memcpy(d->evtchn_priority, prio->priority, sizeof(d->evtchn_priority));
+    spin_unlock(&d->event_lock);
+
+    return 0;
+}
+
 int evtchn_init(struct domain *d)
 {
     evtchn_2l_init(d);
     d->max_evtchn_port = INT_MAX;
+    memset(d->evtchn_priority, EVTCHN_FIFO_PRIORITY_DEFAULT,
+           sizeof(d->evtchn_priority));
 
     d->evtchn = alloc_evtchn_bucket(d, 0);
     if ( !d->evtchn )
         return -ENOMEM;
+    if ( grow_evtchn_inuse(d, EVTCHNS_PER_BUCKET) )
+    {
+        free_evtchn_bucket(d, d->evtchn);
+        return -ENOMEM;
+    }
     d->valid_evtchns = EVTCHNS_PER_BUCKET;
 
     spin_lock_init_prof(d, event_lock);
     if ( get_free_port(d) != 0 )
     {
+        xfree(d->evtchn_inuse);
         free_evtchn_bucket(d, d->evtchn);
         return -EINVAL;
     }
@@ -1288,6 +1456,7 @@ int evtchn_init(struct domain *d)
                                  BITS_TO_LONGS(domain_max_vcpus(d)));
     if ( !d->poll_mask )
     {
+        xfree(d->evtchn_inuse);
         free_evtchn_bucket(d, d->evtchn);
         return -ENOMEM;
     }
@@ -1329,6 +1498,8 @@ void evtchn_destroy_final(struct domain *d)
         xfree(d->evtchn_group[i]);
     }
     free_evtchn_bucket(d, d->evtchn);
+    xfree(d->evtchn_inuse);
+    d->evtchn_inuse = NULL;
 
 #if MAX_VIRT_CPUS > BITS_PER_LONG
     xfree(d->poll_mask);
@@ -1354,6 +1525,61 @@ void evtchn_move_pirqs(struct vcpu *v)
 }
 
 
+int evtchn_get_stats(struct xen_sysctl_evtchn_stats *op)
+{
+    struct domain *d;
+    unsigned int port, nr = 0;
+    int rc = 0;
+
+    if ( !evtchn_stats )
+        return -EOPNOTSUPP;
+    if ( op->pad || op->pad2 )
+        return -EINVAL;
+
+    d = rcu_lock_domain_by_id(op->domid);
+    if ( d == NULL )
+        return -ESRCH;
+
+    op->sent = d->evtchn_nr_sent;
+    op->coalesced = d->evtchn_nr_coalesced;
+    op->link_retries = d->evtchn_nr_link_retries;
+
+    spin_lock(&d->event_lock);
+
+    for ( port = max(op->first_port, 1U);
+          nr < op->nr_ports && port < d->max_evtchns; ++port )
+    {
+        const struct evtchn *chn;
+        struct xen_sysctl_evtchn_port_stats stats;
+
+        if ( !port_is_valid(d, port) )
+            break;
+        chn = evtchn_from_port(d, port);
+        if ( chn->state == ECS_FREE )
+            continue;
+
+        stats.port = port;
+        stats.sent = chn->nr_sent;
+        stats.coalesced = chn->nr_coalesced;
+        stats.link_retries = chn->nr_link_retries;
+
+        if ( copy_to_guest_offset(op->ports, nr, &stats, 1) )
+        {
+            rc = -EFAULT;
+            break;
+        }
+        nr++;
+    }
+
+    spin_unlock(&d->event_lock);
+
+    rcu_unlock_domain(d);
+
+    op->nr_ports = nr;
+
+    return rc;
+}
+
 static void domain_dump_evtchn_info(struct domain *d)
 {
     unsigned int port;
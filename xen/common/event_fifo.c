@@ -33,11 +33,33 @@ static inline event_word_t *evtchn_fifo_word_from_port(struct domain *d,
     return d->evtchn_fifo->event_array[p] + w;
 }
 
+/* The priority a port gets from what it is bound to. */
+static unsigned int evtchn_fifo_default_priority(const struct domain *d,
+                                                 const struct evtchn *evtchn)
+{
+    switch ( evtchn->state )
+    {
+    case ECS_VIRQ:
+        return d->evtchn_priority[evtchn->u.virq == VIRQ_TIMER
+                                  ? XEN_DOMCTL_EVTCHN_CLASS_TIMER
+                                  : XEN_DOMCTL_EVTCHN_CLASS_VIRQ];
+    case ECS_IPI:
+        return d->evtchn_priority[XEN_DOMCTL_EVTCHN_CLASS_IPI];
+    case ECS_PIRQ:
+        return d->evtchn_priority[XEN_DOMCTL_EVTCHN_CLASS_PIRQ];
+    case ECS_UNBOUND:
+    case ECS_INTERDOMAIN:
+        return d->evtchn_priority[XEN_DOMCTL_EVTCHN_CLASS_INTERDOMAIN];
+    }
+
+    return EVTCHN_FIFO_PRIORITY_DEFAULT;
+}
+
 static void evtchn_fifo_init(struct domain *d, struct evtchn *evtchn)
 {
     event_word_t *word;
 
-    evtchn->priority = EVTCHN_FIFO_PRIORITY_DEFAULT;
+    evtchn->priority = evtchn_fifo_default_priority(d, evtchn);
 
     /*
      * If this event is still linked, the first event may be delivered
@@ -109,7 +131,7 @@ static int try_set_link(event_word_t *word, event_word_t *w, uint32_t link)
  * We block unmasking by the guest by marking the tail word as BUSY,
  * therefore, the cmpxchg() may fail at most 4 times.
  */
-static bool_t evtchn_fifo_set_link(const struct domain *d, event_word_t *word,
+static bool_t evtchn_fifo_set_link(struct domain *d, event_word_t *word,
                                    uint32_t link)
 {
     event_word_t w;
@@ -122,6 +144,8 @@ static bool_t evtchn_fifo_set_link(const struct domain *d, event_word_t *word,
     if ( ret >= 0 )
         return ret;
 
+    evtchn_stat_inc(d, evtchn_from_port(d, link), link_retries);
+
     /* Lock the word to prevent guest unmasking. */
     set_bit(EVTCHN_FIFO_BUSY, word);
 
@@ -136,6 +160,7 @@ static bool_t evtchn_fifo_set_link(const struct domain *d, event_word_t *word,
                 clear_bit(EVTCHN_FIFO_BUSY, word);
             return ret;
         }
+        evtchn_stat_inc(d, evtchn_from_port(d, link), link_retries);
     }
     gdprintk(XENLOG_WARNING, "domain %d, port %d not linked\n",
              d->domain_id, link);
@@ -165,6 +190,8 @@ static void evtchn_fifo_set_pending(struct vcpu *v, struct evtchn *evtchn)
     }
 
     was_pending = test_and_set_bit(EVTCHN_FIFO_PENDING, word);
+    if ( was_pending )
+        evtchn_stat_inc(d, evtchn, coalesced);
 
     /*
      * Link the event if it unmasked and not already linked.
@@ -244,10 +271,17 @@ static void evtchn_fifo_set_pending(struct vcpu *v, struct evtchn *evtchn)
 
         spin_unlock_irqrestore(&q->lock, flags);
 
+        /*
+         * The guest keeps consuming events until no queue is ready, so
+         * while a higher priority queue is ready (and will be or is being
+         * processed), there is no need to kick the vCPU for this one.
+         */
         if ( !linked
              && !test_and_set_bit(q->priority,
-                                  &v->evtchn_fifo->control_block->ready) )
-            vcpu_mark_events_pending(v);
+                                  &v->evtchn_fifo->control_block->ready)
+             && !(read_atomic(&v->evtchn_fifo->control_block->ready) &
+                  ((1U << q->priority) - 1)) )
+            evtchn_mark_events_pending(v);
     }
  done:
     if ( !was_pending )
@@ -491,7 +525,7 @@ static void setup_ports(struct domain *d)
      * For each port that is already bound:
      *
      * - save its pending state.
-     * - set default priority.
+     * - set its default priority.
      */
     for ( port = 1; port < d->max_evtchns; port++ )
     {
@@ -505,7 +539,8 @@ static void setup_ports(struct domain *d)
         if ( test_bit(port, &shared_info(d, evtchn_pending)) )
             evtchn->pending = 1;
 
-        evtchn_fifo_set_priority(d, evtchn, EVTCHN_FIFO_PRIORITY_DEFAULT);
+        evtchn_fifo_set_priority(d, evtchn,
+                                 evtchn_fifo_default_priority(d, evtchn));
     }
 }
 
@@ -184,6 +184,73 @@ static inline void gnttab_flush_tlb(const struct domain *d)
 {
     if ( !paging_mode_external(d) )
         flush_tlb_mask(d->domain_dirty_cpumask);
+    gnttab_p2m_flush();
+}
+
+/*
+ * IOMMU mappings changed by the batch of grant operations currently being
+ * processed on this CPU.  The IOTLB flushes which iommu_{,un}map_page()
+ * would do for every element are deferred until the end of the batch and
+ * done once, for the range of frames covered, by gnttab_iotlb_flush().
+ */
+struct gnttab_iotlb_batch {
+    struct domain *d;
+    unsigned long start, end;
+};
+static DEFINE_PER_CPU(struct gnttab_iotlb_batch, gnttab_iotlb_batch);
+
+/* Beyond this many frames a single flush of the whole IOTLB is cheaper. */
+#define GNTTAB_IOTLB_RANGE_MAX 512
+
+static void gnttab_iotlb_defer(struct domain *ld)
+{
+    struct gnttab_iotlb_batch *batch = &this_cpu(gnttab_iotlb_batch);
+
+    if ( !gnttab_need_iommu_mapping(ld) )
+        return;
+
+    ASSERT(!batch->d);
+    batch->d = ld;
+    batch->start = ~0UL;
+    batch->end = 0;
+    this_cpu(iommu_dont_flush_iotlb) = 1;
+}
+
+static void gnttab_iotlb_record(unsigned long frame)
+{
+    struct gnttab_iotlb_batch *batch = &this_cpu(gnttab_iotlb_batch);
+
+    if ( !batch->d )
+        return;
+
+    batch->start = min(batch->start, frame);
+    batch->end = max(batch->end, frame);
+}
+
+/*
+ * Failures are logged, and the domain crashed unless it is the hardware
+ * domain, by iommu_iotlb_flush{,_all}().
+ */
+static int gnttab_iotlb_flush(void)
+{
+    struct gnttab_iotlb_batch *batch = &this_cpu(gnttab_iotlb_batch);
+    struct domain *ld = batch->d;
+    unsigned long count;
+
+    if ( !ld )
+        return 0;
+
+    this_cpu(iommu_dont_flush_iotlb) = 0;
+    batch->d = NULL;
+
+    if ( batch->start > batch->end )
+        return 0;
+
+    count = batch->end - batch->start + 1;
+    if ( count > GNTTAB_IOTLB_RANGE_MAX )
+        return iommu_iotlb_flush_all(ld);
+
+    return iommu_iotlb_flush(ld, batch->start, count);
 }
 
 static inline unsigned int
@@ -390,14 +457,108 @@ put_maptrack_handle(
     write_atomic(&maptrack_entry(t, prev_tail).ref, handle);
 }
 
+/*
+ * Number of maptrack frames allocated at once when the shared pool runs
+ * dry, and number of entries handed to a VCPU per refill from that pool.
+ */
+#define MAPTRACK_CHUNK_FRAMES 16
+#define MAPTRACK_REFILL       MAPTRACK_PER_PAGE
+
+/*
+ * Allocate a chunk of maptrack frames and add all their entries to the
+ * shared pool.  The chunk is sized to the number of VCPUs of the domain,
+ * so that a backend ramping up on all its VCPUs at once takes the
+ * maptrack lock (and calls into the heap allocator) only once rather than
+ * once per VCPU.  Returns the number of frames added.
+ *
+ * Must be called with the maptrack lock held.
+ */
+static unsigned int grow_maptrack(struct grant_table *t,
+                                  const struct domain *d)
+{
+    unsigned int nr, chunk;
+    unsigned int i, j;
+
+    ASSERT(spin_is_locked(&t->maptrack_lock));
+
+    nr = nr_maptrack_frames(t);
+    chunk = min_t(unsigned int, max(d->max_vcpus, 1U), MAPTRACK_CHUNK_FRAMES);
+    chunk = min(chunk, max_maptrack_frames - nr);
+
+    for ( i = 0; i < chunk; i++ )
+    {
+        struct grant_mapping *new_mt = alloc_xenheap_page();
+        grant_handle_t handle = t->maptrack_limit;
+
+        if ( !new_mt )
+            break;
+        clear_page(new_mt);
+
+        for ( j = 0; j < MAPTRACK_PER_PAGE; j++ )
+            new_mt[j].ref = handle + j + 1;
+        new_mt[j - 1].ref = t->maptrack_pool;
+
+        t->maptrack[nr + i] = new_mt;
+        /* Make the frame visible before lookups can index into it. */
+        smp_wmb();
+        t->maptrack_limit += MAPTRACK_PER_PAGE;
+
+        t->maptrack_pool = handle;
+    }
+
+    return i;
+}
+
+/*
+ * Move up to MAPTRACK_REFILL entries from the shared pool to the head of
+ * a VCPU's free list and take one of them for the caller.  Returns -1 if
+ * the pool only had enough entries to set up the VCPU's tail sentinel.
+ *
+ * Must be called with the maptrack lock held and a non-empty pool.
+ * Entries are only ever stolen from a VCPU's head once both the frames
+ * and the pool have been exhausted, so the head can be written directly.
+ */
+static int refill_maptrack(struct grant_table *t, struct vcpu *v)
+{
+    unsigned int first, last, n;
+
+    ASSERT(spin_is_locked(&t->maptrack_lock));
+    ASSERT(t->maptrack_pool != MAPTRACK_TAIL);
+
+    first = last = t->maptrack_pool;
+    maptrack_entry(t, last).vcpu = v->vcpu_id;
+    for ( n = 1; n < MAPTRACK_REFILL; n++ )
+    {
+        unsigned int next = maptrack_entry(t, last).ref;
+
+        if ( next == MAPTRACK_TAIL )
+            break;
+        last = next;
+        maptrack_entry(t, last).vcpu = v->vcpu_id;
+    }
+
+    t->maptrack_pool = maptrack_entry(t, last).ref;
+
+    /* Set tail directly if these are the first entries for this VCPU. */
+    if ( v->maptrack_tail == MAPTRACK_TAIL )
+    {
+        maptrack_entry(t, last).ref = MAPTRACK_TAIL;
+        v->maptrack_tail = last;
+    }
+    else
+        maptrack_entry(t, last).ref = v->maptrack_head;
+
+    write_atomic(&v->maptrack_head, first);
+
+    return __get_maptrack_handle(t, v);
+}
+
 static inline int
 get_maptrack_handle(
     struct grant_table *lgt)
 {
     struct vcpu          *curr = current;
-    int                   i;
     grant_handle_t        handle;
-    struct grant_mapping *new_mt;
 
     handle = __get_maptrack_handle(lgt, curr);
     if ( likely(handle != -1) )
@@ -406,65 +567,51 @@ get_maptrack_handle(
     spin_lock(&lgt->maptrack_lock);
 
     /*
-     * If we've run out of frames, try stealing an entry from another
-     * VCPU (in case the guest isn't mapping across its VCPUs evenly).
+     * Refill this VCPU's free list from the shared pool, growing the pool
+     * by another chunk of frames while allowed to.
      */
-    if ( nr_maptrack_frames(lgt) >= max_maptrack_frames )
+    for ( ; ; )
     {
-        /*
-         * Can drop the lock since no other VCPU can be adding a new
-         * frame once they've run out.
-         */
-        spin_unlock(&lgt->maptrack_lock);
-
-        /*
-         * Uninitialized free list? Steal an extra entry for the tail
-         * sentinel.
-         */
-        if ( curr->maptrack_tail == MAPTRACK_TAIL )
+        if ( lgt->maptrack_pool == MAPTRACK_TAIL )
         {
-            handle = steal_maptrack_handle(lgt, curr);
-            if ( handle == -1 )
+            if ( nr_maptrack_frames(lgt) >= max_maptrack_frames )
+                break;
+            if ( !grow_maptrack(lgt, curr->domain) )
+            {
+                spin_unlock(&lgt->maptrack_lock);
                 return -1;
-            curr->maptrack_tail = handle;
-            write_atomic(&curr->maptrack_head, handle);
+            }
         }
-        return steal_maptrack_handle(lgt, curr);
-    }
 
-    new_mt = alloc_xenheap_page();
-    if ( !new_mt )
-    {
-        spin_unlock(&lgt->maptrack_lock);
-        return -1;
+        handle = refill_maptrack(lgt, curr);
+        if ( handle != -1 )
+        {
+            spin_unlock(&lgt->maptrack_lock);
+            return handle;
+        }
     }
-    clear_page(new_mt);
 
     /*
-     * Use the first new entry and add the remaining entries to the
-     * head of the free list.
+     * We've run out of frames and the pool is empty, so try stealing an
+     * entry from another VCPU (in case the guest isn't mapping across its
+     * VCPUs evenly).  Can drop the lock since no other VCPU can be adding
+     * to the pool once it has run out.
      */
-    handle = lgt->maptrack_limit;
+    spin_unlock(&lgt->maptrack_lock);
 
-    for ( i = 0; i < MAPTRACK_PER_PAGE; i++ )
+    /*
+     * Uninitialized free list? Steal an extra entry for the tail
+     * sentinel.
+     */
+    if ( curr->maptrack_tail == MAPTRACK_TAIL )
     {
-        new_mt[i].ref = handle + i + 1;
-        new_mt[i].vcpu = curr->vcpu_id;
+        handle = steal_maptrack_handle(lgt, curr);
+        if ( handle == -1 )
+            return -1;
+        curr->maptrack_tail = handle;
+        write_atomic(&curr->maptrack_head, handle);
     }
-    new_mt[i - 1].ref = curr->maptrack_head;
-
-    /* Set tail directly if this is the first page for this VCPU. */
-    if ( curr->maptrack_tail == MAPTRACK_TAIL )
-        curr->maptrack_tail = handle + MAPTRACK_PER_PAGE - 1;
-
-    write_atomic(&curr->maptrack_head, handle + 1);
-
-    lgt->maptrack[nr_maptrack_frames(lgt)] = new_mt;
-    lgt->maptrack_limit += MAPTRACK_PER_PAGE;
-
-    spin_unlock(&lgt->maptrack_lock);
-
-    return handle;
+    return steal_maptrack_handle(lgt, curr);
 }
 
 /* Number of grant table entries. Caller must hold d's grant table lock. */
@@ -960,6 +1107,7 @@ __gnttab_map_grant_ref(
         /* We're not translated, so we know that gmfns and mfns are
            the same things, so the IOMMU entry is always 1-to-1. */
         kind = mapkind(lgt, rd, frame);
+        gnttab_iotlb_record(frame);
         if ( (act_pin & (GNTPIN_hstw_mask|GNTPIN_devw_mask)) &&
              !(old_pin & (GNTPIN_hstw_mask|GNTPIN_devw_mask)) )
         {
@@ -1053,21 +1201,36 @@ static long
 gnttab_map_grant_ref(
     XEN_GUEST_HANDLE_PARAM(gnttab_map_grant_ref_t) uop, unsigned int count)
 {
-    int i;
+    int i, rc = 0, err;
     struct gnttab_map_grant_ref op;
 
+    gnttab_iotlb_defer(current->domain);
+
     for ( i = 0; i < count; i++ )
     {
-        if (i && hypercall_preempt_check())
-            return i;
+        if ( i && hypercall_preempt_check() )
+        {
+            rc = i;
+            break;
+        }
         if ( unlikely(__copy_from_guest_offset(&op, uop, i, 1)) )
-            return -EFAULT;
+        {
+            rc = -EFAULT;
+            break;
+        }
         __gnttab_map_grant_ref(&op);
         if ( unlikely(__copy_to_guest_offset(uop, i, &op, 1)) )
-            return -EFAULT;
+        {
+            rc = -EFAULT;
+            break;
+        }
     }
 
-    return 0;
+    err = gnttab_iotlb_flush();
+    if ( unlikely(err) && rc >= 0 )
+        rc = err;
+
+    return rc;
 }
 
 static void
@@ -1189,6 +1352,7 @@ __gnttab_unmap_common(
         double_gt_lock(lgt, rgt);
 
         kind = mapkind(lgt, rd, op->frame);
+        gnttab_iotlb_record(op->frame);
         if ( !kind )
             err = iommu_unmap_page(ld, op->frame);
         else if ( !(kind & MAPKIND_WRITE) )
@@ -1340,6 +1504,8 @@ gnttab_unmap_grant_ref(
     {
         c = min(count, (unsigned int)GNTTAB_UNMAP_BATCH_SIZE);
         partial_done = 0;
+        gnttab_iotlb_defer(current->domain);
+        gnttab_defer_p2m_flush(current->domain);
 
         for ( i = 0; i < c; i++ )
         {
@@ -1353,6 +1519,7 @@ gnttab_unmap_grant_ref(
         }
 
         gnttab_flush_tlb(current->domain);
+        gnttab_iotlb_flush();
 
         for ( i = 0; i < partial_done; i++ )
             __gnttab_unmap_common_complete(&(common[i]));
@@ -1368,6 +1535,7 @@ gnttab_unmap_grant_ref(
 
 fault:
     gnttab_flush_tlb(current->domain);
+    gnttab_iotlb_flush();
 
     for ( i = 0; i < partial_done; i++ )
         __gnttab_unmap_common_complete(&(common[i]));
@@ -1403,6 +1571,8 @@ gnttab_unmap_and_replace(
     {
         c = min(count, (unsigned int)GNTTAB_UNMAP_BATCH_SIZE);
         partial_done = 0;
+        gnttab_iotlb_defer(current->domain);
+        gnttab_defer_p2m_flush(current->domain);
         
         for ( i = 0; i < c; i++ )
         {
@@ -1416,6 +1586,7 @@ gnttab_unmap_and_replace(
         }
         
         gnttab_flush_tlb(current->domain);
+        gnttab_iotlb_flush();
         
         for ( i = 0; i < partial_done; i++ )
             __gnttab_unmap_common_complete(&(common[i]));
@@ -1431,6 +1602,7 @@ gnttab_unmap_and_replace(
 
 fault:
     gnttab_flush_tlb(current->domain);
+    gnttab_iotlb_flush();
 
     for ( i = 0; i < partial_done; i++ )
         __gnttab_unmap_common_complete(&(common[i]));
@@ -2332,35 +2504,51 @@ static int gnttab_copy_lock_domain(domid_t domid, unsigned int gref_flag,
     return rc;
 }
 
-static void gnttab_copy_unlock_domains(struct gnttab_copy_buf *src,
-                                       struct gnttab_copy_buf *dest)
+static void gnttab_copy_release_buf(struct gnttab_copy_buf *buf);
+
+static void gnttab_copy_unlock_domain(struct gnttab_copy_buf *buf)
 {
-    if ( src->domain )
+    if ( buf->domain )
     {
-        rcu_unlock_domain(src->domain);
-        src->domain = NULL;
-    }
-    if ( dest->domain )
-    {
-        rcu_unlock_domain(dest->domain);
-        dest->domain = NULL;
+        rcu_unlock_domain(buf->domain);
+        buf->domain = NULL;
     }
 }
 
+static void gnttab_copy_unlock_domains(struct gnttab_copy_buf *src,
+                                       struct gnttab_copy_buf *dest)
+{
+    gnttab_copy_unlock_domain(src);
+    gnttab_copy_unlock_domain(dest);
+}
+
+/*
+ * Only the side(s) whose domain differs from the previous op get
+ * unlocked and relocked, so that the other side's buffer (and its
+ * mapping) survives e.g. netback copying from a fixed local page into
+ * several guests' grants.
+ */
 static int gnttab_copy_lock_domains(const struct gnttab_copy *op,
                                     struct gnttab_copy_buf *src,
-                                    struct gnttab_copy_buf *dest)
+                                    struct gnttab_copy_buf *dest,
+                                    bool_t src_changed, bool_t dest_changed)
 {
     int rc;
 
-    rc = gnttab_copy_lock_domain(op->source.domid,
-                                 op->flags & GNTCOPY_source_gref, src);
-    if ( rc < 0 )
-        goto error;
-    rc = gnttab_copy_lock_domain(op->dest.domid,
-                                 op->flags & GNTCOPY_dest_gref, dest);
-    if ( rc < 0 )
-        goto error;
+    if ( src_changed )
+    {
+        rc = gnttab_copy_lock_domain(op->source.domid,
+                                     op->flags & GNTCOPY_source_gref, src);
+        if ( rc < 0 )
+            goto error;
+    }
+    if ( dest_changed )
+    {
+        rc = gnttab_copy_lock_domain(op->dest.domid,
+                                     op->flags & GNTCOPY_dest_gref, dest);
+        if ( rc < 0 )
+            goto error;
+    }
 
     rc = xsm_grant_copy(XSM_HOOK, src->domain, dest->domain);
     if ( rc < 0 )
@@ -2371,6 +2559,8 @@ static int gnttab_copy_lock_domains(const struct gnttab_copy *op,
     return 0;
 
  error:
+    gnttab_copy_release_buf(src);
+    gnttab_copy_release_buf(dest);
     gnttab_copy_unlock_domains(src, dest);
     return rc;
 }
@@ -2499,16 +2689,24 @@ static int gnttab_copy_one(const struct gnttab_copy *op,
                            struct gnttab_copy_buf *dest,
                            struct gnttab_copy_buf *src)
 {
+    bool_t src_changed = !src->domain || op->source.domid != src->ptr.domid;
+    bool_t dest_changed = !dest->domain || op->dest.domid != dest->ptr.domid;
     int rc;
 
-    if ( !src->domain || op->source.domid != src->ptr.domid ||
-         !dest->domain || op->dest.domid != dest->ptr.domid )
+    if ( src_changed || dest_changed )
     {
-        gnttab_copy_release_buf(src);
-        gnttab_copy_release_buf(dest);
-        gnttab_copy_unlock_domains(src, dest);
+        if ( src_changed )
+        {
+            gnttab_copy_release_buf(src);
+            gnttab_copy_unlock_domain(src);
+        }
+        if ( dest_changed )
+        {
+            gnttab_copy_release_buf(dest);
+            gnttab_copy_unlock_domain(dest);
+        }
 
-        rc = gnttab_copy_lock_domains(op, src, dest);
+        rc = gnttab_copy_lock_domains(op, src, dest, src_changed, dest_changed);
         if ( rc < 0 )
             goto out;
     }
@@ -3197,6 +3395,7 @@ grant_table_create(
     /* Simple stuff. */
     percpu_rwlock_resource_init(&t->lock, grant_rwlock);
     spin_lock_init(&t->maptrack_lock);
+    t->maptrack_pool = MAPTRACK_TAIL;
     t->nr_grant_frames = INITIAL_NR_GRANT_FRAMES;
 
     /* Active grant table. */
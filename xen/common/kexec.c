@@ -345,6 +345,7 @@ static int kexec_common_shutdown(void)
 
 void kexec_crash(void)
 {
+    s_time_t start = NOW();
     int pos;
 
     pos = (test_bit(KEXEC_FLAG_CRASH_POS, &kexec_flags) != 0);
@@ -358,6 +359,11 @@ void kexec_crash(void)
 
     kexec_crash_save_cpu();
     machine_crash_shutdown();
+
+    /* Reported to help size watchdog timeouts against the crash path. */
+    printk("Crash shutdown took %"PRI_stime"us\n",
+           (NOW() - start) / MICROSECS(1));
+
     machine_kexec(kexec_image[KEXEC_IMAGE_CRASH_BASE + pos]);
 
     BUG();
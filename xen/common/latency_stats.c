@@ -0,0 +1,332 @@
+/******************************************************************************
+ * latency_stats.c
+ *
+ * Per-domain latency histograms, aggregated in Xen so that no trace stream
+ * needs to be collected and post-processed to get at them.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <xen/cpu.h>
+#include <xen/guest_access.h>
+#include <xen/init.h>
+#include <xen/latency_stats.h>
+#include <xen/sched.h>
+#include <xen/spinlock.h>
+#include <xen/xmalloc.h>
+
+/*
+ * Like the hypercall statistics, each CPU collects into a hash table of its
+ * own, keyed by domain, kind and reason, and the tables are merged when
+ * queried.  Events are recorded with interrupts disabled, so no locks are
+ * needed on the recording side.
+ */
+unsigned int __read_mostly opt_latency_stats;
+
+static void __init parse_latency_stats(const char *s)
+{
+    static const char *const names[] = {
+        [XEN_SYSCTL_LATENCY_STATS_exit] = "exit",
+        [XEN_SYSCTL_LATENCY_STATS_runq] = "runq",
+        [XEN_SYSCTL_LATENCY_STATS_wake] = "wake",
+    };
+    const char *ss;
+    unsigned int i;
+
+    if ( !*s )
+    {
+        opt_latency_stats = (1u << ARRAY_SIZE(names)) - 1;
+        return;
+    }
+    if ( !parse_bool(s) )
+    {
+        opt_latency_stats = 0;
+        return;
+    }
+
+    do {
+        ss = strchr(s, ',');
+        if ( !ss )
+            ss = strchr(s, '\0');
+
+        for ( i = 0; i < ARRAY_SIZE(names); i++ )
+            if ( strlen(names[i]) == ss - s && !strncmp(s, names[i], ss - s) )
+                break;
+        if ( i < ARRAY_SIZE(names) )
+            opt_latency_stats |= 1u << i;
+        else
+            printk(XENLOG_WARNING "latency_stats: unknown class '%.*s'\n",
+                   (int)(ss - s), s);
+
+        s = ss + 1;
+    } while ( *ss );
+}
+custom_param("latency_stats", parse_latency_stats);
+
+#define LAT_STATS_ORDER     9       /* Entries per CPU. */
+#define LAT_STATS_MERGED    11      /* Entries of a query. */
+#define LAT_STATS_PROBES    16
+
+/* The kind is offset by one, so that a key of 0 denotes a free slot. */
+#define LAT_STATS_KEY(d, kind, reason) \
+    (((uint64_t)(d) << 48) | ((uint64_t)(kind) + 1) << 32 | (reason))
+
+struct lat_stats {
+    uint64_t key;
+    uint64_t events;
+    uint64_t timed;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint32_t histo[XEN_SYSCTL_LATENCY_STATS_BUCKETS];
+};
+
+/* The VM exit being handled on this CPU, if it is timed. */
+struct lat_exit {
+    const struct vcpu *v;
+    uint32_t reason;
+    s_time_t start;
+};
+
+static DEFINE_PER_CPU(struct lat_stats *, lat_stats);
+static DEFINE_PER_CPU(unsigned long, lat_stats_dropped);
+static DEFINE_PER_CPU(struct lat_exit, lat_exit);
+static DEFINE_SPINLOCK(lat_stats_lock);
+
+static struct lat_stats *lat_stats_find(struct lat_stats *table,
+                                        unsigned int order, uint64_t key)
+{
+    unsigned int i, mask = (1u << order) - 1;
+    unsigned int idx = (key * 0x9e3779b97f4a7c15ULL) >> (64 - order);
+
+    for ( i = 0; i < LAT_STATS_PROBES; i++, idx = (idx + 1) & mask )
+    {
+        if ( table[idx].key == key )
+            return &table[idx];
+        if ( !table[idx].key )
+        {
+            table[idx].key = key;
+            return &table[idx];
+        }
+    }
+
+    return NULL;
+}
+
+void latency_stats_record(const struct vcpu *v, unsigned int kind,
+                          uint32_t reason, s_time_t ns)
+{
+    struct lat_stats *table = this_cpu(lat_stats), *s = NULL;
+
+    ASSERT(!local_irq_is_enabled());
+
+    if ( table )
+        s = lat_stats_find(table, LAT_STATS_ORDER,
+                           LAT_STATS_KEY(v->domain->domain_id, kind, reason));
+    if ( !s )
+    {
+        this_cpu(lat_stats_dropped)++;
+        return;
+    }
+
+    s->events++;
+    if ( ns < 0 )
+        return;
+
+    s->timed++;
+    s->total_ns += ns;
+    if ( ns > s->max_ns )
+        s->max_ns = ns;
+
+    /* Bucket 0 is below 1us, bucket n below 2^n us, the last one 1ms+. */
+    s->histo[ns < (1u << (XEN_SYSCTL_LATENCY_STATS_BUCKETS + 8)) ?
+             fls(ns >> 10) : XEN_SYSCTL_LATENCY_STATS_BUCKETS - 1]++;
+}
+
+void _latency_stats_exit_begin(uint32_t reason)
+{
+    struct lat_exit *e = &this_cpu(lat_exit);
+
+    e->v = current;
+    e->reason = reason;
+    e->start = NOW();
+}
+
+void _latency_stats_exit_end(const struct vcpu *v, bool timed)
+{
+    struct lat_exit *e = &this_cpu(lat_exit);
+
+    if ( e->v != v )
+        return;
+
+    latency_stats_record(v, XEN_SYSCTL_LATENCY_STATS_exit, e->reason,
+                         timed ? NOW() - e->start : -1);
+    e->v = NULL;
+}
+
+static int lat_stats_cpu_callback(
+    struct notifier_block *nfb, unsigned long action, void *hcpu)
+{
+    unsigned int cpu = (unsigned long)hcpu;
+
+    if ( action == CPU_UP_PREPARE && !per_cpu(lat_stats, cpu) )
+    {
+        per_cpu(lat_stats, cpu) =
+            xzalloc_array(struct lat_stats, 1u << LAT_STATS_ORDER);
+        if ( !per_cpu(lat_stats, cpu) )
+            return notifier_from_errno(-ENOMEM);
+    }
+
+    return NOTIFY_DONE;
+}
+
+static struct notifier_block lat_stats_cpu_nfb = {
+    .notifier_call = lat_stats_cpu_callback
+};
+
+static int __init latency_stats_init(void)
+{
+    unsigned int cpu;
+
+    if ( !opt_latency_stats )
+        return 0;
+
+    for_each_online_cpu ( cpu )
+        lat_stats_cpu_callback(&lat_stats_cpu_nfb, CPU_UP_PREPARE,
+                               (void *)(unsigned long)cpu);
+    register_cpu_notifier(&lat_stats_cpu_nfb);
+
+    return 0;
+}
+presmp_initcall(latency_stats_init);
+
+static int latency_stats_query(struct xen_sysctl_latency_stats *op)
+{
+    struct lat_stats *merged, *s, *m;
+    unsigned int cpu, i, nr = 0;
+    int rc = 0;
+
+    merged = xzalloc_array(struct lat_stats, 1u << LAT_STATS_MERGED);
+    if ( !merged )
+        return -ENOMEM;
+
+    op->dropped = 0;
+    for_each_online_cpu ( cpu )
+    {
+        op->dropped += per_cpu(lat_stats_dropped, cpu);
+        if ( !per_cpu(lat_stats, cpu) )
+            continue;
+
+        for ( i = 0; i < (1u << LAT_STATS_ORDER); i++ )
+        {
+            unsigned int b;
+
+            s = &per_cpu(lat_stats, cpu)[i];
+            if ( !s->key )
+                continue;
+
+            m = lat_stats_find(merged, LAT_STATS_MERGED, s->key);
+            if ( !m )
+            {
+                op->dropped += s->events;
+                continue;
+            }
+
+            m->events += s->events;
+            m->timed += s->timed;
+            m->total_ns += s->total_ns;
+            m->max_ns = max(m->max_ns, s->max_ns);
+            for ( b = 0; b < XEN_SYSCTL_LATENCY_STATS_BUCKETS; b++ )
+                m->histo[b] += s->histo[b];
+        }
+    }
+
+    for ( i = 0; i < (1u << LAT_STATS_MERGED); i++ )
+    {
+        struct xen_sysctl_latency_stats_entry e;
+
+        m = &merged[i];
+        if ( !m->key )
+            continue;
+
+        if ( nr < op->nr_entries )
+        {
+            e.domid = m->key >> 48;
+            e.kind = ((m->key >> 32) & 0xffff) - 1;
+            e.reason = (uint32_t)m->key;
+            e.events = m->events;
+            e.timed = m->timed;
+            e.total_ns = m->total_ns;
+            e.max_ns = m->max_ns;
+            memcpy(e.histo, m->histo, sizeof(e.histo));
+            if ( copy_to_guest_offset(op->entries, nr, &e, 1) )
+            {
+                rc = -EFAULT;
+                break;
+            }
+        }
+        nr++;
+    }
+
+    xfree(merged);
+    op->nr_entries = nr;
+
+    return rc;
+}
+
+int latency_stats_op(struct xen_sysctl_latency_stats *op)
+{
+    unsigned int cpu;
+    int rc = 0;
+
+    if ( !opt_latency_stats )
+        return -EOPNOTSUPP;
+
+    spin_lock(&lat_stats_lock);
+
+    switch ( op->cmd )
+    {
+    case XEN_SYSCTL_LATENCY_STATS_query:
+        rc = latency_stats_query(op);
+        break;
+
+    case XEN_SYSCTL_LATENCY_STATS_reset:
+        /* Racing with updates, so some of them may survive. */
+        for_each_online_cpu ( cpu )
+        {
+            if ( per_cpu(lat_stats, cpu) )
+                memset(per_cpu(lat_stats, cpu), 0,
+                       sizeof(struct lat_stats) << LAT_STATS_ORDER);
+            per_cpu(lat_stats_dropped, cpu) = 0;
+        }
+        break;
+
+    default:
+        rc = -EINVAL;
+        break;
+    }
+
+    spin_unlock(&lat_stats_lock);
+
+    return rc;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
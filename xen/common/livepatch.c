@@ -14,6 +14,7 @@
 #include <xen/sched.h>
 #include <xen/smp.h>
 #include <xen/softirq.h>
+#include <xen/sort.h>
 #include <xen/spinlock.h>
 #include <xen/string.h>
 #include <xen/symbols.h>
@@ -54,6 +55,7 @@ struct livepatch_build_id {
 struct payload {
     uint32_t state;                      /* One of the LIVEPATCH_STATE_*. */
     int32_t rc;                          /* 0 or -XEN_EXX. */
+    uint32_t stop_us;                    /* CPUs held by the last action. */
     bool reverted;                       /* Whether it was reverted. */
     bool safe_to_reapply;                /* Can apply safely after revert. */
     struct list_head list;               /* Linked to 'payload_list'. */
@@ -67,7 +69,7 @@ struct payload {
     struct list_head applied_list;       /* Linked to 'applied_list'. */
     struct livepatch_func *funcs;        /* The array of functions to patch. */
     unsigned int nfuncs;                 /* Nr of functions to patch. */
-    const struct livepatch_symbol *symtab; /* All symbols. */
+    const struct livepatch_symbol *symtab; /* All symbols, sorted by name. */
     const char *strtab;                  /* Pointer to .strtab. */
     struct virtual_region region;        /* symbol, bug.frame patching and
                                             exception table (x86). */
@@ -167,23 +169,34 @@ bool_t is_patch(const void *ptr)
     return r;
 }
 
+static int cmp_symbol_name(const void *a, const void *b)
+{
+    const struct livepatch_symbol *l = a, *r = b;
+
+    return strcmp(l->name, r->name);
+}
+
 unsigned long livepatch_symbols_lookup_by_name(const char *symname)
 {
     const struct payload *data;
+    const struct livepatch_symbol key = { .name = symname };
 
     ASSERT(spin_is_locked(&payload_lock));
     list_for_each_entry ( data, &payload_list, list )
     {
-        unsigned int i;
+        const struct livepatch_symbol *s, *end = data->symtab + data->nsyms;
 
-        for ( i = 0; i < data->nsyms; i++ )
-        {
-            if ( !data->symtab[i].new_symbol )
-                continue;
+        s = bsearch(&key, data->symtab, data->nsyms, sizeof(*s),
+                    cmp_symbol_name);
+        if ( !s )
+            continue;
 
-            if ( !strcmp(data->symtab[i].name, symname) )
-                return data->symtab[i].value;
-        }
+        /* Names need not be unique - check every symbol with this one. */
+        while ( s > data->symtab && !strcmp(s[-1].name, symname) )
+            s--;
+        for ( ; s < end && !strcmp(s->name, symname); s++ )
+            if ( s->new_symbol )
+                return s->value;
     }
 
     return 0;
@@ -833,6 +846,9 @@ static int build_symbol_table(struct payload *payload,
         }
     }
 
+    /* For livepatch_symbols_lookup_by_name() to binary search. */
+    sort(symtab, nsyms, sizeof(*symtab), cmp_symbol_name, NULL);
+
     payload->symtab = symtab;
     payload->strtab = strtab;
     payload->nsyms = nsyms;
@@ -979,6 +995,7 @@ static int livepatch_get(xen_sysctl_livepatch_get_t *get)
 
     get->status.state = data->state;
     get->status.rc = data->rc;
+    get->status.stop_us = data->stop_us;
 
     spin_unlock(&payload_lock);
 
@@ -1022,6 +1039,7 @@ static int livepatch_list(xen_sysctl_livepatch_list_t *list)
 
             status.state = data->state;
             status.rc = data->rc;
+            status.stop_us = data->stop_us;
             len = strlen(data->name) + 1;
 
             /* N.B. 'idx' != 'i'. */
@@ -1052,6 +1070,10 @@ static int livepatch_list(xen_sysctl_livepatch_list_t *list)
  * The following functions get the CPUs into an appropriate state and
  * apply (or revert) each of the payload's functions. This is needed
  * for XEN_SYSCTL_LIVEPATCH_ACTION operation (see livepatch_action).
+ *
+ * They run with every CPU held, so must not log: printing to a serial
+ * console would stretch that by milliseconds. schedule_work() logs what
+ * is about to be done instead.
  */
 
 static int apply_payload(struct payload *data)
@@ -1059,9 +1081,6 @@ static int apply_payload(struct payload *data)
     unsigned int i;
     int rc;
 
-    printk(XENLOG_INFO LIVEPATCH "%s: Applying %u functions\n",
-            data->name, data->nfuncs);
-
     rc = arch_livepatch_quiesce();
     if ( rc )
     {
@@ -1101,8 +1120,6 @@ static int revert_payload(struct payload *data)
     unsigned int i;
     int rc;
 
-    printk(XENLOG_INFO LIVEPATCH "%s: Reverting\n", data->name);
-
     rc = arch_livepatch_quiesce();
     if ( rc )
     {
@@ -1211,6 +1228,8 @@ static bool_t is_work_scheduled(const struct payload *data)
 
 static int schedule_work(struct payload *data, uint32_t cmd, uint32_t timeout)
 {
+    struct payload *other;
+
     ASSERT(spin_is_locked(&payload_lock));
 
     /* Fail if an operation is already scheduled. */
@@ -1231,6 +1250,22 @@ static int schedule_work(struct payload *data, uint32_t cmd, uint32_t timeout)
     dprintk(XENLOG_DEBUG, LIVEPATCH "%s: timeout is %"PRIu32"ns\n",
             data->name, livepatch_work.timeout);
 
+    switch ( cmd )
+    {
+    case LIVEPATCH_ACTION_REPLACE:
+        list_for_each_entry ( other, &applied_list, applied_list )
+            printk(XENLOG_INFO LIVEPATCH "%s: Reverting\n", other->name);
+        /* Fallthrough. */
+    case LIVEPATCH_ACTION_APPLY:
+        printk(XENLOG_INFO LIVEPATCH "%s: Applying %u functions\n",
+               data->name, data->nfuncs);
+        break;
+
+    case LIVEPATCH_ACTION_REVERT:
+        printk(XENLOG_INFO LIVEPATCH "%s: Reverting\n", data->name);
+        break;
+    }
+
     atomic_set(&livepatch_work.semaphore, -1);
 
     livepatch_work.ready = 0;
@@ -1287,7 +1322,7 @@ void check_for_livepatch_work(void)
     };
 #undef ACTION
     unsigned int cpu = smp_processor_id();
-    s_time_t timeout;
+    s_time_t start, timeout;
     unsigned long flags;
 
     /* Fast path: no work to do. */
@@ -1332,6 +1367,7 @@ void check_for_livepatch_work(void)
 
         barrier(); /* MUST do it after get_cpu_maps. */
         cpus = num_online_cpus() - 1;
+        start = NOW();
 
         if ( cpus )
         {
@@ -1367,14 +1403,15 @@ void check_for_livepatch_work(void)
  abort:
         arch_livepatch_unmask();
 
+        p->stop_us = (NOW() - start) / MICROSECS(1);
         per_cpu(work_to_do, cpu) = 0;
         livepatch_work.do_work = 0;
 
         /* put_cpu_maps has an barrier(). */
         put_cpu_maps();
 
-        printk(XENLOG_INFO LIVEPATCH "%s finished %s with rc=%d\n",
-               p->name, names[livepatch_work.cmd], p->rc);
+        printk(XENLOG_INFO LIVEPATCH "%s finished %s with rc=%d, CPUs held for %uus\n",
+               p->name, names[livepatch_work.cmd], p->rc, p->stop_us);
     }
     else
     {
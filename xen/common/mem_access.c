@@ -21,6 +21,7 @@
 
 
 #include <xen/sched.h>
+#include <xen/event.h>
 #include <xen/guest_access.h>
 #include <xen/hypercall.h>
 #include <xen/vm_event.h>
@@ -28,6 +29,65 @@
 #include <public/memory.h>
 #include <xsm/xsm.h>
 
+/*
+ * Report the access of the pages in the range of mao as runs, see
+ * XENMEM_access_op_get_access_range.
+ */
+static long mem_access_get_range(struct domain *d, xen_mem_access_op_t *mao)
+{
+    xen_mem_access_run_t run = { .nr = 0 };
+    unsigned long gfn = mao->pfn, end = mao->pfn + mao->nr;
+    unsigned int nr_runs = 0;
+
+    while ( gfn < end )
+    {
+        xenmem_access_t access;
+        bool mapped = !p2m_get_mem_access(d, _gfn(gfn), &access);
+
+        if ( run.nr && (!mapped || access != run.access) )
+        {
+            if ( nr_runs == mao->nr_runs )
+                break;
+            if ( copy_to_guest_offset(mao->runs, nr_runs, &run, 1) )
+                return -EFAULT;
+            nr_runs++;
+            run.nr = 0;
+        }
+
+        if ( mapped )
+        {
+            if ( !run.nr )
+            {
+                run.pfn = gfn;
+                run.access = access;
+            }
+            run.nr++;
+        }
+
+        if ( ++gfn < end && !(gfn & MEMOP_CMD_MASK) &&
+             hypercall_preempt_check() )
+            break;
+    }
+
+    /* The last run is reported if there is room, or else next time. */
+    if ( run.nr )
+    {
+        if ( nr_runs < mao->nr_runs )
+        {
+            if ( copy_to_guest_offset(mao->runs, nr_runs, &run, 1) )
+                return -EFAULT;
+            nr_runs++;
+        }
+        else
+            gfn = run.pfn;
+    }
+
+    mao->pfn = gfn;
+    mao->nr = end - gfn;
+
+    return nr_runs;
+}
+
 int mem_access_memop(unsigned long cmd,
                      XEN_GUEST_HANDLE_PARAM(xen_mem_access_op_t) arg)
 {
@@ -109,6 +169,25 @@ int mem_access_memop(unsigned long cmd,
         break;
     }
 
+    case XENMEM_access_op_get_access_range:
+        rc = -ENOSYS;
+        if ( unlikely(start_iter) )
+            break;
+
+        rc = -EINVAL;
+        if ( !mao.nr_runs ||
+             (mao.nr &&
+              (((mao.pfn + mao.nr - 1) < mao.pfn) ||
+               ((mao.pfn + mao.nr - 1) > domain_get_maximum_gpfn(d)))) )
+            break;
+
+        rc = mem_access_get_range(d, &mao);
+        if ( rc >= 0 &&
+             (__copy_field_to_guest(arg, &mao, pfn) ||
+              __copy_field_to_guest(arg, &mao, nr)) )
+            rc = -EFAULT;
+        break;
+
     default:
         rc = -ENOSYS;
         break;
@@ -23,6 +23,7 @@
 #include <xen/numa.h>
 #include <xen/mem_access.h>
 #include <xen/trace.h>
+#include <xen/vmap.h>
 #include <asm/current.h>
 #include <asm/hardirq.h>
 #include <asm/p2m.h>
@@ -351,9 +352,49 @@ int guest_remove_page(struct domain *d, unsigned long gmfn)
     return 1;
 }
 
+/*
+ * Give back the extent of 2^order pages at gmfn.  Populate-on-demand
+ * entries and (on x86) RAM mapped by a single large page are dealt with as
+ * a whole, anything else page by page.
+ */
+static bool decrease_reservation_extent(struct domain *d, xen_pfn_t gmfn,
+                                        unsigned int order)
+{
+    unsigned long j;
+
+    if ( tb_init_done )
+    {
+        struct {
+            u64 gfn;
+            int d:16,order:16;
+        } t;
+
+        t.gfn = gmfn;
+        t.d = d->domain_id;
+        t.order = order;
+
+        __trace_var(TRC_MEM_DECREASE_RESERVATION, 0, sizeof(t), &t);
+    }
+
+    /* See if populate-on-demand wants to handle this */
+    if ( is_hvm_domain(d) && p2m_pod_decrease_reservation(d, gmfn, order) )
+        return true;
+
+#ifdef CONFIG_X86
+    if ( p2m_remove_ram_extent(d, gmfn, order) )
+        return true;
+#endif
+
+    for ( j = 0; j < (1UL << order); j++ )
+        if ( !guest_remove_page(d, gmfn + j) )
+            return false;
+
+    return true;
+}
+
 static void decrease_reservation(struct memop_args *a)
 {
-    unsigned long i, j;
+    unsigned long i;
     xen_pfn_t gmfn;
 
     if ( !guest_handle_subrange_okay(a->extent_list, a->nr_done,
@@ -372,39 +413,58 @@ static void decrease_reservation(struct memop_args *a)
         if ( unlikely(__copy_from_guest_offset(&gmfn, a->extent_list, i, 1)) )
             goto out;
 
-        if ( tb_init_done )
+        if ( !decrease_reservation_extent(a->domain, gmfn, a->extent_order) )
+            goto out;
+    }
+
+ out:
+    a->nr_done = i;
+}
+
+/*
+ * XENMEM_decrease_reservation_range: a->nr_extents and a->nr_done count
+ * pages, which are given back in the largest naturally aligned extents
+ * the caller may use.
+ */
+static void decrease_reservation_range(struct memop_args *a, xen_pfn_t gfn)
+{
+    unsigned int i, order, max = max_order(current->domain);
+
+    for ( i = a->nr_done; i < a->nr_extents; i += 1U << order )
+    {
+        xen_pfn_t gmfn = gfn + i;
+
+        if ( i != a->nr_done && hypercall_preempt_check() )
         {
-            struct {
-                u64 gfn;
-                int d:16,order:16;
-            } t;
-
-            t.gfn = gmfn;
-            t.d = a->domain->domain_id;
-            t.order = a->extent_order;
-        
-            __trace_var(TRC_MEM_DECREASE_RESERVATION, 0, sizeof(t), &t);
+            a->preempted = 1;
+            break;
         }
 
-        /* See if populate-on-demand wants to handle this */
-        if ( is_hvm_domain(a->domain)
-             && p2m_pod_decrease_reservation(a->domain, gmfn, a->extent_order) )
-            continue;
+        for ( order = 0; order < max; order++ )
+            if ( (gmfn & (1ULL << order)) ||
+                 (2ULL << order) > a->nr_extents - i )
+                break;
 
-        for ( j = 0; j < (1 << a->extent_order); j++ )
-            if ( !guest_remove_page(a->domain, gmfn + j) )
-                goto out;
+        if ( !decrease_reservation_extent(a->domain, gmfn, order) )
+            break;
     }
 
- out:
     a->nr_done = i;
 }
 
+/*
+ * memory_exchange() only allows itself to be preempted at (input) superpage
+ * boundaries, so that exchanging many small extents doesn't turn into as
+ * many continuations.
+ */
+#define EXCHANGE_PREEMPT_ORDER 9
+
 static long memory_exchange(XEN_GUEST_HANDLE_PARAM(xen_memory_exchange_t) arg)
 {
     struct xen_memory_exchange exch;
     PAGE_LIST_HEAD(in_chunk_list);
     PAGE_LIST_HEAD(out_chunk_list);
+    PAGE_LIST_HEAD(free_list);
     unsigned long in_chunk_order, out_chunk_order;
     xen_pfn_t     gpfn, gmfn, mfn;
     unsigned long i, j, k;
@@ -497,6 +557,8 @@ static long memory_exchange(XEN_GUEST_HANDLE_PARAM(xen_memory_exchange_t) arg)
           i++ )
     {
         if ( i != (exch.nr_exchanged >> in_chunk_order) &&
+             !(((i << in_chunk_order) << exch.in.extent_order) &
+               ((1UL << EXCHANGE_PREEMPT_ORDER) - 1)) &&
              hypercall_preempt_check() )
         {
             exch.nr_exchanged = i << in_chunk_order;
@@ -554,8 +616,20 @@ static long memory_exchange(XEN_GUEST_HANDLE_PARAM(xen_memory_exchange_t) arg)
             }
         }
 
-        /* Allocate a chunk's worth of anonymous output pages. */
-        for ( j = 0; j < (1UL << out_chunk_order); j++ )
+        /*
+         * Allocate a chunk's worth of anonymous output pages, preferably as
+         * a single block split into extents.  Don't use up contiguous
+         * memory below an address limit, where it is scarce, though.
+         */
+        page = NULL;
+        if ( out_chunk_order && !XENMEMF_get_address_bits(exch.out.mem_flags) )
+            page = alloc_domheap_pages(d, exch.in.extent_order,
+                                       MEMF_no_owner | memflags);
+        for ( j = 0; page && j < (1UL << out_chunk_order); j++ )
+            page_list_add_tail(page + (j << exch.out.extent_order),
+                               &out_chunk_list);
+
+        for ( ; j < (1UL << out_chunk_order); j++ )
         {
             page = alloc_domheap_pages(d, exch.out.extent_order,
                                        MEMF_no_owner | memflags);
@@ -584,8 +658,17 @@ static long memory_exchange(XEN_GUEST_HANDLE_PARAM(xen_memory_exchange_t) arg)
             /* Pages were unshared above */
             BUG_ON(SHARED_M2P(gfn));
             guest_physmap_remove_page(d, _gfn(gfn), _mfn(mfn), 0);
-            put_page(page);
+
+            /*
+             * Unless someone transiently holds a reference, take over the
+             * last one, so that all such pages get freed in one go.
+             */
+            if ( cmpxchg(&page->count_info, 1, 0) == 1 )
+                page_list_add_tail(page, &free_list);
+            else
+                put_page(page);
         }
+        free_domheap_page_list(&free_list);
 
         /* Assign each output page to the domain. */
         for ( j = 0; (page = page_list_remove_head(&out_chunk_list)); ++j )
@@ -917,6 +1000,7 @@ long do_memory_op(unsigned long cmd, XEN_GUEST_HANDLE_PARAM(void) arg)
     domid_t domid;
     unsigned long start_extent = cmd >> MEMOP_EXTENT_SHIFT;
     int op = cmd & MEMOP_CMD_MASK;
+    unsigned int node;
 
     switch ( op )
     {
@@ -981,6 +1065,54 @@ long do_memory_op(unsigned long cmd, XEN_GUEST_HANDLE_PARAM(void) arg)
 
         break;
 
+    case XENMEM_decrease_reservation_range:
+    {
+        struct xen_reservation_range range;
+
+        if ( copy_from_guest(&range, arg, 1) )
+            return -EFAULT;
+
+        if ( range.pad[0] || range.pad[1] || range.pad[2] ||
+             range.first_gfn + range.nr_pages < range.first_gfn )
+            return -EINVAL;
+
+        /* Is size too large for us to encode a continuation? */
+        if ( range.nr_pages > (UINT_MAX >> MEMOP_EXTENT_SHIFT) )
+            return -EINVAL;
+
+        if ( unlikely(start_extent >= range.nr_pages) )
+            return start_extent;
+
+        d = rcu_lock_domain_by_any_id(range.domid);
+        if ( d == NULL )
+            return -ESRCH;
+
+        rc = xsm_memory_adjust_reservation(XSM_TARGET, curr_d, d);
+        if ( rc )
+        {
+            rcu_unlock_domain(d);
+            return rc;
+        }
+
+        args.domain     = d;
+        args.nr_extents = range.nr_pages;
+        args.nr_done    = start_extent;
+        args.preempted  = 0;
+
+        decrease_reservation_range(&args, range.first_gfn);
+
+        rcu_unlock_domain(d);
+
+        rc = args.nr_done;
+
+        if ( args.preempted )
+            return hypercall_create_continuation(
+                __HYPERVISOR_memory_op, "lh",
+                op | (rc << MEMOP_EXTENT_SHIFT), arg);
+
+        break;
+    }
+
     case XENMEM_exchange:
         if ( unlikely(start_extent) )
             return -EINVAL;
@@ -1171,8 +1303,15 @@ long do_memory_op(unsigned long cmd, XEN_GUEST_HANDLE_PARAM(void) arg)
         if ( reservation.extent_order != 0 )
             return -EINVAL;
 
-        if ( reservation.mem_flags != 0 )
-            return -EINVAL;
+        /* The only flag accepted is a request for a node claim. */
+        if ( reservation.mem_flags == 0 )
+            node = NUMA_NO_NODE;
+        else
+        {
+            node = XENMEMF_get_node(reservation.mem_flags);
+            if ( reservation.mem_flags != XENMEMF_exact_node(node) )
+                return -EINVAL;
+        }
 
         d = rcu_lock_domain_by_id(reservation.domid);
         if ( d == NULL )
@@ -1181,7 +1320,7 @@ long do_memory_op(unsigned long cmd, XEN_GUEST_HANDLE_PARAM(void) arg)
         rc = xsm_claim_pages(XSM_PRIV, d);
 
         if ( !rc )
-            rc = domain_set_outstanding_pages(d, reservation.nr_extents);
+            rc = domain_set_outstanding_pages(d, reservation.nr_extents, node);
 
         rcu_unlock_domain(d);
 
@@ -1388,13 +1527,12 @@ void destroy_ring_for_helper(
     }
 }
 
-int prepare_ring_for_helper(
-    struct domain *d, unsigned long gmfn, struct page_info **_page,
-    void **_va)
+/* Take a writable reference to a guest page for use as (part of) a ring. */
+static int get_ring_page_for_helper(
+    struct domain *d, unsigned long gmfn, struct page_info **_page)
 {
     struct page_info *page;
     p2m_type_t p2mt;
-    void *va;
 
     page = get_page_from_gfn(d, gmfn, &p2mt, P2M_UNSHARE);
 
@@ -1425,6 +1563,23 @@ int prepare_ring_for_helper(
         return -EINVAL;
     }
 
+    *_page = page;
+
+    return 0;
+}
+
+int prepare_ring_for_helper(
+    struct domain *d, unsigned long gmfn, struct page_info **_page,
+    void **_va)
+{
+    struct page_info *page;
+    void *va;
+    int rc;
+
+    rc = get_ring_page_for_helper(d, gmfn, &page);
+    if ( rc )
+        return rc;
+
     va = __map_domain_page_global(page);
     if ( va == NULL )
     {
@@ -1438,6 +1593,76 @@ int prepare_ring_for_helper(
     return 0;
 }
 
+/*
+ * As prepare_ring_for_helper(), for a ring spanning the nr guest frames
+ * starting at gmfn.  The pages are mapped virtually contiguous.
+ */
+int prepare_rings_for_helper(
+    struct domain *d, unsigned long gmfn, unsigned int nr,
+    struct page_info **pages, void **_va)
+{
+    mfn_t *mfns;
+    unsigned int i;
+    void *va = NULL;
+    int rc = 0;
+
+    if ( nr == 1 )
+        return prepare_ring_for_helper(d, gmfn, &pages[0], _va);
+
+    mfns = xmalloc_array(mfn_t, nr);
+    if ( !mfns )
+        return -ENOMEM;
+
+    for ( i = 0; i < nr; i++ )
+    {
+        rc = get_ring_page_for_helper(d, gmfn + i, &pages[i]);
+        if ( rc )
+            break;
+        mfns[i] = _mfn(page_to_mfn(pages[i]));
+    }
+
+    if ( !rc )
+    {
+        va = vmap(mfns, nr);
+        if ( !va )
+            rc = -ENOMEM;
+    }
+
+    xfree(mfns);
+
+    if ( rc )
+    {
+        while ( i-- )
+            put_page_and_type(pages[i]);
+        return rc;
+    }
+
+    *_va = va;
+
+    return 0;
+}
+
+void destroy_rings_for_helper(
+    void **_va, struct page_info **pages, unsigned int nr)
+{
+    void *va = *_va;
+    unsigned int i;
+
+    if ( nr == 1 )
+    {
+        destroy_ring_for_helper(_va, pages[0]);
+        return;
+    }
+
+    if ( va != NULL )
+    {
+        vunmap(va);
+        for ( i = 0; i < nr; i++ )
+            put_page_and_type(pages[i]);
+        *_va = NULL;
+    }
+}
+
 /*
  * Local variables:
  * mode: C
@@ -32,12 +32,29 @@ static void trace_multicall_call(multicall_entry_t *call)
     __trace_multicall_call(call);
 }
 
+static void trace_multicall(uint32_t done, uint32_t nr_calls)
+{
+    uint32_t d[2] = { done, nr_calls };
+
+    if ( !tb_init_done )
+        return;
+
+    __trace_var(TRC_PV_MULTICALL, 0, sizeof(d), d);
+}
+
+/*
+ * Entries are copied from and to guest memory this many at a time, and
+ * preemption is checked for once per batch.
+ */
+#define MULTICALL_BATCH 8
+
 ret_t
 do_multicall(
     XEN_GUEST_HANDLE_PARAM(multicall_entry_t) call_list, uint32_t nr_calls)
 {
     struct mc_state *mcs = &current->mc_state;
-    uint32_t         i;
+    struct multicall_entry batch[MULTICALL_BATCH];
+    uint32_t         i, j, n;
     int              rc = 0;
 
     if ( unlikely(__test_and_set_bit(_MCSF_in_multicall, &mcs->flags)) )
@@ -49,37 +66,53 @@ do_multicall(
     if ( unlikely(!guest_handle_okay(call_list, nr_calls)) )
         rc = -EFAULT;
 
-    for ( i = 0; !rc && i < nr_calls; i++ )
+    for ( i = 0; !rc && i < nr_calls; i += n )
     {
         if ( i && hypercall_preempt_check() )
             goto preempted;
 
-        if ( unlikely(__copy_from_guest(&mcs->call, call_list, 1)) )
+        n = min_t(uint32_t, nr_calls - i, MULTICALL_BATCH);
+        if ( unlikely(__copy_from_guest(batch, call_list, n)) )
         {
             rc = -EFAULT;
             break;
         }
 
-        trace_multicall_call(&mcs->call);
+        for ( j = 0; j < n; j++ )
+        {
+            mcs->call = batch[j];
+
+            trace_multicall_call(&mcs->call);
 
-        arch_do_multicall_call(mcs);
+            arch_do_multicall_call(mcs);
+
+            if ( current->hcall_preempted )
+                break;
 
 #ifndef NDEBUG
-        {
             /*
              * Deliberately corrupt the contents of the multicall structure.
              * The caller must depend only on the 'result' field on return.
              */
-            struct multicall_entry corrupt;
-            memset(&corrupt, 0xAA, sizeof(corrupt));
-            (void)__copy_to_guest(call_list, &corrupt, 1);
-        }
+            memset(&batch[j], 0xAA, sizeof(batch[j]));
 #endif
+            batch[j].result = mcs->call.result;
+        }
 
-        if ( unlikely(__copy_field_to_guest(call_list, &mcs->call, result)) )
+        /* Write back the completed entries. */
+        if ( unlikely(j && __copy_to_guest(call_list, batch, j)) )
+        {
+            if ( j < n )
+                hypercall_cancel_continuation();
             rc = -EFAULT;
-        else if ( current->hcall_preempted )
+            break;
+        }
+        guest_handle_add_offset(call_list, j);
+
+        if ( j < n )
         {
+            i += j;
+
             /* Translate sub-call continuation to guest layout */
             xlat_multicall_entry(mcs);
 
@@ -89,18 +122,19 @@ do_multicall(
             else
                 hypercall_cancel_continuation();
             rc = -EFAULT;
+            break;
         }
-        else
-            guest_handle_add_offset(call_list, 1);
     }
 
     perfc_incr(calls_to_multicall);
     perfc_add(calls_from_multicall, i);
+    trace_multicall(i, nr_calls);
     mcs->flags = 0;
     return rc;
 
  preempted:
     perfc_add(calls_from_multicall, i);
+    trace_multicall(i, nr_calls);
     mcs->flags = 0;
     return hypercall_create_continuation(
         __HYPERVISOR_multicall, "hi", call_list, nr_calls-i);
@@ -122,6 +122,7 @@
 
 #include <xen/init.h>
 #include <xen/types.h>
+#include <xen/cpu.h>
 #include <xen/lib.h>
 #include <xen/sched.h>
 #include <xen/spinlock.h>
@@ -170,6 +171,20 @@ boolean_param("bootscrub", opt_bootscrub);
 static unsigned long __initdata opt_bootscrub_chunk = MB(128);
 size_param("bootscrub_chunk", opt_bootscrub_chunk);
 
+/*
+ * bootscrub_threads -> Number of CPUs per NUMA node to scrub with, SMT
+ * siblings included once all cores are in use.  0 uses one CPU per core.
+ */
+static unsigned int __initdata opt_bootscrub_threads;
+integer_param("bootscrub_threads", opt_bootscrub_threads);
+
+/*
+ * pcpu_page_cache -> Keep small per-CPU caches of order-0 and superpage-sized
+ * free blocks in front of the global heap lock.
+ */
+static bool_t __read_mostly opt_pcpu_page_cache = 1;
+boolean_param("pcpu_page_cache", opt_pcpu_page_cache);
+
 /*
  * Bit width of the DMA heap -- used to override NUMA-node-first.
  * allocation strategy, which can otherwise exhaust low memory.
@@ -177,9 +192,12 @@ size_param("bootscrub_chunk", opt_bootscrub_chunk);
 static unsigned int dma_bitsize;
 integer_param("dma_bits", dma_bitsize);
 
-/* Offlined page list, protected by heap_lock. */
+/*
+ * Offlined and broken page lists, protected by page_offline_lock (nested
+ * inside the heap lock of the pages' node).
+ */
+static DEFINE_SPINLOCK(page_offline_lock);
 PAGE_LIST_HEAD(page_offlined_list);
-/* Broken page list, protected by heap_lock. */
 PAGE_LIST_HEAD(page_broken_list);
 
 /*************************
@@ -199,6 +217,10 @@ struct scrub_region {
     unsigned long per_cpu_sz;
     unsigned long rem;
     cpumask_t cpus;
+    /* Statistics: pages scrubbed, and time spent on them by all CPUs. */
+    spinlock_t stats_lock;
+    unsigned long scrubbed;
+    s_time_t busy;
 };
 static struct scrub_region __initdata region[MAX_NUMNODES];
 static unsigned long __initdata chunk_size;
@@ -390,9 +412,56 @@ static long total_avail_pages;
 static long midsize_alloc_zone_pages;
 #define MIDSIZE_ALLOC_FRAC 128
 
-static DEFINE_SPINLOCK(heap_lock);
+/*
+ * Each node's free lists, avail[] counts and scrubbing state are protected
+ * by that node's heap lock, so that allocations from different nodes don't
+ * contend. Only the system-wide total is shared, and it is updated atomically.
+ */
+static struct node_heap {
+    spinlock_t lock;
+    unsigned long avail_pages;        /* free pages on the node, all zones */
+    unsigned long outstanding_claims; /* claims on this node, see claim_lock */
+    unsigned long free_chunks[MAX_ORDER + 1]; /* by order, all zones */
+} __cacheline_aligned node_heap[MAX_NUMNODES] = {
+    [0 ... MAX_NUMNODES - 1] = { .lock = SPIN_LOCK_UNLOCKED }
+};
+#define heap_lock(node) (node_heap[node].lock)
+#define page_heap_lock(pg) heap_lock(phys_to_nid(page_to_maddr(pg)))
+
+/*
+ * Claims bookkeeping: outstanding_claims, node_heap[].outstanding_claims and
+ * every domain's outstanding_pages and claim_node.
+ */
+static DEFINE_SPINLOCK(claim_lock);
 static long outstanding_claims; /* total outstanding claims by all domains */
 
+/* Free pages still awaiting scrubbing, per node. Protected by heap_lock. */
+static unsigned long node_need_scrub[MAX_NUMNODES];
+/* Nodes which some CPU is currently scrubbing from its idle loop. */
+static nodemask_t node_scrubbing;
+
+static struct page_info *page_cache_alloc(
+    unsigned int node, unsigned int zone_lo, unsigned int zone_hi,
+    unsigned int order, unsigned int memflags);
+static unsigned long page_cache_drain_all(void);
+
+/* Lock all nodes' heaps, e.g. for a consistent view of free memory. */
+static void heap_lock_all(void)
+{
+    unsigned int node;
+
+    for ( node = 0; node < MAX_NUMNODES; node++ )
+        spin_lock(&heap_lock(node));
+}
+
+static void heap_unlock_all(void)
+{
+    unsigned int node = MAX_NUMNODES;
+
+    while ( node-- )
+        spin_unlock(&heap_lock(node));
+}
+
 unsigned long domain_adjust_tot_pages(struct domain *d, long pages)
 {
     long dom_before, dom_after, dom_claimed, sys_before, sys_after;
@@ -402,13 +471,13 @@ unsigned long domain_adjust_tot_pages(struct domain *d, long pages)
 
     /*
      * can test d->claimed_pages race-free because it can only change
-     * if d->page_alloc_lock and heap_lock are both held, see also
+     * if d->page_alloc_lock and claim_lock are both held, see also
      * domain_set_outstanding_pages below
      */
     if ( !d->outstanding_pages )
         goto out;
 
-    spin_lock(&heap_lock);
+    spin_lock(&claim_lock);
     /* adjust domain outstanding pages; may not go negative */
     dom_before = d->outstanding_pages;
     dom_after = dom_before - pages;
@@ -420,29 +489,51 @@ unsigned long domain_adjust_tot_pages(struct domain *d, long pages)
     sys_after = sys_before - (dom_before - dom_claimed);
     BUG_ON(sys_after < 0);
     outstanding_claims = sys_after;
-    spin_unlock(&heap_lock);
+    /*
+     * A node claim shrinks with every page the domain gets, no matter which
+     * node that page came from.
+     */
+    if ( d->claim_node != NUMA_NO_NODE )
+    {
+        BUG_ON(node_heap[d->claim_node].outstanding_claims <
+               dom_before - dom_claimed);
+        node_heap[d->claim_node].outstanding_claims -= dom_before - dom_claimed;
+    }
+    spin_unlock(&claim_lock);
 
 out:
     return d->tot_pages;
 }
 
-int domain_set_outstanding_pages(struct domain *d, unsigned long pages)
+int domain_set_outstanding_pages(struct domain *d, unsigned long pages,
+                                 unsigned int node)
 {
     int ret = -ENOMEM;
     unsigned long claim, avail_pages;
 
+    if ( pages && node != NUMA_NO_NODE &&
+         (node >= MAX_NUMNODES || !node_online(node)) )
+        return -EINVAL;
+
+    /* Memory sitting in per-CPU caches must be visible to the claim. */
+    if ( pages )
+        page_cache_drain_all();
+
     /*
      * take the domain's page_alloc_lock, else all d->tot_page adjustments
-     * must always take the global heap_lock rather than only in the much
-     * rarer case that d->outstanding_pages is non-zero
+     * must always take claim_lock rather than only in the much rarer case
+     * that d->outstanding_pages is non-zero
      */
     spin_lock(&d->page_alloc_lock);
-    spin_lock(&heap_lock);
+    spin_lock(&claim_lock);
 
     /* pages==0 means "unset" the claim. */
     if ( pages == 0 )
     {
         outstanding_claims -= d->outstanding_pages;
+        if ( d->outstanding_pages && d->claim_node != NUMA_NO_NODE )
+            node_heap[d->claim_node].outstanding_claims -=
+                d->outstanding_pages;
         d->outstanding_pages = 0;
         ret = 0;
         goto out;
@@ -462,6 +553,9 @@ int domain_set_outstanding_pages(struct domain *d, unsigned long pages)
         goto out;
     }
 
+    /* Keep allocations from changing free memory while we look at it. */
+    heap_lock_all();
+
     /* how much memory is available? */
     avail_pages = total_avail_pages;
 
@@ -477,6 +571,14 @@ int domain_set_outstanding_pages(struct domain *d, unsigned long pages)
     avail_pages += tmem_freeable_pages();
     avail_pages -= outstanding_claims;
 
+    /* A node claim must, in addition, fit in the node's unclaimed memory. */
+    if ( node != NUMA_NO_NODE )
+        avail_pages = min(avail_pages,
+                          node_heap[node].avail_pages -
+                          node_heap[node].outstanding_claims);
+
+    heap_unlock_all();
+
     /*
      * Note, if domain has already allocated memory before making a claim
      * then the claim must take tot_pages into account
@@ -487,21 +589,41 @@ int domain_set_outstanding_pages(struct domain *d, unsigned long pages)
 
     /* yay, claim fits in available memory, stake the claim, success! */
     d->outstanding_pages = claim;
+    d->claim_node = node;
     outstanding_claims += d->outstanding_pages;
+    if ( node != NUMA_NO_NODE )
+        node_heap[node].outstanding_claims += d->outstanding_pages;
     ret = 0;
 
 out:
-    spin_unlock(&heap_lock);
+    spin_unlock(&claim_lock);
     spin_unlock(&d->page_alloc_lock);
     return ret;
 }
 
 void get_outstanding_claims(uint64_t *free_pages, uint64_t *outstanding_pages)
 {
-    spin_lock(&heap_lock);
+    spin_lock(&claim_lock);
     *outstanding_pages = outstanding_claims;
     *free_pages =  avail_domheap_pages();
-    spin_unlock(&heap_lock);
+    spin_unlock(&claim_lock);
+}
+
+/*
+ * Whether @request pages may come from @node without eating into memory
+ * claimed on that node by someone other than @d.
+ */
+static bool_t node_claims_allow(unsigned int node, unsigned long request,
+                                const struct domain *d)
+{
+    const struct node_heap *nh = &node_heap[node];
+
+    ASSERT(spin_is_locked(&heap_lock(node)));
+
+    if ( likely(nh->outstanding_claims + request <= nh->avail_pages) )
+        return 1;
+
+    return d && d->claim_node == node && d->outstanding_pages >= request;
 }
 
 static bool_t __read_mostly first_node_initialised;
@@ -644,11 +766,20 @@ static void __init setup_low_mem_virq(void)
             low_mem_virq_th);
 }
 
+static DEFINE_SPINLOCK(low_mem_virq_lock);
+
 static void check_low_mem_virq(void)
 {
     unsigned long avail_pages = total_avail_pages +
         tmem_freeable_pages() - outstanding_claims;
 
+    if ( likely(avail_pages > low_mem_virq_th &&
+                avail_pages < low_mem_virq_high) )
+        return;
+
+    /* Allocations on different nodes may get here concurrently. */
+    spin_lock(&low_mem_virq_lock);
+
     if ( unlikely(avail_pages <= low_mem_virq_th) )
     {
         send_global_virq(VIRQ_ENOMEM);
@@ -660,10 +791,8 @@ static void check_low_mem_virq(void)
         if ( low_mem_virq_th_order > 0 )
             low_mem_virq_th_order--;
         low_mem_virq_th     = 1UL << low_mem_virq_th_order;
-        return;
     }
-
-    if ( unlikely(avail_pages >= low_mem_virq_high) )
+    else if ( unlikely(avail_pages >= low_mem_virq_high) )
     {
         /* Reset hysteresis. Bring threshold up one order.
          * If we are back where originally set, set high
@@ -676,6 +805,128 @@ static void check_low_mem_virq(void)
         else
             low_mem_virq_high = 1UL << (low_mem_virq_th_order + 2);
     }
+
+    spin_unlock(&low_mem_virq_lock);
+}
+
+/*
+ * Chunks which may contain unscrubbed pages are kept at the tail of their
+ * free list, so that allocations prefer clean memory and the idle-loop
+ * scrubber only needs to look at list tails.
+ */
+static void page_list_add_scrub(struct page_info *pg, unsigned int node,
+                                unsigned int zone, unsigned int order,
+                                unsigned int first_dirty)
+{
+    PFN_ORDER(pg) = order;
+    pg->u.free.first_dirty = first_dirty;
+    pg->u.free.scrub_state = BUDDY_NOT_SCRUBBING;
+    node_heap[node].free_chunks[order]++;
+
+    if ( first_dirty != INVALID_DIRTY_IDX )
+        page_list_add_tail(pg, &heap(node, zone, order));
+    else
+        page_list_add(pg, &heap(node, zone, order));
+}
+
+static void page_list_del_free(struct page_info *pg, unsigned int node,
+                               unsigned int zone, unsigned int order)
+{
+    node_heap[node].free_chunks[order]--;
+    page_list_del(pg, &heap(node, zone, order));
+}
+
+/*
+ * Make the idle-loop scrubber let go of chunk @head, and wait for it to
+ * do so. Must hold the heap_lock of @head's node.
+ */
+static void check_and_stop_scrub(struct page_info *head)
+{
+    if ( head->u.free.scrub_state == BUDDY_SCRUBBING )
+    {
+        typeof(head->u.free) pgfree;
+
+        head->u.free.scrub_state = BUDDY_SCRUB_ABORT;
+        smp_mb();
+        for ( ; ; )
+        {
+            /* Can't ACCESS_ONCE() a bitfield. */
+            pgfree.val = ACCESS_ONCE(head->u.free.val);
+            if ( pgfree.scrub_state != BUDDY_SCRUB_ABORT )
+                break;
+            cpu_relax();
+        }
+    }
+}
+
+/* Account for @pages (negative when allocating) free pages in @node/@zone. */
+static void adjust_avail_pages(unsigned int node, unsigned int zone,
+                               long pages)
+{
+    ASSERT(spin_is_locked(&heap_lock(node)));
+
+    avail[node][zone] += pages;
+    node_heap[node].avail_pages += pages;
+    arch_fetch_and_add(&total_avail_pages, pages);
+}
+
+/*
+ * Take a 2^@order block off @node's free lists, from the highest zone in
+ * [@zone_lo, @zone_hi] that can satisfy the request. Must hold @node's
+ * heap_lock.
+ */
+static struct page_info *get_free_buddy(
+    unsigned int node, unsigned int zone_lo, unsigned int zone_hi,
+    unsigned int order)
+{
+    unsigned int j, zone = zone_hi, first_dirty;
+    unsigned long request = 1UL << order;
+    struct page_info *pg;
+
+    ASSERT(spin_is_locked(&heap_lock(node)));
+
+    do {
+        /* Check if target node can support the allocation. */
+        if ( !avail[node] || (avail[node][zone] < request) )
+            continue;
+
+        /* Find smallest order which can satisfy the request. */
+        for ( j = order; j <= MAX_ORDER; j++ )
+            if ( (pg = page_list_remove_head(&heap(node, zone, j))) )
+                goto found;
+    } while ( zone-- > zone_lo ); /* careful: unsigned zone may wrap */
+
+    return NULL;
+
+ found:
+    node_heap[node].free_chunks[j]--;
+    check_and_stop_scrub(pg);
+    first_dirty = pg->u.free.first_dirty;
+
+    /* We may have to halve the chunk a number of times. */
+    while ( j != order )
+    {
+        j--;
+        page_list_add_scrub(pg, node, zone, j,
+                            (1U << j) > first_dirty ?
+                            first_dirty : INVALID_DIRTY_IDX);
+        pg += 1 << j;
+
+        if ( first_dirty != INVALID_DIRTY_IDX )
+        {
+            /* Adjust first_dirty for the upper half. */
+            if ( first_dirty >= 1U << j )
+                first_dirty -= 1U << j;
+            else
+                first_dirty = 0; /* We've moved past original first_dirty */
+        }
+    }
+
+    ASSERT(avail[node][zone] >= request);
+    adjust_avail_pages(node, zone, -(long)request);
+    ASSERT(total_avail_pages >= 0);
+
+    return pg;
 }
 
 /* Allocate 2^@order contiguous pages. */
@@ -684,12 +935,14 @@ static struct page_info *alloc_heap_pages(
     unsigned int order, unsigned int memflags,
     struct domain *d)
 {
-    unsigned int i, j, zone = 0, nodemask_retry = 0;
+    unsigned int i, nodemask_retry = 0, dirty_cnt = 0;
     nodeid_t first_node, node = MEMF_get_node(memflags), req_node = node;
+    nodeid_t start_node;
     unsigned long request = 1UL << order;
     struct page_info *pg;
     nodemask_t nodemask = (d != NULL ) ? d->node_affinity : node_online_map;
-    bool_t need_tlbflush = 0;
+    const struct domain *claimer;
+    bool_t need_tlbflush = 0, cache_drained = 0;
     uint32_t tlbflush_timestamp = 0;
 
     /* Make sure there are enough bits in memflags for nodeID. */
@@ -706,7 +959,7 @@ static struct page_info *alloc_heap_pages(
         if ( node >= MAX_NUMNODES )
             node = cpu_to_node(smp_processor_id());
     }
-    first_node = node;
+    start_node = node;
 
     ASSERT(node < MAX_NUMNODES);
     ASSERT(zone_lo <= zone_hi);
@@ -715,16 +968,32 @@ static struct page_info *alloc_heap_pages(
     if ( unlikely(order > MAX_ORDER) )
         return NULL;
 
-    spin_lock(&heap_lock);
+    /* Common small allocations are normally served without heap_lock. */
+    if ( (pg = page_cache_alloc(node, zone_lo, zone_hi, order,
+                                memflags)) != NULL )
+    {
+        if ( d != NULL )
+            d->last_alloc_node = node;
+        return pg;
+    }
+
+ retry:
+    first_node = node = start_node;
+    nodemask = (d != NULL ) ? d->node_affinity : node_online_map;
+    nodemask_retry = 0;
+
+    /* A claim only helps allocations which get accounted to it. */
+    claimer = (memflags & MEMF_no_refcount) ? NULL : d;
 
     /*
      * Claimed memory is considered unavailable unless the request
-     * is made by a domain with sufficient unclaimed pages.
+     * is made by a domain with sufficient unclaimed pages. Allocations
+     * on other nodes may change the totals under our feet, so this may
+     * let through up to one request per node too many.
      */
     if ( (outstanding_claims + request >
           total_avail_pages + tmem_freeable_pages()) &&
-          ((memflags & MEMF_no_refcount) ||
-           !d || d->outstanding_pages < request) )
+          (!claimer || claimer->outstanding_pages < request) )
         goto not_found;
 
     /*
@@ -745,17 +1014,14 @@ static struct page_info *alloc_heap_pages(
      */
     for ( ; ; )
     {
-        zone = zone_hi;
-        do {
-            /* Check if target node can support the allocation. */
-            if ( !avail[node] || (avail[node][zone] < request) )
-                continue;
+        spin_lock(&heap_lock(node));
 
-            /* Find smallest order which can satisfy the request. */
-            for ( j = order; j <= MAX_ORDER; j++ )
-                if ( (pg = page_list_remove_head(&heap(node, zone, j))) )
-                    goto found;
-        } while ( zone-- > zone_lo ); /* careful: unsigned zone may wrap */
+        /* Memory claimed on this node is off limits as well. */
+        if ( node_claims_allow(node, request, claimer) &&
+             (pg = get_free_buddy(node, zone_lo, zone_hi, order)) != NULL )
+            goto found;
+
+        spin_unlock(&heap_lock(node));
 
         if ( (memflags & MEMF_exact_node) && req_node != NUMA_NO_NODE )
             goto not_found;
@@ -788,39 +1054,34 @@ static struct page_info *alloc_heap_pages(
     if ( (pg = tmem_relinquish_pages(order, memflags)) != NULL )
     {
         /* reassigning an already allocated anonymous heap page */
-        spin_unlock(&heap_lock);
         return pg;
     }
 
  not_found:
-    /* No suitable memory blocks. Fail the request. */
-    spin_unlock(&heap_lock);
-    return NULL;
-
- found: 
-    /* We may have to halve the chunk a number of times. */
-    while ( j != order )
+    /* Per-CPU caches may be holding the memory we need: flush and retry. */
+    if ( !cache_drained && page_cache_drain_all() )
     {
-        PFN_ORDER(pg) = --j;
-        page_list_add_tail(pg, &heap(node, zone, j));
-        pg += 1 << j;
+        cache_drained = 1;
+        goto retry;
     }
 
-    ASSERT(avail[node][zone] >= request);
-    avail[node][zone] -= request;
-    total_avail_pages -= request;
-    ASSERT(total_avail_pages >= 0);
-
-    check_low_mem_virq();
+    /* No suitable memory blocks. Fail the request. */
+    return NULL;
 
+ found: 
     if ( d != NULL )
         d->last_alloc_node = node;
 
     for ( i = 0; i < (1 << order); i++ )
     {
         /* Reference count must continuously be zero for free pages. */
-        BUG_ON(pg[i].count_info != PGC_state_free);
-        pg[i].count_info = PGC_state_inuse;
+        BUG_ON((pg[i].count_info & ~PGC_need_scrub) != PGC_state_free);
+
+        /* Preserve PGC_need_scrub so we can check it after lock is dropped. */
+        if ( pg[i].count_info & PGC_need_scrub )
+            dirty_cnt++;
+        pg[i].count_info = PGC_state_inuse |
+                           (pg[i].count_info & PGC_need_scrub);
 
         if ( !(memflags & MEMF_no_tlbflush) )
             accumulate_tlbflush(&need_tlbflush, &pg[i],
@@ -829,6 +1090,23 @@ static struct page_info *alloc_heap_pages(
         /* Initialise fields which have other uses for free pages. */
         pg[i].u.inuse.type_info = 0;
         page_set_owner(&pg[i], NULL);
+    }
+
+    ASSERT(node_need_scrub[node] >= dirty_cnt);
+    node_need_scrub[node] -= dirty_cnt;
+
+    spin_unlock(&heap_lock(node));
+
+    check_low_mem_virq();
+
+    for ( i = 0; i < (1 << order); i++ )
+    {
+        /* Scrub on demand whatever the idle loop didn't get to yet. */
+        if ( dirty_cnt && test_bit(_PGC_need_scrub, &pg[i].count_info) )
+        {
+            scrub_one_page(&pg[i]);
+            clear_bit(_PGC_need_scrub, &pg[i].count_info);
+        }
 
         /* Ensure cache and RAM are consistent for platforms where the
          * guest can control its own visibility of/through the cache.
@@ -836,8 +1114,6 @@ static struct page_info *alloc_heap_pages(
         flush_page_to_ram(page_to_mfn(&pg[i]));
     }
 
-    spin_unlock(&heap_lock);
-
     if ( need_tlbflush )
         filtered_flush_tlb_mask(tlbflush_timestamp);
 
@@ -852,11 +1128,16 @@ static int reserve_offlined_page(struct page_info *head)
     struct page_info *cur_head;
     int cur_order;
 
-    ASSERT(spin_is_locked(&heap_lock));
+    bool_t need_scrub;
+
+    ASSERT(spin_is_locked(&heap_lock(node)));
+
+    check_and_stop_scrub(head);
+    need_scrub = (head->u.free.first_dirty != INVALID_DIRTY_IDX);
 
     cur_head = head;
 
-    page_list_del(head, &heap(node, zone, head_order));
+    page_list_del_free(head, node, zone, head_order);
 
     while ( cur_head < (head + (1 << head_order)) )
     {
@@ -892,8 +1173,8 @@ static int reserve_offlined_page(struct page_info *head)
             {
             merge:
                 /* We don't consider merging outside the head_order. */
-                page_list_add_tail(cur_head, &heap(node, zone, cur_order));
-                PFN_ORDER(cur_head) = cur_order;
+                page_list_add_scrub(cur_head, node, zone, cur_order,
+                                    need_scrub ? 0 : INVALID_DIRTY_IDX);
                 cur_head += (1 << cur_order);
                 break;
             }
@@ -905,13 +1186,17 @@ static int reserve_offlined_page(struct page_info *head)
         if ( !page_state_is(cur_head, offlined) )
             continue;
 
-        avail[node][zone]--;
-        total_avail_pages--;
+        adjust_avail_pages(node, zone, -1);
         ASSERT(total_avail_pages >= 0);
 
+        if ( test_and_clear_bit(_PGC_need_scrub, &cur_head->count_info) )
+            node_need_scrub[node]--;
+
+        spin_lock(&page_offline_lock);
         page_list_add_tail(cur_head,
                            test_bit(_PGC_broken, &cur_head->count_info) ?
                            &page_broken_list : &page_offlined_list);
+        spin_unlock(&page_offline_lock);
 
         count++;
     }
@@ -919,18 +1204,18 @@ static int reserve_offlined_page(struct page_info *head)
     return count;
 }
 
-/* Free 2^@order set of pages. */
-static void free_heap_pages(
-    struct page_info *pg, unsigned int order)
+/*
+ * Move 2^@order pages into the free (or offlined) state, flagging them as
+ * needing scrubbing if @need_scrub. Returns whether any of them got
+ * offlined. Must hold the pages' node's heap_lock.
+ */
+static bool_t mark_pages_free(struct page_info *pg, unsigned int order,
+                              bool_t need_scrub)
 {
-    unsigned long mask, mfn = page_to_mfn(pg);
-    unsigned int i, node = phys_to_nid(page_to_maddr(pg)), tainted = 0;
-    unsigned int zone = page_to_zone(pg);
-
-    ASSERT(order <= MAX_ORDER);
-    ASSERT(node >= 0);
+    unsigned int i, node = phys_to_nid(page_to_maddr(pg));
+    bool_t tainted = 0;
 
-    spin_lock(&heap_lock);
+    ASSERT(spin_is_locked(&heap_lock(node)));
 
     for ( i = 0; i < (1 << order); i++ )
     {
@@ -952,7 +1237,27 @@ static void free_heap_pages(
               ? PGC_state_offlined : PGC_state_free));
         if ( page_state_is(&pg[i], offlined) )
             tainted = 1;
+        else if ( need_scrub )
+        {
+            pg[i].count_info |= PGC_need_scrub;
+            node_need_scrub[node]++;
+        }
+    }
+
+    return tainted;
+}
+
+/*
+ * Record the TLB flush requirement of 2^@order pages which are about to
+ * become free, and detach them from their owner.
+ */
+static void release_page_owner(struct page_info *pg, unsigned int order)
+{
+    unsigned long mfn = page_to_mfn(pg);
+    unsigned int i;
 
+    for ( i = 0; i < (1 << order); i++ )
+    {
         /* If a page has no owner it will need no safety TLB flush. */
         pg[i].u.free.need_tlbflush = (page_get_owner(&pg[i]) != NULL);
         if ( pg[i].u.free.need_tlbflush )
@@ -962,10 +1267,28 @@ static void free_heap_pages(
         page_set_owner(&pg[i], NULL); /* set_gpfn_from_mfn snoops pg owner */
         set_gpfn_from_mfn(mfn + i, INVALID_M2P_ENTRY);
     }
+}
+
+/*
+ * Add 2^@order pages, already marked free, to the buddy heap, merging
+ * chunks as far as possible. Must hold the pages' node's heap_lock.
+ */
+static void merge_free_pages(
+    struct page_info *pg, unsigned int order, bool_t tainted,
+    bool_t need_scrub)
+{
+    unsigned long mask;
+    unsigned int first_dirty = need_scrub ? 0 : INVALID_DIRTY_IDX;
+    unsigned int node = phys_to_nid(page_to_maddr(pg));
+    unsigned int zone = page_to_zone(pg);
+
+    ASSERT(order <= MAX_ORDER);
+    ASSERT(node >= 0);
+    ASSERT(spin_is_locked(&heap_lock(node)));
 
-    avail[node][zone] += 1 << order;
-    total_avail_pages += 1 << order;
+    adjust_avail_pages(node, zone, 1L << order);
 
+    /* Racy against other nodes, but this is only a heuristic. */
     if ( tmem_enabled() )
         midsize_alloc_zone_pages = max(
             midsize_alloc_zone_pages, total_avail_pages / MIDSIZE_ALLOC_FRAC);
@@ -983,8 +1306,14 @@ static void free_heap_pages(
                  (PFN_ORDER(pg-mask) != order) ||
                  (phys_to_nid(page_to_maddr(pg-mask)) != node) )
                 break;
+            /* Update predecessor's first_dirty if necessary. */
+            check_and_stop_scrub(pg - mask);
+            if ( (pg - mask)->u.free.first_dirty == INVALID_DIRTY_IDX &&
+                 first_dirty != INVALID_DIRTY_IDX )
+                (pg - mask)->u.free.first_dirty = first_dirty + mask;
             pg -= mask;
-            page_list_del(pg, &heap(node, zone, order));
+            first_dirty = pg->u.free.first_dirty;
+            page_list_del_free(pg, node, zone, order);
         }
         else
         {
@@ -994,21 +1323,407 @@ static void free_heap_pages(
                  (PFN_ORDER(pg+mask) != order) ||
                  (phys_to_nid(page_to_maddr(pg+mask)) != node) )
                 break;
-            page_list_del(pg + mask, &heap(node, zone, order));
+            /* Update our first_dirty if the successor has dirty pages. */
+            check_and_stop_scrub(pg + mask);
+            if ( first_dirty == INVALID_DIRTY_IDX &&
+                 (pg + mask)->u.free.first_dirty != INVALID_DIRTY_IDX )
+                first_dirty = (pg + mask)->u.free.first_dirty + mask;
+            page_list_del_free(pg + mask, node, zone, order);
         }
 
         order++;
     }
 
-    PFN_ORDER(pg) = order;
-    page_list_add_tail(pg, &heap(node, zone, order));
+    page_list_add_scrub(pg, node, zone, order, first_dirty);
 
     if ( tainted )
         reserve_offlined_page(pg);
+}
 
-    spin_unlock(&heap_lock);
+/* Free 2^@order set of pages, leaving them to be scrubbed if @need_scrub. */
+static void free_heap_pages(
+    struct page_info *pg, unsigned int order, bool_t need_scrub)
+{
+    bool_t tainted;
+
+    ASSERT(order <= MAX_ORDER);
+
+    spin_lock(&page_heap_lock(pg));
+
+    tainted = mark_pages_free(pg, order, need_scrub);
+    release_page_owner(pg, order);
+    merge_free_pages(pg, order, tainted, need_scrub);
+
+    spin_unlock(&page_heap_lock(pg));
+}
+
+
+/*************************
+ * PER-CPU PAGE CACHES
+ *
+ * Each CPU keeps a few free order-0 and superpage-sized blocks from its own
+ * NUMA node, so that the common populate_physmap / decrease_reservation
+ * paths need not take a heap_lock for every page. Caches are refilled from,
+ * and drained to, the buddy heap in batches.
+ *
+ * Pages held in a cache are accounted as allocated by the buddy heap (they
+ * are in the "in use" state with no owner), which keeps them out of any
+ * merging. Caches get drained whenever an allocation would otherwise fail,
+ * whenever a claim is staked, and when their CPU goes offline.
+ */
+
+#define PAGE_CACHE_SUPERPAGE_ORDER 9
+
+static const struct {
+    unsigned int order;
+    unsigned int batch; /* blocks moved per refill / drain */
+    unsigned int high;  /* blocks held before draining */
+} page_cache_params[] = {
+    { 0, 32, 96 },
+    { PAGE_CACHE_SUPERPAGE_ORDER, 1, 2 },
+};
+#define NR_PAGE_CACHE_ORDERS ARRAY_SIZE(page_cache_params)
+
+struct page_cache {
+    spinlock_t lock;
+    struct page_list_head list[NR_PAGE_CACHE_ORDERS];
+    unsigned int count[NR_PAGE_CACHE_ORDERS];
+};
+
+static DEFINE_PER_CPU(struct page_cache, page_cache);
+static bool_t __read_mostly page_cache_initialised;
+
+static int page_cache_index(unsigned int order)
+{
+    unsigned int idx;
+
+    if ( !opt_pcpu_page_cache || !page_cache_initialised || tmem_enabled() )
+        return -1;
+
+    for ( idx = 0; idx < NR_PAGE_CACHE_ORDERS; idx++ )
+        if ( page_cache_params[idx].order == order )
+            return idx;
+
+    return -1;
+}
+
+/* Give a list of 2^@order blocks back to the buddy heap. */
+static void page_cache_free_list(
+    struct page_list_head *list, unsigned int order)
+{
+    struct page_info *pg;
+    nodeid_t node, locked = NUMA_NO_NODE;
+
+    /* Cached blocks normally all come from one node; lock each node once. */
+    while ( (pg = page_list_remove_head(list)) != NULL )
+    {
+        node = phys_to_nid(page_to_maddr(pg));
+        if ( node != locked )
+        {
+            if ( locked != NUMA_NO_NODE )
+                spin_unlock(&heap_lock(locked));
+            spin_lock(&heap_lock(node));
+            locked = node;
+        }
+        merge_free_pages(pg, order, mark_pages_free(pg, order, 0), 0);
+    }
+
+    if ( locked != NUMA_NO_NODE )
+        spin_unlock(&heap_lock(locked));
 }
 
+/* Pull a batch of blocks from @node into @pc. Must hold @pc's lock. */
+static void page_cache_refill(
+    struct page_cache *pc, unsigned int idx, unsigned int node,
+    unsigned int zone_lo, unsigned int zone_hi)
+{
+    unsigned int i, n, order = page_cache_params[idx].order;
+    unsigned long request = 1UL << order, dirty_cnt = 0;
+    struct page_info *pg;
+    PAGE_LIST_HEAD(list);
+
+    spin_lock(&heap_lock(node));
+
+    for ( n = 0; n < page_cache_params[idx].batch; n++ )
+    {
+        /* Never stash away memory which is claimed by some domain. */
+        if ( outstanding_claims + request > total_avail_pages ||
+             !node_claims_allow(node, request, NULL) )
+            break;
+
+        if ( (pg = get_free_buddy(node, zone_lo, zone_hi, order)) == NULL )
+            break;
+
+        for ( i = 0; i < (1 << order); i++ )
+        {
+            /* Reference count must continuously be zero for free pages. */
+            BUG_ON((pg[i].count_info & ~PGC_need_scrub) != PGC_state_free);
+            if ( pg[i].count_info & PGC_need_scrub )
+                dirty_cnt++;
+            pg[i].count_info = PGC_state_inuse |
+                               (pg[i].count_info & PGC_need_scrub);
+        }
+
+        page_list_add_tail(pg, &list);
+    }
+
+    ASSERT(node_need_scrub[node] >= dirty_cnt);
+    node_need_scrub[node] -= dirty_cnt;
+
+    spin_unlock(&heap_lock(node));
+
+    if ( n )
+        check_low_mem_virq();
+
+    /* Cached pages are always clean. */
+    while ( (pg = page_list_remove_head(&list)) != NULL )
+    {
+        for ( i = 0; dirty_cnt && i < (1 << order); i++ )
+            if ( test_bit(_PGC_need_scrub, &pg[i].count_info) )
+            {
+                scrub_one_page(&pg[i]);
+                clear_bit(_PGC_need_scrub, &pg[i].count_info);
+            }
+
+        page_list_add_tail(pg, &pc->list[idx]);
+        pc->count[idx]++;
+    }
+}
+
+static struct page_info *page_cache_alloc(
+    unsigned int node, unsigned int zone_lo, unsigned int zone_hi,
+    unsigned int order, unsigned int memflags)
+{
+    int idx = page_cache_index(order);
+    struct page_cache *pc;
+    struct page_info *pg;
+    unsigned int i, zone;
+    bool_t need_tlbflush = 0;
+    uint32_t tlbflush_timestamp = 0;
+
+    if ( idx < 0 || node != cpu_to_node(smp_processor_id()) )
+        return NULL;
+
+    pc = &this_cpu(page_cache);
+    spin_lock(&pc->lock);
+
+    if ( !pc->count[idx] )
+        page_cache_refill(pc, idx, node, zone_lo, zone_hi);
+
+    if ( (pg = page_list_first(&pc->list[idx])) != NULL )
+    {
+        zone = page_to_zone(pg);
+        if ( zone < zone_lo || zone > zone_hi ||
+             phys_to_nid(page_to_maddr(pg)) != node )
+            pg = NULL;
+        else
+        {
+            page_list_del(pg, &pc->list[idx]);
+            pc->count[idx]--;
+        }
+    }
+
+    spin_unlock(&pc->lock);
+
+    if ( pg == NULL )
+        return NULL;
+
+    for ( i = 0; i < (1 << order); i++ )
+    {
+        /* Pages being offlined, or found broken, go back to the heap. */
+        if ( unlikely(pg[i].count_info != PGC_state_inuse) )
+        {
+            PAGE_LIST_HEAD(list);
+
+            page_list_add(pg, &list);
+            page_cache_free_list(&list, order);
+            return NULL;
+        }
+    }
+
+    for ( i = 0; i < (1 << order); i++ )
+    {
+        if ( !(memflags & MEMF_no_tlbflush) )
+            accumulate_tlbflush(&need_tlbflush, &pg[i],
+                                &tlbflush_timestamp);
+
+        /* Initialise fields which have other uses for free pages. */
+        pg[i].u.inuse.type_info = 0;
+
+        flush_page_to_ram(page_to_mfn(&pg[i]));
+    }
+
+    if ( need_tlbflush )
+        filtered_flush_tlb_mask(tlbflush_timestamp);
+
+    return pg;
+}
+
+/*
+ * Try to stash 2^@order pages being freed in the local CPU's cache. Returns
+ * false if the caller needs to free them to the heap instead.
+ */
+static bool_t page_cache_free(struct page_info *pg, unsigned int order)
+{
+    int idx = page_cache_index(order);
+    PAGE_LIST_HEAD(list);
+    struct page_cache *pc;
+    unsigned long x;
+    unsigned int i;
+
+    if ( idx < 0 ||
+         phys_to_nid(page_to_maddr(pg)) != cpu_to_node(smp_processor_id()) )
+        return 0;
+
+    /*
+     * Only plain in-use pages may be cached. Anything being offlined or
+     * found broken needs the heap's handling. Use cmpxchg() as offlining
+     * may race with us without holding anything but heap_lock.
+     */
+    for ( i = 0; i < (1 << order); i++ )
+    {
+        x = pg[i].count_info;
+        if ( (x & (PGC_broken | PGC_state)) != PGC_state_inuse ||
+             (x != PGC_state_inuse &&
+              cmpxchg(&pg[i].count_info, x, PGC_state_inuse) != x) )
+            return 0;
+    }
+
+    release_page_owner(pg, order);
+
+    pc = &this_cpu(page_cache);
+    spin_lock(&pc->lock);
+
+    page_list_add(pg, &pc->list[idx]);
+    if ( ++pc->count[idx] > page_cache_params[idx].high )
+    {
+        for ( i = 0; i < page_cache_params[idx].batch; i++ )
+        {
+            struct page_info *tail = page_list_last(&pc->list[idx]);
+
+            page_list_del(tail, &pc->list[idx]);
+            page_list_add(tail, &list);
+        }
+        pc->count[idx] -= i;
+    }
+
+    spin_unlock(&pc->lock);
+
+    page_cache_free_list(&list, page_cache_params[idx].order);
+
+    return 1;
+}
+
+/* Give everything cached by @cpu back to the heap. Returns pages drained. */
+static unsigned long page_cache_drain(unsigned int cpu)
+{
+    struct page_cache *pc = &per_cpu(page_cache, cpu);
+    struct page_list_head list[NR_PAGE_CACHE_ORDERS];
+    unsigned long pages = 0;
+    unsigned int idx;
+
+    spin_lock(&pc->lock);
+    for ( idx = 0; idx < NR_PAGE_CACHE_ORDERS; idx++ )
+    {
+        INIT_PAGE_LIST_HEAD(&list[idx]);
+        page_list_move(&list[idx], &pc->list[idx]);
+        pages += (unsigned long)pc->count[idx] << page_cache_params[idx].order;
+        pc->count[idx] = 0;
+    }
+    spin_unlock(&pc->lock);
+
+    for ( idx = 0; idx < NR_PAGE_CACHE_ORDERS; idx++ )
+        page_cache_free_list(&list[idx], page_cache_params[idx].order);
+
+    return pages;
+}
+
+/* Give the local CPU's cached pages back to the heap, for them to merge. */
+void page_cache_drain_local(void)
+{
+    page_cache_drain(smp_processor_id());
+}
+
+static unsigned long page_cache_drain_all(void)
+{
+    unsigned long pages = 0;
+    unsigned int cpu;
+
+    if ( !page_cache_initialised )
+        return 0;
+
+    for_each_online_cpu ( cpu )
+        pages += page_cache_drain(cpu);
+
+    return pages;
+}
+
+/* Number of pages held by the caches of CPUs on @node (-1: all nodes). */
+static unsigned long page_cache_pages(int node)
+{
+    unsigned long pages = 0;
+    unsigned int cpu, idx;
+
+    if ( !page_cache_initialised )
+        return 0;
+
+    for_each_online_cpu ( cpu )
+    {
+        const struct page_cache *pc = &per_cpu(page_cache, cpu);
+
+        if ( node != -1 && cpu_to_node(cpu) != node )
+            continue;
+        for ( idx = 0; idx < NR_PAGE_CACHE_ORDERS; idx++ )
+            pages += (unsigned long)read_atomic(&pc->count[idx]) <<
+                     page_cache_params[idx].order;
+    }
+
+    return pages;
+}
+
+static int cpu_page_cache_callback(
+    struct notifier_block *nfb, unsigned long action, void *hcpu)
+{
+    unsigned int cpu = (unsigned long)hcpu, idx;
+    struct page_cache *pc = &per_cpu(page_cache, cpu);
+
+    switch ( action )
+    {
+    case CPU_UP_PREPARE:
+        spin_lock_init(&pc->lock);
+        for ( idx = 0; idx < NR_PAGE_CACHE_ORDERS; idx++ )
+        {
+            INIT_PAGE_LIST_HEAD(&pc->list[idx]);
+            pc->count[idx] = 0;
+        }
+        break;
+    case CPU_UP_CANCELED:
+    case CPU_DEAD:
+        page_cache_drain(cpu);
+        break;
+    default:
+        break;
+    }
+
+    return NOTIFY_DONE;
+}
+
+static struct notifier_block cpu_page_cache_nfb = {
+    .notifier_call = cpu_page_cache_callback
+};
+
+static int __init page_cache_init(void)
+{
+    void *cpu = (void *)(long)smp_processor_id();
+
+    cpu_page_cache_callback(&cpu_page_cache_nfb, CPU_UP_PREPARE, cpu);
+    register_cpu_notifier(&cpu_page_cache_nfb);
+    page_cache_initialised = 1;
+
+    return 0;
+}
+presmp_initcall(page_cache_init);
+
 
 /*
  * Following rules applied for page offline:
@@ -1021,7 +1736,7 @@ static unsigned long mark_page_offline(struct page_info *pg, int broken)
     unsigned long nx, x, y = pg->count_info;
 
     ASSERT(page_is_ram_type(page_to_mfn(pg), RAM_TYPE_CONVENTIONAL));
-    ASSERT(spin_is_locked(&heap_lock));
+    ASSERT(spin_is_locked(&page_heap_lock(pg)));
 
     do {
         nx = x = y;
@@ -1115,7 +1830,7 @@ int offline_page(unsigned long mfn, int broken, uint32_t *status)
         return 0;
     }
 
-    spin_lock(&heap_lock);
+    spin_lock(&page_heap_lock(pg));
 
     old_info = mark_page_offline(pg, broken);
 
@@ -1123,14 +1838,14 @@ int offline_page(unsigned long mfn, int broken, uint32_t *status)
     {
         reserve_heap_page(pg);
 
-        spin_unlock(&heap_lock);
+        spin_unlock(&page_heap_lock(pg));
 
         *status = broken ? PG_OFFLINE_OFFLINED | PG_OFFLINE_BROKEN
                          : PG_OFFLINE_OFFLINED;
         return 0;
     }
 
-    spin_unlock(&heap_lock);
+    spin_unlock(&page_heap_lock(pg));
 
     if ( (owner = page_get_owner_and_reference(pg)) )
     {
@@ -1192,7 +1907,7 @@ unsigned int online_page(unsigned long mfn, uint32_t *status)
 
     pg = mfn_to_page(mfn);
 
-    spin_lock(&heap_lock);
+    spin_lock(&page_heap_lock(pg));
 
     y = pg->count_info;
     do {
@@ -1207,7 +1922,9 @@ unsigned int online_page(unsigned long mfn, uint32_t *status)
 
         if ( (y & PGC_state) == PGC_state_offlined )
         {
+            spin_lock(&page_offline_lock);
             page_list_del(pg, &page_offlined_list);
+            spin_unlock(&page_offline_lock);
             *status = PG_ONLINE_ONLINED;
         }
         else if ( (y & PGC_state) == PGC_state_offlining )
@@ -1223,10 +1940,10 @@ unsigned int online_page(unsigned long mfn, uint32_t *status)
         nx = (x & ~PGC_state) | PGC_state_inuse;
     } while ( (y = cmpxchg(&pg->count_info, x, nx)) != x );
 
-    spin_unlock(&heap_lock);
+    spin_unlock(&page_heap_lock(pg));
 
     if ( (y & PGC_state) == PGC_state_offlined )
-        free_heap_pages(pg, 0);
+        free_heap_pages(pg, 0, 0);
 
     return ret;
 }
@@ -1242,10 +1959,10 @@ int query_page_offline(unsigned long mfn, uint32_t *status)
     }
 
     *status = 0;
-    spin_lock(&heap_lock);
-
     pg = mfn_to_page(mfn);
 
+    spin_lock(&page_heap_lock(pg));
+
     if ( page_state_is(pg, offlining) )
         *status |= PG_OFFLINE_STATUS_OFFLINE_PENDING;
     if ( pg->count_info & PGC_broken )
@@ -1253,7 +1970,7 @@ int query_page_offline(unsigned long mfn, uint32_t *status)
     if ( page_state_is(pg, offlined) )
         *status |= PG_OFFLINE_STATUS_OFFLINED;
 
-    spin_unlock(&heap_lock);
+    spin_unlock(&page_heap_lock(pg));
 
     return 0;
 }
@@ -1295,7 +2012,7 @@ static void init_heap_pages(
             nr_pages -= n;
         }
 
-        free_heap_pages(pg+i, 0);
+        free_heap_pages(pg+i, 0, 0);
     }
 }
 
@@ -1322,7 +2039,7 @@ static unsigned long avail_heap_pages(
 
 unsigned long total_free_pages(void)
 {
-    return total_avail_pages - midsize_alloc_zone_pages;
+    return total_avail_pages + page_cache_pages(-1) - midsize_alloc_zone_pages;
 }
 
 void __init end_boot_allocator(void)
@@ -1367,6 +2084,8 @@ static void __init smp_scrub_heap_pages(void *data)
     unsigned int temp_cpu, cpu_idx = 0;
     nodeid_t node;
     unsigned int cpu = smp_processor_id();
+    unsigned long scrubbed = 0;
+    s_time_t t = NOW();
 
     if ( data )
         r = data;
@@ -1409,7 +2128,13 @@ static void __init smp_scrub_heap_pages(void *data)
             continue;
 
         scrub_one_page(pg);
+        scrubbed++;
     }
+
+    spin_lock(&r->stats_lock);
+    r->scrubbed += scrubbed;
+    r->busy += NOW() - t;
+    spin_unlock(&r->stats_lock);
 }
 
 static int __init find_non_smt(unsigned int node, cpumask_t *dest)
@@ -1429,6 +2154,33 @@ static int __init find_non_smt(unsigned int node, cpumask_t *dest)
     return cpumask_weight(dest);
 }
 
+/* Pick the CPUs of @node to scrub with, as controlled by bootscrub_threads. */
+static int __init find_scrub_cpus(unsigned int node, cpumask_t *dest)
+{
+    cpumask_t node_cpus;
+    unsigned int i, cpus = find_non_smt(node, dest);
+
+    if ( !opt_bootscrub_threads )
+        return cpus;
+
+    cpumask_and(&node_cpus, &node_to_cpumask(node), &cpu_online_map);
+    for_each_cpu ( i, &node_cpus )
+    {
+        if ( cpus >= opt_bootscrub_threads )
+            break;
+        if ( !cpumask_test_cpu(i, dest) )
+        {
+            __cpumask_set_cpu(i, dest);
+            cpus++;
+        }
+    }
+
+    for ( ; cpus > opt_bootscrub_threads; cpus-- )
+        __cpumask_clear_cpu(cpumask_last(dest), dest);
+
+    return cpus;
+}
+
 /*
  * Scrub all unallocated pages in all heap zones. This function uses all
  * online cpu's to scrub the memory in parallel.
@@ -1463,7 +2215,7 @@ void __init scrub_heap_pages(void)
         /* Just in case NODE has 1 page and starts below first_valid_mfn. */
         end = max(end, start);
         /* CPUs that are online and on this node (if none, that it is OK). */
-        cpus = find_non_smt(i, &node_cpus);
+        cpus = find_scrub_cpus(i, &node_cpus);
         cpumask_or(&all_worker_cpus, &all_worker_cpus, &node_cpus);
         if ( cpus <= 0 )
         {
@@ -1481,6 +2233,7 @@ void __init scrub_heap_pages(void)
         region[i].start = start;
         region[i].rem = rem;
         cpumask_copy(&region[i].cpus, &node_cpus);
+        spin_lock_init(&region[i].stats_lock);
     }
 
     printk("Scrubbing Free RAM on %d nodes using %d CPUs\n", num_online_nodes(),
@@ -1494,9 +2247,9 @@ void __init scrub_heap_pages(void)
 
         process_pending_softirqs();
 
-        spin_lock(&heap_lock);
+        heap_lock_all();
         on_selected_cpus(&all_worker_cpus, smp_scrub_heap_pages, NULL, 1);
-        spin_unlock(&heap_lock);
+        heap_unlock_all();
 
         printk(".");
     }
@@ -1533,7 +2286,7 @@ void __init scrub_heap_pages(void)
          * Use CPUs from best node, and if there are no CPUs on the
          * first node (the default) use the BSP.
          */
-        cpus = find_non_smt(best_node, &node_cpus);
+        cpus = find_scrub_cpus(best_node, &node_cpus);
         if ( cpus == 0 )
         {
             __cpumask_set_cpu(smp_processor_id(), &node_cpus);
@@ -1551,9 +2304,9 @@ void __init scrub_heap_pages(void)
 
             process_pending_softirqs();
 
-            spin_lock(&heap_lock);
+            spin_lock(&heap_lock(i));
             on_selected_cpus(&node_cpus, smp_scrub_heap_pages, &region[i], 1);
-            spin_unlock(&heap_lock);
+            spin_unlock(&heap_lock(i));
 
             printk(".");
         }
@@ -1561,6 +2314,21 @@ void __init scrub_heap_pages(void)
 
     printk("done.\n");
 
+    for_each_online_node ( i )
+    {
+        unsigned long mib = region[i].scrubbed >> (20 - PAGE_SHIFT);
+        s_time_t wall;
+
+        if ( !region[i].busy )
+            continue;
+
+        /* The CPUs of a node run concurrently: average their busy time. */
+        wall = region[i].busy / cpumask_weight(&region[i].cpus) ?: 1;
+        printk("Node %u: scrubbed %lu MiB on %u CPUs, %"PRI_stime" MiB/s\n",
+               i, mib, cpumask_weight(&region[i].cpus),
+               (s_time_t)mib * SECONDS(1) / wall);
+    }
+
     /* Now that the heap is initialized, run checks and set bounds
      * for the low mem virq algorithm. */
     setup_low_mem_virq();
@@ -1622,7 +2390,7 @@ void free_xenheap_pages(void *v, unsigned int order)
 
     memguard_guard_range(v, 1 << (order + PAGE_SHIFT));
 
-    free_heap_pages(virt_to_page(v), order);
+    free_heap_pages(virt_to_page(v), order, 0);
 }
 
 #else
@@ -1676,12 +2444,9 @@ void free_xenheap_pages(void *v, unsigned int order)
     pg = virt_to_page(v);
 
     for ( i = 0; i < (1u << order); i++ )
-    {
-        scrub_one_page(&pg[i]);
         pg[i].count_info &= ~PGC_xen_heap;
-    }
 
-    free_heap_pages(pg, order);
+    free_heap_pages(pg, order, 1);
 }
 
 #endif
@@ -1790,7 +2555,7 @@ struct page_info *alloc_domheap_pages(
     if ( d && !(memflags & MEMF_no_owner) &&
          assign_pages(d, pg, order, memflags) )
     {
-        free_heap_pages(pg, order);
+        free_heap_pages(pg, order, 0);
         return NULL;
     }
     
@@ -1858,17 +2623,49 @@ void free_domheap_pages(struct page_info *pg, unsigned int order)
             scrub = 1;
         }
 
-        if ( unlikely(scrub) )
-            for ( i = 0; i < (1 << order); i++ )
-                scrub_one_page(&pg[i]);
-
-        free_heap_pages(pg, order);
+        /* Pages needing scrubbing are left to the idle-loop scrubber. */
+        if ( scrub || !page_cache_free(pg, order) )
+            free_heap_pages(pg, order, scrub);
     }
 
     if ( drop_dom_ref )
         put_domain(d);
 }
 
+/*
+ * Free a list of single pages which have neither an owner nor references
+ * left (e.g. stolen from a domain), taking each node's heap_lock once for
+ * the lot rather than once per page.  The pages are left to be scrubbed.
+ */
+void free_domheap_page_list(struct page_list_head *list)
+{
+    struct page_info *pg;
+    nodeid_t node, locked = NUMA_NO_NODE;
+    bool_t tainted;
+
+    while ( (pg = page_list_remove_head(list)) != NULL )
+    {
+        ASSERT(!page_get_owner(pg) && !is_xen_heap_page(pg));
+        ASSERT(!(pg->count_info & PGC_count_mask));
+
+        node = phys_to_nid(page_to_maddr(pg));
+        if ( node != locked )
+        {
+            if ( locked != NUMA_NO_NODE )
+                spin_unlock(&heap_lock(locked));
+            spin_lock(&heap_lock(node));
+            locked = node;
+        }
+
+        tainted = mark_pages_free(pg, 0, 1);
+        release_page_owner(pg, 0);
+        merge_free_pages(pg, 0, tainted, 1);
+    }
+
+    if ( locked != NUMA_NO_NODE )
+        spin_unlock(&heap_lock(locked));
+}
+
 unsigned long avail_domheap_pages_region(
     unsigned int node, unsigned int min_width, unsigned int max_width)
 {
@@ -1887,12 +2684,38 @@ unsigned long avail_domheap_pages(void)
 {
     return avail_heap_pages(MEMZONE_XEN + 1,
                             NR_ZONES - 1,
-                            -1);
+                            -1) + page_cache_pages(-1);
 }
 
 unsigned long avail_node_heap_pages(unsigned int nodeid)
 {
-    return avail_heap_pages(MEMZONE_XEN, NR_ZONES -1, nodeid);
+    return avail_heap_pages(MEMZONE_XEN, NR_ZONES -1, nodeid) +
+           page_cache_pages(nodeid);
+}
+
+/*
+ * Copy the number of free chunks of each order (up to @nr of them) on @node
+ * to @chunks.  Pages in the per-CPU caches are not included.  Returns the
+ * number of orders there are.
+ */
+unsigned int avail_node_heap_chunks(unsigned int node, unsigned long *chunks,
+                                    unsigned int nr)
+{
+    unsigned int order;
+
+    if ( node >= MAX_NUMNODES )
+        nr = 0;
+    nr = min(nr, MAX_ORDER + 1U);
+
+    if ( nr )
+    {
+        spin_lock(&heap_lock(node));
+        for ( order = 0; order < nr; order++ )
+            chunks[order] = node_heap[node].free_chunks[order];
+        spin_unlock(&heap_lock(node));
+    }
+
+    return MAX_ORDER + 1;
 }
 
 
@@ -1921,6 +2744,8 @@ static void pagealloc_info(unsigned char key)
     }
 
     printk("    Dom heap: %lukB free\n", total << (PAGE_SHIFT-10));
+    printk("    Per-CPU caches: %lukB\n",
+           page_cache_pages(-1) << (PAGE_SHIFT-10));
 }
 
 static __init int pagealloc_keyhandler_init(void)
@@ -1945,6 +2770,187 @@ void scrub_one_page(struct page_info *pg)
 #endif
 }
 
+/*
+ * Find a node for the local CPU to scrub: its own node, or else the closest
+ * memory-only node with unscrubbed pages. With @get_node, also claim it so
+ * that only one CPU at a time scrubs any node.
+ */
+static nodeid_t node_to_scrub(bool_t get_node)
+{
+    nodeid_t node = cpu_to_node(smp_processor_id()), local_node;
+    nodeid_t closest = NUMA_NO_NODE;
+    u8 dist, shortest = 0xff;
+
+    if ( node == NUMA_NO_NODE )
+        node = 0;
+
+    if ( node_need_scrub[node] &&
+         (!get_node || !node_test_and_set(node, node_scrubbing)) )
+        return node;
+
+    /*
+     * See if there are memory-only nodes that need scrubbing and choose
+     * the closest one.
+     */
+    local_node = node;
+    for ( ; ; )
+    {
+        do {
+            node = cycle_node(node, node_online_map);
+        } while ( !cpumask_empty(&node_to_cpumask(node)) &&
+                  (node != local_node) );
+
+        if ( node == local_node )
+            break;
+
+        if ( node_need_scrub[node] )
+        {
+            if ( !get_node )
+                return node;
+
+            dist = __node_distance(local_node, node);
+
+            /*
+             * Grab the node right away. If we find a closer node later we
+             * will release this one. While there is a chance that another
+             * CPU will not be able to scrub that node when it is searching
+             * for scrub work at the same time it will be able to do so next
+             * time it wakes up. The alternative would be to perform this
+             * search under a lock but then we'd need to take this lock
+             * every time we come in here.
+             */
+            if ( (dist < shortest || closest == NUMA_NO_NODE) &&
+                 !node_test_and_set(node, node_scrubbing) )
+            {
+                if ( closest != NUMA_NO_NODE )
+                    node_clear(closest, node_scrubbing);
+                shortest = dist;
+                closest = node;
+            }
+        }
+    }
+
+    return closest;
+}
+
+/*
+ * Scrub some free pages from the idle loop. Returns whether there is more
+ * scrubbing left to do, i.e. whether the caller should not go to sleep.
+ */
+bool_t scrub_free_pages(void)
+{
+    struct page_info *pg;
+    unsigned int zone, order, i, cnt = 0, dirty_cnt, next;
+    unsigned int cpu = smp_processor_id();
+    bool_t preempt = 0, aborted;
+    typeof(pg->u.free) pgfree;
+    nodeid_t node;
+
+    node = node_to_scrub(1);
+    if ( node == NUMA_NO_NODE )
+        return 0;
+
+    spin_lock(&heap_lock(node));
+
+    for ( zone = 0; zone < NR_ZONES; zone++ )
+    {
+        order = MAX_ORDER;
+        do {
+            while ( !page_list_empty(&heap(node, zone, order)) )
+            {
+                /* Unscrubbed chunks are always at the end of the list. */
+                pg = page_list_last(&heap(node, zone, order));
+                if ( pg->u.free.first_dirty == INVALID_DIRTY_IDX )
+                    break;
+
+                ASSERT(pg->u.free.scrub_state == BUDDY_NOT_SCRUBBING);
+                pg->u.free.scrub_state = BUDDY_SCRUBBING;
+
+                spin_unlock(&heap_lock(node));
+
+                dirty_cnt = 0;
+                for ( i = pg->u.free.first_dirty; i < (1U << order); i++ )
+                {
+                    if ( test_bit(_PGC_need_scrub, &pg[i].count_info) )
+                    {
+                        scrub_one_page(&pg[i]);
+                        /*
+                         * Nobody but a concurrent offline_page() touches a
+                         * chunk we are scrubbing, and it uses cmpxchg().
+                         */
+                        clear_bit(_PGC_need_scrub, &pg[i].count_info);
+                        dirty_cnt++;
+                        cnt += 100; /* scrubbed pages add heavier weight. */
+                    }
+                    else
+                        cnt++;
+
+                    /* Someone wants this chunk? */
+                    pgfree.val = ACCESS_ONCE(pg->u.free.val);
+                    if ( pgfree.scrub_state == BUDDY_SCRUB_ABORT )
+                        break;
+
+                    /* Preempt if there is a softirq pending. */
+                    if ( cnt >= 100 && softirq_pending(cpu) )
+                    {
+                        preempt = 1;
+                        break;
+                    }
+                }
+
+                next = (i >= (1U << order) - 1) ? INVALID_DIRTY_IDX : i + 1;
+
+                /*
+                 * Re-acquire the lock. Whoever asked us to abort holds it
+                 * until we let go of the chunk, so acknowledge such requests
+                 * while waiting.
+                 */
+                aborted = 0;
+                while ( !spin_trylock(&heap_lock(node)) )
+                {
+                    pgfree.val = ACCESS_ONCE(pg->u.free.val);
+                    if ( pgfree.scrub_state == BUDDY_SCRUB_ABORT )
+                    {
+                        pg->u.free.first_dirty = next;
+                        /* Write first_dirty before setting scrub_state. */
+                        smp_wmb();
+                        pg->u.free.scrub_state = BUDDY_NOT_SCRUBBING;
+                        aborted = 1;
+                        spin_lock(&heap_lock(node));
+                        break;
+                    }
+                    cpu_relax();
+                }
+
+                node_need_scrub[node] -= dirty_cnt;
+
+                if ( !aborted )
+                {
+                    pg->u.free.scrub_state = BUDDY_NOT_SCRUBBING;
+                    if ( next == INVALID_DIRTY_IDX )
+                    {
+                        /* Clean chunks go to the head of the list. */
+                        page_list_del_free(pg, node, zone, order);
+                        page_list_add_scrub(pg, node, zone, order,
+                                            INVALID_DIRTY_IDX);
+                    }
+                    else
+                        pg->u.free.first_dirty = next;
+                }
+
+                if ( preempt || !node_need_scrub[node] )
+                    goto out;
+            }
+        } while ( order-- != 0 );
+    }
+
+ out:
+    spin_unlock(&heap_lock(node));
+    node_clear(node, node_scrubbing);
+
+    return node_to_scrub(0) != NUMA_NO_NODE;
+}
+
 static void dump_heap(unsigned char key)
 {
     s_time_t      now = NOW();
@@ -1961,6 +2967,21 @@ static void dump_heap(unsigned char key)
             printk("heap[node=%d][zone=%d] -> %lu pages\n",
                    i, j, avail[i][j]);
     }
+
+    for ( i = 0; i < MAX_NUMNODES; i++ )
+    {
+        if ( !node_need_scrub[i] )
+            continue;
+        printk("Node %d has %lu unscrubbed pages\n", i, node_need_scrub[i]);
+    }
+
+    for ( i = 0; i < MAX_NUMNODES; i++ )
+    {
+        if ( !node_heap[i].outstanding_claims )
+            continue;
+        printk("Node %d has %lu claimed pages\n",
+               i, node_heap[i].outstanding_claims);
+    }
 }
 
 static __init int register_heap_trigger(void)
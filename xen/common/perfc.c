@@ -7,6 +7,7 @@
 #include <xen/spinlock.h>
 #include <xen/mm.h>
 #include <xen/guest_access.h>
+#include <xen/sched.h>
 #include <public/sysctl.h>
 #include <asm/perfc.h>
 
@@ -14,6 +15,7 @@
 #define PERFCOUNTER_ARRAY( var, name, size )  { name, TYPE_ARRAY,  size },
 #define PERFSTATUS( var, name )               { name, TYPE_S_SINGLE, 0 },
 #define PERFSTATUS_ARRAY( var, name, size )   { name, TYPE_S_ARRAY,  size },
+#define PERFCOUNTER_DOM( var, name )          { name, TYPE_SINGLE, 0 },
 static const struct {
     const char *name;
     enum { TYPE_SINGLE, TYPE_ARRAY,
@@ -26,8 +28,44 @@ static const struct {
 
 #define NR_PERFCTRS (sizeof(perfc_info) / sizeof(perfc_info[0]))
 
+#undef PERFCOUNTER
+#undef PERFCOUNTER_ARRAY
+#undef PERFSTATUS
+#undef PERFSTATUS_ARRAY
+#undef PERFCOUNTER_DOM
+#define PERFCOUNTER( var, name )
+#define PERFCOUNTER_ARRAY( var, name, size )
+#define PERFSTATUS( var, name )
+#define PERFSTATUS_ARRAY( var, name, size )
+#define PERFCOUNTER_DOM( var, name )          name,
+static const char *const perfc_dom_names[] = {
+#include <xen/perfc_defn.h>
+};
+
 DEFINE_PER_CPU(perfc_t[NUM_PERFCOUNTERS], perfcounters);
 
+unsigned int __read_mostly perfc_dom_sample_mask;
+
+/* Account one in every 2^<n> events of domain-scoped counters. */
+static void __init parse_perfc_dom_sample(const char *s)
+{
+    perfc_dom_sample_mask = (1u << min(simple_strtoul(s, NULL, 0), 16ul)) - 1;
+}
+custom_param("perfc_dom_sample", parse_perfc_dom_sample);
+
+int perfc_domain_init(struct domain *d)
+{
+    d->perfc = xzalloc_array(perfc_t, NUM_PERFC_DOM_COUNTERS);
+
+    return d->perfc ? 0 : -ENOMEM;
+}
+
+void perfc_domain_destroy(struct domain *d)
+{
+    xfree(d->perfc);
+    d->perfc = NULL;
+}
+
 void perfc_printall(unsigned char key)
 {
     unsigned int i, j;
@@ -120,6 +158,7 @@ void perfc_reset(unsigned char key)
 {
     unsigned int i, j;
     s_time_t now = NOW();
+    struct domain *d;
 
     if ( key != '\0' )
         printk("Xen performance counters RESET (now = 0x%08X:%08X)\n",
@@ -149,6 +188,12 @@ void perfc_reset(unsigned char key)
         }
     }
 
+    rcu_read_lock(&domlist_read_lock);
+    for_each_domain ( d )
+        if ( d->perfc )
+            memset(d->perfc, 0, NUM_PERFC_DOM_COUNTERS * sizeof(perfc_t));
+    rcu_read_unlock(&domlist_read_lock);
+
     arch_perfc_reset();
 }
 
@@ -240,6 +285,65 @@ static int perfc_copy_info(XEN_GUEST_HANDLE_64(xen_sysctl_perfc_desc_t) desc,
     return 0;
 }
 
+/*
+ * Copy out the names of the domain-scoped counters, and a row with the
+ * domain ID and the values of those counters for each domain.
+ */
+static int perfc_copy_dom(xen_sysctl_perfc_op_t *pc)
+{
+    xen_sysctl_perfc_val_t row[NUM_PERFC_DOM_COUNTERS + 1];
+    unsigned int i, nr = 0;
+    struct domain *d;
+    int rc = 0;
+
+    if ( !guest_handle_is_null(pc->desc) )
+    {
+        for ( i = 0; i < NUM_PERFC_DOM_COUNTERS; i++ )
+        {
+            xen_sysctl_perfc_desc_t desc = { .nr_vals = 1 };
+
+            safe_strcpy(desc.name, perfc_dom_names[i]);
+            if ( copy_to_guest_offset(pc->desc, i, &desc, 1) )
+                return -EFAULT;
+        }
+    }
+
+    rcu_read_lock(&domlist_read_lock);
+
+    for_each_domain ( d )
+    {
+        if ( !d->perfc )
+            continue;
+
+        if ( !guest_handle_is_null(pc->val) )
+        {
+            if ( nr + ARRAY_SIZE(row) > pc->nr_vals )
+            {
+                rc = -ENOBUFS;
+                break;
+            }
+
+            row[0] = d->domain_id;
+            for ( i = 0; i < NUM_PERFC_DOM_COUNTERS; i++ )
+                row[i + 1] = d->perfc[i];
+            if ( copy_to_guest_offset(pc->val, nr, row, ARRAY_SIZE(row)) )
+            {
+                rc = -EFAULT;
+                break;
+            }
+        }
+
+        nr += ARRAY_SIZE(row);
+    }
+
+    rcu_read_unlock(&domlist_read_lock);
+
+    pc->nr_counters = NUM_PERFC_DOM_COUNTERS;
+    pc->nr_vals = nr;
+
+    return rc;
+}
+
 /* Dom0 control of perf counters */
 int perfc_control(xen_sysctl_perfc_op_t *pc)
 {
@@ -259,6 +363,11 @@ int perfc_control(xen_sysctl_perfc_op_t *pc)
         rc = perfc_copy_info(pc->desc, pc->val);
         break;
 
+    case XEN_SYSCTL_PERFCOP_query_dom:
+        rc = perfc_copy_dom(pc);
+        spin_unlock(&lock);
+        return rc;
+
     default:
         rc = -EINVAL;
         break;
@@ -21,6 +21,7 @@
 #include <xen/init.h>
 #include <xen/radix-tree.h>
 #include <xen/errno.h>
+#include <xen/prefetch.h>
 
 struct radix_tree_path {
 	struct radix_tree_node *node;
@@ -29,13 +30,17 @@ struct radix_tree_path {
 
 #define RADIX_TREE_INDEX_BITS  (8 /* CHAR_BIT */ * sizeof(unsigned long))
 #define RADIX_TREE_MAX_PATH (DIV_ROUND_UP(RADIX_TREE_INDEX_BITS, \
-					  RADIX_TREE_MAP_SHIFT))
+					  RADIX_TREE_MIN_MAP_SHIFT))
 
-/*
- * The height_to_maxindex array needs to be one deeper than the maximum
- * path as height 0 holds only 1 entry.
- */
-static unsigned long height_to_maxindex[RADIX_TREE_MAX_PATH + 1] __read_mostly;
+static inline unsigned long map_size(const struct radix_tree_root *root)
+{
+	return 1UL << root->shift;
+}
+
+static inline unsigned long map_mask(const struct radix_tree_root *root)
+{
+	return map_size(root) - 1;
+}
 
 static inline void *ptr_to_indirect(void *ptr)
 {
@@ -48,13 +53,15 @@ static inline void *indirect_to_ptr(void *ptr)
 }
 
 struct rcu_node {
-	struct radix_tree_node node;
 	struct rcu_head rcu_head;
+	struct radix_tree_node node;	/* Must be last */
 };
 
+/* The default allocator, with the tree's root as @arg. */
 static struct radix_tree_node *rcu_node_alloc(void *arg)
 {
-	struct rcu_node *rcu_node = xmalloc(struct rcu_node);
+	struct rcu_node *rcu_node = xmalloc_bytes(
+		offsetof(struct rcu_node, node) + radix_tree_node_size(arg));
 	return rcu_node ? &rcu_node->node : NULL;
 }
 
@@ -77,7 +84,7 @@ static struct radix_tree_node *radix_tree_node_alloc(
 	struct radix_tree_node *ret;
 	ret = root->node_alloc(root->node_alloc_free_arg);
 	if (ret)
-		memset(ret, 0, sizeof(*ret));
+		memset(ret, 0, radix_tree_node_size(root));
 	return ret;
 }
 
@@ -91,9 +98,12 @@ static void radix_tree_node_free(
  *	Return the maximum key which can be store into a
  *	radix tree with height HEIGHT.
  */
-static inline unsigned long radix_tree_maxindex(unsigned int height)
+static inline unsigned long radix_tree_maxindex(
+	const struct radix_tree_root *root, unsigned int height)
 {
-	return height_to_maxindex[height];
+	unsigned int width = height * root->shift;
+
+	return width >= RADIX_TREE_INDEX_BITS ? ~0UL : (1UL << width) - 1;
 }
 
 /*
@@ -106,7 +116,7 @@ static int radix_tree_extend(struct radix_tree_root *root, unsigned long index)
 
 	/* Figure out what the height should be.  */
 	height = root->height + 1;
-	while (index > radix_tree_maxindex(height))
+	while (index > radix_tree_maxindex(root, height))
 		height++;
 
 	if (root->rnode == NULL) {
@@ -152,7 +162,7 @@ int radix_tree_insert(struct radix_tree_root *root,
 	BUG_ON(radix_tree_is_indirect_ptr(item));
 
 	/* Make sure the tree is high enough.  */
-	if (index > radix_tree_maxindex(root->height)) {
+	if (index > radix_tree_maxindex(root, root->height)) {
 		error = radix_tree_extend(root, index);
 		if (error)
 			return error;
@@ -161,7 +171,7 @@ int radix_tree_insert(struct radix_tree_root *root,
 	slot = indirect_to_ptr(root->rnode);
 
 	height = root->height;
-	shift = (height-1) * RADIX_TREE_MAP_SHIFT;
+	shift = (height-1) * root->shift;
 
 	offset = 0;			/* uninitialised var warning */
 	while (height > 0) {
@@ -178,10 +188,10 @@ int radix_tree_insert(struct radix_tree_root *root,
 		}
 
 		/* Go a level down */
-		offset = (index >> shift) & RADIX_TREE_MAP_MASK;
+		offset = (index >> shift) & map_mask(root);
 		node = slot;
 		slot = node->slots[offset];
-		shift -= RADIX_TREE_MAP_SHIFT;
+		shift -= root->shift;
 		height--;
 	}
 
@@ -221,19 +231,19 @@ static void *radix_tree_lookup_element(struct radix_tree_root *root,
 	node = indirect_to_ptr(node);
 
 	height = node->height;
-	if (index > radix_tree_maxindex(height))
+	if (index > radix_tree_maxindex(root, height))
 		return NULL;
 
-	shift = (height-1) * RADIX_TREE_MAP_SHIFT;
+	shift = (height-1) * root->shift;
 
 	do {
 		slot = (struct radix_tree_node **)
-			(node->slots + ((index>>shift) & RADIX_TREE_MAP_MASK));
+			(node->slots + ((index>>shift) & map_mask(root)));
 		node = rcu_dereference(*slot);
 		if (node == NULL)
 			return NULL;
 
-		shift -= RADIX_TREE_MAP_SHIFT;
+		shift -= root->shift;
 		height--;
 	} while (height > 0);
 
@@ -352,7 +362,8 @@ unsigned long radix_tree_prev_hole(struct radix_tree_root *root,
 EXPORT_SYMBOL(radix_tree_prev_hole);
 
 static unsigned int
-__lookup(struct radix_tree_node *slot, void ***results, unsigned long index,
+__lookup(struct radix_tree_root *root, struct radix_tree_node *slot,
+	void ***results, unsigned long index,
 	unsigned int max_items, unsigned long *next_index)
 {
 	unsigned int nr_found = 0;
@@ -362,10 +373,10 @@ __lookup(struct radix_tree_node *slot, void ***results, unsigned long index,
 	height = slot->height;
 	if (height == 0)
 		goto out;
-	shift = (height-1) * RADIX_TREE_MAP_SHIFT;
+	shift = (height-1) * root->shift;
 
 	for ( ; height > 1; height--) {
-		i = (index >> shift) & RADIX_TREE_MAP_MASK;
+		i = (index >> shift) & map_mask(root);
 		for (;;) {
 			if (slot->slots[i] != NULL)
 				break;
@@ -374,18 +385,18 @@ __lookup(struct radix_tree_node *slot, void ***results, unsigned long index,
 			if (index == 0)
 				goto out;	/* 32-bit wraparound */
 			i++;
-			if (i == RADIX_TREE_MAP_SIZE)
+			if (i == map_size(root))
 				goto out;
 		}
 
-		shift -= RADIX_TREE_MAP_SHIFT;
+		shift -= root->shift;
 		slot = rcu_dereference(slot->slots[i]);
 		if (slot == NULL)
 			goto out;
 	}
 
 	/* Bottom level: grab some items */
-	for (i = index & RADIX_TREE_MAP_MASK; i < RADIX_TREE_MAP_SIZE; i++) {
+	for (i = index & map_mask(root); i < map_size(root); i++) {
 		index++;
 		if (slot->slots[i]) {
 			results[nr_found++] = &(slot->slots[i]);
@@ -398,6 +409,110 @@ out:
 	return nr_found;
 }
 
+/**
+ *	radix_tree_next_batch - perform a batched lookup over a range of keys
+ *	@root:		radix tree root
+ *	@iter:		walk state, set up by radix_tree_iter_init()
+ *	@results:	where the results of the lookup are placed
+ *	@indices:	where the keys of the results are placed, unless NULL
+ *	@max_items:	place up to this many items at *@results
+ *
+ *	Performs an index-ascending scan of the remainder of @iter's range for
+ *	present items.  Places them at *@results, advances @iter past them and
+ *	returns the number of items which were placed at *@results.  0 is
+ *	returned once the range has been exhausted.
+ *
+ *	Each bottom level node is scanned in one go, with the next one
+ *	prefetched meanwhile.  Like radix_tree_gang_lookup as far as RCU and
+ *	locking goes.
+ */
+unsigned int
+radix_tree_next_batch(struct radix_tree_root *root, struct radix_tree_iter *iter,
+			void **results, unsigned long *indices,
+			unsigned int max_items)
+{
+	unsigned long mask = map_mask(root), index = iter->index;
+	unsigned int nr = 0;
+
+	while (!iter->done && nr < max_items) {
+		struct radix_tree_node *node, *next = NULL;
+		unsigned int height, shift;
+		unsigned long i;
+
+		node = rcu_dereference(root->rnode);
+		if (!node || !radix_tree_is_indirect_ptr(node)) {
+			/* Empty tree, or a single item at index 0. */
+			if (node && !index) {
+				if (indices)
+					indices[nr] = 0;
+				results[nr++] = node;
+			}
+			iter->done = 1;
+			break;
+		}
+		node = indirect_to_ptr(node);
+
+		height = node->height;
+		if (index > radix_tree_maxindex(root, height)) {
+			iter->done = 1;
+			break;
+		}
+		shift = (height - 1) * root->shift;
+
+		/* Go down to the bottom node covering index, skipping holes. */
+		for ( ; height > 1; height--) {
+			i = (index >> shift) & mask;
+			while (!node->slots[i]) {
+				index &= ~((1UL << shift) - 1);
+				index += 1UL << shift;
+				if (!index || index > iter->last) {
+					iter->done = 1;
+					goto out;
+				}
+				if (++i > mask)
+					goto next;	/* Restart from the top. */
+			}
+
+			/* The next bottom node is most likely the sibling. */
+			if (height == 2 && i < mask)
+				next = rcu_dereference(node->slots[i + 1]);
+
+			shift -= root->shift;
+			node = rcu_dereference(node->slots[i]);
+			if (!node)
+				goto next;
+		}
+
+		if (next)
+			prefetch(next);
+
+		/* Bottom level: grab the items. */
+		for (i = index & mask; ; ) {
+			void *item = rcu_dereference(node->slots[i]);
+
+			if (item) {
+				if (indices)
+					indices[nr] = index;
+				results[nr++] = indirect_to_ptr(item);
+			}
+			if (index == iter->last) {
+				iter->done = 1;
+				break;
+			}
+			index++;
+			if (++i > mask || nr == max_items)
+				break;
+		}
+next:
+		;
+	}
+
+out:
+	iter->index = index;
+	return nr;
+}
+EXPORT_SYMBOL(radix_tree_next_batch);
+
 /**
  *	radix_tree_gang_lookup - perform multiple lookup on a radix tree
  *	@root:		radix tree root
@@ -409,8 +524,6 @@ out:
  *	them at *@results and returns the number of items which were placed at
  *	*@results.
  *
- *	The implementation is naive.
- *
  *	Like radix_tree_lookup, radix_tree_gang_lookup may be called under
  *	rcu_read_lock. In this case, rather than the returned results being
  *	an atomic snapshot of the tree at a single point in time, the semantics
@@ -421,51 +534,11 @@ unsigned int
 radix_tree_gang_lookup(struct radix_tree_root *root, void **results,
 			unsigned long first_index, unsigned int max_items)
 {
-	unsigned long max_index;
-	struct radix_tree_node *node;
-	unsigned long cur_index = first_index;
-	unsigned int ret;
-
-	node = rcu_dereference(root->rnode);
-	if (!node)
-		return 0;
+	struct radix_tree_iter iter;
 
-	if (!radix_tree_is_indirect_ptr(node)) {
-		if (first_index > 0)
-			return 0;
-		results[0] = node;
-		return 1;
-	}
-	node = indirect_to_ptr(node);
+	radix_tree_iter_init(&iter, first_index, ~0UL);
 
-	max_index = radix_tree_maxindex(node->height);
-
-	ret = 0;
-	while (ret < max_items) {
-		unsigned int nr_found, slots_found, i;
-		unsigned long next_index;	/* Index of next search */
-
-		if (cur_index > max_index)
-			break;
-		slots_found = __lookup(node, (void ***)results + ret, cur_index,
-					max_items - ret, &next_index);
-		nr_found = 0;
-		for (i = 0; i < slots_found; i++) {
-			struct radix_tree_node *slot;
-			slot = *(((void ***)results)[ret + i]);
-			if (!slot)
-				continue;
-			results[ret + nr_found] =
-				indirect_to_ptr(rcu_dereference(slot));
-			nr_found++;
-		}
-		ret += nr_found;
-		if (next_index == 0)
-			break;
-		cur_index = next_index;
-	}
-
-	return ret;
+	return radix_tree_next_batch(root, &iter, results, NULL, max_items);
 }
 EXPORT_SYMBOL(radix_tree_gang_lookup);
 
@@ -507,7 +580,7 @@ radix_tree_gang_lookup_slot(struct radix_tree_root *root, void ***results,
 	}
 	node = indirect_to_ptr(node);
 
-	max_index = radix_tree_maxindex(node->height);
+	max_index = radix_tree_maxindex(root, node->height);
 
 	ret = 0;
 	while (ret < max_items) {
@@ -516,7 +589,7 @@ radix_tree_gang_lookup_slot(struct radix_tree_root *root, void ***results,
 
 		if (cur_index > max_index)
 			break;
-		slots_found = __lookup(node, results + ret, cur_index,
+		slots_found = __lookup(root, node, results + ret, cur_index,
 					max_items - ret, &next_index);
 		ret += slots_found;
 		if (next_index == 0)
@@ -612,7 +685,7 @@ void *radix_tree_delete(struct radix_tree_root *root, unsigned long index)
 	int offset;
 
 	height = root->height;
-	if (index > radix_tree_maxindex(height))
+	if (index > radix_tree_maxindex(root, height))
 		goto out;
 
 	slot = root->rnode;
@@ -622,7 +695,7 @@ void *radix_tree_delete(struct radix_tree_root *root, unsigned long index)
 	}
 	slot = indirect_to_ptr(slot);
 
-	shift = (height - 1) * RADIX_TREE_MAP_SHIFT;
+	shift = (height - 1) * root->shift;
 	pathp->node = NULL;
 
 	do {
@@ -630,11 +703,11 @@ void *radix_tree_delete(struct radix_tree_root *root, unsigned long index)
 			goto out;
 
 		pathp++;
-		offset = (index >> shift) & RADIX_TREE_MAP_MASK;
+		offset = (index >> shift) & map_mask(root);
 		pathp->offset = offset;
 		pathp->node = slot;
 		slot = slot->slots[offset];
-		shift -= RADIX_TREE_MAP_SHIFT;
+		shift -= root->shift;
 		height--;
 	} while (height > 0);
 
@@ -681,7 +754,7 @@ radix_tree_node_destroy(
 {
 	int i;
 
-	for (i = 0; i < RADIX_TREE_MAP_SIZE; i++) {
+	for (i = 0; i < map_size(root); i++) {
 		struct radix_tree_node *slot = node->slots[i];
 		BUG_ON(radix_tree_is_indirect_ptr(slot));
 		if (slot == NULL)
@@ -702,6 +775,8 @@ void radix_tree_destroy(
 	void (*slot_free)(void *))
 {
 	struct radix_tree_node *node = root->rnode;
+	unsigned int shift = root->shift;
+
 	if (node == NULL)
 		return;
 	if (!radix_tree_is_indirect_ptr(node)) {
@@ -711,14 +786,30 @@ void radix_tree_destroy(
 		node = indirect_to_ptr(node);
 		radix_tree_node_destroy(root, node, slot_free);
 	}
-	radix_tree_init(root);
+	radix_tree_init_fanout(root, shift);
 }
 
 void radix_tree_init(struct radix_tree_root *root)
 {
+	radix_tree_init_fanout(root, RADIX_TREE_MAP_SHIFT);
+}
+
+/**
+ *	radix_tree_init_fanout    -    initialise a tree with 2^@shift wide nodes
+ *	@root:		radix tree root
+ *	@shift:		log2 of the slots per node, between
+ *			RADIX_TREE_MIN_MAP_SHIFT and RADIX_TREE_MAX_MAP_SHIFT
+ */
+void radix_tree_init_fanout(struct radix_tree_root *root, unsigned int shift)
+{
+	BUG_ON(shift < RADIX_TREE_MIN_MAP_SHIFT ||
+	       shift > RADIX_TREE_MAX_MAP_SHIFT);
+
 	memset(root, 0, sizeof(*root));
+	root->shift = shift;
 	root->node_alloc = rcu_node_alloc;
 	root->node_free = rcu_node_free;
+	root->node_alloc_free_arg = root;
 }
 
 void radix_tree_set_alloc_callbacks(
@@ -731,27 +822,3 @@ void radix_tree_set_alloc_callbacks(
 	root->node_free = node_free;
 	root->node_alloc_free_arg = node_alloc_free_arg;
 }
-
-static __init unsigned long __maxindex(unsigned int height)
-{
-	unsigned int width = height * RADIX_TREE_MAP_SHIFT;
-	int shift = RADIX_TREE_INDEX_BITS - width;
-
-	if (shift < 0)
-		return ~0UL;
-	if (shift >= BITS_PER_LONG)
-		return 0UL;
-	return ~0UL >> shift;
-}
-
-static __init int radix_tree_init_maxindex(void)
-{
-	unsigned int i;
-
-	for (i = 0; i < ARRAY_SIZE(height_to_maxindex); i++)
-		height_to_maxindex[i] = __maxindex(i);
-
-	return 0;
-}
-/* pre-SMP just so it runs before 'normal' initcalls */
-presmp_initcall(radix_tree_init_maxindex);
@@ -10,11 +10,12 @@
 #include <xen/sched.h>
 #include <xen/errno.h>
 #include <xen/rangeset.h>
+#include <xen/rbtree.h>
 #include <xsm/xsm.h>
 
-/* An inclusive range [s,e] and pointer to next range in ascending order. */
+/* An inclusive range [s,e], kept in a tree ordered by ascending address. */
 struct range {
-    struct list_head list;
+    struct rb_node node;
     unsigned long s, e;
 };
 
@@ -23,12 +24,12 @@ struct rangeset {
     struct list_head rangeset_list;
     struct domain   *domain;
 
-    /* Ordered list of ranges contained in this set, and protecting lock. */
-    struct list_head range_list;
+    /* Ordered tree of ranges contained in this set, and protecting lock. */
+    struct rb_root   range_tree;
 
     /* Number of ranges that can be allocated */
     long             nr_ranges;
-    rwlock_t         lock;
+    percpu_rwlock_t  lock;
 
     /* Pretty-printing name. */
     char             name[32];
@@ -37,21 +38,34 @@ struct rangeset {
     unsigned int     flags;
 };
 
+/*
+ * Rangesets are consulted on every I/O port, MMIO and ioreq server access
+ * check, but only change when permissions or mappings are altered, so
+ * readers use a per-CPU rwlock.
+ */
+static DEFINE_PERCPU_RWLOCK_GLOBAL(rangeset_rwlock);
+
 /*****************************
- * Private range functions hide the underlying linked-list implemnetation.
+ * Private range functions hide the underlying red-black tree implementation.
  */
 
 /* Find highest range lower than or containing s. NULL if no such range. */
 static struct range *find_range(
     struct rangeset *r, unsigned long s)
 {
+    struct rb_node *n = r->range_tree.rb_node;
     struct range *x = NULL, *y;
 
-    list_for_each_entry ( y, &r->range_list, list )
+    while ( n != NULL )
     {
+        y = rb_entry(n, struct range, node);
         if ( y->s > s )
-            break;
-        x = y;
+            n = n->rb_left;
+        else
+        {
+            x = y;
+            n = n->rb_right;
+        }
     }
 
     return x;
@@ -61,34 +75,58 @@ static struct range *find_range(
 static struct range *first_range(
     struct rangeset *r)
 {
-    if ( list_empty(&r->range_list) )
-        return NULL;
-    return list_entry(r->range_list.next, struct range, list);
+    struct rb_node *n = rb_first(&r->range_tree);
+
+    return n ? rb_entry(n, struct range, node) : NULL;
 }
 
 /* Return range following x in ascending order, or NULL if x is the highest. */
 static struct range *next_range(
     struct rangeset *r, struct range *x)
 {
-    if ( x->list.next == &r->range_list )
-        return NULL;
-    return list_entry(x->list.next, struct range, list);
+    struct rb_node *n = rb_next(&x->node);
+
+    return n ? rb_entry(n, struct range, node) : NULL;
 }
 
-/* Insert range y after range x in r. Insert as first range if x is NULL. */
+/*
+ * Insert range y after range x in r. Insert as first range if x is NULL.
+ * The position is given by x rather than by y's bounds, as callers may
+ * still be adjusting the neighbouring ranges.
+ */
 static void insert_range(
     struct rangeset *r, struct range *x, struct range *y)
 {
-    list_add(&y->list, (x != NULL) ? &x->list : &r->range_list);
+    struct rb_node **link, *parent;
+
+    if ( x == NULL )
+    {
+        parent = rb_first(&r->range_tree);
+        link = parent ? &parent->rb_left : &r->range_tree.rb_node;
+    }
+    else if ( x->node.rb_right == NULL )
+    {
+        parent = &x->node;
+        link = &parent->rb_right;
+    }
+    else
+    {
+        for ( parent = x->node.rb_right; parent->rb_left != NULL; )
+            parent = parent->rb_left;
+        link = &parent->rb_left;
+    }
+
+    rb_link_node(&y->node, parent, link);
+    rb_insert_color(&y->node, &r->range_tree);
 }
 
-/* Remove a range from its list and free it. */
+/* Remove a range from its tree and free it. */
 static void destroy_range(
     struct rangeset *r, struct range *x)
 {
     r->nr_ranges++;
 
-    list_del(&x->list);
+    rb_erase(&x->node, &r->range_tree);
     xfree(x);
 }
 
@@ -120,7 +158,7 @@ int rangeset_add_range(
 
     ASSERT(s <= e);
 
-    write_lock(&r->lock);
+    percpu_write_lock(rangeset_rwlock, &r->lock);
 
     x = find_range(r, s);
     y = find_range(r, e);
@@ -176,7 +214,7 @@ int rangeset_add_range(
     }
 
  out:
-    write_unlock(&r->lock);
+    percpu_write_unlock(rangeset_rwlock, &r->lock);
     return rc;
 }
 
@@ -188,7 +226,7 @@ int rangeset_remove_range(
 
     ASSERT(s <= e);
 
-    write_lock(&r->lock);
+    percpu_write_lock(rangeset_rwlock, &r->lock);
 
     x = find_range(r, s);
     y = find_range(r, e);
@@ -227,7 +265,8 @@ int rangeset_remove_range(
 
         if ( x->s < s )
         {
-            x->e = s - 1;
+            if ( x->e >= s )
+                x->e = s - 1;
             x = next_range(r, x);
         }
 
@@ -244,7 +283,7 @@ int rangeset_remove_range(
     }
 
  out:
-    write_unlock(&r->lock);
+    percpu_write_unlock(rangeset_rwlock, &r->lock);
     return rc;
 }
 
@@ -256,10 +295,10 @@ bool_t rangeset_contains_range(
 
     ASSERT(s <= e);
 
-    read_lock(&r->lock);
+    percpu_read_lock(rangeset_rwlock, &r->lock);
     x = find_range(r, s);
     contains = (x && (x->e >= e));
-    read_unlock(&r->lock);
+    percpu_read_unlock(rangeset_rwlock, &r->lock);
 
     return contains;
 }
@@ -272,10 +311,10 @@ bool_t rangeset_overlaps_range(
 
     ASSERT(s <= e);
 
-    read_lock(&r->lock);
+    percpu_read_lock(rangeset_rwlock, &r->lock);
     x = find_range(r, e);
     overlaps = (x && (s <= x->e));
-    read_unlock(&r->lock);
+    percpu_read_unlock(rangeset_rwlock, &r->lock);
 
     return overlaps;
 }
@@ -287,13 +326,14 @@ int rangeset_report_ranges(
     struct range *x;
     int rc = 0;
 
-    read_lock(&r->lock);
+    percpu_read_lock(rangeset_rwlock, &r->lock);
 
-    for ( x = first_range(r); x && (x->s <= e) && !rc; x = next_range(r, x) )
+    x = find_range(r, s) ?: first_range(r);
+    for ( ; x && (x->s <= e) && !rc; x = next_range(r, x) )
         if ( x->e >= s )
             rc = cb(max(x->s, s), min(x->e, e), ctxt);
 
-    read_unlock(&r->lock);
+    percpu_read_unlock(rangeset_rwlock, &r->lock);
 
     return rc;
 }
@@ -319,7 +359,7 @@ bool_t rangeset_contains_singleton(
 bool_t rangeset_is_empty(
     const struct rangeset *r)
 {
-    return ((r == NULL) || list_empty(&r->range_list));
+    return ((r == NULL) || RB_EMPTY_ROOT(&r->range_tree));
 }
 
 struct rangeset *rangeset_new(
@@ -331,8 +371,8 @@ struct rangeset *rangeset_new(
     if ( r == NULL )
         return NULL;
 
-    rwlock_init(&r->lock);
-    INIT_LIST_HEAD(&r->range_list);
+    percpu_rwlock_resource_init(&r->lock, rangeset_rwlock);
+    r->range_tree = RB_ROOT;
     r->nr_ranges = -1;
 
     BUG_ON(flags & ~RANGESETF_prettyprint_hex);
@@ -410,25 +450,25 @@ void rangeset_domain_destroy(
 
 void rangeset_swap(struct rangeset *a, struct rangeset *b)
 {
-    LIST_HEAD(tmp);
+    struct rb_root tmp;
 
     if ( a < b )
     {
-        write_lock(&a->lock);
-        write_lock(&b->lock);
+        percpu_write_lock(rangeset_rwlock, &a->lock);
+        percpu_write_lock(rangeset_rwlock, &b->lock);
     }
     else
     {
-        write_lock(&b->lock);
-        write_lock(&a->lock);
+        percpu_write_lock(rangeset_rwlock, &b->lock);
+        percpu_write_lock(rangeset_rwlock, &a->lock);
     }
 
-    list_splice_init(&a->range_list, &tmp);
-    list_splice_init(&b->range_list, &a->range_list);
-    list_splice(&tmp, &b->range_list);
+    tmp = a->range_tree;
+    a->range_tree = b->range_tree;
+    b->range_tree = tmp;
 
-    write_unlock(&a->lock);
-    write_unlock(&b->lock);
+    percpu_write_unlock(rangeset_rwlock, &a->lock);
+    percpu_write_unlock(rangeset_rwlock, &b->lock);
 }
 
 /*****************************
@@ -446,7 +486,7 @@ void rangeset_printk(
     int nr_printed = 0;
     struct range *x;
 
-    read_lock(&r->lock);
+    percpu_read_lock(rangeset_rwlock, &r->lock);
 
     printk("%-10s {", r->name);
 
@@ -465,7 +505,7 @@ void rangeset_printk(
 
     printk(" }");
 
-    read_unlock(&r->lock);
+    percpu_read_unlock(rangeset_rwlock, &r->lock);
 }
 
 void rangeset_domain_printk(
@@ -54,6 +54,8 @@ static struct rcu_ctrlblk {
     spinlock_t  lock __cacheline_aligned;
     cpumask_t   cpumask; /* CPUs that need to switch in order    */
     /* for current batch to proceed.        */
+    cpumask_t   idle_cpumask; /* CPUs asleep in the idle loop, and   */
+    /* without callbacks: not waited for by new batches.        */
 } __cacheline_aligned rcu_ctrlblk = {
     .cur = -300,
     .completed = -300,
@@ -92,6 +94,12 @@ static int qhimark = 10000;
 static int qlowmark = 100;
 static int rsinterval = 1000;
 
+/*
+ * Time limit for one invocation of callbacks once qhimark lifted the count
+ * limit, so a long backlog doesn't keep the vCPUs of this CPU off it.
+ */
+#define RCU_BATCH_TIME MICROSECS(500)
+
 struct rcu_barrier_data {
     struct rcu_head head;
     atomic_t *cpu_count;
@@ -195,6 +203,7 @@ static void rcu_do_batch(struct rcu_data *rdp)
 {
     struct rcu_head *next, *list;
     int count = 0;
+    s_time_t deadline = NOW() + RCU_BATCH_TIME;
 
     list = rdp->donelist;
     while (list) {
@@ -204,6 +213,8 @@ static void rcu_do_batch(struct rcu_data *rdp)
         rdp->qlen--;
         if (++count >= rdp->blimit)
             break;
+        if (!(count & 15) && NOW() > deadline)
+            break;
     }
     if (rdp->blimit == INT_MAX && rdp->qlen <= qlowmark)
         rdp->blimit = blimit;
@@ -248,7 +259,12 @@ static void rcu_start_batch(struct rcu_ctrlblk *rcp)
         smp_wmb();
         rcp->cur++;
 
-        cpumask_copy(&rcp->cpumask, &cpu_online_map);
+        /*
+         * Pairs with the barrier in rcu_idle_enter(): either the CPU going
+         * idle sees the new batch number, or we see it idle.
+         */
+        smp_mb();
+        cpumask_andnot(&rcp->cpumask, &cpu_online_map, &rcp->idle_cpumask);
     }
 }
 
@@ -402,6 +418,33 @@ void rcu_check_callbacks(int cpu)
     raise_softirq(RCU_SOFTIRQ);
 }
 
+/*
+ * Called with interrupts disabled by a CPU about to sleep in the idle loop.
+ * Unless it has callbacks of its own to see through, it gets left out of
+ * the batches started while it sleeps, so they need not wait for it to
+ * wake up.  A batch which started just before makes it process
+ * RCU_SOFTIRQ instead of sleeping.
+ */
+void rcu_idle_enter(unsigned int cpu)
+{
+    ASSERT(!local_irq_is_enabled());
+
+    if ( rcu_needs_cpu(cpu) )
+        return;
+
+    cpumask_set_cpu(cpu, &rcu_ctrlblk.idle_cpumask);
+    /* See the comment in rcu_start_batch(). */
+    smp_mb();
+
+    if ( rcu_pending(cpu) )
+        raise_softirq(RCU_SOFTIRQ);
+}
+
+void rcu_idle_exit(unsigned int cpu)
+{
+    cpumask_clear_cpu(cpu, &rcu_ctrlblk.idle_cpumask);
+}
+
 static void rcu_move_batch(struct rcu_data *this_rdp, struct rcu_head *list,
                            struct rcu_head **tail)
 {
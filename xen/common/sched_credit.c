@@ -163,6 +163,10 @@
 static int __read_mostly sched_credit_tslice_ms = CSCHED_DEFAULT_TSLICE_MS;
 integer_param("sched_credit_tslice_ms", sched_credit_tslice_ms);
 
+/* Maximum number of runqueues locked by one load balancing attempt (0: no limit). */
+static unsigned int __read_mostly sched_credit_steal_probes = 16;
+integer_param("sched_credit_steal_probes", sched_credit_steal_probes);
+
 /*
  * Physical CPU
  */
@@ -173,6 +177,15 @@ struct csched_pcpu {
     unsigned int tick;
     unsigned int idle_bias;
     unsigned int nr_runnable;
+    struct {
+        unsigned long balance;  /* load balancing attempts */
+        unsigned long probes;   /* runqueues locked */
+        unsigned long limited;  /* attempts cut short by the probe limit */
+#define CSCHED_STEAL_LLC        0
+#define CSCHED_STEAL_NODE       1
+#define CSCHED_STEAL_REMOTE     2
+        unsigned long stolen[3];
+    } steal_stats;
 };
 
 /*
@@ -402,6 +415,29 @@ boolean_param("tickle_one_idle_cpu", opt_tickle_one_idle);
 
 DEFINE_PER_CPU(unsigned int, last_tickle_cpu);
 
+/*
+ * Of the idlers in @idlers, return the ones closest to the waking cpu:
+ * its hyperthread siblings, failing that the cpus on its socket (and
+ * hence sharing its last level cache), failing that all of them.  A
+ * woken vcpu is most often waiting for data just produced by the waker
+ * (e.g. a netback kick), which is still in that cache.  @tmp is scratch.
+ */
+static const cpumask_t *csched_near_idlers(const cpumask_t *idlers,
+                                           cpumask_t *tmp)
+{
+    unsigned int waker = smp_processor_id();
+
+    cpumask_and(tmp, idlers, per_cpu(cpu_sibling_mask, waker));
+    if ( !cpumask_empty(tmp) )
+        return tmp;
+
+    cpumask_and(tmp, idlers, per_cpu(cpu_core_mask, waker));
+    if ( !cpumask_empty(tmp) )
+        return tmp;
+
+    return idlers;
+}
+
 static inline void __runq_tickle(struct csched_vcpu *new)
 {
     unsigned int cpu = new->vcpu->processor;
@@ -500,7 +536,9 @@ static inline void __runq_tickle(struct csched_vcpu *new)
                 {
                     this_cpu(last_tickle_cpu) =
                         cpumask_cycle(this_cpu(last_tickle_cpu),
-                                      cpumask_scratch_cpu(cpu));
+                                      csched_near_idlers(
+                                          cpumask_scratch_cpu(cpu), &mask));
+                    cpumask_clear(&mask);
                     __cpumask_set_cpu(this_cpu(last_tickle_cpu), &mask);
                 }
                 else
@@ -1234,6 +1272,44 @@ csched_vcpu_yield(const struct scheduler *ops, struct vcpu *vc)
     set_bit(CSCHED_FLAG_VCPU_YIELD, &svc->flags);
 }
 
+/*
+ * Directed yield, called with target's scheduler lock held (the caller
+ * yields right after).  If target is waiting for a pcpu, hand it up to a
+ * time slice worth of our credit and, as on wakeup, boost it so that it
+ * runs ahead of the other vcpus waiting there.
+ */
+static void
+csched_vcpu_yield_to(const struct scheduler *ops, struct vcpu *vc,
+                     struct vcpu *target)
+{
+    struct csched_private *prv = CSCHED_PRIV(ops);
+    struct csched_vcpu * const svc = CSCHED_VCPU(vc);
+    struct csched_vcpu * const tsvc = CSCHED_VCPU(target);
+    int credit;
+
+    if ( is_idle_vcpu(target) || !__vcpu_on_runq(tsvc) )
+        return;
+
+    credit = min_t(int, atomic_read(&svc->credit), prv->credits_per_tslice);
+    if ( credit > 0 )
+    {
+        atomic_sub(credit, &svc->credit);
+        atomic_add(credit, &tsvc->credit);
+    }
+
+    if ( tsvc->pri == CSCHED_PRI_TS_UNDER &&
+         !test_bit(CSCHED_FLAG_VCPU_PARKED, &tsvc->flags) )
+    {
+        TRACE_2D(TRC_CSCHED_BOOST_START, target->domain->domain_id,
+                 target->vcpu_id);
+        SCHED_STAT_CRANK(vcpu_boost);
+        runq_remove(tsvc);
+        tsvc->pri = CSCHED_PRI_TS_BOOST;
+        runq_insert(tsvc);
+        __runq_tickle(tsvc);
+    }
+}
+
 static int
 csched_dom_cntl(
     const struct scheduler *ops,
@@ -1291,6 +1367,29 @@ __csched_set_tslice(struct csched_private *prv, unsigned timeslice)
     prv->credit = prv->credits_per_tslice * prv->ncpus;
 }
 
+static void
+csched_steal_stats(struct csched_private *prv,
+                   xen_sysctl_credit_schedule_t *params)
+{
+    unsigned int cpu;
+
+    ASSERT(spin_is_locked(&prv->lock));
+
+    params->balance = params->probes = params->limited = 0;
+    params->steal_llc = params->steal_node = params->steal_remote = 0;
+    for_each_cpu ( cpu, prv->cpus )
+    {
+        const struct csched_pcpu *spc = CSCHED_PCPU(cpu);
+
+        params->balance += spc->steal_stats.balance;
+        params->probes += spc->steal_stats.probes;
+        params->limited += spc->steal_stats.limited;
+        params->steal_llc += spc->steal_stats.stolen[CSCHED_STEAL_LLC];
+        params->steal_node += spc->steal_stats.stolen[CSCHED_STEAL_NODE];
+        params->steal_remote += spc->steal_stats.stolen[CSCHED_STEAL_REMOTE];
+    }
+}
+
 static int
 csched_sys_cntl(const struct scheduler *ops,
                         struct xen_sysctl_scheduler_op *sc)
@@ -1322,8 +1421,11 @@ csched_sys_cntl(const struct scheduler *ops,
 
         /* FALLTHRU */
     case XEN_SYSCTL_SCHEDOP_getinfo:
+        spin_lock_irqsave(&prv->lock, flags);
         params->tslice_ms = prv->tslice_ms;
         params->ratelimit_us = prv->ratelimit_us;
+        csched_steal_stats(prv, params);
+        spin_unlock_irqrestore(&prv->lock, flags);
         rc = 0;
         break;
     }
@@ -1739,16 +1841,119 @@ csched_runq_steal(int peer_cpu, int cpu, int pri, int balance_step)
     return NULL;
 }
 
+/*
+ * Try to steal work from the pCPUs in workers, starting from the one after
+ * *bias. Every runqueue we lock counts as a probe, and we give up as soon as
+ * *probes reaches zero.
+ */
+static struct csched_vcpu *
+csched_steal_from(int cpu, struct csched_vcpu *snext, int bstep,
+                  cpumask_t *workers, cpumask_t *online, uint32_t *bias,
+                  unsigned int *probes)
+{
+    struct csched_vcpu *speer;
+    int peer_cpu, first_cpu;
+
+    first_cpu = cpumask_cycle(*bias, workers);
+    if ( first_cpu >= nr_cpu_ids )
+        return NULL;
+    peer_cpu = first_cpu;
+    do
+    {
+        spinlock_t *lock;
+
+        /*
+         * If there is only one runnable vCPU on peer_cpu, it means
+         * there's no one to be stolen in its runqueue, so skip it.
+         *
+         * Checking this without holding the lock is racy... But that's
+         * the whole point of this optimization!
+         *
+         * In more details:
+         * - if we race with dec_nr_runnable(), we may try to take the
+         *   lock and call csched_runq_steal() for no reason. This is
+         *   not a functional issue, and should be infrequent enough.
+         *   And we can avoid that by re-checking nr_runnable after
+         *   having grabbed the lock, if we want;
+         * - if we race with inc_nr_runnable(), we skip a pCPU that may
+         *   have runnable vCPUs in its runqueue, but that's not a
+         *   problem because:
+         *   + if racing with csched_vcpu_insert() or csched_vcpu_wake(),
+         *     __runq_tickle() will be called afterwords, so the vCPU
+         *     won't get stuck in the runqueue for too long;
+         *   + if racing with csched_runq_steal(), it may be that a
+         *     vCPU that we could have picked up, stays in a runqueue
+         *     until someone else tries to steal it again. But this is
+         *     no worse than what can happen already (without this
+         *     optimization), it the pCPU would schedule right after we
+         *     have taken the lock, and hence block on it.
+         */
+        if ( CSCHED_PCPU(peer_cpu)->nr_runnable <= 1 )
+        {
+            TRACE_2D(TRC_CSCHED_STEAL_CHECK, peer_cpu, /* skipp'n */ 0);
+            goto next_cpu;
+        }
+
+        if ( *probes == 0 )
+            return NULL;
+        (*probes)--;
+        CSCHED_PCPU(cpu)->steal_stats.probes++;
+
+        /*
+         * Get ahold of the scheduler lock for this peer CPU.
+         *
+         * Note: We don't spin on this lock but simply try it. Spinning
+         * could cause a deadlock if the peer CPU is also load
+         * balancing and trying to lock this CPU.
+         */
+        lock = pcpu_schedule_trylock(peer_cpu);
+        SCHED_STAT_CRANK(steal_trylock);
+        if ( !lock )
+        {
+            SCHED_STAT_CRANK(steal_trylock_failed);
+            TRACE_2D(TRC_CSCHED_STEAL_CHECK, peer_cpu, /* skip */ 0);
+            goto next_cpu;
+        }
+
+        TRACE_2D(TRC_CSCHED_STEAL_CHECK, peer_cpu, /* checked */ 1);
+
+        /* Any work over there to steal? */
+        speer = cpumask_test_cpu(peer_cpu, online) ?
+            csched_runq_steal(peer_cpu, cpu, snext->pri, bstep) : NULL;
+        pcpu_schedule_unlock(lock, peer_cpu);
+
+        /* As soon as one vcpu is found, balancing ends */
+        if ( speer != NULL )
+        {
+            /*
+             * Next time we'll look for work to steal here, we will start
+             * from the next pCPU, with respect to this one, so we don't
+             * risk stealing always from the same ones.
+             */
+            *bias = peer_cpu;
+            return speer;
+        }
+
+ next_cpu:
+        peer_cpu = cpumask_cycle(peer_cpu, workers);
+
+    } while( peer_cpu != first_cpu );
+
+    return NULL;
+}
+
 static struct csched_vcpu *
 csched_load_balance(struct csched_private *prv, int cpu,
     struct csched_vcpu *snext, bool_t *stolen)
 {
     struct cpupool *c = per_cpu(cpupool, cpu);
+    struct csched_pcpu *spc = CSCHED_PCPU(cpu);
     struct csched_vcpu *speer;
-    cpumask_t workers;
+    cpumask_t workers, llc;
     cpumask_t *online;
-    int peer_cpu, first_cpu, peer_node, bstep;
+    int peer_node, bstep;
     int node = cpu_to_node(cpu);
+    unsigned int probes = sched_credit_steal_probes ?: UINT_MAX;
 
     BUG_ON( cpu != snext->vcpu->processor );
     online = cpupool_online_cpumask(c);
@@ -1767,6 +1972,15 @@ csched_load_balance(struct csched_private *prv, int cpu,
     else
         SCHED_STAT_CRANK(load_balance_other);
 
+    spc->steal_stats.balance++;
+
+    /*
+     * The pCPUs sharing the last level cache with us. We have no explicit
+     * cache topology, so the package is used as an approximation of it.
+     */
+    cpumask_and(&llc, online, per_cpu(cpu_core_mask, cpu));
+    __cpumask_clear_cpu(cpu, &llc);
+
     /*
      * Let's look around for work to steal, taking both hard affinity
      * and soft affinity into account. More specifically, we check all
@@ -1776,111 +1990,64 @@ csched_load_balance(struct csched_private *prv, int cpu,
      */
     for_each_csched_balance_step( bstep )
     {
+        /*
+         * Stealing from a pCPU with which we share the cache is the
+         * cheapest kind of migration, so look there first. The idlers
+         * mask tells us which of them are worth probing at all.
+         */
+        cpumask_andnot(&workers, &llc, prv->idlers);
+        speer = csched_steal_from(cpu, snext, bstep, &workers, online,
+                                  &prv->balance_bias[node], &probes);
+        if ( speer != NULL )
+        {
+            spc->steal_stats.stolen[CSCHED_STEAL_LLC]++;
+            goto stolen;
+        }
+
         /*
          * We peek at the non-idling CPUs in a node-wise fashion. In fact,
          * it is more likely that we find some affine work on our same
          * node, not to mention that migrating vcpus within the same node
          * could well expected to be cheaper than across-nodes (memory
          * stays local, there might be some node-wide cache[s], etc.).
+         * The pCPUs in our LLC have been looked at already.
          */
         peer_node = node;
         do
         {
+            if ( probes == 0 )
+                goto out;
+
             /* Select the pCPUs in this node that have work we can steal. */
             cpumask_andnot(&workers, online, prv->idlers);
             cpumask_and(&workers, &workers, &node_to_cpumask(peer_node));
+            cpumask_andnot(&workers, &workers, &llc);
             __cpumask_clear_cpu(cpu, &workers);
 
-            first_cpu = cpumask_cycle(prv->balance_bias[peer_node], &workers);
-            if ( first_cpu >= nr_cpu_ids )
-                goto next_node;
-            peer_cpu = first_cpu;
-            do
+            speer = csched_steal_from(cpu, snext, bstep, &workers, online,
+                                      &prv->balance_bias[peer_node], &probes);
+            if ( speer != NULL )
             {
-                spinlock_t *lock;
-
-                /*
-                 * If there is only one runnable vCPU on peer_cpu, it means
-                 * there's no one to be stolen in its runqueue, so skip it.
-                 *
-                 * Checking this without holding the lock is racy... But that's
-                 * the whole point of this optimization!
-                 *
-                 * In more details:
-                 * - if we race with dec_nr_runnable(), we may try to take the
-                 *   lock and call csched_runq_steal() for no reason. This is
-                 *   not a functional issue, and should be infrequent enough.
-                 *   And we can avoid that by re-checking nr_runnable after
-                 *   having grabbed the lock, if we want;
-                 * - if we race with inc_nr_runnable(), we skip a pCPU that may
-                 *   have runnable vCPUs in its runqueue, but that's not a
-                 *   problem because:
-                 *   + if racing with csched_vcpu_insert() or csched_vcpu_wake(),
-                 *     __runq_tickle() will be called afterwords, so the vCPU
-                 *     won't get stuck in the runqueue for too long;
-                 *   + if racing with csched_runq_steal(), it may be that a
-                 *     vCPU that we could have picked up, stays in a runqueue
-                 *     until someone else tries to steal it again. But this is
-                 *     no worse than what can happen already (without this
-                 *     optimization), it the pCPU would schedule right after we
-                 *     have taken the lock, and hence block on it.
-                 */
-                if ( CSCHED_PCPU(peer_cpu)->nr_runnable <= 1 )
-                {
-                    TRACE_2D(TRC_CSCHED_STEAL_CHECK, peer_cpu, /* skipp'n */ 0);
-                    goto next_cpu;
-                }
-
-                /*
-                 * Get ahold of the scheduler lock for this peer CPU.
-                 *
-                 * Note: We don't spin on this lock but simply try it. Spinning
-                 * could cause a deadlock if the peer CPU is also load
-                 * balancing and trying to lock this CPU.
-                 */
-                lock = pcpu_schedule_trylock(peer_cpu);
-                SCHED_STAT_CRANK(steal_trylock);
-                if ( !lock )
-                {
-                    SCHED_STAT_CRANK(steal_trylock_failed);
-                    TRACE_2D(TRC_CSCHED_STEAL_CHECK, peer_cpu, /* skip */ 0);
-                    goto next_cpu;
-                }
-
-                TRACE_2D(TRC_CSCHED_STEAL_CHECK, peer_cpu, /* checked */ 1);
-
-                /* Any work over there to steal? */
-                speer = cpumask_test_cpu(peer_cpu, online) ?
-                    csched_runq_steal(peer_cpu, cpu, snext->pri, bstep) : NULL;
-                pcpu_schedule_unlock(lock, peer_cpu);
-
-                /* As soon as one vcpu is found, balancing ends */
-                if ( speer != NULL )
-                {
-                    *stolen = 1;
-                    /*
-                     * Next time we'll look for work to steal on this node, we
-                     * will start from the next pCPU, with respect to this one,
-                     * so we don't risk stealing always from the same ones.
-                     */
-                    prv->balance_bias[peer_node] = peer_cpu;
-                    return speer;
-                }
-
- next_cpu:
-                peer_cpu = cpumask_cycle(peer_cpu, &workers);
-
-            } while( peer_cpu != first_cpu );
+                spc->steal_stats.stolen[peer_node == node ? CSCHED_STEAL_NODE
+                                                          : CSCHED_STEAL_REMOTE]++;
+                goto stolen;
+            }
 
- next_node:
             peer_node = cycle_node(peer_node, node_online_map);
         } while( peer_node != node );
     }
 
  out:
+    if ( probes == 0 )
+        spc->steal_stats.limited++;
+
     /* Failed to find more important work elsewhere... */
     __runq_remove(snext);
     return snext;
+
+ stolen:
+    *stolen = 1;
+    return speer;
 }
 
 /*
@@ -2153,6 +2320,7 @@ csched_dump(const struct scheduler *ops)
 {
     struct list_head *iter_sdom, *iter_svc;
     struct csched_private *prv = CSCHED_PRIV(ops);
+    xen_sysctl_credit_schedule_t steal;
     int loop;
     unsigned long flags;
 
@@ -2186,6 +2354,16 @@ csched_dump(const struct scheduler *ops)
            prv->ticks_per_tslice,
            vcpu_migration_delay);
 
+    csched_steal_stats(prv, &steal);
+    printk("load balance:\n"
+           "\tattempts           = %"PRIu64"\n"
+           "\tprobes             = %"PRIu64" (limit %u)\n"
+           "\tprobe limited      = %"PRIu64"\n"
+           "\tstolen llc/node/remote = %"PRIu64"/%"PRIu64"/%"PRIu64"\n",
+           steal.balance, steal.probes, sched_credit_steal_probes,
+           steal.limited, steal.steal_llc, steal.steal_node,
+           steal.steal_remote);
+
     cpumask_scnprintf(idlers_buf, sizeof(idlers_buf), prv->idlers);
     printk("idlers: %s\n", idlers_buf);
 
@@ -2324,6 +2502,7 @@ static const struct scheduler sched_credit_def = {
     .sleep          = csched_vcpu_sleep,
     .wake           = csched_vcpu_wake,
     .yield          = csched_vcpu_yield,
+    .yield_to       = csched_vcpu_yield_to,
 
     .adjust         = csched_dom_cntl,
     .adjust_global  = csched_sys_cntl,
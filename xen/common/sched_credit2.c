@@ -294,6 +294,15 @@ integer_param("credit2_balance_under", opt_underload_balance_tolerance);
 static int __read_mostly opt_overload_balance_tolerance = -3;
 integer_param("credit2_balance_over", opt_overload_balance_tolerance);
 
+/*
+ * SMT isolation: when enabled, try hard not to run vcpus of different
+ * domains on sibling hyperthreads of the same core at the same time.
+ * This is best effort (siblings are looked at without any locking), and
+ * not a guarantee.
+ */
+static bool __read_mostly opt_smt_isolation;
+boolean_param("credit2_smt_isolation", opt_smt_isolation);
+
 /*
  * Runqueue organization.
  *
@@ -536,6 +545,32 @@ void smt_idle_mask_clear(unsigned int cpu, cpumask_t *mask)
         cpumask_andnot(mask, mask, per_cpu(cpu_sibling_mask, cpu));
 }
 
+/*
+ * Check whether a vcpu of domain d can run on cpu without sharing the core
+ * with a (non idle) vcpu of another domain. Always true if SMT isolation
+ * is disabled.
+ */
+static inline bool sibling_compatible(unsigned int cpu, const struct domain *d)
+{
+    unsigned int sibling;
+
+    if ( !opt_smt_isolation || is_idle_domain(d) )
+        return true;
+
+    for_each_cpu ( sibling, per_cpu(cpu_sibling_mask, cpu) )
+    {
+        const struct vcpu *v;
+
+        if ( sibling == cpu )
+            continue;
+        v = curr_on_cpu(sibling);
+        if ( !is_idle_vcpu(v) && v->domain != d )
+            return false;
+    }
+
+    return true;
+}
+
 /*
  * When a hard affinity change occurs, we may not be able to check some
  * (any!) of the other runqueues, when looking for the best new processor
@@ -1895,20 +1930,99 @@ static bool vcpu_is_migrateable(struct csched2_vcpu *svc,
            cpumask_intersects(cpumask_scratch_cpu(cpu), &rqd->active);
 }
 
+/*
+ * Estimate, without taking its lock, what rqd->b_avgload would be if it
+ * were updated at now.  The fields may be read while being updated, so
+ * this is only good for picking a candidate runqueue: the result must be
+ * rechecked with the runqueue lock held.
+ */
+static s_time_t runq_b_avgload_estimate(const struct csched2_private *prv,
+                                        const struct csched2_runqueue_data *rqd,
+                                        s_time_t now)
+{
+    s_time_t load = read_atomic(&rqd->load);
+    s_time_t b_avgload = read_atomic(&rqd->b_avgload);
+    s_time_t delta = (now >> LOADAVG_GRANULARITY_SHIFT) -
+                     read_atomic(&rqd->load_last_update);
+    unsigned int P = prv->load_precision_shift, W = prv->load_window_shift;
+
+    if ( delta > (1LL << W) )
+        return load << P;
+    if ( delta <= 0 )
+        return b_avgload;
+
+    b_avgload += ((delta * (load << P)) >> W) - ((delta * b_avgload) >> W);
+
+    return max_t(s_time_t, b_avgload, 0);
+}
+
+/*
+ * Balancing levels, from the closest runqueues to the furthest.  (SMT
+ * siblings always share a runqueue, so they never need balancing.)
+ */
+#define BALANCE_SOCKET 0
+#define BALANCE_NODE   1
+#define BALANCE_ALL    2
+#define BALANCE_LEVELS 3
+
+static unsigned int balance_level(unsigned int cpu,
+                                  const struct csched2_runqueue_data *rqd)
+{
+    unsigned int peer_cpu = cpumask_first(&rqd->active);
+
+    if ( same_socket(cpu, peer_cpu) )
+        return BALANCE_SOCKET;
+    if ( same_node(cpu, peer_cpu) )
+        return BALANCE_NODE;
+    return BALANCE_ALL;
+}
+
+/* Is a load difference of delta between lrqd and orqd worth balancing? */
+static bool balance_worthwhile(const struct csched2_private *prv,
+                               const struct csched2_runqueue_data *lrqd,
+                               const struct csched2_runqueue_data *orqd,
+                               s_time_t l_load, s_time_t o_load,
+                               s_time_t delta)
+{
+    s_time_t load_max = max(l_load, o_load);
+    unsigned int cpus_max = max(cpumask_weight(&lrqd->active),
+                                cpumask_weight(&orqd->active));
+
+    /*
+     * If we're under 100% capacaty, only shift if load difference
+     * is > 1.  otherwise, shift if under 12.5%
+     */
+    if ( load_max < ((s_time_t)cpus_max << prv->load_precision_shift) )
+        return delta >= (1ULL << (prv->load_precision_shift +
+                                  opt_underload_balance_tolerance));
+
+    return delta >= (1ULL << (prv->load_precision_shift +
+                              opt_overload_balance_tolerance));
+}
+
 static void balance_load(const struct scheduler *ops, int cpu, s_time_t now)
 {
     struct csched2_private *prv = csched2_priv(ops);
-    int i, max_delta_rqi = -1;
+    int i, max_delta_rqi;
     struct list_head *push_iter, *pull_iter;
     bool inner_load_updated = 0;
+    s_time_t level_delta[BALANCE_LEVELS], level_load[BALANCE_LEVELS];
+    int level_rqi[BALANCE_LEVELS];
+    unsigned int lvl;
 
     balance_state_t st = { .best_push_svc = NULL, .best_pull_svc = NULL };
 
     /*
      * Basic algorithm: Push, pull, or swap.
-     * - Find the runqueue with the furthest load distance
+     * - Find the runqueue with the furthest load distance, preferring
+     *   runqueues in the same socket, then in the same node, over any
+     *   other, as long as their imbalance is worth acting on
      * - Find a pair that makes the difference the least (where one
      * on either side may be empty).
+     *
+     * Other runqueues' loads are only estimated, without taking their
+     * locks, so a balancing pass takes no more than one other runqueue
+     * lock, however many runqueues there are.
      */
 
     ASSERT(spin_is_locked(per_cpu(schedule_data, cpu).schedule_lock));
@@ -1920,82 +2034,49 @@ retry:
     if ( !read_trylock(&prv->lock) )
         return;
 
-    st.load_delta = 0;
+    for ( lvl = 0; lvl < BALANCE_LEVELS; lvl++ )
+    {
+        level_delta[lvl] = 0;
+        level_rqi[lvl] = -1;
+    }
 
     for_each_cpu(i, &prv->active_queues)
     {
-        s_time_t delta;
-        
+        s_time_t delta, o_load;
+
         st.orqd = prv->rqd + i;
 
-        if ( st.orqd == st.lrqd
-             || !spin_trylock(&st.orqd->lock) )
+        if ( st.orqd == st.lrqd )
             continue;
 
-        update_runq_load(ops, st.orqd, 0, now);
-    
-        delta = st.lrqd->b_avgload - st.orqd->b_avgload;
+        o_load = runq_b_avgload_estimate(prv, st.orqd, now);
+        delta = st.lrqd->b_avgload - o_load;
         if ( delta < 0 )
             delta = -delta;
 
-        if ( delta > st.load_delta )
+        lvl = balance_level(cpu, st.orqd);
+        if ( delta > level_delta[lvl] )
         {
-            st.load_delta = delta;
-            max_delta_rqi = i;
+            level_delta[lvl] = delta;
+            level_load[lvl] = o_load;
+            level_rqi[lvl] = i;
         }
-
-        spin_unlock(&st.orqd->lock);
     }
 
+    /* Balance at the closest level with a large enough imbalance. */
+    for ( lvl = 0; lvl < BALANCE_LEVELS; lvl++ )
+        if ( level_rqi[lvl] >= 0 &&
+             balance_worthwhile(prv, st.lrqd, prv->rqd + level_rqi[lvl],
+                                st.lrqd->b_avgload, level_load[lvl],
+                                level_delta[lvl]) )
+            break;
+
     /* Minimize holding the private scheduler lock. */
     read_unlock(&prv->lock);
-    if ( max_delta_rqi == -1 )
+    if ( lvl == BALANCE_LEVELS )
         goto out;
+    max_delta_rqi = level_rqi[lvl];
 
-    {
-        s_time_t load_max;
-        int cpus_max;
-
-        
-        load_max = st.lrqd->b_avgload;
-        if ( st.orqd->b_avgload > load_max )
-            load_max = st.orqd->b_avgload;
-
-        cpus_max = cpumask_weight(&st.lrqd->active);
-        i = cpumask_weight(&st.orqd->active);
-        if ( i > cpus_max )
-            cpus_max = i;
-
-        if ( unlikely(tb_init_done) )
-        {
-            struct {
-                unsigned lrq_id:16, orq_id:16;
-                unsigned load_delta;
-            } d;
-            d.lrq_id = st.lrqd->id;
-            d.orq_id = st.orqd->id;
-            d.load_delta = st.load_delta;
-            __trace_var(TRC_CSCHED2_LOAD_CHECK, 1,
-                        sizeof(d),
-                        (unsigned char *)&d);
-        }
-
-        /*
-         * If we're under 100% capacaty, only shift if load difference
-         * is > 1.  otherwise, shift if under 12.5%
-         */
-        if ( load_max < ((s_time_t)cpus_max << prv->load_precision_shift) )
-        {
-            if ( st.load_delta < (1ULL << (prv->load_precision_shift +
-                                           opt_underload_balance_tolerance)) )
-                 goto out;
-        }
-        else
-            if ( st.load_delta < (1ULL << (prv->load_precision_shift +
-                                           opt_overload_balance_tolerance)) )
-                goto out;
-    }
-             
     /* Try to grab the other runqueue lock; if it's been taken in the
      * meantime, try the process over again.  This can't deadlock
      * because if it doesn't get any other rqd locks, it will simply
@@ -2008,6 +2089,31 @@ retry:
     if ( unlikely(st.orqd->id < 0) )
         goto out_up;
 
+    /* Now that we hold the lock, check again using the actual load. */
+    update_runq_load(ops, st.orqd, 0, now);
+
+    st.load_delta = st.lrqd->b_avgload - st.orqd->b_avgload;
+    if ( st.load_delta < 0 )
+        st.load_delta = -st.load_delta;
+
+    if ( unlikely(tb_init_done) )
+    {
+        struct {
+            unsigned lrq_id:16, orq_id:16;
+            unsigned load_delta;
+        } d;
+        d.lrq_id = st.lrqd->id;
+        d.orq_id = st.orqd->id;
+        d.load_delta = st.load_delta;
+        __trace_var(TRC_CSCHED2_LOAD_CHECK, 1,
+                    sizeof(d),
+                    (unsigned char *)&d);
+    }
+
+    if ( !balance_worthwhile(prv, st.lrqd, st.orqd, st.lrqd->b_avgload,
+                             st.orqd->b_avgload, st.load_delta) )
+        goto out_up;
+
     if ( unlikely(tb_init_done) )
     {
         struct {
@@ -2472,7 +2578,8 @@ runq_candidate(struct csched2_runqueue_data *rqd,
     if ( !yield && prv->ratelimit_us && !is_idle_vcpu(scurr->vcpu) &&
          vcpu_runnable(scurr->vcpu) &&
          (now - scurr->vcpu->runstate.state_entry_time) <
-          MICROSECS(prv->ratelimit_us) )
+          MICROSECS(prv->ratelimit_us) &&
+         sibling_compatible(cpu, scurr->vcpu->domain) )
     {
         if ( unlikely(tb_init_done) )
         {
@@ -2490,8 +2597,12 @@ runq_candidate(struct csched2_runqueue_data *rqd,
         return scurr;
     }
 
-    /* Default to current if runnable, idle otherwise */
-    if ( vcpu_runnable(scurr->vcpu) )
+    /*
+     * Default to current if runnable (and, with SMT isolation, if it does
+     * not clash with what our siblings are running), idle otherwise.
+     */
+    if ( vcpu_runnable(scurr->vcpu) &&
+         sibling_compatible(cpu, scurr->vcpu->domain) )
         snext = scurr;
     else
         snext = csched2_vcpu(idle_vcpu[cpu]);
@@ -2531,6 +2642,16 @@ runq_candidate(struct csched2_runqueue_data *rqd,
             continue;
         }
 
+        /*
+         * With SMT isolation, don't pick vcpus of a domain different from
+         * the one(s) running on our siblings.
+         */
+        if ( !sibling_compatible(cpu, svc->vcpu->domain) )
+        {
+            (*skipped)++;
+            continue;
+        }
+
         /*
          * If this is on a different processor, don't pull it unless
          * its credit is at least CSCHED2_MIGRATE_RESIST higher.
@@ -2748,6 +2869,22 @@ csched2_schedule(
         update_load(ops, rqd, NULL, 0, now);
     }
 
+    /*
+     * With SMT isolation, if we are switching to a different domain, poke
+     * our idle siblings, so they get a chance to pick up work from the
+     * domain we are about to run (rather than staying idle because of what
+     * we were running before).
+     */
+    if ( opt_smt_isolation && snext->vcpu->domain != scurr->vcpu->domain &&
+         !list_empty(&rqd->runq) )
+    {
+        cpumask_andnot(cpumask_scratch, per_cpu(cpu_sibling_mask, cpu),
+                       cpumask_of(cpu));
+        cpumask_and(cpumask_scratch, cpumask_scratch, &rqd->idle);
+        if ( !cpumask_empty(cpumask_scratch) )
+            cpumask_raise_softirq(cpumask_scratch, SCHEDULE_SOFTIRQ);
+    }
+
     /*
      * Return task to run next...
      */
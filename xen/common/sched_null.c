@@ -32,6 +32,7 @@
 #include <xen/sched-if.h>
 #include <xen/softirq.h>
 #include <xen/keyhandler.h>
+#include <xen/guest_access.h>
 
 
 /*
@@ -297,9 +298,15 @@ static unsigned int pick_cpu(struct null_private *prv, struct vcpu *v)
                 && cpumask_test_cpu(cpu, cpumask_scratch_cpu(cpu))) )
         return cpu;
 
-    /* If not, just go for a free pCPU, within our affinity, if any */
+    /*
+     * If not, just go for a free pCPU, within our affinity, if any. Prefer
+     * one that is on a node where the domain's memory is, if possible.
+     */
     cpumask_and(cpumask_scratch_cpu(cpu), cpumask_scratch_cpu(cpu),
                 &prv->cpus_free);
+    for_each_cpu ( new_cpu, cpumask_scratch_cpu(cpu) )
+        if ( node_isset(cpu_to_node(new_cpu), v->domain->node_affinity) )
+            return new_cpu;
     new_cpu = cpumask_first(cpumask_scratch_cpu(cpu));
 
     if ( likely(new_cpu != nr_cpu_ids) )
@@ -320,6 +327,31 @@ static unsigned int pick_cpu(struct null_private *prv, struct vcpu *v)
     return cpumask_any(cpumask_scratch_cpu(cpu));
 }
 
+/*
+ * Pick, from the waitqueue, a vCPU that can be assigned to cpu: the first
+ * one (in FIFO order) whose domain has cpu's node in its node affinity, if
+ * any, or just the first one whose affinity allows it to run on cpu.
+ */
+static struct null_vcpu *waitq_pick(struct null_private *prv,
+                                    unsigned int cpu)
+{
+    struct null_vcpu *wvc, *first = NULL;
+
+    ASSERT(spin_is_locked(&prv->waitq_lock));
+
+    list_for_each_entry( wvc, &prv->waitq, waitq_elem )
+    {
+        if ( !vcpu_check_affinity(wvc->vcpu, cpu) )
+            continue;
+        if ( node_isset(cpu_to_node(cpu), wvc->vcpu->domain->node_affinity) )
+            return wvc;
+        if ( first == NULL )
+            first = wvc;
+    }
+
+    return first;
+}
+
 static void vcpu_assign(struct null_private *prv, struct vcpu *v,
                         unsigned int cpu)
 {
@@ -441,17 +473,14 @@ static void _vcpu_remove(struct null_private *prv, struct vcpu *v)
 
     /*
      * If v is assigned to a pCPU, let's see if there is someone waiting,
-     * suitable to be assigned to it.
+     * suitable to be assigned to it (preferably local to its node).
      */
-    list_for_each_entry( wvc, &prv->waitq, waitq_elem )
+    wvc = waitq_pick(prv, cpu);
+    if ( wvc )
     {
-        if ( vcpu_check_affinity(wvc->vcpu, cpu) )
-        {
-            list_del_init(&wvc->waitq_elem);
-            vcpu_assign(prv, wvc->vcpu, cpu);
-            cpu_raise_softirq(cpu, SCHEDULE_SOFTIRQ);
-            break;
-        }
+        list_del_init(&wvc->waitq_elem);
+        vcpu_assign(prv, wvc->vcpu, cpu);
+        cpu_raise_softirq(cpu, SCHEDULE_SOFTIRQ);
     }
 
     spin_unlock(&prv->waitq_lock);
@@ -653,8 +682,8 @@ static struct task_slice null_schedule(const struct scheduler *ops,
     if ( unlikely(ret.task == NULL) )
     {
         spin_lock(&prv->waitq_lock);
-        wvc = list_first_entry_or_null(&prv->waitq, struct null_vcpu, waitq_elem);
-        if ( wvc && vcpu_check_affinity(wvc->vcpu, cpu) )
+        wvc = waitq_pick(prv, cpu);
+        if ( wvc )
         {
             vcpu_assign(prv, wvc->vcpu, cpu);
             list_del_init(&wvc->waitq_elem);
@@ -672,6 +701,51 @@ static struct task_slice null_schedule(const struct scheduler *ops,
     return ret;
 }
 
+/*
+ * Report, for each pCPU of the pool, which vCPU (if any) is assigned to it.
+ * The caller provides room for nr_cpus entries, indexed by pCPU id; on
+ * return, nr_cpus is set to the number of entries that would be needed to
+ * cover all pCPUs (so more than what was copied, if the buffer is short).
+ */
+static int null_sys_cntl(const struct scheduler *ops,
+                         struct xen_sysctl_scheduler_op *sc)
+{
+    xen_sysctl_sched_null_t *params = &sc->u.sched_null;
+    xen_sysctl_null_assignment_t a;
+    unsigned int cpu;
+
+    if ( sc->cmd != XEN_SYSCTL_SCHEDOP_getinfo )
+        return -EINVAL;
+
+    for ( cpu = 0; cpu < min(params->nr_cpus, nr_cpu_ids); cpu++ )
+    {
+        a.domid = DOMID_INVALID;
+        a.pad = 0;
+        a.vcpu_id = ~0U;
+
+        if ( cpu_online(cpu) && per_cpu(scheduler, cpu) == ops )
+        {
+            unsigned long flags;
+            spinlock_t *lock = pcpu_schedule_lock_irqsave(cpu, &flags);
+            const struct vcpu *v = per_cpu(npc, cpu).vcpu;
+
+            if ( v != NULL )
+            {
+                a.domid = v->domain->domain_id;
+                a.vcpu_id = v->vcpu_id;
+            }
+            pcpu_schedule_unlock_irqrestore(lock, flags, cpu);
+        }
+
+        if ( copy_to_guest_offset(params->assignment, cpu, &a, 1) )
+            return -EFAULT;
+    }
+
+    params->nr_cpus = nr_cpu_ids;
+
+    return 0;
+}
+
 static inline void dump_vcpu(struct null_private *prv, struct null_vcpu *nvc)
 {
     printk("[%i.%i] pcpu=%d", nvc->vcpu->domain->domain_id,
@@ -794,6 +868,8 @@ const struct scheduler sched_null_def = {
 
     .wake           = null_vcpu_wake,
     .sleep          = null_vcpu_sleep,
+    .adjust_global  = null_sys_cntl,
+
     .pick_cpu       = null_cpu_pick,
     .migrate        = null_vcpu_migrate,
     .do_schedule    = null_schedule,
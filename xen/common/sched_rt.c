@@ -30,6 +30,7 @@
 #include <xen/trace.h>
 #include <xen/err.h>
 #include <xen/guest_access.h>
+#include <xen/rbtree.h>
 
 /*
  * TODO:
@@ -65,6 +66,9 @@
  * A global runqueue and a global depletedqueue for each CPU pool.
  * The runqueue holds all runnable VCPUs with budget, sorted by deadline;
  * The depletedqueue holds all VCPUs without budget, unsorted;
+ * Both the runqueue and the replenishment events queue are kept in
+ * red-black trees keyed on deadline, so that insertions and removals are
+ * O(log n) even with many vcpus;
  *
  * Note: cpumask and cpupool is supported.
  */
@@ -171,9 +175,9 @@ static void repl_timer_handler(void *data);
 struct rt_private {
     spinlock_t lock;            /* the global coarse-grained lock */
     struct list_head sdom;      /* list of availalbe domains, used for dump */
-    struct list_head runq;      /* ordered list of runnable vcpus */
+    struct rb_root runq;        /* deadline ordered tree of runnable vcpus */
     struct list_head depletedq; /* unordered list of depleted vcpus */
-    struct list_head replq;     /* ordered list of vcpus that need replenishment */
+    struct rb_root replq;       /* deadline ordered tree of replenishments */
     cpumask_t tickled;          /* cpus been tickled */
     struct timer *repl_timer;   /* replenishment timer */
 };
@@ -182,8 +186,10 @@ struct rt_private {
  * Virtual CPU
  */
 struct rt_vcpu {
-    struct list_head q_elem;     /* on the runq/depletedq list */
-    struct list_head replq_elem; /* on the replenishment events list */
+    struct rb_node runq_elem;    /* on the runq tree */
+    struct list_head q_elem;     /* on the depletedq list */
+    struct rb_node replq_elem;   /* on the replenishment events tree */
+    struct list_head repl_elem;  /* on repl_timer_handler()'s local list */
 
     /* Up-pointers */
     struct rt_dom *sdom;
@@ -227,7 +233,7 @@ static inline struct rt_dom *rt_dom(const struct domain *dom)
     return dom->sched_priv;
 }
 
-static inline struct list_head *rt_runq(const struct scheduler *ops)
+static inline struct rb_root *rt_runq(const struct scheduler *ops)
 {
     return &rt_priv(ops)->runq;
 }
@@ -237,7 +243,7 @@ static inline struct list_head *rt_depletedq(const struct scheduler *ops)
     return &rt_priv(ops)->depletedq;
 }
 
-static inline struct list_head *rt_replq(const struct scheduler *ops)
+static inline struct rb_root *rt_replq(const struct scheduler *ops)
 {
     return &rt_priv(ops)->replq;
 }
@@ -246,10 +252,22 @@ static inline struct list_head *rt_replq(const struct scheduler *ops)
  * Helper functions for manipulating the runqueue, the depleted queue,
  * and the replenishment events queue.
  */
+static int
+vcpu_on_runq(const struct rt_vcpu *svc)
+{
+   return !RB_EMPTY_NODE(&svc->runq_elem);
+}
+
 static int
 vcpu_on_q(const struct rt_vcpu *svc)
 {
-   return !list_empty(&svc->q_elem);
+   return vcpu_on_runq(svc) || !list_empty(&svc->q_elem);
+}
+
+static struct rt_vcpu *
+runq_elem(struct rb_node *elem)
+{
+    return rb_entry(elem, struct rt_vcpu, runq_elem);
 }
 
 static struct rt_vcpu *
@@ -259,15 +277,15 @@ q_elem(struct list_head *elem)
 }
 
 static struct rt_vcpu *
-replq_elem(struct list_head *elem)
+replq_elem(struct rb_node *elem)
 {
-    return list_entry(elem, struct rt_vcpu, replq_elem);
+    return rb_entry(elem, struct rt_vcpu, replq_elem);
 }
 
 static int
 vcpu_on_replq(const struct rt_vcpu *svc)
 {
-    return !list_empty(&svc->replq_elem);
+    return !RB_EMPTY_NODE(&svc->replq_elem);
 }
 
 /*
@@ -336,7 +354,9 @@ rt_dump_pcpu(const struct scheduler *ops, int cpu)
 static void
 rt_dump(const struct scheduler *ops)
 {
-    struct list_head *runq, *depletedq, *replq, *iter;
+    struct rb_root *runq, *replq;
+    struct list_head *depletedq, *iter;
+    struct rb_node *node;
     struct rt_private *prv = rt_priv(ops);
     struct rt_vcpu *svc;
     struct rt_dom *sdom;
@@ -352,9 +372,9 @@ rt_dump(const struct scheduler *ops)
     replq = rt_replq(ops);
 
     printk("Global RunQueue info:\n");
-    list_for_each ( iter, runq )
+    for ( node = rb_first(runq); node; node = rb_next(node) )
     {
-        svc = q_elem(iter);
+        svc = runq_elem(node);
         rt_dump_vcpu(ops, svc);
     }
 
@@ -366,9 +386,9 @@ rt_dump(const struct scheduler *ops)
     }
 
     printk("Global Replenishment Events info:\n");
-    list_for_each ( iter, replq )
+    for ( node = rb_first(replq); node; node = rb_next(node) )
     {
-        svc = replq_elem(iter);
+        svc = replq_elem(node);
         rt_dump_vcpu(ops, svc);
     }
 
@@ -452,52 +472,63 @@ rt_update_deadline(s_time_t now, struct rt_vcpu *svc)
  * are dealing with).
  */
 static inline bool_t
-deadline_queue_remove(struct list_head *queue, struct list_head *elem)
+deadline_queue_remove(struct rb_root *queue, struct rb_node *elem)
 {
-    int pos = 0;
+    bool_t first = (rb_first(queue) == elem);
 
-    if ( queue->next != elem )
-        pos = 1;
-
-    list_del_init(elem);
-    return !pos;
+    rb_erase(elem, queue);
+    RB_CLEAR_NODE(elem);
+    return first;
 }
 
+/*
+ * As it used to be for the lists, a vcpu is inserted before the ones
+ * with the same deadline.
+ */
 static inline bool_t
-deadline_queue_insert(struct rt_vcpu * (*qelem)(struct list_head *),
-                      struct rt_vcpu *svc, struct list_head *elem,
-                      struct list_head *queue)
+deadline_queue_insert(struct rt_vcpu * (*qelem)(struct rb_node *),
+                      struct rt_vcpu *svc, struct rb_node *elem,
+                      struct rb_root *queue)
 {
-    struct list_head *iter;
-    int pos = 0;
+    struct rb_node **link = &queue->rb_node, *parent = NULL;
+    bool_t first = 1;
 
-    list_for_each ( iter, queue )
+    while ( *link )
     {
-        struct rt_vcpu * iter_svc = (*qelem)(iter);
-        if ( svc->cur_deadline <= iter_svc->cur_deadline )
-            break;
-        pos++;
+        parent = *link;
+        if ( svc->cur_deadline <= (*qelem)(parent)->cur_deadline )
+            link = &parent->rb_left;
+        else
+        {
+            link = &parent->rb_right;
+            first = 0;
+        }
     }
-    list_add_tail(elem, iter);
-    return !pos;
+    rb_link_node(elem, parent, link);
+    rb_insert_color(elem, queue);
+    return first;
 }
 #define deadline_runq_insert(...) \
-  deadline_queue_insert(&q_elem, ##__VA_ARGS__)
+  deadline_queue_insert(&runq_elem, ##__VA_ARGS__)
 #define deadline_replq_insert(...) \
   deadline_queue_insert(&replq_elem, ##__VA_ARGS__)
 
 static inline void
-q_remove(struct rt_vcpu *svc)
+q_remove(const struct scheduler *ops, struct rt_vcpu *svc)
 {
     ASSERT( vcpu_on_q(svc) );
-    list_del_init(&svc->q_elem);
+
+    if ( vcpu_on_runq(svc) )
+        deadline_queue_remove(rt_runq(ops), &svc->runq_elem);
+    else
+        list_del_init(&svc->q_elem);
 }
 
 static inline void
 replq_remove(const struct scheduler *ops, struct rt_vcpu *svc)
 {
     struct rt_private *prv = rt_priv(ops);
-    struct list_head *replq = rt_replq(ops);
+    struct rb_root *replq = rt_replq(ops);
 
     ASSERT( vcpu_on_replq(svc) );
 
@@ -509,9 +540,9 @@ replq_remove(const struct scheduler *ops, struct rt_vcpu *svc)
          * queue is due. If it is such vcpu that we just removed, we may
          * need to reprogram the timer.
          */
-        if ( !list_empty(replq) )
+        if ( !RB_EMPTY_ROOT(replq) )
         {
-            struct rt_vcpu *svc_next = replq_elem(replq->next);
+            struct rt_vcpu *svc_next = replq_elem(rb_first(replq));
             set_timer(prv->repl_timer, svc_next->cur_deadline);
         }
         else
@@ -528,7 +559,7 @@ static void
 runq_insert(const struct scheduler *ops, struct rt_vcpu *svc)
 {
     struct rt_private *prv = rt_priv(ops);
-    struct list_head *runq = rt_runq(ops);
+    struct rb_root *runq = rt_runq(ops);
 
     ASSERT( spin_is_locked(&prv->lock) );
     ASSERT( !vcpu_on_q(svc) );
@@ -536,7 +567,7 @@ runq_insert(const struct scheduler *ops, struct rt_vcpu *svc)
 
     /* add svc to runq if svc still has budget */
     if ( svc->cur_budget > 0 )
-        deadline_runq_insert(svc, &svc->q_elem, runq);
+        deadline_runq_insert(svc, &svc->runq_elem, runq);
     else
         list_add(&svc->q_elem, &prv->depletedq);
 }
@@ -544,7 +575,7 @@ runq_insert(const struct scheduler *ops, struct rt_vcpu *svc)
 static void
 replq_insert(const struct scheduler *ops, struct rt_vcpu *svc)
 {
-    struct list_head *replq = rt_replq(ops);
+    struct rb_root *replq = rt_replq(ops);
     struct rt_private *prv = rt_priv(ops);
 
     ASSERT( !vcpu_on_replq(svc) );
@@ -566,7 +597,7 @@ replq_insert(const struct scheduler *ops, struct rt_vcpu *svc)
 static void
 replq_reinsert(const struct scheduler *ops, struct rt_vcpu *svc)
 {
-    struct list_head *replq = rt_replq(ops);
+    struct rb_root *replq = rt_replq(ops);
     struct rt_vcpu *rearm_svc = svc;
     bool_t rearm = 0;
 
@@ -584,7 +615,7 @@ replq_reinsert(const struct scheduler *ops, struct rt_vcpu *svc)
     if ( deadline_queue_remove(replq, &svc->replq_elem) )
     {
         deadline_replq_insert(svc, &svc->replq_elem, replq);
-        rearm_svc = replq_elem(replq->next);
+        rearm_svc = replq_elem(rb_first(replq));
         rearm = 1;
     }
     else
@@ -639,9 +670,9 @@ rt_init(struct scheduler *ops)
 
     spin_lock_init(&prv->lock);
     INIT_LIST_HEAD(&prv->sdom);
-    INIT_LIST_HEAD(&prv->runq);
+    prv->runq = RB_ROOT;
     INIT_LIST_HEAD(&prv->depletedq);
-    INIT_LIST_HEAD(&prv->replq);
+    prv->replq = RB_ROOT;
 
     cpumask_clear(&prv->tickled);
 
@@ -847,8 +878,10 @@ rt_alloc_vdata(const struct scheduler *ops, struct vcpu *vc, void *dd)
     if ( svc == NULL )
         return NULL;
 
+    RB_CLEAR_NODE(&svc->runq_elem);
     INIT_LIST_HEAD(&svc->q_elem);
-    INIT_LIST_HEAD(&svc->replq_elem);
+    RB_CLEAR_NODE(&svc->replq_elem);
+    INIT_LIST_HEAD(&svc->repl_elem);
     svc->flags = 0U;
     svc->sdom = dd;
     svc->vcpu = vc;
@@ -924,7 +957,7 @@ rt_vcpu_remove(const struct scheduler *ops, struct vcpu *vc)
 
     lock = vcpu_schedule_lock_irq(vc);
     if ( vcpu_on_q(svc) )
-        q_remove(svc);
+        q_remove(ops, svc);
 
     if ( vcpu_on_replq(svc) )
         replq_remove(ops,svc);
@@ -991,16 +1024,16 @@ burn_budget(const struct scheduler *ops, struct rt_vcpu *svc, s_time_t now)
 static struct rt_vcpu *
 runq_pick(const struct scheduler *ops, const cpumask_t *mask)
 {
-    struct list_head *runq = rt_runq(ops);
-    struct list_head *iter;
+    struct rb_root *runq = rt_runq(ops);
+    struct rb_node *iter;
     struct rt_vcpu *svc = NULL;
     struct rt_vcpu *iter_svc = NULL;
     cpumask_t cpu_common;
     cpumask_t *online;
 
-    list_for_each ( iter, runq )
+    for ( iter = rb_first(runq); iter; iter = rb_next(iter) )
     {
-        iter_svc = q_elem(iter);
+        iter_svc = runq_elem(iter);
 
         /* mask cpu_hard_affinity & cpupool & mask */
         online = cpupool_domain_cpumask(iter_svc->vcpu->domain);
@@ -1100,7 +1133,7 @@ rt_schedule(const struct scheduler *ops, s_time_t now, bool_t tasklet_work_sched
     {
         if ( snext != scurr )
         {
-            q_remove(snext);
+            q_remove(ops, snext);
             __set_bit(__RTDS_scheduled, &snext->flags);
         }
         if ( snext->vcpu->processor != cpu )
@@ -1131,7 +1164,7 @@ rt_vcpu_sleep(const struct scheduler *ops, struct vcpu *vc)
         cpu_raise_softirq(vc->processor, SCHEDULE_SOFTIRQ);
     else if ( vcpu_on_q(svc) )
     {
-        q_remove(svc);
+        q_remove(ops, svc);
         replq_remove(ops, svc);
     }
     else if ( svc->flags & RTDS_delayed_runq_add )
@@ -1439,9 +1472,10 @@ static void repl_timer_handler(void *data){
     s_time_t now;
     struct scheduler *ops = data;
     struct rt_private *prv = rt_priv(ops);
-    struct list_head *replq = rt_replq(ops);
-    struct list_head *runq = rt_runq(ops);
+    struct rb_root *replq = rt_replq(ops);
+    struct rb_root *runq = rt_runq(ops);
     struct timer *repl_timer = prv->repl_timer;
+    struct rb_node *node;
     struct list_head *iter, *tmp;
     struct rt_vcpu *svc;
     LIST_HEAD(tmp_replq);
@@ -1456,20 +1490,20 @@ static void repl_timer_handler(void *data){
      * If svc is on run queue, we need to put it at
      * the correct place since its deadline changes.
      */
-    list_for_each_safe ( iter, tmp, replq )
+    while ( (node = rb_first(replq)) != NULL )
     {
-        svc = replq_elem(iter);
+        svc = replq_elem(node);
 
         if ( now < svc->cur_deadline )
             break;
 
-        list_del(&svc->replq_elem);
+        deadline_queue_remove(replq, &svc->replq_elem);
         rt_update_deadline(now, svc);
-        list_add(&svc->replq_elem, &tmp_replq);
+        list_add(&svc->repl_elem, &tmp_replq);
 
         if ( vcpu_on_q(svc) )
         {
-            q_remove(svc);
+            q_remove(ops, svc);
             runq_insert(ops, svc);
         }
     }
@@ -1483,12 +1517,12 @@ static void repl_timer_handler(void *data){
      */
     list_for_each_safe ( iter, tmp, &tmp_replq )
     {
-        svc = replq_elem(iter);
+        svc = list_entry(iter, struct rt_vcpu, repl_elem);
 
         if ( curr_on_cpu(svc->vcpu->processor) == svc->vcpu &&
-             !list_empty(runq) )
+             !RB_EMPTY_ROOT(runq) )
         {
-            struct rt_vcpu *next_on_runq = q_elem(runq->next);
+            struct rt_vcpu *next_on_runq = runq_elem(rb_first(runq));
 
             if ( svc->cur_deadline > next_on_runq->cur_deadline )
                 runq_tickle(ops, next_on_runq);
@@ -1497,7 +1531,7 @@ static void repl_timer_handler(void *data){
                   vcpu_on_q(svc) )
             runq_tickle(ops, svc);
 
-        list_del(&svc->replq_elem);
+        list_del_init(&svc->repl_elem);
         deadline_replq_insert(svc, &svc->replq_elem, replq);
     }
 
@@ -1506,8 +1540,8 @@ static void repl_timer_handler(void *data){
      * set the next replenishment to happen at the deadline of
      * the one in the front.
      */
-    if ( !list_empty(replq) )
-        set_timer(repl_timer, replq_elem(replq->next)->cur_deadline);
+    if ( !RB_EMPTY_ROOT(replq) )
+        set_timer(repl_timer, replq_elem(rb_first(replq))->cur_deadline);
 
     spin_unlock_irq(&prv->lock);
 }
@@ -30,6 +30,7 @@
 #include <xen/err.h>
 #include <xen/guest_access.h>
 #include <xen/hypercall.h>
+#include <xen/latency_stats.h>
 #include <xen/multicall.h>
 #include <xen/cpu.h>
 #include <xen/preempt.h>
@@ -187,6 +188,25 @@ static inline void vcpu_runstate_change(
     trace_runstate_change(v, new_state);
 
     delta = new_entry_time - v->runstate.state_entry_time;
+
+    if ( unlikely(opt_latency_stats & (LATENCY_STATS_RUNQ |
+                                       LATENCY_STATS_WAKE)) &&
+         !is_idle_vcpu(v) )
+    {
+        if ( new_state == RUNSTATE_runnable )
+            v->latency_woken = v->runstate.state != RUNSTATE_running;
+        else if ( new_state == RUNSTATE_running &&
+                  v->runstate.state == RUNSTATE_runnable )
+        {
+            unsigned int kind = v->latency_woken
+                                ? XEN_SYSCTL_LATENCY_STATS_wake
+                                : XEN_SYSCTL_LATENCY_STATS_runq;
+
+            if ( opt_latency_stats & (1u << kind) )
+                latency_stats_record(v, kind, 0, max_t(s_time_t, delta, 0));
+        }
+    }
+
     if ( delta > 0 )
     {
         v->runstate.time[v->runstate.state] += delta;
@@ -1003,6 +1023,25 @@ long vcpu_yield(void)
     return 0;
 }
 
+/*
+ * Yield, letting the scheduler help @target (which must belong to a
+ * domain the caller holds a reference to) run in our stead.
+ */
+long vcpu_yield_to(struct vcpu *target)
+{
+    struct vcpu *v = current;
+
+    if ( target != v && vcpu_scheduler(target) == vcpu_scheduler(v) )
+    {
+        spinlock_t *lock = vcpu_schedule_lock_irq(target);
+
+        SCHED_OP(vcpu_scheduler(v), yield_to, v, target);
+        vcpu_schedule_unlock_irq(lock, target);
+    }
+
+    return vcpu_yield();
+}
+
 static void domain_watchdog_timeout(void *data)
 {
     struct domain *d = data;
@@ -1245,6 +1284,34 @@ ret_t do_sched_op(int cmd, XEN_GUEST_HANDLE_PARAM(void) arg)
         break;
     }
 
+    case SCHEDOP_yield_to:
+    {
+        struct sched_yield_to sched_yield_to;
+        struct domain *d;
+
+        ret = -EFAULT;
+        if ( copy_from_guest(&sched_yield_to, arg, 1) )
+            break;
+
+        ret = -EINVAL;
+        if ( sched_yield_to.pad )
+            break;
+
+        ret = -ESRCH;
+        d = rcu_lock_domain_by_any_id(sched_yield_to.domain_id);
+        if ( d == NULL )
+            break;
+
+        ret = -ENOENT;
+        if ( sched_yield_to.vcpu_id < d->max_vcpus &&
+             d->vcpu[sched_yield_to.vcpu_id] != NULL )
+            ret = vcpu_yield_to(d->vcpu[sched_yield_to.vcpu_id]);
+
+        rcu_unlock_domain(d);
+
+        break;
+    }
+
     default:
         ret = -ENOSYS;
     }
@@ -1478,6 +1545,9 @@ static void schedule(void)
 
     pcpu_schedule_unlock_irq(lock, cpu);
 
+    if ( is_idle_vcpu(prev) != is_idle_vcpu(next) )
+        cpufreq_sched_update(cpu, now, !is_idle_vcpu(next));
+
     SCHED_STAT_CRANK(sched_ctx);
 
     stop_timer(&prev->periodic_timer);
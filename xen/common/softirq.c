@@ -11,10 +11,12 @@
 
 #include <xen/init.h>
 #include <xen/mm.h>
+#include <xen/perfc.h>
 #include <xen/preempt.h>
 #include <xen/sched.h>
 #include <xen/rcupdate.h>
 #include <xen/softirq.h>
+#include <xen/trace.h>
 
 #ifndef __ARCH_IRQ_STAT
 irq_cpustat_t irq_stat[NR_CPUS];
@@ -25,6 +27,41 @@ static softirq_handler softirq_handlers[NR_SOFTIRQS];
 static DEFINE_PER_CPU(cpumask_t, batch_mask);
 static DEFINE_PER_CPU(unsigned int, batching);
 
+/* Handlers running for longer than this many microseconds get traced. */
+static unsigned int __read_mostly softirq_trace_us = 100;
+integer_param("softirq_trace_us", softirq_trace_us);
+
+/*
+ * Bumped whenever a handler starts running on a CPU.  A handler's run time
+ * is only accounted when this didn't move meanwhile, i.e. if it didn't
+ * process softirqs itself, and if it returned to the frame which called it
+ * rather than to one of another vCPU switched to by the scheduler.
+ */
+static DEFINE_PER_CPU(unsigned long, softirq_seq);
+
+bool softirq_timing(void)
+{
+    return IS_ENABLED(CONFIG_PERF_ARRAYS) || tb_init_done;
+}
+
+bool softirq_slow(s_time_t runtime)
+{
+    return unlikely(tb_init_done) && runtime > MICROSECS(softirq_trace_us);
+}
+
+static void softirq_account(unsigned int nr, s_time_t start,
+                            unsigned long seq)
+{
+    s_time_t runtime = NOW() - start;
+
+    if ( this_cpu(softirq_seq) != seq )
+        return;
+
+    perfc_incr_time_histo(softirq_time, nr, runtime);
+    if ( softirq_slow(runtime) )
+        TRACE_2D(TRC_HW_IRQ_SOFTIRQ_SLOW, nr, runtime);
+}
+
 static void __do_softirq(unsigned long ignore_mask)
 {
     unsigned int i, cpu;
@@ -47,7 +84,17 @@ static void __do_softirq(unsigned long ignore_mask)
 
         i = find_first_set_bit(pending);
         clear_bit(i, &softirq_pending(cpu));
-        (*softirq_handlers[i])();
+
+        if ( softirq_timing() )
+        {
+            s_time_t start = NOW();
+            unsigned long seq = ++this_cpu(softirq_seq);
+
+            (*softirq_handlers[i])();
+            softirq_account(i, start, seq);
+        }
+        else
+            (*softirq_handlers[i])();
     }
 }
 
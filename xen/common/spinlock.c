@@ -1,10 +1,14 @@
 #include <xen/lib.h>
+#include <xen/cpu.h>
+#include <xen/init.h>
 #include <xen/irq.h>
 #include <xen/smp.h>
 #include <xen/time.h>
 #include <xen/spinlock.h>
 #include <xen/guest_access.h>
 #include <xen/preempt.h>
+#include <xen/symbols.h>
+#include <xen/xmalloc.h>
 #include <public/sysctl.h>
 #include <asm/processor.h>
 #include <asm/atomic.h>
@@ -114,6 +118,405 @@ void spin_debug_disable(void)
 
 #endif
 
+#ifdef CONFIG_LOCK_SAMPLE
+
+/*
+ * Sampled lock profiling: one in lock_sample_rate acquisitions on each CPU
+ * is timed, and its wait and hold times are added to the histograms of its
+ * call site.  Like the hypercall statistics, each CPU collects into a hash
+ * table of its own, with interrupts off rather than under a lock (which
+ * would be sampled in turn), and the tables are merged when queried.
+ *
+ * A sampled lock is remembered in a few per-CPU slots until it is released
+ * on the same CPU.  Locks released elsewhere only leave a stale slot behind,
+ * which gets dropped after a while.
+ */
+#define LOCK_SAMPLE_ORDER   6       /* Entries per CPU. */
+#define LOCK_SAMPLE_MERGED  9       /* Entries of a query. */
+#define LOCK_SAMPLE_PROBES  16
+#define LOCK_SAMPLE_HELD    4
+#define LOCK_SAMPLE_STALE   SECONDS(1)
+
+struct lock_sample {
+    unsigned long site;
+    unsigned long lock;
+    uint64_t samples;
+    uint64_t contended;
+    uint64_t wait_ns, wait_max_ns;
+    uint64_t hold_ns, hold_max_ns;
+    uint32_t wait_histo[XEN_SYSCTL_LOCK_SAMPLE_BUCKETS];
+    uint32_t hold_histo[XEN_SYSCTL_LOCK_SAMPLE_BUCKETS];
+};
+
+struct lock_sample_held {
+    unsigned int nr;
+    struct {
+        const spinlock_t *lock;
+        unsigned long site;
+        s_time_t locked;
+    } slot[LOCK_SAMPLE_HELD];
+};
+
+static unsigned int __read_mostly lock_sample_rate;
+integer_param("lock_sample", lock_sample_rate);
+
+static DEFINE_PER_CPU(unsigned int, lock_sample_countdown);
+static DEFINE_PER_CPU(struct lock_sample_held, lock_sample_held);
+static DEFINE_PER_CPU(struct lock_sample *, lock_samples);
+static DEFINE_PER_CPU(unsigned long, lock_samples_dropped);
+
+static struct lock_sample *lock_sample_find(struct lock_sample *table,
+                                            unsigned int order,
+                                            unsigned long site)
+{
+    unsigned int i, mask = (1u << order) - 1;
+    unsigned int idx = (site * 0x9e3779b97f4a7c15ULL) >> (64 - order);
+
+    for ( i = 0; i < LOCK_SAMPLE_PROBES; i++, idx = (idx + 1) & mask )
+    {
+        if ( table[idx].site == site )
+            return &table[idx];
+        if ( !table[idx].site )
+        {
+            table[idx].site = site;
+            return &table[idx];
+        }
+    }
+
+    return NULL;
+}
+
+/* Bucket 0 is below 128ns, bucket n below 2^n * 128ns. */
+static unsigned int lock_sample_bucket(uint64_t ns)
+{
+    return ns < (128u << (XEN_SYSCTL_LOCK_SAMPLE_BUCKETS - 1)) ?
+           fls(ns >> 7) : XEN_SYSCTL_LOCK_SAMPLE_BUCKETS - 1;
+}
+
+static always_inline s_time_t lock_sample_begin(void)
+{
+    unsigned int rate = read_atomic(&lock_sample_rate);
+    unsigned int *count;
+
+    if ( likely(!rate) )
+        return 0;
+
+    count = &this_cpu(lock_sample_countdown);
+    if ( likely(*count && *count < rate) )
+    {
+        --*count;
+        return 0;
+    }
+    *count = rate - 1;
+
+    return NOW();
+}
+
+static void lock_sample_got(const spinlock_t *lock, const void *site,
+                            s_time_t start, bool_t blocked)
+{
+    struct lock_sample_held *held = &this_cpu(lock_sample_held);
+    struct lock_sample *table, *s = NULL;
+    unsigned long flags;
+    s_time_t now = NOW();
+    uint64_t ns = now - start;
+
+    local_irq_save(flags);
+
+    table = this_cpu(lock_samples);
+    if ( table )
+        s = lock_sample_find(table, LOCK_SAMPLE_ORDER, (unsigned long)site);
+    if ( !s )
+    {
+        this_cpu(lock_samples_dropped)++;
+        goto out;
+    }
+
+    s->lock = (unsigned long)lock;
+    s->samples++;
+    if ( blocked )
+        s->contended++;
+    s->wait_ns += ns;
+    if ( ns > s->wait_max_ns )
+        s->wait_max_ns = ns;
+    s->wait_histo[lock_sample_bucket(ns)]++;
+
+    if ( held->nr < LOCK_SAMPLE_HELD )
+    {
+        held->slot[held->nr].lock = lock;
+        held->slot[held->nr].site = (unsigned long)site;
+        held->slot[held->nr].locked = now;
+        held->nr++;
+    }
+
+ out:
+    local_irq_restore(flags);
+}
+
+static void lock_sample_rel(const spinlock_t *lock)
+{
+    struct lock_sample_held *held = &this_cpu(lock_sample_held);
+    struct lock_sample *table, *s;
+    unsigned long flags;
+    s_time_t now = NOW();
+    unsigned int i;
+    uint64_t ns;
+
+    local_irq_save(flags);
+
+    for ( i = held->nr; i--; )
+    {
+        bool_t found = held->slot[i].lock == lock;
+
+        ns = now - held->slot[i].locked;
+        if ( !found && ns < LOCK_SAMPLE_STALE )
+            continue;
+
+        if ( found &&
+             (table = this_cpu(lock_samples)) != NULL &&
+             (s = lock_sample_find(table, LOCK_SAMPLE_ORDER,
+                                   held->slot[i].site)) != NULL )
+        {
+            s->hold_ns += ns;
+            if ( ns > s->hold_max_ns )
+                s->hold_max_ns = ns;
+            s->hold_histo[lock_sample_bucket(ns)]++;
+        }
+
+        held->slot[i] = held->slot[--held->nr];
+        if ( found )
+            break;
+    }
+
+    local_irq_restore(flags);
+}
+
+#define LOCK_SAMPLE_SITE    __builtin_return_address(0)
+#define LOCK_SAMPLE_VAR                                                      \
+    s_time_t sample = lock_sample_begin();                                   \
+    bool_t sample_blocked = 0
+#define LOCK_SAMPLE_BLOCK   sample_blocked = 1;
+#define LOCK_SAMPLE_GOT                                                      \
+    if ( unlikely(sample) )                                                  \
+        lock_sample_got(lock, site, sample, sample_blocked);
+#define LOCK_SAMPLE_REL                                                      \
+    if ( unlikely(this_cpu(lock_sample_held).nr) )                           \
+        lock_sample_rel(lock);
+
+#else
+
+#define LOCK_SAMPLE_SITE    NULL
+#define LOCK_SAMPLE_VAR
+#define LOCK_SAMPLE_BLOCK
+#define LOCK_SAMPLE_GOT
+#define LOCK_SAMPLE_REL
+
+#endif
+
+#ifdef CONFIG_QUEUED_SPINLOCKS
+
+/*
+ * Queued (MCS) spinlocks.
+ *
+ * Uncontended, the lock is taken by atomically turning the lock word from 0
+ * into 'locked'. Otherwise, a waiter appends a per-CPU node to the queue, by
+ * swapping itself in as the new tail, and spins on its own node until its
+ * predecessor hands the head of the queue over to it. The head of the queue
+ * is the only one spinning on the lock itself, until the owner releases it.
+ *
+ * A node is only in use while waiting, not while holding the lock, so each
+ * CPU needs one per nesting level of contexts that can spin concurrently
+ * (normal, IRQ, NMI/#MC, and one spare).
+ */
+#define SPIN_QNODES          4
+#define SPIN_QTAIL_IDX_BITS  2
+#define SPIN_QLOCKED         1U
+#define SPIN_QTAIL_SHIFT     16
+#define SPIN_QTAIL_MASK      (0xffffU << SPIN_QTAIL_SHIFT)
+
+struct spin_qnode {
+    struct spin_qnode *next;
+    bool_t locked;
+};
+
+struct spin_qnodes {
+    unsigned int count;
+    struct spin_qnode node[SPIN_QNODES];
+};
+
+static DEFINE_PER_CPU(struct spin_qnodes, spin_qnodes);
+
+static inline u32 encode_tail(unsigned int cpu, unsigned int idx)
+{
+    return (((cpu + 1) << SPIN_QTAIL_IDX_BITS) | idx) << SPIN_QTAIL_SHIFT;
+}
+
+static inline struct spin_qnode *decode_tail(u32 val)
+{
+    u32 tail = (val & SPIN_QTAIL_MASK) >> SPIN_QTAIL_SHIFT;
+
+    return &per_cpu(spin_qnodes, (tail >> SPIN_QTAIL_IDX_BITS) - 1).node[
+                tail & (SPIN_QNODES - 1)];
+}
+
+static void spin_lock_common(spinlock_t *lock, const void *site)
+{
+    struct spin_qnodes *qnodes;
+    struct spin_qnode *node, *next;
+    unsigned int idx;
+    u32 tail, old, val;
+    LOCK_SAMPLE_VAR;
+    LOCK_PROFILE_VAR;
+
+    BUILD_BUG_ON(NR_CPUS >= (1 << (16 - SPIN_QTAIL_IDX_BITS)));
+    BUILD_BUG_ON(SPIN_QNODES > (1 << SPIN_QTAIL_IDX_BITS));
+
+    check_lock(&lock->debug);
+
+    if ( likely(cmpxchg(&lock->q.val, 0, SPIN_QLOCKED) == 0) )
+        goto out;
+
+    LOCK_PROFILE_BLOCK;
+    LOCK_SAMPLE_BLOCK;
+
+    qnodes = &this_cpu(spin_qnodes);
+    idx = qnodes->count++;
+    if ( unlikely(idx >= SPIN_QNODES) )
+    {
+        /* Nested too deep: don't queue, just wait for the lock to be free. */
+        while ( read_atomic(&lock->q.val) != 0 ||
+                cmpxchg(&lock->q.val, 0, SPIN_QLOCKED) != 0 )
+            arch_lock_relax();
+        goto release;
+    }
+
+    node = &qnodes->node[idx];
+    node->next = NULL;
+    node->locked = 0;
+    tail = encode_tail(smp_processor_id(), idx);
+
+    /* Become the new tail of the queue (cmpxchg() is a full barrier). */
+    do {
+        old = read_atomic(&lock->q.val);
+    } while ( cmpxchg(&lock->q.val, old,
+                      (old & ~SPIN_QTAIL_MASK) | tail) != old );
+
+    /* If there was someone queued already, wait until we're the head. */
+    if ( old & SPIN_QTAIL_MASK )
+    {
+        write_atomic(&decode_tail(old)->next, node);
+        arch_lock_signal();
+        while ( !read_atomic(&node->locked) )
+            arch_lock_relax();
+        smp_rmb();
+    }
+
+    /* At the head of the queue: wait for the owner to release the lock. */
+    while ( (val = read_atomic(&lock->q.val)) & SPIN_QLOCKED )
+        arch_lock_relax();
+
+    /*
+     * If we are the last one queued, take the lock and empty the queue
+     * at once. If not, only we can set 'locked' (no one can take the lock
+     * while the queue is not empty), and we have to pass the head of the
+     * queue over to our successor, once it has linked itself to us.
+     */
+    if ( (val & SPIN_QTAIL_MASK) != tail ||
+         cmpxchg(&lock->q.val, val, SPIN_QLOCKED) != val )
+    {
+        write_atomic(&lock->q.locked, SPIN_QLOCKED);
+        while ( (next = read_atomic(&node->next)) == NULL )
+            arch_lock_relax();
+        smp_wmb();
+        write_atomic(&next->locked, 1);
+        arch_lock_signal();
+    }
+
+ release:
+    qnodes->count--;
+ out:
+    LOCK_PROFILE_GOT;
+    LOCK_SAMPLE_GOT;
+    preempt_disable();
+    arch_lock_acquire_barrier();
+}
+
+void _spin_lock(spinlock_t *lock)
+{
+    spin_lock_common(lock, LOCK_SAMPLE_SITE);
+}
+
+void _spin_unlock(spinlock_t *lock)
+{
+    arch_lock_release_barrier();
+    preempt_enable();
+    LOCK_PROFILE_REL;
+    LOCK_SAMPLE_REL;
+    write_atomic(&lock->q.locked, 0);
+    arch_lock_signal();
+}
+
+int _spin_is_locked(spinlock_t *lock)
+{
+    check_lock(&lock->debug);
+
+    /*
+     * Recursive locks may be locked by another CPU, yet we return
+     * "false" here, making this function suitable only for use in
+     * ASSERT()s and alike.
+     */
+    return lock->recurse_cpu == SPINLOCK_NO_CPU
+           ? read_atomic(&lock->q.locked) != 0
+           : lock->recurse_cpu == smp_processor_id();
+}
+
+int _spin_trylock(spinlock_t *lock)
+{
+    check_lock(&lock->debug);
+    if ( read_atomic(&lock->q.val) != 0 ||
+         cmpxchg(&lock->q.val, 0, SPIN_QLOCKED) != 0 )
+        return 0;
+#ifdef CONFIG_LOCK_PROFILE
+    if (lock->profile)
+        lock->profile->time_locked = NOW();
+#endif
+    preempt_disable();
+    /*
+     * cmpxchg() is a full barrier so no need for an
+     * arch_lock_acquire_barrier().
+     */
+    return 1;
+}
+
+/*
+ * Unlike with ticket locks, we can't tell one owner from the next one, so
+ * this may wait for more than one critical section, under contention.
+ */
+void _spin_barrier(spinlock_t *lock)
+{
+#ifdef CONFIG_LOCK_PROFILE
+    s_time_t block = NOW();
+#endif
+
+    check_barrier(&lock->debug);
+    smp_mb();
+    if ( read_atomic(&lock->q.locked) )
+    {
+        while ( read_atomic(&lock->q.locked) )
+            arch_lock_relax();
+#ifdef CONFIG_LOCK_PROFILE
+        if ( lock->profile )
+        {
+            lock->profile->time_block += NOW() - block;
+            lock->profile->block_cnt++;
+        }
+#endif
+    }
+    smp_mb();
+}
+
+#else /* !CONFIG_QUEUED_SPINLOCKS */
+
 static always_inline spinlock_tickets_t observe_lock(spinlock_tickets_t *t)
 {
     spinlock_tickets_t v;
@@ -129,9 +532,10 @@ static always_inline u16 observe_head(spinlock_tickets_t *t)
     return read_atomic(&t->head);
 }
 
-void _spin_lock(spinlock_t *lock)
+static void spin_lock_common(spinlock_t *lock, const void *site)
 {
     spinlock_tickets_t tickets = SPINLOCK_TICKET_INC;
+    LOCK_SAMPLE_VAR;
     LOCK_PROFILE_VAR;
 
     check_lock(&lock->debug);
@@ -140,27 +544,18 @@ void _spin_lock(spinlock_t *lock)
     while ( tickets.tail != observe_head(&lock->tickets) )
     {
         LOCK_PROFILE_BLOCK;
+        LOCK_SAMPLE_BLOCK;
         arch_lock_relax();
     }
     LOCK_PROFILE_GOT;
+    LOCK_SAMPLE_GOT;
     preempt_disable();
     arch_lock_acquire_barrier();
 }
 
-void _spin_lock_irq(spinlock_t *lock)
+void _spin_lock(spinlock_t *lock)
 {
-    ASSERT(local_irq_is_enabled());
-    local_irq_disable();
-    _spin_lock(lock);
-}
-
-unsigned long _spin_lock_irqsave(spinlock_t *lock)
-{
-    unsigned long flags;
-
-    local_irq_save(flags);
-    _spin_lock(lock);
-    return flags;
+    spin_lock_common(lock, LOCK_SAMPLE_SITE);
 }
 
 void _spin_unlock(spinlock_t *lock)
@@ -168,22 +563,11 @@ void _spin_unlock(spinlock_t *lock)
     arch_lock_release_barrier();
     preempt_enable();
     LOCK_PROFILE_REL;
+    LOCK_SAMPLE_REL;
     add_sized(&lock->tickets.head, 1);
     arch_lock_signal();
 }
 
-void _spin_unlock_irq(spinlock_t *lock)
-{
-    _spin_unlock(lock);
-    local_irq_enable();
-}
-
-void _spin_unlock_irqrestore(spinlock_t *lock, unsigned long flags)
-{
-    _spin_unlock(lock);
-    local_irq_restore(flags);
-}
-
 int _spin_is_locked(spinlock_t *lock)
 {
     check_lock(&lock->debug);
@@ -248,6 +632,36 @@ void _spin_barrier(spinlock_t *lock)
     smp_mb();
 }
 
+#endif /* CONFIG_QUEUED_SPINLOCKS */
+
+void _spin_lock_irq(spinlock_t *lock)
+{
+    ASSERT(local_irq_is_enabled());
+    local_irq_disable();
+    spin_lock_common(lock, LOCK_SAMPLE_SITE);
+}
+
+unsigned long _spin_lock_irqsave(spinlock_t *lock)
+{
+    unsigned long flags;
+
+    local_irq_save(flags);
+    spin_lock_common(lock, LOCK_SAMPLE_SITE);
+    return flags;
+}
+
+void _spin_unlock_irq(spinlock_t *lock)
+{
+    _spin_unlock(lock);
+    local_irq_enable();
+}
+
+void _spin_unlock_irqrestore(spinlock_t *lock, unsigned long flags)
+{
+    _spin_unlock(lock);
+    local_irq_restore(flags);
+}
+
 int _spin_trylock_recursive(spinlock_t *lock)
 {
     unsigned int cpu = smp_processor_id();
@@ -277,7 +691,7 @@ void _spin_lock_recursive(spinlock_t *lock)
 
     if ( likely(lock->recurse_cpu != cpu) )
     {
-        _spin_lock(lock);
+        spin_lock_common(lock, LOCK_SAMPLE_SITE);
         lock->recurse_cpu = cpu;
     }
 
@@ -295,6 +709,211 @@ void _spin_unlock_recursive(spinlock_t *lock)
     }
 }
 
+#ifdef CONFIG_LOCK_SAMPLE
+
+static DEFINE_SPINLOCK(lock_sample_lock);
+static bool_t lock_sample_ready;
+
+static int lock_sample_cpu_callback(
+    struct notifier_block *nfb, unsigned long action, void *hcpu)
+{
+    unsigned int cpu = (unsigned long)hcpu;
+
+    if ( action == CPU_UP_PREPARE && !per_cpu(lock_samples, cpu) )
+    {
+        per_cpu(lock_samples, cpu) =
+            xzalloc_array(struct lock_sample, 1u << LOCK_SAMPLE_ORDER);
+        if ( !per_cpu(lock_samples, cpu) )
+            return notifier_from_errno(-ENOMEM);
+    }
+
+    return NOTIFY_DONE;
+}
+
+static struct notifier_block lock_sample_cpu_nfb = {
+    .notifier_call = lock_sample_cpu_callback
+};
+
+/* The tables are only allocated once sampling first gets enabled. */
+static int lock_sample_alloc(void)
+{
+    unsigned int cpu;
+    int rc = 0;
+
+    if ( lock_sample_ready )
+        return 0;
+
+    if ( !get_cpu_maps() )
+        return -EBUSY;
+
+    for_each_online_cpu ( cpu )
+    {
+        rc = notifier_to_errno(
+            lock_sample_cpu_callback(&lock_sample_cpu_nfb, CPU_UP_PREPARE,
+                                     (void *)(unsigned long)cpu));
+        if ( rc )
+            break;
+    }
+    if ( !rc )
+    {
+        register_cpu_notifier(&lock_sample_cpu_nfb);
+        lock_sample_ready = 1;
+    }
+    put_cpu_maps();
+
+    return rc;
+}
+
+static int __init lock_sample_init(void)
+{
+    if ( lock_sample_rate && lock_sample_alloc() )
+        lock_sample_rate = 0;
+
+    return 0;
+}
+presmp_initcall(lock_sample_init);
+
+static int lock_sample_query(struct xen_sysctl_lock_sample *op)
+{
+    struct lock_sample *merged, *s, *m;
+    unsigned int cpu, i, nr = 0;
+    int rc = 0;
+
+    merged = xzalloc_array(struct lock_sample, 1u << LOCK_SAMPLE_MERGED);
+    if ( !merged )
+        return -ENOMEM;
+
+    op->dropped = 0;
+    for_each_online_cpu ( cpu )
+    {
+        op->dropped += per_cpu(lock_samples_dropped, cpu);
+        if ( !per_cpu(lock_samples, cpu) )
+            continue;
+
+        for ( i = 0; i < (1u << LOCK_SAMPLE_ORDER); i++ )
+        {
+            unsigned int b;
+
+            s = &per_cpu(lock_samples, cpu)[i];
+            if ( !s->site )
+                continue;
+
+            m = lock_sample_find(merged, LOCK_SAMPLE_MERGED, s->site);
+            if ( !m )
+            {
+                op->dropped += s->samples;
+                continue;
+            }
+
+            m->lock = s->lock;
+            m->samples += s->samples;
+            m->contended += s->contended;
+            m->wait_ns += s->wait_ns;
+            m->wait_max_ns = max(m->wait_max_ns, s->wait_max_ns);
+            m->hold_ns += s->hold_ns;
+            m->hold_max_ns = max(m->hold_max_ns, s->hold_max_ns);
+            for ( b = 0; b < XEN_SYSCTL_LOCK_SAMPLE_BUCKETS; b++ )
+            {
+                m->wait_histo[b] += s->wait_histo[b];
+                m->hold_histo[b] += s->hold_histo[b];
+            }
+        }
+    }
+
+    for ( i = 0; i < (1u << LOCK_SAMPLE_MERGED); i++ )
+    {
+        struct xen_sysctl_lock_sample_entry e;
+        char namebuf[KSYM_NAME_LEN + 1];
+        unsigned long size, offset;
+        const char *name;
+
+        m = &merged[i];
+        if ( !m->site )
+            continue;
+
+        if ( nr < op->nr_entries )
+        {
+            memset(&e, 0, sizeof(e));
+            e.site = m->site;
+            e.lock = m->lock;
+            name = symbols_lookup(m->site, &size, &offset, namebuf);
+            if ( name )
+                snprintf(e.name, sizeof(e.name), "%s+%#lx", name, offset);
+            e.samples = m->samples;
+            e.contended = m->contended;
+            e.wait_ns = m->wait_ns;
+            e.wait_max_ns = m->wait_max_ns;
+            e.hold_ns = m->hold_ns;
+            e.hold_max_ns = m->hold_max_ns;
+            memcpy(e.wait_histo, m->wait_histo, sizeof(e.wait_histo));
+            memcpy(e.hold_histo, m->hold_histo, sizeof(e.hold_histo));
+            if ( copy_to_guest_offset(op->entries, nr, &e, 1) )
+            {
+                rc = -EFAULT;
+                break;
+            }
+        }
+        nr++;
+    }
+
+    xfree(merged);
+    op->nr_entries = nr;
+
+    return rc;
+}
+
+int spinlock_sample_op(struct xen_sysctl_lock_sample *op)
+{
+    unsigned int cpu;
+    int rc = 0;
+
+    spin_lock(&lock_sample_lock);
+
+    switch ( op->cmd )
+    {
+    case XEN_SYSCTL_LOCK_SAMPLE_query:
+        rc = lock_sample_query(op);
+        break;
+
+    case XEN_SYSCTL_LOCK_SAMPLE_reset:
+        /* Racing with updates, so some of them may survive. */
+        for_each_online_cpu ( cpu )
+        {
+            if ( per_cpu(lock_samples, cpu) )
+                memset(per_cpu(lock_samples, cpu), 0,
+                       sizeof(struct lock_sample) << LOCK_SAMPLE_ORDER);
+            per_cpu(lock_samples_dropped, cpu) = 0;
+        }
+        break;
+
+    case XEN_SYSCTL_LOCK_SAMPLE_set_rate:
+        if ( op->rate )
+            rc = lock_sample_alloc();
+        if ( !rc )
+            write_atomic(&lock_sample_rate, op->rate);
+        break;
+
+    default:
+        rc = -EINVAL;
+        break;
+    }
+
+    op->rate = lock_sample_rate;
+
+    spin_unlock(&lock_sample_lock);
+
+    return rc;
+}
+
+#else /* !CONFIG_LOCK_SAMPLE */
+
+int spinlock_sample_op(struct xen_sysctl_lock_sample *op)
+{
+    return -EOPNOTSUPP;
+}
+
+#endif /* CONFIG_LOCK_SAMPLE */
+
 #ifdef CONFIG_LOCK_PROFILE
 
 struct lock_profile_anc {
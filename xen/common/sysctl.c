@@ -19,6 +19,7 @@
 #include <xen/iocap.h>
 #include <xen/guest_access.h>
 #include <xen/keyhandler.h>
+#include <xen/latency_stats.h>
 #include <asm/current.h>
 #include <xen/hypercall.h>
 #include <public/sysctl.h>
@@ -66,6 +67,16 @@ long do_sysctl(XEN_GUEST_HANDLE_PARAM(xen_sysctl_t) u_sysctl)
         ret = read_console_ring(&op->u.readconsole);
         break;
 
+    case XEN_SYSCTL_conring_op:
+        /* Resizing may drop contents, like clearing does. */
+        ret = xsm_readconsole(XSM_HOOK, op->u.conring_op.cmd ==
+                                        XEN_SYSCTL_CONRING_set_size);
+        if ( ret )
+            break;
+
+        ret = console_ring_op(&op->u.conring_op);
+        break;
+
     case XEN_SYSCTL_tbuf_op:
         ret = tb_control(&op->u.tbuf_op);
         break;
@@ -114,6 +125,71 @@ long do_sysctl(XEN_GUEST_HANDLE_PARAM(xen_sysctl_t) u_sysctl)
     }
     break;
 
+    case XEN_SYSCTL_vcpu_runstate:
+    {
+        struct xen_sysctl_vcpu_runstate *vr = &op->u.vcpu_runstate;
+        struct xen_sysctl_vcpu_runstate_entry e = { 0 };
+        struct vcpu_runstate_info runstate;
+        struct domain *d;
+        struct vcpu *v;
+        unsigned int nr = 0, nr_d, i;
+
+        vr->next_domain = DOMID_FIRST_RESERVED;
+
+        rcu_read_lock(&domlist_read_lock);
+
+        for_each_domain ( d )
+        {
+            if ( d->domain_id < vr->first_domain ||
+                 xsm_getdomaininfo(XSM_HOOK, d) )
+                continue;
+
+            nr_d = 0;
+            for_each_vcpu ( d, v )
+                nr_d++;
+            if ( nr + nr_d > vr->nr_entries )
+            {
+                vr->next_domain = d->domain_id;
+                if ( !nr )
+                {
+                    nr = nr_d;
+                    ret = -ENOBUFS;
+                }
+                break;
+            }
+
+            for_each_vcpu ( d, v )
+            {
+                /* vCPUs may have got added meanwhile. */
+                if ( nr == vr->nr_entries )
+                    break;
+
+                vcpu_runstate_get(v, &runstate);
+                e.domid = d->domain_id;
+                e.vcpu = v->vcpu_id;
+                e.state = runstate.state;
+                e.state_entry_time = runstate.state_entry_time;
+                for ( i = 0; i < ARRAY_SIZE(e.time); i++ )
+                    e.time[i] = runstate.time[i];
+
+                if ( copy_to_guest_offset(vr->entries, nr, &e, 1) )
+                {
+                    ret = -EFAULT;
+                    break;
+                }
+                nr++;
+            }
+            if ( ret )
+                break;
+        }
+
+        rcu_read_unlock(&domlist_read_lock);
+
+        vr->nr_entries = nr;
+        copyback = 1;
+    }
+    break;
+
 #ifdef CONFIG_PERF_COUNTERS
     case XEN_SYSCTL_perfc_op:
         ret = perfc_control(&op->u.perfc_op);
@@ -171,6 +247,32 @@ long do_sysctl(XEN_GUEST_HANDLE_PARAM(xen_sysctl_t) u_sysctl)
         op->u.availheap.avail_bytes <<= PAGE_SHIFT;
         break;
 
+    case XEN_SYSCTL_heap_chunks:
+    {
+        struct xen_sysctl_heap_chunks *hc = &op->u.heap_chunks;
+        unsigned long chunks[MAX_ORDER + 1];
+        unsigned int i, nr = min(hc->nr_orders, MAX_ORDER + 1U);
+
+        ret = -EINVAL;
+        if ( hc->node >= MAX_NUMNODES || !node_online(hc->node) )
+            break;
+
+        hc->nr_orders = avail_node_heap_chunks(hc->node, chunks, nr);
+
+        ret = 0;
+        for ( i = 0; i < nr; i++ )
+        {
+            uint64_t c = chunks[i];
+
+            if ( copy_to_guest_offset(hc->chunks, i, &c, 1) )
+            {
+                ret = -EFAULT;
+                break;
+            }
+        }
+        break;
+    }
+
 #if defined (CONFIG_ACPI) && defined (CONFIG_HAS_CPUFREQ)
     case XEN_SYSCTL_get_pmstat:
         ret = do_get_pm_info(&op->u.get_pmstat);
@@ -457,6 +559,18 @@ long do_sysctl(XEN_GUEST_HANDLE_PARAM(xen_sysctl_t) u_sysctl)
     }
 #endif
 
+    case XEN_SYSCTL_evtchn_stats:
+        ret = evtchn_get_stats(&op->u.evtchn_stats);
+        break;
+
+    case XEN_SYSCTL_latency_stats:
+        ret = latency_stats_op(&op->u.latency_stats);
+        break;
+
+    case XEN_SYSCTL_lock_sample:
+        ret = spinlock_sample_op(&op->u.lock_sample);
+        break;
+
     case XEN_SYSCTL_tmem_op:
         ret = tmem_control(&op->u.tmem_op);
         break;
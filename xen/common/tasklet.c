@@ -14,9 +14,11 @@
  */
 
 #include <xen/init.h>
+#include <xen/perfc.h>
 #include <xen/sched.h>
 #include <xen/softirq.h>
 #include <xen/tasklet.h>
+#include <xen/trace.h>
 #include <xen/cpu.h>
 
 /* Some subsystems call into us before we are initialised. We ignore them. */
@@ -91,7 +93,24 @@ static void do_tasklet_work(unsigned int cpu, struct list_head *list)
 
     spin_unlock_irq(&tasklet_lock);
     sync_local_execstate();
-    t->func(t->data);
+    if ( softirq_timing() )
+    {
+        s_time_t runtime = NOW();
+
+        t->func(t->data);
+        runtime = NOW() - runtime;
+
+        perfc_incr_time_histo(tasklet_time, t->is_softirq, runtime);
+        if ( softirq_slow(runtime) )
+        {
+            uint64_t addr = (unsigned long)t->func;
+
+            TRACE_4D(TRC_HW_IRQ_TASKLET_SLOW, (uint32_t)addr, addr >> 32,
+                     t->is_softirq, runtime);
+        }
+    }
+    else
+        t->func(t->data);
     spin_lock_irq(&tasklet_lock);
 
     t->is_running = 0;
@@ -28,12 +28,34 @@
 static unsigned int timer_slop __read_mostly = 50000; /* 50 us */
 integer_param("timer_slop", timer_slop);
 
+/*
+ * Timers expiring far enough in the future are not put in the heap, but in
+ * a timer wheel: each slot covers 2^TIMER_WHEEL_SHIFT ns (~1ms), and holds
+ * an unsorted list of timers, which makes adding and removing them O(1).
+ * This suits the many (guest singleshot, scheduler, ...) timers that are
+ * reprogrammed or stopped well before they expire.
+ *
+ * Timers are not run from the wheel. A slot is cascaded, i.e., its timers
+ * moved to the heap, slightly (one slot, plus timer_slop) before it begins,
+ * so that they still fire at their exact expiry time. wheel_clk is the
+ * first slot not cascaded yet, and only timers at least TIMER_WHEEL_MIN
+ * and less than TIMER_WHEEL_SIZE slots after it can go in the wheel, hence
+ * every non empty slot is for exactly one value of (expires >> SHIFT).
+ */
+#define TIMER_WHEEL_SHIFT 20
+#define TIMER_WHEEL_SIZE  512
+#define TIMER_WHEEL_MIN   4
+#define TIMER_WHEEL_GRAN  (1L << TIMER_WHEEL_SHIFT)
+
 struct timers {
     spinlock_t     lock;
     struct timer **heap;
     struct timer  *list;
     struct timer  *running;
     struct list_head inactive;
+    s_time_t       wheel_clk;
+    DECLARE_BITMAP(wheel_map, TIMER_WHEEL_SIZE);
+    struct list_head wheel[TIMER_WHEEL_SIZE];
 } __cacheline_aligned;
 
 static DEFINE_PER_CPU(struct timers, timers);
@@ -166,6 +188,92 @@ static int add_to_list(struct timer **pprev, struct timer *t)
 }
 
 
+/****************************************************************************
+ * TIMER WHEEL OPERATIONS.
+ */
+
+/* When slot must be cascaded into the heap. */
+static inline s_time_t wheel_cascade_time(s_time_t slot)
+{
+    return (slot << TIMER_WHEEL_SHIFT) - TIMER_WHEEL_GRAN - timer_slop;
+}
+
+static void remove_from_wheel(struct timers *ts, struct timer *t)
+{
+    unsigned int idx = (t->expires >> TIMER_WHEEL_SHIFT) &
+                       (TIMER_WHEEL_SIZE - 1);
+
+    list_del(&t->inactive);
+    if ( list_empty(&ts->wheel[idx]) )
+        __clear_bit(idx, ts->wheel_map);
+}
+
+/*
+ * Add @t to the wheel, if it's far enough in time. Return -1 if it is not
+ * (and it should go in the heap), else TRUE if its slot now is the first
+ * one needing cascading, before the currently programmed deadline.
+ */
+static int add_to_wheel(struct timers *ts, struct timer *t, unsigned int cpu)
+{
+    s_time_t slot = t->expires >> TIMER_WHEEL_SHIFT, deadline;
+    unsigned int idx = slot & (TIMER_WHEEL_SIZE - 1);
+
+    if ( (slot < ts->wheel_clk + TIMER_WHEEL_MIN) ||
+         (slot >= ts->wheel_clk + TIMER_WHEEL_SIZE) )
+        return -1;
+
+    list_add(&t->inactive, &ts->wheel[idx]);
+    __set_bit(idx, ts->wheel_map);
+
+    deadline = per_cpu(timer_deadline, cpu);
+    return (deadline == 0) || (wheel_cascade_time(slot) < deadline);
+}
+
+/* First slot of the wheel (in time) with timers in it, or -1 if none. */
+static s_time_t wheel_first_slot(const struct timers *ts)
+{
+    unsigned int clk = ts->wheel_clk & (TIMER_WHEEL_SIZE - 1), idx;
+
+    idx = find_next_bit(ts->wheel_map, TIMER_WHEEL_SIZE, clk);
+    if ( idx >= TIMER_WHEEL_SIZE )
+    {
+        idx = find_first_bit(ts->wheel_map, TIMER_WHEEL_SIZE);
+        if ( idx >= TIMER_WHEEL_SIZE )
+            return -1;
+        idx += TIMER_WHEEL_SIZE;
+    }
+
+    return ts->wheel_clk + (idx - clk);
+}
+
+static int add_entry(struct timer *t);
+
+/* Move to the heap the timers of all the slots which are due by now. */
+static void cascade_wheel(struct timers *ts, s_time_t now)
+{
+    s_time_t limit = (now + TIMER_WHEEL_GRAN + timer_slop) >> TIMER_WHEEL_SHIFT;
+    s_time_t slot;
+
+    while ( (slot = wheel_first_slot(ts)) >= 0 && slot <= limit )
+    {
+        struct list_head *head = &ts->wheel[slot & (TIMER_WHEEL_SIZE - 1)];
+        struct timer *t;
+
+        /* Advance the clock first, so that add_entry() uses the heap. */
+        ts->wheel_clk = slot + 1;
+        while ( !list_empty(head) )
+        {
+            t = list_entry(head->next, struct timer, inactive);
+            remove_from_wheel(ts, t);
+            t->status = TIMER_STATUS_invalid;
+            add_entry(t);
+        }
+    }
+
+    ts->wheel_clk = limit + 1;
+}
+
+
 /****************************************************************************
  * TIMER OPERATIONS.
  */
@@ -183,6 +291,11 @@ static int remove_entry(struct timer *t)
     case TIMER_STATUS_in_list:
         rc = remove_from_list(&timers->list, t);
         break;
+    case TIMER_STATUS_in_wheel:
+        /* A slot cascading earlier than needed is harmless. */
+        remove_from_wheel(timers, t);
+        rc = 0;
+        break;
     default:
         rc = 0;
         BUG();
@@ -199,6 +312,12 @@ static int add_entry(struct timer *t)
 
     ASSERT(t->status == TIMER_STATUS_invalid);
 
+    /* Timers that are far enough in the future go in the wheel. */
+    t->status = TIMER_STATUS_in_wheel;
+    rc = add_to_wheel(timers, t, t->cpu);
+    if ( rc >= 0 )
+        return rc;
+
     /* Try to add to heap. t->heap_offset indicates whether we succeed. */
     t->heap_offset = 0;
     t->status = TIMER_STATUS_in_heap;
@@ -276,7 +395,7 @@ static inline void timer_unlock(struct timer *timer)
 static bool_t active_timer(struct timer *timer)
 {
     ASSERT(timer->status >= TIMER_STATUS_inactive);
-    ASSERT(timer->status <= TIMER_STATUS_in_list);
+    ASSERT(timer->status <= TIMER_STATUS_in_wheel);
     return (timer->status >= TIMER_STATUS_in_heap);
 }
 
@@ -431,7 +550,7 @@ static void timer_softirq_action(void)
 {
     struct timer  *t, **heap, *next;
     struct timers *ts;
-    s_time_t       now, deadline;
+    s_time_t       now, deadline, slot;
 
     ts = &this_cpu(timers);
     heap = ts->heap;
@@ -460,6 +579,9 @@ static void timer_softirq_action(void)
 
     now = NOW();
 
+    /* Move the wheel timers which are about to expire to the heap. */
+    cascade_wheel(ts, now);
+
     /* Execute ready heap timers. */
     while ( (GET_HEAP_SIZE(heap) != 0) &&
             ((t = heap[1])->expires < now) )
@@ -485,12 +607,20 @@ static void timer_softirq_action(void)
         add_entry(t);
     }
 
-    /* Find earliest deadline from head of linked list and top of heap. */
+    /*
+     * Find earliest deadline from head of linked list, top of heap and the
+     * first wheel slot to cascade. As the cascading happens timer_slop
+     * before it would strictly be necessary, it gets coalesced with the
+     * expiry of heap timers in that range.
+     */
     deadline = STIME_MAX;
     if ( GET_HEAP_SIZE(heap) != 0 )
         deadline = heap[1]->expires;
     if ( (ts->list != NULL) && (ts->list->expires < deadline) )
         deadline = ts->list->expires;
+    slot = wheel_first_slot(ts);
+    if ( (slot >= 0) && (wheel_cascade_time(slot) < deadline) )
+        deadline = wheel_cascade_time(slot);
     now = NOW();
     this_cpu(timer_deadline) =
         (deadline == STIME_MAX) ? 0 : MAX(deadline, now + timer_slop);
@@ -535,6 +665,9 @@ static void dump_timerq(unsigned char key)
             dump_timer(ts->heap[j], now);
         for ( t = ts->list, j = 0; t != NULL; t = t->list_next, j++ )
             dump_timer(t, now);
+        for ( j = 0; j < TIMER_WHEEL_SIZE; j++ )
+            list_for_each_entry ( t, &ts->wheel[j], inactive )
+                dump_timer(t, now);
         spin_unlock_irqrestore(&ts->lock, flags);
     }
 }
@@ -544,6 +677,7 @@ static void migrate_timers_from_cpu(unsigned int old_cpu)
     unsigned int new_cpu = cpumask_any(&cpu_online_map);
     struct timers *old_ts, *new_ts;
     struct timer *t;
+    s_time_t slot;
     bool_t notify = 0;
 
     ASSERT(!cpu_online(old_cpu) && cpu_online(new_cpu));
@@ -570,6 +704,15 @@ static void migrate_timers_from_cpu(unsigned int old_cpu)
         notify |= add_entry(t);
     }
 
+    while ( (slot = wheel_first_slot(old_ts)) >= 0 )
+    {
+        t = list_entry(old_ts->wheel[slot & (TIMER_WHEEL_SIZE - 1)].next,
+                       struct timer, inactive);
+        remove_entry(t);
+        write_atomic(&t->cpu, new_cpu);
+        notify |= add_entry(t);
+    }
+
     while ( !list_empty(&old_ts->inactive) )
     {
         t = list_entry(old_ts->inactive.next, struct timer, inactive);
@@ -592,6 +735,7 @@ static int cpu_callback(
 {
     unsigned int cpu = (unsigned long)hcpu;
     struct timers *ts = &per_cpu(timers, cpu);
+    unsigned int i;
 
     switch ( action )
     {
@@ -599,6 +743,10 @@ static int cpu_callback(
         INIT_LIST_HEAD(&ts->inactive);
         spin_lock_init(&ts->lock);
         ts->heap = &dummy_heap;
+        ts->wheel_clk = 0;
+        bitmap_zero(ts->wheel_map, TIMER_WHEEL_SIZE);
+        for ( i = 0; i < TIMER_WHEEL_SIZE; i++ )
+            INIT_LIST_HEAD(&ts->wheel[i]);
         break;
     case CPU_UP_CANCELED:
     case CPU_DEAD:
@@ -50,7 +50,7 @@ struct tmem_object_root {
 
 struct tmem_object_node {
     struct tmem_object_root *obj;
-    struct radix_tree_node rtn;
+    struct radix_tree_node rtn; /* Must be last: variable size. */
 };
 
 struct tmem_page_descriptor {
@@ -106,7 +106,6 @@ unsigned long tmem_page_list_pages = 0;
 
 DEFINE_RWLOCK(tmem_rwlock);
 static DEFINE_SPINLOCK(eph_lists_spinlock); /* Protects global AND clients. */
-static DEFINE_SPINLOCK(pers_lists_spinlock);
 
 #define ASSERT_SPINLOCK(_l) ASSERT(spin_is_locked(_l))
 #define ASSERT_WRITELOCK(_l) ASSERT(rw_is_write_locked(_l))
@@ -370,21 +369,21 @@ static void pgp_delist_free(struct tmem_page_descriptor *pgp)
     }
     else
     {
+        struct tmem_pool *pool = pgp->us.obj->pool;
+
+        spin_lock(&pool->pers_lists_lock);
         if ( client->info.flags.u.migrating )
         {
-            spin_lock(&pers_lists_spinlock);
+            spin_lock(&client->inv_lists_lock);
             list_add_tail(&pgp->client_inv_pages,
                           &client->persistent_invalidated_list);
-            if ( pgp != pgp->us.obj->pool->cur_pgp )
+            spin_unlock(&client->inv_lists_lock);
+            if ( pgp != pool->cur_pgp )
                 list_del_init(&pgp->us.pool_pers_pages);
-            spin_unlock(&pers_lists_spinlock);
         }
         else
-        {
-            spin_lock(&pers_lists_spinlock);
             list_del_init(&pgp->us.pool_pers_pages);
-            spin_unlock(&pers_lists_spinlock);
-        }
+        spin_unlock(&pool->pers_lists_lock);
     }
     life = get_cycles() - pgp->timestamp;
     pgp->us.obj->pool->sum_life_cycles += life;
@@ -437,11 +436,12 @@ static struct radix_tree_node *rtn_alloc(void *arg)
     struct tmem_object_root *obj = (struct tmem_object_root *)arg;
 
     ASSERT(obj->pool != NULL);
-    objnode = tmem_malloc(sizeof(struct tmem_object_node),obj->pool);
+    objnode = tmem_malloc(offsetof(struct tmem_object_node, rtn) +
+                          radix_tree_node_size(&obj->tree_root), obj->pool);
     if (objnode == NULL)
         return NULL;
     objnode->obj = obj;
-    memset(&objnode->rtn, 0, sizeof(struct radix_tree_node));
+    memset(&objnode->rtn, 0, radix_tree_node_size(&obj->tree_root));
     if (++obj->pool->objnode_count > obj->pool->objnode_count_max)
         obj->pool->objnode_count_max = obj->pool->objnode_count;
     atomic_inc_and_max(global_rtree_node_count);
@@ -673,6 +673,7 @@ static struct tmem_pool * pool_alloc(void)
     for (i = 0; i < OBJ_HASH_BUCKETS; i++)
         pool->obj_rb_root[i] = RB_ROOT;
     INIT_LIST_HEAD(&pool->persistent_page_list);
+    spin_lock_init(&pool->pers_lists_lock);
     rwlock_init(&pool->pool_rwlock);
     return pool;
 }
@@ -852,6 +853,7 @@ struct client *client_create(domid_t cli_id)
     list_add_tail(&client->client_list, &tmem_global.client_list);
     INIT_LIST_HEAD(&client->ephemeral_page_list);
     INIT_LIST_HEAD(&client->persistent_invalidated_list);
+    spin_lock_init(&client->inv_lists_lock);
     tmem_client_info("ok\n");
     return client;
 
@@ -1245,10 +1247,10 @@ insert_page:
     }
     else
     { /* is_persistent. */
-        spin_lock(&pers_lists_spinlock);
+        spin_lock(&pool->pers_lists_lock);
         list_add_tail(&pgp->us.pool_pers_pages,
             &pool->persistent_page_list);
-        spin_unlock(&pers_lists_spinlock);
+        spin_unlock(&pool->pers_lists_lock);
     }
 
     if ( is_shared(pool) )
@@ -1716,7 +1718,7 @@ static int tmemc_save_get_next_page(int cli_id, uint32_t pool_id,
     if ( bufsize < PAGE_SIZE + sizeof(struct tmem_handle) )
         return -ENOMEM;
 
-    spin_lock(&pers_lists_spinlock);
+    spin_lock(&pool->pers_lists_lock);
     if ( list_empty(&pool->persistent_page_list) )
     {
         ret = -1;
@@ -1752,7 +1754,7 @@ static int tmemc_save_get_next_page(int cli_id, uint32_t pool_id,
     ret = do_tmem_get(pool, oid, pgp->index, 0, buf);
 
 out:
-    spin_unlock(&pers_lists_spinlock);
+    spin_unlock(&pool->pers_lists_lock);
     return ret;
 }
 
@@ -1768,7 +1770,7 @@ static int tmemc_save_get_next_inv(int cli_id, tmem_cli_va_param_t buf,
         return 0;
     if ( bufsize < sizeof(struct tmem_handle) )
         return 0;
-    spin_lock(&pers_lists_spinlock);
+    spin_lock(&client->inv_lists_lock);
     if ( list_empty(&client->persistent_invalidated_list) )
         goto out;
     if ( client->cur_pgp == NULL )
@@ -1795,7 +1797,7 @@ static int tmemc_save_get_next_inv(int cli_id, tmem_cli_va_param_t buf,
     if ( copy_to_guest(guest_handle_cast(buf, void), &h, 1) )
         ret = -EFAULT;
 out:
-    spin_unlock(&pers_lists_spinlock);
+    spin_unlock(&client->inv_lists_lock);
     return ret;
 }
 
@@ -1872,16 +1874,57 @@ int do_tmem_control(struct xen_sysctl_tmem_op *op)
 
 /************ EXPORTed FUNCTIONS **************************************/
 
+/*
+ * Page operations on one of the caller's existing pools, with tmem_rwlock
+ * held for read: the pool's rwlock and the objects' spinlocks serialize
+ * them against each other.
+ */
+static int do_tmem_page_op(struct client *client, struct tmem_op *op)
+{
+    struct tmem_pool *pool;
+    struct xen_tmem_oid *oidp = &op->u.gen.oid;
+    int rc;
+
+    if ( ((uint32_t)op->pool_id >= MAX_POOLS_PER_DOMAIN) ||
+         ((pool = client->pools[op->pool_id]) == NULL) )
+    {
+        tmem_client_err("tmem: operation requested on uncreated pool\n");
+        return -ENODEV;
+    }
+
+    switch ( op->cmd )
+    {
+    case TMEM_PUT_PAGE:
+        if ( tmem_ensure_avail_pages() )
+            rc = do_tmem_put(pool, oidp, op->u.gen.index, op->u.gen.cmfn,
+                             tmem_cli_buf_null);
+        else
+            rc = -ENOMEM;
+        break;
+    case TMEM_GET_PAGE:
+        rc = do_tmem_get(pool, oidp, op->u.gen.index, op->u.gen.cmfn,
+                         tmem_cli_buf_null);
+        break;
+    case TMEM_FLUSH_PAGE:
+        rc = do_tmem_flush_page(pool, oidp, op->u.gen.index);
+        break;
+    case TMEM_FLUSH_OBJECT:
+        rc = do_tmem_flush_object(pool, oidp);
+        break;
+    default:
+        tmem_client_warn("tmem: op %d not implemented\n", op->cmd);
+        rc = -ENOSYS;
+        break;
+    }
+
+    return rc;
+}
+
 long do_tmem_op(tmem_cli_op_t uops)
 {
     struct tmem_op op;
     struct client *client = current->domain->tmem_client;
-    struct tmem_pool *pool = NULL;
-    struct xen_tmem_oid *oidp;
     int rc = 0;
-    bool_t succ_get = 0, succ_put = 0;
-    bool_t non_succ_get = 0, non_succ_put = 0;
-    bool_t flush = 0, flush_obj = 0;
 
     if ( !tmem_initialized )
         return -ENODEV;
@@ -1904,9 +1947,6 @@ long do_tmem_op(tmem_cli_op_t uops)
         return -EFAULT;
     }
 
-    /* Acquire write lock for all commands at first. */
-    write_lock(&tmem_rwlock);
-
     switch ( op.cmd )
     {
     case TMEM_CONTROL:
@@ -1915,88 +1955,46 @@ long do_tmem_op(tmem_cli_op_t uops)
         rc = -EOPNOTSUPP;
         break;
 
-    default:
-    /*
-	 * For other commands, create per-client tmem structure dynamically on
-	 * first use by client.
-	 */
-        if ( client == NULL )
-        {
-            if ( (client = client_create(current->domain->domain_id)) == NULL )
-            {
-                tmem_client_err("tmem: can't create tmem structure for %s\n",
-                               tmem_client_str);
-                rc = -ENOMEM;
-                goto out;
-            }
-        }
-
-        if ( op.cmd == TMEM_NEW_POOL || op.cmd == TMEM_DESTROY_POOL )
+    case TMEM_NEW_POOL:
+    case TMEM_DESTROY_POOL:
+        write_lock(&tmem_rwlock);
+        /*
+         * Create per-client tmem structure dynamically on first use by
+         * client.
+         */
+        if ( client == NULL &&
+             (client = client_create(current->domain->domain_id)) == NULL )
         {
-            if ( op.cmd == TMEM_NEW_POOL )
-                rc = do_tmem_new_pool(TMEM_CLI_ID_NULL, 0, op.u.creat.flags,
-                                op.u.creat.uuid[0], op.u.creat.uuid[1]);
-	        else
-                rc = do_tmem_destroy_pool(op.pool_id);
+            tmem_client_err("tmem: can't create tmem structure for %s\n",
+                            tmem_client_str);
+            rc = -ENOMEM;
         }
+        else if ( op.cmd == TMEM_NEW_POOL )
+            rc = do_tmem_new_pool(TMEM_CLI_ID_NULL, 0, op.u.creat.flags,
+                                  op.u.creat.uuid[0], op.u.creat.uuid[1]);
         else
-        {
-            if ( ((uint32_t)op.pool_id >= MAX_POOLS_PER_DOMAIN) ||
-                 ((pool = client->pools[op.pool_id]) == NULL) )
-            {
-                tmem_client_err("tmem: operation requested on uncreated pool\n");
-                rc = -ENODEV;
-                goto out;
-            }
-            /* Commands that only need read lock. */
-            write_unlock(&tmem_rwlock);
-            read_lock(&tmem_rwlock);
+            rc = do_tmem_destroy_pool(op.pool_id);
+        write_unlock(&tmem_rwlock);
+        break;
 
-            oidp = &op.u.gen.oid;
-            switch ( op.cmd )
-            {
-            case TMEM_NEW_POOL:
-            case TMEM_DESTROY_POOL:
-                BUG(); /* Done earlier. */
-                break;
-            case TMEM_PUT_PAGE:
-                if (tmem_ensure_avail_pages())
-                    rc = do_tmem_put(pool, oidp, op.u.gen.index, op.u.gen.cmfn,
-                                tmem_cli_buf_null);
-                else
-                    rc = -ENOMEM;
-                if (rc == 1) succ_put = 1;
-                else non_succ_put = 1;
-                break;
-            case TMEM_GET_PAGE:
-                rc = do_tmem_get(pool, oidp, op.u.gen.index, op.u.gen.cmfn,
-                                tmem_cli_buf_null);
-                if (rc == 1) succ_get = 1;
-                else non_succ_get = 1;
-                break;
-            case TMEM_FLUSH_PAGE:
-                flush = 1;
-                rc = do_tmem_flush_page(pool, oidp, op.u.gen.index);
-                break;
-            case TMEM_FLUSH_OBJECT:
-                rc = do_tmem_flush_object(pool, oidp);
-                flush_obj = 1;
-                break;
-            default:
-                tmem_client_warn("tmem: op %d not implemented\n", op.cmd);
-                rc = -ENOSYS;
-                break;
-            }
-            read_unlock(&tmem_rwlock);
-            if ( rc < 0 )
-                tmem_stats.errored_tmem_ops++;
-            return rc;
+    default:
+        /*
+         * A client without pools has nothing for page operations to act on.
+         * Those only take the read lock, so that the guests' puts and gets
+         * don't all serialize here.
+         */
+        if ( client == NULL )
+        {
+            tmem_client_err("tmem: operation requested on uncreated pool\n");
+            rc = -ENODEV;
+            break;
         }
+        read_lock(&tmem_rwlock);
+        rc = do_tmem_page_op(client, &op);
+        read_unlock(&tmem_rwlock);
         break;
-
     }
-out:
-    write_unlock(&tmem_rwlock);
+
     if ( rc < 0 )
         tmem_stats.errored_tmem_ops++;
     return rc;
@@ -30,6 +30,7 @@
 #include <xen/percpu.h>
 #include <xen/pfn.h>
 #include <xen/cpu.h>
+#include <xen/keyhandler.h>
 #include <asm/atomic.h>
 #include <public/sysctl.h>
 
@@ -48,12 +49,33 @@ static unsigned int opt_tevt_mask;
 integer_param("tbuf_size", opt_tbuf_size);
 integer_param("tevt_mask", opt_tevt_mask);
 
+/* What to do when a per-cpu trace buffer is full. */
+static enum {
+    TBUF_OVERFLOW_DROP,     /* Drop new records. */
+    TBUF_OVERFLOW_NOTIFY,   /* Drop new records, and kick the consumer. */
+} opt_tbuf_overflow __read_mostly = TBUF_OVERFLOW_DROP;
+
+static void __init parse_tbuf_overflow(char *str)
+{
+    if ( !strcmp(str, "drop") )
+        opt_tbuf_overflow = TBUF_OVERFLOW_DROP;
+    else if ( !strcmp(str, "notify") )
+        opt_tbuf_overflow = TBUF_OVERFLOW_NOTIFY;
+    else
+        printk("Unknown tbuf_overflow parameter '%s'.  Defaulting to drop.\n",
+               str);
+}
+custom_param("tbuf_overflow", parse_tbuf_overflow);
+
 /* Pointers to the meta-data objects for all system trace buffers */
 static struct t_info *t_info;
 static unsigned int t_info_pages;
 
+/*
+ * Each buffer only has a single producer, the cpu owning it, which writes
+ * records with interrupts disabled.  No lock is needed on this path.
+ */
 static DEFINE_PER_CPU_READ_MOSTLY(struct t_buf *, t_bufs);
-static DEFINE_PER_CPU_READ_MOSTLY(spinlock_t, t_lock);
 static u32 data_size __read_mostly;
 
 /* High water mark for trace buffers; */
@@ -64,6 +86,14 @@ static u32 t_buf_highwater;
 static DEFINE_PER_CPU(unsigned long, lost_records);
 static DEFINE_PER_CPU(unsigned long, lost_records_first_tsc);
 
+/* Records lost since boot, by trace class (bit index in TRC_ALL). */
+#define TRC_NR_CLASSES 12
+static DEFINE_PER_CPU(unsigned long[TRC_NR_CLASSES], lost_by_class);
+static const char *const trc_class_names[TRC_NR_CLASSES] = {
+    "gen", "sched", "dom0op", "hvm", "mem", "pv", "shadow", "hw",
+    [11] = "guest",
+};
+
 /* a flag recording whether initialization has been done */
 /* or more properly, if the tbuf subsystem is enabled right now */
 int tb_init_done __read_mostly;
@@ -78,21 +108,6 @@ static u32 tb_event_mask = TRC_ALL;
  * i.e., sizeof(_type) * ans >= _x. */
 #define fit_to_type(_type, _x) (((_x)+sizeof(_type)-1) / sizeof(_type))
 
-static int cpu_callback(
-    struct notifier_block *nfb, unsigned long action, void *hcpu)
-{
-    unsigned int cpu = (unsigned long)hcpu;
-
-    if ( action == CPU_UP_PREPARE )
-        spin_lock_init(&per_cpu(t_lock, cpu));
-
-    return NOTIFY_DONE;
-}
-
-static struct notifier_block cpu_nfb = {
-    .notifier_call = cpu_callback
-};
-
 static uint32_t calc_tinfo_first_offset(void)
 {
     int offset_in_bytes = offsetof(struct t_info, mfn_offset[NR_CPUS]);
@@ -229,8 +244,6 @@ static int alloc_trace_bufs(unsigned int pages)
         struct t_buf *buf;
         struct page_info *pg;
 
-        spin_lock_init(&per_cpu(t_lock, cpu));
-
         offset = t_info->mfn_offset[cpu];
 
         /* Initialize the buffer metadata */
@@ -345,7 +358,6 @@ int trace_will_trace_event(u32 event)
 void __init init_trace_bufs(void)
 {
     cpumask_setall(&tb_cpu_mask);
-    register_cpu_notifier(&cpu_nfb);
 
     if ( opt_tbuf_size )
     {
@@ -365,6 +377,11 @@ void __init init_trace_bufs(void)
     }
 }
 
+static void clear_lost_records(void *unused)
+{
+    this_cpu(lost_records) = 0;
+}
+
 /**
  * tb_control - sysctl operations on trace buffers.
  * @tbc: a pointer to a xen_sysctl_tbuf_op_t to be filled out
@@ -414,20 +431,15 @@ int tb_control(xen_sysctl_tbuf_op_t *tbc)
          * Disable trace buffers. Just stops new records from being written,
          * does not deallocate any memory.
          */
-        int i;
-
         tb_init_done = 0;
         smp_wmb();
-        /* Clear any lost-record info so we don't get phantom lost records next time we
-         * start tracing.  Grab the lock to make sure we're not racing anyone.  After this
-         * hypercall returns, no more records should be placed into the buffers. */
-        for_each_online_cpu(i)
-        {
-            unsigned long flags;
-            spin_lock_irqsave(&per_cpu(t_lock, i), flags);
-            per_cpu(lost_records, i)=0;
-            spin_unlock_irqrestore(&per_cpu(t_lock, i), flags);
-        }
+        /*
+         * Clear any lost-record info so we don't get phantom lost records
+         * next time we start tracing.  Records are written with interrupts
+         * disabled, so once every cpu has run the IPI no more records can
+         * be placed into the buffers.
+         */
+        on_each_cpu(clear_lost_records, NULL, 1);
     }
         break;
     default:
@@ -689,7 +701,7 @@ void __trace_var(u32 event, bool_t cycles, unsigned int extra,
     u32 bytes_to_tail, bytes_to_wrap;
     unsigned int rec_size, total_size;
     unsigned int extra_word;
-    bool_t started_below_highwater;
+    bool_t started_below_highwater, notify = 0;
 
     if( !tb_init_done )
         return;
@@ -723,7 +735,7 @@ void __trace_var(u32 event, bool_t cycles, unsigned int extra,
     /* Read tb_init_done /before/ t_bufs. */
     smp_rmb();
 
-    spin_lock_irqsave(&this_cpu(t_lock), flags);
+    local_irq_save(flags);
 
     buf = this_cpu(t_bufs);
 
@@ -777,8 +789,16 @@ void __trace_var(u32 event, bool_t cycles, unsigned int extra,
     /* Do we have enough space for everything? */
     if ( total_size > bytes_to_tail )
     {
+        unsigned int cls = (event & TRC_ALL) >> TRC_CLS_SHIFT;
+
         if ( ++this_cpu(lost_records) == 1 )
+        {
             this_cpu(lost_records_first_tsc)=(u64)get_cycles();
+            /* The buffer just filled up: make sure the consumer knows. */
+            notify = (opt_tbuf_overflow == TBUF_OVERFLOW_NOTIFY);
+        }
+        if ( cls )
+            this_cpu(lost_by_class)[ffs(cls) - 1]++;
         started_below_highwater = 0;
         goto unlock;
     }
@@ -810,12 +830,13 @@ void __trace_var(u32 event, bool_t cycles, unsigned int extra,
     __insert_record(buf, event, extra, cycles, rec_size, extra_data);
 
 unlock:
-    spin_unlock_irqrestore(&this_cpu(t_lock), flags);
+    local_irq_restore(flags);
 
     /* Notify trace buffer consumer that we've crossed the high water mark. */
     if ( likely(buf!=NULL)
-         && started_below_highwater
-         && (calc_unconsumed_bytes(buf) >= t_buf_highwater) )
+         && ((started_below_highwater
+              && (calc_unconsumed_bytes(buf) >= t_buf_highwater))
+             || notify) )
         tasklet_schedule(&trace_notify_dom0_tasklet);
 }
 
@@ -871,6 +892,41 @@ void __trace_hypercall(uint32_t event, unsigned long op,
     __trace_var(event, 1, sizeof(uint32_t) * (1 + (a - d.args)), &d);
 }
 
+static void dump_tbuf_info(unsigned char key)
+{
+    unsigned int cpu, cls;
+
+    printk("Trace buffers: %s, %u pages per cpu, overflow policy %s\n",
+           tb_init_done ? "enabled" : "disabled", opt_tbuf_size,
+           opt_tbuf_overflow == TBUF_OVERFLOW_NOTIFY ? "notify" : "drop");
+
+    for_each_online_cpu ( cpu )
+    {
+        const struct t_buf *buf = per_cpu(t_bufs, cpu);
+
+        printk("CPU%u: ", cpu);
+        if ( buf )
+            printk("prod %#x cons %#x ", buf->prod, buf->cons);
+        printk("pending lost %lu\n", per_cpu(lost_records, cpu));
+
+        for ( cls = 0; cls < TRC_NR_CLASSES; cls++ )
+        {
+            unsigned long lost = per_cpu(lost_by_class, cpu)[cls];
+
+            if ( lost )
+                printk("  lost %-6s %lu\n",
+                       trc_class_names[cls] ?: "?", lost);
+        }
+    }
+}
+
+static int __init register_tbuf_keyhandler(void)
+{
+    register_keyhandler('b', dump_tbuf_info, "dump trace buffer info", 1);
+    return 0;
+}
+__initcall(register_tbuf_keyhandler);
+
 /*
  * Local variables:
  * mode: C
@@ -49,6 +49,7 @@ static int vm_event_enable(
 {
     int rc;
     unsigned long ring_gfn = d->arch.hvm_domain.params[param];
+    unsigned int nr_pages = vec->ring_pages ?: 1;
 
     /* Only one helper at a time. If the helper crashed,
      * the ring is in an undefined state and so is the guest.
@@ -61,6 +62,9 @@ static int vm_event_enable(
     if ( ring_gfn == 0 )
         return -ENOSYS;
 
+    if ( nr_pages > XEN_VM_EVENT_MAX_RING_PAGES )
+        return -EINVAL;
+
     vm_event_ring_lock_init(ved);
     vm_event_ring_lock(ved);
 
@@ -69,8 +73,14 @@ static int vm_event_enable(
     if ( rc < 0 )
         goto err;
 
-    rc = prepare_ring_for_helper(d, ring_gfn, &ved->ring_pg_struct,
-                                    &ved->ring_page);
+    rc = -ENOMEM;
+    ved->ring_pg_struct = xzalloc_array(struct page_info *, nr_pages);
+    if ( !ved->ring_pg_struct )
+        goto err;
+    ved->ring_nr_pages = nr_pages;
+
+    rc = prepare_rings_for_helper(d, ring_gfn, nr_pages, ved->ring_pg_struct,
+                                  &ved->ring_page);
     if ( rc < 0 )
         goto err;
 
@@ -88,7 +98,7 @@ static int vm_event_enable(
     /* Prepare ring buffer */
     FRONT_RING_INIT(&ved->front_ring,
                     (vm_event_sring_t *)ved->ring_page,
-                    PAGE_SIZE);
+                    nr_pages * PAGE_SIZE);
 
     /* Save the pause flag for this particular ring. */
     ved->pause_flag = pause_flag;
@@ -100,8 +110,12 @@ static int vm_event_enable(
     return 0;
 
  err:
-    destroy_ring_for_helper(&ved->ring_page,
-                            ved->ring_pg_struct);
+    if ( ved->ring_pg_struct )
+        destroy_rings_for_helper(&ved->ring_page, ved->ring_pg_struct,
+                                 ved->ring_nr_pages);
+    xfree(ved->ring_pg_struct);
+    ved->ring_pg_struct = NULL;
+    ved->ring_nr_pages = 0;
     vm_event_ring_unlock(ved);
 
     return rc;
@@ -214,8 +228,11 @@ static int vm_event_disable(struct domain *d, struct vm_event_domain *ved)
             }
         }
 
-        destroy_ring_for_helper(&ved->ring_page,
-                                ved->ring_pg_struct);
+        destroy_rings_for_helper(&ved->ring_page, ved->ring_pg_struct,
+                                 ved->ring_nr_pages);
+        xfree(ved->ring_pg_struct);
+        ved->ring_pg_struct = NULL;
+        ved->ring_nr_pages = 0;
 
         vm_event_cleanup_domain(d);
 
@@ -311,22 +328,18 @@ void vm_event_put_request(struct domain *d,
     notify_via_xen_event_channel(d, ved->xen_port);
 }
 
-int vm_event_get_response(struct domain *d, struct vm_event_domain *ved,
-                          vm_event_response_t *rsp)
+/*
+ * Take one response off the ring, without waking anyone up.  Must be
+ * called with the ring lock held.
+ */
+static int __vm_event_get_response(struct vm_event_domain *ved,
+                                   vm_event_response_t *rsp)
 {
-    vm_event_front_ring_t *front_ring;
-    RING_IDX rsp_cons;
-
-    vm_event_ring_lock(ved);
-
-    front_ring = &ved->front_ring;
-    rsp_cons = front_ring->rsp_cons;
+    vm_event_front_ring_t *front_ring = &ved->front_ring;
+    RING_IDX rsp_cons = front_ring->rsp_cons;
 
     if ( !RING_HAS_UNCONSUMED_RESPONSES(front_ring) )
-    {
-        vm_event_ring_unlock(ved);
         return 0;
-    }
 
     /* Copy response */
     memcpy(rsp, RING_GET_RESPONSE(front_ring, rsp_cons), sizeof(*rsp));
@@ -336,13 +349,26 @@ int vm_event_get_response(struct domain *d, struct vm_event_domain *ved,
     front_ring->rsp_cons = rsp_cons;
     front_ring->sring->rsp_event = rsp_cons + 1;
 
+    return 1;
+}
+
+int vm_event_get_response(struct domain *d, struct vm_event_domain *ved,
+                          vm_event_response_t *rsp)
+{
+    int rc;
+
+    vm_event_ring_lock(ved);
+
+    rc = __vm_event_get_response(ved, rsp);
+
     /* Kick any waiters -- since we've just consumed an event,
      * there may be additional space available in the ring. */
-    vm_event_wake(d, ved);
+    if ( rc )
+        vm_event_wake(d, ved);
 
     vm_event_ring_unlock(ved);
 
-    return 1;
+    return rc;
 }
 
 /*
@@ -352,15 +378,32 @@ int vm_event_get_response(struct domain *d, struct vm_event_domain *ved,
  *
  * Note: responses are handled the same way regardless of which ring they
  * arrive on.
+ *
+ * Waiters for room in the ring are only woken once the whole batch has been
+ * handled: scanning the vCPUs for every response would make draining a large
+ * ring quadratic, and the vCPUs being answered are unpaused here anyway.
  */
 void vm_event_resume(struct domain *d, struct vm_event_domain *ved)
 {
     vm_event_response_t rsp;
+    unsigned int nr_rsp = 0;
 
     /* Pull all responses off the ring. */
-    while ( vm_event_get_response(d, ved, &rsp) )
+    for ( ; ; )
     {
         struct vcpu *v;
+        int got;
+
+        vm_event_ring_lock(ved);
+        got = __vm_event_get_response(ved, &rsp);
+        if ( !got && nr_rsp )
+            vm_event_wake(d, ved);
+        vm_event_ring_unlock(ved);
+
+        if ( !got )
+            break;
+
+        nr_rsp++;
 
         if ( rsp.version != VM_EVENT_INTERFACE_VERSION )
         {
@@ -3,10 +3,13 @@
 #include <xen/cache.h>
 #include <xen/init.h>
 #include <xen/mm.h>
+#include <xen/percpu.h>
 #include <xen/pfn.h>
 #include <xen/spinlock.h>
 #include <xen/types.h>
 #include <xen/vmap.h>
+#include <asm/atomic.h>
+#include <asm/flushtlb.h>
 #include <asm/page.h>
 
 static DEFINE_SPINLOCK(vm_lock);
@@ -19,6 +22,49 @@ static unsigned int __read_mostly vm_end[VMAP_REGION_NR];
 /* lowest known clear bit in the bitmap */
 static unsigned int vm_low[VMAP_REGION_NR];
 
+/*
+ * Where the architecture allows deferring the TLB flush on unmap, freed
+ * areas keep their virtual range until enough of them have accumulated,
+ * and are then made reusable all at once by a single global flush.
+ */
+#define VMAP_LAZY_MAX_PAGES (MB(32) >> PAGE_SHIFT)
+#define VMAP_LAZY_NR        32
+
+struct vm_lazy {
+    const void *va;
+    unsigned int pages;
+};
+
+/* bitmap allocated areas awaiting a flush, protected by vm_lock */
+static struct vm_lazy vm_lazy[VMAP_LAZY_NR];
+static unsigned int vm_lazy_nr;
+static struct vm_lazy vm_purging[VMAP_LAZY_NR];
+static atomic_t vm_lazy_pages;
+static DEFINE_SPINLOCK(vm_purge_lock);
+
+/*
+ * Small mappings in the default region are served from per-CPU blocks,
+ * keeping them off vm_lock and the bitmap scan.  As in the bitmap, each
+ * area is preceded by a guard page, accounted as part of the area.
+ */
+#define VMAP_BLOCK_PAGES     BITS_PER_LONG
+#define VMAP_BLOCK_MAX_PAGES 4
+#define VMAP_BLOCK_NR_MAX    1024
+
+struct vmap_block {
+    spinlock_t lock;
+    unsigned int cpu;       /* CPU allocating from the block, or NR_CPUS */
+    unsigned long used;     /* pages handed out */
+    unsigned long dirty;    /* pages freed, TLB flush pending */
+    unsigned long purge;    /* dirty pages covered by the running purge */
+    uint8_t size[VMAP_BLOCK_PAGES];
+};
+
+static struct vmap_block *__read_mostly vm_blocks;
+static unsigned int __read_mostly vm_nr_blocks;
+static void *__read_mostly vm_blocks_va;
+static DEFINE_PER_CPU(struct vmap_block *, vm_block);
+
 void __init vm_init_type(enum vmap_region type, void *start, void *end)
 {
     unsigned int i, nr;
@@ -139,6 +185,136 @@ static void *vm_alloc(unsigned int nr, unsigned int align,
     return vm_base[t] + start * PAGE_SIZE;
 }
 
+static int __init vm_blocks_init(void)
+{
+    unsigned int i, nr = min(vm_end[VMAP_DEFAULT] / 16 / VMAP_BLOCK_PAGES,
+                             VMAP_BLOCK_NR_MAX);
+
+    if ( !nr )
+        return 0;
+
+    vm_blocks = xzalloc_array(struct vmap_block, nr);
+    if ( !vm_blocks )
+        return -ENOMEM;
+
+    vm_blocks_va = vm_alloc(nr * VMAP_BLOCK_PAGES, 1, VMAP_DEFAULT);
+    if ( !vm_blocks_va )
+    {
+        xfree(vm_blocks);
+        vm_blocks = NULL;
+        return -ENOMEM;
+    }
+
+    for ( i = 0; i < nr; ++i )
+    {
+        spin_lock_init(&vm_blocks[i].lock);
+        vm_blocks[i].cpu = NR_CPUS;
+    }
+
+    smp_wmb();
+    vm_nr_blocks = nr;
+
+    return 0;
+}
+__initcall(vm_blocks_init);
+
+static struct vmap_block *vm_block_of(const void *va)
+{
+    unsigned int idx;
+
+    if ( !vm_nr_blocks || va < vm_blocks_va )
+        return NULL;
+
+    idx = PFN_DOWN(va - vm_blocks_va) / VMAP_BLOCK_PAGES;
+
+    return idx < vm_nr_blocks ? &vm_blocks[idx] : NULL;
+}
+
+static unsigned int vm_block_slot(const void *va)
+{
+    return PFN_DOWN(va - vm_blocks_va) % VMAP_BLOCK_PAGES - 1;
+}
+
+static unsigned int vm_block_size(const struct vmap_block *b, const void *va)
+{
+    unsigned int i = vm_block_slot(va);
+
+    return i < VMAP_BLOCK_PAGES && b->size[i] ? b->size[i] - 1 : 0;
+}
+
+/* Caller holds b->lock. */
+static void *vm_block_take(struct vmap_block *b, unsigned int nr)
+{
+    unsigned long mask = (2UL << nr) - 1, busy = b->used | b->dirty;
+    unsigned int i;
+
+    for ( i = 0; i + nr < VMAP_BLOCK_PAGES; ++i )
+        if ( !(busy & (mask << i)) )
+        {
+            b->used |= mask << i;
+            b->size[i] = nr + 1;
+            return vm_blocks_va +
+                   ((b - vm_blocks) * VMAP_BLOCK_PAGES + i + 1) * PAGE_SIZE;
+        }
+
+    return NULL;
+}
+
+static void *vm_block_alloc(unsigned int nr)
+{
+    unsigned int cpu = smp_processor_id(), i;
+    struct vmap_block *b = this_cpu(vm_block);
+    void *va = NULL;
+
+    if ( b )
+    {
+        spin_lock(&b->lock);
+        if ( b->cpu == cpu && !(va = vm_block_take(b, nr)) )
+            b->cpu = NR_CPUS;
+        spin_unlock(&b->lock);
+        if ( va )
+            return va;
+    }
+
+    /* Adopt a block no online CPU is allocating from. */
+    for ( i = 0; i < vm_nr_blocks; ++i )
+    {
+        b = &vm_blocks[i];
+        if ( b->cpu < nr_cpu_ids && cpu_online(b->cpu) )
+            continue;
+
+        spin_lock(&b->lock);
+        if ( (b->cpu >= nr_cpu_ids || !cpu_online(b->cpu)) &&
+             (va = vm_block_take(b, nr)) != NULL )
+            b->cpu = cpu;
+        spin_unlock(&b->lock);
+
+        if ( va )
+        {
+            this_cpu(vm_block) = b;
+            break;
+        }
+    }
+
+    return va;
+}
+
+static void vm_block_free(struct vmap_block *b, const void *va, bool lazy)
+{
+    unsigned int i = vm_block_slot(va);
+    unsigned long mask;
+
+    spin_lock(&b->lock);
+    ASSERT(b->size[i]);
+    mask = ((1UL << b->size[i]) - 1) << i;
+    ASSERT((b->used & mask) == mask);
+    b->used &= ~mask;
+    if ( lazy )
+        b->dirty |= mask;
+    b->size[i] = 0;
+    spin_unlock(&b->lock);
+}
+
 static unsigned int vm_index(const void *va, enum vmap_region type)
 {
     unsigned long addr = (unsigned long)va & ~(PAGE_SIZE - 1);
@@ -199,11 +375,114 @@ static void vm_free(const void *va)
     spin_unlock(&vm_lock);
 }
 
+/*
+ * Tear down the mappings of an area, returning whether the TLB flush was
+ * left for vm_purge() to do.
+ */
+static bool vm_unmap(unsigned long addr, unsigned int pages)
+{
+#ifndef _PAGE_NONE
+    destroy_xen_mappings(addr, addr + PAGE_SIZE * pages);
+#else /* Avoid tearing down intermediate page tables. */
+# ifdef MAP_NO_FLUSH
+    /*
+     * Stale translations may outlive the area's pages (see vfree()), which
+     * is fine as long as all RAM is mapped in the directmap anyway.
+     */
+    if ( local_irq_is_enabled() )
+    {
+        map_pages_to_xen(addr, 0, pages, _PAGE_NONE | MAP_NO_FLUSH);
+        return true;
+    }
+# endif
+    map_pages_to_xen(addr, 0, pages, _PAGE_NONE);
+#endif
+
+    return false;
+}
+
+/*
+ * Make the areas freed lazily so far available again, at the cost of a
+ * single TLB flush.  Returns whether anything was released.
+ */
+static bool vm_purge(void)
+{
+    unsigned int i, nr, pages = 0;
+
+    if ( !atomic_read(&vm_lazy_pages) || !local_irq_is_enabled() )
+        return false;
+
+    spin_lock(&vm_purge_lock);
+
+    spin_lock(&vm_lock);
+    nr = vm_lazy_nr;
+    memcpy(vm_purging, vm_lazy, nr * sizeof(*vm_purging));
+    vm_lazy_nr = 0;
+    spin_unlock(&vm_lock);
+
+    for ( i = 0; i < vm_nr_blocks; ++i )
+    {
+        struct vmap_block *b = &vm_blocks[i];
+
+        if ( !b->dirty )
+            continue;
+        spin_lock(&b->lock);
+        b->purge = b->dirty;
+        spin_unlock(&b->lock);
+    }
+
+#ifdef MAP_NO_FLUSH
+    flush_all(FLUSH_TLB_GLOBAL);
+#endif
+
+    for ( i = 0; i < vm_nr_blocks; ++i )
+    {
+        struct vmap_block *b = &vm_blocks[i];
+
+        if ( !b->purge )
+            continue;
+        spin_lock(&b->lock);
+        b->dirty &= ~b->purge;
+        pages += hweight_long(b->purge);
+        b->purge = 0;
+        spin_unlock(&b->lock);
+    }
+
+    for ( i = 0; i < nr; ++i )
+    {
+        vm_free(vm_purging[i].va);
+        pages += vm_purging[i].pages;
+    }
+
+    atomic_sub(pages, &vm_lazy_pages);
+
+    spin_unlock(&vm_purge_lock);
+
+    return pages;
+}
+
+static void *vm_alloc_area(unsigned int nr, unsigned int align,
+                           enum vmap_region t)
+{
+    void *va;
+
+    do {
+        va = NULL;
+        if ( t == VMAP_DEFAULT && nr <= VMAP_BLOCK_MAX_PAGES && align <= 1 &&
+             vm_nr_blocks )
+            va = vm_block_alloc(nr);
+        if ( !va )
+            va = vm_alloc(nr, align, t);
+    } while ( !va && vm_purge() );
+
+    return va;
+}
+
 void *__vmap(const mfn_t *mfn, unsigned int granularity,
              unsigned int nr, unsigned int align, unsigned int flags,
              enum vmap_region type)
 {
-    void *va = vm_alloc(nr * granularity, align, type);
+    void *va = vm_alloc_area(nr * granularity, align, type);
     unsigned long cur = (unsigned long)va;
 
     for ( ; va && nr--; ++mfn, cur += PAGE_SIZE * granularity )
@@ -223,20 +502,54 @@ void *vmap(const mfn_t *mfn, unsigned int nr)
     return __vmap(mfn, 1, nr, 1, PAGE_HYPERVISOR, VMAP_DEFAULT);
 }
 
-void vunmap(const void *va)
+static unsigned int vmap_size(const void *va)
 {
-    unsigned long addr = (unsigned long)va;
-    unsigned int pages = vm_size(va, VMAP_DEFAULT);
+    const struct vmap_block *b = vm_block_of(va);
+    unsigned int pages;
 
+    if ( b )
+        return vm_block_size(b, va);
+
+    pages = vm_size(va, VMAP_DEFAULT);
     if ( !pages )
         pages = vm_size(va, VMAP_XEN);
 
-#ifndef _PAGE_NONE
-    destroy_xen_mappings(addr, addr + PAGE_SIZE * pages);
-#else /* Avoid tearing down intermediate page tables. */
-    map_pages_to_xen(addr, 0, pages, _PAGE_NONE);
-#endif
-    vm_free(va);
+    return pages;
+}
+
+void vunmap(const void *va)
+{
+    unsigned long addr = (unsigned long)va;
+    struct vmap_block *b = vm_block_of(va);
+    unsigned int pages = vmap_size(va);
+    bool lazy = pages && vm_unmap(addr, pages);
+
+    if ( lazy )
+        atomic_add(pages, &vm_lazy_pages);
+
+    if ( b )
+        vm_block_free(b, va, lazy);
+    else if ( lazy )
+    {
+        for ( ; ; )
+        {
+            spin_lock(&vm_lock);
+            if ( vm_lazy_nr < VMAP_LAZY_NR )
+            {
+                vm_lazy[vm_lazy_nr].va = va;
+                vm_lazy[vm_lazy_nr++].pages = pages;
+                spin_unlock(&vm_lock);
+                break;
+            }
+            spin_unlock(&vm_lock);
+            vm_purge();
+        }
+    }
+    else
+        vm_free(va);
+
+    if ( lazy && atomic_read(&vm_lazy_pages) > VMAP_LAZY_MAX_PAGES )
+        vm_purge();
 }
 
 static void *vmalloc_type(size_t size, enum vmap_region type)
@@ -304,17 +617,11 @@ void vfree(void *va)
     unsigned int i, pages;
     struct page_info *pg;
     PAGE_LIST_HEAD(pg_list);
-    enum vmap_region type = VMAP_DEFAULT;
 
     if ( !va )
         return;
 
-    pages = vm_size(va, type);
-    if ( !pages )
-    {
-        type = VMAP_XEN;
-        pages = vm_size(va, type);
-    }
+    pages = vmap_size(va);
     ASSERT(pages);
 
     for ( i = 0; i < pages; i++ )
@@ -23,8 +23,12 @@
  * Adapted for Xen by Dan Magenheimer (dan.magenheimer@oracle.com)
  */
 
+#include <xen/cpu.h>
+#include <xen/init.h>
 #include <xen/irq.h>
+#include <xen/keyhandler.h>
 #include <xen/mm.h>
+#include <xen/percpu.h>
 #include <xen/pfn.h>
 #include <asm/time.h>
 
@@ -452,17 +456,14 @@ void *xmem_pool_alloc(unsigned long size, struct xmem_pool *pool)
     return NULL;
 }
 
-void xmem_pool_free(void *ptr, struct xmem_pool *pool)
+/* Return a used block to the pool.  The pool lock must be held. */
+static void pool_free_block(void *ptr, struct xmem_pool *pool)
 {
     struct bhdr *b, *tmp_b;
     int fl = 0, sl = 0;
 
-    if ( unlikely(ptr == NULL) )
-        return;
-
     b = (struct bhdr *)((char *) ptr - BHDR_OVERHEAD);
 
-    spin_lock(&pool->lock);
     b->size |= FREE_BLOCK;
     pool->used_size -= (b->size & BLOCK_SIZE_MASK) + BHDR_OVERHEAD;
     b->ptr.free_ptr = (struct free_ptr) { NULL, NULL};
@@ -491,14 +492,22 @@ void xmem_pool_free(void *ptr, struct xmem_pool *pool)
         pool->put_mem(b);
         pool->num_regions--;
         pool->used_size -= BHDR_OVERHEAD; /* sentinel block header */
-        goto out;
+        return;
     }
 
     INSERT_BLOCK(b, pool, fl, sl);
 
     tmp_b->size |= PREV_FREE;
     tmp_b->prev_hdr = b;
- out:
+}
+
+void xmem_pool_free(void *ptr, struct xmem_pool *pool)
+{
+    if ( unlikely(ptr == NULL) )
+        return;
+
+    spin_lock(&pool->lock);
+    pool_free_block(ptr, pool);
     spin_unlock(&pool->lock);
 }
 
@@ -549,6 +558,178 @@ static void *xmalloc_whole_pages(unsigned long size, unsigned long align)
     return res;
 }
 
+/*
+ * Per-CPU magazines for small xmalloc() blocks.
+ *
+ * Freed blocks of the common small sizes are kept on a per-CPU stack per
+ * size class and handed out again without taking the pool lock.  A full
+ * magazine returns its oldest half to the pool under a single acquisition
+ * of the lock.  Cached blocks keep their TLSF header and are accounted as
+ * used by the pool.
+ */
+static const unsigned short xmalloc_mag_sizes[] = {
+    32, 48, 64, 96, 128, 192, 256, 384, 512
+};
+#define XMALLOC_MAG_CLASSES ARRAY_SIZE(xmalloc_mag_sizes)
+#define XMALLOC_MAG_DEPTH   16
+#define XMALLOC_MAG_BATCH   (XMALLOC_MAG_DEPTH / 2)
+
+struct xmalloc_magazine {
+    unsigned int nr;
+    void *obj[XMALLOC_MAG_DEPTH];
+    /* Statistics. */
+    unsigned long hits, misses, flushes;
+};
+
+static DEFINE_PER_CPU(struct xmalloc_magazine[XMALLOC_MAG_CLASSES],
+                      xmalloc_mags);
+
+static bool_t __read_mostly opt_xmalloc_magazines = 1;
+boolean_param("xmalloc_magazines", opt_xmalloc_magazines);
+
+/* Smallest class able to satisfy an allocation of @size bytes. */
+static unsigned int mag_alloc_class(unsigned long size)
+{
+    unsigned int c;
+
+    for ( c = 0; c < XMALLOC_MAG_CLASSES; c++ )
+        if ( size <= xmalloc_mag_sizes[c] )
+            break;
+
+    return c;
+}
+
+/* Largest class a free block of @size bytes can be used for. */
+static unsigned int mag_free_class(unsigned long size)
+{
+    unsigned int c;
+
+    if ( size < xmalloc_mag_sizes[0] ||
+         size >= xmalloc_mag_sizes[XMALLOC_MAG_CLASSES - 1] * 3 / 2 )
+        return XMALLOC_MAG_CLASSES;
+
+    for ( c = XMALLOC_MAG_CLASSES - 1; xmalloc_mag_sizes[c] > size; c-- )
+        continue;
+
+    return c;
+}
+
+static void mag_flush(struct xmalloc_magazine *mag, unsigned int nr)
+{
+    unsigned int i;
+
+    spin_lock(&xenpool->lock);
+    for ( i = 0; i < nr; i++ )
+        pool_free_block(mag->obj[i], xenpool);
+    spin_unlock(&xenpool->lock);
+
+    mag->nr -= nr;
+    memmove(mag->obj, mag->obj + nr, mag->nr * sizeof(mag->obj[0]));
+}
+
+static void *xmalloc_small(unsigned long size)
+{
+    struct xmalloc_magazine *mag;
+    unsigned int c = mag_alloc_class(size);
+
+    if ( !opt_xmalloc_magazines || c >= XMALLOC_MAG_CLASSES )
+        return xmem_pool_alloc(size, xenpool);
+
+    mag = &this_cpu(xmalloc_mags)[c];
+    if ( mag->nr )
+    {
+        mag->hits++;
+        return mag->obj[--mag->nr];
+    }
+
+    /* Allocate the full class size so the block can be recycled. */
+    mag->misses++;
+    return xmem_pool_alloc(xmalloc_mag_sizes[c], xenpool);
+}
+
+static void xfree_small(void *p)
+{
+    struct bhdr *b = (struct bhdr *)((char *)p - BHDR_OVERHEAD);
+    struct xmalloc_magazine *mag;
+    unsigned int c = mag_free_class(b->size & BLOCK_SIZE_MASK);
+
+    if ( !opt_xmalloc_magazines || c >= XMALLOC_MAG_CLASSES )
+    {
+        xmem_pool_free(p, xenpool);
+        return;
+    }
+
+    mag = &this_cpu(xmalloc_mags)[c];
+    if ( mag->nr == XMALLOC_MAG_DEPTH )
+    {
+        mag->flushes++;
+        mag_flush(mag, XMALLOC_MAG_BATCH);
+    }
+    mag->obj[mag->nr++] = p;
+}
+
+static void dump_xmalloc_mags(unsigned char key)
+{
+    unsigned int c, cpu;
+
+    printk("xmalloc magazines (%sabled):\n",
+           opt_xmalloc_magazines ? "en" : "dis");
+    for ( c = 0; c < XMALLOC_MAG_CLASSES; c++ )
+    {
+        unsigned long cached = 0, hits = 0, misses = 0, flushes = 0;
+
+        for_each_online_cpu ( cpu )
+        {
+            const struct xmalloc_magazine *mag =
+                &per_cpu(xmalloc_mags, cpu)[c];
+
+            cached += mag->nr;
+            hits += mag->hits;
+            misses += mag->misses;
+            flushes += mag->flushes;
+        }
+
+        printk("  %4u bytes: cached %lu hits %lu misses %lu (%lu%% hit) "
+               "flushes %lu\n", xmalloc_mag_sizes[c], cached, hits, misses,
+               (hits + misses) ? hits * 100 / (hits + misses) : 0, flushes);
+    }
+}
+
+static int cpu_callback(
+    struct notifier_block *nfb, unsigned long action, void *hcpu)
+{
+    unsigned int c, cpu = (unsigned long)hcpu;
+
+    switch ( action )
+    {
+    case CPU_DEAD:
+        for ( c = 0; c < XMALLOC_MAG_CLASSES; c++ )
+        {
+            struct xmalloc_magazine *mag = &per_cpu(xmalloc_mags, cpu)[c];
+
+            if ( mag->nr )
+                mag_flush(mag, mag->nr);
+        }
+        break;
+    default:
+        break;
+    }
+
+    return NOTIFY_DONE;
+}
+
+static struct notifier_block cpu_nfb = {
+    .notifier_call = cpu_callback
+};
+
+static int __init xmalloc_mags_init(void)
+{
+    register_cpu_notifier(&cpu_nfb);
+    register_keyhandler('X', dump_xmalloc_mags, "dump xmalloc magazines", 1);
+    return 0;
+}
+__initcall(xmalloc_mags_init);
+
 static void tlsf_init(void)
 {
     INIT_LIST_HEAD(&pool_list_head);
@@ -587,7 +768,7 @@ void *_xmalloc(unsigned long size, unsigned long align)
         tlsf_init();
 
     if ( size < PAGE_SIZE )
-        p = xmem_pool_alloc(size, xenpool);
+        p = xmalloc_small(size);
     if ( p == NULL )
         return xmalloc_whole_pages(size - align + MEM_ALIGN, align);
 
@@ -648,5 +829,5 @@ void xfree(void *p)
         ASSERT(!(b->size & 1));
     }
 
-    xmem_pool_free(p, xenpool);
+    xfree_small(p);
 }
@@ -254,7 +254,7 @@ static void conring_puts(const char *str)
 long read_console_ring(struct xen_sysctl_readconsole *op)
 {
     XEN_GUEST_HANDLE_PARAM(char) str;
-    uint32_t idx, len, max, sofar, c, p;
+    uint32_t idx, len, max, sofar, c, p, lost = 0;
 
     str   = guest_handle_cast(op->buffer, char),
     max   = op->count;
@@ -266,6 +266,8 @@ long read_console_ring(struct xen_sysctl_readconsole *op)
          (c <= p ? c < op->index && op->index <= p
                  : c < op->index || op->index <= p) )
         c = op->index;
+    else if ( op->incremental && (int32_t)(c - op->index) > 0 )
+        lost = c - op->index;
 
     while ( (c != p) && (sofar < max) )
     {
@@ -290,10 +292,100 @@ long read_console_ring(struct xen_sysctl_readconsole *op)
 
     op->count = sofar;
     op->index = c;
+    op->lost = lost;
 
     return 0;
 }
 
+/* Rings larger than this are unlikely to ever be read in time anyway. */
+#define CONRING_MAX_SIZE (64u << 20)
+
+/*
+ * Readers other than the writers under console_lock are sysctls, which
+ * are serialised with this by sysctl_lock, so the old ring can be freed
+ * right away.
+ */
+static int conring_resize(uint32_t size)
+{
+    char *ring, *old;
+    unsigned int order;
+    uint32_t i, len, si, di, old_size;
+    unsigned long flags;
+
+    if ( !size || size > CONRING_MAX_SIZE )
+        return -EINVAL;
+
+    order = get_order_from_bytes(size);
+    ring = alloc_xenheap_pages(order, MEMF_bits(crashinfo_maxaddr_bits));
+    if ( !ring )
+        return -ENOMEM;
+    size = PAGE_SIZE << order;
+
+    spin_lock_irqsave(&console_lock, flags);
+
+    old = conring;
+    old_size = conring_size;
+
+    if ( (uint32_t)(conringp - conringc) > size )
+        conringc = conringp - size;
+
+    for ( i = conringc; i != conringp; i += len )
+    {
+        si = i & (old_size - 1);
+        di = i & (size - 1);
+        len = min(conringp - i, min(old_size - si, size - di));
+        memcpy(ring + di, old + si, len);
+    }
+
+    /* Never let users of console_force_unlock() index past the ring. */
+    if ( size > old_size )
+    {
+        conring = ring;
+        smp_wmb();
+        conring_size = size;
+    }
+    else
+    {
+        conring_size = size;
+        smp_wmb();
+        conring = ring;
+    }
+
+    spin_unlock_irqrestore(&console_lock, flags);
+
+    if ( old != _conring )
+        free_xenheap_pages(old, get_order_from_bytes(old_size));
+
+    printk(XENLOG_INFO "Console ring resized to %u KiB\n", size >> 10);
+
+    return 0;
+}
+
+long console_ring_op(struct xen_sysctl_conring_op *op)
+{
+    int rc = 0;
+
+    switch ( op->cmd )
+    {
+    case XEN_SYSCTL_CONRING_set_size:
+        rc = conring_resize(op->size);
+        if ( rc )
+            break;
+        /* fall through */
+    case XEN_SYSCTL_CONRING_get_info:
+        op->size = conring_size;
+        op->producer = read_atomic(&conringp);
+        op->consumer = read_atomic(&conringc);
+        break;
+
+    default:
+        rc = -EOPNOTSUPP;
+        break;
+    }
+
+    return rc;
+}
+
 
 /*
  * *******************************************************
@@ -353,7 +445,11 @@ static void dump_console_ring_key(unsigned char key)
         return;
     }
 
+    /* The ring may have been resized meanwhile. */
+    spin_lock_irq(&console_lock);
     c = conringc;
+    if ( conringp - c > (PAGE_SIZE << order) - 1 )
+        c = conringp - ((PAGE_SIZE << order) - 1);
     sofar = 0;
     while ( (c != conringp) )
     {
@@ -365,6 +461,7 @@ static void dump_console_ring_key(unsigned char key)
         sofar += len;
         c += len;
     }
+    spin_unlock_irq(&console_lock);
     buf[sofar] = '\0';
 
     sercon_puts(buf);
@@ -54,6 +54,7 @@ static struct ns16550 {
     /* UART with IRQ line: interrupt-driven I/O. */
     struct irqaction irqaction;
     u8 lsr_mask;
+    u8 ier;        /* Shadow of UART_IER, so TX (un)masking needn't read it. */
 #ifdef CONFIG_ARM
     struct vuart_info vuart;
 #endif
@@ -518,12 +519,13 @@ static void ns16550_poll(void *data)
 static int ns16550_tx_ready(struct serial_port *port)
 {
     struct ns16550 *uart = port->uart;
+    u8 lsr = ns_read_reg(uart, UART_LSR);
 
-    if ( ns16550_ioport_invalid(uart) )
+    /* A vanished port reads all ones: only then is IER worth a look. */
+    if ( lsr == 0xff && ns16550_ioport_invalid(uart) )
         return -EIO;
 
-    return ( (ns_read_reg(uart, UART_LSR) &
-              uart->lsr_mask ) == uart->lsr_mask ) ? uart->fifo_size : 0;
+    return ( (lsr & uart->lsr_mask) == uart->lsr_mask ) ? uart->fifo_size : 0;
 }
 
 static void ns16550_putc(struct serial_port *port, char c)
@@ -576,6 +578,7 @@ static void ns16550_setup_preirq(struct ns16550 *uart)
     lcr = (uart->data_bits - 5) | ((uart->stop_bits - 1) << 2) | uart->parity;
 
     /* No interrupts. */
+    uart->ier = 0;
     ns_write_reg(uart, UART_IER, 0);
 
     if ( uart->dw_usr_bsy &&
@@ -656,7 +659,8 @@ static void ns16550_setup_postirq(struct ns16550 *uart)
                      UART_MCR, UART_MCR_OUT2 | UART_MCR_DTR | UART_MCR_RTS);
 
         /* Enable receive interrupts. */
-        ns_write_reg(uart, UART_IER, UART_IER_ERDAI);
+        uart->ier = UART_IER_ERDAI;
+        ns_write_reg(uart, UART_IER, uart->ier);
     }
 
     if ( uart->irq >= 0 )
@@ -815,21 +819,25 @@ static int __init ns16550_irq(struct serial_port *port)
 static void ns16550_start_tx(struct serial_port *port)
 {
     struct ns16550 *uart = port->uart;
-    u8 ier = ns_read_reg(uart, UART_IER);
 
     /* Unmask transmit holding register empty interrupt if currently masked. */
-    if ( !(ier & UART_IER_ETHREI) )
-        ns_write_reg(uart, UART_IER, ier | UART_IER_ETHREI);
+    if ( !(uart->ier & UART_IER_ETHREI) )
+    {
+        uart->ier |= UART_IER_ETHREI;
+        ns_write_reg(uart, UART_IER, uart->ier);
+    }
 }
 
 static void ns16550_stop_tx(struct serial_port *port)
 {
     struct ns16550 *uart = port->uart;
-    u8 ier = ns_read_reg(uart, UART_IER);
 
     /* Mask off transmit holding register empty interrupt if currently unmasked. */
-    if ( ier & UART_IER_ETHREI )
-        ns_write_reg(uart, UART_IER, ier & ~UART_IER_ETHREI);
+    if ( uart->ier & UART_IER_ETHREI )
+    {
+        uart->ier &= ~UART_IER_ETHREI;
+        ns_write_reg(uart, UART_IER, uart->ier);
+    }
 }
 
 #ifdef CONFIG_ARM
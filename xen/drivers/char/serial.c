@@ -94,12 +94,12 @@ void serial_tx_interrupt(struct serial_port *port, struct cpu_user_regs *regs)
         spin_unlock(&port->tx_lock);
         goto out;
     }
-    else
-    {
-        if ( port->driver->tx_ready(port) )
-            serial_start_tx(port);
-    }
-    for ( i = 0, n = port->driver->tx_ready(port); i < n; i++ )
+
+    /* Each tx_ready() costs a UART register read, so ask only once. */
+    n = port->driver->tx_ready(port);
+    if ( n )
+        serial_start_tx(port);
+    for ( i = 0; i < n; i++ )
     {
         if ( port->txbufc == port->txbufp )
             break;
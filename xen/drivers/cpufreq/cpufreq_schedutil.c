@@ -0,0 +1,217 @@
+/*
+ *  xen/drivers/cpufreq/cpufreq_schedutil.c
+ *
+ *  cpufreq governor setting the frequency from the utilization seen by the
+ *  scheduler, along the lines of Linux' schedutil.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <xen/init.h>
+#include <xen/lib.h>
+#include <xen/percpu.h>
+#include <xen/sched.h>
+#include <xen/timer.h>
+#include <acpi/cpufreq/cpufreq.h>
+
+/*
+ * Each CPU's utilization is a running average of its busy (i.e. not running
+ * the idle vCPU) time, updated whenever the scheduler switches between idle
+ * and busy, and periodically while busy.  With a time constant of
+ * UTIL_TAU, the average follows a burst within a few milliseconds, where
+ * sampling idle time on a timer takes several sampling periods.
+ *
+ * Frequency increases are applied straight away; decreases only once the
+ * frequency was left alone for down_rate_limit, and never right on a
+ * wakeup, where the average still reflects the idle period rather than the
+ * burst which is about to run.
+ */
+#define UTIL_SCALE              1024
+#define UTIL_TAU                MILLISECS(4)
+#define DEF_DOWN_RATE_LIMIT     MILLISECS(10)
+#define MIN_SAMPLING_RATE       MILLISECS(1)
+
+struct su_cpu {
+    bool_t       enable;
+    bool_t       busy;          /* Running a guest since last_update? */
+    unsigned int util;          /* Out of UTIL_SCALE */
+    unsigned int policy_cpu;    /* Whose timer evaluates the policy */
+    s_time_t     last_update;
+};
+
+struct su_policy {
+    bool_t       sampling;      /* Timer armed? */
+    bool_t       kicked;        /* ... for a CPU coming out of idle? */
+    s_time_t     sampling_rate;
+    s_time_t     last_change;
+};
+
+static DEFINE_PER_CPU(struct su_cpu, su_cpu);
+static DEFINE_PER_CPU(struct su_policy, su_policy);
+static DEFINE_PER_CPU(struct timer, su_timer);
+
+static s_time_t __read_mostly down_rate_limit = DEF_DOWN_RATE_LIMIT;
+
+/* The utilization of @su as of @now, without updating it. */
+static unsigned int su_util(const struct su_cpu *su, s_time_t now)
+{
+    s_time_t delta = now - su->last_update;
+    int target = su->busy ? UTIL_SCALE : 0;
+
+    if (delta <= 0)
+        return su->util;
+
+    /* First order low pass: move by delta / (delta + tau) towards target. */
+    return su->util + (target - (int)su->util) * delta / (delta + UTIL_TAU);
+}
+
+static unsigned int su_next_freq(const struct cpufreq_policy *policy,
+                                 s_time_t now)
+{
+    unsigned int j, util = 0;
+    uint64_t freq;
+
+    for_each_cpu(j, policy->cpus)
+        util = max(util, su_util(&per_cpu(su_cpu, j), now));
+
+    /* Leave 25% headroom, like Linux' schedutil. */
+    freq = (uint64_t)policy->cpuinfo.max_freq * util * 5 / 4 / UTIL_SCALE;
+
+    return max_t(uint64_t, policy->min, min_t(uint64_t, freq, policy->max));
+}
+
+static void su_timer_fn(void *data)
+{
+    struct cpufreq_policy *policy = data;
+    struct su_policy *sp = &per_cpu(su_policy, policy->cpu);
+    s_time_t now = NOW();
+    unsigned int j, freq;
+    bool_t busy = 0, kicked = sp->kicked;
+
+    sp->kicked = 0;
+
+    if (unlikely(policy->resume)) {
+        __cpufreq_driver_target(policy, policy->max, CPUFREQ_RELATION_H);
+        sp->last_change = now;
+    } else {
+        freq = su_next_freq(policy, now);
+        if (freq > policy->cur ||
+            (freq < policy->cur && !kicked &&
+             now - sp->last_change >= down_rate_limit)) {
+            __cpufreq_driver_target(policy, freq, CPUFREQ_RELATION_L);
+            sp->last_change = now;
+        }
+    }
+
+    /* Keep sampling while there is load, to follow it going up or down. */
+    for_each_cpu(j, policy->cpus)
+        busy |= per_cpu(su_cpu, j).busy;
+    sp->sampling = busy;
+    if (busy)
+        set_timer(&per_cpu(su_timer, policy->cpu), now + sp->sampling_rate);
+}
+
+void cpufreq_sched_update(unsigned int cpu, s_time_t now, bool_t busy)
+{
+    struct su_cpu *su = &per_cpu(su_cpu, cpu);
+    struct su_policy *sp;
+
+    if (!su->enable)
+        return;
+
+    su->util = su_util(su, now);
+    su->last_update = now;
+    su->busy = busy;
+
+    /*
+     * Coming out of idle, get the policy evaluated right now: the utilization
+     * may already call for a higher frequency, and sampling needs restarting.
+     */
+    sp = &per_cpu(su_policy, su->policy_cpu);
+    if (busy && !sp->sampling) {
+        sp->sampling = 1;
+        sp->kicked = 1;
+        set_timer(&per_cpu(su_timer, su->policy_cpu), now);
+    }
+}
+
+static int cpufreq_governor_schedutil(struct cpufreq_policy *policy,
+                                      unsigned int event)
+{
+    unsigned int cpu = policy->cpu, j;
+    struct su_policy *sp = &per_cpu(su_policy, cpu);
+    s_time_t now = NOW();
+
+    switch (event) {
+    case CPUFREQ_GOV_START:
+        if (!cpu_online(cpu) || !policy->cur || !policy->cpuinfo.max_freq)
+            return -EINVAL;
+
+        /* transition_latency is in ns. */
+        sp->sampling_rate = max_t(s_time_t, MIN_SAMPLING_RATE,
+            (s_time_t)policy->cpuinfo.transition_latency * 10);
+        sp->last_change = now;
+        sp->sampling = 1;
+        sp->kicked = 0;
+        init_timer(&per_cpu(su_timer, cpu), su_timer_fn, policy, cpu);
+
+        for_each_cpu(j, policy->cpus) {
+            struct su_cpu *su = &per_cpu(su_cpu, j);
+
+            su->util = (uint64_t)policy->cur * UTIL_SCALE /
+                       policy->cpuinfo.max_freq;
+            su->busy = 0;
+            su->last_update = now;
+            su->policy_cpu = cpu;
+            smp_wmb();
+            su->enable = 1;
+        }
+
+        set_timer(&per_cpu(su_timer, cpu), now + sp->sampling_rate);
+        break;
+
+    case CPUFREQ_GOV_STOP:
+        for_each_cpu(j, policy->cpus)
+            per_cpu(su_cpu, j).enable = 0;
+        kill_timer(&per_cpu(su_timer, cpu));
+        break;
+
+    case CPUFREQ_GOV_LIMITS:
+        if (policy->max < policy->cur)
+            __cpufreq_driver_target(policy, policy->max, CPUFREQ_RELATION_H);
+        else if (policy->min > policy->cur)
+            __cpufreq_driver_target(policy, policy->min, CPUFREQ_RELATION_L);
+        sp->last_change = now;
+        break;
+
+    default:
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+static bool_t __init cpufreq_schedutil_handle_option(const char *name,
+                                                     const char *val)
+{
+    if (!strcmp(name, "down_rate_limit") && val) {
+        down_rate_limit = MICROSECS(simple_strtoull(val, NULL, 0));
+        return 1;
+    }
+
+    return 0;
+}
+
+struct cpufreq_governor cpufreq_gov_schedutil = {
+    .name = "schedutil",
+    .governor = cpufreq_governor_schedutil,
+    .handle_option = cpufreq_schedutil_handle_option
+};
+
+static int __init cpufreq_gov_schedutil_init(void)
+{
+    return cpufreq_register_governor(&cpufreq_gov_schedutil);
+}
+__initcall(cpufreq_gov_schedutil_init);
@@ -21,6 +21,8 @@
 #include <xen/iommu.h>
 #include <xen/cpu.h>
 #include <xen/irq.h>
+#include <xen/perfc.h>
+#include <xen/trace.h>
 #include <asm/hvm/irq.h>
 #include <asm/hvm/support.h>
 #include <xen/hvm/irq.h>
@@ -409,7 +411,11 @@ int pt_irq_create_bind(
                 pirq_dpci->gmsi.posted = true;
         }
         if ( dest_vcpu_id >= 0 )
+        {
+            /* A (re)binding isn't rate limited. */
+            pirq_dpci->gmsi.last_move = 0;
             hvm_migrate_pirqs(d->vcpu[dest_vcpu_id]);
+        }
 
         /* Use interrupt posting if it is supported. */
         if ( iommu_intpost )
@@ -670,27 +676,73 @@ int pt_pirq_iterate(struct domain *d,
                     void *arg)
 {
     int rc = 0;
-    unsigned int pirq = 0, n, i;
+    unsigned int n, i;
     struct pirq *pirqs[8];
+    struct radix_tree_iter iter;
 
     ASSERT(spin_is_locked(&d->event_lock));
 
-    do {
-        n = radix_tree_gang_lookup(&d->pirq_tree, (void **)pirqs, pirq,
-                                   ARRAY_SIZE(pirqs));
+    radix_tree_iter_init(&iter, 0, d->nr_pirqs - 1);
+    while ( !rc &&
+            (n = radix_tree_next_batch(&d->pirq_tree, &iter, (void **)pirqs,
+                                       NULL, ARRAY_SIZE(pirqs))) )
         for ( i = 0; i < n; ++i )
         {
             struct hvm_pirq_dpci *pirq_dpci = pirq_dpci(pirqs[i]);
 
-            pirq = pirqs[i]->pirq;
             if ( (pirq_dpci->flags & HVM_IRQ_DPCI_MAPPED) )
                 rc = cb(d, pirq_dpci, arg);
         }
-    } while ( !rc && ++pirq < d->nr_pirqs && n == ARRAY_SIZE(pirqs) );
 
     return rc;
 }
 
+/*
+ * Each affinity change of an MSI rewrites its message (or its IRTE, with
+ * interrupt remapping), so a vCPU moving often would keep the IOMMU busy.
+ * The interrupt is thus made to follow its vCPU at most once per interval,
+ * and is moved on delivery to the wrong pCPU once the interval is over.
+ */
+#define PIRQ_MOVE_INTERVAL MILLISECS(10)
+
+/* Called with the IRQ descriptor lock held. */
+bool pt_pirq_follow_vcpu(struct hvm_pirq_dpci *pirq_dpci,
+                         struct irq_desc *desc, unsigned int cpu)
+{
+    s_time_t now = NOW();
+
+    if ( now - pirq_dpci->gmsi.last_move < PIRQ_MOVE_INTERVAL )
+        return false;
+
+    pirq_dpci->gmsi.last_move = now;
+    irq_set_affinity(desc, cpumask_of(cpu));
+
+    return true;
+}
+
+/* A guest MSI landed on a pCPU other than the one of its vCPU. */
+static void hvm_pirq_remote(struct domain *d, struct pirq *pirq,
+                            struct hvm_pirq_dpci *pirq_dpci)
+{
+    const struct vcpu *v = d->vcpu[pirq_dpci->gmsi.dest_vcpu_id];
+    unsigned int cpu = v->processor;
+    struct irq_desc *desc = irq_to_desc(pirq->arch.irq);
+    bool moved = false;
+
+    if ( cpu == smp_processor_id() )
+        return;
+
+    perfc_incr(pirq_remote_deliveries);
+    if ( !(desc->status & IRQ_MOVE_PENDING) &&
+         pt_pirq_follow_vcpu(pirq_dpci, desc, cpu) )
+    {
+        perfc_incr(pirq_follow_moves);
+        moved = true;
+    }
+    TRACE_3D(TRC_HW_IRQ_GUEST_REMOTE, pirq->arch.irq, cpu, moved);
+}
+
+/* Called with the IRQ descriptor lock held. */
 int hvm_do_IRQ_dpci(struct domain *d, struct pirq *pirq)
 {
     struct hvm_irq_dpci *dpci = domain_get_irq_dpci(d);
@@ -700,6 +752,10 @@ int hvm_do_IRQ_dpci(struct domain *d, struct pirq *pirq)
          !(pirq_dpci->flags & HVM_IRQ_DPCI_MAPPED) )
         return 0;
 
+    if ( (pirq_dpci->flags & HVM_IRQ_DPCI_MACH_MSI) &&
+         !pirq_dpci->gmsi.posted && pirq_dpci->gmsi.dest_vcpu_id >= 0 )
+        hvm_pirq_remote(d, pirq, pirq_dpci);
+
     pirq_dpci->masked = 1;
     raise_softirq_for(pirq_dpci);
     return 1;
@@ -296,6 +296,89 @@ int iommu_unmap_page(struct domain *d, unsigned long gfn)
     return rc;
 }
 
+int iommu_map_pages(struct domain *d, unsigned long gfn, unsigned long mfn,
+                    unsigned int order, unsigned int flags)
+{
+    const struct domain_iommu *hd = dom_iommu(d);
+    unsigned long i;
+    int rc = 0;
+
+    if ( !iommu_enabled || !hd->platform_ops )
+        return 0;
+
+    if ( !order || !hd->platform_ops->map_pages )
+    {
+        for ( i = 0; i < (1UL << order); i++ )
+        {
+            rc = iommu_map_page(d, gfn + i, mfn + i, flags);
+            if ( unlikely(rc) )
+            {
+                while ( i-- )
+                    /* If statement to satisfy __must_check. */
+                    if ( iommu_unmap_page(d, gfn + i) )
+                        continue;
+
+                break;
+            }
+        }
+
+        return rc;
+    }
+
+    rc = hd->platform_ops->map_pages(d, gfn, mfn, order, flags);
+    if ( unlikely(rc) )
+    {
+        if ( !d->is_shutting_down && printk_ratelimit() )
+            printk(XENLOG_ERR
+                   "d%d: IOMMU mapping gfn %#lx to mfn %#lx order %u failed: %d\n",
+                   d->domain_id, gfn, mfn, order, rc);
+
+        /* Don't leave part of the range mapped. */
+        if ( hd->platform_ops->unmap_pages(d, gfn, order) ||
+             !is_hardware_domain(d) )
+            domain_crash(d);
+    }
+
+    return rc;
+}
+
+int iommu_unmap_pages(struct domain *d, unsigned long gfn, unsigned int order)
+{
+    const struct domain_iommu *hd = dom_iommu(d);
+    unsigned long i;
+    int rc = 0;
+
+    if ( !iommu_enabled || !hd->platform_ops )
+        return 0;
+
+    if ( !order || !hd->platform_ops->unmap_pages )
+    {
+        for ( i = 0; i < (1UL << order); i++ )
+        {
+            int ret = iommu_unmap_page(d, gfn + i);
+
+            if ( !rc )
+                rc = ret;
+        }
+
+        return rc;
+    }
+
+    rc = hd->platform_ops->unmap_pages(d, gfn, order);
+    if ( unlikely(rc) )
+    {
+        if ( !d->is_shutting_down && printk_ratelimit() )
+            printk(XENLOG_ERR
+                   "d%d: IOMMU unmapping gfn %#lx order %u failed: %d\n",
+                   d->domain_id, gfn, order, rc);
+
+        if ( !is_hardware_domain(d) )
+            domain_crash(d);
+    }
+
+    return rc;
+}
+
 static void iommu_free_pagetables(unsigned long unused)
 {
     do {
@@ -50,6 +50,9 @@ struct mapped_rmrr {
 /* Possible unfiltered LAPIC/MSI messages from untrusted sources? */
 bool_t __read_mostly untrusted_msi;
 
+/* Highest level of superpages supported by all the IOMMUs. */
+static int __read_mostly vtd_max_sp_level = 3;
+
 int nr_iommus;
 
 static struct tasklet vtd_fault_tasklet;
@@ -249,7 +252,54 @@ static u64 bus_to_context_maddr(struct iommu *iommu, u8 bus)
     return maddr;
 }
 
-static u64 addr_to_dma_page_maddr(struct domain *domain, u64 addr, int alloc)
+/*
+ * Replace the superpage *pte at level by a table of entries of the next
+ * level mapping the same frames.  Devices may continue to use the cached
+ * superpage until the range gets flushed, which is harmless as long as
+ * the translation stays the same.
+ */
+static u64 dma_pte_split(struct domain *domain, struct dma_pte *pte,
+                         int level)
+{
+    struct pci_dev *pdev = pci_get_pdev_by_domain(domain, -1, -1, -1);
+    struct acpi_drhd_unit *drhd = acpi_find_matched_drhd_unit(pdev);
+    struct dma_pte *table, e = *pte;
+    u64 maddr = alloc_pgtable_maddr(drhd, 1);
+    unsigned int i;
+
+    if ( !maddr )
+        return 0;
+
+    if ( level == 2 )
+        e.val &= ~DMA_PTE_SP;
+
+    table = map_vtd_domain_page(maddr);
+    for ( i = 0; i < PTE_NUM; i++ )
+    {
+        table[i] = e;
+        dma_set_pte_addr(table[i], dma_pte_addr(*pte) +
+                                   offset_level_address(i, level - 1));
+    }
+    iommu_flush_cache_page(table, 1);
+    unmap_vtd_domain_page(table);
+
+    dma_clear_pte(e);
+    dma_set_pte_addr(e, maddr);
+    dma_set_pte_readable(e);
+    dma_set_pte_writable(e);
+    *pte = e;
+    iommu_flush_cache_entry(pte, sizeof(struct dma_pte));
+
+    return maddr;
+}
+
+/*
+ * Return the maddr of the level target table covering addr, allocating
+ * missing tables if alloc is set.  Superpages above target are split on
+ * the way down, whose failure is reported in *nomem.
+ */
+static u64 addr_to_dma_table_maddr(struct domain *domain, u64 addr,
+                                   int target, int alloc, bool_t *nomem)
 {
     struct acpi_drhd_unit *drhd;
     struct pci_dev *pdev;
@@ -260,6 +310,9 @@ static u64 addr_to_dma_page_maddr(struct domain *domain, u64 addr, int alloc)
     int offset;
     u64 pte_maddr = 0;
 
+    if ( nomem )
+        *nomem = 0;
+
     addr &= (((u64)1) << addr_width) - 1;
     ASSERT(spin_is_locked(&hd->arch.mapping_lock));
     if ( hd->arch.pgd_maddr == 0 )
@@ -302,8 +355,18 @@ static u64 addr_to_dma_page_maddr(struct domain *domain, u64 addr, int alloc)
             dma_set_pte_writable(*pte);
             iommu_flush_cache_entry(pte, sizeof(struct dma_pte));
         }
+        else if ( dma_pte_superpage(*pte) )
+        {
+            pte_maddr = dma_pte_split(domain, pte, level);
+            if ( !pte_maddr )
+            {
+                if ( nomem )
+                    *nomem = 1;
+                break;
+            }
+        }
 
-        if ( level == 2 )
+        if ( level == target + 1 )
             break;
 
         unmap_vtd_domain_page(parent);
@@ -316,6 +379,11 @@ static u64 addr_to_dma_page_maddr(struct domain *domain, u64 addr, int alloc)
     return pte_maddr;
 }
 
+static u64 addr_to_dma_page_maddr(struct domain *domain, u64 addr, int alloc)
+{
+    return addr_to_dma_table_maddr(domain, addr, 1, alloc, NULL);
+}
+
 static void iommu_flush_write_buffer(struct iommu *iommu)
 {
     u32 val;
@@ -551,9 +619,10 @@ static int __must_check iommu_flush_all(void)
     struct acpi_drhd_unit *drhd;
     struct iommu *iommu;
     bool_t flush_dev_iotlb;
-    int rc = 0;
+    int rc = 0, ret;
 
     flush_all_cache();
+    qinval_batch_begin();
     for_each_drhd_unit ( drhd )
     {
         int context_rc, iotlb_rc;
@@ -578,6 +647,10 @@ static int __must_check iommu_flush_all(void)
             rc = iotlb_rc;
     }
 
+    ret = qinval_batch_end();
+    if ( rc >= 0 && ret )
+        rc = ret;
+
     if ( rc > 0 )
         rc = 0;
 
@@ -594,12 +667,13 @@ static int __must_check iommu_flush_iotlb(struct domain *d,
     struct iommu *iommu;
     bool_t flush_dev_iotlb;
     int iommu_domid;
-    int rc = 0;
+    int rc = 0, ret;
 
     /*
      * No need pcideves_lock here because we have flush
      * when assign/deassign device
      */
+    qinval_batch_begin();
     for_each_drhd_unit ( drhd )
     {
         iommu = drhd->iommu;
@@ -629,6 +703,10 @@ static int __must_check iommu_flush_iotlb(struct domain *d,
         }
     }
 
+    ret = qinval_batch_end();
+    if ( !rc )
+        rc = ret;
+
     return rc;
 }
 
@@ -650,15 +728,16 @@ static int __must_check dma_pte_clear_one(struct domain *domain, u64 addr)
     struct domain_iommu *hd = dom_iommu(domain);
     struct dma_pte *page = NULL, *pte = NULL;
     u64 pg_maddr;
+    bool_t nomem;
     int rc = 0;
 
     spin_lock(&hd->arch.mapping_lock);
     /* get last level pte */
-    pg_maddr = addr_to_dma_page_maddr(domain, addr, 0);
+    pg_maddr = addr_to_dma_table_maddr(domain, addr, 1, 0, &nomem);
     if ( pg_maddr == 0 )
     {
         spin_unlock(&hd->arch.mapping_lock);
-        return 0;
+        return nomem ? -ENOMEM : 0;
     }
 
     page = (struct dma_pte *)map_vtd_domain_page(pg_maddr);
@@ -711,7 +790,7 @@ static void iommu_free_page_table(struct page_info *pg)
         if ( !dma_pte_present(*pte) )
             continue;
 
-        if ( next_level >= 1 )
+        if ( next_level >= 1 && !dma_pte_superpage(*pte) )
             iommu_free_pagetable(dma_pte_addr(*pte), next_level);
 
         dma_clear_pte(*pte);
@@ -1434,10 +1513,12 @@ int domain_context_mapping_one(
     spin_unlock(&iommu->lock);
 
     /* Context entry was previously non-present (with domid 0). */
+    qinval_batch_begin();
     rc = iommu_flush_context_device(iommu, 0, PCI_BDF2(bus, devfn),
                                     DMA_CCMD_MASK_NOBIT, 1);
     flush_dev_iotlb = !!find_ats_dev_drhd(iommu);
     ret = iommu_flush_iotlb_dsi(iommu, 0, 1, flush_dev_iotlb);
+    rc = qinval_batch_end() ?: rc;
 
     /*
      * The current logic for returns:
@@ -1583,12 +1664,14 @@ int domain_context_unmap_one(
         return -EINVAL;
     }
 
+    qinval_batch_begin();
     rc = iommu_flush_context_device(iommu, iommu_domid,
                                     PCI_BDF2(bus, devfn),
                                     DMA_CCMD_MASK_NOBIT, 0);
 
     flush_dev_iotlb = !!find_ats_dev_drhd(iommu);
     ret = iommu_flush_iotlb_dsi(iommu, iommu_domid, 0, flush_dev_iotlb);
+    rc = qinval_batch_end() ?: rc;
 
     /*
      * The current logic for returns:
@@ -1816,6 +1899,201 @@ static int __must_check intel_iommu_unmap_page(struct domain *d,
     return dma_pte_clear_one(d, (paddr_t)gfn << PAGE_SHIFT_4K);
 }
 
+#define level_pages(l) (1UL << (((l) - 1) * LEVEL_STRIDE))
+
+/*
+ * Largest level, up to max, at which a single entry maps frames starting
+ * at gfn (and mfn) without going beyond nr frames.
+ */
+static int pages_to_level(unsigned long gfn, unsigned long mfn,
+                          unsigned long nr, int max)
+{
+    int level = max;
+
+    while ( level > 1 &&
+            (((gfn | mfn) & (level_pages(level) - 1)) ||
+             nr < level_pages(level)) )
+        level--;
+
+    return level;
+}
+
+static int sp_max_level(const struct domain_iommu *hd)
+{
+    return min(vtd_max_sp_level, agaw_to_level(hd->arch.agaw) - 1);
+}
+
+/*
+ * Map 2^order frames using superpages where all IOMMUs support them.
+ * Existing tables are not replaced by superpages, but filled instead.
+ */
+static int __must_check intel_iommu_map_pages(struct domain *d,
+                                              unsigned long gfn,
+                                              unsigned long mfn,
+                                              unsigned int order,
+                                              unsigned int flags)
+{
+    struct domain_iommu *hd = dom_iommu(d);
+    unsigned long i, nr = 1UL << order;
+    bool_t changed = 0, old_present = 0;
+    int level, rc = 0, err;
+
+    /* Do nothing if VT-d shares EPT page table */
+    if ( iommu_use_hap_pt(d) )
+        return 0;
+
+    /* Do nothing if hardware domain and iommu supports pass thru. */
+    if ( iommu_passthrough && is_hardware_domain(d) )
+        return 0;
+
+    spin_lock(&hd->arch.mapping_lock);
+
+    for ( i = 0; i < nr; i += level_pages(level) )
+    {
+        paddr_t addr = (paddr_t)(gfn + i) << PAGE_SHIFT_4K;
+        struct dma_pte *page, *pte, old, new = { 0 };
+        u64 pg_maddr;
+
+        level = pages_to_level(gfn + i, mfn + i, nr - i, sp_max_level(hd));
+
+        for ( ; ; )
+        {
+            pg_maddr = addr_to_dma_table_maddr(d, addr, level, 1, NULL);
+            if ( !pg_maddr )
+                break;
+
+            page = map_vtd_domain_page(pg_maddr);
+            pte = page + address_level_offset(addr, level);
+            if ( level == 1 || !dma_pte_present(*pte) ||
+                 dma_pte_superpage(*pte) )
+                break;
+
+            unmap_vtd_domain_page(page);
+            level--;
+        }
+
+        if ( !pg_maddr )
+        {
+            rc = -ENOMEM;
+            break;
+        }
+
+        old = *pte;
+        dma_set_pte_addr(new, (paddr_t)(mfn + i) << PAGE_SHIFT_4K);
+        dma_set_pte_prot(new,
+                         ((flags & IOMMUF_readable) ? DMA_PTE_READ  : 0) |
+                         ((flags & IOMMUF_writable) ? DMA_PTE_WRITE : 0));
+        if ( level > 1 )
+            dma_set_pte_superpage(new);
+
+        /* Set the SNP on leaf page table if Snoop Control available */
+        if ( iommu_snoop )
+            dma_set_pte_snp(new);
+
+        if ( old.val != new.val )
+        {
+            *pte = new;
+            iommu_flush_cache_entry(pte, sizeof(struct dma_pte));
+            changed = 1;
+            old_present |= dma_pte_present(old);
+        }
+
+        unmap_vtd_domain_page(page);
+    }
+
+    spin_unlock(&hd->arch.mapping_lock);
+
+    if ( changed && !this_cpu(iommu_dont_flush_iotlb) )
+    {
+        err = iommu_flush_iotlb(d, gfn, old_present, i ?: 1);
+        if ( !rc )
+            rc = err;
+    }
+
+    return rc;
+}
+
+/* Unmap 2^order frames, clearing whole superpages and leaf tables. */
+static int __must_check intel_iommu_unmap_pages(struct domain *d,
+                                                unsigned long gfn,
+                                                unsigned int order)
+{
+    struct domain_iommu *hd = dom_iommu(d);
+    unsigned long i, nr = 1UL << order;
+    bool_t changed = 0, nomem;
+    int level, rc = 0, err;
+
+    /* Do nothing if hardware domain and iommu supports pass thru. */
+    if ( iommu_passthrough && is_hardware_domain(d) )
+        return 0;
+
+    spin_lock(&hd->arch.mapping_lock);
+
+    for ( i = 0; i < nr; i += level_pages(level) )
+    {
+        paddr_t addr = (paddr_t)(gfn + i) << PAGE_SHIFT_4K;
+        struct dma_pte *page, *pte;
+        u64 pg_maddr;
+
+        level = pages_to_level(gfn + i, 0, nr - i, sp_max_level(hd));
+
+        for ( ; ; )
+        {
+            pg_maddr = addr_to_dma_table_maddr(d, addr, level, 0, &nomem);
+            if ( !pg_maddr )
+                break;
+
+            page = map_vtd_domain_page(pg_maddr);
+            pte = page + address_level_offset(addr, level);
+            if ( level <= 2 || !dma_pte_present(*pte) ||
+                 dma_pte_superpage(*pte) )
+                break;
+
+            unmap_vtd_domain_page(page);
+            level--;
+        }
+
+        if ( !pg_maddr )
+        {
+            /* Nothing is mapped in this range. */
+            if ( !nomem )
+                continue;
+            rc = -ENOMEM;
+            break;
+        }
+
+        if ( level == 2 && dma_pte_present(*pte) && !dma_pte_superpage(*pte) )
+        {
+            /* Clear the whole leaf table, but keep it. */
+            struct dma_pte *leaf = map_vtd_domain_page(dma_pte_addr(*pte));
+
+            memset(leaf, 0, PAGE_SIZE_4K);
+            iommu_flush_cache_page(leaf, 1);
+            unmap_vtd_domain_page(leaf);
+            changed = 1;
+        }
+        else if ( dma_pte_present(*pte) )
+        {
+            dma_clear_pte(*pte);
+            iommu_flush_cache_entry(pte, sizeof(struct dma_pte));
+            changed = 1;
+        }
+
+        unmap_vtd_domain_page(page);
+    }
+
+    spin_unlock(&hd->arch.mapping_lock);
+
+    if ( changed && !this_cpu(iommu_dont_flush_iotlb) )
+    {
+        err = iommu_flush_iotlb_pages(d, gfn, nr);
+        if ( !rc )
+            rc = err;
+    }
+
+    return rc;
+}
+
 int iommu_pte_flush(struct domain *d, u64 gfn, u64 *pte,
                     int order, int present)
 {
@@ -2250,6 +2528,11 @@ int __init intel_vtd_setup(void)
 
         printk(".\n");
 
+        if ( !cap_sps_2mb(iommu->cap) )
+            vtd_max_sp_level = 1;
+        else if ( !cap_sps_1gb(iommu->cap) )
+            vtd_max_sp_level = min(vtd_max_sp_level, 2);
+
         if ( iommu_snoop && !ecap_snp_ctl(iommu->ecap) )
             iommu_snoop = 0;
 
@@ -2523,10 +2806,46 @@ static int __must_check vtd_suspend(void)
     return 0;
 }
 
+/*
+ * Clear @bit (at the same position in GCMD and GSTS) on all IOMMUs but the
+ * IGD one, issuing all the commands before waiting for any, so that slow
+ * units cost DMAR_OPERATION_TIMEOUT once rather than once each.
+ * register_lock isn't taken: the CPUs shot down may have been holding it.
+ */
+static void crash_disable_all(u32 bit)
+{
+    struct acpi_drhd_unit *drhd;
+    s_time_t deadline;
+    bool_t busy;
+    u32 sts;
+
+    for_each_drhd_unit ( drhd )
+    {
+        if ( is_igd_drhd(drhd) )
+            continue;
+        sts = dmar_readl(drhd->iommu->reg, DMAR_GSTS_REG);
+        if ( sts & bit )
+            dmar_writel(drhd->iommu->reg, DMAR_GCMD_REG, sts & ~bit);
+    }
+
+    deadline = NOW() + DMAR_OPERATION_TIMEOUT;
+    do {
+        busy = 0;
+        for_each_drhd_unit ( drhd )
+            if ( !is_igd_drhd(drhd) &&
+                 (dmar_readl(drhd->iommu->reg, DMAR_GSTS_REG) & bit) )
+                busy = 1;
+        if ( !busy )
+            break;
+        cpu_relax();
+    } while ( NOW() < deadline );
+}
+
 static void vtd_crash_shutdown(void)
 {
     struct acpi_drhd_unit *drhd;
     struct iommu *iommu;
+    u32 irta;
 
     if ( !iommu_enabled )
         return;
@@ -2535,12 +2854,31 @@ static void vtd_crash_shutdown(void)
         printk(XENLOG_WARNING VTDPREFIX
                " crash shutdown: IOMMU flush all failed\n");
 
+    /* The IGD unit may need its errata workarounds around each operation. */
     for_each_drhd_unit ( drhd )
     {
+        if ( !is_igd_drhd(drhd) )
+            continue;
         iommu = drhd->iommu;
         iommu_disable_translation(iommu);
-        disable_intremap(drhd->iommu);
-        disable_qinval(drhd->iommu);
+        disable_intremap(iommu);
+        disable_qinval(iommu);
+    }
+
+    crash_disable_all(DMA_GCMD_TE);
+    crash_disable_all(DMA_GCMD_IRE);
+    crash_disable_all(DMA_GCMD_QIE);
+
+    /* Don't stay in Extended Interrupt Mode, as disable_intremap() does. */
+    for_each_drhd_unit ( drhd )
+    {
+        iommu = drhd->iommu;
+        if ( is_igd_drhd(drhd) || !ecap_intr_remap(iommu->ecap) ||
+             !ecap_eim(iommu->ecap) )
+            continue;
+        irta = dmar_readl(iommu->reg, DMAR_IRTA_REG);
+        if ( irta & IRTA_EIME )
+            dmar_writel(iommu->reg, DMAR_IRTA_REG, irta & ~IRTA_EIME);
     }
 }
 
@@ -2606,7 +2944,7 @@ static void vtd_dump_p2m_table_level(paddr_t pt_maddr, int level, paddr_t gpa,
             continue;
 
         address = gpa + offset_level_address(i, level);
-        if ( next_level >= 1 ) 
+        if ( next_level >= 1 && !dma_pte_superpage(*pte) )
             vtd_dump_p2m_table_level(dma_pte_addr(*pte), next_level, 
                                      address, indent + 1);
         else
@@ -2641,6 +2979,8 @@ const struct iommu_ops intel_iommu_ops = {
     .teardown = iommu_domain_teardown,
     .map_page = intel_iommu_map_page,
     .unmap_page = intel_iommu_unmap_page,
+    .map_pages = intel_iommu_map_pages,
+    .unmap_pages = intel_iommu_unmap_pages,
     .free_page_table = iommu_free_page_table,
     .reassign_device = reassign_device_ownership,
     .get_device_group_id = intel_iommu_group_id,
@@ -505,6 +505,10 @@ extern struct list_head acpi_ioapic_units;
 
 struct qi_ctrl {
     u64 qinval_maddr;  /* queue invalidation page machine address */
+    /* Statistics, updated without locking. */
+    unsigned long nr_descs;      /* descriptors queued */
+    unsigned long nr_waits;      /* waits for completion */
+    s_time_t wait_time;          /* time spent waiting */
 };
 
 struct ir_ctrl {
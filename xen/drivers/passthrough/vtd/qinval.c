@@ -31,7 +31,21 @@
 
 #define VTD_QI_TIMEOUT	1
 
+/*
+ * Between qinval_batch_begin() and qinval_batch_end(), context and IOTLB
+ * invalidations are only queued, and the IOMMUs they went to remembered.
+ * qinval_batch_end() then waits once per IOMMU, so that a flush touching
+ * several descriptors or units spins once for each unit rather than once
+ * per descriptor, while the units process their queues in parallel.
+ * Batches are per cpu and may nest.
+ */
+static DEFINE_PER_CPU(unsigned int, qinval_batch_depth);
+static DEFINE_PER_CPU(unsigned long, qinval_batch_pending);
+
 static int __must_check invalidate_sync(struct iommu *iommu);
+static int __must_check queue_invalidate_wait(struct iommu *iommu,
+                                              u8 iflag, u8 sw, u8 fn,
+                                              bool_t flush_dev_iotlb);
 
 static void print_qi_regs(struct iommu *iommu)
 {
@@ -70,6 +84,40 @@ static void qinval_update_qtail(struct iommu *iommu, unsigned int index)
     ASSERT( spin_is_locked(&iommu->register_lock) );
     val = (index + 1) % QINVAL_ENTRY_NR;
     dmar_writeq(iommu->reg, DMAR_IQT_REG, (val << QINVAL_INDEX_SHIFT));
+    iommu_qi_ctrl(iommu)->nr_descs++;
+}
+
+void qinval_batch_begin(void)
+{
+    this_cpu(qinval_batch_depth)++;
+}
+
+int qinval_batch_end(void)
+{
+    struct acpi_drhd_unit *drhd;
+    unsigned long pending;
+    int rc = 0;
+
+    ASSERT(this_cpu(qinval_batch_depth));
+    if ( --this_cpu(qinval_batch_depth) )
+        return 0;
+
+    pending = this_cpu(qinval_batch_pending);
+    this_cpu(qinval_batch_pending) = 0;
+
+    for_each_drhd_unit ( drhd )
+    {
+        int ret;
+
+        if ( !test_bit(drhd->iommu->index, &pending) )
+            continue;
+
+        ret = queue_invalidate_wait(drhd->iommu, 0, 1, 1, 0);
+        if ( !rc )
+            rc = ret;
+    }
+
+    return rc;
 }
 
 static int __must_check queue_invalidate_context_sync(struct iommu *iommu,
@@ -173,19 +221,25 @@ static int __must_check queue_invalidate_wait(struct iommu *iommu,
     qinval_update_qtail(iommu, index);
     spin_unlock_irqrestore(&iommu->register_lock, flags);
 
+    /* The wait covers whatever this cpu has queued so far. */
+    __clear_bit(iommu->index, &this_cpu(qinval_batch_pending));
+
     /* Now we don't support interrupt method */
     if ( sw )
     {
-        s_time_t timeout;
+        struct qi_ctrl *qi_ctrl = iommu_qi_ctrl(iommu);
+        s_time_t start = NOW(), timeout;
 
         /* In case all wait descriptor writes to same addr with same data */
-        timeout = NOW() + MILLISECS(flush_dev_iotlb ?
+        timeout = start + MILLISECS(flush_dev_iotlb ?
                                     iommu_dev_iotlb_timeout : VTD_QI_TIMEOUT);
 
+        qi_ctrl->nr_waits++;
         while ( poll_slot != QINVAL_STAT_DONE )
         {
             if ( NOW() > timeout )
             {
+                qi_ctrl->wait_time += NOW() - start;
                 print_qi_regs(iommu);
                 printk(XENLOG_WARNING VTDPREFIX
                        " Queue invalidate wait descriptor timed out\n");
@@ -193,6 +247,7 @@ static int __must_check queue_invalidate_wait(struct iommu *iommu,
             }
             cpu_relax();
         }
+        qi_ctrl->wait_time += NOW() - start;
         return 0;
     }
 
@@ -205,6 +260,12 @@ static int __must_check invalidate_sync(struct iommu *iommu)
 
     ASSERT(qi_ctrl->qinval_maddr);
 
+    if ( this_cpu(qinval_batch_depth) )
+    {
+        __set_bit(iommu->index, &this_cpu(qinval_batch_pending));
+        return 0;
+    }
+
     return queue_invalidate_wait(iommu, 0, 1, 1, 0);
 }
 
@@ -299,7 +360,8 @@ static int __must_check queue_invalidate_iec_sync(struct iommu *iommu,
     qinval_update_qtail(iommu, index);
     spin_unlock_irqrestore(&iommu->register_lock, flags);
 
-    ret = invalidate_sync(iommu);
+    /* Interrupt remapping changes must not be deferred by a batch. */
+    ret = queue_invalidate_wait(iommu, 0, 1, 1, 0);
 
     /*
      * reading vt-d architecture register will ensure
@@ -192,6 +192,14 @@ void vtd_dump_iommu_info(unsigned char key)
         printk("  Queued Invalidation: %ssupported%s.\n",
             ecap_queued_inval(iommu->ecap) ? "" : "not ",
            (status & DMA_GSTS_QIES) ? " and enabled" : "" );
+        if ( status & DMA_GSTS_QIES )
+        {
+            const struct qi_ctrl *qi_ctrl = iommu_qi_ctrl(iommu);
+
+            printk("    %lu descriptors queued, %lu waits taking %"PRI_stime"us\n",
+                   qi_ctrl->nr_descs, qi_ctrl->nr_waits,
+                   qi_ctrl->wait_time / MICROSECS(1));
+        }
 
 
         printk("  Interrupt Remapping: %ssupported%s.\n",
@@ -108,18 +108,55 @@ void hvm_dpci_isairq_eoi(struct domain *d, unsigned int isairq)
     spin_unlock(&d->event_lock);
 }
 
+/*
+ * Map the 4k frames [gfn, gfn + nr) 1:1, in the largest naturally aligned
+ * chunks possible, so that iommu_map_pages() can use superpages.
+ */
+static int __hwdom_init hwdom_map_range(struct domain *d, unsigned long gfn,
+                                        unsigned long nr)
+{
+    int rc = 0;
+
+    while ( nr )
+    {
+        unsigned int order = min_t(unsigned int, flsl(nr) - 1, PAGE_ORDER_1G);
+        int ret;
+
+        if ( gfn )
+            order = min_t(unsigned int, order, find_first_set_bit(gfn));
+
+        ret = iommu_map_pages(d, gfn, gfn, order,
+                              IOMMUF_readable|IOMMUF_writable);
+        if ( !rc )
+            rc = ret;
+
+        gfn += 1UL << order;
+        nr -= 1UL << order;
+
+        process_pending_softirqs();
+    }
+
+    return rc;
+}
+
 void __hwdom_init vtd_set_hwdom_mapping(struct domain *d)
 {
-    unsigned long i, j, tmp, top;
+    unsigned long i, tmp, top, run_start = 0, run_len = 0;
+    int rc = 0;
 
     BUG_ON(!is_hardware_domain(d));
 
     top = max(max_pdx, pfn_to_pdx(0xffffffffUL >> PAGE_SHIFT) + 1);
+    tmp = 1 << (PAGE_SHIFT - PAGE_SHIFT_4K);
+
+    /*
+     * Translation isn't enabled yet, and intel_iommu_hwdom_init() flushes
+     * everything once done, so don't flush the IOTLB for each mapping.
+     */
+    this_cpu(iommu_dont_flush_iotlb) = 1;
 
     for ( i = 0; i < top; i++ )
     {
-        int rc = 0;
-
         /*
          * Set up 1:1 mapping for dom0. Default to use only conventional RAM
          * areas and let RMRRs include needed reserved regions. When set, the
@@ -127,35 +164,48 @@ void __hwdom_init vtd_set_hwdom_mapping(struct domain *d)
          * ranges.
          */
         unsigned long pfn = pdx_to_pfn(i);
-
-        if ( pfn > (0xffffffffUL >> PAGE_SHIFT) ?
-             (!mfn_valid(_mfn(pfn)) ||
-              !page_is_ram_type(pfn, RAM_TYPE_CONVENTIONAL)) :
-             iommu_inclusive_mapping ?
-             page_is_ram_type(pfn, RAM_TYPE_UNUSABLE) :
-             !page_is_ram_type(pfn, RAM_TYPE_CONVENTIONAL) )
-            continue;
-
-        /* Exclude Xen bits */
-        if ( xen_in_range(pfn) )
-            continue;
-
-        tmp = 1 << (PAGE_SHIFT - PAGE_SHIFT_4K);
-        for ( j = 0; j < tmp; j++ )
+        bool_t map = !(pfn > (0xffffffffUL >> PAGE_SHIFT) ?
+                       (!mfn_valid(_mfn(pfn)) ||
+                        !page_is_ram_type(pfn, RAM_TYPE_CONVENTIONAL)) :
+                       iommu_inclusive_mapping ?
+                       page_is_ram_type(pfn, RAM_TYPE_UNUSABLE) :
+                       !page_is_ram_type(pfn, RAM_TYPE_CONVENTIONAL)) &&
+                     /* Exclude Xen bits */
+                     !xen_in_range(pfn);
+
+        /* Collect contiguous frames into runs, and map each run at once. */
+        if ( map && run_len && run_start + run_len == pfn * tmp )
+            run_len += tmp;
+        else
         {
-            int ret = iommu_map_page(d, pfn * tmp + j, pfn * tmp + j,
-                                     IOMMUF_readable|IOMMUF_writable);
+            if ( run_len )
+            {
+                int ret = hwdom_map_range(d, run_start, run_len);
 
-            if ( !rc )
-               rc = ret;
-        }
+                if ( !rc )
+                    rc = ret;
+            }
 
-        if ( rc )
-           printk(XENLOG_WARNING VTDPREFIX " d%d: IOMMU mapping failed: %d\n",
-                  d->domain_id, rc);
+            run_start = pfn * tmp;
+            run_len = map ? tmp : 0;
+        }
 
         if (!(i & (0xfffff >> (PAGE_SHIFT - PAGE_SHIFT_4K))))
             process_pending_softirqs();
     }
+
+    if ( run_len )
+    {
+        int ret = hwdom_map_range(d, run_start, run_len);
+
+        if ( !rc )
+            rc = ret;
+    }
+
+    this_cpu(iommu_dont_flush_iotlb) = 0;
+
+    if ( rc )
+        printk(XENLOG_WARNING VTDPREFIX " d%d: IOMMU mapping failed: %d\n",
+               d->domain_id, rc);
 }
 
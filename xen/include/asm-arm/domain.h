@@ -259,6 +259,18 @@ struct arch_vcpu
         paddr_t rdist_base;
 #define VGIC_V3_RDIST_LAST  (1 << 0)        /* last vCPU of the rdist */
         uint8_t flags;
+
+        /*
+         * Set when all LRs are in use and none of them can be taken over
+         * by the IRQs in lr_pending.  Refilling is then left until an LR
+         * gets freed (the underflow maintenance interrupt makes sure that
+         * we notice) or another IRQ gets queued.
+         */
+        bool lr_pending_stalled;
+
+        /* Statistics: IRQs queued for lack of an LR, and LRs taken over. */
+        uint32_t lr_overflows;
+        uint32_t lr_evictions;
     } vgic;
 
     /* Timer registers  */
@@ -35,6 +35,9 @@ static inline int replace_grant_supported(void)
 #define gnttab_need_iommu_mapping(d)                    \
     (is_domain_direct_mapped(d) && need_iommu(d))
 
+#define gnttab_defer_p2m_flush(d) p2m_defer_flush(d)
+#define gnttab_p2m_flush() p2m_flush_deferred()
+
 #endif /* __ASM_GRANT_TABLE_H__ */
 /*
  * Local variables:
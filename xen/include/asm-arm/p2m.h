@@ -178,6 +178,10 @@ static inline void p2m_write_lock(struct p2m_domain *p2m)
 
 void p2m_write_unlock(struct p2m_domain *p2m);
 
+/* Batch the TLB flushes of mappings removed from the P2M of a domain. */
+void p2m_defer_flush(struct domain *d);
+void p2m_flush_deferred(void);
+
 static inline void p2m_read_lock(struct p2m_domain *p2m)
 {
     read_lock(&p2m->lock);
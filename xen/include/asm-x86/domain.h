@@ -86,6 +86,19 @@ void hypercall_page_initialise(struct domain *d, void *);
 /************************************************/
 /*          shadow paging extension             */
 /************************************************/
+/* Per-domain shadow statistics, shown by the 'q' debug key. */
+enum shadow_stat {
+    SHADOW_STAT_FAST_EMULATE,   /* write emulated via the fast path */
+    SHADOW_STAT_FAST_PROPAGATE, /* not-present fault bounced to the guest */
+    SHADOW_STAT_FAST_MMIO,      /* MMIO access via the fast path */
+    SHADOW_STAT_REAL_FAULT,     /* fault in the guest's own pagetables */
+    SHADOW_STAT_FIXED,          /* shadow entry filled in */
+    SHADOW_STAT_EMULATE,        /* write to a pagetable emulated */
+    SHADOW_STAT_MMIO,           /* MMIO access via the slow path */
+    SHADOW_STAT_OOS_EVICT,      /* out-of-sync page evicted and resynced */
+    SHADOW_STAT_NR
+};
+
 struct shadow_domain {
 #ifdef CONFIG_SHADOW_PAGING
     unsigned int      opt_flags;    /* runtime tunable optimizations on/off */
@@ -106,6 +119,7 @@ struct shadow_domain {
 
     /* Shadow hashtable */
     struct page_info **hash_table;
+    unsigned int hash_buckets;
     bool_t hash_walking;  /* Some function is walking the hash table */
 
     /* Fast MMIO path heuristic */
@@ -117,6 +131,8 @@ struct shadow_domain {
 
     /* Has this domain ever used HVMOP_pagetable_dying? */
     bool_t pagetable_dying_op;
+
+    atomic_t stats[SHADOW_STAT_NR];
 #endif
 };
 
@@ -158,6 +174,8 @@ struct hap_domain {
     unsigned int      total_pages;  /* number of pages allocated */
     unsigned int      free_pages;   /* number of pages on freelists */
     unsigned int      p2m_pages;    /* number of pages allocates to p2m */
+    unsigned int      grown_pages;  /* number of pages added by autogrow */
+    struct tasklet    grow_tasklet;
 };
 
 /************************************************/
@@ -304,12 +322,17 @@ struct arch_domain
         RELMEM_not_started,
         RELMEM_shared,
         RELMEM_xen,
+        RELMEM_parallel,
         RELMEM_l4,
         RELMEM_l3,
         RELMEM_l2,
         RELMEM_done,
     } relmem;
     struct page_list_head relmem_list;
+    /* Helpers freeing pages in parallel, see relinquish_memory_parallel(). */
+    struct relmem_worker *relmem_workers;
+    unsigned int nr_relmem_workers;
+    atomic_t relmem_busy;
 
     const struct arch_csw {
         void (*from)(struct vcpu *);
@@ -607,13 +630,13 @@ unsigned long pv_guest_cr4_fixup(const struct vcpu *, unsigned long guest_cr4);
       | (mmu_cr4_features                                   \
          & (X86_CR4_PGE | X86_CR4_PSE | X86_CR4_SMEP |      \
             X86_CR4_SMAP | X86_CR4_OSXSAVE |                \
-            X86_CR4_FSGSBASE))                              \
+            X86_CR4_FSGSBASE | X86_CR4_PCIDE))              \
       | ((v)->domain->arch.vtsc ? X86_CR4_TSD : 0))         \
      & ~X86_CR4_DE)
 #define real_cr4_to_pv_guest_cr4(c)                         \
     ((c) & ~(X86_CR4_PGE | X86_CR4_PSE | X86_CR4_TSD |      \
              X86_CR4_OSXSAVE | X86_CR4_SMEP |               \
-             X86_CR4_FSGSBASE | X86_CR4_SMAP))
+             X86_CR4_FSGSBASE | X86_CR4_SMAP | X86_CR4_PCIDE))
 
 #define domain_max_vcpus(d) (is_hvm_domain(d) ? HVM_MAX_VCPUS : MAX_VIRT_CPUS)
 
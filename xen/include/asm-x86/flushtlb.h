@@ -72,6 +72,25 @@ static inline unsigned long read_cr3(void)
 /* Write pagetable base and implicitly tick the tlbflush clock. */
 void write_cr3(unsigned long cr3);
 
+/*
+ * PCIDs tagging the kernel and user address spaces of 64-bit PV guests
+ * (see the "pcid" command line option).  Everything else runs with PCID 0.
+ */
+#define PCID_PV_KERNEL 1
+#define PCID_PV_USER   2
+
+/* Invalidate the (non-global) translations of one address in one PCID. */
+static inline void invpcid_flush_one(unsigned int pcid, unsigned long addr)
+{
+    struct {
+        uint64_t pcid, addr;
+    } desc = { pcid, addr };
+
+    /* invpcid (%rax), %rcx - type 0 is an individual-address invalidation */
+    asm volatile ( ".byte 0x66, 0x0f, 0x38, 0x82, 0x08"
+                   : : "a" (&desc), "c" (0UL), "m" (desc) : "memory" );
+}
+
 /* flush_* flag fields: */
  /*
   * Area to flush: 2^flush_order pages. Default is flush entire address space.
@@ -68,6 +68,10 @@ static inline void gnttab_clear_flag(unsigned int nr, uint16_t *st)
 #define gnttab_need_iommu_mapping(d)                \
     (!paging_mode_translate(d) && need_iommu(d))
 
+/* P2M updates flush the TLBs they need to themselves. */
+#define gnttab_defer_p2m_flush(d) do {} while ( 0 )
+#define gnttab_p2m_flush() do {} while ( 0 )
+
 static inline int replace_grant_supported(void)
 {
     return 1;
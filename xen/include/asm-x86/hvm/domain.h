@@ -21,6 +21,7 @@
 #define __ASM_X86_HVM_DOMAIN_H__
 
 #include <xen/iommu.h>
+#include <xen/tasklet.h>
 #include <asm/hvm/irq.h>
 #include <asm/hvm/vpt.h>
 #include <asm/hvm/vlapic.h>
@@ -37,7 +38,8 @@
 
 struct hvm_ioreq_page {
     unsigned long gmfn;
-    struct page_info *page;
+    unsigned int nr_pages;
+    struct page_info *page[1u << XEN_DMOP_BUFIOREQ_MAX_ORDER];
     void *va;
 };
 
@@ -48,8 +50,19 @@ struct hvm_ioreq_vcpu {
     bool_t           pending;
 };
 
+struct hvm_ioreq_io_event {
+    struct list_head list_entry;
+    uint64_t         addr;
+    uint64_t         data;
+    uint32_t         type;
+    uint8_t          size;
+    uint8_t          flags;
+    evtchn_port_t    port;
+};
+
 #define NR_IO_RANGE_TYPES (XEN_DMOP_IO_RANGE_PCI + 1)
 #define MAX_NR_IO_RANGES  256
+#define MAX_NR_IO_EVENTS  64
 
 struct hvm_ioreq_server {
     struct list_head       list_entry;
@@ -71,6 +84,17 @@ struct hvm_ioreq_server {
     struct rangeset        *range[NR_IO_RANGE_TYPES];
     bool_t                 enabled;
     bool_t                 bufioreq_atomic;
+
+    /* See XEN_DMOP_map_io_event_to_ioreq_server */
+    struct list_head       io_event_list;
+    unsigned int           nr_io_events;
+
+    /* See XEN_DMOP_get_ioreq_server_stats */
+    struct {
+        unsigned long      sync, buffered, ring_full;
+        unsigned long      pio, copy, pci_config, other_type;
+        unsigned long      size[5];
+    } stats;
 };
 
 /*
@@ -166,6 +190,13 @@ struct hvm_domain {
 
     struct viridian_domain viridian;
 
+    /* PAUSE-loop exits, see hvm_pause_loop_exit(). */
+    struct {
+        uint64_t           exits;
+        uint64_t           directed;    /* yielded to a preempted vcpu */
+        unsigned int       last_target;
+    } pause_loop;
+
     bool_t                 hap_enabled;
     bool_t                 mem_sharing_enabled;
     bool_t                 qemu_mapcache_invalidate;
@@ -190,6 +221,15 @@ struct hvm_domain {
         struct list_head list;
     } write_map;
 
+    /* Pages set aside for breaking sharing, see mem_sharing.c. */
+    struct {
+        spinlock_t lock;
+        struct page_list_head pages;
+        unsigned int count;
+        unsigned int target;
+        struct tasklet refill;
+    } unshare_pool;
+
     struct hvm_pi_ops pi_ops;
 
     union {
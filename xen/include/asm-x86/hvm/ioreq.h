@@ -25,7 +25,7 @@ bool_t is_ioreq_server_page(struct domain *d, const struct page_info *page);
 
 int hvm_create_ioreq_server(struct domain *d, domid_t domid,
                             bool_t is_default, int bufioreq_handling,
-                            ioservid_t *id);
+                            unsigned int bufioreq_order, ioservid_t *id);
 int hvm_destroy_ioreq_server(struct domain *d, ioservid_t id);
 int hvm_get_ioreq_server_info(struct domain *d, ioservid_t id,
                               unsigned long *ioreq_pfn,
@@ -37,10 +37,21 @@ int hvm_map_io_range_to_ioreq_server(struct domain *d, ioservid_t id,
 int hvm_unmap_io_range_from_ioreq_server(struct domain *d, ioservid_t id,
                                          uint32_t type, uint64_t start,
                                          uint64_t end);
+int hvm_map_io_event_to_ioreq_server(struct domain *d, ioservid_t id,
+                                     uint32_t type, uint64_t addr,
+                                     unsigned int size, unsigned int flags,
+                                     uint64_t data, evtchn_port_t *port);
+int hvm_unmap_io_event_from_ioreq_server(struct domain *d, ioservid_t id,
+                                         uint32_t type, uint64_t addr,
+                                         unsigned int size, unsigned int flags,
+                                         uint64_t data);
 int hvm_map_mem_type_to_ioreq_server(struct domain *d, ioservid_t id,
                                      uint32_t type, uint32_t flags);
 int hvm_set_ioreq_server_state(struct domain *d, ioservid_t id,
                                bool_t enabled);
+int hvm_complete_ioreqs(struct domain *d, ioservid_t id);
+int hvm_get_ioreq_server_stats(struct domain *d, ioservid_t id,
+                               struct xen_dm_op_get_ioreq_server_stats *stats);
 
 int hvm_all_ioreq_servers_add_vcpu(struct domain *d, struct vcpu *v);
 void hvm_all_ioreq_servers_remove_vcpu(struct domain *d, struct vcpu *v);
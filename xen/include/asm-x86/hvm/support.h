@@ -114,6 +114,7 @@ void hvm_triple_fault(void);
 void hvm_prepare_vm86_tss(struct vcpu *v, uint32_t base, uint32_t limit);
 
 void hvm_rdtsc_intercept(struct cpu_user_regs *regs);
+void hvm_pause_loop_exit(void);
 
 int __must_check hvm_handle_xsetbv(u32 index, u64 new_bv);
 
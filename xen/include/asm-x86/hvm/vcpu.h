@@ -53,6 +53,19 @@ struct hvm_mmio_cache {
     uint8_t buffer[32];
 };
 
+/*
+ * Instruction bytes recently fetched by the emulator, with the frame they
+ * were fetched from, see hvmemul_fetch_insn().
+ */
+#define HVM_INSN_CACHE_ENTRIES 4
+struct hvm_insn_cache {
+    unsigned long cr3;
+    unsigned long addr;
+    unsigned long gfn;
+    uint32_t pfec;
+    uint8_t insn[16];
+};
+
 struct hvm_vcpu_io {
     /* I/O request in flight to device model. */
     enum hvm_io_completion io_completion;
@@ -78,6 +91,8 @@ struct hvm_vcpu_io {
     /* For retries we shouldn't re-fetch the instruction. */
     unsigned int mmio_insn_bytes;
     unsigned char mmio_insn[16];
+    struct hvm_insn_cache insn_cache[HVM_INSN_CACHE_ENTRIES];
+    unsigned int insn_cache_next;
     /*
      * For string instruction emulation we need to be able to signal a
      * necessary retry through other than function return codes.
@@ -141,6 +156,19 @@ struct altp2mvcpu {
 
 #define vcpu_altp2m(v) ((v)->arch.hvm_vcpu.avcpu)
 
+/* Interrupt delivery statistics (approximate, see XEN_SYSCTL_irq_stats). */
+struct hvm_irq_stats {
+    unsigned long extint_exits;
+    unsigned long guest_irq_exits;
+    unsigned long pi_wakeups;
+    /* Local APIC accesses which could not be handled by hardware. */
+    unsigned long apic_icr_exits;
+    unsigned long apic_eoi_exits;
+    unsigned long apic_tpr_exits;
+    unsigned long apic_timer_exits;
+    unsigned long apic_other_exits;
+};
+
 struct hvm_vcpu {
     /* Guest control-register and EFER values, just as the guest sees them. */
     unsigned long       guest_cr[5];
@@ -166,6 +194,9 @@ struct hvm_vcpu {
     bool                debug_state_latch;
     bool                single_step;
 
+    /* Time of the last PAUSE-loop exit. */
+    s_time_t            pause_loop_time;
+
     struct hvm_vcpu_asid n1asid;
 
     u32                 msr_tsc_aux;
@@ -204,6 +235,8 @@ struct hvm_vcpu {
     struct x86_event     inject_event;
 
     struct viridian_vcpu viridian;
+
+    struct hvm_irq_stats *irq_stats;
 };
 
 #endif /* __ASM_X86_HVM_VCPU_H__ */
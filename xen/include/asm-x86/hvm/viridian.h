@@ -19,6 +19,60 @@ union viridian_vp_assist
     } fields;
 };
 
+union viridian_page_msr
+{
+    uint64_t raw;
+    struct
+    {
+        uint64_t enabled:1;
+        uint64_t reserved_preserved:11;
+        uint64_t pfn:48;
+    } fields;
+};
+
+union viridian_sint_msr
+{
+    uint64_t raw;
+    struct
+    {
+        uint64_t vector:8;
+        uint64_t reserved_preserved1:8;
+        uint64_t mask:1;
+        uint64_t auto_eoi:1;
+        uint64_t polling:1;
+        uint64_t reserved_preserved2:45;
+    } fields;
+};
+
+union viridian_stimer_config_msr
+{
+    uint64_t raw;
+    struct
+    {
+        uint64_t enabled:1;
+        uint64_t periodic:1;
+        uint64_t lazy:1;
+        uint64_t auto_enable:1;
+        uint64_t vector:8;
+        uint64_t direct_mode:1;
+        uint64_t reserved_zero1:3;
+        uint64_t sintx:4;
+        uint64_t reserved_zero2:44;
+    } fields;
+};
+
+#define VIRIDIAN_SINT_COUNT   16
+#define VIRIDIAN_STIMER_COUNT 4
+
+struct viridian_stimer
+{
+    struct vcpu *v;
+    struct timer timer;
+    union viridian_stimer_config_msr config;
+    uint64_t count;
+    uint64_t expiration;    /* In reference time (100ns units) */
+};
+
 struct viridian_vcpu
 {
     struct {
@@ -27,6 +81,15 @@ struct viridian_vcpu
         int vector;
     } vp_assist;
     uint64_t crash_param[5];
+    struct {
+        uint64_t scontrol;
+        union viridian_page_msr siefp;
+        union viridian_page_msr simp;
+        void *simp_va;
+        union viridian_sint_msr sint[VIRIDIAN_SINT_COUNT];
+    } synic;
+    struct viridian_stimer stimer[VIRIDIAN_STIMER_COUNT];
+    unsigned long stimer_pending;
 };
 
 union viridian_guest_os_id
@@ -117,6 +180,7 @@ viridian_hypercall(struct cpu_user_regs *regs);
 void viridian_time_ref_count_freeze(struct domain *d);
 void viridian_time_ref_count_thaw(struct domain *d);
 
+void viridian_vcpu_init(struct vcpu *v);
 void viridian_vcpu_deinit(struct vcpu *v);
 void viridian_domain_deinit(struct domain *d);
 
@@ -124,6 +188,10 @@ void viridian_start_apic_assist(struct vcpu *v, int vector);
 int viridian_complete_apic_assist(struct vcpu *v);
 void viridian_abort_apic_assist(struct vcpu *v);
 
+void viridian_poll_stimers(struct vcpu *v);
+bool viridian_synic_is_auto_eoi_sint(const struct vcpu *v, uint8_t vector);
+void viridian_migrate_timers(struct vcpu *v);
+
 #endif /* __ASM_X86_HVM_VIRIDIAN_H__ */
 
 /*
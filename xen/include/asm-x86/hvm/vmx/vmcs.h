@@ -18,6 +18,8 @@
 #ifndef __ASM_X86_HVM_VMX_VMCS_H__
 #define __ASM_X86_HVM_VMX_VMCS_H__
 
+#include <xen/tasklet.h>
+#include <xen/timer.h>
 #include <asm/hvm/io.h>
 #include <irq_vectors.h>
 
@@ -54,8 +56,23 @@ struct ept_data {
     };
     /* Set of PCPUs needing an INVEPT before a VMENTER. */
     cpumask_var_t invalidate;
+    /* Rebuilding of superpages, see ept_coalesce(). */
+    struct timer coalesce_timer;
+    struct tasklet coalesce_tasklet;
+    unsigned long coalesce_gfn;
+    unsigned long coalesced_2m, coalesced_1g;
+    /* NUMA balancing, see ept_balance(). */
+    bool_t balance;
+    struct timer balance_timer;
+    struct tasklet balance_tasklet;
+    unsigned long balance_gfn;
+    unsigned long *balance_accessed;   /* Per node, during this pass. */
+    unsigned int balance_passes;
+    unsigned int balance_node;         /* The vCPUs were steered to. */
 };
 
+extern bool_t opt_ept_coalesce;
+
 #define _VMX_DOMAIN_PML_ENABLED    0
 #define VMX_DOMAIN_PML_ENABLED     (1ul << _VMX_DOMAIN_PML_ENABLED)
 struct vmx_domain {
@@ -255,8 +272,10 @@ extern u32 vmx_secondary_exec_control;
 #define VMX_VPID_INVVPID_SINGLE_CONTEXT_RETAINING_GLOBAL 0x80000000000ULL
 extern u64 vmx_ept_vpid_cap;
 
+#define VMX_MISC_PREEMPT_TIMER_RATE             0x0000001f
 #define VMX_MISC_CR3_TARGET                     0x01ff0000
 #define VMX_MISC_VMWRITE_ALL                    0x20000000
+extern unsigned int vmx_preempt_timer_shift;
 
 #define VMX_TSC_MULTIPLIER_MAX                  0xffffffffffffffffULL
 
@@ -297,6 +316,8 @@ extern u64 vmx_ept_vpid_cap;
     (vmx_secondary_exec_control & SECONDARY_EXEC_VIRTUALIZE_X2APIC_MODE)
 #define cpu_has_vmx_posted_intr_processing \
     (vmx_pin_based_exec_control & PIN_BASED_POSTED_INTERRUPT)
+#define cpu_has_vmx_preempt_timer \
+    (vmx_pin_based_exec_control & PIN_BASED_PREEMPT_TIMER)
 #define cpu_has_vmx_vmcs_shadowing \
     (vmx_secondary_exec_control & SECONDARY_EXEC_ENABLE_VMCS_SHADOWING)
 #define cpu_has_vmx_vmfunc \
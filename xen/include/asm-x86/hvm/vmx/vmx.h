@@ -582,6 +582,9 @@ void vmx_inject_nmi(void);
 
 int ept_p2m_init(struct p2m_domain *p2m);
 void ept_p2m_uninit(struct p2m_domain *p2m);
+int ept_set_numa_balancing(struct p2m_domain *p2m, bool_t enable);
+void ept_get_numa_balancing(const struct p2m_domain *p2m, bool_t *enabled,
+                            unsigned int *node, unsigned int *passes);
 
 void ept_walk_table(struct domain *d, unsigned long gfn);
 bool_t ept_handle_misconfig(uint64_t gpa);
@@ -27,6 +27,9 @@ struct vvmcs_list {
     struct list_head node;
 };
 
+/* Number of guest state fields synchronised on virtual vmentry/vmexit. */
+#define NVMX_GSTATE_FIELDS 50
+
 struct nestedvmx {
     /*
      * vmxon_region_pa is also used to indicate whether a vcpu is in
@@ -51,6 +54,12 @@ struct nestedvmx {
     } ept;
     uint32_t guest_vpid;
     struct list_head launched_list;
+    /*
+     * Guest state last synchronised between the virtual VMCS and the
+     * shadow VMCS, so that only the fields which changed are copied.
+     */
+    uint64_t *gstate;
+    bool_t gstate_valid;
 };
 
 #define vcpu_2_nvmx(v)	(vcpu_nestedhvm(v).u.nvmx)
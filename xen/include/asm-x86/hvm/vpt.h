@@ -145,6 +145,8 @@ void pt_restore_timer(struct vcpu *v);
 int pt_update_irq(struct vcpu *v);
 void pt_intr_post(struct vcpu *v, struct hvm_intack intack);
 void pt_migrate(struct vcpu *v);
+s_time_t pt_lapic_deadline(struct vcpu *v);
+void pt_lapic_expire(struct vcpu *v);
 
 void pt_adjust_global_vcpu_target(struct vcpu *v);
 #define pt_global_vcpu_target(d) \
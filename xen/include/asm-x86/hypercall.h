@@ -5,6 +5,7 @@
 #ifndef __ASM_X86_HYPERCALL_H__
 #define __ASM_X86_HYPERCALL_H__
 
+#include <xen/time.h>
 #include <xen/types.h>
 #include <public/physdev.h>
 #include <public/event_channel.h>
@@ -25,6 +26,22 @@ typedef struct {
 
 extern const hypercall_args_t hypercall_args_table[NR_hypercalls];
 
+/* Hypercall statistics, collected with "hypercall_stats". */
+extern bool_t opt_hypercall_stats;
+
+struct hypercall_stats_ctxt {
+    s_time_t start;
+    uint32_t op, subop;
+};
+
+struct vcpu;
+struct xen_sysctl_hypercall_stats;
+void hypercall_stats_begin(struct hypercall_stats_ctxt *ctxt,
+                           unsigned int op, unsigned long arg0);
+void hypercall_stats_end(const struct hypercall_stats_ctxt *ctxt,
+                         const struct vcpu *v);
+int hypercall_stats_op(struct xen_sysctl_hypercall_stats *op);
+
 /*
  * Both do_mmuext_op() and do_mmu_update():
  * We steal the m.s.b. of the @count parameter to indicate whether this
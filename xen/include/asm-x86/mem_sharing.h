@@ -90,6 +90,10 @@ int mem_sharing_domctl(struct domain *d,
                        xen_domctl_mem_sharing_op_t *mec);
 void mem_sharing_init(void);
 
+/* Set up and tear down the pool of pages for breaking sharing. */
+void mem_sharing_domain_init(struct domain *d);
+void mem_sharing_domain_relinquish(struct domain *d);
+
 /* Scans the p2m and relinquishes any shared pages, destroying 
  * those for which this domain holds the final reference.
  * Preemptible.
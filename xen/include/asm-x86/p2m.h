@@ -29,6 +29,7 @@
 #include <xen/paging.h>
 #include <xen/p2m-common.h>
 #include <xen/mem_access.h>
+#include <xen/tasklet.h>
 #include <asm/mem_sharing.h>
 #include <asm/page.h>    /* for pagetable_t */
 
@@ -257,6 +258,16 @@ struct p2m_domain {
                                                   unsigned long first_gfn,
                                                   unsigned long last_gfn);
     void               (*memory_type_changed)(struct p2m_domain *p2m);
+    /*
+     * Set the access of up to nr entries from gfn without going through
+     * set_entry() for each, where the implementation can do so cheaply.
+     * Returns the number of gfns done, 0 when set_entry() has to deal
+     * with gfn, or -errno.  May be NULL.
+     */
+    long               (*set_access_range)(struct p2m_domain *p2m,
+                                           unsigned long gfn,
+                                           unsigned long nr,
+                                           p2m_access_t p2ma, int sve);
     
     void               (*write_p2m_entry)(struct p2m_domain *p2m,
                                           unsigned long gfn, l1_pgentry_t *p,
@@ -330,6 +341,8 @@ struct p2m_domain {
             unsigned long list[NR_POD_MRP_ENTRIES];
             unsigned int idx;
         } mrp;
+        struct tasklet   sweep_tasklet; /* Background reclamation         */
+        unsigned long    sweep_left;   /* gfns the sweep may still check   */
         mm_lock_t        lock;         /* Locking of private pod structs,   *
                                         * not relying on the p2m lock.      */
     } pod;
@@ -581,6 +594,10 @@ static inline int guest_physmap_add_page(struct domain *d,
 int guest_physmap_remove_page(struct domain *d,
                               gfn_t gfn, mfn_t mfn, unsigned int page_order);
 
+/* Free RAM mapped by a single large p2m entry in one go, if possible */
+int p2m_remove_ram_extent(struct domain *d, unsigned long gfn,
+                          unsigned int order);
+
 /* Set a p2m range as populate-on-demand */
 int guest_physmap_mark_populate_on_demand(struct domain *d, unsigned long gfn,
                                           unsigned int order);
@@ -640,6 +657,9 @@ int p2m_add_foreign(struct domain *tdom, unsigned long fgfn,
 /* Dump PoD information about the domain */
 void p2m_pod_dump_data(struct domain *d);
 
+/* Tasklet reclaiming zero pages before the PoD cache runs dry */
+void p2m_pod_background_sweep(unsigned long data);
+
 /* Move all pages from the populate-on-demand cache to the domain page_list
  * (usually in preparation for domain destruction) */
 int p2m_pod_empty_cache(struct domain *d);
@@ -685,6 +705,19 @@ int p2m_mem_paging_prep(struct domain *d, unsigned long gfn, uint64_t buffer);
 /* Resume normal operation (in case a domain was paused) */
 void p2m_mem_paging_resume(struct domain *d, vm_event_response_t *rsp);
 
+/*
+ * Move memory on nodes outside d's node affinity onto nodes within it,
+ * looking at up to nr_gfns gfns from *gfn on and advancing *gfn.
+ */
+int p2m_rehome_memory(struct domain *d, unsigned long *gfn,
+                      unsigned long nr_gfns, unsigned int *moved,
+                      unsigned int *busy);
+
+/* Move d's extent including mfn out of [avoid, avoid + nr_avoid). */
+int p2m_compact_extent(struct domain *d, mfn_t mfn, unsigned int max_order,
+                       mfn_t avoid, unsigned long nr_avoid,
+                       struct page_list_head *held, unsigned long *nr);
+
 /* 
  * Internal functions, only called by other p2m code
  */
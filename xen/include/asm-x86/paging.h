@@ -156,6 +156,9 @@ void paging_log_dirty_init(struct domain *d, const struct log_dirty_ops *ops);
 void paging_mark_dirty(struct domain *d, mfn_t gmfn);
 /* mark a page as dirty with taking guest pfn as parameter */
 void paging_mark_pfn_dirty(struct domain *d, pfn_t pfn);
+/* mark a batch of guest pfns as dirty */
+void paging_mark_pfns_dirty(struct domain *d, const unsigned long *pfns,
+                            unsigned int nr);
 
 /* is this guest page dirty? 
  * This is called from inside paging code, with the paging lock held. */
@@ -15,21 +15,25 @@ PERFCOUNTER_ARRAY(svmexits,             "SVMexits", SVM_PERF_EXIT_REASON_SIZE)
 
 PERFCOUNTER(seg_fixups,             "segmentation fixups")
 
+PERFCOUNTER_DOM(guest_cpuid,        "guest CPUID executions")
+
 PERFCOUNTER(apic_timer,             "apic timer interrupts")
 
 PERFCOUNTER(domain_page_tlb_flush,  "domain page tlb flushes")
+PERFCOUNTER(domain_page_hash_reclaim, "domain page hash reclaims")
 
 PERFCOUNTER(calls_to_mmuext_op,         "calls to mmuext_op")
 PERFCOUNTER(num_mmuext_ops,             "mmuext ops")
-PERFCOUNTER(calls_to_mmu_update,        "calls to mmu_update")
+PERFCOUNTER_DOM(calls_to_mmu_update,    "calls to mmu_update")
 PERFCOUNTER(num_page_updates,           "page updates")
 PERFCOUNTER(writable_mmu_updates,       "mmu_updates of writable pages")
 PERFCOUNTER(calls_to_update_va,         "calls to update_va_map")
-PERFCOUNTER(page_faults,            "page faults")
+PERFCOUNTER_DOM(page_faults,        "page faults")
 PERFCOUNTER(copy_user_faults,       "copy_user faults")
 
 PERFCOUNTER(map_domain_page_count,  "map_domain_page count")
-PERFCOUNTER(ptwr_emulations,        "writable pt emulations")
+PERFCOUNTER(map_domain_page_hit,    "map_domain_page hash hits")
+PERFCOUNTER_DOM(ptwr_emulations,    "writable pt emulations")
 
 PERFCOUNTER(exception_fixed,        "pre-exception fixed")
 
@@ -47,7 +51,7 @@ PERFCOUNTER(shadow_prealloc_2,     "shadow recycles in-use shadows")
 PERFCOUNTER(shadow_linear_map_failed, "shadow hit read-only linear map")
 PERFCOUNTER(shadow_a_update,       "shadow A bit update")
 PERFCOUNTER(shadow_ad_update,      "shadow A&D bit update")
-PERFCOUNTER(shadow_fault,          "calls to shadow_fault")
+PERFCOUNTER_DOM(shadow_fault,      "calls to shadow_fault")
 PERFCOUNTER(shadow_fault_fast_gnp, "shadow_fault fast path n/p")
 PERFCOUNTER(shadow_fault_fast_mmio, "shadow_fault fast path mmio")
 PERFCOUNTER(shadow_fault_fast_fail, "shadow_fault fast path error")
@@ -55,14 +59,14 @@ PERFCOUNTER(shadow_fault_bail_bad_gfn, "shadow_fault guest bad gfn")
 PERFCOUNTER(shadow_fault_bail_real_fault, 
                                         "shadow_fault really guest fault")
 PERFCOUNTER(shadow_fault_emulate_read, "shadow_fault emulates a read")
-PERFCOUNTER(shadow_fault_emulate_write, "shadow_fault emulates a write")
+PERFCOUNTER_DOM(shadow_fault_emulate_write, "shadow_fault emulates a write")
 PERFCOUNTER(shadow_fault_emulate_failed, "shadow_fault emulator fails")
 PERFCOUNTER(shadow_fault_emulate_stack, "shadow_fault emulate stack write")
 PERFCOUNTER(shadow_fault_emulate_wp, "shadow_fault emulate for CR0.WP=0")
 PERFCOUNTER(shadow_fault_fast_emulate, "shadow_fault fast emulate")
 PERFCOUNTER(shadow_fault_fast_emulate_fail,
                                    "shadow_fault fast emulate failed")
-PERFCOUNTER(shadow_fault_mmio,     "shadow_fault handled as mmio")
+PERFCOUNTER_DOM(shadow_fault_mmio, "shadow_fault handled as mmio")
 PERFCOUNTER(shadow_fault_fixed,    "shadow_fault fixed fault")
 PERFCOUNTER(shadow_ptwr_emulate,   "shadow causes ptwr to emulate")
 PERFCOUNTER(shadow_validate_gl1e_calls, "calls to shadow_validate_gl1e")
@@ -116,6 +120,8 @@ PERFCOUNTER(mshv_call_flush_tlb_list,   "MS Hv Flush TLB list")
 PERFCOUNTER(mshv_call_flush_tlb_all,    "MS Hv Flush TLB all")
 PERFCOUNTER(mshv_call_long_wait,        "MS Hv Notify long wait")
 PERFCOUNTER(mshv_call_flush,            "MS Hv Flush TLB")
+PERFCOUNTER(mshv_call_flush_ex,         "MS Hv Flush TLB Ex")
+PERFCOUNTER(mshv_call_send_ipi,         "MS Hv Send Synthetic IPI")
 PERFCOUNTER(mshv_rdmsr_osid,            "MS Hv rdmsr Guest OS ID")
 PERFCOUNTER(mshv_rdmsr_hc_page,         "MS Hv rdmsr hypercall page")
 PERFCOUNTER(mshv_rdmsr_vp_index,        "MS Hv rdmsr vp index")
@@ -136,10 +142,21 @@ PERFCOUNTER(mshv_wrmsr_eoi,             "MS Hv wrmsr eoi")
 PERFCOUNTER(mshv_wrmsr_apic_assist,     "MS Hv wrmsr APIC assist")
 PERFCOUNTER(mshv_wrmsr_apic_msr,        "MS Hv wrmsr APIC msr")
 PERFCOUNTER(mshv_wrmsr_tsc_msr,         "MS Hv wrmsr TSC msr")
+PERFCOUNTER(mshv_wrmsr_simp,            "MS Hv wrmsr SynIC message page")
+PERFCOUNTER(mshv_wrmsr_eom,             "MS Hv wrmsr SynIC EOM")
+PERFCOUNTER(mshv_wrmsr_stimer,          "MS Hv wrmsr synthetic timer")
+PERFCOUNTER(mshv_stimer_expired,        "MS Hv synthetic timer expired")
 
+PERFCOUNTER_DOM(hvm_emulations,  "HVM instructions emulated")
 PERFCOUNTER(realmode_emulations, "realmode instructions emulated")
 PERFCOUNTER(realmode_exits,      "vmexits from realmode")
 
 PERFCOUNTER(pauseloop_exits, "vmexits from Pause-Loop Detection")
 
+PERFCOUNTER(insn_cache_hits,     "emulated instructions fetched cached")
+PERFCOUNTER(insn_cache_misses,   "emulated instructions fetched uncached")
+
+PERFCOUNTER(pirq_remote_deliveries, "guest MSIs delivered away from their vCPU")
+PERFCOUNTER(pirq_follow_moves,      "guest MSIs moved on remote delivery")
+
 /*#endif*/ /* __XEN_PERFC_DEFN_H__ */
@@ -65,6 +65,8 @@
 /* 'arch_vcpu' flags values */
 #define _TF_kernel_mode        0
 #define TF_kernel_mode         (1<<_TF_kernel_mode)
+#define _TF_flush_user         1
+#define TF_flush_user          (1<<_TF_flush_user)
 
 /* #PF error code values. */
 #define PFEC_page_present   (_AC(1,U) << 0)
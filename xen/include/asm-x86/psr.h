@@ -23,6 +23,7 @@
 
 /* Resource Type Enumeration */
 #define PSR_RESOURCE_TYPE_L3            0x2
+#define PSR_RESOURCE_TYPE_MBA           0x8
 
 /* L3 Monitoring Features */
 #define PSR_CMT_L3_OCCUPANCY           0x1
@@ -30,6 +31,9 @@
 /* CDP Capability */
 #define PSR_CAT_CDP_CAPABILITY       (1u << 2)
 
+/* MBA linear throttling Capability */
+#define PSR_MBA_LINEAR_CAPABILITY    (1u << 2)
+
 /* L3 CDP Enable bit*/
 #define PSR_L3_QOS_CDP_ENABLE_BIT       0x0
 
@@ -70,6 +74,12 @@ int psr_get_l3_cbm(struct domain *d, unsigned int socket,
 int psr_set_l3_cbm(struct domain *d, unsigned int socket,
                    uint64_t cbm, enum cbm_type type);
 
+int psr_get_mba_info(unsigned int socket, uint32_t *thrtl_max,
+                     uint32_t *cos_max, uint32_t *flags);
+int psr_get_mba_thrtl(struct domain *d, unsigned int socket,
+                      uint32_t *thrtl);
+int psr_set_mba_thrtl(struct domain *d, unsigned int socket, uint32_t thrtl);
+
 int psr_domain_init(struct domain *d);
 void psr_domain_free(struct domain *d);
 
@@ -83,6 +83,9 @@ void sh_remove_shadows(struct domain *d, mfn_t gmfn, int fast, int all);
 /* Discard _all_ mappings from the domain's shadows. */
 void shadow_blow_tables_per_domain(struct domain *d);
 
+/* Print the domain's shadow statistics. */
+void shadow_dump_domain_info(struct domain *d);
+
 /* Set the pool of shadow pages to the required number of pages.
  * Input will be rounded up to at least shadow_min_acceptable_pages(),
  * plus space for the p2m table.
@@ -106,6 +109,8 @@ static inline void sh_remove_shadows(struct domain *d, mfn_t gmfn,
 
 static inline void shadow_blow_tables_per_domain(struct domain *d) {}
 
+static inline void shadow_dump_domain_info(struct domain *d) {}
+
 static inline int shadow_domctl(struct domain *d, xen_domctl_shadow_op_t *sc,
                                 XEN_GUEST_HANDLE_PARAM(void) u_domctl)
 {
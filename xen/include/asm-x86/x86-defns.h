@@ -42,6 +42,12 @@
 #define X86_CR0_CD              0x40000000 /* Cache Disable            (RW) */
 #define X86_CR0_PG              0x80000000 /* Paging                   (RW) */
 
+/*
+ * Intel CPU flags in CR3
+ */
+#define X86_CR3_NOFLUSH    0x8000000000000000 /* don't flush the new PCID */
+#define X86_CR3_PCID_MASK  0x0000000000000fff /* PCID (with CR4.PCIDE) */
+
 /*
  * Intel CPU features in CR4
  */
@@ -37,7 +37,7 @@
 #include "hvm/save.h"
 #include "memory.h"
 
-#define XEN_DOMCTL_INTERFACE_VERSION 0x0000000d
+#define XEN_DOMCTL_INTERFACE_VERSION 0x0000000e
 
 /*
  * NB. xen_domctl.domain is an IN/OUT parameter for this operation.
@@ -220,6 +220,16 @@ struct xen_domctl_getpageframeinfo3 {
   * writably by the hypervisor in the dirty bitmap.
   */
 #define XEN_DOMCTL_SHADOW_LOGDIRTY_FINAL   (1 << 0)
+ /*
+  * Return the dirty pages of [start_pfn, start_pfn + nr_pfns) as a list of
+  * extents instead of a bitmap, and (OP_CLEAN) only clean that range.  The
+  * cost of the operation is proportional to the number of dirty pages
+  * rather than to the size of the guest.  The call may stop early, either
+  * because the extents buffer is full or to allow preemption, in which case
+  * start_pfn and nr_pfns are updated to describe the part of the range still
+  * to be scanned, and the call should be repeated.
+  */
+#define XEN_DOMCTL_SHADOW_LOGDIRTY_EXTENTS (1 << 1)
 
 struct xen_domctl_shadow_op_stats {
     uint32_t fault_count;
@@ -228,6 +238,14 @@ struct xen_domctl_shadow_op_stats {
 typedef struct xen_domctl_shadow_op_stats xen_domctl_shadow_op_stats_t;
 DEFINE_XEN_GUEST_HANDLE(xen_domctl_shadow_op_stats_t);
 
+/* A run of nr dirty pages starting at pfn. */
+struct xen_domctl_shadow_op_extent {
+    uint64_aligned_t pfn;
+    uint64_aligned_t nr;
+};
+typedef struct xen_domctl_shadow_op_extent xen_domctl_shadow_op_extent_t;
+DEFINE_XEN_GUEST_HANDLE(xen_domctl_shadow_op_extent_t);
+
 struct xen_domctl_shadow_op {
     /* IN variables. */
     uint32_t       op;       /* XEN_DOMCTL_SHADOW_OP_* */
@@ -243,6 +261,13 @@ struct xen_domctl_shadow_op {
     XEN_GUEST_HANDLE_64(uint8) dirty_bitmap;
     uint64_aligned_t pages; /* Size of buffer. Updated with actual size. */
     struct xen_domctl_shadow_op_stats stats;
+
+    /* OP_PEEK / OP_CLEAN with XEN_DOMCTL_SHADOW_LOGDIRTY_EXTENTS */
+    XEN_GUEST_HANDLE_64(xen_domctl_shadow_op_extent_t) extents;
+    uint64_aligned_t start_pfn; /* IN/OUT: First pfn (still) to scan. */
+    uint64_aligned_t nr_pfns;   /* IN/OUT: Number of pfns (still) to scan. */
+    uint32_t nr_extents;        /* IN: Size of buffer. OUT: Extents written. */
+    uint32_t pad;
 };
 typedef struct xen_domctl_shadow_op xen_domctl_shadow_op_t;
 DEFINE_XEN_GUEST_HANDLE(xen_domctl_shadow_op_t);
@@ -806,6 +831,10 @@ struct xen_domctl_gdbsx_domstatus {
  * control these rings (enable/disable), as well as to signal
  * to the hypervisor to pull responses (resume) from the given
  * ring.
+ *
+ * XEN_VM_EVENT_RESUME pulls every response queued on the ring, so a helper
+ * can acknowledge any number of events with one hypercall (or one
+ * notification of the ring's event channel).
  */
 #define XEN_VM_EVENT_ENABLE               0
 #define XEN_VM_EVENT_DISABLE              1
@@ -873,7 +902,16 @@ struct xen_domctl_vm_event_op {
     uint32_t       mode;         /* XEN_DOMCTL_VM_EVENT_OP_* */
 
     uint32_t port;              /* OUT: event channel for ring */
+
+    /*
+     * IN: ENABLE: number of ring pages, at the gfn held in the ring's
+     * HVM_PARAM and the ones following it.  0 stands for a single page.
+     * A larger ring lets more events be in flight before vCPUs have to
+     * wait for room.
+     */
+    uint32_t ring_pages;
 };
+#define XEN_VM_EVENT_MAX_RING_PAGES      16
 typedef struct xen_domctl_vm_event_op xen_domctl_vm_event_op_t;
 DEFINE_XEN_GUEST_HANDLE(xen_domctl_vm_event_op_t);
 
@@ -881,14 +919,22 @@ DEFINE_XEN_GUEST_HANDLE(xen_domctl_vm_event_op_t);
  * Memory sharing operations
  */
 /* XEN_DOMCTL_mem_sharing_op.
- * The CONTROL sub-domctl is used for bringup/teardown. */
+ * The CONTROL sub-domctl is used for bringup/teardown.
+ * The POOL sub-domctl sets the number of pages Xen keeps allocated for
+ * breaking the sharing of pages of the domain, and returns the number
+ * currently held. */
 #define XEN_DOMCTL_MEM_SHARING_CONTROL          0
+#define XEN_DOMCTL_MEM_SHARING_POOL             1
 
 struct xen_domctl_mem_sharing_op {
     uint8_t op; /* XEN_DOMCTL_MEM_SHARING_* */
 
     union {
         uint8_t enable;                   /* CONTROL */
+        struct {                          /* POOL */
+            uint32_t target;              /* IN: pages to keep */
+            uint32_t count;               /* OUT: pages held */
+        } pool;
     } u;
 };
 typedef struct xen_domctl_mem_sharing_op xen_domctl_mem_sharing_op_t;
@@ -1134,6 +1180,9 @@ struct xen_domctl_psr_cat_op {
 #define XEN_DOMCTL_PSR_CAT_OP_SET_L3_DATA    3
 #define XEN_DOMCTL_PSR_CAT_OP_GET_L3_CODE    4
 #define XEN_DOMCTL_PSR_CAT_OP_GET_L3_DATA    5
+/* Memory bandwidth throttling (MBA), as a delay in % (0: unthrottled). */
+#define XEN_DOMCTL_PSR_CAT_OP_SET_MBA_THRTL  6
+#define XEN_DOMCTL_PSR_CAT_OP_GET_MBA_THRTL  7
     uint32_t cmd;       /* IN: XEN_DOMCTL_PSR_CAT_OP_* */
     uint32_t target;    /* IN */
     uint64_t data;      /* IN/OUT */
@@ -1141,6 +1190,111 @@ struct xen_domctl_psr_cat_op {
 typedef struct xen_domctl_psr_cat_op xen_domctl_psr_cat_op_t;
 DEFINE_XEN_GUEST_HANDLE(xen_domctl_psr_cat_op_t);
 
+/*
+ * XEN_DOMCTL_get_destroy_progress: report how far XEN_DOMCTL_destroydomain
+ * has got with tearing down a domain, e.g. for the toolstack to show while
+ * it waits. Once the domain is fully gone the domctl fails with -ESRCH.
+ * A DONE domain may still own pages which other domains hold references to.
+ */
+#define XEN_DOMCTL_DESTROY_NOT_STARTED 0
+#define XEN_DOMCTL_DESTROY_RUNNING     1
+#define XEN_DOMCTL_DESTROY_DONE        2
+struct xen_domctl_destroy_progress {
+    uint32_t state;                /* OUT: XEN_DOMCTL_DESTROY_* */
+    uint32_t pad;
+    uint64_aligned_t pages_total;  /* OUT: pages owned when teardown began */
+    uint64_aligned_t pages_left;   /* OUT: pages still owned */
+};
+typedef struct xen_domctl_destroy_progress xen_domctl_destroy_progress_t;
+DEFINE_XEN_GUEST_HANDLE(xen_domctl_destroy_progress_t);
+
+/*
+ * XEN_DOMCTL_set_idle_latency: limit the exit latency of the C-states a
+ * physical CPU may enter once it goes idle after running one of the
+ * domain's vCPUs, so that waking that vCPU up again stays quick.
+ */
+struct xen_domctl_idle_latency {
+    uint32_t max_exit_us;          /* IN: 0 for no limit */
+};
+typedef struct xen_domctl_idle_latency xen_domctl_idle_latency_t;
+DEFINE_XEN_GUEST_HANDLE(xen_domctl_idle_latency_t);
+
+/*
+ * XEN_DOMCTL_rehome_memory: move the memory of a translated domain which
+ * lies on nodes outside its node affinity onto nodes within it, e.g. after
+ * the domain was moved to a cpupool on other nodes.  Looks at up to nr_gfns
+ * gfns from gfn on, with the domain paused, and may stop early to allow for
+ * preemption; the caller iterates until gfn exceeds max_gfn.  Pages which
+ * anything beyond the domain's own p2m holds a reference to (e.g. mappings
+ * by other domains) stay where they are and are counted as busy.  Fails
+ * with -EOPNOTSUPP for PV domains and for domains with passthrough devices,
+ * and with -ENOMEM once the nodes in the affinity run out of memory.
+ */
+struct xen_domctl_rehome_memory {
+    uint64_aligned_t gfn;          /* IN/OUT: next gfn to look at */
+    uint64_aligned_t nr_gfns;      /* IN */
+    uint64_aligned_t max_gfn;      /* OUT: highest gfn of the domain */
+    uint32_t moved;                /* OUT: pages moved */
+    uint32_t busy;                 /* OUT: pages left in place */
+};
+typedef struct xen_domctl_rehome_memory xen_domctl_rehome_memory_t;
+DEFINE_XEN_GUEST_HANDLE(xen_domctl_rehome_memory_t);
+
+/*
+ * XEN_DOMCTL_numa_balancing: turn automatic NUMA balancing of an HVM
+ * domain on or off, or look at its state.  While on, Xen samples the EPT
+ * accessed bits of the domain's memory and, once most of what is being
+ * accessed lies on one node, sets the soft affinity of all vCPUs to that
+ * node's CPUs (within the domain's cpupool), overriding what the toolstack
+ * set.  Fails with -EOPNOTSUPP without HAP on VMX with EPT A/D bits.
+ */
+#define XEN_DOMCTL_NUMA_BALANCING_SET   0
+#define XEN_DOMCTL_NUMA_BALANCING_GET   1
+struct xen_domctl_numa_balancing {
+    uint32_t op;                   /* IN: XEN_DOMCTL_NUMA_BALANCING_* */
+    uint32_t enable;               /* IN (SET) / OUT (GET) */
+    uint32_t node;                 /* OUT: node steered to, ~0 if none */
+    uint32_t passes;               /* OUT: passes over the p2m done */
+};
+typedef struct xen_domctl_numa_balancing xen_domctl_numa_balancing_t;
+DEFINE_XEN_GUEST_HANDLE(xen_domctl_numa_balancing_t);
+
+/*
+ * XEN_DOMCTL_set_evtchn_priority: default FIFO priorities (0 highest,
+ * EVTCHN_FIFO_PRIORITY_MIN lowest) for the domain's event channels, by
+ * what they are bound to.  A port takes the priority of its class when
+ * bound, or when the guest switches to the FIFO ABI; the guest may still
+ * change it with EVTCHNOP_set_priority.  Unbound ports count as
+ * interdomain ones.
+ */
+#define XEN_DOMCTL_EVTCHN_CLASS_TIMER       0 /* VIRQ_TIMER */
+#define XEN_DOMCTL_EVTCHN_CLASS_VIRQ        1 /* other VIRQs */
+#define XEN_DOMCTL_EVTCHN_CLASS_IPI         2
+#define XEN_DOMCTL_EVTCHN_CLASS_PIRQ        3
+#define XEN_DOMCTL_EVTCHN_CLASS_INTERDOMAIN 4
+#define XEN_DOMCTL_EVTCHN_CLASS_NR          5
+struct xen_domctl_set_evtchn_priority {
+    uint8_t priority[XEN_DOMCTL_EVTCHN_CLASS_NR]; /* IN */
+    uint8_t pad[3];                               /* IN: must be zero */
+};
+typedef struct xen_domctl_set_evtchn_priority xen_domctl_set_evtchn_priority_t;
+DEFINE_XEN_GUEST_HANDLE(xen_domctl_set_evtchn_priority_t);
+
+/*
+ * XEN_DOMCTL_pause_loop_stats: PAUSE-loop exits (VMX PLE, SVM pause
+ * filter) of an HVM domain's vcpus since it was created, and how many of
+ * them Xen turned into a directed yield to a preempted vcpu of the domain
+ * (the likely lock holder), rather than a plain yield.  Meant for tuning
+ * the ple_gap and ple_window command line options.  The counts are
+ * approximate.
+ */
+struct xen_domctl_pause_loop_stats {
+    uint64_aligned_t exits;        /* OUT */
+    uint64_aligned_t directed;     /* OUT */
+};
+typedef struct xen_domctl_pause_loop_stats xen_domctl_pause_loop_stats_t;
+DEFINE_XEN_GUEST_HANDLE(xen_domctl_pause_loop_stats_t);
+
 struct xen_domctl {
     uint32_t cmd;
 #define XEN_DOMCTL_createdomain                   1
@@ -1218,6 +1372,12 @@ struct xen_domctl {
 #define XEN_DOMCTL_monitor_op                    77
 #define XEN_DOMCTL_psr_cat_op                    78
 #define XEN_DOMCTL_soft_reset                    79
+#define XEN_DOMCTL_get_destroy_progress          80
+#define XEN_DOMCTL_set_idle_latency              81
+#define XEN_DOMCTL_rehome_memory                 82
+#define XEN_DOMCTL_numa_balancing                83
+#define XEN_DOMCTL_set_evtchn_priority           84
+#define XEN_DOMCTL_pause_loop_stats              85
 #define XEN_DOMCTL_gdbsx_guestmemio            1000
 #define XEN_DOMCTL_gdbsx_pausevcpu             1001
 #define XEN_DOMCTL_gdbsx_unpausevcpu           1002
@@ -1280,8 +1440,19 @@ struct xen_domctl {
         struct xen_domctl_psr_cmt_op        psr_cmt_op;
         struct xen_domctl_monitor_op        monitor_op;
         struct xen_domctl_psr_cat_op        psr_cat_op;
+        struct xen_domctl_destroy_progress  destroy_progress;
+        struct xen_domctl_idle_latency      idle_latency;
+        struct xen_domctl_rehome_memory     rehome_memory;
+        struct xen_domctl_numa_balancing    numa_balancing;
+        struct xen_domctl_set_evtchn_priority set_evtchn_priority;
+        struct xen_domctl_pause_loop_stats  pause_loop_stats;
         uint8_t                             pad[128];
     } u;
+    /*
+     * OUT: time spent in the hypervisor handling this domctl, in ns.  For
+     * preemptible operations this only covers the final continuation.
+     */
+    uint64_aligned_t cost_ns;
 };
 typedef struct xen_domctl xen_domctl_t;
 DEFINE_XEN_GUEST_HANDLE(xen_domctl_t);
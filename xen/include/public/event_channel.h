@@ -74,6 +74,7 @@
 #define EVTCHNOP_init_control    11
 #define EVTCHNOP_expand_array    12
 #define EVTCHNOP_set_priority    13
+#define EVTCHNOP_send_multi      14
 /* ` } */
 
 typedef uint32_t evtchn_port_t;
@@ -195,6 +196,24 @@ struct evtchn_send {
 };
 typedef struct evtchn_send evtchn_send_t;
 
+/*
+ * EVTCHNOP_send_multi: As EVTCHNOP_send, for each of the first <nr_ports>
+ * local ports in <ports>.  Ports are notified in order; if one fails, the
+ * error is returned, the ports preceding it have been notified and the
+ * remaining ones have not.  A vCPU that is the target of several of the
+ * ports is only notified once, after all ports have been processed.
+ * <nr_ports> may be at most EVTCHN_SEND_MULTI_MAX.  Only the first
+ * <nr_ports> elements of <ports> need to be valid guest memory.
+ */
+#define EVTCHN_SEND_MULTI_MAX 64
+struct evtchn_send_multi {
+    /* IN parameters. */
+    uint32_t nr_ports;
+    evtchn_port_t ports[EVTCHN_SEND_MULTI_MAX];
+};
+typedef struct evtchn_send_multi evtchn_send_multi_t;
+DEFINE_XEN_GUEST_HANDLE(evtchn_send_multi_t);
+
 /*
  * EVTCHNOP_status: Get the current status of the communication channel which
  * has an endpoint at <dom, port>.
@@ -63,14 +63,21 @@ typedef uint16_t ioservid_t;
  * <handle_bufioreq> should be one of HVM_IOREQSRV_BUFIOREQ_* defined in
  * hvm_op.h. If the value is HVM_IOREQSRV_BUFIOREQ_OFF then  the buffered
  * ioreq ring will not be allocated and hence all emulation requests to
- * this server will be synchronous.
+ * this server will be synchronous.  Otherwise the ring spans
+ * 2^<bufioreq_order> contiguous gmfns, starting at the <bufioreq_pfn>
+ * handed back by XEN_DMOP_get_ioreq_server_info (see IOREQ_BUFFER_SLOTS()
+ * in ioreq.h), so that bursts of buffered writes are less likely to find
+ * it full and fall back to synchronous emulation.
  */
 #define XEN_DMOP_create_ioreq_server 1
 
 struct xen_dm_op_create_ioreq_server {
     /* IN - should server handle buffered ioreqs */
     uint8_t handle_bufioreq;
-    uint8_t pad[3];
+    /* IN - log2 of the number of pages of the buffered ioreq ring */
+    uint8_t bufioreq_order;
+#define XEN_DMOP_BUFIOREQ_MAX_ORDER 3
+    uint8_t pad[2];
     /* OUT - server id */
     ioservid_t id;
 };
@@ -344,6 +351,91 @@ struct xen_dm_op_map_mem_type_to_ioreq_server {
                            has to be set to zero by the caller */
 };
 
+/*
+ * XEN_DMOP_complete_ioreqs: Wake up the vCPUs whose synchronous emulation
+ *                           request to IOREQ Server <id> has been
+ *                           completed.
+ *
+ * This is an alternative to notifying the event channel of each vCPU
+ * whose ioreq was moved to STATE_IORESP_READY, for an emulator completing
+ * several requests at once.
+ */
+#define XEN_DMOP_complete_ioreqs 16
+
+struct xen_dm_op_complete_ioreqs {
+    /* IN - server id */
+    ioservid_t id;
+    uint16_t pad;
+};
+
+/*
+ * XEN_DMOP_get_ioreq_server_stats: Get the numbers of emulation requests
+ *                                  sent to IOREQ Server <id>.
+ *
+ * Requests are counted when sent, synchronously or through the buffered
+ * ring, by type and by access size.  <ring_full> counts the buffered
+ * requests which found the ring full, and were sent synchronously
+ * instead.  Counters are approximate.
+ */
+#define XEN_DMOP_get_ioreq_server_stats 17
+
+struct xen_dm_op_get_ioreq_server_stats {
+    /* IN - server id */
+    ioservid_t id;
+    uint16_t pad0;
+    uint32_t pad1;
+    /* OUT - requests sent synchronously, through the ring, ring found full */
+    uint64_aligned_t sync;
+    uint64_aligned_t buffered;
+    uint64_aligned_t ring_full;
+    /* OUT - requests by type */
+    uint64_aligned_t pio;
+    uint64_aligned_t copy;
+    uint64_aligned_t pci_config;
+    uint64_aligned_t other_type;
+    /* OUT - requests by size: 1, 2, 4, 8 bytes, other */
+    uint64_aligned_t size[5];
+};
+
+/*
+ * XEN_DMOP_map_io_event_to_ioreq_server: Have writes to a port or MMIO
+ *                                        address signal an event
+ *                                        channel of IOREQ Server <id>.
+ * XEN_DMOP_unmap_io_event_from_ioreq_server: Deregister an I/O event
+ *                                            previously registered with
+ *                                            the same parameters.
+ *
+ * A write of exactly <size> bytes to <addr> (and, with
+ * XEN_DMOP_IO_EVENT_DATAMATCH, of the value <data>) is completed by Xen
+ * without sending an emulation request: the event channel handed back in
+ * <port>, which the emulator should bind, is notified instead, much like
+ * KVM's ioeventfd.  This suits doorbell registers, such as virtio queue
+ * notifications, where the emulator does not need the written value.
+ * Other accesses go through the normal emulation path, and events are
+ * only signalled while the IOREQ Server is enabled.
+ */
+#define XEN_DMOP_map_io_event_to_ioreq_server 18
+#define XEN_DMOP_unmap_io_event_from_ioreq_server 19
+
+struct xen_dm_op_ioreq_server_io_event {
+    /* IN - server id */
+    ioservid_t id;
+    /* IN - size of the write: 1, 2, 4 or 8 bytes */
+    uint8_t size;
+    /* IN - flags */
+    uint8_t flags;
+#define XEN_DMOP_IO_EVENT_DATAMATCH (1u << 0)
+    /* IN - XEN_DMOP_IO_RANGE_PORT or XEN_DMOP_IO_RANGE_MEMORY */
+    uint32_t type;
+    /* IN - address written */
+    uint64_aligned_t addr;
+    /* IN - value written, with XEN_DMOP_IO_EVENT_DATAMATCH */
+    uint64_aligned_t data;
+    /* OUT - event channel notified (map only) */
+    evtchn_port_t port;
+    uint32_t pad;
+};
+
 struct xen_dm_op {
     uint32_t op;
     uint32_t pad;
@@ -364,6 +456,11 @@ struct xen_dm_op {
         struct xen_dm_op_inject_msi inject_msi;
         struct xen_dm_op_map_mem_type_to_ioreq_server
                 map_mem_type_to_ioreq_server;
+        struct xen_dm_op_complete_ioreqs complete_ioreqs;
+        struct xen_dm_op_get_ioreq_server_stats get_ioreq_server_stats;
+        struct xen_dm_op_ioreq_server_io_event map_io_event_to_ioreq_server;
+        struct xen_dm_op_ioreq_server_io_event
+                unmap_io_event_from_ioreq_server;
     } u;
 };
 
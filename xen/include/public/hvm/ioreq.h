@@ -98,6 +98,15 @@ struct buffered_iopage {
 }; /* NB. Size of this structure must be no greater than one page. */
 typedef struct buffered_iopage buffered_iopage_t;
 
+/*
+ * A buffered ring may span several contiguous pages (see bufioreq_order in
+ * XEN_DMOP_create_ioreq_server).  Its slots then continue past the end of
+ * struct buffered_iopage into the following pages, for a total of
+ * IOREQ_BUFFER_SLOTS(<number of pages>), and the read and write pointers
+ * are taken modulo that number.
+ */
+#define IOREQ_BUFFER_SLOTS(pages) ((pages) * 512 - 1)
+
 /*
  * ACPI Control/Event register locations. Location is controlled by a 
  * version number in HVM_PARAM_ACPI_IOPORTS_LOCATION.
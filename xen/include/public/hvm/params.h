@@ -139,6 +139,22 @@
 #define _HVMPV_crash_ctl 6
 #define HVMPV_crash_ctl (1 << _HVMPV_crash_ctl)
 
+/* Use Hypercall for IPIs */
+#define _HVMPV_hcall_ipi 7
+#define HVMPV_hcall_ipi (1 << _HVMPV_hcall_ipi)
+
+/* Enable the 'Ex' variants of the TLB flush and IPI hypercalls */
+#define _HVMPV_ex_processor_masks 8
+#define HVMPV_ex_processor_masks (1 << _HVMPV_ex_processor_masks)
+
+/* Enable the synthetic interrupt controller (SynIC) MSRs */
+#define _HVMPV_synic 9
+#define HVMPV_synic (1 << _HVMPV_synic)
+
+/* Enable synthetic timers (requires synic and time_ref_count) */
+#define _HVMPV_stimer 10
+#define HVMPV_stimer (1 << _HVMPV_stimer)
+
 #define HVMPV_feature_mask \
         (HVMPV_base_freq | \
          HVMPV_no_freq | \
@@ -146,7 +162,11 @@
          HVMPV_reference_tsc | \
          HVMPV_hcall_remote_tlb_flush | \
          HVMPV_apic_assist | \
-         HVMPV_crash_ctl)
+         HVMPV_crash_ctl | \
+         HVMPV_hcall_ipi | \
+         HVMPV_ex_processor_masks | \
+         HVMPV_synic | \
+         HVMPV_stimer)
 
 #endif
 
@@ -274,6 +294,14 @@
  */
 #define HVM_PARAM_VM86_TSS_SIZED 37
 
-#define HVM_NR_PARAMS 38
+/*
+ * Boolean: Do not run periodic vpts while their vcpu is blocked. Ticks
+ * missed meanwhile are accounted on wakeup, according to the timer mode.
+ * Only suitable for guests which do not rely on periodic platform timer
+ * interrupts to wake from idle.
+ */
+#define HVM_PARAM_VPT_LAZY 38
+
+#define HVM_NR_PARAMS 39
 
 #endif /* __XEN_PUBLIC_HVM_PARAMS_H__ */
@@ -389,6 +389,9 @@ typedef struct xen_pod_target xen_pod_target_t;
 #define XENMEM_paging_op_nominate           0
 #define XENMEM_paging_op_evict              1
 #define XENMEM_paging_op_prep               2
+#define XENMEM_paging_op_nominate_batch     3
+#define XENMEM_paging_op_evict_batch        4
+#define XENMEM_paging_op_prep_batch         5
 
 struct xen_mem_paging_op {
     uint8_t     op;         /* XENMEM_paging_op_* */
@@ -402,6 +405,31 @@ struct xen_mem_paging_op {
 typedef struct xen_mem_paging_op xen_mem_paging_op_t;
 DEFINE_XEN_GUEST_HANDLE(xen_mem_paging_op_t);
 
+/*
+ * The *_batch ops do the op for each entry of a list, and take a
+ * struct xen_mem_paging_batch_op, which has the size and the first two
+ * fields of struct xen_mem_paging_op.  Entries fail independently.
+ */
+struct xen_mem_paging_batch_entry {
+    uint64_aligned_t gfn;           /* IN: gfn of the page */
+    uint64_aligned_t buffer;        /* IN: as for PAGING_PREP (prep only) */
+    int32_t rc;                     /* OUT: 0 or -errno for this entry */
+    uint32_t _pad;                  /* Must be set to 0 */
+};
+typedef struct xen_mem_paging_batch_entry xen_mem_paging_batch_entry_t;
+DEFINE_XEN_GUEST_HANDLE(xen_mem_paging_batch_entry_t);
+
+struct xen_mem_paging_batch_op {
+    uint8_t     op;         /* XENMEM_paging_op_*_batch */
+    domid_t     domain;
+    uint32_t    nr;         /* IN: number of entries */
+    XEN_GUEST_HANDLE_64(xen_mem_paging_batch_entry_t) entries;
+    uint32_t    done;       /* Must be set to 0 */
+    uint32_t    _pad;       /* Must be set to 0 */
+};
+typedef struct xen_mem_paging_batch_op xen_mem_paging_batch_op_t;
+DEFINE_XEN_GUEST_HANDLE(xen_mem_paging_batch_op_t);
+
 #define XENMEM_access_op                    21
 #define XENMEM_access_op_set_access         0
 #define XENMEM_access_op_get_access         1
@@ -413,6 +441,15 @@ DEFINE_XEN_GUEST_HANDLE(xen_mem_paging_op_t);
  * #define XENMEM_access_op_disable_emulate    3
  */
 #define XENMEM_access_op_set_access_multi   4
+/*
+ * XENMEM_access_op_get_access_range reports the access of the nr pages
+ * from pfn as runs of consecutive pages with the same access, written to
+ * runs.  Pages without a mapping are left out.  Returns the number of runs
+ * written, and updates pfn and nr to the pages not reported yet: nr is
+ * non-zero if runs filled up or the hypervisor needed to preempt, in which
+ * case the op is to be issued again.
+ */
+#define XENMEM_access_op_get_access_range   5
 
 typedef enum {
     XENMEM_access_n,
@@ -438,6 +475,15 @@ typedef enum {
     XENMEM_access_default
 } xenmem_access_t;
 
+struct xen_mem_access_run {
+    uint64_aligned_t pfn;       /* First pfn of the run */
+    uint32_t nr;                /* Number of pages */
+    uint8_t access;             /* xenmem_access_t */
+    uint8_t pad[3];
+};
+typedef struct xen_mem_access_run xen_mem_access_run_t;
+DEFINE_XEN_GUEST_HANDLE(xen_mem_access_run_t);
+
 struct xen_mem_access_op {
     /* XENMEM_access_op_* */
     uint8_t op;
@@ -445,13 +491,13 @@ struct xen_mem_access_op {
     uint8_t access;
     domid_t domid;
     /*
-     * Number of pages for set op (or size of pfn_list for
+     * Number of pages for set and get range ops (or size of pfn_list for
      * XENMEM_access_op_set_access_multi)
      * Ignored on setting default access and other ops
      */
     uint32_t nr;
     /*
-     * First pfn for set op
+     * First pfn for set and get range ops
      * pfn for get op
      * ~0ull is used to set and get the default access for pages
      */
@@ -466,6 +512,12 @@ struct xen_mem_access_op {
      * Used only with XENMEM_access_op_set_access_multi
      */
     XEN_GUEST_HANDLE(const_uint8) access_list;
+    /*
+     * Room for nr_runs runs of pages
+     * Used only with XENMEM_access_op_get_access_range
+     */
+    XEN_GUEST_HANDLE(xen_mem_access_run_t) runs;
+    uint32_t nr_runs;
 };
 typedef struct xen_mem_access_op xen_mem_access_op_t;
 DEFINE_XEN_GUEST_HANDLE(xen_mem_access_op_t);
@@ -480,6 +532,9 @@ DEFINE_XEN_GUEST_HANDLE(xen_mem_access_op_t);
 #define XENMEM_sharing_op_add_physmap       6
 #define XENMEM_sharing_op_audit             7
 #define XENMEM_sharing_op_range_share       8
+#define XENMEM_sharing_op_range_fork        9
+#define XENMEM_sharing_op_nominate_batch    10
+#define XENMEM_sharing_op_share_batch       11
 
 #define XENMEM_SHARING_OP_S_HANDLE_INVALID  (-10)
 #define XENMEM_SHARING_OP_C_HANDLE_INVALID  (-9)
@@ -497,6 +552,28 @@ DEFINE_XEN_GUEST_HANDLE(xen_mem_access_op_t);
 #define XENMEM_SHARING_OP_FIELD_GET_GREF(field)        \
     ((field) & (~XENMEM_SHARING_OP_FIELD_IS_GREF_FLAG))
 
+/*
+ * An entry of XENMEM_sharing_op_{nominate,share}_batch.  nominate_batch
+ * nominates both gfns and returns their handles; share_batch shares the
+ * client gfn with the source gfn, as XENMEM_sharing_op_share does.  The
+ * source is in the domain of the op.  Entries fail independently.
+ *
+ * A handle of 0 given to share_batch makes it nominate that gfn first, so
+ * a caller which already knows the contents match can share a list of
+ * (source_gfn, client_gfn) pairs in one op.
+ */
+struct xen_mem_sharing_batch_entry {
+    uint64_aligned_t source_gfn;    /* IN: the gfn of the source page */
+    uint64_aligned_t source_handle; /* IN (share) / OUT (nominate) */
+    uint64_aligned_t client_gfn;    /* IN: the client gfn */
+    uint64_aligned_t client_handle; /* IN (share) / OUT (nominate) */
+    domid_t  client_domain;         /* IN: the client domain id */
+    uint16_t _pad;                  /* Must be set to 0 */
+    int32_t  rc;                    /* OUT: 0 or -errno for this entry */
+};
+typedef struct xen_mem_sharing_batch_entry xen_mem_sharing_batch_entry_t;
+DEFINE_XEN_GUEST_HANDLE(xen_mem_sharing_batch_entry_t);
+
 struct xen_mem_sharing_op {
     uint8_t     op;     /* XENMEM_sharing_op_* */
     domid_t     domain;
@@ -516,13 +593,18 @@ struct xen_mem_sharing_op {
             uint64_aligned_t client_handle; /* IN: handle to the client page */
             domid_t  client_domain; /* IN: the client domain id */
         } share;
-        struct mem_sharing_op_range {         /* OP_RANGE_SHARE */
+        struct mem_sharing_op_range {         /* OP_RANGE_{SHARE,FORK} */
             uint64_aligned_t first_gfn;      /* IN: the first gfn */
             uint64_aligned_t last_gfn;       /* IN: the last gfn */
             uint64_aligned_t opaque;         /* Must be set to 0 */
             domid_t client_domain;           /* IN: the client domain id */
             uint16_t _pad[3];                /* Must be set to 0 */
         } range;
+        struct mem_sharing_op_batch {         /* OP_{NOMINATE,SHARE}_BATCH */
+            XEN_GUEST_HANDLE_64(xen_mem_sharing_batch_entry_t) entries;
+            uint32_t nr;                     /* IN: number of entries */
+            uint32_t done;                   /* Must be set to 0 */
+        } batch;
         struct mem_sharing_op_debug {     /* OP_DEBUG_xxx */
             union {
                 uint64_aligned_t gfn;      /* IN: gfn to debug          */
@@ -544,6 +626,11 @@ DEFINE_XEN_GUEST_HANDLE(xen_mem_sharing_op_t);
  * allocator has atomically and successfully claimed the requested
  * number of pages, else non-zero.
  *
+ * The claim may be restricted to a single NUMA node, in which case it
+ * must also fit in that node's unclaimed free memory and, while it is
+ * outstanding, others cannot allocate that node's claimed memory.  Pages
+ * the domain gets from any node still count towards resolving it.
+ *
  * Any domain may have only one active claim.  When sufficient memory
  * has been allocated to resolve the claim, the claim silently expires.
  * Claiming zero pages effectively resets any outstanding claim and
@@ -559,8 +646,9 @@ DEFINE_XEN_GUEST_HANDLE(xen_mem_sharing_op_t);
 #define XENMEM_claim_pages                  24
 
 /*
- * XENMEM_claim_pages flags - the are no flags at this time.
- * The zero value is appropriate.
+ * XENMEM_claim_pages flags:
+ *  0 claims memory from any node;
+ *  XENMEMF_exact_node(n) claims memory from node n only.
  */
 
 /*
@@ -648,7 +736,31 @@ struct xen_vnuma_topology_info {
 typedef struct xen_vnuma_topology_info xen_vnuma_topology_info_t;
 DEFINE_XEN_GUEST_HANDLE(xen_vnuma_topology_info_t);
 
-/* Next available subop number is 28 */
+/*
+ * Give back the pages in [@first_gfn, @first_gfn + @nr_pages) of the
+ * specified domain, without having to list them: the range is split into
+ * the largest naturally aligned extents the caller is allowed to use, and
+ * those mapped by a single large page are freed in one step.  Processing
+ * stops at the first page which cannot be freed.
+ * Returns the number of pages freed, i.e. the part of the range successfully
+ * dealt with, or a negative error code for invalid arguments.
+ * arg == addr of struct xen_reservation_range.
+ */
+#define XENMEM_decrease_reservation_range   28
+struct xen_reservation_range {
+    uint64_t first_gfn;
+    uint64_t nr_pages;
+    /*
+     * Domain whose reservation is being changed.
+     * Unprivileged domains can specify only DOMID_SELF.
+     */
+    domid_t domid;
+    uint16_t pad[3];          /* Must be zero. */
+};
+typedef struct xen_reservation_range xen_reservation_range_t;
+DEFINE_XEN_GUEST_HANDLE(xen_reservation_range_t);
+
+/* Next available subop number is 29 */
 
 #endif /* __XEN_PUBLIC_MEMORY_H__ */
 
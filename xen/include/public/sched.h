@@ -130,6 +130,16 @@
  * to be part of the domain's cpupool.
  */
 #define SCHEDOP_pin_override 7
+
+/*
+ * Yield the calling vcpu's physical cpu, in favour of another vcpu, e.g.
+ * one just notified of a request this vcpu will wait for the answer to.
+ * If the target vcpu is waiting for a physical cpu in the same cpupool,
+ * the scheduler may hand it part of the caller's time slice, so that it
+ * runs ahead of other waiting vcpus.  Otherwise this is SCHEDOP_yield.
+ * @arg == pointer to sched_yield_to_t structure.
+ */
+#define SCHEDOP_yield_to    8
 /* ` } */
 
 struct sched_shutdown {
@@ -166,6 +176,14 @@ struct sched_pin_override {
 typedef struct sched_pin_override sched_pin_override_t;
 DEFINE_XEN_GUEST_HANDLE(sched_pin_override_t);
 
+struct sched_yield_to {
+    domid_t domain_id;          /* Domain of the vcpu, or DOMID_SELF */
+    uint16_t pad;               /* Must be zero */
+    uint32_t vcpu_id;
+};
+typedef struct sched_yield_to sched_yield_to_t;
+DEFINE_XEN_GUEST_HANDLE(sched_yield_to_t);
+
 /*
  * Reason codes for SCHEDOP_shutdown. These may be interpreted by control
  * software to determine the appropriate action. For the most part, Xen does
@@ -36,7 +36,7 @@
 #include "physdev.h"
 #include "tmem.h"
 
-#define XEN_SYSCTL_INTERFACE_VERSION 0x0000000F
+#define XEN_SYSCTL_INTERFACE_VERSION 0x00000010
 
 /*
  * Read console content from Xen buffer ring.
@@ -57,6 +57,11 @@ struct xen_sysctl_readconsole {
     XEN_GUEST_HANDLE_64(char) buffer;
     /* IN: Size of buffer; OUT: Bytes written to buffer. */
     uint32_t count;
+    /*
+     * OUT: Bytes overwritten before they could be read, if @incremental
+     * and @index was older than the oldest byte still in the ring.
+     */
+    uint32_t lost;
 };
 typedef struct xen_sysctl_readconsole xen_sysctl_readconsole_t;
 DEFINE_XEN_GUEST_HANDLE(xen_sysctl_readconsole_t);
@@ -128,6 +133,14 @@ DEFINE_XEN_GUEST_HANDLE(xen_sysctl_sched_id_t);
 /* Sub-operations: */
 #define XEN_SYSCTL_PERFCOP_reset 1   /* Reset all counters to zero. */
 #define XEN_SYSCTL_PERFCOP_query 2   /* Get perfctr information. */
+/*
+ * Get the values of the domain-scoped counters: desc receives the
+ * nr_counters names, and val, whose size in entries nr_vals holds on input,
+ * a row per domain of its ID followed by the nr_counters values.  On
+ * return nr_vals is the number of entries written, or needed with a NULL
+ * val.
+ */
+#define XEN_SYSCTL_PERFCOP_query_dom 3
 struct xen_sysctl_perfc_desc {
     char         name[80];             /* name of perf counter */
     uint32_t     nr_vals;              /* number of values for this counter */
@@ -142,7 +155,7 @@ struct xen_sysctl_perfc_op {
     uint32_t       cmd;                /*  XEN_SYSCTL_PERFCOP_??? */
     /* OUT variables. */
     uint32_t       nr_counters;       /*  number of counters description  */
-    uint32_t       nr_vals;           /*  number of values  */
+    uint32_t       nr_vals;           /*  number of values (IN for query_dom) */
     /* counter information (or NULL) */
     XEN_GUEST_HANDLE_64(xen_sysctl_perfc_desc_t) desc;
     /* counter values (or NULL) */
@@ -239,6 +252,14 @@ struct pm_cx_stat {
      */
     XEN_GUEST_HANDLE_64(uint64) pc;
     XEN_GUEST_HANDLE_64(uint64) cc;
+    /*
+     * Idle governor accuracy: the predicted and the measured residencies
+     * (us) summed over all idle periods, and how many periods ended before
+     * the target residency of the (deep) C-state which was picked.
+     */
+    uint64_aligned_t predicted_us;
+    uint64_aligned_t measured_us;
+    uint64_aligned_t early;
 };
 
 struct xen_sysctl_get_pmstat {
@@ -636,6 +657,17 @@ struct xen_sysctl_credit_schedule {
 #define XEN_SYSCTL_CSCHED_TSLICE_MIN 1
     unsigned tslice_ms;
     unsigned ratelimit_us;
+    /*
+     * OUT: load balancing statistics, summed over the pCPUs of the pool.
+     * The steal_* fields count successful steals by the distance of the
+     * runqueue the vCPU was taken from.
+     */
+    uint64_aligned_t balance;      /* work stealing attempts */
+    uint64_aligned_t probes;       /* peer runqueues locked */
+    uint64_aligned_t limited;      /* attempts stopped by the probe limit */
+    uint64_aligned_t steal_llc;    /* ...from a pCPU sharing our cache */
+    uint64_aligned_t steal_node;   /* ...from elsewhere in our node */
+    uint64_aligned_t steal_remote; /* ...from another node */
 };
 typedef struct xen_sysctl_credit_schedule xen_sysctl_credit_schedule_t;
 DEFINE_XEN_GUEST_HANDLE(xen_sysctl_credit_schedule_t);
@@ -646,6 +678,27 @@ struct xen_sysctl_credit2_schedule {
 typedef struct xen_sysctl_credit2_schedule xen_sysctl_credit2_schedule_t;
 DEFINE_XEN_GUEST_HANDLE(xen_sysctl_credit2_schedule_t);
 
+/*
+ * Null scheduler: one entry per pCPU (indexed by pCPU id), saying which
+ * vCPU is assigned to it (domid is DOMID_INVALID for free pCPUs, and for
+ * pCPUs not in the cpupool). Only XEN_SYSCTL_SCHEDOP_getinfo is valid.
+ */
+struct xen_sysctl_null_assignment {
+    domid_t  domid;
+    uint16_t pad;
+    uint32_t vcpu_id;
+};
+typedef struct xen_sysctl_null_assignment xen_sysctl_null_assignment_t;
+DEFINE_XEN_GUEST_HANDLE(xen_sysctl_null_assignment_t);
+
+struct xen_sysctl_sched_null {
+    /* IN: entries in assignment; OUT: entries needed for all pCPUs. */
+    uint32_t nr_cpus;
+    uint32_t pad;
+    XEN_GUEST_HANDLE_64(xen_sysctl_null_assignment_t) assignment;
+};
+typedef struct xen_sysctl_sched_null xen_sysctl_sched_null_t;
+
 /* XEN_SYSCTL_scheduler_op */
 /* Set or get info? */
 #define XEN_SYSCTL_SCHEDOP_putinfo 0
@@ -660,6 +713,7 @@ struct xen_sysctl_scheduler_op {
         } sched_arinc653;
         struct xen_sysctl_credit_schedule sched_credit;
         struct xen_sysctl_credit2_schedule sched_credit2;
+        struct xen_sysctl_sched_null sched_null;
     } u;
 };
 typedef struct xen_sysctl_scheduler_op xen_sysctl_scheduler_op_t;
@@ -744,6 +798,7 @@ typedef struct xen_sysctl_pcitopoinfo xen_sysctl_pcitopoinfo_t;
 DEFINE_XEN_GUEST_HANDLE(xen_sysctl_pcitopoinfo_t);
 
 #define XEN_SYSCTL_PSR_CAT_get_l3_info               0
+#define XEN_SYSCTL_PSR_CAT_get_mba_info              1
 struct xen_sysctl_psr_cat_op {
     uint32_t cmd;       /* IN: XEN_SYSCTL_PSR_CAT_* */
     uint32_t target;    /* IN */
@@ -754,6 +809,13 @@ struct xen_sysctl_psr_cat_op {
 #define XEN_SYSCTL_PSR_CAT_L3_CDP       (1u << 0)
             uint32_t flags;     /* OUT: CAT flags */
         } l3_info;
+        struct {
+            uint32_t thrtl_max; /* OUT: Maximum throttling delay, in % */
+            uint32_t cos_max;   /* OUT: Maximum COS */
+/* Linear throttling: thrtl_max in steps of 100 - thrtl_max, else powers of 2 */
+#define XEN_SYSCTL_PSR_MBA_LINEAR       (1u << 0)
+            uint32_t flags;     /* OUT: MBA flags */
+        } mba_info;
     } u;
 };
 typedef struct xen_sysctl_psr_cat_op xen_sysctl_psr_cat_op_t;
@@ -1007,6 +1069,8 @@ struct xen_livepatch_status {
 #define LIVEPATCH_STATE_APPLIED      2
     uint32_t state;                /* OUT: LIVEPATCH_STATE_*. */
     int32_t rc;                    /* OUT: 0 if no error, otherwise -XEN_EXX. */
+    uint32_t stop_us;              /* OUT: how long the last action held
+                                      the CPUs, in microseconds. */
 };
 typedef struct xen_livepatch_status xen_livepatch_status_t;
 DEFINE_XEN_GUEST_HANDLE(xen_livepatch_status_t);
@@ -1095,6 +1159,283 @@ struct xen_sysctl_livepatch_op {
 typedef struct xen_sysctl_livepatch_op xen_sysctl_livepatch_op_t;
 DEFINE_XEN_GUEST_HANDLE(xen_sysctl_livepatch_op_t);
 
+/*
+ * XEN_SYSCTL_evtchn_stats
+ *
+ * Get the event channel delivery statistics of a domain, which are only
+ * maintained when Xen is booted with "evtchn_stats" (-EOPNOTSUPP
+ * otherwise).  Domain totals cover all ports ever used by the domain;
+ * per-port counters are returned for up to <nr_ports> ports in use,
+ * starting at <first_port>, and are reset when a port is closed.
+ * Counters are approximate and wrap.
+ */
+struct xen_sysctl_evtchn_port_stats {
+    uint32_t port;
+    uint32_t sent;          /* Notifications raised on the port. */
+    uint32_t coalesced;     /* ... of which found it already pending. */
+    uint32_t link_retries;  /* FIFO ABI: queue link attempts retried. */
+};
+typedef struct xen_sysctl_evtchn_port_stats xen_sysctl_evtchn_port_stats_t;
+DEFINE_XEN_GUEST_HANDLE(xen_sysctl_evtchn_port_stats_t);
+
+struct xen_sysctl_evtchn_stats {
+    domid_t  domid;                 /* IN */
+    uint16_t pad;                   /* IN: Must be zero. */
+    uint32_t first_port;            /* IN */
+    uint32_t nr_ports;              /* IN: Number of <ports> elements.
+                                       OUT: Number filled in. */
+    uint32_t pad2;                  /* IN: Must be zero. */
+    uint64_aligned_t sent;          /* OUT: Domain totals. */
+    uint64_aligned_t coalesced;
+    uint64_aligned_t link_retries;
+    XEN_GUEST_HANDLE_64(xen_sysctl_evtchn_port_stats_t) ports; /* OUT */
+};
+typedef struct xen_sysctl_evtchn_stats xen_sysctl_evtchn_stats_t;
+DEFINE_XEN_GUEST_HANDLE(xen_sysctl_evtchn_stats_t);
+
+/*
+ * XEN_SYSCTL_irq_stats (x86)
+ *
+ * Get the interrupt delivery statistics of an HVM domain, summed over its
+ * vCPUs (-EINVAL for other domains).  Exits for interrupts routed to a
+ * guest are counted on VMX only: with posted interrupts they are limited
+ * to vectors which could not be posted.  The apic_*_exits count the local
+ * APIC register accesses, and the EOIs, which were emulated rather than
+ * virtualized by hardware.  Counters are approximate.
+ */
+struct xen_sysctl_irq_stats {
+    domid_t  domid;                     /* IN */
+    uint16_t pad[3];                    /* IN: Must be zero. */
+    uint64_aligned_t extint_exits;      /* OUT: VM exits for an interrupt. */
+    uint64_aligned_t guest_irq_exits;   /* OUT: ... of which for one routed
+                                                to a guest. */
+    uint64_aligned_t pi_wakeups;        /* OUT: vCPUs woken by a posted
+                                                interrupt. */
+    uint64_aligned_t apic_icr_exits;    /* OUT: IPIs sent through ICR. */
+    uint64_aligned_t apic_eoi_exits;    /* OUT: EOIs. */
+    uint64_aligned_t apic_tpr_exits;    /* OUT: TPR accesses. */
+    uint64_aligned_t apic_timer_exits;  /* OUT: Timer register and TSC
+                                                deadline accesses. */
+    uint64_aligned_t apic_other_exits;  /* OUT: Any other register. */
+};
+typedef struct xen_sysctl_irq_stats xen_sysctl_irq_stats_t;
+DEFINE_XEN_GUEST_HANDLE(xen_sysctl_irq_stats_t);
+
+/*
+ * XEN_SYSCTL_hypercall_stats (x86)
+ *
+ * Get or reset the hypercall statistics, which are only collected when Xen
+ * is booted with "hypercall_stats" (-EOPNOTSUPP otherwise).  There is one
+ * entry per calling domain, hypercall and sub-op.  The sub-op is the command
+ * of hypercalls multiplexing several operations, capped at 0xffff, and 0 for
+ * the others.  A preempted hypercall counts once per continuation.  Calls
+ * which found no room in Xen's tables are only counted in <dropped>.
+ * Counters are approximate.
+ */
+#define XEN_SYSCTL_HCALL_STATS_query  0
+#define XEN_SYSCTL_HCALL_STATS_reset  1
+/* Bucket 0 counts runs below 1us, bucket n below 2^n us, the last 1ms+. */
+#define XEN_SYSCTL_HCALL_STATS_BUCKETS 12
+struct xen_sysctl_hypercall_stats_entry {
+    domid_t  domid;                 /* Calling domain. */
+    uint16_t op;                    /* __HYPERVISOR_* */
+    uint32_t subop;
+    uint64_aligned_t calls;         /* Invocations. */
+    uint64_aligned_t continuations; /* ... of which got preempted. */
+    uint64_aligned_t total_ns;      /* Time spent in the hypercall. */
+    uint64_aligned_t max_ns;        /* Longest invocation. */
+    uint32_t histo[XEN_SYSCTL_HCALL_STATS_BUCKETS];
+};
+typedef struct xen_sysctl_hypercall_stats_entry
+    xen_sysctl_hypercall_stats_entry_t;
+DEFINE_XEN_GUEST_HANDLE(xen_sysctl_hypercall_stats_entry_t);
+
+struct xen_sysctl_hypercall_stats {
+    uint32_t cmd;                   /* IN: XEN_SYSCTL_HCALL_STATS_* */
+    uint32_t nr_entries;            /* IN: Number of <entries> elements.
+                                       OUT: Number of entries available. */
+    uint64_aligned_t dropped;       /* OUT */
+    XEN_GUEST_HANDLE_64(xen_sysctl_hypercall_stats_entry_t) entries; /* OUT */
+};
+typedef struct xen_sysctl_hypercall_stats xen_sysctl_hypercall_stats_t;
+DEFINE_XEN_GUEST_HANDLE(xen_sysctl_hypercall_stats_t);
+
+/*
+ * XEN_SYSCTL_latency_stats
+ *
+ * Get or reset the latency statistics, which are only collected when Xen is
+ * booted with "latency_stats" (-EOPNOTSUPP otherwise).  There is one entry
+ * per domain, kind and reason:
+ *  - exit: from a VM exit to the next VM entry of the same vCPU on the same
+ *    pCPU, by exit reason (VMX only).  Exits after which the vCPU got
+ *    descheduled only count in <events>.
+ *  - runq: how long a preempted vCPU waited to run again.
+ *  - wake: how long a vCPU took from being woken up to running.
+ * Events which found no room in Xen's tables are only counted in <dropped>.
+ * Counters are approximate.
+ */
+#define XEN_SYSCTL_LATENCY_STATS_query  0
+#define XEN_SYSCTL_LATENCY_STATS_reset  1
+#define XEN_SYSCTL_LATENCY_STATS_exit   0
+#define XEN_SYSCTL_LATENCY_STATS_runq   1
+#define XEN_SYSCTL_LATENCY_STATS_wake   2
+/* Bucket 0 counts latencies below 1us, bucket n below 2^n us, the last 1ms+. */
+#define XEN_SYSCTL_LATENCY_STATS_BUCKETS 12
+struct xen_sysctl_latency_stats_entry {
+    domid_t  domid;
+    uint16_t kind;                  /* XEN_SYSCTL_LATENCY_STATS_{exit,...} */
+    uint32_t reason;                /* Exit reason, 0 for the others. */
+    uint64_aligned_t events;
+    uint64_aligned_t timed;         /* ... of which were timed. */
+    uint64_aligned_t total_ns;
+    uint64_aligned_t max_ns;
+    uint32_t histo[XEN_SYSCTL_LATENCY_STATS_BUCKETS];
+};
+typedef struct xen_sysctl_latency_stats_entry
+    xen_sysctl_latency_stats_entry_t;
+DEFINE_XEN_GUEST_HANDLE(xen_sysctl_latency_stats_entry_t);
+
+struct xen_sysctl_latency_stats {
+    uint32_t cmd;                   /* IN: XEN_SYSCTL_LATENCY_STATS_* */
+    uint32_t nr_entries;            /* IN: Number of <entries> elements.
+                                       OUT: Number of entries available. */
+    uint64_aligned_t dropped;       /* OUT */
+    XEN_GUEST_HANDLE_64(xen_sysctl_latency_stats_entry_t) entries; /* OUT */
+};
+typedef struct xen_sysctl_latency_stats xen_sysctl_latency_stats_t;
+DEFINE_XEN_GUEST_HANDLE(xen_sysctl_latency_stats_t);
+
+/*
+ * XEN_SYSCTL_vcpu_runstate
+ *
+ * Get the runstate information of the vCPUs of all domains from
+ * <first_domain> on, in domid order, as many domains as fit into <entries>
+ * without splitting one.  Should not even the first fit, -ENOBUFS is
+ * returned, with <nr_entries> set to the number needed.  Domains the caller
+ * may not get information about are skipped.  <next_domain> is where to
+ * continue from, DOMID_FIRST_RESERVED once all domains were covered.
+ */
+struct xen_sysctl_vcpu_runstate_entry {
+    domid_t  domid;
+    uint16_t vcpu;
+    uint32_t state;                 /* RUNSTATE_* */
+    uint64_aligned_t state_entry_time;
+    uint64_aligned_t time[4];       /* Nanoseconds spent in each RUNSTATE_* */
+};
+typedef struct xen_sysctl_vcpu_runstate_entry
+    xen_sysctl_vcpu_runstate_entry_t;
+DEFINE_XEN_GUEST_HANDLE(xen_sysctl_vcpu_runstate_entry_t);
+
+struct xen_sysctl_vcpu_runstate {
+    domid_t  first_domain;          /* IN */
+    domid_t  next_domain;           /* OUT */
+    uint32_t nr_entries;            /* IN: Number of <entries> elements.
+                                       OUT: Number of entries filled in. */
+    XEN_GUEST_HANDLE_64(xen_sysctl_vcpu_runstate_entry_t) entries; /* OUT */
+};
+typedef struct xen_sysctl_vcpu_runstate xen_sysctl_vcpu_runstate_t;
+DEFINE_XEN_GUEST_HANDLE(xen_sysctl_vcpu_runstate_t);
+
+/*
+ * XEN_SYSCTL_heap_chunks
+ *
+ * Get the number of free chunks of each order (i.e. of 2^order pages) in
+ * the heap of <node>.  Up to <nr_orders> are copied into <chunks>, and
+ * <nr_orders> is set to the number of orders there are.  Pages held in
+ * per-CPU free page caches are not counted.
+ */
+struct xen_sysctl_heap_chunks {
+    uint32_t node;                  /* IN */
+    uint32_t nr_orders;             /* IN/OUT */
+    XEN_GUEST_HANDLE_64(uint64) chunks; /* OUT */
+};
+typedef struct xen_sysctl_heap_chunks xen_sysctl_heap_chunks_t;
+DEFINE_XEN_GUEST_HANDLE(xen_sysctl_heap_chunks_t);
+
+/*
+ * XEN_SYSCTL_compact_op (x86)
+ *
+ * Control background memory compaction, which moves memory of HVM guests
+ * out of the way to assemble free chunks of <order> (9 for 2M, up to 18
+ * for 1G) on nodes running short of them.  The counters are cumulative.
+ */
+#define XEN_SYSCTL_COMPACT_get          0
+#define XEN_SYSCTL_COMPACT_set          1
+struct xen_sysctl_compact_op {
+    uint32_t cmd;                   /* IN: XEN_SYSCTL_COMPACT_* */
+    uint32_t enable;                /* IN (set) / OUT (get) */
+    uint32_t order;                 /* IN (set) / OUT (get) */
+    uint32_t pad;
+    uint64_aligned_t moved;         /* OUT (get): Pages moved. */
+    uint64_aligned_t assembled;     /* OUT (get): Chunks assembled. */
+    uint64_aligned_t abandoned;     /* OUT (get): Chunks given up on. */
+};
+typedef struct xen_sysctl_compact_op xen_sysctl_compact_op_t;
+DEFINE_XEN_GUEST_HANDLE(xen_sysctl_compact_op_t);
+
+/*
+ * XEN_SYSCTL_lock_sample
+ *
+ * Get or reset the sampled lock statistics, and get or set the sampling
+ * rate.  When Xen is built without CONFIG_LOCK_SAMPLE, -EOPNOTSUPP is
+ * returned.  With a rate of N, one in N spinlock acquisitions on each pCPU
+ * is timed, and 0 stops sampling.  There is one entry per call site of
+ * spin_lock() and its variants; trylocks are not sampled.  Samples which
+ * found no room in Xen's tables are only counted in <dropped>.  Counters
+ * are approximate.
+ */
+#define XEN_SYSCTL_LOCK_SAMPLE_query     0
+#define XEN_SYSCTL_LOCK_SAMPLE_reset     1
+#define XEN_SYSCTL_LOCK_SAMPLE_set_rate  2
+/* Bucket 0 counts times below 128ns, bucket n below 2^n * 128ns. */
+#define XEN_SYSCTL_LOCK_SAMPLE_BUCKETS 12
+struct xen_sysctl_lock_sample_entry {
+    uint64_aligned_t site;          /* Address of the call. */
+    uint64_aligned_t lock;          /* Last lock sampled there. */
+    char name[48];                  /* Symbol of the call, e.g. "f+0x12". */
+    uint64_aligned_t samples;
+    uint64_aligned_t contended;     /* ... of which had to wait. */
+    uint64_aligned_t wait_ns;       /* Total time spent waiting. */
+    uint64_aligned_t wait_max_ns;
+    uint64_aligned_t hold_ns;       /* Total time the lock was held. */
+    uint64_aligned_t hold_max_ns;
+    uint32_t wait_histo[XEN_SYSCTL_LOCK_SAMPLE_BUCKETS];
+    uint32_t hold_histo[XEN_SYSCTL_LOCK_SAMPLE_BUCKETS];
+};
+typedef struct xen_sysctl_lock_sample_entry xen_sysctl_lock_sample_entry_t;
+DEFINE_XEN_GUEST_HANDLE(xen_sysctl_lock_sample_entry_t);
+
+struct xen_sysctl_lock_sample {
+    uint32_t cmd;                   /* IN: XEN_SYSCTL_LOCK_SAMPLE_* */
+    uint32_t rate;                  /* IN (set_rate), OUT (others) */
+    uint32_t nr_entries;            /* IN: Number of <entries> elements.
+                                       OUT: Number of entries available. */
+    uint32_t pad;
+    uint64_aligned_t dropped;       /* OUT */
+    XEN_GUEST_HANDLE_64(xen_sysctl_lock_sample_entry_t) entries; /* OUT */
+};
+typedef struct xen_sysctl_lock_sample xen_sysctl_lock_sample_t;
+DEFINE_XEN_GUEST_HANDLE(xen_sysctl_lock_sample_t);
+
+/*
+ * XEN_SYSCTL_conring_op
+ *
+ * Get the size and indexes of the console ring, or resize it.  The size is
+ * rounded up to a power of two number of pages.  When shrinking, the oldest
+ * contents are dropped.  Indexes are those of XEN_SYSCTL_readconsole, and
+ * VIRQ_CON_RING is sent when the producer index moves.
+ */
+#define XEN_SYSCTL_CONRING_get_info  0
+#define XEN_SYSCTL_CONRING_set_size  1
+struct xen_sysctl_conring_op {
+    uint32_t cmd;                   /* IN: XEN_SYSCTL_CONRING_* */
+    uint32_t size;                  /* IN (set_size), OUT: Bytes. */
+    uint32_t producer;              /* OUT: Index of the next byte. */
+    uint32_t consumer;              /* OUT: Index of the oldest byte. */
+};
+typedef struct xen_sysctl_conring_op xen_sysctl_conring_op_t;
+DEFINE_XEN_GUEST_HANDLE(xen_sysctl_conring_op_t);
+
 struct xen_sysctl {
     uint32_t cmd;
 #define XEN_SYSCTL_readconsole                    1
@@ -1123,6 +1464,15 @@ struct xen_sysctl {
 #define XEN_SYSCTL_get_cpu_levelling_caps        25
 #define XEN_SYSCTL_get_cpu_featureset            26
 #define XEN_SYSCTL_livepatch_op                  27
+#define XEN_SYSCTL_evtchn_stats                  28
+#define XEN_SYSCTL_irq_stats                     29
+#define XEN_SYSCTL_hypercall_stats               30
+#define XEN_SYSCTL_latency_stats                 31
+#define XEN_SYSCTL_vcpu_runstate                 32
+#define XEN_SYSCTL_heap_chunks                   33
+#define XEN_SYSCTL_compact_op                    34
+#define XEN_SYSCTL_lock_sample                   35
+#define XEN_SYSCTL_conring_op                    36
     uint32_t interface_version; /* XEN_SYSCTL_INTERFACE_VERSION */
     union {
         struct xen_sysctl_readconsole       readconsole;
@@ -1151,6 +1501,15 @@ struct xen_sysctl {
         struct xen_sysctl_cpu_levelling_caps cpu_levelling_caps;
         struct xen_sysctl_cpu_featureset    cpu_featureset;
         struct xen_sysctl_livepatch_op      livepatch;
+        struct xen_sysctl_evtchn_stats      evtchn_stats;
+        struct xen_sysctl_irq_stats         irq_stats;
+        struct xen_sysctl_hypercall_stats   hypercall_stats;
+        struct xen_sysctl_latency_stats     latency_stats;
+        struct xen_sysctl_vcpu_runstate     vcpu_runstate;
+        struct xen_sysctl_heap_chunks       heap_chunks;
+        struct xen_sysctl_compact_op        compact_op;
+        struct xen_sysctl_lock_sample       lock_sample;
+        struct xen_sysctl_conring_op        conring_op;
         uint8_t                             pad[128];
     } u;
 };
@@ -145,6 +145,7 @@
 #define TRC_PV_PTWR_EMULATION_PAE    (TRC_PV_ENTRY + 12)
 #define TRC_PV_HYPERCALL_V2          (TRC_PV_ENTRY + 13)
 #define TRC_PV_HYPERCALL_SUBCALL     (TRC_PV_SUBCALL + 14)
+#define TRC_PV_MULTICALL             (TRC_PV_SUBCALL + 15)
 
 /*
  * TRC_PV_HYPERCALL_V2 format
@@ -271,6 +272,9 @@
 #define TRC_HW_IRQ_ASSIGN_VECTOR      (TRC_HW_IRQ + 0x6)
 #define TRC_HW_IRQ_UNMAPPED_VECTOR    (TRC_HW_IRQ + 0x7)
 #define TRC_HW_IRQ_HANDLED            (TRC_HW_IRQ + 0x8)
+#define TRC_HW_IRQ_GUEST_REMOTE       (TRC_HW_IRQ + 0x9)
+#define TRC_HW_IRQ_SOFTIRQ_SLOW       (TRC_HW_IRQ + 0xa)
+#define TRC_HW_IRQ_TASKLET_SLOW       (TRC_HW_IRQ + 0xb)
 
 /*
  * Event Flags
@@ -12,6 +12,8 @@
 
 struct xen_sysctl_readconsole;
 long read_console_ring(struct xen_sysctl_readconsole *op);
+struct xen_sysctl_conring_op;
+long console_ring_op(struct xen_sysctl_conring_op *op);
 
 void console_init_preirq(void);
 void console_init_ring(void);
@@ -95,5 +95,8 @@ extern void cpuidle_wakeup_mwait(cpumask_t *mask);
 #define CPUIDLE_DRIVER_STATE_START  1
 
 extern void menu_get_trace_data(u32 *expected, u32 *pred);
+void menu_get_residency_stats(unsigned int cpu, uint64_t *predicted_us,
+                              uint64_t *measured_us, uint64_t *early);
+void menu_reset_residency_stats(unsigned int cpu);
 
 #endif /* _XEN_CPUIDLE_H */
@@ -45,6 +45,12 @@ void send_guest_pirq(struct domain *, const struct pirq *);
 /* Send a notification from a given domain's event-channel port. */
 int evtchn_send(struct domain *d, unsigned int lport);
 
+/*
+ * Notify a VCPU of newly pending events.  Deferred until the end of the
+ * batch, and done once per VCPU, during EVTCHNOP_send_multi.
+ */
+void evtchn_mark_events_pending(struct vcpu *v);
+
 /* Bind a local event-channel port to the specified VCPU. */
 long evtchn_bind_vcpu(unsigned int port, unsigned int vcpu_id);
 
@@ -129,6 +135,9 @@ void evtchn_2l_init(struct domain *d);
 /* Close all event channels and reset to 2-level ABI. */
 int evtchn_reset(struct domain *d);
 
+int evtchn_set_default_priority(
+    struct domain *d, const struct xen_domctl_set_evtchn_priority *prio);
+
 /*
  * Low-level event channel port ops.
  */
@@ -155,10 +164,28 @@ static inline void evtchn_port_init(struct domain *d, struct evtchn *evtchn)
         d->evtchn_port_ops->init(d, evtchn);
 }
 
+/*
+ * Delivery statistics ("evtchn_stats" command line option).  Updates are
+ * not atomic, so counts are approximate under contention.
+ */
+extern bool_t evtchn_stats;
+
+#define evtchn_stat_inc(d, chn, what) do {      \
+    if ( unlikely(evtchn_stats) )               \
+    {                                           \
+        (chn)->nr_##what++;                     \
+        (d)->evtchn_nr_##what++;                \
+    }                                           \
+} while ( 0 )
+
+struct xen_sysctl_evtchn_stats;
+int evtchn_get_stats(struct xen_sysctl_evtchn_stats *op);
+
 static inline void evtchn_port_set_pending(struct domain *d,
                                            unsigned int vcpu_id,
                                            struct evtchn *evtchn)
 {
+    evtchn_stat_inc(d, evtchn, sent);
     d->evtchn_port_ops->set_pending(d->vcpu[vcpu_id], evtchn);
 }
 
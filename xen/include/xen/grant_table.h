@@ -78,7 +78,9 @@ struct grant_table {
     /* Mapping tracking table per vcpu. */
     struct grant_mapping **maptrack;
     unsigned int          maptrack_limit;
-    /* Lock protecting the maptrack page list, head, and limit */
+    /* Free maptrack entries not handed out to any VCPU yet. */
+    unsigned int          maptrack_pool;
+    /* Lock protecting the maptrack page list, pool, head, and limit */
     spinlock_t            maptrack_lock;
     /* The defined versions are 1 and 2.  Set to 0 if we don't know
        what version to use yet. */
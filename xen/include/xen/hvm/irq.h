@@ -64,6 +64,7 @@ struct hvm_gmsi_info {
     uint32_t gflags;
     int dest_vcpu_id; /* -1 :multi-dest, non-negative: dest_vcpu_id */
     bool posted; /* directly deliver to guest via VT-d PI? */
+    s_time_t last_move; /* last affinity change following dest_vcpu_id */
 };
 
 struct hvm_girq_dpci_mapping {
@@ -111,6 +112,10 @@ int pt_pirq_iterate(struct domain *d,
                     void *arg);
 
 bool_t pt_pirq_softirq_active(struct hvm_pirq_dpci *);
+struct irq_desc;
+bool pt_pirq_follow_vcpu(struct hvm_pirq_dpci *, struct irq_desc *,
+                         unsigned int cpu);
+
 /* Modify state of a PCI INTx wire. */
 void hvm_pci_intx_assert(
     struct domain *d, unsigned int device, unsigned int intx);
@@ -0,0 +1,49 @@
+#ifndef __XEN_LATENCY_STATS_H__
+#define __XEN_LATENCY_STATS_H__
+
+#include <xen/compiler.h>
+#include <xen/types.h>
+#include <public/sysctl.h>
+
+/*
+ * Latency statistics, collected with "latency_stats": per-domain histograms
+ * of VM exit handling, runqueue wait and wakeup-to-run latencies.
+ */
+#define LATENCY_STATS_EXIT  (1u << XEN_SYSCTL_LATENCY_STATS_exit)
+#define LATENCY_STATS_RUNQ  (1u << XEN_SYSCTL_LATENCY_STATS_runq)
+#define LATENCY_STATS_WAKE  (1u << XEN_SYSCTL_LATENCY_STATS_wake)
+
+extern unsigned int opt_latency_stats;
+
+struct vcpu;
+
+/* Account an event of @kind to @v's domain; @ns < 0 only counts it. */
+void latency_stats_record(const struct vcpu *v, unsigned int kind,
+                          uint32_t reason, s_time_t ns);
+
+/* Time a VM exit, from the exit until the vCPU re-enters the guest. */
+void _latency_stats_exit_begin(uint32_t reason);
+void _latency_stats_exit_end(const struct vcpu *v, bool timed);
+
+static inline void latency_stats_exit_begin(uint32_t reason)
+{
+    if ( unlikely(opt_latency_stats & LATENCY_STATS_EXIT) )
+        _latency_stats_exit_begin(reason);
+}
+
+static inline void latency_stats_exit_end(const struct vcpu *v)
+{
+    if ( unlikely(opt_latency_stats & LATENCY_STATS_EXIT) )
+        _latency_stats_exit_end(v, true);
+}
+
+/* @v is being descheduled: the time until it runs again isn't the exit's. */
+static inline void latency_stats_exit_cancel(const struct vcpu *v)
+{
+    if ( unlikely(opt_latency_stats & LATENCY_STATS_EXIT) )
+        _latency_stats_exit_end(v, false);
+}
+
+int latency_stats_op(struct xen_sysctl_latency_stats *op);
+
+#endif /* __XEN_LATENCY_STATS_H__ */
@@ -157,7 +157,8 @@ int populate_pt_range(unsigned long virt, unsigned long mfn,
                       unsigned long nr_mfns);
 /* Claim handling */
 unsigned long domain_adjust_tot_pages(struct domain *d, long pages);
-int domain_set_outstanding_pages(struct domain *d, unsigned long pages);
+int domain_set_outstanding_pages(struct domain *d, unsigned long pages,
+                                 unsigned int node);
 void get_outstanding_claims(uint64_t *free_pages, uint64_t *outstanding_pages);
 
 /* Domain suballocator. These functions are *not* interrupt-safe.*/
@@ -169,12 +170,16 @@ unsigned long avail_domheap_pages_region(
     unsigned int node, unsigned int min_width, unsigned int max_width);
 unsigned long avail_domheap_pages(void);
 unsigned long avail_node_heap_pages(unsigned int);
+unsigned int avail_node_heap_chunks(unsigned int node, unsigned long *chunks,
+                                    unsigned int nr);
+void page_cache_drain_local(void);
 #define alloc_domheap_page(d,f) (alloc_domheap_pages(d,0,f))
 #define free_domheap_page(p)  (free_domheap_pages(p,0))
 unsigned int online_page(unsigned long mfn, uint32_t *status);
 int offline_page(unsigned long mfn, int broken, uint32_t *status);
 int query_page_offline(unsigned long mfn, uint32_t *status);
 unsigned long total_free_pages(void);
+bool_t scrub_free_pages(void);
 
 void scrub_heap_pages(void);
 
@@ -543,6 +548,9 @@ static inline unsigned int get_order_from_pages(unsigned long nr_pages)
 
 void scrub_one_page(struct page_info *);
 
+/* Free unowned, unreferenced single pages in one batch. */
+void free_domheap_page_list(struct page_list_head *list);
+
 #ifndef arch_free_heap_page
 #define arch_free_heap_page(d, pg)                      \
     page_list_del(pg, is_xen_heap_page(pg) ?            \
@@ -569,6 +577,12 @@ int page_is_ram_type(unsigned long mfn, unsigned long mem_type);
 int prepare_ring_for_helper(struct domain *d, unsigned long gmfn,
                             struct page_info **_page, void **_va);
 void destroy_ring_for_helper(void **_va, struct page_info *page);
+/* The same for a ring spanning nr contiguous guest frames. */
+int prepare_rings_for_helper(struct domain *d, unsigned long gmfn,
+                             unsigned int nr, struct page_info **pages,
+                             void **_va);
+void destroy_rings_for_helper(void **_va, struct page_info **pages,
+                              unsigned int nr);
 
 #include <asm/flushtlb.h>
 
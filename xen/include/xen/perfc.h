@@ -6,6 +6,7 @@
 #include <xen/lib.h>
 #include <xen/smp.h>
 #include <xen/percpu.h>
+#include <xen/softirq.h>
 
 /*
  * NOTE: new counters must be defined in perfc_defn.h
@@ -17,6 +18,9 @@
  * Unlike counters, status variables do not reset:
  * PERFSTATUS (counter, string)               define a new performance stauts
  * PERFSTATUS_ARRAY (counter, string, size)   define an array of status vars
+ *
+ * Domain-scoped counters are additionally accounted to the current domain:
+ * PERFCOUNTER_DOM (counter, string)          define a domain-scoped counter
  * 
  * unsigned long perfc_value  (counter)        get value of a counter  
  * unsigned long perfc_valuea (counter, index) get value of an array counter
@@ -27,6 +31,7 @@
  * void perfc_incra (counter, index)           increment an array counter   
  * void perfc_add   (counter, value)           add a value to a counter     
  * void perfc_adda  (counter, index, value)    add a value to array counter 
+ * void perfc_incr_dom (counter, domain)       increment a domain-scoped counter
  * void perfc_print (counter)                  print out the counter
  */
 
@@ -38,6 +43,7 @@
 
 #define PERFSTATUS       PERFCOUNTER
 #define PERFSTATUS_ARRAY PERFCOUNTER_ARRAY
+#define PERFCOUNTER_DOM  PERFCOUNTER
 
 enum perfcounter {
 #include <xen/perfc_defn.h>
@@ -48,6 +54,25 @@ enum perfcounter {
 #undef PERFCOUNTER_ARRAY
 #undef PERFSTATUS
 #undef PERFSTATUS_ARRAY
+#undef PERFCOUNTER_DOM
+
+#define PERFCOUNTER( name, descr )
+#define PERFCOUNTER_ARRAY( name, descr, size )
+#define PERFSTATUS( name, descr )
+#define PERFSTATUS_ARRAY( name, descr, size )
+#define PERFCOUNTER_DOM( name, descr ) \
+  PERFC_DOM_##name,
+
+enum perfc_dom_counter {
+#include <xen/perfc_defn.h>
+	NUM_PERFC_DOM_COUNTERS
+};
+
+#undef PERFCOUNTER
+#undef PERFCOUNTER_ARRAY
+#undef PERFSTATUS
+#undef PERFSTATUS_ARRAY
+#undef PERFCOUNTER_DOM
 
 typedef unsigned perfc_t;
 #define PRIperfc ""
@@ -72,6 +97,21 @@ DECLARE_PER_CPU(perfc_t[NUM_PERFCOUNTERS], perfcounters);
     ( (y) <= PERFC_LAST_ ## x - PERFC_ ## x ?                           \
 	 this_cpu(perfcounters)[PERFC_ ## x + (y)] = (v) : (v) )
 
+/*
+ * Only one in every perfc_dom_sample_mask + 1 events of a CPU gets
+ * accounted to a domain, for that many.  The per-domain values are not
+ * updated atomically, and hence approximate when several vCPUs of a domain
+ * hit the same counter at once.
+ */
+extern unsigned int perfc_dom_sample_mask;
+
+#define perfc_incr_dom(x,d)                                             \
+    do {                                                                \
+        if ( !(++this_cpu(perfcounters)[PERFC_ ## x] &                  \
+               perfc_dom_sample_mask) && (d)->perfc )                   \
+            (d)->perfc[PERFC_DOM_ ## x] += perfc_dom_sample_mask + 1;   \
+    } while ( 0 )
+
 /*
  * Histogram: special treatment for 0 and 1 count. After that equally spaced 
  * with last bucket taking the rest.
@@ -89,13 +129,30 @@ DECLARE_PER_CPU(perfc_t[NUM_PERFCOUNTERS], perfcounters);
         else                                                            \
             perfc_incra(x, PERFC_LAST_ ## x - PERFC_ ## x);             \
     } while ( 0 )
+
+/*
+ * Run time histograms: PERFC_TIME_HISTO_BUCKETS counters for each of the
+ * (y) instances of (x).  Bucket 0 counts runs shorter than 1us, bucket n
+ * those shorter than 2^n us, and the last one those of 1ms or more.  The
+ * microseconds are approximated as 1024ns.
+ */
+#define perfc_incr_time_histo(x,y,ns)                                   \
+    perfc_incra(x, (y) * PERFC_TIME_HISTO_BUCKETS +                     \
+                ((ns) < (1 << (PERFC_TIME_HISTO_BUCKETS + 8)) ?         \
+                 fls((unsigned int)((ns) >> 10)) :                      \
+                 PERFC_TIME_HISTO_BUCKETS - 1))
 #else
 #define perfc_incr_histo(x,v) ((void)0)
+#define perfc_incr_time_histo(x,y,ns) ((void)0)
 #endif
 
 struct xen_sysctl_perfc_op;
 int perfc_control(struct xen_sysctl_perfc_op *);
 
+struct domain;
+int perfc_domain_init(struct domain *d);
+void perfc_domain_destroy(struct domain *d);
+
 extern void perfc_printall(unsigned char key);
 extern void perfc_reset(unsigned char key);
 
@@ -113,6 +170,11 @@ extern void perfc_reset(unsigned char key);
 #define perfc_add(x,y)    ((void)0)
 #define perfc_adda(x,y,z) ((void)0)
 #define perfc_incr_histo(x,y,z) ((void)0)
+#define perfc_incr_time_histo(x,y,ns) ((void)0)
+#define perfc_incr_dom(x,d) ((void)0)
+
+#define perfc_domain_init(d) 0
+#define perfc_domain_destroy(d) ((void)0)
 
 #endif /* CONFIG_PERF_COUNTERS */
 
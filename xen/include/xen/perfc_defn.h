@@ -12,6 +12,13 @@ PERFCOUNTER(calls_from_multicall,       "calls from multicall")
 PERFCOUNTER(irqs,                   "#interrupts")
 PERFCOUNTER(ipis,                   "#IPIs")
 
+/* Keep in sync with TIME_HISTO_BUCKETS in tools/misc/xenperf.c. */
+#define PERFC_TIME_HISTO_BUCKETS 12
+PERFCOUNTER_ARRAY(softirq_time,     "softirq run times",
+                  NR_SOFTIRQS * PERFC_TIME_HISTO_BUCKETS)
+PERFCOUNTER_ARRAY(tasklet_time,     "tasklet run times",
+                  2 * PERFC_TIME_HISTO_BUCKETS)
+
 /* Generic scheduler counters (applicable to all schedulers) */
 PERFCOUNTER(sched_irq,              "sched: timer")
 PERFCOUNTER(sched_run,              "sched: runs through scheduler")
@@ -50,14 +50,22 @@ static inline int radix_tree_is_indirect_ptr(void *ptr)
  *** However all fields are absolutely private.
  */
 
+/*
+ * Each node holds 2^shift slots, RADIX_TREE_MAP_SHIFT unless chosen
+ * otherwise for the tree (see radix_tree_init_fanout()). Wider nodes make
+ * for shallower trees and longer runs of slots scanned by batched lookups,
+ * at the expense of memory for sparse trees.
+ */
 #define RADIX_TREE_MAP_SHIFT	6
+#define RADIX_TREE_MIN_MAP_SHIFT	4
+#define RADIX_TREE_MAX_MAP_SHIFT	8
 #define RADIX_TREE_MAP_SIZE	(1UL << RADIX_TREE_MAP_SHIFT)
 #define RADIX_TREE_MAP_MASK	(RADIX_TREE_MAP_SIZE-1)
 
 struct radix_tree_node {
 	unsigned int	height;		/* Height from the bottom */
 	unsigned int	count;
-	void __rcu	*slots[RADIX_TREE_MAP_SIZE];
+	void __rcu	*slots[];	/* 2^root->shift of them */
 };
 
 typedef struct radix_tree_node *radix_tree_alloc_fn_t(void *);
@@ -65,6 +73,7 @@ typedef void radix_tree_free_fn_t(struct radix_tree_node *, void *);
 
 struct radix_tree_root {
 	unsigned int		height;
+	unsigned int		shift;	/* log2 of the slots per node */
 	struct radix_tree_node	__rcu *rnode;
 
 	/* Allow to specify custom node alloc/dealloc routines. */
@@ -78,6 +87,7 @@ struct radix_tree_root {
  */
 
 void radix_tree_init(struct radix_tree_root *root);
+void radix_tree_init_fanout(struct radix_tree_root *root, unsigned int shift);
 void radix_tree_set_alloc_callbacks(
 	struct radix_tree_root *root,
 	radix_tree_alloc_fn_t *node_alloc,
@@ -88,6 +98,15 @@ void radix_tree_destroy(
 	struct radix_tree_root *root,
 	void (*slot_free)(void *));
 
+/*
+ * Size of the nodes of @root, for custom node allocators: a node must be
+ * at the end of the structure it is embedded in, if any.
+ */
+static inline size_t radix_tree_node_size(const struct radix_tree_root *root)
+{
+	return sizeof(struct radix_tree_node) + (sizeof(void *) << root->shift);
+}
+
 /**
  * Radix-tree synchronization
  *
@@ -108,6 +127,7 @@ void radix_tree_destroy(
  * radix_tree_lookup_slot
  * radix_tree_gang_lookup
  * radix_tree_gang_lookup_slot
+ * radix_tree_next_batch
  *
  * The first 7 functions are able to be called locklessly, using RCU. The
  * caller must ensure calls to these functions are made within rcu_read_lock()
@@ -200,6 +220,31 @@ radix_tree_gang_lookup(struct radix_tree_root *root, void **results,
 unsigned int
 radix_tree_gang_lookup_slot(struct radix_tree_root *root, void ***results,
 			unsigned long first_index, unsigned int max_items);
+
+/**
+ * struct radix_tree_iter - state of a batched walk over a range of indices
+ *
+ * Set up with radix_tree_iter_init(), then passed to radix_tree_next_batch()
+ * until that returns 0.
+ */
+struct radix_tree_iter {
+	unsigned long	index;		/* Where the next batch starts */
+	unsigned long	last;		/* Last index of the range */
+	bool_t		done;
+};
+
+static inline void radix_tree_iter_init(struct radix_tree_iter *iter,
+					unsigned long first, unsigned long last)
+{
+	iter->index = first;
+	iter->last = last;
+	iter->done = first > last;
+}
+
+unsigned int
+radix_tree_next_batch(struct radix_tree_root *root, struct radix_tree_iter *iter,
+			void **results, unsigned long *indices,
+			unsigned int max_items);
 unsigned long radix_tree_next_hole(struct radix_tree_root *root,
 				unsigned long index, unsigned long max_scan);
 unsigned long radix_tree_prev_hole(struct radix_tree_root *root,
@@ -59,6 +59,9 @@ struct rcu_head {
 int rcu_pending(int cpu);
 int rcu_needs_cpu(int cpu);
 
+void rcu_idle_enter(unsigned int cpu);
+void rcu_idle_exit(unsigned int cpu);
+
 /*
  * Dummy lock type for passing to rcu_read_{lock,unlock}. Currently exists
  * only to document the reason for rcu_read_lock() critical sections.
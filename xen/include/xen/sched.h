@@ -112,6 +112,10 @@ struct evtchn
     u8 priority;
     u8 last_priority;
     u16 last_vcpu_id;
+    /* Delivery statistics, only maintained with "evtchn_stats". */
+    u32 nr_sent;           /* notifications raised */
+    u32 nr_coalesced;      /* ... finding the port already pending */
+    u32 nr_link_retries;   /* FIFO queue link attempts retried */
 #ifdef CONFIG_XSM
     union {
 #ifdef XSM_NEED_GENERIC_EVTCHN_SSID
@@ -209,7 +213,8 @@ struct vcpu
     /* A hypercall is using the compat ABI? */
     bool             hcall_compat;
 #endif
-
+    /* Runnable after blocking, rather than after being preempted? */
+    bool             latency_woken;
 
     /*
      * > 0: a single port is being polled;
@@ -275,12 +280,13 @@ struct vm_event_domain
 {
     /* ring lock */
     spinlock_t ring_lock;
-    /* The ring has 64 entries */
-    unsigned char foreign_producers;
-    unsigned char target_producers;
-    /* shared ring page */
+    /* Reservations held by producers, up to the size of the ring */
+    unsigned int foreign_producers;
+    unsigned int target_producers;
+    /* shared ring pages, mapped contiguously */
     void *ring_page;
-    struct page_info *ring_pg_struct;
+    struct page_info **ring_pg_struct;
+    unsigned int ring_nr_pages;
     /* front-end ring */
     vm_event_front_ring_t front_ring;
     /* event channel port (vcpu0 only) */
@@ -328,6 +334,8 @@ struct domain
     unsigned int     tot_pages;       /* number of pages currently possesed */
     unsigned int     xenheap_pages;   /* # pages allocated from Xen heap    */
     unsigned int     outstanding_pages; /* pages claimed but not possessed  */
+    unsigned int     claim_node;      /* node claimed on, or NUMA_NO_NODE   */
+    unsigned int     teardown_pages;  /* tot_pages when domain_kill() began */
     unsigned int     max_pages;       /* maximum value for tot_pages        */
     atomic_t         shr_pages;       /* number of shared pages             */
     atomic_t         paged_pages;     /* number of paged-out pages          */
@@ -335,6 +343,8 @@ struct domain
     /* Scheduling. */
     void            *sched_priv;    /* scheduler-specific data */
     struct cpupool  *cpupool;
+    /* Max C-state exit latency (us) after running here, 0 if unlimited. */
+    unsigned int     idle_latency_us;
 
     struct domain   *next_in_list;
     struct domain   *next_in_hashbucket;
@@ -348,9 +358,18 @@ struct domain
     unsigned int     max_evtchns;     /* number supported by ABI */
     unsigned int     max_evtchn_port; /* max permitted port number */
     unsigned int     valid_evtchns;   /* number of allocated event channels */
+    unsigned long   *evtchn_inuse;    /* ports known not to be free */
+    unsigned int     evtchn_inuse_size; /* bits in evtchn_inuse */
+    unsigned int     evtchn_port_hint; /* lowest port possibly free */
+    /* Default FIFO priorities, see XEN_DOMCTL_set_evtchn_priority. */
+    uint8_t          evtchn_priority[XEN_DOMCTL_EVTCHN_CLASS_NR];
     spinlock_t       event_lock;
     const struct evtchn_port_ops *evtchn_port_ops;
     struct evtchn_fifo_domain *evtchn_fifo;
+    /* Totals of the per-port statistics in struct evtchn. */
+    uint64_t         evtchn_nr_sent;
+    uint64_t         evtchn_nr_coalesced;
+    uint64_t         evtchn_nr_link_retries;
 
     struct grant_table *grant_table;
 
@@ -463,6 +482,11 @@ struct domain
 
     struct lock_profile_qhead profile_head;
 
+#ifdef CONFIG_PERF_COUNTERS
+    /* Values of the domain-scoped performance counters. */
+    perfc_t *perfc;
+#endif
+
     /* Various vm_events */
     struct vm_event_per_domain *vm_event;
 
@@ -653,6 +677,7 @@ void sched_tick_suspend(void);
 void sched_tick_resume(void);
 void vcpu_wake(struct vcpu *v);
 long vcpu_yield(void);
+long vcpu_yield_to(struct vcpu *target);
 void vcpu_sleep_nosync(struct vcpu *v);
 void vcpu_sleep_sync(struct vcpu *v);
 
@@ -840,6 +865,14 @@ int vcpu_pin_override(struct vcpu *v, int cpu);
 void vcpu_runstate_get(struct vcpu *v, struct vcpu_runstate_info *runstate);
 uint64_t get_cpu_idle_time(unsigned int cpu);
 
+/* Scheduler utilization feed for the schedutil cpufreq governor. */
+#ifdef CONFIG_HAS_CPUFREQ
+void cpufreq_sched_update(unsigned int cpu, s_time_t now, bool_t busy);
+#else
+static inline void cpufreq_sched_update(unsigned int cpu, s_time_t now,
+                                        bool_t busy) {}
+#endif
+
 /*
  * Used by idle loop to decide whether there is work to do:
  *  (1) Run softirqs; or (2) Play dead; or (3) Run tasklets.
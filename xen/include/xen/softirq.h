@@ -14,6 +14,7 @@ enum {
 #include <xen/lib.h>
 #include <xen/smp.h>
 #include <xen/bitops.h>
+#include <xen/time.h>
 #include <asm/current.h>
 #include <asm/hardirq.h>
 #include <asm/softirq.h>
@@ -33,6 +34,13 @@ void raise_softirq(unsigned int nr);
 void cpu_raise_softirq_batch_begin(void);
 void cpu_raise_softirq_batch_finish(void);
 
+/*
+ * Whether softirq and tasklet run times get measured, and whether one
+ * took long enough to be traced.
+ */
+bool softirq_timing(void);
+bool softirq_slow(s_time_t runtime);
+
 /*
  * Process pending softirqs on this CPU. This should be called periodically
  * when performing work that prevents softirqs from running in a timely manner.
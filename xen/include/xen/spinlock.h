@@ -137,8 +137,26 @@ typedef union {
 
 #define SPINLOCK_TICKET_INC { .head_tail = 0x10000, }
 
+/*
+ * Queued spinlock: the owner sets 'locked', and 'tail' identifies the last
+ * waiter in the MCS queue (CPU + 1 and per-CPU node index), or is 0 if there
+ * aren't any.
+ */
+typedef union {
+    u32 val;
+    struct {
+        u8 locked;
+        u8 pad;
+        u16 tail;
+    };
+} spinlock_queued_t;
+
 typedef struct spinlock {
+#ifdef CONFIG_QUEUED_SPINLOCKS
+    spinlock_queued_t q;
+#else
     spinlock_tickets_t tickets;
+#endif
     u16 recurse_cpu:12;
 #define SPINLOCK_NO_CPU 0xfffu
     u16 recurse_cnt:4;
@@ -168,6 +186,9 @@ int _spin_trylock_recursive(spinlock_t *lock);
 void _spin_lock_recursive(spinlock_t *lock);
 void _spin_unlock_recursive(spinlock_t *lock);
 
+struct xen_sysctl_lock_sample;
+int spinlock_sample_op(struct xen_sysctl_lock_sample *op);
+
 #define spin_lock(l)                  _spin_lock(l)
 #define spin_lock_irq(l)              _spin_lock_irq(l)
 #define spin_lock_irqsave(l, f)                                 \
@@ -287,6 +287,7 @@ struct client {
     xen_tmem_client_t info;
     /* For save/restore/migration. */
     bool_t was_frozen;
+    spinlock_t inv_lists_lock; /* Protects the two below. */
     struct list_head persistent_invalidated_list;
     struct tmem_page_descriptor *cur_pgp;
     /* Statistics collection. */
@@ -318,6 +319,7 @@ struct tmem_pool {
     struct list_head share_list; /* Valid if shared. */
     int shared_count; /* Valid if shared. */
     /* For save/restore/migration. */
+    spinlock_t pers_lists_lock; /* Protects the two below. */
     struct list_head persistent_page_list;
     struct tmem_page_descriptor *cur_pgp;
     /* Statistics collection. */
@@ -618,6 +618,13 @@ static int flask_domctl(struct domain *d, int cmd)
     case XEN_DOMCTL_destroydomain:
         return current_has_perm(d, SECCLASS_DOMAIN, DOMAIN__DESTROY);
 
+    case XEN_DOMCTL_get_destroy_progress:
+    case XEN_DOMCTL_pause_loop_stats:
+        return current_has_perm(d, SECCLASS_DOMAIN, DOMAIN__GETDOMAININFO);
+
+    case XEN_DOMCTL_set_idle_latency:
+        return current_has_perm(d, SECCLASS_DOMAIN2, DOMAIN2__SETSCHEDULER);
+
     case XEN_DOMCTL_pausedomain:
         return current_has_perm(d, SECCLASS_DOMAIN, DOMAIN__PAUSE);
 
@@ -626,6 +633,8 @@ static int flask_domctl(struct domain *d, int cmd)
 
     case XEN_DOMCTL_setvcpuaffinity:
     case XEN_DOMCTL_setnodeaffinity:
+    case XEN_DOMCTL_rehome_memory:
+    case XEN_DOMCTL_numa_balancing:
         return current_has_perm(d, SECCLASS_DOMAIN, DOMAIN__SETAFFINITY);
 
     case XEN_DOMCTL_getvcpuaffinity:
@@ -732,6 +741,7 @@ static int flask_domctl(struct domain *d, int cmd)
         return current_has_perm(d, SECCLASS_HVM, HVM__AUDIT_P2M);
 
     case XEN_DOMCTL_set_max_evtchn:
+    case XEN_DOMCTL_set_evtchn_priority:
         return current_has_perm(d, SECCLASS_DOMAIN2, DOMAIN2__SET_MAX_EVTCHN);
 
     case XEN_DOMCTL_cacheflush:
@@ -759,7 +769,9 @@ static int flask_sysctl(int cmd)
     {
     /* These have individual XSM hooks */
     case XEN_SYSCTL_readconsole:
+    case XEN_SYSCTL_conring_op:
     case XEN_SYSCTL_getdomaininfolist:
+    case XEN_SYSCTL_vcpu_runstate:
     case XEN_SYSCTL_page_offline_op:
     case XEN_SYSCTL_scheduler_op:
 #ifdef CONFIG_X86
@@ -774,6 +786,11 @@ static int flask_sysctl(int cmd)
         return domain_has_xen(current->domain, XEN__GETSCHEDULER);
 
     case XEN_SYSCTL_perfc_op:
+    case XEN_SYSCTL_evtchn_stats:
+    case XEN_SYSCTL_irq_stats:
+    case XEN_SYSCTL_hypercall_stats:
+    case XEN_SYSCTL_latency_stats:
+    case XEN_SYSCTL_lock_sample:
         return domain_has_xen(current->domain, XEN__PERFCONTROL);
 
     case XEN_SYSCTL_debug_keys:
@@ -783,6 +800,10 @@ static int flask_sysctl(int cmd)
         return domain_has_xen(current->domain, XEN__GETCPUINFO);
 
     case XEN_SYSCTL_availheap:
+    case XEN_SYSCTL_heap_chunks:
+#ifdef CONFIG_X86
+    case XEN_SYSCTL_compact_op:
+#endif
         return domain_has_xen(current->domain, XEN__HEAP);
 
     case XEN_SYSCTL_get_pmstat:
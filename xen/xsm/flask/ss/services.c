@@ -55,11 +55,17 @@
 
 unsigned int policydb_loaded_version;
 
-static DEFINE_RWLOCK(policy_rwlock);
-#define POLICY_RDLOCK read_lock(&policy_rwlock)
-#define POLICY_WRLOCK write_lock(&policy_rwlock)
-#define POLICY_RDUNLOCK read_unlock(&policy_rwlock)
-#define POLICY_WRUNLOCK write_unlock(&policy_rwlock)
+/*
+ * The policy is read on every AVC miss but only written when a policy or
+ * boolean is loaded, so readers use a per-CPU rwlock and never write to
+ * the shared lock.
+ */
+static DEFINE_PERCPU_RWLOCK_GLOBAL(policy_percpu_rwlock);
+static DEFINE_PERCPU_RWLOCK_RESOURCE(policy_rwlock, policy_percpu_rwlock);
+#define POLICY_RDLOCK percpu_read_lock(policy_percpu_rwlock, &policy_rwlock)
+#define POLICY_WRLOCK percpu_write_lock(policy_percpu_rwlock, &policy_rwlock)
+#define POLICY_RDUNLOCK percpu_read_unlock(policy_percpu_rwlock, &policy_rwlock)
+#define POLICY_WRUNLOCK percpu_write_unlock(policy_percpu_rwlock, &policy_rwlock)
 
 static DEFINE_SPINLOCK(load_sem);
 #define LOAD_LOCK spin_lock(&load_sem)